@@ -23,6 +23,7 @@
 #include <seastar/http/handlers.hh>
 #include <seastar/http/function_handlers.hh>
 #include <seastar/http/file_handler.hh>
+#include <seastar/http/exception.hh>
 #include <seastar/core/seastar.hh>
 #include <seastar/core/reactor.hh>
 #include "demo.json.hh"
@@ -32,6 +33,7 @@
 #include <seastar/core/print.hh>
 #include <seastar/net/inet_address.hh>
 #include "../lib/stop_signal.hh"
+#include <boost/iterator/counting_iterator.hpp>
 
 namespace bpo = boost::program_options;
 
@@ -48,6 +50,92 @@ class handl : public httpd::handler_base {
     }
 };
 
+static unsigned query_param(const request& req, const sstring& name, unsigned def, unsigned max) {
+    auto v = req.get_query_param(name);
+    if (v.empty()) {
+        return def;
+    }
+    try {
+        return std::min<unsigned>(std::stoul(v), max);
+    } catch (...) {
+        throw bad_param_exception(format("{} must be a number", name));
+    }
+}
+
+// Sends ?chunks= chunks of ?size= bytes, flushing each, so the reply goes
+// out with chunked transfer encoding
+class stream_handler : public httpd::handler_base {
+public:
+    virtual future<std::unique_ptr<reply>> handle(const sstring& path,
+            std::unique_ptr<request> req, std::unique_ptr<reply> rep) override {
+        auto chunks = query_param(*req, "chunks", 16, 1 << 20);
+        auto size = query_param(*req, "size", 4096, 1 << 20);
+        rep->write_body("txt", [chunks, size] (output_stream<char>&& os) {
+            return do_with(std::move(os), sstring(size, 'x'), [chunks] (output_stream<char>& os, const sstring& chunk) {
+                return do_for_each(boost::counting_iterator<unsigned>(0), boost::counting_iterator<unsigned>(chunks), [&os, &chunk] (unsigned) {
+                    return os.write(chunk).then([&os] {
+                        return os.flush();
+                    });
+                }).finally([&os] {
+                    return os.close();
+                });
+            });
+        });
+        return make_ready_future<std::unique_ptr<reply>>(std::move(rep));
+    }
+};
+
+// Reads the body as it arrives, and replies with its length
+class upload_handler : public httpd::handler_base {
+public:
+    upload_handler() {
+        stream_content();
+    }
+
+    virtual future<std::unique_ptr<reply>> handle(const sstring& path,
+            std::unique_ptr<request> req, std::unique_ptr<reply> rep) override {
+        auto& in = *req->content_stream;
+        return do_with(size_t(0), [&in] (size_t& received) {
+            return repeat([&in, &received] {
+                return in.read().then([&received] (temporary_buffer<char> buf) {
+                    received += buf.size();
+                    return buf.empty() ? stop_iteration::yes : stop_iteration::no;
+                });
+            }).then([&received] {
+                return received;
+            });
+        }).then([req = std::move(req), rep = std::move(rep)] (size_t received) mutable {
+            rep->write_body("txt", to_sstring(received));
+            return make_ready_future<std::unique_ptr<reply>>(std::move(rep));
+        });
+    }
+};
+
+// Routes under /bench, to measure the server with seawreck et al.:
+//   GET /bench/plaintext            a fixed short text
+//   GET /bench/json?n=N             N objects serialized to JSON
+//   GET /bench/static/<path>        the files of static_dir
+//   GET /bench/stream?chunks=&size= a chunked body
+//   POST /bench/upload              reads the body, replies with its size
+void set_bench_routes(routes& r, sstring static_dir) {
+    r.add(operation_type::GET, url("/bench/plaintext"), new function_handler([] (const_req req) {
+        return "Hello, World!";
+    }, "txt"));
+    r.add(operation_type::GET, url("/bench/json"), new function_handler([] (const_req req) {
+        auto n = query_param(req, "n", 1, 100000);
+        std::vector<demo_json::my_object> objs(n);
+        for (unsigned i = 0; i < n; i++) {
+            objs[i].var1 = to_sstring(i);
+            objs[i].var2 = "bench";
+            objs[i].enum_var = demo_json::my_object::my_object_enum_var::VAL1;
+        }
+        return json::json_return_type(objs);
+    }));
+    r.add(operation_type::GET, url("/bench/static").remainder("path"), new directory_handler(static_dir));
+    r.add(operation_type::GET, url("/bench/stream"), new stream_handler());
+    r.add(operation_type::POST, url("/bench/upload"), new upload_handler());
+}
+
 void set_routes(routes& r) {
     function_handler* h1 = new function_handler([](const_req req) {
         return "hello";
@@ -79,6 +167,7 @@ int main(int ac, char** av) {
     app.add_options()("prometheus_port", bpo::value<uint16_t>()->default_value(9180), "Prometheus port. Set to zero in order to disable.");
     app.add_options()("prometheus_address", bpo::value<sstring>()->default_value("0.0.0.0"), "Prometheus address");
     app.add_options()("prometheus_prefix", bpo::value<sstring>()->default_value("seastar_httpd"), "Prometheus metrics prefix");
+    app.add_options()("static_dir", bpo::value<sstring>()->default_value("."), "Directory from which /bench/static serves files");
 
     return app.run_deprecated(ac, av, [&] {
         return seastar::async([&] {
@@ -110,6 +199,7 @@ int main(int ac, char** av) {
             auto rb = make_shared<api_registry_builder>("apps/httpd/");
             server->start().get();
             server->set_routes(set_routes).get();
+            server->set_routes([static_dir = config["static_dir"].as<sstring>()] (routes& r) { set_bench_routes(r, static_dir); }).get();
             server->set_routes([rb](routes& r){rb->set_api_doc(r);}).get();
             server->set_routes([rb](routes& r) {rb->register_function(r, "demo", "hello world application");}).get();
             server->listen(port).get();
@@ -33,6 +33,8 @@
 #include <seastar/core/with_scheduling_group.hh>
 #include <seastar/core/metrics_api.hh>
 #include <seastar/core/io_intent.hh>
+#include <seastar/core/gate.hh>
+#include <seastar/core/semaphore.hh>
 #include <seastar/util/later.hh>
 #include <chrono>
 #include <vector>
@@ -47,7 +49,9 @@
 #include <boost/accumulators/statistics/extended_p_square_quantile.hpp>
 #include <boost/range/adaptor/filtered.hpp>
 #include <boost/range/adaptor/map.hpp>
+#include <boost/range/algorithm/count_if.hpp>
 #include <boost/array.hpp>
+#include <fstream>
 #include <iomanip>
 #include <random>
 #include <yaml-cpp/yaml.h>
@@ -60,7 +64,7 @@ static auto random_seed = std::chrono::duration_cast<std::chrono::microseconds>(
 static std::default_random_engine random_generator(random_seed);
 
 class context;
-enum class request_type { seqread, seqwrite, randread, randwrite, append, cpu };
+enum class request_type { seqread, seqwrite, randread, randwrite, append, cpu, replay };
 
 namespace std {
 
@@ -160,6 +164,38 @@ class shard_config {
     bool is_set(unsigned cpu) const {
         return _shards.count(cpu);
     }
+
+    unsigned size() const {
+        return _shards.size();
+    }
+
+    // The position of cpu among the shards of the set, in increasing order
+    unsigned index_of(unsigned cpu) const {
+        return boost::count_if(_shards, [cpu] (unsigned s) { return s < cpu; });
+    }
+};
+
+// One request of a recorded block trace, issued at the given time since
+// the first request of the trace
+struct trace_record {
+    std::chrono::duration<double> at;
+    bool write;
+    uint64_t offset;
+    uint64_t size;
+};
+
+using trace = std::vector<trace_record>;
+
+enum class trace_ops { all, reads, writes };
+
+struct trace_config {
+    std::string file;
+    // How much faster than recorded the trace is replayed; 0 issues the
+    // requests as fast as they can be
+    double speed = 1.0;
+    trace_ops ops = trace_ops::all;
+    // Loaded by main() and shared, read-only, by the shards
+    std::shared_ptr<const ::trace> records;
 };
 
 struct shard_info {
@@ -171,6 +207,8 @@ struct shard_info {
     std::chrono::duration<float> think_time = 0ms;
     std::chrono::duration<float> think_after = 0ms;
     std::chrono::duration<float> execution_time = 1ms;
+    // Requests slower than this violate the latency objective; 0 for none
+    std::chrono::duration<float> latency_slo = 0ms;
     seastar::scheduling_group scheduling_group = seastar::default_scheduling_group();
 };
 
@@ -193,11 +231,20 @@ struct job_config {
     // of the disk's cache
     uint64_t file_size;
     uint64_t offset_in_bdev;
+    ::trace_config trace;
     std::unique_ptr<class_data> gen_class_data();
 };
 
 std::array<double, 4> quantiles = { 0.5, 0.95, 0.99, 0.999};
 static bool keep_files = false;
+static bool json_output = false;
+
+// JSON has no comments
+static void emit_comment(YAML::Emitter& out, const char* comment) {
+    if (!json_output) {
+        out << YAML::Comment(comment);
+    }
+}
 
 class class_data {
 protected:
@@ -217,6 +264,17 @@ class class_data {
     std::chrono::steady_clock::time_point _start = {};
     accumulator_type _latencies;
     uint64_t _requests = 0;
+    uint64_t _slo_violations = 0;
+
+    // The requests completed in each second of the evaluation
+    struct interval {
+        accumulator_type latencies;
+        uint64_t requests = 0;
+        uint64_t slo_violations = 0;
+
+        interval() : latencies(extended_p_square_probabilities = quantiles) {}
+    };
+    std::vector<interval> _timeline;
     std::uniform_int_distribution<uint32_t> _pos_distribution;
     file _file;
     bool _think = false;
@@ -225,6 +283,14 @@ class class_data {
 
     virtual future<> do_start(sstring dir, directory_entry_type type) = 0;
     virtual future<size_t> issue_request(char *buf, io_intent* intent) = 0;
+
+    virtual future<> do_issue_requests(std::chrono::steady_clock::time_point stop) {
+        if (rps() == 0) {
+            return issue_requests_in_parallel(stop, parallelism());
+        } else {
+            return issue_requests_at_rate(stop, rps(), parallelism());
+        }
+    }
 public:
     class_data(job_config cfg)
         : _config(std::move(cfg))
@@ -323,11 +389,7 @@ class class_data {
     future<> issue_requests(std::chrono::steady_clock::time_point stop) {
         _start = std::chrono::steady_clock::now();
         return with_scheduling_group(_sg, [this, stop] {
-            if (rps() == 0) {
-                return issue_requests_in_parallel(stop, parallelism());
-            } else {
-                return issue_requests_at_rate(stop, rps(), parallelism());
-            }
+            return do_issue_requests(stop);
         }).then([this] {
             _total_duration = std::chrono::steady_clock::now() - _start;
         });
@@ -350,6 +412,7 @@ class class_data {
     // random writes     : will overwrite the file at a random position, between 0 and EOF
     // append            : will write to the file from pos = EOF onwards, always appending to the end.
     // cpu               : CPU-only load, file is not created.
+    // replay            : will read and write the file where a recorded trace did, wrapping around at EOF.
     future<> start(sstring dir, directory_entry_type type) {
         return do_start(dir, type).then([this] {
             if (this_shard_id() == 0 && _config.shard_info.bandwidth != 0) {
@@ -380,6 +443,7 @@ class class_data {
             { request_type::randwrite, "RAND WRITE" },
             { request_type::append , "APPEND" },
             { request_type::cpu , "CPU" },
+            { request_type::replay , "REPLAY" },
         }[_config.type];;
     }
 
@@ -460,10 +524,51 @@ class class_data {
         return pos + _offset;
     }
 
+    std::chrono::microseconds latency_slo() const {
+        return std::chrono::duration_cast<std::chrono::microseconds>(_config.shard_info.latency_slo);
+    }
+
+    uint64_t slo_violations() const noexcept {
+        return _slo_violations;
+    }
+
     void add_result(size_t data, std::chrono::microseconds latency) {
         _data += data;
         _latencies(latency.count());
         _requests++;
+
+        auto second = size_t((std::chrono::steady_clock::now() - _start) / 1s);
+        if (_timeline.size() <= second) {
+            _timeline.resize(second + 1);
+        }
+        auto& in = _timeline[second];
+        in.latencies(latency.count());
+        in.requests++;
+        if (latency_slo() > 0us && latency > latency_slo()) {
+            _slo_violations++;
+            in.slo_violations++;
+        }
+    }
+
+    void emit_timeline(YAML::Emitter& out) const {
+        out << YAML::Key << "timeline";
+        emit_comment(out, "per second, usec");
+        out << YAML::BeginSeq;
+        for (auto& in : _timeline) {
+            out << YAML::BeginMap;
+            out << YAML::Key << "requests" << YAML::Value << in.requests;
+            if (in.requests) {
+                for (auto& q: quantiles) {
+                    out << YAML::Key << fmt::format("p{}", q) << YAML::Value << uint64_t(quantile(in.latencies, quantile_probability = q));
+                }
+                out << YAML::Key << "max" << YAML::Value << uint64_t(max(in.latencies));
+            }
+            if (latency_slo() > 0us) {
+                out << YAML::Key << "slo_violations" << YAML::Value << in.slo_violations;
+            }
+            out << YAML::EndMap;
+        }
+        out << YAML::EndSeq;
     }
 
 public:
@@ -602,9 +707,11 @@ class io_class_data : public class_data {
     virtual void emit_results(YAML::Emitter& out) override {
         auto throughput_kbs = (total_data() >> 10) / total_duration().count();
         auto iops = requests() / total_duration().count();
-        out << YAML::Key << "throughput" << YAML::Value << throughput_kbs << YAML::Comment("kB/s");
+        out << YAML::Key << "throughput" << YAML::Value << throughput_kbs;
+        emit_comment(out, "kB/s");
         out << YAML::Key << "IOPS" << YAML::Value << iops;
-        out << YAML::Key << "latencies" << YAML::Comment("usec");
+        out << YAML::Key << "latencies";
+        emit_comment(out, "usec");
         out << YAML::BeginMap;
         out << YAML::Key << "average" << YAML::Value << average_latency();
         for (auto& q: quantiles) {
@@ -612,6 +719,15 @@ class io_class_data : public class_data {
         }
         out << YAML::Key << "max" << YAML::Value << max_latency();
         out << YAML::EndMap;
+        if (latency_slo() > 0us) {
+            out << YAML::Key << "slo" << YAML::BeginMap;
+            out << YAML::Key << "target" << YAML::Value << latency_slo().count();
+            emit_comment(out, "usec");
+            out << YAML::Key << "violations" << YAML::Value << slo_violations();
+            out << YAML::Key << "compliance" << YAML::Value << (requests() ? 1.0 - double(slo_violations()) / requests() : 1.0);
+            out << YAML::EndMap;
+        }
+        emit_timeline(out);
         out << YAML::Key << "stats" << YAML::BeginMap;
         out << YAML::Key << "total_requests" << YAML::Value << requests();
         emit_metrics(out);
@@ -639,6 +755,124 @@ class write_io_class_data : public io_class_data {
     }
 };
 
+// Replays the requests of a trace, each at the time it was recorded at, so
+// the requests of a class are spread round-robin over its shards. Offsets
+// wrap around the file, and the trace starts over when it runs out.
+class replay_io_class_data : public io_class_data {
+    std::vector<trace_record> _records;
+    size_t _next = 0;
+    // When the trace started, the last time it did
+    std::chrono::steady_clock::time_point _base;
+    uint64_t _late = 0;
+    // The request issue_request() is to issue
+    const trace_record* _cur = nullptr;
+
+    uint64_t pos_of(const trace_record& r) const {
+        auto size = size_of(r);
+        auto pos = align_down<uint64_t>(r.offset % _config.file_size, _alignment);
+        return std::min(pos, _config.file_size - size) + _offset;
+    }
+
+    size_t size_of(const trace_record& r) const {
+        return std::min(align_up<uint64_t>(std::max<uint64_t>(r.size, 1), _alignment), _config.file_size);
+    }
+
+    std::chrono::steady_clock::time_point due(const trace_record& r) const {
+        auto speed = _config.trace.speed;
+        if (speed == 0) {
+            return _base;
+        }
+        return _base + std::chrono::duration_cast<std::chrono::steady_clock::duration>(r.at / speed);
+    }
+
+    const trace_record& advance() {
+        auto& r = _records[_next];
+        if (++_next == _records.size()) {
+            _next = 0;
+            if (_config.trace.speed != 0) {
+                _base += std::chrono::duration_cast<std::chrono::steady_clock::duration>(_config.trace.records->back().at / _config.trace.speed);
+            }
+        }
+        return r;
+    }
+
+public:
+    replay_io_class_data(job_config cfg) : io_class_data(std::move(cfg)) {
+        auto nr_shards = _config.shard_placement.size();
+        auto index = _config.shard_placement.index_of(this_shard_id());
+        size_t n = 0;
+        for (auto& r : *_config.trace.records) {
+            if ((_config.trace.ops == trace_ops::reads && r.write) || (_config.trace.ops == trace_ops::writes && !r.write)) {
+                continue;
+            }
+            if (n++ % nr_shards == index) {
+                _records.push_back(r);
+            }
+        }
+    }
+
+    future<size_t> issue_request(char *buf, io_intent* intent) override {
+        auto& r = *_cur;
+        auto f = r.write
+                ? _file.dma_write(pos_of(r), buf, size_of(r), _iop, intent)
+                : _file.dma_read(pos_of(r), buf, size_of(r), _iop, intent);
+        return on_io_completed(std::move(f));
+    }
+
+    future<> do_issue_requests(std::chrono::steady_clock::time_point stop) override {
+        if (_records.empty()) {
+            return make_ready_future<>();
+        }
+        _base = _start;
+        // As fast as they can be means as fast as parallelism allows
+        auto in_flight = parallelism() != 0 ? parallelism() : (_config.trace.speed == 0 ? 1 : semaphore::max_counter());
+        return do_with(io_intent{}, gate{}, semaphore(in_flight), [this, stop] (io_intent& intent, gate& g, semaphore& sem) {
+            return do_until([stop] { return std::chrono::steady_clock::now() > stop; }, [this, stop, &intent, &g, &sem] {
+                auto next = due(_records[_next]);
+                auto now = std::chrono::steady_clock::now();
+                auto f = next > now ? _sleep_fn(next, now) : make_ready_future<>();
+                return f.then([&sem] {
+                    return get_units(sem, 1);
+                }).then([this, stop, next, &intent, &g] (auto units) {
+                    auto start = std::chrono::steady_clock::now();
+                    if (start > stop) {
+                        return;
+                    }
+                    if (start - next > 1ms) {
+                        _late++;
+                    }
+                    _cur = &advance();
+                    auto size = size_of(*_cur);
+                    auto bufptr = allocate_aligned_buffer<char>(size, _alignment);
+                    auto buf = bufptr.get();
+                    (void)with_gate(g, [this, buf, start, stop, &intent] {
+                        return issue_request(buf, &intent).then_wrapped([this, start, stop] (auto size_f) {
+                            try {
+                                auto size = size_f.get0();
+                                auto now = std::chrono::steady_clock::now();
+                                if (now < stop) {
+                                    this->add_result(size, std::chrono::duration_cast<std::chrono::microseconds>(now - start));
+                                }
+                            } catch (...) {
+                                // cancelled
+                            }
+                        });
+                    }).finally([bufptr = std::move(bufptr), units = std::move(units)] {});
+                });
+            }).then([&intent, &g] {
+                intent.cancel();
+                return g.close();
+            });
+        });
+    }
+
+    virtual void emit_results(YAML::Emitter& out) override {
+        io_class_data::emit_results(out);
+        out << YAML::Key << "late_requests" << YAML::Value << _late;
+        emit_comment(out, "issued over 1ms behind the trace");
+    }
+};
+
 class cpu_class_data : public class_data {
 public:
     cpu_class_data(job_config cfg) : class_data(std::move(cfg)) {}
@@ -666,6 +900,8 @@ class cpu_class_data : public class_data {
 std::unique_ptr<class_data> job_config::gen_class_data() {
     if (type == request_type::cpu) {
         return std::make_unique<cpu_class_data>(*this);
+    } else if (type == request_type::replay) {
+        return std::make_unique<replay_io_class_data>(*this);
     } else if ((type == request_type::seqread) || (type == request_type::randread)) {
         return std::make_unique<read_io_class_data>(*this);
     } else {
@@ -747,6 +983,7 @@ struct convert<request_type> {
             { "randwrite", request_type::randwrite },
             { "append", request_type::append},
             { "cpu", request_type::cpu},
+            { "replay", request_type::replay},
         };
         auto reqstr = node.as<std::string>();
         if (!mappings.count(reqstr)) {
@@ -785,6 +1022,9 @@ struct convert<shard_info> {
         if (node["execution_time"]) {
             sl.execution_time = node["execution_time"].as<duration_time>().time;
         }
+        if (node["latency_slo"]) {
+            sl.latency_slo = node["latency_slo"].as<duration_time>().time;
+        }
         return true;
     }
 };
@@ -821,6 +1061,32 @@ struct convert<options> {
     }
 };
 
+template<>
+struct convert<trace_config> {
+    static bool decode(const Node& node, trace_config& tc) {
+        tc.file = node["file"].as<std::string>();
+        if (node["speed"]) {
+            tc.speed = node["speed"].as<double>();
+            if (tc.speed < 0) {
+                return false;
+            }
+        }
+        if (node["ops"]) {
+            auto ops = node["ops"].as<std::string>();
+            if (ops == "all") {
+                tc.ops = trace_ops::all;
+            } else if (ops == "reads") {
+                tc.ops = trace_ops::reads;
+            } else if (ops == "writes") {
+                tc.ops = trace_ops::writes;
+            } else {
+                throw std::runtime_error(format("Unknown trace ops {}", ops));
+            }
+        }
+        return true;
+    }
+};
+
 template<>
 struct convert<job_config> {
     static bool decode(const Node& node, job_config& cl) {
@@ -841,11 +1107,75 @@ struct convert<job_config> {
         if (node["options"]) {
             cl.options = node["options"].as<options>();
         }
+        if (node["trace"]) {
+            cl.trace = node["trace"].as<trace_config>();
+        } else if (cl.type == request_type::replay) {
+            throw std::runtime_error(format("Job {} replays no trace", cl.name));
+        }
         return true;
     }
 };
 }
 
+// Reads a block trace, either the iolog of fio, as written by its
+// write_iolog option, or the text output of blkparse, of which the queued
+// requests are taken. Version 2 iologs carry no timestamps, and are
+// replayed as fast as they can be.
+static trace load_trace(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) {
+        throw std::runtime_error(format("Cannot open trace {}", path));
+    }
+    trace t;
+    unsigned iolog_version = 0;
+    std::string line;
+    std::vector<std::string> f;
+    while (std::getline(in, line)) {
+        boost::trim(line);
+        if (line.empty()) {
+            continue;
+        }
+        boost::split(f, line, boost::is_space(), boost::token_compress_on);
+        if (f.size() >= 3 && f[0] == "fio" && f[1] == "version") {
+            iolog_version = boost::lexical_cast<unsigned>(f[2]);
+            continue;
+        }
+        try {
+            if (iolog_version) {
+                // [timestamp_ms] filename action offset length
+                auto ts = iolog_version >= 3;
+                if (f.size() != 4u + ts || (f[1 + ts] != "read" && f[1 + ts] != "write")) {
+                    continue;
+                }
+                auto at = ts ? std::chrono::duration<double>(boost::lexical_cast<double>(f[0]) / 1000) : std::chrono::duration<double>(0);
+                t.push_back({at, f[1 + ts] == "write", boost::lexical_cast<uint64_t>(f[2 + ts]), boost::lexical_cast<uint64_t>(f[3 + ts])});
+            } else {
+                // dev cpu sequence time pid action rwbs sector + sectors [process]
+                if (f.size() < 10 || f[5] != "Q" || f[8] != "+") {
+                    continue;
+                }
+                bool write = f[6].find('W') != std::string::npos;
+                if (!write && f[6].find('R') == std::string::npos) {
+                    continue;
+                }
+                auto at = std::chrono::duration<double>(boost::lexical_cast<double>(f[3]));
+                t.push_back({at, write, boost::lexical_cast<uint64_t>(f[7]) << 9, boost::lexical_cast<uint64_t>(f[9]) << 9});
+            }
+        } catch (boost::bad_lexical_cast&) {
+            continue;
+        }
+    }
+    if (t.empty()) {
+        throw std::runtime_error(format("No requests in trace {}", path));
+    }
+    std::stable_sort(t.begin(), t.end(), [] (const trace_record& a, const trace_record& b) { return a.at < b.at; });
+    auto first = t.front().at;
+    for (auto& r : t) {
+        r.at -= first;
+    }
+    return t;
+}
+
 /// Each shard has one context, and the context is responsible for creating the classes that should
 /// run in this shard.
 class context {
@@ -903,7 +1233,14 @@ class context {
 
 static void show_results(distributed<context>& ctx) {
     YAML::Emitter out;
-    out << YAML::BeginDoc;
+    if (json_output) {
+        // Flow style with quoted strings is JSON
+        out.SetMapFormat(YAML::Flow);
+        out.SetSeqFormat(YAML::Flow);
+        out.SetStringFormat(YAML::DoubleQuoted);
+    } else {
+        out << YAML::BeginDoc;
+    }
     out << YAML::BeginSeq;
     for (unsigned i = 0; i < smp::count; ++i) {
         out << YAML::BeginMap;
@@ -914,8 +1251,10 @@ static void show_results(distributed<context>& ctx) {
         out << YAML::EndMap;
     }
     out << YAML::EndSeq;
-    out << YAML::EndDoc;
-    std::cout << out.c_str();
+    if (!json_output) {
+        out << YAML::EndDoc;
+    }
+    std::cout << out.c_str() << std::endl;
 }
 
 int main(int ac, char** av) {
@@ -928,6 +1267,7 @@ int main(int ac, char** av) {
         ("duration", bpo::value<unsigned>()->default_value(10), "for how long (in seconds) to run the test")
         ("conf", bpo::value<sstring>()->default_value("./conf.yaml"), "YAML file containing benchmark specification")
         ("keep-files", bpo::value<bool>()->default_value(false), "keep test files, next run may re-use them")
+        ("output-format", bpo::value<sstring>()->default_value("yaml"), "format of the results, yaml or json")
     ;
 
     distributed<context> ctx;
@@ -950,10 +1290,22 @@ int main(int ac, char** av) {
             }
 
             keep_files = opts["keep-files"].as<bool>();
+            auto& output_format = opts["output-format"].as<sstring>();
+            if (output_format != "yaml" && output_format != "json") {
+                throw std::runtime_error(format("Unknown output format {}", output_format));
+            }
+            json_output = output_format == "json";
+            // Keep the results the only thing on stdout for JSON
+            std::ostream& progress = json_output ? std::cerr : std::cout;
             auto& duration = opts["duration"].as<unsigned>();
             auto& yaml = opts["conf"].as<sstring>();
             YAML::Node doc = YAML::LoadFile(yaml);
             auto reqs = doc.as<std::vector<job_config>>();
+            for (auto& r : reqs) {
+                if (r.type == request_type::replay) {
+                    r.trace.records = std::make_shared<const trace>(load_trace(r.trace.file));
+                }
+            }
 
             parallel_for_each(reqs, [] (auto& r) {
                 return seastar::create_scheduling_group(r.name, r.shard_info.shares).then([&r] (seastar::scheduling_group sg) {
@@ -973,11 +1325,11 @@ int main(int ac, char** av) {
             engine().at_exit([&ctx] {
                 return ctx.stop();
             });
-            std::cout << "Creating initial files..." << std::endl;
+            progress << "Creating initial files..." << std::endl;
             ctx.invoke_on_all([] (auto& c) {
                 return c.start();
             }).get();
-            std::cout << "Starting evaluation..." << std::endl;
+            progress << "Starting evaluation..." << std::endl;
             ctx.invoke_on_all([] (auto& c) {
                 return c.issue_requests();
             }).get();
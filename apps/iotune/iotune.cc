@@ -51,6 +51,7 @@
 #include <seastar/util/log.hh>
 #include <seastar/util/std-compat.hh>
 #include <seastar/util/read_first_line.hh>
+#include <seastar/util/conversions.hh>
 
 using namespace seastar;
 using namespace std::chrono_literals;
@@ -313,6 +314,21 @@ class read_request_issuer : public request_issuer {
     }
 };
 
+// Reads or writes at random, reading the given fraction of the requests
+class mixed_request_issuer : public request_issuer {
+    file _file;
+    std::bernoulli_distribution _read;
+public:
+    mixed_request_issuer(file f, float read_ratio) : _file(f), _read(read_ratio) {}
+    future<size_t> issue_request(uint64_t pos, char* buf, uint64_t size) override {
+        if (_read(random_generator)) {
+            return _file.dma_read(pos, buf, size);
+        } else {
+            return _file.dma_write(pos, buf, size);
+        }
+    }
+};
+
 class io_worker {
     class requests_rate_meter {
         std::vector<unsigned>& _rates;
@@ -495,6 +511,12 @@ class test_file {
         });
     }
 
+    future<io_rates> mixed_workload(size_t buffer_size, float read_ratio, unsigned max_os_concurrency, std::chrono::duration<double> duration, std::vector<unsigned>& rates) {
+        buffer_size = std::max({buffer_size, _file.disk_read_dma_alignment(), _file.disk_write_dma_alignment()});
+        auto worker = std::make_unique<io_worker>(buffer_size, duration, std::make_unique<mixed_request_issuer>(_file, read_ratio), get_position_generator(buffer_size, pattern::random), rates);
+        return do_workload(std::move(worker), max_os_concurrency);
+    }
+
     future<> stop() {
         return _file.close();
     }
@@ -573,6 +595,23 @@ class iotune_multi_shard_context {
         }, io_rates(), std::plus<io_rates>());
     }
 
+    future<io_rates> mixed_random_data(size_t buffer_size, float read_ratio, std::chrono::duration<double> duration) {
+        return _iotune_test_file.map_reduce0([buffer_size, read_ratio, this, duration] (test_file& tf) {
+            return tf.mixed_workload(buffer_size, read_ratio, per_shard_io_depth(), duration, sharded_rates.local());
+        }, io_rates(), std::plus<io_rates>());
+    }
+
+    // Random reads, iodepth of them in flight over all shards
+    future<io_rates> read_random_data_at_depth(size_t buffer_size, unsigned iodepth, std::chrono::duration<double> duration) {
+        return _iotune_test_file.map_reduce0([buffer_size, iodepth, this, duration] (test_file& tf) {
+            auto depth = iodepth / smp::count + (this_shard_id() < iodepth % smp::count);
+            if (depth == 0) {
+                return make_ready_future<io_rates>();
+            }
+            return tf.read_workload(buffer_size, test_file::pattern::random, depth, duration, sharded_rates.local());
+        }, io_rates(), std::plus<io_rates>());
+    }
+
 private:
     template <typename Fn>
     future<uint64_t> saturate(float rate_threshold, size_t buffer_size, std::chrono::duration<double> duration, Fn&& workload) {
@@ -612,6 +651,10 @@ struct disk_descriptor {
     uint64_t write_bw;
     std::optional<uint64_t> read_sat_len;
     std::optional<uint64_t> write_sat_len;
+    // IOPS of random requests, by the fraction of them which are reads
+    std::vector<std::pair<float, uint64_t>> mixed_iops;
+    // IOPS of random reads, by how many of them are in flight
+    std::vector<std::pair<unsigned, uint64_t>> read_iops_curve;
 };
 
 void string_to_file(sstring conf_file, sstring buf) {
@@ -650,6 +693,26 @@ void write_property_file(sstring conf_file, std::vector<disk_descriptor> disk_de
         if (desc.write_sat_len) {
             out << YAML::Key << "write_saturation_length" << YAML::Value << *desc.write_sat_len;
         }
+        if (!desc.mixed_iops.empty()) {
+            out << YAML::Key << "mixed_iops" << YAML::BeginSeq;
+            for (auto& [read_ratio, iops] : desc.mixed_iops) {
+                out << YAML::Flow << YAML::BeginMap;
+                out << YAML::Key << "read_ratio" << YAML::Value << read_ratio;
+                out << YAML::Key << "iops" << YAML::Value << iops;
+                out << YAML::EndMap;
+            }
+            out << YAML::EndSeq;
+        }
+        if (!desc.read_iops_curve.empty()) {
+            out << YAML::Key << "read_iops_curve" << YAML::BeginSeq;
+            for (auto& [depth, iops] : desc.read_iops_curve) {
+                out << YAML::Flow << YAML::BeginMap;
+                out << YAML::Key << "depth" << YAML::Value << depth;
+                out << YAML::Key << "iops" << YAML::Value << iops;
+                out << YAML::EndMap;
+            }
+            out << YAML::EndSeq;
+        }
         out << YAML::EndMap;
     }
     out << YAML::EndSeq;
@@ -659,6 +722,38 @@ void write_property_file(sstring conf_file, std::vector<disk_descriptor> disk_de
     string_to_file(conf_file, sstring(out.c_str(), out.size()));
 }
 
+// The disks of a properties file written before, by mountpoint
+std::unordered_map<std::string, disk_descriptor> read_property_file(sstring conf_file) {
+    std::unordered_map<std::string, disk_descriptor> ret;
+    auto doc = YAML::LoadFile(conf_file);
+    for (auto&& node : doc["disks"]) {
+        disk_descriptor desc;
+        desc.mountpoint = node["mountpoint"].as<std::string>();
+        desc.read_iops = parse_memory_size(node["read_iops"].as<std::string>());
+        desc.read_bw = parse_memory_size(node["read_bandwidth"].as<std::string>());
+        desc.write_iops = parse_memory_size(node["write_iops"].as<std::string>());
+        desc.write_bw = parse_memory_size(node["write_bandwidth"].as<std::string>());
+        if (node["read_saturation_length"]) {
+            desc.read_sat_len = parse_memory_size(node["read_saturation_length"].as<std::string>());
+        }
+        if (node["write_saturation_length"]) {
+            desc.write_sat_len = parse_memory_size(node["write_saturation_length"].as<std::string>());
+        }
+        if (node["mixed_iops"]) {
+            for (auto&& point : node["mixed_iops"]) {
+                desc.mixed_iops.emplace_back(point["read_ratio"].as<float>(), parse_memory_size(point["iops"].as<std::string>()));
+            }
+        }
+        if (node["read_iops_curve"]) {
+            for (auto&& point : node["read_iops_curve"]) {
+                desc.read_iops_curve.emplace_back(point["depth"].as<unsigned>(), parse_memory_size(point["iops"].as<std::string>()));
+            }
+        }
+        ret.emplace(desc.mountpoint, std::move(desc));
+    }
+    return ret;
+}
+
 // Returns the mountpoint of a path. It works by walking backwards from the canonical path
 // (absolute, with symlinks resolved), until we find a point that crosses a device ID.
 fs::path mountpoint_of(sstring filename) {
@@ -682,6 +777,9 @@ fs::path mountpoint_of(sstring filename) {
 int main(int ac, char** av) {
     namespace bpo = boost::program_options;
     bool fs_check = false;
+    bool mixed = false;
+    bool concurrency_curve = false;
+    bool quick = false;
 
     app_template::config app_cfg;
     app_cfg.name = "IOTune";
@@ -697,6 +795,11 @@ int main(int ac, char** av) {
         ("fs-check", bpo::bool_switch(&fs_check), "perform FS check only")
         ("accuracy", bpo::value<unsigned>()->default_value(3), "acceptable deviation of measurements (percents)")
         ("saturation", bpo::value<sstring>()->default_value(""), "measure saturation lengths (read | write | both) (this is very slow!)")
+        ("mixed", bpo::bool_switch(&mixed), "measure the IOPS of random reads and writes mixed in several ratios")
+        ("concurrency-curve", bpo::bool_switch(&concurrency_curve), "measure the IOPS of random reads at increasing queue depths")
+        ("quick", bpo::bool_switch(&quick), "probe the properties stored in --properties-file for a few seconds, and only measure those which deviate from the probes in full")
+        ("tolerance", bpo::value<unsigned>()->default_value(10), "deviation (percents) of a probe from a stored property beyond which --quick measures it")
+        ("probe-duration", bpo::value<unsigned>()->default_value(2), "time, in seconds, for which --quick probes each property")
     ;
 
     return app.run(ac, av, [&] {
@@ -707,6 +810,22 @@ int main(int ac, char** av) {
             auto duration = std::chrono::duration<double>(configuration["duration"].as<unsigned>() * 1s);
             auto accuracy = configuration["accuracy"].as<unsigned>();
             auto saturation = configuration["saturation"].as<sstring>();
+            auto tolerance = configuration["tolerance"].as<unsigned>();
+            auto probe_duration = std::chrono::duration<double>(configuration["probe-duration"].as<unsigned>() * 1s);
+
+            std::unordered_map<std::string, disk_descriptor> stored_descriptors;
+            if (quick) {
+                if (!configuration.count("properties-file")) {
+                    fmt::print("--quick needs a --properties-file\n");
+                    return 1;
+                }
+                auto properties_file = configuration["properties-file"].as<sstring>();
+                if (file_exists(properties_file).get0()) {
+                    stored_descriptors = read_property_file(properties_file);
+                } else {
+                    iotune_logger.info("{} does not exist, measuring all properties", properties_file);
+                }
+            }
 
             bool read_saturation, write_saturation;
             if (saturation == "") {
@@ -794,15 +913,41 @@ int main(int ac, char** av) {
                 iotune_tests.create_data_file().get();
 
                 fmt::print("Starting Evaluation. This may take a while...\n");
+                const disk_descriptor* stored = nullptr;
+                if (auto it = stored_descriptors.find(mountpoint); it != stored_descriptors.end()) {
+                    stored = &it->second;
+                }
+                // With --quick, a property stored before is kept when a short
+                // probe agrees with it, and measured in full otherwise
+                auto measure = [&] (std::optional<uint64_t> stored_value, std::chrono::duration<double> full_duration, auto run) -> float {
+                    if (quick && stored_value && *stored_value) {
+                        auto probed = run(probe_duration);
+                        auto deviation = std::abs(probed - *stored_value) / *stored_value;
+                        if (deviation * 100 <= tolerance) {
+                            fmt::print("(probe deviates {}%, keeping) ", int(round(deviation * 100)));
+                            return *stored_value;
+                        }
+                        fmt::print("(probe deviates {}%, measuring) ", int(round(deviation * 100)));
+                        std::cout.flush();
+                    }
+                    return run(full_duration);
+                };
+                auto stored_value = [stored] (uint64_t disk_descriptor::* field) -> std::optional<uint64_t> {
+                    return stored ? std::optional<uint64_t>(stored->*field) : std::nullopt;
+                };
+
                 fmt::print("Measuring sequential write bandwidth: ");
                 std::cout.flush();
                 io_rates write_bw;
                 size_t sequential_buffer_size = 1 << 20;
-                for (unsigned shard = 0; shard < smp::count; ++shard) {
-                    write_bw += iotune_tests.write_sequential_data(shard, sequential_buffer_size, duration * 0.70 / smp::count).get0();
-                }
-                write_bw.bytes_per_sec /= smp::count;
-                rates = iotune_tests.get_serial_rates().get0();
+                write_bw.bytes_per_sec = measure(stored_value(&disk_descriptor::write_bw), duration * 0.70, [&] (std::chrono::duration<double> d) {
+                    io_rates bw;
+                    for (unsigned shard = 0; shard < smp::count; ++shard) {
+                        bw += iotune_tests.write_sequential_data(shard, sequential_buffer_size, d / smp::count).get0();
+                    }
+                    rates = iotune_tests.get_serial_rates().get0();
+                    return bw.bytes_per_sec / smp::count;
+                });
                 fmt::print("{} MB/s{}\n", uint64_t(write_bw.bytes_per_sec / (1024 * 1024)), accuracy_msg());
 
                 std::optional<uint64_t> write_sat;
@@ -816,8 +961,12 @@ int main(int ac, char** av) {
 
                 fmt::print("Measuring sequential read bandwidth: ");
                 std::cout.flush();
-                auto read_bw = iotune_tests.read_sequential_data(0, sequential_buffer_size, duration * 0.1).get0();
-                rates = iotune_tests.get_serial_rates().get0();
+                io_rates read_bw;
+                read_bw.bytes_per_sec = measure(stored_value(&disk_descriptor::read_bw), duration * 0.1, [&] (std::chrono::duration<double> d) {
+                    auto bw = iotune_tests.read_sequential_data(0, sequential_buffer_size, d).get0();
+                    rates = iotune_tests.get_serial_rates().get0();
+                    return bw.bytes_per_sec;
+                });
                 fmt::print("{} MB/s{}\n", uint64_t(read_bw.bytes_per_sec / (1024 * 1024)), accuracy_msg());
 
                 std::optional<uint64_t> read_sat;
@@ -831,16 +980,64 @@ int main(int ac, char** av) {
 
                 fmt::print("Measuring random write IOPS: ");
                 std::cout.flush();
-                auto write_iops = iotune_tests.write_random_data(test_directory.minimum_io_size(), duration * 0.1).get0();
-                rates = iotune_tests.get_sharded_worst_rates().get0();
+                io_rates write_iops;
+                write_iops.iops = measure(stored_value(&disk_descriptor::write_iops), duration * 0.1, [&] (std::chrono::duration<double> d) {
+                    auto iops = iotune_tests.write_random_data(test_directory.minimum_io_size(), d).get0();
+                    rates = iotune_tests.get_sharded_worst_rates().get0();
+                    return iops.iops;
+                });
                 fmt::print("{} IOPS{}\n", uint64_t(write_iops.iops), accuracy_msg());
 
                 fmt::print("Measuring random read IOPS: ");
                 std::cout.flush();
-                auto read_iops = iotune_tests.read_random_data(test_directory.minimum_io_size(), duration * 0.1).get0();
-                rates = iotune_tests.get_sharded_worst_rates().get0();
+                io_rates read_iops;
+                read_iops.iops = measure(stored_value(&disk_descriptor::read_iops), duration * 0.1, [&] (std::chrono::duration<double> d) {
+                    auto iops = iotune_tests.read_random_data(test_directory.minimum_io_size(), d).get0();
+                    rates = iotune_tests.get_sharded_worst_rates().get0();
+                    return iops.iops;
+                });
                 fmt::print("{} IOPS{}\n", uint64_t(read_iops.iops), accuracy_msg());
 
+                std::vector<std::pair<float, uint64_t>> mixed_iops;
+                if (mixed) {
+                    for (float read_ratio : {0.25f, 0.5f, 0.75f}) {
+                        fmt::print("Measuring random IOPS, {}% reads: ", int(read_ratio * 100));
+                        std::cout.flush();
+                        auto iops = iotune_tests.mixed_random_data(test_directory.minimum_io_size(), read_ratio, duration * 0.05).get0();
+                        rates = iotune_tests.get_sharded_worst_rates().get0();
+                        fmt::print("{} IOPS{}\n", uint64_t(iops.iops), accuracy_msg());
+                        mixed_iops.emplace_back(read_ratio, iops.iops);
+                    }
+                }
+
+                std::vector<std::pair<unsigned, uint64_t>> read_iops_curve;
+                if (concurrency_curve) {
+                    for (unsigned depth = 1; depth <= test_directory.max_iodepth(); depth *= 2) {
+                        fmt::print("Measuring random read IOPS at depth {}: ", depth);
+                        std::cout.flush();
+                        auto iops = iotune_tests.read_random_data_at_depth(test_directory.minimum_io_size(), depth, duration * 0.02).get0();
+                        rates = iotune_tests.get_sharded_worst_rates().get0();
+                        fmt::print("{} IOPS{}\n", uint64_t(iops.iops), accuracy_msg());
+                        read_iops_curve.emplace_back(depth, iops.iops);
+                    }
+                }
+
+                // What is not measured this time stays as it was
+                if (quick && stored) {
+                    if (!write_saturation) {
+                        write_sat = stored->write_sat_len;
+                    }
+                    if (!read_saturation) {
+                        read_sat = stored->read_sat_len;
+                    }
+                    if (!mixed) {
+                        mixed_iops = stored->mixed_iops;
+                    }
+                    if (!concurrency_curve) {
+                        read_iops_curve = stored->read_iops_curve;
+                    }
+                }
+
                 struct disk_descriptor desc;
                 desc.mountpoint = mountpoint;
                 desc.read_iops = read_iops.iops;
@@ -849,6 +1046,8 @@ int main(int ac, char** av) {
                 desc.write_iops = write_iops.iops;
                 desc.write_bw = write_bw.bytes_per_sec;
                 desc.write_sat_len = write_sat;
+                desc.mixed_iops = std::move(mixed_iops);
+                desc.read_iops_curve = std::move(read_iops_curve);
                 disk_descriptors.push_back(std::move(desc));
             }
 
@@ -66,6 +66,9 @@ blob := any+ >start_blob $advance_blob;
 maybe_noreply = (sp "noreply" @{ _noreply = true; })? >{ _noreply = false; };
 maybe_expiration = (sp expiration)? >{ _expiration = 0; };
 version_field = u64 %{ _version = _u64; };
+meta_key = [^ \r\n]+ >mark %{ _key = memcache::item_key(str()); };
+meta_flag = sp ([a-zA-Z] [^ \r\n]*) >mark %{ auto flag = str(); _meta_flags.push_back(meta_flag{flag[0], flag.substr(1)}); };
+meta_flags = meta_flag* >{ _meta_flags.clear(); };
 
 insertion_params = sp key sp flags sp expiration sp size maybe_noreply (crlf @{ fcall blob; } ) crlf;
 set = "set" insertion_params @{ _state = state::cmd_set; };
@@ -81,8 +84,12 @@ stats = "stats" crlf @{ _state = state::cmd_stats; };
 stats_hash = "stats hash" crlf @{ _state = state::cmd_stats_hash; };
 incr = "incr" sp key sp u64 maybe_noreply crlf @{ _state = state::cmd_incr; };
 decr = "decr" sp key sp u64 maybe_noreply crlf @{ _state = state::cmd_decr; };
+mg = "mg" sp meta_key meta_flags crlf @{ _state = state::cmd_mg; };
+ms = "ms" sp meta_key sp size meta_flags (crlf @{ fcall blob; } ) crlf @{ _state = state::cmd_ms; };
+md = "md" sp meta_key meta_flags crlf @{ _state = state::cmd_md; };
+mn = "mn" crlf @{ _state = state::cmd_mn; };
 main := (add | replace | set | get | gets | delete | flush | version | cas | stats | incr | decr
-    | stats_hash) >eof{ _state = state::eof; };
+    | stats_hash | mg | ms | md | mn) >eof{ _state = state::eof; };
 
 prepush {
     prepush();
@@ -113,6 +120,15 @@ public:
         cmd_stats_hash,
         cmd_incr,
         cmd_decr,
+        cmd_mg,
+        cmd_ms,
+        cmd_md,
+        cmd_mn,
+    };
+    // A flag of a meta command: a letter, and the token which follows it
+    struct meta_flag {
+        char name;
+        sstring token;
     };
     state _state;
     uint32_t _u32;
@@ -127,11 +143,18 @@ public:
     sstring _blob;
     bool _noreply;
     std::vector<memcache::item_key> _keys;
+    std::vector<meta_flag> _meta_flags;
+    // Whether the command is followed by more bytes in the buffer it ended
+    // in, that is, whether the client pipelines commands
+    bool _pipelined;
 public:
     void init() {
         init_base();
         _state = state::error;
         _keys.clear();
+        _meta_flags.clear();
+        _noreply = false;
+        _pipelined = false;
         %% write init;
     }
 
@@ -147,6 +170,7 @@ public:
 #pragma clang diagnostic pop
 #endif
         if (_state != state::error) {
+            _pipelined = p != pe;
             return p;
         }
         if (p != pe) {
@@ -0,0 +1,202 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#pragma once
+
+#include <seastar/core/future.hh>
+#include <seastar/core/iostream.hh>
+#include <seastar/core/sstring.hh>
+#include <seastar/core/temporary_buffer.hh>
+#include <seastar/net/byteorder.hh>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+namespace memcache {
+
+using namespace seastar;
+
+// The binary protocol of memcached: a fixed size header, then extras, key
+// and value, whose sizes the header tells.
+namespace binary {
+
+static constexpr uint8_t magic_request = 0x80;
+static constexpr uint8_t magic_response = 0x81;
+
+enum class opcode : uint8_t {
+    get = 0x00,
+    set = 0x01,
+    add = 0x02,
+    replace = 0x03,
+    del = 0x04,
+    increment = 0x05,
+    decrement = 0x06,
+    quit = 0x07,
+    flush = 0x08,
+    getq = 0x09,
+    noop = 0x0a,
+    version = 0x0b,
+    getk = 0x0c,
+    getkq = 0x0d,
+    stat = 0x10,
+    setq = 0x11,
+    addq = 0x12,
+    replaceq = 0x13,
+    delq = 0x14,
+    incrementq = 0x15,
+    decrementq = 0x16,
+    quitq = 0x17,
+    flushq = 0x18,
+};
+
+enum class status : uint16_t {
+    ok = 0x00,
+    key_not_found = 0x01,
+    key_exists = 0x02,
+    value_too_large = 0x03,
+    invalid_arguments = 0x04,
+    item_not_stored = 0x05,
+    non_numeric_value = 0x06,
+    unknown_command = 0x81,
+    out_of_memory = 0x82,
+};
+
+struct header {
+    uint8_t magic;
+    uint8_t opcode;
+    net::packed<uint16_t> key_length;
+    uint8_t extras_length;
+    uint8_t data_type;
+    // The vbucket of requests, the status of responses
+    net::packed<uint16_t> vbucket_or_status;
+    net::packed<uint32_t> body_length;
+    net::packed<uint32_t> opaque;
+    net::packed<uint64_t> cas;
+
+    template <typename Adjuster>
+    auto adjust_endianness(Adjuster a) {
+        return a(key_length, vbucket_or_status, body_length, opaque, cas);
+    }
+} __attribute__((packed));
+
+static_assert(sizeof(header) == 24);
+
+template <typename T>
+inline T read_be(const char* p) {
+    T v;
+    std::memcpy(&v, p, sizeof(v));
+    return net::ntoh(v);
+}
+
+template <typename T>
+inline void write_be(char* p, T v) {
+    v = net::hton(v);
+    std::memcpy(p, &v, sizeof(v));
+}
+
+}
+
+// Reads a request of the binary protocol off an input_stream, with
+// consume(); like the ASCII parser, it tells whether more requests
+// follow in what was read, so that the protocol can batch them.
+class memcache_binary_parser {
+public:
+    enum class state {
+        error,
+        eof,
+        request,
+    };
+    // Larger values than the items of the cache can hold
+    static constexpr uint32_t max_body_length = 2 << 20;
+
+    state _state;
+    binary::header _header;
+    sstring _extras;
+    sstring _key;
+    sstring _value;
+    // Whether the request is followed by more bytes in the buffer it ended in
+    bool _pipelined;
+private:
+    char _header_bytes[sizeof(binary::header)];
+    size_t _header_read;
+    sstring _body;
+    size_t _body_read;
+
+    void complete() {
+        auto extras = std::min<size_t>(_header.extras_length, _body.size());
+        auto key = std::min<size_t>(_header.key_length, _body.size() - extras);
+        _extras = sstring(_body.data(), extras);
+        _key = sstring(_body.data() + extras, key);
+        _value = sstring(_body.data() + extras + key, _body.size() - extras - key);
+        _body = {};
+        _state = state::request;
+    }
+public:
+    void init() {
+        _state = state::error;
+        _header_read = 0;
+        _body_read = 0;
+        _body = {};
+        _pipelined = false;
+    }
+
+    future<consumption_result<char>> operator()(temporary_buffer<char> buf) {
+        if (buf.empty()) {
+            if (_header_read == 0) {
+                _state = state::eof;
+            }
+            return make_ready_future<consumption_result<char>>(stop_consuming<char>(std::move(buf)));
+        }
+        if (_header_read < sizeof(_header_bytes)) {
+            auto n = std::min(buf.size(), sizeof(_header_bytes) - _header_read);
+            std::memcpy(_header_bytes + _header_read, buf.get(), n);
+            _header_read += n;
+            buf.trim_front(n);
+            if (_header_read < sizeof(_header_bytes)) {
+                return make_ready_future<consumption_result<char>>(continue_consuming{});
+            }
+            std::memcpy(&_header, _header_bytes, sizeof(_header));
+            _header = net::ntoh(_header);
+            if (_header.magic != binary::magic_request || _header.body_length > max_body_length
+                    || _header.extras_length + _header.key_length > _header.body_length) {
+                _state = state::error;
+                return make_ready_future<consumption_result<char>>(stop_consuming<char>(temporary_buffer<char>()));
+            }
+            _body = uninitialized_string(_header.body_length);
+        }
+        auto n = std::min(buf.size(), _body.size() - _body_read);
+        std::memcpy(_body.data() + _body_read, buf.get(), n);
+        _body_read += n;
+        buf.trim_front(n);
+        if (_body_read < _body.size()) {
+            return make_ready_future<consumption_result<char>>(continue_consuming{});
+        }
+        complete();
+        _pipelined = !buf.empty();
+        return make_ready_future<consumption_result<char>>(stop_consuming<char>(std::move(buf)));
+    }
+
+    binary::opcode opcode() const {
+        return binary::opcode(_header.opcode);
+    }
+};
+
+}
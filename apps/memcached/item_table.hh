@@ -0,0 +1,327 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#pragma once
+
+#include <seastar/core/bitops.hh>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <memory>
+#include <utility>
+
+namespace memcache {
+
+/*
+ * An open addressing hash table of pointers to T, with buckets of a cache
+ * line: seven slots, and a byte of the hash of each of their items, the
+ * tag, so that a lookup compares the tags of a bucket all at once, and
+ * mostly touches a single cache line, besides the item it finds.
+ *
+ * An item goes in the first bucket with a free slot from its home bucket
+ * on; each bucket counts the items which went past it, so that lookups
+ * stop at the first bucket which has none, and a miss costs about as
+ * much as a hit.
+ *
+ * Growing the table does not move all the items at once, which would
+ * stall the reactor with many of them: the old buckets are kept, and
+ * moved to the new table a few at a time by migrate(), until none is
+ * left; in the meantime, lookups look in both tables.
+ *
+ * HashOf returns the hash of an item, which must not change while it is
+ * in the table.
+ */
+template <typename T, typename HashOf>
+class item_table {
+public:
+    static constexpr unsigned slots = 7;
+private:
+    static constexpr uint8_t overflow_max = 0xff;
+
+    struct alignas(64) bucket {
+        uint8_t tags[slots] = {}; // 0 for a free slot
+        uint8_t overflow = 0; // saturates at overflow_max
+        T* items[slots] = {};
+    };
+    static_assert(sizeof(T*) != 8 || sizeof(bucket) == 64, "a bucket should be a cache line");
+
+    struct table {
+        std::unique_ptr<bucket[]> buckets;
+        size_t mask = 0;
+        unsigned shift = 64;
+        size_t size = 0;
+
+        table() = default;
+        explicit table(size_t nr_buckets)
+            : buckets(new bucket[nr_buckets])
+            , mask(nr_buckets - 1)
+            , shift(64 - seastar::log2ceil(nr_buckets)) {
+        }
+        size_t nr_buckets() const noexcept {
+            return buckets ? mask + 1 : 0;
+        }
+        size_t home(size_t hash) const noexcept {
+            // The low bits of hashes are those which select the shard
+            return (uint64_t(hash) * 0x9e3779b97f4a7c15ull) >> shift;
+        }
+    };
+
+    table _cur;
+    // Buckets below _migrated have been moved to _cur
+    table _old;
+    size_t _migrated = 0;
+    HashOf _hash_of;
+
+    static uint8_t tag_of(size_t hash) noexcept {
+        return uint8_t(uint64_t(hash) >> 57) | 0x80;
+    }
+
+    static uint64_t load_tags(const bucket& b) noexcept {
+        uint64_t w;
+        std::memcpy(&w, b.tags, sizeof(w));
+        return w;
+    }
+
+    // A bit per slot, the high one of its byte in the word of the tags,
+    // which ends with the overflow count
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    static constexpr uint64_t slot_bits = 0x0080808080808080ull;
+#else
+    static constexpr uint64_t slot_bits = 0x8080808080808000ull;
+#endif
+
+    static unsigned slot_of(uint64_t bits) noexcept {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        return seastar::count_trailing_zeros(bits) / 8;
+#else
+        return seastar::count_leading_zeros(bits) / 8;
+#endif
+    }
+
+    // Slots whose tag may be tag: a borrow may make a slot next to a
+    // matching one match too, but no matching slot is left out
+    static uint64_t match(const bucket& b, uint8_t tag) noexcept {
+        uint64_t x = load_tags(b) ^ (0x0101010101010101ull * tag);
+        return (x - 0x0101010101010101ull) & ~x & slot_bits;
+    }
+
+    static uint64_t free_slots(const bucket& b) noexcept {
+        // Tags have their high bit set
+        return ~load_tags(b) & slot_bits;
+    }
+
+    template <typename Equal>
+    static T* find_in(const table& t, size_t hash, Equal& eq) noexcept {
+        if (!t.buckets) {
+            return nullptr;
+        }
+        auto tag = tag_of(hash);
+        auto i = t.home(hash);
+        for (size_t n = 0; n <= t.mask; n++) {
+            auto& b = t.buckets[i];
+            for (auto m = match(b, tag); m; m &= m - 1) {
+                auto s = slot_of(m);
+                if (b.tags[s] == tag && eq(*b.items[s])) {
+                    return b.items[s];
+                }
+            }
+            if (!b.overflow) {
+                break;
+            }
+            i = (i + 1) & t.mask;
+        }
+        return nullptr;
+    }
+
+    static void insert_in(table& t, T& v, size_t hash) noexcept {
+        auto i = t.home(hash);
+        for (;;) {
+            auto& b = t.buckets[i];
+            if (auto f = free_slots(b)) {
+                auto s = slot_of(f);
+                b.tags[s] = tag_of(hash);
+                b.items[s] = &v;
+                t.size++;
+                return;
+            }
+            if (b.overflow != overflow_max) {
+                b.overflow++;
+            }
+            i = (i + 1) & t.mask;
+        }
+    }
+
+    static bool erase_in(table& t, T& v, size_t hash) noexcept {
+        if (!t.buckets) {
+            return false;
+        }
+        auto tag = tag_of(hash);
+        auto home = t.home(hash);
+        auto i = home;
+        for (size_t n = 0; n <= t.mask; n++) {
+            auto& b = t.buckets[i];
+            for (auto m = match(b, tag); m; m &= m - 1) {
+                auto s = slot_of(m);
+                if (b.items[s] == &v) {
+                    b.tags[s] = 0;
+                    b.items[s] = nullptr;
+                    t.size--;
+                    // The buckets it went past
+                    for (auto j = home; j != i; j = (j + 1) & t.mask) {
+                        auto& o = t.buckets[j].overflow;
+                        if (o != overflow_max) {
+                            o--;
+                        }
+                    }
+                    return true;
+                }
+            }
+            if (!b.overflow) {
+                break;
+            }
+            i = (i + 1) & t.mask;
+        }
+        return false;
+    }
+
+    template <typename Func>
+    static void for_each_in(const table& t, Func& func) {
+        for (size_t i = 0; i < t.nr_buckets(); i++) {
+            auto& b = t.buckets[i];
+            for (unsigned s = 0; s < slots; s++) {
+                if (b.tags[s]) {
+                    func(*b.items[s]);
+                }
+            }
+        }
+    }
+public:
+    static constexpr size_t min_buckets = 8;
+    // Of the slots
+    static constexpr double max_load_factor = 0.8;
+
+    explicit item_table(size_t nr_buckets = min_buckets, HashOf hash_of = HashOf())
+        : _cur(std::max(size_t(1) << seastar::log2ceil(nr_buckets), min_buckets))
+        , _hash_of(std::move(hash_of)) {
+    }
+
+    item_table(const item_table&) = delete;
+    item_table& operator=(const item_table&) = delete;
+
+    size_t size() const noexcept {
+        return _cur.size + _old.size;
+    }
+
+    size_t bucket_count() const noexcept {
+        return _cur.nr_buckets();
+    }
+
+    /// Finds the item with the given hash for which eq() is true
+    template <typename Equal>
+    T* find(size_t hash, Equal&& eq) const noexcept {
+        if (auto p = find_in(_cur, hash, eq)) {
+            return p;
+        }
+        return find_in(_old, hash, eq);
+    }
+
+    /// Inserts an item, which must not be in the table. The table must
+    /// have room for it, see needs_grow().
+    void insert(T& v) noexcept {
+        insert_in(_cur, v, _hash_of(v));
+    }
+
+    /// Removes an item which is in the table
+    void erase(T& v) noexcept {
+        auto hash = _hash_of(v);
+        if (!erase_in(_cur, v, hash)) {
+            erase_in(_old, v, hash);
+        }
+    }
+
+    bool needs_grow() const noexcept {
+        return size() >= _cur.nr_buckets() * slots * max_load_factor;
+    }
+
+    /// Whether insert() would find no free slot, when grow() failed
+    bool full() const noexcept {
+        return size() >= _cur.nr_buckets() * slots;
+    }
+
+    bool migrating() const noexcept {
+        return bool(_old.buckets);
+    }
+
+    /// Doubles the number of buckets. Items are moved by migrate().
+    void grow() {
+        table next(_cur.nr_buckets() * 2);
+        // Not expected, as migrate() is called as items are inserted
+        while (migrating()) {
+            migrate(_old.nr_buckets());
+        }
+        _old = std::exchange(_cur, std::move(next));
+        _migrated = 0;
+    }
+
+    /// Moves up to n buckets of the table before the last grow() to the
+    /// current one
+    void migrate(size_t n) noexcept {
+        for (; n && migrating(); n--) {
+            auto& b = _old.buckets[_migrated];
+            for (unsigned s = 0; s < slots; s++) {
+                if (b.tags[s]) {
+                    insert_in(_cur, *b.items[s], _hash_of(*b.items[s]));
+                    b.tags[s] = 0;
+                    _old.size--;
+                }
+            }
+            // Overflow counts stay, for the items which went past the
+            // bucket and are not moved yet
+            if (++_migrated == _old.nr_buckets()) {
+                _old = table();
+            }
+        }
+    }
+
+    /// Removes all items, calling func for each
+    template <typename Func>
+    void clear_and_dispose(Func&& func) {
+        table cur(min_buckets);
+        auto old_table = std::exchange(_old, table());
+        auto cur_table = std::exchange(_cur, std::move(cur));
+        for_each_in(old_table, func);
+        for_each_in(cur_table, func);
+    }
+
+    /// Calls func with the number of items of each bucket, and the number
+    /// of items which went past it
+    template <typename Func>
+    void for_each_bucket(Func&& func) const {
+        for (auto t : {&_cur, &_old}) {
+            for (size_t i = 0; i < t->nr_buckets(); i++) {
+                auto& b = t->buckets[i];
+                func(unsigned(slots - __builtin_popcountll(free_slots(b))), unsigned(b.overflow));
+            }
+        }
+    }
+};
+
+}
@@ -149,6 +149,29 @@ class TcpSpecificTests(MemcacheTest):
             self.assertEqual(conn('get\r\n'), b'ERROR\r\n')
             self.assertEqual(conn('get key\r\n'), b'END\r\n')
 
+    def test_binary_protocol(self):
+        def request(opcode, key=b'', extras=b'', value=b'', cas=0, opaque=0):
+            return struct.pack('>BBHBBHIIQ', 0x80, opcode, len(key), len(extras), 0, 0,
+                               len(extras) + len(key) + len(value), opaque, cas) + extras + key + value
+        def responses(data):
+            while data:
+                magic, opcode, key_len, extras_len, _, status, body_len, opaque, cas = struct.unpack_from('>BBHBBHIIQ', data)
+                self.assertEqual(magic, 0x81)
+                body = data[24:24 + body_len]
+                yield opcode, status, opaque, body[extras_len:extras_len + key_len], body[extras_len + key_len:]
+                data = data[24 + body_len:]
+        s = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        s.connect(server_addr)
+        s.send(request(0x11, b'k1', struct.pack('>II', 0, 0), b'v1')
+               + request(0x11, b'k2', struct.pack('>II', 0, 0), b'v2')
+               + request(0x0d, b'k1', opaque=1) + request(0x0d, b'nokey', opaque=2)
+               + request(0x0d, b'k2', opaque=3) + request(0x0a, opaque=4)
+               + request(0x07))
+        got = [(op, status, opaque, key, value) for op, status, opaque, key, value in responses(recv_all(s))]
+        s.close()
+        self.assertEqual(got, [(0x0d, 0, 1, b'k1', b'v1'), (0x0d, 0, 3, b'k2', b'v2'),
+                               (0x0a, 0, 4, b'', b''), (0x07, 0, 0, b'', b'')])
+
     def test_incomplete_command_results_in_error(self):
         s = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
         s.connect(server_addr)
@@ -545,6 +568,28 @@ class TestCommands(MemcacheTest):
                 self.assertEqual(call('get key\r\n'), prev)
                 self.delete('key')
 
+    def test_meta_commands(self):
+        self.assertEqual(call('ms key 5 F3 T0\r\nhello\r\n'), b'HD\r\n')
+        self.assertEqual(call('mg key v f s k\r\n'), b'VA 5 f3 s5 kkey\r\nhello\r\n')
+        self.assertEqual(call('mg key Oabc\r\n'), b'HD Oabc\r\n')
+        self.assertEqual(call('mg missing v\r\n'), b'EN\r\n')
+        self.assertEqual(call('ms key 2 ME\r\nhi\r\n'), b'NS\r\n')
+        self.assertEqual(call('ms other 2 MR\r\nhi\r\n'), b'NS\r\n')
+        version = self.getItemVersion('key')
+        self.assertEqual(call('ms key 2 C%d\r\nhi\r\n' % (version + 1)), b'EX\r\n')
+        self.assertEqual(call('ms key 2 C%d\r\nhi\r\n' % version), b'HD\r\n')
+        self.assertEqual(call('mg key v\r\n'), b'VA 2\r\nhi\r\n')
+        self.assertEqual(call('md key Oxy\r\n'), b'HD Oxy\r\n')
+        self.assertEqual(call('md key\r\n'), b'NF\r\n')
+        self.assertEqual(call('mn\r\n'), b'MN\r\n')
+
+    def test_pipelined_meta_gets(self):
+        for i in range(20):
+            self.set('key%d' % i, 'v%d' % i)
+        request = ''.join('mg key%d v k q\r\n' % i for i in range(0, 40, 2)) + 'mn\r\n'
+        expected = ''.join('VA %d kkey%d\r\nv%d\r\n' % (len('v%d' % i), i, i) for i in range(0, 20, 2)) + 'MN\r\n'
+        self.assertEqual(call(request), expected.encode())
+
 def wait_for_memcache_tcp(timeout=4):
     s = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
     timeout_at = time.time() + timeout
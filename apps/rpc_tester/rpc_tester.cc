@@ -25,6 +25,7 @@
 #include <yaml-cpp/yaml.h>
 #include <fmt/core.h>
 #include <boost/range/irange.hpp>
+#include <boost/iterator/counting_iterator.hpp>
 #include <boost/accumulators/accumulators.hpp>
 #include <boost/accumulators/statistics/stats.hpp>
 #include <boost/accumulators/statistics/max.hpp>
@@ -37,7 +38,9 @@
 #include <seastar/core/sharded.hh>
 #include <seastar/core/with_scheduling_group.hh>
 #include <seastar/core/sleep.hh>
+#include <seastar/core/gate.hh>
 #include <seastar/rpc/rpc.hh>
+#include <seastar/rpc/lz4_fragmented_compressor.hh>
 
 using namespace seastar;
 using namespace boost::accumulators;
@@ -160,25 +163,59 @@ std::unique_ptr<pause_distribution> make_uniform_pause(duration_range range) {
     return std::make_unique<uniform_process>(range.min, range.max);
 }
 
+class poisson_process : public pause_distribution {
+    std::random_device _rd;
+    std::mt19937 _rng;
+    std::exponential_distribution<double> _exp;
+
+public:
+    poisson_process(std::chrono::duration<double> period)
+            : _rng(_rd()) , _exp(1.0 / period.count()) { }
+
+    std::chrono::duration<double> get() override {
+        return std::chrono::duration<double>(_exp(_rng));
+    }
+};
+
+std::unique_ptr<pause_distribution> make_poisson_pause(std::chrono::duration<double> d) {
+    return std::make_unique<poisson_process>(d);
+}
+
 struct client_config {
     bool nodelay = true;
+    bool compress = false;
+    std::chrono::microseconds busy_poll{0};
 };
 
 struct server_config {
     bool nodelay = true;
+    bool compress = false;
+    std::chrono::microseconds busy_poll{0};
+    bool napi_id = false;
+};
+
+struct verb_config {
+    std::string verb;
+    size_t payload = 0;
+    unsigned weight = 1;
+    // Payloads a stream call sends
+    unsigned messages = 16;
 };
 
 struct job_config {
     std::string name;
     std::string type;
-    std::string verb;
-    unsigned parallelism;
+    std::vector<verb_config> verbs;
+    unsigned parallelism = 0;
+    // Open loop: calls arrive at this rate regardless of how fast the
+    // previous ones complete
+    unsigned rps = 0;
+    std::string arrival = "steady";
     unsigned shares = 100;
     std::chrono::duration<double> exec_time;
     std::optional<duration_range> exec_time_range;
     std::optional<std::chrono::duration<double>> sleep_time;
     std::optional<duration_range> sleep_time_range;
-    size_t payload;
 
     bool client = false;
     bool server = false;
@@ -210,6 +247,12 @@ struct convert<client_config> {
         if (node["nodelay"]) {
             cfg.nodelay = node["nodelay"].as<bool>();
         }
+        if (node["compress"]) {
+            cfg.compress = node["compress"].as<bool>();
+        }
+        if (node["busy_poll"]) {
+            cfg.busy_poll = std::chrono::microseconds(node["busy_poll"].as<unsigned>());
+        }
         return true;
     }
 };
@@ -220,6 +263,34 @@ struct convert<server_config> {
         if (node["nodelay"]) {
             cfg.nodelay = node["nodelay"].as<bool>();
         }
+        if (node["compress"]) {
+            cfg.compress = node["compress"].as<bool>();
+        }
+        if (node["busy_poll"]) {
+            cfg.busy_poll = std::chrono::microseconds(node["busy_poll"].as<unsigned>());
+        }
+        if (node["napi_id"]) {
+            cfg.napi_id = node["napi_id"].as<bool>();
+        }
+        return true;
+    }
+};
+
+template <>
+struct convert<verb_config> {
+    static bool decode(const Node& node, verb_config& cfg) {
+        cfg.verb = node["verb"].as<std::string>();
+        if (node["payload"]) {
+            cfg.payload = node["payload"].as<byte_size>().size;
+        } else if (cfg.verb != "echo") {
+            return false;
+        }
+        if (node["weight"]) {
+            cfg.weight = node["weight"].as<unsigned>();
+        }
+        if (node["messages"]) {
+            cfg.messages = node["messages"].as<unsigned>();
+        }
         return true;
     }
 };
@@ -229,10 +300,24 @@ struct convert<job_config> {
     static bool decode(const Node& node, job_config& cfg) {
         cfg.name = node["name"].as<std::string>();
         cfg.type = node["type"].as<std::string>();
-        cfg.parallelism = node["parallelism"].as<unsigned>();
+        if (node["rps"]) {
+            cfg.rps = node["rps"].as<unsigned>();
+        }
+        if (node["arrival"]) {
+            cfg.arrival = node["arrival"].as<std::string>();
+            if (cfg.arrival != "steady" && cfg.arrival != "poisson") {
+                return false;
+            }
+        }
+        if (cfg.rps == 0 || node["parallelism"]) {
+            cfg.parallelism = node["parallelism"].as<unsigned>();
+        }
         if (cfg.type == "rpc") {
-            cfg.verb = node["verb"].as<std::string>();
-            cfg.payload = node["payload"].as<byte_size>().size;
+            if (node["verbs"]) {
+                cfg.verbs = node["verbs"].as<std::vector<verb_config>>();
+            } else {
+                cfg.verbs.push_back(node.as<verb_config>());
+            }
             cfg.client = true;
         } else if (cfg.type == "cpu") {
             if (node["execution_time"]) {
@@ -339,6 +424,7 @@ enum class rpc_verb : int32_t {
     BYE = 1,
     ECHO = 2,
     WRITE = 3,
+    STREAM = 4,
 };
 
 using rpc_protocol = rpc::protocol<serializer, rpc_verb>;
@@ -355,14 +441,29 @@ class job {
 class job_rpc : public job {
     using accumulator_type = accumulator_set<double, stats<tag::extended_p_square_quantile(quadratic), tag::mean, tag::max>>;
 
+    struct verb {
+        std::string name;
+        std::function<future<>()> call;
+        uint64_t messages = 0;
+        accumulator_type latencies;
+
+        verb(std::string n, std::function<future<>()> c)
+                : name(std::move(n)), call(std::move(c)), latencies(extended_p_square_probabilities = quantiles) {}
+    };
+
     job_config _cfg;
     socket_address _caddr;
     client_config _ccfg;
     rpc_protocol& _rpc;
     std::unique_ptr<rpc_protocol::client> _client;
-    std::function<future<>(unsigned)> _call;
+    std::vector<payload_t> _payloads;
+    std::vector<verb> _verbs;
+    std::random_device _rd;
+    std::mt19937 _rng;
+    std::discrete_distribution<unsigned> _pick;
     std::chrono::steady_clock::time_point _stop;
     uint64_t _total_messages = 0;
+    uint64_t _errors = 0;
     accumulator_type _latencies;
 
     future<> call_echo(unsigned dummy) {
@@ -376,24 +477,112 @@ class job_rpc : public job {
         });
     }
 
+    future<> call_stream(const payload_t& pl, unsigned messages) {
+        return _client->make_stream_sink<serializer, payload_t>().then([this, &pl, messages] (rpc::sink<payload_t> sink) {
+            auto reply = _rpc.make_client<uint64_t(rpc::sink<payload_t>)>(rpc_verb::STREAM)(*_client, sink);
+            auto sent = do_for_each(boost::counting_iterator<unsigned>(0), boost::counting_iterator<unsigned>(messages), [sink, &pl] (unsigned) mutable {
+                return sink(pl);
+            }).finally([sink] () mutable {
+                return sink.flush();
+            }).finally([sink] () mutable {
+                return sink.close();
+            });
+            return when_all_succeed(std::move(sent), std::move(reply)).then_unpack([exp = pl.size() * messages] (uint64_t res) {
+                assert(res == exp);
+            });
+        });
+    }
+
+    std::function<future<>()> make_call(const verb_config& vc, const payload_t& pl) {
+        if (vc.verb == "echo") {
+            return [this] { return call_echo(_total_messages); };
+        } else if (vc.verb == "write") {
+            return [this, &pl] { return call_write(_total_messages, pl); };
+        } else if (vc.verb == "stream") {
+            return [this, &pl, messages = vc.messages] { return call_stream(pl, messages); };
+        } else {
+            throw std::runtime_error("unknown verb");
+        }
+    }
+
+    verb& pick() {
+        return _verbs.size() == 1 ? _verbs.front() : _verbs[_pick(_rng)];
+    }
+
+    void account(verb& v, std::chrono::steady_clock::time_point start) {
+        std::chrono::microseconds lat = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+        _latencies(lat.count());
+        v.latencies(lat.count());
+    }
+
+    future<> run_closed_loop() {
+        return parallel_for_each(boost::irange(0u, _cfg.parallelism), [this] (auto dummy) {
+            return do_until([this] {
+                return std::chrono::steady_clock::now() > _stop;
+            }, [this] {
+                _total_messages++;
+                auto& v = pick();
+                v.messages++;
+                auto now = std::chrono::steady_clock::now();
+                return v.call().then([this, &v, start = now] {
+                    account(v, start);
+                });
+            });
+        });
+    }
+
+    // Latencies are counted from when a call was due, not from when it
+    // was sent, so that calls delayed by slow earlier ones count as slow
+    // as well, rather than being left out (coordinated omission)
+    future<> run_open_loop() {
+        auto period = std::chrono::duration<double>(1s) / _cfg.rps;
+        auto arrivals = _cfg.arrival == "poisson" ? make_poisson_pause(period) : make_steady_pause(period);
+        return do_with(gate(), std::move(arrivals), std::chrono::steady_clock::now(), [this] (gate& g, auto& arrivals, auto& next) {
+            return do_until([this] {
+                return std::chrono::steady_clock::now() > _stop;
+            }, [this, &g, &arrivals, &next] {
+                auto now = std::chrono::steady_clock::now();
+                auto f = next > now ? seastar::sleep(std::chrono::duration_cast<std::chrono::microseconds>(next - now)) : make_ready_future<>();
+                return f.then([this, &g, &arrivals, &next] {
+                    auto due = next;
+                    next += arrivals->template get_as<std::chrono::steady_clock::duration>();
+                    _total_messages++;
+                    auto& v = pick();
+                    v.messages++;
+                    (void)with_gate(g, [this, &v, due] {
+                        return v.call().then([this, &v, due] {
+                            account(v, due);
+                        });
+                    }).handle_exception([this] (std::exception_ptr) {
+                        _errors++;
+                    });
+                });
+            }).finally([&g] {
+                return g.close();
+            });
+        });
+    }
+
 public:
     job_rpc(job_config cfg, rpc_protocol& rpc, client_config ccfg, socket_address caddr)
             : _cfg(cfg)
             , _caddr(std::move(caddr))
             , _ccfg(ccfg)
             , _rpc(rpc)
+            , _rng(_rd())
             , _stop(std::chrono::steady_clock::now() + _cfg.duration)
             , _latencies(extended_p_square_probabilities = quantiles)
     {
-        if (_cfg.verb == "echo") {
-            _call = [this] (unsigned x) { return call_echo(x); };
-        } else if (_cfg.verb == "write") {
-            payload_t payload;
-            payload.resize(_cfg.payload / sizeof(payload_t::value_type), 0);
-            _call = [this, payload = std::move(payload)] (unsigned x) { return call_write(x, payload); };
-        } else {
-            throw std::runtime_error("unknown verb");
+        // The calls refer to the payloads, which must not move
+        _payloads.reserve(_cfg.verbs.size());
+        _verbs.reserve(_cfg.verbs.size());
+        std::vector<unsigned> weights;
+        for (auto& vc : _cfg.verbs) {
+            _payloads.emplace_back(vc.payload / sizeof(payload_t::value_type), 0);
+            _verbs.emplace_back(vc.verb, make_call(vc, _payloads.back()));
+            weights.push_back(vc.weight);
         }
+        _pick = std::discrete_distribution<unsigned>(weights.begin(), weights.end());
     }
 
     virtual std::string name() const override { return _cfg.name; }
@@ -403,37 +592,50 @@ class job_rpc : public job {
         rpc::client_options co;
         co.tcp_nodelay = _ccfg.nodelay;
         co.isolation_cookie = _cfg.sg_name;
+        if (_ccfg.compress) {
+            co.compressor_factory = &compressor_factory;
+        }
         _client = std::make_unique<rpc_protocol::client>(_rpc, co, _caddr);
-        return parallel_for_each(boost::irange(0u, _cfg.parallelism), [this] (auto dummy) {
-            return do_until([this] {
-                return std::chrono::steady_clock::now() > _stop;
-            }, [this, dummy] {
-                _total_messages++;
-                auto now = std::chrono::steady_clock::now();
-                return _call(dummy).then([this, start = now] {
-                    std::chrono::microseconds lat = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
-                    _latencies(lat.count());
-                });
-            });
-        }).finally([this] {
+        return (_cfg.rps ? run_open_loop() : run_closed_loop()).finally([this] {
             return _client->stop();
         });
       });
     }
 
-    virtual void emit_result(YAML::Emitter& out) const override {
-        out << YAML::Key << "messages" << YAML::Value << _total_messages;
+    static void emit_latencies(YAML::Emitter& out, const accumulator_type& latencies) {
         out << YAML::Key << "latencies" << YAML::Comment("usec");
         out << YAML::BeginMap;
-        out << YAML::Key << "average" << YAML::Value << (uint64_t)mean(_latencies);
+        out << YAML::Key << "average" << YAML::Value << (uint64_t)mean(latencies);
         for (auto& q: quantiles) {
-            out << YAML::Key << fmt::format("p{}", q) << YAML::Value << (uint64_t)quantile(_latencies, quantile_probability = q);
+            out << YAML::Key << fmt::format("p{}", q) << YAML::Value << (uint64_t)quantile(latencies, quantile_probability = q);
         }
-        out << YAML::Key << "max" << YAML::Value << (uint64_t)max(_latencies);
+        out << YAML::Key << "max" << YAML::Value << (uint64_t)max(latencies);
         out << YAML::EndMap;
     }
+
+    virtual void emit_result(YAML::Emitter& out) const override {
+        out << YAML::Key << "messages" << YAML::Value << _total_messages;
+        if (_cfg.rps) {
+            out << YAML::Key << "errors" << YAML::Value << _errors;
+        }
+        emit_latencies(out, _latencies);
+        if (_verbs.size() > 1) {
+            out << YAML::Key << "verbs" << YAML::BeginMap;
+            for (auto& v : _verbs) {
+                out << YAML::Key << v.name << YAML::BeginMap;
+                out << YAML::Key << "messages" << YAML::Value << v.messages;
+                emit_latencies(out, v.latencies);
+                out << YAML::EndMap;
+            }
+            out << YAML::EndMap;
+        }
+    }
+
+    static rpc::lz4_fragmented_compressor::factory compressor_factory;
 };
 
+rpc::lz4_fragmented_compressor::factory job_rpc::compressor_factory;
+
 class job_cpu : public job {
     job_config _cfg;
     std::chrono::steady_clock::time_point _stop;
@@ -550,10 +752,32 @@ class context {
         _rpc->register_handler(rpc_verb::WRITE, [] (payload_t val) {
             return make_ready_future<uint64_t>(val.size());
         });
+        _rpc->register_handler(rpc_verb::STREAM, [] (rpc::source<payload_t> source) {
+            return do_with(std::move(source), uint64_t(0), [] (rpc::source<payload_t>& source, uint64_t& received) {
+                return repeat([&source, &received] {
+                    return source().then([&received] (std::optional<std::tuple<payload_t>> data) {
+                        if (!data) {
+                            return stop_iteration::yes;
+                        }
+                        received += std::get<0>(*data).size();
+                        return stop_iteration::no;
+                    });
+                }).then([&received] {
+                    return received;
+                });
+            });
+        });
 
         if (laddr) {
             rpc::server_options so;
             so.tcp_nodelay = _cfg.server.nodelay;
+            so.busy_poll = _cfg.server.busy_poll;
+            if (_cfg.server.napi_id) {
+                so.load_balancing_algorithm = server_socket::load_balancing_algorithm::napi_id;
+            }
+            if (_cfg.server.compress) {
+                so.compressor_factory = &job_rpc::compressor_factory;
+            }
             rpc::resource_limits limits;
             limits.isolate_connection = [this] (sstring cookie) { return isolate_connection(cookie); };
             _server = std::make_unique<rpc_protocol::server>(*_rpc, so, *laddr, limits);
@@ -568,6 +792,10 @@ class context {
         if (caddr) {
             rpc::client_options co;
             co.tcp_nodelay = _cfg.client.nodelay;
+            co.busy_poll = _cfg.client.busy_poll;
+            if (_cfg.client.compress) {
+                co.compressor_factory = &job_rpc::compressor_factory;
+            }
             _client = std::make_unique<rpc_protocol::client>(*_rpc, co, *caddr);
 
             for (auto&& jc : _cfg.jobs) {
@@ -26,7 +26,12 @@
 #include <seastar/core/app-template.hh>
 #include <seastar/core/distributed.hh>
 #include <seastar/core/semaphore.hh>
+#include <seastar/core/sleep.hh>
+#include <seastar/core/when_all.hh>
+#include <seastar/core/internal/log_histogram.hh>
+#include <boost/range/irange.hpp>
 #include <chrono>
+#include <deque>
 
 using namespace seastar;
 
@@ -37,25 +42,60 @@ void http_debug(const char* fmt, Args&&... args) {
 #endif
 }
 
+using clock_type = steady_clock_type;
+
+struct latency_stats {
+    // Microseconds, up to 2^24
+    internal::latency_histogram<4, 400> histogram;
+    clock_type::duration max{};
+
+    latency_stats& operator+=(const latency_stats& o) {
+        histogram += o.histogram;
+        max = std::max(max, o.max);
+        return *this;
+    }
+};
+
 class http_client {
 private:
+    // The requests of one of the connections of the shard. Without
+    // keep-alive, each request of the slot opens a connection of its own.
+    struct slot {
+        uint64_t sent = 0;
+        // Open loop: when the next request is due
+        clock_type::time_point next_due;
+    };
+
     unsigned _duration;
     unsigned _conn_per_core;
     unsigned _reqs_per_conn;
+    unsigned _depth;
+    // Open loop: between the requests of a slot
+    std::optional<clock_type::duration> _period;
+    bool _keep_alive;
+    ipv4_addr _server_addr;
+    sstring _request;
     std::vector<connected_socket> _sockets;
+    std::vector<slot> _slots;
     semaphore _conn_connected{0};
-    semaphore _conn_finished{0};
     timer<> _run_timer;
     bool _timer_based;
     bool _timer_done{false};
     uint64_t _total_reqs{0};
+    latency_stats _latencies;
 public:
-    http_client(unsigned duration, unsigned total_conn, unsigned reqs_per_conn)
+    http_client(unsigned duration, unsigned total_conn, unsigned reqs_per_conn, unsigned depth, unsigned rate, bool keep_alive, sstring path)
         : _duration(duration)
         , _conn_per_core(total_conn / smp::count)
         , _reqs_per_conn(reqs_per_conn)
+        , _depth(keep_alive ? depth : 1)
+        , _keep_alive(keep_alive)
+        , _request(format("GET {} HTTP/1.1\r\nHost: 127.0.0.1:10000\r\n{}\r\n", path, keep_alive ? "" : "Connection: close\r\n"))
         , _run_timer([this] { _timer_done = true; })
         , _timer_based(reqs_per_conn == 0) {
+        if (rate) {
+            _period = std::chrono::duration_cast<clock_type::duration>(std::chrono::duration<double>(double(total_conn) / rate));
+        }
     }
 
     class connection {
@@ -65,50 +105,123 @@ class http_client {
         output_stream<char> _write_buf;
         http_response_parser _parser;
         http_client* _http_client;
-        uint64_t _nr_done{0};
-    public:
-        connection(connected_socket&& fd, http_client* client)
-            : _fd(std::move(fd))
-            , _read_buf(_fd.input())
-            , _write_buf(_fd.output())
-            , _http_client(client){
+        slot& _slot;
+        // Of the first request, when it waited for its time before the
+        // connection was opened
+        std::optional<clock_type::time_point> _first_due;
+        // When the requests in flight were due, oldest first
+        std::deque<clock_type::time_point> _in_flight;
+        semaphore _window;
+        // Signalled for every request sent, and once more when done sending
+        semaphore _sent{0};
+        uint64_t _nr_sent{0};
+
+        bool sending_done() const {
+            return _http_client->done(_slot) || (!_http_client->_keep_alive && _nr_sent);
         }
 
-        uint64_t nr_done() {
-            return _nr_done;
+        future<clock_type::time_point> next_due() {
+            if (auto due = std::exchange(_first_due, std::nullopt)) {
+                return make_ready_future<clock_type::time_point>(*due);
+            }
+            return _http_client->next_due(_slot);
         }
 
-        future<> do_req() {
-            return _write_buf.write("GET / HTTP/1.1\r\nHost: 127.0.0.1:10000\r\n\r\n").then([this] {
-                return _write_buf.flush();
-            }).then([this] {
-                _parser.init();
-                return _read_buf.consume(_parser).then([this] {
-                    // Read HTTP response header first
-                    if (_parser.eof()) {
-                        return make_ready_future<>();
-                    }
-                    auto _rsp = _parser.get_parsed_response();
-                    auto it = _rsp->_headers.find("Content-Length");
-                    if (it == _rsp->_headers.end()) {
-                        fmt::print("Error: HTTP response does not contain: Content-Length\n");
-                        return make_ready_future<>();
+        future<> send_loop() {
+            return repeat([this] {
+                if (sending_done()) {
+                    return make_ready_future<stop_iteration>(stop_iteration::yes);
+                }
+                return next_due().then([this] (clock_type::time_point due) {
+                    return _window.wait(1).then([this, due] () mutable {
+                        if (!_http_client->_period && _http_client->_keep_alive) {
+                            // Not while waiting for room in the pipeline
+                            due = clock_type::now();
+                        }
+                        if (sending_done()) {
+                            _window.signal(1);
+                            return make_ready_future<stop_iteration>(stop_iteration::yes);
+                        }
+                        _slot.sent++;
+                        _nr_sent++;
+                        _in_flight.push_back(due);
+                        _sent.signal();
+                        return _write_buf.write(_http_client->_request).then([this] {
+                            return _write_buf.flush();
+                        }).then([] {
+                            return stop_iteration::no;
+                        });
+                    });
+                });
+            }).finally([this] {
+                _sent.signal();
+            });
+        }
+
+        // Reads a response, false at EOF
+        future<bool> read_response() {
+            _parser.init();
+            return _read_buf.consume(_parser).then([this] {
+                // Read HTTP response header first
+                if (_parser.eof()) {
+                    return make_ready_future<bool>(false);
+                }
+                auto _rsp = _parser.get_parsed_response();
+                auto it = _rsp->_headers.find("Content-Length");
+                if (it == _rsp->_headers.end()) {
+                    fmt::print("Error: HTTP response does not contain: Content-Length\n");
+                    return make_ready_future<bool>(false);
+                }
+                auto content_len = std::stoi(it->second);
+                http_debug("Content-Length = %d\n", content_len);
+                // Read HTTP response body
+                return _read_buf.read_exactly(content_len).then([] (temporary_buffer<char> buf) {
+                    http_debug("%s\n", buf.get());
+                    return true;
+                });
+            });
+        }
+
+        future<> recv_loop() {
+            return repeat([this] {
+                return _sent.wait(1).then([this] {
+                    if (_in_flight.empty()) {
+                        // Done sending, and all responses are in
+                        return make_ready_future<stop_iteration>(stop_iteration::yes);
                     }
-                    auto content_len = std::stoi(it->second);
-                    http_debug("Content-Length = %d\n", content_len);
-                    // Read HTTP response body
-                    return _read_buf.read_exactly(content_len).then([this] (temporary_buffer<char> buf) {
-                        _nr_done++;
-                        http_debug("%s\n", buf.get());
-                        if (_http_client->done(_nr_done)) {
-                            return make_ready_future();
-                        } else {
-                            return do_req();
+                    return read_response().then([this] (bool ok) {
+                        if (!ok) {
+                            _window.broken();
+                            return stop_iteration::yes;
                         }
+                        _http_client->account(_in_flight.front());
+                        _in_flight.pop_front();
+                        _window.signal(1);
+                        return stop_iteration::no;
                     });
                 });
             });
         }
+    public:
+        connection(connected_socket&& fd, http_client* client, slot& s, std::optional<clock_type::time_point> first_due = std::nullopt)
+            : _fd(std::move(fd))
+            , _read_buf(_fd.input())
+            , _write_buf(_fd.output())
+            , _http_client(client)
+            , _slot(s)
+            , _first_due(first_due)
+            , _window(client->_depth) {
+        }
+
+        // Up to depth requests are in flight, their responses come in the
+        // order they were sent in (HTTP/1.1 pipelining)
+        future<> run() {
+            return when_all_succeed(send_loop(), recv_loop()).discard_result().finally([this] {
+                return _write_buf.close().finally([this] {
+                    return _read_buf.close();
+                });
+            });
+        }
     };
 
     future<uint64_t> total_reqs() {
@@ -116,15 +229,50 @@ class http_client {
         return make_ready_future<uint64_t>(_total_reqs);
     }
 
-    bool done(uint64_t nr_done) {
+    latency_stats latencies() const {
+        return _latencies;
+    }
+
+    bool done(const slot& s) const {
         if (_timer_based) {
             return _timer_done;
         } else {
-            return nr_done >= _reqs_per_conn;
+            return s.sent >= _reqs_per_conn;
         }
     }
 
+    // When the next request of the slot is due, once it is. Closed loop
+    // requests are due when there is room for them, open loop ones on
+    // schedule, so that a slow response delays the requests after it
+    // rather than their deadlines (no coordinated omission).
+    future<clock_type::time_point> next_due(slot& s) {
+        auto now = clock_type::now();
+        if (!_period) {
+            return make_ready_future<clock_type::time_point>(now);
+        }
+        auto due = s.next_due;
+        s.next_due += *_period;
+        if (due <= now) {
+            return make_ready_future<clock_type::time_point>(due);
+        }
+        return seastar::sleep(std::chrono::duration_cast<std::chrono::microseconds>(due - now)).then([due] {
+            return due;
+        });
+    }
+
+    void account(clock_type::time_point due) {
+        auto lat = clock_type::now() - due;
+        _latencies.histogram.add(lat);
+        _latencies.max = std::max(_latencies.max, lat);
+        _total_reqs++;
+    }
+
     future<> connect(ipv4_addr server_addr) {
+        _server_addr = server_addr;
+        if (!_keep_alive) {
+            // Every request connects
+            return make_ready_future<>();
+        }
         // Establish all the TCP connections first
         for (unsigned i = 0; i < _conn_per_core; i++) {
             // Connect in the background, signal _conn_connected when done.
@@ -137,32 +285,40 @@ class http_client {
         return _conn_connected.wait(_conn_per_core);
     }
 
+    future<> run_slot(unsigned i) {
+        auto& s = _slots[i];
+        if (_keep_alive) {
+            auto conn = std::make_unique<connection>(std::move(_sockets[i]), this, s);
+            return conn->run().finally([conn = std::move(conn)] {});
+        }
+        return do_until([this, &s] { return done(s); }, [this, &s] {
+            // The connection is part of the request
+            return next_due(s).then([this, &s] (clock_type::time_point due) {
+                return seastar::connect(make_ipv4_address(_server_addr)).then([this, &s, due] (connected_socket fd) {
+                    auto conn = std::make_unique<connection>(std::move(fd), this, s, due);
+                    return conn->run().finally([conn = std::move(conn)] {});
+                });
+            });
+        });
+    }
+
     future<> run() {
         // All connected, start HTTP request
         http_debug("Established all %6d tcp connections on cpu %3d\n", _conn_per_core, this_shard_id());
         if (_timer_based) {
             _run_timer.arm(std::chrono::seconds(_duration));
         }
-        for (auto&& fd : _sockets) {
-            auto conn = new connection(std::move(fd), this);
-            // Run in the background, signal _conn_finished when done.
-            (void)conn->do_req().then_wrapped([this, conn] (auto&& f) {
-                http_debug("Finished connection %6d on cpu %3d\n", _conn_finished.current(), this_shard_id());
-                _total_reqs += conn->nr_done();
-                _conn_finished.signal();
-                delete conn;
-                // FIXME: should _conn_finished.signal be called only after this?
-                // nothing seems to synchronize with this background work.
-                try {
-                    f.get();
-                } catch (std::exception& ex) {
-                    fmt::print("http request error: {}\n", ex.what());
-                }
-            });
+        auto now = clock_type::now();
+        _slots.resize(_conn_per_core);
+        for (unsigned i = 0; i < _conn_per_core; i++) {
+            // Spread the slots over the period, not to send in bursts
+            _slots[i].next_due = now + (_period ? *_period * i / _conn_per_core : clock_type::duration(0));
         }
-
-        // All finished
-        return _conn_finished.wait(_conn_per_core);
+        return parallel_for_each(boost::irange(0u, _conn_per_core), [this] (unsigned i) {
+            return run_slot(i).handle_exception([] (std::exception_ptr ep) {
+                fmt::print("http request error: {}\n", ep);
+            });
+        });
     }
     future<> stop() {
         return make_ready_future();
@@ -180,7 +336,11 @@ int main(int ac, char** av) {
         ("server,s", bpo::value<std::string>()->default_value("192.168.66.100:10000"), "Server address")
         ("conn,c", bpo::value<unsigned>()->default_value(100), "total connections")
         ("reqs,r", bpo::value<unsigned>()->default_value(0), "reqs per connection")
-        ("duration,d", bpo::value<unsigned>()->default_value(10), "duration of the test in seconds)");
+        ("duration,d", bpo::value<unsigned>()->default_value(10), "duration of the test in seconds)")
+        ("pipeline,p", bpo::value<unsigned>()->default_value(1), "requests in flight on each connection (HTTP/1.1 pipelining)")
+        ("rate", bpo::value<unsigned>()->default_value(0), "total requests per second, sent on schedule whatever the response times (open loop); 0 to send requests as responses come")
+        ("keep-alive", bpo::value<bool>()->default_value(true), "send all the requests of a connection over one TCP connection; with false, open one for every request")
+        ("path", bpo::value<std::string>()->default_value("/"), "path to request, e.g. one of the /bench routes of apps/httpd");
 
     return app.run(ac, av, [&app] () -> future<int> {
         auto& config = app.configuration();
@@ -188,11 +348,19 @@ int main(int ac, char** av) {
         auto reqs_per_conn = config["reqs"].as<unsigned>();
         auto total_conn= config["conn"].as<unsigned>();
         auto duration = config["duration"].as<unsigned>();
+        auto depth = config["pipeline"].as<unsigned>();
+        auto rate = config["rate"].as<unsigned>();
+        auto keep_alive = config["keep-alive"].as<bool>();
+        auto path = config["path"].as<std::string>();
 
         if (total_conn % smp::count != 0) {
             fmt::print("Error: conn needs to be n * cpu_nr\n");
             return make_ready_future<int>(-1);
         }
+        if (depth == 0) {
+            fmt::print("Error: pipeline needs to be at least 1\n");
+            return make_ready_future<int>(-1);
+        }
 
         auto http_clients = new distributed<http_client>;
 
@@ -202,7 +370,11 @@ int main(int ac, char** av) {
         fmt::print("Server: {}\n", server);
         fmt::print("Connections: {:d}\n", total_conn);
         fmt::print("Requests/connection: {}\n", reqs_per_conn == 0 ? "dynamic (timer based)" : std::to_string(reqs_per_conn));
-        return http_clients->start(std::move(duration), std::move(total_conn), std::move(reqs_per_conn)).then([http_clients, server] {
+        fmt::print("Pipeline depth: {:d}\n", keep_alive ? depth : 1);
+        fmt::print("Rate: {}\n", rate == 0 ? "closed loop" : fmt::format("{:d} requests/sec", rate));
+        fmt::print("Keep-alive: {}\n", keep_alive ? "yes" : "no");
+        fmt::print("Path: {}\n", path);
+        return http_clients->start(std::move(duration), std::move(total_conn), std::move(reqs_per_conn), depth, rate, keep_alive, sstring(path)).then([http_clients, server] {
             return http_clients->invoke_on_all(&http_client::connect, ipv4_addr{server});
         }).then([http_clients] {
             return http_clients->invoke_on_all(&http_client::run);
@@ -213,18 +385,28 @@ int main(int ac, char** av) {
            auto finished = steady_clock_type::now();
            auto elapsed = finished - started;
            auto secs = static_cast<double>(elapsed.count() / 1000000000.0);
-           fmt::print("Total cpus: {:d}\n", smp::count);
-           fmt::print("Total requests: {:d}\n", total_reqs);
-           fmt::print("Total time: {:f}\n", secs);
-           fmt::print("Requests/sec: {:f}\n", static_cast<double>(total_reqs) / secs);
-           fmt::print("==========     done     ============\n");
-           return http_clients->stop().then([http_clients] {
-               // FIXME: If we call engine().exit(0) here to exit when
-               // requests are done. The tcp connection will not be closed
-               // properly, becasue we exit too earily and the FIN packets are
-               // not exchanged.
-                delete http_clients;
-                return make_ready_future<int>(0);
+           return http_clients->map_reduce0(std::mem_fn(&http_client::latencies), latency_stats(), [] (latency_stats a, const latency_stats& b) {
+               a += b;
+               return a;
+           }).then([http_clients, total_reqs, secs] (latency_stats lat) {
+               fmt::print("Total cpus: {:d}\n", smp::count);
+               fmt::print("Total requests: {:d}\n", total_reqs);
+               fmt::print("Total time: {:f}\n", secs);
+               fmt::print("Requests/sec: {:f}\n", static_cast<double>(total_reqs) / secs);
+               fmt::print("Latency (usec):\n");
+               for (auto p : {0.5, 0.9, 0.99, 0.999}) {
+                   fmt::print("  p{}: {:d}\n", p * 100, lat.histogram.percentile(p));
+               }
+               fmt::print("  max: {:d}\n", std::chrono::duration_cast<std::chrono::microseconds>(lat.max).count());
+               fmt::print("==========     done     ============\n");
+               return http_clients->stop().then([http_clients] {
+                   // FIXME: If we call engine().exit(0) here to exit when
+                   // requests are done. The tcp connection will not be closed
+                   // properly, becasue we exit too earily and the FIN packets are
+                   // not exchanged.
+                    delete http_clients;
+                    return make_ready_future<int>(0);
+               });
            });
         });
     });
@@ -43,13 +43,27 @@ if (URING_INCLUDE_DIR)
   list(APPEND CMAKE_REQUIRED_INCLUDES ${URING_INCLUDE_DIR})
   CHECK_STRUCT_HAS_MEMBER ("struct io_uring" features liburing.h
     HAVE_IOURING_FEATURES LANGUAGE CXX)
+  list(APPEND CMAKE_REQUIRED_LIBRARIES ${URING_LIBRARY})
+  include (CheckCXXSymbolExists)
+  # provided buffer rings, liburing 2.2
+  CHECK_CXX_SYMBOL_EXISTS (io_uring_register_buf_ring liburing.h
+    HAVE_IOURING_BUF_RING)
+  # zero-copy sendmsg, liburing 2.3
+  CHECK_CXX_SYMBOL_EXISTS (io_uring_prep_sendmsg_zc liburing.h
+    HAVE_IOURING_SEND_ZC)
+  # submitting and waiting with a signal mask in one call, liburing 2.2
+  CHECK_CXX_SYMBOL_EXISTS (io_uring_submit_and_wait_timeout liburing.h
+    HAVE_IOURING_SUBMIT_AND_WAIT_TIMEOUT)
   cmake_pop_check_state ()
 endif ()
 
 mark_as_advanced (
   URING_LIBRARY
   URING_INCLUDE_DIR
-  HAVE_IOURING_FEATURES)
+  HAVE_IOURING_FEATURES
+  HAVE_IOURING_BUF_RING
+  HAVE_IOURING_SEND_ZC
+  HAVE_IOURING_SUBMIT_AND_WAIT_TIMEOUT)
 
 
 include (FindPackageHandleStandardArgs)
@@ -0,0 +1,71 @@
+#
+# This file is open source software, licensed to you under the terms
+# of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+# distributed with this work for additional information regarding copyright
+# ownership.  You may not use this file except in compliance with the License.
+#
+# You may obtain a copy of the License at
+#
+#   http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing,
+# software distributed under the License is distributed on an
+# "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+# KIND, either express or implied.  See the License for the
+# specific language governing permissions and limitations
+# under the License.
+#
+
+#
+# Copyright (C) 2023 ScyllaDB
+#
+
+find_package (PkgConfig REQUIRED)
+
+pkg_search_module (XDP libxdp)
+pkg_search_module (BPF libbpf)
+
+find_library (XDP_LIBRARY
+  NAMES xdp
+  HINTS
+    ${XDP_PC_LIBDIR}
+    ${XDP_PC_LIBRARY_DIRS})
+
+find_library (BPF_LIBRARY
+  NAMES bpf
+  HINTS
+    ${BPF_PC_LIBDIR}
+    ${BPF_PC_LIBRARY_DIRS})
+
+find_path (XDP_INCLUDE_DIR
+  NAMES xdp/xsk.h
+  HINTS
+    ${XDP_PC_INCLUDEDIR}
+    ${XDP_PC_INCLUDE_DIRS})
+
+mark_as_advanced (
+  XDP_LIBRARY
+  BPF_LIBRARY
+  XDP_INCLUDE_DIR)
+
+include (FindPackageHandleStandardArgs)
+
+find_package_handle_standard_args (LibXdp
+  REQUIRED_VARS
+    XDP_LIBRARY
+    BPF_LIBRARY
+    XDP_INCLUDE_DIR
+  VERSION_VAR XDP_PC_VERSION)
+
+set (XDP_LIBRARIES ${XDP_LIBRARY} ${BPF_LIBRARY})
+set (XDP_INCLUDE_DIRS ${XDP_INCLUDE_DIR})
+
+if (LibXdp_FOUND AND NOT (TARGET XDP::xdp))
+  add_library (XDP::xdp UNKNOWN IMPORTED)
+
+  set_target_properties (XDP::xdp
+    PROPERTIES
+      IMPORTED_LOCATION ${XDP_LIBRARY}
+      INTERFACE_INCLUDE_DIRECTORIES ${XDP_INCLUDE_DIRS}
+      INTERFACE_LINK_LIBRARIES ${BPF_LIBRARY})
+endif ()
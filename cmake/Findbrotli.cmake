@@ -0,0 +1,60 @@
+#
+# This file is open source software, licensed to you under the terms
+# of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+# distributed with this work for additional information regarding copyright
+# ownership.  You may not use this file except in compliance with the License.
+#
+# You may obtain a copy of the License at
+#
+#   http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing,
+# software distributed under the License is distributed on an
+# "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+# KIND, either express or implied.  See the License for the
+# specific language governing permissions and limitations
+# under the License.
+#
+
+#
+# Copyright (C) 2023 ScyllaDB
+#
+find_package (PkgConfig REQUIRED)
+
+pkg_search_module (brotli_PC libbrotlienc)
+
+find_library (brotli_LIBRARY
+  NAMES brotlienc
+  HINTS
+    ${brotli_PC_LIBDIR}
+    ${brotli_PC_LIBRARY_DIRS})
+
+find_path (brotli_INCLUDE_DIR
+  NAMES brotli/encode.h
+  HINTS
+    ${brotli_PC_INCLUDEDIR}
+    ${brotli_PC_INCLUDEDIRS})
+
+mark_as_advanced (
+  brotli_LIBRARY
+  brotli_INCLUDE_DIR)
+
+include (FindPackageHandleStandardArgs)
+
+find_package_handle_standard_args (brotli
+  REQUIRED_VARS
+    brotli_LIBRARY
+    brotli_INCLUDE_DIR
+  VERSION_VAR brotli_PC_VERSION)
+
+set (brotli_LIBRARIES ${brotli_LIBRARY})
+set (brotli_INCLUDE_DIRS ${brotli_INCLUDE_DIR})
+
+if (brotli_FOUND AND NOT (TARGET brotli::brotli))
+  add_library (brotli::brotli UNKNOWN IMPORTED)
+
+  set_target_properties (brotli::brotli
+    PROPERTIES
+      IMPORTED_LOCATION ${brotli_LIBRARY}
+      INTERFACE_INCLUDE_DIRECTORIES ${brotli_INCLUDE_DIRS})
+endif ()
@@ -0,0 +1,85 @@
+#
+# This file is open source software, licensed to you under the terms
+# of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+# distributed with this work for additional information regarding copyright
+# ownership.  You may not use this file except in compliance with the License.
+#
+# You may obtain a copy of the License at
+#
+#   http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing,
+# software distributed under the License is distributed on an
+# "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+# KIND, either express or implied.  See the License for the
+# specific language governing permissions and limitations
+# under the License.
+#
+
+#
+# Copyright (C) 2023 ScyllaDB
+#
+find_package (PkgConfig REQUIRED)
+
+pkg_search_module (ngtcp2_PC libngtcp2)
+pkg_search_module (ngtcp2_crypto_gnutls_PC libngtcp2_crypto_gnutls)
+
+find_library (ngtcp2_LIBRARY
+  NAMES ngtcp2
+  HINTS
+    ${ngtcp2_PC_LIBDIR}
+    ${ngtcp2_PC_LIBRARY_DIRS})
+
+find_library (ngtcp2_crypto_gnutls_LIBRARY
+  NAMES ngtcp2_crypto_gnutls
+  HINTS
+    ${ngtcp2_crypto_gnutls_PC_LIBDIR}
+    ${ngtcp2_crypto_gnutls_PC_LIBRARY_DIRS})
+
+find_path (ngtcp2_INCLUDE_DIR
+  NAMES ngtcp2/ngtcp2.h
+  HINTS
+    ${ngtcp2_PC_INCLUDEDIR}
+    ${ngtcp2_PC_INCLUDEDIRS})
+
+find_path (ngtcp2_crypto_gnutls_INCLUDE_DIR
+  NAMES ngtcp2/ngtcp2_crypto_gnutls.h
+  HINTS
+    ${ngtcp2_crypto_gnutls_PC_INCLUDEDIR}
+    ${ngtcp2_crypto_gnutls_PC_INCLUDEDIRS})
+
+mark_as_advanced (
+  ngtcp2_LIBRARY
+  ngtcp2_crypto_gnutls_LIBRARY
+  ngtcp2_INCLUDE_DIR
+  ngtcp2_crypto_gnutls_INCLUDE_DIR)
+
+include (FindPackageHandleStandardArgs)
+
+find_package_handle_standard_args (ngtcp2
+  REQUIRED_VARS
+    ngtcp2_LIBRARY
+    ngtcp2_crypto_gnutls_LIBRARY
+    ngtcp2_INCLUDE_DIR
+    ngtcp2_crypto_gnutls_INCLUDE_DIR
+  VERSION_VAR ngtcp2_PC_VERSION)
+
+set (ngtcp2_LIBRARIES ${ngtcp2_crypto_gnutls_LIBRARY} ${ngtcp2_LIBRARY})
+set (ngtcp2_INCLUDE_DIRS ${ngtcp2_INCLUDE_DIR} ${ngtcp2_crypto_gnutls_INCLUDE_DIR})
+
+if (ngtcp2_FOUND AND NOT (TARGET ngtcp2::ngtcp2))
+  add_library (ngtcp2::ngtcp2 UNKNOWN IMPORTED)
+
+  set_target_properties (ngtcp2::ngtcp2
+    PROPERTIES
+      IMPORTED_LOCATION ${ngtcp2_LIBRARY}
+      INTERFACE_INCLUDE_DIRECTORIES "${ngtcp2_INCLUDE_DIRS}")
+
+  add_library (ngtcp2::crypto_gnutls UNKNOWN IMPORTED)
+
+  set_target_properties (ngtcp2::crypto_gnutls
+    PROPERTIES
+      IMPORTED_LOCATION ${ngtcp2_crypto_gnutls_LIBRARY}
+      INTERFACE_INCLUDE_DIRECTORIES "${ngtcp2_INCLUDE_DIRS}"
+      INTERFACE_LINK_LIBRARIES ngtcp2::ngtcp2)
+endif ()
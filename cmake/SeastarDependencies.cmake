@@ -92,6 +92,7 @@ macro (seastar_find_dependencies)
     Concepts
     GnuTLS
     LibUring
+    LibXdp
     LinuxMembarrier
     Sanitizers
     SourceLocation
@@ -100,7 +101,11 @@ macro (seastar_find_dependencies)
     lksctp-tools # No version information published.
     numactl # No version information published.
     rt
-    yaml-cpp)
+    yaml-cpp
+    zstd
+    ZLIB
+    brotli
+    ngtcp2)
 
   # Arguments to `find_package` for each 3rd-party dependency.
   # Note that the version specification is a "minimal" version requirement.
@@ -130,6 +135,8 @@ macro (seastar_find_dependencies)
   seastar_set_dep_args (LibUring
     VERSION 2.0
     OPTION ${Seastar_IO_URING})
+  seastar_set_dep_args (LibXdp
+    OPTION ${Seastar_XDP})
   seastar_set_dep_args (StdAtomic REQUIRED)
   seastar_set_dep_args (hwloc
     VERSION 1.11.2
@@ -140,6 +147,17 @@ macro (seastar_find_dependencies)
     OPTION ${Seastar_NUMA})
   seastar_set_dep_args (yaml-cpp REQUIRED
     VERSION 0.5.1)
+  seastar_set_dep_args (zstd
+    VERSION 1.4.0
+    OPTION ${Seastar_ZSTD})
+  seastar_set_dep_args (ZLIB REQUIRED
+    VERSION 1.2.0)
+  seastar_set_dep_args (brotli
+    VERSION 1.0.0
+    OPTION ${Seastar_BROTLI})
+  seastar_set_dep_args (ngtcp2
+    VERSION 1.0.0
+    OPTION ${Seastar_QUIC})
 
   foreach (third_party ${_seastar_all_dependencies})
     if (NOT _seastar_dep_skip_${third_party})
@@ -113,6 +113,26 @@ add_tristate(
     name='io_uring',
     dest='io_uring',
     help='Support io_uring via liburing')
+add_tristate(
+    arg_parser,
+    name='xdp',
+    dest='xdp',
+    help='AF_XDP network backend via libxdp')
+add_tristate(
+    arg_parser,
+    name='zstd',
+    dest='zstd',
+    help='zstd RPC compressor via libzstd')
+add_tristate(
+    arg_parser,
+    name='brotli',
+    dest='brotli',
+    help='brotli HTTP response compression via libbrotlienc')
+add_tristate(
+    arg_parser,
+    name='quic',
+    dest='quic',
+    help='QUIC transport via ngtcp2')
 arg_parser.add_argument('--allocator-page-size', dest='alloc_page_size', type=int, help='override allocator page size')
 arg_parser.add_argument('--without-tests', dest='exclude_tests', action='store_true', help='Do not build tests by default')
 arg_parser.add_argument('--without-apps', dest='exclude_apps', action='store_true', help='Do not build applications by default')
@@ -202,6 +222,10 @@ def configure_mode(mode):
         tr(infer_dpdk_machine(args.user_cflags), 'DPDK_MACHINE'),
         tr(args.hwloc, 'HWLOC', value_when_none='yes'),
         tr(args.io_uring, 'IO_URING', value_when_none=None),
+        tr(args.xdp, 'XDP'),
+        tr(args.zstd, 'ZSTD'),
+        tr(args.brotli, 'BROTLI'),
+        tr(args.quic, 'QUIC'),
         tr(args.alloc_failure_injection, 'ALLOC_FAILURE_INJECTION', value_when_none='DEFAULT'),
         tr(args.task_backtrace, 'TASK_BACKTRACE'),
         tr(args.alloc_page_size, 'ALLOC_PAGE_SIZE'),
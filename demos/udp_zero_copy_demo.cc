@@ -71,7 +71,7 @@ class server {
             _n_sent++;
         });
     }
-    void start(int chunk_size, bool copy, size_t mem_size) {
+    void start(int chunk_size, bool copy, size_t mem_size, size_t batch) {
         ipv4_addr listen_addr{10000};
         _chan = make_udp_channel(listen_addr);
 
@@ -104,33 +104,41 @@ class server {
         assert(3 * _chunk_size <= _packet_size);
 
         // Run sender in background.
-        (void)keep_doing([this] {
-            return _chan.receive().then([this] (udp_datagram dgram) {
-                auto chunk = next_chunk();
-                lw_shared_ptr<sstring> item;
-                if (_copy) {
-                    _packets.clear();
-                    // FIXME: future is discarded
-                    (void)_out->write(chunk, _chunk_size);
-                    chunk += _chunk_size;
-                    (void)_out->write(chunk, _chunk_size);
-                    chunk += _chunk_size;
-                    (void)_out->write(chunk, _chunk_size);
-                    (void)_out->flush();
-                    assert(_packets.size() == 1);
-                    return send(dgram.get_src(), std::move(_packets[0]));
-                } else {
-                    auto chunk = next_chunk();
-                    scattered_message<char> msg;
-                    msg.reserve(3);
-                    msg.append_static(chunk, _chunk_size);
-                    msg.append_static(chunk, _chunk_size);
-                    msg.append_static(chunk, _chunk_size);
-                    return send(dgram.get_src(), std::move(msg).release());
-                }
+        (void)keep_doing([this, batch] {
+            return _chan.receive_batch(batch).then([this] (std::vector<udp_datagram> dgrams) {
+                return do_with(std::move(dgrams), [this] (std::vector<udp_datagram>& dgrams) {
+                    return do_for_each(dgrams, [this] (udp_datagram& dgram) {
+                        return respond(dgram);
+                    });
+                });
             });
         });
     }
+private:
+    future<> respond(udp_datagram& dgram) {
+        auto chunk = next_chunk();
+        lw_shared_ptr<sstring> item;
+        if (_copy) {
+            _packets.clear();
+            // FIXME: future is discarded
+            (void)_out->write(chunk, _chunk_size);
+            chunk += _chunk_size;
+            (void)_out->write(chunk, _chunk_size);
+            chunk += _chunk_size;
+            (void)_out->write(chunk, _chunk_size);
+            (void)_out->flush();
+            assert(_packets.size() == 1);
+            return send(dgram.get_src(), std::move(_packets[0]));
+        } else {
+            auto chunk = next_chunk();
+            scattered_message<char> msg;
+            msg.reserve(3);
+            msg.append_static(chunk, _chunk_size);
+            msg.append_static(chunk, _chunk_size);
+            msg.append_static(chunk, _chunk_size);
+            return send(dgram.get_src(), std::move(msg).release());
+        }
+    }
 };
 
 int main(int ac, char ** av) {
@@ -142,12 +150,15 @@ int main(int ac, char ** av) {
         ("mem-size", bpo::value<int>()->default_value(512),
              "Memory pool size in MiB")
         ("copy", "Copy data rather than send via zero-copy")
+        ("batch", bpo::value<unsigned>()->default_value(32),
+             "Maximum number of requests received at once")
         ;
     return app.run_deprecated(ac, av, [&app, &s] {
         auto&& config = app.configuration();
         auto chunk_size = config["chunk-size"].as<int>();
         auto mem_size = (size_t)config["mem-size"].as<int>() * MB;
         auto copy = config.count("copy");
-        s.start(chunk_size, copy, mem_size);
+        auto batch = config["batch"].as<unsigned>();
+        s.start(chunk_size, copy, mem_size, batch);
     });
 }
@@ -50,7 +50,6 @@ class abort_requested_exception : public std::exception {
 /// atomically with a call to request_abort().
 class abort_source {
     using subscription_callback_type = noncopyable_function<void (const std::optional<std::exception_ptr>&) noexcept>;
-    using naive_subscription_callback_type = noncopyable_function<void() noexcept>;
 
 public:
     /// Represents a handle to the callback registered by a given fiber. Ending the
@@ -67,8 +66,11 @@ class abort_source {
         }
 
         struct naive_cb_tag {}; // to disambiguate constructors
-        explicit subscription(naive_cb_tag, abort_source& as, naive_subscription_callback_type naive_cb)
-                : _target([cb = std::move(naive_cb)] (const std::optional<std::exception_ptr>&) noexcept { cb(); }) {
+        // Wraps the callback itself, rather than a noncopyable_function holding
+        // it, so that a small callback is stored inline, without allocating
+        template <typename Func>
+        explicit subscription(naive_cb_tag, abort_source& as, Func&& naive_cb)
+                : _target([cb = std::forward<Func>(naive_cb)] (const std::optional<std::exception_ptr>&) mutable noexcept { cb(); }) {
             as._subscriptions->push_back(*this);
         }
 
@@ -124,6 +126,10 @@ class abort_source {
     abort_source& operator=(abort_source&&) = default;
 
     /// Delays the invocation of the callback \c f until \ref request_abort() is called.
+    ///
+    /// The subscription is linked into the abort source, and a callback of up
+    /// to 32 bytes, such as a lambda capturing a few pointers, is stored in it,
+    /// so that subscribing does not allocate.
     /// \returns an engaged \ref optimized_optional containing a \ref subscription that can be used to control
     ///          the lifetime of the callback \c f, if \ref abort_requested() is \c false. Otherwise,
     ///          returns a disengaged \ref optimized_optional.
@@ -175,6 +181,12 @@ class abort_source {
     }
 
 
+    /// Returns the exception an abort was requested with, or the default one
+    /// (see \ref get_default_exception()); null if no abort was requested.
+    std::exception_ptr abort_requested_exception_ptr() const noexcept {
+        return _ex;
+    }
+
     /// Throws a \ref abort_requested_exception if cancellation has been requested.
     void check() const {
         if (abort_requested()) {
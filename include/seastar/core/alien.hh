@@ -26,8 +26,7 @@
 #include <deque>
 #include <future>
 #include <memory>
-
-#include <boost/lockfree/queue.hpp>
+#include <vector>
 
 #include <seastar/core/future.hh>
 #include <seastar/core/cacheline.hh>
@@ -46,15 +45,29 @@ namespace alien {
 class message_queue {
     static constexpr size_t batch_size = 128;
     static constexpr size_t prefetch_cnt = 2;
-    struct work_item;
-    struct lf_queue_remote {
-        reactor* remote;
+    struct work_item {
+        std::atomic<work_item*> _next{nullptr};
+        virtual ~work_item() = default;
+        virtual void process() = 0;
     };
-    using lf_queue_base = boost::lockfree::queue<work_item*>;
-    // use inheritence to control placement order
-    struct lf_queue : lf_queue_remote, lf_queue_base {
-        lf_queue(reactor* remote)
-            : lf_queue_remote{remote}, lf_queue_base{batch_size} {}
+    struct stub_item final : work_item {
+        void process() override {}
+    };
+    // An intrusive multiple producer, single consumer queue: producers
+    // append a chain of items with a single exchange of the head, and the
+    // consumer follows the links from the tail. A producer which has
+    // exchanged the head but not linked its chain yet hides the items after
+    // it until it does, and wakes the reactor up after that.
+    struct lf_queue {
+        reactor* remote;
+        alignas(seastar::cache_line_size) std::atomic<work_item*> _head;
+        alignas(seastar::cache_line_size) work_item* _tail;
+        stub_item _stub;
+
+        lf_queue(reactor* remote) : remote(remote), _head(&_stub), _tail(&_stub) {}
+        void push(work_item* first, work_item* last) noexcept;
+        work_item* pop() noexcept;
+        bool empty() const noexcept;
         void maybe_wakeup();
     } _pending;
     struct alignas(seastar::cache_line_size) {
@@ -69,10 +82,6 @@ class message_queue {
         size_t _received = 0;
         size_t _last_rcv_batch = 0;
     };
-    struct work_item {
-        virtual ~work_item() = default;
-        virtual void process() = 0;
-    };
     template <typename  Func>
     struct async_work_item : work_item {
         Func _func;
@@ -84,6 +93,7 @@ class message_queue {
     template<typename Func>
     size_t process_queue(lf_queue& q, Func process);
     void submit_item(std::unique_ptr<work_item> wi);
+    void submit_items(std::vector<std::unique_ptr<work_item>> items);
 public:
     message_queue(reactor *to);
     void start();
@@ -93,6 +103,15 @@ class message_queue {
         auto wi = std::make_unique<async_work_item<Func>>(std::forward<Func>(func));
         submit_item(std::move(wi));
     }
+    template <typename Func>
+    void submit_batch(std::vector<Func> funcs) {
+        std::vector<std::unique_ptr<work_item>> items;
+        items.reserve(funcs.size());
+        for (auto& func : funcs) {
+            items.push_back(std::make_unique<async_work_item<Func>>(std::move(func)));
+        }
+        submit_items(std::move(items));
+    }
     size_t process_incoming();
     bool pure_poll_rx() const;
 };
@@ -161,6 +180,19 @@ void run_on(unsigned shard, Func func) {
     run_on(*internal::default_instance, shard, std::move(func));
 }
 
+/// Runs functions on a remote shard from an alien thread where engine() is not available.
+///
+/// Like calling run_on() for each function, in order, but the functions are
+/// queued at once, and the shard is woken up at most once for all of them.
+///
+/// \param instance designates the Seastar instance to process the messages
+/// \param shard designates the shard to run the functions on
+/// \param funcs the callables to run on \c shard, see run_on()
+template <typename Func>
+void run_batch_on(instance& instance, unsigned shard, std::vector<Func> funcs) {
+    instance._qs[shard].submit_batch(std::move(funcs));
+}
+
 namespace internal {
 template<typename Func>
 using return_value_t = typename futurize<std::invoke_result_t<Func>>::value_type;
@@ -186,6 +218,21 @@ struct return_type_of<Func, false> {
     }
 };
 template <typename Func> using return_type_t = typename return_type_of<Func>::type;
+
+template <typename Func, typename T>
+struct promised_call {
+    std::promise<T> pr;
+    Func func;
+    void operator()() {
+        (void)func().then_wrapped([pr = std::move(pr)] (auto&& result) mutable {
+            try {
+                return_type_of<Func>::set(pr, result.get());
+            } catch (...) {
+                pr.set_exception(std::current_exception());
+            }
+        });
+    }
+};
 }
 
 /// Runs a function on a remote shard from an alien thread where engine() is not available.
@@ -222,6 +269,31 @@ std::future<T> submit_to(instance& instance, unsigned shard, Func func) {
 ///          the caller must guarantee that it will survive the call.
 /// \return whatever \c func returns, as a \c std::future<>
 /// \note the caller must keep the returned future alive until \c func returns
+/// Runs functions on a remote shard from an alien thread where engine() is not available.
+///
+/// Like calling submit_to() for each function, in order, but the functions
+/// are queued at once, and the shard is woken up at most once for all of
+/// them.
+///
+/// \param instance designates the Seastar instance to process the messages
+/// \param shard designates the shard to run the functions on
+/// \param funcs the callables to run on \c shard, see submit_to()
+/// \return whatever each of \c funcs returns, as a \c std::future<>
+template<typename Func, typename T = internal::return_type_t<Func>>
+std::vector<std::future<T>> submit_batch_to(instance& instance, unsigned shard, std::vector<Func> funcs) {
+    std::vector<std::future<T>> futs;
+    std::vector<internal::promised_call<Func, T>> calls;
+    futs.reserve(funcs.size());
+    calls.reserve(funcs.size());
+    for (auto& func : funcs) {
+        std::promise<T> pr;
+        futs.push_back(pr.get_future());
+        calls.push_back({std::move(pr), std::move(func)});
+    }
+    run_batch_on(instance, shard, std::move(calls));
+    return futs;
+}
+
 template<typename Func, typename T = internal::return_type_t<Func>>
 [[deprecated("Use submit_to(instance&, unsigned shard, Func) instead.")]]
 std::future<T> submit_to(unsigned shard, Func func) {
@@ -0,0 +1,131 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#pragma once
+
+#include <seastar/core/file.hh>
+#include <seastar/core/future.hh>
+#include <seastar/core/gate.hh>
+#include <seastar/core/metrics_registration.hh>
+#include <seastar/core/shared_future.hh>
+#include <seastar/core/sstring.hh>
+#include <seastar/core/temporary_buffer.hh>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+namespace seastar {
+
+/// \addtogroup fileio-module
+/// @{
+
+struct append_log_options {
+    /// Space allocated ahead of the end of the log, so that appends do not
+    /// change the size of the file and only write data
+    uint64_t preallocation_size = 32 << 20;
+    /// Priority class of the writes of the log
+    io_priority_class priority = default_priority_class();
+    /// If not empty, the statistics of the log are exported as metrics of
+    /// the \c append_log group, labeled with this name
+    sstring metrics_name;
+};
+
+/// An append-only file for write-ahead logs.
+///
+/// Appends are durable when the future they return resolves. Appends
+/// issued while a write is in flight are written together by the next
+/// one (group commit), so that there is at most one write in flight and
+/// each write is made durable by the device as part of it, with O_DSYNC,
+/// rather than by a separate flush.
+///
+/// The file is extended with \ref file::allocate() in steps of
+/// \ref append_log_options::preallocation_size ahead of the end of the log,
+/// and cut back to it by \ref close(). After a crash the file may end with
+/// zeros past the last append; the log records should be framed so that
+/// they can be told apart.
+///
+/// Not movable: appends in flight refer to it.
+class append_log {
+public:
+    struct stats {
+        uint64_t appends = 0;
+        uint64_t bytes = 0;        ///< appended
+        uint64_t writes = 0;       ///< each a batch of appends made durable
+        uint64_t preallocations = 0;
+    };
+private:
+    file _file;
+    append_log_options _opts;
+    uint64_t _alignment;
+    // End of the log, and of the space allocated for it
+    uint64_t _size;
+    uint64_t _allocated;
+    // The log past the last aligned offset, which is rewritten by the next
+    // write since writes are aligned
+    temporary_buffer<char> _tail;
+    // Appends waiting for the next write
+    std::vector<temporary_buffer<char>> _queued;
+    uint64_t _queued_bytes = 0;
+    std::unique_ptr<shared_promise<>> _queued_done;
+    std::exception_ptr _failed;
+    bool _writing = false;
+    gate _writes;
+    stats _stats;
+    metrics::metric_groups _metrics;
+
+    future<> write_queued();
+    future<> write_batch();
+    future<> preallocate(uint64_t end);
+public:
+    /// Takes over \c f, opened with \ref open_flags::dsync, whose log ends
+    /// at \c size; \c tail holds the bytes of the log past the last
+    /// multiple of the write alignment of \c f before \c size.
+    append_log(file f, uint64_t size, temporary_buffer<char> tail, append_log_options opts);
+    append_log(append_log&&) = delete;
+
+    /// Appends \c data to the log; the returned future resolves to its
+    /// offset in the file once it is durable.
+    ///
+    /// Once a write fails, it and all later appends fail with its error.
+    future<uint64_t> append(std::string_view data);
+
+    /// The end of the log, including appends which are not yet durable
+    uint64_t size() const noexcept {
+        return _size + _queued_bytes;
+    }
+
+    const stats& get_stats() const noexcept {
+        return _stats;
+    }
+
+    /// Waits for the appends in flight, cuts the preallocated space off
+    /// the file and closes it.
+    future<> close() noexcept;
+};
+
+/// Opens or creates the append-only log \c name; appends go to its end.
+future<std::unique_ptr<append_log>> open_append_log(std::string_view name, append_log_options opts = {}) noexcept;
+
+/// @}
+
+}
@@ -0,0 +1,651 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+
+#pragma once
+
+#include <seastar/core/future.hh>
+#include <seastar/core/loop.hh>
+#include <seastar/core/preempt.hh>
+#include <seastar/util/concepts.hh>
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <new>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace seastar {
+
+/// An ordered map, kept in a B+tree with large nodes.
+///
+/// Meant for shard-local indexes with many entries, where std::map's node
+/// per entry costs a cache miss per level of a deep tree. Nodes hold up to
+/// \c NodeSize entries, keys apart from values, so that a lookup reads few
+/// and contiguous cache lines. For arithmetic keys compared with
+/// \c std::less the position in a node is found by counting the smaller
+/// keys, a loop without branches that compilers vectorize; other keys are
+/// binary searched.
+///
+/// Entries live in the leaves, which are linked for ordered iteration.
+/// Iterators dereference to a pair of references, \c first to the key and
+/// \c second to the value, like the elements of std::map. Inserting or
+/// erasing invalidates all iterators.
+///
+/// clear_gently() and erase_gently() release large numbers of entries
+/// without stalling the reactor.
+///
+/// Keys and values must be nothrow move constructible.
+template <typename Key, typename T, typename Compare = std::less<Key>, size_t NodeSize = 64>
+SEASTAR_CONCEPT(requires std::is_nothrow_move_constructible_v<Key> && std::is_nothrow_move_constructible_v<T>)
+class btree_map {
+    static_assert(NodeSize >= 4, "btree_map nodes must hold at least 4 entries");
+
+    static constexpr unsigned capacity = NodeSize;
+    // Nodes other than the root hold at least this many entries, or children
+    static constexpr unsigned min_fill = NodeSize / 2;
+
+    struct inner_node;
+
+    struct node {
+        const bool leaf;
+        // Entries of a leaf, children of an inner node
+        unsigned n = 0;
+
+        explicit node(bool l) noexcept : leaf(l) {}
+    };
+
+    struct leaf_node : node {
+        leaf_node* prev = nullptr;
+        leaf_node* next = nullptr;
+        union {
+            Key keys[capacity];
+        };
+        union {
+            T values[capacity];
+        };
+
+        leaf_node() noexcept : node(true) {}
+        ~leaf_node() {
+            for (unsigned i = 0; i < this->n; i++) {
+                keys[i].~Key();
+                values[i].~T();
+            }
+        }
+    };
+
+    struct inner_node : node {
+        // keys[i] separates children[i] and children[i + 1]: the keys of
+        // the former are smaller, those of the latter are not
+        union {
+            Key keys[capacity - 1];
+        };
+        node* children[capacity];
+
+        inner_node() noexcept : node(false) {}
+        ~inner_node() {
+            for (unsigned i = 0; i + 1 < this->n; i++) {
+                keys[i].~Key();
+            }
+        }
+    };
+
+    node* _root = nullptr;
+    leaf_node* _first = nullptr;
+    leaf_node* _last = nullptr;
+    size_t _size = 0;
+    [[no_unique_address]] Compare _cmp;
+
+public:
+    using key_type = Key;
+    using mapped_type = T;
+    using size_type = size_t;
+    using key_compare = Compare;
+
+    template <bool Const>
+    class basic_iterator {
+        friend class btree_map;
+        using map_type = std::conditional_t<Const, const btree_map, btree_map>;
+        using value_ref = std::conditional_t<Const, const T&, T&>;
+
+        map_type* _map = nullptr;
+        leaf_node* _leaf = nullptr;
+        unsigned _idx = 0;
+
+        basic_iterator(map_type* m, leaf_node* l, unsigned i) noexcept : _map(m), _leaf(l), _idx(i) {}
+    public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using difference_type = std::ptrdiff_t;
+        using value_type = std::pair<const Key&, value_ref>;
+        using reference = value_type;
+
+        struct pointer {
+            value_type pair;
+            const value_type* operator->() const noexcept { return &pair; }
+        };
+
+        basic_iterator() noexcept = default;
+        template <bool C = Const>
+        SEASTAR_CONCEPT(requires C)
+        basic_iterator(const basic_iterator<false>& o) noexcept : _map(o._map), _leaf(o._leaf), _idx(o._idx) {}
+
+        const Key& key() const noexcept { return _leaf->keys[_idx]; }
+        value_ref value() const noexcept { return _leaf->values[_idx]; }
+
+        reference operator*() const noexcept { return reference(key(), value()); }
+        pointer operator->() const noexcept { return pointer{**this}; }
+
+        basic_iterator& operator++() noexcept {
+            if (++_idx == _leaf->n) {
+                _leaf = _leaf->next;
+                _idx = 0;
+            }
+            return *this;
+        }
+        basic_iterator operator++(int) noexcept {
+            auto it = *this;
+            ++*this;
+            return it;
+        }
+        basic_iterator& operator--() noexcept {
+            if (!_leaf) {
+                _leaf = _map->_last;
+                _idx = _leaf->n - 1;
+            } else if (_idx == 0) {
+                _leaf = _leaf->prev;
+                _idx = _leaf->n - 1;
+            } else {
+                _idx--;
+            }
+            return *this;
+        }
+        basic_iterator operator--(int) noexcept {
+            auto it = *this;
+            --*this;
+            return it;
+        }
+
+        bool operator==(const basic_iterator& o) const noexcept {
+            return _leaf == o._leaf && _idx == o._idx;
+        }
+    };
+
+    using iterator = basic_iterator<false>;
+    using const_iterator = basic_iterator<true>;
+
+    btree_map() = default;
+    explicit btree_map(Compare cmp) : _cmp(std::move(cmp)) {}
+    btree_map(btree_map&& o) noexcept
+        : _root(std::exchange(o._root, nullptr))
+        , _first(std::exchange(o._first, nullptr))
+        , _last(std::exchange(o._last, nullptr))
+        , _size(std::exchange(o._size, 0))
+        , _cmp(std::move(o._cmp))
+    {}
+    btree_map& operator=(btree_map&& o) noexcept {
+        if (this != &o) {
+            clear();
+            std::swap(_root, o._root);
+            std::swap(_first, o._first);
+            std::swap(_last, o._last);
+            std::swap(_size, o._size);
+            std::swap(_cmp, o._cmp);
+        }
+        return *this;
+    }
+    btree_map(const btree_map&) = delete;
+    btree_map& operator=(const btree_map&) = delete;
+    ~btree_map() {
+        clear();
+    }
+
+    size_t size() const noexcept { return _size; }
+    bool empty() const noexcept { return _size == 0; }
+
+    iterator begin() noexcept { return iterator(this, _first, 0); }
+    iterator end() noexcept { return iterator(this, nullptr, 0); }
+    const_iterator begin() const noexcept { return const_iterator(this, _first, 0); }
+    const_iterator end() const noexcept { return const_iterator(this, nullptr, 0); }
+    const_iterator cbegin() const noexcept { return begin(); }
+    const_iterator cend() const noexcept { return end(); }
+
+    /// The first entry whose key is not smaller than \c k
+    iterator lower_bound(const Key& k) noexcept {
+        return bound<false>(k);
+    }
+    const_iterator lower_bound(const Key& k) const noexcept {
+        return const_cast<btree_map*>(this)->lower_bound(k);
+    }
+    /// The first entry whose key is greater than \c k
+    iterator upper_bound(const Key& k) noexcept {
+        return bound<true>(k);
+    }
+    const_iterator upper_bound(const Key& k) const noexcept {
+        return const_cast<btree_map*>(this)->upper_bound(k);
+    }
+
+    iterator find(const Key& k) noexcept {
+        auto it = lower_bound(k);
+        return it != end() && !_cmp(k, it.key()) ? it : end();
+    }
+    const_iterator find(const Key& k) const noexcept {
+        return const_cast<btree_map*>(this)->find(k);
+    }
+    bool contains(const Key& k) const noexcept {
+        return find(k) != end();
+    }
+
+    /// Inserts an entry with the value constructed from \c args, unless
+    /// there already is one with the key.
+    ///
+    /// \return the entry with the key, and whether it was inserted
+    template <typename... Args>
+    std::pair<iterator, bool> try_emplace(Key k, Args&&... args) {
+        auto it = find(k);
+        if (it != end()) {
+            return {it, false};
+        }
+        T v(std::forward<Args>(args)...);
+        if (!_root) {
+            auto l = new leaf_node();
+            _root = _first = _last = l;
+        }
+        split s;
+        insert_into(_root, std::move(k), std::move(v), s, it);
+        if (s.right) {
+            auto r = new inner_node();
+            r->children[0] = _root;
+            r->children[1] = s.right;
+            new (&r->keys[0]) Key(std::move(*s.sep));
+            r->n = 2;
+            _root = r;
+        }
+        _size++;
+        return {it, true};
+    }
+
+    std::pair<iterator, bool> insert(Key k, T v) {
+        return try_emplace(std::move(k), std::move(v));
+    }
+
+    T& operator[](const Key& k) {
+        return try_emplace(k).first.value();
+    }
+
+    /// Removes the entry with the key, if any, and returns how many were
+    size_t erase(const Key& k) noexcept {
+        if (!_root || !erase_from(_root, k)) {
+            return 0;
+        }
+        _size--;
+        if (!_root->leaf && _root->n == 1) {
+            auto r = static_cast<inner_node*>(_root);
+            _root = r->children[0];
+            r->n = 0;
+            delete r;
+        } else if (_root->leaf && _root->n == 0) {
+            delete static_cast<leaf_node*>(_root);
+            _root = _first = _last = nullptr;
+        }
+        return 1;
+    }
+
+    /// Removes the entry and returns the one after it
+    iterator erase(const_iterator it) noexcept {
+        Key k = it.key();
+        erase(k);
+        return upper_bound(k);
+    }
+
+    void clear() noexcept {
+        if (_root) {
+            destroy(_root);
+        }
+        _root = _first = _last = nullptr;
+        _size = 0;
+    }
+
+    /// Empties the map at once, but releases its nodes in a loop which
+    /// yields when the reactor needs to run other tasks.
+    ///
+    /// The map can be used right away, also before the returned future
+    /// resolves.
+    future<> clear_gently() noexcept {
+        if (!_root) {
+            return make_ready_future<>();
+        }
+        auto root = std::exchange(_root, nullptr);
+        _first = _last = nullptr;
+        _size = 0;
+        std::vector<node*> nodes;
+        try {
+            nodes.push_back(root);
+        } catch (...) {
+            destroy(root);
+            return make_ready_future<>();
+        }
+        return do_with(std::move(nodes), [] (std::vector<node*>& nodes) {
+            return repeat([&nodes] {
+                while (!nodes.empty()) {
+                    auto n = nodes.back();
+                    nodes.pop_back();
+                    if (!n->leaf) {
+                        auto in = static_cast<inner_node*>(n);
+                        for (unsigned i = 0; i < in->n; i++) {
+                            try {
+                                nodes.push_back(in->children[i]);
+                            } catch (...) {
+                                destroy(in->children[i]);
+                            }
+                        }
+                        delete in;
+                    } else {
+                        delete static_cast<leaf_node*>(n);
+                    }
+                    if (need_preempt()) {
+                        return make_ready_future<stop_iteration>(stop_iteration::no);
+                    }
+                }
+                return make_ready_future<stop_iteration>(stop_iteration::yes);
+            });
+        });
+    }
+
+    /// Removes the entries with keys in [\c from, \c to), yielding when
+    /// the reactor needs to run other tasks. The map must not be modified
+    /// until the returned future resolves.
+    future<> erase_gently(Key from, Key to) noexcept {
+        return do_with(std::move(from), std::move(to), [this] (Key& from, const Key& to) {
+            return repeat([this, &from, &to] {
+                auto it = lower_bound(from);
+                while (it != end() && _cmp(it.key(), to)) {
+                    from = it.key();
+                    erase(from);
+                    if (need_preempt()) {
+                        return make_ready_future<stop_iteration>(stop_iteration::no);
+                    }
+                    it = lower_bound(from);
+                }
+                return make_ready_future<stop_iteration>(stop_iteration::yes);
+            });
+        });
+    }
+
+private:
+    static constexpr bool counted_search = std::is_arithmetic_v<Key>
+            && (std::is_same_v<Compare, std::less<Key>> || std::is_same_v<Compare, std::less<>>);
+
+    // Index of the first key not smaller than (Upper: greater than) k
+    template <bool Upper>
+    unsigned search(const Key* keys, unsigned n, const Key& k) const noexcept {
+        if constexpr (counted_search) {
+            unsigned count = 0;
+            for (unsigned i = 0; i < n; i++) {
+                count += Upper ? keys[i] <= k : keys[i] < k;
+            }
+            return count;
+        } else if constexpr (Upper) {
+            return std::upper_bound(keys, keys + n, k, _cmp) - keys;
+        } else {
+            return std::lower_bound(keys, keys + n, k, _cmp) - keys;
+        }
+    }
+
+    template <bool Upper>
+    iterator bound(const Key& k) noexcept {
+        if (!_root) {
+            return end();
+        }
+        node* n = _root;
+        while (!n->leaf) {
+            auto in = static_cast<inner_node*>(n);
+            n = in->children[search<true>(in->keys, in->n - 1, k)];
+        }
+        auto l = static_cast<leaf_node*>(n);
+        auto idx = search<Upper>(l->keys, l->n, k);
+        if (idx == l->n) {
+            return iterator(this, l->next, 0);
+        }
+        return iterator(this, l, idx);
+    }
+
+    // Moves count items from src to dst, both of which may overlap
+    template <typename U>
+    static void move_items(U* dst, U* src, unsigned count) noexcept {
+        if constexpr (std::is_trivially_copyable_v<U>) {
+            std::memmove(static_cast<void*>(dst), src, count * sizeof(U));
+        } else if (dst < src) {
+            for (unsigned i = 0; i < count; i++) {
+                new (&dst[i]) U(std::move(src[i]));
+                src[i].~U();
+            }
+        } else {
+            for (unsigned i = count; i-- > 0;) {
+                new (&dst[i]) U(std::move(src[i]));
+                src[i].~U();
+            }
+        }
+    }
+
+    // The new right half of a split node, and the separator from the left
+    struct split {
+        node* right = nullptr;
+        std::optional<Key> sep;
+    };
+
+    // Inserts into the subtree of n, splitting n if it is full. Ancestor
+    // splits don't move leaf entries, so the position of the entry, set in
+    // \c it, stays valid.
+    void insert_into(node* n, Key&& k, T&& v, split& s, iterator& it) {
+        if (n->leaf) {
+            auto l = static_cast<leaf_node*>(n);
+            if (l->n == capacity) {
+                auto r = new leaf_node();
+                move_items(r->keys, l->keys + min_fill, capacity - min_fill);
+                move_items(r->values, l->values + min_fill, capacity - min_fill);
+                r->n = capacity - min_fill;
+                l->n = min_fill;
+                r->next = l->next;
+                r->prev = l;
+                (r->next ? r->next->prev : _last) = r;
+                l->next = r;
+                if (!_cmp(k, r->keys[0])) {
+                    l = r;
+                }
+                s.right = r;
+                s.sep.emplace(r->keys[0]);
+            }
+            auto idx = search<false>(l->keys, l->n, k);
+            move_items(l->keys + idx + 1, l->keys + idx, l->n - idx);
+            move_items(l->values + idx + 1, l->values + idx, l->n - idx);
+            new (&l->keys[idx]) Key(std::move(k));
+            new (&l->values[idx]) T(std::move(v));
+            l->n++;
+            it = iterator(this, l, idx);
+            return;
+        }
+
+        auto in = static_cast<inner_node*>(n);
+        auto ci = search<true>(in->keys, in->n - 1, k);
+        split child;
+        insert_into(in->children[ci], std::move(k), std::move(v), child, it);
+        if (!child.right) {
+            return;
+        }
+        if (in->n == capacity) {
+            // Split so that the halves get min_fill and capacity - min_fill
+            // children, with the key between them going up
+            auto r = new inner_node();
+            auto moved = capacity - min_fill;
+            move_items(r->keys, in->keys + min_fill, moved - 1);
+            std::copy(in->children + min_fill, in->children + capacity, r->children);
+            r->n = moved;
+            s.sep.emplace(std::move(in->keys[min_fill - 1]));
+            in->keys[min_fill - 1].~Key();
+            in->n = min_fill;
+            s.right = r;
+            if (ci >= min_fill) {
+                in = r;
+                ci -= min_fill;
+            }
+        }
+        move_items(in->keys + ci + 1, in->keys + ci, in->n - 1 - ci);
+        new (&in->keys[ci]) Key(std::move(*child.sep));
+        std::copy_backward(in->children + ci + 1, in->children + in->n, in->children + in->n + 1);
+        in->children[ci + 1] = child.right;
+        in->n++;
+    }
+
+    bool erase_from(node* n, const Key& k) noexcept {
+        if (n->leaf) {
+            auto l = static_cast<leaf_node*>(n);
+            auto idx = search<false>(l->keys, l->n, k);
+            if (idx == l->n || _cmp(k, l->keys[idx])) {
+                return false;
+            }
+            l->keys[idx].~Key();
+            l->values[idx].~T();
+            move_items(l->keys + idx, l->keys + idx + 1, l->n - idx - 1);
+            move_items(l->values + idx, l->values + idx + 1, l->n - idx - 1);
+            l->n--;
+            return true;
+        }
+        auto in = static_cast<inner_node*>(n);
+        auto ci = search<true>(in->keys, in->n - 1, k);
+        if (!erase_from(in->children[ci], k)) {
+            return false;
+        }
+        if (in->children[ci]->n < min_fill) {
+            rebalance(in, ci);
+        }
+        return true;
+    }
+
+    // Refills the underfull child ci from a sibling, or merges it with one
+    void rebalance(inner_node* p, unsigned ci) noexcept {
+        if (ci > 0 && p->children[ci - 1]->n > min_fill) {
+            borrow_from_left(p, ci);
+        } else if (ci + 1 < p->n && p->children[ci + 1]->n > min_fill) {
+            borrow_from_right(p, ci);
+        } else if (ci > 0) {
+            merge(p, ci - 1);
+        } else if (ci + 1 < p->n) {
+            merge(p, ci);
+        }
+    }
+
+    void borrow_from_left(inner_node* p, unsigned ci) noexcept {
+        auto& sep = p->keys[ci - 1];
+        if (p->children[ci]->leaf) {
+            auto l = static_cast<leaf_node*>(p->children[ci - 1]);
+            auto r = static_cast<leaf_node*>(p->children[ci]);
+            move_items(r->keys + 1, r->keys, r->n);
+            move_items(r->values + 1, r->values, r->n);
+            move_items(r->keys, l->keys + l->n - 1, 1);
+            move_items(r->values, l->values + l->n - 1, 1);
+            l->n--;
+            r->n++;
+            sep = r->keys[0];
+        } else {
+            auto l = static_cast<inner_node*>(p->children[ci - 1]);
+            auto r = static_cast<inner_node*>(p->children[ci]);
+            move_items(r->keys + 1, r->keys, r->n - 1);
+            std::copy_backward(r->children, r->children + r->n, r->children + r->n + 1);
+            move_items(r->keys, &sep, 1);
+            r->children[0] = l->children[l->n - 1];
+            move_items(&sep, l->keys + l->n - 2, 1);
+            l->n--;
+            r->n++;
+        }
+    }
+
+    void borrow_from_right(inner_node* p, unsigned ci) noexcept {
+        auto& sep = p->keys[ci];
+        if (p->children[ci]->leaf) {
+            auto l = static_cast<leaf_node*>(p->children[ci]);
+            auto r = static_cast<leaf_node*>(p->children[ci + 1]);
+            move_items(l->keys + l->n, r->keys, 1);
+            move_items(l->values + l->n, r->values, 1);
+            move_items(r->keys, r->keys + 1, r->n - 1);
+            move_items(r->values, r->values + 1, r->n - 1);
+            l->n++;
+            r->n--;
+            sep = r->keys[0];
+        } else {
+            auto l = static_cast<inner_node*>(p->children[ci]);
+            auto r = static_cast<inner_node*>(p->children[ci + 1]);
+            move_items(l->keys + l->n - 1, &sep, 1);
+            l->children[l->n] = r->children[0];
+            move_items(&sep, r->keys, 1);
+            move_items(r->keys, r->keys + 1, r->n - 2);
+            std::copy(r->children + 1, r->children + r->n, r->children);
+            l->n++;
+            r->n--;
+        }
+    }
+
+    // Merges child ci + 1 of p into child ci
+    void merge(inner_node* p, unsigned ci) noexcept {
+        if (p->children[ci]->leaf) {
+            auto l = static_cast<leaf_node*>(p->children[ci]);
+            auto r = static_cast<leaf_node*>(p->children[ci + 1]);
+            move_items(l->keys + l->n, r->keys, r->n);
+            move_items(l->values + l->n, r->values, r->n);
+            l->n += r->n;
+            r->n = 0;
+            l->next = r->next;
+            (l->next ? l->next->prev : _last) = l;
+            delete r;
+            p->keys[ci].~Key();
+        } else {
+            // The separator moves down, between the children of both
+            auto l = static_cast<inner_node*>(p->children[ci]);
+            auto r = static_cast<inner_node*>(p->children[ci + 1]);
+            move_items(l->keys + l->n - 1, &p->keys[ci], 1);
+            move_items(l->keys + l->n, r->keys, r->n - 1);
+            std::copy(r->children, r->children + r->n, l->children + l->n);
+            l->n += r->n;
+            r->n = 0;
+            delete r;
+        }
+        move_items(p->keys + ci, p->keys + ci + 1, p->n - 2 - ci);
+        std::copy(p->children + ci + 2, p->children + p->n, p->children + ci + 1);
+        p->n--;
+    }
+
+    static void destroy(node* n) noexcept {
+        if (n->leaf) {
+            delete static_cast<leaf_node*>(n);
+            return;
+        }
+        auto in = static_cast<inner_node*>(n);
+        for (unsigned i = 0; i < in->n; i++) {
+            destroy(in->children[i]);
+        }
+        delete in;
+    }
+};
+
+}
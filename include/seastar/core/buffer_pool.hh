@@ -0,0 +1,161 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#pragma once
+
+#include <seastar/core/bitops.hh>
+#include <seastar/core/memory.hh>
+#include <seastar/core/smp.hh>
+#include <array>
+#include <cstddef>
+#include <cstdlib>
+#include <memory_resource>
+#include <new>
+
+namespace seastar {
+
+namespace memory {
+
+/// \addtogroup memory-module
+/// @{
+
+/// A pool of recycled I/O buffers.
+///
+/// Buffers from \ref min_size to \ref max_size bytes are rounded up to a
+/// power of two, and kept on a free list of their size class when they are
+/// released, up to a total of \c capacity bytes per pool, so that buffers
+/// which live for the time it takes to parse them, such as those of data
+/// sources, do not go back and forth to the allocator. Other sizes are
+/// passed to it directly. Pooled buffers are page aligned.
+///
+/// The pool is a \c std::pmr::memory_resource; it is used through a
+/// \c std::pmr::polymorphic_allocator, e.g. for the buffers of a posix
+/// network stack, or with \ref make_temporary_buffer(), whose deleter
+/// returns the buffer to the pool.
+///
+/// A pool belongs to the shard that created it. Buffers released on
+/// another shard are freed rather than pooled.
+class buffer_pool final : public std::pmr::memory_resource {
+public:
+    static constexpr size_t min_size = 8 << 10;
+    static constexpr size_t max_size = 128 << 10;
+    static constexpr size_t default_capacity = 4 << 20;
+
+    struct stats {
+        uint64_t allocations = 0; ///< of pooled sizes
+        uint64_t hits = 0;        ///< allocations served from the pool
+        uint64_t releases = 0;    ///< buffers put back in the pool
+        uint64_t drops = 0;       ///< buffers freed because the pool was full
+        size_t cached_bytes = 0;  ///< in the pool now
+    };
+private:
+    static constexpr unsigned min_class = log2ceil(min_size);
+    static constexpr unsigned nr_classes = log2ceil(max_size) - min_class + 1;
+
+    struct free_buffer {
+        free_buffer* next;
+    };
+
+    std::array<free_buffer*, nr_classes> _free{};
+    size_t _capacity;
+    stats _stats;
+    shard_id _shard = this_shard_id();
+public:
+    /// \param capacity bytes the pool may hold, over all size classes
+    explicit buffer_pool(size_t capacity = default_capacity) noexcept
+        : _capacity(capacity)
+    { }
+    buffer_pool(const buffer_pool&) = delete;
+    buffer_pool& operator=(const buffer_pool&) = delete;
+    ~buffer_pool() {
+        release();
+    }
+
+    /// Frees the buffers held by the pool
+    void release() noexcept {
+        for (auto& head : _free) {
+            while (head) {
+                std::free(std::exchange(head, head->next));
+            }
+        }
+        _stats.cached_bytes = 0;
+    }
+
+    const stats& get_stats() const noexcept {
+        return _stats;
+    }
+private:
+    static bool pooled(size_t bytes, size_t alignment) noexcept {
+        return bytes >= min_size && bytes <= max_size && alignment <= page_size;
+    }
+    static unsigned size_class(size_t bytes) noexcept {
+        return log2ceil(bytes) - min_class;
+    }
+    static size_t class_size(unsigned c) noexcept {
+        return size_t(1) << (c + min_class);
+    }
+
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        if (!pooled(bytes, alignment)) {
+            return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+        }
+        auto c = size_class(bytes);
+        _stats.allocations++;
+        if (auto b = _free[c]) {
+            _free[c] = b->next;
+            _stats.hits++;
+            _stats.cached_bytes -= class_size(c);
+            return b;
+        }
+        auto p = std::aligned_alloc(page_size, class_size(c));
+        if (!p) {
+            throw std::bad_alloc();
+        }
+        return p;
+    }
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override {
+        if (!pooled(bytes, alignment)) {
+            return std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+        }
+        if (this_shard_id() != _shard) {
+            std::free(p);
+            return;
+        }
+        auto c = size_class(bytes);
+        if (_stats.cached_bytes + class_size(c) > _capacity) {
+            _stats.drops++;
+            std::free(p);
+            return;
+        }
+        _free[c] = new (p) free_buffer{_free[c]};
+        _stats.releases++;
+        _stats.cached_bytes += class_size(c);
+    }
+    bool do_is_equal(const std::pmr::memory_resource& o) const noexcept override {
+        return this == &o;
+    }
+};
+
+/// @}
+
+}
+
+}
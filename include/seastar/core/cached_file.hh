@@ -0,0 +1,73 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#pragma once
+
+#include <seastar/core/file.hh>
+
+namespace seastar {
+
+/// \addtogroup fileio-module
+/// @{
+
+/// Options for \ref make_cached_file()
+struct cached_file_options {
+    /// Size of the cached pages, must be a multiple of the file's
+    /// read and memory DMA alignment
+    size_t page_size = 4096;
+    /// Number of pages to read past the requested range on a miss
+    unsigned read_ahead_pages = 0;
+};
+
+/// Statistics of the shard's page cache
+struct page_cache_stats {
+    uint64_t hits = 0;          ///< pages served from the cache
+    uint64_t misses = 0;        ///< pages read from the underlying files
+    uint64_t read_ahead = 0;    ///< pages read past the requested ranges
+    uint64_t evictions = 0;     ///< pages dropped to stay within the memory limit
+    uint64_t reclaimed = 0;     ///< pages dropped on request of the memory allocator
+    uint64_t invalidations = 0; ///< pages dropped because they were written, truncated or discarded
+    size_t bytes = 0;           ///< memory held by cached pages
+};
+
+/// Wraps a file so that its reads are served from a per-shard cache of
+/// file pages, with the underlying file only read on misses.
+///
+/// Writes, truncation and discards through the returned file keep the
+/// cache coherent; changes made to the file through other handles are
+/// not seen until the affected pages are evicted. The cache is shared by
+/// all cached files of the shard, pages are evicted with the CLOCK
+/// algorithm when it grows above its memory limit and are given back to
+/// the allocator when it runs low on memory. The pages of a file are
+/// dropped when it is closed.
+file make_cached_file(file f, cached_file_options options = {});
+
+/// Sets the memory limit of the shard's page cache.
+///
+/// The default is 5% of the shard's memory.
+void set_page_cache_memory_limit(size_t bytes);
+
+/// Returns the statistics of the shard's page cache.
+const page_cache_stats& get_page_cache_stats() noexcept;
+
+/// @}
+
+}
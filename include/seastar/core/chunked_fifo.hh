@@ -23,6 +23,8 @@
 
 #include <memory>
 #include <algorithm>
+#include <cstring>
+#include <iterator>
 
 namespace seastar {
 
@@ -180,8 +182,15 @@ class chunked_fifo {
     const T& back() const noexcept;
     template <typename... A>
     inline void emplace_back(A&&... args);
+    // Appends the elements of [first, last) a chunk at a time. Trivially
+    // copyable elements of contiguous ranges are copied with memcpy().
+    template <typename Iterator>
+    void push_back(Iterator first, Iterator last);
     inline T& front() const noexcept;
     inline void pop_front() noexcept;
+    // Removes the first n items, there must be as many. Chunks that
+    // become empty are freed at once, not item by item.
+    void pop_front(size_t n) noexcept;
     inline bool empty() const noexcept;
     inline size_t size() const noexcept;
     void clear() noexcept;
@@ -266,7 +275,14 @@ chunked_fifo<T, items_per_chunk>::basic_iterator<U>::operator++() noexcept {
     ++_item_index;
     if (_item_index == _chunk->end) {
         _chunk = _chunk->next;
-        _item_index = _chunk ? _chunk->begin : 0;
+        if (_chunk) {
+            _item_index = _chunk->begin;
+            // Iteration is likely to get to the next chunk too; prefetching
+            // a null pointer is harmless
+            __builtin_prefetch(_chunk->next);
+        } else {
+            _item_index = 0;
+        }
     }
     return *this;
 }
@@ -558,6 +574,50 @@ chunked_fifo<T, items_per_chunk>::pop_front() noexcept {
     }
 }
 
+template <typename T, size_t items_per_chunk>
+template <typename Iterator>
+void
+chunked_fifo<T, items_per_chunk>::push_back(Iterator first, Iterator last) {
+    if constexpr (std::is_trivially_copyable_v<T> && std::contiguous_iterator<Iterator>
+            && std::is_same_v<std::iter_value_t<Iterator>, T>) {
+        auto src = std::to_address(first);
+        auto n = size_t(last - first);
+        while (n) {
+            ensure_room_back();
+            auto room = items_per_chunk - (_back_chunk->end - _back_chunk->begin);
+            auto idx = mask(_back_chunk->end);
+            // The free items may wrap around the end of the chunk
+            auto now = std::min({n, room, items_per_chunk - idx});
+            std::memcpy(static_cast<void*>(&_back_chunk->items[idx]), src, now * sizeof(T));
+            _back_chunk->end += now;
+            src += now;
+            n -= now;
+        }
+    } else {
+        for (; first != last; ++first) {
+            push_back(*first);
+        }
+    }
+}
+
+template <typename T, size_t items_per_chunk>
+void
+chunked_fifo<T, items_per_chunk>::pop_front(size_t n) noexcept {
+    while (n) {
+        auto now = std::min<size_t>(n, _front_chunk->end - _front_chunk->begin);
+        if constexpr (!std::is_trivially_destructible_v<T>) {
+            for (size_t i = 0; i < now; i++) {
+                _front_chunk->items[mask(_front_chunk->begin + i)].data.~T();
+            }
+        }
+        _front_chunk->begin += now;
+        n -= now;
+        if (_front_chunk->begin == _front_chunk->end) {
+            front_chunk_delete();
+        }
+    }
+}
+
 template <typename T, size_t items_per_chunk>
 void chunked_fifo<T, items_per_chunk>::reserve(size_t n) {
     // reserve() guarantees that (n - size()) additional push()es will
@@ -26,6 +26,8 @@
 #include <seastar/util/concepts.hh>
 #include <memory>
 #include <algorithm>
+#include <cstring>
+#include <iterator>
 
 namespace seastar {
 
@@ -99,11 +101,19 @@ class circular_buffer {
     void push_back(T&& data);
     template <typename... A>
     void emplace_back(A&&... args);
+    /// Appends the elements of [first, last), growing the storage at most
+    /// once if the iterators tell the number of elements in advance.
+    /// Trivially copyable elements of contiguous ranges are copied with
+    /// memcpy().
+    template <typename Iterator>
+    void push_back(Iterator first, Iterator last);
     T& front() noexcept;
     const T& front() const noexcept;
     T& back() noexcept;
     const T& back() const noexcept;
     void pop_front() noexcept;
+    /// Removes the first \c n elements, there must be as many
+    void pop_front(size_t n) noexcept;
     void pop_back() noexcept;
     bool empty() const noexcept;
     size_t size() const noexcept;
@@ -417,6 +427,35 @@ circular_buffer<T, Alloc>::emplace_back(Args&&... args) {
     ++_impl.end;
 }
 
+template <typename T, typename Alloc>
+template <typename Iterator>
+inline
+void
+circular_buffer<T, Alloc>::push_back(Iterator first, Iterator last) {
+    using category = typename std::iterator_traits<Iterator>::iterator_category;
+    if constexpr (std::is_base_of_v<std::forward_iterator_tag, category>) {
+        auto n = size_t(std::distance(first, last));
+        if (n == 0) {
+            return;
+        }
+        reserve(size() + n);
+        if constexpr (std::is_trivially_copyable_v<T> && std::contiguous_iterator<Iterator>
+                && std::is_same_v<std::iter_value_t<Iterator>, T>) {
+            // At most two pieces, before and after the storage wraps around
+            auto src = std::to_address(first);
+            auto idx = mask(_impl.end);
+            auto head = std::min(n, _impl.capacity - idx);
+            std::memcpy(_impl.storage + idx, src, head * sizeof(T));
+            std::memcpy(_impl.storage, src + head, (n - head) * sizeof(T));
+            _impl.end += n;
+            return;
+        }
+    }
+    for (; first != last; ++first) {
+        push_back(*first);
+    }
+}
+
 template <typename T, typename Alloc>
 inline
 T&
@@ -453,6 +492,18 @@ circular_buffer<T, Alloc>::pop_front() noexcept {
     ++_impl.begin;
 }
 
+template <typename T, typename Alloc>
+inline
+void
+circular_buffer<T, Alloc>::pop_front(size_t n) noexcept {
+    if constexpr (!std::is_trivially_destructible_v<T>) {
+        for (size_t i = 0; i < n; i++) {
+            std::allocator_traits<Alloc>::destroy(_impl, &_impl.storage[mask(_impl.begin + i)]);
+        }
+    }
+    _impl.begin += n;
+}
+
 template <typename T, typename Alloc>
 inline
 void
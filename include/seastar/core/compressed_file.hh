@@ -0,0 +1,58 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#pragma once
+
+#include <seastar/core/file.hh>
+
+namespace seastar {
+
+/// \addtogroup fileio-module
+/// @{
+
+/// Options for \ref make_compressed_file()
+struct compressed_file_options {
+    /// Size of the uncompressed blocks, the unit of compression; a read
+    /// decompresses all the blocks it touches
+    uint32_t block_size = 64 << 10;
+};
+
+/// Wraps a file so that its data is stored compressed.
+///
+/// The data is split into blocks of \ref compressed_file_options::block_size
+/// bytes, each compressed with LZ4 (or stored as is, if it does not
+/// compress) and checksummed with CRC32C, and written one after the other
+/// to the underlying file with aligned DMA writes, followed on close by an
+/// index of the blocks. A read only reads and decompresses the blocks
+/// holding the requested range; a block whose checksum does not match
+/// fails the read.
+///
+/// If \c f is empty, the returned file is written: writes must be
+/// sequential, each starting where the previous one ended, and the file
+/// can only be read once it has been closed and wrapped again. Truncation
+/// may only cut back what was written within the last write alignment,
+/// e.g. the padding of a file output stream. Otherwise \c f must have been
+/// written through a compressed file, and the returned file is read-only.
+future<file> make_compressed_file(file f, compressed_file_options options = {});
+
+/// @}
+
+}
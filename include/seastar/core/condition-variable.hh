@@ -188,20 +188,27 @@ class condition_variable {
     };
 #endif
 
-    boost::intrusive::list<waiter, boost::intrusive::constant_time_size<false>> _waiters;
+    using waiter_list = boost::intrusive::list<waiter, boost::intrusive::constant_time_size<false>>;
+    class wake_task;
+
+    waiter_list _waiters;
+    waiter_list _pending; // notified by broadcast(), not woken yet
     std::exception_ptr _ex; //"broken" exception
     bool _signalled = false; // set to true if signalled while no waiters
+    wake_task* _wake_task = nullptr; // wakes _pending
 
     void add_waiter(waiter&) noexcept;
     void timeout(waiter&) noexcept;
     bool wakeup_first() noexcept;
     bool check_and_consume_signal() noexcept;
+    // Wakes _pending, in batches unless \c batched is false
+    void wake_pending(bool batched) noexcept;
 public:
     /// Constructs a condition_variable object.
     /// Initialzie the semaphore with a default value of 0 to enusre
     /// the first call to wait() before signal() won't be waken up immediately.
     condition_variable() noexcept = default;
-    condition_variable(condition_variable&& rhs) noexcept = default;
+    condition_variable(condition_variable&& rhs) noexcept;
     ~condition_variable();
 
     /// Waits until condition variable is signaled, may wake up without condition been met
@@ -396,6 +403,9 @@ class condition_variable {
     void signal() noexcept;
 
     /// Notify variable and wake up all waiter
+    ///
+    /// When there are many waiters, only the first ones may be woken right
+    /// away, and the rest by a later task, so as not to stall the reactor.
     void broadcast() noexcept;
 
     /// Signal to waiters that an error occurred.  \ref wait() will see
@@ -28,6 +28,7 @@
 #endif
 
 #include <seastar/core/std-coroutine.hh>
+#include <seastar/core/internal/coroutine_frame_pool.hh>
 #include <seastar/coroutine/exception.hh>
 
 namespace seastar {
@@ -44,6 +45,14 @@ class coroutine_traits_base {
         promise_type(promise_type&&) = delete;
         promise_type(const promise_type&) = delete;
 
+        // Coroutine frames come from the per-shard frame pool
+        static void* operator new(size_t size) {
+            return coroutine_frame_pool::allocate(size);
+        }
+        static void operator delete(void* ptr, size_t size) noexcept {
+            coroutine_frame_pool::free(ptr, size);
+        }
+
         template<typename... U>
         void return_value(U&&... value) {
             _promise.set_value(std::forward<U>(value)...);
@@ -96,6 +105,14 @@ class coroutine_traits_base<> {
         promise_type(promise_type&&) = delete;
         promise_type(const promise_type&) = delete;
 
+        // Coroutine frames come from the per-shard frame pool
+        static void* operator new(size_t size) {
+            return coroutine_frame_pool::allocate(size);
+        }
+        static void operator delete(void* ptr, size_t size) noexcept {
+            coroutine_frame_pool::free(ptr, size);
+        }
+
         void return_void() noexcept {
             _promise.set_value();
         }
@@ -0,0 +1,90 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#pragma once
+
+#include <seastar/core/future.hh>
+#include <seastar/core/sstring.hh>
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+#include <typeinfo>
+#include <vector>
+
+/// \file
+///
+/// A sampling CPU profiler built into the reactor, for when perf cannot be
+/// run against the process. While it runs, each shard samples its own
+/// backtrace every period of its CPU time, using a perf_event task clock
+/// (or a CPU time POSIX timer where perf_event is not available), and
+/// counts the samples by call stack, scheduling group and task type.
+
+namespace seastar {
+
+namespace httpd {
+class http_server;
+}
+
+/// A call stack sampled by the CPU profiler
+struct cpu_profile_stack {
+    std::vector<uintptr_t> addresses; ///< return addresses, innermost first
+    sstring scheduling_group; ///< the group the reactor was running
+    const std::type_info* task_type = nullptr; ///< the task it was running, if any
+    uint64_t samples = 0;
+};
+
+/// The call stacks sampled by the CPU profiler on a shard
+struct cpu_profile {
+    unsigned shard = 0;
+    std::chrono::nanoseconds period{}; ///< CPU time between samples
+    std::vector<cpu_profile_stack> stacks;
+    uint64_t dropped_samples = 0; ///< samples which found the table full
+};
+
+/// Starts the CPU profiler on all shards, or changes its period.
+future<> start_cpu_profiler(std::chrono::nanoseconds period = std::chrono::milliseconds(10));
+
+/// Stops the CPU profiler on all shards; what it sampled can still be read.
+future<> stop_cpu_profiler();
+
+/// Collects the CPU profiles of all shards.
+///
+/// \param reset whether to clear the profiles after they are read
+future<std::vector<cpu_profile>> get_cpu_profiles(bool reset = false);
+
+/// Writes a profile in the folded format which flame graph tools read: a
+/// line per call stack, with frames "shard N", the scheduling group, the
+/// task type and then the stack from the outermost, separated by ';',
+/// followed by the number of samples.
+void write_folded(std::ostream& os, const cpu_profile& profile);
+
+/// Writes profiles, summed, in the legacy CPU profile format of gperftools,
+/// which pprof reads along with the binary. The format has no room for the
+/// scheduling group or the task type.
+void write_pprof(std::ostream& os, const std::vector<cpu_profile>& profiles);
+
+/// Adds routes to control the CPU profiler: POST <prefix>/start, with an
+/// optional period_us query parameter, POST <prefix>/stop, and GET
+/// <prefix>/folded and <prefix>/pprof, which return the profiles of all
+/// shards, and clear them with the query parameter reset=true.
+future<> add_cpu_profiler_routes(httpd::http_server& server, sstring prefix = "/cpu_profile");
+
+}
@@ -34,6 +34,8 @@
 #include <seastar/util/std-compat.hh>
 #include <fmt/format.h>
 #include <fmt/ostream.h>
+#include <array>
+#include <chrono>
 #include <vector>
 #include <boost/range/irange.hpp>
 #include <boost/range/adaptor/transformed.hpp>
@@ -120,11 +122,22 @@ std::reference_wrapper<T> unwrap_for_es(reference_wrapper_for_es<T> ref) {
 /// Base execution stage class
 class execution_stage {
 public:
+    /// Batches of up to 2^i calls are counted in bucket i
+    static constexpr size_t batch_size_buckets = 12;
+    /// The queue length at which calls are executed in the caller rather
+    /// than waiting for the stage's task, which adapts between these
+    static constexpr size_t min_queue_length = 128;
+    static constexpr size_t max_queue_length = 1024;
+
     struct stats {
         uint64_t tasks_scheduled = 0;
         uint64_t tasks_preempted = 0;
         uint64_t function_calls_enqueued = 0;
         uint64_t function_calls_executed = 0;
+        /// Time spent executing queued calls
+        std::chrono::steady_clock::duration cpu_time{};
+        /// Number of batches of each size, see batch_size_buckets
+        std::array<uint64_t, batch_size_buckets> batch_sizes{};
     };
 protected:
     bool _empty = true;
@@ -133,8 +146,19 @@ class execution_stage {
     stats _stats;
     sstring _name;
     metrics::metric_group _metric_group;
+    size_t _max_queue_length = max_queue_length;
+private:
+    // Average time per call of the batches of each size bucket, in ns
+    std::array<double, batch_size_buckets> _cost_per_call{};
+    std::array<uint32_t, batch_size_buckets> _cost_samples{};
+    unsigned _batches_since_adapt = 0;
+
+    void account_batch(uint64_t calls, std::chrono::steady_clock::duration took) noexcept;
+    void adapt_queue_length() noexcept;
 protected:
     virtual void do_flush() noexcept = 0;
+    /// Calls do_flush(), accounting for the batch of calls it executes
+    void run_flush() noexcept;
 public:
     explicit execution_stage(const sstring& name, scheduling_group sg = {});
     virtual ~execution_stage();
@@ -155,6 +179,15 @@ class execution_stage {
     /// Returns execution stage usage statistics
     const stats& get_stats() const noexcept { return _stats; }
 
+    /// Returns the queue length at which calls are executed in the caller
+    ///
+    /// Larger batches amortize the cost of bringing the stage's code and
+    /// data into the caches over more calls, and the stage measures the
+    /// time per call of the batches it runs: the length is the smallest
+    /// batch size whose time per call comes within an eighth of the best
+    /// one, as larger batches only add latency.
+    size_t queue_length_limit() const noexcept { return _max_queue_length; }
+
     /// Flushes execution stage
     ///
     /// Ensures that a task which would execute all queued operations is
@@ -212,7 +245,6 @@ class concrete_execution_stage final : public execution_stage {
                   "Function arguments need to be nothrow move constructible");
 
     static constexpr size_t flush_threshold = 128;
-    static constexpr size_t max_queue_length = 1024;
 
     using return_type = futurize_t<ReturnType>;
     using promise_type = typename return_type::promise_type;
@@ -287,8 +319,8 @@ class concrete_execution_stage final : public execution_stage {
     /// \param args arguments passed to the stage's function
     /// \return future containing the result of the call to the stage's function
     return_type operator()(typename internal::wrap_for_es<Args>::type... args) {
-        if (_queue.size() >= max_queue_length) {
-            do_flush();
+        if (_queue.size() >= _max_queue_length) {
+            run_flush();
         }
         _queue.emplace_back(std::move(args)...);
         _empty = false;
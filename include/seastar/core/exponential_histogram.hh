@@ -0,0 +1,144 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#pragma once
+
+#include <seastar/core/metrics_types.hh>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+/// \file
+///
+/// A histogram to be exported as a metric, which records values as they
+/// come, unlike \ref metrics::histogram, which only holds what a histogram
+/// implementation reports.
+
+namespace seastar {
+
+namespace metrics {
+
+/// A histogram of exponential buckets, as Prometheus native histograms
+/// have them: for a schema \c s, every power of two is split into \c 2^s
+/// buckets of the same ratio, so that the relative error of the
+/// histogram is the same over its whole range, as in HDR histograms.
+/// Bucket \c i holds the values in <tt>(base^(i-1), base^i]</tt>, where
+/// <tt>base = 2^(2^-s)</tt>.
+///
+/// Buckets are allocated upfront, for a range of values, so that record()
+/// never allocates. Values below the range, and negative values, are
+/// counted in a zero bucket; values above it, in the last bucket.
+///
+/// A histogram belongs to a shard, so it needs no atomic operations; to
+/// report a value over the shards, register one per shard, and aggregate
+/// them over the \c shard label. Histograms with the same range and schema
+/// can be added together.
+class exponential_histogram {
+    int _schema;
+    int32_t _min_id;
+    double _zero_threshold;
+    uint64_t _zero_count = 0;
+    uint64_t _count = 0;
+    double _sum = 0;
+    // Bucket i holds the values of bucket id _min_id + i
+    std::vector<uint64_t> _buckets;
+    // Upper bounds of the buckets of a power of two, normalized to [0.5, 1)
+    std::vector<double> _bounds;
+public:
+    /// The largest supported schema
+    static constexpr int max_schema = 8;
+
+    /// Creates a histogram for values from \c min to \c max.
+    ///
+    /// \param schema the resolution, from 0 to \ref max_schema; with 3,
+    ///        the default, buckets are 9% wide
+    exponential_histogram(double min, double max, int schema = 3);
+
+    /// Records a value
+    void record(double v) noexcept {
+        _count++;
+        _sum += v;
+        if (v <= _zero_threshold) [[unlikely]] {
+            _zero_count++;
+            return;
+        }
+        int32_t i = bucket_id(v) - _min_id;
+        if (i >= int32_t(_buckets.size())) [[unlikely]] {
+            i = _buckets.size() - 1;
+        }
+        _buckets[i]++;
+    }
+
+    /// Records a duration, in seconds
+    template <typename Rep, typename Period>
+    void record(std::chrono::duration<Rep, Period> d) noexcept {
+        record(std::chrono::duration<double>(d).count());
+    }
+
+    /// The id of the bucket which holds \c v, which must be positive
+    int32_t bucket_id(double v) const noexcept {
+        int exp;
+        double frac = std::frexp(v, &exp);
+        // The first bound which is not below frac
+        int32_t j = 0;
+        int32_t n = _bounds.size();
+        while (j < n && _bounds[j] < frac) {
+            j++;
+        }
+        return (exp - 1) * n + j;
+    }
+
+    /// The upper bound of a bucket
+    double upper_bound(int32_t id) const noexcept {
+        return std::exp2(std::ldexp(double(id), -_schema));
+    }
+
+    int schema() const noexcept { return _schema; }
+    uint64_t count() const noexcept { return _count; }
+    double sum() const noexcept { return _sum; }
+
+    /// Forgets all values
+    void reset() noexcept;
+
+    /// Adds the values of \c h, which must have the same range and schema.
+    ///
+    /// \throws std::invalid_argument if it does not
+    exponential_histogram& operator+=(const exponential_histogram& h);
+
+    /// An upper estimate of a quantile, from 0 to 1
+    double quantile(double q) const noexcept;
+
+    /// Reports the histogram to the metrics layer, with the layout of its
+    /// buckets, so that exporters which support native histograms can use
+    /// it, and the others see a conventional histogram.
+    histogram to_metrics_histogram() const;
+
+    /// Reports quantiles of the histogram to the metrics layer, as a
+    /// summary. As summaries hold integers, each quantile is reported
+    /// multiplied by \c unit, e.g. 1e6 for values in seconds reported in
+    /// microseconds.
+    histogram to_metrics_summary(const std::vector<double>& quantiles, double unit = 1) const;
+};
+
+}
+
+}
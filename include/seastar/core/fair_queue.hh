@@ -184,6 +184,7 @@ class fair_group {
     static constexpr float fixed_point_factor = float(1 << 24);
     using rate_resolution = std::milli;
     using token_bucket_t = internal::shared_token_bucket<capacity_t, rate_resolution, internal::capped_release::yes>;
+    using lease_t = internal::shared_token_bucket_lease<token_bucket_t, capacity_t>;
 
 private:
 
@@ -208,6 +209,8 @@ class fair_group {
 
     const fair_queue_ticket _cost_capacity;
     token_bucket_t _token_bucket;
+    const capacity_t _nominal_rate;
+    const capacity_t _lease_capacity;
 
 public:
 
@@ -237,6 +240,12 @@ class fair_group {
         unsigned long size_rate;
         float rate_factor = 1.0;
         std::chrono::duration<double> rate_limit_duration = std::chrono::milliseconds(1);
+        /*
+         * Queues take the capacity from the group in chunks of this fraction
+         * of the per-shard slice of the limit, not to contend on the shared
+         * rovers for every request. Zero makes them take it per request.
+         */
+        float lease_fraction = 0.125;
     };
 
     explicit fair_group(config cfg);
@@ -245,11 +254,21 @@ class fair_group {
     fair_queue_ticket cost_capacity() const noexcept { return _cost_capacity; }
     capacity_t maximum_capacity() const noexcept { return _token_bucket.limit(); }
     capacity_t grab_capacity(capacity_t cap) noexcept;
+    // A lease to grab and release the capacity through, see
+    // internal::shared_token_bucket_lease
+    lease_t make_lease() noexcept { return lease_t(_token_bucket, _lease_capacity); }
     clock_type::time_point replenished_ts() const noexcept { return _token_bucket.replenished_ts(); }
     void release_capacity(capacity_t cap) noexcept;
+    void refund_capacity(capacity_t cap) noexcept;
     void replenish_capacity(clock_type::time_point now) noexcept;
     void maybe_replenish_capacity(clock_type::time_point& local_ts) noexcept;
 
+    // The replenish rate relative to the configured one. It's lowered
+    // when the device cannot keep up with the configured rate and sustain
+    // the expected latency, see io_queue::config::latency_target.
+    double rate_scale() const noexcept { return (double)_token_bucket.rate() / _nominal_rate; }
+    void set_rate_scale(double scale) noexcept;
+
     capacity_t capacity_deficiency(capacity_t from) const noexcept;
     capacity_t ticket_capacity(fair_queue_ticket ticket) const noexcept;
 
@@ -278,6 +297,12 @@ class fair_group {
 /// When the classes that lag behind start seeing requests, the fair queue will serve
 /// them first, until balance is restored. This balancing is expected to happen within
 /// a certain time window that obeys an exponential decay.
+///
+/// Classes can be arranged into a two-level hierarchy. Every class belongs to a
+/// group, groups divide the capacity between each other according to their
+/// shares and the classes of a group divide the group's slice according to
+/// theirs. Classes registered without a group belong to the \ref default_group,
+/// so with no groups registered the queue behaves as a flat one.
 class fair_queue {
 public:
     /// \brief Fair Queue configuration structure.
@@ -290,26 +315,36 @@ class fair_queue {
     };
 
     using class_id = unsigned int;
+    using group_id = unsigned int;
     class priority_class_data;
+    class priority_class_group_data;
     using capacity_t = fair_group::capacity_t;
     using signed_capacity_t = std::make_signed<capacity_t>::type;
 
+    /// The group classes belong to unless registered into another one
+    static constexpr group_id default_group = 0;
+    /// Shares the \ref default_group is created with
+    static constexpr uint32_t default_group_shares = 100;
+
 private:
     using clock_type = std::chrono::steady_clock;
     using priority_class_ptr = priority_class_data*;
+    using priority_class_group_ptr = priority_class_group_data*;
     struct class_compare {
-        bool operator() (const priority_class_ptr& lhs, const priority_class_ptr & rhs) const noexcept;
+        template <typename Ptr>
+        bool operator() (const Ptr& lhs, const Ptr& rhs) const noexcept;
     };
 
-    class priority_queue : public std::priority_queue<priority_class_ptr, std::vector<priority_class_ptr>, class_compare> {
-        using super = std::priority_queue<priority_class_ptr, std::vector<priority_class_ptr>, class_compare>;
+    template <typename Ptr>
+    class priority_queue : public std::priority_queue<Ptr, std::vector<Ptr>, class_compare> {
+        using super = std::priority_queue<Ptr, std::vector<Ptr>, class_compare>;
     public:
         void reserve(size_t len) {
-            c.reserve(len);
+            this->c.reserve(len);
         }
 
         void assert_enough_capacity() const noexcept {
-            assert(c.size() < c.capacity());
+            assert(this->c.size() < this->c.capacity());
         }
     };
 
@@ -320,9 +355,10 @@ class fair_queue {
     fair_queue_ticket _resources_queued;
     unsigned _requests_executing = 0;
     unsigned _requests_queued = 0;
-    priority_queue _handles;
+    priority_queue<priority_class_group_ptr> _handles;
     std::vector<std::unique_ptr<priority_class_data>> _priority_classes;
-    size_t _nr_classes = 0;
+    std::vector<std::unique_ptr<priority_class_group_data>> _priority_groups;
+    size_t _nr_groups = 0;
     capacity_t _last_accumulated = 0;
 
     /*
@@ -344,10 +380,16 @@ class fair_queue {
     };
 
     std::optional<pending> _pending;
+    fair_group::lease_t _lease;
 
     void push_priority_class(priority_class_data& pc) noexcept;
     void push_priority_class_from_idle(priority_class_data& pc) noexcept;
     void pop_priority_class(priority_class_data& pc) noexcept;
+    template <typename Entity>
+    void catch_up_from_idle(Entity& e, capacity_t last_accumulated) noexcept;
+    void push_priority_group(priority_class_group_data& pg) noexcept;
+    void push_priority_group_from_idle(priority_class_group_data& pg) noexcept;
+    void pop_priority_group(priority_class_group_data& pg) noexcept;
     void plug_priority_class(priority_class_data& pc) noexcept;
     void unplug_priority_class(priority_class_data& pc) noexcept;
 
@@ -364,10 +406,24 @@ class fair_queue {
 
     sstring label() const noexcept { return _config.label; }
 
+    /// Registers a group of priority classes against this fair queue.
+    ///
+    /// \param shares how many shares of the queue capacity the group gets
+    void register_priority_class_group(group_id g, uint32_t shares);
+
+    /// Unregister a group of priority classes.
+    ///
+    /// It is illegal to unregister a group that still has classes in it. The
+    /// \ref default_group cannot be unregistered.
+    void unregister_priority_class_group(group_id g);
+
+    void update_shares_for_class_group(group_id g, uint32_t new_shares);
+
     /// Registers a priority class against this fair queue.
     ///
     /// \param shares how many shares to create this class with
-    void register_priority_class(class_id c, uint32_t shares);
+    /// \param g the group the class divides the capacity in
+    void register_priority_class(class_id c, uint32_t shares, group_id g = default_group);
 
     /// Unregister a priority class.
     ///
@@ -402,7 +458,14 @@ class fair_queue {
     /// Notifies that ont request finished
     /// \param desc an instance of \c fair_queue_ticket structure describing the request that just finished.
     void notify_request_finished(fair_queue_ticket desc) noexcept;
+    /// Same as \ref notify_request_finished, but for a request that was
+    /// aborted before the device did the work, so its capacity is
+    /// returned to the group for others to use right away
+    void notify_request_aborted(fair_queue_ticket desc) noexcept;
     void notify_request_cancelled(fair_queue_entry& ent) noexcept;
+    /// Changes the ticket of a still queued entry, e.g. when another request
+    /// was merged into it
+    void update_queued_entry(fair_queue_entry& ent, fair_queue_ticket ticket) noexcept;
 
     /// Try to execute new requests if there is capacity left in the queue.
     void dispatch_requests(std::function<void(fair_queue_entry&)> cb);
@@ -410,6 +473,7 @@ class fair_queue {
     clock_type::time_point next_pending_aio() const noexcept;
 
     std::vector<seastar::metrics::impl::metric_definition_impl> metrics(class_id c);
+    std::vector<seastar::metrics::impl::metric_definition_impl> group_metrics(group_id g);
 };
 /// @}
 
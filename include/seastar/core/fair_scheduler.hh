@@ -0,0 +1,155 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+
+#pragma once
+
+#include <seastar/core/fair_queue.hh>
+#include <seastar/core/future.hh>
+#include <seastar/core/timer.hh>
+#include <chrono>
+#include <utility>
+
+namespace seastar {
+
+/// Schedules the use of a resource by classes of users with a \ref fair_queue.
+///
+/// The fair queue is not tied to the disk: a \ref fair_queue_ticket is a pair
+/// of costs, the number of operations and their size in whatever unit the
+/// resource is used, and the \ref fair_group the queue draws from is given
+/// the rates at which the resource can serve both. For example
+///
+/// - outbound network traffic: one operation per message, its size in bytes,
+///   the link bandwidth as the size rate;
+/// - RPC server concurrency: one operation per call, its size an estimate of
+///   the CPU time it takes in microseconds, a million per second per shard
+///   serving calls as the size rate.
+///
+/// Users acquire() a \ref permit for the ticket of what they are about to do
+/// and release it when done. Permits are granted as the group has capacity
+/// for them, the classes dividing it in proportion to their shares, so a
+/// class with a lot of work, e.g. bulk streaming, cannot starve the others.
+///
+/// \code
+/// fair_group::config gcfg;
+/// gcfg.weight_rate = 100'000;        // messages per second
+/// gcfg.size_rate = 1'250'000'000;    // bytes per second
+/// fair_group group(gcfg);
+/// fair_scheduler net(group, {});
+/// net.register_class(streaming, 100);
+/// net.register_class(queries, 400);
+/// ...
+/// return net.acquire(streaming, fair_queue_ticket(1, buf.size())).then([&out, buf = std::move(buf)] (auto permit) mutable {
+///     return out.write(std::move(buf)).finally([permit = std::move(permit)] {});
+/// });
+/// \endcode
+///
+/// The group can be shared by the schedulers of several shards, like the
+/// group of an I/O queue is.
+class fair_scheduler {
+public:
+    using class_id = fair_queue::class_id;
+    using group_id = fair_queue::group_id;
+
+    struct config {
+        fair_queue::config queue;
+        /// How often to retry granting permits when the group has no
+        /// capacity left, but doesn't know when it will have it either
+        std::chrono::microseconds dispatch_period = std::chrono::microseconds(100);
+    };
+
+    /// Capacity granted by \ref acquire(), given back to the group when the
+    /// permit is released or destroyed
+    class permit {
+        friend class fair_scheduler;
+        fair_scheduler* _sched = nullptr;
+        fair_queue_ticket _ticket;
+
+        permit(fair_scheduler& sched, fair_queue_ticket ticket) noexcept : _sched(&sched), _ticket(ticket) {}
+    public:
+        permit() noexcept = default;
+        permit(permit&& o) noexcept : _sched(std::exchange(o._sched, nullptr)), _ticket(o._ticket) {}
+        permit& operator=(permit&& o) noexcept {
+            if (this != &o) {
+                release();
+                _sched = std::exchange(o._sched, nullptr);
+                _ticket = o._ticket;
+            }
+            return *this;
+        }
+        ~permit() {
+            release();
+        }
+
+        fair_queue_ticket ticket() const noexcept { return _ticket; }
+        explicit operator bool() const noexcept { return _sched != nullptr; }
+
+        void release() noexcept {
+            if (auto s = std::exchange(_sched, nullptr)) {
+                s->release(_ticket);
+            }
+        }
+    };
+
+private:
+    struct waiter;
+
+    fair_queue _queue;
+    config _config;
+    timer<> _dispatch_timer;
+    unsigned _waiters = 0;
+
+    void dispatch() noexcept;
+    void release(fair_queue_ticket ticket) noexcept;
+public:
+    fair_scheduler(fair_group& group, config cfg);
+    fair_scheduler(fair_scheduler&&) = delete;
+    /// All permits must be released, and granted, before the scheduler is
+    /// destroyed
+    ~fair_scheduler();
+
+    /// Registers a class, see \ref fair_queue::register_priority_class()
+    void register_class(class_id c, uint32_t shares, group_id g = fair_queue::default_group) {
+        _queue.register_priority_class(c, shares, g);
+    }
+    /// Unregisters a class that has no permits waiting to be granted
+    void unregister_class(class_id c) {
+        _queue.unregister_priority_class(c);
+    }
+    void update_shares(class_id c, uint32_t shares) {
+        _queue.update_shares_for_class(c, shares);
+    }
+    /// Registers a group of classes, see \ref fair_queue::register_priority_class_group()
+    void register_class_group(group_id g, uint32_t shares) {
+        _queue.register_priority_class_group(g, shares);
+    }
+
+    /// Waits for the capacity of \c ticket to be granted to class \c c
+    future<permit> acquire(class_id c, fair_queue_ticket ticket);
+
+    /// Permits waiting to be granted
+    unsigned waiters() const noexcept { return _waiters; }
+
+    /// The queue, e.g. for its \ref fair_queue::metrics()
+    fair_queue& queue() noexcept { return _queue; }
+};
+
+}
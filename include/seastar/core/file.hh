@@ -29,6 +29,7 @@
 #include <seastar/core/io_priority_class.hh>
 #include <seastar/core/file-types.hh>
 #include <seastar/util/std-compat.hh>
+#include <span>
 #include <system_error>
 #include <sys/statvfs.h>
 #include <sys/ioctl.h>
@@ -49,6 +50,18 @@ struct directory_entry {
     std::optional<directory_entry_type> type;
 };
 
+/// Options for \ref file::list_directory_batches().
+struct list_directory_options {
+    /// Size of the buffer each read of the directory fills; the entries
+    /// of a batch are those of one read.
+    size_t buffer_size = 128 << 10;
+    /// Look up the type of the entries whose type the file system does
+    /// not keep in the directory, with a stat of each.
+    bool resolve_types = false;
+    /// How many of those lookups run at the same time.
+    unsigned stat_concurrency = 16;
+};
+
 /// Filesystem object stat information
 struct stat_data {
     uint64_t  device_id;      // ID of device containing file
@@ -142,6 +155,7 @@ class file_impl {
     virtual future<> close() = 0;
     virtual std::unique_ptr<file_handle_impl> dup();
     virtual subscription<directory_entry> list_directory(std::function<future<> (directory_entry de)> next) = 0;
+    virtual future<> list_directory_batches(std::function<future<> (std::span<directory_entry> entries)> next, list_directory_options opts);
     virtual future<temporary_buffer<uint8_t>> dma_read_bulk(uint64_t offset, size_t range_size, const io_priority_class& pc) = 0;
     virtual future<temporary_buffer<uint8_t>> dma_read_bulk(uint64_t offset, size_t range_size, const io_priority_class& pc, io_intent*) {
         return dma_read_bulk(offset, range_size, pc);
@@ -524,6 +538,22 @@ class file {
     /// Returns a directory listing, given that this file object is a directory.
     subscription<directory_entry> list_directory(std::function<future<> (directory_entry de)> next);
 
+    /// Lists a directory, given that this file object is a directory, in
+    /// batches of entries.
+    ///
+    /// Reads the directory in large steps, and passes \c next all entries
+    /// of a step at once, which for large directories costs much less than
+    /// \ref list_directory(), which passes them one at a time.
+    ///
+    /// \param next called with each batch, not before the future returned
+    ///        for the previous one resolved; the entries may be moved from
+    ///        and are gone after that future resolves
+    /// \param opts see \ref list_directory_options
+    /// \return a future which resolves once all entries have been passed,
+    ///         or fails with the first error of reading the directory or
+    ///         of \c next
+    future<> list_directory_batches(std::function<future<> (std::span<directory_entry> entries)> next, list_directory_options opts = {});
+
     /**
      * Read a data bulk containing the provided addresses range that starts at
      * the given offset and ends at either the address aligned to
@@ -56,8 +56,22 @@ struct file_input_stream_options {
     unsigned read_ahead = 0;      ///< Maximum number of extra read-ahead operations
     ::seastar::io_priority_class io_priority_class = default_priority_class();
     lw_shared_ptr<file_input_stream_history> dynamic_adjustments = { }; ///< Input stream history, if null dynamic adjustments are disabled
+    /// Detect the access pattern and size read-ahead after it: it ramps up
+    /// exponentially (up to \c read_ahead) while the stream is consumed
+    /// sequentially, or with a small constant stride, and stops on random
+    /// skips
+    bool adaptive_read_ahead = false;
 };
 
+/// Limits the number of bytes file input streams of the given priority
+/// class may have in read-ahead at a time on this shard.
+///
+/// Only reads issued ahead of the consumer are limited, the read the
+/// consumer waits for is always issued. This keeps a scan with a deep
+/// read-ahead from monopolizing the class's disk share at the expense
+/// of point reads. The default is unlimited.
+void set_read_ahead_budget(const io_priority_class& pc, size_t bytes);
+
 /// \brief Creates an input_stream to read a portion of a file.
 ///
 /// \param file File to read; multiple streams for the same file may coexist
@@ -94,8 +108,21 @@ struct file_output_stream_options {
     unsigned preallocation_size = 0; ///< Preallocate extents. For large files, set to a large number (a few megabytes) to reduce fragmentation
     unsigned write_behind = 1; ///< Number of buffers to write in parallel
     ::seastar::io_priority_class io_priority_class = default_priority_class();
+    /// When non-zero, sequential buffers are gathered and written with a
+    /// single vectored write once this many bytes are collected (or on
+    /// flush). The memory of buffers not yet written back is accounted
+    /// against the shard's write-behind memory limit, see
+    /// \ref set_write_behind_memory_limit().
+    unsigned coalesce_size = 0;
 };
 
+/// Sets the amount of memory coalescing file output streams of this shard
+/// may hold in buffers that are not yet written to disk.
+///
+/// Once the limit is reached, writes to such streams wait for earlier
+/// writes to complete. The default is unlimited.
+void set_write_behind_memory_limit(size_t bytes);
+
 SEASTAR_INCLUDE_API_V2 namespace api_v2 {
 
 /// Create an output_stream for writing starting at the position zero of a
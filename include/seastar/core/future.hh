@@ -756,6 +756,73 @@ class continuation_base_with_promise : public continuation_base<T SEASTAR_ELLIPS
     Promise _pr;
 };
 
+namespace internal {
+
+// Recently freed continuations, by size, for reuse by the next ones of
+// the same size class: a chain of .then() typically frees a continuation
+// right before allocating one of a similar type, so the storage can be
+// recycled without going through the allocator. Not used in debug
+// builds, where reuse would hide use-after-free of continuations from
+// the sanitizers.
+struct continuation_cache {
+    static constexpr size_t granularity = 16;
+    static constexpr unsigned nr_size_classes = 8; // up to 128 bytes
+    static constexpr unsigned max_objects = 32; // per size class
+    struct free_object {
+        free_object* next;
+    };
+    free_object* free[nr_size_classes];
+    unsigned count[nr_size_classes];
+
+    static constexpr size_t size_class(size_t size) noexcept {
+        return (size - 1) / granularity;
+    }
+};
+
+extern thread_local continuation_cache local_continuation_cache;
+
+inline
+void* allocate_continuation(size_t size) {
+#ifndef SEASTAR_DEBUG
+    auto idx = continuation_cache::size_class(size);
+    if (idx < continuation_cache::nr_size_classes) {
+        auto& c = local_continuation_cache;
+        if (auto obj = c.free[idx]) {
+            c.free[idx] = obj->next;
+            --c.count[idx];
+            return obj;
+        }
+        // Round up, so the object can be reused for anything in its class
+        return ::operator new((idx + 1) * continuation_cache::granularity);
+    }
+#endif
+    return ::operator new(size);
+}
+
+inline
+void free_continuation(void* ptr, size_t size) noexcept {
+#ifndef SEASTAR_DEBUG
+    auto idx = continuation_cache::size_class(size);
+    if (idx < continuation_cache::nr_size_classes) {
+        auto& c = local_continuation_cache;
+        if (c.count[idx] < continuation_cache::max_objects) {
+            auto obj = static_cast<continuation_cache::free_object*>(ptr);
+            obj->next = c.free[idx];
+            c.free[idx] = obj;
+            ++c.count[idx];
+            return;
+        }
+        size = (idx + 1) * continuation_cache::granularity;
+    }
+#endif
+    ::operator delete(ptr, size);
+}
+
+// Returns the cached continuations of this thread to the allocator.
+void drain_continuation_cache() noexcept;
+
+}
+
 #if SEASTAR_API_LEVEL < 6
 template <typename Promise, typename Func, typename Wrapper, typename... T>
 #else
@@ -784,6 +851,20 @@ struct continuation final : continuation_base_with_promise<Promise, T SEASTAR_EL
         }
         delete this;
     }
+    static void* operator new(size_t size) {
+        if constexpr (alignof(continuation) > alignof(std::max_align_t)) {
+            return ::operator new(size, std::align_val_t(alignof(continuation)));
+        } else {
+            return internal::allocate_continuation(size);
+        }
+    }
+    static void operator delete(void* ptr, size_t size) noexcept {
+        if constexpr (alignof(continuation) > alignof(std::max_align_t)) {
+            ::operator delete(ptr, size, std::align_val_t(alignof(continuation)));
+        } else {
+            internal::free_continuation(ptr, size);
+        }
+    }
     Func _func;
     [[no_unique_address]] Wrapper _wrapper;
 };
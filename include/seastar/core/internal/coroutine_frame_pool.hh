@@ -0,0 +1,73 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace seastar {
+
+namespace internal {
+
+// Per-shard free lists of coroutine frames, by size class.
+//
+// A coroutine frame lives from the call to its final co_return, so the
+// frames of a hot coroutine are allocated and freed at a high rate, at
+// sizes (a few hundred bytes) that the small pools of the allocator serve
+// through their free lists and spans. Keeping a bounded number of freed
+// frames per size class lets the next call of a coroutine of the same size
+// take one back without reaching the allocator.
+//
+// Frames are sized up to their class in both directions, so a frame can be
+// freed with the pool disabled, or vice versa. Debug builds bypass the free
+// lists, to keep use-after-free detectable.
+class coroutine_frame_pool {
+public:
+    static constexpr size_t size_class_bytes = 64;
+    static constexpr size_t size_classes = 16;
+    static constexpr size_t max_pooled_size = size_class_bytes * size_classes;
+    // Per size class
+    static constexpr unsigned max_pooled_frames = 128;
+
+    struct stats {
+        // Frame allocations by size class, with those larger than
+        // max_pooled_size in the last slot
+        std::array<uint64_t, size_classes + 1> allocations{};
+        // Allocations served from the free lists
+        std::array<uint64_t, size_classes> reuses{};
+        // Bytes held in the free lists
+        size_t pooled_bytes = 0;
+    };
+
+    static void* allocate(size_t size);
+    static void free(void* ptr, size_t size) noexcept;
+
+    // For comparing with and without the pool. Frames already in the free
+    // lists are released when disabling.
+    static void set_enabled(bool enabled) noexcept;
+    static const stats& get_stats() noexcept;
+};
+
+}
+
+}
@@ -0,0 +1,76 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+
+namespace seastar {
+
+namespace internal {
+
+/*
+ * Keeps a shard within its part of a CPU quota, such as that of a cgroup
+ * with cpu.max set, by sleeping between tasks.
+ *
+ * The kernel lets a cgroup use its quota as fast as it likes, then stops
+ * all of its threads until the end of the period, whatever they were
+ * doing, which shows up as latency spikes of up to the period. The pacer
+ * gives the shard credit for CPU time at its share of the wall time, up
+ * to a small burst, and asks it to sleep for as long as it takes to pay
+ * back the CPU time it used beyond that, so that it is slowed down evenly
+ * rather than stopped.
+ */
+class cpu_quota_pacer {
+public:
+    using duration = std::chrono::nanoseconds;
+private:
+    double _share;
+    double _burst_ns;
+    double _credit_ns;
+public:
+    /// \param share the CPU time the shard may use per unit of wall time
+    /// \param burst the most CPU time it may save up while it is idle
+    cpu_quota_pacer(double share, duration burst) noexcept
+        : _share(share)
+        , _burst_ns(burst.count())
+        , _credit_ns(_burst_ns)
+    { }
+
+    double share() const noexcept {
+        return _share;
+    }
+
+    /// Accounts for \c cpu time used over \c elapsed wall time, and
+    /// returns how long to sleep to make up for the excess, if any
+    duration update(duration elapsed, duration cpu) noexcept {
+        _credit_ns = std::min(_credit_ns + _share * elapsed.count() - cpu.count(), _burst_ns);
+        if (_credit_ns >= 0) {
+            return duration(0);
+        }
+        return duration(static_cast<duration::rep>(-_credit_ns / _share));
+    }
+};
+
+}
+
+}
@@ -0,0 +1,133 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#pragma once
+
+#include <seastar/core/bitops.hh>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+namespace seastar {
+
+namespace internal {
+
+/*
+ * Picks how long the reactor polls, once it runs out of work, before it
+ * goes to sleep.
+ *
+ * An idle period shorter than the poll time costs its length in CPU time,
+ * and no wakeup; a longer one costs the poll time, and the latency of a
+ * wakeup. The policy keeps a histogram of the lengths of the recent idle
+ * periods, in power-of-two buckets of microseconds, halved on every
+ * update, and picks the longest poll time whose polling would have cost
+ * at most a budget, a fraction of the elapsed time, up to a maximum; then
+ * the shortest one which would have avoided about as many wakeups, so that
+ * no time is spent polling for work which comes too late for it anyway.
+ */
+class idle_poll_policy {
+public:
+    using duration = std::chrono::nanoseconds;
+private:
+    // Bucket i holds periods of [2^i, 2^(i+1)) us, the first also the
+    // shorter ones, the last also the longer ones
+    static constexpr unsigned nr_buckets = 20;
+
+    std::array<double, nr_buckets> _periods = {};
+    double _elapsed_us = 0;
+    duration _max_poll_time;
+    double _budget;
+    duration _poll_time;
+
+    static unsigned bucket_of(uint64_t us) noexcept {
+        return us ? std::min(unsigned(log2floor(us)), nr_buckets - 1) : 0;
+    }
+    // Periods of the bucket are shorter than this
+    static double upper_bound_us(unsigned b) noexcept {
+        return double(uint64_t(2) << b);
+    }
+public:
+    /// \param max_poll_time the longest poll time
+    /// \param budget the fraction of the time which may be spent polling
+    idle_poll_policy(duration max_poll_time, double budget) noexcept
+        : _max_poll_time(max_poll_time)
+        , _budget(budget)
+        , _poll_time(max_poll_time)
+    { }
+
+    duration poll_time() const noexcept {
+        return _poll_time;
+    }
+
+    /// An idle period ended, after \c d
+    void on_idle_end(duration d) noexcept {
+        _periods[bucket_of(std::chrono::duration_cast<std::chrono::microseconds>(d).count())] += 1;
+    }
+
+    /// Picks the poll time from the idle periods which ended in the last
+    /// \c elapsed time, and those before them
+    void update(duration elapsed) noexcept {
+        _elapsed_us += std::chrono::duration_cast<std::chrono::duration<double, std::micro>>(elapsed).count();
+        auto max_us = std::chrono::duration_cast<std::chrono::duration<double, std::micro>>(_max_poll_time).count();
+        auto allowed_us = _budget * _elapsed_us;
+        // Poll times of 0 and of the upper bounds of the buckets, which
+        // avoid the wakeups of all periods of the buckets up to theirs,
+        // the last one cut to the maximum
+        double total = 0;
+        for (auto n : _periods) {
+            total += n;
+        }
+        // Longer polls must avoid a sixteenth more of the wakeups
+        auto min_gain = total / 16;
+        double best_us = 0;
+        double best_hits = 0;
+        for (unsigned p = 0; p < nr_buckets && (p == 0 || upper_bound_us(p - 1) < max_us); p++) {
+            auto poll_us = std::min(upper_bound_us(p), max_us);
+            double cost = 0;
+            double hits = 0;
+            for (unsigned b = 0; b < nr_buckets; b++) {
+                if (b <= p) {
+                    cost += _periods[b] * upper_bound_us(b);
+                    hits += _periods[b];
+                } else {
+                    cost += _periods[b] * poll_us;
+                }
+            }
+            if (cost > allowed_us) {
+                break;
+            }
+            if (hits >= best_hits + min_gain && hits > best_hits) {
+                best_us = poll_us;
+                best_hits = hits;
+            }
+        }
+        _poll_time = std::chrono::duration_cast<duration>(std::chrono::duration<double, std::micro>(best_us));
+        for (auto& n : _periods) {
+            n /= 2;
+        }
+        _elapsed_us /= 2;
+    }
+};
+
+}
+
+}
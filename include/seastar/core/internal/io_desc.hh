@@ -31,5 +31,11 @@ class kernel_completion {
     ~kernel_completion() = default;
 public:
     virtual void complete_with(ssize_t res) = 0;
+    // Called by the io_uring backend, which also has the completion
+    // queue entry flags (selected buffer id, more-completions-follow).
+    // Completions that don't care about them take the default.
+    virtual void complete_with_flags(ssize_t res, unsigned flags) {
+        complete_with(res);
+    }
 };
 }
@@ -32,6 +32,18 @@ class io_intent;
 
 namespace internal {
 
+/*
+ * A request that left the IO queue and is being executed, but that
+ * is still bound to the intent. Cancelling the intent tries to abort
+ * it, the request is unlinked once it completes.
+ */
+class dispatched_request : public bi::list_base_hook<bi::link_mode<bi::auto_unlink>> {
+public:
+    virtual void on_intent_cancelled() noexcept = 0;
+protected:
+    ~dispatched_request() = default;
+};
+
 /*
  * The tracker of cancellable sub-queue of requests.
  *
@@ -60,10 +72,13 @@ class cancellable_queue {
             cq.push_back(*this);
         }
 
-        void maybe_dequeue() noexcept {
-            if (_ref != nullptr) {
-                _ref->pop_front();
+        // Returns the queue the link was removed from, if any
+        cancellable_queue* maybe_dequeue() noexcept {
+            auto cq = _ref;
+            if (cq != nullptr) {
+                cq->pop_front();
             }
+            return cq;
         }
     };
 
@@ -76,6 +91,7 @@ class cancellable_queue {
 
     link* _first;
     list_of_links_t _rest;
+    bi::list<dispatched_request, bi::constant_time_size<false>> _dispatched;
 
     void push_back(link& il) noexcept;
     void pop_front() noexcept;
@@ -86,6 +102,10 @@ class cancellable_queue {
     cancellable_queue(cancellable_queue&& o) noexcept;
     cancellable_queue& operator=(cancellable_queue&& o) noexcept;
     ~cancellable_queue();
+
+    void track_dispatched(dispatched_request& r) noexcept {
+        _dispatched.push_back(r);
+    }
 };
 
 /*
@@ -282,11 +282,14 @@ class io_request {
     }
 
     struct part;
-    std::vector<part> split(size_t max_length);
+    // Splits the request into parts of at most max_length bytes. If the
+    // boundary is not zero, parts also don't cross file offsets that are
+    // multiples of it.
+    std::vector<part> split(size_t max_length, size_t boundary = 0);
 
 private:
-    std::vector<part> split_buffer(size_t max_length);
-    std::vector<part> split_iovec(size_t max_length);
+    std::vector<part> split_buffer(size_t max_length, size_t boundary);
+    std::vector<part> split_iovec(size_t max_length, size_t boundary);
 };
 
 struct io_request::part {
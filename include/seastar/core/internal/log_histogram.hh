@@ -0,0 +1,144 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#pragma once
+
+#include <seastar/core/bitops.hh>
+#include <seastar/core/metrics_types.hh>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+namespace seastar {
+
+namespace internal {
+
+/*
+ * Log-linear histogram of integer values. Like in HDR histograms, every
+ * power-of-two range is split into 2^SubBucketsShift equal buckets, so the
+ * relative error is the same across the whole range. The last bucket
+ * collects everything above it.
+ */
+template <unsigned SubBucketsShift, unsigned NrBuckets>
+class log_histogram {
+    static constexpr unsigned sub_buckets = 1 << SubBucketsShift;
+    static_assert(NrBuckets > sub_buckets);
+
+    std::array<uint64_t, NrBuckets> _buckets = {};
+    uint64_t _count = 0;
+    uint64_t _sum = 0;
+
+    static unsigned bucket_of(uint64_t v) noexcept {
+        if (v < sub_buckets) {
+            return v;
+        }
+        unsigned msb = 63 - count_leading_zeros(v);
+        unsigned idx = (msb - SubBucketsShift + 1) * sub_buckets + ((v >> (msb - SubBucketsShift)) & (sub_buckets - 1));
+        return std::min(idx, NrBuckets - 1);
+    }
+
+    // Values in the bucket are below this
+    static uint64_t upper_bound(unsigned idx) noexcept {
+        if (idx < sub_buckets) {
+            return idx + 1;
+        }
+        unsigned shift = idx / sub_buckets - 1;
+        return (uint64_t(sub_buckets + idx % sub_buckets) + 1) << shift;
+    }
+
+public:
+    void add(uint64_t v) noexcept {
+        _buckets[bucket_of(v)]++;
+        _count++;
+        _sum += v;
+    }
+
+    uint64_t count() const noexcept { return _count; }
+
+    // Adds the values of another histogram, e.g. of another shard
+    log_histogram& operator+=(const log_histogram& o) noexcept {
+        for (unsigned i = 0; i < NrBuckets; i++) {
+            _buckets[i] += o._buckets[i];
+        }
+        _count += o._count;
+        _sum += o._sum;
+        return *this;
+    }
+
+    void reset() noexcept {
+        _buckets = {};
+        _count = 0;
+        _sum = 0;
+    }
+
+    // Upper estimate of the given percentile
+    uint64_t percentile(double p) const noexcept {
+        auto want = uint64_t(std::ceil(_count * p));
+        uint64_t seen = 0;
+        for (unsigned i = 0; i < NrBuckets - 1; i++) {
+            seen += _buckets[i];
+            if (seen >= want) {
+                return upper_bound(i);
+            }
+        }
+        return upper_bound(NrBuckets - 1);
+    }
+
+    // Reports the values multiplied by unit
+    metrics::histogram to_metrics_histogram(double unit = 1) const {
+        metrics::histogram h;
+        h.sample_count = _count;
+        h.sample_sum = _sum * unit;
+        h.buckets.resize(NrBuckets);
+        uint64_t cumulative = 0;
+        for (unsigned i = 0; i < NrBuckets; i++) {
+            cumulative += _buckets[i];
+            h.buckets[i].count = cumulative;
+            h.buckets[i].upper_bound = upper_bound(i) * unit;
+        }
+        h.buckets[NrBuckets - 1].upper_bound = std::numeric_limits<double>::infinity();
+        return h;
+    }
+};
+
+/*
+ * Histogram of latencies with microsecond resolution, reported to the
+ * metrics layer in seconds.
+ */
+template <unsigned SubBucketsShift, unsigned NrBuckets>
+class latency_histogram : public log_histogram<SubBucketsShift, NrBuckets> {
+    using base = log_histogram<SubBucketsShift, NrBuckets>;
+public:
+    void add(std::chrono::duration<double> lat) noexcept {
+        base::add(std::chrono::duration_cast<std::chrono::microseconds>(lat).count());
+    }
+
+    metrics::histogram to_metrics_histogram() const {
+        return base::to_metrics_histogram(1e-6);
+    }
+};
+
+}
+
+}
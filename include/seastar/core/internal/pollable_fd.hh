@@ -88,6 +88,9 @@ class pollable_fd_state {
     int events_requested = 0; // wanted by pollin/pollout promises
     int events_epoll = 0;     // installed in epoll
     int events_known = 0;     // returned from epoll
+    // See pollable_fd::set_multishot()
+    bool multishot_accept = false;
+    bool multishot_recv = false;
 
     friend class reactor;
     friend class pollable_fd;
@@ -101,6 +104,7 @@ class pollable_fd_state {
     future<> write_all(const uint8_t* buffer, size_t size);
     future<size_t> write_some(net::packet& p);
     future<> write_all(net::packet& p);
+    future<size_t> sendfile(int in_fd, uint64_t pos, size_t len);
     future<> readable();
     future<> writeable();
     future<> readable_or_writeable();
@@ -109,6 +113,8 @@ class pollable_fd_state {
     future<temporary_buffer<char>> recv_some(internal::buffer_allocator* ba);
     future<size_t> sendmsg(struct msghdr *msg);
     future<size_t> recvmsg(struct msghdr *msg);
+    future<size_t> sendmmsg(struct mmsghdr* msgvec, unsigned vlen);
+    future<size_t> recvmmsg(struct mmsghdr* msgvec, unsigned vlen);
     future<size_t> sendto(socket_address addr, const void* buf, size_t len);
 
 protected:
@@ -155,6 +161,11 @@ class pollable_fd {
     future<> write_all(net::packet& p) {
         return _s->write_all(p);
     }
+    // Sends up to len bytes of in_fd, starting at pos, with sendfile(2).
+    // Returns the number of bytes sent, 0 at the end of the file.
+    future<size_t> sendfile(int in_fd, uint64_t pos, size_t len) {
+        return _s->sendfile(in_fd, pos, len);
+    }
     future<> readable() {
         return _s->readable();
     }
@@ -179,10 +190,26 @@ class pollable_fd {
     future<size_t> recvmsg(struct msghdr *msg) {
         return _s->recvmsg(msg);
     }
+    // Return the number of messages sent or received; at least one.
+    future<size_t> sendmmsg(struct mmsghdr* msgvec, unsigned vlen) {
+        return _s->sendmmsg(msgvec, vlen);
+    }
+    future<size_t> recvmmsg(struct mmsghdr* msgvec, unsigned vlen) {
+        return _s->recvmmsg(msgvec, vlen);
+    }
     future<size_t> sendto(socket_address addr, const void* buf, size_t len) {
         return _s->sendto(addr, buf, len);
     }
     file_desc& get_file_desc() const { return _s->fd; }
+    // Lets the backend keep a single request armed in the kernel that
+    // completes once per connection accepted on this (listening) fd, and
+    // makes connections accepted on it receive the same way. Only the
+    // io_uring backend acts on it.
+    void set_multishot(bool accept, bool recv) {
+        _s->multishot_accept = accept;
+        _s->multishot_recv = recv;
+    }
+    bool multishot_recv() const { return _s->multishot_recv; }
     using shutdown_kernel_only = bool_class<struct shutdown_kernel_only_tag>;
     void shutdown(int how, shutdown_kernel_only kernel_only = shutdown_kernel_only::yes);
     void close() { _s.reset(); }
@@ -37,6 +37,14 @@ struct file_read_state {
     , _front(front)
     , _iref(intent) {}
 
+    file_read_state(uint64_t offset, uint64_t front, size_t to_read,
+            tmp_buf_type buf, io_intent* intent)
+    : buf(std::move(buf))
+    , _offset(offset)
+    , _to_read(to_read)
+    , _front(front)
+    , _iref(intent) {}
+
     bool done() const {
         return eof || pos >= _to_read;
     }
@@ -0,0 +1,56 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+
+#pragma once
+
+#include <seastar/core/preempt.hh>
+#include <cstdint>
+
+namespace seastar {
+
+namespace internal {
+
+/*
+ * Waking many waiters at once, as resolving a shared_future or
+ * condition_variable::broadcast() does, is done in batches: after a
+ * minimum batch, waking stops once the task quota is used up, and the
+ * remaining waiters are woken by a task of their own, so that thousands
+ * of waiters do not stall the reactor.
+ */
+struct wakeup_stats {
+    uint64_t wakeups = 0;          // resolutions and broadcasts which had waiters
+    uint64_t waiters = 0;          // waiters woken by them
+    uint64_t deferred_batches = 0; // batches left to a task of their own
+};
+
+wakeup_stats& get_wakeup_stats() noexcept;
+
+inline constexpr unsigned min_wakeup_batch = 64;
+
+/// Whether to wake more waiters after \c n of the current batch
+inline bool continue_wakeups(unsigned n) noexcept {
+    return n < min_wakeup_batch || !need_preempt();
+}
+
+}
+
+}
@@ -0,0 +1,154 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+
+#pragma once
+
+#include <seastar/core/shared_ptr.hh>
+#include <seastar/util/concepts.hh>
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+namespace seastar {
+
+template <typename T>
+class intrusive_ref;
+
+/// Base of the objects managed by \ref intrusive_ref.
+///
+/// The reference count lives in the object, like with
+/// \ref enable_lw_shared_from_this, and when it drops to zero the object is
+/// destroyed by a \c Deleter that's known at compile time, so neither the
+/// object nor the pointer need a control block or a virtual destructor.
+/// Objects shared by many continuations on the hot path, such as the state
+/// of a connection, are the intended users:
+///
+/// \code
+/// struct connection_state : intrusive_ref_counted<connection_state> {
+///     ...
+/// };
+/// auto st = make_intrusive_ref<connection_state>(...);
+/// return read().then([st] (auto buf) { ... });
+/// \endcode
+///
+/// The count is not atomic: all references must be taken and dropped on
+/// the shard the object was created on. With \c SEASTAR_DEBUG_SHARED_PTR
+/// defined, as it is in debug builds, doing otherwise aborts the program,
+/// the same as for lw_shared_ptr.
+///
+/// \tparam T the class deriving from this one
+/// \tparam Deleter default constructible, called with a \c T* to destroy it
+template <typename T, typename Deleter = std::default_delete<T>>
+class intrusive_ref_counted {
+    mutable shared_ptr_counter_type _refs = 0;
+
+    template <typename U>
+    friend class intrusive_ref;
+
+    void ref() const noexcept {
+        ++_refs;
+    }
+    void unref() const noexcept {
+        if (--_refs == 0) {
+            Deleter()(const_cast<T*>(static_cast<const T*>(this)));
+        }
+    }
+protected:
+    intrusive_ref_counted() noexcept = default;
+    // Copies of an object are references to another object
+    intrusive_ref_counted(const intrusive_ref_counted&) noexcept {}
+    intrusive_ref_counted& operator=(const intrusive_ref_counted&) noexcept { return *this; }
+    ~intrusive_ref_counted() = default;
+public:
+    /// The number of references to the object
+    long use_count() const noexcept { return _refs; }
+};
+
+/// A reference counting pointer to an object deriving from
+/// \ref intrusive_ref_counted, one machine word in size.
+template <typename T>
+class intrusive_ref {
+    T* _p = nullptr;
+
+    template <typename U>
+    friend class intrusive_ref;
+public:
+    using element_type = T;
+
+    intrusive_ref() noexcept = default;
+    intrusive_ref(std::nullptr_t) noexcept {}
+    /// Takes a reference to \c p, which may already be referenced
+    explicit intrusive_ref(T* p) noexcept : _p(p) {
+        if (_p) {
+            _p->ref();
+        }
+    }
+    intrusive_ref(const intrusive_ref& o) noexcept : intrusive_ref(o._p) {}
+    intrusive_ref(intrusive_ref&& o) noexcept : _p(std::exchange(o._p, nullptr)) {}
+    template <typename U>
+    SEASTAR_CONCEPT(requires std::is_convertible_v<U*, T*>)
+    intrusive_ref(const intrusive_ref<U>& o) noexcept : intrusive_ref(static_cast<T*>(o._p)) {}
+    template <typename U>
+    SEASTAR_CONCEPT(requires std::is_convertible_v<U*, T*>)
+    intrusive_ref(intrusive_ref<U>&& o) noexcept : _p(std::exchange(o._p, nullptr)) {}
+    ~intrusive_ref() {
+        if (_p) {
+            _p->unref();
+        }
+    }
+
+    // The old object is only dropped once the new one is referenced,
+    // in case the former owns the latter
+    intrusive_ref& operator=(const intrusive_ref& o) noexcept {
+        intrusive_ref tmp(o);
+        std::swap(_p, tmp._p);
+        return *this;
+    }
+    intrusive_ref& operator=(intrusive_ref&& o) noexcept {
+        intrusive_ref tmp(std::move(o));
+        std::swap(_p, tmp._p);
+        return *this;
+    }
+    intrusive_ref& operator=(std::nullptr_t) noexcept {
+        return *this = intrusive_ref();
+    }
+
+    T* get() const noexcept { return _p; }
+    T& operator*() const noexcept { return *_p; }
+    T* operator->() const noexcept { return _p; }
+    explicit operator bool() const noexcept { return _p; }
+
+    long use_count() const noexcept { return _p ? _p->use_count() : 0; }
+
+    template <typename U>
+    bool operator==(const intrusive_ref<U>& o) const noexcept { return _p == o._p; }
+    bool operator==(std::nullptr_t) const noexcept { return _p == nullptr; }
+};
+
+/// Allocates a \c T with \c new and returns the first reference to it
+template <typename T, typename... A>
+intrusive_ref<T> make_intrusive_ref(A&&... a) {
+    return intrusive_ref<T>(new T(std::forward<A>(a)...));
+}
+
+}
@@ -22,6 +22,7 @@
 #pragma once
 
 #include <boost/container/small_vector.hpp>
+#include <seastar/core/abort_source.hh>
 #include <seastar/core/internal/io_intent.hh>
 #include <seastar/core/io_priority_class.hh>
 
@@ -37,6 +38,10 @@ namespace seastar {
 ///
 /// If no intent is provided, then the request is processed till its
 /// completion be it success or error
+///
+/// An intent made with an \ref abort_source is cancelled when an abort is
+/// requested, so that e.g. the reads of a request which timed out stop
+/// taking disk bandwidth right away.
 class io_intent {
     struct intents_for_queue {
         dev_t dev;
@@ -68,24 +73,45 @@ class io_intent {
 
     boost::container::small_vector<intents_for_queue, 1> _intents;
     references _refs;
+    abort_source* _as = nullptr;
+    optimized_optional<abort_source::subscription> _abort_sub;
     friend internal::intent_reference::intent_reference(io_intent*) noexcept;
 
+    void subscribe() noexcept {
+        _abort_sub = _as->subscribe([this] () noexcept { cancel(); });
+    }
+
 public:
     io_intent() = default;
     ~io_intent() = default;
 
+    /// Makes an intent cancelled when an abort is requested from \c as;
+    /// requests made with it after that are cancelled right away. The
+    /// abort source must outlive the intent.
+    explicit io_intent(abort_source& as) noexcept : _as(&as) {
+        subscribe();
+    }
+
     io_intent(const io_intent&) = delete;
     io_intent& operator=(const io_intent&) = delete;
     io_intent& operator=(io_intent&&) = delete;
-    io_intent(io_intent&& o) noexcept : _intents(std::move(o._intents)), _refs(std::move(o._refs)) {
+    io_intent(io_intent&& o) noexcept : _intents(std::move(o._intents)), _refs(std::move(o._refs)), _as(std::exchange(o._as, nullptr)) {
         for (auto&& r : _refs.list) {
             r._intent = this;
         }
+        if (std::exchange(o._abort_sub, {})) {
+            subscribe();
+        }
     }
 
     /// Explicitly cancels all the requests attached to this intent
     /// so far. The respective futures are resolved into the \ref
     /// cancelled_error "cancelled_error"
+    ///
+    /// Queued requests are resolved right at once. Requests that were
+    /// already submitted to the kernel are aborted where the reactor
+    /// backend supports it (io_uring) and are resolved once the kernel
+    /// lets go of their buffers.
     void cancel() noexcept {
         _refs.clear();
         _intents.clear();
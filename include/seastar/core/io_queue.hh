@@ -28,6 +28,7 @@
 #include <seastar/core/future.hh>
 #include <seastar/core/internal/io_request.hh>
 #include <seastar/util/spinlock.hh>
+#include <unordered_map>
 
 struct io_queue_for_tests;
 
@@ -73,6 +74,28 @@ class io_queue {
 
     priority_class_data& find_or_create_class(const io_priority_class& pc);
 
+    class latency_controller;
+    std::unique_ptr<latency_controller> _latency_controller;
+
+    // Queued reads that can be extended with the read that continues them,
+    // by the fd, the position they end at and the class
+    struct read_merge_key {
+        int fd;
+        uint64_t pos;
+        unsigned class_id;
+
+        bool operator==(const read_merge_key& o) const noexcept {
+            return fd == o.fd && pos == o.pos && class_id == o.class_id;
+        }
+    };
+    struct read_merge_key_hash {
+        size_t operator()(const read_merge_key& k) const noexcept;
+    };
+    std::unordered_map<read_merge_key, queued_io_request*, read_merge_key_hash> _mergeable_reads;
+
+    bool can_merge_read(const queued_io_request& head, internal::io_direction_and_length dnl) const noexcept;
+    future<size_t> merge_read(queued_io_request& head, priority_class_data& pclass, internal::io_direction_and_length dnl, internal::io_request req);
+
     // The fields below are going away, they are just here so we can implement deprecated
     // functions that used to be provided by the fair_queue and are going away (from both
     // the fair_queue and the io_queue). Double-accounting for now will allow for easier
@@ -107,12 +130,25 @@ class io_queue {
         float rate_factor = 1.0;
         std::chrono::duration<double> rate_limit_duration = std::chrono::milliseconds(1);
         size_t block_count_limit_min = 1;
+        // When non-zero, the group rate is lowered below the configured one
+        // for as long as the 99th percentile of in-disk latency exceeds it
+        std::chrono::duration<double> latency_target = std::chrono::duration<double>(0);
+        // Striped (RAID-0 like) volumes consist of several member devices,
+        // each serving its own stripe_size chunks of stripe_members * stripe_size
+        // long rows. Requests are split at stripe boundaries and the capacity
+        // of each member is accounted separately, the rates above are those
+        // of the whole volume.
+        size_t stripe_size = 0;
+        unsigned stripe_members = 1;
+        // Contiguous reads of a file queued in the same class are merged
+        // into a single read of up to this many bytes; 0 disables merging
+        size_t max_read_merge_length = 0;
     };
 
     io_queue(io_group_ptr group, internal::io_sink& sink);
     ~io_queue();
 
-    stream_id request_stream(internal::io_direction_and_length dnl) const noexcept;
+    stream_id request_stream(internal::io_direction_and_length dnl, uint64_t pos) const noexcept;
 
     future<size_t> submit_io_read(const io_priority_class& priority_class,
             size_t len, internal::io_request req, io_intent* intent, iovec_keeper iovs = {}) noexcept;
@@ -125,6 +161,9 @@ class io_queue {
     void cancel_request(queued_io_request& req) noexcept;
     void complete_cancelled_request(queued_io_request& req) noexcept;
     void complete_request(io_desc_read_write& desc) noexcept;
+    void complete_aborted_request(io_desc_read_write& desc) noexcept;
+    void account_execution_latency(std::chrono::duration<double> lat) noexcept;
+    void forget_mergeable_read(queued_io_request& req) noexcept;
 
 
     [[deprecated("I/O queue users should not track individual requests, but resources (weight, size) passing through the queue")]]
@@ -181,6 +220,9 @@ class io_group {
     std::vector<std::unique_ptr<priority_class_data>> _priority_classes;
     util::spinlock _lock;
     const shard_id _allocated_on;
+    // Per-shard 99th percentile of in-disk latency (usec) over the last
+    // latency feedback period, 0 if unknown
+    std::vector<std::atomic<uint64_t>> _shard_latency;
 
     static fair_group::config make_fair_group_config(const io_queue::config& qcfg) noexcept;
     priority_class_data& find_or_create_class(io_priority_class pc);
@@ -0,0 +1,101 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#pragma once
+
+#include <seastar/core/future.hh>
+#include <seastar/core/io_priority_class.hh>
+#include <seastar/core/sstring.hh>
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+#include <vector>
+#include <sys/types.h>
+
+/// \file
+///
+/// The I/O trace keeps the last few thousand disk requests of a shard in a
+/// ring, each with the times it was queued, dispatched and completed, so
+/// that a latency spike can be matched with the requests around it without
+/// running blktrace. Tracing is off unless a size is set, with
+/// --io-trace-entries or \ref set_io_trace_size().
+
+namespace seastar {
+
+namespace httpd {
+class http_server;
+}
+
+/// A disk request, as recorded in the I/O trace
+struct io_trace_entry {
+    using clock_type = std::chrono::steady_clock;
+    enum class outcome : uint8_t {
+        completed,
+        failed,
+        cancelled,
+    };
+
+    clock_type::time_point queued;
+    clock_type::time_point dispatched; ///< default if cancelled while queued
+    clock_type::time_point completed;
+    dev_t dev;
+    io_priority_class_id priority_class;
+    bool write;
+    outcome result;
+    uint64_t pos;
+    size_t length;
+    size_t bytes; ///< transferred, for completed requests
+};
+
+/// The I/O trace of a shard
+struct io_trace {
+    unsigned shard = 0;
+    std::vector<io_trace_entry> entries; ///< oldest first
+    uint64_t dropped = 0; ///< entries overwritten before they were read
+};
+
+/// Sets how many requests the I/O trace of this shard keeps, dropping
+/// those it holds; 0 disables tracing.
+void set_io_trace_size(size_t entries);
+
+/// Reads the I/O trace of this shard.
+///
+/// \param reset whether to clear the trace after it is read
+io_trace get_io_trace(bool reset = false);
+
+/// Writes a trace, a line per request: shard, device (major:minor),
+/// priority class id, R or W, position, length, the outcome, bytes
+/// transferred, then the time it was queued, in microseconds since the
+/// clock's epoch, the time it waited in the queue and the time it took
+/// the disk, in microseconds.
+void write_io_trace(std::ostream& os, const io_trace& trace);
+
+/// Collects the I/O traces of all shards.
+///
+/// \param reset whether to clear the traces after they are read
+future<std::vector<io_trace>> get_io_traces(bool reset = false);
+
+/// Adds a GET route that returns the I/O traces of all shards, as written
+/// by \ref write_io_trace(). With the query parameter reset=true, the
+/// traces are cleared after they are read.
+future<> add_io_trace_route(httpd::http_server& server, sstring path = "/io_trace");
+
+}
@@ -206,6 +206,58 @@ input_stream<CharType>::read_exactly(size_t n) noexcept {
     }
 }
 
+template <typename CharType>
+future<std::vector<temporary_buffer<CharType>>>
+input_stream<CharType>::read_exactly_fragmented_part(size_t n, std::vector<tmp_buf> frags) noexcept {
+    if (!n) {
+        return make_ready_future<std::vector<tmp_buf>>(std::move(frags));
+    }
+    return read_up_to(n).then([this, n, frags = std::move(frags)] (tmp_buf buf) mutable {
+        if (buf.empty()) {
+            return make_ready_future<std::vector<tmp_buf>>(std::move(frags));
+        }
+        auto size = buf.size();
+        frags.push_back(std::move(buf));
+        return this->read_exactly_fragmented_part(n - size, std::move(frags));
+    });
+}
+
+template <typename CharType>
+future<std::vector<temporary_buffer<CharType>>>
+input_stream<CharType>::read_exactly_fragmented(size_t n) noexcept {
+    return read_exactly_fragmented_part(n, {});
+}
+
+template <typename CharType>
+future<size_t>
+input_stream<CharType>::read_exactly_into_part(CharType* dst, size_t n, size_t completed) noexcept {
+    if (available()) {
+        auto now = std::min(n - completed, available());
+        std::copy(_buf.get(), _buf.get() + now, dst + completed);
+        _buf.trim_front(now);
+        completed += now;
+    }
+    if (completed == n || _eof) {
+        return make_ready_future<size_t>(completed);
+    }
+
+    // _buf is now empty
+    return _fd.get().then([this, dst, n, completed] (auto buf) mutable {
+        if (buf.size() == 0) {
+            _eof = true;
+            return make_ready_future<size_t>(completed);
+        }
+        _buf = std::move(buf);
+        return this->read_exactly_into_part(dst, n, completed);
+    });
+}
+
+template <typename CharType>
+future<size_t>
+input_stream<CharType>::read_exactly_into(CharType* dst, size_t n) noexcept {
+    return read_exactly_into_part(dst, n, 0);
+}
+
 template <typename CharType>
 template <typename Consumer>
 SEASTAR_CONCEPT(requires InputStreamConsumer<Consumer, CharType> || ObsoleteInputStreamConsumer<Consumer, CharType>)
@@ -296,6 +348,28 @@ input_stream<CharType>::read() noexcept {
     }
 }
 
+template <typename CharType>
+future<temporary_buffer<CharType>>
+input_stream<CharType>::read(abort_source& as) noexcept {
+    using tmp_buf = temporary_buffer<CharType>;
+    if (as.abort_requested()) {
+        return make_exception_future<tmp_buf>(as.abort_requested_exception_ptr());
+    }
+    if (_eof || !_buf.empty()) {
+        return read();
+    }
+    auto sub = as.subscribe([this] () noexcept {
+        _fd.cancel();
+    });
+    return read().then_wrapped([&as, sub = std::move(sub)] (future<tmp_buf> f) {
+        if (as.abort_requested()) {
+            f.ignore_ready_future();
+            return make_exception_future<tmp_buf>(as.abort_requested_exception_ptr());
+        }
+        return f;
+    });
+}
+
 template <typename CharType>
 future<>
 input_stream<CharType>::skip(uint64_t n) noexcept {
@@ -430,6 +504,10 @@ future<> output_stream<CharType>::do_flush() noexcept {
 template <typename CharType>
 future<>
 output_stream<CharType>::flush() noexcept {
+    if (_corked) {
+        _corked_flush = true;
+        return make_ready_future<>();
+    }
     if (!_batch_flushes) {
         return do_flush();
     } else {
@@ -447,6 +525,17 @@ output_stream<CharType>::flush() noexcept {
     return make_ready_future<>();
 }
 
+template <typename CharType>
+future<>
+output_stream<CharType>::uncork() noexcept {
+    assert(_corked && "uncork() without cork()");
+    if (--_corked || !_corked_flush) {
+        return make_ready_future<>();
+    }
+    _corked_flush = false;
+    return flush();
+}
+
 template <typename CharType>
 future<>
 output_stream<CharType>::put(temporary_buffer<CharType> buf) noexcept {
@@ -462,6 +551,20 @@ output_stream<CharType>::put(temporary_buffer<CharType> buf) noexcept {
     }
 }
 
+template <typename CharType>
+future<>
+output_stream<CharType>::write_file(file& f, uint64_t pos, uint64_t len) noexcept {
+    // Buffered data must reach the sink before the file does, so
+    // cancel a scheduled batch flush and do it here instead.
+    _flush = false;
+    auto flushed = _flushing ? _in_batch.value().get_future() : make_ready_future<>();
+    return flushed.then([this] {
+        return do_flush();
+    }).then([this, &f, pos, len] {
+        return _fd.put_file(f, pos, len);
+    });
+}
+
 template <typename CharType>
 void
 output_stream<CharType>::poll_flush() noexcept {
@@ -491,6 +594,8 @@ output_stream<CharType>::poll_flush() noexcept {
 template <typename CharType>
 future<>
 output_stream<CharType>::close() noexcept {
+    _corked = 0;
+    _corked_flush = false;
     return flush().finally([this] {
         if (_in_batch) {
             return _in_batch.value().get_future();
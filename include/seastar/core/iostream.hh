@@ -36,10 +36,12 @@
 #pragma once
 
 #include <boost/intrusive/slist.hpp>
+#include <seastar/core/abort_source.hh>
 #include <seastar/core/future.hh>
 #include <seastar/core/temporary_buffer.hh>
 #include <seastar/core/scattered_message.hh>
 #include <seastar/util/std-compat.hh>
+#include <vector>
 
 namespace bi = boost::intrusive;
 
@@ -47,12 +49,19 @@ namespace seastar {
 
 namespace net { class packet; }
 
+class file;
+
 class data_source_impl {
 public:
     virtual ~data_source_impl() {}
     virtual future<temporary_buffer<char>> get() = 0;
     virtual future<temporary_buffer<char>> skip(uint64_t n);
     virtual future<> close() { return make_ready_future<>(); }
+    /// Makes a pending get() complete as soon as possible, with whatever
+    /// it has, an error or the end of the data; nothing is to be read from
+    /// the source afterwards. The default lets a pending get() complete on
+    /// its own.
+    virtual void cancel() noexcept {}
 };
 
 class data_source {
@@ -88,6 +97,9 @@ class data_source {
             return current_exception_as_future<>();
         }
     }
+    void cancel() noexcept {
+        _dsi->cancel();
+    }
 };
 
 class data_sink_impl {
@@ -111,6 +123,12 @@ class data_sink_impl {
     virtual future<> flush() {
         return make_ready_future<>();
     }
+    // Transfers up to \c len bytes of \c f starting at \c pos, stopping
+    // early at the end of the file. The default reads the range into
+    // buffers and put()s them; sinks backed by a socket may hand the
+    // transfer to the kernel instead. \c f must stay alive until the
+    // returned future resolves.
+    virtual future<> put_file(file& f, uint64_t pos, uint64_t len);
     virtual future<> close() = 0;
 
     // The method should return the maximum buffer size that's acceptable by
@@ -154,6 +172,13 @@ class data_sink {
         return current_exception_as_future();
       }
     }
+    future<> put_file(file& f, uint64_t pos, uint64_t len) noexcept {
+      try {
+        return _dsi->put_file(f, pos, len);
+      } catch (...) {
+        return current_exception_as_future();
+      }
+    }
     future<> flush() noexcept {
       try {
         return _dsi->flush();
@@ -285,6 +310,26 @@ class input_stream final {
     /// \throws if an I/O error occurs during the read. As explained above,
     /// prematurely reaching the end of stream is *not* an I/O error.
     future<temporary_buffer<CharType>> read_exactly(size_t n) noexcept;
+    /// Reads n bytes from the stream as the buffers the data source
+    /// produced them in, or fewer if reached the end of stream.
+    ///
+    /// Unlike \ref read_exactly(), the bytes are never copied into a
+    /// contiguous buffer: the returned buffers share the data source's
+    /// memory (for the native network stack, the received packets), the
+    /// first and last ones possibly trimmed.
+    ///
+    /// \throws if an I/O error occurs during the read.
+    future<std::vector<temporary_buffer<CharType>>> read_exactly_fragmented(size_t n) noexcept;
+    /// Reads n bytes from the stream into a caller-provided buffer, or
+    /// fewer if reached the end of stream.
+    ///
+    /// Data is copied once, from the data source's buffers straight to
+    /// \c dst, which must stay alive until the returned future resolves.
+    ///
+    /// \returns a future holding the number of bytes read, smaller than n
+    /// only at the end of stream.
+    /// \throws if an I/O error occurs during the read.
+    future<size_t> read_exactly_into(CharType* dst, size_t n) noexcept;
     template <typename Consumer>
     SEASTAR_CONCEPT(requires InputStreamConsumer<Consumer, CharType> || ObsoleteInputStreamConsumer<Consumer, CharType>)
     future<> consume(Consumer&& c) noexcept(std::is_nothrow_move_constructible_v<Consumer>);
@@ -295,6 +340,12 @@ class input_stream final {
     /// Returns some data from the stream, or an empty buffer on end of
     /// stream.
     future<tmp_buf> read() noexcept;
+    /// Like \ref read(), but if an abort is requested from \c as while the
+    /// stream waits for the data source, the source is cancelled (see
+    /// \ref data_source_impl::cancel()) and the returned future fails with
+    /// the exception of the abort. The stream must not be read from after
+    /// that, only closed.
+    future<tmp_buf> read(abort_source& as) noexcept;
     /// Returns up to n bytes from the stream, or an empty buffer on end of
     /// stream.
     future<tmp_buf> read_up_to(size_t n) noexcept;
@@ -327,6 +378,8 @@ class input_stream final {
     data_source detach() &&;
 private:
     future<temporary_buffer<CharType>> read_exactly_part(size_t n, tmp_buf buf, size_t completed) noexcept;
+    future<std::vector<tmp_buf>> read_exactly_fragmented_part(size_t n, std::vector<tmp_buf> frags) noexcept;
+    future<size_t> read_exactly_into_part(CharType* dst, size_t n, size_t completed) noexcept;
 };
 
 struct output_stream_options {
@@ -360,6 +413,9 @@ class output_stream final {
     std::optional<promise<>> _in_batch;
     bool _flush = false;
     bool _flushing = false;
+    unsigned _corked = 0;
+    // flush() was called while corked
+    bool _corked_flush = false;
     std::exception_ptr _ex;
     bi::slist_member_hook<> _in_poller;
 
@@ -403,8 +459,39 @@ class output_stream final {
     future<> write(net::packet p) noexcept;
     future<> write(scattered_message<char_type> msg) noexcept;
     future<> write(temporary_buffer<char_type>) noexcept;
+    /// Writes up to \c len bytes of \c f, starting at \c pos, to the stream.
+    ///
+    /// Data written before is flushed first. Streams over a POSIX socket
+    /// transfer the range in the kernel (sendfile), without copying it
+    /// through user-space buffers; other streams read it and write it out.
+    /// The transfer stops early at the end of the file.
+    ///
+    /// \param f the file to send; must be kept alive until the returned future resolves
+    /// \param pos offset of the first byte to send
+    /// \param len number of bytes to send
+    future<> write_file(file& f, uint64_t pos, uint64_t len) noexcept;
     future<> flush() noexcept;
 
+    /// Defers flushes until the matching uncork().
+    ///
+    /// While the stream is corked, flush() only records that a flush is
+    /// wanted, so that a batch of small writes, each followed by a flush,
+    /// such as the replies to pipelined requests, reaches the data sink in
+    /// as few puts as the buffer size allows. Buffers that fill up are still
+    /// put as usual. Corks nest.
+    void cork() noexcept {
+        ++_corked;
+    }
+
+    /// Undoes a cork(). Once the last cork is removed, flushes the stream
+    /// if flush() was called in the meantime.
+    future<> uncork() noexcept;
+
+    /// Whether the stream is corked, see cork().
+    bool corked() const noexcept {
+        return _corked;
+    }
+
     /// Flushes the stream before closing it (and the underlying data sink) to
     /// any further writes.  The resulting future must be waited on before
     /// destroying this object.
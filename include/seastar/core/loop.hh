@@ -22,10 +22,12 @@
 
 #pragma once
 
+#include <algorithm>
 #include <cstddef>
 #include <iterator>
 #include <memory>
 #include <type_traits>
+#include <utility>
 #include <vector>
 
 #include <seastar/core/future.hh>
@@ -486,6 +488,94 @@ future<> do_for_each(Container& c, AsyncAction action) noexcept {
     }
 }
 
+/// Options of \ref preemptible_for_each()
+struct preemptible_loop_options {
+    /// Name of the loop, which the stall detector reports if an iteration
+    /// stalls the reactor. Must outlive the loop, e.g. a string literal.
+    const char* name = nullptr;
+    /// Number of iterations between checks of \ref need_preempt()
+    unsigned check_every = 16;
+};
+
+namespace internal {
+
+// The name of the preemptible loop running on this thread, if any, for
+// the stall detector
+inline const char*& running_loop_name() noexcept {
+    static thread_local const char* name = nullptr;
+    return name;
+}
+
+class running_loop_guard {
+    const char* _prev;
+public:
+    explicit running_loop_guard(const char* name) noexcept
+        : _prev(std::exchange(running_loop_name(), name)) {
+    }
+    ~running_loop_guard() {
+        running_loop_name() = _prev;
+    }
+};
+
+} // namespace internal
+
+/// \brief Call a synchronous function for each item in a range, yielding
+/// to the reactor when the task quota is exhausted (iterator version).
+///
+/// Unlike a plain loop, a long range does not stall the reactor, and
+/// unlike \ref do_for_each(), the function need not return a future.
+/// \ref need_preempt() is only checked every \c opts.check_every
+/// iterations, so that a tight loop body is not slowed down by the
+/// checks.
+///
+/// The range must outlive the returned future.
+///
+/// \param begin an \c InputIterator designating the beginning of the range
+/// \param end an \c InputIterator designating the end of the range
+/// \param func a callable, taking a reference to objects from the range
+/// \param opts the name of the loop and how often to check for preemption
+/// \return a ready future on success, or a failed future if \c func threw
+template <typename Iterator, typename Sentinel, typename Func>
+SEASTAR_CONCEPT( requires requires (Iterator i, Sentinel s, Func f) {
+    f(*i);
+    { i != s } -> std::convertible_to<bool>;
+} )
+inline
+future<> preemptible_for_each(Iterator begin, Sentinel end, Func func, preemptible_loop_options opts = {}) noexcept {
+    return repeat([begin = std::move(begin), end = std::move(end), func = std::move(func), opts] () mutable {
+        internal::running_loop_guard guard(opts.name);
+        do {
+            for (auto n = std::max(opts.check_every, 1u); n && begin != end; --n, ++begin) {
+                func(*begin);
+            }
+            if (!(begin != end)) {
+                return stop_iteration::yes;
+            }
+        } while (!need_preempt());
+        return stop_iteration::no;
+    });
+}
+
+/// \brief Call a synchronous function for each item in a range, yielding
+/// to the reactor when the task quota is exhausted (range version).
+///
+/// \see preemptible_for_each(Iterator, Sentinel, Func, preemptible_loop_options)
+///
+/// \param c an \c Container object designating input range, which must
+///          outlive the returned future
+/// \param func a callable, taking a reference to objects from the range
+/// \param opts the name of the loop and how often to check for preemption
+/// \return a ready future on success, or a failed future if \c func threw
+template <typename Container, typename Func>
+SEASTAR_CONCEPT( requires requires (Container c, Func f) {
+    f(*std::begin(c));
+    std::end(c);
+} )
+inline
+future<> preemptible_for_each(Container& c, Func func, preemptible_loop_options opts = {}) noexcept {
+    return preemptible_for_each(std::begin(c), std::end(c), std::move(func), opts);
+}
+
 namespace internal {
 
 template <typename T, typename = void>
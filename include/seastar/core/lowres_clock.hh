@@ -111,5 +111,11 @@ class lowres_system_clock final {
 
 extern template class timer<lowres_clock>;
 
+/// lowres_clock timers are mostly timeouts, of which there can be very
+/// many, and keeping them in a timing wheel makes arming and cancelling
+/// them O(1).
+template <>
+struct use_timer_wheel<lowres_clock> : std::true_type {};
+
 }
 
@@ -43,6 +43,13 @@ class manual_clock {
         return time_point(duration(_now.load(std::memory_order_relaxed)));
     }
     static void advance(duration d) noexcept;
+    /// Advances the clock to the deadline of the earliest manual_clock
+    /// timer of this shard, unless a task of the shard is ready to run,
+    /// so that code waiting on nothing but these timers runs in virtual
+    /// time (see testing::simulation).
+    ///
+    /// \returns false if the shard has neither tasks to run nor timers
+    static bool advance_to_next_timer() noexcept;
 };
 
 extern template class timer<manual_clock>;
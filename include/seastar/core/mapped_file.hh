@@ -0,0 +1,106 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#pragma once
+
+#include <seastar/core/future.hh>
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <utility>
+
+namespace seastar {
+
+/// \addtogroup fileio-module
+/// @{
+
+/// A file mapped read-only into memory.
+///
+/// For read-mostly files which are accessed randomly and fit in memory,
+/// such as indexes, where a DMA read per lookup costs more than the lookup.
+///
+/// Touching a page of the mapping which is not resident blocks the
+/// reactor on a major fault until the page is read from disk. Call
+/// \ref prefault() to have the syscall thread bring the file in, and
+/// \ref resident() before touching a range which may have been evicted;
+/// the major faults the reactor thread took are counted per shard, in
+/// \ref major_faults() and the \c reactor_major_faults metric.
+class mapped_file {
+    const char* _data = nullptr;
+    size_t _size = 0;
+
+    mapped_file(const char* data, size_t size) noexcept : _data(data), _size(size) {}
+    void unmap() noexcept;
+    static future<mapped_file> map(std::string_view name, bool populate) noexcept;
+public:
+    mapped_file() noexcept = default;
+    mapped_file(mapped_file&& o) noexcept
+        : _data(std::exchange(o._data, nullptr))
+        , _size(std::exchange(o._size, 0))
+    { }
+    mapped_file& operator=(mapped_file&& o) noexcept {
+        if (this != &o) {
+            unmap();
+            _data = std::exchange(o._data, nullptr);
+            _size = std::exchange(o._size, 0);
+        }
+        return *this;
+    }
+    ~mapped_file() {
+        unmap();
+    }
+
+    /// Maps the file \c name, without reading it.
+    static future<mapped_file> open(std::string_view name) noexcept;
+
+    /// Maps the file \c name and reads all of it in.
+    static future<mapped_file> open_populated(std::string_view name) noexcept;
+
+    const char* data() const noexcept {
+        return _data;
+    }
+    size_t size() const noexcept {
+        return _size;
+    }
+    std::span<const char> span() const noexcept {
+        return {_data, _size};
+    }
+
+    /// Reads \c len bytes of the file from \c pos into memory on the
+    /// syscall thread, so that touching them does not fault.
+    future<> prefault(uint64_t pos, uint64_t len) noexcept;
+    /// Reads the whole file into memory on the syscall thread.
+    future<> prefault() noexcept {
+        return prefault(0, _size);
+    }
+
+    /// Whether all pages holding the \c len bytes at \c pos are in memory,
+    /// so that touching them does not block the reactor.
+    bool resident(uint64_t pos, uint64_t len) const;
+
+    /// The major faults the calling thread took, e.g. by touching pages
+    /// of a mapped_file which were not resident.
+    static uint64_t major_faults() noexcept;
+};
+
+/// @}
+
+}
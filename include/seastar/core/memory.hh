@@ -24,7 +24,9 @@
 #include <seastar/core/resource.hh>
 #include <seastar/core/bitops.hh>
 #include <new>
+#include <chrono>
 #include <functional>
+#include <limits>
 #include <vector>
 
 namespace seastar {
@@ -84,9 +86,11 @@ namespace seastar {
 /// ### Heap profiling
 ///
 /// Heap profiling allows finding out how memory is used by your application, by
-/// recording the stacktrace of all allocations. See:
+/// recording the stacktrace of all allocations, or of a sample of them. See:
 /// * \ref set_heap_profiling_enabled()
+/// * \ref set_heap_profiling_sampling_interval()
 /// * \ref scoped_heap_profiling
+/// * \ref generate_heap_profile()
 ///
 /// ### Abort on allocation failure
 ///
@@ -178,6 +182,8 @@ enum class reclaimer_scope {
     sync
 };
 
+struct cpu_pages;
+
 class reclaimer {
 public:
     struct request {
@@ -186,18 +192,35 @@ class reclaimer {
         // If less is released then the reclaimer may be invoked again.
         size_t bytes_to_reclaim;
     };
+    // Accumulated over all invocations of the reclaimer by the allocator
+    struct statistics {
+        uint64_t invocations = 0;
+        // Growth of free memory across the invocations
+        uint64_t bytes_reclaimed = 0;
+        std::chrono::nanoseconds time_spent{0};
+    };
     using reclaim_fn = std::function<reclaiming_result ()>;
 private:
     std::function<reclaiming_result (request)> _reclaim;
     reclaimer_scope _scope;
+    int _priority = 0;
+    statistics _stats;
+    friend struct cpu_pages;
 public:
     // Installs new reclaimer which will be invoked when system is falling
     // low on memory. 'scope' determines when reclaimer can be executed.
     reclaimer(std::function<reclaiming_result ()> reclaim, reclaimer_scope scope = reclaimer_scope::async);
     reclaimer(std::function<reclaiming_result (request)> reclaim, reclaimer_scope scope = reclaimer_scope::async);
+    // Reclaimers with a higher 'priority' are asked first, and the ones
+    // after them are skipped once enough memory has been released, so
+    // cheap-to-refill caches should get a higher priority. Reclaimers
+    // of equal priority are asked in order of installation.
+    reclaimer(std::function<reclaiming_result (request)> reclaim, reclaimer_scope scope, int priority);
     ~reclaimer();
     reclaiming_result do_reclaim(size_t bytes_to_reclaim) { return _reclaim(request{bytes_to_reclaim}); }
     reclaimer_scope scope() const { return _scope; }
+    int priority() const { return _priority; }
+    const statistics& stats() const { return _stats; }
 };
 
 extern std::pmr::polymorphic_allocator<char>* malloc_allocator;
@@ -238,14 +261,22 @@ class statistics {
     uint64_t _foreign_mallocs;
     uint64_t _foreign_frees;
     uint64_t _foreign_cross_frees;
+    size_t _free_huge_pages;
+    size_t _transparent_hugepage_memory;
+    uint64_t _span_allocations;
+    uint64_t _span_splits;
 private:
     statistics(uint64_t mallocs, uint64_t frees, uint64_t cross_cpu_frees,
             uint64_t total_memory, uint64_t free_memory, uint64_t reclaims, uint64_t large_allocs,
-            uint64_t foreign_mallocs, uint64_t foreign_frees, uint64_t foreign_cross_frees)
+            uint64_t foreign_mallocs, uint64_t foreign_frees, uint64_t foreign_cross_frees,
+            size_t free_huge_pages, size_t transparent_hugepage_memory,
+            uint64_t span_allocations, uint64_t span_splits)
         : _mallocs(mallocs), _frees(frees), _cross_cpu_frees(cross_cpu_frees)
         , _total_memory(total_memory), _free_memory(free_memory), _reclaims(reclaims), _large_allocs(large_allocs)
         , _foreign_mallocs(foreign_mallocs), _foreign_frees(foreign_frees)
-        , _foreign_cross_frees(foreign_cross_frees) {}
+        , _foreign_cross_frees(foreign_cross_frees)
+        , _free_huge_pages(free_huge_pages), _transparent_hugepage_memory(transparent_hugepage_memory)
+        , _span_allocations(span_allocations), _span_splits(span_splits) {}
 public:
     /// Total number of memory allocations calls since the system was started.
     uint64_t mallocs() const { return _mallocs; }
@@ -272,6 +303,20 @@ class statistics {
     uint64_t foreign_frees() const { return _foreign_frees; }
     /// Number of foreign frees on reactor threads
     uint64_t foreign_cross_frees() const { return _foreign_cross_frees; }
+    /// Number of \ref huge_page_size units of memory that are entirely free
+    size_t free_huge_pages() const { return _free_huge_pages; }
+    /// Memory (in bytes) the kernel currently backs with transparent huge pages.
+    ///
+    /// Sampled from \c /proc/self/smaps at most every 10 seconds.
+    size_t transparent_hugepage_memory() const { return _transparent_hugepage_memory; }
+    /// Number of page spans taken from the free lists, for large allocations
+    /// and for small object pools
+    uint64_t span_allocations() const { return _span_allocations; }
+    /// Number of times a free span had to be halved to serve a span allocation.
+    ///
+    /// Grows faster than \ref span_allocations() as free memory fragments
+    /// into spans smaller than the requests.
+    uint64_t span_splits() const { return _span_splits; }
     friend statistics stats();
 };
 
@@ -284,9 +329,172 @@ struct memory_layout {
 // Supported only when seastar allocator is enabled.
 memory::memory_layout get_memory_layout();
 
+/// A file mapped as the memory of a shard, with \c --hugepages.
+struct memory_backing {
+    int fd;           ///< open while the process runs
+    uintptr_t start;  ///< where the file is mapped, from its beginning
+    size_t size;
+};
+
+/// Returns the files backing the memory of the shards, which other
+/// processes can map to share it, e.g. a vhost-user backend. Empty without
+/// \c --hugepages, or with the seastar allocator disabled.
+std::vector<memory_backing> get_memory_backings();
+
+/// Residency of a shard's memory on one NUMA node, see \ref numa_stats().
+struct numa_node_statistics {
+    /// NUMA node id
+    unsigned node;
+    /// Bytes of the shard's memory that were meant to be placed on this node
+    size_t bound = 0;
+    /// Estimated bytes of the shard's memory actually resident on this node
+    size_t resident = 0;
+};
+
+/// Placement of this shard's memory across NUMA nodes, see \ref numa_stats().
+struct numa_statistics {
+    /// Per node residency, for every node that is either intended or observed
+    std::vector<numa_node_statistics> nodes;
+    /// Number of pages inspected
+    size_t sampled_pages = 0;
+    /// Inspected pages that are resident, but not on their intended node
+    size_t misplaced_pages = 0;
+    /// Inspected pages that are not resident at all
+    size_t unpopulated_pages = 0;
+};
+
+/// Samples where this shard's memory actually resides.
+///
+/// Inspects up to \c max_samples pages, spread evenly over the shard's
+/// memory, with move_pages(2) and extrapolates. Intended to verify that
+/// memory binding took effect; the call is a system call per batch of
+/// pages, so it should not be made from the fast path.
+///
+/// Returns empty statistics when the seastar allocator or NUMA support
+/// is not available.
+numa_statistics numa_stats(size_t max_samples = 4096);
+
+/// Moves resident pages of this shard's memory that are not on their
+/// intended NUMA node to that node.
+///
+/// Scans the whole shard's memory, so it is meant to be called once at
+/// startup (see the \c numa-migrate-misplaced-memory option).
+///
+/// Returns the number of bytes moved.
+size_t migrate_misplaced_memory();
+
+/// Utilization of one small object size class, see \ref fragmentation_report.
+struct small_pool_utilization {
+    /// Size of the objects in the size class
+    size_t object_size;
+    /// Objects handed out, including those cached for reuse by the allocator
+    size_t live_objects;
+    /// Memory (in bytes) held by the size class, whether objects in it are live or not
+    size_t memory;
+    /// Spans of pages held by the size class
+    size_t spans;
+    /// Spans in which less than \ref fragmentation_report::sparse_span_utilization
+    /// of the objects are live; candidates for \ref compact_sparse_spans()
+    size_t sparse_spans;
+};
+
+/// How fragmented the memory of this shard is, see \ref get_fragmentation_report().
+struct fragmentation_report {
+    /// Utilization under which a span counts as sparse
+    static constexpr float sparse_span_utilization = 0.25;
+    /// Size classes holding memory
+    std::vector<small_pool_utilization> small_pools;
+    /// Number of free spans of each size: \c free_spans[i] counts the free
+    /// spans of 2^i pages. Free memory concentrated in low indexes cannot
+    /// serve large allocations.
+    std::vector<size_t> free_spans;
+    /// Size (in bytes) of the largest free span, i.e. of the largest
+    /// allocation that can be served without reclaiming
+    size_t largest_free_span = 0;
+};
+
+/// Reports how fragmented this shard's memory is.
+///
+/// Walks all spans held by the small object pools, so it should not be
+/// called from the fast path.
+fragmentation_report get_fragmentation_report();
+
+/// A range of pages whose live objects should be moved elsewhere, see \ref compactor.
+struct compaction_request {
+    const void* start;
+    size_t size;
+};
+
+/// Lets the owner of objects that can be moved be asked to move them
+/// out of pages the allocator would like to release.
+///
+/// The callback is passed a range of pages; it should move out any of
+/// its objects living there, reallocating them normally, and return the
+/// number of bytes it moved. Ranges usually hold objects of other
+/// owners too, so the callback must only touch objects it knows about.
+/// It is unregistered on destruction.
+class compactor {
+    std::function<size_t (compaction_request)> _compact;
+public:
+    explicit compactor(std::function<size_t (compaction_request)> compact);
+    compactor(const compactor&) = delete;
+    compactor& operator=(const compactor&) = delete;
+    ~compactor();
+    size_t compact(compaction_request r) { return _compact(r); }
+};
+
+/// Asks compactors to evacuate the sparsest spans of the small object pools.
+///
+/// Spans in which live objects occupy less than \c max_utilization of the
+/// capacity are passed to every registered \ref compactor, at most
+/// \c max_spans of them. Once all of a span's objects are freed, its pages
+/// go back to the free page spans where they can coalesce.
+///
+/// Returns the number of bytes the compactors reported to have moved.
+size_t compact_sparse_spans(float max_utilization = fragmentation_report::sparse_span_utilization,
+        size_t max_spans = std::numeric_limits<size_t>::max());
+
 /// Returns the size of free memory in bytes.
 size_t free_memory();
 
+/// How close the shard is to running out of free memory.
+///
+/// Levels are defined in terms of the free memory low water mark (see
+/// \ref min_free_memory()), below which reclaimers are invoked:
+/// * \c moderate: free memory below 4 times the low water mark;
+/// * \c high: below twice the low water mark;
+/// * \c critical: below the low water mark, reclaim is under way.
+///
+/// A level is only left once free memory is back above its threshold by
+/// a quarter of the low water mark, so that the level doesn't flap.
+enum class memory_pressure {
+    none,
+    moderate,
+    high,
+    critical,
+};
+
+/// Returns the current memory pressure level of this shard.
+memory_pressure current_memory_pressure();
+
+/// Subscribes to changes in the memory pressure level of this shard.
+///
+/// Lets caches shrink incrementally as memory gets tight, instead of
+/// waiting to be asked by a \ref reclaimer when free memory has already
+/// run out. The callback is invoked with the new level from a high
+/// priority task, soon after the level changes, and not from within an
+/// allocation; if the level changes several times in between, only the
+/// latest one is reported. It is unsubscribed on destruction.
+class memory_pressure_listener {
+    std::function<void (memory_pressure)> _callback;
+    friend struct cpu_pages;
+public:
+    explicit memory_pressure_listener(std::function<void (memory_pressure)> callback);
+    memory_pressure_listener(const memory_pressure_listener&) = delete;
+    memory_pressure_listener& operator=(const memory_pressure_listener&) = delete;
+    ~memory_pressure_listener();
+};
+
 /// Returns the value of free memory low water mark in bytes.
 /// When free memory is below this value, reclaimers are invoked until it goes above again.
 size_t min_free_memory();
@@ -359,6 +567,22 @@ class scoped_large_allocation_warning_disable {
 /// [example flame graph](https://user-images.githubusercontent.com/1389273/72920437-f0cf8a80-3d51-11ea-92f0-f3dbeb698871.png)).
 void set_heap_profiling_enabled(bool);
 
+/// Make the heap profiler sample allocations instead of recording all.
+///
+/// With a non-zero \c bytes, the heap profiler records the backtrace of
+/// one allocation per \c bytes allocated on average, the distance between
+/// samples being exponentially distributed, so that the cost is bounded
+/// regardless of the allocation rate, and allocations of all sizes get
+/// a chance to be sampled. With zero (the default), every allocation is
+/// recorded. Can be changed at any time; applies to the current shard.
+///
+/// See \ref generate_heap_profile() for how to make use of sampled data.
+void set_heap_profiling_sampling_interval(size_t bytes);
+
+/// Returns the current heap profiling sampling interval of this shard,
+/// see \ref set_heap_profiling_sampling_interval().
+size_t get_heap_profiling_sampling_interval();
+
 /// Enable heap profiling for the duration of the scope.
 ///
 /// For more information about heap profiling see
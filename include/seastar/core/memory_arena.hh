@@ -0,0 +1,167 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#pragma once
+
+#include <seastar/core/align.hh>
+#include <seastar/core/memory.hh>
+#include <cstddef>
+#include <cstdlib>
+#include <memory_resource>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace seastar {
+
+namespace memory {
+
+/// \addtogroup memory-module
+/// @{
+
+/// A bump pointer allocator for objects that all die together.
+///
+/// Memory is carved, by advancing a pointer, out of chunks obtained from
+/// the shard's allocator; chunks are sized so that they are served from
+/// whole page spans rather than from the small object pools. Individual
+/// objects are never freed: everything is released at once by \ref reset()
+/// or by destroying the arena, at the cost of one free per chunk.
+///
+/// Typical use is for request-scoped state, either directly through
+/// \ref make() or via the \c std::pmr::memory_resource interface with pmr
+/// containers.
+///
+/// An arena belongs to the shard that created it and must not be used
+/// concurrently.
+class arena final : public std::pmr::memory_resource {
+    struct chunk {
+        chunk* prev;
+        size_t size;
+    };
+    static constexpr size_t chunk_header_size = align_up(sizeof(chunk), alignof(std::max_align_t));
+public:
+    static constexpr size_t default_chunk_size = 32 << 10;
+private:
+    chunk* _current = nullptr;
+    char* _pos = nullptr;
+    char* _end = nullptr;
+    size_t _chunk_size;
+    size_t _allocated = 0;
+    size_t _reserved = 0;
+public:
+    /// Creates an empty arena; no memory is taken until the first allocation.
+    ///
+    /// \param chunk_size size of the chunks memory is carved from; larger
+    ///        requests get a chunk of their own.
+    explicit arena(size_t chunk_size = default_chunk_size) noexcept
+        : _chunk_size(align_up(std::max(chunk_size, chunk_header_size + 1), page_size))
+    { }
+    arena(const arena&) = delete;
+    arena& operator=(const arena&) = delete;
+    ~arena() {
+        free_chunks(nullptr);
+    }
+
+    /// Allocates and constructs a \c T in the arena.
+    ///
+    /// Destructors are not run when the arena is released, hence \c T
+    /// must be trivially destructible.
+    template <typename T, typename... Args>
+    T* make(Args&&... args) {
+        static_assert(std::is_trivially_destructible_v<T>, "arena does not run destructors");
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    /// Releases everything allocated from the arena.
+    ///
+    /// The most recent chunk is kept to serve subsequent allocations, all
+    /// others are returned to the allocator.
+    void reset() noexcept {
+        if (!_current) {
+            return;
+        }
+        free_chunks(_current);
+        _current->prev = nullptr;
+        _reserved = _current->size;
+        _pos = reinterpret_cast<char*>(_current) + chunk_header_size;
+        _end = reinterpret_cast<char*>(_current) + _current->size;
+        _allocated = 0;
+    }
+
+    /// Bytes handed out since the last \ref reset(), including alignment padding.
+    size_t allocated_bytes() const noexcept { return _allocated; }
+    /// Bytes held in chunks.
+    size_t reserved_bytes() const noexcept { return _reserved; }
+private:
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        auto p = align_up(_pos, alignment);
+        if (__builtin_expect(p + bytes > _end || !_pos, false)) {
+            p = allocate_chunk(bytes, alignment);
+        }
+        _allocated += p + bytes - _pos;
+        _pos = p + bytes;
+        return p;
+    }
+    void do_deallocate(void*, size_t, size_t) override {
+        // memory is only reclaimed by reset() or destruction
+    }
+    bool do_is_equal(const std::pmr::memory_resource& o) const noexcept override {
+        return this == &o;
+    }
+
+    [[gnu::noinline]]
+    char* allocate_chunk(size_t bytes, size_t alignment) {
+        auto size = std::max(_chunk_size, align_up(chunk_header_size + bytes + alignment, page_size));
+        auto c = static_cast<chunk*>(std::malloc(size));
+        if (!c) {
+            throw std::bad_alloc();
+        }
+        c->prev = _current;
+        c->size = size;
+        _current = c;
+        _reserved += size;
+        _pos = reinterpret_cast<char*>(c) + chunk_header_size;
+        _end = reinterpret_cast<char*>(c) + size;
+        return align_up(_pos, alignment);
+    }
+
+    // Frees the chunks older than keep, or all of them
+    void free_chunks(chunk* keep) noexcept {
+        auto c = keep ? keep->prev : _current;
+        while (c) {
+            auto prev = c->prev;
+            _reserved -= c->size;
+            std::free(c);
+            c = prev;
+        }
+        if (!keep) {
+            _current = nullptr;
+            _pos = _end = nullptr;
+            _allocated = 0;
+        }
+    }
+};
+
+/// @}
+
+}
+
+}
@@ -20,6 +20,8 @@
  */
 
 #pragma once
+#include <cstdint>
+#include <optional>
 #include <vector>
 
 namespace seastar {
@@ -38,6 +40,20 @@ struct histogram_bucket {
 };
 
 
+/*!
+ * \brief Layout of the buckets of a native histogram
+ *
+ * Native histograms, as Prometheus calls them, have exponential buckets
+ * which are identified by their index, see \ref exponential_histogram.
+ * In a histogram with this layout, the first bucket is the zero bucket,
+ * whose upper bound is the zero threshold, and the bucket at position
+ * i > 0 is the one with index min_id + i - 1.
+ */
+struct native_histogram_info {
+    int32_t schema; //!< each power of two is split into 2^schema buckets
+    int32_t min_id; //!< the index of the first bucket after the zero bucket
+};
+
 /*!
  * \brief Histogram data type
  *
@@ -49,6 +65,7 @@ struct histogram {
     uint64_t sample_count = 0;
     double sample_sum = 0;
     std::vector<histogram_bucket> buckets; // Ordered in increasing order of upper_bound, +Inf bucket is optional.
+    std::optional<native_histogram_info> native_histogram; // set if the buckets are those of a native histogram
 
     /*!
      * \brief Addition assigning a historgram
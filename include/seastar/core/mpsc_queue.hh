@@ -0,0 +1,303 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+
+#pragma once
+
+#include <seastar/core/bitops.hh>
+#include <seastar/core/cacheline.hh>
+#include <seastar/core/condition-variable.hh>
+#include <seastar/core/future.hh>
+#include <seastar/core/gate.hh>
+#include <seastar/core/loop.hh>
+#include <seastar/core/smp.hh>
+#include <seastar/core/do_with.hh>
+#include <seastar/util/concepts.hh>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <optional>
+
+namespace seastar {
+
+/// \addtogroup smp-module
+/// @{
+
+/// Bounded queue into which any shard pushes and one shard pops.
+///
+/// For fan-in workloads, where many shards feed one aggregating shard, e.g.
+/// log shipping or metrics aggregation. Unlike a set of per-pair queues, the
+/// consumer looks at one queue, and it is woken up once per batch: a
+/// producer only sends it a message when it went to sleep waiting for items,
+/// not for every item. Producers don't take locks, they claim slots of a
+/// ring with a compare-and-swap.
+///
+/// The queue is created on, and popped from, the consumer shard. Producers
+/// on any shard push() to it, waiting while it's full; waiting producers of
+/// a shard are woken up together, once the consumer frees some room.
+///
+/// Items are moved from the producer shard to the consumer shard as they
+/// are, so they must not own memory or objects that cannot be used, or
+/// freed, on another shard; wrap such items in a \ref foreign_ptr.
+///
+/// stop() must be called, on the consumer shard, before the queue is
+/// destroyed, and no more items may be pushed once it's called.
+template <typename T>
+SEASTAR_CONCEPT(requires std::is_nothrow_move_constructible_v<T>)
+class mpsc_queue {
+    struct cell {
+        // Tells which lap of the ring the cell is on and whether it's
+        // filled, see try_push() and try_pop()
+        std::atomic<size_t> seq;
+        union {
+            T item;
+        };
+        cell() noexcept {}
+        ~cell() {}
+    };
+
+    struct alignas(cache_line_size) shard_state {
+        // Producers of the shard wait for room
+        std::atomic<bool> waiting = { false };
+        condition_variable not_full;
+        // Cross-shard wakeups sent by the shard
+        gate wakeups;
+    };
+
+    const size_t _mask;
+    std::unique_ptr<cell[]> _cells;
+    const shard_id _owner;
+    std::unique_ptr<shard_state[]> _shards;
+    alignas(cache_line_size) std::atomic<size_t> _tail = { 0 };
+    alignas(cache_line_size) std::atomic<bool> _consumer_sleeping = { false };
+    std::atomic<unsigned> _waiting_shards = { 0 };
+    alignas(cache_line_size) size_t _head = 0;
+    condition_variable _not_empty;
+
+public:
+    /// \param capacity how many items the queue holds, rounded up to a
+    ///        power of two
+    explicit mpsc_queue(size_t capacity)
+        : _mask((size_t(1) << log2ceil(std::max<size_t>(capacity, 2))) - 1)
+        , _cells(new cell[_mask + 1])
+        , _owner(this_shard_id())
+        , _shards(new shard_state[smp::count])
+    {
+        for (size_t i = 0; i <= _mask; i++) {
+            _cells[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+    mpsc_queue(mpsc_queue&&) = delete;
+    ~mpsc_queue() {
+        while (try_pop()) {
+        }
+    }
+
+    size_t capacity() const noexcept {
+        return _mask + 1;
+    }
+
+    /// Pushes an item unless the queue is full. Can be called on any shard.
+    ///
+    /// \return whether the item was pushed; it's only moved from if it was
+    bool try_push(T& item) noexcept {
+        auto pos = _tail.load(std::memory_order_relaxed);
+        cell* c;
+        for (;;) {
+            c = &_cells[pos & _mask];
+            auto seq = c->seq.load(std::memory_order_acquire);
+            auto lap = intptr_t(seq) - intptr_t(pos);
+            if (lap == 0) {
+                if (_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (lap < 0) {
+                // The consumer hasn't freed the cell since the previous lap
+                return false;
+            } else {
+                pos = _tail.load(std::memory_order_relaxed);
+            }
+        }
+        new (&c->item) T(std::move(item));
+        c->seq.store(pos + 1, std::memory_order_release);
+        // Pairs with the one in wait_not_empty(), so that either the
+        // consumer sees the item or the producer sees it sleeping
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (_consumer_sleeping.load(std::memory_order_relaxed) && _consumer_sleeping.exchange(false)) {
+            wake_consumer();
+        }
+        return true;
+    }
+
+    /// Pushes an item, waiting while the queue is full. Can be called on
+    /// any shard.
+    ///
+    /// Fails with \ref broken_condition_variable if the queue is stopped
+    /// while waiting.
+    future<> push(T item) noexcept {
+        if (try_push(item)) {
+            return make_ready_future<>();
+        }
+        return do_with(std::move(item), [this] (T& item) {
+            return repeat([this, &item] {
+                auto& s = _shards[this_shard_id()];
+                if (!s.waiting.exchange(true)) {
+                    _waiting_shards.fetch_add(1);
+                }
+                // The consumer may have freed room before it saw the flag
+                if (try_push(item)) {
+                    return make_ready_future<stop_iteration>(stop_iteration::yes);
+                }
+                return s.not_full.wait().then([] {
+                    return stop_iteration::no;
+                });
+            });
+        });
+    }
+
+    /// Whether there is an item to pop. Consumer shard only.
+    bool empty() const noexcept {
+        return _cells[_head & _mask].seq.load(std::memory_order_acquire) != _head + 1;
+    }
+
+    /// Pops an item, if there is one. Consumer shard only.
+    std::optional<T> try_pop() noexcept {
+        auto item = pop_one();
+        if (item) {
+            maybe_wake_producers();
+        }
+        return item;
+    }
+
+    /// Pops up to \c max items, calling \c func for each of them, and
+    /// returns how many were popped. Consumer shard only.
+    template <typename Func>
+    SEASTAR_CONCEPT(requires std::is_nothrow_invocable_v<Func, T>)
+    size_t consume(Func func, size_t max = std::numeric_limits<size_t>::max()) noexcept {
+        size_t n = 0;
+        while (n < max) {
+            auto item = pop_one();
+            if (!item) {
+                break;
+            }
+            func(std::move(*item));
+            n++;
+        }
+        if (n) {
+            maybe_wake_producers();
+        }
+        return n;
+    }
+
+    /// Waits until there is an item to pop. Consumer shard only.
+    ///
+    /// Fails with \ref broken_condition_variable if the queue is stopped.
+    future<> wait_not_empty() noexcept {
+        if (!empty()) {
+            return make_ready_future<>();
+        }
+        return repeat([this] {
+            _consumer_sleeping.store(true);
+            if (!empty()) {
+                _consumer_sleeping.store(false, std::memory_order_relaxed);
+                return make_ready_future<stop_iteration>(stop_iteration::yes);
+            }
+            return _not_empty.wait().then([this] {
+                return stop_iteration(!empty());
+            });
+        });
+    }
+
+    /// Pops an item, waiting for one if there is none. Consumer shard only.
+    future<T> pop() noexcept {
+        return wait_not_empty().then([this] {
+            return std::move(*try_pop());
+        });
+    }
+
+    /// Wakes up waiting producers and consumer with
+    /// \ref broken_condition_variable and waits for the wakeups in flight.
+    /// Consumer shard only.
+    future<> stop() noexcept {
+        _not_empty.broken();
+        return smp::invoke_on_all([this] {
+            auto& s = _shards[this_shard_id()];
+            s.not_full.broken();
+            return s.wakeups.close();
+        });
+    }
+
+private:
+    std::optional<T> pop_one() noexcept {
+        auto& c = _cells[_head & _mask];
+        if (c.seq.load(std::memory_order_acquire) != _head + 1) {
+            return std::nullopt;
+        }
+        std::optional<T> item(std::move(c.item));
+        c.item.~T();
+        c.seq.store(_head + _mask + 1, std::memory_order_release);
+        _head++;
+        return item;
+    }
+
+    template <typename Func>
+    void send_wakeup(shard_id to, Func func) noexcept {
+        // Shard-local gate, so that stop() knows when all of them arrived
+        (void)try_with_gate(_shards[this_shard_id()].wakeups, [to, func = std::move(func)] {
+            return smp::submit_to(to, std::move(func));
+        }).handle_exception([] (std::exception_ptr) {});
+    }
+
+    void wake_consumer() noexcept {
+        if (this_shard_id() == _owner) {
+            _not_empty.signal();
+        } else {
+            send_wakeup(_owner, [this] {
+                _not_empty.signal();
+            });
+        }
+    }
+
+    void maybe_wake_producers() noexcept {
+        // Pairs with the exchange in push(), so that either the producer
+        // sees the room or the consumer sees it waiting
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!_waiting_shards.load(std::memory_order_relaxed)) {
+            return;
+        }
+        for (shard_id s = 0; s < smp::count; s++) {
+            if (_shards[s].waiting.load(std::memory_order_relaxed) && _shards[s].waiting.exchange(false)) {
+                _waiting_shards.fetch_sub(1);
+                if (s == this_shard_id()) {
+                    _shards[s].not_full.broadcast();
+                } else {
+                    send_wakeup(s, [this, s] {
+                        _shards[s].not_full.broadcast();
+                    });
+                }
+            }
+        }
+    }
+};
+
+/// @}
+
+}
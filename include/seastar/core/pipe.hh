@@ -23,6 +23,7 @@
 
 #include <seastar/core/future.hh>
 #include <seastar/core/queue.hh>
+#include <vector>
 
 #include <seastar/util/std-compat.hh>
 
@@ -93,6 +94,25 @@ class pipe_buffer {
     future<> write(T&& data) {
         return _buf.push_eventually(std::move(data));
     }
+    future<std::vector<T>> read_batch(size_t max) {
+        return _buf.pop_eventually_batch(max).then([] (std::vector<std::optional<T>> items) {
+            std::vector<T> ret;
+            ret.reserve(items.size());
+            for (auto& item : items) {
+                // The EOF mark comes alone, see close_write()
+                if (item) {
+                    ret.push_back(std::move(*item));
+                }
+            }
+            return ret;
+        });
+    }
+    future<> write_batch(std::vector<T>&& data) {
+        return _buf.push_batch_eventually(std::move(data));
+    }
+    void set_not_full_threshold(std::optional<size_t> threshold) noexcept {
+        _buf.set_not_full_threshold(threshold);
+    }
     bool readable() const {
         return _write_open || !_buf.empty();
     }
@@ -156,6 +176,25 @@ class pipe_reader {
             return make_ready_future<std::optional<T>>();
         }
     }
+    /// \brief Read up to \c max items from the pipe
+    ///
+    /// Like read(), but returns all the items, up to \c max, that are in
+    /// the pipe's buffer once it becomes non-empty, so that a consumer can
+    /// handle a batch of items per task. An empty vector marks the end of
+    /// file.
+    future<std::vector<T>> read_batch(size_t max) {
+        if (_unread) {
+            std::vector<T> ret;
+            ret.push_back(std::move(*_unread));
+            _unread = {};
+            return make_ready_future<std::vector<T>>(std::move(ret));
+        }
+        if (_bufp->readable()) {
+            return _bufp->read_batch(max);
+        } else {
+            return make_ready_future<std::vector<T>>();
+        }
+    }
     /// \brief Return an item to the front of the pipe
     ///
     /// Pushes the given item to the front of the pipe, so it will be
@@ -211,6 +250,23 @@ class pipe_writer {
             return make_exception_future<>(broken_pipe_exception());
         }
     }
+    /// \brief Write a batch of items to the pipe
+    ///
+    /// Like write(), for all of the items in order, waiting for room as
+    /// many times as needed.
+    future<> write_batch(std::vector<T>&& data) {
+        if (_bufp->writeable()) {
+            return _bufp->write_batch(std::move(data));
+        } else {
+            return make_exception_future<>(broken_pipe_exception());
+        }
+    }
+    /// \brief Make a writer blocked on a full pipe wait for it to drain
+    ///
+    /// See \ref queue::set_not_full_threshold().
+    void set_not_full_threshold(std::optional<size_t> threshold) noexcept {
+        _bufp->set_not_full_threshold(threshold);
+    }
     ~pipe_writer() {
         if (_bufp && _bufp->close_write()) {
             delete _bufp;
@@ -244,6 +244,14 @@ class file_desc {
         throw_system_error_on(r == -1, "recvmsg");
         return { size_t(r) };
     }
+    std::optional<size_t> recvmmsg(mmsghdr* msgvec, unsigned vlen, int flags) {
+        auto r = ::recvmmsg(_fd, msgvec, vlen, flags, nullptr);
+        if (r == -1 && errno == EAGAIN) {
+            return {};
+        }
+        throw_system_error_on(r == -1, "recvmmsg");
+        return { size_t(r) };
+    }
     std::optional<size_t> send(const void* buffer, size_t len, int flags) {
         auto r = ::send(_fd, buffer, len, flags);
         if (r == -1 && errno == EAGAIN) {
@@ -268,6 +276,14 @@ class file_desc {
         throw_system_error_on(r == -1, "sendmsg");
         return { size_t(r) };
     }
+    std::optional<size_t> sendmmsg(mmsghdr* msgvec, unsigned vlen, int flags) {
+        auto r = ::sendmmsg(_fd, msgvec, vlen, flags);
+        if (r == -1 && errno == EAGAIN) {
+            return {};
+        }
+        throw_system_error_on(r == -1, "sendmmsg");
+        return { size_t(r) };
+    }
     void bind(sockaddr& sa, socklen_t sl) {
         auto r = ::bind(_fd, &sa, sl);
         throw_system_error_on(r == -1, "bind");
@@ -285,6 +301,12 @@ class file_desc {
         throw_system_error_on(r == -1, "getsockname");
         return addr;
     }
+    socket_address get_remote_address() {
+        socket_address addr;
+        auto r = ::getpeername(_fd, &addr.u.sa, &addr.addr_length);
+        throw_system_error_on(r == -1, "getpeername");
+        return addr;
+    }
     void listen(int backlog) {
         auto fd = ::listen(_fd, backlog);
         throw_system_error_on(fd == -1, "listen");
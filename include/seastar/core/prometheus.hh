@@ -37,12 +37,13 @@ struct config {
     sstring hostname; //!< hostname is deprecated, use label instead
     std::optional<metrics::label_instance> label; //!< A label that will be added to all metrics, we advice not to use it and set it on the prometheus server
     sstring prefix = "seastar"; //!< a prefix that will be added to metric names
+    bool allow_protobuf = false; //!< reply in the protobuf format to scrapers which ask for it in their Accept header
 };
 
 future<> start(httpd::http_server_control& http_server, config ctx);
 
 /// \defgroup add_prometheus_routes adds a /metrics endpoint that returns prometheus metrics
-///    in txt format
+///    in txt format, or in the protobuf format if config::allow_protobuf is set
 /// @{
 future<> add_prometheus_routes(distributed<http_server>& server, config ctx);
 future<> add_prometheus_routes(http_server& server, config ctx);
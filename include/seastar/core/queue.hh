@@ -23,7 +23,10 @@
 
 #include <seastar/core/circular_buffer.hh>
 #include <seastar/core/future.hh>
+#include <seastar/core/do_with.hh>
+#include <seastar/core/loop.hh>
 #include <queue>
+#include <vector>
 #include <seastar/util/std-compat.hh>
 
 namespace seastar {
@@ -40,12 +43,16 @@ SEASTAR_CONCEPT(requires std::is_nothrow_move_constructible_v<T>)
 class queue {
     std::queue<T, circular_buffer<T>> _q;
     size_t _max;
+    std::optional<size_t> _not_full_threshold;
     std::optional<promise<>> _not_empty;
     std::optional<promise<>> _not_full;
     std::exception_ptr _ex = nullptr;
 private:
     void notify_not_empty() noexcept;
     void notify_not_full() noexcept;
+    void maybe_notify_not_full() noexcept;
+    template <typename U>
+    void push_some(std::vector<U>& items, size_t& pushed);
 public:
     explicit queue(size_t size);
 
@@ -101,6 +108,25 @@ class queue {
     /// A producer-side operation. Cannot be called concurrently with other producer-side operations.
     future<> push_eventually(T&& data) noexcept;
 
+    /// Pops at least one and at most \c max elements, waiting for one if
+    /// the queue is empty, so that a consumer can handle a batch of
+    /// elements per task.
+    /// If the queue is, or already was, abort()ed, the future resolves with
+    /// the exception provided to abort().
+    /// A consumer-side operation. Cannot be called concurrently with other consumer-side operations.
+    future<std::vector<T>> pop_eventually_batch(size_t max) noexcept;
+
+    /// Pushes all the elements, in order, waiting for room as many times as
+    /// needed. Returns a future<> which resolves when all of them were
+    /// pushed.
+    /// If the queue is, or already was, abort()ed, the future resolves with
+    /// the exception provided to abort(); some of the elements may have been
+    /// pushed by then.
+    /// A producer-side operation. Cannot be called concurrently with other producer-side operations.
+    template <typename U>
+    SEASTAR_CONCEPT(requires std::is_constructible_v<T, U&&>)
+    future<> push_batch_eventually(std::vector<U>&& items) noexcept;
+
     /// Returns the number of items currently in the queue.
     size_t size() const noexcept {
         // std::queue::size() has no reason to throw
@@ -117,9 +143,16 @@ class queue {
     /// bigger than its max_size.
     void set_max_size(size_t max) noexcept {
         _max = max;
-        if (!full()) {
-            notify_not_full();
-        }
+        maybe_notify_not_full();
+    }
+
+    /// Makes a producer waiting for room wait until the queue drains down
+    /// to \c threshold elements, rather than until there's room for one.
+    /// A producer then gets to push a batch of elements per wakeup, and the
+    /// consumer to pop a batch per wakeup too. Unset by default.
+    void set_not_full_threshold(std::optional<size_t> threshold) noexcept {
+        _not_full_threshold = threshold;
+        maybe_notify_not_full();
     }
 
     /// Destroy any items in the queue, and pass the provided exception to any
@@ -177,6 +210,15 @@ void queue<T>::notify_not_full() noexcept {
     }
 }
 
+template <typename T>
+SEASTAR_CONCEPT(requires std::is_nothrow_move_constructible_v<T>)
+inline
+void queue<T>::maybe_notify_not_full() noexcept {
+    if (!full() && (!_not_full_threshold || _q.size() <= *_not_full_threshold)) {
+        notify_not_full();
+    }
+}
+
 template <typename T>
 SEASTAR_CONCEPT(requires std::is_nothrow_move_constructible_v<T>)
 inline
@@ -202,9 +244,6 @@ template <typename T>
 SEASTAR_CONCEPT(requires std::is_nothrow_move_constructible_v<T>)
 inline
 T queue<T>::pop() noexcept {
-    if (_q.size() == _max) {
-        notify_not_full();
-    }
     // popping the front element must not throw
     // as T is required to be nothrow_move_constructible
     // and std::queue::pop won't throw since it uses
@@ -212,6 +251,7 @@ T queue<T>::pop() noexcept {
     assert(!_q.empty());
     T data = std::move(_q.front());
     _q.pop();
+    maybe_notify_not_full();
     return data;
 }
 
@@ -276,12 +316,71 @@ bool queue<T>::consume(Func&& func) {
         running = func(std::move(_q.front()));
         _q.pop();
     }
-    if (!full()) {
-        notify_not_full();
-    }
+    maybe_notify_not_full();
     return running;
 }
 
+template <typename T>
+SEASTAR_CONCEPT(requires std::is_nothrow_move_constructible_v<T>)
+inline
+future<std::vector<T>> queue<T>::pop_eventually_batch(size_t max) noexcept {
+    return not_empty().then([this, max] {
+        if (_ex) {
+            return make_exception_future<std::vector<T>>(_ex);
+        }
+        std::vector<T> ret;
+        ret.reserve(std::min(max, _q.size()));
+        while (!_q.empty() && ret.size() < max) {
+            ret.push_back(std::move(_q.front()));
+            _q.pop();
+        }
+        maybe_notify_not_full();
+        return make_ready_future<std::vector<T>>(std::move(ret));
+    });
+}
+
+template <typename T>
+SEASTAR_CONCEPT(requires std::is_nothrow_move_constructible_v<T>)
+template <typename U>
+inline
+void queue<T>::push_some(std::vector<U>& items, size_t& pushed) {
+    auto before = pushed;
+    while (pushed < items.size() && !full()) {
+        _q.push(T(std::move(items[pushed])));
+        pushed++;
+    }
+    if (pushed != before) {
+        notify_not_empty();
+    }
+}
+
+template <typename T>
+SEASTAR_CONCEPT(requires std::is_nothrow_move_constructible_v<T>)
+template <typename U>
+SEASTAR_CONCEPT(requires std::is_constructible_v<T, U&&>)
+inline
+future<> queue<T>::push_batch_eventually(std::vector<U>&& items) noexcept {
+    if (_ex) {
+        return make_exception_future<>(_ex);
+    }
+    size_t pushed = 0;
+    try {
+        push_some(items, pushed);
+    } catch (...) {
+        return current_exception_as_future();
+    }
+    if (pushed == items.size()) {
+        return make_ready_future<>();
+    }
+    return do_with(std::move(items), pushed, [this] (std::vector<U>& items, size_t& pushed) {
+        return do_until([&items, &pushed] { return pushed == items.size(); }, [this, &items, &pushed] {
+            return not_full().then([this, &items, &pushed] {
+                push_some(items, pushed);
+            });
+        });
+    });
+}
+
 template <typename T>
 SEASTAR_CONCEPT(requires std::is_nothrow_move_constructible_v<T>)
 inline
@@ -26,6 +26,8 @@
 #include <seastar/util/eclipse.hh>
 #include <algorithm>
 #include <memory>
+#include <optional>
+#include <string_view>
 #include <cassert>
 #include <seastar/util/std-compat.hh>
 #include <seastar/core/future.hh>
@@ -89,6 +91,17 @@ class sstring_builder::guard {
         }
         _builder._start = nullptr;
     }
+    // Like mark_end(), but a string that lies within this block is left in
+    // place and returned as a view; nullopt means it was built, for get().
+    std::optional<std::string_view> mark_end_in_place(const char* p) {
+        if (!_builder._value.empty()) {
+            mark_end(p);
+            return std::nullopt;
+        }
+        auto start = _builder._start ? _builder._start : p;
+        _builder._start = nullptr;
+        return std::string_view(start, p - start);
+    }
 };
 
 
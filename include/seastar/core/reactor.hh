@@ -27,6 +27,9 @@
 #include <seastar/core/cacheline.hh>
 #include <seastar/core/circular_buffer_fixed_capacity.hh>
 #include <seastar/core/idle_cpu_handler.hh>
+#include <seastar/core/internal/cpu_quota_pacer.hh>
+#include <seastar/core/internal/idle_poll_policy.hh>
+#include <seastar/core/internal/log_histogram.hh>
 #include <memory>
 #include <type_traits>
 #include <sys/epoll.h>
@@ -46,6 +49,7 @@
 #include <chrono>
 #include <ratio>
 #include <atomic>
+#include <array>
 #include <stack>
 #include <seastar/util/std-compat.hh>
 #include <boost/next_prior.hpp>
@@ -123,6 +127,8 @@ namespace seastar {
 
 class thread_pool;
 class smp;
+struct stall_profile;
+struct cpu_profile;
 
 class reactor_backend_selector;
 
@@ -132,7 +138,10 @@ namespace internal {
 
 class reactor_stall_sampler;
 class cpu_stall_detector;
+class cpu_profiler;
 class buffer_allocator;
+class stealable_work_queue;
+class smp_batched_calls;
 
 template <typename Func> // signature: bool ()
 std::unique_ptr<pollfn> make_pollfn(Func&& func);
@@ -179,8 +188,10 @@ class io_completion : public kernel_completion {
 
 class reactor {
 private:
+    struct sched_entity;
     struct task_queue;
-    using task_queue_list = circular_buffer_fixed_capacity<task_queue*, 1 << log2ceil(max_scheduling_groups())>;
+    struct task_queue_group;
+    using task_queue_list = circular_buffer_fixed_capacity<sched_entity*, 1 << log2ceil(max_scheduling_groups() + max_scheduling_supergroups())>;
     using pollfn = seastar::pollfn;
 
     class signal_pollfn;
@@ -195,6 +206,7 @@ class reactor {
     class io_queue_submission_pollfn;
     class syscall_pollfn;
     class execution_stage_pollfn;
+    class stealable_pollfn;
     friend class manual_clock;
     friend class file_data_source_impl; // for fstream statistics
     friend class internal::reactor_stall_sampler;
@@ -226,6 +238,20 @@ class reactor {
         uint64_t fstream_read_bytes_blocked = 0;
         uint64_t fstream_read_aheads_discarded = 0;
         uint64_t fstream_read_ahead_discarded_bytes = 0;
+        uint64_t fstream_read_aheads_throttled = 0;
+        uint64_t uring_recv_buffers_used = 0;
+        uint64_t uring_recv_buffers_exhausted = 0;
+        uint64_t uring_multishot_accept_submissions = 0;
+        uint64_t uring_multishot_accepts = 0;
+        uint64_t uring_multishot_recv_submissions = 0;
+        uint64_t uring_multishot_recvs = 0;
+        uint64_t uring_fixed_buffer_ios = 0;
+        uint64_t uring_enters = 0;
+        uint64_t uring_fixed_buffers_exhausted = 0;
+        uint64_t uring_zerocopy_sends = 0;
+        uint64_t uring_zerocopy_sends_copied = 0;
+        uint64_t packet_sends = 0;
+        uint64_t packet_send_iovecs = 0;
     };
     /// Scheduling statistics.
     struct sched_stats {
@@ -285,44 +311,103 @@ class reactor {
     uint64_t _global_tasks_processed = 0;
     uint64_t _polls = 0;
     std::unique_ptr<internal::cpu_stall_detector> _cpu_stall_detector;
+    std::unique_ptr<internal::cpu_profiler> _cpu_profiler;
+    bool _cpu_profiler_running = false;
 
     unsigned _max_task_backlog = 1000;
-    timer_set<timer<>, &timer<>::_link> _timers;
-    timer_set<timer<>, &timer<>::_link>::timer_list_t _expired_timers;
-    timer_set<timer<lowres_clock>, &timer<lowres_clock>::_link> _lowres_timers;
-    timer_set<timer<lowres_clock>, &timer<lowres_clock>::_link>::timer_list_t _expired_lowres_timers;
-    timer_set<timer<manual_clock>, &timer<manual_clock>::_link> _manual_timers;
-    timer_set<timer<manual_clock>, &timer<manual_clock>::_link>::timer_list_t _expired_manual_timers;
+    timer_container<timer<>, &timer<>::_link> _timers;
+    timer_container<timer<>, &timer<>::_link>::timer_list_t _expired_timers;
+    timer_container<timer<lowres_clock>, &timer<lowres_clock>::_link> _lowres_timers;
+    timer_container<timer<lowres_clock>, &timer<lowres_clock>::_link>::timer_list_t _expired_lowres_timers;
+    timer_container<timer<manual_clock>, &timer<manual_clock>::_link> _manual_timers;
+    timer_container<timer<manual_clock>, &timer<manual_clock>::_link>::timer_list_t _expired_manual_timers;
     io_stats _io_stats;
     uint64_t _fsyncs = 0;
+    uint64_t _fsyncs_issued = 0;
+    uint64_t _fsyncs_batched = 0;
+    // Files with an fdatasync() in flight, and the flushes that arrived
+    // since and wait for the one issued after it completes
+    struct fsync_batch {
+        std::vector<promise<>> next;
+    };
+    std::unordered_map<int, fsync_batch> _fsync_batches;
     uint64_t _cxx_exceptions = 0;
     uint64_t _abandoned_failed_futures = 0;
-    struct task_queue {
-        explicit task_queue(unsigned id, sstring name, float shares);
+    // What the CPU time is divided between, at each level: a task queue,
+    // or the group of those of a scheduling supergroup
+    struct sched_entity {
+        sched_entity(float shares, bool is_group) noexcept;
         int64_t _vruntime = 0;
         float _shares;
         int64_t _reciprocal_shares_times_2_power_32;
-        bool _current = false;
         bool _active = false;
+        const bool _is_group;
+        // nullptr at the top level
+        task_queue_group* _parent = nullptr;
+        int64_t to_vruntime(sched_clock::duration runtime) const;
+        void set_shares(float shares) noexcept;
+        struct indirect_compare;
+    };
+    struct task_queue : sched_entity {
+        explicit task_queue(unsigned id, sstring name, float shares);
+        bool _current = false;
+        bool _migratable = false;
         uint8_t _id;
         sched_clock::time_point _ts; // to help calculating wait/starve-times
         sched_clock::duration _runtime = {};
         sched_clock::duration _waittime = {};
         sched_clock::duration _starvetime = {};
         uint64_t _tasks_processed = 0;
+        // 2 buckets per octave, up to ~16 seconds. The delay is from the
+        // queue becoming runnable, or being preempted, to it running again;
+        // the runtime is of each time the queue is given the CPU.
+        internal::latency_histogram<1, 50> _queue_delay;
+        internal::latency_histogram<1, 50> _quantum_runtime;
         circular_buffer<task*> _q;
+        struct deadline_task {
+            sched_clock::time_point deadline;
+            task* tsk;
+            // std::push_heap() builds a max-heap, we want the earliest deadline on top
+            bool operator<(const deadline_task& x) const noexcept { return deadline > x.deadline; }
+        };
+        // Tasks scheduled with a deadline. They run earliest deadline first,
+        // ahead of the FIFO tasks in _q.
+        std::vector<deadline_task> _deadline_q;
+        uint64_t _deadline_tasks_processed = 0;
+        uint64_t _deadline_misses = 0;
         sstring _name;
-        int64_t to_vruntime(sched_clock::duration runtime) const;
-        void set_shares(float shares) noexcept;
-        struct indirect_compare;
+        bool empty() const noexcept { return _q.empty() && _deadline_q.empty(); }
+        size_t size() const noexcept { return _q.size() + _deadline_q.size(); }
+        task* pop_front() noexcept;
         sched_clock::duration _time_spent_on_task_quota_violations = {};
+        // With a CPU cap, the queue is taken off the CPU, until the timer
+        // fires, once it has run more than the cap allows
+        std::optional<internal::cpu_quota_pacer> _cap;
+        sched_clock::time_point _cap_checked;
+        timer<> _cap_timer;
+        uint64_t _throttles = 0;
+        sched_clock::duration _throttled_time = {};
         seastar::metrics::metric_groups _metrics;
         void rename(sstring new_name);
     private:
         void register_stats();
     };
 
+    // The task queues of a scheduling supergroup, which compete for the
+    // CPU as one at the top level, and between each other within it
+    struct task_queue_group : sched_entity {
+        task_queue_group(unsigned id, float shares);
+        unsigned _id;
+        unsigned _nr_queues = 0;
+        int64_t _last_vruntime = 0;
+        task_queue_list _active_queues;
+        sched_clock::duration _runtime = {};
+        seastar::metrics::metric_groups _metrics;
+    };
+
     boost::container::static_vector<std::unique_ptr<task_queue>, max_scheduling_groups()> _task_queues;
+    // Indexed by supergroup id, the top level having none
+    std::array<std::unique_ptr<task_queue_group>, max_scheduling_supergroups() + 1> _task_queue_groups;
     internal::scheduling_group_specific_thread_local_data _scheduling_group_specific_data;
     int64_t _last_vruntime = 0;
     task_queue_list _active_task_queues;
@@ -330,6 +415,8 @@ class reactor {
     task_queue* _at_destroy_tasks;
     sched_clock::duration _task_quota;
     task* _current_task = nullptr;
+    // The type of _current_task, kept only while the CPU profiler runs
+    const std::type_info* _current_task_type = nullptr;
     /// Handler that will be called when there is no task to execute on cpu.
     /// It represents a low priority work.
     /// 
@@ -349,6 +436,33 @@ class reactor {
     sched_clock::duration _total_sleep;
     sched_clock::time_point _start_time = now();
     std::chrono::nanoseconds _max_poll_time = calculate_poll_time();
+    // Adapts _max_poll_time, with --idle-poll-budget
+    std::optional<internal::idle_poll_policy> _idle_poll_policy;
+    uint64_t _sleeps = 0;
+    // Of add_busy_poll(), and the longest of them
+    std::vector<std::chrono::nanoseconds> _busy_polls;
+    std::chrono::nanoseconds _busy_poll_time{0};
+    // With --park-below-load, a parked shard sleeps as soon as it runs
+    // out of work, rather than polling for more first
+    std::optional<double> _park_below_load;
+    bool _parked = false;
+    uint64_t _parks = 0;
+    sched_clock::duration _total_parked{0};
+    sched_clock::time_point _parked_since;
+    // With a cgroup CPU quota, sleeps between tasks to keep within the
+    // shard's part of it, rather than be throttled by the kernel
+    std::optional<internal::cpu_quota_pacer> _cpu_quota_pacer;
+    sched_clock::time_point _cpu_quota_checked;
+    std::chrono::nanoseconds _cpu_quota_cputime{0};
+    uint64_t _cpu_quota_sleeps = 0;
+    sched_clock::duration _cpu_quota_sleep_time{0};
+    // How late high resolution timers expire, while active and while
+    // parked, which measures the cost in latency of sleeping
+    struct timer_delay_stats {
+        uint64_t expirations = 0;
+        std::chrono::nanoseconds total{0};
+    };
+    std::array<timer_delay_stats, 2> _timer_delays;
     output_stream<char>::batch_flush_list_t _flush_batching;
     std::atomic<bool> _sleeping alignas(seastar::cache_line_size){0};
     pthread_t _thread_id alignas(seastar::cache_line_size) = pthread_self();
@@ -360,7 +474,7 @@ class reactor {
     std::atomic<bool> _dying{false};
 private:
     static std::chrono::nanoseconds calculate_poll_time();
-    static void block_notifier(int);
+    static void block_notifier(int, siginfo_t*, void*);
     size_t handle_aio_error(internal::linux_abi::iocb* iocb, int ec);
     bool flush_pending_aio();
     steady_clock_type::time_point next_pending_aio() const noexcept;
@@ -413,9 +527,14 @@ class reactor {
 
     signals _signals;
     std::unique_ptr<thread_pool> _thread_pool;
+    std::unique_ptr<internal::stealable_work_queue> _stealable_queue;
+    std::unique_ptr<internal::smp_batched_calls> _batched_calls;
     friend class thread_pool;
+    friend struct internal::stealable_work_item;
+    friend class internal::stealable_work_queue;
     friend class thread_context;
     friend class internal::cpu_stall_detector;
+    friend class internal::cpu_profiler;
 
     uint64_t pending_task_count() const;
     void run_tasks(task_queue& tq);
@@ -423,13 +542,20 @@ class reactor {
     bool posix_reuseport_detect();
     void run_some_tasks();
     void activate(task_queue& tq);
-    void insert_active_task_queue(task_queue* tq);
+    void insert_active_task_queue(task_queue_list& atq, sched_entity* e);
+    // Makes the number of runnable tasks visible to smp::load_of()
+    void publish_runnable_tasks() noexcept;
     task_queue* pop_active_task_queue(sched_clock::time_point now);
     void insert_activating_task_queues();
     void account_runtime(task_queue& tq, sched_clock::duration runtime);
+    sched_clock::duration charge_cpu_cap(task_queue& tq, sched_clock::time_point now, sched_clock::duration runtime) noexcept;
+    void set_cpu_cap(task_queue& tq, std::optional<float> fraction) noexcept;
+    void unthrottle(task_queue& tq) noexcept;
     void account_idle(sched_clock::duration idletime);
     void allocate_scheduling_group_specific_data(scheduling_group sg, scheduling_group_key key);
-    future<> init_scheduling_group(scheduling_group sg, sstring name, float shares);
+    future<> init_scheduling_group(scheduling_group sg, sstring name, float shares, scheduling_supergroup parent = {});
+    void init_scheduling_supergroup(scheduling_supergroup sg, float shares);
+    void destroy_scheduling_supergroup(scheduling_supergroup sg) noexcept;
     future<> init_new_scheduling_group_key(scheduling_group_key key, scheduling_group_key_config cfg);
     future<> destroy_scheduling_group(scheduling_group sg) noexcept;
     uint64_t tasks_processed() const;
@@ -454,6 +580,8 @@ class reactor {
     do_write_some(pollable_fd_state& fd, const void* buffer, size_t size);
     future<size_t>
     do_write_some(pollable_fd_state& fd, net::packet& p);
+    future<size_t>
+    do_sendfile(pollable_fd_state& fd, int in_fd, uint64_t pos, size_t len);
 
     future<temporary_buffer<char>>
     do_recv_some(pollable_fd_state& fd, internal::buffer_allocator* ba);
@@ -507,7 +635,18 @@ class reactor {
 
     bool posix_reuseport_available() const { return _reuseport; }
 
+    /// @private
+    /// Keeps the reactor polling for at least \c t once it runs out of work,
+    /// before it sleeps, until remove_busy_poll(). Sockets which busy poll
+    /// their NIC queue for \c t get their data sooner than an interrupt
+    /// would bring it, only if the reactor is still polling them by then.
+    void add_busy_poll(std::chrono::nanoseconds t);
+    /// @private
+    void remove_busy_poll(std::chrono::nanoseconds t) noexcept;
+
     pollable_fd make_pollable_fd(socket_address sa, int proto);
+    /// Makes a pollable_fd of a socket made elsewhere
+    pollable_fd make_pollable_fd(file_desc fd);
 
     future<> posix_connect(pollable_fd pfd, socket_address sa, socket_address local);
 
@@ -558,7 +697,7 @@ class reactor {
     void add_task(task* t) noexcept {
         auto sg = t->group();
         auto* q = _task_queues[sg._id].get();
-        bool was_empty = q->_q.empty();
+        bool was_empty = q->empty();
         q->_q.push_back(std::move(t));
 #ifdef SEASTAR_SHUFFLE_TASK_QUEUE
         shuffle(q->_q.back(), *q);
@@ -571,7 +710,7 @@ class reactor {
         memory::scoped_critical_alloc_section _;
         auto sg = t->group();
         auto* q = _task_queues[sg._id].get();
-        bool was_empty = q->_q.empty();
+        bool was_empty = q->empty();
         q->_q.push_front(std::move(t));
 #ifdef SEASTAR_SHUFFLE_TASK_QUEUE
         shuffle(q->_q.front(), *q);
@@ -580,6 +719,7 @@ class reactor {
             activate(*q);
         }
     }
+    void add_task_with_deadline(task* t, sched_clock::time_point deadline) noexcept;
 
     /// Set a handler that will be called when there is no task to execute on cpu.
     /// Handler should do a low priority work.
@@ -602,6 +742,7 @@ class reactor {
     shard_id cpu_id() const;
 
     void sleep();
+    void pace_cpu_quota();
 
     steady_clock_type::duration total_idle_time();
     steady_clock_type::duration total_busy_time();
@@ -635,6 +776,8 @@ class reactor {
     future<> write_all_part(pollable_fd_state& fd, const void* buffer, size_t size, size_t completed);
 
     future<> fdatasync(int fd) noexcept;
+    future<> issue_fdatasync(int fd) noexcept;
+    future<> do_fdatasync(int fd) noexcept;
 
     void add_timer(timer<steady_clock_type>*) noexcept;
     bool queue_timer(timer<steady_clock_type>*) noexcept;
@@ -654,6 +797,7 @@ class reactor {
     friend struct pollable_fd_state_deleter;
     friend class posix_file_impl;
     friend class blockdev_file_impl;
+    friend class mapped_file;
     friend class timer<>;
     friend class timer<lowres_clock>;
     friend class timer<manual_clock>;
@@ -667,7 +811,11 @@ class reactor {
     friend void with_allow_abandoned_failed_futures(unsigned count, noncopyable_function<void ()> func);
     metrics::metric_groups _metric_groups;
     friend future<scheduling_group> create_scheduling_group(sstring name, float shares) noexcept;
+    friend future<scheduling_group> create_scheduling_group(sstring name, float shares, scheduling_supergroup parent) noexcept;
     friend future<> seastar::destroy_scheduling_group(scheduling_group) noexcept;
+    friend future<scheduling_supergroup> create_scheduling_supergroup(float shares) noexcept;
+    friend future<> seastar::destroy_scheduling_supergroup(scheduling_supergroup) noexcept;
+    friend class scheduling_supergroup;
     friend future<> seastar::rename_scheduling_group(scheduling_group sg, sstring new_name) noexcept;
     friend future<scheduling_group_key> scheduling_group_key_create(scheduling_group_key_config cfg) noexcept;
 
@@ -705,8 +853,33 @@ class reactor {
     /// performance and an increase in memory consumption.
     void set_strict_dma(bool value);
     void set_bypass_fsync(bool value);
+    /// \cond internal
+    /// Allocates a buffer for DMA file I/O, aligned to \c alignment.
+    ///
+    /// The buffer may come from memory the reactor backend registered with
+    /// the kernel; I/O into such memory avoids pinning its pages per request.
+    temporary_buffer<char> allocate_dma_buffer(size_t alignment, size_t size);
+    /// Tries to abort an already submitted disk I/O, see io_intent.
+    bool cancel_io(kernel_completion* desc) noexcept;
+    /// \endcond
     void update_blocked_reactor_notify_ms(std::chrono::milliseconds ms);
     std::chrono::milliseconds get_blocked_reactor_notify_ms() const;
+    /// Enables or disables the stall profiler, which samples a backtrace
+    /// every \c interval of CPU time while the reactor is blocked, and counts
+    /// the samples by call stack.
+    void set_stall_profiling(bool enabled, std::chrono::microseconds interval = std::chrono::milliseconds(1));
+    bool stall_profiling_enabled() const;
+    /// Returns the call stacks the stall profiler sampled on this shard,
+    /// and clears them if \c reset is true. See stall_profile.hh.
+    stall_profile get_stall_profile(bool reset = false);
+    /// Starts the CPU profiler of this shard, see cpu_profiler.hh. If it
+    /// had run with another period, what it sampled then is cleared.
+    void start_cpu_profiler(std::chrono::nanoseconds period);
+    void stop_cpu_profiler();
+    bool cpu_profiler_running() const { return _cpu_profiler_running; }
+    /// Returns the call stacks the CPU profiler sampled on this shard,
+    /// and clears them if \c reset is true.
+    cpu_profile get_cpu_profile(bool reset = false);
     // For testing:
     void set_stall_detector_report_function(std::function<void ()> report);
     std::function<void ()> get_stall_detector_report_function() const;
@@ -31,6 +31,11 @@ namespace seastar {
 struct reactor_config {
     bool auto_handle_sigint_sigterm = true;
     unsigned max_networking_aio_io_control_blocks = 10000;
+    unsigned uring_recv_buffers = 0;
+    unsigned uring_dma_buffers = 0;
+    unsigned uring_send_zerocopy_threshold = 0;
+    unsigned syscall_threads = 1;
+    unsigned slow_syscall_threads = 1;
 };
 /// \endcond
 
@@ -53,6 +58,25 @@ struct reactor_options : public program_options::option_group {
     ///
     /// Reduce for overprovisioned environments or laptops.
     program_options::value<unsigned> idle_poll_time_us;
+    /// \brief Fraction of the CPU time which idle polling may use.
+    ///
+    /// When set, the idle polling time adapts to the lengths of the recent
+    /// idle periods: it is the shortest which avoids most of the wakeups
+    /// that polling for at most \ref idle_poll_time_us could avoid, while
+    /// polling for no more than this fraction of the time.
+    ///
+    /// Default: unset, always poll for \ref idle_poll_time_us.
+    program_options::value<double> idle_poll_budget;
+    /// \brief Load below which a shard parks.
+    ///
+    /// A shard whose load, averaged over the last 5 seconds, falls below
+    /// this fraction of the CPU time parks: it goes to sleep as soon as it
+    /// runs out of work, without idle polling. Network and cross-shard
+    /// messages still wake it up, at the cost of the wakeup latency. It
+    /// resumes polling when its load exceeds twice the threshold.
+    ///
+    /// Default: unset, never park.
+    program_options::value<double> park_below_load;
     /// \brief Busy-poll for disk I/O.
     ///
     /// Reduces latency and increases throughput.
@@ -65,12 +89,38 @@ struct reactor_options : public program_options::option_group {
     ///
     /// Default: 1.5 * task_quota_ms value
     program_options::value<double> io_latency_goal_ms;
+    /// \brief Target 99th percentile of in-disk IO latency (ms).
+    ///
+    /// When set, IO queues measure the latency of completed requests and
+    /// lower the dispatch rate below the configured disk throughput when
+    /// the device cannot sustain it within this time.
+    /// Default: not set (disabled).
+    program_options::value<double> io_latency_target_ms;
+    /// \brief Maximum size (KiB) of a read merged from contiguous queued reads.
+    ///
+    /// Reads of the same file and class that are waiting in the IO queue
+    /// back to back are submitted as a single vectored read of up to this
+    /// size.
+    /// Default: 0 (disabled).
+    program_options::value<unsigned> io_max_read_merge_kb;
+    /// \brief Number of disk requests kept in the I/O trace of each shard,
+    /// see \ref get_io_trace().
+    ///
+    /// Default: 0 (disabled).
+    program_options::value<unsigned> io_trace_entries;
     /// \brief Maximum number of task backlog to allow.
     ///
     /// When the number of tasks grow above this, we stop polling (e.g. I/O)
     /// until it goes back below the limit.
     /// Default: 1000.
     program_options::value<unsigned> max_task_backlog;
+    /// \brief Keep within the CPU quota of the cgroup (cpu.max).
+    ///
+    /// The number of shards defaults to the quota, rounded up, rather than
+    /// the number of CPUs, and shards sleep between tasks to stay within
+    /// their part of it instead of being throttled by the kernel.
+    /// Default: \p true.
+    program_options::value<bool> cpu_quota_pacing;
     /// \brief Threshold in milliseconds over which the reactor is considered
     /// blocked if no progress is made.
     ///
@@ -84,6 +134,16 @@ struct reactor_options : public program_options::option_group {
     ///
     /// Default: \p true.
     program_options::value<bool> blocked_reactor_report_format_oneline;
+    /// \brief Sample backtraces while the reactor is blocked, and count them
+    /// by call stack, see \ref reactor::get_stall_profile().
+    ///
+    /// Default: \p false.
+    program_options::value<bool> blocked_reactor_profile;
+    /// \brief CPU time between backtraces sampled while the reactor is blocked,
+    /// with \ref blocked_reactor_profile, in microseconds.
+    ///
+    /// Default: 1000.
+    program_options::value<unsigned> blocked_reactor_profile_interval_us;
     /// \brief Allow using buffered I/O if DMA is not available (reduces performance).
     program_options::value<> relaxed_dma;
     /// \brief Use the Linux NOWAIT AIO feature, which reduces reactor stalls due
@@ -145,10 +205,70 @@ struct reactor_options : public program_options::option_group {
     ///
     /// Default: 10000.
     program_options::value<unsigned> max_networking_io_control_blocks;
+    /// \brief Number of socket receive buffers to register with io_uring per shard.
+    ///
+    /// When non-zero, socket receives don't allocate a buffer up front;
+    /// the kernel picks one from a shared ring of registered buffers when
+    /// data arrives, and the data reaches the application without a copy.
+    /// Rounded up to a power of two. Requires Linux 5.19 or later. Only
+    /// valid for the \p io_uring reactor backend (see \ref reactor_backend).
+    ///
+    /// Default: 0 (disabled).
+    program_options::value<unsigned> io_uring_recv_buffers;
+    /// \brief Number of 128k file I/O buffers to register with io_uring per shard.
+    ///
+    /// When non-zero, \ref file::dma_read_bulk() and file output streams
+    /// allocate their buffers from an arena registered with the kernel, and
+    /// reads and writes into it are issued as fixed-buffer operations that
+    /// don't pin and unpin pages per request. Allocations fall back to regular
+    /// memory once the arena is exhausted. The arena is locked in memory, so
+    /// \p RLIMIT_MEMLOCK must allow it. Only valid for the \p io_uring reactor
+    /// backend (see \ref reactor_backend).
+    ///
+    /// Default: 0 (disabled).
+    program_options::value<unsigned> io_uring_dma_buffers;
+    /// \brief Send packets of at least this many bytes without copying them.
+    ///
+    /// When non-zero, large socket writes are issued as zero-copy sends:
+    /// the kernel transmits straight from the packet's memory, which is
+    /// kept alive until the kernel reports it is done with it. Smaller
+    /// packets are still copied, as for them the notification costs more
+    /// than the copy. Requires Linux 6.1 or later. Only valid for the
+    /// \p io_uring reactor backend (see \ref reactor_backend).
+    ///
+    /// Default: 0 (disabled).
+    program_options::value<unsigned> io_uring_send_zerocopy_threshold;
+    /// \brief Threads per shard running blocking system calls.
+    ///
+    /// File system operations the reactor backend cannot issue
+    /// asynchronously, such as opening or renaming files, run on these
+    /// threads; each goes to the one with the fewest in flight, so that
+    /// a system call which hangs, e.g. on a remote file system, does not
+    /// hold up the others.
+    ///
+    /// Default: 1.
+    program_options::value<unsigned> syscall_threads;
+    /// \brief Threads per shard running system calls known to be slow.
+    ///
+    /// Syncing, truncating, allocating and discarding file data and asking
+    /// file systems for their space run on these threads, apart from the
+    /// \ref syscall_threads. With 0, they share those.
+    ///
+    /// Default: 1.
+    program_options::value<unsigned> slow_syscall_threads;
     /// \brief Enable seastar heap profiling.
     ///
     /// \note Unused when seastar was compiled without heap profiling support.
     program_options::value<> heapprof;
+    /// \brief Make the heap profiler record one allocation per this many
+    /// bytes allocated, on average, instead of every allocation.
+    ///
+    /// See \ref memory::set_heap_profiling_sampling_interval().
+    ///
+    /// Default: 0 (record every allocation).
+    ///
+    /// \note Unused when seastar was compiled without heap profiling support.
+    program_options::value<unsigned> heapprof_sampling_interval;
     /// Ignore SIGINT (for gdb).
     program_options::value<> no_handle_interrupt;
 
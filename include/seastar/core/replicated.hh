@@ -0,0 +1,128 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#pragma once
+
+#include <seastar/core/cacheline.hh>
+#include <seastar/core/future.hh>
+#include <seastar/core/semaphore.hh>
+#include <seastar/core/smp.hh>
+#include <memory>
+#include <vector>
+
+/// \file
+
+namespace seastar {
+
+/// \addtogroup smp-module
+/// @{
+
+/// Read-mostly data shared by all shards.
+///
+/// Unlike \ref sharded, which keeps an instance per shard, a replicated
+/// object keeps a single immutable snapshot of a \c T, which every shard
+/// reads in place: \ref local() is a plain pointer load from a slot of the
+/// current shard. \ref publish() replaces the snapshot with a broadcast of a
+/// pointer to every shard, and frees the previous one once all shards have
+/// moved on to the new one.
+///
+/// Reclamation relies on a grace period, as in RCU: a reference obtained
+/// from \ref local() must not be kept past the current task, i.e. across a
+/// suspension point. Since the broadcast runs as a task on every shard,
+/// once it has run everywhere, no reader can still hold the old snapshot.
+///
+/// The snapshot is created, and destroyed, on the shard that owns the
+/// replicated object; \ref publish() may only be called there. The object
+/// must outlive all readers, and publish() calls.
+///
+/// \tparam T the type of the data; accessed through const references only,
+///         so it must be safe to read concurrently from all shards
+template <typename T>
+class replicated {
+    struct alignas(cache_line_size) slot {
+        const T* value = nullptr;
+    };
+    std::unique_ptr<slot[]> _slots;
+    std::unique_ptr<const T> _current;
+    // Snapshots that may still be visible after a failed broadcast
+    std::vector<std::unique_ptr<const T>> _retired;
+    semaphore _publish_sem{1};
+    shard_id _owner;
+public:
+    /// Creates the object on the current shard, with an initial snapshot
+    explicit replicated(T initial)
+        : _slots(std::make_unique<slot[]>(smp::count))
+        , _current(std::make_unique<const T>(std::move(initial)))
+        , _owner(this_shard_id()) {
+        // No other shard can see the object before it is constructed
+        for (unsigned i = 0; i < smp::count; i++) {
+            _slots[i].value = _current.get();
+        }
+    }
+
+    replicated(const replicated&) = delete;
+    replicated(replicated&&) = delete;
+
+    /// Returns the current snapshot, as this shard sees it. The reference is
+    /// valid until the current task ends.
+    const T& local() const noexcept {
+        return *_slots[this_shard_id()].value;
+    }
+
+    const T& operator*() const noexcept {
+        return local();
+    }
+
+    const T* operator->() const noexcept {
+        return &local();
+    }
+
+    /// Replaces the snapshot on all shards.
+    ///
+    /// Concurrent calls are serialized.
+    ///
+    /// \return a future that resolves when all shards see the new snapshot,
+    ///         and the previous one is freed
+    future<> publish(T value) {
+        assert(this_shard_id() == _owner);
+        return with_semaphore(_publish_sem, 1, [this, value = std::move(value)] () mutable {
+            auto next = std::make_unique<const T>(std::move(value));
+            auto p = next.get();
+            _retired.reserve(_retired.size() + 1);
+            return smp::invoke_on_all([this, p] () noexcept {
+                _slots[this_shard_id()].value = p;
+            }).then_wrapped([this, next = std::move(next)] (future<> f) mutable {
+                auto prev = std::exchange(_current, std::move(next));
+                if (f.failed()) {
+                    // Some shards may still see prev
+                    _retired.push_back(std::move(prev));
+                    return f;
+                }
+                _retired.clear();
+                return make_ready_future<>();
+            });
+        });
+    }
+};
+
+/// @}
+
+}
@@ -56,7 +56,10 @@ namespace hwloc::internal {
 #ifdef SEASTAR_HAVE_HWLOC
 class topology_holder {
     hwloc_topology_t _topology;
+    std::optional<std::string> _xml_cache;
 
+    bool load_xml_cache();
+    void save_xml_cache();
 public:
     topology_holder() noexcept
         : _topology(nullptr)
@@ -72,6 +75,12 @@ class topology_holder {
         return _topology != nullptr;
     }
 
+    // The topology is loaded from this file if it exists and is written
+    // there otherwise; to be set before the topology is loaded.
+    void set_xml_cache(std::string path) {
+        _xml_cache = std::move(path);
+    }
+
     void init_and_load();
     hwloc_topology_t get();
 };
@@ -117,6 +126,18 @@ struct io_queue_topology {
 struct cpu {
     unsigned cpu_id;
     std::vector<memory> mem;
+    // Index of the physical core, shared by SMT siblings
+    unsigned core_id = 0;
+};
+
+// Restrictions on the CPUs shards are placed on
+struct placement_policy {
+    // At most one CPU of each physical core
+    bool avoid_smt_siblings = false;
+    // Only the CPUs of the most performant kind, on hosts with cores of
+    // several kinds, or of as many of the most performant kinds as it
+    // takes for nr_shards
+    bool prefer_performance_cores = false;
 };
 
 struct resources {
@@ -126,6 +147,8 @@ struct resources {
 
 resources allocate(configuration& c);
 unsigned nr_processing_units(configuration& c);
+// The CPUs of cpus which shards may run on under the policy
+cpuset apply_placement_policy(configuration& c, cpuset cpus, const placement_policy& p, std::optional<unsigned> nr_shards);
 
 std::optional<resource::cpuset> parse_cpuset(std::string value);
 
@@ -22,6 +22,7 @@
 #pragma once
 
 #include <chrono>
+#include <optional>
 #include <typeindex>
 #include <seastar/core/sstring.hh>
 #include <seastar/core/function_traits.hh>
@@ -32,6 +33,9 @@
 namespace seastar {
 
 constexpr unsigned max_scheduling_groups() { return SEASTAR_SCHEDULING_GROUPS_COUNT; }
+/// Every supergroup holds at least one scheduling group, and the default
+/// group is in none
+constexpr unsigned max_scheduling_supergroups() { return max_scheduling_groups() - 1; }
 
 #if SEASTAR_API_LEVEL < 6
 #define SEASTAR_ELLIPSIS ...
@@ -45,6 +49,7 @@ class future;
 class reactor;
 
 class scheduling_group;
+class scheduling_supergroup;
 class scheduling_group_key;
 
 using sched_clock = std::chrono::steady_clock;
@@ -75,6 +80,20 @@ T* scheduling_group_get_specific_ptr(scheduling_group sg, scheduling_group_key k
 /// \return a scheduling group that can be used on any shard
 future<scheduling_group> create_scheduling_group(sstring name, float shares) noexcept;
 
+/// Creates a scheduling group in a supergroup.
+///
+/// The group divides the CPU time allotted to the supergroup with the
+/// other groups in it, by their shares, rather than competing for the CPU
+/// with the groups which are in no supergroup.
+///
+/// \param name A name that identifiers the group; will be used as a label
+///             in the group's metrics
+/// \param shares number of shares of the supergroup's CPU time allotted
+///              to the group
+/// \param parent a supergroup created with create_scheduling_supergroup()
+/// \return a scheduling group that can be used on any shard
+future<scheduling_group> create_scheduling_group(sstring name, float shares, scheduling_supergroup parent) noexcept;
+
 /// Destroys a scheduling group.
 ///
 /// Destroys a \ref scheduling_group previously created with create_scheduling_group().
@@ -286,7 +305,35 @@ class scheduling_group {
     /// \param shares number of shares allotted to the group. Use numbers
     ///               in the 1-1000 range.
     void set_shares(float shares) noexcept;
+    /// Allows work submitted from this group to run on sibling shards.
+    ///
+    /// Work submitted with \ref smp::submit_stealable() from a migratable group
+    /// may be picked up by an idle shard on the same NUMA node, and will run
+    /// there in this group. Work submitted from any other group always runs
+    /// on the submitting shard. The setting is local to the shard.
+    ///
+    /// \param migratable whether work from this group may be stolen
+    void set_migratable(bool migratable) noexcept;
+    /// Returns whether \ref set_migratable() was enabled for this group on this shard
+    bool is_migratable() const noexcept;
+    /// Caps the CPU time the group may use.
+    ///
+    /// Shares divide the CPU time between the groups which want it, so a
+    /// group with no competition gets all of it. A capped group is kept
+    /// off the CPU once it has used more than \c fraction of the time, on
+    /// average, even if nothing else wants the CPU, so that background
+    /// work does not fill the gaps of a bursty foreground load. The
+    /// setting is local to the shard.
+    ///
+    /// \param fraction of the shard's CPU time the group may use, in
+    ///                 (0, 1], or \c std::nullopt for no cap
+    void set_cpu_cap(std::optional<float> fraction) noexcept;
+    /// Returns the cap set with \ref set_cpu_cap() on this shard, if any
+    std::optional<float> cpu_cap() const noexcept;
+    /// Returns the supergroup the group was created in, or the top level
+    scheduling_supergroup supergroup() const noexcept;
     friend future<scheduling_group> create_scheduling_group(sstring name, float shares) noexcept;
+    friend future<scheduling_group> create_scheduling_group(sstring name, float shares, scheduling_supergroup parent) noexcept;
     friend future<> destroy_scheduling_group(scheduling_group sg) noexcept;
     friend future<> rename_scheduling_group(scheduling_group sg, sstring new_name) noexcept;
     friend class reactor;
@@ -310,6 +357,65 @@ class scheduling_group {
 
 };
 
+/// \brief A group of scheduling groups, which divide the CPU time it gets
+///
+/// Supergroups add a level to the division of CPU time. The supergroups,
+/// and the scheduling groups which are in none, divide the CPU time by
+/// their shares; the groups of a supergroup then divide its part of it by
+/// theirs. A service with several tenants can create a supergroup for each,
+/// and the groups of its workloads in it, so that a tenant with many busy
+/// workloads does not take CPU time from the others, the way the groups of
+/// a \ref fair_queue divide the capacity of a disk.
+///
+/// Supergroups hold no tasks themselves, and do not count against
+/// \ref max_scheduling_groups().
+class scheduling_supergroup {
+    unsigned _id;
+private:
+    explicit scheduling_supergroup(unsigned id) noexcept : _id(id) {}
+public:
+    /// Creates a `scheduling_supergroup` object denoting the top level,
+    /// where the groups created in no supergroup are
+    constexpr scheduling_supergroup() noexcept : _id(0) {}
+    bool operator==(scheduling_supergroup x) const noexcept { return _id == x._id; }
+    bool operator!=(scheduling_supergroup x) const noexcept { return _id != x._id; }
+    bool is_top_level() const noexcept { return _id == 0; }
+    /// Adjusts the number of shares allotted to the supergroup.
+    ///
+    /// The adjustment is local to the shard.
+    ///
+    /// \param shares number of shares allotted to the supergroup. Use
+    ///               numbers in the 1-1000 range.
+    void set_shares(float shares) noexcept;
+    /// Returns the number of shares allotted to the supergroup on this shard
+    float get_shares() const noexcept;
+    friend future<scheduling_supergroup> create_scheduling_supergroup(float shares) noexcept;
+    friend future<> destroy_scheduling_supergroup(scheduling_supergroup sg) noexcept;
+    friend future<scheduling_group> create_scheduling_group(sstring name, float shares, scheduling_supergroup parent) noexcept;
+    friend class scheduling_group;
+    friend class reactor;
+};
+
+/// Creates a scheduling supergroup with a specified number of shares.
+///
+/// The operation is global and affects all shards.
+///
+/// \param shares number of shares of the CPU time allotted to the
+///              supergroup, against the other supergroups and the groups
+///              which are in none; use numbers in the 1-1000 range
+/// \return a supergroup to create scheduling groups in, on any shard
+future<scheduling_supergroup> create_scheduling_supergroup(float shares) noexcept;
+
+/// Destroys a scheduling supergroup.
+///
+/// The groups created in it must have been destroyed first.
+///
+/// The operation is global and affects all shards.
+///
+/// \param sg The supergroup to be destroyed
+/// \return a future that is ready when the supergroup has been torn down
+future<> destroy_scheduling_supergroup(scheduling_supergroup sg) noexcept;
+
 /// \cond internal
 namespace internal {
 
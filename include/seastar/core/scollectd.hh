@@ -365,6 +365,24 @@ struct options : public program_options::option_group {
     program_options::value<unsigned> collectd_poll_period;
     /// \deprecated use \ref metrics::options::metrics_hostname instead
     program_options::value<std::string> collectd_hostname;
+    /// \brief Send aggregated values.
+    ///
+    /// Shard 0 sends the values of all shards, counters summed and gauges
+    /// averaged, with the plugin instance \p total, instead of each shard
+    /// sending its own.
+    /// Default: \p false.
+    program_options::value<bool> collectd_aggregate;
+    /// \brief Maximum packet size (bytes).
+    ///
+    /// As many values as fit are sent in each packet.
+    /// Default: \p 1452.
+    program_options::value<unsigned> collectd_packet_size;
+    /// \brief Poll period jitter (percent).
+    ///
+    /// Each send is advanced or delayed by up to this percentage of the
+    /// poll period, so that shards and nodes do not send at the same time.
+    /// Default: \p 10.
+    program_options::value<unsigned> collectd_poll_jitter;
 
     /// \cond internal
     options(program_options::option_group* parent_group);
@@ -61,11 +61,15 @@ template <class CharType> class output_stream;
 
 class server_socket;
 class socket;
+class abort_source;
 class connected_socket;
 class socket_address;
 struct listen_options;
 enum class transport;
 
+// posix.hh
+class file_desc;
+
 // file.hh
 class file;
 struct file_open_options;
@@ -132,11 +136,38 @@ future<connected_socket> connect(socket_address sa);
 ///
 /// \param sa socket address to connect to
 /// \param local socket address for local endpoint
-/// \param proto transport protocol (TCP or SCTP)
+/// \param proto transport protocol (TCP or SCTP; SEQPACKET for AF_UNIX
+///        SOCK_SEQPACKET sockets)
 ///
 /// \return a \ref connected_socket object, or an exception
 future<connected_socket> connect(socket_address sa, socket_address local, transport proto);
 
+/// Establishes a connection to a given address, unless an abort is
+/// requested first
+///
+/// Like \ref connect(socket_address, socket_address, transport), except that
+/// an abort requested from \c as stops the connection attempt, and the
+/// returned future then fails with the exception of the abort.
+///
+/// \param sa socket address to connect to
+/// \param local socket address for local endpoint
+/// \param proto transport protocol
+/// \param as abort source, which must outlive the returned future
+///
+/// \return a \ref connected_socket object, or an exception
+future<connected_socket> connect(socket_address sa, socket_address local, transport proto, abort_source& as);
+
+/// Makes a \ref connected_socket of the file descriptor of a connected
+/// socket, e.g. a connection another process passed over an AF_UNIX
+/// socket (see \ref connected_socket::dup_fd()), so that a restarted
+/// process takes over its predecessor's connections without dropping them.
+///
+/// The socket is handled as by the posix stack, whatever the network stack
+/// in use.
+///
+/// \param fd a connected TCP, SCTP or AF_UNIX socket
+connected_socket make_connected_socket(file_desc fd);
+
 
 /// Creates a socket object suitable for establishing stream-oriented connections
 ///
@@ -30,6 +30,13 @@
 #include <seastar/core/abortable_fifo.hh>
 #include <seastar/core/timed_out_error.hh>
 #include <seastar/core/abort_on_expiry.hh>
+#include <boost/intrusive/list.hpp>
+#include <array>
+#include <chrono>
+#include <memory>
+#ifdef SEASTAR_COROUTINES_ENABLED
+#   include <seastar/core/coroutine.hh>
+#endif
 
 namespace seastar {
 
@@ -125,6 +132,45 @@ struct named_semaphore_exception_factory {
     named_semaphore_aborted aborted() const noexcept;
 };
 
+/// Contention statistics of a semaphore, kept once enabled with
+/// \ref basic_semaphore::enable_stats().
+///
+/// To follow a semaphore in production, register them as metrics:
+///
+/// \code
+/// sem.enable_stats();
+/// _metrics.add_group("my_service", {
+///     sm::make_counter("sem_waits", [&sem] { return sem.stats()->waits; }, sm::description("Waits that had to queue")),
+///     sm::make_gauge("sem_max_queue_length", [&sem] { return sem.stats()->max_queue_length; }, sm::description("Longest wait queue seen")),
+/// });
+/// \endcode
+struct semaphore_stats {
+    // Bucket i counts waits of less than 2^i microseconds; the last one
+    // counts all longer waits
+    static constexpr size_t wait_time_buckets = 20;
+    /// Waits granted without queueing
+    uint64_t immediate = 0;
+    /// Waits that had to queue
+    uint64_t waits = 0;
+    /// Queued waits that were granted, and their total time in the queue
+    uint64_t granted = 0;
+    std::chrono::steady_clock::duration total_wait_time{};
+    std::array<uint64_t, wait_time_buckets> wait_time_histogram{};
+    /// The longest the wait queue got
+    size_t max_queue_length = 0;
+
+    void account_wait(std::chrono::steady_clock::duration d) noexcept {
+        ++granted;
+        total_wait_time += d;
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+        size_t bucket = 0;
+        while (bucket < wait_time_buckets - 1 && us >= (int64_t(1) << bucket)) {
+            ++bucket;
+        }
+        ++wait_time_histogram[bucket];
+    }
+};
+
 /// \brief Counted resource guard.
 ///
 /// This is a standard computer science semaphore, adapted
@@ -157,6 +203,10 @@ class basic_semaphore : private ExceptionFactory {
     struct entry {
         promise<> pr;
         size_t nr;
+        // Orders the entry with the coroutine waiters
+        uint64_t seq = 0;
+        // Only set with stats enabled
+        std::chrono::steady_clock::time_point queued;
         std::optional<abort_on_expiry<clock>> timer;
         entry(promise<>&& pr_, size_t nr_) noexcept : pr(std::move(pr_)), nr(nr_) {}
     };
@@ -185,11 +235,48 @@ class basic_semaphore : private ExceptionFactory {
         }
     };
     internal::abortable_fifo<entry, expiry_handler> _wait_list;
+
+    // A waiter of acquire(), which lives in the coroutine frame rather than
+    // in _wait_list, so that waiting does not allocate
+    struct coroutine_waiter : public boost::intrusive::list_base_hook<boost::intrusive::link_mode<boost::intrusive::auto_unlink>> {
+        size_t nr;
+        uint64_t seq = 0;
+        std::chrono::steady_clock::time_point queued;
+        explicit coroutine_waiter(size_t nr) noexcept : nr(nr) {}
+        virtual void wake(std::exception_ptr ex) noexcept = 0;
+    protected:
+        ~coroutine_waiter() = default;
+    };
+    boost::intrusive::list<coroutine_waiter, boost::intrusive::constant_time_size<false>> _coroutine_waiters;
+    // The order of the next waiter, across both queues
+    uint64_t _next_seq = 0;
+    std::unique_ptr<semaphore_stats> _stats;
+
     bool has_available_units(size_t nr) const noexcept {
         return _count >= 0 && (static_cast<size_t>(_count) >= nr);
     }
     bool may_proceed(size_t nr) const noexcept {
-        return has_available_units(nr) && _wait_list.empty();
+        return has_available_units(nr) && _wait_list.empty() && _coroutine_waiters.empty();
+    }
+    void account_immediate() noexcept {
+        if (_stats) [[unlikely]] {
+            ++_stats->immediate;
+        }
+    }
+    template <typename Waiter>
+    void account_queued(Waiter& w) noexcept {
+        w.seq = _next_seq++;
+        if (_stats) [[unlikely]] {
+            ++_stats->waits;
+            _stats->max_queue_length = std::max(_stats->max_queue_length, waiters());
+            w.queued = std::chrono::steady_clock::now();
+        }
+    }
+    template <typename Waiter>
+    void account_granted(const Waiter& w) noexcept {
+        if (_stats) [[unlikely]] {
+            _stats->account_wait(std::chrono::steady_clock::now() - w.queued);
+        }
     }
 public:
     /// Returns the maximum number of units the semaphore counter can hold
@@ -243,6 +330,7 @@ class basic_semaphore : private ExceptionFactory {
     future<> wait(time_point timeout, size_t nr = 1) noexcept {
         if (may_proceed(nr)) {
             _count -= nr;
+            account_immediate();
             return make_ready_future<>();
         }
         if (_ex) {
@@ -250,6 +338,7 @@ class basic_semaphore : private ExceptionFactory {
         }
         try {
             entry& e = _wait_list.emplace_back(promise<>(), nr);
+            account_queued(e);
             auto f = e.pr.get_future();
             if (timeout != time_point::max()) {
                 e.timer.emplace(timeout);
@@ -278,6 +367,7 @@ class basic_semaphore : private ExceptionFactory {
     future<> wait(abort_source& as, size_t nr = 1) noexcept {
         if (may_proceed(nr)) {
             _count -= nr;
+            account_immediate();
             return make_ready_future<>();
         }
         if (_ex) {
@@ -285,6 +375,7 @@ class basic_semaphore : private ExceptionFactory {
         }
         try {
             entry& e = _wait_list.emplace_back(promise<>(), nr);
+            account_queued(e);
             // taking future here since make_back_abortable may expire the entry
             auto f = e.pr.get_future();
             _wait_list.make_back_abortable(as);
@@ -310,6 +401,66 @@ class basic_semaphore : private ExceptionFactory {
     future<> wait(duration timeout, size_t nr = 1) noexcept {
         return wait(clock::now() + timeout, nr);
     }
+#ifdef SEASTAR_COROUTINES_ENABLED
+    struct [[nodiscard("must co_await an acquire() call")]] awaiter : public coroutine_waiter, private seastar::task {
+        basic_semaphore* _sem;
+        SEASTAR_INTERNAL_COROUTINE_NAMESPACE::coroutine_handle<void> _when_ready;
+        std::exception_ptr _ex;
+        task* _waiting_task = nullptr;
+
+        awaiter(basic_semaphore* sem, size_t nr) noexcept : coroutine_waiter(nr), _sem(sem) {}
+
+        bool await_ready() noexcept {
+            if (_sem->may_proceed(this->nr)) {
+                _sem->_count -= this->nr;
+                _sem->account_immediate();
+                return true;
+            }
+            if (_sem->_ex) {
+                _ex = _sem->_ex;
+                return true;
+            }
+            return false;
+        }
+        template<typename T>
+        void await_suspend(SEASTAR_INTERNAL_COROUTINE_NAMESPACE::coroutine_handle<T> h) noexcept {
+            _when_ready = h;
+            _waiting_task = &h.promise();
+            _sem->_coroutine_waiters.push_back(*this);
+            _sem->account_queued(*this);
+        }
+        void await_resume() {
+            if (_ex) {
+                std::rethrow_exception(std::move(_ex));
+            }
+        }
+        virtual void wake(std::exception_ptr ex) noexcept override {
+            _ex = std::move(ex);
+            schedule(this);
+        }
+        virtual void run_and_dispose() noexcept override {
+            _when_ready.resume();
+        }
+        virtual task* waiting_task() noexcept override {
+            return _waiting_task;
+        }
+    };
+
+    /// Coroutine/co_await only waiter.
+    /// Waits until at least a specific number of units are available in the
+    /// counter, and reduces the counter by that amount of units, like
+    /// \ref wait(size_t), but without allocating: the waiter is kept in the
+    /// coroutine frame. Queued in FIFO order along with other waits.
+    ///
+    /// \param nr Amount of units to wait for (default 1).
+    /// \return an awaitable that resumes when sufficient units are available.
+    ///         If the semaphore was \ref broken(), throws the exception it
+    ///         was broken with.
+    awaiter acquire(size_t nr = 1) noexcept {
+        return awaiter{this, nr};
+    }
+#endif
+
     /// Deposits a specified number of units into the counter.
     ///
     /// The counter is incremented by the specified number of units.
@@ -324,11 +475,31 @@ class basic_semaphore : private ExceptionFactory {
             return;
         }
         _count += nr;
-        while (!_wait_list.empty() && has_available_units(_wait_list.front().nr)) {
-            auto& x = _wait_list.front();
-            _count -= x.nr;
-            x.pr.set_value();
-            _wait_list.pop_front();
+        for (;;) {
+            // Serve whichever of the two queues has the older waiter
+            bool entry_first = !_wait_list.empty()
+                    && (_coroutine_waiters.empty() || _wait_list.front().seq < _coroutine_waiters.front().seq);
+            if (entry_first) {
+                auto& x = _wait_list.front();
+                if (!has_available_units(x.nr)) {
+                    break;
+                }
+                _count -= x.nr;
+                account_granted(x);
+                x.pr.set_value();
+                _wait_list.pop_front();
+            } else if (!_coroutine_waiters.empty()) {
+                auto& w = _coroutine_waiters.front();
+                if (!has_available_units(w.nr)) {
+                    break;
+                }
+                _count -= w.nr;
+                account_granted(w);
+                _coroutine_waiters.pop_front();
+                w.wake(nullptr);
+            } else {
+                break;
+            }
         }
     }
 
@@ -359,6 +530,7 @@ class basic_semaphore : private ExceptionFactory {
     bool try_wait(size_t nr = 1) noexcept {
         if (may_proceed(nr)) {
             _count -= nr;
+            account_immediate();
             return true;
         } else {
             return false;
@@ -376,7 +548,20 @@ class basic_semaphore : private ExceptionFactory {
     ssize_t available_units() const noexcept { return _count; }
 
     /// Returns the current number of waiters
-    size_t waiters() const noexcept { return _wait_list.size(); }
+    size_t waiters() const noexcept { return _wait_list.size() + _coroutine_waiters.size(); }
+
+    /// Starts keeping contention statistics, see \ref stats().
+    void enable_stats() {
+        if (!_stats) {
+            _stats = std::make_unique<semaphore_stats>();
+        }
+    }
+
+    /// Returns the contention statistics, or nullptr unless
+    /// \ref enable_stats() was called.
+    const semaphore_stats* stats() const noexcept {
+        return _stats.get();
+    }
 
     /// Signal to waiters that an error occurred.  \ref wait() will see
     /// an exceptional future<> containing a \ref broken_semaphore exception.
@@ -426,6 +611,11 @@ basic_semaphore<ExceptionFactory, Clock>::broken(std::exception_ptr xp) noexcept
         x.pr.set_exception(xp);
         _wait_list.pop_front();
     }
+    while (!_coroutine_waiters.empty()) {
+        auto& w = _coroutine_waiters.front();
+        _coroutine_waiters.pop_front();
+        w.wake(xp);
+    }
 }
 
 template<typename ExceptionFactory = semaphore_default_exception_factory, typename Clock = typename timer<>::clock>
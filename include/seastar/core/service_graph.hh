@@ -0,0 +1,132 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#pragma once
+
+#include <seastar/core/future.hh>
+#include <seastar/core/sharded.hh>
+#include <seastar/core/sstring.hh>
+#include <seastar/util/noncopyable_function.hh>
+#include <chrono>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace seastar {
+
+/// \addtogroup smp-module
+/// @{
+
+/// Starts and stops a set of services in the order of their dependencies.
+///
+/// Each service is added with the names of those it depends on; start()
+/// starts a service once all of its dependencies have started, so that
+/// services which do not depend on one another start concurrently, rather
+/// than one after the other as a sequence of \c start() calls would.
+/// stop() stops a service once all of the services which depend on it
+/// have stopped.
+///
+/// Typically used from the function passed to app_template::run():
+///
+/// \code
+/// service_graph g;
+/// g.add_sharded("storage", storage, {});
+/// g.add_sharded("cache", cache, {}, 1 << 30);
+/// g.add_sharded("server", server, {"storage", "cache"}, std::ref(storage), std::ref(cache));
+/// return g.start().then([&g] {
+///     ...
+/// }).finally([&g] {
+///     return g.stop();
+/// });
+/// \endcode
+class service_graph {
+public:
+    using start_func = noncopyable_function<future<> ()>;
+    using stop_func = noncopyable_function<future<> ()>;
+    using clock_type = std::chrono::steady_clock;
+private:
+    struct service {
+        sstring name;
+        std::vector<sstring> deps;
+        start_func start;
+        stop_func stop;
+        bool started = false;
+        std::optional<clock_type::duration> startup_time;
+    };
+    std::vector<service> _services;
+    // Indices into _services, dependencies first; set by start()
+    std::vector<size_t> _order;
+
+    std::vector<size_t> sorted() const;
+    future<> start_one(size_t idx);
+public:
+    service_graph() = default;
+    service_graph(service_graph&&) = delete;
+
+    /// Adds a service.
+    ///
+    /// \param name unique name of the service
+    /// \param deps names of the services which must be started before
+    ///        this one, and stopped after it
+    /// \param start starts the service
+    /// \param stop stops the service; only called if \c start succeeded
+    void add(sstring name, std::vector<sstring> deps, start_func start, stop_func stop);
+
+    /// Adds a sharded service, started with \ref sharded::start() and
+    /// the given constructor arguments, which are copied until then.
+    template <typename Service, typename... Args>
+    void add_sharded(sstring name, sharded<Service>& s, std::vector<sstring> deps, Args&&... args) {
+        add(std::move(name), std::move(deps),
+            [&s, args = std::tuple<std::decay_t<Args>...>(std::forward<Args>(args)...)] () mutable {
+                return std::apply([&s] (auto&&... a) {
+                    return s.start(std::move(a)...);
+                }, std::move(args));
+            },
+            [&s] {
+                return s.stop();
+            });
+    }
+
+    /// Starts all services.
+    ///
+    /// Fails with \c std::invalid_argument, without starting anything, if
+    /// a dependency is not a service of the graph or dependencies form a
+    /// cycle. If a service fails to start, the services which depend on
+    /// it are not started, those which did start are stopped, and the
+    /// returned future fails with the exception of a failed service.
+    future<> start();
+
+    /// Stops the services which were started, dependents first.
+    ///
+    /// All services are stopped even if some fail to; the returned future
+    /// then fails with the first exception.
+    future<> stop();
+
+    /// The time each service which started took to start, from when all
+    /// of its dependencies had started, in the order they were added.
+    std::vector<std::pair<sstring, clock_type::duration>> startup_times() const;
+};
+
+/// @}
+
+}
@@ -0,0 +1,268 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#pragma once
+
+#include <seastar/core/circular_buffer.hh>
+#include <seastar/core/future.hh>
+#include <seastar/core/gate.hh>
+#include <seastar/core/semaphore.hh>
+#include <seastar/core/smp.hh>
+#include <seastar/util/later.hh>
+#include <memory>
+#include <optional>
+#include <vector>
+
+/// \file
+
+namespace seastar {
+
+/// \addtogroup smp-module
+/// @{
+
+/// A stream of items from one shard to another.
+///
+/// smp::submit_to() sends a message for every call; streaming items
+/// through it means one message, and one reply, per item. A channel
+/// gathers the items pushed on the producer shard into batches, and sends
+/// each batch in a single smp message to the consumer shard, where they
+/// are queued for \ref pop(). Items are moved, never copied, so a
+/// \ref foreign_ptr crosses without touching what it points to.
+///
+/// The channel holds at most \c capacity items that have been pushed and not
+/// yet popped: the producer is held back by credits, which the consumer
+/// returns in batches as it pops items.
+///
+/// The channel object lives on the consumer shard; the producer gets a
+/// \ref sender with \ref make_sender() and moves it to its own shard.
+/// \ref pop() returns an empty optional once the sender is closed and all
+/// items have been popped; the channel must not be destroyed before then.
+///
+/// \tparam T the type of the items; must be movable across shards
+template <typename T>
+class shard_channel {
+    struct sender_state;
+public:
+    class sender;
+private:
+    size_t _capacity;
+    size_t _batch_size;
+    circular_buffer<T> _items;
+    std::optional<promise<>> _not_empty;
+    bool _eof = false;
+    // Known once the first batch arrives
+    sender_state* _sender = nullptr;
+    shard_id _sender_shard = 0;
+    // Popped, and not credited back yet
+    size_t _consumed = 0;
+    // Holds credit messages, which must land before the sender goes away
+    gate _credits_gate;
+
+    void receive(sender_state* s, shard_id shard, std::vector<T>&& batch) {
+        _sender = s;
+        _sender_shard = shard;
+        for (auto& item : batch) {
+            _items.push_back(std::move(item));
+        }
+        wake();
+    }
+
+    future<> close_sender() {
+        _eof = true;
+        wake();
+        return _credits_gate.close();
+    }
+
+    void wake() noexcept {
+        if (_not_empty) {
+            _not_empty->set_value();
+            _not_empty.reset();
+        }
+    }
+
+    void return_credits() noexcept {
+        if (_eof || !_consumed) {
+            return;
+        }
+        (void)with_gate(_credits_gate, [s = _sender, shard = _sender_shard, n = std::exchange(_consumed, 0)] {
+            return smp::submit_to(shard, [s, n] {
+                s->credits.signal(n);
+            });
+        });
+    }
+public:
+    /// Creates a channel to the current shard.
+    ///
+    /// \param capacity the number of items the channel holds before
+    ///                 \ref sender::push() waits
+    /// \param batch_size the number of items the sender gathers before sending
+    ///                 them; at most \c capacity
+    explicit shard_channel(size_t capacity, size_t batch_size = 16)
+        : _capacity(capacity)
+        , _batch_size(std::min(batch_size, capacity)) {
+        assert(capacity > 0 && batch_size > 0);
+    }
+
+    shard_channel(const shard_channel&) = delete;
+    shard_channel(shard_channel&&) = delete;
+
+    /// Returns the sending end of the channel, which the producer shard moves
+    /// to itself. A channel has a single sender.
+    sender make_sender() {
+        return sender(std::make_unique<sender_state>(this, this_shard_id(), _capacity, _batch_size));
+    }
+
+    /// Waits for the next item.
+    ///
+    /// \return the item, or an empty optional once the sender was closed and
+    ///         all its items popped
+    future<std::optional<T>> pop() {
+        if (_items.empty()) {
+            if (_eof) {
+                return make_ready_future<std::optional<T>>();
+            }
+            _not_empty.emplace();
+            return _not_empty->get_future().then([this] {
+                return pop();
+            });
+        }
+        std::optional<T> item(std::move(_items.front()));
+        _items.pop_front();
+        // Credits go back a batch at a time, or when the consumer caught up
+        if (++_consumed >= _batch_size || _items.empty()) {
+            return_credits();
+        }
+        return make_ready_future<std::optional<T>>(std::move(item));
+    }
+
+    /// Returns the number of items waiting to be popped
+    size_t size() const noexcept {
+        return _items.size();
+    }
+};
+
+template <typename T>
+struct shard_channel<T>::sender_state {
+    shard_channel* channel;
+    shard_id consumer;
+    size_t batch_size;
+    semaphore credits;
+    std::vector<T> batch;
+    bool flush_scheduled = false;
+    // Holds batches on their way, and the scheduled flush
+    gate flushes;
+
+    sender_state(shard_channel* channel, shard_id consumer, size_t capacity, size_t batch_size)
+        : channel(channel)
+        , consumer(consumer)
+        , batch_size(batch_size)
+        , credits(capacity) {
+        batch.reserve(batch_size);
+    }
+
+    future<> push(T&& item) {
+        if (!credits.try_wait(1)) {
+            // The consumer returns credits for items it got
+            flush();
+            return credits.wait(1).then([this, item = std::move(item)] () mutable {
+                add(std::move(item));
+            });
+        }
+        add(std::move(item));
+        return make_ready_future<>();
+    }
+
+    void add(T&& item) {
+        batch.push_back(std::move(item));
+        if (batch.size() >= batch_size) {
+            flush();
+        } else if (!flush_scheduled) {
+            // Sends what the producer pushes before it yields
+            flush_scheduled = true;
+            (void)with_gate(flushes, [this] {
+                return yield().then([this] {
+                    flush_scheduled = false;
+                    flush();
+                });
+            });
+        }
+    }
+
+    void flush() {
+        if (batch.empty()) {
+            return;
+        }
+        auto items = std::exchange(batch, {});
+        batch.reserve(batch_size);
+        // Messages between a pair of shards are processed in order, so
+        // batches arrive in the order they were sent
+        (void)with_gate(flushes, [this, items = std::move(items)] () mutable {
+            return smp::submit_to(consumer, [this, producer = this_shard_id(), items = std::move(items)] () mutable {
+                channel->receive(this, producer, std::move(items));
+            });
+        });
+    }
+
+    future<> close() {
+        flush();
+        return flushes.close().then([this] {
+            return smp::submit_to(consumer, [this] {
+                return channel->close_sender();
+            });
+        });
+    }
+};
+
+/// The sending end of a \ref shard_channel, for use on a single shard.
+template <typename T>
+class shard_channel<T>::sender {
+    std::unique_ptr<sender_state> _state;
+
+    explicit sender(std::unique_ptr<sender_state> state) noexcept : _state(std::move(state)) {}
+    friend class shard_channel;
+public:
+    sender(sender&&) noexcept = default;
+    sender& operator=(sender&&) noexcept = default;
+
+    /// Adds an item to the channel.
+    ///
+    /// Items are sent in batches: when a batch fills up, when the producer
+    /// yields, or when it has to wait. The returned future waits while the
+    /// channel is full. Only one push may wait at a time.
+    future<> push(T item) {
+        return _state->push(std::move(item));
+    }
+
+    /// Sends the items pushed so far without waiting for the batch to fill up
+    void flush() {
+        _state->flush();
+    }
+
+    /// Sends what is left and closes the channel. The sender must not be
+    /// destroyed before the returned future resolves.
+    future<> close() {
+        return _state->close();
+    }
+};
+
+/// @}
+
+}
@@ -31,6 +31,8 @@
 #include <seastar/util/log.hh>
 #include <boost/iterator/counting_iterator.hpp>
 #include <functional>
+#include <optional>
+#include <span>
 #if __has_include(<concepts>)
 #include <concepts>
 #endif
@@ -409,6 +411,55 @@ class sharded {
                             std::move(reduce));
     }
 
+    /// Applies a map function to all shards, then reduces the output in a tree
+    /// of shards.
+    ///
+    /// Like \ref map_reduce0(Mapper map, Initial initial, Reduce reduce), but
+    /// rather than having every shard's result sent to the calling shard, which
+    /// then reduces them all, shards reduce the results of a few others and pass
+    /// theirs on. On machines with many shards this takes the load off the
+    /// calling shard, and the reduction runs in parallel. Each NUMA node is a
+    /// subtree of its own, so only one result per node crosses nodes.
+    ///
+    /// \param map callable with the signature `Value (Service&)` or
+    ///               `future<Value> (Service&)`, where `Value` converts to
+    ///               \c Initial
+    /// \param initial initial value used as the first input to \c reduce
+    /// \param reduce binary function taking two \c Initial values and returning
+    ///               an \c Initial. It has to be associative and commutative, as
+    ///               the order in which results are combined is not specified.
+    /// \param fanout the largest number of subtrees a shard reduces the results
+    ///               of, with its own
+    ///
+    /// \c map and \c reduce stay on the calling shard, and are invoked on all
+    /// shards through a const reference, so they must not hold shard-local
+    /// state. Partial results are moved across shards.
+    ///
+    /// \return  Result of invoking `map` with each instance in parallel, reduced
+    ///          with \c initial by calling `reduce()`.
+    template <typename Mapper, typename Initial, typename Reduce>
+    inline
+    future<Initial>
+    tree_map_reduce0(Mapper map, Initial initial, Reduce reduce, unsigned fanout = 4) {
+        assert(fanout > 0);
+        return do_with(internal::make_shard_reduction_order(this_shard_id()), std::move(map), std::move(reduce),
+                [this, initial = std::move(initial), fanout] (internal::shard_reduction_order& order, const Mapper& map, const Reduce& reduce) mutable {
+            return ::seastar::map_reduce(boost::make_counting_iterator<size_t>(0),
+                                boost::make_counting_iterator<size_t>(order.node_starts.size() - 1),
+                [this, &order, &map, &reduce, fanout] (size_t node) {
+                    std::span<const shard_id> shards(order.shards.data() + order.node_starts[node],
+                                                     order.shards.data() + order.node_starts[node + 1]);
+                    return smp::submit_to(shards.front(), [this, &map, &reduce, shards, fanout] {
+                        return reduce_subtree<Initial>(map, reduce, shards, fanout);
+                    });
+                },
+                std::move(initial),
+                [&reduce] (Initial acc, Initial partial) {
+                    return Initial(std::invoke(reduce, std::move(acc), std::move(partial)));
+                });
+        });
+    }
+
     /// Applies a map function to all shards, and return a vector of the result.
     ///
     /// \param mapper callable with the signature `Value (Service&)` or
@@ -503,6 +554,42 @@ class sharded {
         return s;
     }
 
+    // Runs on shards.front(). Reduces the result of the local instance with
+    // those of subtrees over the rest of the shards, split into at most
+    // fanout contiguous parts.
+    template <typename Initial, typename Mapper, typename Reduce>
+    future<Initial> reduce_subtree(const Mapper& map, const Reduce& reduce, std::span<const shard_id> shards, unsigned fanout) {
+        auto rest = shards.subspan(1);
+        size_t parts = std::min<size_t>(fanout, rest.size());
+        // The subtrees go first, so that they run while the local instance is mapped
+        return ::seastar::map_reduce(boost::make_counting_iterator<size_t>(0),
+                            boost::make_counting_iterator<size_t>(parts + 1),
+            [this, &map, &reduce, rest, parts, fanout] (size_t i) -> future<Initial> {
+                if (i == parts) {
+                    return futurize_invoke([this, &map] {
+                        auto inst = get_local_service();
+                        return std::invoke(map, *inst);
+                    }).then([] (auto value) {
+                        return Initial(std::move(value));
+                    });
+                }
+                auto begin = i * rest.size() / parts;
+                auto subtree = rest.subspan(begin, (i + 1) * rest.size() / parts - begin);
+                return smp::submit_to(subtree.front(), [this, &map, &reduce, subtree, fanout] {
+                    return reduce_subtree<Initial>(map, reduce, subtree, fanout);
+                });
+            },
+            std::optional<Initial>(),
+            [&reduce] (std::optional<Initial> acc, Initial partial) {
+                if (!acc) {
+                    return std::optional<Initial>(std::move(partial));
+                }
+                return std::optional<Initial>(std::invoke(reduce, std::move(*acc), std::move(partial)));
+            }).then([] (std::optional<Initial> acc) {
+                return std::move(*acc);
+            });
+    }
+
     shared_ptr<Service> get_local_service() {
         auto inst = _instances[this_shard_id()].service;
         if (!inst) {
@@ -831,6 +918,8 @@ inline bool sharded<Service>::local_is_initialized() const noexcept {
 /// or similar, and remembers on what core this happened.
 /// When the \c foreign_ptr<> object is destroyed, it sends a message to
 /// the original core so that the wrapped object can be safely destroyed.
+/// Objects dropped together, such as the elements of a vector, go back to
+/// their core in one message (see \ref smp::submit_batched()).
 ///
 /// \c foreign_ptr<> is a move-only object; it cannot be copied.
 ///
@@ -844,8 +933,15 @@ class foreign_ptr {
     void destroy(PtrType p, unsigned cpu) noexcept {
         // `destroy()` is called from the destructor and other
         // synchronous methods (like `reset()`), that have no way to
-        // wait for this future.
-        (void)destroy_on(std::move(p), cpu);
+        // wait, so returns to the same shard can go in one message.
+        if (p && cpu != this_shard_id()) {
+            smp::submit_batched(cpu, [v = std::move(p)] () mutable {
+                // Destroy the contained pointer. We do this explicitly
+                // in the current shard, because the lambda is destroyed
+                // in the shard that submitted the task.
+                v = {};
+            });
+        }
     }
 
     static future<> destroy_on(PtrType p, unsigned cpu) noexcept {
@@ -0,0 +1,551 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+
+#pragma once
+
+#include <seastar/core/bitops.hh>
+#include <seastar/core/future.hh>
+#include <seastar/core/gate.hh>
+#include <seastar/core/lowres_clock.hh>
+#include <seastar/core/memory.hh>
+#include <seastar/core/metrics.hh>
+#include <seastar/core/metrics_registration.hh>
+#include <seastar/core/shared_future.hh>
+#include <seastar/core/sstring.hh>
+#include <seastar/util/noncopyable_function.hh>
+#include <boost/intrusive/list.hpp>
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+namespace seastar {
+
+/// \addtogroup smp-module
+/// @{
+
+/// Eviction policy of a \ref sharded_cache
+enum class cache_eviction {
+    /// Entries used since the clock hand last passed them get a second
+    /// chance; the cheapest, for sets of popular keys which change slowly
+    clock,
+    /// New entries go to a small LRU window, and from there to a segmented
+    /// LRU only if they are used more often than the entries they would
+    /// replace, so that scans and keys used once do not flush the cache
+    w_tinylfu,
+};
+
+/// Options for \ref sharded_cache
+struct sharded_cache_options {
+    /// Memory the cache may hold on each shard, as counted by its entry
+    /// sizer; 0 for 5% of the shard's memory
+    size_t memory_limit = 0;
+    cache_eviction eviction = cache_eviction::w_tinylfu;
+    /// If set, entries expire this long after they are inserted
+    std::optional<lowres_clock::duration> ttl;
+    /// Priority of the cache's \ref memory::reclaimer
+    int reclaimer_priority = 0;
+    /// If not empty, the statistics of the cache are exported as metrics of
+    /// the \c cache group, labeled with this name
+    sstring metrics_name;
+};
+
+namespace internal {
+
+// Approximate access counts of keys, by hash, in a count-min sketch of
+// saturating counters, all halved once there were ten increments per
+// counter of a row, so that old accesses weigh less
+class frequency_sketch {
+    static constexpr unsigned depth = 4;
+    static constexpr uint8_t max_count = 15;
+    std::vector<uint8_t> _counters;
+    unsigned _shift = 64;
+    size_t _additions = 0;
+    size_t _sample_size = 0;
+
+    size_t index(size_t hash, unsigned row) const noexcept {
+        static constexpr std::array<uint64_t, depth> seeds = {
+            0x9e3779b97f4a7c15ull, 0xc2b2ae3d27d4eb4full, 0x165667b19e3779f9ull, 0xd6e8feb86659fd93ull,
+        };
+        return row * width() + ((uint64_t(hash) * seeds[row]) >> _shift);
+    }
+    void age() noexcept {
+        for (auto& c : _counters) {
+            c >>= 1;
+        }
+        _additions /= 2;
+    }
+public:
+    size_t width() const noexcept {
+        return _counters.size() / depth;
+    }
+
+    /// Sizes the sketch for about \c n keys, forgetting the counts
+    void resize(size_t n) {
+        auto bits = std::max(6u, log2ceil(std::max<size_t>(n, 1)));
+        _counters.assign(size_t(depth) << bits, 0);
+        _shift = 64 - bits;
+        _additions = 0;
+        _sample_size = size_t(10) << bits;
+    }
+
+    void increment(size_t hash) noexcept {
+        if (_counters.empty()) {
+            return;
+        }
+        bool added = false;
+        for (unsigned r = 0; r < depth; r++) {
+            auto& c = _counters[index(hash, r)];
+            if (c < max_count) {
+                c++;
+                added = true;
+            }
+        }
+        if (added && ++_additions >= _sample_size) {
+            age();
+        }
+    }
+
+    unsigned frequency(size_t hash) const noexcept {
+        if (_counters.empty()) {
+            return 0;
+        }
+        unsigned f = max_count;
+        for (unsigned r = 0; r < depth; r++) {
+            f = std::min<unsigned>(f, _counters[index(hash, r)]);
+        }
+        return f;
+    }
+};
+
+}
+
+/// A memory-bounded cache for the shards of a sharded service.
+///
+/// Each shard has its own instance, either as a member of its instance of
+/// the service, or with \c sharded<sharded_cache<Key,Value>> started with
+/// the options; entries are not shared between shards.
+///
+/// Entries are accounted for by the size the \c sizer returns, and evicted
+/// by the policy of \ref sharded_cache_options::eviction once they go over
+/// the memory limit. They are also dropped when the allocator runs low on
+/// memory, through a \ref memory::reclaimer, and when they expire, if the
+/// cache has a TTL, on their next lookup.
+///
+/// get_or_load() loads values on misses; concurrent misses of the same key
+/// wait for a single load. A value loaded while the key is inserted or
+/// erased is returned to the waiters, but not cached, since it may be
+/// stale.
+///
+/// Values are returned by copy, so they are typically shared pointers.
+/// Not movable: the reclaimer and loads in flight refer to it; stop() must
+/// be called before it is destroyed if loads may be in flight.
+template <typename Key, typename Value, typename Hash = std::hash<Key>, typename KeyEqual = std::equal_to<Key>>
+class sharded_cache {
+public:
+    using clock_type = lowres_clock;
+    /// Returns the memory an entry holds
+    using entry_sizer = noncopyable_function<size_t (const Key&, const Value&)>;
+
+    struct stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;        ///< lookups which found no entry
+        uint64_t coalesced = 0;     ///< misses which waited for a load already in flight
+        uint64_t loads = 0;         ///< loads started by misses
+        uint64_t evictions = 0;     ///< entries dropped to stay within the memory limit
+        uint64_t rejections = 0;    ///< new entries not admitted, as used less often than the ones they would replace
+        uint64_t reclaimed = 0;     ///< entries dropped on request of the memory allocator
+        uint64_t expirations = 0;   ///< entries dropped because their TTL passed
+        size_t bytes = 0;           ///< memory held by entries
+    };
+private:
+    // With CLOCK all entries are in the window, whose front is the hand
+    enum segment : uint8_t { window, probation, protect, nr_segments };
+
+    struct entry : public boost::intrusive::list_base_hook<> {
+        Key key;
+        Value value;
+        size_t size;
+        clock_type::time_point expiry;
+        segment seg = window;
+        bool referenced = false;
+
+        entry(Key k, Value v, size_t s, clock_type::time_point e)
+            : key(std::move(k)), value(std::move(v)), size(s), expiry(e) {}
+    };
+    using list_type = boost::intrusive::list<entry, boost::intrusive::constant_time_size<false>>;
+
+    struct pending_load {
+        shared_future<Value> value;
+        // Inserted or erased while loading: the value may be stale
+        bool invalidated = false;
+    };
+
+    sharded_cache_options _opts;
+    entry_sizer _sizer;
+    size_t _limit;
+    std::unordered_map<Key, std::unique_ptr<entry>, Hash, KeyEqual> _entries;
+    // Least recently used first
+    std::array<list_type, nr_segments> _lists;
+    std::array<size_t, nr_segments> _segment_bytes = {};
+    internal::frequency_sketch _sketch;
+    std::unordered_map<Key, pending_load, Hash, KeyEqual> _loading;
+    stats _stats;
+    gate _gate;
+    memory::reclaimer _reclaimer;
+    metrics::metric_groups _metrics;
+
+    // The entry and its node of the hash table
+    static size_t default_size(const Key&, const Value&) noexcept {
+        return sizeof(entry) + sizeof(typename decltype(_entries)::value_type) + 2 * sizeof(void*);
+    }
+
+    size_t hash(const Key& k) const {
+        return _entries.hash_function()(k);
+    }
+    size_t window_limit() const noexcept {
+        return _limit / 100;
+    }
+    size_t main_limit() const noexcept {
+        return _limit - window_limit();
+    }
+    size_t protected_limit() const noexcept {
+        return main_limit() / 5 * 4;
+    }
+
+    void link(entry& e, segment s) noexcept {
+        e.seg = s;
+        _lists[s].push_back(e);
+        _segment_bytes[s] += e.size;
+    }
+    void unlink(entry& e) noexcept {
+        auto& l = _lists[e.seg];
+        l.erase(l.iterator_to(e));
+        _segment_bytes[e.seg] -= e.size;
+    }
+    void erase_entry(entry& e) noexcept {
+        auto it = _entries.find(e.key);
+        unlink(e);
+        _stats.bytes -= e.size;
+        _entries.erase(it);
+    }
+
+    void touch(entry& e) noexcept {
+        if (_opts.eviction == cache_eviction::clock) {
+            e.referenced = true;
+            return;
+        }
+        auto s = e.seg == window ? window : protect;
+        unlink(e);
+        link(e, s);
+        // Promoted entries push the least recently used protected ones
+        // back to probation
+        auto& p = _lists[protect];
+        while (_segment_bytes[protect] > protected_limit() && &p.front() != &e) {
+            auto& d = p.front();
+            unlink(d);
+            link(d, probation);
+        }
+    }
+
+    entry* victim() noexcept {
+        if (_opts.eviction == cache_eviction::clock) {
+            auto& l = _lists[window];
+            while (!l.empty()) {
+                auto& e = l.front();
+                if (!e.referenced) {
+                    return &e;
+                }
+                e.referenced = false;
+                l.pop_front();
+                l.push_back(e);
+            }
+            return nullptr;
+        }
+        for (auto s : {probation, window, protect}) {
+            if (!_lists[s].empty()) {
+                return &_lists[s].front();
+            }
+        }
+        return nullptr;
+    }
+
+    void evict() noexcept {
+        if (_opts.eviction == cache_eviction::w_tinylfu) {
+            // Entries leaving the window are admitted to the main space if
+            // it has room for them, or if they are used more often than the
+            // entries they replace; the newest entry stays in the window
+            auto& w = _lists[window];
+            while (_segment_bytes[window] > window_limit() && &w.front() != &w.back()) {
+                auto& c = w.front();
+                unlink(c);
+                auto freq = _sketch.frequency(hash(c.key));
+                bool admit = true;
+                while (_segment_bytes[probation] + _segment_bytes[protect] + c.size > main_limit()) {
+                    auto& l = _lists[_lists[probation].empty() ? protect : probation];
+                    if (l.empty()) {
+                        break;
+                    }
+                    if (freq <= _sketch.frequency(hash(l.front().key))) {
+                        admit = false;
+                        break;
+                    }
+                    erase_entry(l.front());
+                    _stats.evictions++;
+                }
+                link(c, probation);
+                if (!admit) {
+                    erase_entry(c);
+                    _stats.rejections++;
+                }
+            }
+        }
+        while (_stats.bytes > _limit) {
+            auto e = victim();
+            if (!e) {
+                break;
+            }
+            erase_entry(*e);
+            _stats.evictions++;
+        }
+    }
+
+    memory::reclaiming_result reclaim(size_t bytes) noexcept {
+        size_t freed = 0;
+        while (freed < bytes) {
+            auto e = victim();
+            if (!e) {
+                break;
+            }
+            freed += e->size;
+            erase_entry(*e);
+            _stats.reclaimed++;
+        }
+        return freed ? memory::reclaiming_result::reclaimed_something : memory::reclaiming_result::reclaimed_nothing;
+    }
+
+    entry* lookup(const Key& k) noexcept {
+        if (_opts.eviction == cache_eviction::w_tinylfu) {
+            _sketch.increment(hash(k));
+        }
+        auto it = _entries.find(k);
+        if (it == _entries.end()) {
+            return nullptr;
+        }
+        auto& e = *it->second;
+        if (_opts.ttl && e.expiry <= clock_type::now()) {
+            erase_entry(e);
+            _stats.expirations++;
+            return nullptr;
+        }
+        touch(e);
+        return &e;
+    }
+
+    void invalidate_load(const Key& k) noexcept {
+        auto it = _loading.find(k);
+        if (it != _loading.end()) {
+            it->second.invalidated = true;
+        }
+    }
+
+    void do_insert(Key k, Value v) {
+        auto size = _sizer(k, v);
+        auto it = _entries.find(k);
+        if (it != _entries.end()) {
+            erase_entry(*it->second);
+        }
+        if (size > _limit) {
+            _stats.rejections++;
+            return;
+        }
+        auto expiry = _opts.ttl ? clock_type::now() + *_opts.ttl : clock_type::time_point::max();
+        it = _entries.try_emplace(k).first;
+        try {
+            it->second = std::make_unique<entry>(std::move(k), std::move(v), size, expiry);
+        } catch (...) {
+            _entries.erase(it);
+            throw;
+        }
+        _stats.bytes += size;
+        link(*it->second, window);
+        if (_opts.eviction == cache_eviction::w_tinylfu && _entries.size() > _sketch.width()) {
+            _sketch.resize(_entries.size() * 2);
+        }
+        evict();
+    }
+
+public:
+    /// \param sizer returns the memory an entry holds; by default that of
+    ///        its bookkeeping only, for keys and values which do not
+    ///        allocate
+    explicit sharded_cache(sharded_cache_options opts = {}, entry_sizer sizer = default_size)
+        : _opts(std::move(opts))
+        , _sizer(std::move(sizer))
+        , _limit(_opts.memory_limit ? _opts.memory_limit : memory::stats().total_memory() / 20)
+        , _reclaimer([this] (memory::reclaimer::request r) { return reclaim(r.bytes_to_reclaim); },
+                memory::reclaimer_scope::sync, _opts.reclaimer_priority)
+    {
+        if (_opts.eviction == cache_eviction::w_tinylfu) {
+            _sketch.resize(64);
+        }
+        if (!_opts.metrics_name.empty()) {
+            namespace sm = seastar::metrics;
+            auto l = sm::label_instance("cache", _opts.metrics_name);
+            _metrics.add_group("cache", {
+                sm::make_counter("hits", _stats.hits, sm::description("Total lookups which found an entry"), {l}),
+                sm::make_counter("misses", _stats.misses, sm::description("Total lookups which found no entry"), {l}),
+                sm::make_counter("coalesced_misses", _stats.coalesced,
+                        sm::description("Total misses which waited for a load of the same key already in flight"), {l}),
+                sm::make_counter("loads", _stats.loads, sm::description("Total loads of values started by misses"), {l}),
+                sm::make_counter("evictions", _stats.evictions, sm::description("Total entries dropped to stay within the memory limit"), {l}),
+                sm::make_counter("rejections", _stats.rejections,
+                        sm::description("Total new entries not admitted, as used less often than the ones they would replace"), {l}),
+                sm::make_counter("reclaimed", _stats.reclaimed, sm::description("Total entries dropped on request of the memory allocator"), {l}),
+                sm::make_counter("expirations", _stats.expirations, sm::description("Total entries dropped because their TTL passed"), {l}),
+                sm::make_gauge("entries", [this] { return _entries.size(); }, sm::description("Entries in the cache"), {l}),
+                sm::make_gauge("bytes", _stats.bytes, sm::description("Memory held by the entries of the cache"), {l}),
+                sm::make_gauge("hit_ratio", [this] {
+                    auto lookups = _stats.hits + _stats.misses;
+                    return lookups ? double(_stats.hits) / lookups : 0.0;
+                }, sm::description("Fraction of the lookups which found an entry"), {l}),
+            });
+        }
+    }
+    sharded_cache(sharded_cache&&) = delete;
+
+    ~sharded_cache() {
+        clear();
+    }
+
+    /// Returns the value of the key, if cached
+    std::optional<Value> find(const Key& k) {
+        auto e = lookup(k);
+        if (!e) {
+            _stats.misses++;
+            return std::nullopt;
+        }
+        _stats.hits++;
+        return e->value;
+    }
+
+    /// Returns the value of the key, calling \c load, which returns a
+    /// \c future<Value>, to load and cache it if it is not cached and is
+    /// not being loaded already. A failed load is not cached.
+    template <typename Func>
+    future<Value> get_or_load(const Key& k, Func&& load) {
+        if (auto e = lookup(k)) {
+            _stats.hits++;
+            return make_ready_future<Value>(e->value);
+        }
+        _stats.misses++;
+        if (auto it = _loading.find(k); it != _loading.end()) {
+            _stats.coalesced++;
+            return it->second.value.get_future();
+        }
+        if (_gate.is_closed()) {
+            return make_exception_future<Value>(gate_closed_exception());
+        }
+        _stats.loads++;
+        auto it = _loading.emplace(k, pending_load{shared_future<Value>(futurize_invoke(std::forward<Func>(load), k))}).first;
+        // Registered first, so that the value is cached by the time the
+        // waiters see it
+        (void)it->second.value.get_future().then_wrapped([this, k, h = _gate.hold()] (future<Value> f) {
+            auto it = _loading.find(k);
+            auto invalidated = it->second.invalidated;
+            _loading.erase(it);
+            if (f.failed()) {
+                f.ignore_ready_future();
+            } else if (!invalidated) {
+                try {
+                    do_insert(k, f.get());
+                } catch (...) {
+                    // Not cached; the waiters have the value
+                }
+            }
+        });
+        return it->second.value.get_future();
+    }
+
+    /// Caches the value of the key, replacing the previous one
+    void insert(Key k, Value v) {
+        if (_opts.eviction == cache_eviction::w_tinylfu) {
+            _sketch.increment(hash(k));
+        }
+        invalidate_load(k);
+        do_insert(std::move(k), std::move(v));
+    }
+
+    /// Drops the key; returns whether it was cached
+    bool erase(const Key& k) noexcept {
+        invalidate_load(k);
+        auto it = _entries.find(k);
+        if (it == _entries.end()) {
+            return false;
+        }
+        erase_entry(*it->second);
+        return true;
+    }
+
+    /// Drops all entries
+    void clear() noexcept {
+        for (auto& [k, l] : _loading) {
+            l.invalidated = true;
+        }
+        for (auto& l : _lists) {
+            l.clear();
+        }
+        _segment_bytes = {};
+        _entries.clear();
+        _stats.bytes = 0;
+    }
+
+    /// Sets the memory limit, evicting entries over it; 0 for 5% of the
+    /// shard's memory
+    void set_memory_limit(size_t bytes) noexcept {
+        _limit = bytes ? bytes : memory::stats().total_memory() / 20;
+        evict();
+    }
+
+    /// Number of entries
+    size_t size() const noexcept {
+        return _entries.size();
+    }
+
+    const stats& get_stats() const noexcept {
+        return _stats;
+    }
+
+    /// Waits for the loads in flight; later misses fail with
+    /// \ref gate_closed_exception instead of loading
+    future<> stop() {
+        return _gate.close();
+    }
+};
+
+/// @}
+
+}
@@ -25,6 +25,8 @@
 #include <seastar/core/future.hh>
 #include <seastar/core/abortable_fifo.hh>
 #include <seastar/core/abort_on_expiry.hh>
+#include <seastar/core/make_task.hh>
+#include <seastar/core/internal/wakeup_batch.hh>
 #include <seastar/core/timed_out_error.hh>
 
 namespace seastar {
@@ -138,22 +140,36 @@ class shared_future {
         explicit shared_state(future_type f) noexcept : _original_future(std::move(f)) { }
         void resolve(future_type&& f) noexcept {
             _original_future = std::move(f);
+            if (_peers) {
+                internal::get_wakeup_stats().wakeups++;
+                resolve_peers();
+            }
+        }
+
+        // Resolves the peers in batches, see internal::continue_wakeups()
+        void resolve_peers() noexcept {
             auto& state = _original_future._state;
-            if (_original_future.failed()) {
-                while (_peers) {
-                    _peers.front().pr.set_exception(state.get_exception());
-                    _peers.pop_front();
-                }
-            } else {
-                while (_peers) {
-                    auto& p = _peers.front().pr;
+            unsigned n = 0;
+            for (; _peers && internal::continue_wakeups(n); ++n) {
+                auto& p = _peers.front().pr;
+                if (_original_future.failed()) {
+                    p.set_exception(state.get_exception());
+                } else {
                     try {
                         p.set_value(state.get_value());
                     } catch (...) {
                         p.set_exception(std::current_exception());
                     }
-                    _peers.pop_front();
                 }
+                _peers.pop_front();
+            }
+            internal::get_wakeup_stats().waiters += n;
+            if (_peers) {
+                internal::get_wakeup_stats().deferred_batches++;
+                memory::scoped_critical_alloc_section _;
+                schedule(make_task([s = this->shared_from_this()] {
+                    s->resolve_peers();
+                }));
             }
         }
 
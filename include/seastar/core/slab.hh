@@ -26,6 +26,7 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <assert.h>
+#include <array>
 #include <memory>
 #include <vector>
 #include <algorithm>
@@ -126,43 +127,92 @@ struct slab_page_desc {
 
 class slab_item_base {
     boost::intrusive::list_member_hook<> _lru_link;
+    // The segment of the LRU of its slab class the item is in, and whether
+    // it was used since it got there.
+    uint8_t _lru_segment = 0;
+    bool _active = false;
 
     template<typename Item>
     friend class slab_class;
 };
 
+/*
+ * The LRU of a slab class is segmented: new items go to the hot segment,
+ * and age to the warm one if they are used while there, or to the cold
+ * one otherwise; items of the warm segment which go unused age to the cold
+ * one, and cold items which are used go back to the warm one. Evictions
+ * take cold items first, so that items which are used once, such as those
+ * of a scan, don't push out those which are used again and again.
+ */
+enum class slab_lru_segment : uint8_t {
+    hot,
+    warm,
+    cold,
+};
+
 template<typename Item>
 class slab_class {
 private:
     boost::intrusive::list<slab_page_desc,
         boost::intrusive::member_hook<slab_page_desc, boost::intrusive::list_member_hook<>,
         &slab_page_desc::_free_pages_link>> _free_slab_pages;
-    boost::intrusive::list<slab_item_base,
+    using lru_type = boost::intrusive::list<slab_item_base,
         boost::intrusive::member_hook<slab_item_base, boost::intrusive::list_member_hook<>,
-        &slab_item_base::_lru_link>> _lru;
+        &slab_item_base::_lru_link>>;
+    static constexpr unsigned hot = unsigned(slab_lru_segment::hot);
+    static constexpr unsigned warm = unsigned(slab_lru_segment::warm);
+    static constexpr unsigned cold = unsigned(slab_lru_segment::cold);
+    // Shares of the items of the class, in percent, beyond which items age
+    static constexpr size_t hot_percent = 20;
+    static constexpr size_t warm_percent = 40;
+    // Items aged with each item created
+    static constexpr size_t age_per_create = 2;
+    std::array<lru_type, 3> _lru;
     size_t _size; // size of objects
     uint8_t _slab_class_id;
+    size_t _pages = 0;
+    uint64_t _evictions = 0;
+    // Evictions since the allocator last looked for a page to move
+    uint64_t _recent_evictions = 0;
 private:
+    static slab_item_base& base(Item* item) {
+        return reinterpret_cast<slab_item_base&>(*item);
+    }
+
+    void link(slab_item_base& item, unsigned segment) {
+        item._lru_segment = segment;
+        _lru[segment].push_front(item);
+    }
+
+    void unlink(slab_item_base& item) {
+        auto& lru = _lru[item._lru_segment];
+        lru.erase(lru.iterator_to(item));
+    }
+
     template<typename... Args>
     inline
     Item* create_item(void *object, uint32_t slab_page_index, Args&&... args) {
         Item *new_item = new(object) Item(slab_page_index, std::forward<Args>(args)...);
-        _lru.push_front(reinterpret_cast<slab_item_base&>(*new_item));
+        link(base(new_item), hot);
+        age(age_per_create);
         return new_item;
     }
 
     inline
     std::pair<void *, uint32_t> evict_lru_item(std::function<void (Item& item_ref)>& erase_func) {
-        if (_lru.empty()) {
+        auto segment = std::find_if(_lru.rbegin(), _lru.rend(), [] (const lru_type& lru) { return !lru.empty(); });
+        if (segment == _lru.rend()) {
             return { nullptr, 0U };
         }
 
-        Item& victim = reinterpret_cast<Item&>(_lru.back());
+        Item& victim = reinterpret_cast<Item&>(segment->back());
         uint32_t index = victim.get_slab_page_index();
         assert(victim.is_unlocked());
-        _lru.erase(_lru.iterator_to(reinterpret_cast<slab_item_base&>(victim)));
+        segment->pop_back();
         // WARNING: You need to make sure that erase_func will not release victim back to slab.
         erase_func(victim);
+        _evictions++;
+        _recent_evictions++;
 
         return { reinterpret_cast<void*>(&victim), index };
     }
@@ -175,7 +225,9 @@ class slab_class {
     slab_class(slab_class&&) = default;
     ~slab_class() {
         _free_slab_pages.clear();
-        _lru.clear();
+        for (auto& lru : _lru) {
+            lru.clear();
+        }
     }
 
     size_t size() const {
@@ -187,7 +239,49 @@ class slab_class {
     }
 
     bool has_no_slab_pages() const {
-        return _lru.empty();
+        return items() == 0;
+    }
+
+    // Items in the LRU, which leaves out those which are locked
+    size_t items() const {
+        return _lru[hot].size() + _lru[warm].size() + _lru[cold].size();
+    }
+
+    size_t items(slab_lru_segment segment) const {
+        return _lru[unsigned(segment)].size();
+    }
+
+    size_t pages() const {
+        return _pages;
+    }
+
+    uint64_t evictions() const {
+        return _evictions;
+    }
+
+    /**
+     * Ages up to n items from the tails of the hot and warm segments, as
+     * long as these hold more than their share of the items.
+     *
+     * \return the number of items aged
+     */
+    size_t age(size_t n) {
+        auto total = items();
+        size_t aged = 0;
+        for (; aged < n && _lru[hot].size() * 100 > total * hot_percent; aged++) {
+            auto& item = _lru[hot].back();
+            _lru[hot].pop_back();
+            link(item, item._active ? warm : cold);
+            item._active = false;
+        }
+        for (; aged < n && _lru[warm].size() * 100 > total * warm_percent; aged++) {
+            auto& item = _lru[warm].back();
+            _lru[warm].pop_back();
+            // Items used again stay warm, for another round
+            link(item, item._active ? warm : cold);
+            item._active = false;
+        }
+        return aged;
     }
 
     template<typename... Args>
@@ -224,8 +318,12 @@ class slab_class {
             throw std::bad_alloc{};
         }
 
-        _free_slab_pages.push_front(*desc);
+        // A page of a single object has none left
+        if (!desc->empty()) {
+            _free_slab_pages.push_front(*desc);
+        }
         insert_slab_page_desc(*desc);
+        _pages++;
 
         // first object from the allocated slab page is returned.
         return create_item(slab_page, slab_page_index, std::forward<Args>(args)...);
@@ -242,7 +340,7 @@ class slab_class {
 
     void free_item(Item *item, slab_page_desc& desc) {
         void *object = item;
-        _lru.erase(_lru.iterator_to(reinterpret_cast<slab_item_base&>(*item)));
+        unlink(base(item));
         desc.free_object(object);
         if (desc.size() == 1) {
             // push back desc into the list of slab pages with free objects.
@@ -251,25 +349,44 @@ class slab_class {
     }
 
     void touch_item(Item *item) {
-        auto& item_ref = reinterpret_cast<slab_item_base&>(*item);
-        _lru.erase(_lru.iterator_to(item_ref));
-        _lru.push_front(item_ref);
+        auto& item_ref = base(item);
+        // Locked items are out of the LRU, and go back to their segment
+        if (item_ref._lru_segment == cold && item_ref._lru_link.is_linked()) {
+            unlink(item_ref);
+            link(item_ref, warm);
+        } else {
+            item_ref._active = true;
+        }
     }
 
     void remove_item_from_lru(Item *item) {
-        auto& item_ref = reinterpret_cast<slab_item_base&>(*item);
-        _lru.erase(_lru.iterator_to(item_ref));
+        unlink(base(item));
     }
 
     void insert_item_into_lru(Item *item) {
-        auto& item_ref = reinterpret_cast<slab_item_base&>(*item);
-        _lru.push_front(item_ref);
+        auto& item_ref = base(item);
+        link(item_ref, item_ref._lru_segment);
     }
 
     void remove_desc_from_free_list(slab_page_desc& desc) {
         assert(desc.slab_class_id() == _slab_class_id);
         _free_slab_pages.erase(_free_slab_pages.iterator_to(desc));
     }
+
+    void add_slab_page(slab_page_desc& desc) {
+        assert(desc.slab_class_id() == _slab_class_id);
+        _free_slab_pages.push_back(desc);
+        _pages++;
+    }
+
+    void remove_slab_page() {
+        _pages--;
+    }
+
+    // Evictions since the last call
+    uint64_t take_recent_evictions() {
+        return std::exchange(_recent_evictions, 0);
+    }
 };
 
 template<typename Item>
@@ -289,7 +406,8 @@ class slab_allocator {
     struct collectd_stats {
         uint64_t allocs;
         uint64_t frees;
-    } _stats;
+        uint64_t page_moves;
+    } _stats{};
     memory::reclaimer *_reclaimer = nullptr;
     bool _reclaimed = false;
 private:
@@ -302,9 +420,27 @@ class slab_allocator {
         }
         // get descriptor of the least-recently-used slab page and related info.
         auto& desc = _slab_page_desc_lru.back();
+        void *slab_page = desc.slab_page();
+        // remove desc from the list of slab page descriptors.
+        _slab_page_desc_lru.erase(_slab_page_desc_lru.iterator_to(desc));
+        // remove desc from the slab page vector.
+        _slab_pages_vector[desc.index()] = nullptr;
+        erase_slab_page_items(desc);
+#ifdef SEASTAR_DEBUG
+        printf("lru slab page eviction succeeded! desc_empty?=%d\n", desc.empty());
+#endif
+        ::free(slab_page); // free slab page object
+        delete &desc; // free its descriptor
+        return memory::reclaiming_result::reclaimed_something;
+    }
+
+    /*
+     * Erases the items of a slab page, which has none locked, and takes it
+     * away from its slab class.
+     */
+    void erase_slab_page_items(slab_page_desc& desc) {
         assert(desc.refcnt() == 0);
-        uint8_t slab_class_id = desc.slab_class_id();
-        auto slab_class = get_slab_class(slab_class_id);
+        auto slab_class = get_slab_class(desc.slab_class_id());
         void *slab_page = desc.slab_page();
 
         auto& free_objects = desc.free_objects();
@@ -314,10 +450,6 @@ class slab_allocator {
             // and sort the array of free objects for binary search later on.
             std::sort(free_objects.begin(), free_objects.end());
         }
-        // remove desc from the list of slab page descriptors.
-        _slab_page_desc_lru.erase(_slab_page_desc_lru.iterator_to(desc));
-        // remove desc from the slab page vector.
-        _slab_pages_vector[desc.index()] = nullptr;
 
         // Iterate through objects in the slab page and if the object is an allocated
         // item, the item should be removed from LRU and then erased.
@@ -338,12 +470,7 @@ class slab_allocator {
             _erase_func(*item);
             _stats.frees++;
         }
-#ifdef SEASTAR_DEBUG
-        printf("lru slab page eviction succeeded! desc_empty?=%d\n", desc.empty());
-#endif
-        ::free(slab_page); // free slab page object
-        delete &desc; // free its descriptor
-        return memory::reclaiming_result::reclaimed_something;
+        slab_class->remove_slab_page();
     }
 
     /*
@@ -404,7 +531,11 @@ class slab_allocator {
             sm::make_counter("free_total_operations", sm::description("Total number of slab free operations"), _stats.frees),
             sm::make_gauge("malloc_objects", sm::description("Number of slab created objects currently in memory"), [this] {
                 return _stats.allocs - _stats.frees;
-            })
+            }),
+            sm::make_counter("evictions_total", sm::description("Total number of items evicted to make room for others"), [this] {
+                return evictions();
+            }),
+            sm::make_counter("page_moves_total", sm::description("Total number of slab pages moved from a slab class to another"), _stats.page_moves)
         });
     }
 
@@ -493,13 +624,10 @@ class slab_allocator {
 
     void lock_item(Item *item) {
         auto& desc = get_slab_page_desc(item);
-        if (_reclaimer) {
-            auto& refcnt = desc.refcnt();
-
-            if (++refcnt == 1) {
-                // remove slab page descriptor from list of slab page descriptors.
-                _slab_page_desc_lru.erase(_slab_page_desc_lru.iterator_to(desc));
-            }
+        // Pages with locked items can't be evicted nor moved
+        if (++desc.refcnt() == 1 && _reclaimer) {
+            // remove slab page descriptor from list of slab page descriptors.
+            _slab_page_desc_lru.erase(_slab_page_desc_lru.iterator_to(desc));
         }
         // remove item from the lru of its slab class.
         auto slab_class = get_slab_class(desc.slab_class_id());
@@ -508,13 +636,9 @@ class slab_allocator {
 
     void unlock_item(Item *item) {
         auto& desc = get_slab_page_desc(item);
-        if (_reclaimer) {
-            auto& refcnt = desc.refcnt();
-
-            if (--refcnt == 0) {
-                // insert slab page descriptor back into list of slab page descriptors.
-                _slab_page_desc_lru.push_front(desc);
-            }
+        if (--desc.refcnt() == 0 && _reclaimer) {
+            // insert slab page descriptor back into list of slab page descriptors.
+            _slab_page_desc_lru.push_front(desc);
         }
         // insert item into the lru of its slab class.
         auto slab_class = get_slab_class(desc.slab_class_id());
@@ -544,6 +668,112 @@ class slab_allocator {
         }
     }
 
+    /**
+     * Ages items from the hot and warm segments of the LRUs, up to n of
+     * each slab class. Creating items ages a few, so that segments keep
+     * close to their share; this catches up with those not used for a while.
+     */
+    void age(size_t n) {
+        for (auto& slab_class : _slab_classes) {
+            slab_class.age(n);
+        }
+    }
+
+    /**
+     * Moves a slab page to the slab class which evicted the most items since
+     * the last call, from one which evicted less than half as many, so that
+     * pages follow the sizes of items as they change. The page chosen is the
+     * one with the most free objects, among those with no locked item; its
+     * items are erased.
+     *
+     * \return whether a page was moved
+     */
+    bool rebalance() {
+        slab_class<Item>* receiver = nullptr;
+        uint64_t receiver_evictions = 0;
+        std::vector<uint64_t> evictions;
+        evictions.reserve(_slab_classes.size());
+        for (auto& slab_class : _slab_classes) {
+            evictions.push_back(slab_class.take_recent_evictions());
+            if (evictions.back() > receiver_evictions) {
+                receiver = &slab_class;
+                receiver_evictions = evictions.back();
+            }
+        }
+        if (!receiver || !_erase_func) {
+            return false;
+        }
+        slab_class<Item>* donor = nullptr;
+        for (size_t i = 0; i < _slab_classes.size(); i++) {
+            auto& slab_class = _slab_classes[i];
+            // A class keeps its last page
+            if (&slab_class == receiver || slab_class.pages() < 2 || evictions[i] * 2 >= receiver_evictions) {
+                continue;
+            }
+            auto donor_evictions = donor ? evictions[donor - _slab_classes.data()] : 0;
+            if (!donor || evictions[i] < donor_evictions
+                    || (evictions[i] == donor_evictions && slab_class.pages() > donor->pages())) {
+                donor = &slab_class;
+            }
+        }
+        if (!donor) {
+            return false;
+        }
+        slab_page_desc* page = nullptr;
+        for (auto desc : _slab_pages_vector) {
+            if (desc && desc->slab_class_id() == donor - _slab_classes.data() && desc->refcnt() == 0
+                    && (!page || desc->size() > page->size())) {
+                page = desc;
+            }
+        }
+        if (!page) {
+            return false;
+        }
+
+        // All that may fail comes before the page is emptied
+        auto objects = _max_object_size / receiver->size();
+        auto receiver_id = uint8_t(receiver - _slab_classes.data());
+        auto desc = std::make_unique<slab_page_desc>(page->slab_page(), objects, receiver->size(), receiver_id, page->index());
+        desc->free_object(page->slab_page());
+
+        if (_reclaimer) {
+            _slab_page_desc_lru.erase(_slab_page_desc_lru.iterator_to(*page));
+        }
+        erase_slab_page_items(*page);
+        delete page;
+        _slab_pages_vector[desc->index()] = desc.get();
+        receiver->add_slab_page(*desc);
+        if (_reclaimer) {
+            _slab_page_desc_lru.push_front(*desc);
+        }
+        desc.release();
+        _stats.page_moves++;
+        return true;
+    }
+
+    uint64_t evictions() const {
+        uint64_t total = 0;
+        for (auto& slab_class : _slab_classes) {
+            total += slab_class.evictions();
+        }
+        return total;
+    }
+
+    uint64_t page_moves() const {
+        return _stats.page_moves;
+    }
+
+    /**
+     * Number of items in a segment of the LRUs of all slab classes.
+     */
+    size_t items(slab_lru_segment segment) const {
+        size_t total = 0;
+        for (auto& slab_class : _slab_classes) {
+            total += slab_class.items(segment);
+        }
+        return total;
+    }
+
     /**
      * Helper function: Print all available slab classes and their respective properties.
      */
@@ -21,6 +21,7 @@
 
 #pragma once
 
+#include <seastar/core/cacheline.hh>
 #include <seastar/core/future.hh>
 #include <seastar/core/loop.hh>
 #include <seastar/core/semaphore.hh>
@@ -28,9 +29,14 @@
 #include <seastar/core/posix.hh>
 #include <seastar/core/reactor_config.hh>
 #include <seastar/core/resource.hh>
+#include <seastar/core/tracing.hh>
+#include <seastar/util/noncopyable_function.hh>
 #include <boost/lockfree/spsc_queue.hpp>
 #include <boost/thread/barrier.hpp>
 #include <boost/range/irange.hpp>
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <deque>
 #include <thread>
 
@@ -168,7 +174,12 @@ smp_service_group_semaphore& get_smp_service_groups_semaphore(unsigned ssg_id, s
 class smp_message_queue {
     static constexpr size_t queue_length = 128;
     static constexpr size_t batch_size = 16;
+    static constexpr size_t max_batch_size = queue_length / 2;
     static constexpr size_t prefetch_cnt = 2;
+    // Buckets of the adaptive batching histograms: latencies in
+    // microseconds and queue depths, both in powers of two.
+    static constexpr size_t latency_buckets = 16;
+    static constexpr size_t depth_buckets = 8;
     struct work_item;
     struct lf_queue_remote {
         reactor* remote;
@@ -198,10 +209,51 @@ class smp_message_queue {
     struct alignas(seastar::cache_line_size) {
         size_t _received = 0;
         size_t _last_rcv_batch = 0;
+        uint64_t _queue_time_ns = 0; // only accounted with traffic stats
     };
+public:
+    /// \cond internal
+    struct config {
+        // Adapt the request batch size to the measured round-trip time
+        // instead of always flushing every batch_size items
+        bool adaptive_batching = false;
+        std::chrono::microseconds batch_latency_target{100};
+        // Account the size of the submitted functions and the time they
+        // spend queued
+        bool traffic_stats = false;
+    };
+    /// \endcond
+private:
+    const bool _traffic_stats;
+    size_t _sent_bytes = 0; // only accounted with traffic stats
+    // Sender side state of adaptive batching; untouched unless enabled
+    struct alignas(seastar::cache_line_size) adaptive_batching {
+        const bool enabled;
+        const sched_clock::duration latency_target;
+        size_t batch_limit = batch_size;
+        sched_clock::duration rtt_estimate{};
+        std::array<uint64_t, latency_buckets> latency_hist{};
+        uint64_t latency_count = 0;
+        double latency_sum_us = 0;
+        std::array<uint64_t, depth_buckets> depth_hist{};
+        uint64_t depth_count = 0;
+        double depth_sum = 0;
+
+        explicit adaptive_batching(const config& cfg) noexcept
+            : enabled(cfg.adaptive_batching)
+            , latency_target(cfg.batch_latency_target) {}
+        void account_latency(sched_clock::duration rtt) noexcept;
+        void account_depth(size_t depth) noexcept;
+        void adjust(bool batch_was_full) noexcept;
+    } _batching;
     struct work_item : public task {
-        explicit work_item(smp_service_group ssg) : task(current_scheduling_group()), ssg(ssg) {}
+        explicit work_item(smp_service_group ssg) : task(current_scheduling_group()), ssg(ssg), trace(tracing::current_context()) {
+            // The handle means nothing on the shard that runs the item
+            _trace_handle = 0;
+        }
         smp_service_group ssg;
+        tracing::trace_context trace;
+        sched_clock::time_point submitted; // only set for adaptive batching and traffic stats
         virtual ~work_item() {}
         virtual void fail_with(std::exception_ptr) = 0;
         void process();
@@ -228,7 +280,7 @@ class smp_message_queue {
         virtual void run_and_dispose() noexcept override {
             // _queue.respond() below forwards the continuation chain back to the
             // calling shard.
-            (void)futurator::invoke(this->_func).then_wrapped([this] (auto f) {
+            (void)tracing::with_context(this->trace, this->_func).then_wrapped([this] (auto f) {
                 if (f.failed()) {
                     _ex = f.get_exception();
                 } else {
@@ -259,12 +311,15 @@ class smp_message_queue {
     } _tx;
     std::vector<work_item*> _completed_fifo;
 public:
-    smp_message_queue(reactor* from, reactor* to);
+    smp_message_queue(reactor* from, reactor* to, const config& cfg);
     ~smp_message_queue();
     template <typename Func>
     futurize_t<std::invoke_result_t<Func>> submit(shard_id t, smp_submit_to_options options, Func&& func) noexcept {
         memory::scoped_critical_alloc_section _;
         auto wi = std::make_unique<async_work_item<Func>>(*this, options.service_group, std::forward<Func>(func));
+        if (_traffic_stats) {
+            _sent_bytes += sizeof(Func);
+        }
         auto fut = wi->get_future();
         submit_item(t, options.timeout, std::move(wi));
         return fut;
@@ -289,6 +344,108 @@ class smp_message_queue {
     friend class smp;
 };
 
+namespace internal {
+
+class memory_prefaulter;
+class smp_batched_calls;
+
+// Self-contained work queued by smp::submit_stealable(). It runs as a
+// task in the submitter's scheduling group, either on the submitting shard
+// or on an idle sibling that stole it; the result is always delivered on
+// the submitting shard.
+struct stealable_work_item : public task {
+    shard_id origin;
+    explicit stealable_work_item(scheduling_group sg) noexcept : task(sg), origin(this_shard_id()) {
+        // The item may run on another shard, where the handle means nothing
+        _trace_handle = 0;
+    }
+    virtual ~stealable_work_item() {}
+    // Runs the function; called on whichever shard executes the item
+    virtual void execute() noexcept = 0;
+    // Resolves the promise; called on the origin shard
+    virtual void complete() noexcept = 0;
+    virtual void run_and_dispose() noexcept override;
+    virtual task* waiting_task() noexcept override {
+        // The waiter lives on the origin shard, possibly not this one
+        return nullptr;
+    }
+};
+
+template <typename Func>
+struct stealable_work_item_impl final : stealable_work_item {
+    Func _func;
+    using futurator = futurize<std::invoke_result_t<Func>>;
+    using future_type = typename futurator::type;
+    using value_type = typename future_type::value_type;
+    std::optional<value_type> _result;
+    std::exception_ptr _ex; // if !_result
+    typename futurator::promise_type _promise;
+    stealable_work_item_impl(scheduling_group sg, Func&& func) : stealable_work_item(sg), _func(std::move(func)) {}
+    virtual void execute() noexcept override {
+        auto f = futurator::invoke(_func);
+        if (f.failed()) {
+            _ex = f.get_exception();
+        } else {
+            _result = f.get();
+        }
+    }
+    virtual void complete() noexcept override {
+        if (_result) {
+            _promise.set_value(std::move(*_result));
+        } else {
+            _promise.set_exception(std::move(_ex));
+        }
+    }
+    future_type get_future() noexcept { return _promise.get_future(); }
+};
+
+}
+
+/// Where a shard runs.
+///
+/// \see smp::placement_of()
+struct shard_placement {
+    /// OS index of the CPU the shard is pinned to
+    unsigned cpu_id = 0;
+    /// Index of the physical core of the CPU, shared by its SMT siblings
+    unsigned core_id = 0;
+    /// NUMA node of the shard's memory
+    unsigned numa_node = 0;
+};
+
+/// How busy a shard is, as it last published it.
+///
+/// \see smp::load_of()
+struct shard_load {
+    /// Fraction of the last second the shard spent running, from 0 to 1
+    float utilization = 0;
+    /// Tasks waiting to run, when the shard last ran tasks
+    unsigned runnable_tasks = 0;
+};
+
+namespace internal {
+
+struct alignas(seastar::cache_line_size) published_shard_load {
+    std::atomic<float> utilization{0};
+    std::atomic<unsigned> runnable_tasks{0};
+};
+
+}
+
+/// Cross-shard traffic from one shard to another.
+///
+/// \see smp::get_traffic_stats()
+struct smp_traffic_stats {
+    shard_id from;
+    shard_id to;
+    /// Number of messages (\ref smp::submit_to() calls and their descendants) sent
+    uint64_t messages;
+    /// Total size of the submitted functions, including their captured state
+    uint64_t bytes;
+    /// Total time the messages spent queued before the destination started to process them
+    std::chrono::nanoseconds queue_time;
+};
+
 class smp_message_queue;
 struct reactor_options;
 struct smp_options;
@@ -302,10 +459,23 @@ class smp : public std::enable_shared_from_this<smp> {
       void operator()(smp_message_queue** qs) const;
     };
     std::unique_ptr<smp_message_queue*[], qs_deleter> _qs_owner;
+    struct prefaulter_deleter {
+      void operator()(internal::memory_prefaulter* p) const;
+    };
+    std::unique_ptr<internal::memory_prefaulter, prefaulter_deleter> _prefaulter;
     static thread_local smp_message_queue**_qs;
     static thread_local std::thread::id _tmain;
     bool _using_dpdk = false;
 
+    static void submit_stealable_item(std::unique_ptr<internal::stealable_work_item> wi) noexcept;
+
+    using batched_call = noncopyable_function<void (), 32, false>;
+    template <typename Func>
+    static constexpr bool fits_batched_call = sizeof(Func) <= 32 && alignof(Func) <= alignof(void*)
+            && std::is_nothrow_move_constructible_v<Func>;
+    static void submit_batched_call(unsigned t, batched_call func) noexcept;
+    friend class internal::smp_batched_calls;
+
     template <typename Func>
     using returns_future = is_future<std::invoke_result_t<Func>>;
     template <typename Func>
@@ -375,11 +545,80 @@ class smp : public std::enable_shared_from_this<smp> {
     static futurize_t<std::invoke_result_t<Func>> submit_to(unsigned t, Func&& func) noexcept {
         return submit_to(t, default_smp_service_group(), std::forward<Func>(func));
     }
+    /// Runs a self-contained function, possibly on a sibling shard.
+    ///
+    /// If the current scheduling group is migratable (see
+    /// \ref scheduling_group::set_migratable()), \c func is queued so that an
+    /// idle shard on the same NUMA node can steal it and run it in the same
+    /// scheduling group; otherwise it is invoked right away on this shard.
+    /// Queued work that nobody steals is run by this shard in due course.
+    ///
+    /// Since \c func may run on any shard, it must not access shard-local
+    /// state and cannot return a future. It is moved, and eventually destroyed,
+    /// on the calling shard.
+    ///
+    /// \param func a callable to run
+    /// \return whatever \c func returns, as a future<> resolved on the calling shard
+    template <typename Func>
+    static futurize_t<std::invoke_result_t<Func>> submit_stealable(Func&& func) noexcept {
+        using ret_type = std::invoke_result_t<Func>;
+        static_assert(!is_future<ret_type>::value, "submit_stealable() requires a function that does not return a future");
+        auto sg = current_scheduling_group();
+        if (count == 1 || !sg.is_migratable()) {
+            return futurize<ret_type>::invoke(std::forward<Func>(func));
+        }
+        try {
+            auto wi = std::make_unique<internal::stealable_work_item_impl<std::decay_t<Func>>>(sg, std::decay_t<Func>(std::forward<Func>(func)));
+            auto fut = wi->get_future();
+            submit_stealable_item(std::move(wi));
+            return fut;
+        } catch (...) {
+            return futurize<ret_type>::make_exception_future(std::current_exception());
+        }
+    }
+    /// Runs a function on a remote core, without waiting for it.
+    ///
+    /// Functions submitted to the same core are collected until this shard
+    /// next polls its smp queues, and sent to it in a single message, so
+    /// that fire-and-forget work such as returning objects to the shard
+    /// that owns them, as \ref foreign_ptr does, costs one message per
+    /// destination per poll rather than one per object. Functions run on
+    /// \c t in the order they were submitted; they are moved, and
+    /// destroyed, on the calling core. Those too large to be stored in
+    /// place are submitted on their own with \ref submit_to().
+    ///
+    /// \param t designates the core to run the function on
+    /// \param func a callable to run on core \c t, not returning a future
+    template <typename Func>
+    static void submit_batched(unsigned t, Func&& func) noexcept {
+        using func_type = std::decay_t<Func>;
+        static_assert(std::is_same_v<std::invoke_result_t<func_type&>, void>, "submit_batched() requires a function returning void");
+        if (t == this_shard_id()) {
+            func();
+        } else if constexpr (fits_batched_call<func_type>) {
+            submit_batched_call(t, batched_call(func_type(std::forward<Func>(func))));
+        } else {
+            (void)submit_to(t, std::forward<Func>(func));
+        }
+    }
+    /// Returns a snapshot of the cross-shard traffic matrix.
+    ///
+    /// Contains an entry for every ordered pair of distinct shards. Only
+    /// message counts are kept by default; \c bytes and \c queue_time are
+    /// zero unless the application runs with \c --smp-traffic-stats.
+    static future<std::vector<smp_traffic_stats>> get_traffic_stats();
     static bool poll_queues();
     static bool pure_poll_queues();
     static boost::integer_range<unsigned> all_cpus() noexcept {
         return boost::irange(0u, count);
     }
+    /// Returns the NUMA node a shard's memory is on, or 0 if not known
+    static unsigned numa_node_of(shard_id shard) noexcept;
+    /// Returns the CPU, core and NUMA node of a shard, as placed at startup
+    static shard_placement placement_of(shard_id shard) noexcept;
+    /// Returns how busy a shard is. Cheap enough to call from any shard on
+    /// every decision, e.g. which shard to give a new connection to.
+    static shard_load load_of(shard_id shard) noexcept;
     /// Invokes func on all shards.
     ///
     /// \param options the options to forward to the \ref smp::submit_to()
@@ -461,8 +700,28 @@ class smp : public std::enable_shared_from_this<smp> {
     void allocate_reactor(unsigned id, reactor_backend_selector rbs, reactor_config cfg);
     void create_thread(std::function<void ()> thread_loop);
     unsigned adjust_max_networking_aio_io_control_blocks(unsigned network_iocbs);
+    // Indexed by shard
+    static std::vector<shard_placement> _placements;
+    // Indexed by shard, written by the shard's reactor
+    static std::unique_ptr<internal::published_shard_load[]> _loads;
+    friend class reactor;
 public:
     static unsigned count;
 };
 
+namespace internal {
+
+// The shards arranged for a reduction rooted at a shard: the root first,
+// the rest of its NUMA node after it, then the shards of each other node
+// in turn. \c node_starts has the offset of each node's shards, and the
+// size of \c shards at the end.
+struct shard_reduction_order {
+    std::vector<shard_id> shards;
+    std::vector<size_t> node_starts;
+};
+
+shard_reduction_order make_shard_reduction_order(shard_id root);
+
+}
+
 }
@@ -51,6 +51,15 @@ struct smp_options : public program_options::option_group {
     program_options::value<std::string> hugepages;
     /// Lock all memory (prevents swapping).
     program_options::value<bool> lock_memory;
+    /// \brief Fault in the memory of the shards in the background.
+    ///
+    /// A thread per shard touches the memory of its shard, at idle
+    /// priority on the shard's CPU, so that the page faults are not taken
+    /// on first use of the memory, nor all at startup.
+    ///
+    /// Default: the value of \ref lock_memory.
+    /// \note Unused when the seastar allocator is not used.
+    program_options::value<bool> prefault_memory;
     /// Pin threads to their cpus (disable for overprovisioning).
     ///
     /// Default: \p true.
@@ -75,6 +84,13 @@ struct smp_options : public program_options::option_group {
     ///
     /// Default: \p true.
     program_options::value<bool> mbind;
+    /// Move each shard's resident memory that is not on its intended NUMA
+    /// node there at startup.
+    ///
+    /// See \ref memory::migrate_misplaced_memory().
+    ///
+    /// Default: \p false.
+    program_options::value<bool> numa_migrate_misplaced_memory;
     /// Enable workaround for glibc/gcc c++ exception scalablity problem.
     ///
     /// Default: \p true.
@@ -84,6 +100,57 @@ struct smp_options : public program_options::option_group {
     /// them to remote ones.
     /// \note Unused when seastar is compiled without \p HWLOC support.
     program_options::value<bool> allow_cpus_in_remote_numa_nodes;
+    /// \brief Path to a file caching the hardware topology.
+    ///
+    /// If the file exists, the topology is loaded from it instead of being
+    /// discovered, which takes a while on large machines; otherwise it is
+    /// discovered and written there. The cache is discarded if it does not
+    /// have as many CPUs as the process may run on; it must be removed when
+    /// the hardware changes otherwise.
+    /// \note Unused when seastar is compiled without \p HWLOC support.
+    program_options::value<std::string> hwloc_topology_cache;
+    /// \brief Place at most one shard on each physical core.
+    ///
+    /// SMT siblings share the execution units of their core, so shards on
+    /// siblings slow each other down. Fewer shards are started by default,
+    /// one per core of the usable CPUs.
+    ///
+    /// Default: \p false.
+    /// \note Unused when seastar is compiled without \p HWLOC support.
+    program_options::value<bool> avoid_smt_siblings;
+    /// \brief Place shards on the most performant cores.
+    ///
+    /// On hosts with cores of several kinds, e.g. performance and efficiency
+    /// cores, only the most performant kind is used, or as many of the most
+    /// performant kinds as it takes for \ref smp shards.
+    ///
+    /// Default: \p false.
+    /// \note Unused when seastar is compiled without \p HWLOC support, or
+    /// with a version of it older than 2.4.
+    program_options::value<bool> prefer_performance_cores;
+    /// \brief Adapt the batching of cross-shard messages to their round-trip time.
+    ///
+    /// By default messages to another shard are handed over in batches of a
+    /// fixed size, or at the next poll. When enabled, the batch size grows
+    /// while senders keep filling batches and shrinks when round trips exceed
+    /// \ref smp_batch_latency_target_us. Per shard pair round-trip time and
+    /// queue depth histograms are exported as metrics.
+    ///
+    /// Default: \p false.
+    program_options::value<bool> smp_adaptive_batching;
+    /// \brief Round-trip time target (us) for \ref smp_adaptive_batching.
+    ///
+    /// Default: 100.
+    program_options::value<unsigned> smp_batch_latency_target_us;
+    /// \brief Account cross-shard traffic per shard pair.
+    ///
+    /// Counts the size of the functions sent between each pair of shards,
+    /// with their captured state, and the time they spend queued, and
+    /// exports them, along with message counts, as metrics and through
+    /// \ref smp::get_traffic_stats().
+    ///
+    /// Default: \p false.
+    program_options::value<bool> smp_traffic_stats;
 
     /// Memory allocator to use.
     ///
@@ -92,6 +159,8 @@ struct smp_options : public program_options::option_group {
     /// * \ref smp_options::reserve_memory
     /// * \ref smp_options::hugepages
     /// * \ref smp_options::mbind
+    /// * \ref smp_options::numa_migrate_misplaced_memory
+    /// * \ref smp_options::prefault_memory
     /// * \ref reactor_options::heapprof
     /// * \ref reactor_options::abort_on_seastar_bad_alloc
     /// * \ref reactor_options::dump_memory_diagnostics_on_alloc_failure_kind
@@ -0,0 +1,76 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#pragma once
+
+#include <seastar/core/future.hh>
+#include <seastar/core/sstring.hh>
+#include <seastar/util/backtrace.hh>
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+#include <vector>
+
+/// \file
+///
+/// The stall profiler samples a backtrace every few hundred microseconds of
+/// CPU time while the reactor is blocked past the stall detector threshold,
+/// and counts the samples by call stack, per shard. Unlike the stall
+/// reports in the log, the counts add up over many stalls, and are written
+/// in the folded format which flame graph tools read. Enable it with
+/// --blocked-reactor-profile, or \ref reactor::set_stall_profiling().
+
+namespace seastar {
+
+namespace httpd {
+class http_server;
+}
+
+/// A call stack sampled during stalls
+struct stall_profile_stack {
+    std::vector<frame> frames; ///< innermost first
+    uint64_t samples; ///< how many times it was sampled
+};
+
+/// The call stacks sampled during stalls on a shard
+struct stall_profile {
+    unsigned shard = 0;
+    std::chrono::nanoseconds interval{}; ///< CPU time between samples
+    std::vector<stall_profile_stack> stacks;
+    uint64_t dropped_samples = 0; ///< samples which found the table full
+};
+
+/// Writes a profile in the folded format: a line per call stack, with its
+/// frames from the outermost, below a "shard N" frame, separated by ';',
+/// followed by the number of samples.
+void write_folded(std::ostream& os, const stall_profile& profile);
+
+/// Collects the stall profiles of all shards.
+///
+/// \param reset whether to clear the profiles after they are read
+future<std::vector<stall_profile>> get_stall_profiles(bool reset = false);
+
+/// Adds a GET route that returns the stall profiles of all shards in the
+/// folded format. With the query parameter reset=true, the profiles are
+/// cleared after they are read.
+future<> add_stall_profile_route(httpd::http_server& server, sstring path = "/stall_profile");
+
+}
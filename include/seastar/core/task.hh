@@ -27,9 +27,27 @@
 
 namespace seastar {
 
+/// \cond internal
+namespace internal {
+
+// The trace context of the running task, as a handle to a context held by
+// tracing on this shard; see tracing.hh
+inline
+uint32_t*
+current_trace_handle_ptr() noexcept {
+    static thread_local uint32_t handle;
+    return &handle;
+}
+
+}
+/// \endcond
+
 class task {
 protected:
     scheduling_group _sg;
+    // Inherited from the creating task, like _sg, and only meaningful on
+    // this shard. Fills the padding after _sg.
+    uint32_t _trace_handle;
 private:
 #ifdef SEASTAR_TASK_BACKTRACE
     shared_backtrace _bt;
@@ -45,11 +63,13 @@ class task {
         return std::exchange(_sg, new_sg);
     }
 public:
-    explicit task(scheduling_group sg = current_scheduling_group()) noexcept : _sg(sg) {}
+    explicit task(scheduling_group sg = current_scheduling_group()) noexcept
+        : _sg(sg), _trace_handle(*internal::current_trace_handle_ptr()) {}
     virtual void run_and_dispose() noexcept = 0;
     /// Returns the next task which is waiting for this task to complete execution, or nullptr.
     virtual task* waiting_task() noexcept = 0;
     scheduling_group group() const { return _sg; }
+    uint32_t trace_handle() const noexcept { return _trace_handle; }
     shared_backtrace get_backtrace() const;
 #ifdef SEASTAR_TASK_BACKTRACE
     void make_backtrace() noexcept;
@@ -69,5 +89,6 @@ shared_backtrace task::get_backtrace() const {
 
 void schedule(task* t) noexcept;
 void schedule_urgent(task* t) noexcept;
+void schedule_with_deadline(task* t, sched_clock::time_point deadline) noexcept;
 
 }
@@ -82,6 +82,25 @@ class thread_attributes {
     size_t stack_size = 0;
 };
 
+/// Statistics of the shard's pool of thread stacks, see
+/// \ref set_thread_stack_pool_capacity().
+struct thread_stack_pool_stats {
+    uint64_t hits = 0;          ///< stacks taken from the pool
+    uint64_t misses = 0;        ///< stacks allocated as the pool had none of the size
+    uint64_t releases = 0;      ///< stacks returned to the pool
+    uint64_t drops = 0;         ///< stacks freed as the pool was full
+    size_t cached_bytes = 0;    ///< held in the pool now
+};
+
+/// Sets how many bytes of stacks of finished threads the shard keeps, to
+/// give to new threads of the same stack size. Pooled stacks keep their
+/// guard page, if any, so reusing one costs no system call. Reducing the
+/// capacity frees stacks above it; 0 disables pooling.
+void set_thread_stack_pool_capacity(size_t bytes);
+
+/// Returns the statistics of the shard's pool of thread stacks.
+thread_stack_pool_stats get_thread_stack_pool_stats() noexcept;
+
 
 /// \cond internal
 extern thread_local jmp_buf_link g_unthreaded_context;
@@ -93,7 +112,8 @@ class thread_context final : private task {
     struct stack_deleter {
         void operator()(char *ptr) const noexcept;
         int valgrind_id;
-        stack_deleter(int valgrind_id);
+        size_t size;
+        stack_deleter(int valgrind_id, size_t size);
     };
     using stack_holder = std::unique_ptr<char[], stack_deleter>;
 
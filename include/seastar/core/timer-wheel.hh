@@ -0,0 +1,317 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#pragma once
+
+#include <seastar/core/timer-set.hh>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <type_traits>
+
+namespace seastar {
+
+/**
+ * A hierarchical timing wheel, with the same interface as timer_set.
+ *
+ * Time is divided in ticks of a fixed granularity, and each level of the
+ * wheel has 64 slots of 64 times the span of the slots of the level below.
+ * A timer goes to the lowest level at which its tick and the current tick
+ * share all the higher digits, so inserting and removing a timer are
+ * O(1) regardless of how many timers there are. Timers move down a level
+ * only when time reaches their slot, so that, as with timer_set, timers
+ * which are cancelled before they get close to expiring are never sorted
+ * at all.
+ *
+ * Timers farther in the future than the wheel spans (2^36 ticks) wait in
+ * an overflow list, which is looked at once per turn of the top level.
+ */
+template<typename Timer, boost::intrusive::list_member_hook<> Timer::*link>
+class timer_wheel {
+public:
+    using time_point = typename Timer::time_point;
+    using timer_list_t = boost::intrusive::list<Timer, boost::intrusive::member_hook<Timer, boost::intrusive::list_member_hook<>, link>>;
+private:
+    using duration = typename Timer::duration;
+    using timestamp_t = typename Timer::duration::rep;
+    using tick_t = uint64_t;
+
+    static constexpr timestamp_t max_timestamp = std::numeric_limits<timestamp_t>::max();
+    static constexpr unsigned level_bits = 6;
+    static constexpr unsigned n_levels = 6;
+    static constexpr unsigned n_slots = 1u << level_bits;
+    static constexpr tick_t slot_mask = n_slots - 1;
+    // After the slots of all levels: timers with tick <= _cur, then timers
+    // beyond the span of the wheel.
+    static constexpr unsigned due_index = n_levels * n_slots;
+    static constexpr unsigned overflow_index = due_index + 1;
+
+    std::array<timer_list_t, n_levels * n_slots + 2> _lists;
+    std::array<uint64_t, n_levels> _non_empty_slots{};
+    // Ticks are a power of two of the clock's units
+    unsigned _tick_shift;
+    // Every timer in a slot of level l has a tick which agrees with _cur on
+    // all digits above l, and has a greater digit l.
+    tick_t _cur = 0;
+    timestamp_t _last = 0;
+    timestamp_t _next = max_timestamp;
+    size_t _size = 0;
+
+    struct event {
+        unsigned level;
+        unsigned slot;
+        tick_t tick;
+    };
+private:
+    static timestamp_t get_timestamp(time_point _time_point) noexcept {
+        return _time_point.time_since_epoch().count();
+    }
+
+    static timestamp_t get_timestamp(Timer& timer) noexcept {
+        return get_timestamp(timer.get_timeout());
+    }
+
+    tick_t get_tick(timestamp_t timestamp) const noexcept {
+        return timestamp <= 0 ? 0 : tick_t(timestamp) >> _tick_shift;
+    }
+
+    static unsigned digit(tick_t tick, unsigned level) noexcept {
+        return (tick >> (level * level_bits)) & slot_mask;
+    }
+
+    unsigned get_index(tick_t tick) const noexcept {
+        if (tick <= _cur) {
+            return due_index;
+        }
+        unsigned level = (std::numeric_limits<tick_t>::digits - 1 - bitsets::count_leading_zeros(tick ^ _cur)) / level_bits;
+        if (level >= n_levels) {
+            return overflow_index;
+        }
+        return level * n_slots + digit(tick, level);
+    }
+
+    void place(Timer& timer) noexcept {
+        auto index = get_index(get_tick(get_timestamp(timer)));
+        _lists[index].push_back(timer);
+        if (index < due_index) {
+            _non_empty_slots[index / n_slots] |= uint64_t(1) << (index % n_slots);
+        }
+    }
+
+    // The next point at which expire() has work to do: the first non-empty
+    // slot after the current one, on the lowest level that has one, since
+    // any slot of a level comes after all those of the levels below.
+    std::optional<event> next_event() const noexcept {
+        for (unsigned level = 0; level < n_levels; level++) {
+            auto d = digit(_cur, level);
+            auto later = d == slot_mask ? 0 : _non_empty_slots[level] & (~uint64_t(0) << (d + 1));
+            if (later) {
+                auto slot = bitsets::count_trailing_zeros(later);
+                auto shift = (level + 1) * level_bits;
+                tick_t tick = ((_cur >> shift) << shift) | (tick_t(slot) << (level * level_bits));
+                return event{level, unsigned(slot), tick};
+            }
+        }
+        if (!_lists[overflow_index].empty()) {
+            auto shift = n_levels * level_bits;
+            return event{n_levels, 0, ((_cur >> shift) + 1) << shift};
+        }
+        return std::nullopt;
+    }
+
+    timestamp_t tick_timestamp(tick_t tick) const noexcept {
+        if (tick > (tick_t(max_timestamp) >> _tick_shift)) {
+            return max_timestamp;
+        }
+        return timestamp_t(tick << _tick_shift);
+    }
+public:
+    /**
+     * Constructs an empty wheel.
+     *
+     * \param granularity the span of a tick, rounded down to a power of two
+     *        of the clock's units; the wheel is exact whatever the granularity,
+     *        which only sets how timers are spread.
+     */
+    explicit timer_wheel(duration granularity = std::chrono::milliseconds(1)) noexcept
+        : _tick_shift(granularity.count() > 1 ? std::numeric_limits<uint64_t>::digits - 1 - bitsets::count_leading_zeros(uint64_t(granularity.count())) : 0)
+    {
+    }
+
+    ~timer_wheel() {
+        for (auto&& list : _lists) {
+            while (!list.empty()) {
+                auto& timer = *list.begin();
+                timer.cancel();
+            }
+        }
+    }
+
+    /**
+     * Adds timer to the active set. See timer_set::insert().
+     */
+    bool insert(Timer& timer) noexcept
+    {
+        place(timer);
+        _size++;
+        auto timestamp = get_timestamp(timer);
+        if (timestamp < _next) {
+            _next = timestamp;
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * Removes timer from the active set. See timer_set::remove().
+     */
+    void remove(Timer& timer) noexcept
+    {
+        auto index = get_index(get_tick(get_timestamp(timer)));
+        auto& list = _lists[index];
+        list.erase(list.iterator_to(timer));
+        if (index < due_index && list.empty()) {
+            _non_empty_slots[index / n_slots] &= ~(uint64_t(1) << (index % n_slots));
+        }
+        _size--;
+    }
+
+    /**
+     * Expires active timers. See timer_set::expire().
+     */
+    timer_list_t expire(time_point now) noexcept
+    {
+        timer_list_t exp;
+        auto timestamp = get_timestamp(now);
+
+        if (timestamp < _last) {
+            abort();
+        }
+        _last = timestamp;
+
+        auto target = get_tick(timestamp);
+        auto& due = _lists[due_index];
+        auto ev = next_event();
+        while (ev && ev->tick <= target) {
+            _cur = ev->tick;
+            if (ev->level == n_levels) {
+                auto overflow = std::move(_lists[overflow_index]);
+                while (!overflow.empty()) {
+                    auto& timer = *overflow.begin();
+                    overflow.pop_front();
+                    place(timer);
+                }
+            } else {
+                auto& list = _lists[ev->level * n_slots + ev->slot];
+                _non_empty_slots[ev->level] &= ~(uint64_t(1) << ev->slot);
+                if (ev->level == 0) {
+                    due.splice(due.end(), list);
+                } else {
+                    // Cascade: the timers spread over the levels below
+                    while (!list.empty()) {
+                        auto& timer = *list.begin();
+                        list.pop_front();
+                        place(timer);
+                    }
+                }
+            }
+            ev = next_event();
+        }
+        // No slot lies between _cur and target, so moving _cur keeps every
+        // timer where get_index() finds it.
+        _cur = std::max(_cur, target);
+
+        _next = ev ? tick_timestamp(ev->tick) : max_timestamp;
+        for (auto it = due.begin(); it != due.end();) {
+            auto& timer = *it;
+            auto t = get_timestamp(timer);
+            if (t <= timestamp) {
+                it = due.erase(it);
+                exp.push_back(timer);
+                _size--;
+            } else {
+                // Within the current tick
+                _next = std::min(_next, t);
+                ++it;
+            }
+        }
+        return exp;
+    }
+
+    /**
+     * Returns a time point at which expire() should be called
+     * in order to ensure timers are expired in a timely manner.
+     * This may be before any timer expires, when timers need to move
+     * down the wheel.
+     *
+     * Returned values are monotonically increasing.
+     */
+    time_point get_next_timeout() const noexcept
+    {
+        return time_point(duration(std::max(_last, _next)));
+    }
+
+    /**
+     * Clears the active set.
+     */
+    void clear() noexcept
+    {
+        for (auto&& list : _lists) {
+            list.clear();
+        }
+        _non_empty_slots = {};
+        _size = 0;
+    }
+
+    size_t size() const noexcept
+    {
+        return _size;
+    }
+
+    /**
+     * Returns true if and only if there are no timers in the active set.
+     */
+    bool empty() const noexcept
+    {
+        return _size == 0;
+    }
+
+    time_point now() noexcept {
+        return Timer::clock::now();
+    }
+};
+
+/// Tells whether the reactor keeps the timers of \c Clock in a
+/// \ref timer_wheel, rather than in a \ref timer_set. The wheel is better
+/// suited to a clock with many timers far apart, such as per-request
+/// timeouts; specialize as \c std::true_type to select it.
+template <typename Clock>
+struct use_timer_wheel : std::false_type {};
+
+/// The container the reactor keeps \c Timer in, as selected by
+/// \ref use_timer_wheel for its clock.
+template<typename Timer, boost::intrusive::list_member_hook<> Timer::*link>
+using timer_container = std::conditional_t<use_timer_wheel<typename Timer::clock>::value,
+        timer_wheel<Timer, link>, timer_set<Timer, link>>;
+
+}
@@ -0,0 +1,195 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#pragma once
+
+#include <seastar/core/future.hh>
+#include <seastar/core/sstring.hh>
+#include <seastar/core/task.hh>
+#include <chrono>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/// \file
+///
+/// Lightweight distributed tracing. A \ref tracing::span times an
+/// operation; while it is active, it is the trace context of the current
+/// task, which tasks created from it inherit, as they inherit the
+/// scheduling group. The context follows smp::submit_to() to other shards,
+/// and rpc calls to other nodes, where spans become children of the
+/// remote one. Ended spans go to a ring on each shard, from which they
+/// are exported in the OpenTelemetry (OTLP/JSON) format.
+///
+/// Traces are sampled when their root span starts; spans of traces which
+/// are not sampled cost a branch, and have no context to propagate.
+
+namespace seastar {
+
+namespace tracing {
+
+/// Identifies a span and its trace, as propagated across shards and nodes
+struct trace_context {
+    uint64_t trace_id_high = 0;
+    uint64_t trace_id_low = 0;
+    uint64_t span_id = 0;
+    uint8_t flags = 0; ///< W3C trace flags, bit 0 telling the trace is sampled
+    bool valid() const noexcept {
+        return trace_id_high || trace_id_low;
+    }
+    bool sampled() const noexcept {
+        return flags & 1;
+    }
+    /// The size of the serialized form
+    static constexpr size_t serialized_size = 32;
+    /// Writes the context, or zeros if it is not valid, as serialized_size
+    /// little-endian bytes
+    void serialize(char* p) const noexcept;
+    static trace_context deserialize(const char* p) noexcept;
+};
+
+/// Tracing settings of a shard
+struct config {
+    /// The probability that a trace is sampled when its root span starts;
+    /// with zero, tracing is disabled.
+    double sampling_rate = 0;
+    /// How many ended spans are kept; the oldest are dropped first.
+    size_t max_spans = 4096;
+    /// The service.name resource attribute of exported spans
+    sstring service_name = "seastar";
+};
+
+/// Configures tracing on this shard
+void configure_local(config cfg);
+/// Configures tracing on all shards
+future<> configure(config cfg);
+
+/// Returns the trace context of the current task, which is not valid if
+/// the task is not part of a sampled trace.
+trace_context current_context() noexcept;
+
+/// \cond internal
+namespace internal {
+uint32_t attach(const trace_context& ctx) noexcept;
+void detach(uint32_t handle) noexcept;
+}
+/// \endcond
+
+/// Times an operation. A span which is not recording does nothing, so
+/// that the cost of tracing is only paid for sampled traces.
+///
+/// A span belongs to the shard it starts on; it ends when end() is called,
+/// or when it is destroyed.
+class span {
+    trace_context _context;
+    uint64_t _parent_span_id = 0;
+    uint32_t _handle = 0; // holds _context while recording
+    sstring _name;
+    std::chrono::system_clock::time_point _start;
+    std::vector<std::pair<sstring, sstring>> _attributes;
+public:
+    /// Creates a span which is not recording
+    span() noexcept = default;
+    /// Starts a span, as a child of the current context if there is one,
+    /// and otherwise as the root of a new trace, if it is sampled.
+    explicit span(sstring name);
+    /// Starts a span, as a child of \c parent if it is valid. For contexts
+    /// received from other nodes.
+    span(sstring name, const trace_context& parent);
+    span(span&& x) noexcept;
+    span& operator=(span&& x) noexcept;
+    ~span();
+
+    bool recording() const noexcept { return _handle; }
+    /// The context of the span, to propagate by other means; not valid if
+    /// the span is not recording
+    const trace_context& context() const noexcept { return _context; }
+    void set_attribute(sstring key, sstring value);
+    /// Ends the span and records it on this shard
+    void end() noexcept;
+
+    /// Calls func with the span as the current context, so that the tasks
+    /// it creates inherit it.
+    template <typename Func>
+    std::invoke_result_t<Func> activate(Func&& func) {
+        if (!_handle) {
+            return std::invoke(std::forward<Func>(func));
+        }
+        auto prev = std::exchange(*seastar::internal::current_trace_handle_ptr(), _handle);
+        auto restore = [prev] { *seastar::internal::current_trace_handle_ptr() = prev; };
+        try {
+            if constexpr (std::is_void_v<std::invoke_result_t<Func>>) {
+                std::invoke(std::forward<Func>(func));
+                restore();
+            } else {
+                auto ret = std::invoke(std::forward<Func>(func));
+                restore();
+                return ret;
+            }
+        } catch (...) {
+            restore();
+            throw;
+        }
+    }
+};
+
+/// Runs func, which may return a future, within a new span which ends
+/// when it completes. See span::span(sstring).
+template <typename Func>
+futurize_t<std::invoke_result_t<Func>> with_span(sstring name, Func&& func) noexcept {
+    span s;
+    try {
+        s = span(std::move(name));
+    } catch (...) {
+        // Tracing must not fail the operation
+    }
+    if (!s.recording()) {
+        return futurize_invoke(std::forward<Func>(func));
+    }
+    auto f = s.activate([&func] { return futurize_invoke(std::forward<Func>(func)); });
+    return f.finally([s = std::move(s)] () mutable { s.end(); });
+}
+
+/// Runs func, which may return a future, with ctx, received from another
+/// shard, as the current context until it completes.
+template <typename Func>
+futurize_t<std::invoke_result_t<Func>> with_context(const trace_context& ctx, Func&& func) noexcept {
+    if (!ctx.valid()) {
+        return futurize_invoke(std::forward<Func>(func));
+    }
+    auto handle = internal::attach(ctx);
+    auto prev = std::exchange(*seastar::internal::current_trace_handle_ptr(), handle);
+    auto f = futurize_invoke(std::forward<Func>(func));
+    *seastar::internal::current_trace_handle_ptr() = prev;
+    if (!handle) {
+        return f;
+    }
+    return f.finally([handle] { internal::detach(handle); });
+}
+
+/// Collects the ended spans of all shards, and removes them, in the
+/// OTLP/JSON format of an ExportTraceServiceRequest.
+future<sstring> export_otlp_json();
+
+}
+
+}
@@ -0,0 +1,66 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/*
+ * Copyright (C) 2023 ScyllaDB.
+ */
+
+#pragma once
+
+#include <seastar/core/future.hh>
+#include <seastar/core/make_task.hh>
+
+namespace seastar {
+
+/// \addtogroup future-util
+/// @{
+
+/// \brief run a callable (with some arbitrary arguments) ahead of FIFO work in its scheduling group
+///
+/// The function is queued in the current scheduling group as a task with
+/// a deadline. Within a scheduling group, tasks with a deadline run earliest
+/// deadline first, ahead of the tasks queued without one; a task that only
+/// starts after its deadline has passed is counted in the group's
+/// \c deadline_misses metric. The scheduling groups themselves are still
+/// arbitrated by their shares.
+///
+/// The deadline applies to the invocation of \c func only: continuations
+/// it schedules are queued in FIFO order as usual.
+///
+/// \param deadline the point in time by which \c func should start running
+/// \param func function to run; must be movable or copyable
+/// \param args arguments to the function; may be copied or moved, so use \c std::ref()
+///             to force passing references
+template <typename Func, typename... Args>
+SEASTAR_CONCEPT( requires std::is_nothrow_move_constructible_v<Func> )
+inline
+auto
+with_deadline(sched_clock::time_point deadline, Func func, Args&&... args) noexcept {
+    static_assert(std::is_nothrow_move_constructible_v<Func>);
+    using return_type = decltype(func(std::forward<Args>(args)...));
+    using futurator = futurize<return_type>;
+    auto tsk = make_task(current_scheduling_group(), [func = std::move(func), args = std::make_tuple(std::forward<Args>(args)...)] () mutable {
+        return futurator::apply(func, std::move(args));
+    });
+    schedule_with_deadline(tsk, deadline);
+    return tsk->get_future();
+}
+
+/// @}
+
+} // namespace seastar
@@ -0,0 +1,113 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#pragma once
+
+#include <span>
+#include <string_view>
+#include <vector>
+#include <seastar/core/coroutine.hh>
+#include <seastar/core/iostream.hh>
+#include <seastar/core/sstring.hh>
+#include <seastar/coroutine/generator.hh>
+
+namespace seastar::coroutine::experimental {
+
+/// `seastar::coroutine::experimental::batch_generator<T>` is a generator
+/// which yields a sequence of values a batch at a time.
+///
+/// Handing a value over from a generator to its caller takes a task switch
+/// each way, which dominates when the work per value is small, such as
+/// per record of a parse, filter and serialize pipeline. A batch generator
+/// `co_yield`s a contiguous range of values instead, which the caller gets
+/// as a `std::span<T>` that stays valid until it asks for the next batch.
+/// The values are not copied: they live in the generator coroutine, which
+/// is suspended while the caller looks at them, so it can reuse the same
+/// storage for the next batch.
+///
+/// Example
+///
+/// ```
+/// auto parse = [] (input_stream<char>& in) -> batch_generator<record> {
+///     std::vector<record> records;
+///     while (auto buf = co_await in.read()) {
+///         records.clear();
+///         parse_records(buf, records);
+///         co_yield records;
+///     }
+/// };
+///
+/// auto records = parse(in);
+/// while (auto batch = co_await records()) {
+///     for (record& r : *batch) {
+///         process(r);
+///     }
+/// }
+/// ```
+template <typename T>
+using batch_generator = generator<std::span<T>, std::optional>;
+
+/// Reads an input stream as records ended by a delimiter, such as lines,
+/// yielding the records of each buffer read as one batch.
+///
+/// The records point into the buffers of the stream where possible. Only
+/// those split between two buffers are copied, to put them together. The
+/// last record needs no delimiter after it.
+///
+/// \param in the stream to read, to its end
+/// \param delimiter the character that ends a record, not part of it
+inline batch_generator<std::string_view>
+read_delimited(input_stream<char>& in, char delimiter = '\n') {
+    std::vector<std::string_view> records;
+    // The start of a record that goes on in the next buffer
+    sstring carry;
+    while (true) {
+        temporary_buffer<char> buf = co_await in.read();
+        if (buf.empty()) {
+            break;
+        }
+        records.clear();
+        std::string_view data(buf.get(), buf.size());
+        // The record completing carry, kept until the batch is consumed
+        sstring joined;
+        for (auto pos = data.find(delimiter); pos != std::string_view::npos; pos = data.find(delimiter)) {
+            if (carry.empty()) {
+                records.emplace_back(data.data(), pos);
+            } else {
+                carry.append(data.data(), pos);
+                joined = std::exchange(carry, {});
+                records.emplace_back(joined);
+            }
+            data.remove_prefix(pos + 1);
+        }
+        carry.append(data.data(), data.size());
+        if (!records.empty()) {
+            co_yield records;
+        }
+    }
+    if (!carry.empty()) {
+        records.clear();
+        records.emplace_back(carry);
+        co_yield records;
+    }
+}
+
+}
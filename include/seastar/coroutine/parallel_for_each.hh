@@ -21,7 +21,10 @@
 
 #pragma once
 
+#include <memory>
 #include <ranges>
+#include <variant>
+#include <vector>
 
 #include <boost/container/small_vector.hpp>
 
@@ -180,6 +183,276 @@ template <std::ranges::range Range, typename Func>
 requires std::invocable<Func, std::ranges::range_reference_t<Range>>
 parallel_for_each(Range&& range, Func&& func) -> parallel_for_each<Func>;
 
+namespace internal {
 
+// The machinery behind max_concurrent_for_each and max_concurrent_map: a
+// window of slots, each a continuation waiting for one invocation of the
+// function. When an invocation completes, its slot starts the next one in
+// its place, so the number in flight stays at the limit without any
+// allocation per element. Invocations that complete right away are
+// consumed in a loop, which yields when preemption is needed.
+template <typename Iterator, typename Sentinel, typename Func, typename Future>
+class concurrency_window {
+protected:
+    using value_type = typename Future::value_type;
+    static constexpr bool has_results = !std::is_same_v<value_type, seastar::internal::monostate>;
+    using results_type = std::conditional_t<has_results, std::vector<value_type>, std::monostate>;
+
+    struct slot final : continuation_base_from_future_t<Future> {
+        concurrency_window* window = nullptr;
+        // Of the element being processed
+        size_t index = 0;
+        // Scheduled to carry on after preemption rather than waiting
+        bool yielded = false;
+
+        // To reuse the slot as a continuation, its state has to be reset
+        // before setting it again
+        void wait_for(Future&& fut) noexcept {
+            this->_state = {};
+            seastar::internal::set_callback(std::move(fut), this);
+        }
+
+        virtual void run_and_dispose() noexcept override {
+            if (yielded) {
+                yielded = false;
+            } else {
+                window->consume(index, std::move(this->_state));
+            }
+            window->on_ready(*this);
+        }
+        virtual task* waiting_task() noexcept override {
+            return window->_waiting_task;
+        }
+    };
+
+    Iterator _begin;
+    Sentinel _end;
+    Func _func;
+    size_t _max_concurrent;
+    size_t _next_index = 0;
+    std::unique_ptr<slot[]> _slots;
+    // Slots with an invocation in flight
+    size_t _active = 0;
+    results_type _results;
+    std::exception_ptr _ex;
+    SEASTAR_INTERNAL_COROUTINE_NAMESPACE::coroutine_handle<void> _when_ready;
+    task* _waiting_task = nullptr;
+
+    void set_result(size_t index, value_type&& value) {
+        if (index >= _results.size()) {
+            _results.resize(index + 1);
+        }
+        _results[index] = std::move(value);
+    }
+
+    void set_exception(std::exception_ptr ex) noexcept {
+        // The first one wins, like seastar::max_concurrent_for_each()
+        if (!_ex) {
+            _ex = std::move(ex);
+        }
+    }
+
+    void consume(size_t index, Future&& fut) noexcept {
+        if (fut.failed()) {
+            set_exception(fut.get_exception());
+            return;
+        }
+        if constexpr (has_results) {
+            try {
+                set_result(index, fut.get0());
+            } catch (...) {
+                set_exception(std::current_exception());
+            }
+        }
+    }
+
+    template <typename State>
+    void consume(size_t index, State&& state) noexcept {
+        if (state.failed()) {
+            set_exception(std::move(state).get_exception());
+            return;
+        }
+        if constexpr (has_results) {
+            try {
+                set_result(index, std::move(state).take_value());
+            } catch (...) {
+                set_exception(std::current_exception());
+            }
+        }
+    }
+
+    // Starts invocations in the slot until one does not complete right
+    // away. Returns whether the slot has one in flight.
+    bool run(slot& s) noexcept {
+        while (_begin != _end) {
+            if (need_preempt()) {
+                s.yielded = true;
+                seastar::schedule(&s);
+                return true;
+            }
+            auto index = _next_index++;
+            auto fut = futurize_invoke(_func, *_begin);
+            ++_begin;
+            if (fut.available()) {
+                consume(index, std::move(fut));
+                continue;
+            }
+            s.index = index;
+            s.wait_for(std::move(fut));
+            return true;
+        }
+        return false;
+    }
+
+    void on_ready(slot& s) noexcept {
+        if (!run(s) && --_active == 0) {
+            // Nothing may touch this after the coroutine resumes
+            _when_ready.resume();
+        }
+    }
+
+public:
+    template <typename Func1>
+    concurrency_window(Iterator begin, Sentinel end, size_t max_concurrent, Func1&& func) noexcept
+        : _begin(std::move(begin))
+        , _end(std::move(end))
+        , _func(std::forward<Func1>(func))
+        , _max_concurrent(max_concurrent) {
+        assert(max_concurrent > 0);
+    }
+
+    // Only movable until awaited, as nothing runs before
+    concurrency_window(concurrency_window&&) = default;
+
+    bool await_ready() {
+        size_t n = _max_concurrent;
+        if constexpr (seastar::internal::has_iterator_category<Iterator>::value) {
+            using itraits = std::iterator_traits<Iterator>;
+            size_t estimate = seastar::internal::iterator_range_estimate_vector_capacity(_begin, _end, typename itraits::iterator_category{});
+            if (estimate) {
+                n = std::min(n, estimate);
+                if constexpr (has_results) {
+                    _results.reserve(estimate);
+                }
+            }
+        }
+        _slots = std::make_unique<slot[]>(n);
+        for (size_t i = 0; i < n && _begin != _end; i++) {
+            _slots[i].window = this;
+            if (run(_slots[i])) {
+                ++_active;
+            }
+        }
+        return _active == 0;
+    }
+
+    template<typename T>
+    void await_suspend(SEASTAR_INTERNAL_COROUTINE_NAMESPACE::coroutine_handle<T> h) noexcept {
+        _when_ready = h;
+        _waiting_task = &h.promise();
+    }
+};
+
+}
+
+/// Invoke a function on all elements in a range, with at most a given
+/// number of invocations in flight, and wait for all of them to complete
+/// in a coroutine.
+///
+/// Unlike `parallel_for_each`, which starts an invocation for every element
+/// at once, only \c max_concurrent invocations run at a time: each one that
+/// completes makes room for the next element. This keeps memory and I/O
+/// queue depth bounded for ranges of any size, even lazy ones such as
+/// `std::views::iota(0, n)`. The window takes one allocation of
+/// \c max_concurrent slots, none per element.
+///
+/// If one or more of the function invocations resolves to an exception,
+/// the first one is re-thrown once all of them are done.
+///
+/// Example
+///
+/// ```
+/// co_await coroutine::max_concurrent_for_each(keys, 100, [&] (const key& k) {
+///     return store.remove(k);
+/// });
+/// ```
+///
+/// Safe for use with lambda coroutines.
+template <typename Iterator, typename Sentinel, typename Func>
+class [[nodiscard("must co_await a max_concurrent_for_each() object")]] max_concurrent_for_each final
+        : public internal::concurrency_window<Iterator, Sentinel, Func, future<>> {
+    using base = internal::concurrency_window<Iterator, Sentinel, Func, future<>>;
+public:
+    template <typename Func1>
+    requires std::same_as<future<>, futurize_t<std::invoke_result_t<Func, std::iter_reference_t<Iterator>>>>
+    explicit max_concurrent_for_each(Iterator begin, Sentinel end, size_t max_concurrent, Func1&& func) noexcept
+        : base(std::move(begin), std::move(end), max_concurrent, std::forward<Func1>(func))
+    { }
+
+    template <std::ranges::range Range, typename Func1>
+    explicit max_concurrent_for_each(Range&& range, size_t max_concurrent, Func1&& func) noexcept
+        : max_concurrent_for_each(std::ranges::begin(range), std::ranges::end(range), max_concurrent, std::forward<Func1>(func))
+    { }
+
+    void await_resume() {
+        if (this->_ex) [[unlikely]] {
+            std::rethrow_exception(std::move(this->_ex));
+        }
+    }
+};
+
+template <typename Iterator, typename Sentinel, typename Func>
+max_concurrent_for_each(Iterator begin, Sentinel end, size_t max_concurrent, Func&& func)
+    -> max_concurrent_for_each<Iterator, Sentinel, std::decay_t<Func>>;
+
+template <std::ranges::range Range, typename Func>
+max_concurrent_for_each(Range&& range, size_t max_concurrent, Func&& func)
+    -> max_concurrent_for_each<std::ranges::iterator_t<Range>, std::ranges::sentinel_t<Range>, std::decay_t<Func>>;
+
+/// Like `max_concurrent_for_each`, with a function returning a `future<T>`,
+/// and results in a `std::vector<T>` in the order of the range, however the
+/// invocations complete. \c T has to be default constructible.
+///
+/// Example
+///
+/// ```
+/// std::vector<value> values = co_await coroutine::max_concurrent_map(keys, 100, [&] (const key& k) {
+///     return store.get(k);
+/// });
+/// ```
+template <typename Iterator, typename Sentinel, typename Func>
+class [[nodiscard("must co_await a max_concurrent_map() object")]] max_concurrent_map final
+        : public internal::concurrency_window<Iterator, Sentinel, Func,
+                futurize_t<std::invoke_result_t<Func, std::iter_reference_t<Iterator>>>> {
+    using future_type = futurize_t<std::invoke_result_t<Func, std::iter_reference_t<Iterator>>>;
+    using base = internal::concurrency_window<Iterator, Sentinel, Func, future_type>;
+public:
+    template <typename Func1>
+    requires (!std::is_same_v<typename future_type::value_type, seastar::internal::monostate>)
+        && std::default_initializable<typename future_type::value_type>
+    explicit max_concurrent_map(Iterator begin, Sentinel end, size_t max_concurrent, Func1&& func) noexcept
+        : base(std::move(begin), std::move(end), max_concurrent, std::forward<Func1>(func))
+    { }
+
+    template <std::ranges::range Range, typename Func1>
+    explicit max_concurrent_map(Range&& range, size_t max_concurrent, Func1&& func) noexcept
+        : max_concurrent_map(std::ranges::begin(range), std::ranges::end(range), max_concurrent, std::forward<Func1>(func))
+    { }
+
+    std::vector<typename future_type::value_type> await_resume() {
+        if (this->_ex) [[unlikely]] {
+            std::rethrow_exception(std::move(this->_ex));
+        }
+        return std::move(this->_results);
+    }
+};
+
+template <typename Iterator, typename Sentinel, typename Func>
+max_concurrent_map(Iterator begin, Sentinel end, size_t max_concurrent, Func&& func)
+    -> max_concurrent_map<Iterator, Sentinel, std::decay_t<Func>>;
+
+template <std::ranges::range Range, typename Func>
+max_concurrent_map(Range&& range, size_t max_concurrent, Func&& func)
+    -> max_concurrent_map<std::ranges::iterator_t<Range>, std::ranges::sentinel_t<Range>, std::decay_t<Func>>;
 
 }
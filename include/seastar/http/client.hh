@@ -0,0 +1,145 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#pragma once
+
+#include <seastar/core/condition-variable.hh>
+#include <seastar/core/gate.hh>
+#include <seastar/core/iostream.hh>
+#include <seastar/core/shared_ptr.hh>
+#include <seastar/http/exception.hh>
+#include <seastar/http/reply.hh>
+#include <seastar/http/request.hh>
+#include <seastar/http/response_parser.hh>
+#include <seastar/net/api.hh>
+#include <seastar/util/noncopyable_function.hh>
+#include <optional>
+#include <vector>
+
+namespace seastar {
+
+namespace http {
+
+/**
+ * Makes the connections of a client, e.g. TLS ones or ones bound to
+ * a local address
+ */
+class connection_factory {
+public:
+    virtual ~connection_factory() {}
+    virtual future<connected_socket> make() = 0;
+};
+
+/**
+ * Makes plain connections to an address
+ */
+class basic_connection_factory : public connection_factory {
+    socket_address _addr;
+public:
+    explicit basic_connection_factory(socket_address addr) : _addr(std::move(addr)) {}
+    virtual future<connected_socket> make() override;
+};
+
+/**
+ * Thrown when a response has another status than the expected one
+ */
+class unexpected_status_error : public httpd::base_exception {
+public:
+    explicit unexpected_status_error(httpd::reply::status_type status)
+            : base_exception(format("unexpected HTTP status {}", int(status)), status) {
+    }
+};
+
+struct client_options {
+    /// The most connections opened to the server at once
+    unsigned max_connections = 100;
+    /// The most requests sent ahead of their responses over one connection.
+    /// Connections are only shared by requests once all of them are in use,
+    /// and 1 disables pipelining altogether, which is safest: a request
+    /// pipelined behind one the server fails fails too.
+    unsigned max_pipelined_requests = 1;
+};
+
+/**
+ * A client of a single HTTP/1.1 server
+ *
+ * Connections are kept open after their requests and reused by the following
+ * ones, as long as the server does not ask for them to be closed. Clients are
+ * not shared between shards, each shard that talks to the server keeps its
+ * own client, and a service talking to several servers one client per server.
+ */
+class client {
+public:
+    using reply_handler = noncopyable_function<future<>(const http_response&, input_stream<char>& body)>;
+private:
+    class connection;
+    std::unique_ptr<connection_factory> _factory;
+    client_options _options;
+    std::vector<lw_shared_ptr<connection>> _connections;
+    unsigned _connecting = 0;
+    uint64_t _total_new_connections = 0;
+    condition_variable _connection_released;
+    gate _gate;
+public:
+    explicit client(socket_address addr, client_options options = {});
+    explicit client(std::unique_ptr<connection_factory> factory, client_options options = {});
+    ~client();
+
+    /**
+     * Sends a request and hands its response to a handler
+     *
+     * The handler may read the body from the stream it is given; what it leaves
+     * unread is skipped, so that the connection can serve further requests.
+     * A request that failed because the server closed an idle connection is
+     * resent over a new one, unless its body is streamed.
+     *
+     * @param req the request, see request::make() and request::write_body()
+     * @param handle called with the response, and its body
+     * @param expected if set, responses with another status fail with unexpected_status_error
+     *                 and are not handed to the handler
+     */
+    future<> make_request(httpd::request req, reply_handler handle, std::optional<httpd::reply::status_type> expected = std::nullopt);
+
+    /**
+     * Waits for the requests in progress and closes the connections
+     */
+    future<> close();
+
+    /// Connections currently open
+    unsigned connections() const noexcept {
+        return _connections.size();
+    }
+
+    /// Connections opened over the client's lifetime
+    uint64_t total_new_connections() const noexcept {
+        return _total_new_connections;
+    }
+
+private:
+    future<lw_shared_ptr<connection>> get_connection();
+    future<lw_shared_ptr<connection>> make_connection();
+    void release_connection(lw_shared_ptr<connection> con);
+    future<> do_make_request(httpd::request& req, reply_handler& handle, std::optional<httpd::reply::status_type> expected, bool may_retry);
+};
+
+}
+
+}
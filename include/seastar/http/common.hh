@@ -23,6 +23,7 @@
 
 #include <unordered_map>
 #include <seastar/core/sstring.hh>
+#include <seastar/core/iostream.hh>
 
 namespace seastar {
 
@@ -71,4 +72,17 @@ operation_type str2type(const sstring& type);
 
 }
 
+namespace http {
+
+namespace internal {
+
+// Streams written to these encode the body onto out, closing them does not close out
+output_stream<char> make_http_chunked_output_stream(output_stream<char>& out);
+// The body is expected to be exactly len bytes long
+output_stream<char> make_http_content_length_output_stream(output_stream<char>& out, size_t len);
+
+}
+
+}
+
 }
@@ -0,0 +1,125 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#pragma once
+
+#include <seastar/core/future.hh>
+#include <seastar/core/iostream.hh>
+#include <seastar/core/sstring.hh>
+#include <string_view>
+#include <vector>
+
+namespace seastar {
+
+namespace httpd {
+
+struct reply;
+
+/**
+ * The content codings of RFC 7231, section 3.1.2.1, and brotli (RFC 7932)
+ */
+enum class content_encoding {
+    identity,
+    deflate,
+    gzip,
+    br,
+};
+
+/**
+ * The name of the coding in Content-Encoding and Accept-Encoding
+ */
+std::string_view to_string(content_encoding e) noexcept;
+
+/**
+ * The codings this build can compress with, best first. br is only there
+ * when seastar is built with brotli.
+ */
+const std::vector<content_encoding>& supported_content_encodings() noexcept;
+
+/**
+ * Pick the coding to send a body in (RFC 7231, section 5.3.4)
+ * @param accept_encoding the Accept-Encoding header of the request
+ * @param candidates the codings to pick from, by preference of the server,
+ * which decides between those the client rates the same
+ * @return the coding, or identity when the client accepts none of them
+ */
+content_encoding negotiate_content_encoding(std::string_view accept_encoding,
+        const std::vector<content_encoding>& candidates);
+
+/**
+ * Whether bodies of a media type are worth compressing: text, JSON,
+ * JavaScript, XML and SVG are; images, video, archives and the like are
+ * compressed already.
+ * @param content_type the Content-Type header, parameters are ignored
+ */
+bool is_compressible(std::string_view content_type) noexcept;
+
+/**
+ * Wrap a stream so that what is written to it gets compressed on the way.
+ * flush() flushes the compressor as well, so that the peer can decode all
+ * that was written so far, and close() ends the compressed stream and
+ * closes \c out.
+ * @param out the stream to write the compressed data to
+ * @param e the coding, not identity
+ * @param level the compression level, from 1 to 9 for gzip and deflate and
+ * from 0 to 11 for br; -1 for the coding's default
+ */
+output_stream<char> make_compressed_output_stream(output_stream<char>&& out, content_encoding e, int level = -1);
+
+/**
+ * Compress a whole body, yielding between parts of it
+ */
+future<sstring> compress(sstring content, content_encoding e, int level = -1);
+
+/**
+ * How http_server compresses replies
+ */
+struct compression_config {
+    /**
+     * The codings to offer, by preference
+     */
+    std::vector<content_encoding> encodings = supported_content_encodings();
+    /**
+     * Contents shorter than this are sent as they are, the saving would not
+     * be worth the cost. Bodies written by a body writer have no size up
+     * front and are compressed regardless.
+     */
+    size_t min_size = 1024;
+    /**
+     * The compression level, see make_compressed_output_stream()
+     */
+    int level = -1;
+};
+
+/**
+ * Compress the body of a reply in the coding the client prefers, setting
+ * Content-Encoding and Vary accordingly. Replies without a compressible
+ * Content-Type, with a Content-Encoding already, or with a status that has
+ * no body are left as they are.
+ * @param rep the reply, done() already
+ * @param accept_encoding the Accept-Encoding header of the request
+ * @param cfg the compression configuration
+ */
+future<> compress_reply(reply& rep, std::string_view accept_encoding, const compression_config& cfg);
+
+}
+
+}
@@ -79,6 +79,19 @@ class file_interaction_handler : public handler_base {
         return this;
     }
 
+    /**
+     * Serve pre-compressed files: when the client accepts br or gzip and
+     * there is a file of the same name with a .br or .gz suffix next to
+     * the requested one, that file is sent with the matching
+     * Content-Encoding. Ignored while a transformer is set.
+     * @param b whether to look for pre-compressed files
+     * @return this
+     */
+    file_interaction_handler* set_precompressed(bool b) {
+        precompressed = b;
+        return this;
+    }
+
     /**
      * if the url ends without a slash redirect
      * @param req the request
@@ -104,7 +117,19 @@ class file_interaction_handler : public handler_base {
      */
     future<std::unique_ptr<reply> > read(sstring file,
             std::unique_ptr<request> req, std::unique_ptr<reply> rep);
+
+    /**
+     * read a file from the disk and return it in the reply, typed by the
+     * name of another (its uncompressed original)
+     * @param file the file the content type goes by
+     * @param path the full path to the file to read
+     * @param req the request
+     * @param rep the reply
+     */
+    future<std::unique_ptr<reply> > read(sstring file, sstring path,
+            std::unique_ptr<request> req, std::unique_ptr<reply> rep);
     file_transformer* transformer;
+    bool precompressed = false;
 
     output_stream<char> get_stream(std::unique_ptr<request> req,
             const sstring& extension, output_stream<char>&& s);
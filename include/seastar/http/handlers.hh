@@ -63,7 +63,21 @@ class handler_base {
         return *this;
     }
 
+    /**
+     * Have the request body passed to handle() as it arrives, through
+     * request::content_stream, rather than read into request::content
+     * first. This is what http_server::set_content_streaming() does for
+     * all handlers.
+     * @param b whether to stream the body
+     * @return a reference to the handler
+     */
+    handler_base& stream_content(bool b = true) {
+        _content_streaming = b;
+        return *this;
+    }
+
     std::vector<sstring> _mandatory_param;
+    bool _content_streaming = false;
 
 };
 
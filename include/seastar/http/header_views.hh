@@ -0,0 +1,124 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#pragma once
+
+#include <seastar/core/sstring.hh>
+#include <seastar/core/temporary_buffer.hh>
+#include <boost/container/small_vector.hpp>
+#include <deque>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace seastar {
+
+namespace httpd {
+
+/**
+ * Header fields kept as views into the buffers they were received in, so
+ * that parsing them neither copies nor allocates. Only the values that had
+ * to be put together (split between two buffers, folded or repeated) get
+ * strings of their own.
+ *
+ * Names are looked up case insensitively, by a scan of the fields while
+ * there are few of them, and through an index built on demand past that.
+ */
+class header_views {
+public:
+    using field = std::pair<std::string_view, std::string_view>;
+private:
+    struct case_insensitive_hash {
+        size_t operator()(std::string_view s) const noexcept;
+    };
+    struct case_insensitive_equal {
+        bool operator()(std::string_view a, std::string_view b) const noexcept;
+    };
+
+    static constexpr size_t scanned_fields = 16;
+
+    boost::container::small_vector<field, scanned_fields> _fields;
+    mutable std::unordered_map<std::string_view, size_t, case_insensitive_hash, case_insensitive_equal> _index;
+    std::vector<temporary_buffer<char>> _buffers;
+    std::deque<sstring> _strings;
+
+    size_t find_index(std::string_view name) const noexcept;
+public:
+    /**
+     * Keeps a buffer that views point into alive as long as the headers
+     */
+    void retain(temporary_buffer<char> buf) {
+        _buffers.push_back(std::move(buf));
+    }
+
+    /**
+     * Moves a string into the headers
+     * @return a view of the string, valid as long as the headers
+     */
+    std::string_view keep(sstring s) {
+        return _strings.emplace_back(std::move(s));
+    }
+
+    /**
+     * Adds a field, or appends the value to the field of the same name
+     * with a comma in between (RFC 7230, section 3.2.2)
+     */
+    void add(std::string_view name, std::string_view value) {
+        append(name, value, ",");
+    }
+
+    /**
+     * Appends to the value of the field, after the separator, or adds the
+     * field when there is none of that name
+     */
+    void append(std::string_view name, std::string_view value, std::string_view separator);
+
+    /**
+     * Search for a field
+     * @param name the field name
+     * @return a pointer to the value, or nullptr when there is no such field
+     */
+    const std::string_view* find(std::string_view name) const noexcept {
+        auto i = find_index(name);
+        return i == _fields.size() ? nullptr : &_fields[i].second;
+    }
+
+    bool empty() const noexcept {
+        return _fields.empty();
+    }
+
+    size_t size() const noexcept {
+        return _fields.size();
+    }
+
+    auto begin() const noexcept {
+        return _fields.begin();
+    }
+
+    auto end() const noexcept {
+        return _fields.end();
+    }
+};
+
+}
+
+}
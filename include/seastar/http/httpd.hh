@@ -30,6 +30,7 @@
 #include <seastar/core/distributed.hh>
 #include <seastar/core/queue.hh>
 #include <seastar/core/gate.hh>
+#include <seastar/core/semaphore.hh>
 #include <seastar/core/metrics_registration.hh>
 #include <seastar/util/std-compat.hh>
 #include <iostream>
@@ -38,11 +39,14 @@
 #include <queue>
 #include <bitset>
 #include <limits>
+#include <optional>
 #include <cctype>
 #include <vector>
 #include <boost/intrusive/list.hpp>
 #include <seastar/http/routes.hh>
+#include <seastar/http/compression.hh>
 #include <seastar/net/tls.hh>
+#include <seastar/net/memory_budget.hh>
 #include <seastar/core/shared_ptr.hh>
 
 namespace seastar {
@@ -53,6 +57,10 @@ class http_server;
 class http_stats;
 struct reply;
 
+namespace internal {
+class http2_connection;
+}
+
 using namespace std::chrono_literals;
 
 class http_stats {
@@ -74,15 +82,21 @@ class connection : public boost::intrusive::list_base_hook<> {
     // null element marks eof
     queue<std::unique_ptr<reply>> _replies { 10 };
     bool _done = false;
+    // HTTP/2 can only start before the first HTTP/1 request
+    bool _http1 = false;
+    // With pipelining, the requests being handled and the chain that queues
+    // their replies in the order of the requests
+    semaphore _pipeline_sem{0};
+    future<> _pipeline = make_ready_future<>();
+    bool _pipeline_broken = false;
+    // What the buffers of streamed request bodies may take up, see
+    // http_server::set_content_memory_limit()
+    lw_shared_ptr<semaphore> _content_memory;
 public:
     [[deprecated("use connection(http_server&, connected_socket&&)")]]
     connection(http_server& server, connected_socket&& fd,
             socket_address) : connection(server, std::move(fd)) {}
-    connection(http_server& server, connected_socket&& fd)
-            : _server(server), _fd(std::move(fd)), _read_buf(_fd.input()), _write_buf(
-                    _fd.output()) {
-        on_new_connection();
-    }
+    connection(http_server& server, connected_socket&& fd);
     ~connection();
     void on_new_connection();
 
@@ -92,6 +106,7 @@ class connection : public boost::intrusive::list_base_hook<> {
     future<> read_one();
     future<> respond();
     future<> do_response_loop();
+    future<> serve_http2();
 
     void set_headers(reply& resp);
 
@@ -125,9 +140,20 @@ class connection : public boost::intrusive::list_base_hook<> {
     future<bool> generate_reply(std::unique_ptr<request> req);
     void generate_error_reply_and_close(std::unique_ptr<request> req, reply::status_type status, const sstring& msg);
 
+    /**
+     * Whether requests are handled while those before them are, see
+     * http_server::set_max_pipelined_requests()
+     */
+    bool pipelined() const;
+
     future<> write_body();
 
     output_stream<char>& out();
+private:
+    future<std::unique_ptr<reply>> handle_request(std::unique_ptr<request> req);
+    future<> generate_reply_pipelined(std::unique_ptr<request> req, std::unique_ptr<input_stream<char>> content);
+    // Queues the reply once those of the requests before it are queued
+    void push_reply_in_order(future<std::unique_ptr<reply>> rep, semaphore_units<> units = {});
 };
 
 class http_server_tester;
@@ -144,12 +170,19 @@ class http_server {
     sstring _date = http_date();
     timer<> _date_format_timer { [this] {_date = http_date();} };
     size_t _content_length_limit = std::numeric_limits<size_t>::max();
+    size_t _content_memory_limit = std::numeric_limits<size_t>::max();
     bool _content_streaming = false;
+    sstring _name;
+    std::unique_ptr<net::connection_memory_budget> _connection_memory;
+    unsigned _max_pipelined_requests = 1;
+    bool _http2 = false;
+    bool _header_views = false;
+    std::optional<compression_config> _compression;
     gate _task_gate;
 public:
     routes _routes;
     using connection = seastar::httpd::connection;
-    explicit http_server(const sstring& name) : _stats(*this, name) {
+    explicit http_server(const sstring& name) : _stats(*this, name), _name(name) {
         _date_format_timer.arm_periodic(1s);
     }
     /*!
@@ -186,8 +219,97 @@ class http_server {
 
     bool get_content_streaming() const;
 
+    /*!
+     * \brief pass request bodies to all handlers through request::content_stream
+     *
+     * Handlers can also stream bodies on their own, see
+     * handler_base::stream_content().
+     */
     void set_content_streaming(bool b);
 
+    size_t get_content_memory_limit() const;
+
+    /*!
+     * \brief bound the memory taken by the streamed request bodies of a connection
+     *
+     * Once the buffers read from request::content_stream that are still
+     * held take up this much, reading from it waits for some of them to be
+     * released. The rest of the body is meanwhile left in the socket,
+     * throttling the client, so an upload can be written out at the speed
+     * of the disk with a bounded amount of memory. A handler must thus not
+     * hold more of the body than this at a time. Unlimited by default.
+     */
+    void set_content_memory_limit(size_t limit);
+
+    size_t get_connection_memory_limit() const;
+
+    /*!
+     * \brief bound the memory taken by the buffers of all connections
+     *
+     * The connection streams charge a \ref net::connection_memory_budget
+     * of this size, which shrinks their buffers as connections are added
+     * and pauses the reads and sends of those holding more than their
+     * share once it is used up. Its metrics are labelled with the name of
+     * the server. Must be set before the server starts listening.
+     * Unlimited by default.
+     */
+    void set_connection_memory_limit(size_t limit);
+
+    bool get_http2() const;
+
+    /*!
+     * \brief serve HTTP/2 to clients that start with its connection preface
+     *
+     * Such clients (with "prior knowledge" of HTTP/2, as there is no ALPN)
+     * get their requests on the connection multiplexed as HTTP/2 streams,
+     * dispatched to the same routes as HTTP/1 requests. Others are served
+     * HTTP/1.1 as before.
+     */
+    void set_http2(bool b);
+
+    bool get_header_views() const;
+
+    /*!
+     * \brief parse request headers into request::_header_views
+     *
+     * The headers are then views into the buffers they were received in,
+     * which the request keeps, so parsing them copies and allocates close to
+     * nothing. request::get_header() finds them as usual, but request::_headers
+     * is left empty, so only set this when the handlers do not use it.
+     */
+    void set_header_views(bool b);
+
+    unsigned get_max_pipelined_requests() const;
+
+    /*!
+     * \brief handle up to n pipelined requests of a connection at a time
+     *
+     * By default a connection reads the next request only once the handler
+     * of the current one is done. With n > 1 it goes on reading requests
+     * and passes them to their handlers while up to n - 1 earlier ones are
+     * still being handled, and sends the replies in the order of the
+     * requests. Handlers of a connection must then be fine with running
+     * concurrently.
+     *
+     * A request's body has to be read before the next request can be, so
+     * requests with a streamed body are handled once all those before them
+     * have been replied to.
+     */
+    void set_max_pipelined_requests(unsigned n);
+
+    const std::optional<compression_config>& get_compression() const;
+
+    /*!
+     * \brief compress replies in a coding the client accepts
+     *
+     * The Accept-Encoding header of each request picks one of the
+     * configured codings, see compress_reply(). Handlers that set
+     * Content-Encoding themselves (such as a file_handler serving
+     * pre-compressed files) are left alone. std::nullopt, the default,
+     * turns compression off.
+     */
+    void set_compression(std::optional<compression_config> c);
+
     future<> listen(socket_address addr, listen_options lo);
     future<> listen(socket_address addr);
     future<> stop();
@@ -204,8 +326,13 @@ class http_server {
     static sstring http_date();
 private:
     future<> do_accept_one(int which);
+    // Whether the handler of the request gets its body as a stream
+    bool streams_content(const request& req);
+    // Compresses the reply as set by set_compression()
+    future<std::unique_ptr<reply>> compress(const sstring& accept_encoding, std::unique_ptr<reply> rep);
     boost::intrusive::list<connection> _connections;
     friend class seastar::httpd::connection;
+    friend class internal::http2_connection;
     friend class http_server_tester;
 };
 
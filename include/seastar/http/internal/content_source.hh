@@ -23,6 +23,8 @@
 
 #include <seastar/http/chunk_parsers.hh>
 #include <seastar/core/iostream.hh>
+#include <seastar/core/semaphore.hh>
+#include <seastar/core/shared_ptr.hh>
 #include <seastar/core/temporary_buffer.hh>
 #include <seastar/http/common.hh>
 #include <seastar/util/log.hh>
@@ -221,6 +223,48 @@ class chunked_source_impl : public data_source_impl {
     }
 };
 
+/*
+ * A data source wrapper that bounds the memory the buffers read from it
+ * take up until they are released. Once the limit is reached, reading waits
+ * for earlier buffers to be freed, which in turn leaves the rest of the
+ * body in the socket, so that the sender is throttled by TCP flow control.
+ * */
+class budgeted_source_impl : public data_source_impl {
+    data_source _src;
+    // Shared with the buffers, which can outlive the source
+    lw_shared_ptr<semaphore> _memory;
+    size_t _limit;
+public:
+    budgeted_source_impl(data_source src, lw_shared_ptr<semaphore> memory, size_t limit)
+        : _src(std::move(src)), _memory(std::move(memory)), _limit(limit) {
+    }
+
+    virtual future<temporary_buffer<char>> get() override {
+        return _src.get().then([this] (temporary_buffer<char> buf) {
+            if (buf.empty()) {
+                return make_ready_future<temporary_buffer<char>>(std::move(buf));
+            }
+            // A buffer larger than the whole budget takes all of it
+            size_t units = std::min(buf.size(), _limit);
+            return _memory->wait(units).then([this, units, buf = std::move(buf)] () mutable {
+                char* p = buf.get_write();
+                size_t size = buf.size();
+                return temporary_buffer<char>(p, size, make_deleter(buf.release(), [memory = _memory, units] {
+                    memory->signal(units);
+                }));
+            });
+        });
+    }
+
+    virtual future<temporary_buffer<char>> skip(uint64_t n) override {
+        return _src.skip(n);
+    }
+
+    virtual future<> close() override {
+        return _src.close();
+    }
+};
+
 } // namespace internal
 
 } // namespace httpd
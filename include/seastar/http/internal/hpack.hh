@@ -0,0 +1,87 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#pragma once
+
+#include <seastar/core/sstring.hh>
+#include <deque>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace seastar {
+
+namespace http {
+
+namespace internal {
+
+// HPACK, the header compression of HTTP/2 (RFC 7541)
+
+using header_field = std::pair<sstring, sstring>;
+
+// A malformed header block, a connection error of type COMPRESSION_ERROR
+class hpack_error : public std::runtime_error {
+public:
+    explicit hpack_error(const char* what) : std::runtime_error(what) {}
+};
+
+class hpack_decoder {
+    // Newest entry first
+    std::deque<header_field> _table;
+    size_t _size = 0;
+    size_t _max_size;
+    // The most the peer may make _max_size, as advertised in SETTINGS
+    size_t _limit;
+public:
+    explicit hpack_decoder(size_t max_table_size = 4096)
+            : _max_size(max_table_size), _limit(max_table_size) {
+    }
+
+    // Decodes a whole header block. The fields are returned in their order in
+    // the block, and the dynamic table is updated even when this throws, as it
+    // is shared by all the blocks of a connection.
+    std::vector<header_field> decode(std::string_view block);
+
+    size_t table_size() const noexcept {
+        return _size;
+    }
+private:
+    const header_field& lookup(uint64_t index) const;
+    void insert(header_field field);
+    void evict(size_t max_size);
+};
+
+// Encodes header fields without adding them to the dynamic table, so that the
+// encoder has no state to keep in sync with the peer; fields of the static
+// table are indexed and strings are Huffman coded when that makes them shorter.
+class hpack_encoder {
+public:
+    // Appends the field to a header block
+    void encode(std::string& out, std::string_view name, std::string_view value) const;
+};
+
+}
+
+}
+
+}
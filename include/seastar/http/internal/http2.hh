@@ -0,0 +1,114 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#pragma once
+
+#include <seastar/http/internal/hpack.hh>
+#include <seastar/core/condition-variable.hh>
+#include <seastar/core/gate.hh>
+#include <seastar/core/iostream.hh>
+#include <seastar/core/semaphore.hh>
+#include <seastar/core/shared_ptr.hh>
+#include <seastar/core/temporary_buffer.hh>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+namespace seastar {
+
+namespace httpd {
+
+class http_server;
+struct request;
+struct reply;
+
+namespace internal {
+
+// The server side of an HTTP/2 connection (RFC 7540), taken over from
+// httpd::connection once the client preface has been read. The requests of
+// all the streams go to the routes of the server concurrently, and their
+// replies are interleaved on the connection as the peer's flow control
+// windows allow.
+class http2_connection {
+    struct stream;
+    class body_source;
+    class body_sink;
+
+    http_server& _server;
+    input_stream<char>& _in;
+    output_stream<char>& _out;
+    bool _tls;
+    std::unordered_map<uint32_t, lw_shared_ptr<stream>> _streams;
+    http::internal::hpack_decoder _decoder;
+    http::internal::hpack_encoder _encoder;
+    uint32_t _last_stream_id = 0;
+    // A header block that waits for its CONTINUATION frames
+    uint32_t _continued_stream = 0;
+    bool _continued_end_stream = false;
+    std::string _header_block;
+    // What the peer lets us send on the connection, and its settings
+    int64_t _send_window;
+    int64_t _peer_initial_window;
+    size_t _peer_max_frame_size;
+    // Signalled when a window grows or a stream is reset
+    condition_variable _window_cv;
+    // Frames are written whole, one at a time
+    semaphore _write_sem { 1 };
+    gate _streams_gate;
+    bool _settings_received = false;
+    bool _eof = false;
+public:
+    http2_connection(http_server& server, input_stream<char>& in, output_stream<char>& out, bool tls);
+    ~http2_connection();
+
+    // Serves the connection until the peer closes it or breaks the protocol,
+    // and then waits for the replies of the streams it had opened.
+    future<> process();
+private:
+    future<> read_frame();
+    future<> handle_frame(uint8_t type, uint8_t flags, uint32_t stream_id, temporary_buffer<char> payload);
+    // The payload of a DATA frame of the given size, as the fragments it
+    // was read in
+    future<> handle_data(uint8_t flags, uint32_t stream_id, std::vector<temporary_buffer<char>> payload, size_t size);
+    future<> handle_headers(uint8_t flags, uint32_t stream_id, temporary_buffer<char> payload);
+    future<> handle_continuation(uint8_t flags, uint32_t stream_id, temporary_buffer<char> payload);
+    future<> handle_header_block(uint32_t stream_id, bool end_stream);
+    future<> handle_settings(uint8_t flags, uint32_t stream_id, temporary_buffer<char> payload);
+    future<> handle_window_update(uint32_t stream_id, temporary_buffer<char> payload);
+    void handle_rst_stream(uint32_t stream_id, temporary_buffer<char> payload);
+
+    future<> serve(lw_shared_ptr<stream> s, std::unique_ptr<request> req);
+    future<> send_reply(lw_shared_ptr<stream> s, std::unique_ptr<reply> rep);
+    future<> send_data(lw_shared_ptr<stream> s, temporary_buffer<char> buf, bool end_stream);
+    future<> consumed(stream& s, size_t size);
+    void reset(stream& s, std::exception_ptr ex);
+
+    future<> write_frame(uint8_t type, uint8_t flags, uint32_t stream_id, temporary_buffer<char> payload);
+    future<> send_frame(uint8_t type, uint8_t flags, uint32_t stream_id, temporary_buffer<char> payload = {});
+    future<> send_rst_stream(uint32_t stream_id, uint32_t error_code);
+    future<> send_window_update(uint32_t stream_id, uint32_t increment);
+};
+
+}
+
+}
+
+}
@@ -0,0 +1,177 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#pragma once
+
+#include <seastar/core/bitops.hh>
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <string_view>
+#include <utility>
+#include <vector>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace seastar {
+
+namespace httpd {
+
+namespace internal {
+
+// A pre-scanner for the common case of http_request_parser: a request head
+// which is whole in one buffer, and holds nothing but the plain syntax. Runs
+// of URI and of field value characters are skipped 16 bytes at a time, in
+// the manner of picohttpparser, rather than a state transition per byte.
+// Anything else (a head split between buffers, obs-fold, control
+// characters, invalid field names) is left to the ragel machine, which
+// then parses the head from its start, so the scanner only has to be right
+// about what it accepts.
+
+inline constexpr auto tchar_map = [] {
+    std::array<bool, 256> m{};
+    for (int c = '0'; c <= '9'; c++) {
+        m[c] = true;
+    }
+    for (int c = 'a'; c <= 'z'; c++) {
+        m[c] = m[c - 'a' + 'A'] = true;
+    }
+    for (char c : std::string_view("!#$%&'*+-.^_`|~")) {
+        m[static_cast<unsigned char>(c)] = true;
+    }
+    return m;
+}();
+
+inline bool is_tchar(char c) noexcept {
+    return tchar_map[static_cast<unsigned char>(c)];
+}
+
+inline bool is_sp_ht(char c) noexcept {
+    return c == ' ' || c == '\t';
+}
+
+// The position of the first byte from i that is stop, or a control
+// character other than a tab, or DEL; or n
+inline size_t find_special(const char* p, size_t i, size_t n, char stop) noexcept {
+#ifdef __SSE2__
+    // Control characters are those the unsigned max with 0x1F leaves at 0x1F
+    const __m128i s = _mm_set1_epi8(stop);
+    const __m128i control = _mm_set1_epi8(0x1F);
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i del = _mm_set1_epi8(0x7F);
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        __m128i ctl = _mm_andnot_si128(_mm_cmpeq_epi8(v, tab), _mm_cmpeq_epi8(_mm_max_epu8(v, control), control));
+        __m128i special = _mm_or_si128(ctl, _mm_or_si128(_mm_cmpeq_epi8(v, s), _mm_cmpeq_epi8(v, del)));
+        unsigned mask = _mm_movemask_epi8(special);
+        if (mask) {
+            return i + count_trailing_zeros(mask);
+        }
+    }
+#endif
+    for (; i < n; ++i) {
+        auto c = static_cast<unsigned char>(p[i]);
+        if (c == static_cast<unsigned char>(stop) || (c < 0x20 && c != '\t') || c == 0x7F) {
+            break;
+        }
+    }
+    return i;
+}
+
+struct scanned_request {
+    std::string_view method;
+    std::string_view url;
+    std::string_view version;
+    // Values without the white space around them
+    std::vector<std::pair<std::string_view, std::string_view>> fields;
+};
+
+// Scans the request head at the start of [p, p + n) into r.
+// Returns the length of the head, or 0 when it is not whole in the range
+// or is not of the plain syntax, for the ragel machine to decide on.
+inline size_t scan_request_head(const char* p, size_t n, scanned_request& r) {
+    r.fields.clear();
+    size_t i = 0;
+    while (i < n && p[i] >= 'A' && p[i] <= 'Z') {
+        ++i;
+    }
+    if (i == 0 || i == n || p[i] != ' ') {
+        return 0;
+    }
+    r.method = std::string_view(p, i);
+    size_t start = ++i;
+    i = find_special(p, i, n, ' ');
+    if (i == start || i == n || p[i] != ' ') {
+        return 0;
+    }
+    r.url = std::string_view(p + start, i - start);
+    ++i;
+    auto is_digit = [] (char c) { return c >= '0' && c <= '9'; };
+    if (n - i < 10 || std::memcmp(p + i, "HTTP/", 5) || !is_digit(p[i + 5]) || p[i + 6] != '.' || !is_digit(p[i + 7])
+            || p[i + 8] != '\r' || p[i + 9] != '\n') {
+        return 0;
+    }
+    r.version = std::string_view(p + i + 5, 3);
+    i += 10;
+    for (;;) {
+        if (i == n) {
+            return 0;
+        }
+        if (p[i] == '\r') {
+            return i + 1 < n && p[i + 1] == '\n' ? i + 2 : 0;
+        }
+        start = i;
+        i = find_special(p, i, n, ':');
+        if (i == start || i == n || p[i] != ':') {
+            return 0;
+        }
+        for (size_t j = start; j < i; j++) {
+            if (!is_tchar(p[j])) {
+                return 0;
+            }
+        }
+        std::string_view name(p + start, i - start);
+        ++i;
+        while (i < n && is_sp_ht(p[i])) {
+            ++i;
+        }
+        start = i;
+        i = find_special(p, i, n, '\r');
+        // The byte after the CRLF tells whether the next line continues
+        // the value
+        if (n - i < 3 || p[i] != '\r' || p[i + 1] != '\n' || is_sp_ht(p[i + 2])) {
+            return 0;
+        }
+        size_t end = i;
+        while (end > start && is_sp_ht(p[end - 1])) {
+            --end;
+        }
+        r.fields.emplace_back(name, std::string_view(p + start, end - start));
+        i += 2;
+    }
+}
+
+}
+
+}
+
+}
@@ -0,0 +1,89 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#pragma once
+
+#include <seastar/http/matchrules.hh>
+#include <seastar/core/sstring.hh>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <memory>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace seastar {
+
+namespace httpd {
+
+namespace internal {
+
+// The match rules of one operation, compiled into a tree over the segments
+// of the url ("/a", "/b" of "/a/b"), so that a lookup costs about the length
+// of the url instead of a run of every rule.
+//
+// Rules made of str_matcher and param_matcher are in the tree, any other rule
+// is run as is. The result is the same as running the rules in the order of
+// their cookies and taking the first that matches.
+class route_tree {
+    static constexpr uint64_t no_cookie = std::numeric_limits<uint64_t>::max();
+
+    struct leaf {
+        uint64_t cookie;
+        handler_base* handler;
+        // The names of the rule's parameters, in the order of the url
+        std::vector<sstring> params;
+    };
+
+    struct node {
+        // Owns the key of the node in its parent's literals
+        sstring segment;
+        std::unordered_map<std::string_view, std::unique_ptr<node>> literals;
+        std::unique_ptr<node> param;
+        // The first rule that ends here, and the first whose last parameter
+        // takes the rest of the url from here on
+        const leaf* end = nullptr;
+        const leaf* rest = nullptr;
+        // The first cookie of the subtree, a lookup skips subtrees that
+        // cannot hold a better rule than the one it found
+        uint64_t min_cookie = no_cookie;
+    };
+
+    struct match;
+
+    node _root;
+    std::vector<std::unique_ptr<leaf>> _leaves;
+    std::vector<std::pair<uint64_t, match_rule*>> _others;
+public:
+    explicit route_tree(const std::map<uint64_t, match_rule*>& rules);
+
+    handler_base* get(const sstring& url, parameters& params) const;
+private:
+    bool insert(uint64_t cookie, const match_rule& rule);
+    void find(const node& n, std::string_view url, size_t pos, match& m) const;
+};
+
+}
+
+}
+
+}
@@ -43,6 +43,11 @@ namespace httpd {
 
 class connection;
 class routes;
+struct compression_config;
+
+namespace internal {
+class http2_connection;
+}
 
 /**
  * A reply to be sent to a client.
@@ -196,6 +201,8 @@ struct reply {
     noncopyable_function<future<>(output_stream<char>&&)> _body_writer;
     friend class routes;
     friend class connection;
+    friend class internal::http2_connection;
+    friend future<> compress_reply(reply& rep, std::string_view accept_encoding, const compression_config& cfg);
 };
 
 } // namespace httpd
@@ -36,7 +36,11 @@
 #include <vector>
 #include <strings.h>
 #include <seastar/http/common.hh>
+#include <seastar/http/header_views.hh>
 #include <seastar/core/iostream.hh>
+#include <seastar/core/print.hh>
+#include <seastar/util/noncopyable_function.hh>
+#include <seastar/util/ascii.hh>
 
 namespace seastar {
 
@@ -53,16 +57,14 @@ struct request {
     };
 
     struct case_insensitive_cmp {
-        bool operator()(const sstring& s1, const sstring& s2) const {
-            return std::equal(s1.begin(), s1.end(), s2.begin(), s2.end(),
-                    [](char a, char b) { return ::tolower(a) == ::tolower(b); });
+        bool operator()(std::string_view s1, std::string_view s2) const noexcept {
+            return ascii_iequals(s1, s2);
         }
     };
 
     struct case_insensitive_hash {
-        size_t operator()(sstring s) const {
-            std::transform(s.begin(), s.end(), s.begin(), ::tolower);
-            return std::hash<sstring>()(s);
+        size_t operator()(std::string_view s) const noexcept {
+            return ascii_ihash(s);
         }
     };
 
@@ -74,6 +76,9 @@ struct request {
     ctclass content_type_class;
     size_t content_length = 0;
     std::unordered_map<sstring, sstring, case_insensitive_hash, case_insensitive_cmp> _headers;
+    // The headers of a request received with http_server::set_header_views(),
+    // which leaves _headers empty
+    header_views _header_views;
     std::unordered_map<sstring, sstring> query_parameters;
     connection* connection_ptr;
     parameters param;
@@ -87,6 +92,11 @@ struct request {
     std::unordered_map<sstring, sstring> trailing_headers;
     std::unordered_map<sstring, sstring> chunk_extensions;
     sstring protocol_name = "http";
+    /*
+     * Used by http::client: writes the body of an outgoing request instead of content,
+     * see write_body(). It has to close the stream it is given once it is done.
+     * */
+    noncopyable_function<future<>(output_stream<char>&&)> body_writer;
 
     /**
      * Search for the first header of a given name
@@ -96,7 +106,8 @@ struct request {
     sstring get_header(const sstring& name) const {
         auto res = _headers.find(name);
         if (res == _headers.end()) {
-            return "";
+            auto view = _header_views.find(name);
+            return view ? sstring(*view) : "";
         }
         return res->second;
     }
@@ -144,14 +155,63 @@ struct request {
 
         // TODO: handle HTTP/2.0 when it releases
 
-        auto it = _headers.find("Connection");
+        auto connection = get_header("Connection");
         if (_version == "1.0") {
-            return it != _headers.end()
-                 && case_insensitive_cmp()(it->second, "keep-alive");
+            return case_insensitive_cmp()(connection, "keep-alive");
         } else { // HTTP/1.1
-            return it == _headers.end() || !case_insensitive_cmp()(it->second, "close");
+            return !case_insensitive_cmp()(connection, "close");
         }
     }
+
+    /**
+     * Sets the body of an outgoing request
+     * @param content_type the type of the body, e.g. "application/json"
+     * @param content the body
+     */
+    void write_body(const sstring& content_type, sstring content) {
+        _headers["Content-Type"] = content_type;
+        _headers["Content-Length"] = to_sstring(content.size());
+        this->content = std::move(content);
+    }
+
+    /**
+     * Sets a body of an outgoing request that is streamed with chunked encoding
+     * @param content_type the type of the body
+     * @param body_writer writes the body to the stream and closes it
+     */
+    void write_body(const sstring& content_type, noncopyable_function<future<>(output_stream<char>&&)>&& body_writer) {
+        _headers["Content-Type"] = content_type;
+        _headers["Transfer-Encoding"] = "chunked";
+        this->body_writer = std::move(body_writer);
+    }
+
+    /**
+     * Sets a body of an outgoing request that is streamed, and known to be len bytes long
+     * @param content_type the type of the body
+     * @param len the exact length of the body
+     * @param body_writer writes the body to the stream and closes it
+     */
+    void write_body(const sstring& content_type, size_t len, noncopyable_function<future<>(output_stream<char>&&)>&& body_writer) {
+        _headers["Content-Type"] = content_type;
+        _headers["Content-Length"] = to_sstring(len);
+        content_length = len;
+        this->body_writer = std::move(body_writer);
+    }
+
+    /**
+     * Makes an outgoing request
+     * @param method the method, e.g. "GET"
+     * @param host the value of the Host header
+     * @param path the path and query of the resource, e.g. "/bucket/key?acl"
+     */
+    static request make(sstring method, sstring host, sstring path) {
+        request rq;
+        rq._method = std::move(method);
+        rq._url = std::move(path);
+        rq._version = "1.1";
+        rq._headers["Host"] = std::move(host);
+        return rq;
+    }
 };
 
 } // namespace httpd
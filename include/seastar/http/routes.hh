@@ -22,6 +22,7 @@
 #pragma once
 
 #include <seastar/http/matchrules.hh>
+#include <seastar/http/internal/route_tree.hh>
 #include <seastar/http/handlers.hh>
 #include <seastar/http/common.hh>
 #include <seastar/http/reply.hh>
@@ -101,12 +102,15 @@ class routes {
      * rules are search only if an exact match was not found.
      * rules are search by the order they were added.
      * First in higher priority
+     * rules are compiled on the first lookup after a change, so a rule
+     * should not be changed once a lookup saw it
      * @param rule a rule to add
      * @param type the operation type
      * @return it self
      */
     routes& add(match_rule* rule, operation_type type = GET) {
         _rules[type][_rover++] = rule;
+        _trees[type].reset();
         return *this;
     }
 
@@ -160,6 +164,14 @@ class routes {
     handler_base* get_handler(operation_type type, const sstring& url,
             parameters& params);
 
+    /**
+     * Whether the handler of a url streams the request body, see
+     * handler_base::stream_content()
+     * @param type the http operation type
+     * @param url the request url, without the query string
+     */
+    bool streams_content(operation_type type, const sstring& url);
+
 private:
     /**
      * Normalize the url to remove the last / if exists
@@ -176,6 +188,8 @@ class routes {
 private:
     rule_cookie _rover = 0;
     std::map<rule_cookie, match_rule*> _rules[NUM_OPERATION];
+    // The rules compiled for lookup, built on the first one after a change
+    std::unique_ptr<internal::route_tree> _trees[NUM_OPERATION];
     //default Handler -- for any HTTP Method and Path (/*)
     handler_base* _default_handler = nullptr;
 public:
@@ -225,6 +239,7 @@ class routes {
     rule_cookie add_cookie(match_rule* rule, operation_type type) {
         auto pos = _rover++;
         _rules[type][pos] = rule;
+        _trees[type].reset();
         return pos;
     }
 
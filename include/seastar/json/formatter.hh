@@ -94,15 +94,17 @@ class formatter {
         }
     }
 
+    // Writes element by element, a large container never takes a string
+    // of its own, and yields between elements when preemption is due
     template<typename Iter>
     static future<> write(output_stream<char>& stream, state s, Iter i, Iter e) {
         return do_with(true, [&stream, s, i, e] (bool& first) {
             return stream.write(begin(s)).then([&first, &stream, s, i, e] {
-                return do_for_each(i, e, [&first, &stream] (auto& m) {
+                return do_for_each(i, e, [&first, &stream, s] (auto& m) {
                     auto f = (first) ? make_ready_future<>() : stream.write(",");
                     first = false;
-                    return f.then([&m, &stream] {
-                        return write(stream, m);
+                    return f.then([&m, &stream, s] {
+                        return write(stream, s, m);
                     });
                 }).then([&stream, s] {
                     return stream.write(end(s));
@@ -114,7 +116,7 @@ class formatter {
     // fallback template
     template<typename T>
     static future<> write(output_stream<char>& stream, state, const T& t) {
-        return stream.write(to_json(t));
+        return write(stream, t);
     }
 
 public:
@@ -254,6 +256,15 @@ class formatter {
         return s.write(to_json(n));
     }
 
+    /**
+     * return a json formatted unsigned
+     * @param n the unsigned to format
+     * @return the given unsigned in a json format
+     */
+    static future<> write(output_stream<char>& s, unsigned n) {
+        return s.write(to_json(n));
+    }
+
     /**
      * return a json formatted float
      * @param f the float to format
@@ -320,13 +331,11 @@ class formatter {
      }
 
     /**
-     * return a json formatted json object
-     * @param obj the date_time to format
-     * @return the given json object in a json format
+     * write a json object, streaming it element by element when the
+     * object supports it (see jsonable::write)
+     * @param obj the json object to write
      */
-    static future<> write(output_stream<char>& s, const jsonable& obj) {
-      return s.write(to_json(obj));
-     }
+    static future<> write(output_stream<char>& s, const jsonable& obj);
 
     /**
      * return a json formatted unsigned long
@@ -0,0 +1,210 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+
+#pragma once
+
+#include <seastar/core/future.hh>
+#include <seastar/core/iostream.hh>
+#include <seastar/core/sstring.hh>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace seastar {
+
+namespace json {
+
+/// Thrown on a malformed JSON document
+class parse_error : public std::runtime_error {
+    uint64_t _offset;
+public:
+    parse_error(const std::string& msg, uint64_t offset);
+    /// Of the character at which the document was found malformed
+    uint64_t offset() const noexcept {
+        return _offset;
+    }
+};
+
+struct parse_options {
+    /// Deepest nesting of arrays and objects accepted
+    unsigned max_depth = 1024;
+};
+
+/// Receives the events of a parse, in document order.
+///
+/// The strings passed to it are only valid during the call. Exceptions
+/// thrown by the handler abort the parse.
+class parse_handler {
+public:
+    virtual ~parse_handler() = default;
+    virtual void on_null() = 0;
+    virtual void on_bool(bool b) = 0;
+    /// Numbers without a fraction or an exponent that fit, others are
+    /// passed to on_double()
+    virtual void on_integer(int64_t n) = 0;
+    virtual void on_double(double d) = 0;
+    virtual void on_string(std::string_view s) = 0;
+    virtual void on_start_object() = 0;
+    /// The key of the next member of the object
+    virtual void on_key(std::string_view key) = 0;
+    virtual void on_end_object() = 0;
+    virtual void on_start_array() = 0;
+    virtual void on_end_array() = 0;
+};
+
+/// An incremental parser of a JSON document.
+///
+/// The document is fed in fragments, split anywhere, and the handler is
+/// called as soon as each value is complete. Strings and numbers that lie
+/// within a fragment are passed to it without copying. The runs of string
+/// characters and of whitespace are scanned 16 bytes at a time with SSE2,
+/// where it is available.
+class parser {
+    enum class expect : uint8_t {
+        value, value_or_end, key, key_or_end, colon, comma_or_end, done,
+    };
+    enum class token : uint8_t {
+        none, string, key, number, literal,
+    };
+
+    parse_handler& _h;
+    unsigned _max_depth;
+    // The open containers, innermost last, true for objects
+    std::vector<bool> _stack;
+    expect _expect = expect::value;
+    // The token being read, which may span fragments
+    token _token = token::none;
+    // In a string: 1 after a backslash, 2 to 5 in the hex digits of a \u
+    uint8_t _escape = 0;
+    uint32_t _code = 0;
+    // A high surrogate waiting for the \u escape of its low one
+    uint32_t _high_surrogate = 0;
+    // The part of the token in earlier fragments, strings unescaped
+    std::string _buf;
+    // Of the fragment being fed
+    uint64_t _offset = 0;
+
+    [[noreturn]] void fail(const char* msg, size_t pos) const;
+    size_t start_value(const char* p, size_t i);
+    void push(bool object, size_t pos);
+    void end_container();
+    void value_done() noexcept;
+    size_t continue_string(const char* p, size_t i, size_t n);
+    size_t continue_escape(const char* p, size_t i);
+    void end_unicode_escape(size_t pos);
+    void emit_string(std::string_view s);
+    size_t continue_number(const char* p, size_t i, size_t n);
+    void emit_number(std::string_view s, size_t pos);
+    size_t continue_literal(const char* p, size_t i, size_t n);
+    void emit_literal(std::string_view s, size_t pos);
+public:
+    explicit parser(parse_handler& h, parse_options opts = {});
+
+    /// Parses the next fragment of the document.
+    ///
+    /// \throws parse_error if the document is malformed
+    void feed(std::string_view data);
+
+    /// Ends the document.
+    ///
+    /// \throws parse_error if it is incomplete
+    void finish();
+
+    /// Whether a whole document was parsed; only whitespace may follow
+    bool done() const noexcept {
+        return _expect == expect::done && _token == token::none;
+    }
+};
+
+/// Parses the document read from \c in to its end, passing its values to
+/// \c h as they are read. Long fragments are parsed in slices, yielding in
+/// between when the task quota is used up.
+///
+/// The returned future fails with \ref parse_error if the document is
+/// malformed. \c in and \c h must be kept alive until it resolves.
+future<> parse(input_stream<char>& in, parse_handler& h, parse_options opts = {});
+
+/// A parsed JSON document, or a value in one
+class value {
+public:
+    using array = std::vector<value>;
+    /// The members, in document order; duplicate keys are kept
+    using object = std::vector<std::pair<sstring, value>>;
+private:
+    std::variant<std::nullptr_t, bool, int64_t, double, sstring, array, object> _v;
+public:
+    value() noexcept : _v(nullptr) {}
+    explicit value(bool b) noexcept : _v(b) {}
+    explicit value(int64_t n) noexcept : _v(n) {}
+    explicit value(double d) noexcept : _v(d) {}
+    explicit value(sstring s) noexcept : _v(std::move(s)) {}
+    explicit value(array a) noexcept : _v(std::move(a)) {}
+    explicit value(object o) noexcept : _v(std::move(o)) {}
+
+    bool is_null() const noexcept { return std::holds_alternative<std::nullptr_t>(_v); }
+    bool is_bool() const noexcept { return std::holds_alternative<bool>(_v); }
+    bool is_integer() const noexcept { return std::holds_alternative<int64_t>(_v); }
+    bool is_number() const noexcept { return is_integer() || std::holds_alternative<double>(_v); }
+    bool is_string() const noexcept { return std::holds_alternative<sstring>(_v); }
+    bool is_array() const noexcept { return std::holds_alternative<array>(_v); }
+    bool is_object() const noexcept { return std::holds_alternative<object>(_v); }
+
+    /// The accessors throw \c std::bad_variant_access if the value is of
+    /// another type
+    bool as_bool() const { return std::get<bool>(_v); }
+    int64_t as_integer() const { return std::get<int64_t>(_v); }
+    /// Integers too
+    double as_double() const {
+        return is_integer() ? double(as_integer()) : std::get<double>(_v);
+    }
+    const sstring& as_string() const { return std::get<sstring>(_v); }
+    const array& as_array() const { return std::get<array>(_v); }
+    array& as_array() { return std::get<array>(_v); }
+    const object& as_object() const { return std::get<object>(_v); }
+    object& as_object() { return std::get<object>(_v); }
+
+    /// The first member of an object with the key, or nullptr if there is
+    /// none or the value is not an object
+    const value* find(std::string_view key) const noexcept;
+
+    bool operator==(const value& o) const {
+        return _v == o._v;
+    }
+};
+
+/// Parses a whole document
+///
+/// \throws parse_error if it is malformed
+value parse_value(std::string_view text, parse_options opts = {});
+
+/// Parses the document read from \c in to its end, see
+/// parse(input_stream<char>&, parse_handler&, parse_options)
+future<value> parse_value(input_stream<char>& in, parse_options opts = {});
+
+}
+
+}
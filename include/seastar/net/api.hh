@@ -21,14 +21,17 @@
 
 #pragma once
 
+#include <chrono>
 #include <memory>
 #include <vector>
 #include <cstring>
 #include <seastar/core/future.hh>
+#include <seastar/core/posix.hh>
 #include <seastar/net/byteorder.hh>
 #include <seastar/net/socket_defs.hh>
 #include <seastar/net/packet.hh>
 #include <seastar/core/temporary_buffer.hh>
+#include <seastar/core/sstring.hh>
 #include <seastar/core/iostream.hh>
 #include <seastar/util/std-compat.hh>
 #include <seastar/util/program-options.hh>
@@ -74,6 +77,25 @@ struct sctp_keepalive_params {
 
 using keepalive_params = std::variant<tcp_keepalive_params, sctp_keepalive_params>;
 
+/// Statistics of a TCP connection, after Linux's \c TCP_INFO
+struct tcp_connection_stats {
+    uint32_t mss = 0;                       ///< size of the segments sent, in bytes
+    uint32_t cwnd = 0;                      ///< congestion window, in bytes
+    uint32_t ssthresh = 0;                  ///< slow start threshold, in bytes
+    uint32_t bytes_in_flight = 0;           ///< bytes sent and neither acknowledged nor deemed lost
+    std::chrono::microseconds srtt{0};      ///< smoothed round trip time
+    std::chrono::microseconds rttvar{0};    ///< round trip time variation
+    std::chrono::microseconds rto{0};       ///< retransmission timeout
+    uint64_t retransmits = 0;               ///< segments retransmitted during the connection's lifetime
+};
+
+/// A message received on an AF_UNIX socket, with the file descriptors
+/// passed along with it (SCM_RIGHTS)
+struct unix_message {
+    temporary_buffer<char> data;
+    std::vector<file_desc> fds;
+};
+
 /// \cond internal
 class connected_socket_impl;
 class socket_impl;
@@ -81,6 +103,7 @@ class socket_impl;
 class server_socket_impl;
 class udp_channel_impl;
 class get_impl;
+class connection_memory_budget;
 /// \endcond
 
 class udp_datagram_impl {
@@ -117,8 +140,18 @@ class udp_channel {
     socket_address local_address() const;
 
     future<udp_datagram> receive();
+    /// Receives up to \c max_datagrams queued datagrams at once.
+    ///
+    /// Waits for at least one datagram. The posix stack fetches the batch
+    /// with a single recvmmsg() call; other stacks may return one
+    /// datagram at a time.
+    future<std::vector<udp_datagram>> receive_batch(size_t max_datagrams);
     future<> send(const socket_address& dst, const char* msg);
     future<> send(const socket_address& dst, packet p);
+    /// Sends several datagrams to \c dst, in order.
+    ///
+    /// The posix stack issues them with as few sendmmsg() calls as possible.
+    future<> send(const socket_address& dst, std::vector<packet> packets);
     bool is_closed() const;
     /// Causes a pending receive() to complete (possibly with an exception)
     void shutdown_input();
@@ -170,6 +203,7 @@ struct session_dn {
 /// two endpoints, a local endpoint and a remote endpoint.
 class connected_socket {
     friend class net::get_impl;
+    friend class net::connection_memory_budget;
     std::unique_ptr<net::connected_socket_impl> _csi;
 public:
     /// Constructs a \c connected_socket not corresponding to a connection
@@ -219,6 +253,47 @@ class connected_socket {
     int get_sockopt(int level, int optname, void* data, size_t len) const;
     /// Local address of the socket
     socket_address local_address() const noexcept;
+    /// Gets the statistics of the connection.
+    ///
+    /// Backed by \c TCP_INFO on the posix stack and by the connection's
+    /// state on the native one.
+    ///
+    /// \throws std::system_error with \c ENOTSUP if the socket is not
+    /// a TCP connection.
+    net::tcp_connection_stats get_stats() const;
+
+    /// Sends \c data, and passes \c fds to the peer along with it
+    /// (SCM_RIGHTS), on an AF_UNIX socket.
+    ///
+    /// On a \ref transport::SEQPACKET socket \c data is one message. On a
+    /// stream socket, the descriptors come with the first byte of \c data,
+    /// which must not be empty then. The message bypasses the output
+    /// stream, which must have nothing left to flush.
+    ///
+    /// \throws std::system_error with \c ENOTSUP if the socket is not an
+    /// AF_UNIX socket of the posix stack.
+    future<> send_message(temporary_buffer<char> data, std::vector<file_desc> fds = {});
+    /// Receives a message, of up to \c max_size bytes, and up to \c max_fds
+    /// file descriptors passed along with it, on an AF_UNIX socket.
+    ///
+    /// On a stream socket the data is whatever arrived, up to the first byte
+    /// which came with descriptors. The data is empty at the end of the
+    /// stream. Not to be mixed with reads of the input stream.
+    ///
+    /// \throws std::system_error with \c EMSGSIZE if the message or its
+    /// descriptors were cut, and with \c ENOTSUP if the socket is not an
+    /// AF_UNIX socket of the posix stack.
+    future<net::unix_message> receive_message(size_t max_size = 64 << 10, unsigned max_fds = 16);
+    /// Duplicates the file descriptor of the socket, to pass the connection
+    /// to another process with send_message() (see
+    /// \ref make_connected_socket()).
+    ///
+    /// The socket must then be dropped without closing its output stream
+    /// or shutting it down, which would affect the passed one too.
+    ///
+    /// \throws std::system_error with \c ENOTSUP if the socket is not one
+    /// of the posix stack.
+    file_desc dup_fd() const;
 
     /// Disables output to the socket.
     ///
@@ -311,6 +386,25 @@ class server_socket {
         port,
         // This algorithm distributes all new connections to listen_options::fixed_cpu shard only.
         fixed,
+        // This algorithm sends new connections to the least loaded shard, by the shards'
+        // recent CPU utilization and run queue length (see smp::load_of()), in proportion
+        // to their number of connections. Connections which differ in cost end up spread
+        // by the work they bring, not only by their count.
+        load_aware,
+        // This algorithm sends new connections to the shard running on the CPU that
+        // received the connection's packets (SO_INCOMING_CPU), so that a connection is
+        // served where the NIC steers its traffic. Connections received on a CPU with no
+        // shard are distributed as by connection_distribution. With SO_REUSEPORT
+        // listeners, an eBPF program steers each connection to the listener of the shard
+        // on the CPU which received its SYN; without the privileges to load it, each
+        // shard's listener asks the kernel to prefer it for the connections of its CPU.
+        incoming_cpu,
+        // This algorithm groups connections by the NIC receive queue their packets arrive
+        // on (SO_INCOMING_NAPI_ID), and sends all connections of a queue to one shard,
+        // picked for the queue's first connection as by connection_distribution. With
+        // listen_options::busy_poll, a queue is then polled by that shard alone.
+        // Connections with no queue are distributed as by connection_distribution.
+        napi_id,
         default_ = connection_distribution
     };
     /// Constructs a \c server_socket without being bound to any address
@@ -368,6 +462,28 @@ struct listen_options {
     transport proto = transport::TCP;
     int listen_backlog = 100;
     unsigned fixed_cpu = 0u;
+    /// Keep a single multishot accept armed in the kernel instead of
+    /// submitting an accept per connection. Only effective with the
+    /// io_uring reactor backend, ignored otherwise.
+    bool multishot_accept = false;
+    /// Receive on accepted connections with multishot requests, which
+    /// complete once per received buffer. Requires the io_uring reactor
+    /// backend with --io-uring-recv-buffers, ignored otherwise.
+    bool multishot_recv = false;
+    /// Busy poll the NIC receive queue of an accepted connection for up
+    /// to this long when it waits for data, rather than wait for the
+    /// interrupt (SO_BUSY_POLL, SO_PREFER_BUSY_POLL), and keep the reactor
+    /// polling for at least as long before it sleeps. Polling for longer
+    /// than net.core.busy_read needs CAP_NET_ADMIN. Zero disables. The
+    /// posix stack only.
+    std::chrono::microseconds busy_poll{0};
+    /// Packets a busy poll may process (SO_BUSY_POLL_BUDGET), zero for the
+    /// kernel's default
+    unsigned busy_poll_budget = 0;
+    /// Congestion control algorithm of the accepted TCP connections, by
+    /// the name Linux uses for it. The native stack supports "reno",
+    /// "cubic" and "bbr". Empty keeps the stack's default.
+    sstring congestion_control;
     void set_fixed_cpu(unsigned cpu) {
         lba = server_socket::load_balancing_algorithm::fixed;
         fixed_cpu = cpu;
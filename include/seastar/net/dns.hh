@@ -86,6 +86,32 @@ class dns_resolver {
             tcp_port, udp_port;
         std::optional<std::vector<sstring>>
             domains;
+        /// Keeps the results of get_host_by_name() for the TTL of their
+        /// records, clamped to cache_min_ttl and cache_max_ttl, and names
+        /// which do not exist for negative_ttl. Concurrent queries for a
+        /// name share one lookup, and a name looked up past cache_prefetch
+        /// of its TTL is refreshed in the background. Off by default.
+        std::optional<bool>
+            cache;
+        std::optional<size_t>
+            cache_size;
+        std::optional<std::chrono::seconds>
+            cache_min_ttl, cache_max_ttl, negative_ttl;
+        std::optional<float>
+            cache_prefetch;
+        /// The "resolver" label of the dns_cache metrics
+        std::optional<sstring>
+            cache_metrics_name;
+    };
+
+    struct cache_stats {
+        uint64_t hits = 0;
+        uint64_t negative_hits = 0;
+        uint64_t misses = 0;
+        /// Lookups which waited for a query already in flight
+        uint64_t coalesced = 0;
+        uint64_t prefetches = 0;
+        size_t entries = 0;
     };
 
     enum class srv_proto {
@@ -126,6 +152,11 @@ class dns_resolver {
                                         const sstring& service,
                                         const sstring& domain);
 
+    /**
+     * What the cache of names did, see options::cache
+     */
+    cache_stats get_cache_stats() const;
+
     /**
      * Shuts the object down. Great for tests.
      */
@@ -41,6 +41,27 @@ struct dpdk_options : public program_options::option_group {
     ///
     /// Default: \p on.
     program_options::value<std::string> hw_fc;
+    /// \brief Number of packets to accumulate before handing them to the NIC.
+    ///
+    /// Fewer packets are sent once they have been held for \ref tx_burst_delay.
+    ///
+    /// Default: 1.
+    program_options::value<unsigned> tx_burst;
+    /// \brief Maximum time (in us) to hold packets back to accumulate a Tx burst.
+    ///
+    /// Default: 20.
+    program_options::value<unsigned> tx_burst_delay;
+    /// \brief Number of Rx mbufs per queue the application may hold at once
+    /// through received packets, when running without \c --hugepages.
+    ///
+    /// Received packets point to the mbufs they were received into, and
+    /// return them to the pool when destroyed; once the application holds
+    /// that many, packets are copied out of their mbufs instead, so that
+    /// the NIC has mbufs left to receive into. At most half the mbufs of a
+    /// queue are held; 0 always copies.
+    ///
+    /// Default: 256.
+    program_options::value<unsigned> rx_zero_copy_mbufs;
 
     /// \cond internal
     dpdk_options(program_options::option_group* parent_group);
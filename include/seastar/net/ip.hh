@@ -196,8 +196,19 @@ class ipv4_udp : public ip_protocol {
     int _queue_size = default_queue_size;
     uint16_t _next_anonymous_port = min_anonymous_port;
     circular_buffer<ipv4_traits::l4packet> _packetq;
+    // The instance of the shard, to which datagrams for ports it owns are
+    // passed
+    static thread_local ipv4_udp* _local;
 private:
     uint16_t next_port(uint16_t port);
+    // Anonymous ports are spread over the shards, so that a datagram sent
+    // to one, wherever RSS on its 4-tuple delivers it, reaches the shard of
+    // its channel. Other ports are bound on each shard separately, and
+    // served where datagrams arrive.
+    static unsigned owner_of(uint16_t port) {
+        return port >= min_anonymous_port ? port % smp::count : this_shard_id();
+    }
+    void deliver(packet p, ipv4_address from, ipv4_address to);
 public:
     class registration {
     private:
@@ -216,6 +227,7 @@ class ipv4_udp : public ip_protocol {
     };
 
     ipv4_udp(ipv4& inet);
+    ~ipv4_udp();
     udp_channel make_channel(ipv4_addr addr);
     virtual void received(packet p, ipv4_address from, ipv4_address to) override;
     void send(uint16_t src_port, ipv4_addr dst, packet &&p);
@@ -306,6 +318,16 @@ class ipv4 {
     timer<lowres_clock> _frag_timer;
     circular_buffer<l3_protocol::l3packet> _packetq;
     unsigned _pkt_provider_idx = 0;
+    // Received packets dropped, by reason; of fragments, whole datagrams
+    struct rx_drop_stats {
+        uint64_t bad_header = 0;
+        uint64_t bad_checksum = 0;
+        uint64_t bad_length = 0;
+        uint64_t not_for_us = 0;
+        uint64_t unknown_protocol = 0;
+        uint64_t frag_timeout = 0;
+        uint64_t frag_no_memory = 0;
+    } _rx_drops;
     metrics::metric_groups _metrics;
 private:
     future<> handle_received_packet(packet p, ethernet_address from);
@@ -0,0 +1,113 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+
+#pragma once
+
+#include <seastar/core/iostream.hh>
+#include <seastar/core/metrics_registration.hh>
+#include <seastar/core/semaphore.hh>
+#include <seastar/core/sstring.hh>
+#include <seastar/net/api.hh>
+#include <cstdint>
+
+namespace seastar {
+
+namespace net {
+
+/// \addtogroup networking-module
+/// @{
+
+/// A memory budget shared by the connections of a server.
+///
+/// The streams of a connection, created by input() and output() rather
+/// than by \ref connected_socket::input() and \ref connected_socket::output(),
+/// charge the budget with the buffers they hold: an input stream with the
+/// buffers it read until they are released, an output stream with the
+/// data it sends until the send completes.
+///
+/// Each stream is entitled to a fair share of the budget, \c memory divided
+/// by the number of streams. The buffer sizes of new streams are cut to
+/// their fair share, so that buffers shrink as connections are added. Once
+/// the budget is used up, a stream which holds more than its share waits
+/// for memory to be released before it reads or sends more; streams within
+/// their share are never held back, so the budget can be exceeded by at
+/// most a buffer per stream. A reader must not keep more than its share of
+/// buffers while waiting for more data, or it may wait for ever.
+///
+/// If it has a name, the budget exports metrics in the
+/// "connection_memory" group, labelled with it. The budget must outlive
+/// the streams and the buffers they returned.
+class connection_memory_budget {
+    class source;
+    class sink;
+
+    semaphore _sem;
+    size_t _memory;
+    unsigned _streams = 0;
+    uint64_t _paused_reads = 0;
+    uint64_t _paused_writes = 0;
+    metrics::metric_groups _metrics;
+
+    future<> maybe_wait(size_t held, uint64_t& paused);
+public:
+    /// \param memory bytes the buffers of all streams may take up
+    /// \param name labels the metrics of the budget; none are exported if empty
+    explicit connection_memory_budget(size_t memory, sstring name = {});
+    connection_memory_budget(const connection_memory_budget&) = delete;
+    connection_memory_budget& operator=(const connection_memory_budget&) = delete;
+
+    /// Creates an input stream of \c s charging this budget, with buffer
+    /// sizes cut to the fair share of a stream
+    input_stream<char> input(connected_socket& s, connected_socket_input_stream_config csisc = {});
+    /// Creates an output stream of \c s charging this budget, with a buffer
+    /// size cut to half the fair share of a stream
+    output_stream<char> output(connected_socket& s, size_t buffer_size = 8192);
+
+    size_t memory() const noexcept {
+        return _memory;
+    }
+    /// Bytes held by the streams; may exceed memory()
+    size_t used() const noexcept {
+        return _memory - _sem.available_units();
+    }
+    unsigned streams() const noexcept {
+        return _streams;
+    }
+    /// What a stream is entitled to
+    size_t fair_share() const noexcept {
+        return _memory / std::max(_streams, 1u);
+    }
+    /// Reads delayed because the budget was used up
+    uint64_t paused_reads() const noexcept {
+        return _paused_reads;
+    }
+    /// Sends delayed because the budget was used up
+    uint64_t paused_writes() const noexcept {
+        return _paused_writes;
+    }
+};
+
+/// @}
+
+}
+
+}
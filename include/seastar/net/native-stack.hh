@@ -24,6 +24,7 @@
 #include <seastar/net/net.hh>
 #include <seastar/net/virtio.hh>
 #include <seastar/net/dpdk.hh>
+#include <seastar/net/xdp.hh>
 #include <seastar/util/program-options.hh>
 
 namespace seastar {
@@ -72,8 +73,15 @@ struct native_stack_options : public program_options::option_group {
     ///
     /// \note Unused when seastar is compiled without DPDK support.
     program_options::value<> dpdk_pmd;
+    /// \brief Use AF_XDP sockets.
+    ///
+    /// \note Unused when seastar is compiled without AF_XDP support.
+    program_options::value<> xdp;
     /// \brief Enable LRO (on/off).
     ///
+    /// With DPDK, TCP segments are coalesced in software when the NIC
+    /// offers no LRO but verifies the received checksums.
+    ///
     /// Default: \p on.
     program_options::value<std::string> lro;
 
@@ -83,6 +91,10 @@ struct native_stack_options : public program_options::option_group {
     ///
     /// \note Unused when seastar is compiled without DPDK support.
     dpdk_options dpdk_opts;
+    /// AF_XDP configuration.
+    ///
+    /// \note Unused when seastar is compiled without AF_XDP support.
+    xdp_options xdp_opts;
 
     /// \cond internal
     bool _hugepages;
@@ -26,10 +26,13 @@
 #include <seastar/core/queue.hh>
 #include <seastar/core/stream.hh>
 #include <seastar/core/metrics_registration.hh>
+#include <seastar/core/internal/log_histogram.hh>
 #include <seastar/net/toeplitz.hh>
 #include <seastar/net/ethernet.hh>
 #include <seastar/net/packet.hh>
 #include <seastar/net/const.hh>
+#include <seastar/net/ipv4_address.hh>
+#include <memory>
 #include <unordered_map>
 
 namespace seastar {
@@ -47,6 +50,7 @@ class interface;
 class device;
 class qp;
 class l3_protocol;
+class gro;
 
 class forward_hash {
     uint8_t data[64];
@@ -91,6 +95,21 @@ struct hw_features {
     uint16_t max_packet_len = ip_packet_len_max - eth_hdr_len;
 };
 
+// The packets of a flow, as seen on receive
+struct flow_tuple {
+    ipv4_address src_ip;
+    ipv4_address dst_ip;
+    uint16_t src_port;
+    uint16_t dst_port;
+    ip_protocol_num proto;
+};
+
+// Steering of a flow to a receive queue, in effect until destroyed
+class flow_rule {
+public:
+    virtual ~flow_rule() {}
+};
+
 class l3_protocol {
 public:
     struct l3packet {
@@ -116,6 +135,11 @@ class interface {
         stream<packet, ethernet_address> packet_stream;
         future<> ready;
         std::function<bool (forward_hash&, packet&, size_t)> forward;
+        uint64_t packets = 0;
+        // Dropped because the protocol was still handling an earlier packet
+        uint64_t busy_drops = 0;
+        // Time the protocol took to handle a sample of the packets
+        internal::latency_histogram<1, 50> latency;
         l3_rx_stream(std::function<bool (forward_hash&, packet&, size_t)>&& fw) : ready(packet_stream.started()), forward(fw) {}
     };
     std::unordered_map<uint16_t, l3_rx_stream> _proto_map;
@@ -123,6 +147,13 @@ class interface {
     ethernet_address _hw_address;
     net::hw_features _hw_features;
     std::vector<l3_protocol::packet_provider_type> _pkt_providers;
+    uint64_t _forwarded = 0;
+    uint64_t _forward_drops = 0;
+    uint64_t _unknown_protocol_drops = 0;
+    // The handling latency of one in that many received packets is sampled
+    static constexpr unsigned rx_latency_sample_interval = 64;
+    unsigned _rx_latency_sample = 0;
+    metrics::metric_groups _metrics;
 private:
     future<> dispatch_packet(packet p);
 public:
@@ -133,6 +164,8 @@ class interface {
             std::function<future<> (packet p, ethernet_address from)> next,
             std::function<bool (forward_hash&, packet&, size_t)> forward);
     void forward(unsigned cpuid, packet p);
+    // Have the device deliver a flow to this shard, see device::steer_flow()
+    std::unique_ptr<flow_rule> steer_flow(const flow_tuple& flow);
     unsigned hash2cpu(uint32_t hash);
     void register_packet_provider(l3_protocol::packet_provider_type func) {
         _pkt_providers.push_back(std::move(func));
@@ -206,6 +239,7 @@ struct qp_stats {
             uint64_t no_mem;       // Packets dropped due to allocation failure
             uint64_t total;        // total number of erroneous packets
             uint64_t csum;         // packets with bad checksum
+            uint64_t ring_full;    // packets the device dropped because the receive ring was full
         } bad;
     } rx;
 
@@ -223,6 +257,8 @@ class qp {
     stream<packet> _rx_stream;
     std::unique_ptr<internal::poller> _tx_poller;
     circular_buffer<packet> _tx_packetq;
+    size_t _tx_refill_threshold = 16;
+    std::unique_ptr<gro> _gro;
 
 protected:
     const std::string _stats_plugin_name;
@@ -230,6 +266,17 @@ class qp {
     metrics::metric_groups _metrics;
     qp_stats _stats;
 
+    // Passes a packet of the current receive batch up the stack, merging
+    // it with the earlier TCP segments of its flow when GRO is enabled
+    void gro_receive(packet p);
+    // Ends the receive batch, passing up the packets held for merging
+    void gro_flush();
+    // Upper layers are polled for packets while fewer than that are queued,
+    // devices holding packets back for larger bursts need it at least as big
+    void set_tx_refill_threshold(size_t n) {
+        _tx_refill_threshold = std::max(_tx_refill_threshold, n);
+    }
+
 public:
     qp(bool register_copy_stats = false,
        const std::string stats_plugin_name = std::string("network"),
@@ -247,6 +294,9 @@ class qp {
         return sent;
     }
     virtual void rx_start() {};
+    // Enable software receive coalescing of TCP segments. Only valid when
+    // the device verifies the received checksums.
+    void enable_gro();
     void configure_proxies(const std::map<unsigned, float>& cpu_weights);
     // build REdirection TAble for cpu_weights map: target cpu -> weight
     void build_sw_reta(const std::map<unsigned, float>& cpu_weights);
@@ -285,6 +335,12 @@ class device {
     virtual unsigned hash2qid(uint32_t hash) {
         return hash % hw_queues_count();
     }
+    // Have the device deliver the packets of a flow straight to the queue
+    // of the given shard, wherever RSS would send them. Returns nullptr
+    // when it can't, packets then reach the shard by software forwarding.
+    virtual std::unique_ptr<flow_rule> steer_flow(const flow_tuple& flow, unsigned cpu) {
+        return nullptr;
+    }
     void set_local_queue(std::unique_ptr<qp> dev);
     template <typename Func>
     unsigned forward_dst(unsigned src_cpuid, Func&& hashfn) {
@@ -76,10 +76,21 @@ struct offload_info {
 // extra space, so prepending to the packet does not require extra
 // allocations.  This is useful when adding headers.
 //
+// Similarly, small fragments appended by copy go to a buffer with spare
+// room after them, the tail, where later small fragments are appended to
+// the last fragment rather than becoming fragments of their own. Packets
+// which accumulate many fragments nonetheless are compacted, by
+// coalescing runs of small fragments, to keep the number of iovecs of a
+// send and the work of checksumming bounded.
+//
 class packet final {
     // enough for lots of headers, not quite two cache lines:
     static constexpr size_t internal_data_size = 128 - 16;
     static constexpr size_t default_nr_frags = 4;
+    static constexpr size_t small_fragment_size = 256;
+    static constexpr size_t tail_buffer_size = 2048;
+    // Packets with more fragments are compacted
+    static constexpr size_t max_nr_frags = 128;
 
     struct pseudo_vector {
         fragment* _start;
@@ -101,6 +112,9 @@ class packet final {
         std::optional<uint32_t> _rss_hash;
         char _data[internal_data_size]; // only _frags[0] may use
         unsigned _headroom = internal_data_size; // in _data
+        // Spare room after the last fragment, if it ends at _tail
+        char* _tail = nullptr;
+        unsigned _tail_room = 0;
         // FIXME: share _data/_frags space
 
         fragment _frags[];
@@ -122,6 +136,8 @@ class packet final {
             n->_len = old->_len;
             n->_nr_frags = old->_nr_frags;
             n->_headroom = old->_headroom;
+            n->_tail = old->_tail;
+            n->_tail_room = old->_tail_room;
             n->_offload_info = old->_offload_info;
             n->_rss_hash = old->_rss_hash;
             std::copy(old->_frags, old->_frags + old->_nr_frags, n->_frags);
@@ -173,6 +189,22 @@ class packet final {
             _deleter = std::move(d);
             _headroom = internal_data_size;
         }
+        // Appends a copy of frag to the last fragment, if there is room
+        // for it in the tail
+        bool append_to_tail(fragment frag) noexcept {
+            if (!_nr_frags || frag.size > _tail_room) {
+                return false;
+            }
+            auto& last = _frags[_nr_frags - 1];
+            if (last.base + last.size != _tail) {
+                return false;
+            }
+            _tail = std::copy(frag.base, frag.base + frag.size, _tail);
+            _tail_room -= frag.size;
+            last.size += frag.size;
+            _len += frag.size;
+            return true;
+        }
         void copy_internal_fragment_to(impl* to) noexcept {
             if (!using_internal_data()) {
                 return;
@@ -308,9 +340,16 @@ class packet final {
     static packet make_null_packet() noexcept {
         return net::packet(nullptr);
     }
+    // Coalesces runs of small fragments
+    void compact() noexcept;
 private:
     void linearize(size_t at_frag, size_t desired_size);
     bool allocate_headroom(size_t size);
+    void maybe_compact() noexcept {
+        if (_impl->_nr_frags > max_nr_frags) {
+            compact();
+        }
+    }
 public:
     struct offload_info offload_info() const noexcept { return _impl->_offload_info; }
     struct offload_info& offload_info_ref() noexcept { return _impl->_offload_info; }
@@ -402,14 +441,22 @@ packet::packet(Iterator begin, Iterator end, deleter del) {
 
 inline
 packet::packet(packet&& x, fragment frag)
-    : _impl(impl::allocate_if_needed(std::move(x._impl), 1)) {
+    : _impl(std::move(x._impl)) {
+    if (frag.size <= small_fragment_size && _impl->append_to_tail(frag)) {
+        return;
+    }
+    _impl = impl::allocate_if_needed(std::move(_impl), 1);
     _impl->_len += frag.size;
-    std::unique_ptr<char[]> buf(new char[frag.size]);
+    auto size = frag.size <= small_fragment_size ? tail_buffer_size : frag.size;
+    std::unique_ptr<char[]> buf(new char[size]);
     std::copy(frag.base, frag.base + frag.size, buf.get());
     _impl->_frags[_impl->_nr_frags++] = {buf.get(), frag.size};
+    _impl->_tail = buf.get() + frag.size;
+    _impl->_tail_room = size - frag.size;
     _impl->_deleter = make_deleter(std::move(_impl->_deleter), [buf = buf.release()] {
         delete[] buf;
     });
+    maybe_compact();
 }
 
 inline
@@ -459,11 +506,16 @@ packet::packet(fragment frag, packet&& x)
 
 inline
 packet::packet(packet&& x, fragment frag, deleter d)
-    : _impl(impl::allocate_if_needed(std::move(x._impl), 1)) {
+    : _impl(std::move(x._impl)) {
+    if (frag.size <= small_fragment_size && _impl->append_to_tail(frag)) {
+        return;
+    }
+    _impl = impl::allocate_if_needed(std::move(_impl), 1);
     _impl->_len += frag.size;
     _impl->_frags[_impl->_nr_frags++] = frag;
     d.append(std::move(_impl->_deleter));
     _impl->_deleter = std::move(d);
+    maybe_compact();
 }
 
 inline
@@ -493,8 +545,11 @@ void packet::append(packet&& p) {
     std::copy(p._impl->_frags, p._impl->_frags + p._impl->_nr_frags,
             _impl->_frags + _impl->_nr_frags);
     _impl->_nr_frags += p._impl->_nr_frags;
+    _impl->_tail = p._impl->_tail;
+    _impl->_tail_room = p._impl->_tail_room;
     p._impl->_deleter.append(std::move(_impl->_deleter));
     _impl->_deleter = std::move(p._impl->_deleter);
+    maybe_compact();
 }
 
 inline
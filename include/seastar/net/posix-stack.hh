@@ -60,6 +60,40 @@ class conntrack {
             _cpu_load[cpu]++;
             return cpu;
         }
+        // Weighs the connections of each shard by how busy it is, so that a
+        // shard whose connections cost more gets fewer new ones. The load
+        // is published every second at most, the connection counts keep a
+        // shard from taking all connections until then.
+        shard_id next_cpu_by_load() {
+            shard_id best = 0;
+            double best_score = 0;
+            for (shard_id cpu = 0; cpu < _cpu_load.size(); cpu++) {
+                auto load = smp::load_of(cpu);
+                auto busy = load.utilization + std::min(load.runnable_tasks, runnable_tasks_scale) / double(runnable_tasks_scale);
+                auto score = (_cpu_load[cpu] + 1) * (idle_weight + busy);
+                if (cpu == 0 || score < best_score) {
+                    best = cpu;
+                    best_score = score;
+                }
+            }
+            _cpu_load[best]++;
+            return best;
+        }
+        // All connections of a NIC queue go to the shard of its first one
+        shard_id cpu_of_napi_id(unsigned napi_id) {
+            auto [i, inserted] = _napi_cpu.try_emplace(napi_id, 0);
+            if (inserted) {
+                i->second = next_cpu();
+                return i->second;
+            }
+            return force_cpu(i->second);
+        }
+    private:
+        std::unordered_map<unsigned, shard_id> _napi_cpu;
+        // As busy as a fully utilized shard
+        static constexpr unsigned runnable_tasks_scale = 1000;
+        // Keeps idle shards apart by their connections
+        static constexpr double idle_weight = 0.05;
     };
 
     lw_shared_ptr<load_balancer> _lb;
@@ -102,6 +136,12 @@ class conntrack {
     handle get_handle(shard_id cpu) {
         return handle(_lb->force_cpu(cpu), _lb);
     }
+    handle get_handle_by_load() {
+        return handle(_lb->next_cpu_by_load(), _lb);
+    }
+    handle get_handle_by_napi_id(unsigned napi_id) {
+        return handle(_lb->cpu_of_napi_id(napi_id), _lb);
+    }
 };
 
 class posix_data_source_impl final : public data_source_impl, private internal::buffer_allocator {
@@ -117,6 +157,7 @@ class posix_data_source_impl final : public data_source_impl, private internal::
     }
     future<temporary_buffer<char>> get() override;
     future<> close() override;
+    void cancel() noexcept override;
 };
 
 class posix_data_sink_impl : public data_sink_impl {
@@ -127,6 +168,7 @@ class posix_data_sink_impl : public data_sink_impl {
     using data_sink_impl::put;
     future<> put(packet p) override;
     future<> put(temporary_buffer<char> buf) override;
+    future<> put_file(file& f, uint64_t pos, uint64_t len) override;
     future<> close() override;
 };
 
@@ -166,23 +208,33 @@ class posix_server_socket_impl : public server_socket_impl {
     server_socket::load_balancing_algorithm _lba;
     shard_id _fixed_cpu;
     std::pmr::polymorphic_allocator<char>* _allocator;
+    // Shard of each CPU, for load_balancing_algorithm::incoming_cpu
+    std::unordered_map<unsigned, shard_id> _shard_of_cpu;
+
+    conntrack::handle handle_of_incoming_cpu(const pollable_fd& fd);
+    conntrack::handle handle_of_napi_id(const pollable_fd& fd);
 public:
     explicit posix_server_socket_impl(int protocol, socket_address sa, pollable_fd lfd,
         server_socket::load_balancing_algorithm lba, shard_id fixed_cpu,
-        std::pmr::polymorphic_allocator<char>* allocator=memory::malloc_allocator) : _sa(sa), _protocol(protocol), _lfd(std::move(lfd)), _lba(lba), _fixed_cpu(fixed_cpu), _allocator(allocator) {}
+        std::pmr::polymorphic_allocator<char>* allocator=memory::malloc_allocator);
     virtual future<accept_result> accept() override;
     virtual void abort_accept() override;
     virtual socket_address local_address() const override;
 };
 
+class reuseport_steering;
+
 class posix_reuseport_server_socket_impl : public server_socket_impl {
     socket_address _sa;
     int _protocol;
     pollable_fd _lfd;
+    // Of load_balancing_algorithm::incoming_cpu, if eBPF is permitted
+    std::shared_ptr<reuseport_steering> _steering;
     std::pmr::polymorphic_allocator<char>* _allocator;
 public:
     explicit posix_reuseport_server_socket_impl(int protocol, socket_address sa, pollable_fd lfd,
-        std::pmr::polymorphic_allocator<char>* allocator=memory::malloc_allocator) : _sa(sa), _protocol(protocol), _lfd(std::move(lfd)), _allocator(allocator) {}
+        std::shared_ptr<reuseport_steering> steering,
+        std::pmr::polymorphic_allocator<char>* allocator=memory::malloc_allocator) : _sa(sa), _protocol(protocol), _lfd(std::move(lfd)), _steering(std::move(steering)), _allocator(allocator) {}
     virtual future<accept_result> accept() override;
     virtual void abort_accept() override;
     virtual socket_address local_address() const override;
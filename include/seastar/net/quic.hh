@@ -0,0 +1,145 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+
+#pragma once
+
+#ifdef SEASTAR_HAVE_QUIC
+
+#include <seastar/core/future.hh>
+#include <seastar/core/shared_ptr.hh>
+#include <seastar/core/sstring.hh>
+#include <seastar/net/api.hh>
+#include <seastar/net/socket_defs.hh>
+#include <seastar/net/tls.hh>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+namespace seastar {
+
+/// QUIC transport (RFC 9000), over a \ref net::udp_channel of the network
+/// stack in use, posix or native, with TLS 1.3 by gnutls.
+///
+/// The streams of a connection are \ref connected_socket objects, read
+/// and written through their input and output streams. A socket's output
+/// side is finished, with a FIN, when its output stream is closed.
+///
+/// Datagrams are received and sent in batches (see
+/// \ref net::udp_channel::receive_batch()); the posix stack sends runs of
+/// full-size datagrams to a peer with UDP GSO where the kernel allows it.
+///
+/// A connection belongs to the shard which created or accepted it. A
+/// server binds its port on each shard it is started on, with
+/// SO_REUSEPORT on the posix stack; connection migration to another
+/// address, which the kernel could steer to another shard, is disabled.
+namespace quic {
+
+/// Transport parameters and limits of a connection.
+struct options {
+    /// Application protocols (ALPN) a client offers, or a server accepts,
+    /// e.g. "h3"; empty for none.
+    std::vector<sstring> alpn;
+    /// The connection is closed after that long without any packet.
+    std::chrono::milliseconds idle_timeout = std::chrono::seconds(30);
+    /// Bytes a peer may send on a stream before it's read.
+    uint64_t max_stream_data = 256 << 10;
+    /// Bytes a peer may send over all streams before they're read.
+    uint64_t max_data = 4 << 20;
+    /// Bidirectional streams the peer may open.
+    uint64_t max_streams = 100;
+    /// Unidirectional streams the peer may open.
+    uint64_t max_uni_streams = 3;
+    /// Largest UDP payload path MTU discovery may raise the datagrams to,
+    /// from the 1200 bytes every path must carry.
+    size_t max_udp_payload_size = 1452;
+    /// Datagrams handed to the UDP channel at once.
+    size_t max_send_batch = 16;
+};
+
+/// \cond internal
+class connection_impl;
+class server_impl;
+/// \endcond
+
+/// A QUIC connection.
+///
+/// Streams opened and accepted keep the connection referenced; it must be
+/// closed with close() before its last handle goes away.
+class connection {
+    lw_shared_ptr<connection_impl> _impl;
+public:
+    /// \cond internal
+    explicit connection(lw_shared_ptr<connection_impl>) noexcept;
+    /// \endcond
+    connection(connection&&) noexcept;
+    connection& operator=(connection&&) noexcept;
+    ~connection();
+
+    /// Opens a bidirectional stream, waiting while the peer allows no
+    /// more streams.
+    future<connected_socket> open_stream();
+    /// Waits for a stream opened by the peer. The output stream of a
+    /// unidirectional stream fails to write.
+    future<connected_socket> accept_stream();
+
+    socket_address local_address() const noexcept;
+    socket_address remote_address() const noexcept;
+    /// The application protocol negotiated, empty if none
+    sstring alpn() const;
+
+    /// Closes the connection, telling the peer the application
+    /// \c error_code, and fails the operations pending on its streams.
+    future<> close(uint64_t error_code = 0);
+};
+
+/// Connects to a QUIC server, and waits for the handshake to complete.
+///
+/// \param remote address of the server
+/// \param creds trust the server's certificate is verified against
+/// \param name name the server's certificate must match, and sent as SNI;
+///        empty not to verify the certificate
+future<connection> connect(socket_address remote, shared_ptr<tls::certificate_credentials> creds,
+        sstring name, options opts = {});
+
+/// Accepts QUIC connections on a UDP port of the shard.
+class server {
+    lw_shared_ptr<server_impl> _impl;
+public:
+    server(socket_address local, shared_ptr<tls::server_credentials> creds, options opts = {});
+    server(server&&) noexcept;
+    server& operator=(server&&) noexcept;
+    ~server();
+
+    /// Waits for a connection whose handshake completed
+    future<connection> accept();
+    socket_address local_address() const noexcept;
+    /// Stops accepting, and closes all connections of the server, which
+    /// share its UDP port: those not accepted yet, and the accepted ones,
+    /// whose streams fail.
+    future<> stop();
+};
+
+}
+
+}
+
+#endif
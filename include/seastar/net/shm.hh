@@ -0,0 +1,56 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+// Shared memory connections between processes of the same host
+
+#pragma once
+
+#include <seastar/net/api.hh>
+#include <seastar/net/socket_defs.hh>
+#include <cstddef>
+
+namespace seastar {
+
+namespace net {
+
+struct shm_options {
+    // Bytes each direction may have in flight, a power of two
+    size_t ring_size = 1 << 20;
+};
+
+// Listens for shared memory connections on a unix domain socket address.
+//
+// The unix socket only carries the handshake, which hands over the shared
+// memory and the eventfds signalling it; data moves through a ring per
+// direction without system calls as long as the reader keeps up. Closing
+// the unix socket, e.g. when a process dies, ends the connection.
+//
+// The connections are plain connected_sockets and may be used with anything
+// that takes one, rpc::server and rpc::client among others. Socket options
+// such as TCP_NODELAY and keepalive are accepted and ignored.
+server_socket shm_listen(socket_address sa, shm_options opts = {});
+
+// Creates a socket connecting to a listener created by shm_listen().
+socket shm_socket(shm_options opts = {});
+
+}
+
+}
@@ -101,7 +101,10 @@ std::ostream& operator<<(std::ostream&, const socket_address&);
 
 enum class transport {
     TCP = IPPROTO_TCP,
-    SCTP = IPPROTO_SCTP
+    SCTP = IPPROTO_SCTP,
+    /// AF_UNIX SOCK_SEQPACKET sockets, which keep the boundaries of the
+    /// messages (see \ref connected_socket::send_message()); no IP protocol
+    SEQPACKET = -1,
 };
 
 struct ipv4_addr {
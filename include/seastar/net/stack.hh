@@ -47,6 +47,14 @@ class connected_socket_impl {
     virtual void set_sockopt(int level, int optname, const void* data, size_t len) = 0;
     virtual int get_sockopt(int level, int optname, void* data, size_t len) const = 0;
     virtual socket_address local_address() const noexcept = 0;
+    virtual tcp_connection_stats get_stats() const;
+    /// Sends a TLS record of the given content type, on a socket whose
+    /// record layer was handed over to the kernel (SOL_TLS TLS_TX), where
+    /// what is written through sink() goes out as application data.
+    virtual future<> send_tls_record(uint8_t content_type, temporary_buffer<char> data);
+    virtual future<> send_message(temporary_buffer<char> data, std::vector<file_desc> fds);
+    virtual future<unix_message> receive_message(size_t max_size, unsigned max_fds);
+    virtual file_desc dup_fd() const;
 };
 
 class socket_impl {
@@ -72,8 +80,10 @@ class udp_channel_impl {
     virtual ~udp_channel_impl() {}
     virtual socket_address local_address() const = 0;
     virtual future<udp_datagram> receive() = 0;
+    virtual future<std::vector<udp_datagram>> receive_batch(size_t max_datagrams);
     virtual future<> send(const socket_address& dst, const char* msg) = 0;
     virtual future<> send(const socket_address& dst, packet p) = 0;
+    virtual future<> send(const socket_address& dst, std::vector<packet> packets);
     virtual void shutdown_input() = 0;
     virtual void shutdown_output() = 0;
     virtual bool is_closed() const = 0;
@@ -0,0 +1,88 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+// Congestion controllers of the native TCP stack
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+
+namespace seastar {
+
+namespace net {
+
+// What a connection learned from an acknowledgment
+struct congestion_sample {
+    using clock_type = std::chrono::steady_clock;
+    clock_type::time_point now;
+    // Bytes newly acknowledged by the cumulative ACK
+    uint32_t acked_bytes = 0;
+    // Bytes still in flight
+    uint32_t flight_size = 0;
+    // Round trip of the newest acknowledged segment that was never
+    // retransmitted, zero when there is none
+    std::chrono::microseconds rtt{0};
+    // Smoothed round trip time of the connection
+    std::chrono::microseconds srtt{0};
+    // Bytes per second delivered while the newest acknowledged segment
+    // was in flight, zero when there is no sample
+    uint64_t delivery_rate = 0;
+    // Fast retransmit or SACK loss recovery in progress, the connection
+    // then manages cwnd itself
+    bool in_recovery = false;
+};
+
+// The congestion state of a connection, in bytes
+struct congestion_window {
+    uint32_t& cwnd;
+    uint32_t& ssthresh;
+    uint32_t mss;
+};
+
+class congestion_controller {
+public:
+    virtual ~congestion_controller() = default;
+    // The name Linux uses for the algorithm
+    virtual const char* name() const noexcept = 0;
+    // Data was acknowledged
+    virtual void on_ack(congestion_window& w, const congestion_sample& s) = 0;
+    // Loss was detected with flight_size bytes in flight, returns the
+    // slow start threshold to recover with
+    virtual uint32_t on_loss(congestion_window& w, uint32_t flight_size, congestion_sample::clock_type::time_point now) = 0;
+    // The retransmission timer fired, cwnd was reset to one segment
+    virtual void on_timeout(congestion_window& w) {}
+    // Loss recovery completed
+    virtual void on_recovery_exit(congestion_window& w) {}
+    // Bytes per second transmissions are to be paced at, zero to send
+    // as the windows allow
+    virtual uint64_t pacing_rate() const noexcept { return 0; }
+};
+
+// Creates the controller called name, one of "reno", "cubic" or "bbr";
+// an empty name selects reno. Throws std::invalid_argument on other names.
+std::unique_ptr<congestion_controller> make_congestion_controller(std::string_view name);
+
+}
+
+}
@@ -25,18 +25,23 @@
 #include <seastar/core/queue.hh>
 #include <seastar/core/semaphore.hh>
 #include <seastar/core/byteorder.hh>
+#include <seastar/core/bitops.hh>
 #include <seastar/core/metrics.hh>
+#include <seastar/net/api.hh>
 #include <seastar/net/net.hh>
 #include <seastar/net/ip_checksum.hh>
 #include <seastar/net/ip.hh>
 #include <seastar/net/const.hh>
 #include <seastar/net/packet-util.hh>
+#include <seastar/net/tcp-congestion.hh>
 #include <seastar/util/std-compat.hh>
 #include <unordered_map>
 #include <map>
 #include <functional>
 #include <deque>
+#include <array>
 #include <chrono>
+#include <optional>
 #include <random>
 #include <stdexcept>
 #include <system_error>
@@ -93,10 +98,41 @@ void tcp_debug(const char* fmt, Args&&... args) {
 #endif
 }
 
+struct tcp_seq {
+    uint32_t raw;
+};
+
+inline tcp_seq ntoh(tcp_seq s) {
+    return tcp_seq { ntoh(s.raw) };
+}
+
+inline tcp_seq hton(tcp_seq s) {
+    return tcp_seq { hton(s.raw) };
+}
+
+inline
+std::ostream& operator<<(std::ostream& os, tcp_seq s) {
+    return os << s.raw;
+}
+
+inline tcp_seq make_seq(uint32_t raw) { return tcp_seq{raw}; }
+inline tcp_seq& operator+=(tcp_seq& s, int32_t n) { s.raw += n; return s; }
+inline tcp_seq& operator-=(tcp_seq& s, int32_t n) { s.raw -= n; return s; }
+inline tcp_seq operator+(tcp_seq s, int32_t n) { return s += n; }
+inline tcp_seq operator-(tcp_seq s, int32_t n) { return s -= n; }
+inline int32_t operator-(tcp_seq s, tcp_seq q) { return s.raw - q.raw; }
+inline bool operator==(tcp_seq s, tcp_seq q)  { return s.raw == q.raw; }
+inline bool operator!=(tcp_seq s, tcp_seq q) { return !(s == q); }
+inline bool operator<(tcp_seq s, tcp_seq q) { return s - q < 0; }
+inline bool operator>(tcp_seq s, tcp_seq q) { return q < s; }
+inline bool operator<=(tcp_seq s, tcp_seq q) { return !(s > q); }
+inline bool operator>=(tcp_seq s, tcp_seq q) { return !(s < q); }
+
 struct tcp_option {
     // The kind and len field are fixed and defined in TCP protocol
-    enum class option_kind: uint8_t { mss = 2, win_scale = 3, sack = 4, timestamps = 8,  nop = 1, eol = 0 };
-    enum class option_len:  uint8_t { mss = 4, win_scale = 3, sack = 2, timestamps = 10, nop = 1, eol = 1 };
+    enum class option_kind: uint8_t { mss = 2, win_scale = 3, sack = 4, sack_blocks = 5, timestamps = 8,  nop = 1, eol = 0 };
+    // sack_blocks is followed by 8 bytes per block
+    enum class option_len:  uint8_t { mss = 4, win_scale = 3, sack = 2, sack_blocks = 2, timestamps = 10, nop = 1, eol = 1 };
     static void write(char* p, option_kind kind, option_len len) {
         p[0] = static_cast<uint8_t>(kind);
         if (static_cast<uint8_t>(len) > 1) {
@@ -141,9 +177,47 @@ struct tcp_option {
             tcp_option::write(p, kind, len);
         }
     };
+    // RFC2018 blocks of data received out of order
+    struct sack_blocks {
+        static constexpr option_kind kind = option_kind::sack_blocks;
+        static constexpr option_len len = option_len::sack_blocks;
+        // As many blocks fit in the option space as long as timestamps are not sent
+        static constexpr unsigned max_blocks = 4;
+        static constexpr unsigned max_blocks_with_timestamps = 3;
+        struct block {
+            tcp_seq left;
+            tcp_seq right;
+        };
+        std::array<block, max_blocks> blocks;
+        unsigned nr = 0;
+        static tcp_option::sack_blocks read(const char* p) {
+            tcp_option::sack_blocks x;
+            x.nr = std::min(unsigned(uint8_t(p[1]) - uint8_t(len)) / 8, max_blocks);
+            for (unsigned i = 0; i < x.nr; i++) {
+                x.blocks[i].left = tcp_seq{read_be<uint32_t>(p + 2 + 8 * i)};
+                x.blocks[i].right = tcp_seq{read_be<uint32_t>(p + 6 + 8 * i)};
+            }
+            return x;
+        }
+        uint8_t size() const {
+            return uint8_t(len) + 8 * nr;
+        }
+        void write(char* p) const {
+            p[0] = static_cast<uint8_t>(kind);
+            p[1] = size();
+            for (unsigned i = 0; i < nr; i++) {
+                write_be<uint32_t>(p + 2 + 8 * i, blocks[i].left.raw);
+                write_be<uint32_t>(p + 6 + 8 * i, blocks[i].right.raw);
+            }
+        }
+    };
+    // RFC7323 timestamps: t1 is TSval, the sender's clock, and t2 is
+    // TSecr, the latest TSval received from the remote
     struct timestamps {
         static constexpr option_kind kind = option_kind::timestamps;
         static constexpr option_len len = option_len::timestamps;
+        // Space taken in every segment, with the padding
+        static constexpr uint8_t aligned_len = 12;
         uint32_t t1;
         uint32_t t2;
         static tcp_option::timestamps read(const char* p) {
@@ -175,6 +249,10 @@ struct tcp_option {
     static const uint8_t align = 4;
 
     void parse(uint8_t* beg, uint8_t* end);
+    // Extracts the SACK blocks of a segment, other options are skipped
+    static sack_blocks parse_sack_blocks(uint8_t* beg, uint8_t* end);
+    // Extracts the timestamps of a segment, if it carries them
+    static std::optional<timestamps> parse_timestamps(uint8_t* beg, uint8_t* end);
     uint8_t fill(void* h, const tcp_hdr* th, uint8_t option_size);
     uint8_t get_size(bool syn_on, bool ack_on);
 
@@ -189,41 +267,20 @@ struct tcp_option {
     uint16_t _local_mss;
     uint8_t _remote_win_scale = 0;
     uint8_t _local_win_scale = 0;
+    // Blocks to report in the next segment, once SACK was negotiated
+    sack_blocks _local_sack_blocks;
+    // Timestamps to send, once negotiated: our clock and TS.Recent, the
+    // value to echo to the remote
+    uint32_t _local_ts_val = 0;
+    uint32_t _ts_recent = 0;
+private:
+    // Returns the option of the given kind, or nullptr
+    static const char* find_option(uint8_t* beg, uint8_t* end, option_kind kind);
 };
 inline char*& operator+=(char*& x, tcp_option::option_len len) { x += uint8_t(len); return x; }
 inline const char*& operator+=(const char*& x, tcp_option::option_len len) { x += uint8_t(len); return x; }
 inline uint8_t& operator+=(uint8_t& x, tcp_option::option_len len) { x += uint8_t(len); return x; }
 
-struct tcp_seq {
-    uint32_t raw;
-};
-
-inline tcp_seq ntoh(tcp_seq s) {
-    return tcp_seq { ntoh(s.raw) };
-}
-
-inline tcp_seq hton(tcp_seq s) {
-    return tcp_seq { hton(s.raw) };
-}
-
-inline
-std::ostream& operator<<(std::ostream& os, tcp_seq s) {
-    return os << s.raw;
-}
-
-inline tcp_seq make_seq(uint32_t raw) { return tcp_seq{raw}; }
-inline tcp_seq& operator+=(tcp_seq& s, int32_t n) { s.raw += n; return s; }
-inline tcp_seq& operator-=(tcp_seq& s, int32_t n) { s.raw -= n; return s; }
-inline tcp_seq operator+(tcp_seq s, int32_t n) { return s += n; }
-inline tcp_seq operator-(tcp_seq s, int32_t n) { return s -= n; }
-inline int32_t operator-(tcp_seq s, tcp_seq q) { return s.raw - q.raw; }
-inline bool operator==(tcp_seq s, tcp_seq q)  { return s.raw == q.raw; }
-inline bool operator!=(tcp_seq s, tcp_seq q) { return !(s == q); }
-inline bool operator<(tcp_seq s, tcp_seq q) { return s - q < 0; }
-inline bool operator>(tcp_seq s, tcp_seq q) { return q < s; }
-inline bool operator<=(tcp_seq s, tcp_seq q) { return !(s > q); }
-inline bool operator>=(tcp_seq s, tcp_seq q) { return !(s < q); }
-
 struct tcp_hdr {
     static constexpr size_t len = 20;
     uint16_t src_port;
@@ -296,6 +353,27 @@ class tcp {
     using connid_hash = typename connid::connid_hash;
     class connection;
     class listener;
+    // Retransmissions of a connection, or of all of them
+    struct retransmit_stats {
+        uint64_t timeout = 0;
+        uint64_t fast = 0;
+        uint64_t sack = 0;
+        // Segments RACK deemed lost
+        uint64_t rack_losses = 0;
+        // Tail loss probes sent
+        uint64_t tlp = 0;
+    };
+    // Round trip times measured on a connection
+    struct rtt_histogram {
+        static constexpr unsigned nr_buckets = 24;
+        // Bucket i counts the samples from 2^i to 2^(i+1) microseconds,
+        // the last one also counts the longer ones
+        std::array<uint64_t, nr_buckets> buckets = {};
+        void add(std::chrono::microseconds rtt) noexcept {
+            auto us = std::max<uint64_t>(rtt.count(), 1);
+            buckets[std::min<unsigned>(log2floor(us), nr_buckets - 1)]++;
+        }
+    };
 private:
     class tcb;
 
@@ -325,6 +403,19 @@ class tcp {
             uint16_t data_len;
             unsigned nr_transmits;
             clock_type::time_point tx_time;
+            // For delivery rate samples: when it was sent, and the bytes
+            // delivered and the time of the latest delivery by then
+            congestion_sample::clock_type::time_point sent_time;
+            uint64_t delivered;
+            congestion_sample::clock_type::time_point delivered_time;
+            // Reported received by a SACK block of the remote
+            bool sacked = false;
+            // Deemed lost by the RFC6675 IsLost() heuristic or by RACK
+            bool lost = false;
+            // Deemed lost by RACK, until retransmitted
+            bool rack_lost = false;
+            // Retransmitted during the current SACK loss recovery
+            bool sack_retransmitted = false;
         };
         struct send {
             tcp_seq unacknowledged;
@@ -349,15 +440,27 @@ class tcp {
             // wait for there is at least one byte available in the queue
             std::optional<promise<>> _send_available_promise;
             // Round-trip time variation
-            std::chrono::milliseconds rttvar;
+            std::chrono::microseconds rttvar;
             // Smoothed round-trip time
-            std::chrono::milliseconds srtt;
+            std::chrono::microseconds srtt;
             bool first_rto_sample = true;
             clock_type::time_point syn_tx_time;
             // Congestion window
             uint32_t cwnd;
             // Slow start threshold
             uint32_t ssthresh;
+            // Bytes cumulatively acknowledged, and when the latest were
+            uint64_t delivered = 0;
+            congestion_sample::clock_type::time_point delivered_time;
+            // Round trip times measured with the high resolution clock
+            std::chrono::microseconds precise_srtt{0};
+            std::chrono::microseconds min_rtt = std::chrono::microseconds::max();
+            // RFC8985 RACK: the latest transmission known delivered, and
+            // the round trip it took
+            congestion_sample::clock_type::time_point rack_xmit_time;
+            tcp_seq rack_end_seq;
+            std::chrono::microseconds rack_rtt{0};
+            bool tlp_outstanding = false;
             // Duplicated ACKs
             uint16_t dupacks = 0;
             unsigned syn_retransmit = 0;
@@ -365,6 +468,10 @@ class tcp {
             uint32_t limited_transfer = 0;
             uint32_t partial_ack = 0;
             tcp_seq recover;
+            // RFC6675 loss recovery in progress, and the estimate of the
+            // bytes in flight that limits sending during it
+            bool sack_recovery = false;
+            uint32_t pipe = 0;
             bool window_probe = false;
             uint8_t zero_window_probing_out = 0;
         } _snd;
@@ -379,6 +486,13 @@ class tcp {
             // The total size of data stored in std::deque<packet> data
             size_t data_size = 0;
             tcp_packet_merger out_of_order;
+            // Start of the latest segment received out of order, its block
+            // is reported first in SACK options
+            tcp_seq last_out_of_order;
+            // RFC7323: the acknowledgment number last sent, and when
+            // TS.Recent was last updated
+            tcp_seq last_ack_sent;
+            clock_type::time_point ts_recent_stamp;
             std::optional<promise<>> _data_received_promise;
             // The maximun memory buffer size allowed for receiving
             // Currently, it is the same as default receive window size when window scaling is enabled
@@ -396,6 +510,23 @@ class tcp {
         static constexpr uint16_t _max_nr_retransmit{5};
         timer<lowres_clock> _retransmit;
         timer<lowres_clock> _persist;
+        std::unique_ptr<congestion_controller> _cc;
+        // Sub-RTO loss detection: the RACK reordering window and the
+        // tail loss probe timeout
+        timer<> _rack_reorder;
+        timer<> _tlp;
+        static constexpr std::chrono::milliseconds _tlp_min{1};
+        // Worst case delayed ACK of the remote
+        static constexpr std::chrono::milliseconds _tlp_delayed_ack{200};
+        retransmit_stats _retransmits;
+        rtt_histogram _rtt_histogram;
+        // Random offset of our timestamps, so they don't tell the uptime
+        uint32_t _ts_offset;
+        // Data is held back until then when the controller paces
+        timer<> _pacing;
+        congestion_sample::clock_type::time_point _next_send_time;
+        // Delivers the connection to this shard when RSS would not
+        std::unique_ptr<flow_rule> _flow_rule;
         uint16_t _nr_full_seg_received = 0;
         struct isn_secret {
             // 512 bits secretkey for ISN generating
@@ -428,7 +559,7 @@ class tcp {
         void input_handle_listen_state(tcp_hdr* th, packet p);
         void input_handle_syn_sent_state(tcp_hdr* th, packet p);
         void input_handle_other_state(tcp_hdr* th, packet p);
-        void output_one(bool data_retransmit = false);
+        void output_one(bool data_retransmit = false, size_t seg_idx = 0);
         future<> wait_for_data();
         void abort_reader() noexcept;
         future<> wait_for_all_data_acked();
@@ -466,6 +597,33 @@ class tcp {
         future<> connect_done() {
             return _connect_done.get_future();
         }
+        void set_congestion_control(std::string_view name) {
+            _cc = make_congestion_controller(name);
+        }
+        const char* congestion_control() const noexcept {
+            return _cc->name();
+        }
+        const retransmit_stats& get_retransmit_stats() const noexcept {
+            return _retransmits;
+        }
+        const rtt_histogram& get_rtt_histogram() const noexcept {
+            return _rtt_histogram;
+        }
+        tcp_connection_stats get_stats() const noexcept {
+            tcp_connection_stats stats;
+            stats.mss = send_mss();
+            stats.cwnd = _snd.cwnd;
+            stats.ssthresh = _snd.ssthresh;
+            stats.bytes_in_flight = _snd.sack_recovery ? _snd.pipe : uint32_t(_snd.next - _snd.unacknowledged);
+            stats.srtt = _snd.precise_srtt;
+            stats.rttvar = _snd.first_rto_sample ? std::chrono::microseconds(0) : _snd.rttvar;
+            stats.rto = _rto;
+            stats.retransmits = _retransmits.timeout + _retransmits.fast + _retransmits.sack + _retransmits.tlp;
+            return stats;
+        }
+        void set_flow_rule(std::unique_ptr<flow_rule> rule) {
+            _flow_rule = std::move(rule);
+        }
         tcp_state& state() {
             return _state;
         }
@@ -477,9 +635,9 @@ class tcp {
         bool should_send_ack(uint16_t seg_len);
         void clear_delayed_ack() noexcept;
         packet get_transmit_packet();
-        void retransmit_one() {
+        void retransmit_one(size_t seg_idx = 0) {
             bool data_retransmit = true;
-            output_one(data_retransmit);
+            output_one(data_retransmit, seg_idx);
         }
         void start_retransmit_timer() {
             auto now = clock_type::now();
@@ -506,8 +664,53 @@ class tcp {
         void persist();
         void retransmit();
         void fast_retransmit();
+        bool sack_enabled() const noexcept {
+            return _option._sack_received;
+        }
+        bool timestamps_enabled() const noexcept {
+            return _option._timestamps_received;
+        }
+        // Our timestamps tick every millisecond, as RFC7323 suggests
+        uint32_t ts_now() const noexcept {
+            auto now = congestion_sample::clock_type::now().time_since_epoch();
+            return uint32_t(std::chrono::duration_cast<std::chrono::milliseconds>(now).count()) + _ts_offset;
+        }
+        bool paws_reject(const tcp_option::timestamps& ts);
+        // Payload that fits in a segment along with the options sent in all of them
+        uint16_t send_mss() const noexcept {
+            return _snd.mss - (timestamps_enabled() ? tcp_option::timestamps::aligned_len : 0);
+        }
+        void update_sack_blocks();
+        void mark_sacked(const tcp_option::sack_blocks& sack);
+        void update_pipe();
+        void enter_sack_recovery();
+        void sack_retransmit();
+        bool has_lost() const noexcept {
+            return std::any_of(_snd.data.begin(), _snd.data.end(), [] (const unacked_segment& seg) { return seg.lost && !seg.sacked; });
+        }
+        void rack_update(unacked_segment& seg, tcp_seq end, congestion_sample::clock_type::time_point now);
+        void rack_detect_loss();
+        void rack_reorder_timeout();
+        void schedule_tail_loss_probe();
+        void tail_loss_probe();
+        void count_retransmit(uint64_t retransmit_stats::* counter) {
+            _retransmits.*counter += 1;
+            _tcp._stats.retransmits.*counter += 1;
+        }
         void update_rto(clock_type::time_point tx_time);
-        void update_cwnd(uint32_t acked_bytes);
+        void update_rto(std::chrono::microseconds rtt, unsigned expected_samples);
+        congestion_window cc_window() {
+            return congestion_window{_snd.cwnd, _snd.ssthresh, _snd.mss};
+        }
+        void update_cwnd(const congestion_sample& sample);
+        uint32_t ssthresh_on_loss(uint32_t flight_size) {
+            auto w = cc_window();
+            return _cc->on_loss(w, flight_size, congestion_sample::clock_type::now());
+        }
+        void cc_recovery_exit() {
+            auto w = cc_window();
+            _cc->on_recovery_exit(w);
+        }
         void cleanup();
         uint32_t can_send() {
             if (_snd.window_probe) {
@@ -530,7 +733,18 @@ class tcp {
 
             // Can not send more than congestion window allows
             x = std::min(_snd.cwnd, x);
-            if (_snd.dupacks == 1 || _snd.dupacks == 2) {
+            if (x && _cc->pacing_rate() && congestion_sample::clock_type::now() < _next_send_time) {
+                // Paced, data goes out when the pacing timer fires
+                if (!_pacing.armed()) {
+                    _pacing.arm(_next_send_time);
+                }
+                return 0;
+            }
+            if (_snd.sack_recovery) {
+                // RFC6675: the pipe, not an inflated cwnd, accounts for the
+                // segments that left the network
+                x = _snd.pipe < _snd.cwnd ? std::min(x, _snd.cwnd - _snd.pipe) : 0;
+            } else if (_snd.dupacks == 1 || _snd.dupacks == 2) {
                 // RFC5681 Step 3.1
                 // Send cwnd + 2 * smss per RFC3042
                 auto flight = flight_size();
@@ -645,8 +859,14 @@ class tcp {
             _snd.dupacks = 0;
             _snd.limited_transfer = 0;
             _snd.partial_ack = 0;
+            if (_snd.sack_recovery) {
+                _snd.sack_recovery = false;
+                for (auto& seg : _snd.data) {
+                    seg.sack_retransmitted = false;
+                }
+            }
         }
-        uint32_t data_segment_acked(tcp_seq seg_ack);
+        uint32_t data_segment_acked(tcp_seq seg_ack, const std::optional<tcp_option::timestamps>& ts);
         bool segment_acceptable(tcp_seq seg_seq, unsigned seg_len);
         void init_from_options(tcp_hdr* th, uint8_t* opt_start, uint8_t* opt_end);
         friend class connection;
@@ -661,6 +881,26 @@ class tcp {
     // queue for packets that do not belong to any tcb
     circular_buffer<ipv4_traits::l4packet> _packetq;
     semaphore _queue_space = {212992};
+    // Loss recovery of all connections
+    struct stats {
+        uint64_t sack_blocks_sent = 0;
+        uint64_t sack_blocks_received = 0;
+        uint64_t sacked_bytes = 0;
+        uint64_t sack_recoveries = 0;
+        // Segments dropped by RFC7323 PAWS as older than the ones seen
+        uint64_t paws_rejected = 0;
+        // Other received segments dropped, by reason
+        uint64_t bad_header = 0;
+        uint64_t bad_checksum = 0;
+        uint64_t no_connection = 0;
+        uint64_t listen_queue_full = 0;
+        uint64_t out_of_window = 0;
+        uint64_t out_of_order_segments = 0;
+        // Resets not sent because the queue of packets without a
+        // connection was full
+        uint64_t reset_drops = 0;
+        retransmit_stats retransmits;
+    } _stats;
     metrics::metric_groups _metrics;
 public:
     const inet_type& inet() const {
@@ -707,6 +947,23 @@ class tcp {
         uint16_t local_port() {
             return _tcb->_local_port;
         }
+        // Switches the connection to congestion controller name, see
+        // make_congestion_controller()
+        void set_congestion_control(std::string_view name) {
+            _tcb->set_congestion_control(name);
+        }
+        const char* congestion_control() const noexcept {
+            return _tcb->congestion_control();
+        }
+        const retransmit_stats& get_retransmit_stats() const noexcept {
+            return _tcb->get_retransmit_stats();
+        }
+        const rtt_histogram& get_rtt_histogram() const noexcept {
+            return _tcb->get_rtt_histogram();
+        }
+        tcp_connection_stats get_stats() const noexcept {
+            return _tcb->get_stats();
+        }
         void shutdown_connect();
         void close_read() noexcept;
         void close_write() noexcept;
@@ -716,6 +973,7 @@ class tcp {
         uint16_t _port;
         queue<connection> _q;
         size_t _pending = 0;
+        sstring _congestion_control;
     private:
         listener(tcp& t, uint16_t port, size_t queue_length)
             : _tcp(t), _port(port), _q(queue_length) {
@@ -723,7 +981,7 @@ class tcp {
         }
     public:
         listener(listener&& x)
-            : _tcp(x._tcp), _port(x._port), _q(std::move(x._q)) {
+            : _tcp(x._tcp), _port(x._port), _q(std::move(x._q)), _congestion_control(std::move(x._congestion_control)) {
             _tcp._listening[_port] = this;
             x._port = 0;
         }
@@ -740,6 +998,13 @@ class tcp {
         void abort_accept() {
             _q.abort(std::make_exception_ptr(std::system_error(ECONNABORTED, std::system_category())));
         }
+        // Congestion controller of the connections accepted from now on,
+        // see make_congestion_controller()
+        void set_congestion_control(std::string_view name) {
+            // Reject unknown names here, rather than on the first SYN
+            make_congestion_controller(name);
+            _congestion_control = sstring(name);
+        }
         bool full() { return _pending + _q.size() >= _q.max_size(); }
         void inc_pending() { _pending++; }
         void dec_pending() { _pending--; }
@@ -782,7 +1047,56 @@ tcp<InetTraits>::tcp(inet_type& inet)
     _metrics.add_group("tcp", {
         sm::make_counter("linearizations", [] { return tcp_packet_merger::linearizations(); },
                         sm::description("Counts a number of times a buffer linearization was invoked during the buffers merge process. "
-                                        "Divide it by a total TCP receive packet rate to get an everage number of lineraizations per TCP packet."))
+                                        "Divide it by a total TCP receive packet rate to get an everage number of lineraizations per TCP packet.")),
+        sm::make_counter("sack_blocks_sent", _stats.sack_blocks_sent,
+                        sm::description("Counts SACK blocks reported to remotes about data received out of order")),
+        sm::make_counter("sack_blocks_received", _stats.sack_blocks_received,
+                        sm::description("Counts SACK blocks received from remotes")),
+        sm::make_counter("sacked_bytes", _stats.sacked_bytes,
+                        sm::description("Counts bytes of sent data reported received by SACK blocks ahead of the cumulative acknowledgment")),
+        sm::make_counter("sack_recoveries", _stats.sack_recoveries,
+                        sm::description("Counts the loss recovery episodes driven by SACK information")),
+        sm::make_counter("paws_rejected", _stats.paws_rejected,
+                        sm::description("Counts segments dropped because their timestamp is older than the ones received before (PAWS)")),
+        sm::make_counter("out_of_order_segments", _stats.out_of_order_segments,
+                        sm::description("Counts segments received ahead of the next expected sequence number, and queued until the gap is filled")),
+        sm::make_counter("reset_drops", _stats.reset_drops,
+                        sm::description("Counts resets not sent because too many packets without a connection were queued")),
+        sm::make_counter("sack_retransmits", _stats.retransmits.sack,
+                        sm::description("Counts segments retransmitted during SACK based loss recovery")),
+        sm::make_counter("fast_retransmits", _stats.retransmits.fast,
+                        sm::description("Counts segments retransmitted by NewReno fast retransmit, for connections without SACK")),
+        sm::make_counter("timeout_retransmits", _stats.retransmits.timeout,
+                        sm::description("Counts segments retransmitted on retransmission timeout")),
+        sm::make_counter("rack_losses", _stats.retransmits.rack_losses,
+                        sm::description("Counts segments RACK deemed lost from the delivery of segments sent after them")),
+        sm::make_counter("tlp_probes", _stats.retransmits.tlp,
+                        sm::description("Counts tail loss probes sent ahead of the retransmission timeout")),
+        // Sampled from the connections when the metrics are read
+        sm::make_gauge("connections", [this] { return _tcbs.size(); },
+                        sm::description("Holds the number of TCP connections")),
+        sm::make_gauge("bytes_in_flight", [this] {
+                            uint64_t bytes = 0;
+                            for (auto&& [id, tcbp] : _tcbs) {
+                                bytes += tcbp->get_stats().bytes_in_flight;
+                            }
+                            return bytes;
+                        },
+                        sm::description("Holds the bytes in flight over all connections, sent and neither acknowledged nor deemed lost"))
+    });
+
+    auto drops = [] (uint64_t& counter, const char* reason) {
+        return sm::make_counter("rx_drops", counter,
+                        sm::description("Counts received segments dropped by TCP, by reason"),
+                        {sm::label_instance("reason", reason)});
+    };
+    _metrics.add_group("tcp", {
+        drops(_stats.bad_header, "bad_header"),
+        drops(_stats.bad_checksum, "bad_checksum"),
+        drops(_stats.no_connection, "no_connection"),
+        drops(_stats.listen_queue_full, "listen_queue_full"),
+        drops(_stats.out_of_window, "out_of_window"),
+        drops(_stats.paws_rejected, "paws"),
     });
 
     _inet.register_packet_provider([this, tcb_polled = 0u] () mutable {
@@ -829,15 +1143,30 @@ auto tcp<InetTraits>::connect(socket_address sa) -> connection {
     auto src_ip = _inet._inet.host_address();
     auto dst_ip = ipv4_address(sa);
     auto dst_port = net::ntoh(sa.u.in.sin_port);
+    auto netif = _inet._inet.netif();
+    auto pick_port = [&] {
+        do {
+            src_port = _port_dist(_e);
+            id = connid{src_ip, dst_ip, src_port, dst_port};
+        } while (_tcbs.find(id) != _tcbs.end());
+    };
+    auto rss_to_here = [&] {
+        return netif->hw_queues_count() <= 1 || netif->hash2cpu(id.hash(netif->rss_key())) == this_shard_id();
+    };
 
-    do {
-        src_port = _port_dist(_e);
-        id = connid{src_ip, dst_ip, src_port, dst_port};
-    } while (_inet._inet.netif()->hw_queues_count() > 1 &&
-             (_inet._inet.netif()->hash2cpu(id.hash(_inet._inet.netif()->rss_key())) != this_shard_id()
-              || _tcbs.find(id) != _tcbs.end()));
+    pick_port();
+    std::unique_ptr<flow_rule> rule;
+    if (!rss_to_here()) {
+        // Rather than searching for a port RSS delivers here, ask the
+        // device to steer the connection here
+        rule = netif->steer_flow(flow_tuple{dst_ip, src_ip, dst_port, src_port, ip_protocol_num::tcp});
+        while (!rule && !rss_to_here()) {
+            pick_port();
+        }
+    }
 
     auto tcbp = make_lw_shared<tcb>(*this, id);
+    tcbp->set_flow_rule(std::move(rule));
     _tcbs.insert({id, tcbp});
     tcbp->connect();
     return connection(tcbp);
@@ -860,11 +1189,13 @@ template <typename InetTraits>
 void tcp<InetTraits>::received(packet p, ipaddr from, ipaddr to) {
     auto th = p.get_header(0, tcp_hdr::len);
     if (!th) {
+        _stats.bad_header++;
         return;
     }
     // data_offset is correct even before ntoh()
     auto data_offset = uint8_t(th[12]) >> 4;
     if (size_t(data_offset * 4) < tcp_hdr::len) {
+        _stats.bad_header++;
         return;
     }
 
@@ -873,6 +1204,7 @@ void tcp<InetTraits>::received(packet p, ipaddr from, ipaddr to) {
         InetTraits::tcp_pseudo_header_checksum(csum, from, to, p.len());
         csum.sum(p);
         if (csum.get() != 0) {
+            _stats.bad_checksum++;
             return;
         }
     }
@@ -883,6 +1215,11 @@ void tcp<InetTraits>::received(packet p, ipaddr from, ipaddr to) {
     if (tcbi == _tcbs.end()) {
         auto listener = _listening.find(id.local_port);
         if (listener == _listening.end() || listener->second->full()) {
+            if (listener == _listening.end()) {
+                _stats.no_connection++;
+            } else {
+                _stats.listen_queue_full++;
+            }
             // 1) In CLOSE state
             // 1.1 all data in the incoming segment is discarded.  An incoming
             // segment containing a RST is discarded. An incoming segment not
@@ -910,6 +1247,7 @@ void tcp<InetTraits>::received(packet p, ipaddr from, ipaddr to) {
                 // check the security
                 // NOTE: Ignored for now
                 tcbp = make_lw_shared<tcb>(*this, id);
+                tcbp->set_congestion_control(listener->second->_congestion_control);
                 _tcbs.insert({id, tcbp});
                 // TODO: we need to remove the tcb and decrease the pending if
                 // it stays SYN_RECEIVED state forever.
@@ -944,6 +1282,8 @@ void tcp<InetTraits>::send_packet_without_tcb(ipaddr from, ipaddr to, packet p)
         (void)_inet.get_l2_dst_address(to).then([this, to, p = std::move(p)] (ethernet_address e_dst) mutable {
                 _packetq.emplace_back(ipv4_traits::l4packet{to, std::move(p), e_dst, ip_protocol_num::tcp});
         });
+    } else {
+        _stats.reset_drops++;
     }
 }
 
@@ -965,7 +1305,12 @@ tcp<InetTraits>::tcb::tcb(tcp& t, connid id)
     , _foreign_port(id.foreign_port)
     , _delayed_ack([this] { _nr_full_seg_received = 0; output(); })
     , _retransmit([this] { retransmit(); })
-    , _persist([this] { persist(); }) {
+    , _persist([this] { persist(); })
+    , _cc(make_congestion_controller({}))
+    , _rack_reorder([this] { rack_reorder_timeout(); })
+    , _tlp([this] { tail_loss_probe(); })
+    , _ts_offset(t._e())
+    , _pacing([this] { output(); }) {
 }
 
 template <typename InetTraits>
@@ -1018,18 +1363,34 @@ void tcp<InetTraits>::respond_with_reset(tcp_hdr* rth, ipaddr local_ip, ipaddr f
 }
 
 template <typename InetTraits>
-uint32_t tcp<InetTraits>::tcb::data_segment_acked(tcp_seq seg_ack) {
+uint32_t tcp<InetTraits>::tcb::data_segment_acked(tcp_seq seg_ack, const std::optional<tcp_option::timestamps>& ts) {
     uint32_t total_acked_bytes = 0;
+    // RFC7323 Appendix G: one RTT sample per ACK rather than per round trip
+    auto expected_samples = ts ? std::max(1u, (flight_size() + 2 * _snd.mss - 1) / (2 * _snd.mss)) : 1;
+    congestion_sample sample;
+    sample.now = congestion_sample::clock_type::now();
+    // The newest segment acknowledged that was sent once gives the samples
+    bool have_rs = false;
+    uint64_t rs_delivered = 0;
+    congestion_sample::clock_type::time_point rs_delivered_time;
     // Full ACK of segment
     while (!_snd.data.empty()
             && (_snd.unacknowledged + _snd.data.front().p.len() <= seg_ack)) {
         auto acked_bytes = _snd.data.front().p.len();
         _snd.unacknowledged += acked_bytes;
-        // Ignore retransmitted segments when setting the RTO
+        // Ignore retransmitted segments when setting the RTO, the
+        // echoed timestamp gives the sample when there is one
         if (_snd.data.front().nr_transmits == 0) {
-            update_rto(_snd.data.front().tx_time);
+            if (!ts) {
+                update_rto(_snd.data.front().tx_time);
+            }
+            auto& rs = _snd.data.front();
+            have_rs = true;
+            sample.rtt = std::chrono::duration_cast<std::chrono::microseconds>(sample.now - rs.sent_time);
+            rs_delivered = rs.delivered;
+            rs_delivered_time = rs.delivered_time;
         }
-        update_cwnd(acked_bytes);
+        rack_update(_snd.data.front(), _snd.unacknowledged, sample.now);
         total_acked_bytes += acked_bytes;
         _snd.current_queue_space -= _snd.data.front().data_len;
         signal_send_available();
@@ -1043,12 +1404,58 @@ uint32_t tcp<InetTraits>::tcb::data_segment_acked(tcp_seq seg_ack) {
             unacked_seg.p.trim_front(acked_bytes);
         }
         _snd.unacknowledged = seg_ack;
-        update_cwnd(acked_bytes);
         total_acked_bytes += acked_bytes;
     }
+
+    _snd.delivered += total_acked_bytes;
+    _snd.delivered_time = sample.now;
+    if (total_acked_bytes) {
+        // The tail loss probe episode, if any, is over
+        _snd.tlp_outstanding = false;
+    }
+    if (ts && total_acked_bytes) {
+        // RFC7323 4.1: the echoed timestamp tells when the segment that
+        // triggered the ACK was sent, retransmitted or not
+        auto rtt = int32_t(ts_now() - ts->t2);
+        if (rtt >= 0 && std::chrono::milliseconds(rtt) <= _rto_max) {
+            update_rto(std::chrono::milliseconds(rtt), expected_samples);
+        }
+    }
+    if (have_rs) {
+        // SRTT <- (1 - alpha) * SRTT + alpha * R', as RFC6298 does
+        _snd.precise_srtt = _snd.precise_srtt.count() ? _snd.precise_srtt * 7 / 8 + sample.rtt / 8 : sample.rtt;
+        _snd.min_rtt = std::min(_snd.min_rtt, sample.rtt);
+        _rtt_histogram.add(sample.rtt);
+    }
+    if (have_rs) {
+        auto interval = std::chrono::duration<double>(sample.now - rs_delivered_time).count();
+        if (interval > 0) {
+            sample.delivery_rate = (_snd.delivered - rs_delivered) / interval;
+        }
+    }
+    sample.acked_bytes = total_acked_bytes;
+    sample.flight_size = flight_size();
+    sample.srtt = _snd.precise_srtt;
+    sample.in_recovery = _snd.sack_recovery || _snd.dupacks >= 3;
+    update_cwnd(sample);
     return total_acked_bytes;
 }
 
+template <typename InetTraits>
+bool tcp<InetTraits>::tcb::paws_reject(const tcp_option::timestamps& ts) {
+    if (int32_t(ts.t1 - _option._ts_recent) >= 0) {
+        return false;
+    }
+    // RFC7323 5.5: TS.Recent is not trusted after 24 days of idleness,
+    // the remote's clock may have wrapped around
+    if (clock_type::now() - _rcv.ts_recent_stamp > std::chrono::hours(24 * 24)) {
+        _option._ts_recent = ts.t1;
+        _rcv.ts_recent_stamp = clock_type::now();
+        return false;
+    }
+    return true;
+}
+
 template <typename InetTraits>
 bool tcp<InetTraits>::tcb::segment_acceptable(tcp_seq seg_seq, unsigned seg_len) {
     if (seg_len == 0 && _rcv.window == 0) {
@@ -1085,6 +1492,10 @@ void tcp<InetTraits>::tcb::init_from_options(tcp_hdr* th, uint8_t* opt_start, ui
     // Maximum segment size local can receive
     _rcv.mss = _option._local_mss = local_mss();
 
+    // TS.Recent holds the timestamp of the SYN, if timestamps are used
+    _rcv.last_ack_sent = _rcv.next;
+    _rcv.ts_recent_stamp = clock_type::now();
+
     _rcv.window = get_default_receive_window_size();
     _snd.window = th->window << _snd.window_scale;
 
@@ -1207,6 +1618,18 @@ void tcp<InetTraits>::tcb::input_handle_syn_sent_state(tcp_hdr* th, packet p) {
 
 template <typename InetTraits>
 void tcp<InetTraits>::tcb::input_handle_other_state(tcp_hdr* th, packet p) {
+    tcp_option::sack_blocks sack;
+    std::optional<tcp_option::timestamps> ts;
+    if (th->data_offset * 4 > tcp_hdr::len) {
+        auto opt_start = reinterpret_cast<uint8_t*>(p.get_header(0, th->data_offset * 4)) + tcp_hdr::len;
+        auto opt_end = opt_start + th->data_offset * 4 - tcp_hdr::len;
+        if (sack_enabled()) {
+            sack = tcp_option::parse_sack_blocks(opt_start, opt_end);
+        }
+        if (timestamps_enabled()) {
+            ts = tcp_option::parse_timestamps(opt_start, opt_end);
+        }
+    }
     p.trim_front(th->data_offset * 4);
     bool do_output = false;
     bool do_output_data = false;
@@ -1214,12 +1637,28 @@ void tcp<InetTraits>::tcb::input_handle_other_state(tcp_hdr* th, packet p) {
     auto seg_ack = th->ack;
     auto seg_len = p.len();
 
+    // RFC7323 5.3 R1: PAWS, drop old duplicates of wrapped around
+    // sequence numbers
+    if (ts && !th->f_rst && paws_reject(*ts)) {
+        _tcp._stats.paws_rejected++;
+        //<SEQ=SND.NXT><ACK=RCV.NXT><CTL=ACK>
+        return output();
+    }
+
     // 4.1 first check sequence number
     if (!segment_acceptable(seg_seq, seg_len)) {
+        _tcp._stats.out_of_window++;
         //<SEQ=SND.NXT><ACK=RCV.NXT><CTL=ACK>
         return output();
     }
 
+    // RFC7323 4.3: echo the timestamp of the earliest segment the next
+    // ACK acknowledges
+    if (ts && int32_t(ts->t1 - _option._ts_recent) >= 0 && seg_seq <= _rcv.last_ack_sent) {
+        _option._ts_recent = ts->t1;
+        _rcv.ts_recent_stamp = clock_type::now();
+    }
+
     // In the following it is assumed that the segment is the idealized
     // segment that begins at RCV.NXT and does not exceed the window.
     if (seg_seq < _rcv.next) {
@@ -1232,6 +1671,7 @@ void tcp<InetTraits>::tcb::input_handle_other_state(tcp_hdr* th, packet p) {
     // FIXME: We should trim data outside the right edge of the receive window as well
 
     if (seg_seq != _rcv.next) {
+        _tcp._stats.out_of_order_segments++;
         insert_out_of_order(seg_seq, std::move(p));
         // A TCP receiver SHOULD send an immediate duplicate ACK
         // when an out-of-order segment arrives.
@@ -1329,7 +1769,10 @@ void tcp<InetTraits>::tcb::input_handle_other_state(tcp_hdr* th, packet p) {
             // If SND.UNA < SEG.ACK =< SND.NXT then, set SND.UNA <- SEG.ACK.
             if (_snd.unacknowledged < seg_ack && seg_ack <= _snd.next) {
                 // Remote ACKed data we sent
-                auto acked_bytes = data_segment_acked(seg_ack);
+                auto acked_bytes = data_segment_acked(seg_ack, ts);
+                if (sack_enabled()) {
+                    mark_sacked(sack);
+                }
 
                 // If SND.UNA < SEG.ACK =< SND.NXT, the send window should be updated.
                 if (_snd.wl1 < seg_seq || (_snd.wl1 == seg_seq && _snd.wl2 <= seg_ack)) {
@@ -1340,9 +1783,11 @@ void tcp<InetTraits>::tcb::input_handle_other_state(tcp_hdr* th, packet p) {
                 do_output_data = true;
 
                 auto set_retransmit_timer = [this] {
+                    schedule_tail_loss_probe();
                     if (_snd.data.empty()) {
                         // All outstanding segments are acked, turn off the timer.
                         stop_retransmit_timer();
+                        _rack_reorder.cancel();
                         // Signal the waiter of this event
                         signal_all_data_acked();
                     } else {
@@ -1351,7 +1796,20 @@ void tcp<InetTraits>::tcb::input_handle_other_state(tcp_hdr* th, packet p) {
                     }
                 };
 
-                if (_snd.dupacks >= 3) {
+                if (_snd.sack_recovery) {
+                    if (seg_ack > _snd.recover) {
+                        tcp_debug("ack: sack recovery full_ack\n");
+                        // RFC6675: recovery ends once RecoveryPoint is ACKed
+                        _snd.cwnd = _snd.ssthresh;
+                        exit_fast_recovery();
+                        cc_recovery_exit();
+                    } else {
+                        // A partial ACK, keep repairing the holes
+                        update_pipe();
+                        sack_retransmit();
+                    }
+                    set_retransmit_timer();
+                } else if (_snd.dupacks >= 3) {
                     // We are in fast retransmit / fast recovery phase
                     uint32_t smss = _snd.mss;
                     if (seg_ack > _snd.recover) {
@@ -1360,6 +1818,7 @@ void tcp<InetTraits>::tcb::input_handle_other_state(tcp_hdr* th, packet p) {
                         _snd.cwnd = std::min(_snd.ssthresh, std::max(flight_size(), smss) + smss);
                         // Exit the fast recovery procedure
                         exit_fast_recovery();
+                        cc_recovery_exit();
                         set_retransmit_timer();
                     } else {
                         tcp_debug("ack: partial_ack\n");
@@ -1391,6 +1850,11 @@ void tcp<InetTraits>::tcb::input_handle_other_state(tcp_hdr* th, packet p) {
                     // SND.UNA.
                     exit_fast_recovery();
                     set_retransmit_timer();
+                    // Loss can be inferred from SACK blocks alone, without
+                    // waiting for duplicate ACKs
+                    if (sack_enabled() && has_lost() && seg_ack - 1 > _snd.recover) {
+                        enter_sack_recovery();
+                    }
                 }
             } else if ((packets_out > 0) && !_snd.data.empty() && seg_len == 0 &&
                 th->f_fin == 0 && th->f_syn == 0 &&
@@ -1405,8 +1869,22 @@ void tcp<InetTraits>::tcb::input_handle_other_state(tcp_hdr* th, packet p) {
                 // Here, We follow RFC5681.
                 _snd.dupacks++;
                 uint32_t smss = _snd.mss;
-                // 3 duplicated ACKs trigger a fast retransmit
-                if (_snd.dupacks == 1 || _snd.dupacks == 2) {
+                if (sack_enabled()) {
+                    mark_sacked(sack);
+                }
+                if (_snd.sack_recovery) {
+                    // RFC6675 Step 4.3: the pipe accounts for the segment
+                    // that left the network, no cwnd inflation
+                    sack_retransmit();
+                    do_output_data = true;
+                } else if (sack_enabled() && (_snd.dupacks >= 3 || has_lost()) && seg_ack - 1 > _snd.recover) {
+                    // RFC6675 Section 5: DupThresh duplicate ACKs, or
+                    // segments deemed lost by IsLost() or RACK, start loss
+                    // recovery
+                    enter_sack_recovery();
+                    do_output_data = true;
+                } else if (_snd.dupacks == 1 || _snd.dupacks == 2) {
+                    // 3 duplicated ACKs trigger a fast retransmit
                     // RFC5681 Step 3.1
                     // Send cwnd + 2 * smss per RFC3042
                     do_output_data = true;
@@ -1415,7 +1893,7 @@ void tcp<InetTraits>::tcb::input_handle_other_state(tcp_hdr* th, packet p) {
                     if (seg_ack - 1 > _snd.recover) {
                         _snd.recover = _snd.next - 1;
                         // RFC5681 Step 3.2
-                        _snd.ssthresh = std::max((flight_size() - _snd.limited_transfer) / 2, 2 * smss);
+                        _snd.ssthresh = ssthresh_on_loss(flight_size() - _snd.limited_transfer);
                         fast_retransmit();
                     } else {
                         // Do not enter fast retransmit and do not reset ssthresh
@@ -1578,6 +2056,7 @@ packet tcp<InetTraits>::tcb::get_transmit_packet() {
         len = _tcp.hw_features().max_packet_len - net::tcp_hdr_len_min - InetTraits::ip_hdr_len_min;
     } else {
         len = std::min(uint16_t(_tcp.hw_features().mtu - net::tcp_hdr_len_min - InetTraits::ip_hdr_len_min), _snd.mss);
+        len = std::min(len, uint32_t(send_mss()));
     }
     can_send = std::min(can_send, len);
     // easy case: one small packet
@@ -1614,17 +2093,19 @@ packet tcp<InetTraits>::tcb::get_transmit_packet() {
 }
 
 template <typename InetTraits>
-void tcp<InetTraits>::tcb::output_one(bool data_retransmit) {
+void tcp<InetTraits>::tcb::output_one(bool data_retransmit, size_t seg_idx) {
     if (in_state(CLOSED)) {
         return;
     }
 
-    packet p = data_retransmit ? _snd.data.front().p.share() : get_transmit_packet();
+    packet p = data_retransmit ? _snd.data[seg_idx].p.share() : get_transmit_packet();
     packet clone = p.share();  // early clone to prevent share() from calling packet::unuse_internal_data() on header.
     uint16_t len = p.len();
     bool syn_on = syn_needs_on();
     bool ack_on = ack_needs_on();
 
+    update_sack_blocks();
+    _option._local_ts_val = ts_now();
     auto options_size = _option.get_size(syn_on, ack_on);
     auto th = p.prepend_uninitialized_header(tcp_hdr::len + options_size);
     auto h = tcp_hdr{};
@@ -1643,12 +2124,32 @@ void tcp<InetTraits>::tcb::output_one(bool data_retransmit) {
     tcp_seq seq;
     if (data_retransmit) {
         seq = _snd.unacknowledged;
+        for (size_t i = 0; i < seg_idx; i++) {
+            seq += _snd.data[i].p.len();
+        }
     } else {
         seq = syn_on ? _snd.initial : _snd.next;
         _snd.next += len;
     }
+    if (_snd.sack_recovery) {
+        _snd.pipe += len;
+    }
+    auto now_sent = congestion_sample::clock_type::now();
+    if (data_retransmit) {
+        // RACK judges segments by their latest transmission
+        _snd.data[seg_idx].sent_time = now_sent;
+    }
+    if (len) {
+        if (auto rate = _cc->pacing_rate()) {
+            auto gap = std::chrono::duration<double>(double(len) / rate);
+            _next_send_time = std::max(_next_send_time, now_sent) + std::chrono::duration_cast<congestion_sample::clock_type::duration>(gap);
+        }
+    }
     h.seq = seq;
     h.ack = _rcv.next;
+    if (ack_on) {
+        _rcv.last_ack_sent = h.ack;
+    }
     h.data_offset = (tcp_hdr::len + options_size) / 4;
     h.window = _rcv.window >> _rcv.window_scale;
     h.checksum = 0;
@@ -1679,8 +2180,8 @@ void tcp<InetTraits>::tcb::output_one(bool data_retransmit) {
         // segment length set to 0. All the rest is the same as for a TCP Tx
         // CSUM offload case.
         //
-        if (_tcp.hw_features().tx_tso && len > _snd.mss) {
-            oi.tso_seg_size = _snd.mss;
+        if (_tcp.hw_features().tx_tso && len > send_mss()) {
+            oi.tso_seg_size = send_mss();
         } else {
             pseudo_hdr_seg_len = tcp_hdr::len + options_size + len;
         }
@@ -1709,8 +2210,14 @@ void tcp<InetTraits>::tcb::output_one(bool data_retransmit) {
         auto now = clock_type::now();
         if (len) {
             unsigned nr_transmits = 0;
+            if (_snd.data.empty()) {
+                // A new flight starts, do not count the idle time in
+                // delivery rate samples
+                _snd.delivered_time = now_sent;
+            }
             _snd.data.emplace_back(unacked_segment{std::move(clone),
-                                   len, nr_transmits, now});
+                                   len, nr_transmits, now, now_sent, _snd.delivered, _snd.delivered_time});
+            schedule_tail_loss_probe();
         }
         if (!_retransmit.armed()) {
             start_retransmit_timer(now);
@@ -1909,6 +2416,9 @@ bool tcp<InetTraits>::tcb::merge_out_of_order() {
 
 template <typename InetTraits>
 void tcp<InetTraits>::tcb::insert_out_of_order(tcp_seq seg, packet p) {
+    if (p.len()) {
+        _rcv.last_out_of_order = seg;
+    }
     _rcv.out_of_order.merge(seg, std::move(p));
 }
 
@@ -1974,15 +2484,26 @@ void tcp<InetTraits>::tcb::retransmit() {
     // Update ssthresh only for the first retransmit
     uint32_t smss = _snd.mss;
     if (unacked_seg.nr_transmits == 0) {
-        _snd.ssthresh = std::max(flight_size() / 2, 2 * smss);
+        _snd.ssthresh = ssthresh_on_loss(flight_size());
     }
     // RFC6582 Step 4
     _snd.recover = _snd.next - 1;
     // Start the slow start process
     _snd.cwnd = smss;
+    auto w = cc_window();
+    _cc->on_timeout(w);
     // End fast recovery
     exit_fast_recovery();
 
+    // RFC2018: the receiver may have dropped the data it SACKed
+    for (auto& seg : _snd.data) {
+        seg.sacked = false;
+        seg.lost = false;
+        seg.rack_lost = false;
+    }
+    _rack_reorder.cancel();
+    _tlp.cancel();
+
     if (unacked_seg.nr_transmits < _max_nr_retransmit) {
         unacked_seg.nr_transmits++;
     } else {
@@ -1990,6 +2511,7 @@ void tcp<InetTraits>::tcb::retransmit() {
         do_reset();
         return;
     }
+    count_retransmit(&retransmit_stats::timeout);
     retransmit_one();
 
     output_update_rto();
@@ -2000,15 +2522,250 @@ void tcp<InetTraits>::tcb::fast_retransmit() {
     if (!_snd.data.empty()) {
         auto& unacked_seg = _snd.data.front();
         unacked_seg.nr_transmits++;
+        count_retransmit(&retransmit_stats::fast);
         retransmit_one();
         output();
     }
 }
 
+template <typename InetTraits>
+void tcp<InetTraits>::tcb::update_sack_blocks() {
+    auto& sack = _option._local_sack_blocks;
+    sack.nr = 0;
+    auto& ooo = _rcv.out_of_order.map;
+    if (!sack_enabled() || ooo.empty()) {
+        return;
+    }
+    auto add_block = [&sack] (auto it) {
+        sack.blocks[sack.nr++] = {it->first, it->first + it->second.len()};
+    };
+    // RFC2018: the first block must hold the latest segment received, the
+    // merger keeps contiguous data in one entry so every entry is a block
+    auto latest = std::find_if(ooo.begin(), ooo.end(), [this] (auto& e) {
+        return e.first <= _rcv.last_out_of_order && _rcv.last_out_of_order < e.first + e.second.len();
+    });
+    if (latest != ooo.end()) {
+        add_block(latest);
+    }
+    auto max_blocks = timestamps_enabled() ? sack.max_blocks_with_timestamps : sack.max_blocks;
+    for (auto it = ooo.begin(); it != ooo.end() && sack.nr < max_blocks; ++it) {
+        if (it != latest) {
+            add_block(it);
+        }
+    }
+    _tcp._stats.sack_blocks_sent += sack.nr;
+}
+
+template <typename InetTraits>
+void tcp<InetTraits>::tcb::mark_sacked(const tcp_option::sack_blocks& sack) {
+    auto now = congestion_sample::clock_type::now();
+    _tcp._stats.sack_blocks_received += sack.nr;
+    for (unsigned i = 0; i < sack.nr; i++) {
+        auto& b = sack.blocks[i];
+        // Ignore blocks below the cumulative ACK (D-SACK) or past what was sent
+        if (b.right <= _snd.unacknowledged || b.right > _snd.next || b.left >= b.right) {
+            continue;
+        }
+        auto seq = _snd.unacknowledged;
+        for (auto& seg : _snd.data) {
+            auto end = seq + seg.p.len();
+            if (seq >= b.right) {
+                break;
+            }
+            if (!seg.sacked && b.left <= seq && end <= b.right) {
+                seg.sacked = true;
+                _tcp._stats.sacked_bytes += seg.p.len();
+                rack_update(seg, end, now);
+            }
+            seq = end;
+        }
+    }
+    rack_detect_loss();
+    update_pipe();
+}
+
+template <typename InetTraits>
+void tcp<InetTraits>::tcb::update_pipe() {
+    // RFC6675 IsLost(): a segment is lost when DupThresh segments, or more
+    // than (DupThresh - 1) * SMSS bytes, above it were SACKed
+    constexpr unsigned dup_thresh = 3;
+    uint32_t sacked_bytes_above = 0;
+    unsigned sacked_segs_above = 0;
+    uint32_t pipe = 0;
+    for (auto it = _snd.data.rbegin(); it != _snd.data.rend(); ++it) {
+        auto& seg = *it;
+        if (seg.sacked) {
+            sacked_bytes_above += seg.p.len();
+            sacked_segs_above++;
+            continue;
+        }
+        seg.lost = seg.rack_lost || sacked_segs_above >= dup_thresh || sacked_bytes_above > (dup_thresh - 1) * _snd.mss;
+        // Segments not lost are still in flight, and so are retransmissions
+        if (!seg.lost) {
+            pipe += seg.p.len();
+        }
+        if (seg.sack_retransmitted) {
+            pipe += seg.p.len();
+        }
+    }
+    _snd.pipe = pipe;
+}
+
+template <typename InetTraits>
+void tcp<InetTraits>::tcb::enter_sack_recovery() {
+    _tcp._stats.sack_recoveries++;
+    // RFC6675 Section 5 steps 4.1 to 4.4
+    _snd.recover = _snd.next - 1;
+    _snd.ssthresh = ssthresh_on_loss(flight_size() - _snd.limited_transfer);
+    _snd.cwnd = _snd.ssthresh;
+    _snd.sack_recovery = true;
+    update_pipe();
+    // The first unSACKed segment is retransmitted even if the pipe is full
+    auto first = std::find_if(_snd.data.begin(), _snd.data.end(), [] (auto& seg) { return !seg.sacked; });
+    if (first != _snd.data.end()) {
+        first->lost = true;
+        first->sack_retransmitted = true;
+        first->nr_transmits++;
+        count_retransmit(&retransmit_stats::sack);
+        retransmit_one(first - _snd.data.begin());
+    }
+    sack_retransmit();
+}
+
+template <typename InetTraits>
+void tcp<InetTraits>::tcb::sack_retransmit() {
+    // RFC6675 NextSeg() rule 1: fill the holes deemed lost, lowest first,
+    // while the pipe leaves room for a segment. New data is sent by
+    // output() once the holes are repaired
+    uint32_t smss = _snd.mss;
+    for (size_t i = 0; i < _snd.data.size() && _snd.pipe + smss <= _snd.cwnd; i++) {
+        auto& seg = _snd.data[i];
+        if (seg.sacked || !seg.lost || seg.sack_retransmitted) {
+            continue;
+        }
+        seg.sack_retransmitted = true;
+        seg.nr_transmits++;
+        count_retransmit(&retransmit_stats::sack);
+        retransmit_one(i);
+    }
+    output();
+}
+
+template <typename InetTraits>
+void tcp<InetTraits>::tcb::rack_update(unacked_segment& seg, tcp_seq end, congestion_sample::clock_type::time_point now) {
+    auto rtt = std::chrono::duration_cast<std::chrono::microseconds>(now - seg.sent_time);
+    // RFC8985 6.2 step 2: a retransmission delivered within less than a
+    // round trip may be the delivery of the original
+    if (seg.nr_transmits && rtt < _snd.min_rtt) {
+        return;
+    }
+    _snd.rack_rtt = rtt;
+    if (seg.sent_time > _snd.rack_xmit_time || (seg.sent_time == _snd.rack_xmit_time && end > _snd.rack_end_seq)) {
+        _snd.rack_xmit_time = seg.sent_time;
+        _snd.rack_end_seq = end;
+    }
+}
+
+template <typename InetTraits>
+void tcp<InetTraits>::tcb::rack_detect_loss() {
+    using clock = congestion_sample::clock_type;
+    if (_snd.rack_xmit_time == clock::time_point()) {
+        return;
+    }
+    auto now = clock::now();
+    // RFC8985 6.2 step 4: tolerate reordering for a quarter of the
+    // minimum round trip
+    auto reo_wnd = _snd.min_rtt != std::chrono::microseconds::max() ? std::min(_snd.min_rtt / 4, _snd.precise_srtt) : std::chrono::microseconds(0);
+    clock::duration timeout{0};
+    auto seq = _snd.unacknowledged;
+    for (auto& seg : _snd.data) {
+        auto end = seq + seg.p.len();
+        seq = end;
+        if (seg.sacked) {
+            continue;
+        }
+        // Only segments sent before the latest delivered one can be lost
+        if (seg.sent_time > _snd.rack_xmit_time || (seg.sent_time == _snd.rack_xmit_time && end >= _snd.rack_end_seq)) {
+            continue;
+        }
+        auto remaining = seg.sent_time + _snd.rack_rtt + reo_wnd - now;
+        if (remaining <= clock::duration(0)) {
+            // A lost retransmission is to be retransmitted again
+            if (!seg.rack_lost || seg.sack_retransmitted) {
+                seg.rack_lost = true;
+                seg.sack_retransmitted = false;
+                count_retransmit(&retransmit_stats::rack_losses);
+            }
+        } else {
+            timeout = std::max(timeout, remaining);
+        }
+    }
+    if (timeout > clock::duration(0)) {
+        _rack_reorder.rearm(now + timeout);
+    }
+}
+
+template <typename InetTraits>
+void tcp<InetTraits>::tcb::rack_reorder_timeout() {
+    rack_detect_loss();
+    update_pipe();
+    if (!has_lost()) {
+        return;
+    }
+    if (_snd.sack_recovery) {
+        sack_retransmit();
+    } else if (_snd.unacknowledged - 1 > _snd.recover) {
+        enter_sack_recovery();
+    }
+}
+
+template <typename InetTraits>
+void tcp<InetTraits>::tcb::schedule_tail_loss_probe() {
+    // RFC8985 7.2: probe when the tail of a flight may be lost, with no
+    // later segments left to reveal the loss to RACK
+    if (!sack_enabled() || _snd.sack_recovery || _snd.dupacks || _snd.tlp_outstanding
+            || _snd.data.empty() || !_snd.precise_srtt.count()) {
+        _tlp.cancel();
+        return;
+    }
+    std::chrono::microseconds pto = 2 * _snd.precise_srtt;
+    if (_snd.data.size() == 1) {
+        // The only segment's ACK may be delayed
+        pto += _tlp_delayed_ack;
+    }
+    pto = std::max<std::chrono::microseconds>(pto, _tlp_min);
+    pto = std::min<std::chrono::microseconds>(pto, _rto);
+    _tlp.rearm(congestion_sample::clock_type::now() + pto);
+}
+
+template <typename InetTraits>
+void tcp<InetTraits>::tcb::tail_loss_probe() {
+    if (in_state(CLOSED) || _snd.data.empty() || _snd.sack_recovery) {
+        return;
+    }
+    _snd.tlp_outstanding = true;
+    count_retransmit(&retransmit_stats::tlp);
+    // RFC8985 7.3: probe with new data when the windows allow, with the
+    // last segment sent otherwise
+    if (_snd.unsent_len && can_send()) {
+        output();
+    } else {
+        auto idx = _snd.data.size() - 1;
+        _snd.data[idx].nr_transmits++;
+        retransmit_one(idx);
+        output();
+    }
+    start_retransmit_timer();
+}
+
 template <typename InetTraits>
 void tcp<InetTraits>::tcb::update_rto(clock_type::time_point tx_time) {
+    update_rto(std::chrono::duration_cast<std::chrono::microseconds>(clock_type::now() - tx_time), 1);
+}
+
+template <typename InetTraits>
+void tcp<InetTraits>::tcb::update_rto(std::chrono::microseconds R, unsigned expected_samples) {
     // Update RTO according to RFC6298
-    auto R = std::chrono::duration_cast<std::chrono::milliseconds>(clock_type::now() - tx_time);
     if (_snd.first_rto_sample) {
         _snd.first_rto_sample = false;
         // RTTVAR <- R/2
@@ -2018,13 +2775,15 @@ void tcp<InetTraits>::tcb::update_rto(clock_type::time_point tx_time) {
     } else {
         // RTTVAR <- (1 - beta) * RTTVAR + beta * |SRTT - R'|
         // SRTT <- (1 - alpha) * SRTT + alpha * R'
-        // where alpha = 1/8 and beta = 1/4
+        // where alpha = 1/8 and beta = 1/4, divided by the samples
+        // expected per round trip (RFC7323 Appendix G)
         auto delta = _snd.srtt > R ? (_snd.srtt - R) : (R - _snd.srtt);
-        _snd.rttvar = _snd.rttvar * 3 / 4 + delta / 4;
-        _snd.srtt = _snd.srtt * 7 / 8 +  R / 8;
+        auto n = int(expected_samples);
+        _snd.rttvar = _snd.rttvar - _snd.rttvar / (4 * n) + delta / (4 * n);
+        _snd.srtt = _snd.srtt - _snd.srtt / (8 * n) + R / (8 * n);
     }
     // RTO <- SRTT + max(G, K * RTTVAR)
-    _rto =  _snd.srtt + std::max(_rto_clk_granularity, 4 * _snd.rttvar);
+    _rto = std::chrono::duration_cast<std::chrono::milliseconds>(_snd.srtt + std::max<std::chrono::microseconds>(_rto_clk_granularity, 4 * _snd.rttvar));
 
     // Make sure 1 sec << _rto << 60 sec
     _rto = std::max(_rto, _rto_min);
@@ -2032,16 +2791,9 @@ void tcp<InetTraits>::tcb::update_rto(clock_type::time_point tx_time) {
 }
 
 template <typename InetTraits>
-void tcp<InetTraits>::tcb::update_cwnd(uint32_t acked_bytes) {
-    uint32_t smss = _snd.mss;
-    if (_snd.cwnd < _snd.ssthresh) {
-        // In slow start phase
-        _snd.cwnd += std::min(acked_bytes, smss);
-    } else {
-        // In congestion avoidance phase
-        uint32_t round_up = 1;
-        _snd.cwnd += std::max(round_up, smss * smss / _snd.cwnd);
-    }
+void tcp<InetTraits>::tcb::update_cwnd(const congestion_sample& sample) {
+    auto w = cc_window();
+    _cc->on_ack(w, sample);
 }
 
 template <typename InetTraits>
@@ -2052,7 +2804,11 @@ void tcp<InetTraits>::tcb::cleanup() {
     _rcv.data_size = 0;
     _rcv.data.clear();
     stop_retransmit_timer();
+    _rack_reorder.cancel();
+    _tlp.cancel();
+    _pacing.cancel();
     clear_delayed_ack();
+    _flow_rule.reset();
     remove_from_tcbs();
 }
 
@@ -2090,10 +2846,11 @@ std::optional<typename InetTraits::l4packet> tcp<InetTraits>::tcb::get_packet()
 
     auto p = std::move(_packetq.front());
     _packetq.pop_front();
-    if (!_packetq.empty() || (_snd.dupacks < 3 && can_send() > 0 && (_snd.window > 0))) {
+    if (!_packetq.empty() || ((_snd.sack_recovery || _snd.dupacks < 3) && can_send() > 0 && (_snd.window > 0))) {
         // If there are packets to send in the queue or tcb is allowed to send
         // more add tcp back to polling set to keep sending. In addition, dupacks >= 3
-        // is an indication that an segment is lost, stop sending more in this case.
+        // is an indication that an segment is lost, stop sending more in this case,
+        // unless SACK recovery tells what is still in flight.
         // Finally - we can't send more until window is opened again.
         output();
     }
@@ -26,6 +26,7 @@
 #include <boost/any.hpp>
 
 #include <seastar/core/future.hh>
+#include <seastar/core/sharded.hh>
 #include <seastar/core/sstring.hh>
 #include <seastar/core/shared_ptr.hh>
 #include <seastar/net/socket_defs.hh>
@@ -62,6 +63,7 @@ namespace tls {
     class session;
     class server_session;
     class server_credentials;
+    class session_cache;
     class certificate_credentials;
     class credentials_builder;
 
@@ -210,6 +212,38 @@ namespace tls {
          */
         void set_dn_verification_callback(dn_callback);
 
+        /**
+         * Hands the record layer of sessions over to the kernel (kTLS)
+         * once their handshake completes, so that records are encrypted
+         * and decrypted by the kernel, or the NIC, rather than copied
+         * through gnutls. Needs the posix network stack, the "tls" kernel
+         * module, and an AES-GCM or ChaCha20-Poly1305 cipher suite;
+         * sessions for which any of these is missing, or directions for
+         * which the kernel refuses the keys, stay in user space.
+         *
+         * Received data is offloaded only when nothing beyond the handshake
+         * was read yet, and, for TLS 1.3, only by servers, since clients
+         * receive session tickets after the handshake, which the kernel
+         * would not hand out as data. Renegotiation and key updates are not
+         * possible in offloaded directions.
+         */
+        void set_kernel_tls(bool);
+
+        /**
+         * Runs handshakes, whose public key operations may take
+         * milliseconds of CPU, on a pool of threads outside the reactor,
+         * shared by all shards (see set_handshake_offload_threads()), so
+         * that connection storms do not stall the reactor. The session
+         * resumes on its shard between steps, when gnutls waits for the
+         * peer.
+         *
+         * The peer certificate and the dn callback are then checked on the
+         * shard once the handshake completes, rather than during it.
+         * Needs the alien queues app_template sets up; without them,
+         * handshakes run on the reactor.
+         */
+        void set_handshake_offload(bool);
+
     private:
         class impl;
         friend class session;
@@ -218,9 +252,19 @@ namespace tls {
         friend class credentials_builder;
         template<typename Base>
         friend class reloadable_credentials;
+        friend struct credentials_access;
         shared_ptr<impl> _impl;
     };
 
+    /// \cond internal
+    // Lends the gnutls credentials to other users of gnutls in seastar,
+    // such as the QUIC handshake
+    struct credentials_access {
+        // A gnutls_certificate_credentials_t
+        static void* gnutls_credentials(const certificate_credentials&);
+    };
+    /// \endcond
+
     /** Exception thrown on certificate validation error */
     class verification_error : public std::runtime_error {
     public:
@@ -248,6 +292,86 @@ namespace tls {
         server_credentials& operator=(const server_credentials&) = delete;
 
         void set_client_auth(client_auth);
+
+        /**
+         * Issues session tickets, encrypted with the given key, as made by
+         * generate_session_ticket_key(), so that clients can resume their
+         * sessions with an abbreviated handshake. Sessions may be resumed on
+         * any shard, or server, whose credentials have the same key.
+         *
+         * The key may be rotated at any time by setting a new one on every
+         * shard: tickets issued with the previous key then only lead to full
+         * handshakes. An empty key disables tickets.
+         */
+        void set_session_ticket_key(const blob&);
+
+        /**
+         * Keeps the sessions of TLS 1.2 clients which resume by session id,
+         * rather than with a ticket, in the given cache, which must outlive
+         * the credentials.
+         */
+        void set_session_cache(sharded<session_cache>&);
+    };
+
+    /// Sets the number of threads handshakes run on, for credentials with
+    /// handshake offload, before the first such handshake. The default is 2.
+    void set_handshake_offload_threads(unsigned);
+
+    /// What the TLS sessions of a shard wrote, with the record layer in
+    /// user space
+    struct write_stats {
+        /// Batches of records pushed to the socket, one or more per put
+        uint64_t writes = 0;
+        uint64_t records = 0;
+        /// Of plaintext
+        uint64_t bytes = 0;
+    };
+
+    const write_stats& get_write_stats() noexcept;
+
+    /// Makes a random key for server_credentials::set_session_ticket_key().
+    sstring generate_session_ticket_key();
+
+    /**
+     * A server side cache of TLS sessions by session id, used as a
+     * sharded service: each shard owns the sessions whose id hashes to it,
+     * and handshakes on other shards look them up there, before gnutls
+     * sees the client hello, so that a client may resume its session on
+     * whichever shard its new connection lands.
+     *
+     * Each shard keeps up to max_entries sessions, forgetting the least
+     * recently stored first, and sessions expire after the given time.
+     */
+    class session_cache : public peering_sharded_service<session_cache> {
+    public:
+        struct stats {
+            uint64_t lookups = 0;
+            uint64_t hits = 0;
+            uint64_t stores = 0;
+            uint64_t evictions = 0;
+        };
+
+        explicit session_cache(size_t max_entries = 100000, std::chrono::seconds expiry = std::chrono::hours(1));
+        ~session_cache();
+
+        /// Waits for stores and removals in flight to other shards
+        future<> stop();
+
+        /// Looks the session up on the shard which owns it
+        future<std::optional<sstring>> lookup(sstring id);
+        /// Stores the session on the shard which owns it, in the background
+        void store(sstring id, sstring data);
+        /// Removes the session from the shard which owns it, in the background
+        void remove(sstring id);
+
+        std::chrono::seconds expiry() const noexcept;
+        /// The number of sessions this shard owns
+        size_t size() const noexcept;
+        /// The operations on the sessions this shard owns
+        const stats& get_stats() const noexcept;
+    private:
+        class impl;
+        std::unique_ptr<impl> _impl;
     };
 
     class reloadable_credentials_base;
@@ -281,6 +405,10 @@ namespace tls {
         future<> set_system_trust();
         void set_client_auth(client_auth);
         void set_priority_string(const sstring&);
+        void set_kernel_tls(bool);
+        void set_handshake_offload(bool);
+        void set_session_ticket_key(const blob&);
+        void set_session_cache(sharded<session_cache>&);
 
         void apply_to(certificate_credentials&) const;
 
@@ -297,6 +425,10 @@ namespace tls {
         std::multimap<sstring, boost::any> _blobs;
         client_auth _client_auth = client_auth::NONE;
         sstring _priority;
+        bool _kernel_tls = false;
+        bool _handshake_offload = false;
+        sstring _session_ticket_key;
+        sharded<session_cache>* _session_cache = nullptr;
     };
 
     /**
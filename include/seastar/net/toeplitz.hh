@@ -43,6 +43,9 @@
 
 #pragma once
 
+#include <bit>
+#include <cstdint>
+#include <string_view>
 #include <vector>
 
 namespace seastar {
@@ -73,27 +76,29 @@ static constexpr uint8_t default_rsskey_52bytes_v[] = {
 
 static constexpr rss_key_type default_rsskey_52bytes{default_rsskey_52bytes_v, sizeof(default_rsskey_52bytes_v)};
 
+// Rather than shifting the key in bit by bit, keeps the 64 bits of the key
+// from the current byte of data on, out of which the 32-bit window of
+// each bit of the byte is read, and only visits the bits which are set.
 template<typename T>
 static inline uint32_t
 toeplitz_hash(rss_key_type key, const T& data)
 {
-	uint32_t hash = 0, v;
-	u_int i, b;
-
-	/* XXXRW: Perhaps an assertion about key length vs. data length? */
-
-	v = (key[0]<<24) + (key[1]<<16) + (key[2] <<8) + key[3];
-	for (i = 0; i < data.size(); i++) {
-		for (b = 0; b < 8; b++) {
-			if (data[i] & (1<<(7-b)))
-				hash ^= v;
-			v <<= 1;
-			if ((i + 4) < key.size() &&
-			    (key[i+4] & (1<<(7-b))))
-				v |= 1;
-		}
-	}
-	return (hash);
+    auto key_byte = [&key] (size_t i) -> uint64_t {
+        return i < key.size() ? key[i] : 0;
+    };
+    uint64_t window = 0;
+    for (size_t i = 0; i < 8; i++) {
+        window = (window << 8) | key_byte(i);
+    }
+    uint32_t hash = 0;
+    for (size_t i = 0; i < data.size(); i++) {
+        for (uint8_t d = data[i]; d; d &= d - 1) {
+            auto b = std::countr_zero(d);
+            hash ^= uint32_t(window >> (25 + b));
+        }
+        window = (window << 8) | key_byte(i + 8);
+    }
+    return hash;
 }
 
 }
@@ -52,6 +52,23 @@ struct virtio_options : public program_options::option_group {
     ///
     /// Default: 256.
     program_options::value<unsigned> virtio_ring_size;
+    /// \brief Number of virtio queue pairs, at most one per shard (0 for
+    /// one per shard).
+    ///
+    /// Flows are spread over the queues by the host, and passed on in
+    /// software to the shards owning them when needed.
+    ///
+    /// Default: 1.
+    program_options::value<unsigned> virtio_queues;
+    /// \brief Path of the unix socket of a vhost-user backend, e.g. the
+    /// vhost port of a DPDK virtual switch, to use instead of vhost-net
+    /// and a tap device.
+    ///
+    /// The backend maps the memory of the shards, which requires
+    /// \c --hugepages.
+    ///
+    /// Default: empty, vhost-net.
+    program_options::value<std::string> vhost_user;
 
     /// \cond internal
     virtio_options(program_options::option_group* parent_group);
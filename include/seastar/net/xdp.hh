@@ -0,0 +1,82 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#pragma once
+
+#include <memory>
+#include <seastar/net/net.hh>
+#include <seastar/core/sstring.hh>
+#include <seastar/util/program-options.hh>
+
+namespace seastar {
+
+namespace net {
+
+/// AF_XDP configuration.
+struct xdp_options : public program_options::option_group {
+    /// \brief Network interface to bind the AF_XDP sockets to.
+    ///
+    /// Default: \p eth0.
+    program_options::value<std::string> xdp_interface;
+    /// \brief First queue of the interface to bind to.
+    ///
+    /// Shard N is bound to queue xdp_first_queue + N. The kernel keeps
+    /// the traffic of the other queues, steer the stack's traffic to the
+    /// bound ones (e.g. with ethtool ntuple rules or an RSS context) to
+    /// share the interface.
+    ///
+    /// Default: 0.
+    program_options::value<unsigned> xdp_first_queue;
+    /// \brief Number of queues to bind to, one per shard from shard 0.
+    ///
+    /// Shards without a queue get their packets forwarded by the others.
+    ///
+    /// Default: all the interface's queues, up to the number of shards.
+    program_options::value<unsigned> xdp_queues;
+    /// \brief Use zero-copy mode (on / off).
+    ///
+    /// Falls back to copy mode when the driver doesn't support it.
+    ///
+    /// Default: \p on.
+    program_options::value<std::string> xdp_zero_copy;
+    /// \brief Size of the AF_XDP rings (must be power-of-two).
+    ///
+    /// Default: 2048.
+    program_options::value<unsigned> xdp_ring_size;
+
+    /// \cond internal
+    xdp_options(program_options::option_group* parent_group);
+    /// \endcond
+};
+
+}
+
+/// \cond internal
+
+#ifdef SEASTAR_HAVE_XDP
+
+std::unique_ptr<net::device> create_xdp_net_device(const net::xdp_options& opts);
+
+#endif // SEASTAR_HAVE_XDP
+
+/// \endcond
+
+}
@@ -29,6 +29,7 @@
 #include <seastar/core/future.hh>
 #include <seastar/core/seastar.hh>
 #include <seastar/net/api.hh>
+#include <seastar/net/memory_budget.hh>
 #include <seastar/core/iostream.hh>
 #include <seastar/core/shared_ptr.hh>
 #include <seastar/core/condition-variable.hh>
@@ -38,7 +39,10 @@
 #include <seastar/core/shared_future.hh>
 #include <seastar/core/queue.hh>
 #include <seastar/core/weak_ptr.hh>
+#include <seastar/core/tracing.hh>
 #include <seastar/core/scheduling.hh>
+#include <seastar/core/metrics_registration.hh>
+#include <seastar/core/internal/log_histogram.hh>
 #include <seastar/util/backtrace.hh>
 #include <seastar/util/log.hh>
 
@@ -83,6 +87,21 @@ struct isolation_config {
 /// In the scheduling_group that the protocol::server was created in.
 isolation_config default_isolate_connection(sstring isolation_cookie);
 
+/// \brief Load shedding of requests waiting for server resources
+///
+/// The time requests wait for the memory of \ref resource_limits is tracked
+/// per scheduling group. A request is rejected with \ref overloaded_error
+/// right away if the average wait would exceed the timeout its caller sent
+/// along. When even the shortest wait over an \c interval exceeded
+/// \c target, the queue is standing rather than absorbing a burst, and
+/// requests are only let wait \c target until the wait drops again (after
+/// CoDel). The waits are bounded on \ref rpc_clock_type, so targets below its
+/// resolution are rounded up to it.
+struct load_shedding_config {
+    std::chrono::microseconds target = std::chrono::milliseconds(5); ///< Acceptable standing wait for resources
+    std::chrono::microseconds interval = std::chrono::milliseconds(100); ///< Window over which the shortest wait is measured
+};
+
 /// \brief Resource limits for an RPC server
 ///
 /// A request's memory use will be estimated as
@@ -104,6 +123,18 @@ struct resource_limits {
     using asyncronous_isolation_function = std::function<future<isolation_config> (sstring isolation_cookie)>;
     using isolation_function_alternatives = std::variant<syncronous_isolation_function, asyncronous_isolation_function>;
     isolation_function_alternatives isolate_connection = default_isolate_connection;
+    /// If set, requests unlikely to get resources in time are rejected early
+    std::optional<load_shedding_config> load_shedding;
+};
+
+/// Configures a stream connection.
+struct stream_options {
+    /// Receive window of the stream, in bytes: how much data a sink may send
+    /// ahead of what the source on the other end has consumed. The window
+    /// applies to both directions of the stream, the server may shrink it for
+    /// its own side. Zero disables credit based flow control, leaving only
+    /// the fixed per connection buffer limits.
+    uint32_t window = 0;
 };
 
 struct client_options {
@@ -111,8 +142,29 @@ struct client_options {
     bool tcp_nodelay = true;
     bool reuseaddr = false;
     compressor::factory* compressor_factory = nullptr;
+    /// If set, frames sent to the server skip compression when it does not pay off
+    std::optional<adaptive_compression_config> adaptive_compression;
+    /// Maps a verb to the outgoing lane of its requests, below \ref outgoing_lanes.
+    /// Requests of higher lanes overtake queued requests of lower ones, so that
+    /// latency sensitive verbs are not stuck behind bulk transfers. All
+    /// requests use lane 0 if unset.
+    std::function<unsigned (uint64_t verb)> verb_lane;
+    /// How long to hold back the flush of a message sent on an otherwise
+    /// idle connection, so that messages sent shortly after it go out in
+    /// the same send call. Messages queued behind one another are always
+    /// coalesced.
+    std::chrono::microseconds coalescing_delay{0};
+    /// Busy poll the NIC queue of the connection for up to this long when
+    /// waiting for replies, \see listen_options::busy_poll. Zero disables.
+    std::chrono::microseconds busy_poll{0};
     bool send_timeout_data = true;
+    /// Propagate the trace context of the caller of each request to the
+    /// server, which then traces the handler as a child span, see tracing.hh
+    bool send_trace_context = true;
     connection_id stream_parent = invalid_connection_id;
+    /// Options of the streams created by this client, unless given
+    /// to \ref client::make_stream_sink() explicitly
+    stream_options stream;
     /// Configures how this connection is isolated from other connection on the same server.
     ///
     /// \see resource_limits::isolate_connection
@@ -149,9 +201,24 @@ class server;
 
 struct server_options {
     compressor::factory* compressor_factory = nullptr;
+    /// If set, frames sent to clients skip compression when it does not pay off
+    std::optional<adaptive_compression_config> adaptive_compression;
+    /// \see client_options::coalescing_delay
+    std::chrono::microseconds coalescing_delay{0};
     bool tcp_nodelay = true;
     std::optional<streaming_domain_type> streaming_domain;
+    /// Largest receive window granted to a client stream, \see stream_options::window.
+    /// Zero disables credit based flow control for the streams of this server.
+    uint32_t max_stream_window = 16 << 20;
     server_socket::load_balancing_algorithm load_balancing_algorithm = server_socket::load_balancing_algorithm::default_;
+    /// \see listen_options::busy_poll
+    std::chrono::microseconds busy_poll{0};
+    /// If set, the memory the buffers of all the connections of this server
+    /// may take up, \see net::connection_memory_budget
+    std::optional<size_t> connection_memory;
+    /// Labels the metrics of the connection memory budget; none are
+    /// exported if empty
+    sstring connection_memory_name;
     // optional filter function. If set, will be called with remote 
     // (connecting) address.    
     // Returning false will refuse the incoming connection. 
@@ -178,6 +245,10 @@ enum class protocol_features : uint32_t {
     CONNECTION_ID = 2,
     STREAM_PARENT = 3,
     ISOLATION = 4,
+    UNCOMPRESSED_FRAMES = 5,
+    SHARD_INFO = 6,
+    STREAM_FLOW_CONTROL = 7,
+    TRACING = 8,
 };
 
 // internal representation of feature data
@@ -234,6 +305,9 @@ class logger {
 };
 
 class connection {
+public:
+    // A stream data frame, or the credit returned by a window update
+    using stream_frame_value = std::variant<rcv_buf, uint32_t>;
 protected:
     connected_socket _fd;
     input_stream<char> _read_buf;
@@ -252,7 +326,8 @@ class connection {
         snd_buf buf;
         promise<> done;
         cancellable* pcancel = nullptr;
-        outgoing_entry(snd_buf b) : buf(std::move(b)) {}
+        unsigned lane;
+        outgoing_entry(snd_buf b, unsigned l) : buf(std::move(b)), lane(l) {}
 
         outgoing_entry(outgoing_entry&&) = delete;
         outgoing_entry(const outgoing_entry&) = delete;
@@ -277,9 +352,20 @@ class connection {
     future<> _outgoing_queue_ready = _negotiated->get_shared_future();
     outgoing_entry::container_t _outgoing_queue;
     size_t _outgoing_queue_size = 0;
+    std::array<size_t, outgoing_lanes> _outgoing_lane_size = {};
     std::unique_ptr<compressor> _compressor;
+    // The peer accepts frames flagged as not compressed
+    bool _uncompressed_frames = false;
+    std::optional<adaptive_compression_config> _adaptive_compression;
+    unsigned _compression_backoff = 0;
+    unsigned _compression_backoff_left = 0;
     bool _propagate_timeout = false;
     bool _timeout_negotiated = false;
+    // Requests carry the trace context of the caller
+    bool _tracing_negotiated = false;
+    // Messages were written but left for a later entry to flush
+    bool _pending_flush = false;
+    std::chrono::microseconds _coalescing_delay{0};
     // stream related fields
     bool _is_stream = false;
     connection_id _id = invalid_connection_id;
@@ -287,6 +373,12 @@ class connection {
     std::unordered_map<connection_id, xshard_connection_ptr> _streams;
     queue<rcv_buf> _stream_queue = queue<rcv_buf>(max_queued_stream_buffers);
     semaphore _stream_sem = semaphore(max_stream_buffers_memory);
+    // Credit based stream flow control, the windows are zero unless negotiated.
+    // The sink spends _stream_credits, granted by the peer's window updates;
+    // the connection returns credit to the peer as the source consumes frames.
+    uint32_t _stream_send_window = 0;
+    uint32_t _stream_recv_window = 0;
+    semaphore _stream_credits = semaphore(0);
     bool _sink_closed = true;
     bool _source_closed = true;
     // the future holds if sink is already closed
@@ -296,6 +388,7 @@ class connection {
     size_t outgoing_queue_length() const noexcept {
         return _outgoing_queue_size;
     }
+    void fill_queue_stats(stats& res) const noexcept;
 
     void set_negotiated() noexcept;
 
@@ -304,17 +397,25 @@ class connection {
     }
 
     snd_buf compress(snd_buf buf);
+    bool compresses_well(size_t compressed_size, size_t size) const noexcept;
+    void back_off_compression() noexcept;
     future<> send_buffer(snd_buf buf);
 
     future<> send_entry(outgoing_entry& d);
+    future<> flush_or_coalesce(outgoing_entry& d);
+    future<> flush_pending();
+    future<> flush_written();
     future<> stop_send_loop(std::exception_ptr ex);
-    future<std::optional<rcv_buf>>  read_stream_frame_compressed(input_stream<char>& in);
+    future<std::optional<stream_frame_value>> read_stream_frame_compressed(input_stream<char>& in);
     bool stream_check_twoway_closed() const noexcept {
         return _sink_closed && _source_closed;
     }
     future<> stream_close();
     future<> stream_process_incoming(rcv_buf&&);
     future<> handle_stream_frame();
+    void set_stream_windows(uint32_t send_window, uint32_t recv_window);
+    future<> stream_wait_credits(size_t frame_size);
+    void stream_return_credits(size_t credit);
 
 public:
     connection(connected_socket&& fd, const logger& l, void* s, connection_id id = invalid_connection_id) : connection(l, s, id) {
@@ -322,11 +423,11 @@ class connection {
     }
     connection(const logger& l, void* s, connection_id id = invalid_connection_id) : _logger(l), _serializer(s), _id(id) {}
     virtual ~connection() {}
-    void set_socket(connected_socket&& fd);
+    void set_socket(connected_socket&& fd, net::connection_memory_budget* budget = nullptr);
     future<> send_negotiation_frame(feature_map features);
     // functions below are public because they are used by external heavily templated functions
     // and I am not smart enough to know how to define them as friends
-    future<> send(snd_buf buf, std::optional<rpc_clock_type::time_point> timeout = {}, cancellable* cancel = nullptr);
+    future<> send(snd_buf buf, std::optional<rpc_clock_type::time_point> timeout = {}, cancellable* cancel = nullptr, unsigned lane = 0);
     bool error() const noexcept { return _error; }
     void abort();
     future<> stop() noexcept;
@@ -377,7 +478,7 @@ class connection {
 
     void suspend_for_testing(promise<>& p) {
         _outgoing_queue_ready.get();
-        auto dummy = std::make_unique<outgoing_entry>(snd_buf());
+        auto dummy = std::make_unique<outgoing_entry>(snd_buf(), 0);
         _outgoing_queue.push_back(*dummy);
         _outgoing_queue_ready = dummy->done.get_future();
         (void)p.get_future().then([dummy = std::move(dummy)] { dummy->done.set_value(); });
@@ -416,6 +517,8 @@ class source_impl : public source<In...>::impl {
     future<std::optional<std::tuple<In...>>> operator()() override;
 };
 
+class verb_stats;
+
 class client : public rpc::connection, public weakly_referencable<client> {
     socket _socket;
     id_type _message_id = 1;
@@ -456,6 +559,10 @@ class client : public rpc::connection, public weakly_referencable<client> {
     socket_address _server_addr, _local_addr;
     client_options _options;
     weak_ptr<client> _parent; // for stream clients
+    std::optional<shard_info> _peer_shard_info;
+protected:
+    verb_stats* _verb_stats = nullptr;
+private:
 
 private:
     future<> negotiate_protocol(input_stream<char>& in);
@@ -502,6 +609,19 @@ class client : public rpc::connection, public weakly_referencable<client> {
     socket_address peer_address() const override {
         return _server_addr;
     }
+    /// The per verb statistics requests are recorded in, if any
+    verb_stats* get_verb_stats() const noexcept {
+        return _verb_stats;
+    }
+    /// The outgoing lane of requests of the given verb
+    unsigned verb_lane(uint64_t verb) const {
+        return _options.verb_lane ? _options.verb_lane(verb) : 0;
+    }
+    /// The server shard serving this connection, known once it is negotiated
+    /// and if the server advertises it
+    const std::optional<shard_info>& peer_shard_info() const noexcept {
+        return _peer_shard_info;
+    }
     future<> await_connection() {
         if (!_negotiated) {
             return make_ready_future<>();
@@ -510,14 +630,16 @@ class client : public rpc::connection, public weakly_referencable<client> {
         }
     }
     template<typename Serializer, typename... Out>
-    future<sink<Out...>> make_stream_sink(socket socket) {
-        return await_connection().then([this, socket = std::move(socket)] () mutable {
+    future<sink<Out...>> make_stream_sink(socket socket, stream_options opts) {
+        return await_connection().then([this, socket = std::move(socket), opts] () mutable {
             if (!this->get_connection_id()) {
                 return make_exception_future<sink<Out...>>(std::runtime_error("Streaming is not supported by the server"));
             }
             client_options o = _options;
             o.stream_parent = this->get_connection_id();
             o.send_timeout_data = false;
+            o.send_trace_context = false;
+            o.stream = opts;
             auto c = make_shared<client>(_logger, _serializer, o, std::move(socket), _server_addr, _local_addr);
             c->_parent = this->weak_from_this();
             c->_is_stream = true;
@@ -535,6 +657,14 @@ class client : public rpc::connection, public weakly_referencable<client> {
         });
     }
     template<typename Serializer, typename... Out>
+    future<sink<Out...>> make_stream_sink(socket socket) {
+        return make_stream_sink<Serializer, Out...>(std::move(socket), _options.stream);
+    }
+    template<typename Serializer, typename... Out>
+    future<sink<Out...>> make_stream_sink(stream_options opts) {
+        return make_stream_sink<Serializer, Out...>(make_socket(), opts);
+    }
+    template<typename Serializer, typename... Out>
     future<sink<Out...>> make_stream_sink() {
         return make_stream_sink<Serializer, Out...>(make_socket());
     }
@@ -554,10 +684,18 @@ class server {
         std::optional<isolation_config> _isolation_config;
     private:
         future<> negotiate_protocol(input_stream<char>& in);
-        future<std::tuple<std::optional<uint64_t>, uint64_t, int64_t, std::optional<rcv_buf>>>
+        future<std::tuple<std::optional<uint64_t>, uint64_t, int64_t, std::optional<rcv_buf>, tracing::trace_context>>
         read_request_frame_compressed(input_stream<char>& in);
         future<feature_map> negotiate(feature_map requested);
         future<> send_unknown_verb_reply(std::optional<rpc_clock_type::time_point> timeout, int64_t msg_id, uint64_t type);
+        future<resource_permit> get_resources(size_t memory_consumed, std::optional<rpc_clock_type::time_point> timeout) {
+            if (timeout) {
+                return get_units(_server._resources_available, memory_consumed, *timeout);
+            } else {
+                return get_units(_server._resources_available, memory_consumed);
+            }
+        }
+        future<resource_permit> admit(size_t memory_consumed, std::optional<rpc_clock_type::time_point> timeout);
     public:
         connection(server& s, connected_socket&& fd, socket_address&& addr, const logger& l, void* seralizer, connection_id id);
         future<> process();
@@ -566,7 +704,7 @@ class server {
         const client_info& info() const { return _info; }
         stats get_stats() const {
             stats res = _stats;
-            res.pending = outgoing_queue_length();
+            fill_queue_stats(res);
             return res;
         }
 
@@ -576,14 +714,16 @@ class server {
         socket_address peer_address() const override {
             return _info.addr;
         }
-        // Resources will be released when this goes out of scope
+        // Resources will be released when this goes out of scope.
+        // Fails with overloaded_error if the request is shed.
         future<resource_permit> wait_for_resources(size_t memory_consumed,  std::optional<rpc_clock_type::time_point> timeout) {
-            if (timeout) {
-                return get_units(_server._resources_available, memory_consumed, *timeout);
-            } else {
-                return get_units(_server._resources_available, memory_consumed);
+            if (_server._limits.load_shedding) {
+                return admit(memory_consumed, timeout);
             }
+            return get_resources(memory_consumed, timeout);
         }
+        // Tells the client its request was shed
+        future<> send_overloaded_reply(std::optional<rpc_clock_type::time_point> timeout, int64_t msg_id);
         size_t estimate_request_size(size_t serialized_size) {
             return rpc::estimate_request_size(_server._limits, serialized_size);
         }
@@ -596,10 +736,22 @@ class server {
         future<> deregister_this_stream();
     };
 private:
+    // Waits for resources of the requests of one scheduling group
+    struct admission_queue {
+        using clock_type = std::chrono::steady_clock;
+        clock_type::duration average_wait{};
+        clock_type::duration min_wait = clock_type::duration::max();
+        clock_type::time_point interval_end{};
+        bool standing = false; // the shortest wait of the last interval exceeded the target
+        void record(clock_type::duration wait, clock_type::time_point now, const load_shedding_config& cfg) noexcept;
+    };
     protocol_base* _proto;
     server_socket _ss;
     resource_limits _limits;
     rpc_semaphore _resources_available;
+    std::array<admission_queue, max_scheduling_groups()> _admission;
+    // Outlives the connections, which charge it
+    std::unique_ptr<net::connection_memory_budget> _connection_memory;
     std::unordered_map<connection_id, shared_ptr<connection>> _conns;
     promise<> _ss_stopped;
     gate _reply_gate;
@@ -635,6 +787,77 @@ struct rpc_handler {
     gate use_gate;
 };
 
+/// \addtogroup rpc
+/// @{
+
+/// Statistics of the requests of one verb, on one side of the connections
+struct verb_side_stats {
+    uint64_t requests = 0;  ///< Requests sent or received
+    uint64_t in_flight = 0; ///< Requests waiting for a reply, or being handled
+    /// On a client from sending a request to receiving its reply (to sending
+    /// it for no_wait verbs), on a server from receiving a request to
+    /// sending its reply
+    internal::latency_histogram<1, 50> latency;
+    internal::log_histogram<1, 64> request_size; ///< Serialized size of the arguments, in bytes
+};
+
+/// Accounts for one request in its verb_side_stats
+class verb_call {
+    verb_side_stats* _stats = nullptr;
+    std::chrono::steady_clock::time_point _start;
+public:
+    verb_call() noexcept = default;
+    verb_call(verb_side_stats& stats, size_t request_size) noexcept;
+    verb_call(verb_call&& o) noexcept : _stats(std::exchange(o._stats, nullptr)), _start(o._start) {}
+    verb_call& operator=(verb_call&&) = delete;
+    ~verb_call() {
+        if (_stats) {
+            _stats->in_flight--;
+        }
+    }
+    explicit operator bool() const noexcept {
+        return _stats;
+    }
+    /// Records the latency of the completed request. A request dropped
+    /// without completing only leaves the in flight count.
+    void done() noexcept;
+};
+
+/// Per verb statistics of a protocol
+///
+/// \see protocol::enable_verb_stats()
+class verb_stats {
+    struct verb_data {
+        verb_side_stats client;
+        verb_side_stats server;
+    };
+    // Node based, the metrics keep pointers to the elements
+    std::unordered_map<uint64_t, verb_data> _verbs;
+    std::optional<sstring> _group;
+    metrics::metric_groups _metrics;
+private:
+    verb_data& get(uint64_t verb);
+    void register_metrics(uint64_t verb, verb_data& data);
+public:
+    /// Starts collecting statistics, exported as metrics of the given group
+    void enable(sstring group_name);
+    bool enabled() const noexcept {
+        return bool(_group);
+    }
+    verb_call client_call(uint64_t verb, size_t request_size) {
+        return enabled() ? verb_call(get(verb).client, request_size) : verb_call();
+    }
+    verb_call server_call(uint64_t verb, size_t request_size) {
+        return enabled() ? verb_call(get(verb).server, request_size) : verb_call();
+    }
+    /// Statistics of a verb's requests sent by clients, nullptr if there were none
+    const verb_side_stats* client_stats(uint64_t verb) const noexcept;
+    /// Statistics of a verb's requests handled by servers, nullptr if there were none
+    const verb_side_stats* server_stats(uint64_t verb) const noexcept;
+};
+
+/// @}
+
 class protocol_base {
 public:
     virtual ~protocol_base() {};
@@ -763,9 +986,13 @@ class protocol final : public protocol_base {
          * @param local the local address of this client
          */
         client(protocol& p, const socket_address& addr, const socket_address& local = {}) :
-            rpc::client(p.get_logger(), &p._serializer, addr, local) {}
+            rpc::client(p.get_logger(), &p._serializer, addr, local) {
+            _verb_stats = &p._verb_stats;
+        }
         client(protocol& p, client_options options, const socket_address& addr, const socket_address& local = {}) :
-            rpc::client(p.get_logger(), &p._serializer, options, addr, local) {}
+            rpc::client(p.get_logger(), &p._serializer, options, addr, local) {
+            _verb_stats = &p._verb_stats;
+        }
 
         /**
          * Create client object which will attempt to connect to the remote address using the
@@ -776,9 +1003,70 @@ class protocol final : public protocol_base {
          * @param socket the socket object use to connect to the remote address
          */
         client(protocol& p, socket socket, const socket_address& addr, const socket_address& local = {}) :
-            rpc::client(p.get_logger(), &p._serializer, std::move(socket), addr, local) {}
+            rpc::client(p.get_logger(), &p._serializer, std::move(socket), addr, local) {
+            _verb_stats = &p._verb_stats;
+        }
         client(protocol& p, client_options options, socket socket, const socket_address& addr, const socket_address& local = {}) :
-            rpc::client(p.get_logger(), &p._serializer, options, std::move(socket), addr, local) {}
+            rpc::client(p.get_logger(), &p._serializer, options, std::move(socket), addr, local) {
+            _verb_stats = &p._verb_stats;
+        }
+    };
+
+    /// A set of connections to one server, letting requests be sent
+    /// directly to the server shard that owns them instead of being
+    /// forwarded there by the server.
+    ///
+    /// If the server routes connections by their source port
+    /// (server_socket::load_balancing_algorithm::port), the pool opens one
+    /// connection per server shard, bound to a source port landing it on
+    /// that shard. Otherwise it opens the requested number of connections
+    /// and spreads the shards over them.
+    ///
+    /// A connection that failed is replaced when it is next picked.
+    class client_pool {
+        protocol& _proto;
+        client_options _options;
+        socket_address _addr;
+        unsigned _connections;
+        std::function<socket()> _make_socket;
+        std::vector<std::unique_ptr<client>> _clients;
+        bool _shard_routing = false;
+        unsigned _next = 0;
+        future<> _stopping = make_ready_future<>();
+    private:
+        socket_address local_address(unsigned shard) const;
+        std::unique_ptr<client> new_client(unsigned idx) const;
+        future<> connect_shard(unsigned shard, unsigned attempts);
+        client& maybe_reconnect(unsigned idx);
+    public:
+        /// \param connections number of connections to open when the server
+        ///        does not route them by source port
+        client_pool(protocol& proto, client_options options, socket_address addr, unsigned connections = 1)
+            : _proto(proto), _options(std::move(options)), _addr(std::move(addr)), _connections(std::max(connections, 1u)) {}
+        /// Connects with sockets obtained from make_socket
+        client_pool(protocol& proto, client_options options, socket_address addr, unsigned connections, std::function<socket()> make_socket)
+            : client_pool(proto, std::move(options), std::move(addr), connections) {
+            _make_socket = std::move(make_socket);
+        }
+        client_pool(client_pool&&) = delete;
+
+        /// Opens the connections, resolves once all of them are negotiated
+        future<> start();
+        /// Stops all connections
+        future<> stop() noexcept;
+        /// Returns the connection served by the given server shard, or the
+        /// connection the shard is spread over if the server does not
+        /// route by source port
+        client& for_shard(unsigned shard);
+        /// Returns the connections in turn
+        client& next();
+        /// Whether \ref for_shard() reaches the requested server shard
+        bool shard_routing() const noexcept {
+            return _shard_routing;
+        }
+        size_t size() const noexcept {
+            return _clients.size();
+        }
     };
 
     friend server;
@@ -786,6 +1074,7 @@ class protocol final : public protocol_base {
     std::unordered_map<MsgType, rpc_handler> _handlers;
     Serializer _serializer;
     logger _logger;
+    verb_stats _verb_stats;
 
 public:
     protocol(Serializer&& serializer) : _serializer(std::forward<Serializer>(serializer)) {}
@@ -867,6 +1156,19 @@ class protocol final : public protocol_base {
         return _logger;
     }
 
+    /// Starts keeping per verb statistics of the requests sent by the
+    /// clients and handled by the servers of this protocol: request
+    /// counts, in flight requests, latency and request size histograms.
+    /// They are exported by the metrics layer in the given group, labelled
+    /// with the verb.
+    void enable_verb_stats(sstring metrics_group = "rpc_verbs") {
+        _verb_stats.enable(std::move(metrics_group));
+    }
+
+    const verb_stats& get_verb_stats() const noexcept {
+        return _verb_stats;
+    }
+
     shared_ptr<rpc::server::connection> make_server_connection(rpc::server& server, connected_socket fd, socket_address addr, connection_id id) override {
         return make_shared<rpc::server::connection>(server, std::move(fd), std::move(addr), _logger, &_serializer, id);
     }
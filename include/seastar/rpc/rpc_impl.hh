@@ -20,16 +20,20 @@
  */
 #pragma once
 
+#include <seastar/core/abort_source.hh>
 #include <seastar/core/function_traits.hh>
 #include <seastar/core/shared_ptr.hh>
 #include <seastar/core/sstring.hh>
 #include <seastar/core/when_all.hh>
 #include <seastar/util/is_smart_ptr.hh>
 #include <seastar/core/simple-stream.hh>
+#include <boost/range/irange.hpp>
 #include <boost/range/numeric.hpp>
 #include <boost/range/adaptor/transformed.hpp>
+#include <seastar/net/inet_address.hh>
 #include <seastar/net/packet-data-source.hh>
 #include <seastar/core/print.hh>
+#include <random>
 
 namespace seastar {
 
@@ -38,6 +42,7 @@ namespace rpc {
 enum class exception_type : uint32_t {
     USER = 0,
     UNKNOWN_VERB = 1,
+    OVERLOADED = 2,
 };
 
 template<typename T>
@@ -187,6 +192,40 @@ inline connection_id deserialize_connection_id(const sstring& s) {
     return id;
 }
 
+inline sstring serialize_shard_info(const shard_info& info) {
+    sstring p = uninitialized_string(9);
+    auto c = p.data();
+    write_le<uint32_t>(c, info.shard);
+    write_le<uint32_t>(c + 4, info.shard_count);
+    c[8] = info.port_routing;
+    return p;
+}
+
+inline sstring serialize_stream_window(uint32_t window) {
+    sstring p = uninitialized_string(sizeof(window));
+    write_le(p.data(), window);
+    return p;
+}
+
+inline uint32_t deserialize_stream_window(const sstring& s) {
+    return s.size() < sizeof(uint32_t) ? 0 : read_le<uint32_t>(s.c_str());
+}
+
+inline std::optional<shard_info> deserialize_shard_info(const sstring& s) {
+    if (s.size() < 9) {
+        return std::nullopt;
+    }
+    auto p = s.c_str();
+    shard_info info;
+    info.shard = read_le<uint32_t>(p);
+    info.shard_count = read_le<uint32_t>(p + 4);
+    info.port_routing = p[8];
+    if (info.shard >= info.shard_count) {
+        return std::nullopt;
+    }
+    return info;
+}
+
 template <bool IsSmartPtr>
 struct serialize_helper;
 
@@ -209,12 +248,24 @@ struct serialize_helper<true> {
 template <typename Serializer, typename Output, typename... T>
 inline void do_marshall(Serializer& serializer, Output& out, const T&... args);
 
+// Shares len bytes of the frame starting at pos, without copying them
+blob share_blob(rcv_buf& buf, size_t pos, size_t len);
+
 template <typename Serializer, typename Output>
 struct marshall_one {
     template <typename T> struct helper {
         static void doit(Serializer& serializer, Output& out, const T& arg) {
-            using serialize_helper_type = serialize_helper<is_smart_ptr<typename std::remove_reference<T>::type>::value>;
-            serialize_helper_type::serialize(serializer, out, arg);
+            if constexpr (std::is_same_v<T, blob>) {
+                // Blobs bypass the serializer: a little-endian 32-bit size, then the data
+                uint32_t size = cpu_to_le(uint32_t(arg.size()));
+                out.write(reinterpret_cast<const char*>(&size), sizeof(size));
+                for (auto& f : arg) {
+                    out.write(f.get(), f.size());
+                }
+            } else {
+                using serialize_helper_type = serialize_helper<is_smart_ptr<typename std::remove_reference<T>::type>::value>;
+                serialize_helper_type::serialize(serializer, out, arg);
+            }
         }
     };
     template<typename T> struct helper<std::reference_wrapper<const T>> {
@@ -274,27 +325,39 @@ inline snd_buf marshall(Serializer& serializer, size_t head_space, const T&... a
 }
 
 template <typename Serializer, typename Input, typename... T>
-std::tuple<T...> do_unmarshall(connection& c, Input& in);
+std::tuple<T...> do_unmarshall(connection& c, rcv_buf& frame, Input& in);
 
 template<typename Serializer, typename Input>
 struct unmarshal_one {
     template<typename T> struct helper {
-        static T doit(connection& c, Input& in) {
-            return read(c.serializer<Serializer>(), in, type<T>());
+        static T doit(connection& c, rcv_buf& frame, Input& in) {
+            if constexpr (std::is_same_v<T, blob>) {
+                uint32_t size;
+                in.read(reinterpret_cast<char*>(&size), sizeof(size));
+                size = le_to_cpu(size);
+                // The stream spans the whole frame, what is left of it ends the frame
+                auto ret = share_blob(frame, frame.size - in.size(), size);
+                in.skip(size);
+                return ret;
+            } else {
+                return read(c.serializer<Serializer>(), in, type<T>());
+            }
         }
     };
     template<typename T> struct helper<optional<T>> {
-        static optional<T> doit(connection& c, Input& in) {
-            if (in.size()) {
-                return optional<T>(read(c.serializer<Serializer>(), in, type<typename remove_optional<T>::type>()));
-            } else {
+        static optional<T> doit(connection& c, rcv_buf& frame, Input& in) {
+            if (!in.size()) {
                 return optional<T>();
+            } else if constexpr (std::is_same_v<T, blob>) {
+                return optional<T>(helper<T>::doit(c, frame, in));
+            } else {
+                return optional<T>(read(c.serializer<Serializer>(), in, type<typename remove_optional<T>::type>()));
             }
         }
     };
     template<typename T> struct helper<std::reference_wrapper<const T>> {
-        static T doit(connection& c, Input& in) {
-            return helper<T>::doit(c, in);
+        static T doit(connection& c, rcv_buf& frame, Input& in) {
+            return helper<T>::doit(c, frame, in);
         }
     };
     static connection_id get_connection_id(Input& in) {
@@ -303,24 +366,24 @@ struct unmarshal_one {
         return deserialize_connection_id(id);
     }
     template<typename... T> struct helper<sink<T...>> {
-        static sink<T...> doit(connection& c, Input& in) {
+        static sink<T...> doit(connection& c, rcv_buf& frame, Input& in) {
             return sink<T...>(make_shared<sink_impl<Serializer, T...>>(c.get_stream(get_connection_id(in))));
         }
     };
     template<typename... T> struct helper<source<T...>> {
-        static source<T...> doit(connection& c, Input& in) {
+        static source<T...> doit(connection& c, rcv_buf& frame, Input& in) {
             return source<T...>(make_shared<source_impl<Serializer, T...>>(c.get_stream(get_connection_id(in))));
         }
     };
     template <typename... T> struct helper<tuple<T...>> {
-        static tuple<T...> doit(connection& c, Input& in) {
-            return do_unmarshall<Serializer, Input, T...>(c, in);
+        static tuple<T...> doit(connection& c, rcv_buf& frame, Input& in) {
+            return do_unmarshall<Serializer, Input, T...>(c, frame, in);
         }
     };
 };
 
 template <typename Serializer, typename Input, typename... T>
-inline std::tuple<T...> do_unmarshall(connection& c, Input& in) {
+inline std::tuple<T...> do_unmarshall(connection& c, rcv_buf& frame, Input& in) {
     // Argument order processing is unspecified, but we need to deserialize
     // left-to-right. So we deserialize into something that can be lazily
     // constructed (and can conditionally destroy itself if we only constructed some
@@ -328,7 +391,7 @@ inline std::tuple<T...> do_unmarshall(connection& c, Input& in) {
     std::tuple<std::optional<T>...> temporary;
     return std::apply([&] (auto&... args) {
         // Comma-expression preserves left-to-right order
-        (..., (args = unmarshal_one<Serializer, Input>::template helper<typename std::remove_reference_t<decltype(args)>::value_type>::doit(c, in)));
+        (..., (args = unmarshal_one<Serializer, Input>::template helper<typename std::remove_reference_t<decltype(args)>::value_type>::doit(c, frame, in)));
         return std::tuple(std::move(*args)...);
     }, temporary);
 }
@@ -336,7 +399,7 @@ inline std::tuple<T...> do_unmarshall(connection& c, Input& in) {
 template <typename Serializer, typename... T>
 inline std::tuple<T...> unmarshall(connection& c, rcv_buf input) {
     auto in = make_deserializer_stream(input);
-    return do_unmarshall<Serializer, decltype(in), T...>(c, in);
+    return do_unmarshall<Serializer, decltype(in), T...>(c, input, in);
 }
 
 inline std::exception_ptr unmarshal_exception(rcv_buf& d) {
@@ -362,6 +425,9 @@ inline std::exception_ptr unmarshal_exception(rcv_buf& d) {
         ex = std::make_exception_ptr(unknown_verb_error(le_to_cpu(v64)));
         break;
     }
+    case exception_type::OVERLOADED:
+        ex = std::make_exception_ptr(overloaded_error());
+        break;
     default:
         ex = std::make_exception_ptr(unknown_exception_error());
         break;
@@ -468,19 +534,32 @@ auto send_helper(MsgType xt, signature<Ret (InArgs...)> xsig) {
 
             // send message
             auto msg_id = dst.next_message_id();
-            snd_buf data = marshall(dst.template serializer<Serializer>(), 28, args...);
-            static_assert(snd_buf::chunk_size >= 28, "send buffer chunk size is too small");
-            auto p = data.front().get_write() + 8; // 8 extra bytes for expiration timer
+            // Extra bytes for the trace context and the expiration timer,
+            // which the connection drops unless negotiated
+            constexpr size_t headroom = tracing::trace_context::serialized_size + 8 + 20;
+            snd_buf data = marshall(dst.template serializer<Serializer>(), headroom, args...);
+            static_assert(snd_buf::chunk_size >= headroom, "send buffer chunk size is too small");
+            auto p = data.front().get_write();
+            tracing::current_context().serialize(p);
+            p += tracing::trace_context::serialized_size + 8;
             write_le<uint64_t>(p, uint64_t(t));
             write_le<int64_t>(p + 8, msg_id);
-            write_le<uint32_t>(p + 16, data.size - 28);
+            write_le<uint32_t>(p + 16, data.size - headroom);
+
+            auto call = dst.get_verb_stats() ? dst.get_verb_stats()->client_call(uint64_t(t), data.size - headroom) : verb_call();
 
             // prepare reply handler, if return type is now_wait_type this does nothing, since no reply will be sent
             using wait = wait_signature_t<Ret>;
-            return when_all(dst.send(std::move(data), timeout, cancel), wait_for_reply<Serializer>(wait(), timeout, cancel, dst, msg_id, sig)).then([] (auto r) {
+            auto f = when_all(dst.send(std::move(data), timeout, cancel, dst.verb_lane(uint64_t(t))), wait_for_reply<Serializer>(wait(), timeout, cancel, dst, msg_id, sig)).then([] (auto r) {
                     std::get<0>(r).ignore_ready_future();
                     return std::move(std::get<1>(r)); // return future of wait_for_reply
             });
+            if (!call) {
+                return f;
+            }
+            return f.finally([call = std::move(call)] () mutable {
+                call.done();
+            });
         }
         auto operator()(rpc::client& dst, const InArgs&... args) {
             return send(dst, {}, nullptr, args...);
@@ -494,6 +573,19 @@ auto send_helper(MsgType xt, signature<Ret (InArgs...)> xsig) {
         auto operator()(rpc::client& dst, cancellable& cancel, const InArgs&... args) {
             return send(dst, {}, &cancel, args...);
         }
+        // Cancelled, failing with canceled_error, when an abort is requested
+        auto operator()(rpc::client& dst, abort_source& as, const InArgs&... args) {
+            if (as.abort_requested()) {
+                using cleaned_ret_type = typename wait_signature<Ret>::cleaned_type;
+                return futurize<cleaned_ret_type>::make_exception_future(canceled_error());
+            }
+            auto cancel = std::make_unique<cancellable>();
+            auto sub = as.subscribe([c = cancel.get()] () noexcept {
+                c->cancel();
+            });
+            auto f = send(dst, {}, cancel.get(), args...);
+            return f.finally([cancel = std::move(cancel), sub = std::move(sub)] {});
+        }
 
     };
     return shelper{xt, xsig};
@@ -566,13 +658,14 @@ auto lref_to_cref(T& x) {
 // Creates lambda to handle RPC message on a server.
 // The lambda unmarshalls all parameters, calls a handler, marshall return values and sends them back to a client
 template <typename Serializer, typename Func, typename Ret, typename... InArgs, typename WantClientInfo, typename WantTimePoint>
-auto recv_helper(signature<Ret (InArgs...)> sig, Func&& func, WantClientInfo, WantTimePoint) {
+auto recv_helper(signature<Ret (InArgs...)> sig, Func&& func, WantClientInfo, WantTimePoint, verb_stats& stats, uint64_t verb) {
     using signature = decltype(sig);
     using wait_style = wait_signature_t<Ret>;
-    return [func = lref_to_cref(std::forward<Func>(func))](shared_ptr<server::connection> client,
+    return [func = lref_to_cref(std::forward<Func>(func)), &stats, verb](shared_ptr<server::connection> client,
                                                            std::optional<rpc_clock_type::time_point> timeout,
                                                            int64_t msg_id,
                                                            rcv_buf data) mutable {
+        auto call = stats.server_call(verb, data.size);
         auto memory_consumed = client->estimate_request_size(data.size);
         if (memory_consumed > client->max_request_size()) {
             auto err = format("request size {:d} large than memory limit {:d}", memory_consumed, client->max_request_size());
@@ -586,14 +679,16 @@ auto recv_helper(signature<Ret (InArgs...)> sig, Func&& func, WantClientInfo, Wa
             return make_ready_future();
         }
         // note: apply is executed asynchronously with regards to networking so we cannot chain futures here by doing "return apply()"
-        auto f = client->wait_for_resources(memory_consumed, timeout).then([client, timeout, msg_id, data = std::move(data), &func] (auto permit) mutable {
+        auto f = client->wait_for_resources(memory_consumed, timeout).then([client, timeout, msg_id, data = std::move(data), call = std::move(call), &func] (auto permit) mutable {
                 // FIXME: future is discarded
-                (void)try_with_gate(client->get_server().reply_gate(), [client, timeout, msg_id, data = std::move(data), permit = std::move(permit), &func] () mutable {
+                (void)try_with_gate(client->get_server().reply_gate(), [client, timeout, msg_id, data = std::move(data), permit = std::move(permit), call = std::move(call), &func] () mutable {
                     try {
                         auto args = unmarshall<Serializer, InArgs...>(*client, std::move(data));
-                        return apply(func, client->info(), timeout, WantClientInfo(), WantTimePoint(), signature(), std::move(args)).then_wrapped([client, timeout, msg_id, permit = std::move(permit)] (futurize_t<Ret> ret) mutable {
+                        return apply(func, client->info(), timeout, WantClientInfo(), WantTimePoint(), signature(), std::move(args)).then_wrapped([client, timeout, msg_id, permit = std::move(permit), call = std::move(call)] (futurize_t<Ret> ret) mutable {
                             return reply<Serializer>(wait_style(), std::move(ret), msg_id, client, timeout).handle_exception([permit = std::move(permit), client, msg_id] (std::exception_ptr eptr) {
                                 client->get_logger()(client->info(), msg_id, format("got exception while processing a message: {}", eptr));
+                            }).finally([call = std::move(call)] () mutable {
+                                call.done();
                             });
                         });
                     } catch (...) {
@@ -606,6 +701,13 @@ auto recv_helper(signature<Ret (InArgs...)> sig, Func&& func, WantClientInfo, Wa
         if (timeout) {
             f = f.handle_exception_type([] (semaphore_timed_out&) { /* ignore */ });
         }
+        f = f.handle_exception_type([client, timeout, msg_id] (overloaded_error&) {
+            if constexpr (std::is_same_v<wait_style, no_wait_type>) {
+                return make_ready_future();
+            } else {
+                return client->send_overloaded_reply(timeout, msg_id);
+            }
+        });
 
         return f;
     };
@@ -672,7 +774,7 @@ auto protocol<Serializer, MsgType>::register_handler(MsgType t, scheduling_group
     using want_client_info = typename sig_type::want_client_info;
     using want_time_point = typename sig_type::want_time_point;
     auto recv = recv_helper<Serializer>(clean_sig_type(), std::forward<Func>(func),
-            want_client_info(), want_time_point());
+            want_client_info(), want_time_point(), _verb_stats, uint64_t(t));
     register_receiver(t, rpc_handler{sg, make_copyable_function(std::move(recv)), {}});
     return make_client(clean_sig_type(), t);
 }
@@ -723,6 +825,104 @@ void protocol<Serializer, MsgType>::put_handler(rpc_handler* h) {
     h->use_gate.leave();
 }
 
+template<typename Serializer, typename MsgType>
+socket_address protocol<Serializer, MsgType>::client_pool::local_address(unsigned shard) const {
+    if (!_shard_routing) {
+        return socket_address();
+    }
+    // A random port of the usual ephemeral range congruent to the shard
+    static constexpr unsigned first_port = 32768;
+    static constexpr unsigned last_port = 60999;
+    auto count = _clients.size();
+    static thread_local std::default_random_engine eng{std::random_device{}()};
+    auto dist = std::uniform_int_distribution<unsigned>((first_port + count - 1) / count, last_port / count - 1);
+    auto port = dist(eng) * count + shard;
+    return socket_address(net::inet_address(_addr.addr().in_family()), port);
+}
+
+template<typename Serializer, typename MsgType>
+auto protocol<Serializer, MsgType>::client_pool::new_client(unsigned idx) const -> std::unique_ptr<client> {
+    auto local = local_address(idx);
+    if (_make_socket) {
+        return std::make_unique<client>(_proto, _options, _make_socket(), _addr, local);
+    }
+    return std::make_unique<client>(_proto, _options, _addr, local);
+}
+
+template<typename Serializer, typename MsgType>
+future<> protocol<Serializer, MsgType>::client_pool::connect_shard(unsigned shard, unsigned attempts) {
+    _clients[shard] = new_client(shard);
+    return _clients[shard]->await_connection().handle_exception([this, shard, attempts] (std::exception_ptr ex) {
+        // Most likely the source port is in use already
+        auto c = std::move(_clients[shard]);
+        auto f = c->stop();
+        return f.finally([c = std::move(c)] {}).then([this, shard, attempts, ex] {
+            if (!attempts) {
+                return make_exception_future<>(ex);
+            }
+            return connect_shard(shard, attempts - 1);
+        });
+    });
+}
+
+template<typename Serializer, typename MsgType>
+future<> protocol<Serializer, MsgType>::client_pool::start() {
+    _clients.push_back(new_client(0));
+    return _clients.front()->await_connection().then([this] {
+        auto& info = _clients.front()->peer_shard_info();
+        if (info && info->port_routing) {
+            _shard_routing = true;
+            auto first = std::move(_clients.front());
+            _clients.clear();
+            _clients.resize(info->shard_count);
+            _clients[info->shard] = std::move(first);
+        } else {
+            _clients.resize(_connections);
+        }
+        return parallel_for_each(boost::irange<unsigned>(0, _clients.size()), [this] (unsigned shard) {
+            if (_clients[shard]) {
+                return make_ready_future<>();
+            }
+            return connect_shard(shard, 8);
+        });
+    });
+}
+
+template<typename Serializer, typename MsgType>
+future<> protocol<Serializer, MsgType>::client_pool::stop() noexcept {
+    return parallel_for_each(_clients, [] (std::unique_ptr<client>& c) {
+        return c ? c->stop() : make_ready_future<>();
+    }).finally([this] {
+        return std::exchange(_stopping, make_ready_future<>());
+    });
+}
+
+template<typename Serializer, typename MsgType>
+typename protocol<Serializer, MsgType>::client& protocol<Serializer, MsgType>::client_pool::maybe_reconnect(unsigned idx) {
+    auto& c = _clients[idx];
+    if (!c || c->error()) {
+        if (c) {
+            _stopping = _stopping.then([c = std::move(c)] () mutable {
+                auto f = c->stop();
+                return f.finally([c = std::move(c)] {});
+            });
+        }
+        c = new_client(idx);
+    }
+    return *c;
+}
+
+template<typename Serializer, typename MsgType>
+typename protocol<Serializer, MsgType>::client& protocol<Serializer, MsgType>::client_pool::for_shard(unsigned shard) {
+    return maybe_reconnect(shard % _clients.size());
+}
+
+template<typename Serializer, typename MsgType>
+typename protocol<Serializer, MsgType>::client& protocol<Serializer, MsgType>::client_pool::next() {
+    auto idx = _next++ % _clients.size();
+    return maybe_reconnect(idx);
+}
+
 template<typename T> T make_shard_local_buffer_copy(foreign_ptr<std::unique_ptr<T>> org);
 
 template<typename Serializer, typename... Out>
@@ -745,33 +945,38 @@ future<> sink_impl<Serializer, Out...>::operator()(const Out&... args) {
         // wait for it when closing.
         (void)smp::submit_to(this->_con->get_owner_shard(), [this, data = std::move(data), seq_num] () mutable {
             connection* con = this->_con->get();
-            if (con->error()) {
-                return make_exception_future(closed_error());
-            }
-            if(con->sink_closed()) {
-                return make_exception_future(stream_closed());
-            }
-
-            auto& last_seq_num = _remote_state.last_seq_num;
-            auto& out_of_order_bufs = _remote_state.out_of_order_bufs;
-
-            auto local_data = make_shard_local_buffer_copy(std::move(data));
-            const auto seq_num_diff = seq_num - last_seq_num;
-            if (seq_num_diff > 1) {
-                auto [it, _] = out_of_order_bufs.emplace(seq_num, deferred_snd_buf{promise<>{}, std::move(local_data)});
-                return it->second.pr.get_future();
-            }
-
-            last_seq_num = seq_num;
-            auto ret_fut = con->send(std::move(local_data), {}, nullptr);
-            while (!out_of_order_bufs.empty() && out_of_order_bufs.begin()->first == (last_seq_num + 1)) {
-                auto it = out_of_order_bufs.begin();
-                last_seq_num = it->first;
-                auto fut = con->send(std::move(it->second.data), {}, nullptr);
-                fut.forward_to(std::move(it->second.pr));
-                out_of_order_bufs.erase(it);
-            }
-            return ret_fut;
+            // Credits are taken in the order frames arrive from the sink's shard,
+            // which is the order of their sequence numbers
+            auto credits = con->stream_wait_credits(data->size);
+            return credits.then([this, con, data = std::move(data), seq_num] () mutable {
+                if (con->error()) {
+                    return make_exception_future(closed_error());
+                }
+                if(con->sink_closed()) {
+                    return make_exception_future(stream_closed());
+                }
+
+                auto& last_seq_num = _remote_state.last_seq_num;
+                auto& out_of_order_bufs = _remote_state.out_of_order_bufs;
+
+                auto local_data = make_shard_local_buffer_copy(std::move(data));
+                const auto seq_num_diff = seq_num - last_seq_num;
+                if (seq_num_diff > 1) {
+                    auto [it, _] = out_of_order_bufs.emplace(seq_num, deferred_snd_buf{promise<>{}, std::move(local_data)});
+                    return it->second.pr.get_future();
+                }
+
+                last_seq_num = seq_num;
+                auto ret_fut = con->send(std::move(local_data), {}, nullptr);
+                while (!out_of_order_bufs.empty() && out_of_order_bufs.begin()->first == (last_seq_num + 1)) {
+                    auto it = out_of_order_bufs.begin();
+                    last_seq_num = it->first;
+                    auto fut = con->send(std::move(it->second.data), {}, nullptr);
+                    fut.forward_to(std::move(it->second.pr));
+                    out_of_order_bufs.erase(it);
+                }
+                return ret_fut;
+            });
         }).then_wrapped([su = std::move(su), this] (future<> f) {
             if (f.failed() && !this->_ex) { // first error is the interesting one
                 this->_ex = f.get_exception();
@@ -22,6 +22,7 @@
 #pragma once
 
 #include <seastar/net/api.hh>
+#include <array>
 #include <stdexcept>
 #include <string>
 #include <boost/any.hpp>
@@ -45,14 +46,22 @@ using rpc_clock_type = lowres_clock;
 template<typename T>
 using type = boost::type<T>;
 
+/// Number of priority lanes of a connection's outgoing queue. Messages of
+/// higher lanes are sent ahead of queued messages of lower ones.
+constexpr unsigned outgoing_lanes = 4;
+
 struct stats {
     using counter_type = uint64_t;
     counter_type replied = 0;
     counter_type pending = 0;
     counter_type exception_received = 0;
     counter_type sent_messages = 0;
+    counter_type flushes = 0; ///< flushes of the sent messages; sent_messages / flushes is the number of frames per send call
+    counter_type uncompressed_messages = 0; ///< messages sent without compression on a compressed connection
+    std::array<counter_type, outgoing_lanes> pending_per_lane = {}; ///< queued messages of each outgoing lane
     counter_type wait_reply = 0;
     counter_type timeout = 0;
+    counter_type shed = 0; ///< requests rejected by load shedding, see \ref load_shedding_config
 };
 
 
@@ -96,6 +105,12 @@ class unknown_verb_error : public error {
     unknown_verb_error(uint64_t type_) : error("unknown verb"), type(type_) {}
 };
 
+/// The server shed the request, it would not get resources in time
+class overloaded_error : public error {
+public:
+    overloaded_error() : error("rpc server overloaded") {}
+};
+
 class unknown_exception_error : public error {
 public:
     unknown_exception_error() : error("unknown exception") {}
@@ -192,6 +207,36 @@ struct rcv_buf {
         : size(size), bufs(std::move(bufs)) {};
 };
 
+/// A possibly fragmented chunk of bytes passed as a verb argument or a
+/// return value without going through the serializer.
+///
+/// On the receiving side the fragments share the buffers the frame was
+/// read into, so large payloads reach the handler without being copied
+/// or linearized. Keeping a blob alive past the handler keeps the whole
+/// frame in memory, outside of the server's request memory accounting;
+/// copy the data out if it has to stay around long.
+class blob {
+    std::vector<temporary_buffer<char>> _fragments;
+    size_t _size = 0;
+public:
+    using const_iterator = std::vector<temporary_buffer<char>>::const_iterator;
+    blob() = default;
+    explicit blob(temporary_buffer<char> b) : _size(b.size()) {
+        if (_size) {
+            _fragments.push_back(std::move(b));
+        }
+    }
+    blob(std::vector<temporary_buffer<char>> fragments, size_t size) noexcept
+        : _fragments(std::move(fragments)), _size(size) {}
+    size_t size() const noexcept { return _size; }
+    bool empty() const noexcept { return !_size; }
+    const std::vector<temporary_buffer<char>>& fragments() const noexcept { return _fragments; }
+    const_iterator begin() const noexcept { return _fragments.begin(); }
+    const_iterator end() const noexcept { return _fragments.end(); }
+    /// Copies the data into a single buffer
+    temporary_buffer<char> linearize() const;
+};
+
 struct snd_buf {
     // Preferred, but not required, chunk size.
     static constexpr size_t chunk_size = 128*1024;
@@ -240,6 +285,34 @@ class compressor {
     };
 };
 
+/// Lets a connection send frames without compressing them when compression
+/// would not pay off, either because they are small or because they do not
+/// compress well (already compressed or encrypted data). The peers agree on
+/// it during negotiation, so older peers keep getting every frame compressed.
+///
+/// A frame found incompressible makes the connection send the next frames as
+/// is, for a number that doubles with every further incompressible probe, up
+/// to \ref max_backoff. Large probe frames are judged on a compressed sample
+/// of \ref sample_size bytes before compressing them whole.
+struct adaptive_compression_config {
+    /// Frames smaller than this are never compressed
+    size_t min_size = 1024;
+    /// Frames whose compressed size is above this fraction of their size are
+    /// deemed incompressible and are sent as is
+    double max_ratio = 0.9;
+    /// Size of the sample compressed to probe large frames
+    size_t sample_size = 16 * 1024;
+    /// Maximum number of frames sent without compression between probes
+    unsigned max_backoff = 64;
+};
+
+/// Shard placement of a server side connection, as advertised by the server
+struct shard_info {
+    unsigned shard = 0;         ///< shard serving the connection
+    unsigned shard_count = 0;   ///< number of shards of the server
+    bool port_routing = false;  ///< whether connections land on shard (source port % shard_count)
+};
+
 class connection;
 
 struct connection_id {
@@ -0,0 +1,101 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#pragma once
+
+#ifdef SEASTAR_HAVE_ZSTD
+
+#include <seastar/core/sstring.hh>
+#include <seastar/core/temporary_buffer.hh>
+#include <seastar/rpc/rpc_types.hh>
+#include <memory>
+#include <vector>
+
+struct ZSTD_CDict_s;
+struct ZSTD_DDict_s;
+
+namespace seastar {
+
+namespace rpc {
+
+// A compression dictionary, shared by both sides of a connection.
+//
+// The dictionary is digested once on creation and is immutable afterwards,
+// so a single instance may be used by the compressors of all shards.
+// Its id is part of the negotiated feature name ("ZSTD:<id>") and must
+// therefore identify the dictionary contents; it cannot contain ','.
+class zstd_dictionary {
+    struct cdict_deleter {
+        void operator()(ZSTD_CDict_s*) const noexcept;
+    };
+    struct ddict_deleter {
+        void operator()(ZSTD_DDict_s*) const noexcept;
+    };
+    sstring _id;
+    std::unique_ptr<ZSTD_CDict_s, cdict_deleter> _cdict;
+    std::unique_ptr<ZSTD_DDict_s, ddict_deleter> _ddict;
+public:
+    zstd_dictionary(sstring id, const temporary_buffer<char>& data, int level);
+    const sstring& id() const noexcept { return _id; }
+    const ZSTD_CDict_s* cdict() const noexcept { return _cdict.get(); }
+    const ZSTD_DDict_s* ddict() const noexcept { return _ddict.get(); }
+
+    // Trains a dictionary of at most max_size bytes on sample messages
+    static temporary_buffer<char> train(const std::vector<temporary_buffer<char>>& samples, size_t max_size = 110 * 1024);
+};
+
+// Compresses RPC frames with zstd. Fragmented frames are compressed and
+// decompressed in a streaming fashion, no contiguous copy of large frames
+// is made.
+class zstd_compressor : public compressor {
+    int _level;
+    std::shared_ptr<const zstd_dictionary> _dict;
+public:
+    static constexpr int default_level = 3;
+
+    class factory: public rpc::compressor::factory {
+        int _level;
+        std::shared_ptr<const zstd_dictionary> _dict;
+        sstring _name;
+    public:
+        // Negotiates "ZSTD", compressing at the given level
+        explicit factory(int level = default_level);
+        // Negotiates "ZSTD:<id>", compressing with the dictionary at its level.
+        // Several such factories can be combined with multi_algo_compressor_factory
+        // to let peers agree on a dictionary both of them have.
+        explicit factory(std::shared_ptr<const zstd_dictionary> dict);
+        virtual const sstring& supported() const override;
+        virtual std::unique_ptr<rpc::compressor> negotiate(sstring feature, bool is_server) const override;
+    };
+public:
+    explicit zstd_compressor(int level = default_level, std::shared_ptr<const zstd_dictionary> dict = {});
+    // compress data, leaving head_space empty in returned buffer
+    snd_buf compress(size_t head_space, snd_buf data) override;
+    // decompress data
+    rcv_buf decompress(rcv_buf data) override;
+    sstring name() const override;
+};
+
+}
+
+}
+
+#endif
@@ -26,6 +26,15 @@ namespace seastar {
 
 namespace testing {
 
+/// Runs the registered test cases with boost.test.
+///
+/// With \c --jobs N among the arguments for boost.test (before \c --),
+/// each test case runs in a process of its own, with its own reactor, up
+/// to N at a time; every process gets as many cores as the arguments for
+/// Seastar ask for with \c --smp (one if they do not), pinned apart from
+/// the others if there are enough, and an equal part of the memory. The
+/// time each test case took is printed, and the output of those that
+/// failed. Test cases picked with \c --run_test run in this process.
 int entry_point(int argc, char **argv);
 
 }
@@ -43,7 +43,16 @@ class linux_perf_event {
     uint64_t read();
     void enable();
     void disable();
+    // -1 if the event could not be opened
+    int fd() const noexcept { return _fd; }
 public:
     static linux_perf_event user_instructions_retired();
+    // Events to count in the group of group_fd, if it is not -1: they are
+    // counted when the group leader is, and all at the same time.
+    static linux_perf_event user_cpu_cycles(int group_fd = -1);
+    static linux_perf_event user_l1d_read_misses(int group_fd = -1);
+    static linux_perf_event user_llc_misses(int group_fd = -1);
+    static linux_perf_event user_branch_misses(int group_fd = -1);
+    static linux_perf_event user_dtlb_read_misses(int group_fd = -1);
 };
 
@@ -21,13 +21,20 @@
 
 #pragma once
 
+#include <array>
 #include <atomic>
 #include <memory>
+#include <optional>
 
 #include <fmt/format.h>
 
 #include <seastar/core/future.hh>
+#include <seastar/core/do_with.hh>
 #include <seastar/core/loop.hh>
+#include <seastar/core/exponential_histogram.hh>
+#include <seastar/core/gate.hh>
+#include <seastar/core/semaphore.hh>
+#include <seastar/core/sleep.hh>
 #include <seastar/testing/linux_perf_event.hh>
 
 #ifdef SEASTAR_COROUTINES_ENABLED
@@ -43,11 +50,42 @@ struct config;
 
 using clock_type = std::chrono::steady_clock;
 
+// Hardware events which can be counted, besides retired instructions
+enum class hw_counter : unsigned {
+    cycles,
+    l1d_misses,
+    llc_misses,
+    branch_misses,
+    dtlb_misses,
+};
+
+static constexpr unsigned nr_hw_counters = 5;
+
+using hw_counter_values = std::array<uint64_t, nr_hw_counters>;
+
+// The counters of a test: retired instructions, and the hardware counters
+// of the configuration, in a group that it leads, so that they all count
+// the same code, and can be compared.
+class perf_counters {
+    linux_perf_event _instructions_retired = linux_perf_event::user_instructions_retired();
+    std::array<std::optional<linux_perf_event>, nr_hw_counters> _hw;
+public:
+    void open(hw_counter c);
+    void close() noexcept;
+    void enable();
+    void disable();
+    uint64_t instructions_retired() {
+        return _instructions_retired.read();
+    }
+    hw_counter_values read_hw();
+};
+
 class perf_stats {
 public:
     uint64_t allocations = 0;
     uint64_t tasks_executed = 0;
     uint64_t instructions_retired = 0;
+    hw_counter_values hw = {};
 
 private:
     static uint64_t perf_mallocs();
@@ -55,15 +93,17 @@ class perf_stats {
 
 public:
     perf_stats() = default;
-    perf_stats(uint64_t allocations_, uint64_t tasks_executed_, uint64_t instructions_retired_ = 0)
+    perf_stats(uint64_t allocations_, uint64_t tasks_executed_, uint64_t instructions_retired_ = 0, hw_counter_values hw_ = {})
         : allocations(allocations_)
         , tasks_executed(tasks_executed_)
         , instructions_retired(instructions_retired_)
+        , hw(hw_)
     {}
     perf_stats(perf_stats&& o) noexcept
         : allocations(std::exchange(o.allocations, 0))
         , tasks_executed(std::exchange(o.tasks_executed, 0))
         , instructions_retired(std::exchange(o.instructions_retired, 0))
+        , hw(std::exchange(o.hw, {}))
     {}
     perf_stats(const perf_stats& o) = default;
 
@@ -73,31 +113,16 @@ class perf_stats {
     perf_stats& operator+=(perf_stats b);
     perf_stats& operator-=(perf_stats b);
 
-    static perf_stats snapshot(linux_perf_event* instructions_retired_counter = nullptr);
+    static perf_stats snapshot(perf_counters* counters = nullptr);
 };
 
-inline
-perf_stats
-operator+(perf_stats a, perf_stats b) {
-    a.allocations += b.allocations;
-    a.tasks_executed += b.tasks_executed;
-    a.instructions_retired += b.instructions_retired;
-    return a;
-}
-
-inline
-perf_stats
-operator-(perf_stats a, perf_stats b) {
-    a.allocations -= b.allocations;
-    a.tasks_executed -= b.tasks_executed;
-    a.instructions_retired -= b.instructions_retired;
-    return a;
-}
-
 inline perf_stats& perf_stats::operator+=(perf_stats b) {
     allocations += b.allocations;
     tasks_executed += b.tasks_executed;
     instructions_retired += b.instructions_retired;
+    for (unsigned i = 0; i < nr_hw_counters; i++) {
+        hw[i] += b.hw[i];
+    }
     return *this;
 }
 
@@ -105,9 +130,26 @@ inline perf_stats& perf_stats::operator-=(perf_stats b) {
     allocations -= b.allocations;
     tasks_executed -= b.tasks_executed;
     instructions_retired -= b.instructions_retired;
+    for (unsigned i = 0; i < nr_hw_counters; i++) {
+        hw[i] -= b.hw[i];
+    }
     return *this;
 }
 
+inline
+perf_stats
+operator+(perf_stats a, perf_stats b) {
+    a += b;
+    return a;
+}
+
+inline
+perf_stats
+operator-(perf_stats a, perf_stats b) {
+    a -= b;
+    return a;
+}
+
 class performance_test {
     std::string _test_case;
     std::string _test_group;
@@ -115,7 +157,12 @@ class performance_test {
     uint64_t _single_run_iterations = 0;
     std::atomic<uint64_t> _max_single_run_iterations;
 protected:
-    linux_perf_event _instructions_retired_counter = linux_perf_event::user_instructions_retired();
+    perf_counters _counters;
+    // Latencies of calls, in nanoseconds, in the latency modes
+    metrics::exponential_histogram _latencies{1, 1e11, 5};
+    double _max_latency = 0;
+    // Calls in flight in the open loop
+    static constexpr size_t max_open_loop_calls = 10000;
 private:
     void do_run(const config&);
 public:
@@ -134,9 +181,20 @@ class performance_test {
         _single_run_iterations += n;
     }
 
+    void record_latency(clock_type::time_point due) noexcept {
+        double ns = std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now() - due).count();
+        _latencies.record(ns);
+        _max_latency = std::max(_max_latency, ns);
+    }
+
     virtual void set_up() = 0;
     virtual void tear_down() noexcept = 0;
     virtual future<run_result> do_single_run() = 0;
+    // Times each call. With a zero interval, calls are made one after the
+    // other; otherwise, one is due every interval, whether the previous
+    // ones are done or not, and is timed from when it was due, so that
+    // the latencies include the time a slow call made the next ones wait.
+    virtual future<run_result> do_latency_run(clock_type::duration interval) = 0;
 public:
     performance_test(const std::string& test_case, const std::string& test_group)
         : _test_case(test_case)
@@ -167,18 +225,18 @@ class time_measurement {
     perf_stats _start_stats;
     perf_stats _total_stats;
 
-    linux_perf_event* _instructions_retired_counter = nullptr;
+    perf_counters* _counters = nullptr;
 
 public:
     [[gnu::always_inline]] [[gnu::hot]]
-    void start_run(linux_perf_event* instructions_retired_counter = nullptr) {
-        _instructions_retired_counter = instructions_retired_counter;
+    void start_run(perf_counters* counters = nullptr) {
+        _counters = counters;
         _total_time = { };
         _total_stats = {};
         auto t = clock_type::now();
         _run_start_time = t;
         _start_time = t;
-        _start_stats = perf_stats::snapshot(_instructions_retired_counter);
+        _start_stats = perf_stats::snapshot(_counters);
     }
 
     [[gnu::always_inline]] [[gnu::hot]]
@@ -187,20 +245,20 @@ class time_measurement {
         performance_test::run_result ret;
         if (_start_time == _run_start_time) {
             ret.duration = t - _start_time;
-            auto stats = perf_stats::snapshot(_instructions_retired_counter);
+            auto stats = perf_stats::snapshot(_counters);
             ret.stats = stats - _start_stats;
         } else {
             ret.duration = _total_time;
             ret.stats = _total_stats;
         }
-        _instructions_retired_counter = nullptr;
+        _counters = nullptr;
         return ret;
     }
 
     [[gnu::always_inline]] [[gnu::hot]]
     void start_iteration() {
         _start_time = clock_type::now();
-        _start_stats = perf_stats::snapshot(_instructions_retired_counter);
+        _start_stats = perf_stats::snapshot(_counters);
     }
 
     [[gnu::always_inline]] [[gnu::hot]]
@@ -208,7 +266,7 @@ class time_measurement {
         auto t = clock_type::now();
         _total_time += t - _start_time;
         perf_stats stats;
-        stats = perf_stats::snapshot(_instructions_retired_counter);
+        stats = perf_stats::snapshot(_counters);
         _total_stats += stats - _start_stats;
     }
 };
@@ -261,9 +319,9 @@ class concrete_performance_test final : public performance_test {
     [[gnu::hot]]
     virtual future<run_result> do_single_run() override {
         // Redundant 'this->'s courtesy of https://gcc.gnu.org/bugzilla/show_bug.cgi?id=61636
-        _instructions_retired_counter.enable();
+        _counters.enable();
         return if_constexpr_<is_future<decltype(_test->run())>::value>([&] (auto&&...) {
-            measure_time.start_run(&_instructions_retired_counter);
+            measure_time.start_run(&_counters);
             return do_until([this] { return this->stop_iteration(); }, [this] {
                 return if_constexpr_<std::is_same<decltype(_test->run()), future<>>::value>([&] (auto&&...) {
                     this->next_iteration(1);
@@ -278,10 +336,10 @@ class concrete_performance_test final : public performance_test {
             }).then([] {
                 return measure_time.stop_run();
             }).finally([this] {
-                _instructions_retired_counter.disable();
+                _counters.disable();
             });
         }, [&] (auto&&...) {
-            measure_time.start_run(&_instructions_retired_counter);
+            measure_time.start_run(&_counters);
             while (!stop_iteration()) {
                 if_constexpr_<std::is_void<decltype(_test->run())>::value>([&] (auto&&...) {
                     (void)_test->run();
@@ -293,10 +351,68 @@ class concrete_performance_test final : public performance_test {
                 })();
             }
             auto ret = measure_time.stop_run();
-            _instructions_retired_counter.disable();
+            _counters.disable();
             return make_ready_future<run_result>(std::move(ret));
         })();
     }
+
+    // Runs the test once, returning the number of iterations it did
+    future<size_t> run_once() {
+        using ret_type = decltype(_test->run());
+        if constexpr (std::is_same_v<ret_type, future<>>) {
+            return _test->run().then([] { return size_t(1); });
+        } else if constexpr (is_future<ret_type>::value) {
+            return _test->run().then([] (auto n) { return size_t(n); });
+        } else if constexpr (std::is_void_v<ret_type>) {
+            _test->run();
+            return make_ready_future<size_t>(1);
+        } else {
+            return make_ready_future<size_t>(_test->run());
+        }
+    }
+
+    virtual future<run_result> do_latency_run(clock_type::duration interval) override {
+        _counters.enable();
+        measure_time.start_run(&_counters);
+        auto start = clock_type::now();
+        return do_with(uint64_t(0), gate(), semaphore(max_open_loop_calls), std::exception_ptr(),
+                [this, start, interval] (uint64_t& calls, gate& g, semaphore& in_flight, std::exception_ptr& error) {
+            return do_until([this, &error] { return error || this->stop_iteration(); }, [this, start, interval, &calls, &g, &in_flight, &error] {
+                // A call which returns a number of iterations counts as one
+                this->next_iteration(1);
+                if (!interval.count()) {
+                    auto due = clock_type::now();
+                    return run_once().then([this, due] (size_t) {
+                        this->record_latency(due);
+                    });
+                }
+                auto due = start + calls++ * interval;
+                auto now = clock_type::now();
+                auto f = due > now ? seastar::sleep(due - now) : make_ready_future<>();
+                return f.then([this, due, &g, &in_flight, &error] {
+                    return get_units(in_flight, 1).then([this, due, &g, &error] (auto units) {
+                        (void)with_gate(g, [this, due, &error, units = std::move(units)] () mutable {
+                            return run_once().then([this, due] (size_t) {
+                                this->record_latency(due);
+                            }).handle_exception([&error] (std::exception_ptr ep) {
+                                error = std::move(ep);
+                            }).finally([units = std::move(units)] {});
+                        });
+                    });
+                });
+            }).then([&g] {
+                return g.close();
+            }).then([&error] {
+                if (error) {
+                    std::rethrow_exception(error);
+                }
+            });
+        }).then([] {
+            return measure_time.stop_run();
+        }).finally([this] {
+            _counters.disable();
+        });
+    }
 public:
     using performance_test::performance_test;
 };
@@ -0,0 +1,159 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#pragma once
+
+#include <seastar/core/file.hh>
+#include <seastar/core/future.hh>
+#include <seastar/core/manual_clock.hh>
+#include <seastar/core/queue.hh>
+#include <seastar/core/shared_ptr.hh>
+#include <seastar/core/sstring.hh>
+#include <seastar/net/api.hh>
+#include <seastar/net/socket_defs.hh>
+#include <seastar/util/concepts.hh>
+#include <concepts>
+#include <cstdint>
+#include <random>
+#include <unordered_map>
+#include <utility>
+
+namespace seastar {
+
+namespace testing {
+
+/// How long the transfers of a network link or of a disk take.
+///
+/// Transfers over the same link, or of the same kind on the same disk,
+/// go one after the other at \c bandwidth, and each completes \c latency
+/// after it was sent, plus some random extra time.
+struct latency_model {
+    /// Time from the end of a transfer to its completion
+    manual_clock::duration latency{};
+    /// Bytes per second; 0 for no limit
+    uint64_t bandwidth = 0;
+    /// Extra latency, uniformly distributed below this
+    manual_clock::duration jitter{};
+    /// The fraction of transfers that take \c tail_latency longer
+    double tail_probability = 0;
+    manual_clock::duration tail_latency{};
+};
+
+/// How long the reads and writes of a simulated disk take
+struct disk_model {
+    latency_model read;
+    latency_model write;
+};
+
+/// Deterministic simulation of network and disk latency in virtual time.
+///
+/// Connections and files made by the simulation complete their transfers
+/// on \ref manual_clock timers, according to their \ref latency_model.
+/// The code under test is run with run(), which advances the clock to
+/// the next timer whenever nothing else is ready to run, so that an
+/// experiment covering minutes of traffic over slow links takes as long
+/// as the code takes to run. The random parts of the models come from a
+/// generator seeded by the caller; a run with the same seed takes the
+/// same course, and ends at the same virtual time, so a pathology found
+/// once can be replayed.
+///
+/// Everything simulated has to wait on \ref manual_clock rather than on
+/// another clock, or on real I/O, and runs on one shard. The simulation
+/// must outlive its sockets and files.
+///
+/// \code
+/// testing::simulation sim(seed, {.latency = 100us, .bandwidth = 1'000'000'000});
+/// auto listener = sim.listen(addr);
+/// sim.run([&] {
+///     return when_all(serve(listener), run_clients(sim, addr));
+/// }).get();
+/// \endcode
+class simulation {
+    class channel;
+    class sim_source;
+    class sim_sink;
+    class sim_socket;
+    class sim_server_socket;
+    class sim_file;
+    struct file_data;
+
+    uint64_t _seed;
+    std::mt19937_64 _rng;
+    latency_model _network;
+    disk_model _disk;
+    manual_clock::time_point _disk_read_free;
+    manual_clock::time_point _disk_write_free;
+    std::unordered_map<socket_address, lw_shared_ptr<queue<connected_socket>>> _listeners;
+    std::unordered_map<sstring, lw_shared_ptr<file_data>> _files;
+
+    manual_clock::duration extra_latency(const latency_model& m);
+    // When a transfer of the size, over a resource busy until free, would
+    // complete if it started now; moves free past its transmission
+    manual_clock::time_point schedule(const latency_model& m, manual_clock::time_point& free, size_t bytes);
+public:
+    /// \param seed seeds the random parts of the models
+    /// \param network the model of each direction of each connection
+    /// \param disk the model of the disk the files are on
+    explicit simulation(uint64_t seed, latency_model network = {}, disk_model disk = {});
+    simulation(simulation&&) = delete;
+    ~simulation();
+
+    uint64_t seed() const noexcept {
+        return _seed;
+    }
+
+    /// Waits for a future, advancing \ref manual_clock to the deadline of
+    /// the earliest timer of the shard whenever the shard has nothing
+    /// else to run.
+    ///
+    /// Fails if the shard runs out of both tasks and timers first, as
+    /// nothing could then resolve the future.
+    future<> run(future<> f);
+
+    /// Runs a function, then waits for the future it returns as
+    /// run(future<>) does, discarding its value.
+    template <typename Func>
+    SEASTAR_CONCEPT( requires std::invocable<Func> )
+    future<> run(Func&& func) {
+        return run(futurize_invoke(std::forward<Func>(func)).discard_result());
+    }
+
+    /// Makes a connection: a pair of sockets, each transferring to the
+    /// other over its own link of the network model
+    std::pair<connected_socket, connected_socket> make_connection();
+
+    /// Listens on an address of the simulated network, for connect()
+    server_socket listen(socket_address addr);
+
+    /// Connects to an address listen() was called for. The server side
+    /// is accepted after one trip over the network, the connection
+    /// established after two; fails with \c ECONNREFUSED if nothing
+    /// listens on the address.
+    future<connected_socket> connect(socket_address addr);
+
+    /// Opens a file on the simulated disk, kept in memory, creating it
+    /// empty if it is not there yet
+    file open_file(sstring name);
+};
+
+}
+
+}
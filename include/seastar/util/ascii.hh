@@ -0,0 +1,66 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+
+/// \file
+///
+/// String functions for protocol text, such as header names, which is ASCII
+/// whatever the locale. They work on several bytes at a time, with SSE2
+/// where it is available; bytes outside ASCII are compared as they are.
+
+namespace seastar {
+
+/// Returns \c c in lower case, if it is an ASCII upper case letter
+constexpr char ascii_tolower(char c) noexcept {
+    return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+/// Compares two strings, ignoring the case of ASCII letters
+bool ascii_iequals(std::string_view a, std::string_view b) noexcept;
+
+/// Hashes a string, ignoring the case of ASCII letters: strings that
+/// \ref ascii_iequals() finds equal hash the same
+size_t ascii_ihash(std::string_view s) noexcept;
+
+/// Finds the first character of \c s, from \c pos, that is one of \c chars.
+///
+/// \return its position, or std::string_view::npos if there is none
+size_t ascii_find_first_of(std::string_view s, std::string_view chars, size_t pos = 0) noexcept;
+
+/// A hash functor for case-insensitive maps of strings
+struct ascii_ihash_fn {
+    size_t operator()(std::string_view s) const noexcept {
+        return ascii_ihash(s);
+    }
+};
+
+/// An equality functor for case-insensitive maps of strings
+struct ascii_iequals_fn {
+    bool operator()(std::string_view a, std::string_view b) const noexcept {
+        return ascii_iequals(a, b);
+    }
+};
+
+}
@@ -46,6 +46,8 @@ struct frame {
 
 bool operator==(const frame& a, const frame& b) noexcept;
 
+std::ostream& operator<<(std::ostream& out, const frame& f);
+
 
 // If addr doesn't seem to belong to any of the provided shared objects, it
 // will be considered as part of the executable.
@@ -79,6 +81,7 @@ class simple_backtrace {
 
     size_t hash() const noexcept { return _hash; }
     char delimeter() const noexcept { return _delimeter; }
+    const vector_type& frames() const noexcept { return _frames; }
 
     friend std::ostream& operator<<(std::ostream& out, const simple_backtrace&);
 
@@ -132,6 +135,8 @@ class tasktrace {
 
     size_t hash() const noexcept { return _hash; }
     char delimeter() const noexcept { return _main.delimeter(); }
+    // The backtrace of the task that was running when this was captured.
+    const simple_backtrace& main_backtrace() const noexcept { return _main; }
 
     friend std::ostream& operator<<(std::ostream& out, const tasktrace&);
 
@@ -0,0 +1,137 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#pragma once
+
+#include <seastar/core/temporary_buffer.hh>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+/// \file
+///
+/// Checksums for file formats and messages: CRC32C, with the CRC32C
+/// instructions of SSE4.2 or ARMv8 where the CPU has them, and xxHash64,
+/// which is faster where it does not. Both are computed over a buffer, or
+/// incrementally over the fragments of one, e.g. the buffers of an rpc
+/// \c snd_buf, with the same result.
+
+namespace seastar {
+
+namespace internal {
+
+/// How \ref crc32c is computed; exposed for tests and benchmarks
+enum class crc32c_kernel {
+    table,       ///< eight bytes at a time, with lookup tables
+    hardware,    ///< the CRC32C instruction
+    interleaved, ///< the CRC32C instruction on three streams at a time
+    best,        ///< the fastest available for the buffer
+};
+
+/// Whether the CPU has CRC32C instructions
+bool crc32c_hardware_available() noexcept;
+
+/// Continues the CRC32C register \c crc, not inverted, over \c len bytes
+/// at \c data; the \c hardware kernels must be available.
+uint32_t crc32c_update(uint32_t crc, const char* data, size_t len, crc32c_kernel k = crc32c_kernel::best) noexcept;
+
+}
+
+/// CRC32C (Castagnoli), the checksum of iSCSI, ext4 and many file formats
+class crc32c {
+    uint32_t _crc = ~uint32_t(0);
+public:
+    /// Adds \c len bytes at \c data
+    void update(const char* data, size_t len) noexcept {
+        _crc = internal::crc32c_update(_crc, data, len);
+    }
+    void update(std::string_view s) noexcept {
+        update(s.data(), s.size());
+    }
+    template <typename CharType>
+    void update(const temporary_buffer<CharType>& buf) noexcept {
+        update(reinterpret_cast<const char*>(buf.get()), buf.size());
+    }
+    /// Adds each of a range of fragments, e.g. temporary_buffers
+    template <typename Fragments>
+    void update_fragments(const Fragments& fragments) noexcept {
+        for (auto& f : fragments) {
+            update(f);
+        }
+    }
+
+    /// The checksum of the bytes added so far
+    uint32_t checksum() const noexcept {
+        return ~_crc;
+    }
+
+    /// The checksum of \c len bytes at \c data
+    static uint32_t of(const char* data, size_t len) noexcept {
+        return ~internal::crc32c_update(~uint32_t(0), data, len);
+    }
+    static uint32_t of(std::string_view s) noexcept {
+        return of(s.data(), s.size());
+    }
+
+    /// The checksum of two pieces of data one after the other, from the
+    /// checksums of each and the length of the second one.
+    static uint32_t combine(uint32_t crc1, uint32_t crc2, size_t len2) noexcept;
+};
+
+/// xxHash64, the 64-bit hash of the xxHash family
+class xxhash64 {
+    uint64_t _acc[4];
+    uint64_t _seed;
+    uint64_t _total = 0;
+    // Input short of a 32 byte stripe
+    char _buf[32];
+    size_t _buffered = 0;
+public:
+    explicit xxhash64(uint64_t seed = 0) noexcept;
+
+    /// Adds \c len bytes at \c data
+    void update(const char* data, size_t len) noexcept;
+    void update(std::string_view s) noexcept {
+        update(s.data(), s.size());
+    }
+    template <typename CharType>
+    void update(const temporary_buffer<CharType>& buf) noexcept {
+        update(reinterpret_cast<const char*>(buf.get()), buf.size());
+    }
+    /// Adds each of a range of fragments, e.g. temporary_buffers
+    template <typename Fragments>
+    void update_fragments(const Fragments& fragments) noexcept {
+        for (auto& f : fragments) {
+            update(f);
+        }
+    }
+
+    /// The hash of the bytes added so far
+    uint64_t digest() const noexcept;
+
+    /// The hash of \c len bytes at \c data
+    static uint64_t of(const char* data, size_t len, uint64_t seed = 0) noexcept;
+    static uint64_t of(std::string_view s, uint64_t seed = 0) noexcept {
+        return of(s.data(), s.size(), seed);
+    }
+};
+
+}
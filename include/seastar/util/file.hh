@@ -46,6 +46,36 @@ namespace seastar {
 ///
 future<> recursive_remove_directory(std::filesystem::path path) noexcept;
 
+/// How \ref copy_file() copied the data.
+enum class copy_file_method {
+    clone,      ///< the copy shares the blocks of the source (FICLONERANGE)
+    copy_range, ///< the kernel copied some or all of it (copy_file_range(2))
+    stream,     ///< all of it was read and written with DMA
+};
+
+/// Copies \c len bytes of \c src at \c src_pos to \c dst at \c dst_pos.
+///
+/// The range is cloned if the file system can share its blocks between the
+/// files; else copied by the kernel, without passing through user space, if
+/// the file systems allow; else read and written with DMA in the class
+/// \c pc, so that it is throttled like the other I/O of the class. The
+/// copy stops early if \c src ends.
+///
+/// When the data is read and written, \c dst_pos must be aligned to
+/// \ref file::disk_write_dma_alignment() of \c dst; the copy may
+/// write up to an alignment past the range, rewriting the data there.
+///
+/// The copy is not flushed; call \ref file::flush() on \c dst for that.
+future<copy_file_method> copy_file(file& src, uint64_t src_pos, file& dst, uint64_t dst_pos, uint64_t len,
+        const io_priority_class& pc = default_priority_class()) noexcept;
+
+/// Copies the file at \c src to \c dst, which is created or truncated.
+///
+/// See \ref copy_file(file&, uint64_t, file&, uint64_t, uint64_t, const io_priority_class&).
+/// The copy is flushed before the returned future resolves.
+future<copy_file_method> copy_file(std::string_view src, std::string_view dst,
+        const io_priority_class& pc = default_priority_class()) noexcept;
+
 /// @}
 
 /// \defgroup fileio-util File and Stream Utilities
@@ -85,6 +85,24 @@ struct options : public program_options::option_group {
     ///
     /// Default: \p true.
     program_options::value<bool> log_with_color;
+
+    /// Write log messages from a dedicated thread, see
+    /// \ref logger::set_async_enabled().
+    ///
+    /// Default: \p false.
+    program_options::value<bool> log_async;
+
+    /// Size in bytes of the buffer of each thread, for messages not yet
+    /// written by the log thread.
+    ///
+    /// Default: 1MB.
+    program_options::value<unsigned> log_async_buffer_size;
+
+    /// With \ref log_async, leave the formatting of messages to the log
+    /// thread, see \ref logger::set_deferred_formatting().
+    ///
+    /// Default: \p false.
+    program_options::value<bool> log_deferred_formatting;
     /// \cond internal
     options(program_options::option_group* parent_group);
     /// \endcond
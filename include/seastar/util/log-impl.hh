@@ -21,7 +21,10 @@
 
 #pragma once
 
+#include <cstdint>
+#include <cstring>
 #include <iterator>
+#include <string_view>
 
 /// \addtogroup logging
 /// @{
@@ -115,6 +118,66 @@ class log_buf {
     std::string_view view() const noexcept { return std::string_view(_begin, size()); }
 };
 
+/// The types of the arguments of a log message which \ref log_arg_encoder
+/// serializes.
+enum class log_arg_type : uint8_t {
+    i64,
+    u64,
+    f32,
+    f64,
+    boolean,
+    character,
+    string,
+    pointer,
+};
+
+/// Serializes the arguments of a log message into a buffer, so that the
+/// message can be formatted later, on another thread.
+///
+/// Each argument is a \ref log_arg_type, followed by its value; strings
+/// are a 32-bit length, followed by their characters.
+class log_arg_encoder {
+    char* _begin;
+    char* _current;
+    char* _end;
+    bool _ok = true;
+private:
+    void put_bytes(const void* p, size_t n) noexcept {
+        if (size_t(_end - _current) < n) {
+            _ok = false;
+            return;
+        }
+        std::memcpy(_current, p, n);
+        _current += n;
+    }
+public:
+    log_arg_encoder(char* buf, size_t size) noexcept
+        : _begin(buf)
+        , _current(buf)
+        , _end(buf + size)
+    {}
+
+    template <typename T>
+    void put(log_arg_type type, T value) noexcept {
+        put_bytes(&type, sizeof(type));
+        put_bytes(&value, sizeof(value));
+    }
+
+    void put_string(std::string_view s) noexcept {
+        auto type = log_arg_type::string;
+        uint32_t len = s.size();
+        put_bytes(&type, sizeof(type));
+        put_bytes(&len, sizeof(len));
+        put_bytes(s.data(), s.size());
+    }
+
+    void fail() noexcept { _ok = false; }
+
+    /// Tells whether all the arguments fit, and can be formatted later
+    bool ok() const noexcept { return _ok; }
+    std::string_view view() const noexcept { return std::string_view(_begin, _current - _begin); }
+};
+
 } // namespace internal
 /// \endcond
 
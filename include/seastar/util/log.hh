@@ -26,6 +26,7 @@
 #include <seastar/core/lowres_clock.hh>
 #include <seastar/util/std-compat.hh>
 
+#include <array>
 #include <unordered_map>
 #include <exception>
 #include <iosfwd>
@@ -69,6 +70,74 @@ namespace seastar {
 
 class logger;
 class logger_registry;
+class async_log_sink;
+
+/// \cond internal
+namespace internal {
+
+template <typename T>
+struct is_log_string : std::false_type {};
+template <>
+struct is_log_string<std::string> : std::true_type {};
+template <>
+struct is_log_string<std::string_view> : std::true_type {};
+template <typename Size, Size max_size, bool NulTerminate>
+struct is_log_string<basic_sstring<char, Size, max_size, NulTerminate>> : std::true_type {};
+
+template <typename T>
+struct is_log_c_string : std::false_type {};
+template <>
+struct is_log_c_string<const char*> : std::true_type {};
+template <>
+struct is_log_c_string<char*> : std::true_type {};
+template <size_t N>
+struct is_log_c_string<char[N]> : std::true_type {};
+template <size_t N>
+struct is_log_c_string<const char[N]> : std::true_type {};
+
+/// Whether a log argument of type \c T can be serialized by
+/// \ref log_arg_encoder, and formatted later the way it is now
+template <typename T>
+inline constexpr bool is_deferrable_log_arg_v =
+        (std::is_integral_v<T> && sizeof(T) <= sizeof(uint64_t)
+                && !std::is_same_v<T, wchar_t> && !std::is_same_v<T, char8_t>
+                && !std::is_same_v<T, char16_t> && !std::is_same_v<T, char32_t>)
+        || std::is_same_v<T, float> || std::is_same_v<T, double>
+        || std::is_same_v<T, const void*> || std::is_same_v<T, void*>
+        || is_log_string<T>::value || is_log_c_string<T>::value;
+
+template <typename T>
+void encode_log_arg(log_arg_encoder& enc, const T& arg) noexcept {
+    if constexpr (std::is_same_v<T, bool>) {
+        enc.put(log_arg_type::boolean, arg);
+    } else if constexpr (std::is_same_v<T, char>) {
+        enc.put(log_arg_type::character, arg);
+    } else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+        enc.put(log_arg_type::i64, int64_t(arg));
+    } else if constexpr (std::is_integral_v<T>) {
+        enc.put(log_arg_type::u64, uint64_t(arg));
+    } else if constexpr (std::is_same_v<T, float>) {
+        enc.put(log_arg_type::f32, arg);
+    } else if constexpr (std::is_same_v<T, double>) {
+        enc.put(log_arg_type::f64, arg);
+    } else if constexpr (std::is_pointer_v<T> && !is_log_c_string<T>::value) {
+        enc.put(log_arg_type::pointer, static_cast<const void*>(arg));
+    } else if constexpr (std::is_pointer_v<T>) {
+        if (arg) {
+            enc.put_string(std::string_view(arg));
+        } else {
+            // Left to the eager path to report
+            enc.fail();
+        }
+    } else if constexpr (std::is_array_v<T>) {
+        enc.put_string(std::string_view(arg));
+    } else {
+        enc.put_string(std::string_view(arg.data(), arg.size()));
+    }
+}
+
+}
+/// \endcond
 
 /// \brief Logger class for ostream or syslog.
 ///
@@ -87,7 +156,9 @@ class logger {
     static std::ostream* _out;
     static std::atomic<bool> _ostream;
     static std::atomic<bool> _syslog;
+    static std::atomic<bool> _deferred;
     static unsigned _shard_field_width;
+    friend class async_log_sink;
     static inline thread_local bool silent = false;
 
 public:
@@ -137,6 +208,16 @@ class logger {
     // We can't use an std::function<> as it potentially allocates.
     void do_log(log_level level, log_writer& writer);
     void failed_to_log(std::exception_ptr ex, format_info fmt) noexcept;
+    // Returns false if the message has to be formatted now
+    bool do_log_deferred(log_level level, std::string_view format, std::string_view args);
+
+    template <typename... Args>
+    bool log_deferred(log_level level, std::string_view format, const Args&... args) {
+        std::array<char, 512> buf;
+        internal::log_arg_encoder enc(buf.data(), buf.size());
+        (internal::encode_log_arg(enc, args), ...);
+        return enc.ok() && do_log_deferred(level, format, enc.view());
+    }
 
     class silencer {
     public:
@@ -217,6 +298,11 @@ class logger {
     void log(log_level level, format_info fmt, Args&&... args) noexcept {
         if (is_enabled(level)) {
             try {
+                if constexpr ((internal::is_deferrable_log_arg_v<std::remove_cvref_t<Args>> && ...)) {
+                    if (_deferred.load(std::memory_order_relaxed) && log_deferred(level, fmt.format, args...)) {
+                        return;
+                    }
+                }
                 lambda_log_writer writer([&] (internal::log_buf::inserter_iterator it) {
 #if FMT_VERSION >= 80000
                     return fmt::format_to(it, fmt::runtime(fmt.format), std::forward<Args>(args)...);
@@ -425,6 +511,37 @@ class logger {
     /// \param width the minimal width of the shard id field
     static void set_shard_field_width(unsigned width) noexcept;
 
+    /// Write log messages from a dedicated thread.
+    ///
+    /// Each thread queues its formatted messages in a buffer of its own,
+    /// which the log thread drains to the output stream and syslog, so that
+    /// a slow sink does not stall the reactor. While the buffer of a thread
+    /// is full, its messages are dropped and counted, except for messages
+    /// at error level, which wait for room, and then for the message to be
+    /// written, so that it is not lost if the process is about to abort.
+    ///
+    /// Must not be called while other threads may log, i.e. only before the
+    /// reactors start, or after they stop.
+    ///
+    /// \param enabled whether messages are written by the log thread; when
+    ///        disabling, pending messages are written first
+    /// \param buffer_size the size of the buffer of each thread, in bytes
+    static void set_async_enabled(bool enabled, size_t buffer_size = 1 << 20);
+
+    /// Leave the formatting of messages to the log thread.
+    ///
+    /// With \ref set_async_enabled(), messages whose arguments are all
+    /// numbers, strings or pointers are queued as the format string and a
+    /// binary copy of the arguments, and formatted by the log thread, so
+    /// that logging costs the thread little more than a copy. Messages
+    /// with other arguments are formatted as they are logged. Has no effect
+    /// without async logging, or with {fmt} older than 8.
+    static void set_deferred_formatting(bool enabled) noexcept;
+
+    /// The number of messages dropped because the buffer of the log thread
+    /// was full, see \ref set_async_enabled()
+    static uint64_t async_dropped_messages() noexcept;
+
     /// enable/disable the colored tag in ostream
     ///
     /// \note this is a noop if fmtlib's version is less than 6.0
@@ -506,6 +623,9 @@ struct logging_settings final {
     bool with_color;
     logger_timestamp_style stdout_timestamp_style = logger_timestamp_style::real;
     logger_ostream_type logger_ostream = logger_ostream_type::stderr;
+    bool async = false;
+    size_t async_buffer_size = 1 << 20;
+    bool deferred_formatting = false;
 };
 
 /// Shortcut for configuring the logging system all at once.
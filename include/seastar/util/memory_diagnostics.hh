@@ -21,7 +21,10 @@
 
 #pragma once
 
+#include <seastar/util/backtrace.hh>
 #include <seastar/util/noncopyable_function.hh>
+#include <cstdint>
+#include <vector>
 
 namespace seastar {
 namespace memory {
@@ -81,5 +84,52 @@ void set_additional_diagnostics_producer(noncopyable_function<void(memory_diagno
 /// low-memory conditions.
 sstring generate_memory_diagnostics_report();
 
+/// Generate a profile of the live memory recorded by the heap profiler
+///
+/// The profile covers allocations made on this shard while heap profiling
+/// was enabled (see \ref set_heap_profiling_enabled()) and that are still
+/// live. It is in the legacy text heap profile format understood by pprof,
+/// which takes care of scaling sampled data up to estimates of the actual
+/// usage (see \ref set_heap_profiling_sampling_interval()). The mapping of
+/// shared objects needed to symbolize it is included.
+///
+/// Returns an empty string when seastar was compiled without heap profiling
+/// support.
+sstring generate_heap_profile();
+
+/// Live memory recorded by the heap profiler for one allocation site
+///
+/// When heap profiling samples allocations (see
+/// \ref set_heap_profiling_sampling_interval()), the sizes and counts are
+/// estimates scaled up from the sampled ones.
+struct allocation_site_stats {
+    size_t size;              ///< bytes retained by live objects
+    size_t count;             ///< live objects
+    int64_t growth;           ///< change of \c size since the last snapshot
+    saved_backtrace backtrace;
+};
+
+/// The order of the sites returned by \ref top_allocation_sites()
+enum class allocation_site_order {
+    size,   ///< largest retained size first
+    growth, ///< largest growth since the last snapshot first
+};
+
+/// The allocation sites of this shard which retain the most memory, or
+/// grew the most since the last call to \ref snapshot_allocation_sites()
+///
+/// The same sites, ten of each order, are listed in the diagnostics report
+/// dumped on allocation failure.
+///
+/// Returns an empty vector when the heap profiler recorded nothing, or
+/// seastar was compiled without heap profiling support.
+///
+/// \param n the number of sites to return, at most
+std::vector<allocation_site_stats> top_allocation_sites(size_t n, allocation_site_order order = allocation_site_order::size);
+
+/// Records the size retained by each allocation site of this shard, which
+/// later growth is measured from
+void snapshot_allocation_sites();
+
 } // namespace memory
 } // namespace seastar
@@ -29,15 +29,16 @@
 
 namespace seastar {
 
-template <typename Signature>
+template <typename Signature, size_t DirectSize = 32, bool AllowIndirect = true>
 class noncopyable_function;
 
 namespace internal {
 
+template <size_t DirectSize>
 class noncopyable_function_base {
 private:
     noncopyable_function_base() = default;
-    static constexpr size_t nr_direct = 32;
+    static constexpr size_t nr_direct = DirectSize;
     union [[gnu::may_alias]] storage {
         char direct[nr_direct];
         void* indirect;
@@ -75,7 +76,7 @@ class noncopyable_function_base {
 private:
     storage _storage;
 
-    template <typename Signature>
+    template <typename Signature, size_t, bool>
     friend class seastar::noncopyable_function;
 };
 
@@ -98,8 +99,22 @@ struct is_nothrow_if_object<> {
 
 /// A clone of \c std::function, but only invokes the move constructor
 /// of the contained function.
-template <typename Ret, typename... Args, bool Noexcept>
-class noncopyable_function<Ret (Args...) noexcept(Noexcept)> : private internal::noncopyable_function_base {
+///
+/// Functions of up to \c DirectSize bytes are stored inline; larger ones are
+/// allocated, unless \c AllowIndirect is false, in which case they do not
+/// compile. See \ref inplace_function.
+template <typename Ret, typename... Args, bool Noexcept, size_t DirectSize, bool AllowIndirect>
+class noncopyable_function<Ret (Args...) noexcept(Noexcept), DirectSize, AllowIndirect> : private internal::noncopyable_function_base<DirectSize> {
+    using base = internal::noncopyable_function_base<DirectSize>;
+    using typename base::storage;
+    using typename base::move_type;
+    using typename base::destroy_type;
+    using base::nr_direct;
+    using base::empty_move;
+    using base::empty_destroy;
+    using base::indirect_move;
+    using base::trivial_direct_destroy;
+    using noncopyable_function_base = base;
     using call_type = Ret (*)(const noncopyable_function* func, Args...);
     struct vtable {
         const call_type call;
@@ -130,7 +145,7 @@ class noncopyable_function<Ret (Args...) noexcept(Noexcept)> : private internal:
         static constexpr move_type select_move_thunk() {
             bool can_trivially_move = std::is_trivially_move_constructible<Func>::value
                     && std::is_trivially_destructible<Func>::value;
-            return can_trivially_move ? trivial_direct_move<internal::used_size<Func>::value> : move;
+            return can_trivially_move ? base::template trivial_direct_move<internal::used_size<Func>::value> : move;
         }
         static void destroy(noncopyable_function_base* func) {
             access(func)->~Func();
@@ -173,10 +188,17 @@ class noncopyable_function<Ret (Args...) noexcept(Noexcept)> : private internal:
     template <typename Func>
     struct vtable_for : select_vtable_for<Func, is_direct<Func>()> {};
 public:
+    /// The size of the largest function stored without an allocation
+    static constexpr size_t inline_capacity = DirectSize;
+
     noncopyable_function() noexcept : _vtable(&_s_empty_vtable) {}
     template <typename Func>
     noncopyable_function(Func func) {
         static_assert(!Noexcept || noexcept(std::declval<Func>()(std::declval<Args>()...)));
+        static_assert(AllowIndirect || sizeof(Func) <= nr_direct,
+                "the function does not fit in the inline storage of this inplace_function; raise its capacity");
+        static_assert(AllowIndirect || (alignof(Func) <= alignof(storage) && std::is_nothrow_move_constructible<Func>::value),
+                "an inplace_function can only hold a function that is nothrow move constructible and aligned to at most a pointer");
         vtable_for<Func>::initialize(std::move(func), this);
         _vtable = &vtable_for<Func>::s_vtable;
     }
@@ -215,19 +237,30 @@ class noncopyable_function<Ret (Args...) noexcept(Noexcept)> : private internal:
 };
 
 
-template <typename Ret, typename... Args, bool Noexcept>
-constexpr typename noncopyable_function<Ret (Args...) noexcept(Noexcept)>::vtable noncopyable_function<Ret (Args...) noexcept(Noexcept)>::_s_empty_vtable;
+template <typename Ret, typename... Args, bool Noexcept, size_t DirectSize, bool AllowIndirect>
+constexpr typename noncopyable_function<Ret (Args...) noexcept(Noexcept), DirectSize, AllowIndirect>::vtable noncopyable_function<Ret (Args...) noexcept(Noexcept), DirectSize, AllowIndirect>::_s_empty_vtable;
 
-template <typename Ret, typename... Args, bool Noexcept>
+template <typename Ret, typename... Args, bool Noexcept, size_t DirectSize, bool AllowIndirect>
 template <typename Func>
-const typename noncopyable_function<Ret (Args...) noexcept(Noexcept)>::vtable noncopyable_function<Ret (Args...) noexcept(Noexcept)>::direct_vtable_for<Func>::s_vtable
-        = noncopyable_function<Ret (Args...) noexcept(Noexcept)>::direct_vtable_for<Func>::make_vtable();
+const typename noncopyable_function<Ret (Args...) noexcept(Noexcept), DirectSize, AllowIndirect>::vtable noncopyable_function<Ret (Args...) noexcept(Noexcept), DirectSize, AllowIndirect>::direct_vtable_for<Func>::s_vtable
+        = noncopyable_function<Ret (Args...) noexcept(Noexcept), DirectSize, AllowIndirect>::direct_vtable_for<Func>::make_vtable();
 
 
-template <typename Ret, typename... Args, bool Noexcept>
+template <typename Ret, typename... Args, bool Noexcept, size_t DirectSize, bool AllowIndirect>
 template <typename Func>
-const typename noncopyable_function<Ret (Args...) noexcept(Noexcept)>::vtable noncopyable_function<Ret (Args...) noexcept(Noexcept)>::indirect_vtable_for<Func>::s_vtable
-        = noncopyable_function<Ret (Args...) noexcept(Noexcept)>::indirect_vtable_for<Func>::make_vtable();
+const typename noncopyable_function<Ret (Args...) noexcept(Noexcept), DirectSize, AllowIndirect>::vtable noncopyable_function<Ret (Args...) noexcept(Noexcept), DirectSize, AllowIndirect>::indirect_vtable_for<Func>::s_vtable
+        = noncopyable_function<Ret (Args...) noexcept(Noexcept), DirectSize, AllowIndirect>::indirect_vtable_for<Func>::make_vtable();
+
+/// A \ref noncopyable_function that never allocates.
+///
+/// Holds functions of up to \c Capacity bytes inline; a larger one is a
+/// compile-time error rather than a heap allocation, so hot paths can size
+/// the storage to fit their captures and be sure they stay allocation-free.
+///
+/// \code
+/// inplace_function<void (), 64> f = [a, b, c, d] { ... };
+/// \endcode
+template <typename Signature, size_t Capacity = 32>
+using inplace_function = noncopyable_function<Signature, Capacity, false>;
 
 }
-
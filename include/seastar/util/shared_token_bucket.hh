@@ -23,9 +23,11 @@
 #pragma once
 
 #include <seastar/util/concepts.hh>
+#include <algorithm>
 #include <atomic>
 #include <chrono>
 #include <cmath>
+#include <utility>
 
 namespace seastar {
 namespace internal {
@@ -94,7 +96,8 @@ SEASTAR_CONCEPT( requires std::is_nothrow_copy_constructible_v<T> && supports_wr
 class shared_token_bucket {
     using rate_resolution = std::chrono::duration<double, Period>;
 
-    T _replenish_rate;
+    // Can be updated by one shard while others replenish from it
+    std::atomic<T> _replenish_rate;
     const T _replenish_limit;
     const T _replenish_threshold;
     std::atomic<typename Clock::time_point> _replenished;
@@ -161,6 +164,11 @@ class shared_token_bucket {
         _rovers.release(tokens);
     }
 
+    // Puts back tokens that were grabbed, but not spent after all
+    void refund(T tokens) noexcept {
+        fetch_add(_rovers.head, std::min(tokens, _rovers.max_extra(_replenish_limit)));
+    }
+
     void replenish(typename Clock::time_point now) noexcept {
         auto ts = _replenished.load(std::memory_order_relaxed);
 
@@ -193,22 +201,113 @@ class shared_token_bucket {
     template <typename Rep, typename Per>
     T accumulated_in(const std::chrono::duration<Rep, Per> delta) const noexcept {
        auto delta_at_rate = std::min(rate_cast(delta), max_delta);
-       return accumulated(_replenish_rate, delta_at_rate);
+       return accumulated(rate(), delta_at_rate);
     }
 
     // Estimated time to process the given amount of tokens
     // (peer of accumulated_in helper)
     rate_resolution duration_for(T tokens) const noexcept {
-        return rate_resolution(tokens / _replenish_rate);
+        return rate_resolution(tokens / rate());
     }
 
-    T rate() const noexcept { return _replenish_rate; }
+    T rate() const noexcept { return _replenish_rate.load(std::memory_order_relaxed); }
     T limit() const noexcept { return _replenish_limit; }
     T threshold() const noexcept { return _replenish_threshold; }
     typename Clock::time_point replenished_ts() const noexcept { return _replenished; }
 
     void update_rate(T rate) noexcept {
-        _replenish_rate = std::min(rate, max_rate);
+        _replenish_rate.store(std::min(rate, max_rate), std::memory_order_relaxed);
+    }
+};
+
+/*
+ * A shard-local slice of the bucket's tail.
+ *
+ * Instead of moving the shared tail rover for every grab, the lease moves
+ * it by a chunk of tokens at a time and hands the tokens of the chunk out
+ * locally. Each grab still gets its own position in the chunk to wait for
+ * the head to cross, so leasing doesn't delay anything. Released tokens are
+ * batched the same way and put back once there's a chunk of them.
+ *
+ * A lease thus holds at most a chunk of grabbed, but not yet spent, tokens
+ * and a chunk of released, but not yet returned, ones. This bounds how much
+ * the owning shard can get ahead of, or hold back, the others. The owner
+ * should return_tokens() when it runs out of work, so that the tokens
+ * it holds don't stay out of the others' reach for long.
+ */
+template <typename Bucket, typename T>
+class shared_token_bucket_lease {
+    Bucket* _bucket;
+    T _chunk;
+    // The leased tokens not yet handed out are [_pos, _end)
+    T _pos = 0;
+    T _end = 0;
+    T _released = 0;
+
+public:
+    shared_token_bucket_lease(Bucket& bucket, T chunk) noexcept
+        : _bucket(&bucket)
+        , _chunk(chunk)
+    {}
+
+    shared_token_bucket_lease(shared_token_bucket_lease&& o) noexcept
+        : _bucket(o._bucket)
+        , _chunk(o._chunk)
+        , _pos(std::exchange(o._pos, 0))
+        , _end(std::exchange(o._end, 0))
+        , _released(std::exchange(o._released, 0))
+    {}
+
+    ~shared_token_bucket_lease() {
+        return_tokens();
+    }
+
+    T chunk() const noexcept { return _chunk; }
+    T leased() const noexcept { return _end - _pos; }
+
+    // Same as Bucket::grab()
+    T grab(T tokens) noexcept {
+        if (_end - _pos < tokens) {
+            auto want = std::max(tokens, _chunk);
+            auto end = _bucket->grab(want);
+            if (end - want != _end) {
+                // Some other shard grabbed in between, the rest of the
+                // previous chunk cannot be continued
+                return_unused();
+                _pos = end - want;
+            }
+            _end = end;
+        }
+        _pos += tokens;
+        return _pos;
+    }
+
+    // Same as Bucket::release()
+    void release(T tokens) noexcept {
+        _released += tokens;
+        if (_released >= _chunk) {
+            _bucket->release(std::exchange(_released, 0));
+        }
+    }
+
+    // Puts back the grabbed, but not handed out, tokens and the
+    // released ones
+    void return_tokens() noexcept {
+        return_unused();
+        if (_released) {
+            _bucket->release(std::exchange(_released, 0));
+        }
+    }
+
+private:
+    void return_unused() noexcept {
+        if (auto unused = _end - _pos) {
+            // The same as if they were grabbed for a request that was
+            // aborted right away
+            _bucket->release(unused);
+            _bucket->refund(unused);
+            _pos = _end;
+        }
     }
 };
 
@@ -136,6 +136,10 @@ class websocket_parser {
     std::unique_ptr<frame_header> _header;
     uint64_t _payload_length;
     uint32_t _masking_key;
+    // How far into the payload of the frame unmasking got, modulo 4
+    uint8_t _mask_offset = 0;
+    // Whether RSV1 may mark a message compressed
+    bool _permessage_deflate = false;
     buff_t _result;
 
     static future<consumption_result_t> dont_stop() {
@@ -145,13 +149,9 @@ class websocket_parser {
         return make_ready_future<consumption_result_t>(stop_consuming(std::move(data)));
     }
 
-    // Removes mask from payload given in p.
-    void remove_mask(buff_t& p, size_t n) {
-        char *payload = p.get_write();
-        for (uint64_t i = 0, j = 0; i < n; ++i, j = (j + 1) % 4) {
-            payload[i] ^= static_cast<char>(((_masking_key << (j * 8)) >> 24));
-        }
-    } 
+    // Removes mask from the first n bytes of p, which carry on the payload
+    // from where the previous call left off.
+    void remove_mask(buff_t& p, size_t n);
 public:
     websocket_parser() : _state(parsing_state::flags_and_payload_data),
                          _cstate(connection_state::valid),
@@ -160,10 +160,24 @@ class websocket_parser {
     future<consumption_result_t> operator()(temporary_buffer<char> data);
     bool is_valid() { return _cstate == connection_state::valid; }
     bool eof() { return _cstate == connection_state::closed; }
+    /*!
+     * \brief let RSV1 mark the first frame of a compressed message
+     * (RFC 7692, section 6)
+     */
+    void set_permessage_deflate(bool b) { _permessage_deflate = b; }
     opcodes opcode() const;
+    // Whether the current frame is the last of its message
+    bool fin() const;
+    // Whether the message the current frame starts is compressed
+    bool compressed() const;
+    // Whether result() is the end of the current frame. Large frames come
+    // out in parts, as their payload is received.
+    bool frame_done() const;
     buff_t result();
 };
 
+class permessage_deflate;
+
 /*!
  * \brief a WebSocket connection
  */
@@ -247,25 +261,16 @@ class connection : public boost::intrusive::list_base_hook<> {
 
     sstring _subprotocol;
     handler_t _handler;
+    // Set when permessage-deflate was negotiated
+    std::unique_ptr<permessage_deflate> _deflate;
+    // Whether the message being received is compressed
+    bool _message_compressed = false;
 public:
     /*!
      * \param server owning \ref server
      * \param fd established socket used for communication
      */
-    connection(server& server, connected_socket&& fd)
-        : _server(server)
-        , _fd(std::move(fd))
-        , _read_buf(_fd.input())
-        , _write_buf(_fd.output())
-        , _input_buffer{PIPE_SIZE}
-        , _output_buffer{PIPE_SIZE}
-    {
-        _input = input_stream<char>{data_source{
-                std::make_unique<connection_source_impl>(&_input_buffer)}};
-        _output = output_stream<char>{data_sink{
-                std::make_unique<connection_sink_impl>(&_output_buffer)}};
-        on_new_connection();
-    }
+    connection(server& server, connected_socket&& fd);
     ~connection();
 
     /*!
@@ -288,7 +293,12 @@ class connection : public boost::intrusive::list_base_hook<> {
     /*!
      * \brief Packs buff in websocket frame and sends it to the client.
      */
-    future<> send_data(opcodes opcode, temporary_buffer<char>&& buff);
+    future<> send_data(opcodes opcode, temporary_buffer<char>&& buff, bool compressed = false);
+    /*!
+     * \brief Passes a part of a data message on to the handler, decompressing it
+     * if needed.
+     */
+    future<> receive_data(temporary_buffer<char> buff, bool fin);
 
 };
 
@@ -304,6 +314,8 @@ class server {
     std::map<std::string, handler_t> _handlers;
     future<> _accept_fut = make_ready_future<>();
     bool _stopped = false;
+    bool _permessage_deflate = false;
+    int _compression_level = -1;
 public:
     /*!
      * \brief listen for a WebSocket connection on given address
@@ -326,6 +338,17 @@ class server {
 
     void register_handler(std::string&& name, handler_t handler);
 
+    /*!
+     * \brief compress messages with clients that offer permessage-deflate
+     *
+     * The extension (RFC 7692) is negotiated in the handshake. Messages from
+     * the client are then decompressed as their frames come in, and what the
+     * handler writes is sent compressed.
+     * \param b whether to accept the extension, off by default
+     * \param level the zlib compression level, from 1 to 9; -1 for its default
+     */
+    void set_permessage_deflate(bool b, int level = -1);
+
     friend class connection;
 protected:
     void do_accepts(int which);
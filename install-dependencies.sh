@@ -39,6 +39,7 @@ debian_packages=(
     xfslibs-dev
     libgnutls28-dev
     liblz4-dev
+    zlib1g-dev
     libsctp-dev
     liburing-dev
     gcc
@@ -76,6 +77,7 @@ redhat_packages=(
     gnutls-devel
     lksctp-tools-devel
     lz4-devel
+    zlib-devel
     liburing-devel
     gcc
     make
@@ -153,6 +155,7 @@ arch_packages=(
     gnutls
     lksctp-tools
     lz4
+    zlib
     make
     libtool
     cmake
@@ -192,6 +195,7 @@ opensuse_packages=(
     libgnutls-devel
     libgnutlsxx28
     liblz4-devel
+    zlib-devel
     libnuma-devel
     lksctp-tools-devel
     ninja
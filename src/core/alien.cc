@@ -36,6 +36,45 @@ void message_queue::stop() {
     _metrics.clear();
 }
 
+void message_queue::lf_queue::push(work_item* first, work_item* last) noexcept {
+    last->_next.store(nullptr, std::memory_order_relaxed);
+    auto prev = _head.exchange(last, std::memory_order_acq_rel);
+    prev->_next.store(first, std::memory_order_release);
+}
+
+message_queue::work_item* message_queue::lf_queue::pop() noexcept {
+    auto tail = _tail;
+    auto next = tail->_next.load(std::memory_order_acquire);
+    if (tail == &_stub) {
+        if (!next) {
+            return nullptr;
+        }
+        _tail = tail = next;
+        next = next->_next.load(std::memory_order_acquire);
+    }
+    if (next) {
+        _tail = next;
+        return tail;
+    }
+    if (tail != _head.load(std::memory_order_acquire)) {
+        // A producer is linking after tail
+        return nullptr;
+    }
+    // tail is the last item; put the stub after it, so that it can be
+    // taken out of the queue
+    push(&_stub, &_stub);
+    next = tail->_next.load(std::memory_order_acquire);
+    if (next) {
+        _tail = next;
+        return tail;
+    }
+    return nullptr;
+}
+
+bool message_queue::lf_queue::empty() const noexcept {
+    return _tail == &_stub && _head.load(std::memory_order_acquire) == &_stub;
+}
+
 void
 message_queue::lf_queue::maybe_wakeup() {
     // see also smp_message_queue::lf_queue::maybe_wakeup()
@@ -47,14 +86,27 @@ message_queue::lf_queue::maybe_wakeup() {
 }
 
 void message_queue::submit_item(std::unique_ptr<message_queue::work_item> item) {
-    if (!_pending.push(item.get())) {
-        throw std::bad_alloc();
-    }
-    item.release();
+    auto wi = item.release();
+    _pending.push(wi, wi);
     _pending.maybe_wakeup();
     ++_sent.value;
 }
 
+void message_queue::submit_items(std::vector<std::unique_ptr<message_queue::work_item>> items) {
+    if (items.empty()) {
+        return;
+    }
+    for (size_t i = 1; i < items.size(); i++) {
+        items[i - 1]->_next.store(items[i].get(), std::memory_order_relaxed);
+    }
+    _pending.push(items.front().get(), items.back().get());
+    for (auto& item : items) {
+        (void)item.release();
+    }
+    _pending.maybe_wakeup();
+    _sent.value += items.size();
+}
+
 bool message_queue::pure_poll_rx() const {
     return !_pending.empty();
 }
@@ -63,8 +115,8 @@ template<typename Func>
 size_t message_queue::process_queue(lf_queue& q, Func process) {
     // copy batch to local memory in order to minimize
     // time in which cross-cpu data is accessed
-    work_item* wi;
-    if (!q.pop(wi)) {
+    work_item* wi = q.pop();
+    if (!wi) {
         return 0;
     }
     work_item* items[batch_size + prefetch_cnt];
@@ -72,7 +124,7 @@ size_t message_queue::process_queue(lf_queue& q, Func process) {
     // access with potential cache miss the second pop may cause
     prefetch<2>(wi);
     size_t nr = 0;
-    while (nr < batch_size && q.pop(items[nr])) {
+    while (nr < batch_size && (items[nr] = q.pop())) {
         ++nr;
     }
     std::fill(std::begin(items) + nr, std::begin(items) + nr + prefetch_cnt, nr ? items[nr - 1] : wi);
@@ -0,0 +1,166 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#include <seastar/core/append_log.hh>
+#include <seastar/core/align.hh>
+#include <seastar/core/loop.hh>
+#include <seastar/core/metrics.hh>
+#include <seastar/core/seastar.hh>
+#include <algorithm>
+
+namespace seastar {
+
+append_log::append_log(file f, uint64_t size, temporary_buffer<char> tail, append_log_options opts)
+        : _file(std::move(f))
+        , _opts(std::move(opts))
+        , _alignment(_file.disk_write_dma_alignment())
+        , _size(size)
+        , _allocated(size)
+        , _tail(std::move(tail))
+{
+    if (!_opts.metrics_name.empty()) {
+        namespace sm = seastar::metrics;
+        auto l = sm::label_instance("log", _opts.metrics_name);
+        _metrics.add_group("append_log", {
+            sm::make_counter("appends", _stats.appends, sm::description("Total appends to the log"), {l}),
+            sm::make_counter("bytes", _stats.bytes, sm::description("Total bytes appended to the log"), {l}),
+            sm::make_counter("writes", _stats.writes,
+                    sm::description("Total writes of the log, each making a batch of appends durable; divide appends by it for the batching"), {l}),
+            sm::make_counter("preallocations", _stats.preallocations, sm::description("Total extensions of the space allocated for the log"), {l}),
+        });
+    }
+}
+
+future<uint64_t> append_log::append(std::string_view data) {
+    if (_failed) {
+        return make_exception_future<uint64_t>(_failed);
+    }
+    if (_writes.is_closed()) {
+        return make_exception_future<uint64_t>(gate_closed_exception());
+    }
+    auto offset = size();
+    if (!_queued_done) {
+        _queued_done = std::make_unique<shared_promise<>>();
+    }
+    _queued.emplace_back(data.data(), data.size());
+    _queued_bytes += data.size();
+    auto done = _queued_done->get_shared_future();
+    if (!_writing) {
+        _writing = true;
+        // Failures are reported to the appends
+        (void)with_gate(_writes, [this] {
+            return write_queued();
+        });
+    }
+    return done.then([offset] {
+        return offset;
+    });
+}
+
+future<> append_log::write_queued() {
+    return do_until([this] { return _queued.empty(); }, [this] {
+        return write_batch();
+    }).handle_exception([this] (std::exception_ptr ex) {
+        _failed = ex;
+    }).finally([this] {
+        _writing = false;
+    });
+}
+
+future<> append_log::preallocate(uint64_t end) {
+    if (end <= _allocated) {
+        return make_ready_future<>();
+    }
+    auto len = align_up(std::max(end - _allocated, _opts.preallocation_size), _alignment);
+    return _file.allocate(_allocated, len).then([this, len] {
+        _allocated += len;
+        _stats.preallocations++;
+    });
+}
+
+future<> append_log::write_batch() {
+    auto records = std::exchange(_queued, {});
+    auto bytes = std::exchange(_queued_bytes, 0);
+    auto done = std::exchange(_queued_done, nullptr);
+    if (_failed) {
+        done->set_exception(_failed);
+        return make_ready_future<>();
+    }
+    // Writes are aligned, so each starts with the unaligned end of the log
+    auto pos = _size - _tail.size();
+    auto len = _tail.size() + bytes;
+    auto padded = align_up(len, _alignment);
+    auto buf = temporary_buffer<char>::aligned(_file.memory_dma_alignment(), padded);
+    auto p = std::copy(_tail.begin(), _tail.end(), buf.get_write());
+    for (auto& r : records) {
+        p = std::copy(r.begin(), r.end(), p);
+    }
+    std::fill(p, buf.get_write() + padded, 0);
+    return preallocate(pos + padded).then([this, pos, data = buf.get(), padded] {
+        return _file.dma_write(pos, data, padded, _opts.priority);
+    }).then([padded] (size_t written) {
+        if (written != padded) {
+            throw std::system_error(EIO, std::system_category(), "short append_log write");
+        }
+    }).then_wrapped([this, buf = std::move(buf), bytes, len, nr = records.size(), done = std::move(done)] (future<> f) mutable {
+        if (f.failed()) {
+            _failed = f.get_exception();
+            done->set_exception(_failed);
+            return;
+        }
+        _size += bytes;
+        auto tail_len = len % _alignment;
+        _tail = buf.share(len - tail_len, tail_len);
+        _stats.appends += nr;
+        _stats.bytes += bytes;
+        _stats.writes++;
+        done->set_value();
+    });
+}
+
+future<> append_log::close() noexcept {
+    return _writes.close().then([this] {
+        return _allocated > _size ? _file.truncate(_size) : make_ready_future<>();
+    }).finally([this] {
+        return _file.close();
+    });
+}
+
+future<std::unique_ptr<append_log>> open_append_log(std::string_view name, append_log_options opts) noexcept {
+    return open_file_dma(name, open_flags::rw | open_flags::create | open_flags::dsync).then([opts = std::move(opts)] (file f) mutable {
+        return f.size().then([f, opts = std::move(opts)] (uint64_t size) mutable {
+            auto align = f.disk_write_dma_alignment();
+            auto tail_pos = align_down(size, align);
+            auto tail = tail_pos == size
+                    ? make_ready_future<temporary_buffer<char>>()
+                    : f.dma_read<char>(tail_pos, size - tail_pos, opts.priority);
+            return tail.then([f, size, opts = std::move(opts)] (temporary_buffer<char> tail) mutable {
+                return std::make_unique<append_log>(std::move(f), size, std::move(tail), std::move(opts));
+            });
+        }).handle_exception([f] (std::exception_ptr ex) mutable {
+            return f.close().then([ex = std::move(ex)] {
+                return make_exception_future<std::unique_ptr<append_log>>(std::move(ex));
+            });
+        });
+    });
+}
+
+}
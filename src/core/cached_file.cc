@@ -0,0 +1,374 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#include <boost/intrusive/list.hpp>
+#include <seastar/core/cached_file.hh>
+#include <seastar/core/layered_file.hh>
+#include <seastar/core/memory.hh>
+#include <seastar/core/when_all.hh>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+namespace seastar {
+
+namespace bi = boost::intrusive;
+
+namespace {
+
+struct page_key {
+    uint64_t file_id;
+    uint64_t index;
+
+    bool operator==(const page_key& o) const noexcept {
+        return file_id == o.file_id && index == o.index;
+    }
+};
+
+struct page_key_hash {
+    size_t operator()(const page_key& k) const noexcept {
+        return std::hash<uint64_t>()(k.index) ^ std::hash<uint64_t>()(k.file_id * 0x9e3779b97f4a7c15ull);
+    }
+};
+
+struct cached_page : public bi::list_base_hook<> {
+    page_key key;
+    // Shorter than the page size if the page is the last one of the file
+    temporary_buffer<uint8_t> data;
+    bool referenced = false;
+
+    cached_page(page_key k, temporary_buffer<uint8_t> d) noexcept : key(k), data(std::move(d)) {}
+};
+
+// Pages are evicted with the CLOCK algorithm: the hand is the front of
+// the list, referenced pages get a second chance by moving to its back
+class page_cache {
+    std::unordered_map<page_key, std::unique_ptr<cached_page>, page_key_hash> _pages;
+    bi::list<cached_page, bi::constant_time_size<false>> _clock;
+    size_t _limit;
+    page_cache_stats _stats;
+    memory::reclaimer _reclaimer;
+
+    size_t evict_one() noexcept {
+        while (true) {
+            auto& p = _clock.front();
+            if (p.referenced) {
+                p.referenced = false;
+                _clock.pop_front();
+                _clock.push_back(p);
+                continue;
+            }
+            auto size = p.data.size();
+            erase(p);
+            return size;
+        }
+    }
+
+    void erase(cached_page& p) noexcept {
+        _clock.erase(_clock.iterator_to(p));
+        _stats.bytes -= p.data.size();
+        _pages.erase(p.key);
+    }
+
+    memory::reclaiming_result reclaim(size_t bytes) noexcept {
+        size_t freed = 0;
+        while (freed < bytes && !_clock.empty()) {
+            freed += evict_one();
+            _stats.reclaimed++;
+        }
+        return freed ? memory::reclaiming_result::reclaimed_something : memory::reclaiming_result::reclaimed_nothing;
+    }
+
+public:
+    page_cache()
+        : _limit(memory::stats().total_memory() / 20)
+        , _reclaimer([this] (memory::reclaimer::request r) { return reclaim(r.bytes_to_reclaim); }, memory::reclaimer_scope::sync)
+    { }
+
+    page_cache_stats& stats() noexcept { return _stats; }
+
+    cached_page* find(page_key k) noexcept {
+        auto it = _pages.find(k);
+        if (it == _pages.end()) {
+            return nullptr;
+        }
+        it->second->referenced = true;
+        return it->second.get();
+    }
+
+    void insert(page_key k, temporary_buffer<uint8_t> data) {
+        auto [it, inserted] = _pages.try_emplace(k);
+        if (!inserted) {
+            // Raced with another read of the same page
+            _stats.bytes += data.size() - it->second->data.size();
+            it->second->data = std::move(data);
+        } else {
+            try {
+                it->second = std::make_unique<cached_page>(k, std::move(data));
+            } catch (...) {
+                _pages.erase(it);
+                throw;
+            }
+            _stats.bytes += it->second->data.size();
+            _clock.push_back(*it->second);
+        }
+        while (_stats.bytes > _limit && !_clock.empty()) {
+            evict_one();
+            _stats.evictions++;
+        }
+    }
+
+    // Drops pages [first, last] of the file
+    void invalidate(uint64_t file_id, uint64_t first, uint64_t last) noexcept {
+        if (last - first < _pages.size()) {
+            for (auto idx = first; idx <= last; idx++) {
+                auto it = _pages.find(page_key{file_id, idx});
+                if (it != _pages.end()) {
+                    erase(*it->second);
+                    _stats.invalidations++;
+                }
+            }
+            return;
+        }
+        for (auto it = _clock.begin(); it != _clock.end();) {
+            auto& p = *it++;
+            if (p.key.file_id == file_id && p.key.index >= first && p.key.index <= last) {
+                erase(p);
+                _stats.invalidations++;
+            }
+        }
+    }
+
+    void set_limit(size_t bytes) noexcept {
+        _limit = bytes;
+        while (_stats.bytes > _limit && !_clock.empty()) {
+            evict_one();
+            _stats.evictions++;
+        }
+    }
+};
+
+page_cache& local_page_cache() {
+    static thread_local page_cache cache;
+    return cache;
+}
+
+thread_local uint64_t next_cached_file_id = 0;
+
+}
+
+class cached_file_impl : public layered_file_impl {
+    const uint64_t _id;
+    const cached_file_options _options;
+    page_cache& _cache;
+    // Index of a cached page shorter than the page size, if any. It's
+    // where the file ended when read, and goes stale once the file grows
+    std::optional<uint64_t> _short_page;
+
+    static constexpr uint64_t all_pages = std::numeric_limits<uint64_t>::max();
+
+    void invalidate(uint64_t pos, uint64_t len) noexcept {
+        if (len) {
+            auto last = len == all_pages ? all_pages : (pos + len - 1) / _options.page_size;
+            _cache.invalidate(_id, pos / _options.page_size, last);
+        }
+        if (_short_page) {
+            _cache.invalidate(_id, *_short_page, *_short_page);
+            _short_page.reset();
+        }
+    }
+
+    // Reads pages [idx, idx + count + extra) of the file into the cache and the
+    // slots of the requested pages, the extra ones are read-ahead
+    future<> fill(uint64_t idx, uint64_t count, uint64_t extra, std::vector<temporary_buffer<uint8_t>>& slots, uint64_t first, const io_priority_class& pc) {
+        auto ps = _options.page_size;
+        return _underlying_file.dma_read_bulk<uint8_t>(idx * ps, (count + extra) * ps, pc).then([this, idx, count, &slots, first, ps] (temporary_buffer<uint8_t> buf) {
+            auto& stats = _cache.stats();
+            for (uint64_t i = 0; i * ps < buf.size(); i++) {
+                auto n = std::min<size_t>(ps, buf.size() - i * ps);
+                auto page = temporary_buffer<uint8_t>::aligned(_memory_dma_alignment, n);
+                std::memcpy(page.get_write(), buf.get() + i * ps, n);
+                if (i < count) {
+                    slots[idx + i - first] = page.share();
+                    stats.misses++;
+                } else {
+                    stats.read_ahead++;
+                }
+                if (n < ps) {
+                    _short_page = idx + i;
+                }
+                _cache.insert(page_key{_id, idx + i}, std::move(page));
+            }
+        });
+    }
+
+    future<temporary_buffer<uint8_t>> read(uint64_t pos, size_t len, const io_priority_class& pc) {
+        if (!len) {
+            return make_ready_future<temporary_buffer<uint8_t>>();
+        }
+        auto ps = _options.page_size;
+        auto first = pos / ps;
+        auto last = (pos + len - 1) / ps;
+        auto slots = std::make_unique<std::vector<temporary_buffer<uint8_t>>>(last - first + 1);
+        std::vector<future<>> fills;
+        auto idx = first;
+        while (idx <= last) {
+            if (auto p = _cache.find(page_key{_id, idx})) {
+                (*slots)[idx - first] = p->data.share();
+                _cache.stats().hits++;
+                idx++;
+                continue;
+            }
+            auto run = idx;
+            while (idx <= last && !_cache.find(page_key{_id, idx})) {
+                idx++;
+            }
+            auto extra = idx > last ? _options.read_ahead_pages : 0;
+            fills.push_back(fill(run, idx - run, extra, *slots, first, pc));
+        }
+        return when_all_succeed(fills.begin(), fills.end()).then([this, slots = std::move(slots), pos, len, first, ps] () {
+            // The pages up to the end of the file
+            size_t avail = 0;
+            for (auto& s : *slots) {
+                avail += s.size();
+                if (s.size() < ps) {
+                    break;
+                }
+            }
+            auto start = pos - first * ps;
+            if (avail <= start) {
+                return temporary_buffer<uint8_t>();
+            }
+            auto size = std::min(len, avail - start);
+            if (start + size <= (*slots)[0].size()) {
+                return (*slots)[0].share(start, size);
+            }
+            auto ret = temporary_buffer<uint8_t>::aligned(_memory_dma_alignment, align_up(size, size_t(_memory_dma_alignment)));
+            ret.trim(size);
+            size_t copied = 0;
+            for (auto& s : *slots) {
+                auto from = copied ? 0 : start;
+                auto n = std::min(s.size() - from, size - copied);
+                std::memcpy(ret.get_write() + copied, s.get() + from, n);
+                copied += n;
+                if (copied == size) {
+                    break;
+                }
+            }
+            return ret;
+        });
+    }
+
+public:
+    cached_file_impl(file f, cached_file_options options)
+        : layered_file_impl(std::move(f))
+        , _id(next_cached_file_id++)
+        , _options(options)
+        , _cache(local_page_cache())
+    {
+        if (!_options.page_size || _options.page_size % _disk_read_dma_alignment || _options.page_size % _memory_dma_alignment) {
+            throw std::invalid_argument("cached file page size must be a multiple of the file's DMA alignment");
+        }
+    }
+
+    virtual future<size_t> write_dma(uint64_t pos, const void* buffer, size_t len, const io_priority_class& pc) override {
+        invalidate(pos, len);
+        return get_file_impl(_underlying_file)->write_dma(pos, buffer, len, pc).finally([this, pos, len] {
+            invalidate(pos, len);
+        });
+    }
+    virtual future<size_t> write_dma(uint64_t pos, std::vector<iovec> iov, const io_priority_class& pc) override {
+        size_t len = 0;
+        for (auto& v : iov) {
+            len += v.iov_len;
+        }
+        invalidate(pos, len);
+        return get_file_impl(_underlying_file)->write_dma(pos, std::move(iov), pc).finally([this, pos, len] {
+            invalidate(pos, len);
+        });
+    }
+    virtual future<size_t> read_dma(uint64_t pos, void* buffer, size_t len, const io_priority_class& pc) override {
+        return read(pos, len, pc).then([buffer] (temporary_buffer<uint8_t> buf) {
+            std::memcpy(buffer, buf.get(), buf.size());
+            return buf.size();
+        });
+    }
+    virtual future<size_t> read_dma(uint64_t pos, std::vector<iovec> iov, const io_priority_class& pc) override {
+        size_t len = 0;
+        for (auto& v : iov) {
+            len += v.iov_len;
+        }
+        return read(pos, len, pc).then([iov = std::move(iov)] (temporary_buffer<uint8_t> buf) {
+            size_t copied = 0;
+            for (auto& v : iov) {
+                auto n = std::min(v.iov_len, buf.size() - copied);
+                std::memcpy(v.iov_base, buf.get() + copied, n);
+                copied += n;
+            }
+            return copied;
+        });
+    }
+    virtual future<temporary_buffer<uint8_t>> dma_read_bulk(uint64_t offset, size_t range_size, const io_priority_class& pc) override {
+        return read(offset, range_size, pc);
+    }
+    virtual future<> flush() override {
+        return _underlying_file.flush();
+    }
+    virtual future<struct stat> stat() override {
+        return _underlying_file.stat();
+    }
+    virtual future<> truncate(uint64_t length) override {
+        invalidate(length, all_pages);
+        return _underlying_file.truncate(length);
+    }
+    virtual future<> discard(uint64_t offset, uint64_t length) override {
+        invalidate(offset, length);
+        return _underlying_file.discard(offset, length);
+    }
+    virtual future<> allocate(uint64_t position, uint64_t length) override {
+        invalidate(position, 0);
+        return _underlying_file.allocate(position, length);
+    }
+    virtual future<uint64_t> size() override {
+        return _underlying_file.size();
+    }
+    virtual future<> close() override {
+        invalidate(0, all_pages);
+        return _underlying_file.close();
+    }
+    virtual subscription<directory_entry> list_directory(std::function<future<> (directory_entry de)> next) override {
+        return _underlying_file.list_directory(std::move(next));
+    }
+};
+
+file make_cached_file(file f, cached_file_options options) {
+    return file(make_shared<cached_file_impl>(std::move(f), options));
+}
+
+void set_page_cache_memory_limit(size_t bytes) {
+    local_page_cache().set_limit(bytes);
+}
+
+const page_cache_stats& get_page_cache_stats() noexcept {
+    return local_page_cache().stats();
+}
+
+}
@@ -23,6 +23,8 @@
 
 #include <string>
 #include <seastar/util/std-compat.hh>
+#include <chrono>
+#include <cstdint>
 #include <set>
 
 namespace seastar {
@@ -35,6 +37,29 @@ using cpuset = std::set<unsigned>;
 optional<cpuset> cpu_set();
 size_t memory_limit();
 
+// The CPU time the cgroup may use per period (cpu.max, or
+// cpu.cfs_quota_us and cpu.cfs_period_us in v1)
+struct cpu_quota {
+    std::chrono::microseconds quota;
+    std::chrono::microseconds period;
+
+    double cpus() const noexcept {
+        return double(quota.count()) / period.count();
+    }
+};
+
+// The tightest quota of the cgroup and its ancestors, if any
+optional<cpu_quota> cpu_limit();
+
+// How often the kernel stopped the cgroup for running out of its quota
+struct cpu_throttling {
+    uint64_t periods;
+    uint64_t throttled_periods;
+    std::chrono::microseconds throttled_time;
+};
+
+optional<cpu_throttling> cpu_throttling_stats();
+
 template <typename T>
 optional<T> read_setting_as(std::string path);
 
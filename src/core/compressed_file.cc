@@ -0,0 +1,412 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#include <seastar/core/compressed_file.hh>
+#include <seastar/core/align.hh>
+#include <seastar/core/byteorder.hh>
+#include <seastar/core/gate.hh>
+#include <seastar/core/layered_file.hh>
+#include <seastar/core/print.hh>
+#include <seastar/util/checksum.hh>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+#include <vector>
+#include <lz4.h>
+
+namespace seastar {
+
+namespace {
+
+// Layout of the underlying file, all integers little endian:
+//
+// - the header, padded to the write alignment: the magic, the block size
+//   (u32), the number of blocks (u64), the size of the data (u64), the
+//   offset of the index (u64) and the CRC32C of all of those (u32)
+// - the blocks, one after the other: the length of the payload (u32, with
+//   stored_flag set if the block is stored uncompressed), the CRC32C of
+//   the payload (u32) and the payload
+// - the index: the offsets of the blocks and of the end of the last one
+//   (u64 each), and their CRC32C (u32)
+constexpr char magic[8] = {'S', 'C', 'M', 'P', 'F', 'I', 'L', '1'};
+constexpr size_t header_size = sizeof(magic) + 4 + 8 + 8 + 8 + 4;
+constexpr size_t block_header_size = 8;
+constexpr uint32_t stored_flag = uint32_t(1) << 31;
+
+// Compressed blocks are written once this much of them is pending
+constexpr size_t write_batch_size = 128 << 10;
+
+[[noreturn]] void throw_corrupt(const char* what) {
+    throw std::runtime_error(format("compressed file is corrupt: {}", what));
+}
+
+template <typename... T>
+future<T...> not_writable() {
+    return make_exception_future<T...>(std::system_error(EBADF, std::system_category(), "compressed file is read-only"));
+}
+
+}
+
+class compressed_file_impl : public layered_file_impl {
+    const uint32_t _block_size;
+    const bool _writing;
+    // Size of the data
+    uint64_t _size;
+    // Offsets of the blocks in the underlying file, and, once they are all
+    // known, of the end of the last one
+    std::vector<uint64_t> _index;
+
+    // When writing: the data past the last compressed block, kept until a
+    // block and a write alignment more are written, so that truncation can
+    // cut back the padding of the last write
+    std::vector<char> _pending;
+    // Compressed blocks not written yet, from _out_pos, which is aligned
+    std::vector<char> _out;
+    uint64_t _out_pos;
+    const io_priority_class* _pc = &default_priority_class();
+    std::exception_ptr _failed;
+    gate _writes;
+
+    void compress_block(const char* data, size_t len) {
+        _index.push_back(_out_pos + _out.size());
+        auto start = _out.size();
+        auto bound = LZ4_compressBound(len);
+        _out.resize(start + block_header_size + bound);
+        auto payload = _out.data() + start + block_header_size;
+#ifdef SEASTAR_HAVE_LZ4_COMPRESS_DEFAULT
+        auto clen = LZ4_compress_default(data, payload, len, bound);
+#else
+        auto clen = LZ4_compress(data, payload, len);
+#endif
+        uint32_t header = clen;
+        if (clen <= 0 || size_t(clen) >= len) {
+            std::memcpy(payload, data, len);
+            clen = len;
+            header = len | stored_flag;
+        }
+        write_le<uint32_t>(_out.data() + start, header);
+        write_le<uint32_t>(_out.data() + start + 4, crc32c::of(payload, clen));
+        _out.resize(start + block_header_size + clen);
+    }
+
+    // Compresses the full blocks pending which are followed by a write
+    // alignment, or, if \c all, all of the data pending
+    void compress_pending(bool all) {
+        size_t done = 0;
+        while (all ? done < _pending.size() : _pending.size() - done >= _block_size + _disk_write_dma_alignment) {
+            auto n = std::min<size_t>(_block_size, _pending.size() - done);
+            compress_block(_pending.data() + done, n);
+            done += n;
+        }
+        _pending.erase(_pending.begin(), _pending.begin() + done);
+    }
+
+    // Writes the compressed blocks pending, up to the last aligned offset
+    // unless \c all, padded then
+    future<> write_out(bool all) {
+        auto align = _disk_write_dma_alignment;
+        auto n = all ? align_up<size_t>(_out.size(), align) : align_down<size_t>(_out.size(), align);
+        if (!n || (!all && _out.size() < write_batch_size)) {
+            return make_ready_future<>();
+        }
+        auto buf = temporary_buffer<char>::aligned(_memory_dma_alignment, n);
+        auto copied = std::min(n, _out.size());
+        std::memcpy(buf.get_write(), _out.data(), copied);
+        std::memset(buf.get_write() + copied, 0, n - copied);
+        _out.erase(_out.begin(), _out.begin() + copied);
+        auto pos = std::exchange(_out_pos, _out_pos + n);
+        return with_gate(_writes, [this, pos, buf = std::move(buf)] () mutable {
+            return _underlying_file.dma_write(pos, buf.get(), buf.size(), *_pc).then([size = buf.size()] (size_t written) {
+                if (written != size) {
+                    throw std::system_error(EIO, std::system_category(), "short write of compressed file");
+                }
+            }).finally([buf = std::move(buf)] {});
+        }).handle_exception([this] (std::exception_ptr ex) {
+            _failed = ex;
+            return make_exception_future<>(std::move(ex));
+        });
+    }
+
+    future<> finish() {
+        if (_failed) {
+            return make_exception_future<>(_failed);
+        }
+        compress_pending(true);
+        auto index_pos = _out_pos + _out.size();
+        _index.push_back(index_pos);
+        auto start = _out.size();
+        _out.resize(start + _index.size() * 8 + 4);
+        auto p = _out.data() + start;
+        for (auto off : _index) {
+            write_le<uint64_t>(p, off);
+            p += 8;
+        }
+        write_le<uint32_t>(p, crc32c::of(_out.data() + start, _index.size() * 8));
+        auto nr_blocks = _index.size() - 1;
+        return write_out(true).then([this] {
+            return _writes.close();
+        }).then([this, nr_blocks, index_pos] {
+            if (_failed) {
+                return make_exception_future<>(_failed);
+            }
+            auto hdr = temporary_buffer<char>::aligned(_memory_dma_alignment, _disk_write_dma_alignment);
+            std::memset(hdr.get_write(), 0, hdr.size());
+            auto p = hdr.get_write();
+            std::memcpy(p, magic, sizeof(magic));
+            write_le<uint32_t>(p + 8, _block_size);
+            write_le<uint64_t>(p + 12, nr_blocks);
+            write_le<uint64_t>(p + 20, _size);
+            write_le<uint64_t>(p + 28, index_pos);
+            write_le<uint32_t>(p + 36, crc32c::of(p, header_size - 4));
+            auto f = _underlying_file.dma_write(0, hdr.get(), hdr.size(), *_pc);
+            return f.then([hdr = std::move(hdr)] (size_t written) {
+                if (written != hdr.size()) {
+                    throw std::system_error(EIO, std::system_category(), "short write of compressed file");
+                }
+            }).then([this] {
+                return _underlying_file.flush();
+            });
+        });
+    }
+
+    future<temporary_buffer<uint8_t>> read(uint64_t pos, size_t len, const io_priority_class& pc) {
+        if (_writing) {
+            return make_exception_future<temporary_buffer<uint8_t>>(std::system_error(EBADF, std::system_category(), "compressed file is not readable until closed"));
+        }
+        if (pos >= _size || !len) {
+            return make_ready_future<temporary_buffer<uint8_t>>();
+        }
+        len = std::min<uint64_t>(len, _size - pos);
+        auto first = pos / _block_size;
+        auto last = (pos + len - 1) / _block_size;
+        auto from = _index[first];
+        auto n = _index[last + 1] - from;
+        return _underlying_file.dma_read<char>(from, n, pc).then([this, pos, len, first, last, from, n] (temporary_buffer<char> buf) {
+            if (buf.size() != n) {
+                throw_corrupt("blocks past the end of the file");
+            }
+            auto ret = temporary_buffer<uint8_t>::aligned(_memory_dma_alignment, align_up(len, size_t(_memory_dma_alignment)));
+            ret.trim(len);
+            std::unique_ptr<char[]> scratch;
+            for (auto b = first; b <= last; b++) {
+                auto rec = buf.get() + (_index[b] - from);
+                auto header = read_le<uint32_t>(rec);
+                auto plen = header & ~stored_flag;
+                if (block_header_size + plen != _index[b + 1] - _index[b]) {
+                    throw_corrupt("block length does not match the index");
+                }
+                auto payload = rec + block_header_size;
+                if (crc32c::of(payload, plen) != read_le<uint32_t>(rec + 4)) {
+                    throw_corrupt("block checksum mismatch");
+                }
+                auto block_pos = b * _block_size;
+                auto block_len = std::min<uint64_t>(_block_size, _size - block_pos);
+                auto copy_from = std::max(pos, block_pos);
+                auto copy_to = std::min(pos + len, block_pos + block_len);
+                auto dst = reinterpret_cast<char*>(ret.get_write()) + (copy_from - pos);
+                if (header & stored_flag) {
+                    if (plen != block_len) {
+                        throw_corrupt("stored block length");
+                    }
+                    std::memcpy(dst, payload + (copy_from - block_pos), copy_to - copy_from);
+                    continue;
+                }
+                // Decompress straight into the result if it holds all of the block
+                char* out = dst;
+                if (copy_from != block_pos || copy_to != block_pos + block_len) {
+                    if (!scratch) {
+                        scratch = std::make_unique<char[]>(_block_size);
+                    }
+                    out = scratch.get();
+                }
+                if (LZ4_decompress_safe(payload, out, plen, block_len) != int(block_len)) {
+                    throw_corrupt("block does not decompress");
+                }
+                if (out != dst) {
+                    std::memcpy(dst, out + (copy_from - block_pos), copy_to - copy_from);
+                }
+            }
+            return ret;
+        });
+    }
+public:
+    // Written
+    compressed_file_impl(file f, uint32_t block_size)
+        : layered_file_impl(std::move(f))
+        , _block_size(block_size)
+        , _writing(true)
+        , _size(0)
+        , _out_pos(_disk_write_dma_alignment)
+    { }
+    // Read
+    compressed_file_impl(file f, uint32_t block_size, uint64_t size, std::vector<uint64_t> index)
+        : layered_file_impl(std::move(f))
+        , _block_size(block_size)
+        , _writing(false)
+        , _size(size)
+        , _index(std::move(index))
+        , _out_pos(0)
+    { }
+
+    static future<shared_ptr<compressed_file_impl>> load(file f) {
+        return f.dma_read_exactly<char>(0, header_size).then([f] (temporary_buffer<char> hdr) mutable {
+            auto p = hdr.get();
+            if (std::memcmp(p, magic, sizeof(magic))) {
+                throw_corrupt("bad magic");
+            }
+            if (crc32c::of(p, header_size - 4) != read_le<uint32_t>(p + 36)) {
+                throw_corrupt("header checksum mismatch");
+            }
+            auto block_size = read_le<uint32_t>(p + 8);
+            auto nr_blocks = read_le<uint64_t>(p + 12);
+            auto size = read_le<uint64_t>(p + 20);
+            auto index_pos = read_le<uint64_t>(p + 28);
+            if (!block_size || block_size >= stored_flag || nr_blocks != (size + block_size - 1) / block_size) {
+                throw_corrupt("bad header");
+            }
+            return f.dma_read_exactly<char>(index_pos, (nr_blocks + 1) * 8 + 4).then([f, block_size, size, nr_blocks] (temporary_buffer<char> buf) mutable {
+                auto index_len = (nr_blocks + 1) * 8;
+                if (crc32c::of(buf.get(), index_len) != read_le<uint32_t>(buf.get() + index_len)) {
+                    throw_corrupt("index checksum mismatch");
+                }
+                std::vector<uint64_t> index(nr_blocks + 1);
+                for (uint64_t i = 0; i <= nr_blocks; i++) {
+                    index[i] = read_le<uint64_t>(buf.get() + i * 8);
+                    if (i && index[i] < index[i - 1] + block_header_size) {
+                        throw_corrupt("bad index");
+                    }
+                }
+                return seastar::make_shared<compressed_file_impl>(std::move(f), block_size, size, std::move(index));
+            });
+        });
+    }
+
+    virtual future<size_t> write_dma(uint64_t pos, const void* buffer, size_t len, const io_priority_class& pc) override {
+        if (!_writing) {
+            return not_writable<size_t>();
+        }
+        if (_failed) {
+            return make_exception_future<size_t>(_failed);
+        }
+        if (pos != _size) {
+            return make_exception_future<size_t>(std::invalid_argument(format("compressed file written at {}, not at its end {}", pos, _size)));
+        }
+        _pc = &pc;
+        auto p = static_cast<const char*>(buffer);
+        _pending.insert(_pending.end(), p, p + len);
+        _size += len;
+        compress_pending(false);
+        return write_out(false).then([len] {
+            return len;
+        });
+    }
+    virtual future<size_t> write_dma(uint64_t pos, std::vector<iovec> iov, const io_priority_class& pc) override {
+        std::vector<char> data;
+        for (auto& v : iov) {
+            auto p = static_cast<const char*>(v.iov_base);
+            data.insert(data.end(), p, p + v.iov_len);
+        }
+        return write_dma(pos, data.data(), data.size(), pc);
+    }
+    virtual future<size_t> read_dma(uint64_t pos, void* buffer, size_t len, const io_priority_class& pc) override {
+        return read(pos, len, pc).then([buffer] (temporary_buffer<uint8_t> buf) {
+            std::memcpy(buffer, buf.get(), buf.size());
+            return buf.size();
+        });
+    }
+    virtual future<size_t> read_dma(uint64_t pos, std::vector<iovec> iov, const io_priority_class& pc) override {
+        size_t len = 0;
+        for (auto& v : iov) {
+            len += v.iov_len;
+        }
+        return read(pos, len, pc).then([iov = std::move(iov)] (temporary_buffer<uint8_t> buf) {
+            size_t copied = 0;
+            for (auto& v : iov) {
+                auto n = std::min(v.iov_len, buf.size() - copied);
+                std::memcpy(v.iov_base, buf.get() + copied, n);
+                copied += n;
+            }
+            return copied;
+        });
+    }
+    virtual future<temporary_buffer<uint8_t>> dma_read_bulk(uint64_t offset, size_t range_size, const io_priority_class& pc) override {
+        return read(offset, range_size, pc);
+    }
+    virtual future<> flush() override {
+        // The data is complete once closed; this only flushes the blocks
+        // written so far
+        return _underlying_file.flush();
+    }
+    virtual future<struct stat> stat() override {
+        return _underlying_file.stat().then([this] (struct stat st) {
+            st.st_size = _size;
+            return st;
+        });
+    }
+    virtual future<> truncate(uint64_t length) override {
+        if (!_writing) {
+            return not_writable<>();
+        }
+        if (length > _size || _size - length > _pending.size()) {
+            return make_exception_future<>(std::invalid_argument(format("compressed file of size {} cannot be truncated to {}", _size, length)));
+        }
+        _pending.resize(_pending.size() - (_size - length));
+        _size = length;
+        return make_ready_future<>();
+    }
+    virtual future<> discard(uint64_t offset, uint64_t length) override {
+        return make_exception_future<>(std::system_error(EOPNOTSUPP, std::system_category(), "discard of a compressed file"));
+    }
+    virtual future<> allocate(uint64_t position, uint64_t length) override {
+        // The compressed size is not known in advance
+        return make_ready_future<>();
+    }
+    virtual future<uint64_t> size() override {
+        return make_ready_future<uint64_t>(_size);
+    }
+    virtual future<> close() override {
+        auto done = _writing ? finish() : make_ready_future<>();
+        return done.then_wrapped([this] (future<> f) {
+            return _underlying_file.close().then([f = std::move(f)] () mutable {
+                return std::move(f);
+            });
+        });
+    }
+    virtual subscription<directory_entry> list_directory(std::function<future<> (directory_entry de)> next) override {
+        return _underlying_file.list_directory(std::move(next));
+    }
+};
+
+future<file> make_compressed_file(file f, compressed_file_options options) {
+    if (!options.block_size || options.block_size >= stored_flag) {
+        return make_exception_future<file>(std::invalid_argument(format("bad compressed file block size {}", options.block_size)));
+    }
+    return f.size().then([f, options] (uint64_t size) mutable {
+        if (!size) {
+            return make_ready_future<file>(file(seastar::make_shared<compressed_file_impl>(std::move(f), options.block_size)));
+        }
+        return compressed_file_impl::load(std::move(f)).then([] (shared_ptr<compressed_file_impl> impl) {
+            return file(std::move(impl));
+        });
+    });
+}
+
+}
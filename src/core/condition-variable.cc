@@ -20,6 +20,7 @@
  */
 
 #include <seastar/core/condition-variable.hh>
+#include <seastar/core/internal/wakeup_batch.hh>
 
 namespace seastar {
 
@@ -31,8 +32,42 @@ const char* condition_variable_timed_out::what() const noexcept {
     return "Condition variable timed out";
 }
 
+// Wakes the rest of the waiters of a broadcast() once the ones before
+// them had their turn
+class condition_variable::wake_task final : public task {
+public:
+    condition_variable* _cv;
+
+    explicit wake_task(condition_variable* cv) noexcept : _cv(cv) {}
+    void run_and_dispose() noexcept override {
+        if (_cv) {
+            _cv->_wake_task = nullptr;
+            _cv->wake_pending(true);
+        }
+        delete this;
+    }
+    task* waiting_task() noexcept override {
+        return nullptr;
+    }
+};
+
+condition_variable::condition_variable(condition_variable&& rhs) noexcept
+    : _waiters(std::move(rhs._waiters))
+    , _pending(std::move(rhs._pending))
+    , _ex(std::move(rhs._ex))
+    , _signalled(rhs._signalled)
+    , _wake_task(std::exchange(rhs._wake_task, nullptr))
+{
+    if (_wake_task) {
+        _wake_task->_cv = this;
+    }
+}
+
 condition_variable::~condition_variable() {
     broken();
+    if (_wake_task) {
+        _wake_task->_cv = nullptr;
+    }
 }
 
 void condition_variable::add_waiter(waiter& w) noexcept {
@@ -73,18 +108,30 @@ void condition_variable::signal() noexcept {
     }
 }
 
+void condition_variable::wake_pending(bool batched) noexcept {
+    unsigned n = 0;
+    for (; !_pending.empty() && (!batched || internal::continue_wakeups(n)); ++n) {
+        auto& w = _pending.front();
+        _pending.pop_front();
+        w.signal();
+    }
+    internal::get_wakeup_stats().waiters += n;
+    if (!_pending.empty() && !_wake_task) {
+        internal::get_wakeup_stats().deferred_batches++;
+        memory::scoped_critical_alloc_section _;
+        _wake_task = new wake_task(this);
+        schedule(_wake_task);
+    }
+}
+
 /// Notify variable and wake up all waiter
 void condition_variable::broadcast() noexcept {
-    auto tmp(std::move(_waiters));
-    while (!tmp.empty()) {
-        auto& w = tmp.front();
-        tmp.pop_front();
-        if (_ex) {
-            w.set_exception(_ex);
-        } else {
-            w.signal();
-        }
+    if (_waiters.empty()) {
+        return;
     }
+    internal::get_wakeup_stats().wakeups++;
+    _pending.splice(_pending.end(), _waiters);
+    wake_pending(true);
 }
 
 /// Signal to waiters that an error occurred.  \ref wait() will see
@@ -95,8 +142,11 @@ void condition_variable::broken() noexcept {
 }
 
 void condition_variable::broken(std::exception_ptr ep) noexcept {
+    // Waiters of an earlier broadcast() were notified before the error
+    wake_pending(false);
     _ex = ep;
-    broadcast();
+    while (wakeup_first()) {
+    }
 }
 
 } // namespace seastar
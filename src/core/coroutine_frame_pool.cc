@@ -0,0 +1,116 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#include <seastar/core/internal/coroutine_frame_pool.hh>
+#include <new>
+
+namespace seastar {
+
+namespace internal {
+
+namespace {
+
+struct free_frame {
+    free_frame* next;
+};
+
+struct frame_pool_shard {
+    std::array<free_frame*, coroutine_frame_pool::size_classes> free_lists{};
+    std::array<unsigned, coroutine_frame_pool::size_classes> free_counts{};
+    coroutine_frame_pool::stats stats;
+#ifdef SEASTAR_DEBUG
+    bool enabled = false;
+#else
+    bool enabled = true;
+#endif
+
+    void drain() noexcept {
+        for (size_t i = 0; i < coroutine_frame_pool::size_classes; i++) {
+            while (auto f = free_lists[i]) {
+                free_lists[i] = f->next;
+                ::operator delete(f, (i + 1) * coroutine_frame_pool::size_class_bytes);
+            }
+            free_counts[i] = 0;
+        }
+        stats.pooled_bytes = 0;
+    }
+
+    ~frame_pool_shard() {
+        drain();
+    }
+};
+
+thread_local frame_pool_shard frame_pool;
+
+}
+
+void* coroutine_frame_pool::allocate(size_t size) {
+    auto& pool = frame_pool;
+    if (size > max_pooled_size) {
+        ++pool.stats.allocations[size_classes];
+        return ::operator new(size);
+    }
+    size_t i = (size - 1) / size_class_bytes;
+    ++pool.stats.allocations[i];
+    if (auto f = pool.free_lists[i]) {
+        pool.free_lists[i] = f->next;
+        --pool.free_counts[i];
+        ++pool.stats.reuses[i];
+        pool.stats.pooled_bytes -= (i + 1) * size_class_bytes;
+        return f;
+    }
+    return ::operator new((i + 1) * size_class_bytes);
+}
+
+void coroutine_frame_pool::free(void* ptr, size_t size) noexcept {
+    if (size > max_pooled_size) {
+        ::operator delete(ptr, size);
+        return;
+    }
+    auto& pool = frame_pool;
+    size_t i = (size - 1) / size_class_bytes;
+    if (!pool.enabled || pool.free_counts[i] == max_pooled_frames) {
+        ::operator delete(ptr, (i + 1) * size_class_bytes);
+        return;
+    }
+    auto f = static_cast<free_frame*>(ptr);
+    f->next = pool.free_lists[i];
+    pool.free_lists[i] = f;
+    ++pool.free_counts[i];
+    pool.stats.pooled_bytes += (i + 1) * size_class_bytes;
+}
+
+void coroutine_frame_pool::set_enabled(bool enabled) noexcept {
+#ifndef SEASTAR_DEBUG
+    frame_pool.enabled = enabled;
+    if (!enabled) {
+        frame_pool.drain();
+    }
+#endif
+}
+
+const coroutine_frame_pool::stats& coroutine_frame_pool::get_stats() noexcept {
+    return frame_pool.stats;
+}
+
+}
+
+}
@@ -0,0 +1,278 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#include <seastar/core/cpu_profiler.hh>
+#include <seastar/core/reactor.hh>
+#include <seastar/core/smp.hh>
+#include <seastar/http/httpd.hh>
+#include <seastar/http/function_handlers.hh>
+#include <seastar/http/exception.hh>
+#include <seastar/util/backtrace.hh>
+#include <seastar/util/log.hh>
+#include "core/cpu_profiler.hh"
+#include "core/uname.hh"
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <fstream>
+#include <sstream>
+
+namespace seastar {
+
+namespace internal {
+
+static thread_local cpu_profiler* local_cpu_profiler = nullptr;
+
+static void cpu_profiler_signal_handler(int, siginfo_t*, void* ucontext) {
+    if (auto p = local_cpu_profiler) {
+        p->on_signal(interrupted_pc(ucontext));
+    }
+}
+
+cpu_profiler::cpu_profiler(std::chrono::nanoseconds period)
+        : _period(period) {
+}
+
+cpu_profiler::~cpu_profiler() {
+    stop();
+    local_cpu_profiler = nullptr;
+}
+
+static std::optional<file_desc> make_perf_event_sampler(std::chrono::nanoseconds period, int signo) {
+    // Signals on overflow need no ring buffer, nor any sample to be written.
+    ::perf_event_attr pea = {
+        .type = PERF_TYPE_SOFTWARE,
+        .size = sizeof(pea),
+        .config = PERF_COUNT_SW_TASK_CLOCK, // more likely to work on virtual machines than hardware events
+        .sample_period = uint64_t(period.count()),
+        .disabled = 1,
+    };
+    unsigned long flags = 0;
+    if (kernel_uname().whitelisted({"3.14"})) {
+        flags |= PERF_FLAG_FD_CLOEXEC;
+    }
+    int fd = syscall(__NR_perf_event_open, &pea, 0, -1, -1, flags);
+    if (fd == -1) {
+        return std::nullopt;
+    }
+    auto desc = file_desc::from_fd(fd);
+    struct f_owner_ex sig_owner = {
+        .type = F_OWNER_TID,
+        .pid = static_cast<pid_t>(syscall(SYS_gettid)),
+    };
+    if (::fcntl(fd, F_SETOWN_EX, &sig_owner) == -1
+            || ::fcntl(fd, F_SETSIG, signo) == -1
+            || ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_ASYNC) == -1) {
+        return std::nullopt;
+    }
+    return desc;
+}
+
+void cpu_profiler::start() {
+    if (_perf_event || _timer) {
+        return;
+    }
+    struct sigaction sa = {};
+    sa.sa_sigaction = &cpu_profiler_signal_handler;
+    sa.sa_flags = SA_SIGINFO | SA_RESTART;
+    auto r = ::sigaction(signal_number(), &sa, nullptr);
+    throw_system_error_on(r == -1, "sigaction");
+    auto mask = make_sigset_mask(signal_number());
+    r = ::pthread_sigmask(SIG_UNBLOCK, &mask, nullptr);
+    throw_pthread_error(r);
+    local_cpu_profiler = this;
+    std::atomic_signal_fence(std::memory_order_release);
+
+    _perf_event = make_perf_event_sampler(_period, signal_number());
+    if (_perf_event) {
+        _perf_event->ioctl(PERF_EVENT_IOC_ENABLE, 0);
+        return;
+    }
+    seastar_logger.warn("Creation of perf_event based CPU profiler failed, falling back to posix timer");
+    struct sigevent sev = {};
+    sev.sigev_notify = SIGEV_THREAD_ID;
+    sev.sigev_signo = signal_number();
+    sev._sigev_un._tid = syscall(SYS_gettid);
+    timer_t timer;
+    r = timer_create(CLOCK_THREAD_CPUTIME_ID, &sev, &timer);
+    throw_system_error_on(r == -1, "timer_create");
+    _timer = timer;
+    auto its = posix::to_relative_itimerspec(_period, _period);
+    timer_settime(timer, 0, &its, nullptr);
+}
+
+void cpu_profiler::stop() noexcept {
+    if (_perf_event) {
+        _perf_event->ioctl(PERF_EVENT_IOC_DISABLE, 0);
+        _perf_event.reset();
+    }
+    if (_timer) {
+        timer_delete(*_timer);
+        _timer.reset();
+    }
+}
+
+void cpu_profiler::on_signal(const void* pc) noexcept {
+    // A signal may still be pending after stop()
+    if (!_perf_event && !_timer) {
+        return;
+    }
+    auto& r = engine();
+    auto sg = scheduling_group_index(*current_scheduling_group_ptr());
+    _samples.record_backtrace(pc, sg, r._current_task ? r._current_task_type : nullptr);
+}
+
+cpu_profile cpu_profiler::get_profile(bool reset) {
+    cpu_profile ret;
+    ret.shard = this_shard_id();
+    ret.period = _period;
+    auto& r = engine();
+    _samples.consume(reset, [&] (const sampled_stacks::entry& e) {
+        cpu_profile_stack stack;
+        stack.addresses.assign(e.frames, e.frames + e.nr_frames);
+        // The group may have been destroyed since
+        stack.scheduling_group = r._task_queues[e.sg] ? r._task_queues[e.sg]->_name : sstring("unknown");
+        stack.task_type = e.task_type;
+        stack.samples = e.count;
+        ret.stacks.push_back(std::move(stack));
+    }, [&ret] (uint64_t dropped) {
+        ret.dropped_samples = dropped;
+    });
+    return ret;
+}
+
+}
+
+future<> start_cpu_profiler(std::chrono::nanoseconds period) {
+    return smp::invoke_on_all([period] {
+        engine().start_cpu_profiler(period);
+    });
+}
+
+future<> stop_cpu_profiler() {
+    return smp::invoke_on_all([] {
+        engine().stop_cpu_profiler();
+    });
+}
+
+future<std::vector<cpu_profile>> get_cpu_profiles(bool reset) {
+    return do_with(std::vector<cpu_profile>(smp::count), [reset] (std::vector<cpu_profile>& profiles) {
+        return smp::invoke_on_all([&profiles, reset] {
+            // Each shard writes its own element
+            profiles[this_shard_id()] = engine().get_cpu_profile(reset);
+        }).then([&profiles] {
+            return std::move(profiles);
+        });
+    });
+}
+
+void write_folded(std::ostream& os, const cpu_profile& profile) {
+    for (auto& stack : profile.stacks) {
+        os << "shard " << profile.shard << ";sg:" << stack.scheduling_group << ";task:";
+        if (stack.task_type) {
+            os << pretty_type_name(*stack.task_type);
+        } else {
+            os << "none";
+        }
+        for (auto a = stack.addresses.rbegin(); a != stack.addresses.rend(); ++a) {
+            os << ';' << decorate(*a - 1);
+        }
+        os << ' ' << stack.samples << '\n';
+    }
+}
+
+void write_pprof(std::ostream& os, const std::vector<cpu_profile>& profiles) {
+    auto write_word = [&os] (uintptr_t w) {
+        os.write(reinterpret_cast<const char*>(&w), sizeof(w));
+    };
+    std::chrono::microseconds period(1);
+    if (!profiles.empty()) {
+        period = std::max(period, std::chrono::duration_cast<std::chrono::microseconds>(profiles.front().period));
+    }
+    // Header: header words, version, sampling period, padding
+    for (uintptr_t w : {uintptr_t(0), uintptr_t(3), uintptr_t(0), uintptr_t(period.count()), uintptr_t(0)}) {
+        write_word(w);
+    }
+    for (auto& profile : profiles) {
+        for (auto& stack : profile.stacks) {
+            write_word(stack.samples);
+            write_word(stack.addresses.size());
+            for (auto a : stack.addresses) {
+                write_word(a);
+            }
+        }
+    }
+    // Trailer, then the mappings with which pprof finds the symbols
+    for (uintptr_t w : {uintptr_t(0), uintptr_t(1), uintptr_t(0)}) {
+        write_word(w);
+    }
+    std::ifstream maps("/proc/self/maps");
+    os << maps.rdbuf();
+}
+
+future<> add_cpu_profiler_routes(httpd::http_server& server, sstring prefix) {
+    using namespace httpd;
+    server._routes.put(POST, prefix + "/start", new function_handler([] (std::unique_ptr<request> req, std::unique_ptr<reply> rep) {
+        std::chrono::nanoseconds period = std::chrono::milliseconds(10);
+        auto period_us = req->get_query_param("period_us");
+        if (!period_us.empty()) {
+            try {
+                period = std::chrono::microseconds(std::stoul(period_us));
+            } catch (...) {
+                throw bad_param_exception("period_us must be a number of microseconds");
+            }
+            if (period <= std::chrono::nanoseconds(0)) {
+                throw bad_param_exception("period_us must be positive");
+            }
+        }
+        return start_cpu_profiler(period).then([rep = std::move(rep)] () mutable {
+            return std::move(rep);
+        });
+    }, "txt"));
+    server._routes.put(POST, prefix + "/stop", new function_handler([] (std::unique_ptr<request> req, std::unique_ptr<reply> rep) {
+        return stop_cpu_profiler().then([rep = std::move(rep)] () mutable {
+            return std::move(rep);
+        });
+    }, "txt"));
+    server._routes.put(GET, prefix + "/folded", new function_handler([] (std::unique_ptr<request> req, std::unique_ptr<reply> rep) {
+        return get_cpu_profiles(req->get_query_param("reset") == "true").then([rep = std::move(rep)] (std::vector<cpu_profile> profiles) mutable {
+            std::ostringstream os;
+            for (auto& profile : profiles) {
+                write_folded(os, profile);
+            }
+            rep->write_body("txt", sstring(os.str()));
+            return std::move(rep);
+        });
+    }, "txt"));
+    server._routes.put(GET, prefix + "/pprof", new function_handler([] (std::unique_ptr<request> req, std::unique_ptr<reply> rep) {
+        return get_cpu_profiles(req->get_query_param("reset") == "true").then([rep = std::move(rep)] (std::vector<cpu_profile> profiles) mutable {
+            std::ostringstream os;
+            write_pprof(os, profiles);
+            rep->write_body("bin", sstring(os.str()));
+            return std::move(rep);
+        });
+    }, "bin"));
+    return make_ready_future<>();
+}
+
+}
@@ -0,0 +1,58 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#pragma once
+
+#include <seastar/core/posix.hh>
+#include <chrono>
+#include <optional>
+#include <signal.h>
+#include <time.h>
+#include "sampled_stacks.hh"
+
+namespace seastar {
+
+struct cpu_profile;
+
+namespace internal {
+
+// The CPU profiler of a shard. It lives on the reactor thread, which gets
+// its signal on every period of CPU time.
+class cpu_profiler {
+    std::chrono::nanoseconds _period;
+    std::optional<file_desc> _perf_event;
+    std::optional<timer_t> _timer;
+    sampled_stacks _samples{4096};
+public:
+    static int signal_number() { return SIGRTMIN + 2; }
+    explicit cpu_profiler(std::chrono::nanoseconds period);
+    ~cpu_profiler();
+    std::chrono::nanoseconds period() const noexcept { return _period; }
+    // Starts sampling, with a perf_event task clock if possible
+    void start();
+    void stop() noexcept;
+    void on_signal(const void* pc) noexcept;
+    cpu_profile get_profile(bool reset);
+};
+
+}
+
+}
@@ -22,7 +22,10 @@
 #include <seastar/core/execution_stage.hh>
 #include <seastar/core/print.hh>
 #include <seastar/core/make_task.hh>
+#include <seastar/core/bitops.hh>
 #include <seastar/util/defer.hh>
+#include <algorithm>
+#include <limits>
 
 namespace seastar {
 
@@ -129,6 +132,37 @@ execution_stage::execution_stage(const sstring& name, scheduling_group sg)
                                   [name, &esm = internal::execution_stage_manager::get()] {
                                       return esm.get_stage(name)->get_stats().function_calls_executed;
                                   }),
+             metrics::make_counter("cpu_time_us",
+                                  metrics::description("Total time spent executing function calls queued in execution stages"),
+                                  { metrics::label_instance("execution_stage", name), },
+                                  [name, &esm = internal::execution_stage_manager::get()] {
+                                      auto t = esm.get_stage(name)->get_stats().cpu_time;
+                                      return std::chrono::duration_cast<std::chrono::microseconds>(t).count();
+                                  }),
+             metrics::make_gauge("queue_length_limit",
+                                  metrics::description("Queue length at which execution stages execute calls in the caller"),
+                                  { metrics::label_instance("execution_stage", name), },
+                                  [name, &esm = internal::execution_stage_manager::get()] {
+                                      return esm.get_stage(name)->queue_length_limit();
+                                  }),
+             metrics::make_histogram("batch_size",
+                                  metrics::description("Histogram of the number of function calls executed at once by execution stages"),
+                                  { metrics::label_instance("execution_stage", name), },
+                                  [name, &esm = internal::execution_stage_manager::get()] {
+                                      auto& st = esm.get_stage(name)->get_stats();
+                                      metrics::histogram h;
+                                      h.buckets.resize(batch_size_buckets);
+                                      uint64_t cumulative = 0;
+                                      for (size_t i = 0; i < batch_size_buckets; i++) {
+                                          cumulative += st.batch_sizes[i];
+                                          h.buckets[i].count = cumulative;
+                                          h.buckets[i].upper_bound = double(uint64_t(1) << i);
+                                      }
+                                      h.buckets.back().upper_bound = std::numeric_limits<double>::infinity();
+                                      h.sample_count = cumulative;
+                                      h.sample_sum = st.function_calls_executed;
+                                      return h;
+                                  }),
            });
     undo.cancel();
 }
@@ -139,11 +173,56 @@ bool execution_stage::flush() noexcept {
     }
     _stats.tasks_scheduled++;
     schedule(make_task(_sg, [this] {
-        do_flush();
+        run_flush();
         _flush_scheduled = false;
     }));
     _flush_scheduled = true;
     return true;
 };
 
+void execution_stage::run_flush() noexcept {
+    auto executed = _stats.function_calls_executed;
+    auto start = std::chrono::steady_clock::now();
+    do_flush();
+    account_batch(_stats.function_calls_executed - executed, std::chrono::steady_clock::now() - start);
+}
+
+void execution_stage::account_batch(uint64_t calls, std::chrono::steady_clock::duration took) noexcept {
+    if (!calls) {
+        return;
+    }
+    _stats.cpu_time += took;
+    auto bucket = std::min<size_t>(log2ceil(calls), batch_size_buckets - 1);
+    _stats.batch_sizes[bucket]++;
+    double ns = std::chrono::duration<double, std::nano>(took).count() / calls;
+    auto& cost = _cost_per_call[bucket];
+    // An average over the last batches of the size, so that the stage
+    // follows changes of its load
+    cost = _cost_samples[bucket]++ ? cost + (ns - cost) / 8 : ns;
+    if (++_batches_since_adapt == 64) {
+        _batches_since_adapt = 0;
+        adapt_queue_length();
+    }
+}
+
+void execution_stage::adapt_queue_length() noexcept {
+    // Buckets with too few batches to tell are left out
+    constexpr uint32_t min_samples = 4;
+    double best = std::numeric_limits<double>::infinity();
+    for (size_t i = 0; i < batch_size_buckets; i++) {
+        if (_cost_samples[i] >= min_samples) {
+            best = std::min(best, _cost_per_call[i]);
+        }
+    }
+    if (best == std::numeric_limits<double>::infinity()) {
+        return;
+    }
+    for (size_t i = 0; i < batch_size_buckets; i++) {
+        if (_cost_samples[i] >= min_samples && _cost_per_call[i] <= best * 1.125) {
+            _max_queue_length = std::clamp<size_t>(size_t(1) << i, min_queue_length, max_queue_length);
+            return;
+        }
+    }
+}
+
 }
@@ -0,0 +1,116 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#include <seastar/core/exponential_histogram.hh>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <fmt/format.h>
+
+namespace seastar {
+
+namespace metrics {
+
+exponential_histogram::exponential_histogram(double min, double max, int schema)
+        : _schema(schema) {
+    if (schema < 0 || schema > max_schema) {
+        throw std::invalid_argument(fmt::format("exponential_histogram: schema {} is not within [0, {}]", schema, max_schema));
+    }
+    if (!(min > 0) || !(max >= min)) {
+        throw std::invalid_argument(fmt::format("exponential_histogram: bad range [{}, {}]", min, max));
+    }
+    int32_t n = 1 << schema;
+    _bounds.reserve(n);
+    for (int32_t j = 0; j < n; j++) {
+        _bounds.push_back(std::exp2(double(j) / n - 1));
+    }
+    _min_id = bucket_id(min);
+    // Values below the first bucket are in the zero bucket
+    _zero_threshold = upper_bound(_min_id - 1);
+    _buckets.resize(bucket_id(max) - _min_id + 1);
+}
+
+void exponential_histogram::reset() noexcept {
+    std::fill(_buckets.begin(), _buckets.end(), 0);
+    _zero_count = 0;
+    _count = 0;
+    _sum = 0;
+}
+
+exponential_histogram& exponential_histogram::operator+=(const exponential_histogram& h) {
+    if (h._schema != _schema || h._min_id != _min_id || h._buckets.size() != _buckets.size()) {
+        throw std::invalid_argument("exponential_histogram: adding a histogram of another layout");
+    }
+    for (size_t i = 0; i < _buckets.size(); i++) {
+        _buckets[i] += h._buckets[i];
+    }
+    _zero_count += h._zero_count;
+    _count += h._count;
+    _sum += h._sum;
+    return *this;
+}
+
+double exponential_histogram::quantile(double q) const noexcept {
+    auto want = uint64_t(std::ceil(_count * q));
+    uint64_t seen = _zero_count;
+    if (seen >= want) {
+        return _zero_threshold;
+    }
+    for (size_t i = 0; i < _buckets.size(); i++) {
+        seen += _buckets[i];
+        if (seen >= want) {
+            return upper_bound(_min_id + i);
+        }
+    }
+    return upper_bound(_min_id + _buckets.size() - 1);
+}
+
+histogram exponential_histogram::to_metrics_histogram() const {
+    histogram h;
+    h.sample_count = _count;
+    h.sample_sum = _sum;
+    h.native_histogram = native_histogram_info{_schema, _min_id};
+    h.buckets.reserve(_buckets.size() + 1);
+    uint64_t cumulative = _zero_count;
+    h.buckets.push_back(histogram_bucket{cumulative, _zero_threshold});
+    for (size_t i = 0; i < _buckets.size(); i++) {
+        cumulative += _buckets[i];
+        h.buckets.push_back(histogram_bucket{cumulative, upper_bound(_min_id + i)});
+    }
+    // The last bucket also holds the values above the range
+    h.buckets.back().upper_bound = std::numeric_limits<double>::infinity();
+    return h;
+}
+
+histogram exponential_histogram::to_metrics_summary(const std::vector<double>& quantiles, double unit) const {
+    histogram h;
+    h.sample_count = _count;
+    h.sample_sum = _sum * unit;
+    h.buckets.reserve(quantiles.size());
+    for (auto q : quantiles) {
+        h.buckets.push_back(histogram_bucket{uint64_t(std::llround(quantile(q) * unit)), q});
+    }
+    return h;
+}
+
+}
+
+}
@@ -97,10 +97,12 @@ fair_group::fair_group(config cfg)
                         std::max<capacity_t>(cfg.rate_factor * fixed_point_factor * token_bucket_t::rate_cast(cfg.rate_limit_duration).count(), ticket_capacity(fair_queue_ticket(cfg.limit_min_weight, cfg.limit_min_size))),
                         ticket_capacity(fair_queue_ticket(cfg.min_weight, cfg.min_size))
                        )
+        , _nominal_rate(_token_bucket.rate())
+        , _lease_capacity(std::min<capacity_t>(_token_bucket.limit() * cfg.lease_fraction / smp::count, _token_bucket.limit()))
 {
     assert(_cost_capacity.is_non_zero());
-    seastar_logger.info("Created fair group {}, capacity rate {}, limit {}, rate {} (factor {}), threshold {}", cfg.label,
-            _cost_capacity, _token_bucket.limit(), _token_bucket.rate(), cfg.rate_factor, _token_bucket.threshold());
+    seastar_logger.info("Created fair group {}, capacity rate {}, limit {}, rate {} (factor {}), threshold {}, lease {}", cfg.label,
+            _cost_capacity, _token_bucket.limit(), _token_bucket.rate(), cfg.rate_factor, _token_bucket.threshold(), _lease_capacity);
 
     if (cfg.rate_factor * fixed_point_factor > _token_bucket.max_rate) {
         throw std::runtime_error("Fair-group rate_factor is too large");
@@ -120,6 +122,10 @@ void fair_group::release_capacity(capacity_t cap) noexcept {
     _token_bucket.release(cap);
 }
 
+void fair_group::refund_capacity(capacity_t cap) noexcept {
+    _token_bucket.refund(cap);
+}
+
 void fair_group::replenish_capacity(clock_type::time_point now) noexcept {
     _token_bucket.replenish(now);
 }
@@ -134,6 +140,10 @@ void fair_group::maybe_replenish_capacity(clock_type::time_point& local_ts) noex
     }
 }
 
+void fair_group::set_rate_scale(double scale) noexcept {
+    _token_bucket.update_rate(std::max<capacity_t>(std::round(_nominal_rate * scale), 1));
+}
+
 auto fair_group::capacity_deficiency(capacity_t from) const noexcept -> capacity_t {
     return _token_bucket.deficiency(from);
 }
@@ -149,11 +159,15 @@ class fair_queue::priority_class_data {
     capacity_t _accumulated = 0;
     capacity_t _pure_accumulated = 0;
     fair_queue_entry::container_list_t _queue;
+    priority_class_group_data& _group;
     bool _queued = false;
     bool _plugged = true;
 
 public:
-    explicit priority_class_data(uint32_t shares) noexcept : _shares(std::max(shares, 1u)) {}
+    priority_class_data(uint32_t shares, priority_class_group_data& group) noexcept
+        : _shares(std::max(shares, 1u))
+        , _group(group)
+    {}
     priority_class_data(const priority_class_data&) = delete;
     priority_class_data(priority_class_data&&) = delete;
 
@@ -162,7 +176,30 @@ class fair_queue::priority_class_data {
     }
 };
 
-bool fair_queue::class_compare::operator() (const priority_class_ptr& lhs, const priority_class_ptr & rhs) const noexcept {
+// Group of priority classes. Groups compete for the capacity between each
+// other the same way classes do within a group
+class fair_queue::priority_class_group_data {
+    friend class fair_queue;
+    uint32_t _shares = 0;
+    capacity_t _accumulated = 0;
+    capacity_t _pure_accumulated = 0;
+    priority_queue<priority_class_ptr> _handles;
+    size_t _nr_classes = 0;
+    capacity_t _last_accumulated = 0;
+    bool _queued = false;
+
+public:
+    explicit priority_class_group_data(uint32_t shares) noexcept : _shares(std::max(shares, 1u)) {}
+    priority_class_group_data(const priority_class_group_data&) = delete;
+    priority_class_group_data(priority_class_group_data&&) = delete;
+
+    void update_shares(uint32_t shares) noexcept {
+        _shares = (std::max(shares, 1u));
+    }
+};
+
+template <typename Ptr>
+bool fair_queue::class_compare::operator() (const Ptr& lhs, const Ptr& rhs) const noexcept {
     return lhs->_accumulated > rhs->_accumulated;
 }
 
@@ -170,7 +207,9 @@ fair_queue::fair_queue(fair_group& group, config cfg)
     : _config(std::move(cfg))
     , _group(group)
     , _group_replenish(clock_type::now())
+    , _lease(group.make_lease())
 {
+    register_priority_class_group(default_group, default_group_shares);
 }
 
 fair_queue::fair_queue(fair_queue&& other)
@@ -183,7 +222,10 @@ fair_queue::fair_queue(fair_queue&& other)
     , _requests_queued(std::exchange(other._requests_queued, 0))
     , _handles(std::move(other._handles))
     , _priority_classes(std::move(other._priority_classes))
+    , _priority_groups(std::move(other._priority_groups))
+    , _nr_groups(std::exchange(other._nr_groups, 0))
     , _last_accumulated(other._last_accumulated)
+    , _lease(std::move(other._lease))
 {
 }
 
@@ -193,35 +235,69 @@ fair_queue::~fair_queue() {
     }
 }
 
+// Classes within a group and groups within the queue compete the same way, so
+// a newcomer of either level is treated alike.
+template <typename Entity>
+void fair_queue::catch_up_from_idle(Entity& e, capacity_t last_accumulated) noexcept {
+    // Don't let the newcomer monopolize the disk for more than tau
+    // duration. For this estimate how many capacity units can be
+    // accumulated with the current shares per rate resulution
+    // and scale it up to tau.
+    capacity_t max_deviation = fair_group::fixed_point_factor / e._shares * fair_group::token_bucket_t::rate_cast(_config.tau).count();
+    // On start this deviation can go to negative values, so not to
+    // introduce extra if's for that short corner case, use signed
+    // arithmetics and make sure the _accumulated value doesn't grow
+    // over signed maximum (see overflow check in dispatch_requests)
+    e._accumulated = std::max<signed_capacity_t>(last_accumulated - max_deviation, e._accumulated);
+}
+
+void fair_queue::push_priority_group(priority_class_group_data& pg) noexcept {
+    if (!pg._queued) {
+        _handles.assert_enough_capacity();
+        _handles.push(&pg);
+        pg._queued = true;
+    }
+}
+
+void fair_queue::push_priority_group_from_idle(priority_class_group_data& pg) noexcept {
+    if (!pg._queued) {
+        catch_up_from_idle(pg, _last_accumulated);
+        _handles.assert_enough_capacity();
+        _handles.push(&pg);
+        pg._queued = true;
+    }
+}
+
+void fair_queue::pop_priority_group(priority_class_group_data& pg) noexcept {
+    assert(pg._queued);
+    pg._queued = false;
+    _handles.pop();
+}
+
 void fair_queue::push_priority_class(priority_class_data& pc) noexcept {
     assert(pc._plugged && !pc._queued);
-    _handles.assert_enough_capacity();
-    _handles.push(&pc);
+    auto& pg = pc._group;
+    pg._handles.assert_enough_capacity();
+    pg._handles.push(&pc);
     pc._queued = true;
+    push_priority_group(pg);
 }
 
 void fair_queue::push_priority_class_from_idle(priority_class_data& pc) noexcept {
     if (!pc._queued) {
-        // Don't let the newcomer monopolize the disk for more than tau
-        // duration. For this estimate how many capacity units can be
-        // accumulated with the current class shares per rate resulution
-        // and scale it up to tau.
-        capacity_t max_deviation = fair_group::fixed_point_factor / pc._shares * fair_group::token_bucket_t::rate_cast(_config.tau).count();
-        // On start this deviation can go to negative values, so not to
-        // introduce extra if's for that short corner case, use signed
-        // arithmetics and make sure the _accumulated value doesn't grow
-        // over signed maximum (see overflow check below)
-        pc._accumulated = std::max<signed_capacity_t>(_last_accumulated - max_deviation, pc._accumulated);
-        _handles.assert_enough_capacity();
-        _handles.push(&pc);
+        auto& pg = pc._group;
+        catch_up_from_idle(pc, pg._last_accumulated);
+        pg._handles.assert_enough_capacity();
+        pg._handles.push(&pc);
         pc._queued = true;
+        push_priority_group_from_idle(pg);
     }
 }
 
 void fair_queue::pop_priority_class(priority_class_data& pc) noexcept {
     assert(pc._plugged && pc._queued);
     pc._queued = false;
-    _handles.pop();
+    pc._group._handles.pop();
 }
 
 void fair_queue::plug_priority_class(priority_class_data& pc) noexcept {
@@ -261,7 +337,7 @@ auto fair_queue::grab_pending_capacity(const fair_queue_entry& ent) noexcept ->
     }
 
     if (cap < _pending->cap) {
-        _group.release_capacity(_pending->cap - cap); // FIXME -- replenish right at once?
+        _lease.release(_pending->cap - cap); // FIXME -- replenish right at once?
     }
 
     _pending.reset();
@@ -274,7 +350,8 @@ auto fair_queue::grab_capacity(const fair_queue_entry& ent) noexcept -> grab_res
     }
 
     capacity_t cap = _group.ticket_capacity(ent._ticket);
-    capacity_t want_head = _group.grab_capacity(cap);
+    assert(cap <= _group.maximum_capacity());
+    capacity_t want_head = _lease.grab(cap);
     if (_group.capacity_deficiency(want_head)) {
         _pending.emplace(want_head, cap);
         return grab_result::pending;
@@ -283,23 +360,52 @@ auto fair_queue::grab_capacity(const fair_queue_entry& ent) noexcept -> grab_res
     return grab_result::grabbed;
 }
 
-void fair_queue::register_priority_class(class_id id, uint32_t shares) {
+void fair_queue::register_priority_class_group(group_id id, uint32_t shares) {
+    if (id >= _priority_groups.size()) {
+        _priority_groups.resize(id + 1);
+    } else {
+        assert(!_priority_groups[id]);
+    }
+
+    _handles.reserve(_nr_groups + 1);
+    _priority_groups[id] = std::make_unique<priority_class_group_data>(shares);
+    _nr_groups++;
+}
+
+void fair_queue::unregister_priority_class_group(group_id id) {
+    assert(id != default_group);
+    auto& pgroup = _priority_groups[id];
+    assert(pgroup && pgroup->_nr_classes == 0);
+    pgroup.reset();
+    _nr_groups--;
+}
+
+void fair_queue::update_shares_for_class_group(group_id id, uint32_t shares) {
+    assert(id < _priority_groups.size());
+    auto& pg = _priority_groups[id];
+    assert(pg);
+    pg->update_shares(shares);
+}
+
+void fair_queue::register_priority_class(class_id id, uint32_t shares, group_id gid) {
+    assert(gid < _priority_groups.size() && _priority_groups[gid]);
+    auto& pg = *_priority_groups[gid];
     if (id >= _priority_classes.size()) {
         _priority_classes.resize(id + 1);
     } else {
         assert(!_priority_classes[id]);
     }
 
-    _handles.reserve(_nr_classes + 1);
-    _priority_classes[id] = std::make_unique<priority_class_data>(shares);
-    _nr_classes++;
+    pg._handles.reserve(pg._nr_classes + 1);
+    _priority_classes[id] = std::make_unique<priority_class_data>(shares, pg);
+    pg._nr_classes++;
 }
 
 void fair_queue::unregister_priority_class(class_id id) {
     auto& pclass = _priority_classes[id];
     assert(pclass && pclass->_queue.empty());
+    pclass->_group._nr_classes--;
     pclass.reset();
-    _nr_classes--;
 }
 
 void fair_queue::update_shares_for_class(class_id id, uint32_t shares) {
@@ -341,7 +447,15 @@ void fair_queue::queue(class_id id, fair_queue_entry& ent) noexcept {
 void fair_queue::notify_request_finished(fair_queue_ticket desc) noexcept {
     _resources_executing -= desc;
     _requests_executing--;
-    _group.release_capacity(_group.ticket_capacity(desc));
+    _lease.release(_group.ticket_capacity(desc));
+    if (_requests_executing == 0) {
+        _lease.return_tokens();
+    }
+}
+
+void fair_queue::notify_request_aborted(fair_queue_ticket desc) noexcept {
+    notify_request_finished(desc);
+    _group.refund_capacity(_group.ticket_capacity(desc));
 }
 
 void fair_queue::notify_request_cancelled(fair_queue_entry& ent) noexcept {
@@ -349,6 +463,12 @@ void fair_queue::notify_request_cancelled(fair_queue_entry& ent) noexcept {
     ent._ticket = fair_queue_ticket();
 }
 
+void fair_queue::update_queued_entry(fair_queue_entry& ent, fair_queue_ticket ticket) noexcept {
+    _resources_queued -= ent._ticket;
+    ent._ticket = ticket;
+    _resources_queued += ticket;
+}
+
 fair_queue::clock_type::time_point fair_queue::next_pending_aio() const noexcept {
     if (_pending) {
         /*
@@ -374,7 +494,13 @@ void fair_queue::dispatch_requests(std::function<void(fair_queue_entry&)> cb) {
     boost::container::small_vector<priority_class_ptr, 2> preempt;
 
     while (!_handles.empty() && (dispatched < _group.maximum_capacity() / smp::count)) {
-        priority_class_data& h = *_handles.top();
+        priority_class_group_data& g = *_handles.top();
+        if (g._handles.empty()) {
+            pop_priority_group(g);
+            continue;
+        }
+
+        priority_class_data& h = *g._handles.top();
         if (h._queue.empty()) {
             pop_priority_class(h);
             continue;
@@ -392,7 +518,9 @@ void fair_queue::dispatch_requests(std::function<void(fair_queue_entry&)> cb) {
             continue;
         }
 
-        _last_accumulated = std::max(h._accumulated, _last_accumulated);
+        _last_accumulated = std::max(g._accumulated, _last_accumulated);
+        g._last_accumulated = std::max(h._accumulated, g._last_accumulated);
+        pop_priority_group(g);
         pop_priority_class(h);
         h._queue.pop_front();
 
@@ -410,7 +538,7 @@ void fair_queue::dispatch_requests(std::function<void(fair_queue_entry&)> cb) {
         // signed overflow check to make push_priority_class_from_idle math work
         if (h._accumulated >= std::numeric_limits<signed_capacity_t>::max() - req_cost) {
             for (auto& pc : _priority_classes) {
-                if (pc) {
+                if (pc && &pc->_group == &g) {
                     if (pc->_queued) {
                         pc->_accumulated -= h._accumulated;
                     } else { // this includes h
@@ -418,22 +546,46 @@ void fair_queue::dispatch_requests(std::function<void(fair_queue_entry&)> cb) {
                     }
                 }
             }
-            _last_accumulated = 0;
+            g._last_accumulated = 0;
         }
         h._accumulated += req_cost;
         h._pure_accumulated += req_cap;
 
+        // Same for the group, its cost is the capacity divided by the group shares
+        auto req_group_cost = std::max(req_cap / g._shares, (capacity_t)1);
+        if (g._accumulated >= std::numeric_limits<signed_capacity_t>::max() - req_group_cost) {
+            for (auto& pg : _priority_groups) {
+                if (pg) {
+                    if (pg->_queued) {
+                        pg->_accumulated -= g._accumulated;
+                    } else { // this includes g
+                        pg->_accumulated = 0;
+                    }
+                }
+            }
+            _last_accumulated = 0;
+        }
+        g._accumulated += req_group_cost;
+        g._pure_accumulated += req_cap;
+
         dispatched += _group.ticket_capacity(req._ticket);
         cb(req);
 
         if (h._plugged && !h._queue.empty()) {
             push_priority_class(h);
+        } else if (!g._handles.empty()) {
+            push_priority_group(g);
         }
     }
 
     for (auto&& h : preempt) {
         push_priority_class(*h);
     }
+
+    if (_handles.empty()) {
+        // Nothing to spend the rest of the lease on
+        _lease.return_tokens();
+    }
 }
 
 std::vector<seastar::metrics::impl::metric_definition_impl> fair_queue::metrics(class_id c) {
@@ -449,4 +601,17 @@ std::vector<seastar::metrics::impl::metric_definition_impl> fair_queue::metrics(
     });
 }
 
+std::vector<seastar::metrics::impl::metric_definition_impl> fair_queue::group_metrics(group_id g) {
+    namespace sm = seastar::metrics;
+    priority_class_group_data& pg = *_priority_groups[g];
+    return std::vector<sm::impl::metric_definition_impl>({
+            sm::make_counter("group_consumption",
+                    [&pg] { return fair_group::capacity_tokens(pg._pure_accumulated); },
+                    sm::description("Accumulated disk capacity units consumed by the classes of this group")),
+            sm::make_counter("group_adjusted_consumption",
+                    [&pg] { return fair_group::capacity_tokens(pg._accumulated); },
+                    sm::description("Consumed disk capacity units adjusted for group shares and idling preemption")),
+    });
+}
+
 }
@@ -0,0 +1,82 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+
+#include <seastar/core/fair_scheduler.hh>
+#include <boost/intrusive/parent_from_member.hpp>
+#include <cassert>
+
+namespace seastar {
+
+struct fair_scheduler::waiter {
+    fair_queue_entry ent;
+    promise<permit> pr;
+
+    explicit waiter(fair_queue_ticket t) noexcept : ent(t) {}
+
+    static waiter& from(fair_queue_entry& ent) noexcept {
+        return *boost::intrusive::get_parent_from_member(&ent, &waiter::ent);
+    }
+};
+
+fair_scheduler::fair_scheduler(fair_group& group, config cfg)
+    : _queue(group, cfg.queue)
+    , _config(std::move(cfg))
+    , _dispatch_timer([this] { dispatch(); })
+{
+}
+
+fair_scheduler::~fair_scheduler() {
+    assert(_waiters == 0);
+}
+
+future<fair_scheduler::permit> fair_scheduler::acquire(class_id c, fair_queue_ticket ticket) {
+    auto w = std::make_unique<waiter>(ticket);
+    auto fut = w->pr.get_future();
+    _queue.queue(c, w.release()->ent);
+    _waiters++;
+    dispatch();
+    return fut;
+}
+
+void fair_scheduler::release(fair_queue_ticket ticket) noexcept {
+    _queue.notify_request_finished(ticket);
+    if (_waiters) {
+        dispatch();
+    }
+}
+
+void fair_scheduler::dispatch() noexcept {
+    _queue.dispatch_requests([this] (fair_queue_entry& ent) {
+        std::unique_ptr<waiter> w(&waiter::from(ent));
+        _waiters--;
+        w->pr.set_value(permit(*this, ent.ticket()));
+    });
+
+    if (_waiters && !_dispatch_timer.armed()) {
+        // The queue knows when the group will have the capacity it waits
+        // for, if it does wait; otherwise it only stopped to let others in
+        auto next = std::min(_queue.next_pending_aio(), timer<>::clock::now() + _config.dispatch_period);
+        _dispatch_timer.arm(next);
+    }
+}
+
+}
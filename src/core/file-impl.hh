@@ -36,6 +36,8 @@ struct fs_info;
 
 }
 
+directory_entry_type stat_to_entry_type(mode_t type);
+
 class posix_file_handle_impl : public seastar::file_handle_impl {
     int _fd;
     std::atomic<unsigned>* _refcount;
@@ -86,6 +88,19 @@ class posix_file_impl : public file_impl {
             bool nowait_works);
 public:
     virtual ~posix_file_impl() override;
+    // The descriptor behind \c f, or -1 if \c f is not backed by a
+    // posix_file_impl (e.g. it is layered over one).
+    static int fd_of(file& f) noexcept;
+    struct kernel_copy_result {
+        uint64_t copied;
+        bool cloned;
+    };
+    // Copies up to \c len bytes of \c src_fd at \c src_pos to \c dst_fd at
+    // \c dst_pos without passing them through user space: shares their
+    // blocks with FICLONERANGE if the file system can, else copies them
+    // with copy_file_range(2). Copies fewer bytes if the source ends, or
+    // if the file systems support neither for the rest of the range.
+    static future<kernel_copy_result> copy_in_kernel(int src_fd, uint64_t src_pos, int dst_fd, uint64_t dst_pos, uint64_t len) noexcept;
     future<> flush(void) noexcept override;
     future<struct stat> stat(void) noexcept override;
     future<> truncate(uint64_t length) noexcept override;
@@ -101,6 +116,10 @@ class posix_file_impl : public file_impl {
     virtual future<> close() noexcept override;
     virtual std::unique_ptr<seastar::file_handle_impl> dup() override;
     virtual subscription<directory_entry> list_directory(std::function<future<> (directory_entry de)> next) override;
+    virtual future<> list_directory_batches(std::function<future<> (std::span<directory_entry> entries)> next, list_directory_options opts) override;
+private:
+    future<> resolve_entry_types(std::vector<directory_entry>& entries, unsigned concurrency);
+public:
 
     virtual future<size_t> read_dma(uint64_t pos, void* buffer, size_t len, const io_priority_class& pc) noexcept override {
         return read_dma(pos, buffer, len, pc, nullptr);
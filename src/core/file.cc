@@ -34,6 +34,7 @@
 #include <xfs/xfs.h>
 #undef min
 #include <seastar/core/reactor.hh>
+#include <seastar/core/loop.hh>
 #include <seastar/core/file.hh>
 #include <seastar/core/report_exception.hh>
 #include <seastar/core/linux-aio.hh>
@@ -68,6 +69,14 @@ struct fs_info {
 using namespace internal;
 using namespace internal::linux_abi;
 
+// Comes from the reactor so that the io_uring backend can serve it from
+// memory registered with the kernel.
+static temporary_buffer<uint8_t> allocate_dma_buffer(size_t alignment, size_t size) {
+    auto buf = engine().allocate_dma_buffer(alignment, size);
+    auto p = reinterpret_cast<uint8_t*>(buf.get_write());
+    return temporary_buffer<uint8_t>(p, size, buf.release());
+}
+
 file_handle::file_handle(const file_handle& x)
         : _impl(x._impl ? x._impl->clone() : std::unique_ptr<file_handle_impl>()) {
 }
@@ -108,6 +117,76 @@ posix_file_impl::posix_file_impl(int fd, open_flags f, file_open_options options
     configure_dma_alignment(fsi);
 }
 
+int
+posix_file_impl::fd_of(file& f) noexcept {
+    auto pfi = dynamic_cast<posix_file_impl*>(get_file_impl(f));
+    return pfi ? pfi->_fd : -1;
+}
+
+// Errors meaning the file systems cannot clone or copy the range, rather
+// than that copying it failed
+static bool kernel_copy_unsupported(int err) noexcept {
+    return err == EOPNOTSUPP || err == ENOTTY || err == EXDEV || err == EINVAL || err == ENOSYS;
+}
+
+future<posix_file_impl::kernel_copy_result>
+posix_file_impl::copy_in_kernel(int src_fd, uint64_t src_pos, int dst_fd, uint64_t dst_pos, uint64_t len) noexcept {
+    return engine()._thread_pool->submit<syscall_result_extra<uint64_t>>([=] {
+        struct stat st;
+        auto r = ::fstat(src_fd, &st);
+        if (r == -1) {
+            return wrap_syscall(r, uint64_t(0));
+        }
+        // Clones are cut at the end of the source
+        auto to_clone = src_pos < uint64_t(st.st_size) ? std::min(len, uint64_t(st.st_size) - src_pos) : 0;
+        if (!to_clone) {
+            return wrap_syscall(0, uint64_t(0));
+        }
+        struct file_clone_range fcr = {
+            .src_fd = src_fd,
+            .src_offset = src_pos,
+            .src_length = to_clone,
+            .dest_offset = dst_pos,
+        };
+        r = ::ioctl(dst_fd, FICLONERANGE, &fcr);
+        return wrap_syscall(r, r == -1 ? uint64_t(0) : to_clone);
+    }, thread_pool::lane::slow).then([=] (syscall_result_extra<uint64_t> sr) {
+        if (sr.result != -1) {
+            return make_ready_future<kernel_copy_result>(kernel_copy_result{sr.extra, true});
+        }
+        if (!kernel_copy_unsupported(sr.error)) {
+            sr.throw_if_error();
+        }
+        // Copy in chunks, so that a large copy does not hold on to a
+        // syscall thread
+        static constexpr uint64_t chunk = 64 << 20;
+        return do_with(uint64_t(0), [=] (uint64_t& copied) {
+            return repeat([=, &copied] {
+                if (copied == len) {
+                    return make_ready_future<stop_iteration>(stop_iteration::yes);
+                }
+                loff_t in = src_pos + copied;
+                loff_t out = dst_pos + copied;
+                auto n = std::min(chunk, len - copied);
+                return engine()._thread_pool->submit<syscall_result<ssize_t>>([=] () mutable {
+                    return wrap_syscall(::copy_file_range(src_fd, &in, dst_fd, &out, n, 0));
+                }, thread_pool::lane::slow).then([&copied] (syscall_result<ssize_t> sr) {
+                    if (sr.result == -1) {
+                        if (kernel_copy_unsupported(sr.error)) {
+                            return stop_iteration::yes;
+                        }
+                        sr.throw_if_error();
+                    }
+                    copied += sr.result;
+                    return stop_iteration(sr.result == 0);
+                });
+            }).then([&copied] {
+                return kernel_copy_result{copied, false};
+            });
+        });
+    });
+}
+
 posix_file_impl::~posix_file_impl() {
     if (_refcount && _refcount->fetch_add(-1, std::memory_order_relaxed) != 1) {
         return;
@@ -187,7 +266,7 @@ future<>
 posix_file_impl::truncate(uint64_t length) noexcept {
     return engine()._thread_pool->submit<syscall_result<int>>([this, length] {
         return wrap_syscall<int>(::ftruncate(_fd, length));
-    }).then([] (syscall_result<int> sr) {
+    }, thread_pool::lane::slow).then([] (syscall_result<int> sr) {
         sr.throw_if_error();
         return make_ready_future<>();
     });
@@ -240,7 +319,7 @@ posix_file_impl::discard(uint64_t offset, uint64_t length) noexcept {
     return engine()._thread_pool->submit<syscall_result<int>>([this, offset, length] () mutable {
         return wrap_syscall<int>(::fallocate(_fd, FALLOC_FL_PUNCH_HOLE|FALLOC_FL_KEEP_SIZE,
             offset, length));
-    }).then([] (syscall_result<int> sr) {
+    }, thread_pool::lane::slow).then([] (syscall_result<int> sr) {
         sr.throw_if_error();
         return make_ready_future<>();
     });
@@ -261,7 +340,7 @@ posix_file_impl::allocate(uint64_t position, uint64_t length) noexcept {
             supported = false; // Racy, but harmless.  At most we issue an extra call or two.
         }
         return wrap_syscall<int>(ret);
-    }).then([] (syscall_result<int> sr) {
+    }, thread_pool::lane::slow).then([] (syscall_result<int> sr) {
         sr.throw_if_error();
         return make_ready_future<>();
     });
@@ -324,93 +403,119 @@ blockdev_file_impl::size(void) noexcept {
     });
 }
 
+// From getdents(2):
+struct linux_dirent64 {
+    ino64_t        d_ino;    /* 64-bit inode number */
+    off64_t        d_off;    /* 64-bit offset to next structure */
+    unsigned short d_reclen; /* Size of this dirent */
+    unsigned char  d_type;   /* File type */
+    char           d_name[]; /* Filename (null-terminated) */
+};
+
+static std::optional<directory_entry_type> dirent_to_entry_type(unsigned char d_type) {
+    switch (d_type) {
+    case DT_BLK:
+        return directory_entry_type::block_device;
+    case DT_CHR:
+        return directory_entry_type::char_device;
+    case DT_DIR:
+        return directory_entry_type::directory;
+    case DT_FIFO:
+        return directory_entry_type::fifo;
+    case DT_REG:
+        return directory_entry_type::regular;
+    case DT_LNK:
+        return directory_entry_type::link;
+    case DT_SOCK:
+        return directory_entry_type::socket;
+    default:
+        // unknown, ignore
+        return std::nullopt;
+    }
+}
+
 subscription<directory_entry>
 posix_file_impl::list_directory(std::function<future<> (directory_entry de)> next) {
-    static constexpr size_t buffer_size = 8192;
+    auto s = make_lw_shared<stream<directory_entry>>();
+    auto ret = s->listen(std::move(next));
+    // List the directory asynchronously in the background.
+    // Caller synchronizes using the returned subscription.
+    (void)s->started().then([s, this] {
+        return list_directory_batches([s] (std::span<directory_entry> entries) {
+            return do_for_each(entries, [s] (directory_entry& de) {
+                return s->produce(std::move(de));
+            });
+        }, {});
+    }).then([s] {
+        s->close();
+    }).handle_exception([] (std::exception_ptr ignored) {});
+    return ret;
+}
+
+future<>
+posix_file_impl::list_directory_batches(std::function<future<> (std::span<directory_entry> entries)> next, list_directory_options opts) {
     struct work {
-        stream<directory_entry> s;
-        unsigned current = 0;
-        unsigned total = 0;
+        std::function<future<> (std::span<directory_entry>)> next;
+        list_directory_options opts;
+        std::unique_ptr<char[]> buffer;
+        std::vector<directory_entry> entries;
         bool eof = false;
-        int error = 0;
-        char buffer[buffer_size];
     };
 
     // While it would be natural to use fdopendir()/readdir(),
     // our syscall thread pool doesn't support malloc(), which is
     // required for this to work.  So resort to using getdents()
     // instead.
-
-    // From getdents(2):
-    struct linux_dirent64 {
-        ino64_t        d_ino;    /* 64-bit inode number */
-        off64_t        d_off;    /* 64-bit offset to next structure */
-        unsigned short d_reclen; /* Size of this dirent */
-        unsigned char  d_type;   /* File type */
-        char           d_name[]; /* Filename (null-terminated) */
-    };
-
     auto w = make_lw_shared<work>();
-    auto ret = w->s.listen(std::move(next));
-    // List the directory asynchronously in the background.
-    // Caller synchronizes using the returned subscription.
-    (void)w->s.started().then([w, this] {
-        auto eofcond = [w] { return w->eof; };
-        return do_until(eofcond, [w, this] {
-            if (w->current == w->total) {
-                return engine()._thread_pool->submit<syscall_result<long>>([w , this] () {
-                    auto ret = ::syscall(__NR_getdents64, _fd, reinterpret_cast<linux_dirent64*>(w->buffer), buffer_size);
-                    return wrap_syscall(ret);
-                }).then([w] (syscall_result<long> ret) {
-                    ret.throw_if_error();
-                    if (ret.result == 0) {
-                        w->eof = true;
-                    } else {
-                        w->current = 0;
-                        w->total = ret.result;
-                    }
-                });
+    w->next = std::move(next);
+    w->opts = opts;
+    w->opts.buffer_size = std::max(opts.buffer_size, sizeof(linux_dirent64) + NAME_MAX + 1);
+    w->buffer = std::make_unique<char[]>(w->opts.buffer_size);
+    return do_until([w] { return w->eof; }, [w, this] {
+        return engine()._thread_pool->submit<syscall_result<long>>([w, this] () {
+            auto ret = ::syscall(__NR_getdents64, _fd, reinterpret_cast<linux_dirent64*>(w->buffer.get()), w->opts.buffer_size);
+            return wrap_syscall(ret);
+        }).then([w, this] (syscall_result<long> ret) {
+            ret.throw_if_error();
+            if (ret.result == 0) {
+                w->eof = true;
+                return make_ready_future<>();
             }
-            auto start = w->buffer + w->current;
-            auto de = reinterpret_cast<linux_dirent64*>(start);
-            std::optional<directory_entry_type> type;
-            switch (de->d_type) {
-            case DT_BLK:
-                type = directory_entry_type::block_device;
-                break;
-            case DT_CHR:
-                type = directory_entry_type::char_device;
-                break;
-            case DT_DIR:
-                type = directory_entry_type::directory;
-                break;
-            case DT_FIFO:
-                type = directory_entry_type::fifo;
-                break;
-            case DT_REG:
-                type = directory_entry_type::regular;
-                break;
-            case DT_LNK:
-                type = directory_entry_type::link;
-                break;
-            case DT_SOCK:
-                type = directory_entry_type::socket;
-                break;
-            default:
-                // unknown, ignore
-                ;
+            w->entries.clear();
+            for (long pos = 0; pos < ret.result;) {
+                auto de = reinterpret_cast<linux_dirent64*>(w->buffer.get() + pos);
+                pos += de->d_reclen;
+                std::string_view name = de->d_name;
+                if (name == "." || name == "..") {
+                    continue;
+                }
+                w->entries.push_back({sstring(name), dirent_to_entry_type(de->d_type)});
             }
-            w->current += de->d_reclen;
-            sstring name = de->d_name;
-            if (name == "." || name == "..") {
-                return make_ready_future<>();
+            auto resolved = w->opts.resolve_types ? resolve_entry_types(w->entries, w->opts.stat_concurrency) : make_ready_future<>();
+            return resolved.then([w] {
+                return w->next(std::span<directory_entry>(w->entries));
+            });
+        });
+    });
+}
+
+future<>
+posix_file_impl::resolve_entry_types(std::vector<directory_entry>& entries, unsigned concurrency) {
+    return max_concurrent_for_each(entries.begin(), entries.end(), std::max(concurrency, 1u), [this] (directory_entry& de) {
+        if (de.type) {
+            return make_ready_future<>();
+        }
+        return engine()._thread_pool->submit<syscall_result_extra<struct stat>>([this, name = de.name] {
+            struct stat st;
+            auto ret = ::fstatat(_fd, name.c_str(), &st, AT_SYMLINK_NOFOLLOW);
+            return wrap_syscall(ret, st);
+        }).then([&de] (syscall_result_extra<struct stat> sr) {
+            // An entry removed since it was read keeps an unknown type
+            if (sr.result != -1) {
+                de.type = stat_to_entry_type(sr.extra.st_mode);
             }
-            return w->s.produce({std::move(name), type});
         });
-    }).then([w] {
-        w->s.close();
-    }).handle_exception([] (std::exception_ptr ignored) {});
-    return ret;
+    });
 }
 
 future<size_t>
@@ -475,8 +580,7 @@ posix_file_impl::do_dma_read_bulk(uint64_t offset, size_t range_size, const io_p
 
     auto rstate = make_lw_shared<internal::file_read_state<uint8_t>>(offset, front,
                                                        range_size,
-                                                       _memory_dma_alignment,
-                                                       _disk_read_dma_alignment,
+                                                       allocate_dma_buffer(_memory_dma_alignment, align_up(range_size, size_t(_disk_read_dma_alignment))),
                                                        intent);
 
     //
@@ -534,7 +638,7 @@ posix_file_impl::read_maybe_eof(uint64_t pos, size_t len, const io_priority_clas
     // We have to allocate a new aligned buffer to make sure we don't get
     // an EINVAL error due to unaligned destination buffer.
     //
-    temporary_buffer<uint8_t> buf = temporary_buffer<uint8_t>::aligned(
+    temporary_buffer<uint8_t> buf = allocate_dma_buffer(
                _memory_dma_alignment, align_up(len, size_t(_disk_read_dma_alignment)));
 
     // try to read a single bulk from the given position
@@ -594,7 +698,7 @@ blockdev_file_impl::discard(uint64_t offset, uint64_t length) noexcept {
     return engine()._thread_pool->submit<syscall_result<int>>([this, offset, length] () mutable {
         uint64_t range[2] { offset, length };
         return wrap_syscall<int>(::ioctl(_fd, BLKDISCARD, &range));
-    }).then([] (syscall_result<int> sr) {
+    }, thread_pool::lane::slow).then([] (syscall_result<int> sr) {
         sr.throw_if_error();
         return make_ready_future<>();
     });
@@ -1100,6 +1204,11 @@ file::list_directory(std::function<future<>(directory_entry de)> next) {
     return _file_impl->list_directory(std::move(next));
 }
 
+future<>
+file::list_directory_batches(std::function<future<> (std::span<directory_entry> entries)> next, list_directory_options opts) {
+    return _file_impl->list_directory_batches(std::move(next), opts);
+}
+
 future<int> file::ioctl(uint64_t cmd, void* argp) noexcept {
     return _file_impl->ioctl(cmd, argp);
 }
@@ -1283,6 +1392,19 @@ file_impl::dup() {
     throw std::runtime_error("this file type cannot be duplicated");
 }
 
+future<>
+file_impl::list_directory_batches(std::function<future<> (std::span<directory_entry> entries)> next, list_directory_options opts) {
+    // Batches of one entry
+    auto sub = list_directory([next = std::move(next)] (directory_entry de) {
+        return do_with(std::move(de), [&next] (directory_entry& de) {
+            return next(std::span<directory_entry>(&de, 1));
+        });
+    });
+    return do_with(std::move(sub), [] (subscription<directory_entry>& sub) {
+        return sub.done();
+    });
+}
+
 future<int> file_impl::ioctl(uint64_t cmd, void* argp) noexcept {
     return make_exception_future<int>(std::runtime_error("this file type does not support ioctl"));
 }
@@ -20,8 +20,13 @@
  */
 
 #include <seastar/core/internal/pollable_fd.hh>
+#include <seastar/core/loop.hh>
 #include <seastar/core/posix.hh>
 #include <seastar/core/reactor.hh>
+#include <seastar/core/seastar.hh>
+#include <seastar/core/sleep.hh>
+#include <map>
+#include <unordered_map>
 #include "fsnotify.hh"
 
 class seastar::fsnotifier::impl : public enable_shared_from_this<impl> {
@@ -34,15 +39,44 @@ class seastar::fsnotifier::impl : public enable_shared_from_this<impl> {
             return get_fd();
         }
     };
+    // A directory of a recursive watch
+    struct tree_dir {
+        watch_token root;
+        sstring path;
+        // Relative to the root, with a trailing '/' unless the root
+        sstring rel;
+        flags mask;
+    };
+    // Events read by a wait()
+    struct batch {
+        temporary_buffer<char> buf;
+        std::vector<event> events;
+        // Of the events which may be coalesced, by watch and name
+        std::map<std::pair<watch_token, sstring>, size_t> coalesced;
+        // Directories which appeared in recursive watches
+        std::vector<tree_dir> new_dirs;
+    };
+
     my_poll_fd _fd;
     watch_token _close_dummy = -1;
+    std::unordered_map<watch_token, tree_dir> _tree;
+
+    static constexpr flags coalescible = flags::modify | flags::attrib | flags::access | flags::open | flags::close;
+    // Keep track of the directories of recursive watches
+    static constexpr flags tree_flags = flags::create_child | flags::move | flags::onlydir;
+
+    void parse(const char* p, const char* e, batch& b, bool coalesce);
+    void drain(batch& b, const wait_options& opts);
+    future<watch_token> add_tree(tree_dir dir);
+    void remove_tree(watch_token root, const sstring& rel_prefix);
 public:
     impl()
         : _fd(file_desc::inotify_init(IN_NONBLOCK | IN_CLOEXEC))
     {}
     void remove_watch(watch_token);
     future<watch_token> create_watch(const sstring& path, flags events);
-    future<std::vector<event>> wait();
+    future<watch_token> create_recursive_watch(const sstring& path, flags events);
+    future<std::vector<event>> wait(wait_options opts);
     void shutdown();
     bool active() const {
         return bool(_fd);
@@ -50,6 +84,11 @@ class seastar::fsnotifier::impl : public enable_shared_from_this<impl> {
 };
 
 void seastar::fsnotifier::impl::remove_watch(watch_token token) {
+    auto i = _tree.find(token);
+    if (i != _tree.end() && i->second.root == token) {
+        remove_tree(token, "");
+        return;
+    }
     if (active()) {
         auto res = ::inotify_rm_watch(_fd, token);
         // throw if any other error than EINVAL.
@@ -64,30 +103,173 @@ seastar::future<seastar::fsnotifier::watch_token> seastar::fsnotifier::impl::cre
     return engine().inotify_add_watch(_fd, path, uint32_t(events));
 }
 
-seastar::future<std::vector<seastar::fsnotifier::event>> seastar::fsnotifier::impl::wait() {
-    // be paranoid about buffer alignment
-    auto buf = temporary_buffer<char>::aligned(std::max(alignof(::inotify_event), alignof(int64_t)), 4096);
-    auto f = _fd.read_some(buf.get_write(), buf.size());
-    return f.then([me = shared_from_this(), buf = std::move(buf)](size_t n) {
-        auto p = buf.get();
-        auto e = buf.get() + n;
+void seastar::fsnotifier::impl::remove_tree(watch_token root, const sstring& rel_prefix) {
+    for (auto i = _tree.begin(); i != _tree.end();) {
+        auto& d = i->second;
+        if (d.root == root && std::string_view(d.rel).starts_with(std::string_view(rel_prefix))) {
+            if (active()) {
+                auto res = ::inotify_rm_watch(_fd, i->first);
+                throw_system_error_on(res == -1 && errno != EINVAL, "could not remove inotify watch");
+            }
+            i = _tree.erase(i);
+        } else {
+            ++i;
+        }
+    }
+}
 
-        std::vector<event> events;
+// Watches the directory and those below it; the root of a recursive watch
+// is added with a root of -1, and its token returned
+seastar::future<seastar::fsnotifier::watch_token> seastar::fsnotifier::impl::add_tree(tree_dir dir) {
+    auto is_root = dir.root == -1;
+    return engine().inotify_add_watch(_fd, dir.path, uint32_t(dir.mask | tree_flags)).then([this, dir] (watch_token t) mutable {
+        if (dir.root == -1) {
+            dir.root = t;
+        }
+        _tree.insert_or_assign(t, dir);
+        return open_directory(dir.path).then([this, dir = std::move(dir)] (file f) mutable {
+            return do_with(std::move(f), std::vector<tree_dir>(), [this, dir = std::move(dir)] (file& f, std::vector<tree_dir>& subdirs) {
+                list_directory_options opts;
+                opts.resolve_types = true;
+                return f.list_directory_batches([&subdirs, &dir] (std::span<directory_entry> entries) {
+                    for (auto& de : entries) {
+                        if (de.type == directory_entry_type::directory) {
+                            subdirs.push_back(tree_dir{dir.root, dir.path + "/" + de.name, dir.rel + de.name + "/", dir.mask});
+                        }
+                    }
+                    return make_ready_future<>();
+                }, opts).finally([&f] {
+                    return f.close();
+                }).then([this, &subdirs] {
+                    return do_for_each(subdirs, [this] (tree_dir& d) {
+                        return add_tree(std::move(d)).discard_result();
+                    });
+                });
+            });
+        }).then([t] {
+            return t;
+        });
+    }).handle_exception([is_root] (std::exception_ptr ex) {
+        // A directory removed while being walked is not an error,
+        // but failing to watch the root is
+        if (!is_root) {
+            try {
+                std::rethrow_exception(ex);
+            } catch (std::system_error& e) {
+                if (e.code().value() == ENOENT || e.code().value() == ENOTDIR) {
+                    return make_ready_future<watch_token>(-1);
+                }
+            } catch (...) {
+            }
+        }
+        return make_exception_future<watch_token>(std::move(ex));
+    });
+}
+
+seastar::future<seastar::fsnotifier::watch_token> seastar::fsnotifier::impl::create_recursive_watch(const sstring& path, flags events) {
+    if (!active()) {
+        throw std::runtime_error("attempting to use closed notifier");
+    }
+    return add_tree(tree_dir{-1, path, "", events}).handle_exception([this, path] (std::exception_ptr ex) {
+        // Drop what was watched before the failure
+        for (auto& [t, d] : _tree) {
+            if (d.root == t && d.path == path) {
+                remove_tree(t, "");
+                break;
+            }
+        }
+        return make_exception_future<watch_token>(std::move(ex));
+    });
+}
 
-        while (p < e) {
-            auto ev = reinterpret_cast<const ::inotify_event*>(p);
-            if (ev->wd == me->_close_dummy && me->_close_dummy != -1) {
-                me->_fd.close();                
+void seastar::fsnotifier::impl::parse(const char* p, const char* e, batch& b, bool coalesce) {
+    while (p < e) {
+        auto ev = reinterpret_cast<const ::inotify_event*>(p);
+        p += sizeof(::inotify_event) + ev->len;
+        if (ev->wd == _close_dummy && _close_dummy != -1) {
+            _fd.close();
+            return;
+        }
+        auto mask = flags(ev->mask);
+        auto name = ev->len != 0 ? sstring(ev->name) : sstring{};
+        auto id = ev->wd;
+        auto t = _tree.find(ev->wd);
+        if (t != _tree.end()) {
+            auto& dir = t->second;
+            auto is_root = dir.root == ev->wd;
+            if ((mask & flags::ignored) != flags{}) {
+                _tree.erase(t);
+                if (!is_root) {
+                    continue;
+                }
             } else {
-                events.emplace_back(event {
-                    ev->wd, flags(ev->mask), ev->cookie,
-                    ev->len != 0 ? sstring(ev->name) : sstring{}
-                });
+                if ((mask & flags::is_dir) != flags{} && !name.empty()) {
+                    if ((mask & (flags::create_child | flags::move_to)) != flags{}) {
+                        b.new_dirs.push_back(tree_dir{dir.root, dir.path + "/" + name, dir.rel + name + "/", dir.mask});
+                    } else if ((mask & flags::move_from) != flags{}) {
+                        // Moved out of the tree, or back in, below another name
+                        remove_tree(dir.root, dir.rel + name + "/");
+                    }
+                }
+                // Only the root reports on itself
+                if (!is_root && name.empty()) {
+                    continue;
+                }
+                // Drop what was only asked for to follow the tree
+                mask = mask & (dir.mask | flags::is_dir | flags::ignored | flags::queue_overflow);
+                if ((mask & ~(flags::is_dir)) == flags{}) {
+                    continue;
+                }
+                id = dir.root;
+                name = dir.rel + name;
+            }
+        }
+        if (coalesce && ev->cookie == 0 && (mask & ~(coalescible | flags::is_dir)) == flags{}) {
+            auto [i, inserted] = b.coalesced.emplace(std::make_pair(id, name), b.events.size());
+            if (!inserted) {
+                b.events[i->second].mask |= mask;
+                continue;
             }
-            p += sizeof(::inotify_event) + ev->len;
         }
+        b.events.emplace_back(event{id, mask, ev->cookie, std::move(name)});
+    }
+}
 
-        return events;
+// Reads the events which are queued, without waiting, until there are no
+// more or enough
+void seastar::fsnotifier::impl::drain(batch& b, const wait_options& opts) {
+    while (active() && b.events.size() < opts.max_events) {
+        auto n = ::read(_fd, b.buf.get_write(), b.buf.size());
+        if (n <= 0) {
+            throw_system_error_on(n == -1 && errno != EAGAIN, "could not read inotify events");
+            return;
+        }
+        parse(b.buf.get(), b.buf.get() + n, b, opts.coalesce_window.count() != 0);
+    }
+}
+
+seastar::future<std::vector<seastar::fsnotifier::event>> seastar::fsnotifier::impl::wait(wait_options opts) {
+    // be paranoid about buffer alignment
+    auto buf = temporary_buffer<char>::aligned(std::max(alignof(::inotify_event), alignof(int64_t)),
+            std::max(opts.buffer_size, sizeof(::inotify_event) + NAME_MAX + 1));
+    auto f = _fd.read_some(buf.get_write(), buf.size());
+    return f.then([me = shared_from_this(), buf = std::move(buf), opts](size_t n) mutable {
+        auto b = std::make_unique<batch>();
+        b->buf = std::move(buf);
+        me->parse(b->buf.get(), b->buf.get() + n, *b, opts.coalesce_window.count() != 0);
+        me->drain(*b, opts);
+        auto more = opts.coalesce_window.count() && me->active() && b->events.size() < opts.max_events
+                ? sleep(opts.coalesce_window).then([me, b = b.get(), opts] {
+                    me->drain(*b, opts);
+                })
+                : make_ready_future<>();
+        return more.then([me, b = b.get()] {
+            return do_for_each(b->new_dirs, [me] (tree_dir& d) {
+                return me->_tree.contains(d.root) ? me->add_tree(std::move(d)).discard_result() : make_ready_future<>();
+            });
+        }).then([b = std::move(b)] () mutable {
+            return std::move(b->events);
+        });
     });
 }
 
@@ -138,8 +320,18 @@ seastar::future<seastar::fsnotifier::watch> seastar::fsnotifier::create_watch(co
     });
 }
 
+seastar::future<seastar::fsnotifier::watch> seastar::fsnotifier::create_recursive_watch(const sstring& path, flags events) {
+    return _impl->create_recursive_watch(path, events).then([this](watch_token token) {
+        return watch(_impl, token);
+    });
+}
+
 seastar::future<std::vector<seastar::fsnotifier::event>> seastar::fsnotifier::wait() const {
-    return _impl->wait();
+    return _impl->wait(wait_options{});
+}
+
+seastar::future<std::vector<seastar::fsnotifier::event>> seastar::fsnotifier::wait(wait_options opts) const {
+    return _impl->wait(opts);
 }
 
 void seastar::fsnotifier::shutdown() {
@@ -21,6 +21,8 @@
 
 #pragma once
 
+#include <chrono>
+#include <limits>
 #include <memory>
 #include <sys/inotify.h>
 
@@ -78,6 +80,8 @@ class fsnotifier {
                                         // DIR results if pathname is not a directory.  Using this
                                         // flag provides an application with a race-free way of
                                         // ensuring that the monitored object is a directory.
+        is_dir = IN_ISDIR,              // Set in events: the subject of the event is a directory.
+        queue_overflow = IN_Q_OVERFLOW, // Event queue overflowed, events were lost (id is -1).
     };
 
     using watch_token = int32_t;
@@ -117,6 +121,16 @@ class fsnotifier {
     // events specified in mask 
     future<watch> create_watch(const sstring& path, flags mask);
 
+    // create a watch point for the directory tree at path: the
+    // directory and all directories below it, including those
+    // created or moved in later, produce the events specified in
+    // mask. Events of the tree all carry the token of the returned
+    // watch, and the path of their subject relative to path as name.
+    // Directories created between being listed and watched may miss
+    // events; and a directory of the tree must not also be watched on
+    // its own, as inotify has a single watch per inode.
+    future<watch> create_recursive_watch(const sstring& path, flags mask);
+
     // a watch event. 
     struct event {
         // matches source watch
@@ -127,8 +141,21 @@ class fsnotifier {
         sstring name; // optional file name, in case of move_from/to
     };
 
-    // wait for events
+    struct wait_options {
+        // size of the reads of the event queue
+        size_t buffer_size = 64 << 10;
+        // once the first events arrive, keep reading events for this
+        // long before returning them, and coalesce repeated modify,
+        // attrib, access, open and close events of the same entry into one,
+        // whose mask holds all of them
+        std::chrono::milliseconds coalesce_window{0};
+        // return once this many events have been read
+        size_t max_events = std::numeric_limits<size_t>::max();
+    };
+
+    // wait for events, and return all that are queued
     future<std::vector<event>> wait() const;
+    future<std::vector<event>> wait(wait_options opts) const;
 
     // shutdown notifier and abort any event wait.
     // all watches are invalidated, and no new ones can be
@@ -142,20 +169,24 @@ class fsnotifier {
     }
 };
 
-inline fsnotifier::flags operator|(fsnotifier::flags a, fsnotifier::flags b) {
+inline constexpr fsnotifier::flags operator|(fsnotifier::flags a, fsnotifier::flags b) {
     return fsnotifier::flags(std::underlying_type_t<fsnotifier::flags>(a) | std::underlying_type_t<fsnotifier::flags>(b));
 }
 
-inline void operator|=(fsnotifier::flags& a, fsnotifier::flags b) {
+inline constexpr void operator|=(fsnotifier::flags& a, fsnotifier::flags b) {
     a = (a | b);
 }
 
-inline fsnotifier::flags operator&(fsnotifier::flags a, fsnotifier::flags b) {
+inline constexpr fsnotifier::flags operator&(fsnotifier::flags a, fsnotifier::flags b) {
     return fsnotifier::flags(std::underlying_type_t<fsnotifier::flags>(a) & std::underlying_type_t<fsnotifier::flags>(b));
 }
 
-inline void operator&=(fsnotifier::flags& a, fsnotifier::flags b) {
+inline constexpr void operator&=(fsnotifier::flags& a, fsnotifier::flags b) {
     a = (a & b);
 }
 
+inline constexpr fsnotifier::flags operator~(fsnotifier::flags a) {
+    return fsnotifier::flags(~std::underlying_type_t<fsnotifier::flags>(a));
+}
+
 }
\ No newline at end of file
@@ -59,6 +59,29 @@ static inline T select_buffer_size(T configured_value, T maximum_value) noexcept
     }
 }
 
+namespace {
+
+struct read_ahead_budget {
+    size_t limit = std::numeric_limits<size_t>::max();
+    size_t in_flight = 0;
+};
+
+// Indexed by io_priority_class id, classes without a budget set are not tracked
+thread_local std::vector<read_ahead_budget> read_ahead_budgets;
+
+read_ahead_budget* find_read_ahead_budget(const io_priority_class& pc) noexcept {
+    return pc.id() < read_ahead_budgets.size() ? &read_ahead_budgets[pc.id()] : nullptr;
+}
+
+}
+
+void set_read_ahead_budget(const io_priority_class& pc, size_t bytes) {
+    if (pc.id() >= read_ahead_budgets.size()) {
+        read_ahead_budgets.resize(pc.id() + 1);
+    }
+    read_ahead_budgets[pc.id()].limit = bytes;
+}
+
 class file_data_source_impl : public data_source_impl {
     struct issued_read {
         uint64_t _pos;
@@ -82,7 +105,15 @@ class file_data_source_impl : public data_source_impl {
     size_t _current_buffer_size;
     bool _in_slow_start = false;
     io_intent _intent;
+    // Access pattern detection, see file_input_stream_options::adaptive_read_ahead
+    enum class access_pattern { unknown, sequential, random };
+    access_pattern _pattern = access_pattern::unknown;
+    uint64_t _last_skip = 0;
+    unsigned _sequential_gets = 0;
     using unused_ratio_target = std::ratio<25, 100>;
+    // Consecutive gets with no skips in between that make a random
+    // stream sequential again
+    static constexpr unsigned sequential_gets_threshold = 2;
 private:
     size_t minimal_buffer_size() const {
         return std::min(std::max(_options.buffer_size / 4, size_t(8192)), _options.buffer_size);
@@ -100,7 +131,28 @@ class file_data_source_impl : public data_source_impl {
             }
         }
     }
+    void adapt_read_ahead_on_get() {
+        if (_pattern == access_pattern::random && ++_sequential_gets < sequential_gets_threshold) {
+            return;
+        }
+        _pattern = access_pattern::sequential;
+        _current_read_ahead = std::min(std::max(_current_read_ahead * 2, 1u), _options.read_ahead);
+    }
+    void adapt_read_ahead_on_skip(uint64_t n) {
+        // Skipping the same small distance again and again is a strided
+        // access, the read-ahead still brings in the data that is used
+        auto strided = n == _last_skip && n < _current_buffer_size;
+        _last_skip = n;
+        if (!strided) {
+            _pattern = access_pattern::random;
+            _sequential_gets = 0;
+            _current_read_ahead = 0;
+        }
+    }
     unsigned get_initial_read_ahead() const {
+        if (_options.adaptive_read_ahead) {
+            return 0;
+        }
         return _options.dynamic_adjustments
                ? std::min(_options.dynamic_adjustments->read_ahead, _options.read_ahead)
                : !!_options.read_ahead;
@@ -205,7 +257,9 @@ class file_data_source_impl : public data_source_impl {
         assert(_reads_in_progress == 0);
     }
     virtual future<temporary_buffer<char>> get() override {
-        if (!_read_buffers.empty() && !_read_buffers.front()._ready.available()) {
+        if (_options.adaptive_read_ahead) {
+            adapt_read_ahead_on_get();
+        } else if (!_read_buffers.empty() && !_read_buffers.front()._ready.available()) {
             try_increase_read_ahead();
         }
         issue_read_aheads(1);
@@ -221,6 +275,9 @@ class file_data_source_impl : public data_source_impl {
         return std::move(ret._ready);
     }
     virtual future<temporary_buffer<char>> skip(uint64_t n) override {
+        if (_options.adaptive_read_ahead && n) {
+            adapt_read_ahead_on_skip(n);
+        }
         uint64_t dropped = 0;
         while (n) {
             if (_read_buffers.empty()) {
@@ -275,6 +332,7 @@ class file_data_source_impl : public data_source_impl {
         }
         auto ra = _current_read_ahead + additional;
         _read_buffers.reserve(ra); // prevent push_back() failure
+        auto budget = find_read_ahead_budget(_options.io_priority_class);
         while (_read_buffers.size() < ra) {
             if (!_remain) {
                 if (_read_buffers.size() >= additional) {
@@ -283,7 +341,6 @@ class file_data_source_impl : public data_source_impl {
                 _read_buffers.emplace_back(_pos, 0, make_ready_future<temporary_buffer<char>>());
                 continue;
             }
-            ++_reads_in_progress;
             // if _pos is not dma-aligned, we'll get a short read.  Account for that.
             // Also avoid reading beyond _remain.
             uint64_t align = _file.disk_read_dma_alignment();
@@ -291,11 +348,24 @@ class file_data_source_impl : public data_source_impl {
             auto end = std::min(align_up(start + _current_buffer_size, align), _pos + _remain);
             auto len = end - start;
             auto actual_size = std::min(end - _pos, _remain);
+            size_t charged = 0;
+            if (budget && _read_buffers.size() >= additional) {
+                if (budget->in_flight + len > budget->limit) {
+                    _reactor._io_stats.fstream_read_aheads_throttled += 1;
+                    return;
+                }
+                budget->in_flight += len;
+                charged = len;
+            }
+            ++_reads_in_progress;
             _read_buffers.emplace_back(_pos, actual_size, futurize_invoke([&] {
                     return _file.dma_read_bulk<char>(start, len, _options.io_priority_class, &_intent);
             }).then_wrapped(
-                    [this, start, pos = _pos, remain = _remain] (future<temporary_buffer<char>> ret) {
+                    [this, start, pos = _pos, remain = _remain, charged] (future<temporary_buffer<char>> ret) {
                 --_reads_in_progress;
+                if (charged) {
+                    read_ahead_budgets[_options.io_priority_class.id()].in_flight -= charged;
+                }
                 if (_done && !_reads_in_progress) {
                     _done->set_value();
                 }
@@ -347,6 +417,41 @@ input_stream<char> make_file_input_stream(
     return make_file_input_stream(std::move(f), 0, std::move(options));
 }
 
+future<> data_sink_impl::put_file(file& f, uint64_t pos, uint64_t len) {
+    return do_with(file_data_source(f, pos, len, file_input_stream_options{}), [this] (data_source& src) {
+        return repeat([this, &src] {
+            return src.get().then([this] (temporary_buffer<char> buf) {
+                if (buf.empty()) {
+                    return make_ready_future<stop_iteration>(stop_iteration::yes);
+                }
+                return put(std::move(buf)).then([] {
+                    return stop_iteration::no;
+                });
+            });
+        }).finally([&src] {
+            return src.close();
+        });
+    });
+}
+
+
+namespace {
+
+// Memory held by coalescing file sinks in buffers not yet written
+thread_local semaphore write_behind_memory{semaphore::max_counter()};
+thread_local size_t write_behind_memory_limit = semaphore::max_counter();
+
+}
+
+void set_write_behind_memory_limit(size_t bytes) {
+    bytes = std::clamp<size_t>(bytes, 1, semaphore::max_counter());
+    if (bytes > write_behind_memory_limit) {
+        write_behind_memory.signal(bytes - write_behind_memory_limit);
+    } else {
+        write_behind_memory.consume(write_behind_memory_limit - bytes);
+    }
+    write_behind_memory_limit = bytes;
+}
 
 class file_data_sink_impl : public data_sink_impl {
     file _file;
@@ -355,6 +460,11 @@ class file_data_sink_impl : public data_sink_impl {
     semaphore _write_behind_sem = { _options.write_behind };
     future<> _background_writes_done = make_ready_future<>();
     bool _failed = false;
+    // Buffers gathered for the next write, see file_output_stream_options::coalesce_size
+    std::vector<temporary_buffer<char>> _batch;
+    uint64_t _batch_pos = 0;
+    size_t _batch_size = 0;
+    semaphore_units<> _batch_memory{write_behind_memory, 0};
 public:
     file_data_sink_impl(file f, file_output_stream_options options)
             : _file(std::move(f)), _options(options) {
@@ -363,28 +473,40 @@ class file_data_sink_impl : public data_sink_impl {
     }
     future<> put(net::packet data) override { abort(); }
     virtual temporary_buffer<char> allocate_buffer(size_t size) override {
-        return temporary_buffer<char>::aligned(_file.memory_dma_alignment(), size);
+        return engine().allocate_dma_buffer(_file.memory_dma_alignment(), size);
     }
     using data_sink_impl::put;
     virtual future<> put(temporary_buffer<char> buf) override {
         uint64_t pos = _pos;
         _pos += buf.size();
-        if (!_options.write_behind) {
+        if (_options.coalesce_size) {
+            return coalesce(pos, std::move(buf));
+        }
+        return write_behind([this, pos, buf = std::move(buf)] () mutable {
             return do_put(pos, std::move(buf));
+        });
+    }
+private:
+    // Issues the write produced by the writer, in the background if
+    // write-behind is enabled
+    template <typename Writer>
+    future<> write_behind(Writer writer) {
+        if (!_options.write_behind) {
+            return writer();
         }
         // Write behind strategy:
         //
         // 1. Issue N writes in parallel, using a semaphore to limit to N
         // 2. Collect results in _background_writes_done, merging exception futures
         // 3. If we've already seen a failure, don't issue more writes.
-        return _write_behind_sem.wait().then([this, pos, buf = std::move(buf)] () mutable {
+        return _write_behind_sem.wait().then([this, writer = std::move(writer)] () mutable {
             if (_failed) {
                 _write_behind_sem.signal();
                 auto ret = std::move(_background_writes_done);
                 _background_writes_done = make_ready_future<>();
                 return ret;
             }
-            auto this_write_done = do_put(pos, std::move(buf)).finally([this] {
+            auto this_write_done = writer().finally([this] {
                 _write_behind_sem.signal();
             });
             _background_writes_done = when_all(std::move(_background_writes_done), std::move(this_write_done))
@@ -405,7 +527,99 @@ class file_data_sink_impl : public data_sink_impl {
             return make_ready_future<>();
         });
     }
-private:
+
+    future<> coalesce(uint64_t pos, temporary_buffer<char> buf) {
+        auto units = std::min(buf.size(), write_behind_memory_limit);
+        auto mem = try_get_units(write_behind_memory, units);
+        if (!mem) {
+            // Write back what we hold, so that waiting for others doesn't
+            // wait for ourselves
+            return put_batch().then([this, pos, units, buf = std::move(buf)] () mutable {
+                return get_units(write_behind_memory, units).then([this, pos, buf = std::move(buf)] (semaphore_units<> mem) mutable {
+                    return add_to_batch(pos, std::move(buf), std::move(mem));
+                });
+            });
+        }
+        return add_to_batch(pos, std::move(buf), std::move(*mem));
+    }
+
+    future<> add_to_batch(uint64_t pos, temporary_buffer<char> buf, semaphore_units<> mem) {
+        if (_batch.empty()) {
+            _batch_pos = pos;
+        }
+        // Only the last buffer may be unaligned, see do_put()
+        bool aligned = (buf.size() & (_file.disk_write_dma_alignment() - 1)) == 0;
+        _batch_size += buf.size();
+        _batch.push_back(std::move(buf));
+        _batch_memory.adopt(std::move(mem));
+        if (_batch_size >= _options.coalesce_size || !aligned || _batch.size() >= IOV_MAX) {
+            return put_batch();
+        }
+        return make_ready_future<>();
+    }
+
+    future<> put_batch() {
+        if (_batch.empty()) {
+            return make_ready_future<>();
+        }
+        auto pos = _batch_pos;
+        _batch_size = 0;
+        return write_behind([this, pos, bufs = std::exchange(_batch, {}), mem = std::move(_batch_memory)] () mutable {
+            return do_put_batch(pos, std::move(bufs), std::move(mem));
+        });
+    }
+
+    future<> do_put_batch(uint64_t pos, std::vector<temporary_buffer<char>> bufs, semaphore_units<> mem) noexcept {
+      try {
+        if (bufs.size() == 1) {
+            return do_put(pos, std::move(bufs.front())).finally([mem = std::move(mem)] {});
+        }
+        assert(!(pos & (_file.disk_write_dma_alignment() - 1)));
+        bool truncate = false;
+        auto& last = bufs.back();
+        if ((last.size() & (_file.disk_write_dma_alignment() - 1)) != 0) {
+            auto tmp = allocate_buffer(align_up(last.size(), _file.disk_write_dma_alignment()));
+            ::memcpy(tmp.get_write(), last.get(), last.size());
+            ::memset(tmp.get_write() + last.size(), 0, tmp.size() - last.size());
+            last = std::move(tmp);
+            truncate = true;
+        }
+        std::vector<iovec> iov;
+        iov.reserve(bufs.size());
+        size_t len = 0;
+        for (auto& b : bufs) {
+            iov.push_back({ b.get_write(), b.size() });
+            len += b.size();
+        }
+        return _file.dma_write(pos, std::move(iov), _options.io_priority_class).then(
+                [this, pos, len, truncate, bufs = std::move(bufs), mem = std::move(mem)] (size_t size) mutable {
+            if (size < len) {
+                // short write, put the rest one by one
+                auto written = size;
+                auto it = bufs.begin();
+                while (written >= it->size()) {
+                    written -= it->size();
+                    ++it;
+                }
+                it->trim_front(written);
+                return do_for_each(it, bufs.end(), [this, pos = pos + size] (temporary_buffer<char>& b) mutable {
+                    auto p = pos;
+                    pos += b.size();
+                    return do_put(p, std::move(b));
+                }).then([this, truncate] {
+                    return truncate ? _file.truncate(_pos) : make_ready_future<>();
+                }).finally([bufs = std::move(bufs), mem = std::move(mem)] {});
+            }
+            if (truncate) {
+                return _file.truncate(_pos);
+            }
+            return make_ready_future<>();
+        });
+      } catch (...) {
+          return make_exception_future<>(std::current_exception());
+      }
+    }
+
     future<> do_put(uint64_t pos, temporary_buffer<char> buf) noexcept {
       try {
         // put() must usually be of chunks multiple of file::dma_alignment.
@@ -460,12 +674,20 @@ class file_data_sink_impl : public data_sink_impl {
     }
 public:
     virtual future<> flush() override {
-        return wait().then([this] {
+        return put_batch().then([this] {
+            return wait();
+        }).then([this] {
             return _file.flush();
         });
     }
     virtual future<> close() noexcept override {
-        return wait().finally([this] {
+        return futurize_invoke([this] {
+            return put_batch();
+        }).then_wrapped([this] (future<> f) {
+            return wait().then([f = std::move(f)] () mutable {
+                return std::move(f);
+            });
+        }).finally([this] {
             return _file.close();
         });
     }
@@ -22,6 +22,7 @@
 #include <seastar/core/future.hh>
 #include <seastar/core/reactor.hh>
 #include <seastar/core/thread.hh>
+#include <seastar/core/internal/wakeup_batch.hh>
 #include <seastar/core/report_exception.hh>
 #include <seastar/util/backtrace.hh>
 
@@ -53,6 +54,24 @@ namespace internal {
 
 static_assert(std::is_empty<uninitialized_wrapper<std::tuple<>>>::value, "This should still be empty");
 
+thread_local continuation_cache local_continuation_cache;
+
+void drain_continuation_cache() noexcept {
+    auto& c = local_continuation_cache;
+    for (unsigned idx = 0; idx < continuation_cache::nr_size_classes; ++idx) {
+        while (auto obj = c.free[idx]) {
+            c.free[idx] = obj->next;
+            ::operator delete(obj, (idx + 1) * continuation_cache::granularity);
+        }
+        c.count[idx] = 0;
+    }
+}
+
+wakeup_stats& get_wakeup_stats() noexcept {
+    static thread_local wakeup_stats stats;
+    return stats;
+}
+
 void promise_base::move_it(promise_base&& x) noexcept {
     // Don't use std::exchange to make sure x's values are nulled even
     // if &x == this.
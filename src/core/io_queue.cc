@@ -31,9 +31,13 @@
 #include <seastar/core/linux-aio.hh>
 #include <seastar/core/internal/io_desc.hh>
 #include <seastar/core/internal/io_sink.hh>
+#include <seastar/core/internal/log_histogram.hh>
 #include <seastar/core/io_priority_class.hh>
+#include <seastar/core/io_trace.hh>
+#include <seastar/core/bitops.hh>
 #include <seastar/util/log.hh>
 #include <chrono>
+#include <cmath>
 #include <mutex>
 #include <array>
 #include <fmt/format.h>
@@ -51,6 +55,50 @@ static constexpr auto io_direction_write = io_direction_and_length::write_idx;
 
 static fair_queue_ticket make_ticket(io_direction_and_length dnl, const io_queue::config& cfg) noexcept;
 
+static_assert(std::is_same_v<io_queue::clock_type, io_trace_entry::clock_type>);
+
+// The last requests of the shard, over all of its queues
+struct io_trace_ring {
+    std::vector<io_trace_entry> entries;
+    size_t next = 0;
+    uint64_t recorded = 0;
+
+    bool enabled() const noexcept { return !entries.empty(); }
+
+    void record(const io_trace_entry& e) noexcept {
+        entries[next] = e;
+        next = (next + 1) % entries.size();
+        recorded++;
+    }
+};
+
+static thread_local io_trace_ring trace_ring;
+
+void set_io_trace_size(size_t entries) {
+    trace_ring = io_trace_ring{};
+    trace_ring.entries.resize(entries);
+}
+
+io_trace get_io_trace(bool reset) {
+    io_trace ret;
+    ret.shard = this_shard_id();
+    auto& r = trace_ring;
+    auto size = r.entries.size();
+    if (r.recorded > size) {
+        ret.dropped = r.recorded - size;
+        ret.entries.reserve(size);
+        ret.entries.insert(ret.entries.end(), r.entries.begin() + r.next, r.entries.end());
+        ret.entries.insert(ret.entries.end(), r.entries.begin(), r.entries.begin() + r.next);
+    } else {
+        ret.entries.assign(r.entries.begin(), r.entries.begin() + r.recorded);
+    }
+    if (reset) {
+        r.next = 0;
+        r.recorded = 0;
+    }
+    return ret;
+}
+
 struct default_io_exception_factory {
     static auto cancelled() {
         return cancelled_error();
@@ -83,6 +131,8 @@ struct io_group::priority_class_data {
     }
 };
 
+using internal::latency_histogram;
+
 class io_queue::priority_class_data {
     io_queue& _queue;
     const io_priority_class _pc;
@@ -95,7 +145,7 @@ class io_queue::priority_class_data {
             ops++;
             bytes += len;
         }
-    } _rwstat[2] = {}, _splits = {};
+    } _rwstat[2] = {}, _splits = {}, _merges = {}, _aborted = {}, _wasted = {};
     uint32_t _nr_queued;
     uint32_t _nr_executing;
     std::chrono::duration<double> _queue_time;
@@ -103,6 +153,10 @@ class io_queue::priority_class_data {
     std::chrono::duration<double> _total_execution_time;
     std::chrono::duration<double> _starvation_time;
     io_queue::clock_type::time_point _activated;
+    // 2 buckets per octave, up to ~16 seconds
+    using histogram_type = latency_histogram<1, 50>;
+    histogram_type _queue_latency;
+    histogram_type _exec_latency;
 
     io_group::priority_class_data& _group;
     size_t _replenish_head;
@@ -156,6 +210,7 @@ class io_queue::priority_class_data {
         _rwstat[dnl.rw_idx()].add(dnl.length());
         _queue_time = lat;
         _total_queue_time += lat;
+        _queue_latency.add(lat);
         _nr_queued--;
         _nr_executing++;
         if (_nr_executing == 1) {
@@ -178,6 +233,7 @@ class io_queue::priority_class_data {
 
     void on_complete(std::chrono::duration<double> lat) noexcept {
         _total_execution_time += lat;
+        _exec_latency.add(lat);
         _nr_executing--;
         if (_nr_executing == 0 && _nr_queued != 0) {
             _activated = io_queue::clock_type::now();
@@ -195,27 +251,207 @@ class io_queue::priority_class_data {
         _splits.add(dnl.length());
     }
 
+    void on_merge(io_direction_and_length dnl) noexcept {
+        _merges.add(dnl.length());
+    }
+
+    // A dispatched request was cancelled and the device either
+    // didn't do it (aborted) or had done it already (wasted)
+    void on_dispatched_cancel(io_direction_and_length dnl, bool aborted) noexcept {
+        (aborted ? _aborted : _wasted).add(dnl.length());
+        on_error();
+    }
+
     fair_queue::class_id fq_class() const noexcept { return _pc.id(); }
 
     std::vector<seastar::metrics::impl::metric_definition_impl> metrics();
     metrics::metric_groups metric_groups;
 };
 
-class io_desc_read_write final : public io_completion {
+/*
+ * Closed-loop control of the group rate against the in-disk latency.
+ *
+ * The rates the group is configured with are measured once by iotune, but
+ * devices degrade over time (SSD garbage collection, noisy neighbours on
+ * cloud disks) and then requests dispatched at the configured rate just pile
+ * up inside the disk. Every shard collects execution latencies into a
+ * histogram and once per period publishes its 99th percentile
+ * into the group. The shard that owns the group takes the worst of them and
+ * derates the fair groups' replenish rate multiplicatively when it's above
+ * the target, and gives the rate back in small steps when it's comfortably
+ * below, never exceeding the configured rate.
+ */
+class io_queue::latency_controller {
+    static constexpr auto period = std::chrono::milliseconds(100);
+    static constexpr uint64_t min_samples = 32;
+    static constexpr double max_decrease = 0.5;
+    static constexpr double increase_step = 0.05;
+    static constexpr double relax_ratio = 0.8;
+    static constexpr double min_scale = 0.05;
+
+    io_queue& _queue;
+    const double _target_us;
+    // 4 buckets per octave, up to ~16 seconds
+    latency_histogram<2, 96> _histogram;
+    uint64_t _p99_us = 0;
+    uint64_t _derates = 0;
+    uint64_t _uprates = 0;
+    timer<lowres_clock> _timer;
+    metrics::metric_groups _metrics;
+
+    io_group& group() const noexcept { return *_queue._group; }
+
+    void tick() noexcept {
+        _p99_us = _histogram.count() >= min_samples ? _histogram.percentile(0.99) : 0;
+        _histogram.reset();
+        group()._shard_latency[this_shard_id()].store(_p99_us, std::memory_order_relaxed);
+        if (group()._allocated_on == this_shard_id()) {
+            adjust();
+        }
+    }
+
+    void adjust() noexcept {
+        uint64_t worst = 0;
+        for (auto& l : group()._shard_latency) {
+            worst = std::max(worst, l.load(std::memory_order_relaxed));
+        }
+        if (worst == 0) {
+            return;
+        }
+
+        auto scale = rate_scale();
+        auto prev = scale;
+        if (worst > _target_us) {
+            scale = std::max(scale * std::max(_target_us / worst, max_decrease), min_scale);
+            _derates++;
+        } else if (worst < _target_us * relax_ratio && scale < 1.0) {
+            scale = std::min(scale + increase_step, 1.0);
+            _uprates++;
+        }
+        if (scale != prev) {
+            for (auto& fg : group()._fgs) {
+                fg->set_rate_scale(scale);
+            }
+            io_log.debug("dev {} : p99 latency {}us (target {}us), rate scale {:.2f} -> {:.2f}",
+                    _queue.dev_id(), worst, _target_us, prev, scale);
+        }
+    }
+
+public:
+    latency_controller(io_queue& q, std::chrono::duration<double> target)
+        : _queue(q)
+        , _target_us(target.count() * 1e6)
+        , _timer([this] { tick(); })
+    {
+        namespace sm = seastar::metrics;
+        auto owner_l = sm::shard_label(this_shard_id());
+        auto mnt_l = sm::label("mountpoint")(_queue.mountpoint());
+        _metrics.add_group("io_queue", {
+            sm::make_gauge("latency_feedback_p99", [this] { return _p99_us * 1e-6; },
+                    sm::description("99th percentile of in-disk latency over the last feedback period, seconds"), {owner_l, mnt_l}),
+            sm::make_gauge("latency_feedback_target", [this] { return _target_us * 1e-6; },
+                    sm::description("Target 99th percentile of in-disk latency, seconds"), {owner_l, mnt_l}),
+            sm::make_gauge("latency_feedback_rate_scale", [this] { return rate_scale(); },
+                    sm::description("Ratio of the current dispatch rate to the configured one, lower than 1 when the disk is derated"), {owner_l, mnt_l}),
+            sm::make_counter("latency_feedback_derates", _derates,
+                    sm::description("Number of times the dispatch rate was lowered to hold the latency target"), {owner_l, mnt_l}),
+            sm::make_counter("latency_feedback_uprates", _uprates,
+                    sm::description("Number of times the dispatch rate was raised back towards the configured one"), {owner_l, mnt_l}),
+        });
+        _timer.arm_periodic(period);
+    }
+
+    double rate_scale() const noexcept {
+        return group()._fgs[0]->rate_scale();
+    }
+
+    void account(std::chrono::duration<double> lat) noexcept {
+        _histogram.add(lat);
+    }
+};
+
+static bool is_aborted_io(std::exception_ptr eptr) noexcept {
+    try {
+        std::rethrow_exception(std::move(eptr));
+    } catch (const std::system_error& e) {
+        return e.code() == std::error_code(ECANCELED, std::system_category());
+    } catch (...) {
+        return false;
+    }
+}
+
+class io_desc_read_write final : public io_completion, public internal::dispatched_request {
     io_queue& _ioq;
     io_queue::priority_class_data& _pclass;
     io_queue::clock_type::time_point _ts;
+    const io_queue::clock_type::time_point _queued;
+    const uint64_t _pos;
     const stream_id _stream;
     const io_direction_and_length _dnl;
-    const fair_queue_ticket _fq_ticket;
+    fair_queue_ticket _fq_ticket;
     promise<size_t> _pr;
     iovec_keeper _iovs;
+    // Contiguous reads merged into this one, in file order. They are
+    // accounted in their classes, but they take the queue capacity of
+    // this request.
+    std::vector<io_desc_read_write*> _merged;
+    // The intent was cancelled after the request had been dispatched
+    bool _cancelled = false;
+
+    // _ts is the dispatch time once the request is dispatched
+    void trace(io_trace_entry::outcome result, size_t bytes, bool dispatched = true) noexcept {
+        if (trace_ring.enabled()) {
+            trace_ring.record(io_trace_entry{
+                .queued = _queued,
+                .dispatched = dispatched ? _ts : io_queue::clock_type::time_point(),
+                .completed = io_queue::clock_type::now(),
+                .dev = _ioq.dev_id(),
+                .priority_class = _pclass.fq_class(),
+                .write = _dnl.rw_idx() == io_direction_write,
+                .result = result,
+                .pos = _pos,
+                .length = _dnl.length(),
+                .bytes = bytes,
+            });
+        }
+    }
+
+    void complete_merged(size_t res, std::chrono::duration<double> lat) noexcept {
+        io_log.trace("dev {} : req {} complete merged", _ioq.dev_id(), fmt::ptr(this));
+        trace(io_trace_entry::outcome::completed, res);
+        _pclass.on_complete(lat);
+        _pr.set_value(res);
+        delete this;
+    }
+
+    void fail_merged(std::exception_ptr eptr) noexcept {
+        io_log.trace("dev {} : req {} error merged", _ioq.dev_id(), fmt::ptr(this));
+        trace(io_trace_entry::outcome::failed, 0);
+        _pclass.on_error();
+        _pr.set_exception(std::move(eptr));
+        delete this;
+    }
+
+    void complete_cancelled(bool aborted) noexcept {
+        io_log.trace("dev {} : req {} {} after cancel", _ioq.dev_id(), fmt::ptr(this), aborted ? "aborted" : "completed");
+        trace(io_trace_entry::outcome::cancelled, 0);
+        _pclass.on_dispatched_cancel(_dnl, aborted);
+        if (aborted) {
+            _ioq.complete_aborted_request(*this);
+        } else {
+            _ioq.complete_request(*this);
+        }
+        _pr.set_exception(std::make_exception_ptr(default_io_exception_factory::cancelled()));
+        delete this;
+    }
 
 public:
-    io_desc_read_write(io_queue& ioq, io_queue::priority_class_data& pc, stream_id stream, io_direction_and_length dnl, fair_queue_ticket ticket, iovec_keeper iovs)
+    io_desc_read_write(io_queue& ioq, io_queue::priority_class_data& pc, stream_id stream, uint64_t pos, io_direction_and_length dnl, fair_queue_ticket ticket, iovec_keeper iovs)
         : _ioq(ioq)
         , _pclass(pc)
         , _ts(io_queue::clock_type::now())
+        , _queued(_ts)
+        , _pos(pos)
         , _stream(stream)
         , _dnl(dnl)
         , _fq_ticket(ticket)
@@ -225,7 +461,15 @@ class io_desc_read_write final : public io_completion {
     }
 
     virtual void set_exception(std::exception_ptr eptr) noexcept override {
+        if (_cancelled) {
+            complete_cancelled(is_aborted_io(std::move(eptr)));
+            return;
+        }
         io_log.trace("dev {} : req {} error", _ioq.dev_id(), fmt::ptr(this));
+        trace(io_trace_entry::outcome::failed, 0);
+        for (auto* m : _merged) {
+            m->fail_merged(eptr);
+        }
         _pclass.on_error();
         _ioq.complete_request(*this);
         _pr.set_exception(eptr);
@@ -233,27 +477,72 @@ class io_desc_read_write final : public io_completion {
     }
 
     virtual void complete(size_t res) noexcept override {
+        if (_cancelled) {
+            complete_cancelled(false);
+            return;
+        }
         io_log.trace("dev {} : req {} complete", _ioq.dev_id(), fmt::ptr(this));
         auto now = io_queue::clock_type::now();
-        _pclass.on_complete(std::chrono::duration_cast<std::chrono::duration<double>>(now - _ts));
+        auto lat = std::chrono::duration_cast<std::chrono::duration<double>>(now - _ts);
+        // Short merged read: whoever's data is beyond the end gets less
+        auto left = res;
+        res = std::min(left, _dnl.length());
+        left -= res;
+        trace(io_trace_entry::outcome::completed, res);
+        for (auto* m : _merged) {
+            auto r = std::min(left, m->_dnl.length());
+            left -= r;
+            m->complete_merged(r, lat);
+        }
+        _pclass.on_complete(lat);
+        _ioq.account_execution_latency(lat);
         _ioq.complete_request(*this);
         _pr.set_value(res);
         delete this;
     }
 
     void cancel() noexcept {
+        // Requests with intents are never merged
+        assert(_merged.empty());
+        trace(io_trace_entry::outcome::cancelled, 0, false);
         _pclass.on_cancel();
         _pr.set_exception(std::make_exception_ptr(default_io_exception_factory::cancelled()));
         delete this;
     }
 
+    virtual void on_intent_cancelled() noexcept override {
+        io_log.trace("dev {} : req {} cancel dispatched", _ioq.dev_id(), fmt::ptr(this));
+        _cancelled = true;
+        engine().cancel_io(this);
+    }
+
     void dispatch() noexcept {
         io_log.trace("dev {} : req {} submit", _ioq.dev_id(), fmt::ptr(this));
         auto now = io_queue::clock_type::now();
         _pclass.on_dispatch(_dnl, std::chrono::duration_cast<std::chrono::duration<double>>(now - _ts));
         _ts = now;
+        for (auto* m : _merged) {
+            m->dispatch();
+        }
+    }
+
+    void merge(void* address, std::unique_ptr<io_desc_read_write> desc, void* desc_address, fair_queue_ticket ticket) {
+        _iovs.reserve(_iovs.size() + (_merged.empty() ? 2 : 1));
+        _merged.reserve(_merged.size() + 1);
+        if (_merged.empty()) {
+            _iovs.push_back({ address, _dnl.length() });
+        }
+        io_log.trace("dev {} : req {} merge req {} len {}", _ioq.dev_id(), fmt::ptr(this), fmt::ptr(desc.get()), desc->_dnl.length());
+        _iovs.push_back({ desc_address, desc->_dnl.length() });
+        desc->_pclass.on_merge(desc->_dnl);
+        _merged.push_back(desc.release());
+        _fq_ticket = ticket;
     }
 
+    bool merged() const noexcept { return !_merged.empty(); }
+    iovec_keeper& iovecs() noexcept { return _iovs; }
+    io_queue::priority_class_data& pclass() const noexcept { return _pclass; }
+
     future<size_t> get_future() {
         return _pr.get_future();
     }
@@ -268,6 +557,8 @@ class queued_io_request : private internal::io_request {
     fair_queue_entry _fq_entry;
     internal::cancellable_queue::link _intent;
     std::unique_ptr<io_desc_read_write> _desc;
+    size_t _length;
+    bool _mergeable = false;
 
     bool is_cancelled() const noexcept { return !_desc; }
 
@@ -275,9 +566,10 @@ class queued_io_request : private internal::io_request {
     queued_io_request(internal::io_request req, io_queue& q, io_queue::priority_class_data& pc, io_direction_and_length dnl, iovec_keeper iovs)
         : io_request(std::move(req))
         , _ioq(q)
-        , _stream(_ioq.request_stream(dnl))
+        , _stream(_ioq.request_stream(dnl, pos()))
         , _fq_entry(make_ticket(dnl, _ioq.get_config()))
-        , _desc(std::make_unique<io_desc_read_write>(_ioq, pc, _stream, dnl, _fq_entry.ticket(), std::move(iovs)))
+        , _desc(std::make_unique<io_desc_read_write>(_ioq, pc, _stream, pos(), dnl, _fq_entry.ticket(), std::move(iovs)))
+        , _length(dnl.length())
     {
     }
 
@@ -290,12 +582,32 @@ class queued_io_request : private internal::io_request {
             return;
         }
 
-        _intent.maybe_dequeue();
+        if (auto cq = _intent.maybe_dequeue()) {
+            cq->track_dispatched(*_desc);
+        }
+        if (_mergeable) {
+            _ioq.forget_mergeable_read(*this);
+        }
+        if (_desc->merged()) {
+            static_cast<io_request&>(*this) = io_request::make_readv(io_request::fd(), io_request::pos(), _desc->iovecs(), io_request::nowait_works());
+        }
         _desc->dispatch();
         _ioq.submit_request(_desc.release(), std::move(*this));
         delete this;
     }
 
+    // Appends the read that starts right where this one ends
+    void merge(std::unique_ptr<io_desc_read_write> desc, void* address, size_t len, fair_queue_ticket ticket) {
+        _desc->merge(io_request::address(), std::move(desc), address, ticket);
+        _length += len;
+    }
+
+    int fd() const noexcept { return io_request::fd(); }
+    uint64_t pos() const noexcept { return io_request::pos(); }
+    size_t length() const noexcept { return _length; }
+    io_queue::priority_class_data& pclass() const noexcept { return _desc->pclass(); }
+    void set_mergeable(bool v) noexcept { _mergeable = v; }
+
     void cancel() noexcept {
         _ioq.cancel_request(*this);
         _desc.release()->cancel();
@@ -322,7 +634,8 @@ namespace internal {
 
 cancellable_queue::cancellable_queue(cancellable_queue&& o) noexcept
         : _first(std::exchange(o._first, nullptr))
-        , _rest(std::move(o._rest)) {
+        , _rest(std::move(o._rest))
+        , _dispatched(std::move(o._dispatched)) {
     if (_first != nullptr) {
         _first->_ref = this;
     }
@@ -332,6 +645,7 @@ cancellable_queue& cancellable_queue::operator=(cancellable_queue&& o) noexcept
     if (this != &o) {
         _first = std::exchange(o._first, nullptr);
         _rest = std::move(o._rest);
+        _dispatched = std::move(o._dispatched);
         if (_first != nullptr) {
             _first->_ref = this;
         }
@@ -344,6 +658,9 @@ cancellable_queue::~cancellable_queue() {
         queued_io_request::from_cq_link(*_first).cancel();
         pop_front();
     }
+    _dispatched.clear_and_dispose([] (dispatched_request* r) {
+        r->on_intent_cancelled();
+    });
 }
 
 void cancellable_queue::push_back(link& il) noexcept {
@@ -369,7 +686,13 @@ void cancellable_queue::pop_front() noexcept {
 }
 
 intent_reference::intent_reference(io_intent* intent) noexcept : _intent(intent) {
-    if (_intent != nullptr) {
+    if (_intent == nullptr) {
+        return;
+    }
+    if (intent->_as && intent->_as->abort_requested()) {
+        // Requests made after the abort are cancelled right away
+        on_cancel();
+    } else {
         intent->_refs.bind(*this);
     }
 }
@@ -390,25 +713,29 @@ void io_sink::submit(io_completion* desc, io_request req) noexcept {
     }
 }
 
-std::vector<io_request::part> io_request::split(size_t max_length) {
+std::vector<io_request::part> io_request::split(size_t max_length, size_t boundary) {
     if (_op == operation::read || _op == operation::write) {
-        return split_buffer(max_length);
+        return split_buffer(max_length, boundary);
     }
     if (_op == operation::readv || _op == operation::writev) {
-        return split_iovec(max_length);
+        return split_iovec(max_length, boundary);
     }
 
     seastar_logger.error("Invalid operation for split: {}", static_cast<int>(_op));
     std::abort();
 }
 
-std::vector<io_request::part> io_request::split_buffer(size_t max_length) {
+static size_t part_length_at(uint64_t pos, size_t max_length, size_t boundary) noexcept {
+    return boundary == 0 ? max_length : std::min<size_t>(max_length, boundary - pos % boundary);
+}
+
+std::vector<io_request::part> io_request::split_buffer(size_t max_length, size_t boundary) {
     std::vector<part> ret;
-    ret.reserve((_size.len + max_length - 1) / max_length);
+    ret.reserve((_size.len + max_length - 1) / max_length + (boundary != 0));
 
     size_t off = 0;
     do {
-        size_t len = std::min(_size.len - off, max_length);
+        size_t len = std::min(_size.len - off, part_length_at(_attr.pos + off, max_length, boundary));
         io_request part(_op, _fd, _attr.pos + off, _ptr.addr + off, len, _nowait_works);
         ret.push_back({ std::move(part), len, {} });
         off += len;
@@ -417,14 +744,15 @@ std::vector<io_request::part> io_request::split_buffer(size_t max_length) {
     return ret;
 }
 
-std::vector<io_request::part> io_request::split_iovec(size_t max_length) {
+std::vector<io_request::part> io_request::split_iovec(size_t max_length, size_t boundary) {
     std::vector<part> parts;
     std::vector<::iovec> vecs;
     ::iovec* cur = iov();
     size_t pos = 0;
     size_t off = 0;
     ::iovec* end = cur + iov_len();
-    size_t remaining = max_length;
+    size_t length = part_length_at(_attr.pos, max_length, boundary);
+    size_t remaining = length;
 
     while (cur != end) {
         ::iovec iov;
@@ -446,15 +774,16 @@ std::vector<io_request::part> io_request::split_iovec(size_t max_length) {
         }
 
         io_request req(_op, _fd, _attr.pos + pos, vecs.data(), vecs.size(), _nowait_works);
-        parts.push_back({ std::move(req), max_length, std::move(vecs) });
-        pos += max_length;
-        remaining = max_length;
+        parts.push_back({ std::move(req), length, std::move(vecs) });
+        pos += length;
+        length = part_length_at(_attr.pos + pos, max_length, boundary);
+        remaining = length;
     }
 
     if (vecs.size() > 0) {
-        assert(remaining < max_length);
+        assert(remaining < length);
         io_request req(_op, _fd, _attr.pos + pos, vecs.data(), vecs.size(), _nowait_works);
-        parts.push_back({ std::move(req), max_length - remaining, std::move(vecs) });
+        parts.push_back({ std::move(req), length - remaining, std::move(vecs) });
     }
 
     return parts;
@@ -468,6 +797,18 @@ io_queue::complete_request(io_desc_read_write& desc) noexcept {
     _streams[desc.stream()].notify_request_finished(desc.ticket());
 }
 
+void
+io_queue::complete_aborted_request(io_desc_read_write& desc) noexcept {
+    _requests_executing--;
+    _streams[desc.stream()].notify_request_aborted(desc.ticket());
+}
+
+void io_queue::account_execution_latency(std::chrono::duration<double> lat) noexcept {
+    if (_latency_controller) {
+        _latency_controller->account(lat);
+    }
+}
+
 fair_queue::config io_queue::make_fair_queue_config(const config& iocfg, sstring label) {
     fair_queue::config cfg;
     cfg.label = label;
@@ -480,13 +821,21 @@ io_queue::io_queue(io_group_ptr group, internal::io_sink& sink)
     , _sink(sink)
 {
     auto& cfg = get_config();
-    if (cfg.duplex) {
-        static_assert(internal::io_direction_and_length::write_idx == 0);
-        _streams.emplace_back(*_group->_fgs[0], make_fair_queue_config(cfg, "write"));
-        static_assert(internal::io_direction_and_length::read_idx == 1);
-        _streams.emplace_back(*_group->_fgs[1], make_fair_queue_config(cfg, "read"));
-    } else {
-        _streams.emplace_back(*_group->_fgs[0], make_fair_queue_config(cfg, "rw"));
+    for (unsigned m = 0; m < cfg.stripe_members; m++) {
+        // Members' streams go one after another, see request_stream()
+        sstring suffix = cfg.stripe_members > 1 ? format("-{}", m) : sstring();
+        if (cfg.duplex) {
+            static_assert(internal::io_direction_and_length::write_idx == 0);
+            _streams.emplace_back(*_group->_fgs[m * 2], make_fair_queue_config(cfg, "write" + suffix));
+            static_assert(internal::io_direction_and_length::read_idx == 1);
+            _streams.emplace_back(*_group->_fgs[m * 2 + 1], make_fair_queue_config(cfg, "read" + suffix));
+        } else {
+            _streams.emplace_back(*_group->_fgs[m], make_fair_queue_config(cfg, "rw" + suffix));
+        }
+    }
+
+    if (cfg.latency_target.count() > 0) {
+        _latency_controller = std::make_unique<latency_controller>(*this, cfg.latency_target);
     }
 
     if (this_shard_id() == 0) {
@@ -515,8 +864,9 @@ fair_group::config io_group::make_fair_group_config(const io_queue::config& qcfg
     cfg.min_size = std::min(io_queue::read_request_base_count, qcfg.disk_blocks_write_to_read_multiplier);
     cfg.limit_min_weight = std::max(io_queue::read_request_base_count, qcfg.disk_req_write_to_read_multiplier);
     cfg.limit_min_size = std::max(io_queue::read_request_base_count, qcfg.disk_blocks_write_to_read_multiplier) * qcfg.block_count_limit_min;
-    cfg.weight_rate = qcfg.req_count_rate;
-    cfg.size_rate = qcfg.blocks_count_rate;
+    // Members of a striped volume share its throughput evenly
+    cfg.weight_rate = qcfg.req_count_rate / qcfg.stripe_members;
+    cfg.size_rate = qcfg.blocks_count_rate / qcfg.stripe_members;
     cfg.rate_factor = qcfg.rate_factor;
     cfg.rate_limit_duration = qcfg.rate_limit_duration;
     return cfg;
@@ -531,13 +881,25 @@ static void maybe_warn_latency_goal_auto_adjust(const fair_group& fg, const io_q
 io_group::io_group(io_queue::config io_cfg)
     : _config(std::move(io_cfg))
     , _allocated_on(this_shard_id())
+    , _shard_latency(_config.latency_target.count() > 0 ? smp::count : 0)
 {
+    if (_config.stripe_members == 0 || (_config.stripe_members > 1 &&
+            (_config.stripe_size == 0 || _config.stripe_size % (1 << io_queue::block_size_shift) != 0))) {
+        throw std::runtime_error(fmt::format("Bad stripe configuration {}x{} for io group", _config.stripe_members, _config.stripe_size));
+    }
+
     auto fg_cfg = make_fair_group_config(_config);
-    _fgs.push_back(std::make_unique<fair_group>(fg_cfg));
-    maybe_warn_latency_goal_auto_adjust(*_fgs.back(), io_cfg);
-    if (_config.duplex) {
+    for (unsigned m = 0; m < _config.stripe_members; m++) {
         _fgs.push_back(std::make_unique<fair_group>(fg_cfg));
-        maybe_warn_latency_goal_auto_adjust(*_fgs.back(), io_cfg);
+        if (m == 0) {
+            maybe_warn_latency_goal_auto_adjust(*_fgs.back(), io_cfg);
+        }
+        if (_config.duplex) {
+            _fgs.push_back(std::make_unique<fair_group>(fg_cfg));
+            if (m == 0) {
+                maybe_warn_latency_goal_auto_adjust(*_fgs.back(), io_cfg);
+            }
+        }
     }
 
     /*
@@ -571,6 +933,12 @@ io_group::io_group(io_queue::config io_cfg)
             _max_request_length[io_direction_read],
             _max_request_length[io_direction_write],
             _config.req_count_rate, _config.blocks_count_rate);
+    if (_config.stripe_members > 1) {
+        seastar_logger.info("IO group dev({}) is striped over {} members by {} bytes", _config.devid, _config.stripe_members, _config.stripe_size);
+    }
+    if (_config.latency_target.count() > 0) {
+        seastar_logger.info("IO group dev({}) adapts its rate to {:.2f}ms latency target", _config.devid, _config.latency_target.count() * 1000);
+    }
 }
 
 io_group::~io_group() {
@@ -695,12 +1063,30 @@ std::vector<seastar::metrics::impl::metric_definition_impl> io_queue::priority_c
                     sm::description("Total number of requests split")),
             sm::make_counter("total_split_bytes", _splits.bytes,
                     sm::description("Total number of bytes split")),
+            sm::make_counter("total_merged_ops", _merges.ops,
+                    sm::description("Total number of reads merged into adjacent ones")),
+            sm::make_counter("total_merged_bytes", _merges.bytes,
+                    sm::description("Total number of bytes in reads merged into adjacent ones")),
+            sm::make_counter("total_aborted_ops", _aborted.ops,
+                    sm::description("Total number of dispatched requests aborted by intent cancellation")),
+            sm::make_counter("total_aborted_bytes", _aborted.bytes,
+                    sm::description("Total number of bytes in dispatched requests aborted by intent cancellation")),
+            sm::make_counter("total_wasted_ops", _wasted.ops,
+                    sm::description("Total number of requests executed after their intent was cancelled")),
+            sm::make_counter("total_wasted_bytes", _wasted.bytes,
+                    sm::description("Total number of bytes in requests executed after their intent was cancelled")),
             sm::make_counter("total_delay_sec", [this] {
                     return _total_queue_time.count();
                 }, sm::description("Total time spent in the queue")),
             sm::make_counter("total_exec_sec", [this] {
                     return _total_execution_time.count();
                 }, sm::description("Total time spent in disk")),
+            sm::make_histogram("queue_latency", sm::description("Histogram of the time requests spent in the queue, in seconds"), [this] {
+                    return _queue_latency.to_metrics_histogram();
+                }),
+            sm::make_histogram("disk_latency", sm::description("Histogram of the time requests spent in disk, in seconds"), [this] {
+                    return _exec_latency.to_metrics_histogram();
+                }),
             sm::make_counter("starvation_time_sec", [this] {
                 auto st = _starvation_time;
                 if (_nr_queued != 0 && _nr_executing == 0) {
@@ -803,8 +1189,14 @@ io_group::priority_class_data& io_group::find_or_create_class(io_priority_class
     return *_priority_classes[id];
 }
 
-stream_id io_queue::request_stream(io_direction_and_length dnl) const noexcept {
-    return get_config().duplex ? dnl.rw_idx() : 0;
+stream_id io_queue::request_stream(io_direction_and_length dnl, uint64_t pos) const noexcept {
+    const auto& cfg = get_config();
+    stream_id s = cfg.duplex ? dnl.rw_idx() : 0;
+    if (cfg.stripe_members > 1) {
+        auto member = (pos / cfg.stripe_size) % cfg.stripe_members;
+        s += member * (cfg.duplex ? 2 : 1);
+    }
+    return s;
 }
 
 fair_queue_ticket make_ticket(io_direction_and_length dnl, const io_queue::config& cfg) noexcept {
@@ -838,12 +1230,22 @@ future<size_t> io_queue::queue_one_request(const io_priority_class& pc, io_direc
         // First time will hit here, and then we create the class. It is important
         // that we create the shared pointer in the same shard it will be used at later.
         auto& pclass = find_or_create_class(pc);
+        bool mergeable = intent == nullptr && req.opcode() == internal::io_request::operation::read && get_config().max_read_merge_length != 0;
+        if (mergeable) {
+            auto it = _mergeable_reads.find(read_merge_key{req.fd(), req.pos(), pclass.fq_class()});
+            if (it != _mergeable_reads.end() && can_merge_read(*it->second, dnl)) {
+                return merge_read(*it->second, pclass, dnl, std::move(req));
+            }
+        }
         auto queued_req = std::make_unique<queued_io_request>(std::move(req), *this, pclass, std::move(dnl), std::move(iovs));
         auto fut = queued_req->get_future();
         if (intent != nullptr) {
             auto& cq = intent->find_or_create_cancellable_queue(dev_id(), pc.id());
             queued_req->set_intent(cq);
         }
+        if (mergeable) {
+            queued_req->set_mergeable(_mergeable_reads.emplace(read_merge_key{queued_req->fd(), queued_req->pos() + queued_req->length(), pclass.fq_class()}, queued_req.get()).second);
+        }
 
         _streams[queued_req->stream()].queue(pclass.fq_class(), queued_req->queue_entry());
         queued_req.release();
@@ -853,20 +1255,64 @@ future<size_t> io_queue::queue_one_request(const io_priority_class& pc, io_direc
     });
 }
 
+size_t io_queue::read_merge_key_hash::operator()(const read_merge_key& k) const noexcept {
+    return std::hash<uint64_t>()(k.pos) ^ (size_t(k.fd) << 32) ^ k.class_id;
+}
+
+bool io_queue::can_merge_read(const queued_io_request& head, io_direction_and_length dnl) const noexcept {
+    const auto& cfg = get_config();
+    auto len = head.length() + dnl.length();
+    if (len > cfg.max_read_merge_length || len > _group->_max_request_length[io_direction_read]) {
+        return false;
+    }
+    // Don't merge across members of a striped volume
+    return cfg.stripe_members <= 1 || head.pos() % cfg.stripe_size + len <= cfg.stripe_size;
+}
+
+future<size_t> io_queue::merge_read(queued_io_request& head, priority_class_data& pclass, io_direction_and_length dnl, internal::io_request req) {
+    auto desc = std::make_unique<io_desc_read_write>(*this, pclass, head.stream(), head.pos() + head.length(), dnl, fair_queue_ticket(), iovec_keeper());
+    auto fut = desc->get_future();
+    auto old_key = read_merge_key{head.fd(), head.pos() + head.length(), pclass.fq_class()};
+    auto ticket = make_ticket(io_direction_and_length(io_direction_read, head.length() + dnl.length()), get_config());
+    head.merge(std::move(desc), req.address(), dnl.length(), ticket);
+    // No exceptions from now on, the read is in
+    _streams[head.stream()].update_queued_entry(head.queue_entry(), ticket);
+    pclass.on_queue();
+    _mergeable_reads.erase(old_key);
+    try {
+        _mergeable_reads.emplace(read_merge_key{head.fd(), head.pos() + head.length(), pclass.fq_class()}, &head);
+    } catch (...) {
+        head.set_mergeable(false);
+    }
+    return fut;
+}
+
+void io_queue::forget_mergeable_read(queued_io_request& req) noexcept {
+    auto it = _mergeable_reads.find(read_merge_key{req.fd(), req.pos() + req.length(), req.pclass().fq_class()});
+    if (it != _mergeable_reads.end() && it->second == &req) {
+        _mergeable_reads.erase(it);
+    }
+}
+
 future<size_t> io_queue::queue_request(const io_priority_class& pc, io_direction_and_length dnl, internal::io_request req, io_intent* intent, iovec_keeper iovs) noexcept {
     size_t max_length = _group->_max_request_length[dnl.rw_idx()];
+    // Requests to striped volumes must fit into a single member's stripe
+    size_t stripe = get_config().stripe_members > 1 ? get_config().stripe_size : 0;
 
-    if (__builtin_expect(dnl.length() <= max_length, true)) {
+    if (__builtin_expect(dnl.length() <= max_length, true) &&
+            (stripe == 0 || req.pos() % stripe + dnl.length() <= stripe)) {
         return queue_one_request(pc, dnl, std::move(req), intent, std::move(iovs));
     }
 
     std::vector<internal::io_request::part> parts;
     lw_shared_ptr<std::vector<future<size_t>>> p;
+    std::vector<size_t> lengths;
 
     try {
-        parts = req.split(max_length);
+        parts = req.split(max_length, stripe);
         p = make_lw_shared<std::vector<future<size_t>>>();
         p->reserve(parts.size());
+        lengths.reserve(parts.size());
         find_or_create_class(pc).on_split(dnl);
         engine()._io_stats.aio_outsizes++;
     } catch (...) {
@@ -876,21 +1322,23 @@ future<size_t> io_queue::queue_request(const io_priority_class& pc, io_direction
     // No exceptions from now on. If queue_one_request fails it will resolve
     // into exceptional future which will be picked up by when_all() below
     for (auto&& part : parts) {
+        lengths.push_back(part.size);
         auto f = queue_one_request(pc, io_direction_and_length(dnl.rw_idx(), part.size), std::move(part.req), intent, std::move(part.iovecs));
         p->push_back(std::move(f));
     }
 
-    return when_all(p->begin(), p->end()).then([p, max_length] (auto results) {
+    return when_all(p->begin(), p->end()).then([p, lengths = std::move(lengths)] (auto results) {
         bool prev_ok = true;
         size_t total = 0;
         std::exception_ptr ex;
 
-        for (auto&& res : results) {
+        for (size_t i = 0; i < results.size(); i++) {
+            auto& res = results[i];
             if (!res.failed()) {
                 if (prev_ok) {
                     size_t sz = res.get0();
                     total += sz;
-                    prev_ok &= (sz == max_length);
+                    prev_ok &= (sz == lengths[i]);
                 }
             } else {
                 if (!ex) {
@@ -0,0 +1,81 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#include <seastar/core/io_trace.hh>
+#include <seastar/core/smp.hh>
+#include <seastar/http/httpd.hh>
+#include <seastar/http/function_handlers.hh>
+#include <ostream>
+#include <sstream>
+#include <sys/sysmacros.h>
+
+namespace seastar {
+
+static const char* to_string(io_trace_entry::outcome o) noexcept {
+    switch (o) {
+    case io_trace_entry::outcome::completed: return "completed";
+    case io_trace_entry::outcome::failed: return "failed";
+    case io_trace_entry::outcome::cancelled: return "cancelled";
+    }
+    return "unknown";
+}
+
+void write_io_trace(std::ostream& os, const io_trace& trace) {
+    using std::chrono::duration_cast;
+    using std::chrono::microseconds;
+    for (auto& e : trace.entries) {
+        auto dispatched = e.dispatched == io_trace_entry::clock_type::time_point() ? e.completed : e.dispatched;
+        os << trace.shard << ' ' << major(e.dev) << ':' << minor(e.dev) << ' ' << e.priority_class
+           << ' ' << (e.write ? 'W' : 'R') << ' ' << e.pos << ' ' << e.length
+           << ' ' << to_string(e.result) << ' ' << e.bytes
+           << ' ' << duration_cast<microseconds>(e.queued.time_since_epoch()).count()
+           << ' ' << duration_cast<microseconds>(dispatched - e.queued).count()
+           << ' ' << duration_cast<microseconds>(e.completed - dispatched).count() << '\n';
+    }
+}
+
+future<std::vector<io_trace>> get_io_traces(bool reset) {
+    return do_with(std::vector<io_trace>(smp::count), [reset] (std::vector<io_trace>& traces) {
+        return smp::invoke_on_all([&traces, reset] {
+            // Each shard writes its own element
+            traces[this_shard_id()] = get_io_trace(reset);
+        }).then([&traces] {
+            return std::move(traces);
+        });
+    });
+}
+
+future<> add_io_trace_route(httpd::http_server& server, sstring path) {
+    server._routes.put(httpd::GET, path, new httpd::function_handler([] (std::unique_ptr<httpd::request> req, std::unique_ptr<httpd::reply> rep) {
+        bool reset = req->get_query_param("reset") == "true";
+        return get_io_traces(reset).then([rep = std::move(rep)] (std::vector<io_trace> traces) mutable {
+            std::ostringstream os;
+            for (auto& trace : traces) {
+                write_io_trace(os, trace);
+            }
+            rep->write_body("txt", sstring(os.str()));
+            return std::move(rep);
+        });
+    }, "txt"));
+    return make_ready_future<>();
+}
+
+}
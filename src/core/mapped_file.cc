@@ -0,0 +1,135 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#include <seastar/core/mapped_file.hh>
+#include <seastar/core/align.hh>
+#include <seastar/core/posix.hh>
+#include <seastar/core/reactor.hh>
+#include <seastar/core/sstring.hh>
+#include "core/syscall_result.hh"
+#include "core/thread_pool.hh"
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <vector>
+
+namespace seastar {
+
+void mapped_file::unmap() noexcept {
+    if (_data) {
+        ::munmap(const_cast<char*>(_data), _size);
+    }
+}
+
+static size_t page_size() noexcept {
+    static const size_t size = ::sysconf(_SC_PAGESIZE);
+    return size;
+}
+
+future<mapped_file> mapped_file::map(std::string_view name, bool populate) noexcept {
+    // open() and mmap() can block on the file system, and with
+    // MAP_POPULATE read the whole file
+    return engine()._thread_pool->submit<syscall_result_extra<std::pair<void*, size_t>>>([name = sstring(name), populate] {
+        std::pair<void*, size_t> mapping{nullptr, 0};
+        int fd = ::open(name.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+            return wrap_syscall(fd, mapping);
+        }
+        struct stat st;
+        int r = ::fstat(fd, &st);
+        if (r != -1 && st.st_size) {
+            auto addr = ::mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED | (populate ? MAP_POPULATE : 0), fd, 0);
+            if (addr == MAP_FAILED) {
+                r = -1;
+            } else {
+                mapping = {addr, size_t(st.st_size)};
+            }
+        }
+        auto ret = wrap_syscall(r, mapping);
+        ::close(fd);
+        return ret;
+    }, populate ? thread_pool::lane::slow : thread_pool::lane::regular).then([] (syscall_result_extra<std::pair<void*, size_t>> sr) {
+        sr.throw_if_error();
+        return mapped_file(static_cast<const char*>(sr.extra.first), sr.extra.second);
+    });
+}
+
+future<mapped_file> mapped_file::open(std::string_view name) noexcept {
+    return map(name, false);
+}
+
+future<mapped_file> mapped_file::open_populated(std::string_view name) noexcept {
+    return map(name, true);
+}
+
+future<> mapped_file::prefault(uint64_t pos, uint64_t len) noexcept {
+    if (pos >= _size || !len) {
+        return make_ready_future<>();
+    }
+    len = std::min<uint64_t>(len, _size - pos);
+    auto start = align_down<uintptr_t>(reinterpret_cast<uintptr_t>(_data) + pos, page_size());
+    auto end = reinterpret_cast<uintptr_t>(_data) + pos + len;
+    return engine()._thread_pool->submit<syscall_result<int>>([start, end] {
+        auto addr = reinterpret_cast<void*>(start);
+#ifdef MADV_POPULATE_READ
+        auto r = ::madvise(addr, end - start, MADV_POPULATE_READ);
+        if (r == 0 || errno != EINVAL) {
+            return wrap_syscall(r);
+        }
+#endif
+        // Older kernels: start readahead of the whole range, then wait
+        // for each page by touching it
+        ::madvise(addr, end - start, MADV_WILLNEED);
+        for (auto p = start; p < end; p += page_size()) {
+            (void)*reinterpret_cast<const volatile char*>(p);
+        }
+        return wrap_syscall(0);
+    }, thread_pool::lane::slow).then([] (syscall_result<int> sr) {
+        sr.throw_if_error();
+    });
+}
+
+bool mapped_file::resident(uint64_t pos, uint64_t len) const {
+    if (pos >= _size || !len) {
+        return true;
+    }
+    len = std::min<uint64_t>(len, _size - pos);
+    auto start = align_down<uintptr_t>(reinterpret_cast<uintptr_t>(_data) + pos, page_size());
+    auto end = reinterpret_cast<uintptr_t>(_data) + pos + len;
+    std::vector<unsigned char> vec((end - start + page_size() - 1) / page_size());
+    throw_system_error_on(::mincore(reinterpret_cast<void*>(start), end - start, vec.data()) == -1, "mincore");
+    for (auto v : vec) {
+        if (!(v & 1)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint64_t mapped_file::major_faults() noexcept {
+    struct ::rusage ru;
+    ::getrusage(RUSAGE_THREAD, &ru);
+    return ru.ru_majflt;
+}
+
+}
@@ -61,7 +61,10 @@
 #include <seastar/util/log.hh>
 #include <seastar/core/aligned_buffer.hh>
 #include <unordered_set>
+#include <cmath>
 #include <iostream>
+#include <fstream>
+#include <random>
 #include <thread>
 
 #include <dlfcn.h>
@@ -145,6 +148,7 @@ __thread volatile int critical_alloc_section = 0;
 #include <cstring>
 #include <boost/intrusive/list.hpp>
 #include <sys/mman.h>
+#include <unistd.h>
 #include <seastar/util/backtrace.hh>
 
 #ifdef SEASTAR_HAVE_NUMA
@@ -156,6 +160,7 @@ namespace seastar {
 struct allocation_site {
     mutable size_t count = 0; // number of live objects allocated at backtrace.
     mutable size_t size = 0; // amount of bytes in live objects allocated at backtrace.
+    mutable size_t snapshot_size = 0; // estimated size at the last snapshot_allocation_sites()
     mutable const allocation_site* next = nullptr;
     saved_backtrace backtrace;
 
@@ -195,7 +200,7 @@ using allocation_site_ptr = const allocation_site*;
 namespace memory {
 
 [[gnu::unused]]
-static allocation_site_ptr get_allocation_site();
+static allocation_site_ptr get_allocation_site(size_t size);
 
 static void on_allocation_failure(size_t size);
 
@@ -356,6 +361,9 @@ class page_list {
     page& front(page* ary) { return ary[_front]; }
     page& back(page* ary) { return ary[_back]; }
     bool empty() const { return !_front; }
+    static page* next(page* ary, page& span) {
+        return span.link._next ? &ary[span.link._next] : nullptr;
+    }
     void erase(page* ary, page& span) {
         if (span.link._next) {
             ary[span.link._next].link._prev = span.link._prev;
@@ -409,7 +417,10 @@ class small_pool {
     ~small_pool();
     void* allocate();
     void deallocate(void* object);
+    unsigned allocate_batch(void** objects, unsigned n);
+    void deallocate_batch(void** objects, unsigned n);
     unsigned object_size() const { return _object_size; }
+    size_t free_count() const { return _free_count; }
     bool objects_page_aligned() const { return is_page_aligned(_object_size); }
     static constexpr unsigned size_to_idx(unsigned size);
     static constexpr unsigned idx_to_size(unsigned idx);
@@ -468,6 +479,21 @@ class small_pool_array {
 static constexpr size_t max_small_allocation
     = small_pool::idx_to_size(small_pool_array::nr_small_pools - 1);
 
+// A fixed-size stack of free objects of one small size class, in front of
+// the small_pool free list. Popping a pointer off an array avoids the
+// dependent load of the next link out of the (often cold) object itself;
+// the pool is refilled from, and drained to, in batches.
+struct small_pool_magazine {
+    static constexpr unsigned capacity = 32;
+    static constexpr unsigned batch = capacity / 2;
+    unsigned count = 0;
+    void* objects[capacity];
+};
+
+// Size classes up to this size get a magazine
+static constexpr size_t max_magazine_object_size = 64;
+static constexpr unsigned nr_small_pool_magazines = small_pool::size_to_idx(max_magazine_object_size) + 1;
+
 constexpr size_t object_size_with_alloc_site(size_t size) {
 #ifdef SEASTAR_HEAPPROF
     // For page-aligned sizes, allocation_site* lives in page::alloc_site, not with the object.
@@ -497,6 +523,19 @@ struct cross_cpu_free_item {
     cross_cpu_free_item* next;
 };
 
+// Objects freed by a reactor thread on behalf of another shard, waiting
+// to be handed over to the owner's xcpu_freelist as a single chain.
+struct cross_cpu_free_batch {
+    // Hand the batch over once it gets this long, rather than waiting for
+    // the next poll
+    static constexpr unsigned max_size = 64;
+    cross_cpu_free_item* head = nullptr;
+    cross_cpu_free_item* tail = nullptr;
+    unsigned size = 0;
+    // Whether the owner is in xcpu_pending_cpus
+    bool listed = false;
+};
+
 struct cpu_pages {
     uint32_t min_free_pages = 20000000 / page_size;
     char* memory;
@@ -507,11 +546,33 @@ struct cpu_pages {
     size_t large_allocation_warning_threshold = std::numeric_limits<size_t>::max();
     unsigned cpu_id = -1U;
     std::function<void (std::function<void ()>)> reclaim_hook;
-    std::vector<reclaimer*> reclaimers;
+    std::vector<reclaimer*> reclaimers; // by decreasing priority
+    memory_pressure pressure = memory_pressure::none;
+    // nr_free_pages bounds outside of which the pressure level changes;
+    // not checked until both are set by update_pressure()
+    uint32_t pressure_enter_pages = 0;
+    uint32_t pressure_leave_pages = std::numeric_limits<uint32_t>::max();
+    memory_pressure notified_pressure = memory_pressure::none;
+    bool pressure_notification_pending = false;
+    std::vector<memory_pressure_listener*> pressure_listeners;
+    std::vector<compactor*> compactors;
     static constexpr unsigned nr_span_lists = 32;
     page_list free_spans[nr_span_lists];  // contains aligned spans with span_size == 2^idx
+    // Bit idx is set iff free_spans[idx] is not empty, so that the best
+    // fitting list is found without walking the empty ones
+    uint32_t nonempty_span_lists = 0;
+    static_assert(nr_span_lists <= std::numeric_limits<decltype(nonempty_span_lists)>::digits);
+    // Spans handed out from free_spans, and times one was split to do so
+    uint64_t span_allocations = 0;
+    uint64_t span_splits = 0;
     small_pool_array small_pools;
+    small_pool_magazine magazines[nr_small_pool_magazines];
     alignas(seastar::cache_line_size) std::atomic<cross_cpu_free_item*> xcpu_freelist;
+    // Frees of other shards' objects made by this shard, per owner
+    cross_cpu_free_batch xcpu_pending[max_cpus];
+    // Owners with a non-empty xcpu_pending entry
+    uint16_t xcpu_pending_cpus[max_cpus];
+    unsigned nr_xcpu_pending_cpus = 0;
     static std::atomic<unsigned> cpu_id_gen;
     static cpu_pages* all_cpus[max_cpus];
     union asu {
@@ -523,6 +584,16 @@ struct cpu_pages {
     } asu;
     allocation_site_ptr alloc_site_list_head = nullptr; // For easy traversal of asu.alloc_sites from scylla-gdb.py
     bool collect_backtrace = false;
+    // Record one allocation per this many bytes on average, 0 to record all
+    size_t heapprof_sampling_interval = 0;
+    int64_t heapprof_bytes_until_sample = 0;
+    std::minstd_rand heapprof_rng;
+    static constexpr unsigned huge_page_pages = huge_page_size / page_size;
+    // Last sample of transparent_hugepage_memory()
+    size_t thp_memory = 0;
+    std::chrono::steady_clock::time_point thp_sampled;
+    // Intended NUMA placement of the memory, in order, as given to configure()
+    std::vector<resource::memory> numa_layout;
     char* mem() { return memory; }
 
     void link(page_list& list, page* span);
@@ -536,6 +607,7 @@ struct cpu_pages {
     void* allocate_large(unsigned nr_pages);
     void* allocate_large_aligned(unsigned align_pages, unsigned nr_pages);
     page* find_and_unlink_span(unsigned nr_pages);
+    page* pick_span(page_list& list, unsigned n_pages);
     page* find_and_unlink_span_reclaiming(unsigned n_pages);
     void free_large(void* ptr);
     bool grow_span(pageidx& start, uint32_t& nr_pages, unsigned idx);
@@ -543,11 +615,16 @@ struct cpu_pages {
     void free_span_no_merge(pageidx start, uint32_t nr_pages);
     void free_span_unaligned(pageidx start, uint32_t nr_pages);
     void* allocate_small(unsigned size);
+    void* allocate_from_magazine(unsigned idx);
+    void free_small(small_pool& pool, unsigned idx, void* ptr);
     void free(void* ptr);
     void free(void* ptr, size_t size);
     static bool try_foreign_free(void* ptr);
     void shrink(void* ptr, size_t new_size);
     static void free_cross_cpu(unsigned cpu_id, void* ptr);
+    static void push_cross_cpu(unsigned cpu_id, cross_cpu_free_item* head, cross_cpu_free_item* tail);
+    void queue_cross_cpu_free(unsigned cpu_id, void* ptr);
+    bool flush_cross_cpu_frees();
     bool drain_cross_cpu_freelist();
     size_t object_size(void* ptr);
     page* to_page(void* p) {
@@ -558,6 +635,14 @@ struct cpu_pages {
     bool initialize();
     reclaiming_result run_reclaimers(reclaimer_scope, size_t pages_to_reclaim);
     void schedule_reclaim();
+    uint32_t pressure_threshold(memory_pressure level) const;
+    void check_pressure() {
+        if (__builtin_expect(nr_free_pages < pressure_enter_pages || nr_free_pages >= pressure_leave_pages, false)) {
+            update_pressure();
+        }
+    }
+    void update_pressure();
+    void notify_pressure();
     void set_reclaim_hook(std::function<void (std::function<void ()>)> hook);
     void set_min_free_pages(size_t pages);
     void resize(size_t new_size, allocate_system_memory_fn alloc_sys_mem);
@@ -566,6 +651,24 @@ struct cpu_pages {
     void check_large_allocation(size_t size);
     void warn_large_allocation(size_t size);
     memory::memory_layout memory_layout();
+    size_t free_huge_pages();
+    size_t transparent_hugepage_memory();
+    // Calls fn(pool, span) for the first page of every span held by a
+    // small pool. fn must not allocate.
+    template <typename Func>
+    void for_each_small_pool_span(Func&& fn) {
+        for (pageidx i = 0; i < nr_pages;) {
+            auto& span = pages[i];
+            if (!span.span_size) {
+                ++i;
+                continue;
+            }
+            if (!span.free && span.pool) {
+                fn(*span.pool, span);
+            }
+            i += span.span_size;
+        }
+    }
     ~cpu_pages();
 };
 
@@ -575,6 +678,11 @@ cpu_pages* cpu_pages::all_cpus[max_cpus];
 
 static cpu_pages& get_cpu_mem();
 
+static int64_t next_heapprof_sample_distance(cpu_pages& cpu_mem) {
+    std::exponential_distribution<double> dist(1.0 / cpu_mem.heapprof_sampling_interval);
+    return int64_t(dist(cpu_mem.heapprof_rng)) + 1;
+}
+
 #ifdef SEASTAR_HEAPPROF
 
 void set_heap_profiling_enabled(bool enable) {
@@ -604,6 +712,18 @@ scoped_heap_profiling::~scoped_heap_profiling() {
     }
 }
 
+void set_heap_profiling_sampling_interval(size_t bytes) {
+    auto& cpu_mem = get_cpu_mem();
+    cpu_mem.heapprof_sampling_interval = bytes;
+    if (bytes) {
+        cpu_mem.heapprof_bytes_until_sample = next_heapprof_sample_distance(cpu_mem);
+    }
+}
+
+size_t get_heap_profiling_sampling_interval() {
+    return get_cpu_mem().heapprof_sampling_interval;
+}
+
 #else
 
 void set_heap_profiling_enabled(bool enable) {
@@ -618,6 +738,13 @@ scoped_heap_profiling::scoped_heap_profiling() noexcept {
 scoped_heap_profiling::~scoped_heap_profiling() {
 }
 
+void set_heap_profiling_sampling_interval(size_t) {
+}
+
+size_t get_heap_profiling_sampling_interval() {
+    return 0;
+}
+
 #endif
 
 // Smallest index i such that all spans stored in the index are >= pages.
@@ -632,11 +759,15 @@ unsigned index_of(unsigned pages) {
 void
 cpu_pages::unlink(page_list& list, page* span) {
     list.erase(pages, *span);
+    if (list.empty()) {
+        nonempty_span_lists &= ~(1u << (&list - free_spans));
+    }
 }
 
 void
 cpu_pages::link(page_list& list, page* span) {
     list.push_front(pages, *span);
+    nonempty_span_lists |= 1u << (&list - free_spans);
 }
 
 void cpu_pages::free_span_no_merge(uint32_t span_start, uint32_t nr_pages) {
@@ -674,6 +805,7 @@ void cpu_pages::free_span(uint32_t span_start, uint32_t nr_pages) {
         ++idx;
     }
     free_span_no_merge(span_start, nr_pages);
+    check_pressure();
 }
 
 // Internal, used during startup. Span is not aligned so needs to be broken up
@@ -694,21 +826,40 @@ cpu_pages::find_and_unlink_span(unsigned n_pages) {
     if (n_pages >= (2u << idx)) {
         return nullptr;
     }
-    while (idx < nr_span_lists && free_spans[idx].empty()) {
-        ++idx;
-    }
-    if (idx == nr_span_lists) {
+    auto candidates = idx < nr_span_lists ? nonempty_span_lists & (~0u << idx) : 0;
+    if (!candidates) {
         if (initialize()) {
             return find_and_unlink_span(n_pages);
         }
         return nullptr;
     }
+    idx = count_trailing_zeros(candidates);
     auto& list = free_spans[idx];
-    page* span = &list.front(pages);
+    page* span = pick_span(list, n_pages);
     unlink(list, span);
+    ++span_allocations;
     return span;
 }
 
+// Among the first few spans on the list, spans for requests smaller than a
+// huge page are taken from the lowest address, and larger ones from the
+// highest. Small allocations then pack into as few huge pages as possible,
+// and large ones keep whole huge pages to themselves, both of which let
+// transparent huge pages back more of the memory.
+page*
+cpu_pages::pick_span(page_list& list, unsigned n_pages) {
+    static constexpr unsigned max_candidates = 8;
+    bool small = n_pages < huge_page_pages;
+    page* best = &list.front(pages);
+    page* p = page_list::next(pages, *best);
+    for (unsigned i = 1; i < max_candidates && p; ++i, p = page_list::next(pages, *p)) {
+        if (small ? p < best : p > best) {
+            best = p;
+        }
+    }
+    return best;
+}
+
 page*
 cpu_pages::find_and_unlink_span_reclaiming(unsigned n_pages) {
     while (true) {
@@ -723,6 +874,7 @@ cpu_pages::find_and_unlink_span_reclaiming(unsigned n_pages) {
 }
 
 void cpu_pages::maybe_reclaim() {
+    check_pressure();
     if (nr_free_pages < current_min_free_pages) {
         drain_cross_cpu_freelist();
         if (nr_free_pages < current_min_free_pages) {
@@ -752,13 +904,14 @@ cpu_pages::allocate_large_and_trim(unsigned n_pages) {
         span_size /= 2;
         auto other_span_idx = span_idx + span_size;
         free_span_no_merge(other_span_idx, span_size);
+        ++span_splits;
     }
     auto span_end = &pages[span_idx + span_size - 1];
     span->free = span_end->free = false;
     span->span_size = span_end->span_size = span_size;
     span->pool = nullptr;
 #ifdef SEASTAR_HEAPPROF
-    auto alloc_site = get_allocation_site();
+    auto alloc_site = get_allocation_site(span->span_size * page_size);
     span->alloc_site = alloc_site;
     if (alloc_site) {
         ++alloc_site->count;
@@ -813,10 +966,17 @@ saved_backtrace get_backtrace() noexcept {
 }
 
 static
-allocation_site_ptr get_allocation_site() {
+allocation_site_ptr get_allocation_site(size_t size) {
     if (!cpu_mem.is_initialized() || !cpu_mem.collect_backtrace) {
         return nullptr;
     }
+    if (cpu_mem.heapprof_sampling_interval) {
+        cpu_mem.heapprof_bytes_until_sample -= size;
+        if (cpu_mem.heapprof_bytes_until_sample > 0) {
+            return nullptr;
+        }
+        cpu_mem.heapprof_bytes_until_sample = next_heapprof_sample_distance(cpu_mem);
+    }
     disable_backtrace_temporarily dbt;
     allocation_site new_alloc_site;
     new_alloc_site.backtrace = get_backtrace();
@@ -847,12 +1007,12 @@ cpu_pages::allocate_small(unsigned size) {
     auto idx = small_pool::size_to_idx(size);
     auto& pool = small_pools[idx];
     assert(size <= pool.object_size());
-    auto ptr = pool.allocate();
+    auto ptr = idx < nr_small_pool_magazines ? allocate_from_magazine(idx) : pool.allocate();
 #ifdef SEASTAR_HEAPPROF
     if (!ptr) {
         return nullptr;
     }
-    allocation_site_ptr alloc_site = get_allocation_site();
+    allocation_site_ptr alloc_site = get_allocation_site(pool.object_size());
     if (alloc_site) {
         ++alloc_site->count;
         alloc_site->size += pool.object_size();
@@ -862,6 +1022,36 @@ cpu_pages::allocate_small(unsigned size) {
     return ptr;
 }
 
+inline
+void*
+cpu_pages::allocate_from_magazine(unsigned idx) {
+    auto& m = magazines[idx];
+    if (__builtin_expect(!m.count, false)) {
+        m.count = small_pools[idx].allocate_batch(m.objects, small_pool_magazine::batch);
+        if (!m.count) {
+            return nullptr;
+        }
+    }
+    return m.objects[--m.count];
+}
+
+inline
+void
+cpu_pages::free_small(small_pool& pool, unsigned idx, void* ptr) {
+    if (idx >= nr_small_pool_magazines) {
+        pool.deallocate(ptr);
+        return;
+    }
+    auto& m = magazines[idx];
+    if (__builtin_expect(m.count == small_pool_magazine::capacity, false)) {
+        // Hand back the older half, keep the recently freed (cache hot) half
+        pool.deallocate_batch(m.objects, small_pool_magazine::batch);
+        std::copy(m.objects + small_pool_magazine::batch, m.objects + m.count, m.objects);
+        m.count -= small_pool_magazine::batch;
+    }
+    m.objects[m.count++] = ptr;
+}
+
 void cpu_pages::free_large(void* ptr) {
     pageidx idx = (reinterpret_cast<char*>(ptr) - mem()) / page_size;
     page* span = &pages[idx];
@@ -891,21 +1081,64 @@ size_t cpu_pages::object_size(void* ptr) {
     }
 }
 
-void cpu_pages::free_cross_cpu(unsigned cpu_id, void* ptr) {
+void cpu_pages::push_cross_cpu(unsigned cpu_id, cross_cpu_free_item* head, cross_cpu_free_item* tail) {
     if (!live_cpus[cpu_id].load(std::memory_order_relaxed)) {
         // Thread was destroyed; leak object
         // should only happen for boost unit-tests.
         return;
     }
-    auto p = reinterpret_cast<cross_cpu_free_item*>(ptr);
     auto& list = all_cpus[cpu_id]->xcpu_freelist;
     auto old = list.load(std::memory_order_relaxed);
     do {
-        p->next = old;
-    } while (!list.compare_exchange_weak(old, p, std::memory_order_release, std::memory_order_relaxed));
+        tail->next = old;
+    } while (!list.compare_exchange_weak(old, head, std::memory_order_release, std::memory_order_relaxed));
+}
+
+void cpu_pages::free_cross_cpu(unsigned cpu_id, void* ptr) {
+    auto p = reinterpret_cast<cross_cpu_free_item*>(ptr);
+    push_cross_cpu(cpu_id, p, p);
     alloc_stats::increment(alloc_stats::types::cross_cpu_frees);
 }
 
+// Reactor threads buffer foreign frees per owner and publish each batch
+// with a single CAS, either when it fills up or from the next poll.
+void cpu_pages::queue_cross_cpu_free(unsigned cpu_id, void* ptr) {
+    auto p = reinterpret_cast<cross_cpu_free_item*>(ptr);
+    auto& b = xcpu_pending[cpu_id];
+    p->next = b.head;
+    b.head = p;
+    if (!b.size++) {
+        b.tail = p;
+    }
+    if (!b.listed) {
+        b.listed = true;
+        xcpu_pending_cpus[nr_xcpu_pending_cpus++] = cpu_id;
+    }
+    alloc_stats::increment_local(alloc_stats::types::cross_cpu_frees);
+    if (b.size == cross_cpu_free_batch::max_size) {
+        push_cross_cpu(cpu_id, b.head, b.tail);
+        // stays listed, the next flush skips it if nothing was added
+        b.head = b.tail = nullptr;
+        b.size = 0;
+    }
+}
+
+bool cpu_pages::flush_cross_cpu_frees() {
+    if (!nr_xcpu_pending_cpus) {
+        return false;
+    }
+    for (unsigned i = 0; i < nr_xcpu_pending_cpus; ++i) {
+        auto cpu_id = xcpu_pending_cpus[i];
+        auto& b = xcpu_pending[cpu_id];
+        if (b.size) {
+            push_cross_cpu(cpu_id, b.head, b.tail);
+            b = cross_cpu_free_batch{};
+        }
+    }
+    nr_xcpu_pending_cpus = 0;
+    return true;
+}
+
 bool cpu_pages::drain_cross_cpu_freelist() {
     if (!xcpu_freelist.load(std::memory_order_relaxed)) {
         return false;
@@ -931,7 +1164,7 @@ void cpu_pages::free(void* ptr) {
             alloc_site->size -= pool.object_size();
         }
 #endif
-        pool.deallocate(ptr);
+        free_small(pool, &pool - &small_pools[0], ptr);
     } else {
         free_large(ptr);
     }
@@ -944,7 +1177,8 @@ void cpu_pages::free(void* ptr, size_t size) {
     }
     if (size <= max_small_allocation) {
         size = object_size_with_alloc_site(size);
-        auto pool = &small_pools[small_pool::size_to_idx(size)];
+        auto idx = small_pool::size_to_idx(size);
+        auto pool = &small_pools[idx];
 #ifdef SEASTAR_HEAPPROF
         allocation_site_ptr alloc_site = pool->alloc_site_holder(ptr);
         if (alloc_site) {
@@ -952,7 +1186,7 @@ void cpu_pages::free(void* ptr, size_t size) {
             alloc_site->size -= pool->object_size();
         }
 #endif
-        pool->deallocate(ptr);
+        free_small(*pool, idx, ptr);
     } else {
         free_large(ptr);
     }
@@ -973,7 +1207,11 @@ cpu_pages::try_foreign_free(void* ptr) {
         original_free_func(ptr);
         return true;
     }
-    free_cross_cpu(object_cpu_id(ptr), ptr);
+    if (is_reactor_thread) {
+        get_cpu_mem().queue_cross_cpu_free(object_cpu_id(ptr), ptr);
+    } else {
+        free_cross_cpu(object_cpu_id(ptr), ptr);
+    }
     return true;
 }
 
@@ -1008,6 +1246,7 @@ void cpu_pages::shrink(void* ptr, size_t new_size) {
 
 cpu_pages::~cpu_pages() {
     if (is_initialized()) {
+        flush_cross_cpu_frees();
         live_cpus[cpu_id].store(false, std::memory_order_relaxed);
     }
 }
@@ -1142,8 +1381,18 @@ reclaiming_result cpu_pages::run_reclaimers(reclaimer_scope scope, size_t n_page
         bool made_progress = false;
         alloc_stats::increment_local(alloc_stats::types::reclaims);
         for (auto&& r : reclaimers) {
+            if (nr_free_pages >= target) {
+                break;
+            }
             if (r->scope() >= scope) {
+                auto free_before = nr_free_pages;
+                auto start = std::chrono::steady_clock::now();
                 made_progress |= r->do_reclaim((target - nr_free_pages) * page_size) == reclaiming_result::reclaimed_something;
+                r->_stats.time_spent += std::chrono::steady_clock::now() - start;
+                ++r->_stats.invocations;
+                if (nr_free_pages > free_before) {
+                    r->_stats.bytes_reclaimed += size_t(nr_free_pages - free_before) * page_size;
+                }
             }
         }
         if (!made_progress) {
@@ -1177,9 +1426,111 @@ memory::memory_layout cpu_pages::memory_layout() {
     };
 }
 
+size_t cpu_pages::free_huge_pages() {
+    if (!is_initialized()) {
+        return 0;
+    }
+    // Free spans are aligned to their size, so any span of at least a
+    // huge page consists of whole huge pages.
+    size_t ret = 0;
+    for (unsigned idx = log2ceil(huge_page_pages); idx < nr_span_lists; ++idx) {
+        auto& list = free_spans[idx];
+        for (auto p = list.empty() ? nullptr : &list.front(pages); p; p = page_list::next(pages, *p)) {
+            ret += p->span_size / huge_page_pages;
+        }
+    }
+    return ret;
+}
+
+size_t cpu_pages::transparent_hugepage_memory() {
+    static constexpr auto sample_interval = std::chrono::seconds(10);
+    auto now = std::chrono::steady_clock::now();
+    if (!is_initialized() || now - thp_sampled < sample_interval) {
+        return thp_memory;
+    }
+    thp_sampled = now;
+    // The kernel only reports huge page residency per mapping. Our memory
+    // is normally mapped on its own, but prorate in case the mapping was
+    // merged with a neighbour.
+    auto lo = reinterpret_cast<uintptr_t>(memory);
+    auto hi = lo + size_t(nr_pages) * page_size;
+    std::ifstream smaps("/proc/self/smaps");
+    std::string line;
+    uintptr_t start = 0, end = 0;
+    size_t ret = 0;
+    while (std::getline(smaps, line)) {
+        unsigned long s, e;
+        if (std::sscanf(line.c_str(), "%lx-%lx ", &s, &e) == 2) {
+            start = s;
+            end = e;
+        } else if (line.compare(0, 14, "AnonHugePages:") == 0) {
+            auto overlap_start = std::max(start, lo);
+            auto overlap_end = std::min(end, hi);
+            if (overlap_end > overlap_start) {
+                auto bytes = std::strtoull(line.c_str() + 14, nullptr, 10) * 1024;
+                ret += bytes * double(overlap_end - overlap_start) / (end - start);
+            }
+        }
+    }
+    thp_memory = ret;
+    return ret;
+}
+
 void cpu_pages::set_reclaim_hook(std::function<void (std::function<void ()>)> hook) {
     reclaim_hook = hook;
     current_min_free_pages = min_free_pages;
+    update_pressure();
+}
+
+uint32_t cpu_pages::pressure_threshold(memory_pressure level) const {
+    switch (level) {
+    case memory_pressure::none: return std::numeric_limits<uint32_t>::max();
+    case memory_pressure::moderate: return 4 * min_free_pages;
+    case memory_pressure::high: return 2 * min_free_pages;
+    case memory_pressure::critical: return min_free_pages;
+    }
+    abort();
+}
+
+void cpu_pages::update_pressure() {
+    static constexpr memory_pressure levels[] = {
+        memory_pressure::moderate, memory_pressure::high, memory_pressure::critical,
+    };
+    const uint32_t hysteresis = min_free_pages / 4;
+    auto level = memory_pressure::none;
+    for (auto l : levels) {
+        // enter a level as soon as we're below its threshold, but only
+        // leave it once we're clearly above
+        auto threshold = pressure_threshold(l) + (l <= pressure ? hysteresis : 0);
+        if (nr_free_pages < threshold) {
+            level = l;
+        }
+    }
+    pressure = level;
+    pressure_enter_pages = level == memory_pressure::critical ? 0 : pressure_threshold(memory_pressure(int(level) + 1));
+    pressure_leave_pages = level == memory_pressure::none ? std::numeric_limits<uint32_t>::max() : pressure_threshold(level) + hysteresis;
+    if (pressure != notified_pressure && !pressure_notification_pending && reclaim_hook && !pressure_listeners.empty()) {
+        pressure_notification_pending = true;
+        reclaim_hook([this] {
+            notify_pressure();
+        });
+    }
+}
+
+void cpu_pages::notify_pressure() {
+    pressure_notification_pending = false;
+    auto level = pressure;
+    if (level == notified_pressure) {
+        return;
+    }
+    notified_pressure = level;
+    // listeners may unsubscribe themselves from their callback
+    auto listeners = pressure_listeners;
+    for (auto l : listeners) {
+        if (std::find(pressure_listeners.begin(), pressure_listeners.end(), l) != pressure_listeners.end()) {
+            l->_callback(level);
+        }
+    }
 }
 
 void cpu_pages::set_min_free_pages(size_t pages) {
@@ -1187,6 +1538,9 @@ void cpu_pages::set_min_free_pages(size_t pages) {
         throw std::runtime_error("Number of pages too large");
     }
     min_free_pages = pages;
+    if (reclaim_hook) {
+        update_pressure();
+    }
     maybe_reclaim();
 }
 
@@ -1256,6 +1610,26 @@ small_pool::deallocate(void* object) {
     }
 }
 
+unsigned
+small_pool::allocate_batch(void** objects, unsigned n) {
+    unsigned i = 0;
+    for (; i < n; ++i) {
+        auto obj = allocate();
+        if (!obj) {
+            break;
+        }
+        objects[i] = obj;
+    }
+    return i;
+}
+
+void
+small_pool::deallocate_batch(void** objects, unsigned n) {
+    for (unsigned i = 0; i < n; ++i) {
+        deallocate(objects[i]);
+    }
+}
+
 void
 small_pool::add_more_objects() {
     auto goal = (_min_free + _max_free) / 2;
@@ -1489,9 +1863,16 @@ reclaimer::reclaimer(std::function<reclaiming_result ()> reclaim, reclaimer_scop
 }
 
 reclaimer::reclaimer(std::function<reclaiming_result (request)> reclaim, reclaimer_scope scope)
+    : reclaimer(std::move(reclaim), scope, 0) {
+}
+
+reclaimer::reclaimer(std::function<reclaiming_result (request)> reclaim, reclaimer_scope scope, int priority)
     : _reclaim(std::move(reclaim))
-    , _scope(scope) {
-    get_cpu_mem().reclaimers.push_back(this);
+    , _scope(scope)
+    , _priority(priority) {
+    auto& r = get_cpu_mem().reclaimers;
+    auto pos = std::find_if(r.begin(), r.end(), [priority] (reclaimer* o) { return o->priority() < priority; });
+    r.insert(pos, this);
 }
 
 reclaimer::~reclaimer() {
@@ -1499,6 +1880,110 @@ reclaimer::~reclaimer() {
     r.erase(std::find(r.begin(), r.end(), this));
 }
 
+memory_pressure current_memory_pressure() {
+    return get_cpu_mem().pressure;
+}
+
+fragmentation_report get_fragmentation_report() {
+    auto& cpu_mem = get_cpu_mem();
+    fragmentation_report ret;
+    if (!cpu_mem.is_initialized()) {
+        return ret;
+    }
+    ret.free_spans.resize(cpu_mem.nr_span_lists);
+    for (unsigned idx = 0; idx < cpu_mem.nr_span_lists; ++idx) {
+        auto& list = cpu_mem.free_spans[idx];
+        for (auto p = list.empty() ? nullptr : &list.front(cpu_mem.pages); p; p = page_list::next(cpu_mem.pages, *p)) {
+            ++ret.free_spans[idx];
+        }
+        if (ret.free_spans[idx]) {
+            ret.largest_free_span = (size_t(1) << idx) * page_size;
+        }
+    }
+    // sized upfront, we must not allocate while walking the spans
+    std::vector<small_pool_utilization> pools(cpu_mem.small_pools.nr_small_pools);
+    for (unsigned i = 0; i < pools.size(); ++i) {
+        pools[i] = {cpu_mem.small_pools[i].object_size(), 0, 0, 0, 0};
+    }
+    cpu_mem.for_each_small_pool_span([&] (small_pool& pool, page& span) {
+        auto& u = pools[&pool - &cpu_mem.small_pools[0]];
+        auto capacity = span.span_size * page_size / pool.object_size();
+        ++u.spans;
+        u.memory += span.span_size * page_size;
+        // nr_small_alloc counts objects on the pool's free list too, so
+        // spans can only look less sparse than they are
+        u.live_objects += span.nr_small_alloc;
+        if (span.nr_small_alloc < fragmentation_report::sparse_span_utilization * capacity) {
+            ++u.sparse_spans;
+        }
+    });
+    for (unsigned i = 0; i < pools.size(); ++i) {
+        if (pools[i].spans) {
+            pools[i].live_objects -= cpu_mem.small_pools[i].free_count();
+            ret.small_pools.push_back(pools[i]);
+        }
+    }
+    return ret;
+}
+
+compactor::compactor(std::function<size_t (compaction_request)> compact)
+        : _compact(std::move(compact)) {
+    get_cpu_mem().compactors.push_back(this);
+}
+
+compactor::~compactor() {
+    auto& c = get_cpu_mem().compactors;
+    c.erase(std::find(c.begin(), c.end(), this));
+}
+
+size_t compact_sparse_spans(float max_utilization, size_t max_spans) {
+    auto& cpu_mem = get_cpu_mem();
+    if (!cpu_mem.is_initialized() || cpu_mem.compactors.empty() || !max_spans) {
+        return 0;
+    }
+    auto is_sparse = [max_utilization] (small_pool& pool, page& span) {
+        auto capacity = span.span_size * page_size / pool.object_size();
+        return span.nr_small_alloc < max_utilization * capacity;
+    };
+    size_t nr_sparse = 0;
+    cpu_mem.for_each_small_pool_span([&] (small_pool& pool, page& span) {
+        nr_sparse += is_sparse(pool, span);
+    });
+    std::vector<compaction_request> requests;
+    requests.reserve(std::min(nr_sparse, max_spans));
+    cpu_mem.for_each_small_pool_span([&] (small_pool& pool, page& span) {
+        if (requests.size() < requests.capacity() && is_sparse(pool, span)) {
+            requests.push_back({cpu_mem.mem() + (&span - cpu_mem.pages) * page_size, span.span_size * page_size});
+        }
+    });
+    size_t moved = 0;
+    // compactors may come and go while compacting
+    auto compactors = cpu_mem.compactors;
+    for (auto& r : requests) {
+        for (auto c : compactors) {
+            if (std::find(cpu_mem.compactors.begin(), cpu_mem.compactors.end(), c) != cpu_mem.compactors.end()) {
+                moved += c->compact(r);
+            }
+        }
+    }
+    return moved;
+}
+
+memory_pressure_listener::memory_pressure_listener(std::function<void (memory_pressure)> callback)
+        : _callback(std::move(callback)) {
+    auto& cpu_mem = get_cpu_mem();
+    cpu_mem.pressure_listeners.push_back(this);
+    if (cpu_mem.reclaim_hook) {
+        // report the current level, if it's not none
+        cpu_mem.update_pressure();
+    }
+}
+
+memory_pressure_listener::~memory_pressure_listener() {
+    auto& l = get_cpu_mem().pressure_listeners;
+    l.erase(std::find(l.begin(), l.end(), this));
+}
+
 void set_large_allocation_warning_threshold(size_t threshold) {
     get_cpu_mem().large_allocation_warning_threshold = threshold;
 }
@@ -1511,6 +1996,10 @@ void disable_large_allocation_warning() {
     get_cpu_mem().large_allocation_warning_threshold = std::numeric_limits<size_t>::max();
 }
 
+// Of the shards whose memory is backed by hugetlbfs
+static std::mutex memory_backings_mutex;
+static std::vector<memory_backing> memory_backings;
+
 void configure(std::vector<resource::memory> m, bool mbind,
         optional<std::string> hugetlbfs_path) {
     // we need to make sure cpu_mem is initialize since configure calls cpu_mem.resize
@@ -1526,16 +2015,24 @@ void configure(std::vector<resource::memory> m, bool mbind,
         total += x.bytes;
     }
     allocate_system_memory_fn sys_alloc = allocate_anonymous_memory;
+    lw_shared_ptr<file_desc> fdp;
     if (hugetlbfs_path) {
         // std::function is copyable, but file_desc is not, so we must use
         // a shared_ptr to allow sys_alloc to be copied around
-        auto fdp = make_lw_shared<file_desc>(file_desc::temporary(*hugetlbfs_path));
+        fdp = make_lw_shared<file_desc>(file_desc::temporary(*hugetlbfs_path));
         sys_alloc = [fdp] (void* where, size_t how_much) {
             return allocate_hugetlbfs_memory(*fdp, where, how_much);
         };
         get_cpu_mem().replace_memory_backing(sys_alloc);
     }
     get_cpu_mem().resize(total, sys_alloc);
+    if (fdp) {
+        // The shard's memory is the file from its start, in one mapping
+        std::lock_guard<std::mutex> lock(memory_backings_mutex);
+        memory_backings.push_back(memory_backing{::dup(fdp->get()),
+                reinterpret_cast<uintptr_t>(get_cpu_mem().mem()), size_t(get_cpu_mem().nr_pages) * page_size});
+    }
+    get_cpu_mem().numa_layout = m;
     size_t pos = 0;
     for (auto&& x : m) {
 #ifdef SEASTAR_HAVE_NUMA
@@ -1561,7 +2058,9 @@ void configure(std::vector<resource::memory> m, bool mbind,
 statistics stats() {
     return statistics{alloc_stats::get(alloc_stats::types::allocs), alloc_stats::get(alloc_stats::types::frees), alloc_stats::get(alloc_stats::types::cross_cpu_frees),
         cpu_mem.nr_pages * page_size, cpu_mem.nr_free_pages * page_size, alloc_stats::get(alloc_stats::types::reclaims), alloc_stats::get(alloc_stats::types::large_allocs),
-        alloc_stats::get(alloc_stats::types::foreign_mallocs), alloc_stats::get(alloc_stats::types::foreign_frees), alloc_stats::get(alloc_stats::types::foreign_cross_frees)};
+        alloc_stats::get(alloc_stats::types::foreign_mallocs), alloc_stats::get(alloc_stats::types::foreign_frees), alloc_stats::get(alloc_stats::types::foreign_cross_frees),
+        cpu_mem.free_huge_pages(), cpu_mem.transparent_hugepage_memory(),
+        cpu_mem.span_allocations, cpu_mem.span_splits};
 }
 
 size_t free_memory() {
@@ -1569,13 +2068,143 @@ size_t free_memory() {
 }
 
 bool drain_cross_cpu_freelist() {
-    return get_cpu_mem().drain_cross_cpu_freelist();
+    auto& cpu_mem = get_cpu_mem();
+    // Publish our own pending foreign frees first, so that the owners
+    // get them on their next poll
+    bool flushed = cpu_mem.flush_cross_cpu_frees();
+    return cpu_mem.drain_cross_cpu_freelist() || flushed;
 }
 
 memory_layout get_memory_layout() {
     return get_cpu_mem().memory_layout();
 }
 
+std::vector<memory_backing> get_memory_backings() {
+    std::lock_guard<std::mutex> lock(memory_backings_mutex);
+    return memory_backings;
+}
+
+#ifdef SEASTAR_HAVE_NUMA
+
+// Calls fn(addresses, intended_node) for consecutive batches of addresses
+// of pages in the shard's memory, taking every stride'th OS page.
+template <typename Func>
+static void for_each_page_batch(cpu_pages& cpu_mem, size_t stride, Func fn) {
+    static constexpr size_t batch_size = 1024;
+    const size_t os_page_size = ::getpagesize();
+    std::vector<void*> batch;
+    batch.reserve(batch_size);
+    char* pos = cpu_mem.mem();
+    for (auto&& x : cpu_mem.numa_layout) {
+        char* end = pos + x.bytes;
+        for (char* p = pos; p < end; p += stride * os_page_size) {
+            batch.push_back(p);
+            if (batch.size() == batch_size) {
+                fn(batch, x.nodeid);
+                batch.clear();
+            }
+        }
+        if (!batch.empty()) {
+            fn(batch, x.nodeid);
+            batch.clear();
+        }
+        pos = end;
+    }
+}
+
+numa_statistics numa_stats(size_t max_samples) {
+    auto& cpu_mem = get_cpu_mem();
+    numa_statistics ret;
+    size_t total = 0;
+    for (auto&& x : cpu_mem.numa_layout) {
+        total += x.bytes;
+    }
+    const size_t os_page_size = ::getpagesize();
+    auto total_pages = total / os_page_size;
+    if (!total_pages || !max_samples) {
+        return ret;
+    }
+    auto stride = std::max<size_t>(1, total_pages / max_samples);
+    auto node_stats = [&ret] (unsigned node) -> numa_node_statistics& {
+        for (auto& n : ret.nodes) {
+            if (n.node == node) {
+                return n;
+            }
+        }
+        return ret.nodes.emplace_back(numa_node_statistics{node});
+    };
+    for (auto&& x : cpu_mem.numa_layout) {
+        node_stats(x.nodeid).bound += x.bytes;
+    }
+    std::vector<int> status;
+    for_each_page_batch(cpu_mem, stride, [&] (std::vector<void*>& pages, unsigned node) {
+        status.assign(pages.size(), 0);
+        // with a null node array, move_pages() only reports where the pages are
+        if (::move_pages(0, pages.size(), pages.data(), nullptr, status.data(), 0) == -1) {
+            return;
+        }
+        ret.sampled_pages += pages.size();
+        for (auto st : status) {
+            if (st < 0) {
+                ++ret.unpopulated_pages;
+                continue;
+            }
+            if (unsigned(st) != node) {
+                ++ret.misplaced_pages;
+            }
+            node_stats(st).resident += stride * os_page_size;
+        }
+    });
+    return ret;
+}
+
+size_t migrate_misplaced_memory() {
+    auto& cpu_mem = get_cpu_mem();
+    const size_t os_page_size = ::getpagesize();
+    size_t moved = 0;
+    std::vector<int> status;
+    std::vector<void*> misplaced;
+    std::vector<int> nodes;
+    for_each_page_batch(cpu_mem, 1, [&] (std::vector<void*>& pages, unsigned node) {
+        status.assign(pages.size(), 0);
+        if (::move_pages(0, pages.size(), pages.data(), nullptr, status.data(), 0) == -1) {
+            return;
+        }
+        misplaced.clear();
+        for (size_t i = 0; i < pages.size(); ++i) {
+            if (status[i] >= 0 && unsigned(status[i]) != node) {
+                misplaced.push_back(pages[i]);
+            }
+        }
+        if (misplaced.empty()) {
+            return;
+        }
+        nodes.assign(misplaced.size(), node);
+        status.assign(misplaced.size(), 0);
+        if (::move_pages(0, misplaced.size(), misplaced.data(), nodes.data(), status.data(), MPOL_MF_MOVE) == -1) {
+            return;
+        }
+        for (auto st : status) {
+            if (st >= 0 && unsigned(st) == node) {
+                moved += os_page_size;
+            }
+        }
+    });
+    return moved;
+}
+
+#else
+
+numa_statistics numa_stats(size_t) {
+    return {};
+}
+
+size_t migrate_misplaced_memory() {
+    return 0;
+}
+
+#endif
+
 size_t min_free_memory() {
     return get_cpu_mem().min_free_pages * page_size;
 }
@@ -1669,6 +2298,68 @@ static human_readable_value to_hr_number(uint64_t number) {
     return to_human_readable_value(number, 1000, 10000, suffixes);
 }
 
+#ifdef SEASTAR_HEAPPROF
+
+// The live objects and bytes the samples of a site stand for. An allocation
+// of s bytes is sampled with a probability of 1 - e^(-s/interval); like
+// pprof, we take s to be the average size of the objects of the site.
+static std::pair<size_t, size_t> estimated_usage(const allocation_site& site) noexcept {
+    auto interval = get_cpu_mem().heapprof_sampling_interval;
+    if (!interval || !site.count) {
+        return {site.count, site.size};
+    }
+    auto scale = 1 / -std::expm1(-double(site.size) / site.count / interval);
+    return {size_t(site.count * scale), size_t(site.size * scale)};
+}
+
+static int64_t allocation_site_key(const allocation_site& site, allocation_site_order order) noexcept {
+    auto size = estimated_usage(site).second;
+    return order == allocation_site_order::size ? int64_t(size) : int64_t(size) - int64_t(site.snapshot_size);
+}
+
+// Fills top[0, n) with the sites with live objects which come first in the
+// order, without allocating; returns how many it found
+static size_t find_top_allocation_sites(const allocation_site** top, size_t n, allocation_site_order order) noexcept {
+    size_t nr = 0;
+    for (auto site = get_cpu_mem().alloc_site_list_head; site && n; site = site->next) {
+        if (!site->count) {
+            continue;
+        }
+        auto key = allocation_site_key(*site, order);
+        if (nr == n && key <= allocation_site_key(*top[n - 1], order)) {
+            continue;
+        }
+        auto i = nr < n ? nr++ : n - 1;
+        for (; i && allocation_site_key(*top[i - 1], order) < key; --i) {
+            top[i] = top[i - 1];
+        }
+        top[i] = site;
+    }
+    return nr;
+}
+
+static seastar::internal::log_buf::inserter_iterator
+dump_top_allocation_sites(seastar::internal::log_buf::inserter_iterator it, allocation_site_order order) {
+    static constexpr size_t nr_top_sites = 10;
+    std::array<const allocation_site*, nr_top_sites> top;
+    auto nr = find_top_allocation_sites(top.data(), top.size(), order);
+    it = fmt::format_to(it, "Top allocation sites by {}:\n", order == allocation_site_order::size ? "retained memory" : "growth");
+    it = fmt::format_to(it, "size\tgrowth\tcount\tbacktrace\n");
+    for (size_t i = 0; i < nr; i++) {
+        auto [count, size] = estimated_usage(*top[i]);
+        auto growth = int64_t(size) - int64_t(top[i]->snapshot_size);
+        it = fmt::format_to(it, "{}\t{}{}\t{}\t", to_hr_size(size), growth < 0 ? "-" : "+",
+                to_hr_size(growth < 0 ? -growth : growth), to_hr_number(count));
+        for (auto& f : top[i]->backtrace.main_backtrace().frames()) {
+            it = fmt::format_to(it, " 0x{:x}", f.so->begin + f.addr);
+        }
+        it = fmt::format_to(it, "\n");
+    }
+    return it;
+}
+
+#endif
+
 seastar::internal::log_buf::inserter_iterator do_dump_memory_diagnostics(seastar::internal::log_buf::inserter_iterator it) {
     auto free_mem = get_cpu_mem().nr_free_pages * page_size;
     auto total_mem = get_cpu_mem().nr_pages * page_size;
@@ -1761,6 +2452,14 @@ seastar::internal::log_buf::inserter_iterator do_dump_memory_diagnostics(seastar
                 to_hr_number(total_spans));
     }
 
+#ifdef SEASTAR_HEAPPROF
+    // Recorded while heap profiling is, or was, enabled
+    if (get_cpu_mem().alloc_site_list_head) {
+        it = dump_top_allocation_sites(it, allocation_site_order::size);
+        it = dump_top_allocation_sites(it, allocation_site_order::growth);
+    }
+#endif
+
     return it;
 }
 
@@ -1812,6 +2511,79 @@ sstring generate_memory_diagnostics_report() {
     return sstring(buf.data(), buf.size());
 }
 
+#ifdef SEASTAR_HEAPPROF
+
+sstring generate_heap_profile() {
+    auto& cpu_mem = get_cpu_mem();
+    // Don't record our own allocations, they would also invalidate the
+    // iteration over the allocation sites
+    disable_backtrace_temporarily dbt;
+    size_t total_count = 0;
+    size_t total_size = 0;
+    for (auto site = cpu_mem.alloc_site_list_head; site; site = site->next) {
+        total_count += site->count;
+        total_size += site->size;
+    }
+    seastar::internal::log_buf buf;
+    auto it = buf.back_insert_begin();
+    // pprof scales samples up by the sampling rate given in the header;
+    // a rate of 1 makes that a no-op when all allocations are recorded
+    it = fmt::format_to(it, "heap profile: {}: {} [{}: {}] @ heap_v2/{}\n",
+            total_count, total_size, total_count, total_size, std::max<size_t>(cpu_mem.heapprof_sampling_interval, 1));
+    for (auto site = cpu_mem.alloc_site_list_head; site; site = site->next) {
+        if (!site->count) {
+            continue;
+        }
+        it = fmt::format_to(it, "{}: {} [{}: {}] @", site->count, site->size, site->count, site->size);
+        for (auto& f : site->backtrace.main_backtrace().frames()) {
+            it = fmt::format_to(it, " 0x{:x}", f.so->begin + f.addr);
+        }
+        it = fmt::format_to(it, "\n");
+    }
+    it = fmt::format_to(it, "\nMAPPED_LIBRARIES:\n");
+    std::ifstream maps("/proc/self/maps");
+    std::string line;
+    while (std::getline(maps, line)) {
+        it = fmt::format_to(it, "{}\n", line);
+    }
+    return sstring(buf.data(), buf.size());
+}
+
+std::vector<allocation_site_stats> top_allocation_sites(size_t n, allocation_site_order order) {
+    // Don't record our own allocations
+    disable_backtrace_temporarily dbt;
+    std::vector<const allocation_site*> top(n);
+    top.resize(find_top_allocation_sites(top.data(), n, order));
+    std::vector<allocation_site_stats> ret;
+    ret.reserve(top.size());
+    for (auto site : top) {
+        auto [count, size] = estimated_usage(*site);
+        ret.push_back(allocation_site_stats{size, count, int64_t(size) - int64_t(site->snapshot_size), site->backtrace});
+    }
+    return ret;
+}
+
+void snapshot_allocation_sites() {
+    for (auto site = get_cpu_mem().alloc_site_list_head; site; site = site->next) {
+        site->snapshot_size = estimated_usage(*site).second;
+    }
+}
+
+#else
+
+sstring generate_heap_profile() {
+    return {};
+}
+
+std::vector<allocation_site_stats> top_allocation_sites(size_t, allocation_site_order) {
+    return {};
+}
+
+void snapshot_allocation_sites() {
+}
+
+#endif
+
 static void trigger_error_injector() {
     on_alloc_point();
 }
@@ -2247,6 +3019,13 @@ scoped_heap_profiling::scoped_heap_profiling() noexcept {
 scoped_heap_profiling::~scoped_heap_profiling() {
 }
 
+void set_heap_profiling_sampling_interval(size_t) {
+}
+
+size_t get_heap_profiling_sampling_interval() {
+    return 0;
+}
+
 void enable_abort_on_allocation_failure() {
     seastar_logger.warn("Seastar compiled with default allocator, will not abort on bad_alloc");
 }
@@ -2257,6 +3036,33 @@ reclaimer::reclaimer(std::function<reclaiming_result ()> reclaim, reclaimer_scop
 reclaimer::reclaimer(std::function<reclaiming_result (request)> reclaim, reclaimer_scope) {
 }
 
+reclaimer::reclaimer(std::function<reclaiming_result (request)> reclaim, reclaimer_scope, int) {
+}
+
+memory_pressure current_memory_pressure() {
+    return memory_pressure::none;
+}
+
+fragmentation_report get_fragmentation_report() {
+    return {};
+}
+
+compactor::compactor(std::function<size_t (compaction_request)> compact) {
+}
+
+compactor::~compactor() {
+}
+
+size_t compact_sparse_spans(float, size_t) {
+    return 0;
+}
+
+memory_pressure_listener::memory_pressure_listener(std::function<void (memory_pressure)> callback) {
+}
+
+memory_pressure_listener::~memory_pressure_listener() {
+}
+
 reclaimer::~reclaimer() {
 }
 
@@ -2267,7 +3073,7 @@ void configure(std::vector<resource::memory> m, bool mbind, std::optional<std::s
 }
 
 statistics stats() {
-    return statistics{0, 0, 0, 1 << 30, 1 << 30, 0, 0, 0, 0, 0};
+    return statistics{0, 0, 0, 1 << 30, 1 << 30, 0, 0, 0, 0, 0, 0, 0, 0, 0};
 }
 
 size_t free_memory() {
@@ -2282,6 +3088,18 @@ memory_layout get_memory_layout() {
     throw std::runtime_error("get_memory_layout() not supported");
 }
 
+std::vector<memory_backing> get_memory_backings() {
+    return {};
+}
+
+numa_statistics numa_stats(size_t) {
+    return {};
+}
+
+size_t migrate_misplaced_memory() {
+    return 0;
+}
+
 size_t min_free_memory() {
     return 0;
 }
@@ -2321,6 +3139,20 @@ sstring generate_memory_diagnostics_report() {
     return {};
 }
 
+sstring generate_heap_profile() {
+    // Ignore, not supported for default allocator.
+    return {};
+}
+
+std::vector<allocation_site_stats> top_allocation_sites(size_t, allocation_site_order) {
+    // Ignore, not supported for default allocator.
+    return {};
+}
+
+void snapshot_allocation_sites() {
+    // Ignore, not supported for default allocator.
+}
+
 }
 
 }
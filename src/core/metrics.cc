@@ -376,6 +376,12 @@ const bool metric_disabled = false;
 
 
 histogram& histogram::operator+=(const histogram& c) {
+    if (buckets.empty()) {
+        native_histogram = c.native_histogram;
+    } else if (c.native_histogram.has_value() != native_histogram.has_value() ||
+            (native_histogram && (native_histogram->schema != c.native_histogram->schema || native_histogram->min_id != c.native_histogram->min_id))) {
+        throw std::out_of_range("Trying to add histogram with different native layouts");
+    }
     for (size_t i = 0; i < c.buckets.size(); i++) {
         if (buckets.size() <= i) {
             buckets.push_back(c.buckets[i]);
@@ -0,0 +1,67 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#include "prefault.hh"
+#include <seastar/core/align.hh>
+#include <pthread.h>
+#include <sched.h>
+
+namespace seastar::internal {
+
+memory_prefaulter::memory_prefaulter(std::vector<shard_memory> shards) {
+    _workers.reserve(shards.size());
+    for (auto& m : shards) {
+        _workers.emplace_back([this, m] {
+            work(m);
+        });
+    }
+}
+
+memory_prefaulter::~memory_prefaulter() {
+    _stop_request.store(true, std::memory_order_relaxed);
+    for (auto& w : _workers) {
+        w.join();
+    }
+}
+
+void memory_prefaulter::work(shard_memory m) {
+    pthread_setname_np(pthread_self(), "prefault");
+    if (m.cpu_id) {
+        pin_this_thread(*m.cpu_id);
+    }
+    // SCHED_IDLE cannot be set through the attributes of a new thread
+    sched_param param = {};
+    pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+    auto start = align_up(m.layout.start, memory::huge_page_size);
+    for (auto hp = start; hp < m.layout.end; hp += memory::huge_page_size) {
+        if (_stop_request.load(std::memory_order_relaxed)) {
+            return;
+        }
+        auto end = std::min(hp + memory::huge_page_size, m.layout.end);
+        for (auto p = hp; p < end; p += memory::page_size) {
+            // Touch the page for write without changing it, atomically, as
+            // the shard may be writing to it
+            __atomic_fetch_or(reinterpret_cast<char*>(p), 0, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+}
@@ -0,0 +1,55 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#pragma once
+
+#include <seastar/core/memory.hh>
+#include <seastar/core/posix.hh>
+#include <atomic>
+#include <optional>
+#include <vector>
+
+namespace seastar::internal {
+
+// Faults in the memory of the shards from background threads, one per
+// shard, running at idle priority on the CPU of their shard, so that
+// neither startup nor the first uses of the memory wait for the page
+// faults, and, with --lock-memory, for the locking, of all of it.
+// Memory is touched in huge page steps, so that a fault maps a whole
+// transparent huge page when it can.
+class memory_prefaulter {
+public:
+    struct shard_memory {
+        memory::memory_layout layout;
+        std::optional<unsigned> cpu_id; // to pin the thread to
+    };
+private:
+    std::atomic<bool> _stop_request{false};
+    std::vector<posix_thread> _workers;
+
+    void work(shard_memory m);
+public:
+    explicit memory_prefaulter(std::vector<shard_memory> shards);
+    // Stops the threads, whether they are done or not
+    ~memory_prefaulter();
+};
+
+}
@@ -20,7 +20,6 @@
  */
 
 #include <seastar/core/prometheus.hh>
-#include <sstream>
 
 #include <seastar/core/scollectd_api.hh>
 #include "core/scollectd-impl.hh"
@@ -33,6 +32,9 @@
 #include <boost/range/combine.hpp>
 #include <seastar/core/thread.hh>
 #include <seastar/core/loop.hh>
+#include <seastar/core/byteorder.hh>
+#include <fmt/format.h>
+#include <cstring>
 
 namespace seastar {
 
@@ -57,37 +59,160 @@ static std::string to_str(seastar::metrics::impl::data_type dt) {
     return "untyped";
 }
 
-static std::string to_str(const seastar::metrics::impl::metric_value& v) {
-    switch (v.type()) {
-    case seastar::metrics::impl::data_type::GAUGE:
-    case seastar::metrics::impl::data_type::REAL_COUNTER:
-        return std::to_string(v.d());
-    case seastar::metrics::impl::data_type::COUNTER:
-        return std::to_string(v.i());
-    case seastar::metrics::impl::data_type::HISTOGRAM:
-    case seastar::metrics::impl::data_type::SUMMARY:
-        break;
+using text_buffer = fmt::memory_buffer;
+
+/*!
+ * \brief writes a sample name and its labels, in the text format
+ *
+ * \param global_label the label of the config, rendered
+ * \param labels the labels of the metric, rendered
+ * \param extra a label which the sample adds, such as the bucket of a histogram
+ */
+static void add_name(text_buffer& b, std::string_view name, std::string_view global_label, std::string_view labels, std::string_view extra = {}) {
+    b.append(name.data(), name.data() + name.size());
+    b.push_back('{');
+    const char* delimiter = "";
+    for (auto l : {global_label, labels, extra}) {
+        if (!l.empty()) {
+            fmt::format_to(std::back_inserter(b), "{}{}", delimiter, l);
+            delimiter = ",";
+        }
     }
-    return ""; // we should never get here but it makes the compiler happy
+    b.append(std::string_view("} "));
 }
 
-static void add_name(std::ostream& s, const sstring& name, const std::map<sstring, sstring>& labels, const config& ctx) {
-    s << name << "{";
-    const char* delimiter = "";
-    if (ctx.label) {
-        s << ctx.label->key()  << "=\"" << ctx.label->value() << '"';
-        delimiter = ",";
+/*!
+ * \brief the exposition formats of the metrics
+ *
+ * The protobuf format is that of src/proto/metrics2.proto, as length
+ * delimited MetricFamily messages.
+ */
+enum class exposition_format {
+    text,
+    protobuf,
+};
+
+static constexpr const char* protobuf_content_type = "application/vnd.google.protobuf; proto=io.prometheus.client.MetricFamily; encoding=delimited";
+
+/*!
+ * \brief an encoder of the protobuf wire format
+ *
+ * Only what metrics2.proto needs, to do without a dependency on a protobuf
+ * library.
+ */
+namespace pb {
+
+using buffer = fmt::memory_buffer;
+
+enum wire_type : unsigned {
+    varint = 0,
+    fixed64 = 1,
+    length_delimited = 2,
+};
+
+static void put_varint(buffer& b, uint64_t v) {
+    while (v >= 0x80) {
+        b.push_back(char(v | 0x80));
+        v >>= 7;
     }
+    b.push_back(char(v));
+}
+
+static void put_tag(buffer& b, unsigned field, wire_type type) {
+    put_varint(b, (field << 3) | type);
+}
+
+static void put_uint(buffer& b, unsigned field, uint64_t v) {
+    put_tag(b, field, varint);
+    put_varint(b, v);
+}
 
-    if (!labels.empty()) {
-        for (auto l : labels) {
-            s << delimiter;
-            s << l.first  << "=\"" << l.second << '"';
+static void put_double(buffer& b, unsigned field, double v) {
+    uint64_t bits;
+    std::memcpy(&bits, &v, sizeof(bits));
+    bits = cpu_to_le(bits);
+    put_tag(b, field, fixed64);
+    b.append(reinterpret_cast<const char*>(&bits), reinterpret_cast<const char*>(&bits) + sizeof(bits));
+}
+
+static void put_sint(buffer& b, unsigned field, int64_t v) {
+    put_tag(b, field, varint);
+    // zigzag
+    put_varint(b, (uint64_t(v) << 1) ^ uint64_t(v >> 63));
+}
+
+static void put_bytes(buffer& b, unsigned field, std::string_view v) {
+    put_tag(b, field, length_delimited);
+    put_varint(b, v.size());
+    b.append(v.data(), v.data() + v.size());
+}
+
+static void put_message(buffer& b, unsigned field, const buffer& m) {
+    put_bytes(b, field, std::string_view(m.data(), m.size()));
+}
+
+}
+
+/*!
+ * \brief renders labels in an exposition format
+ *
+ * In the text format, the labels as they appear between the braces,
+ * and in the protobuf format, the label fields of a Metric message.
+ */
+static sstring render_labels(const std::map<sstring, sstring>& labels, exposition_format f) {
+    fmt::memory_buffer b;
+    if (f == exposition_format::text) {
+        const char* delimiter = "";
+        for (auto& l : labels) {
+            fmt::format_to(std::back_inserter(b), "{}{}=\"{}\"", delimiter, l.first, l.second);
             delimiter = ",";
         }
+    } else {
+        pb::buffer pair;
+        for (auto& l : labels) {
+            pair.clear();
+            pb::put_bytes(pair, 1, l.first);
+            pb::put_bytes(pair, 2, l.second);
+            pb::put_message(b, 1, pair);
+        }
     }
-    s << "} ";
+    return sstring(b.data(), b.size());
+}
+
+/*!
+ * \brief the labels of the metrics of a shard, rendered in an exposition format
+ *
+ * Rendering the labels is most of the work of a scrape, and they only change
+ * when metrics are registered or removed, which replaces the metadata of the
+ * shard. So each shard keeps the labels it rendered, along with the metadata
+ * they come from, from one scrape to the next.
+ */
+struct rendered_labels {
+    shared_ptr<mi::metric_metadata> metadata;
+    // Per metric family, and per metric, in the order of the metadata
+    std::vector<std::vector<sstring>> labels;
+};
+
+static thread_local lw_shared_ptr<rendered_labels> local_rendered_labels[2];
 
+static lw_shared_ptr<rendered_labels> get_rendered_labels(const shared_ptr<mi::metric_metadata>& metadata, exposition_format f) {
+    auto& cached = local_rendered_labels[unsigned(f)];
+    if (cached && cached->metadata == metadata) {
+        return cached;
+    }
+    // Scrapes which still use the previous labels keep them alive
+    auto r = make_lw_shared<rendered_labels>();
+    r->metadata = metadata;
+    r->labels.reserve(metadata->size());
+    for (auto& mf : *metadata) {
+        auto& family = r->labels.emplace_back();
+        family.reserve(mf.metrics.size());
+        for (auto& m : mf.metrics) {
+            family.push_back(render_labels(m.id.labels(), f));
+        }
+    }
+    cached = r;
+    return r;
 }
 
 /*!
@@ -132,7 +257,7 @@ static void add_name(std::ostream& s, const sstring& name, const std::map<sstrin
  *
  * for (auto&& i : m) {
  *   std::cout << i.name() << std::endl;
- *   i.foreach_metric([](const mi::metric_value& value, const mi::metric_info& value_info) {
+ *   i.foreach_metric([](const mi::metric_value& value, const mi::metric_info& value_info, const sstring& labels) {
  *     std::cout << value_info.id.labels().size() <<std::cout;
  *   });
  * }
@@ -146,6 +271,7 @@ class metric_family_range;
 class metrics_families_per_shard {
     using metrics_family_per_shard_data_container = std::vector<foreign_ptr<mi::values_reference>>;
     metrics_family_per_shard_data_container _data;
+    std::vector<foreign_ptr<lw_shared_ptr<rendered_labels>>> _labels;
     using comp_function = std::function<bool(const sstring&, const mi::metric_family_metadata&)>;
     /*!
      * \brief find the last item in a range of metric family based on a comparator function
@@ -204,6 +330,7 @@ class metrics_families_per_shard {
 
     void resize(size_t new_size) {
         _data.resize(new_size);
+        _labels.resize(new_size);
     }
 
     reference& operator[](size_t n) {
@@ -214,19 +341,35 @@ class metrics_families_per_shard {
         return _data[n];
     }
     /** @} */
+
+    /*!
+     * \brief the rendered labels of a shard, which match its metadata
+     */
+    const rendered_labels& labels(size_t n) const {
+        return *_labels[n];
+    }
+
+    void set_labels(size_t n, foreign_ptr<lw_shared_ptr<rendered_labels>> labels) {
+        _labels[n] = std::move(labels);
+    }
 };
 
-static future<> get_map_value(metrics_families_per_shard& vec) {
+static future<> get_map_value(metrics_families_per_shard& vec, exposition_format f) {
     vec.resize(smp::count);
-    return parallel_for_each(boost::irange(0u, smp::count), [&vec] (auto cpu) {
-        return smp::submit_to(cpu, [] {
-            return mi::get_values();
+    return parallel_for_each(boost::irange(0u, smp::count), [&vec, f] (auto cpu) {
+        return smp::submit_to(cpu, [f] {
+            auto values = mi::get_values();
+            auto labels = make_foreign(get_rendered_labels(values->metadata, f));
+            return std::make_pair(std::move(values), std::move(labels));
         }).then([&vec, cpu] (auto res) {
-            vec[cpu] = std::move(res);
+            vec[cpu] = std::move(res.first);
+            vec.set_labels(cpu, std::move(res.second));
         });
     });
 }
 
+using metric_function = std::function<void(const mi::metric_value&, const mi::metric_info&, const sstring&)>;
+
 
 /*!
  * \brief a facade class for metric family
@@ -260,7 +403,7 @@ class metric_family {
         return *_family_info;
     }
 
-    void foreach_metric(std::function<void(const mi::metric_value&, const mi::metric_info&)>&& f);
+    void foreach_metric(metric_function&& f);
 
     bool end() const {
         return !_name || !_family_info;
@@ -377,11 +520,11 @@ class metric_family_iterator {
         return _positions.empty() || _info.end();
     }
 
-    void foreach_metric(std::function<void(const mi::metric_value&, const mi::metric_info&)>&& f) {
+    void foreach_metric(metric_function&& f) {
         // iterating over the shard vector and the position vector
-        for (auto&& i : boost::combine(_positions, _families)) {
-            auto& pos_in_metric_per_shard = boost::get<0>(i);
-            auto& metric_family = boost::get<1>(i);
+        for (size_t shard = 0; shard < _positions.size(); shard++) {
+            auto pos_in_metric_per_shard = _positions[shard];
+            auto& metric_family = _families[shard];
             if (pos_in_metric_per_shard >= metric_family->metadata->size()) {
                 // no more metric family in this shard
                 continue;
@@ -392,10 +535,9 @@ class metric_family_iterator {
             if (metadata.mf.name == name()) {
                 const mi::value_vector& values = metric_family->values[pos_in_metric_per_shard];
                 const mi::metric_metadata_vector& metrics_metadata = metadata.metrics;
-                for (auto&& vm : boost::combine(values, metrics_metadata)) {
-                    auto& value = boost::get<0>(vm);
-                    auto& metric_metadata = boost::get<1>(vm);
-                    f(value, metric_metadata);
+                const std::vector<sstring>& labels = _families.labels(shard).labels[pos_in_metric_per_shard];
+                for (size_t i = 0; i < values.size(); i++) {
+                    f(values[i], metrics_metadata[i], labels[i]);
                 }
             }
         }
@@ -403,7 +545,7 @@ class metric_family_iterator {
 
 };
 
-void metric_family::foreach_metric(std::function<void(const mi::metric_value&, const mi::metric_info&)>&& f) {
+void metric_family::foreach_metric(metric_function&& f) {
     _iterator_state.foreach_metric(std::move(f));
 }
 
@@ -481,39 +623,36 @@ metric_family_range get_range(const metrics_families_per_shard& mf, const sstrin
 
 }
 
-void write_histogram(std::stringstream& s, const config& ctx, const sstring& name, const seastar::metrics::histogram& h, std::map<sstring, sstring> labels) noexcept {
-    add_name(s, name + "_sum", labels, ctx);
-    s << h.sample_sum << '\n';
+static void write_histogram(text_buffer& b, std::string_view global_label, const sstring& name, const seastar::metrics::histogram& h, std::string_view labels) {
+    auto out = std::back_inserter(b);
+    add_name(b, name + "_sum", global_label, labels);
+    fmt::format_to(out, "{:g}\n", h.sample_sum);
 
-    add_name(s, name + "_count", labels, ctx);
-    s << h.sample_count  << '\n';
+    add_name(b, name + "_count", global_label, labels);
+    fmt::format_to(out, "{}\n", h.sample_count);
 
-    auto& le = labels["le"];
     auto bucket = name + "_bucket";
     for (auto  i : h.buckets) {
-         le = std::to_string(i.upper_bound);
-        add_name(s, bucket, labels, ctx);
-        s << i.count << '\n';
+        add_name(b, bucket, global_label, labels, fmt::format("le=\"{:f}\"", i.upper_bound));
+        fmt::format_to(out, "{}\n", i.count);
     }
-    labels["le"] = "+Inf";
-    add_name(s, bucket, labels, ctx);
-    s << h.sample_count  << '\n';
+    add_name(b, bucket, global_label, labels, "le=\"+Inf\"");
+    fmt::format_to(out, "{}\n", h.sample_count);
 }
 
-void write_summary(std::stringstream& s, const config& ctx, const sstring& name, const seastar::metrics::histogram& h, std::map<sstring, sstring> labels) noexcept {
+static void write_summary(text_buffer& b, std::string_view global_label, const sstring& name, const seastar::metrics::histogram& h, std::string_view labels) {
+    auto out = std::back_inserter(b);
     if (h.sample_sum) {
-        add_name(s, name + "_sum", labels, ctx);
-        s << h.sample_sum  << '\n';
+        add_name(b, name + "_sum", global_label, labels);
+        fmt::format_to(out, "{:g}\n", h.sample_sum);
     }
     if (h.sample_count) {
-        add_name(s, name + "_count", labels, ctx);
-        s << h.sample_count  << '\n';
+        add_name(b, name + "_count", global_label, labels);
+        fmt::format_to(out, "{}\n", h.sample_count);
     }
-    auto& le = labels["quantile"];
     for (auto  i : h.buckets) {
-        le = std::to_string(i.upper_bound);
-        add_name(s, name, labels, ctx);
-        s << i.count  << '\n';
+        add_name(b, name, global_label, labels, fmt::format("quantile=\"{:f}\"", i.upper_bound));
+        fmt::format_to(out, "{}\n", i.count);
     }
 }
 /*!
@@ -562,71 +701,260 @@ class metric_aggregate_by_labels {
     }
 };
 
-std::string get_value_as_string(std::stringstream& s, const mi::metric_value& value) noexcept {
-    std::string value_str;
+/*!
+ * \brief writes the value of a gauge or a counter, in the text format
+ *
+ * \param sample what comes before the value, to report errors
+ */
+static void write_value(text_buffer& b, const mi::metric_value& value, std::string_view sample) {
+    auto out = std::back_inserter(b);
     try {
-        value_str = to_str(value);
+        switch (value.type()) {
+        case mi::data_type::GAUGE:
+        case mi::data_type::REAL_COUNTER:
+            fmt::format_to(out, "{:f}\n", value.d());
+            return;
+        case mi::data_type::COUNTER:
+            fmt::format_to(out, "{}\n", value.i());
+            return;
+        case mi::data_type::HISTOGRAM:
+        case mi::data_type::SUMMARY:
+            break;
+        }
+        b.push_back('\n');
     } catch (const std::range_error& e) {
-        seastar_logger.debug("prometheus: get_value_as_string: {}: {}", s.str(), e.what());
-        value_str = "NaN";
+        seastar_logger.debug("prometheus: write_value: {}: {}", sample, e.what());
+        b.append(std::string_view("NaN\n"));
     } catch (...) {
         auto ex = std::current_exception();
         // print this error as it's ignored later on by `connection::start_response`
-        seastar_logger.error("prometheus: get_value_as_string: {}: {}", s.str(), ex);
+        seastar_logger.error("prometheus: write_value: {}: {}", sample, ex);
         std::rethrow_exception(std::move(ex));
     }
-    return value_str;
 }
 
+static void write_sample(text_buffer& b, std::string_view global_label, const sstring& name, const mi::metric_value& value, std::string_view labels) {
+    if (value.type() == mi::data_type::SUMMARY) {
+        write_summary(b, global_label, name, value.get_histogram(), labels);
+    } else if (value.type() == mi::data_type::HISTOGRAM) {
+        write_histogram(b, global_label, name, value.get_histogram(), labels);
+    } else {
+        auto start = b.size();
+        add_name(b, name, global_label, labels);
+        write_value(b, value, std::string_view(b.data() + start, b.size() - start));
+    }
+}
+
+// Large families are written in pieces of about this size
+static constexpr size_t write_threshold = 64 * 1024;
+
 future<> write_text_representation(output_stream<char>& out, const config& ctx, const metric_family_range& m, bool show_help) {
     return seastar::async([&ctx, &out, &m, show_help] () mutable {
-        bool found = false;
-        std::stringstream s;
+        text_buffer b;
+        auto flush = [&b, &out] {
+            if (b.size()) {
+                out.write(b.data(), b.size()).get();
+                b.clear();
+            }
+        };
+        sstring global_label = ctx.label ? render_labels({{ctx.label->key(), ctx.label->value()}}, exposition_format::text) : sstring();
         for (metric_family& metric_family : m) {
             auto name = ctx.prefix + "_" + metric_family.name();
-            found = false;
+            bool found = false;
             metric_aggregate_by_labels aggregated_values(metric_family.metadata().aggregate_labels);
             bool should_aggregate = !metric_family.metadata().aggregate_labels.empty();
-            metric_family.foreach_metric([&s, &out, &ctx, &found, &name, &metric_family, &aggregated_values, should_aggregate, show_help](auto value, auto value_info) mutable {
-                s.clear();
-                s.str("");
+            metric_family.foreach_metric([&] (const mi::metric_value& value, const mi::metric_info& value_info, const sstring& labels) {
                 if (value_info.should_skip_when_empty && value.is_empty()) {
                     return;
                 }
                 if (!found) {
                     if (show_help && metric_family.metadata().d.str() != "") {
-                        s << "# HELP " << name << " " <<  metric_family.metadata().d.str() << '\n';
+                        fmt::format_to(std::back_inserter(b), "# HELP {} {}\n", name, metric_family.metadata().d.str());
                     }
-                    s << "# TYPE " << name << " " << to_str(metric_family.metadata().type) << '\n';
+                    fmt::format_to(std::back_inserter(b), "# TYPE {} {}\n", name, to_str(metric_family.metadata().type));
                     found = true;
                 }
                 if (should_aggregate) {
                     aggregated_values.add(value, value_info.id.labels());
-                } else if (value.type() == mi::data_type::SUMMARY) {
-                    write_summary(s, ctx, name, value.get_histogram(), value_info.id.labels());
-                } else if (value.type() == mi::data_type::HISTOGRAM) {
-                    write_histogram(s, ctx, name, value.get_histogram(), value_info.id.labels());
                 } else {
-                    add_name(s, name, value_info.id.labels(), ctx);
-                    s << get_value_as_string(s, value) << '\n';
+                    write_sample(b, global_label, name, value, labels);
+                }
+                if (b.size() >= write_threshold) {
+                    flush();
                 }
-                out.write(s.str()).get();
                 thread::maybe_yield();
             });
-            if (!aggregated_values.empty()) {
-                for (auto&& h : aggregated_values.get_values()) {
-                    s.clear();
-                    s.str("");
-                    if (h.second.type() == mi::data_type::HISTOGRAM) {
-                        write_histogram(s, ctx, name, h.second.get_histogram(), h.first);
-                    } else {
-                        add_name(s, name, h.first, ctx);
-                        s << get_value_as_string(s, h.second) << '\n';
-                    }
-                    out.write(s.str()).get();
-                    thread::maybe_yield();
+            for (auto&& h : aggregated_values.get_values()) {
+                write_sample(b, global_label, name, h.second, render_labels(h.first, exposition_format::text));
+                if (b.size() >= write_threshold) {
+                    flush();
                 }
+                thread::maybe_yield();
             }
+            flush();
+        }
+    });
+}
+
+static unsigned protobuf_type(mi::data_type type) {
+    // MetricType of metrics2.proto
+    switch (type) {
+    case mi::data_type::COUNTER:
+    case mi::data_type::REAL_COUNTER:
+        return 0;
+    case mi::data_type::GAUGE:
+        return 1;
+    case mi::data_type::SUMMARY:
+        return 2;
+    case mi::data_type::HISTOGRAM:
+        return 4;
+    }
+    return 3;
+}
+
+/*!
+ * \brief encodes the native buckets of a Histogram message
+ *
+ * Runs of empty buckets are left out, in the gaps between spans.
+ */
+static void encode_native_buckets(pb::buffer& m, const seastar::metrics::histogram& h) {
+    auto& info = *h.native_histogram;
+    pb::put_sint(m, 5, info.schema);
+    pb::put_double(m, 6, h.buckets[0].upper_bound);
+    pb::put_uint(m, 7, h.buckets[0].count);
+    pb::buffer span;
+    auto put_span = [&] (int32_t offset, uint32_t length) {
+        span.clear();
+        pb::put_sint(span, 1, offset);
+        pb::put_uint(span, 2, length);
+        pb::put_message(m, 12, span);
+    };
+    // Spans first, as deltas go after them
+    int32_t next_id = 0; // the id after the previous span
+    bool first = true;
+    for (size_t i = 1; i < h.buckets.size();) {
+        if (h.buckets[i].count == h.buckets[i - 1].count) {
+            i++;
+            continue;
+        }
+        size_t start = i;
+        while (i < h.buckets.size() && h.buckets[i].count != h.buckets[i - 1].count) {
+            i++;
+        }
+        int32_t id = info.min_id + start - 1;
+        put_span(first ? id : id - next_id, i - start);
+        next_id = info.min_id + i - 1;
+        first = false;
+    }
+    if (first) {
+        // Tells that the histogram is a native one
+        put_span(0, 0);
+        return;
+    }
+    int64_t prev = 0;
+    for (size_t i = 1; i < h.buckets.size(); i++) {
+        int64_t count = h.buckets[i].count - h.buckets[i - 1].count;
+        if (count) {
+            pb::put_sint(m, 13, count - prev);
+            prev = count;
+        }
+    }
+}
+
+/*!
+ * \brief encodes a Metric message
+ *
+ * \param global_label the label of the config, rendered
+ * \param labels the labels of the metric, rendered
+ */
+static void encode_metric(pb::buffer& b, const mi::metric_value& value, std::string_view global_label, std::string_view labels) {
+    b.append(global_label.data(), global_label.data() + global_label.size());
+    b.append(labels.data(), labels.data() + labels.size());
+    pb::buffer m;
+    switch (value.type()) {
+    case mi::data_type::GAUGE:
+        pb::put_double(m, 1, value.d());
+        pb::put_message(b, 2, m);
+        break;
+    case mi::data_type::COUNTER:
+    case mi::data_type::REAL_COUNTER:
+        pb::put_double(m, 1, value.d());
+        pb::put_message(b, 3, m);
+        break;
+    case mi::data_type::HISTOGRAM:
+    case mi::data_type::SUMMARY: {
+        auto& h = value.get_histogram();
+        bool summary = value.type() == mi::data_type::SUMMARY;
+        pb::put_uint(m, 1, h.sample_count);
+        pb::put_double(m, 2, h.sample_sum);
+        pb::buffer bucket;
+        for (auto& i : h.buckets) {
+            bucket.clear();
+            if (summary) {
+                // Quantile
+                pb::put_double(bucket, 1, i.upper_bound);
+                pb::put_double(bucket, 2, i.count);
+            } else {
+                // Bucket
+                pb::put_uint(bucket, 1, i.count);
+                pb::put_double(bucket, 2, i.upper_bound);
+            }
+            pb::put_message(m, 3, bucket);
+        }
+        if (!summary && h.native_histogram && !h.buckets.empty()) {
+            encode_native_buckets(m, h);
+        }
+        pb::put_message(b, summary ? 4 : 7, m);
+        break;
+    }
+    }
+}
+
+future<> write_protobuf_representation(output_stream<char>& out, const config& ctx, const metric_family_range& m, bool show_help) {
+    return seastar::async([&ctx, &out, &m, show_help] () mutable {
+        // The length of a family comes before it, so it is written whole
+        pb::buffer metrics;
+        pb::buffer metric;
+        pb::buffer header;
+        auto add_metric = [&] (const mi::metric_value& value, std::string_view global_label, std::string_view labels) {
+            metric.clear();
+            encode_metric(metric, value, global_label, labels);
+            pb::put_message(metrics, 4, metric);
+        };
+        sstring global_label = ctx.label ? render_labels({{ctx.label->key(), ctx.label->value()}}, exposition_format::protobuf) : sstring();
+        for (metric_family& metric_family : m) {
+            metrics.clear();
+            metric_aggregate_by_labels aggregated_values(metric_family.metadata().aggregate_labels);
+            bool should_aggregate = !metric_family.metadata().aggregate_labels.empty();
+            metric_family.foreach_metric([&] (const mi::metric_value& value, const mi::metric_info& value_info, const sstring& labels) {
+                if (value_info.should_skip_when_empty && value.is_empty()) {
+                    return;
+                }
+                if (should_aggregate) {
+                    aggregated_values.add(value, value_info.id.labels());
+                } else {
+                    add_metric(value, global_label, labels);
+                }
+                thread::maybe_yield();
+            });
+            for (auto&& h : aggregated_values.get_values()) {
+                add_metric(h.second, global_label, render_labels(h.first, exposition_format::protobuf));
+                thread::maybe_yield();
+            }
+            if (!metrics.size()) {
+                continue;
+            }
+            header.clear();
+            pb::put_bytes(header, 1, ctx.prefix + "_" + metric_family.name());
+            if (show_help && metric_family.metadata().d.str() != "") {
+                pb::put_bytes(header, 2, metric_family.metadata().d.str());
+            }
+            pb::put_uint(header, 3, protobuf_type(metric_family.metadata().type));
+            pb::buffer length;
+            pb::put_varint(length, header.size() + metrics.size());
+            out.write(length.data(), length.size()).get();
+            out.write(header.data(), header.size()).get();
+            out.write(metrics.data(), metrics.size()).get();
         }
     });
 }
@@ -663,13 +991,18 @@ class metrics_handler : public handler_base  {
         sstring metric_family_name = req->get_query_param("name");
         bool show_help = req->get_query_param("help") != "false";
         bool prefix = trim_asterisk(metric_family_name);
+        auto f = _ctx.allow_protobuf && req->get_header("Accept").find("application/vnd.google.protobuf") != sstring::npos
+                ? exposition_format::protobuf : exposition_format::text;
 
-        rep->write_body("txt", [this, metric_family_name, prefix, show_help] (output_stream<char>&& s) {
+        rep->write_body("txt", [this, metric_family_name, prefix, show_help, f] (output_stream<char>&& s) {
             return do_with(metrics_families_per_shard(), output_stream<char>(std::move(s)),
-                    [this, prefix, &metric_family_name, show_help] (metrics_families_per_shard& families, output_stream<char>& s) mutable {
-                return get_map_value(families).then([&s, &families, this, prefix, &metric_family_name, show_help]() mutable {
+                    [this, prefix, &metric_family_name, show_help, f] (metrics_families_per_shard& families, output_stream<char>& s) mutable {
+                return get_map_value(families, f).then([&s, &families, this, prefix, &metric_family_name, show_help, f]() mutable {
                     return do_with(get_range(families, metric_family_name, prefix),
-                            [&s, this, show_help](metric_family_range& m) {
+                            [&s, this, show_help, f](metric_family_range& m) {
+                        if (f == exposition_format::protobuf) {
+                            return write_protobuf_representation(s, _ctx, m, show_help);
+                        }
                         return write_text_representation(s, _ctx, m, show_help);
                     });
                 }).finally([&s] () mutable {
@@ -677,6 +1010,9 @@ class metrics_handler : public handler_base  {
                 });
             });
         });
+        if (f == exposition_format::protobuf) {
+            rep->set_mime_type(protobuf_content_type);
+        }
         return make_ready_future<std::unique_ptr<httpd::reply>>(std::move(rep));
     }
 };
@@ -28,10 +28,14 @@
 #include <sys/time.h>
 #include <sys/resource.h>
 #include <sys/inotify.h>
+#include <sys/sendfile.h>
 #include <fmt/ranges.h>
 #include <seastar/core/task.hh>
+#include <seastar/core/abort_source.hh>
 #include <seastar/core/reactor.hh>
 #include <seastar/core/memory.hh>
+#include <seastar/core/cached_file.hh>
+#include <seastar/core/mapped_file.hh>
 #include <seastar/core/posix.hh>
 #include <seastar/net/packet.hh>
 #include <seastar/net/stack.hh>
@@ -48,11 +52,15 @@
 #include <seastar/core/systemwide_memory_barrier.hh>
 #include <seastar/core/report_exception.hh>
 #include <seastar/core/stall_sampler.hh>
+#include <seastar/core/stall_profile.hh>
+#include <seastar/core/cpu_profiler.hh>
 #include <seastar/core/thread_cputime_clock.hh>
 #include <seastar/core/abort_on_ebadf.hh>
 #include <seastar/core/io_queue.hh>
+#include <seastar/core/io_trace.hh>
 #include <seastar/core/internal/io_desc.hh>
 #include <seastar/core/internal/buffer_allocator.hh>
+#include <seastar/core/internal/wakeup_batch.hh>
 #include <seastar/core/scheduling_specific.hh>
 #include <seastar/core/smp_options.hh>
 #include <seastar/util/log.hh>
@@ -72,6 +80,7 @@
 #include <sys/poll.h>
 #include <boost/lexical_cast.hpp>
 #include <boost/thread/barrier.hpp>
+#include <boost/lockfree/queue.hpp>
 #include <boost/algorithm/string/classification.hpp>
 #include <boost/algorithm/string/split.hpp>
 #include <boost/iterator/counting_iterator.hpp>
@@ -87,6 +96,7 @@
 #include <dirent.h>
 #include <linux/types.h> // for xfs, below
 #include <sys/ioctl.h>
+#include <netinet/tcp.h>
 #include <linux/perf_event.h>
 #include <xfs/linux.h>
 #define min min    /* prevent xfs.h from defining min() as a macro */
@@ -133,6 +143,8 @@
 #include <seastar/core/execution_stage.hh>
 #include <seastar/core/exception_hacks.hh>
 #include "stall_detector.hh"
+#include "cpu_profiler.hh"
+#include "prefault.hh"
 #include <seastar/util/memory_diagnostics.hh>
 #include <seastar/util/internal/iovec_utils.hh>
 #include <seastar/util/internal/magic.hh>
@@ -159,6 +171,12 @@ struct mountpoint_params {
     uint64_t write_saturation_length = std::numeric_limits<uint64_t>::max();
     bool duplex = false;
     float rate_factor = 1.0;
+    uint64_t stripe_size = 0;
+    unsigned stripe_members = 1;
+    // IOPS of random requests, by the fraction of them which are reads
+    std::vector<std::pair<double, uint64_t>> mixed_iops;
+    // IOPS of random reads, by how many of them are in flight
+    std::vector<std::pair<unsigned, uint64_t>> read_iops_curve;
 };
 
 }
@@ -185,6 +203,20 @@ struct convert<seastar::mountpoint_params> {
         if (node["rate_factor"]) {
             mp.rate_factor = node["rate_factor"].as<float>();
         }
+        if (node["stripe_members"]) {
+            mp.stripe_members = node["stripe_members"].as<unsigned>();
+            mp.stripe_size = parse_memory_size(node["stripe_size"].as<std::string>());
+        }
+        if (node["mixed_iops"]) {
+            for (auto&& point : node["mixed_iops"]) {
+                mp.mixed_iops.emplace_back(point["read_ratio"].as<double>(), parse_memory_size(point["iops"].as<std::string>()));
+            }
+        }
+        if (node["read_iops_curve"]) {
+            for (auto&& point : node["read_iops_curve"]) {
+                mp.read_iops_curve.emplace_back(point["depth"].as<unsigned>(), parse_memory_size(point["iops"].as<std::string>()));
+            }
+        }
         return true;
     }
 };
@@ -359,6 +391,24 @@ reactor::do_write_some(pollable_fd_state& fd, net::packet& p) {
     });
 }
 
+future<size_t>
+reactor::do_sendfile(pollable_fd_state& fd, int in_fd, uint64_t pos, size_t len) {
+    return writeable(fd).then([this, &fd, in_fd, pos, len] {
+        // Reading the file may block on the disk, so not on the reactor
+        // thread. The socket stays non-blocking.
+        return _thread_pool->submit<syscall_result<ssize_t>>([&fd, in_fd, pos, len] {
+            auto off = off_t(pos);
+            return wrap_syscall<ssize_t>(::sendfile(fd.fd.get(), in_fd, &off, len));
+        });
+    }).then([this, &fd, in_fd, pos, len] (syscall_result<ssize_t> sr) {
+        if (sr.result == -1 && sr.error == EAGAIN) {
+            return do_sendfile(fd, in_fd, pos, len);
+        }
+        sr.throw_if_error();
+        return make_ready_future<size_t>(sr.result);
+    });
+}
+
 future<>
 reactor::write_all_part(pollable_fd_state& fd, const void* buffer, size_t len, size_t completed) {
     if (completed == len) {
@@ -411,6 +461,9 @@ future<temporary_buffer<char>> pollable_fd_state::read_some(internal::buffer_all
 }
 
 future<size_t> pollable_fd_state::write_some(net::packet& p) {
+    auto& stats = engine()._io_stats;
+    stats.packet_sends++;
+    stats.packet_send_iovecs += std::min<size_t>(p.nr_frags(), IOV_MAX);
     return engine()._backend->write_some(*this, p);
 }
 
@@ -432,6 +485,10 @@ future<> pollable_fd_state::write_all(net::packet& p) {
     });
 }
 
+future<size_t> pollable_fd_state::sendfile(int in_fd, uint64_t pos, size_t len) {
+    return engine().do_sendfile(*this, in_fd, pos, len);
+}
+
 future<> pollable_fd_state::readable() {
     return engine().readable(*this);
 }
@@ -493,6 +550,37 @@ future<size_t> pollable_fd_state::sendmsg(struct msghdr* msg) {
     });
 }
 
+future<size_t> pollable_fd_state::recvmmsg(struct mmsghdr* msgvec, unsigned vlen) {
+    maybe_no_more_recv();
+    return engine().readable(*this).then([this, msgvec, vlen] {
+        auto r = fd.recvmmsg(msgvec, vlen, 0);
+        if (!r) {
+            return recvmmsg(msgvec, vlen);
+        }
+        // Unlike recvmsg(), we know whether the queue was drained: only a
+        // full batch suggests more messages are waiting.
+        if (*r == vlen) {
+            speculate_epoll(EPOLLIN);
+        }
+        return make_ready_future<size_t>(*r);
+    });
+}
+
+future<size_t> pollable_fd_state::sendmmsg(struct mmsghdr* msgvec, unsigned vlen) {
+    maybe_no_more_send();
+    return engine().writeable(*this).then([this, msgvec, vlen] {
+        auto r = fd.sendmmsg(msgvec, vlen, 0);
+        if (!r) {
+            return sendmmsg(msgvec, vlen);
+        }
+        // See the comment about speculation in sendmsg().
+        if (*r == vlen) {
+            speculate_epoll(EPOLLOUT);
+        }
+        return make_ready_future<size_t>(*r);
+    });
+}
+
 future<size_t> pollable_fd_state::sendto(socket_address addr, const void* buf, size_t len) {
     maybe_no_more_send();
     return engine().writeable(*this).then([this, buf, len, addr] () mutable {
@@ -843,9 +931,14 @@ static decltype(auto) install_signal_handler_stack() {
     });
 }
 
-reactor::task_queue::task_queue(unsigned id, sstring name, float shares)
+reactor::sched_entity::sched_entity(float shares, bool is_group) noexcept
         : _shares(std::max(shares, 1.0f))
         , _reciprocal_shares_times_2_power_32((uint64_t(1) << 32) / _shares)
+        , _is_group(is_group) {
+}
+
+reactor::task_queue::task_queue(unsigned id, sstring name, float shares)
+        : sched_entity(shares, false)
         , _id(id)
         , _ts(now())
         , _name(name) {
@@ -874,9 +967,23 @@ reactor::task_queue::register_stats() {
         sm::make_counter("tasks_processed", _tasks_processed,
                 sm::description("Count of tasks executing on this queue; indicates together with runtime_ms indicates length of tasks"),
                 {group_label}),
-        sm::make_gauge("queue_length", [this] { return _q.size(); },
+        sm::make_histogram("queue_delay", sm::description("Histogram of the time this queue waited for the CPU, from becoming runnable or being preempted, in seconds; "
+                "long delays with short quanta indicate starvation"), {group_label}, [this] {
+            return _queue_delay.to_metrics_histogram();
+        }),
+        sm::make_histogram("quantum_runtime", sm::description("Histogram of the time this queue ran each time it got the CPU, in seconds; "
+                "quanta much longer than the task quota indicate long tasks"), {group_label}, [this] {
+            return _quantum_runtime.to_metrics_histogram();
+        }),
+        sm::make_gauge("queue_length", [this] { return size(); },
                 sm::description("Size of backlog on this queue, in tasks; indicates whether the queue is busy and/or contended"),
                 {group_label}),
+        sm::make_counter("deadline_tasks_processed", _deadline_tasks_processed,
+                sm::description("Count of tasks with a deadline executing on this queue"),
+                {group_label}),
+        sm::make_counter("deadline_misses", _deadline_misses,
+                sm::description("Count of tasks with a deadline that started running after it had passed"),
+                {group_label}),
         sm::make_gauge("shares", [this] { return _shares; },
                 sm::description("Shares allocated to this queue"),
                 {group_label}),
@@ -884,10 +991,32 @@ reactor::task_queue::register_stats() {
                 return _time_spent_on_task_quota_violations / 1ms;
         }, sm::description("Total amount in milliseconds we were in violation of the task quota"),
            {group_label}),
+        sm::make_counter("throttles", _throttles,
+                sm::description("Number of times this queue was taken off the CPU for running over its CPU cap"),
+                {group_label}),
+        sm::make_counter("throttled_time_ms", [this] {
+                return std::chrono::duration_cast<std::chrono::milliseconds>(_throttled_time).count();
+        }, sm::description("Accumulated time this queue had tasks but was kept off the CPU by its CPU cap"),
+           {group_label}),
     });
     _metrics = std::exchange(new_metrics, {});
 }
 
+reactor::task_queue_group::task_queue_group(unsigned id, float shares)
+        : sched_entity(shares, true)
+        , _id(id) {
+    namespace sm = seastar::metrics;
+    static auto supergroup = sm::label("supergroup");
+    auto label = supergroup(id);
+    _metrics.add_group("scheduler", {
+        sm::make_counter("supergroup_runtime_ms", [this] {
+            return std::chrono::duration_cast<std::chrono::milliseconds>(_runtime).count();
+        }, sm::description("Accumulated runtime of the task queues of this supergroup"), {label}),
+        sm::make_gauge("supergroup_shares", [this] { return _shares; },
+                sm::description("Shares allocated to this supergroup"), {label}),
+    });
+}
+
 void
 reactor::task_queue::rename(sstring new_name) {
     if (_name != new_name) {
@@ -903,14 +1032,14 @@ __attribute__((no_sanitize("undefined"))) // multiplication below may overflow;
 #endif
 inline
 int64_t
-reactor::task_queue::to_vruntime(sched_clock::duration runtime) const {
+reactor::sched_entity::to_vruntime(sched_clock::duration runtime) const {
     auto scaled = (runtime.count() * _reciprocal_shares_times_2_power_32) >> 32;
     // Prevent overflow from returning ridiculous values
     return std::max<int64_t>(scaled, 0);
 }
 
 void
-reactor::task_queue::set_shares(float shares) noexcept {
+reactor::sched_entity::set_shares(float shares) noexcept {
     _shares = std::max(shares, 1.0f);
     _reciprocal_shares_times_2_power_32 = (uint64_t(1) << 32) / _shares;
 }
@@ -922,19 +1051,212 @@ reactor::account_runtime(task_queue& tq, sched_clock::duration runtime) {
     }
     tq._vruntime += tq.to_vruntime(runtime);
     tq._runtime += runtime;
+    if (auto g = tq._parent) {
+        g->_vruntime += g->to_vruntime(runtime);
+        g->_runtime += runtime;
+    }
+}
+
+sched_clock::duration
+reactor::charge_cpu_cap(task_queue& tq, sched_clock::time_point now, sched_clock::duration runtime) noexcept {
+    auto pause = tq._cap->update(now - tq._cap_checked, runtime);
+    tq._cap_checked = now;
+    // Not worth a timer; the debt is paid with the next pause
+    static constexpr auto min_pause = 100us;
+    return pause >= min_pause ? pause : sched_clock::duration(0);
+}
+
+void
+reactor::set_cpu_cap(task_queue& tq, std::optional<float> fraction) noexcept {
+    if (!fraction) {
+        // A throttled queue is let back when the timer fires
+        tq._cap.reset();
+        return;
+    }
+    auto f = std::clamp(*fraction, 0.001f, 1.0f);
+    // The queue may run for up to this long at once, after a pause
+    static constexpr auto burst_window = 10ms;
+    tq._cap.emplace(f, std::chrono::duration_cast<std::chrono::nanoseconds>(burst_window * f));
+    tq._cap_checked = now();
+    tq._cap_timer.set_callback([this, &tq] {
+        unthrottle(tq);
+    });
+}
+
+void
+reactor::unthrottle(task_queue& tq) noexcept {
+    auto now = reactor::now();
+    tq._throttled_time += now - tq._ts;
+    tq._ts = now;
+    tq._active = false;
+    if (!tq.empty()) {
+        activate(tq);
+    }
 }
 
 void
-reactor::account_idle(sched_clock::duration runtime) {
-    // anything to do here?
+reactor::account_idle(sched_clock::duration idletime) {
+    if (_idle_poll_policy) {
+        _idle_poll_policy->on_idle_end(idletime);
+    }
 }
 
-struct reactor::task_queue::indirect_compare {
-    bool operator()(const task_queue* tq1, const task_queue* tq2) const {
+struct reactor::sched_entity::indirect_compare {
+    bool operator()(const sched_entity* tq1, const sched_entity* tq2) const {
         return tq1->_vruntime < tq2->_vruntime;
     }
 };
 
+namespace internal {
+
+// Per-shard queue of work submitted with smp::submit_stealable().
+//
+// The owning shard pushes items and pops them at its own pace; idle
+// siblings on the same NUMA node pop from it too, so the queue is
+// multi-consumer. Items are only ever started from the reactor loop, as
+// tasks in the scheduling group of their submitter.
+class stealable_work_queue {
+    static constexpr size_t queue_length = 1024;
+    boost::lockfree::queue<stealable_work_item*, boost::lockfree::capacity<queue_length>> _q;
+    reactor& _owner;
+    std::vector<stealable_work_queue*> _siblings;
+    size_t _next_victim = 0;
+public:
+    static constexpr size_t batch_size = 16;
+    uint64_t submitted = 0;
+    uint64_t stolen = 0; // siblings' items run here
+    uint64_t stolen_from = 0; // our items run by siblings
+
+    explicit stealable_work_queue(reactor& owner) noexcept : _owner(owner) {}
+    void add_sibling(stealable_work_queue* q) {
+        _siblings.push_back(q);
+    }
+    bool push(stealable_work_item* wi) noexcept {
+        if (!_q.bounded_push(wi)) {
+            return false;
+        }
+        submitted++;
+        wake_sibling();
+        return true;
+    }
+    stealable_work_item* pop() noexcept {
+        stealable_work_item* wi;
+        return _q.pop(wi) ? wi : nullptr;
+    }
+    bool empty() const noexcept {
+        return _q.empty();
+    }
+    bool siblings_have_work() const noexcept {
+        return std::any_of(_siblings.begin(), _siblings.end(), [] (const stealable_work_queue* q) {
+            return !q->empty();
+        });
+    }
+    // Moves up to max items from the siblings' queues into this shard's
+    // task queues, starting from a different victim every time.
+    size_t steal(size_t max) noexcept {
+        size_t got = 0;
+        for (size_t tried = 0; tried < _siblings.size() && got < max; tried++) {
+            auto victim = _siblings[_next_victim++ % _siblings.size()];
+            while (got < max) {
+                auto wi = victim->pop();
+                if (!wi) {
+                    break;
+                }
+                _owner.add_task(wi);
+                got++;
+            }
+        }
+        return got;
+    }
+private:
+    void wake_sibling() noexcept {
+        if (_siblings.empty()) {
+            return;
+        }
+        // See smp_message_queue::lf_queue::maybe_wakeup()
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+        auto& r = _siblings[_next_victim++ % _siblings.size()]->_owner;
+        if (r._sleeping.load(std::memory_order_relaxed)) {
+            r._sleeping.store(false, std::memory_order_relaxed);
+            r.wakeup();
+        }
+    }
+};
+
+// Functions of smp::submit_batched(), by destination shard, until the
+// next poll of the smp queues sends each shard's in one message
+class smp_batched_calls {
+    std::vector<std::vector<smp::batched_call>> _pending;
+    std::vector<shard_id> _dirty;
+public:
+    uint64_t single = 0;
+    uint64_t batched = 0;
+    uint64_t batches = 0;
+
+    ~smp_batched_calls() {
+        // Functions left when the shard stops are leaked, like messages
+        // left in the smp queues, rather than run on the wrong shard
+        for (auto& calls : _pending) {
+            if (!calls.empty()) {
+                (void)new std::vector<smp::batched_call>(std::move(calls));
+            }
+        }
+    }
+    void add(shard_id t, smp::batched_call func) {
+        if (_pending.empty()) {
+            _pending.resize(smp::count);
+        }
+        auto& calls = _pending[t];
+        if (calls.empty()) {
+            _dirty.push_back(t);
+        }
+        calls.push_back(std::move(func));
+    }
+    bool empty() const noexcept {
+        return _dirty.empty();
+    }
+    bool flush() noexcept {
+        if (_dirty.empty()) {
+            return false;
+        }
+        for (auto t : _dirty) {
+            auto calls = std::exchange(_pending[t], {});
+            if (calls.size() == 1) {
+                single++;
+                (void)smp::submit_to(t, std::move(calls.front()));
+            } else if (!calls.empty()) {
+                batched += calls.size();
+                batches++;
+                (void)smp::submit_to(t, [calls = std::move(calls)] () mutable {
+                    for (auto& func : calls) {
+                        func();
+                    }
+                });
+            }
+        }
+        _dirty.clear();
+        return true;
+    }
+};
+
+void stealable_work_item::run_and_dispose() noexcept {
+    execute();
+    if (origin == this_shard_id()) {
+        complete();
+        delete this;
+        return;
+    }
+    engine()._stealable_queue->stolen++;
+    // The promise and the function belong to the origin shard
+    (void)smp::submit_to(origin, [this] {
+        engine()._stealable_queue->stolen_from++;
+        complete();
+        delete this;
+    });
+}
+
+}
+
 reactor::reactor(std::shared_ptr<smp> smp, alien::instance& alien, unsigned id, reactor_backend_selector rbs, reactor_config cfg)
     : _smp(std::move(smp))
     , _alien(alien)
@@ -950,7 +1272,9 @@ reactor::reactor(std::shared_ptr<smp> smp, alien::instance& alien, unsigned id,
     , _cpu_started(0)
     , _cpu_stall_detector(make_cpu_stall_detector())
     , _reuseport(posix_reuseport_detect())
-    , _thread_pool(std::make_unique<thread_pool>(this, seastar::format("syscall-{}", id))) {
+    , _thread_pool(std::make_unique<thread_pool>(this, seastar::format("syscall-{}", id), cfg.syscall_threads, cfg.slow_syscall_threads))
+    , _stealable_queue(std::make_unique<internal::stealable_work_queue>(*this))
+    , _batched_calls(std::make_unique<internal::smp_batched_calls>()) {
     /*
      * The _backend assignment is here, not on the initialization list as
      * the chosen backend constructor may want to handle signals and thus
@@ -1017,6 +1341,7 @@ reactor::~reactor() {
             }
         }
     }
+    internal::drain_continuation_cache();
 }
 
 reactor::sched_stats
@@ -1046,6 +1371,14 @@ void reactor::set_bypass_fsync(bool value) {
     _bypass_fsync = value;
 }
 
+temporary_buffer<char> reactor::allocate_dma_buffer(size_t alignment, size_t size) {
+    return _backend->allocate_dma_buffer(alignment, size);
+}
+
+bool reactor::cancel_io(kernel_completion* desc) noexcept {
+    return _backend->cancel_io(desc);
+}
+
 void
 reactor::reset_preemption_monitor() {
     return _backend->reset_preemption_monitor();
@@ -1098,9 +1431,16 @@ cpu_stall_detector::get_config() const {
 }
 
 void cpu_stall_detector::update_config(cpu_stall_detector_config cfg) {
+    if (cfg.profile && !_profile) {
+        auto profile = std::make_unique<sampled_stacks>(1024);
+        std::atomic_signal_fence(std::memory_order_release); // The signal handler must see the table filled
+        _profile = std::move(profile);
+    }
     _config = cfg;
     _threshold = std::chrono::duration_cast<sched_clock::duration>(cfg.threshold);
     _slack = std::chrono::duration_cast<sched_clock::duration>(cfg.threshold * cfg.slack);
+    _profile_interval = std::max(std::chrono::duration_cast<sched_clock::duration>(cfg.profile_interval), sched_clock::duration(10us));
+    _profiling = cfg.profile;
     _stall_detector_reports_per_minute = cfg.stall_detector_reports_per_minute;
     _max_reports_per_minute = cfg.stall_detector_reports_per_minute;
     _rearm_timer_at = reactor::now();
@@ -1116,7 +1456,7 @@ void cpu_stall_detector::maybe_report() {
 // the near past it's an increment and two branches.
 //
 // We can do it a cheaper if we don't report suppressed backtraces.
-void cpu_stall_detector::on_signal() {
+void cpu_stall_detector::on_signal(const void* pc) {
     if (reap_event_and_check_spuriousness()) {
         return;
     }
@@ -1125,14 +1465,59 @@ void cpu_stall_detector::on_signal() {
     if (!last_seen) {
         return; // stall detector in not active
     } else if (last_seen == tasks_processed) { // no task was processed - report
-        maybe_report();
-        _report_at <<= 1;
+        if (_profiling) {
+            on_profiled_stall(pc);
+        } else {
+            maybe_report();
+            _report_at <<= 1;
+        }
     } else {
         _last_tasks_processed_seen.store(tasks_processed, std::memory_order_relaxed);
+        _sampling = false;
     }
     arm_timer();
 }
 
+// While profiling, a stall is sampled every _profile_interval once it is
+// detected, and is reported as often as it would be otherwise.
+void cpu_stall_detector::on_profiled_stall(const void* pc) noexcept {
+    _profile->record_backtrace(pc);
+    if (!_sampling) {
+        _sampling = true;
+        _sampled_for = {};
+        maybe_report();
+        _report_at <<= 1;
+    } else {
+        _sampled_for += _profile_interval;
+        if (_sampled_for >= _threshold * _report_at) {
+            _sampled_for = {};
+            maybe_report();
+            _report_at <<= 1;
+        }
+    }
+}
+
+stall_profile cpu_stall_detector::get_profile(bool reset) {
+    stall_profile ret;
+    ret.shard = _shard_id;
+    ret.interval = std::chrono::duration_cast<std::chrono::nanoseconds>(_profile_interval);
+    if (!_profile) {
+        return ret;
+    }
+    _profile->consume(reset, [&ret] (const sampled_stacks::entry& e) {
+        stall_profile_stack stack;
+        stack.frames.reserve(e.nr_frames);
+        for (unsigned i = 0; i < e.nr_frames; ++i) {
+            stack.frames.push_back(decorate(e.frames[i] - 1));
+        }
+        stack.samples = e.count;
+        ret.stacks.push_back(std::move(stack));
+    }, [&ret] (uint64_t dropped) {
+        ret.dropped_samples = dropped;
+    });
+    return ret;
+}
+
 void cpu_stall_detector::report_suppressions(sched_clock::time_point now) {
     if (now > _minute_mark + 60s) {
         if (_reported > _max_reports_per_minute) {
@@ -1153,7 +1538,7 @@ void cpu_stall_detector::report_suppressions(sched_clock::time_point now) {
 }
 
 void cpu_stall_detector_posix_timer::arm_timer() {
-    auto its = posix::to_relative_itimerspec(_threshold * _report_at + _slack, 0s);
+    auto its = posix::to_relative_itimerspec(timer_period(), 0s);
     timer_settime(_timer, 0, &its, nullptr);
 }
 
@@ -1161,6 +1546,7 @@ void cpu_stall_detector::start_task_run(sched_clock::time_point now) {
     if (now > _rearm_timer_at) {
         report_suppressions(now);
         _report_at = 1;
+        _sampling = false;
         _run_started_at = now;
         _rearm_timer_at = now + _threshold * _report_at;
         arm_timer();
@@ -1205,7 +1591,7 @@ cpu_stall_detector_linux_perf_event::~cpu_stall_detector_linux_perf_event() {
 
 void
 cpu_stall_detector_linux_perf_event::arm_timer() {
-    uint64_t ns = (_threshold * _report_at + _slack) / 1ns;
+    uint64_t ns = timer_period() / 1ns;
     if (__builtin_expect(_enabled && _current_period == ns, 1)) {
         // Common case - we're re-arming with the same period, the counter
         // is already enabled.
@@ -1348,8 +1734,57 @@ reactor::get_stall_detector_report_function() const {
 }
 
 void
-reactor::block_notifier(int) {
-    engine()._cpu_stall_detector->on_signal();
+reactor::set_stall_profiling(bool enabled, std::chrono::microseconds interval) {
+    auto cfg = _cpu_stall_detector->get_config();
+    cfg.profile = enabled;
+    cfg.profile_interval = interval;
+    _cpu_stall_detector->update_config(std::move(cfg));
+}
+
+bool
+reactor::stall_profiling_enabled() const {
+    return _cpu_stall_detector->get_config().profile;
+}
+
+stall_profile
+reactor::get_stall_profile(bool reset) {
+    return _cpu_stall_detector->get_profile(reset);
+}
+
+void
+reactor::start_cpu_profiler(std::chrono::nanoseconds period) {
+    if (_cpu_profiler && _cpu_profiler->period() != period) {
+        _cpu_profiler.reset();
+    }
+    if (!_cpu_profiler) {
+        _cpu_profiler = std::make_unique<cpu_profiler>(period);
+    }
+    _current_task_type = nullptr;
+    _cpu_profiler_running = true;
+    _cpu_profiler->start();
+}
+
+void
+reactor::stop_cpu_profiler() {
+    if (_cpu_profiler) {
+        _cpu_profiler->stop();
+    }
+    _cpu_profiler_running = false;
+}
+
+cpu_profile
+reactor::get_cpu_profile(bool reset) {
+    if (!_cpu_profiler) {
+        cpu_profile ret;
+        ret.shard = this_shard_id();
+        return ret;
+    }
+    return _cpu_profiler->get_profile(reset);
+}
+
+void
+reactor::block_notifier(int, siginfo_t*, void* ucontext) {
+    engine()._cpu_stall_detector->on_signal(interrupted_pc(ucontext));
 }
 
 void
@@ -1366,6 +1801,10 @@ cpu_stall_detector::generate_trace() {
     buf.append("Reactor stalled for ");
     buf.append_decimal(uint64_t(delta / 1ms));
     buf.append(" ms");
+    if (auto loop = internal::running_loop_name()) {
+        buf.append(" in loop ");
+        buf.append(loop);
+    }
     print_with_backtrace(buf, _config.oneline);
     maybe_report_kernel_trace();
 }
@@ -1444,18 +1883,37 @@ class network_stack_factory {
     future<std::unique_ptr<network_stack>> operator()(const program_options::option_group& opts) { return _func(opts); }
 };
 
+// The CPU quota of our cgroup, read by smp::configure() before the
+// reactors are configured, with --cpu-quota-pacing
+static std::optional<cgroup::cpu_quota> cgroup_cpu_quota;
+
 void reactor::configure(const reactor_options& opts) {
     _network_stack_ready = opts.network_stack.get_selected_candidate()(*opts.network_stack.get_selected_candidate_opts());
 
     _handle_sigint = !opts.no_handle_interrupt;
     auto task_quota = opts.task_quota_ms.get_value() * 1ms;
     _task_quota = std::chrono::duration_cast<sched_clock::duration>(task_quota);
+    if (opts.cpu_quota_pacing.get_value() && cgroup_cpu_quota) {
+        // Keep a margin for the threads which are not shards
+        auto share = 0.9 * cgroup_cpu_quota->cpus() / smp::count;
+        if (share < 1) {
+            auto period = std::chrono::duration_cast<std::chrono::nanoseconds>(cgroup_cpu_quota->period);
+            _cpu_quota_pacer.emplace(share, std::chrono::duration_cast<std::chrono::nanoseconds>(period * share / 10));
+            // A task quota should be a small part of the shard's budget
+            // for the period
+            _task_quota = std::min(_task_quota, std::chrono::duration_cast<sched_clock::duration>(period * share / 4));
+            _cpu_quota_checked = now();
+            _cpu_quota_cputime = thread_cputime_clock::now().time_since_epoch();
+        }
+    }
 
     auto blocked_time = opts.blocked_reactor_notify_ms.get_value() * 1ms;
     cpu_stall_detector_config csdc;
     csdc.threshold = blocked_time;
     csdc.stall_detector_reports_per_minute = opts.blocked_reactor_reports_per_minute.get_value();
     csdc.oneline = opts.blocked_reactor_report_format_oneline.get_value();
+    csdc.profile = opts.blocked_reactor_profile.get_value();
+    csdc.profile_interval = opts.blocked_reactor_profile_interval_us.get_value() * 1us;
     _cpu_stall_detector->update_config(csdc);
 
     _max_task_backlog = opts.max_task_backlog.get_value();
@@ -1466,6 +1924,12 @@ void reactor::configure(const reactor_options& opts) {
     if (opts.overprovisioned && opts.idle_poll_time_us.defaulted() && !opts.poll_mode) {
         _max_poll_time = 0us;
     }
+    if (opts.idle_poll_budget && !opts.poll_mode) {
+        _idle_poll_policy.emplace(_max_poll_time, std::clamp(opts.idle_poll_budget.get_value(), 0.0, 1.0));
+    }
+    if (opts.park_below_load && !opts.poll_mode) {
+        _park_below_load = std::clamp(opts.park_below_load.get_value(), 0.0, 1.0);
+    }
     set_strict_dma(!opts.relaxed_dma);
     if (!opts.poll_aio.get_value() || (opts.poll_aio.defaulted() && opts.overprovisioned)) {
         _aio_eventfd = pollable_fd(file_desc::eventfd(0, 0));
@@ -1475,6 +1939,7 @@ void reactor::configure(const reactor_options& opts) {
     _force_io_getevents_syscall = opts.force_aio_syscalls.get_value();
     aio_nowait_supported = opts.linux_aio_nowait.get_value();
     _have_aio_fsync = opts.aio_fsync.get_value();
+    set_io_trace_size(opts.io_trace_entries.get_value());
 }
 
 pollable_fd
@@ -1501,12 +1966,31 @@ reactor::posix_listen(socket_address sa, listen_options opts) {
             *somaxconn, opts.listen_backlog, opts.listen_backlog);
     }
 
-    file_desc fd = file_desc::socket(sa.u.sa.sa_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, specific_protocol);
+    auto type = sa.is_af_unix() && opts.proto == transport::SEQPACKET ? SOCK_SEQPACKET : SOCK_STREAM;
+    file_desc fd = file_desc::socket(sa.u.sa.sa_family, type | SOCK_NONBLOCK | SOCK_CLOEXEC, specific_protocol);
     if (opts.reuse_address) {
         fd.setsockopt(SOL_SOCKET, SO_REUSEADDR, 1);
     }
     if (_reuseport && !sa.is_af_unix())
         fd.setsockopt(SOL_SOCKET, SO_REUSEPORT, 1);
+    if (!opts.congestion_control.empty() && !sa.is_af_unix()) {
+        // Inherited by the accepted connections
+        fd.setsockopt(IPPROTO_TCP, TCP_CONGESTION, opts.congestion_control.c_str());
+    }
+    if (opts.busy_poll.count() && !sa.is_af_unix()) {
+        // Also inherited. Polling longer than net.core.busy_read, or with a
+        // larger budget than the default, needs CAP_NET_ADMIN; without it
+        // the connections are served as usual.
+        try {
+            fd.setsockopt(SOL_SOCKET, SO_BUSY_POLL, int(opts.busy_poll.count()));
+            fd.setsockopt(SOL_SOCKET, SO_PREFER_BUSY_POLL, 1);
+            if (opts.busy_poll_budget) {
+                fd.setsockopt(SOL_SOCKET, SO_BUSY_POLL_BUDGET, int(opts.busy_poll_budget));
+            }
+        } catch (const std::system_error& e) {
+            seastar_logger.warn("Cannot busy poll the connections of {}: {}", sa, e.what());
+        }
+    }
 
     try {
         fd.bind(sa.u.sa, sa.length());
@@ -1515,7 +1999,22 @@ reactor::posix_listen(socket_address sa, listen_options opts) {
         throw std::system_error(s.code(), fmt::format("posix_listen failed for address {}", sa));
     }
 
-    return pollable_fd(std::move(fd));
+    auto pfd = pollable_fd(std::move(fd));
+    pfd.set_multishot(opts.multishot_accept, opts.multishot_recv);
+    return pfd;
+}
+
+void reactor::add_busy_poll(std::chrono::nanoseconds t) {
+    _busy_polls.push_back(t);
+    _busy_poll_time = std::max(_busy_poll_time, t);
+}
+
+void reactor::remove_busy_poll(std::chrono::nanoseconds t) noexcept {
+    auto i = std::find(_busy_polls.begin(), _busy_polls.end(), t);
+    if (i != _busy_polls.end()) {
+        _busy_polls.erase(i);
+    }
+    _busy_poll_time = _busy_polls.empty() ? std::chrono::nanoseconds(0) : *std::max_element(_busy_polls.begin(), _busy_polls.end());
 }
 
 bool
@@ -1570,7 +2069,23 @@ void pollable_fd::shutdown(int how, shutdown_kernel_only kernel_only) {
 pollable_fd
 reactor::make_pollable_fd(socket_address sa, int proto) {
     int maybe_nonblock = _backend->do_blocking_io() ? 0 : SOCK_NONBLOCK;
-    file_desc fd = file_desc::socket(sa.u.sa.sa_family, SOCK_STREAM | maybe_nonblock | SOCK_CLOEXEC, proto);
+    int type = SOCK_STREAM;
+    if (sa.is_af_unix()) {
+        type = proto == int(transport::SEQPACKET) ? SOCK_SEQPACKET : SOCK_STREAM;
+        proto = 0;
+    }
+    file_desc fd = file_desc::socket(sa.u.sa.sa_family, type | maybe_nonblock | SOCK_CLOEXEC, proto);
+    return pollable_fd(std::move(fd));
+}
+
+pollable_fd
+reactor::make_pollable_fd(file_desc fd) {
+    // Descriptors from elsewhere, e.g. passed by another process, may be
+    // blocking
+    if (!_backend->do_blocking_io()) {
+        auto flags = ::fcntl(fd.get(), F_GETFL);
+        throw_system_error_on(flags == -1 || ::fcntl(fd.get(), F_SETFL, flags | O_NONBLOCK) == -1, "fcntl");
+    }
     return pollable_fd(std::move(fd));
 }
 
@@ -1715,62 +2230,92 @@ size_t sanitize_iovecs(std::vector<iovec>& iov, size_t disk_alignment) noexcept
 
 }
 
+static bool is_tmpfs(int fd) {
+    struct ::statfs buf;
+    auto r = ::fstatfs(fd, &buf);
+    if (r == -1) {
+        return false;
+    }
+    return buf.f_type == fs_magic::tmpfs;
+}
+
 future<file>
 reactor::open_file_dma(std::string_view nameref, open_flags flags, file_open_options options) noexcept {
     return do_with(static_cast<int>(flags), std::move(options), [this, nameref] (auto& open_flags, file_open_options& options) {
         sstring name(nameref);
-        return _thread_pool->submit<syscall_result<int>>([this, name, &open_flags, &options, strict_o_direct = _strict_o_direct, bypass_fsync = _bypass_fsync] () mutable {
-            // We want O_DIRECT, except in three cases:
-            //   - tmpfs (which doesn't support it, but works fine anyway)
-            //   - strict_o_direct == false (where we forgive it being not supported)
-            //   - _kernel_page_cache == true (where we disable it for short-lived test processes)
-            // Because open() with O_DIRECT will fail, we open it without O_DIRECT, try
-            // to update it to O_DIRECT with fcntl(), and if that fails, see if we
-            // can forgive it.
-            auto is_tmpfs = [] (int fd) {
-                struct ::statfs buf;
-                auto r = ::fstatfs(fd, &buf);
-                if (r == -1) {
-                    return false;
+        auto open_in_thread_pool = [this, name, &open_flags, &options, strict_o_direct = _strict_o_direct, bypass_fsync = _bypass_fsync] () mutable {
+            return _thread_pool->submit<syscall_result<int>>([this, name, &open_flags, &options, strict_o_direct, bypass_fsync] () mutable {
+                // We want O_DIRECT, except in three cases:
+                //   - tmpfs (which doesn't support it, but works fine anyway)
+                //   - strict_o_direct == false (where we forgive it being not supported)
+                //   - _kernel_page_cache == true (where we disable it for short-lived test processes)
+                // Because open() with O_DIRECT will fail, we open it without O_DIRECT, try
+                // to update it to O_DIRECT with fcntl(), and if that fails, see if we
+                // can forgive it.
+                open_flags |= O_CLOEXEC;
+                if (bypass_fsync) {
+                    open_flags &= ~O_DSYNC;
                 }
-                return buf.f_type == fs_magic::tmpfs;
-            };
+                auto mode = static_cast<mode_t>(options.create_permissions);
+                int fd = ::open(name.c_str(), open_flags, mode);
+                if (fd == -1) {
+                    return wrap_syscall<int>(fd);
+                }
+                int o_direct_flag = _kernel_page_cache ? 0 : O_DIRECT;
+                int r = ::fcntl(fd, F_SETFL, open_flags | o_direct_flag);
+                auto maybe_ret = wrap_syscall<int>(r);  // capture errno (should be EINVAL)
+                if (r == -1  && strict_o_direct && !is_tmpfs(fd)) {
+                    ::close(fd);
+                    return maybe_ret;
+                }
+                if (fd != -1 && options.extent_allocation_size_hint && !_kernel_page_cache) {
+                    fsxattr attr = {};
+                    int r = ::ioctl(fd, XFS_IOC_FSGETXATTR, &attr);
+                    // xfs delayed allocation is disabled when extent size hints are present.
+                    // This causes tons of xfs log fsyncs. Given that extent size hints are
+                    // unneeded when delayed allocation is available (which is the case
+                    // when not using O_DIRECT), disable them.
+                    //
+                    // Ignore error; may be !xfs, and just a hint anyway
+                    if (r != -1) {
+                        attr.fsx_xflags |= XFS_XFLAG_EXTSIZE;
+                        attr.fsx_extsize = std::min(options.extent_allocation_size_hint,
+                                            file_open_options::max_extent_allocation_size_hint);
+
+                        // Ignore error; may be !xfs, and just a hint anyway
+                        ::ioctl(fd, XFS_IOC_FSSETXATTR, &attr);
+                    }
+                }
+                return wrap_syscall<int>(fd);
+            });
+        };
+        // The backend can open the file itself, unless the open needs the
+        // extent size hint, which is set with blocking ioctls. Setting
+        // O_DIRECT afterwards, as the thread pool does, does not block.
+        bool needs_hint = options.extent_allocation_size_hint && !_kernel_page_cache && (open_flags & O_ACCMODE) != O_RDONLY;
+        auto opened = make_ready_future<syscall_result<int>>(-1, 0);
+        if (_backend->has_metadata_ops() && !needs_hint) {
             open_flags |= O_CLOEXEC;
-            if (bypass_fsync) {
+            if (_bypass_fsync) {
                 open_flags &= ~O_DSYNC;
             }
             auto mode = static_cast<mode_t>(options.create_permissions);
-            int fd = ::open(name.c_str(), open_flags, mode);
-            if (fd == -1) {
-                return wrap_syscall<int>(fd);
-            }
-            int o_direct_flag = _kernel_page_cache ? 0 : O_DIRECT;
-            int r = ::fcntl(fd, F_SETFL, open_flags | o_direct_flag);
-            auto maybe_ret = wrap_syscall<int>(r);  // capture errno (should be EINVAL)
-            if (r == -1  && strict_o_direct && !is_tmpfs(fd)) {
-                ::close(fd);
-                return maybe_ret;
-            }
-            if (fd != -1 && options.extent_allocation_size_hint && !_kernel_page_cache) {
-                fsxattr attr = {};
-                int r = ::ioctl(fd, XFS_IOC_FSGETXATTR, &attr);
-                // xfs delayed allocation is disabled when extent size hints are present.
-                // This causes tons of xfs log fsyncs. Given that extent size hints are
-                // unneeded when delayed allocation is available (which is the case
-                // when not using O_DIRECT), disable them.
-                //
-                // Ignore error; may be !xfs, and just a hint anyway
-                if (r != -1) {
-                    attr.fsx_xflags |= XFS_XFLAG_EXTSIZE;
-                    attr.fsx_extsize = std::min(options.extent_allocation_size_hint,
-                                        file_open_options::max_extent_allocation_size_hint);
-
-                    // Ignore error; may be !xfs, and just a hint anyway
-                    ::ioctl(fd, XFS_IOC_FSSETXATTR, &attr);
+            opened = _backend->openat(name, open_flags, mode).then([this, &open_flags, strict_o_direct = _strict_o_direct] (syscall_result<int> sr) {
+                if (sr.result == -1 || _kernel_page_cache) {
+                    return sr;
                 }
-            }
-            return wrap_syscall<int>(fd);
-        }).then([&options, name = std::move(name), &open_flags] (syscall_result<int> sr) {
+                int r = ::fcntl(sr.result, F_SETFL, open_flags | O_DIRECT);
+                auto maybe_ret = wrap_syscall<int>(r);
+                if (r == -1 && strict_o_direct && !is_tmpfs(sr.result)) {
+                    ::close(sr.result);
+                    return maybe_ret;
+                }
+                return sr;
+            });
+        } else {
+            opened = open_in_thread_pool();
+        }
+        return opened.then([&options, name = std::move(name), &open_flags] (syscall_result<int> sr) {
             sr.throw_fs_exception_if_error("open failed", name);
             return make_file_impl(sr.result, options, open_flags);
         }).then([] (shared_ptr<file_impl> impl) {
@@ -1782,10 +2327,19 @@ reactor::open_file_dma(std::string_view nameref, open_flags flags, file_open_opt
 future<>
 reactor::remove_file(std::string_view pathname) noexcept {
     // Allocating memory for a sstring can throw, hence the futurize_invoke
-    return futurize_invoke([pathname] {
-        return engine()._thread_pool->submit<syscall_result<int>>([pathname = sstring(pathname)] {
+    return futurize_invoke([this, pathname] {
+        auto f = _backend->has_metadata_ops()
+                ? _backend->unlinkat(sstring(pathname), 0).then([this, pathname = sstring(pathname)] (syscall_result<int> sr) {
+            // Like remove(), also removes empty directories
+            if (sr.result == -1 && sr.error == EISDIR) {
+                return _backend->unlinkat(pathname, AT_REMOVEDIR);
+            }
+            return make_ready_future<syscall_result<int>>(sr);
+        })
+                : _thread_pool->submit<syscall_result<int>>([pathname = sstring(pathname)] {
             return wrap_syscall<int>(::remove(pathname.c_str()));
-        }).then([pathname = sstring(pathname)] (syscall_result<int> sr) {
+        });
+        return f.then([pathname = sstring(pathname)] (syscall_result<int> sr) {
             sr.throw_fs_exception_if_error("remove failed", pathname);
             return make_ready_future<>();
         });
@@ -1795,10 +2349,13 @@ reactor::remove_file(std::string_view pathname) noexcept {
 future<>
 reactor::rename_file(std::string_view old_pathname, std::string_view new_pathname) noexcept {
     // Allocating memory for a sstring can throw, hence the futurize_invoke
-    return futurize_invoke([old_pathname, new_pathname] {
-        return engine()._thread_pool->submit<syscall_result<int>>([old_pathname = sstring(old_pathname), new_pathname = sstring(new_pathname)] {
+    return futurize_invoke([this, old_pathname, new_pathname] {
+        auto f = _backend->has_metadata_ops()
+                ? _backend->renameat(sstring(old_pathname), sstring(new_pathname))
+                : _thread_pool->submit<syscall_result<int>>([old_pathname = sstring(old_pathname), new_pathname = sstring(new_pathname)] {
             return wrap_syscall<int>(::rename(old_pathname.c_str(), new_pathname.c_str()));
-        }).then([old_pathname = sstring(old_pathname), new_pathname = sstring(new_pathname)] (syscall_result<int> sr) {
+        });
+        return f.then([old_pathname = sstring(old_pathname), new_pathname = sstring(new_pathname)] (syscall_result<int> sr) {
             sr.throw_fs_exception_if_error("rename failed",  old_pathname, new_pathname);
             return make_ready_future<>();
         });
@@ -1897,11 +2454,14 @@ timespec_to_time_point(const timespec& ts) {
 
 future<struct stat>
 reactor::fstat(int fd) noexcept {
-    return _thread_pool->submit<syscall_result_extra<struct stat>>([fd] {
+    auto f = _backend->has_metadata_ops()
+            ? _backend->statx(fd, "", AT_EMPTY_PATH)
+            : _thread_pool->submit<syscall_result_extra<struct stat>>([fd] {
         struct stat st;
         auto ret = ::fstat(fd, &st);
         return wrap_syscall(ret, st);
-    }).then([] (syscall_result_extra<struct stat> ret) {
+    });
+    return f.then([] (syscall_result_extra<struct stat> ret) {
         ret.throw_if_error();
         return make_ready_future<struct stat>(ret.extra);
     });
@@ -1925,12 +2485,15 @@ future<stat_data>
 reactor::file_stat(std::string_view pathname, follow_symlink follow) noexcept {
     // Allocating memory for a sstring can throw, hence the futurize_invoke
     return futurize_invoke([pathname, follow, this] {
-        return _thread_pool->submit<syscall_result_extra<struct stat>>([pathname = sstring(pathname), follow] {
+        auto f = _backend->has_metadata_ops()
+                ? _backend->statx(AT_FDCWD, sstring(pathname), follow ? 0 : AT_SYMLINK_NOFOLLOW)
+                : _thread_pool->submit<syscall_result_extra<struct stat>>([pathname = sstring(pathname), follow] {
             struct stat st;
             auto stat_syscall = follow ? stat : lstat;
             auto ret = stat_syscall(pathname.c_str(), &st);
             return wrap_syscall(ret, st);
-        }).then([pathname = sstring(pathname)] (syscall_result_extra<struct stat> sr) {
+        });
+        return f.then([pathname = sstring(pathname)] (syscall_result_extra<struct stat> sr) {
             sr.throw_fs_exception_if_error("stat failed", pathname);
             struct stat& st = sr.extra;
             stat_data sd;
@@ -1990,7 +2553,7 @@ reactor::file_system_at(std::string_view pathname) noexcept {
             struct statfs st;
             auto ret = statfs(pathname.c_str(), &st);
             return wrap_syscall(ret, st);
-        }).then([pathname = sstring(pathname)] (syscall_result_extra<struct statfs> sr) {
+        }, thread_pool::lane::slow).then([pathname = sstring(pathname)] (syscall_result_extra<struct statfs> sr) {
             static std::unordered_map<long int, fs_type> type_mapper = {
                 { fs_magic::xfs, fs_type::xfs },
                 { fs_magic::ext2, fs_type::ext2 },
@@ -2017,7 +2580,7 @@ reactor::fstatfs(int fd) noexcept {
         struct statfs st;
         auto ret = ::fstatfs(fd, &st);
         return wrap_syscall(ret, st);
-    }).then([] (syscall_result_extra<struct statfs> sr) {
+    }, thread_pool::lane::slow).then([] (syscall_result_extra<struct statfs> sr) {
         sr.throw_if_error();
         struct statfs st = sr.extra;
         return make_ready_future<struct statfs>(std::move(st));
@@ -2032,7 +2595,7 @@ reactor::statvfs(std::string_view pathname) noexcept {
             struct statvfs st;
             auto ret = ::statvfs(pathname.c_str(), &st);
             return wrap_syscall(ret, st);
-        }).then([pathname = sstring(pathname)] (syscall_result_extra<struct statvfs> sr) {
+        }, thread_pool::lane::slow).then([pathname = sstring(pathname)] (syscall_result_extra<struct statvfs> sr) {
             sr.throw_fs_exception_if_error("statvfs failed", pathname);
             struct statvfs st = sr.extra;
             return make_ready_future<struct statvfs>(std::move(st));
@@ -2085,12 +2648,57 @@ reactor::touch_directory(std::string_view name, file_permissions permissions) no
     });
 }
 
+// Concurrent flushes of a file are committed as a group: while an
+// fdatasync() is in flight, the flushes that arrive are queued and all
+// served by the single fdatasync() issued once it completes. They can't
+// share the one in flight, as it may have started before their writes
+// completed.
 future<>
 reactor::fdatasync(int fd) noexcept {
     ++_fsyncs;
     if (_bypass_fsync) {
         return make_ready_future<>();
     }
+    return futurize_invoke([this, fd] {
+        auto [it, idle] = _fsync_batches.try_emplace(fd);
+        if (idle) {
+            return issue_fdatasync(fd);
+        }
+        auto& waiters = it->second.next;
+        waiters.emplace_back();
+        ++_fsyncs_batched;
+        return waiters.back().get_future();
+    });
+}
+
+future<>
+reactor::issue_fdatasync(int fd) noexcept {
+    ++_fsyncs_issued;
+    return do_fdatasync(fd).then_wrapped([this, fd] (future<> f) {
+        auto it = _fsync_batches.find(fd);
+        auto waiters = std::exchange(it->second.next, {});
+        if (waiters.empty()) {
+            _fsync_batches.erase(it);
+        } else {
+            (void)issue_fdatasync(fd).then_wrapped([waiters = std::move(waiters)] (future<> f) mutable {
+                if (f.failed()) {
+                    auto ex = f.get_exception();
+                    for (auto& pr : waiters) {
+                        pr.set_exception(ex);
+                    }
+                } else {
+                    for (auto& pr : waiters) {
+                        pr.set_value();
+                    }
+                }
+            });
+        }
+        return f;
+    });
+}
+
+future<>
+reactor::do_fdatasync(int fd) noexcept {
     if (_have_aio_fsync) {
         // Does not go through the I/O queue, but has to be deleted
         struct fsync_io_desc final : public io_completion {
@@ -2121,7 +2729,7 @@ reactor::fdatasync(int fd) noexcept {
     }
     return _thread_pool->submit<syscall_result<int>>([fd] {
         return wrap_syscall<int>(::fdatasync(fd));
-    }).then([] (syscall_result<int> sr) {
+    }, thread_pool::lane::slow).then([] (syscall_result<int> sr) {
         sr.throw_if_error();
         return make_ready_future<>();
     });
@@ -2249,7 +2857,7 @@ uint64_t
 reactor::pending_task_count() const {
     uint64_t ret = 0;
     for (auto&& tq : _task_queues) {
-        ret += tq->_q.size();
+        ret += tq->size();
     }
     return ret;
 }
@@ -2268,10 +2876,42 @@ void reactor::register_metrics() {
             // total_operations value:DERIVE:0:U
             sm::make_counter("tasks_processed", std::bind(&reactor::tasks_processed, this), sm::description("Total tasks processed")),
             sm::make_counter("polls", _polls, sm::description("Number of times pollers were executed")),
+            sm::make_counter("stealable_tasks_submitted", _stealable_queue->submitted,
+                    sm::description("Total tasks queued by smp::submit_stealable() for possible execution on sibling shards")),
+            sm::make_counter("tasks_stolen", _stealable_queue->stolen,
+                    sm::description("Total tasks stolen from sibling shards and run on this one")),
+            sm::make_counter("tasks_stolen_by_siblings", _stealable_queue->stolen_from,
+                    sm::description("Total tasks queued on this shard that sibling shards stole and ran")),
             sm::make_gauge("timers_pending", std::bind(&decltype(_timers)::size, &_timers), sm::description("Number of tasks in the timer-pending queue")),
             sm::make_gauge("utilization", [this] { return (1-_load)  * 100; }, sm::description("CPU utilization")),
             sm::make_counter("cpu_busy_ms", [this] () -> int64_t { return total_busy_time() / 1ms; },
                     sm::description("Total cpu busy time in milliseconds")),
+            sm::make_counter("idle_poll_time_ms", [this] () -> int64_t { return (_total_idle - _total_sleep) / 1ms; },
+                    sm::description("Total time spent polling for work while idle, in milliseconds")),
+            sm::make_counter("sleep_time_ms", [this] () -> int64_t { return _total_sleep / 1ms; },
+                    sm::description("Total time spent sleeping while idle, in milliseconds")),
+            sm::make_counter("sleeps", _sleeps, sm::description("Number of times the reactor went to sleep after polling while idle")),
+            sm::make_gauge("idle_poll_limit_us", [this] () -> double { return _max_poll_time == std::chrono::nanoseconds::max() ? -1 : _max_poll_time / 1us; },
+                    sm::description("How long the reactor polls for work while idle before sleeping, in microseconds; -1 if it never sleeps")),
+            sm::make_gauge("parked", [this] { return _parked; },
+                    sm::description("Whether the shard is parked: sleeps as soon as it runs out of work, because of --park-below-load")),
+            sm::make_counter("parks", _parks, sm::description("Number of times the shard parked")),
+            sm::make_counter("parked_time_ms", [this] () -> int64_t { return (_total_parked + (_parked ? now() - _parked_since : sched_clock::duration::zero())) / 1ms; },
+                    sm::description("Total time the shard was parked, in milliseconds")),
+            sm::make_counter("timer_expirations", _timer_delays[false].expirations, sm::description("Number of high resolution timer expirations while not parked")),
+            sm::make_counter("timer_delay_us", [this] () -> int64_t { return _timer_delays[false].total / 1us; },
+                    sm::description("Total delay of high resolution timer expirations past their deadline while not parked, in microseconds")),
+            sm::make_counter("parked_timer_expirations", _timer_delays[true].expirations, sm::description("Number of high resolution timer expirations while parked")),
+            sm::make_counter("parked_timer_delay_us", [this] () -> int64_t { return _timer_delays[true].total / 1us; },
+                    sm::description("Total delay of high resolution timer expirations past their deadline while parked, in microseconds; "
+                                    "compared with timer_delay_us, the latency cost of parking")),
+            sm::make_counter("cpu_quota_sleeps", _cpu_quota_sleeps,
+                    sm::description("Number of times the shard slept to keep within its part of the cgroup CPU quota")),
+            sm::make_counter("cpu_quota_sleep_time_ms", [this] () -> int64_t { return _cpu_quota_sleep_time / 1ms; },
+                    sm::description("Total time the shard slept to keep within its part of the cgroup CPU quota, in milliseconds")),
+            sm::make_counter("major_faults", [] { return mapped_file::major_faults(); },
+                    sm::description("Total major page faults taken by the reactor thread, each of which blocked it on a disk read; "
+                                    "see mapped_file::prefault()")),
             sm::make_counter("cpu_steal_time_ms", [this] () -> int64_t { return total_steal_time() / 1ms; },
                     sm::description("Total steal time, the time in which some other process was running while Seastar was not trying to run (not sleeping)."
                                      "Because this is in userspace, some time that could be legitimally thought as steal time is not accounted as such. For example, if we are sleeping and can wake up but the kernel hasn't woken us up yet.")),
@@ -2284,12 +2924,91 @@ void reactor::register_metrics() {
             sm::make_total_bytes("aio_bytes_write", _io_stats.aio_write_bytes, sm::description("Total aio-writes bytes")),
             sm::make_counter("aio_outsizes", _io_stats.aio_outsizes, sm::description("Total number of aio operations that exceed IO limit")),
             sm::make_counter("aio_errors", _io_stats.aio_errors, sm::description("Total aio errors")),
+            sm::make_counter("uring_recv_buffers_used", _io_stats.uring_recv_buffers_used,
+                    sm::description("Total socket receives completed into an io_uring provided buffer")),
+            sm::make_counter("uring_recv_buffers_exhausted", _io_stats.uring_recv_buffers_exhausted,
+                    sm::description("Total socket receives that found the io_uring provided buffer ring empty and fell back to an allocated buffer")),
+            sm::make_counter("uring_multishot_accept_submissions", _io_stats.uring_multishot_accept_submissions,
+                    sm::description("Total multishot accept requests submitted to io_uring")),
+            sm::make_counter("uring_multishot_accepts", _io_stats.uring_multishot_accepts,
+                    sm::description("Total connections accepted by multishot accept requests; divide by uring_multishot_accept_submissions for accepts per submission")),
+            sm::make_counter("uring_multishot_recv_submissions", _io_stats.uring_multishot_recv_submissions,
+                    sm::description("Total multishot receive requests submitted to io_uring")),
+            sm::make_counter("uring_multishot_recvs", _io_stats.uring_multishot_recvs,
+                    sm::description("Total buffers received by multishot receive requests")),
+            sm::make_counter("uring_fixed_buffer_ios", _io_stats.uring_fixed_buffer_ios,
+                    sm::description("Total file reads and writes issued on memory registered with io_uring")),
+            sm::make_counter("uring_enters", _io_stats.uring_enters,
+                    sm::description("Total io_uring_enter system calls made to submit requests or wait for completions; divide by polls for system calls per reactor iteration")),
+            sm::make_counter("uring_fixed_buffers_exhausted", _io_stats.uring_fixed_buffers_exhausted,
+                    sm::description("Total DMA buffer allocations that found the io_uring fixed buffer arena empty")),
+            sm::make_counter("uring_zerocopy_sends", _io_stats.uring_zerocopy_sends,
+                    sm::description("Total socket writes issued as io_uring zero-copy sends")),
+            sm::make_counter("uring_zerocopy_sends_copied", _io_stats.uring_zerocopy_sends_copied,
+                    sm::description("Total zero-copy sends for which the kernel fell back to copying the data")),
+            sm::make_counter("packet_sends", _io_stats.packet_sends,
+                    sm::description("Total socket writes of packets")),
+            sm::make_counter("packet_send_iovecs", _io_stats.packet_send_iovecs,
+                    sm::description("Total fragments passed to socket writes of packets, one iovec each")),
             // total_operations value:DERIVE:0:U
             sm::make_counter("fsyncs", _fsyncs, sm::description("Total number of fsync operations")),
+            sm::make_counter("fsyncs_issued", _fsyncs_issued, sm::description("Total number of fsync operations issued to the kernel, concurrent fsyncs of a file are batched into one")),
+            sm::make_counter("fsyncs_batched", _fsyncs_batched, sm::description("Total number of fsync operations served by an fsync issued for a batch of them")),
             // total_operations value:DERIVE:0:U
             sm::make_counter("io_threaded_fallbacks", std::bind(&thread_pool::operation_count, _thread_pool.get()),
                     sm::description("Total number of io-threaded-fallbacks operations")),
+            sm::make_queue_length("syscall_queue_depth", [this] { return _thread_pool->queue_depth(thread_pool::lane::regular); },
+                    sm::description("Number of system calls submitted to the syscall threads and not completed yet")),
+            sm::make_queue_length("slow_syscall_queue_depth", [this] { return _thread_pool->queue_depth(thread_pool::lane::slow); },
+                    sm::description("Number of system calls known to be slow submitted to their own syscall threads and not completed yet")),
+
+    });
+
+    // The throttling of the cgroup is the same for all shards
+    if (_id == 0 && cgroup_cpu_quota && cgroup::cpu_throttling_stats()) {
+        _metric_groups.add_group("reactor", {
+                sm::make_counter("cgroup_throttled_periods", [] { return cgroup::cpu_throttling_stats().value_or(cgroup::cpu_throttling{}).throttled_periods; },
+                        sm::description("Number of periods in which the kernel stopped the cgroup for using up its CPU quota")),
+                sm::make_counter("cgroup_throttled_time_ms", [] () -> int64_t { return cgroup::cpu_throttling_stats().value_or(cgroup::cpu_throttling{}).throttled_time / 1ms; },
+                        sm::description("Total time the kernel stopped the cgroup for using up its CPU quota, in milliseconds")),
+        });
+    }
+
+    _metric_groups.add_group("smp", {
+            sm::make_counter("batched_call_singles", _batched_calls->single,
+                    sm::description("Total functions of smp::submit_batched(), such as foreign_ptr destructions, sent on their own, "
+                                    "because they were the only ones for their shard since the last poll")),
+            sm::make_counter("batched_calls", _batched_calls->batched,
+                    sm::description("Total functions of smp::submit_batched(), such as foreign_ptr destructions, sent along with others for the same shard")),
+            sm::make_counter("batched_call_messages", _batched_calls->batches,
+                    sm::description("Total messages carrying more than one function of smp::submit_batched()")),
+    });
+
+    _metric_groups.add_group("reactor", {
+            sm::make_counter("bulk_wakeups", [] { return internal::get_wakeup_stats().wakeups; },
+                    sm::description("Total resolutions of shared futures and condition variable broadcasts which had waiters")),
+            sm::make_counter("bulk_wakeup_waiters", [] { return internal::get_wakeup_stats().waiters; },
+                    sm::description("Total waiters woken by resolutions of shared futures and condition variable broadcasts")),
+            sm::make_counter("deferred_wakeup_batches", [] { return internal::get_wakeup_stats().deferred_batches; },
+                    sm::description("Total times waking the waiters of a shared future or condition variable broadcast was deferred to a task of its own, "
+                                    "because the task quota was used up")),
+    });
 
+    _metric_groups.add_group("page_cache", {
+            sm::make_counter("hits", [] { return get_page_cache_stats().hits; },
+                    sm::description("Total number of cached file pages served from the page cache")),
+            sm::make_counter("misses", [] { return get_page_cache_stats().misses; },
+                    sm::description("Total number of cached file pages read from disk")),
+            sm::make_counter("read_ahead", [] { return get_page_cache_stats().read_ahead; },
+                    sm::description("Total number of cached file pages read ahead of the requested ranges")),
+            sm::make_counter("evictions", [] { return get_page_cache_stats().evictions; },
+                    sm::description("Total number of pages evicted to stay within the page cache memory limit")),
+            sm::make_counter("reclaimed", [] { return get_page_cache_stats().reclaimed; },
+                    sm::description("Total number of pages evicted on request of the memory allocator")),
+            sm::make_counter("invalidations", [] { return get_page_cache_stats().invalidations; },
+                    sm::description("Total number of pages dropped because of writes, truncation or discards")),
+            sm::make_gauge("bytes", [] { return get_page_cache_stats().bytes; },
+                    sm::description("Memory held by the page cache")),
     });
 
     _metric_groups.add_group("memory", {
@@ -2301,7 +3020,16 @@ void reactor::register_metrics() {
             sm::make_current_bytes("free_memory", [] { return memory::stats().free_memory(); }, sm::description("Free memory size in bytes")),
             sm::make_current_bytes("total_memory", [] { return memory::stats().total_memory(); }, sm::description("Total memory size in bytes")),
             sm::make_current_bytes("allocated_memory", [] { return memory::stats().allocated_memory(); }, sm::description("Allocated memory size in bytes")),
-            sm::make_counter("reclaims_operations", [] { return memory::stats().reclaims(); }, sm::description("Total reclaims operations"))
+            sm::make_counter("reclaims_operations", [] { return memory::stats().reclaims(); }, sm::description("Total reclaims operations")),
+            sm::make_gauge("free_huge_pages", [] { return memory::stats().free_huge_pages(); }, sm::description("Number of entirely free huge pages")),
+            sm::make_current_bytes("transparent_hugepage_memory", [] { return memory::stats().transparent_hugepage_memory(); },
+                    sm::description("Memory backed by transparent huge pages, in bytes")),
+            sm::make_counter("span_allocations", [] { return memory::stats().span_allocations(); },
+                    sm::description("Total number of page spans taken from the allocator's free lists")),
+            sm::make_counter("span_splits", [] { return memory::stats().span_splits(); },
+                    sm::description("Total number of free spans split in half to serve a smaller span allocation")),
+            sm::make_gauge("memory_pressure", [] { return int(memory::current_memory_pressure()); },
+                    sm::description("Memory pressure level: 0 - none, 1 - moderate, 2 - high, 3 - critical"))
     });
 
     _metric_groups.add_group("reactor", {
@@ -2337,19 +3065,53 @@ void reactor::register_metrics() {
                 description(
                         "Counts the number of buffered bytes that were read ahead of time and were discarded because they were not needed, wasting disk bandwidth."
                         " Indicates over-eager read ahead configuration.")),
+        make_counter("fstream_reads_aheads_throttled", _io_stats.fstream_read_aheads_throttled,
+                description(
+                        "Counts the number of times a read ahead was not issued because its priority class exhausted the read ahead budget.")),
     });
 }
 
+void reactor::add_task_with_deadline(task* t, sched_clock::time_point deadline) noexcept {
+    memory::scoped_critical_alloc_section _;
+    auto* q = _task_queues[t->group()._id].get();
+    bool was_empty = q->empty();
+    q->_deadline_q.push_back(task_queue::deadline_task{deadline, t});
+    std::push_heap(q->_deadline_q.begin(), q->_deadline_q.end());
+    if (was_empty) {
+        activate(*q);
+    }
+}
+
+task* reactor::task_queue::pop_front() noexcept {
+    if (_deadline_q.empty()) {
+        auto tsk = _q.front();
+        _q.pop_front();
+        return tsk;
+    }
+    std::pop_heap(_deadline_q.begin(), _deadline_q.end());
+    auto dt = _deadline_q.back();
+    _deadline_q.pop_back();
+    ++_deadline_tasks_processed;
+    if (sched_clock::now() > dt.deadline) {
+        ++_deadline_misses;
+    }
+    return dt.tsk;
+}
+
 void reactor::run_tasks(task_queue& tq) {
     // Make sure new tasks will inherit our scheduling group
     *internal::current_scheduling_group_ptr() = scheduling_group(tq._id);
-    auto& tasks = tq._q;
-    while (!tasks.empty()) {
-        auto tsk = tasks.front();
-        tasks.pop_front();
+    auto trace_handle = internal::current_trace_handle_ptr();
+    auto reset_trace_handle = defer([trace_handle] () noexcept { *trace_handle = 0; });
+    while (!tq.empty()) {
+        auto tsk = tq.pop_front();
         STAP_PROBE(seastar, reactor_run_tasks_single_start);
         task_histogram_add_task(*tsk);
+        *trace_handle = tsk->trace_handle();
         _current_task = tsk;
+        if (__builtin_expect(_cpu_profiler_running, false)) {
+            _current_task_type = &typeid(*tsk);
+        }
         tsk->run_and_dispose();
         _current_task = nullptr;
         STAP_PROBE(seastar, reactor_run_tasks_single_end);
@@ -2357,7 +3119,7 @@ void reactor::run_tasks(task_queue& tq) {
         ++_global_tasks_processed;
         // check at end of loop, to allow at least one task to run
         if (need_preempt()) {
-            if (tasks.size() <= _max_task_backlog) {
+            if (tq.size() <= _max_task_backlog) {
                 break;
             } else {
                 // While need_preempt() is set, task execution is inefficient due to
@@ -2429,6 +3191,19 @@ manual_clock::advance(manual_clock::duration d) noexcept {
     }
 }
 
+bool
+manual_clock::advance_to_next_timer() noexcept {
+    auto& r = *local_engine;
+    if (r.pending_task_count()) {
+        return true;
+    }
+    if (r._manual_timers.empty()) {
+        return false;
+    }
+    advance(std::max(r._manual_timers.get_next_timeout() - now(), duration(0)));
+    return true;
+}
+
 bool
 reactor::do_check_lowres_timers() const noexcept {
     return lowres_clock::now() > _lowres_next_timeout;
@@ -2641,6 +3416,43 @@ class reactor::execution_stage_pollfn final : public reactor::pollfn {
     virtual void exit_interrupt_mode() override { }
 };
 
+class reactor::stealable_pollfn final : public reactor::pollfn {
+    reactor& _r;
+public:
+    stealable_pollfn(reactor& r) : _r(r) {}
+    virtual bool poll() final override {
+        auto& q = *_r._stealable_queue;
+        // A busy shard releases one of its own items per poll, so they make
+        // progress even if no sibling is idle, and leaves the rest to be
+        // stolen. An idle shard takes a batch of its own, or else helps out
+        // a sibling.
+        bool idle = !_r.have_more_tasks();
+        size_t max = idle ? internal::stealable_work_queue::batch_size : 1;
+        size_t got = 0;
+        while (got < max) {
+            auto wi = q.pop();
+            if (!wi) {
+                break;
+            }
+            _r.add_task(wi);
+            got++;
+        }
+        if (!got && idle) {
+            got = q.steal(max);
+        }
+        return got;
+    }
+    virtual bool pure_poll() override final {
+        auto& q = *_r._stealable_queue;
+        return !q.empty() || q.siblings_have_work();
+    }
+    virtual bool try_enter_interrupt_mode() override {
+        // Siblings wake us up when they queue more work
+        return !pure_poll();
+    }
+    virtual void exit_interrupt_mode() override final { }
+};
+
 class reactor::syscall_pollfn final : public reactor::pollfn {
     reactor& _r;
 public:
@@ -2702,10 +3514,9 @@ reactor::have_more_tasks() const {
     return _active_task_queues.size() + _activating_task_queues.size();
 }
 
-void reactor::insert_active_task_queue(task_queue* tq) {
+void reactor::insert_active_task_queue(task_queue_list& atq, sched_entity* tq) {
     tq->_active = true;
-    auto& atq = _active_task_queues;
-    auto less = task_queue::indirect_compare();
+    auto less = sched_entity::indirect_compare();
     if (atq.empty() || less(atq.back(), tq)) {
         // Common case: idle->working
         // Common case: CPU intensive task queue going to the back
@@ -2723,17 +3534,44 @@ void reactor::insert_active_task_queue(task_queue* tq) {
 }
 
 reactor::task_queue* reactor::pop_active_task_queue(sched_clock::time_point now) {
-    task_queue* tq = _active_task_queues.front();
+    sched_entity* e = _active_task_queues.front();
     _active_task_queues.pop_front();
-    tq->_starvetime += now - tq->_ts;
+    if (e->_is_group) {
+        // Stays active while its queue runs, and is put back after it
+        auto& g = static_cast<task_queue_group&>(*e);
+        _last_vruntime = std::max(g._vruntime, _last_vruntime);
+        e = g._active_queues.front();
+        g._active_queues.pop_front();
+    }
+    auto* tq = static_cast<task_queue*>(e);
+    auto delay = now - tq->_ts;
+    tq->_starvetime += delay;
+    tq->_queue_delay.add(delay);
     return tq;
 }
 
+void
+reactor::publish_runnable_tasks() noexcept {
+    if (!smp::_loads) {
+        return;
+    }
+    unsigned tasks = 0;
+    for (auto& tq : _task_queues) {
+        if (tq) {
+            tasks += tq->size();
+        }
+    }
+    auto& published = smp::_loads[_id].runnable_tasks;
+    if (published.load(std::memory_order_relaxed) != tasks) {
+        published.store(tasks, std::memory_order_relaxed);
+    }
+}
+
 void
 reactor::insert_activating_task_queues() {
     // Quadratic, but since we expect the common cases in insert_active_task_queue() to dominate, faster
     for (auto&& tq : _activating_task_queues) {
-        insert_active_task_queue(tq);
+        insert_active_task_queue(_active_task_queues, tq);
     }
     _activating_task_queues.clear();
 }
@@ -2756,21 +3594,41 @@ reactor::run_some_tasks() {
         task_queue* tq = pop_active_task_queue(t_run_started);
         sched_print("running tq {} {}", (void*)tq, tq->_name);
         tq->_current = true;
-        _last_vruntime = std::max(tq->_vruntime, _last_vruntime);
+        auto* g = tq->_parent;
+        if (g) {
+            g->_last_vruntime = std::max(tq->_vruntime, g->_last_vruntime);
+        } else {
+            _last_vruntime = std::max(tq->_vruntime, _last_vruntime);
+        }
         run_tasks(*tq);
         tq->_current = false;
         t_run_completed = now();
         auto delta = t_run_completed - t_run_started;
         account_runtime(*tq, delta);
+        auto pause = tq->_cap ? charge_cpu_cap(*tq, t_run_completed, delta) : sched_clock::duration(0);
+        tq->_quantum_runtime.add(delta);
         sched_print("run complete ({} {}); time consumed {} usec; final vruntime {} empty {}",
-                (void*)tq, tq->_name, delta / 1us, tq->_vruntime, tq->_q.empty());
+                (void*)tq, tq->_name, delta / 1us, tq->_vruntime, tq->empty());
         tq->_ts = t_run_completed;
-        if (!tq->_q.empty()) {
-            insert_active_task_queue(tq);
-        } else {
+        if (tq->empty()) {
             tq->_active = false;
+        } else if (pause.count()) {
+            // Stays active, so that new tasks don't put it back early
+            sched_print("tq {} {} throttled for {} usec", (void*)tq, tq->_name, pause / 1us);
+            tq->_throttles++;
+            tq->_cap_timer.arm(t_run_completed + pause);
+        } else {
+            insert_active_task_queue(g ? g->_active_queues : _active_task_queues, tq);
+        }
+        if (g) {
+            if (!g->_active_queues.empty()) {
+                insert_active_task_queue(_active_task_queues, g);
+            } else {
+                g->_active = false;
+            }
         }
     } while (have_more_tasks() && !need_preempt());
+    publish_runnable_tasks();
     _cpu_stall_detector->end_task_run(t_run_completed);
     STAP_PROBE(seastar, reactor_run_tasks_end);
     *internal::current_scheduling_group_ptr() = default_scheduling_group(); // Prevent inheritance from last group run
@@ -2789,17 +3647,39 @@ reactor::activate(task_queue& tq) {
     // bound later.
     //
     // FIXME: different scheduling groups have different sensitivity to jitter, take advantage
+    auto now = reactor::now();
+    tq._waittime += now - tq._ts;
+    tq._ts = now;
+    if (auto g = tq._parent) {
+        // The same, within the supergroup, and for the supergroup itself
+        // at the top level. The queue goes straight into the supergroup's
+        // list, which only run_some_tasks() reads.
+        tq._vruntime = std::max(g->_last_vruntime, tq._vruntime);
+        insert_active_task_queue(g->_active_queues, &tq);
+        if (g->_active) {
+            return;
+        }
+        g->_active = true;
+        g->_vruntime = std::max(_last_vruntime, g->_vruntime);
+        _activating_task_queues.push_back(g);
+        return;
+    }
     if (_last_vruntime > tq._vruntime) {
         sched_print("tq {} {} losing vruntime {} due to sleep", (void*)&tq, tq._name, _last_vruntime - tq._vruntime);
     }
     tq._vruntime = std::max(_last_vruntime, tq._vruntime);
-    auto now = reactor::now();
-    tq._waittime += now - tq._ts;
-    tq._ts = now;
     _activating_task_queues.push_back(&tq);
 }
 
 void reactor::service_highres_timer() noexcept {
+    if (!_timers.empty()) {
+        auto delay = now() - _timers.get_next_timeout();
+        if (delay >= sched_clock::duration::zero()) {
+            auto& s = _timer_delays[_parked];
+            s.expirations++;
+            s.total += delay;
+        }
+    }
     complete_timers(_timers, _expired_timers, [this] () noexcept {
         if (!_timers.empty()) {
             enable_timer(_timers.get_next_timeout());
@@ -2847,6 +3727,7 @@ int reactor::do_run() {
     // 6. reap kernel events completion: some of the submissions from last step may return immediately.
     //                                   For example if we are dealing with poll() on a fd that has events.
     poller smp_poller(std::make_unique<smp_pollfn>(*this));
+    poller stealable_poller(std::make_unique<stealable_pollfn>(*this));
 
     poller reap_kernel_completions_poller(std::make_unique<reap_kernel_completions_pollfn>(*this));
     poller io_queue_submission_poller(std::make_unique<io_queue_submission_pollfn>(*this));
@@ -2904,6 +3785,25 @@ int reactor::do_run() {
             _load -= (drop/5);
         }
         _load += (load/5);
+        if (smp::_loads) {
+            smp::_loads[_id].utilization.store(1 - load, std::memory_order_relaxed);
+        }
+        if (_idle_poll_policy) {
+            _idle_poll_policy->update(1s);
+            _max_poll_time = _idle_poll_policy->poll_time();
+        }
+        if (_park_below_load) {
+            if (!_parked && _load < *_park_below_load) {
+                _parked = true;
+                _parks++;
+                _parked_since = now();
+                seastar_logger.debug("Parking shard {}, load {:.3f}", _id, _load);
+            } else if (_parked && _load > 2 * *_park_below_load) {
+                _parked = false;
+                _total_parked += now() - _parked_since;
+                seastar_logger.debug("Unparking shard {}, load {:.3f}", _id, _load);
+            }
+        }
     });
     load_timer.arm_periodic(1s);
 
@@ -2912,8 +3812,8 @@ int reactor::do_run() {
     auto& task_quote_itimerspec = its;
 
     struct sigaction sa_block_notifier = {};
-    sa_block_notifier.sa_handler = &reactor::block_notifier;
-    sa_block_notifier.sa_flags = SA_RESTART;
+    sa_block_notifier.sa_sigaction = &reactor::block_notifier;
+    sa_block_notifier.sa_flags = SA_SIGINFO | SA_RESTART;
     auto r = sigaction(cpu_stall_detector::signal_number(), &sa_block_notifier, nullptr);
     assert(r == 0);
 
@@ -2927,13 +3827,16 @@ int reactor::do_run() {
     };
     while (true) {
         run_some_tasks();
+        if (_cpu_quota_pacer) {
+            pace_cpu_quota();
+        }
         if (_stopped) {
             load_timer.cancel();
             // Final tasks may include sending the last response to cpu 0, so run them
             while (have_more_tasks()) {
                 run_some_tasks();
             }
-            while (!_at_destroy_tasks->_q.empty()) {
+            while (!_at_destroy_tasks->empty()) {
                 run_tasks(*_at_destroy_tasks);
             }
             _finished_running_tasks = true;
@@ -2972,7 +3875,7 @@ int reactor::do_run() {
             }
             if (go_to_sleep) {
                 internal::cpu_relax();
-                if (idle_end - idle_start > _max_poll_time) {
+                if (_parked || idle_end - idle_start > std::max(_max_poll_time, _busy_poll_time)) {
                     // Turn off the task quota timer to avoid spurious wakeups
                     struct itimerspec zero_itimerspec = {};
                     _task_quota_timer.timerfd_settime(0, zero_itimerspec);
@@ -2983,6 +3886,7 @@ int reactor::do_run() {
                     // We may have slept for a while, so freshen idle_end
                     idle_end = now();
                     _total_sleep += idle_end - start_sleep;
+                    _sleeps++;
                     _task_quota_timer.timerfd_settime(0, task_quote_itimerspec);
                 }
             } else {
@@ -3000,6 +3904,33 @@ int reactor::do_run() {
     return _return;
 }
 
+void
+reactor::pace_cpu_quota() {
+    // Reading the thread's CPU time is a system call, so not after every
+    // round of tasks
+    static constexpr auto check_interval = 1ms;
+    static constexpr auto min_pause = 200us;
+    auto t = now();
+    if (t - _cpu_quota_checked < check_interval) {
+        return;
+    }
+    auto cputime = thread_cputime_clock::now().time_since_epoch();
+    auto pause = _cpu_quota_pacer->update(t - _cpu_quota_checked, cputime - _cpu_quota_cputime);
+    _cpu_quota_checked = t;
+    _cpu_quota_cputime = cputime;
+    if (pause < min_pause) {
+        return;
+    }
+    struct itimerspec zero_itimerspec = {};
+    _task_quota_timer.timerfd_settime(0, zero_itimerspec);
+    _cpu_stall_detector->start_sleep();
+    std::this_thread::sleep_for(pause);
+    _cpu_stall_detector->end_sleep();
+    _cpu_quota_sleeps++;
+    _cpu_quota_sleep_time += now() - t;
+    _task_quota_timer.timerfd_settime(0, seastar::posix::to_relative_itimerspec(_task_quota, _task_quota));
+}
+
 void
 reactor::sleep() {
     for (auto i = _pollers.begin(); i != _pollers.end(); ++i) {
@@ -3180,12 +4111,58 @@ unsigned syscall_work_queue::complete() {
 }
 
 
-smp_message_queue::smp_message_queue(reactor* from, reactor* to)
+smp_message_queue::smp_message_queue(reactor* from, reactor* to, const config& cfg)
     : _pending(to)
     , _completed(from)
+    , _traffic_stats(cfg.traffic_stats)
+    , _batching(cfg)
 {
 }
 
+void smp_message_queue::adaptive_batching::account_latency(sched_clock::duration rtt) noexcept {
+    // Round-trip times are noisy, smooth them over the last several samples
+    rtt_estimate += (rtt - rtt_estimate) / 8;
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(rtt).count();
+    auto bucket = us > 0 ? std::min<size_t>(log2floor(uint64_t(us)) + 1, latency_buckets - 1) : 0;
+    latency_hist[bucket]++;
+    latency_count++;
+    latency_sum_us += us;
+}
+
+void smp_message_queue::adaptive_batching::account_depth(size_t depth) noexcept {
+    auto bucket = depth > 0 ? std::min<size_t>(log2floor(depth) + 1, depth_buckets - 1) : 0;
+    depth_hist[bucket]++;
+    depth_count++;
+    depth_sum += depth;
+}
+
+void smp_message_queue::adaptive_batching::adjust(bool batch_was_full) noexcept {
+    // Multiplicative decrease when round trips get slow, so that items stop
+    // lingering in the pending fifo, and additive increase while senders
+    // keep filling batches, so that a flood amortizes the cross-cpu traffic.
+    if (rtt_estimate > latency_target) {
+        batch_limit = std::max<size_t>(batch_limit / 2, 1);
+    } else if (batch_was_full) {
+        batch_limit = std::min(batch_limit + 1, max_batch_size);
+    }
+}
+
+static metrics::histogram make_pow2_histogram(const uint64_t* buckets, size_t nr, uint64_t count, double sum) {
+    metrics::histogram h;
+    h.sample_count = count;
+    h.sample_sum = sum;
+    h.buckets.resize(nr);
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i < nr; i++) {
+        cumulative += buckets[i];
+        h.buckets[i].count = cumulative;
+        h.buckets[i].upper_bound = i == 0 ? 0 : (uint64_t(1) << i) - 1;
+    }
+    // The last bucket also collects everything above it
+    h.buckets[nr - 1].upper_bound = std::numeric_limits<double>::infinity();
+    return h;
+}
+
 smp_message_queue::~smp_message_queue()
 {
     if (_pending.remote != _completed.remote) {
@@ -3210,6 +4187,9 @@ void smp_message_queue::move_pending() {
     _current_queue_length += nr;
     _last_snt_batch = nr;
     _sent += nr;
+    if (_batching.enabled) {
+        _batching.account_depth(_current_queue_length);
+    }
 }
 
 bool smp_message_queue::pure_poll_tx() const {
@@ -3232,9 +4212,12 @@ void smp_message_queue::submit_item(shard_id t, smp_timeout_clock::time_point ti
     }
     _tx.a.pending_fifo.push_back(item.get());
     // no exceptions from this point
+    if (_batching.enabled || _traffic_stats) {
+        item->submitted = sched_clock::now();
+    }
     item.release();
     units_fut.get0().release();
-    if (_tx.a.pending_fifo.size() >= batch_size) {
+    if (_tx.a.pending_fifo.size() >= (_batching.enabled ? _batching.batch_limit : batch_size)) {
         move_pending();
     }
   });
@@ -3318,12 +4301,27 @@ size_t smp_message_queue::process_queue(lf_queue& q, Func process) {
 }
 
 size_t smp_message_queue::process_completions(shard_id t) {
-    auto nr = process_queue<prefetch_cnt*2>(_completed, [t] (work_item* wi) {
-        wi->complete();
-        auto ssg_id = smp_service_group_id(wi->ssg);
-        get_smp_service_groups_semaphore(ssg_id, t).signal();
-        delete wi;
-    });
+    size_t nr;
+    if (_batching.enabled) {
+        auto now = sched_clock::now();
+        nr = process_queue<prefetch_cnt*2>(_completed, [this, t, now] (work_item* wi) {
+            _batching.account_latency(now - wi->submitted);
+            wi->complete();
+            auto ssg_id = smp_service_group_id(wi->ssg);
+            get_smp_service_groups_semaphore(ssg_id, t).signal();
+            delete wi;
+        });
+        if (nr) {
+            _batching.adjust(_last_snt_batch >= _batching.batch_limit);
+        }
+    } else {
+        nr = process_queue<prefetch_cnt*2>(_completed, [t] (work_item* wi) {
+            wi->complete();
+            auto ssg_id = smp_service_group_id(wi->ssg);
+            get_smp_service_groups_semaphore(ssg_id, t).signal();
+            delete wi;
+        });
+    }
     _current_queue_length -= nr;
     _compl += nr;
     _last_cmpl_batch = nr;
@@ -3338,9 +4336,18 @@ void smp_message_queue::flush_request_batch() {
 }
 
 size_t smp_message_queue::process_incoming() {
-    auto nr = process_queue<prefetch_cnt>(_pending, [] (work_item* wi) {
-        wi->process();
-    });
+    size_t nr;
+    if (_traffic_stats) {
+        auto now = sched_clock::now();
+        nr = process_queue<prefetch_cnt>(_pending, [this, now] (work_item* wi) {
+            _queue_time_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(now - wi->submitted).count();
+            wi->process();
+        });
+    } else {
+        nr = process_queue<prefetch_cnt>(_pending, [] (work_item* wi) {
+            wi->process();
+        });
+    }
     _received += nr;
     _last_rcv_batch = nr;
     return nr;
@@ -3361,10 +4368,28 @@ void smp_message_queue::start(unsigned cpuid) {
             // total_operations value:DERIVE:0:U
             sm::make_counter("total_received_messages", _received, sm::description("Total number of received messages"), {sm::shard_label(instance)})(sm::metric_disabled),
             // total_operations value:DERIVE:0:U
-            sm::make_counter("total_sent_messages", _sent, sm::description("Total number of sent messages"), {sm::shard_label(instance)})(sm::metric_disabled),
+            sm::make_counter("total_sent_messages", _sent, sm::description("Total number of sent messages"), {sm::shard_label(instance)})(_traffic_stats),
             // total_operations value:DERIVE:0:U
             sm::make_counter("total_completed_messages", _compl, sm::description("Total number of messages completed"), {sm::shard_label(instance)})(sm::metric_disabled)
     });
+    if (_traffic_stats) {
+        _metrics.add_group("smp", {
+            sm::make_total_bytes("total_sent_bytes", _sent_bytes, sm::description("Total size of the functions, with their captured state, sent"), {sm::shard_label(instance)}),
+            sm::make_counter("total_queue_time_us", [this] { return _queue_time_ns / 1000; },
+                    sm::description("Total time sent messages spent queued before the destination started processing them"), {sm::shard_label(instance)}),
+        });
+    }
+    if (_batching.enabled) {
+        _metrics.add_group("smp", {
+            sm::make_gauge("send_batch_limit", _batching.batch_limit, sm::description("Current adaptive send batch size limit"), {sm::shard_label(instance)}),
+            sm::make_histogram("round_trip_latency", sm::description("Histogram of message round-trip times, in microseconds"), {sm::shard_label(instance)}, [this] {
+                return make_pow2_histogram(_batching.latency_hist.data(), latency_buckets, _batching.latency_count, _batching.latency_sum_us);
+            }),
+            sm::make_histogram("send_queue_depth", sm::description("Histogram of the send queue length after each batch"), {sm::shard_label(instance)}, [this] {
+                return make_pow2_histogram(_batching.depth_hist.data(), depth_buckets, _batching.depth_count, _batching.depth_sum);
+            }),
+        });
+    }
 }
 
 readable_eventfd writeable_eventfd::read_side() {
@@ -3408,6 +4433,10 @@ void schedule_urgent(task* t) noexcept {
     engine().add_urgent_task(t);
 }
 
+void schedule_with_deadline(task* t, sched_clock::time_point deadline) noexcept {
+    engine().add_task_with_deadline(t, deadline);
+}
+
 }
 
 bool operator==(const ::sockaddr_in a, const ::sockaddr_in b) {
@@ -3460,14 +4489,24 @@ reactor_options::reactor_options(program_options::option_group* parent_group)
     , poll_mode(*this, "poll-mode", "poll continuously (100% cpu use)")
     , idle_poll_time_us(*this, "idle-poll-time-us", reactor::calculate_poll_time() / 1us,
                 "idle polling time in microseconds (reduce for overprovisioned environments or laptops)")
+    , idle_poll_budget(*this, "idle-poll-budget", {},
+                "fraction of the CPU time idle polling may use; adapts the idle polling time, up to --idle-poll-time-us, to the lengths of recent idle periods (default: unset, fixed)")
+    , park_below_load(*this, "park-below-load", {},
+                "load (fraction of the CPU time, averaged over 5 seconds) below which a shard stops idle polling and sleeps as soon as it runs out of work, until its load exceeds twice that (default: unset, never park)")
     , poll_aio(*this, "poll-aio", true,
                 "busy-poll for disk I/O (reduces latency and increases throughput)")
     , task_quota_ms(*this, "task-quota-ms", 0.5, "Max time (ms) between polls")
     , io_latency_goal_ms(*this, "io-latency-goal-ms", {}, "Max time (ms) io operations must take (1.5 * task-quota-ms if not set)")
+    , io_latency_target_ms(*this, "io-latency-target-ms", {}, "Target 99th percentile of in-disk io latency (ms), IO queues slow down below the configured disk rates to hold it (disabled if not set)")
+    , io_max_read_merge_kb(*this, "io-max-read-merge-kb", 0, "Max size (KiB) of a read merged from contiguous queued reads of a file (0 disables merging)")
+    , io_trace_entries(*this, "io-trace-entries", 0, "Number of disk requests kept, with their queue, dispatch and completion times, in the I/O trace of each shard (0 disables tracing)")
     , max_task_backlog(*this, "max-task-backlog", 1000, "Maximum number of task backlog to allow; above this we ignore I/O")
+    , cpu_quota_pacing(*this, "cpu-quota-pacing", true, "Keep within the cgroup's CPU quota: default the number of shards to it, and sleep between tasks rather than be throttled by the kernel")
     , blocked_reactor_notify_ms(*this, "blocked-reactor-notify-ms", 25, "threshold in miliseconds over which the reactor is considered blocked if no progress is made")
     , blocked_reactor_reports_per_minute(*this, "blocked-reactor-reports-per-minute", 5, "Maximum number of backtraces reported by stall detector per minute")
     , blocked_reactor_report_format_oneline(*this, "blocked-reactor-report-format-oneline", true, "Print a simplified backtrace on a single line")
+    , blocked_reactor_profile(*this, "blocked-reactor-profile", false, "Sample backtraces while the reactor is blocked, and count them by call stack for flame graphs")
+    , blocked_reactor_profile_interval_us(*this, "blocked-reactor-profile-interval-us", 1000, "CPU time between backtraces sampled while the reactor is blocked, with --blocked-reactor-profile")
     , relaxed_dma(*this, "relaxed-dma", "allow using buffered I/O if DMA is not available (reduces performance)")
     , linux_aio_nowait(*this, "linux-aio-nowait", aio_nowait_supported,
                 "use the Linux NOWAIT AIO feature, which reduces reactor stalls due to aio (autodetected)")
@@ -3492,10 +4531,30 @@ reactor_options::reactor_options(program_options::option_group* parent_group)
     , max_networking_io_control_blocks(*this, "max-networking-io-control-blocks", 10000,
                 "Maximum number of I/O control blocks (IOCBs) to allocate per shard. This translates to the number of sockets supported per shard."
                 " Requires tuning /proc/sys/fs/aio-max-nr. Only valid for the linux-aio reactor backend (see --reactor-backend).")
+    , io_uring_recv_buffers(*this, "io-uring-recv-buffers", 0,
+                "Number of socket receive buffers to register with io_uring per shard (0 to disable). Sockets then share"
+                " the buffers instead of pinning one per pending receive. Requires Linux 5.19 or later."
+                " Only valid for the io_uring reactor backend (see --reactor-backend).")
+    , io_uring_dma_buffers(*this, "io-uring-dma-buffers", 0,
+                "Number of 128k file I/O buffers to register with io_uring per shard (0 to disable). Reads and writes into"
+                " them skip pinning pages on every request; the memory is locked, so RLIMIT_MEMLOCK must allow it."
+                " Only valid for the io_uring reactor backend (see --reactor-backend).")
+    , io_uring_send_zerocopy_threshold(*this, "io-uring-send-zerocopy-threshold", 0,
+                "Socket writes of at least this many bytes are sent without copying the data (0 to disable)."
+                " Requires Linux 6.1 or later. Only valid for the io_uring reactor backend (see --reactor-backend).")
+    , syscall_threads(*this, "syscall-threads", 1,
+                "Number of threads per shard running blocking system calls, such as opening or renaming files")
+    , slow_syscall_threads(*this, "slow-syscall-threads", 1,
+                "Number of threads per shard running system calls known to be slow, such as syncing, allocating"
+                " or discarding file data, apart from --syscall-threads (0 to share those)")
 #ifdef SEASTAR_HEAPPROF
     , heapprof(*this, "heapprof", "enable seastar heap profiling")
+    , heapprof_sampling_interval(*this, "heapprof-sampling-interval", 0,
+                "record one allocation per this many bytes allocated, on average, instead of every allocation (0 to record all)."
+                " Makes heap profiling cheap enough to leave on in production; see --heapprof")
 #else
     , heapprof(*this, "heapprof", program_options::unused{})
+    , heapprof_sampling_interval(*this, "heapprof-sampling-interval", program_options::unused{})
 #endif
     , no_handle_interrupt(*this, "no-handle-interrupt", "ignore SIGINT (for gdb)")
 {
@@ -3509,6 +4568,7 @@ smp_options::smp_options(program_options::option_group* parent_group)
     , reserve_memory(*this, "reserve-memory", {}, "memory reserved to OS (if --memory not specified)")
     , hugepages(*this, "hugepages", {}, "path to accessible hugetlbfs mount (typically /dev/hugepages/something)")
     , lock_memory(*this, "lock-memory", {}, "lock all memory (prevents swapping)")
+    , prefault_memory(*this, "prefault-memory", {}, "fault in shard memory in the background at idle priority (default: as --lock-memory)")
     , thread_affinity(*this, "thread-affinity", true, "pin threads to their cpus (disable for overprovisioning)")
 #ifdef SEASTAR_HAVE_HWLOC
     , num_io_queues(*this, "num-io-queues", {}, "Number of IO queues. Each IO unit will be responsible for a fraction of the IO requests. Defaults to the number of threads")
@@ -3520,6 +4580,8 @@ smp_options::smp_options(program_options::option_group* parent_group)
     , io_properties_file(*this, "io-properties-file", {}, "path to a YAML file describing the characteristics of the I/O Subsystem")
     , io_properties(*this, "io-properties", {}, "a YAML string describing the characteristics of the I/O Subsystem")
     , mbind(*this, "mbind", true, "enable mbind")
+    , numa_migrate_misplaced_memory(*this, "numa-migrate-misplaced-memory", false,
+            "at startup, move resident shard memory found on the wrong NUMA node to its intended node")
 #ifndef SEASTAR_NO_EXCEPTION_HACK
     , enable_glibc_exception_scaling_workaround(*this, "enable-glibc-exception-scaling-workaround", true, "enable workaround for glibc/gcc c++ exception scalablity problem")
 #else
@@ -3527,9 +4589,21 @@ smp_options::smp_options(program_options::option_group* parent_group)
 #endif
 #ifdef SEASTAR_HAVE_HWLOC
     , allow_cpus_in_remote_numa_nodes(*this, "allow-cpus-in-remote-numa-nodes", true, "if some CPUs are found not to have any local NUMA nodes, allow assigning them to remote ones")
+    , hwloc_topology_cache(*this, "hwloc-topology-cache", {}, "file to load the hardware topology from instead of discovering it, written if missing")
+    , avoid_smt_siblings(*this, "avoid-smt-siblings", false, "place at most one shard on each physical core, leaving SMT siblings unused")
+    , prefer_performance_cores(*this, "prefer-performance-cores", false, "on hosts with cores of several kinds, place shards on the most performant ones only, unless --smp needs more")
 #else
     , allow_cpus_in_remote_numa_nodes(*this, "allow-cpus-in-remote-numa-nodes", program_options::unused{})
+    , hwloc_topology_cache(*this, "hwloc-topology-cache", program_options::unused{})
+    , avoid_smt_siblings(*this, "avoid-smt-siblings", program_options::unused{})
+    , prefer_performance_cores(*this, "prefer-performance-cores", program_options::unused{})
 #endif
+    , smp_adaptive_batching(*this, "smp-adaptive-batching", false,
+                "adapt the batching of cross-shard messages to their round-trip time instead of using a fixed batch size")
+    , smp_batch_latency_target_us(*this, "smp-batch-latency-target-us", 100,
+                "cross-shard round-trip time (us) above which adaptive batching shrinks batches")
+    , smp_traffic_stats(*this, "smp-traffic-stats", false,
+                "account the size and queueing time of cross-shard messages per shard pair, and export them as metrics")
 {
 }
 
@@ -3551,6 +4625,8 @@ thread_local std::unique_ptr<reactor, reactor_deleter> reactor_holder;
 thread_local smp_message_queue** smp::_qs;
 thread_local std::thread::id smp::_tmain;
 unsigned smp::count = 0;
+std::vector<shard_placement> smp::_placements;
+std::unique_ptr<internal::published_shard_load[]> smp::_loads;
 
 void smp::start_all_queues()
 {
@@ -3614,6 +4690,7 @@ void smp::allocate_reactor(unsigned id, reactor_backend_selector rbs, reactor_co
 }
 
 void smp::cleanup() noexcept {
+    _prefaulter.reset();
     smp::_threads = std::vector<posix_thread>();
     _thread_loops.clear();
 }
@@ -3679,6 +4756,10 @@ static void sigabrt_action() noexcept {
     reraise_signal(SIGABRT);
 }
 
+void smp::prefaulter_deleter::operator()(internal::memory_prefaulter* p) const {
+    delete p;
+}
+
 void smp::qs_deleter::operator()(smp_message_queue** qs) const {
     for (unsigned i = 0; i < smp::count; i++) {
         for (unsigned j = 0; j < smp::count; j++) {
@@ -3694,6 +4775,8 @@ class disk_config_params {
     unsigned _num_io_groups = 0;
     std::unordered_map<dev_t, mountpoint_params> _mountpoints;
     std::chrono::duration<double> _latency_goal;
+    std::chrono::duration<double> _latency_target{0};
+    size_t _max_read_merge_length = 0;
 
 public:
     uint64_t per_io_group(uint64_t qty, unsigned nr_groups) const noexcept {
@@ -3716,6 +4799,14 @@ class disk_config_params {
         seastar_logger.debug("smp::count: {}", smp::count);
         _latency_goal = std::chrono::duration_cast<std::chrono::duration<double>>(latency_goal_opt(reactor_opts) * 1ms);
         seastar_logger.debug("latency_goal: {}", latency_goal().count());
+        if (reactor_opts.io_latency_target_ms) {
+            auto target = reactor_opts.io_latency_target_ms.get_value();
+            if (target <= 0) {
+                throw std::runtime_error("io-latency-target-ms must be greater than zero");
+            }
+            _latency_target = std::chrono::duration_cast<std::chrono::duration<double>>(target * 1ms);
+        }
+        _max_read_merge_length = size_t(reactor_opts.io_max_read_merge_kb.get_value()) << 10;
 
         if (smp_opts.num_io_groups) {
             _num_io_groups = smp_opts.num_io_groups.get_value();
@@ -3765,8 +4856,22 @@ class disk_config_params {
                             d.read_req_rate == 0 || d.write_req_rate == 0) {
                         throw std::runtime_error(fmt::format("R/W bytes and req rates must not be zero"));
                     }
+                    for (auto& [read_ratio, iops] : d.mixed_iops) {
+                        if (read_ratio < 0 || read_ratio >= 1 || iops == 0) {
+                            throw std::runtime_error(fmt::format("Mountpoint {} mixed_iops read_ratio must be in [0, 1) and iops must not be zero", d.mountpoint));
+                        }
+                    }
+                    if (d.stripe_members == 0 || (d.stripe_members > 1 && (d.stripe_size == 0 || d.stripe_size % 512 != 0))) {
+                        throw std::runtime_error(fmt::format("Mountpoint {} stripe_size must be a non-zero multiple of 512 and stripe_members must not be zero", d.mountpoint));
+                    }
 
                     seastar_logger.debug("dev_id: {} mountpoint: {}", st_dev, d.mountpoint);
+                    if (!d.read_iops_curve.empty()) {
+                        // Requests queued deeper than that mostly add latency
+                        auto best = std::max_element(d.read_iops_curve.begin(), d.read_iops_curve.end(), [] (auto& a, auto& b) { return a.second < b.second; })->second;
+                        auto knee = std::find_if(d.read_iops_curve.begin(), d.read_iops_curve.end(), [best] (auto& point) { return point.second >= best * 0.9; });
+                        seastar_logger.info("Mountpoint {} reaches 90% of its read IOPS at depth {}", d.mountpoint, knee->first);
+                    }
                     _mountpoints.emplace(st_dev, d);
                 }
             }
@@ -3777,6 +4882,26 @@ class disk_config_params {
         _mountpoints.emplace(0, d);
     }
 
+    // The cost of a write, in reads, with which the rates of the mixed
+    // loads come closest to the capacity of the disk: with reads costing
+    // 1/R and writes k/R, a load reading a fraction r of its requests gets
+    // M IOPS when r/R + (1-r)k/R = 1/M. Disks often do worse on mixed
+    // loads than their read and write IOPS alone tell, so the result is
+    // never below R/W, which keeps pure write loads within the disk's rate.
+    static unsigned mixed_write_to_read_multiplier(const mountpoint_params& p) noexcept {
+        double r_rate = p.read_req_rate;
+        double k_linear = r_rate / p.write_req_rate;
+        double num = 0, den = 0;
+        for (auto& [r, m] : p.mixed_iops) {
+            double a = (1 - r) / r_rate;
+            double b = 1.0 / m - r / r_rate;
+            num += a * b;
+            den += a * a;
+        }
+        auto k = den > 0 ? std::max(num / den, k_linear) : k_linear;
+        return io_queue::read_request_base_count * k;
+    }
+
     struct io_queue::config generate_config(dev_t devid, unsigned nr_groups) const {
         seastar_logger.debug("generate_config dev_id: {}", devid);
         const mountpoint_params& p = _mountpoints.at(devid);
@@ -3791,6 +4916,9 @@ class disk_config_params {
         if (p.read_req_rate != std::numeric_limits<uint64_t>::max()) {
             cfg.req_count_rate = io_queue::read_request_base_count * (unsigned long)per_io_group(p.read_req_rate, nr_groups);
             cfg.disk_req_write_to_read_multiplier = (io_queue::read_request_base_count * p.read_req_rate) / p.write_req_rate;
+            if (!p.mixed_iops.empty()) {
+                cfg.disk_req_write_to_read_multiplier = mixed_write_to_read_multiplier(p);
+            }
         }
         if (p.read_saturation_length != std::numeric_limits<uint64_t>::max()) {
             cfg.disk_read_saturation_length = p.read_saturation_length;
@@ -3802,6 +4930,10 @@ class disk_config_params {
         cfg.duplex = p.duplex;
         cfg.rate_factor = p.rate_factor;
         cfg.rate_limit_duration = latency_goal();
+        cfg.latency_target = _latency_target;
+        cfg.max_read_merge_length = _max_read_merge_length;
+        cfg.stripe_size = p.stripe_size;
+        cfg.stripe_members = p.stripe_members;
         // Block count limit should not be less than the minimal IO size on the device
         // On the other hand, even this is not good enough -- in the worst case the
         // scheduler will self-tune to allow for the single 64k request, while it would
@@ -3893,6 +5025,11 @@ void smp::configure(const smp_options& smp_opts, const reactor_options& reactor_
     }
 
     resource::configuration rc;
+#ifdef SEASTAR_HAVE_HWLOC
+    if (smp_opts.hwloc_topology_cache) {
+        rc.topology.set_xml_cache(smp_opts.hwloc_topology_cache.get_value());
+    }
+#endif
 
     smp::count = 1;
     smp::_tmain = std::this_thread::get_id();
@@ -3919,10 +5056,31 @@ void smp::configure(const smp_options& smp_opts, const reactor_options& reactor_
         cpu_set = opts_cpuset;
     }
 
+#ifdef SEASTAR_HAVE_HWLOC
+    resource::placement_policy placement;
+    placement.avoid_smt_siblings = smp_opts.avoid_smt_siblings.get_value();
+    placement.prefer_performance_cores = smp_opts.prefer_performance_cores.get_value();
+    if (placement.avoid_smt_siblings || placement.prefer_performance_cores) {
+        cpu_set = resource::apply_placement_policy(rc, std::move(cpu_set), placement,
+                smp_opts.smp ? std::optional<unsigned>(smp_opts.smp.get_value()) : std::nullopt);
+    }
+#endif
+
+    if (reactor_opts.cpu_quota_pacing.get_value()) {
+        cgroup_cpu_quota = cgroup::cpu_limit();
+    }
     if (smp_opts.smp) {
         nr_cpus = smp_opts.smp.get_value();
     } else {
         nr_cpus = cpu_set.size();
+        if (cgroup_cpu_quota) {
+            // Shards with a fraction of a CPU each only add latency
+            auto quota_cpus = std::max(1u, unsigned(std::ceil(cgroup_cpu_quota->cpus())));
+            if (quota_cpus < nr_cpus) {
+                seastar_logger.info("Running {} shards for a cgroup CPU quota of {:.2f} CPUs", quota_cpus, cgroup_cpu_quota->cpus());
+                nr_cpus = quota_cpus;
+            }
+        }
     }
     smp::count = nr_cpus;
     logger::set_shard_field_width(std::ceil(std::log10(smp::count)));
@@ -4000,8 +5158,26 @@ void smp::configure(const smp_options& smp_opts, const reactor_options& reactor_
     if (thread_affinity) {
         smp::pin(allocations[0].cpu_id);
     }
+    auto migrate_misplaced = mbind && smp_opts.numa_migrate_misplaced_memory.get_value();
+    auto migrate_misplaced_memory = [migrate_misplaced] {
+        if (!migrate_misplaced) {
+            return;
+        }
+        auto moved = memory::migrate_misplaced_memory();
+        if (moved) {
+            seastar_logger.info("moved {} bytes of memory to their intended NUMA node", moved);
+        }
+    };
+    auto prefault = smp_opts.memory_allocator == memory_allocator::seastar
+            && (smp_opts.prefault_memory ? smp_opts.prefault_memory.get_value() : mlock);
+    // Written by each shard before reactors_registered
+    std::vector<internal::memory_prefaulter::shard_memory> prefault_memory(prefault ? smp::count : 0);
     if (smp_opts.memory_allocator == memory_allocator::seastar) {
         memory::configure(allocations[0].mem, mbind, hugepages_path);
+        migrate_misplaced_memory();
+    }
+    if (prefault) {
+        prefault_memory[0] = {memory::get_memory_layout(), thread_affinity ? std::optional<unsigned>(allocations[0].cpu_id) : std::nullopt};
     }
 
     if (reactor_opts.abort_on_seastar_bad_alloc) {
@@ -4015,14 +5191,22 @@ void smp::configure(const smp_options& smp_opts, const reactor_options& reactor_
     reactor_config reactor_cfg;
     reactor_cfg.auto_handle_sigint_sigterm = reactor_opts._auto_handle_sigint_sigterm;
     reactor_cfg.max_networking_aio_io_control_blocks = adjust_max_networking_aio_io_control_blocks(reactor_opts.max_networking_io_control_blocks.get_value());
+    reactor_cfg.uring_recv_buffers = reactor_opts.io_uring_recv_buffers.get_value();
+    reactor_cfg.uring_dma_buffers = reactor_opts.io_uring_dma_buffers.get_value();
+    reactor_cfg.uring_send_zerocopy_threshold = reactor_opts.io_uring_send_zerocopy_threshold.get_value();
+    reactor_cfg.syscall_threads = reactor_opts.syscall_threads.get_value();
+    reactor_cfg.slow_syscall_threads = reactor_opts.slow_syscall_threads.get_value();
 
 #ifdef SEASTAR_HEAPPROF
     bool heapprof_enabled = reactor_opts.heapprof;
+    size_t heapprof_sampling_interval = reactor_opts.heapprof_sampling_interval.get_value();
     if (heapprof_enabled) {
+        memory::set_heap_profiling_sampling_interval(heapprof_sampling_interval);
         memory::set_heap_profiling_enabled(heapprof_enabled);
     }
 #else
     bool heapprof_enabled = false;
+    size_t heapprof_sampling_interval = 0;
 #endif
 
 #ifdef SEASTAR_HAVE_DPDK
@@ -4100,7 +5284,7 @@ void smp::configure(const smp_options& smp_opts, const reactor_options& reactor_
     auto smp_tmain = smp::_tmain;
     for (i = 1; i < smp::count; i++) {
         auto allocation = allocations[i];
-        create_thread([this, smp_tmain, inited, &reactors_registered, &smp_queues_constructed, &smp_opts, &reactor_opts, &reactors, hugepages_path, i, allocation, assign_io_queues, alloc_io_queues, thread_affinity, heapprof_enabled, mbind, backend_selector, reactor_cfg] {
+        create_thread([this, smp_tmain, inited, &reactors_registered, &smp_queues_constructed, &smp_opts, &reactor_opts, &reactors, hugepages_path, i, allocation, assign_io_queues, alloc_io_queues, thread_affinity, heapprof_enabled, heapprof_sampling_interval, mbind, migrate_misplaced_memory, backend_selector, reactor_cfg, prefault, &prefault_memory] {
           try {
             // initialize thread_locals that are equal across all reacto threads of this smp instance
             smp::_tmain = smp_tmain;
@@ -4111,8 +5295,13 @@ void smp::configure(const smp_options& smp_opts, const reactor_options& reactor_
             }
             if (smp_opts.memory_allocator == memory_allocator::seastar) {
                 memory::configure(allocation.mem, mbind, hugepages_path);
+                migrate_misplaced_memory();
+            }
+            if (prefault) {
+                prefault_memory[i] = {memory::get_memory_layout(), thread_affinity ? std::optional<unsigned>(allocation.cpu_id) : std::nullopt};
             }
             if (heapprof_enabled) {
+                memory::set_heap_profiling_sampling_interval(heapprof_sampling_interval);
                 memory::set_heap_profiling_enabled(heapprof_enabled);
             }
             sigset_t mask;
@@ -4165,12 +5354,34 @@ void smp::configure(const smp_options& smp_opts, const reactor_options& reactor_
 #endif
 
     reactors_registered.wait();
+    if (prefault) {
+        _prefaulter.reset(new internal::memory_prefaulter(std::move(prefault_memory)));
+    }
+    smp_message_queue::config qcfg;
+    qcfg.adaptive_batching = smp_opts.smp_adaptive_batching.get_value();
+    qcfg.batch_latency_target = std::chrono::microseconds(smp_opts.smp_batch_latency_target_us.get_value());
+    qcfg.traffic_stats = smp_opts.smp_traffic_stats.get_value();
+    auto numa_node_of = [] (const resource::cpu& c) {
+        return c.mem.empty() ? 0u : c.mem.front().nodeid;
+    };
+    _placements.resize(smp::count);
+    _loads = std::make_unique<internal::published_shard_load[]>(smp::count);
+    for (unsigned i = 0; i < smp::count; i++) {
+        _placements[i] = shard_placement{allocations[i].cpu_id, allocations[i].core_id, numa_node_of(allocations[i])};
+    }
+    for (unsigned i = 0; i < smp::count; i++) {
+        for (unsigned j = 0; j < smp::count; j++) {
+            if (i != j && numa_node_of(allocations[i]) == numa_node_of(allocations[j])) {
+                reactors[i]->_stealable_queue->add_sibling(reactors[j]->_stealable_queue.get());
+            }
+        }
+    }
     _qs_owner = decltype(smp::_qs_owner){new smp_message_queue* [smp::count], qs_deleter{}};
     _qs = _qs_owner.get();
     for(unsigned i = 0; i < smp::count; i++) {
         smp::_qs_owner[i] = reinterpret_cast<smp_message_queue*>(operator new[] (sizeof(smp_message_queue) * smp::count));
         for (unsigned j = 0; j < smp::count; ++j) {
-            new (&smp::_qs_owner[i][j]) smp_message_queue(reactors[j], reactors[i]);
+            new (&smp::_qs_owner[i][j]) smp_message_queue(reactors[j], reactors[i], qcfg);
         }
     }
     _alien._qs = alien::instance::create_qs(reactors);
@@ -4183,7 +5394,7 @@ void smp::configure(const smp_options& smp_opts, const reactor_options& reactor_
 }
 
 bool smp::poll_queues() {
-    size_t got = 0;
+    size_t got = engine()._batched_calls->flush();
     for (unsigned i = 0; i < count; i++) {
         if (this_shard_id() != i) {
             auto& rxq = _qs[this_shard_id()][i];
@@ -4198,7 +5409,55 @@ bool smp::poll_queues() {
     return got != 0;
 }
 
+future<std::vector<smp_traffic_stats>> smp::get_traffic_stats() {
+    return do_with(std::vector<smp_traffic_stats>(), [] (std::vector<smp_traffic_stats>& res) {
+        return parallel_for_each(all_cpus(), [&res] (shard_id from) {
+            // The sending shard owns the counters, except for the queueing
+            // time that the destination accounts.
+            return submit_to(from, [from] {
+                std::vector<smp_traffic_stats> local;
+                local.reserve(count - 1);
+                for (shard_id to = 0; to < count; to++) {
+                    if (to != from) {
+                        auto& q = _qs[to][from];
+                        local.push_back(smp_traffic_stats{from, to, q._sent, q._sent_bytes, std::chrono::nanoseconds(q._queue_time_ns)});
+                    }
+                }
+                return local;
+            }).then([&res] (std::vector<smp_traffic_stats> local) {
+                res.insert(res.end(), local.begin(), local.end());
+            });
+        }).then([&res] {
+            std::sort(res.begin(), res.end(), [] (const smp_traffic_stats& a, const smp_traffic_stats& b) {
+                return std::tie(a.from, a.to) < std::tie(b.from, b.to);
+            });
+            return std::move(res);
+        });
+    });
+}
+
+void smp::submit_batched_call(unsigned t, batched_call func) noexcept {
+    try {
+        engine()._batched_calls->add(t, std::move(func));
+    } catch (...) {
+        // Left in place by the failed add
+        (void)submit_to(t, std::move(func));
+    }
+}
+
+void smp::submit_stealable_item(std::unique_ptr<internal::stealable_work_item> wi) noexcept {
+    auto& q = *engine()._stealable_queue;
+    auto p = wi.release();
+    if (!q.push(p)) {
+        // Full; nobody is likely to be idle enough to help anyway
+        engine().add_task(p);
+    }
+}
+
 bool smp::pure_poll_queues() {
+    if (!engine()._batched_calls->empty()) {
+        return true;
+    }
     for (unsigned i = 0; i < count; i++) {
         if (this_shard_id() != i) {
             auto& rxq = _qs[this_shard_id()][i];
@@ -4278,6 +5537,26 @@ future<connected_socket> connect(socket_address sa, socket_address local, transp
     return engine().connect(sa, local, proto);
 }
 
+future<connected_socket> connect(socket_address sa, socket_address local, transport proto, abort_source& as) {
+    if (as.abort_requested()) {
+        return make_exception_future<connected_socket>(as.abort_requested_exception_ptr());
+    }
+    return do_with(engine().net().socket(), [sa, local, proto, &as] (::seastar::socket& s) {
+        // Shutting the socket down stops the attempt, or drops the
+        // connection if it was just established
+        auto sub = as.subscribe([&s] () noexcept {
+            s.shutdown();
+        });
+        return s.connect(sa, local, proto).then_wrapped([&as, sub = std::move(sub)] (future<connected_socket> f) {
+            if (as.abort_requested()) {
+                f.ignore_ready_future();
+                return make_exception_future<connected_socket>(as.abort_requested_exception_ptr());
+            }
+            return f;
+        });
+    });
+}
+
 socket make_socket() {
     return engine().net().socket();
 }
@@ -4364,7 +5643,7 @@ std::chrono::nanoseconds reactor::total_steal_time() {
     // steal time but we have no ways to account it.
     //
     // But what we have here should be good enough and at least has a well defined meaning.
-    return std::chrono::duration_cast<std::chrono::nanoseconds>(now() - _start_time - _total_sleep) -
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(now() - _start_time - _total_sleep - _cpu_quota_sleep_time) -
            std::chrono::duration_cast<std::chrono::nanoseconds>(thread_cputime_clock::now().time_since_epoch());
 }
 
@@ -4388,6 +5667,30 @@ allocate_scheduling_group_id() noexcept {
     return i;
 }
 
+static std::atomic<unsigned long> s_used_scheduling_supergroup_ids_bitmap{1}; // 0=top level
+
+static
+int
+allocate_scheduling_supergroup_id() noexcept {
+    auto b = s_used_scheduling_supergroup_ids_bitmap.load(std::memory_order_relaxed);
+    auto nb = b;
+    unsigned i = 0;
+    do {
+        if (__builtin_popcountl(b) == max_scheduling_supergroups() + 1) {
+            return -1;
+        }
+        i = count_trailing_zeros(~b);
+        nb = b | (1ul << i);
+    } while (!s_used_scheduling_supergroup_ids_bitmap.compare_exchange_weak(b, nb, std::memory_order_relaxed));
+    return i;
+}
+
+static
+void
+deallocate_scheduling_supergroup_id(unsigned id) noexcept {
+    s_used_scheduling_supergroup_ids_bitmap.fetch_and(~(1ul << id), std::memory_order_relaxed);
+}
+
 static
 unsigned long
 allocate_scheduling_group_specific_key() noexcept {
@@ -4417,12 +5720,17 @@ reactor::allocate_scheduling_group_specific_data(scheduling_group sg, scheduling
 }
 
 future<>
-reactor::init_scheduling_group(seastar::scheduling_group sg, sstring name, float shares) {
+reactor::init_scheduling_group(seastar::scheduling_group sg, sstring name, float shares, scheduling_supergroup parent) {
     auto& sg_data = _scheduling_group_specific_data;
     auto& this_sg = sg_data.per_scheduling_group_data[sg._id];
     this_sg.queue_is_initialized = true;
     _task_queues.resize(std::max<size_t>(_task_queues.size(), sg._id + 1));
     _task_queues[sg._id] = std::make_unique<task_queue>(sg._id, name, shares);
+    if (!parent.is_top_level()) {
+        auto& g = *_task_queue_groups[parent._id];
+        _task_queues[sg._id]->_parent = &g;
+        g._nr_queues++;
+    }
     unsigned long num_keys = s_next_scheduling_group_specific_key.load(std::memory_order_relaxed);
 
     return with_scheduling_group(sg, [this, num_keys, sg] () {
@@ -4470,11 +5778,24 @@ reactor::destroy_scheduling_group(scheduling_group sg) noexcept {
         auto& sg_data = _scheduling_group_specific_data;
         auto& this_sg = sg_data.per_scheduling_group_data[sg._id];
         this_sg.queue_is_initialized = false;
+        if (auto g = _task_queues[sg._id]->_parent) {
+            g->_nr_queues--;
+        }
         _task_queues[sg._id].reset();
     });
 
 }
 
+void
+reactor::init_scheduling_supergroup(scheduling_supergroup sg, float shares) {
+    _task_queue_groups[sg._id] = std::make_unique<task_queue_group>(sg._id, shares);
+}
+
+void
+reactor::destroy_scheduling_supergroup(scheduling_supergroup sg) noexcept {
+    _task_queue_groups[sg._id].reset();
+}
+
 void
 internal::no_such_scheduling_group(scheduling_group sg) {
     throw std::invalid_argument(format("The scheduling group does not exist ({})", internal::scheduling_group_index(sg)));
@@ -4490,6 +5811,43 @@ scheduling_group::set_shares(float shares) noexcept {
     engine()._task_queues[_id]->set_shares(shares);
 }
 
+void
+scheduling_group::set_migratable(bool migratable) noexcept {
+    engine()._task_queues[_id]->_migratable = migratable;
+}
+
+bool
+scheduling_group::is_migratable() const noexcept {
+    return engine()._task_queues[_id]->_migratable;
+}
+
+void
+scheduling_group::set_cpu_cap(std::optional<float> fraction) noexcept {
+    engine().set_cpu_cap(*engine()._task_queues[_id], fraction);
+}
+
+std::optional<float>
+scheduling_group::cpu_cap() const noexcept {
+    auto& tq = *engine()._task_queues[_id];
+    return tq._cap ? std::optional<float>(tq._cap->share()) : std::nullopt;
+}
+
+scheduling_supergroup
+scheduling_group::supergroup() const noexcept {
+    auto g = engine()._task_queues[_id]->_parent;
+    return g ? scheduling_supergroup(g->_id) : scheduling_supergroup();
+}
+
+void
+scheduling_supergroup::set_shares(float shares) noexcept {
+    engine()._task_queue_groups[_id]->set_shares(shares);
+}
+
+float
+scheduling_supergroup::get_shares() const noexcept {
+    return engine()._task_queue_groups[_id]->_shares;
+}
+
 future<scheduling_group>
 create_scheduling_group(sstring name, float shares) noexcept {
     auto aid = allocate_scheduling_group_id();
@@ -4506,6 +5864,57 @@ create_scheduling_group(sstring name, float shares) noexcept {
     });
 }
 
+future<scheduling_group>
+create_scheduling_group(sstring name, float shares, scheduling_supergroup parent) noexcept {
+    if (parent.is_top_level()) {
+        return create_scheduling_group(std::move(name), shares);
+    }
+    if (!engine()._task_queue_groups[parent._id]) {
+        return make_exception_future<scheduling_group>(std::invalid_argument(fmt::format("The scheduling supergroup does not exist ({})", parent._id)));
+    }
+    auto aid = allocate_scheduling_group_id();
+    if (aid < 0) {
+        return make_exception_future<scheduling_group>(std::runtime_error(fmt::format("Scheduling group limit exceeded while creating {}", name)));
+    }
+    auto id = static_cast<unsigned>(aid);
+    assert(id < max_scheduling_groups());
+    auto sg = scheduling_group(id);
+    return smp::invoke_on_all([sg, name, shares, parent] {
+        return engine().init_scheduling_group(sg, name, shares, parent);
+    }).then([sg] {
+        return make_ready_future<scheduling_group>(sg);
+    });
+}
+
+future<scheduling_supergroup>
+create_scheduling_supergroup(float shares) noexcept {
+    auto aid = allocate_scheduling_supergroup_id();
+    if (aid < 0) {
+        return make_exception_future<scheduling_supergroup>(std::runtime_error("Scheduling supergroup limit exceeded"));
+    }
+    auto sg = scheduling_supergroup(static_cast<unsigned>(aid));
+    return smp::invoke_on_all([sg, shares] {
+        engine().init_scheduling_supergroup(sg, shares);
+    }).then([sg] {
+        return make_ready_future<scheduling_supergroup>(sg);
+    });
+}
+
+future<>
+destroy_scheduling_supergroup(scheduling_supergroup sg) noexcept {
+    if (sg.is_top_level()) {
+        return make_exception_future<>(make_backtraced_exception_ptr<std::runtime_error>("Attempt to destroy the top level scheduling supergroup"));
+    }
+    if (engine()._task_queue_groups[sg._id]->_nr_queues) {
+        return make_exception_future<>(make_backtraced_exception_ptr<std::runtime_error>("Attempt to destroy a scheduling supergroup which still has groups"));
+    }
+    return smp::invoke_on_all([sg] {
+        engine().destroy_scheduling_supergroup(sg);
+    }).then([sg] {
+        deallocate_scheduling_supergroup_id(sg._id);
+    });
+}
+
 future<scheduling_group_key>
 scheduling_group_key_create(scheduling_group_key_config cfg) noexcept {
     scheduling_group_key key = allocate_scheduling_group_specific_key();
@@ -24,6 +24,8 @@
 #include "uname.hh"
 #include <seastar/core/print.hh>
 #include <seastar/core/reactor.hh>
+#include <seastar/core/bitops.hh>
+#include <seastar/core/smp.hh>
 #include <seastar/core/internal/buffer_allocator.hh>
 #include <seastar/util/defer.hh>
 #include <seastar/util/internal/iovec_utils.hh>
@@ -33,6 +35,7 @@
 #include <filesystem>
 #include <sys/poll.h>
 #include <sys/syscall.h>
+#include <sys/sysmacros.h>
 
 #ifdef SEASTAR_HAVE_URING
 #include <liburing.h>
@@ -49,6 +52,26 @@ using namespace internal;
 using namespace internal::linux_abi;
 namespace fs = std::filesystem;
 
+static std::exception_ptr no_metadata_ops() {
+    return std::make_exception_ptr(std::logic_error("reactor backend cannot issue file system metadata operations"));
+}
+
+future<syscall_result<int>> reactor_backend::openat(sstring path, int flags, mode_t mode) {
+    return make_exception_future<syscall_result<int>>(no_metadata_ops());
+}
+
+future<syscall_result<int>> reactor_backend::renameat(sstring old_path, sstring new_path) {
+    return make_exception_future<syscall_result<int>>(no_metadata_ops());
+}
+
+future<syscall_result<int>> reactor_backend::unlinkat(sstring path, int flags) {
+    return make_exception_future<syscall_result<int>>(no_metadata_ops());
+}
+
+future<syscall_result_extra<struct stat>> reactor_backend::statx(int dirfd, sstring path, int flags) {
+    return make_exception_future<syscall_result_extra<struct stat>>(no_metadata_ops());
+}
+
 class pollable_fd_state_completion : public kernel_completion {
     promise<> _pr;
 public:
@@ -1228,6 +1251,191 @@ detect_io_uring() {
     return bool(ring_opt);
 }
 
+#ifdef SEASTAR_HAVE_URING_BUF_RING
+
+// A ring of fixed-size receive buffers handed to the kernel up front
+// (IORING_REGISTER_PBUF_RING). Receives submitted with IOSQE_BUFFER_SELECT
+// don't carry a buffer; the kernel picks one from the ring only when data
+// arrives. Idle connections therefore don't pin a buffer each, and the
+// received data is handed to the application in place, returning to the
+// ring when the last temporary_buffer referencing it is released.
+class uring_provided_buffer_ring : public enable_lw_shared_from_this<uring_provided_buffer_ring> {
+    ::io_uring* _uring;
+    ::io_uring_buf_ring* _ring = nullptr;
+    const unsigned _nr;
+    const size_t _buffer_size;
+    const shard_id _owner;
+    std::unique_ptr<char[], free_deleter> _buffers;
+    unsigned _available = 0;
+public:
+    static constexpr unsigned short group_id = 0;
+
+    uring_provided_buffer_ring(::io_uring& uring, unsigned nr, size_t buffer_size)
+            : _uring(&uring)
+            , _nr(nr)
+            , _buffer_size(buffer_size)
+            , _owner(this_shard_id()) {
+        auto ring_mem = ::aligned_alloc(4096, align_up<size_t>(_nr * sizeof(::io_uring_buf), 4096));
+        auto buffers_mem = ::aligned_alloc(4096, _nr * _buffer_size);
+        if (!ring_mem || !buffers_mem) {
+            ::free(ring_mem);
+            ::free(buffers_mem);
+            throw std::bad_alloc();
+        }
+        _ring = reinterpret_cast<::io_uring_buf_ring*>(ring_mem);
+        _buffers.reset(reinterpret_cast<char*>(buffers_mem));
+        ::io_uring_buf_ring_init(_ring);
+        auto reg = ::io_uring_buf_reg{};
+        reg.ring_addr = reinterpret_cast<uintptr_t>(_ring);
+        reg.ring_entries = _nr;
+        reg.bgid = group_id;
+        auto r = ::io_uring_register_buf_ring(_uring, &reg, 0);
+        if (r < 0) {
+            ::free(_ring);
+            throw std::system_error(-r, std::system_category(), "registering io_uring provided buffer ring");
+        }
+        for (unsigned bid = 0; bid < _nr; ++bid) {
+            ::io_uring_buf_ring_add(_ring, buffer(bid), _buffer_size, bid, ::io_uring_buf_ring_mask(_nr), bid);
+        }
+        ::io_uring_buf_ring_advance(_ring, _nr);
+        _available = _nr;
+    }
+    ~uring_provided_buffer_ring() {
+        ::free(_ring);
+    }
+    // Called when the ring goes away; buffers still held by the application
+    // stay valid until released, but are no longer returned to the kernel.
+    void unregister() noexcept {
+        if (_uring) {
+            ::io_uring_unregister_buf_ring(_uring, group_id);
+            _uring = nullptr;
+        }
+    }
+    size_t buffer_size() const noexcept {
+        return _buffer_size;
+    }
+    unsigned available() const noexcept {
+        return _available;
+    }
+    char* buffer(unsigned short bid) const noexcept {
+        return _buffers.get() + size_t(bid) * _buffer_size;
+    }
+    // Wraps a buffer the kernel selected and filled.
+    temporary_buffer<char> take(unsigned short bid, size_t size) {
+        --_available;
+        return temporary_buffer<char>(buffer(bid), size, make_deleter([self = shared_from_this(), bid] () mutable {
+            release(std::move(self), bid);
+        }));
+    }
+private:
+    static void release(lw_shared_ptr<uring_provided_buffer_ring> self, unsigned short bid) noexcept {
+        if (this_shard_id() == self->_owner) {
+            self->recycle(bid);
+            return;
+        }
+        // The buffer travelled to another shard; the ring may only be
+        // touched from its owner.
+        try {
+            auto owner = self->_owner;
+            (void)smp::submit_to(owner, [self = std::move(self), bid] {
+                self->recycle(bid);
+            });
+        } catch (...) {
+            // Losing the buffer only shrinks the ring.
+        }
+    }
+    void recycle(unsigned short bid) noexcept {
+        if (!_uring) {
+            return;
+        }
+        ::io_uring_buf_ring_add(_ring, buffer(bid), _buffer_size, bid, ::io_uring_buf_ring_mask(_nr), 0);
+        ::io_uring_buf_ring_advance(_ring, 1);
+        ++_available;
+    }
+};
+
+#endif
+
+// A per-shard arena of DMA buffers registered with io_uring as a single
+// fixed buffer. Reads and writes whose memory lies in the arena are issued as
+// IORING_OP_READ_FIXED/WRITE_FIXED, so the kernel does not have to pin and
+// unpin the pages on every request.
+class uring_registered_buffers : public enable_lw_shared_from_this<uring_registered_buffers> {
+    ::io_uring* _uring;
+    const unsigned _nr;
+    const size_t _buffer_size;
+    const shard_id _owner;
+    std::unique_ptr<char[], free_deleter> _buffers;
+    std::vector<unsigned> _free;
+public:
+    static constexpr int buffer_index = 0;
+
+    uring_registered_buffers(::io_uring& uring, unsigned nr, size_t buffer_size)
+            : _uring(&uring)
+            , _nr(nr)
+            , _buffer_size(buffer_size)
+            , _owner(this_shard_id()) {
+        auto mem = ::aligned_alloc(4096, _nr * _buffer_size);
+        if (!mem) {
+            throw std::bad_alloc();
+        }
+        _buffers.reset(reinterpret_cast<char*>(mem));
+        auto iov = ::iovec{_buffers.get(), _nr * _buffer_size};
+        auto r = ::io_uring_register_buffers(_uring, &iov, 1);
+        if (r < 0) {
+            throw std::system_error(-r, std::system_category(), "registering io_uring fixed buffers");
+        }
+        _free.reserve(_nr);
+        for (unsigned i = _nr; i > 0; --i) {
+            _free.push_back(i - 1);
+        }
+    }
+    // Called when the ring goes away; buffers still held by the application
+    // stay valid until released, but are no longer used for fixed I/O.
+    void unregister() noexcept {
+        if (_uring) {
+            ::io_uring_unregister_buffers(_uring);
+            _uring = nullptr;
+        }
+    }
+    size_t buffer_size() const noexcept {
+        return _buffer_size;
+    }
+    bool contains(const void* p, size_t len) const noexcept {
+        auto b = reinterpret_cast<uintptr_t>(_buffers.get());
+        auto a = reinterpret_cast<uintptr_t>(p);
+        return _uring && a >= b && a + len <= b + _nr * _buffer_size;
+    }
+    // Returns an empty buffer if the arena is exhausted
+    temporary_buffer<char> allocate(size_t size) {
+        if (_free.empty() || !_uring) {
+            return temporary_buffer<char>();
+        }
+        auto idx = _free.back();
+        auto d = make_deleter([self = shared_from_this(), idx] () mutable {
+            release(std::move(self), idx);
+        });
+        _free.pop_back();
+        return temporary_buffer<char>(_buffers.get() + size_t(idx) * _buffer_size, size, std::move(d));
+    }
+private:
+    static void release(lw_shared_ptr<uring_registered_buffers> self, unsigned idx) noexcept {
+        if (this_shard_id() == self->_owner) {
+            self->_free.push_back(idx);
+            return;
+        }
+        // The free list may only be touched from the owning shard
+        try {
+            auto owner = self->_owner;
+            (void)smp::submit_to(owner, [self = std::move(self), idx] {
+                self->_free.push_back(idx);
+            });
+        } catch (...) {
+            // Losing the buffer only shrinks the arena.
+        }
+    }
+};
+
 class reactor_backend_uring final : public reactor_backend {
     // s_queue_len is more or less arbitrary. Too low and we'll be
     // issuing too small batches, too high and we require too much locked
@@ -1239,11 +1447,32 @@ class reactor_backend_uring final : public reactor_backend {
     bool _has_pending_submissions = false;
     file_desc _hrtimer_timerfd;
     preempt_io_context _preempt_io_context;
+#ifdef SEASTAR_HAVE_URING_BUF_RING
+    // Receive buffers shared by all sockets on this shard, see
+    // reactor_options::io_uring_recv_buffers
+    lw_shared_ptr<uring_provided_buffer_ring> _recv_buffers;
+    static constexpr size_t s_recv_buffer_size = 16 * 1024;
+#endif
+    // DMA buffers registered as a fixed buffer, see
+    // reactor_options::io_uring_dma_buffers
+    lw_shared_ptr<uring_registered_buffers> _dma_buffers;
+    static constexpr size_t s_dma_buffer_size = 128 * 1024;
+    // Set if the kernel supports all of the metadata operations, see
+    // reactor_backend::has_metadata_ops()
+    bool _have_metadata_ops = false;
+
+    class multishot_accept_completion;
+    class multishot_recv_completion;
 
     class uring_pollable_fd_state : public pollable_fd_state {
         pollable_fd_state_completion _completion_pollin;
         pollable_fd_state_completion _completion_pollout;
     public:
+        multishot_accept_completion* _multishot_accept = nullptr;
+        multishot_recv_completion* _multishot_recv = nullptr;
+        // Set once a zero-copy send failed with EOPNOTSUPP
+        bool _zerocopy_unsupported = false;
+
         explicit uring_pollable_fd_state(file_desc desc, speculation speculate)
                 : pollable_fd_state(std::move(desc), std::move(speculate)) {
         }
@@ -1259,6 +1488,280 @@ class reactor_backend_uring final : public reactor_backend {
         }
     };
 
+    // Completes requests (such as the cancellation of a multishot request)
+    // nobody waits for.
+    class ignore_completion final : public kernel_completion {
+    public:
+        virtual void complete_with(ssize_t res) override {}
+    };
+
+    // Multishot requests stay armed in the kernel and post one completion
+    // per result until they fail, run out of resources or are cancelled;
+    // a completion without IORING_CQE_F_MORE says the request is gone.
+    // Results nobody has asked for yet are queued. When the fd is
+    // forgotten the request is cancelled, and the completion outlives the
+    // fd until the kernel acknowledges that.
+    template <typename Result>
+    class multishot_completion : public kernel_completion {
+    protected:
+        reactor_backend_uring& _be;
+        pollable_fd_state* _fd;
+        bool _armed = false;
+        circular_buffer<Result> _ready;
+        std::exception_ptr _error;
+        std::optional<promise<Result>> _waiter;
+    public:
+        multishot_completion(reactor_backend_uring& be, pollable_fd_state& fd)
+            : _be(be), _fd(&fd) {}
+        virtual ~multishot_completion() = default;
+        virtual void complete_with(ssize_t res) override {
+            complete_with_flags(res, 0);
+        }
+        bool detached() const noexcept {
+            return !_fd;
+        }
+        void detach() noexcept {
+            _fd = nullptr;
+            _ready.clear();
+            if (!_armed) {
+                delete this;
+                return;
+            }
+            auto sqe = _be.get_sqe();
+            ::io_uring_prep_cancel(sqe, static_cast<kernel_completion*>(this), 0);
+            ::io_uring_sqe_set_data(sqe, static_cast<kernel_completion*>(&_be._ignore_completion));
+            _be._has_pending_submissions = true;
+        }
+    protected:
+        // Returns true if the completion was consumed by a detached request
+        bool finish_cqe(unsigned flags) noexcept {
+            if (!(flags & IORING_CQE_F_MORE)) {
+                _armed = false;
+                if (detached()) {
+                    delete this;
+                    return true;
+                }
+            }
+            return detached();
+        }
+        bool deliver() noexcept {
+            if (!_waiter) {
+                return true;
+            }
+            if (!_ready.empty()) {
+                _waiter->set_value(std::move(_ready.front()));
+                _ready.pop_front();
+            } else if (_error) {
+                _waiter->set_exception(std::exchange(_error, nullptr));
+            } else {
+                return false;
+            }
+            _waiter.reset();
+            return true;
+        }
+        future<Result> wait() {
+            _waiter.emplace();
+            return _waiter->get_future();
+        }
+    };
+
+#ifdef IORING_ACCEPT_MULTISHOT
+    class multishot_accept_completion final : public multishot_completion<std::tuple<pollable_fd, socket_address>> {
+    public:
+        using multishot_completion::multishot_completion;
+        virtual void complete_with_flags(ssize_t res, unsigned flags) override {
+            auto last = !(flags & IORING_CQE_F_MORE);
+            if (finish_cqe(flags)) {
+                if (res >= 0) {
+                    ::close(res);
+                }
+                return;
+            }
+            try {
+                if (res >= 0) {
+                    ++_be._r._io_stats.uring_multishot_accepts;
+                    auto fd = file_desc::from_fd(res);
+                    auto sa = fd.get_remote_address();
+                    pollable_fd pfd(std::move(fd), pollable_fd::speculation(EPOLLOUT));
+                    _ready.emplace_back(std::move(pfd), std::move(sa));
+                } else {
+                    if (res == -EINVAL) {
+                        // The chances are that we shutting down the connection.
+                        _fd->maybe_no_more_recv();
+                    }
+                    throw std::system_error(-res, std::system_category());
+                }
+            } catch (...) {
+                // Errors don't necessarily terminate the request; only
+                // report the ones that do, or the next accept() would
+                // wait for a request that isn't there.
+                if (last || res >= 0) {
+                    _error = std::current_exception();
+                }
+            }
+            deliver();
+        }
+        future<std::tuple<pollable_fd, socket_address>> accept() {
+            auto fut = wait();
+            if (!deliver() && !_armed) {
+                auto sqe = _be.get_sqe();
+                ::io_uring_prep_accept(sqe, _fd->fd.get(), nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                sqe->ioprio |= IORING_ACCEPT_MULTISHOT;
+                ::io_uring_sqe_set_data(sqe, static_cast<kernel_completion*>(this));
+                _be._has_pending_submissions = true;
+                _armed = true;
+                ++_be._r._io_stats.uring_multishot_accept_submissions;
+            }
+            return fut;
+        }
+    };
+#else
+    class multishot_accept_completion : public multishot_completion<std::tuple<pollable_fd, socket_address>> {};
+#endif
+
+#if defined(SEASTAR_HAVE_URING_BUF_RING) && defined(IORING_RECV_MULTISHOT)
+    // Multishot receives always select their buffers from _recv_buffers;
+    // the request terminates with -ENOBUFS when the ring runs dry, and
+    // receiving falls back to allocated buffers until buffers are returned.
+    class multishot_recv_completion final : public multishot_completion<temporary_buffer<char>> {
+        lw_shared_ptr<uring_provided_buffer_ring> _ring;
+        internal::buffer_allocator* _ba = nullptr;
+    public:
+        multishot_recv_completion(reactor_backend_uring& be, pollable_fd_state& fd)
+            : multishot_completion(be, fd), _ring(be._recv_buffers) {}
+        virtual void complete_with_flags(ssize_t res, unsigned flags) override {
+            std::optional<temporary_buffer<char>> buf;
+            try {
+                if (flags & IORING_CQE_F_BUFFER) {
+                    buf = _ring->take(flags >> IORING_CQE_BUFFER_SHIFT, std::max<ssize_t>(res, 0));
+                }
+            } catch (...) {
+                _error = std::current_exception();
+            }
+            if (finish_cqe(flags)) {
+                return;
+            }
+            if (res == -ENOBUFS) {
+                ++_be._r._io_stats.uring_recv_buffers_exhausted;
+                if (_waiter && _ready.empty()) {
+                    futurize_invoke([this] {
+                        return _be.recv_some_allocated(*_fd, _ba);
+                    }).forward_to(std::move(*_waiter));
+                    _waiter.reset();
+                }
+                return;
+            }
+            if (res < 0) {
+                ++_be._r._io_stats.aio_errors;
+                _error = std::make_exception_ptr(std::system_error(-res, std::system_category()));
+            } else {
+                ++_be._r._io_stats.uring_multishot_recvs;
+                try {
+                    // res == 0 is end-of-file, and also terminates the request
+                    _ready.push_back(buf ? std::move(*buf) : temporary_buffer<char>());
+                } catch (...) {
+                    _error = std::current_exception();
+                }
+            }
+            deliver();
+        }
+        future<temporary_buffer<char>> recv(internal::buffer_allocator* ba) {
+            auto fut = wait();
+            if (deliver() || _armed) {
+                _ba = ba;
+                return fut;
+            }
+            if (!_ring->available()) {
+                _waiter.reset();
+                return _be.recv_some_allocated(*_fd, ba);
+            }
+            auto sqe = _be.get_sqe();
+            ::io_uring_prep_recv(sqe, _fd->fd.get(), nullptr, 0, 0);
+            sqe->ioprio |= IORING_RECV_MULTISHOT;
+            sqe->flags |= IOSQE_BUFFER_SELECT;
+            sqe->buf_group = uring_provided_buffer_ring::group_id;
+            ::io_uring_sqe_set_data(sqe, static_cast<kernel_completion*>(this));
+            _be._has_pending_submissions = true;
+            _armed = true;
+            _ba = ba;
+            ++_be._r._io_stats.uring_multishot_recv_submissions;
+            return fut;
+        }
+    };
+#else
+    class multishot_recv_completion : public multishot_completion<temporary_buffer<char>> {};
+#endif
+
+#ifdef SEASTAR_HAVE_URING_SEND_ZC
+    // A zero-copy send posts two completions: the result, flagged with
+    // IORING_CQE_F_MORE, and later a notification (IORING_CQE_F_NOTIF)
+    // once the kernel no longer references the data. The packet's
+    // fragments are kept alive until then.
+    class zerocopy_send_completion final : public kernel_completion {
+        reactor_backend_uring& _be;
+        uring_pollable_fd_state& _fd;
+        net::packet _p;
+        ::msghdr _mh = {};
+    public:
+        promise<size_t> _result;
+
+        zerocopy_send_completion(reactor_backend_uring& be, uring_pollable_fd_state& fd, net::packet& p)
+                : _be(be), _fd(fd), _p(p.share()) {
+            _mh.msg_iov = reinterpret_cast<iovec*>(_p.fragment_array());
+            _mh.msg_iovlen = std::min<size_t>(_p.nr_frags(), IOV_MAX);
+        }
+        ::msghdr* msghdr() {
+            return &_mh;
+        }
+        virtual void complete_with(ssize_t res) override {
+            complete_with_flags(res, 0);
+        }
+        virtual void complete_with_flags(ssize_t res, unsigned flags) override {
+            if (flags & IORING_CQE_F_NOTIF) {
+#ifdef IORING_NOTIF_USAGE_ZC_COPIED
+                if (res & IORING_NOTIF_USAGE_ZC_COPIED) {
+                    ++_be._r._io_stats.uring_zerocopy_sends_copied;
+                }
+#endif
+                delete this;
+                return;
+            }
+            if (res >= 0) {
+                if (size_t(res) == _p.len()) {
+                    _fd.speculate_epoll(EPOLLOUT);
+                }
+                _result.set_value(res);
+            } else if (res == -EOPNOTSUPP) {
+                // Not every socket family supports it; report nothing
+                // written so that the caller retries with a copying send.
+                _fd._zerocopy_unsupported = true;
+                _result.set_value(0);
+            } else {
+                ++_be._r._io_stats.aio_errors;
+                try {
+                    throw_kernel_error(res);
+                } catch (...) {
+                    _result.set_exception(std::current_exception());
+                }
+            }
+            if (!(flags & IORING_CQE_F_MORE)) {
+                delete this;
+            }
+        }
+    };
+
+    future<size_t> write_some_zerocopy(uring_pollable_fd_state& fd, net::packet& p) {
+        auto desc = new zerocopy_send_completion(*this, fd, p);
+        auto fut = desc->_result.get_future();
+        auto sqe = get_sqe();
+        ::io_uring_prep_sendmsg_zc(sqe, fd.fd.get(), desc->msghdr(), MSG_NOSIGNAL);
+        ::io_uring_sqe_set_data(sqe, static_cast<kernel_completion*>(desc));
+        _has_pending_submissions = true;
+        ++_r._io_stats.uring_zerocopy_sends;
+        return fut;
+    }
+#endif
+
     // eventfd and timerfd both need an 8-byte read after completion
     class recurring_eventfd_or_timerfd_completion : public fd_kernel_completion {
         bool _armed = false;
@@ -1303,6 +1806,12 @@ class reactor_backend_uring final : public reactor_backend {
 
     hrtimer_completion _hrtimer_completion;
     smp_wakeup_completion _smp_wakeup_completion;
+    ignore_completion _ignore_completion;
+    // Multishot accept needs Linux 5.19, multishot receive 6.0
+    const bool _has_multishot_accept = kernel_uname().whitelisted({"5.19"});
+    const bool _has_multishot_recv = kernel_uname().whitelisted({"6.0"});
+    // Zero-copy sendmsg needs Linux 6.1
+    const bool _has_send_zc = kernel_uname().whitelisted({"6.1"});
 private:
     static file_desc make_timerfd() {
         return file_desc::timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC|TFD_NONBLOCK);
@@ -1313,11 +1822,21 @@ class reactor_backend_uring final : public reactor_backend {
         return ::io_uring_get_sqe(&_uring);
     }
 
+    // Hands the prepared requests to the kernel, all in one system call;
+    // none if there are none. Returns the number of requests submitted.
+    int submit_prepared() {
+        if (!::io_uring_sq_ready(&_uring)) {
+            return 0;
+        }
+        ++_r._io_stats.uring_enters;
+        return ::io_uring_submit(&_uring);
+    }
+
     bool do_flush_submission_ring() {
         if (_has_pending_submissions) {
             _has_pending_submissions = false;
             _did_work_while_getting_sqe = false;
-            io_uring_submit(&_uring);
+            submit_prepared();
             return true;
         } else {
             return std::exchange(_did_work_while_getting_sqe, false);
@@ -1348,10 +1867,20 @@ class reactor_backend_uring final : public reactor_backend {
         using o = internal::io_request::operation;
         switch (req.opcode()) {
             case o::read:
-                ::io_uring_prep_read(sqe, req.fd(), req.address(), req.size(), req.pos());
+                if (_dma_buffers && _dma_buffers->contains(req.address(), req.size())) {
+                    ::io_uring_prep_read_fixed(sqe, req.fd(), req.address(), req.size(), req.pos(), uring_registered_buffers::buffer_index);
+                    ++_r._io_stats.uring_fixed_buffer_ios;
+                } else {
+                    ::io_uring_prep_read(sqe, req.fd(), req.address(), req.size(), req.pos());
+                }
                 break;
             case o::write:
-                ::io_uring_prep_write(sqe, req.fd(), req.address(), req.size(), req.pos());
+                if (_dma_buffers && _dma_buffers->contains(req.address(), req.size())) {
+                    ::io_uring_prep_write_fixed(sqe, req.fd(), req.address(), req.size(), req.pos(), uring_registered_buffers::buffer_index);
+                    ++_r._io_stats.uring_fixed_buffer_ios;
+                } else {
+                    ::io_uring_prep_write(sqe, req.fd(), req.address(), req.size(), req.pos());
+                }
                 break;
             case o::readv:
                 ::io_uring_prep_readv(sqe, req.fd(), req.iov(), req.iov_len(), req.pos());
@@ -1409,7 +1938,7 @@ class reactor_backend_uring final : public reactor_backend {
         for (auto p = buf; p != buf + nr; ++p) {
             auto cqe = *p;
             auto completion = reinterpret_cast<kernel_completion*>(cqe->user_data);
-            completion->complete_with(cqe->res);
+            completion->complete_with_flags(cqe->res, cqe->flags);
         }
     }
 
@@ -1431,6 +1960,35 @@ class reactor_backend_uring final : public reactor_backend {
         return did_work | std::exchange(_did_work_while_getting_sqe, false);
     }
 
+    // A file system metadata request, which owns what the kernel reads
+    // and writes until it completes
+    class metadata_completion final : public kernel_completion {
+        promise<syscall_result<int>> _pr;
+    public:
+        sstring path;
+        sstring path2;
+
+        virtual void complete_with(ssize_t res) override {
+            _pr.set_value(res < 0 ? syscall_result<int>(-1, -res) : syscall_result<int>(res, 0));
+            delete this;
+        }
+        future<syscall_result<int>> get_future() {
+            return _pr.get_future();
+        }
+    };
+
+    // Prepares the request with prep(sqe, completion); it is submitted
+    // with the rest in the next poll
+    template <typename Prep>
+    future<syscall_result<int>> submit_metadata_request(std::unique_ptr<metadata_completion> desc, Prep prep) {
+        auto fut = desc->get_future();
+        auto sqe = get_sqe();
+        prep(sqe, *desc);
+        ::io_uring_sqe_set_data(sqe, static_cast<kernel_completion*>(desc.release()));
+        _has_pending_submissions = true;
+        return fut;
+    }
+
     template<typename Completion>
     auto submit_request(std::unique_ptr<Completion> desc, io_request&& req) noexcept {
         auto fut = desc->get_future();
@@ -1449,8 +2007,44 @@ class reactor_backend_uring final : public reactor_backend {
         // expired when it really hasn't, we don't want to block in read(tfd, ...).
         auto tfd = _r._task_quota_timer.get();
         ::fcntl(tfd, F_SETFL, ::fcntl(tfd, F_GETFL) | O_NONBLOCK);
+#ifdef SEASTAR_HAVE_URING_BUF_RING
+        if (auto nr = _r._cfg.uring_recv_buffers) {
+            try {
+                // The kernel wants a power of two, at most 32k entries
+                nr = std::min(1u << log2ceil(nr), 32768u);
+                _recv_buffers = make_lw_shared<uring_provided_buffer_ring>(_uring, nr, s_recv_buffer_size);
+            } catch (...) {
+                // Kernels before 5.19 don't support provided buffer rings; the
+                // regular receive path works everywhere.
+                seastar_logger.warn("io_uring provided receive buffers unavailable, using per-socket buffers: {}", std::current_exception());
+            }
+        }
+#endif
+        if (auto probe = ::io_uring_get_probe_ring(&_uring)) {
+            _have_metadata_ops = ::io_uring_opcode_supported(probe, IORING_OP_OPENAT)  // linux 5.6
+                    && ::io_uring_opcode_supported(probe, IORING_OP_STATX)
+                    && ::io_uring_opcode_supported(probe, IORING_OP_RENAMEAT)      // linux 5.11
+                    && ::io_uring_opcode_supported(probe, IORING_OP_UNLINKAT);
+            ::free(probe);
+        }
+        if (auto nr = _r._cfg.uring_dma_buffers) {
+            try {
+                _dma_buffers = make_lw_shared<uring_registered_buffers>(_uring, nr, s_dma_buffer_size);
+            } catch (...) {
+                // Usually RLIMIT_MEMLOCK is too low to pin the arena
+                seastar_logger.warn("io_uring fixed DMA buffers unavailable, using regular buffers: {}", std::current_exception());
+            }
+        }
     }
     ~reactor_backend_uring() {
+#ifdef SEASTAR_HAVE_URING_BUF_RING
+        if (_recv_buffers) {
+            _recv_buffers->unregister();
+        }
+#endif
+        if (_dma_buffers) {
+            _dma_buffers->unregister();
+        }
         ::io_uring_queue_exit(&_uring);
     }
     virtual bool reap_kernel_completions() override {
@@ -1460,26 +2054,85 @@ class reactor_backend_uring final : public reactor_backend {
         bool did_work = false;
         did_work |= _preempt_io_context.service_preempting_io();
         did_work |= queue_pending_file_io();
-        did_work |= ::io_uring_submit(&_uring);
+        did_work |= submit_prepared();
         return did_work;
     }
     virtual bool kernel_events_can_sleep() const override {
         // We never need to spin while I/O is in flight.
         return true;
     }
+    virtual bool has_metadata_ops() const noexcept override {
+        return _have_metadata_ops;
+    }
+    virtual future<syscall_result<int>> openat(sstring path, int flags, mode_t mode) override {
+        auto desc = std::make_unique<metadata_completion>();
+        desc->path = std::move(path);
+        return submit_metadata_request(std::move(desc), [flags, mode] (::io_uring_sqe* sqe, metadata_completion& d) {
+            ::io_uring_prep_openat(sqe, AT_FDCWD, d.path.c_str(), flags, mode);
+        });
+    }
+    virtual future<syscall_result<int>> renameat(sstring old_path, sstring new_path) override {
+        auto desc = std::make_unique<metadata_completion>();
+        desc->path = std::move(old_path);
+        desc->path2 = std::move(new_path);
+        return submit_metadata_request(std::move(desc), [] (::io_uring_sqe* sqe, metadata_completion& d) {
+            ::io_uring_prep_renameat(sqe, AT_FDCWD, d.path.c_str(), AT_FDCWD, d.path2.c_str(), 0);
+        });
+    }
+    virtual future<syscall_result<int>> unlinkat(sstring path, int flags) override {
+        auto desc = std::make_unique<metadata_completion>();
+        desc->path = std::move(path);
+        return submit_metadata_request(std::move(desc), [flags] (::io_uring_sqe* sqe, metadata_completion& d) {
+            ::io_uring_prep_unlinkat(sqe, AT_FDCWD, d.path.c_str(), flags);
+        });
+    }
+    virtual future<syscall_result_extra<struct stat>> statx(int dirfd, sstring path, int flags) override {
+        auto desc = std::make_unique<metadata_completion>();
+        desc->path = std::move(path);
+        // Outlives the completion, which is gone when the result is read
+        auto stx = make_lw_shared<struct ::statx>();
+        return submit_metadata_request(std::move(desc), [dirfd, flags, stx] (::io_uring_sqe* sqe, metadata_completion& d) {
+            ::io_uring_prep_statx(sqe, dirfd, d.path.c_str(), flags, STATX_BASIC_STATS, stx.get());
+        }).then([stx] (syscall_result<int> sr) {
+            struct stat st = {};
+            if (sr.result != -1) {
+                st.st_dev = makedev(stx->stx_dev_major, stx->stx_dev_minor);
+                st.st_ino = stx->stx_ino;
+                st.st_mode = stx->stx_mode;
+                st.st_nlink = stx->stx_nlink;
+                st.st_uid = stx->stx_uid;
+                st.st_gid = stx->stx_gid;
+                st.st_rdev = makedev(stx->stx_rdev_major, stx->stx_rdev_minor);
+                st.st_size = stx->stx_size;
+                st.st_blksize = stx->stx_blksize;
+                st.st_blocks = stx->stx_blocks;
+                st.st_atim = {stx->stx_atime.tv_sec, stx->stx_atime.tv_nsec};
+                st.st_mtim = {stx->stx_mtime.tv_sec, stx->stx_mtime.tv_nsec};
+                st.st_ctim = {stx->stx_ctime.tv_sec, stx->stx_ctime.tv_nsec};
+            }
+            return syscall_result_extra<struct stat>(sr.result, sr.error, st);
+        });
+    }
     virtual void wait_and_process_events(const sigset_t* active_sigmask) override {
         _smp_wakeup_completion.maybe_rearm(*this);
         _hrtimer_completion.maybe_rearm(*this);
-        ::io_uring_submit(&_uring);
         bool did_work = false;
         did_work |= _preempt_io_context.service_preempting_io();
         did_work |= std::exchange(_did_work_while_getting_sqe, false);
         if (did_work) {
+            submit_prepared();
             return;
         }
         struct ::io_uring_cqe* cqe = nullptr;
         sigset_t sigs = *active_sigmask; // io_uring_wait_cqes() wants non-const
+        ++_r._io_stats.uring_enters;
+#ifdef SEASTAR_HAVE_URING_SUBMIT_AND_WAIT_TIMEOUT
+        // Submit the rearmed wakeup requests and wait in the same system call
+        auto r = ::io_uring_submit_and_wait_timeout(&_uring, &cqe, 1, nullptr, &sigs);
+#else
+        submit_prepared();
         auto r = ::io_uring_wait_cqes(&_uring, &cqe, 1, nullptr, &sigs);
+#endif
         if (__builtin_expect(r < 0, false)) {
             switch (-r) {
             case EINTR:
@@ -1502,9 +2155,24 @@ class reactor_backend_uring final : public reactor_backend {
     }
     virtual void forget(pollable_fd_state& fd) noexcept override {
         auto* pfd = static_cast<uring_pollable_fd_state*>(&fd);
+        if (pfd->_multishot_accept) {
+            pfd->_multishot_accept->detach();
+        }
+        if (pfd->_multishot_recv) {
+            pfd->_multishot_recv->detach();
+        }
         delete pfd;
     }
     virtual future<std::tuple<pollable_fd, socket_address>> accept(pollable_fd_state& listenfd) override {
+#ifdef IORING_ACCEPT_MULTISHOT
+        if (listenfd.multishot_accept && _has_multishot_accept) {
+            auto* ufd = static_cast<uring_pollable_fd_state*>(&listenfd);
+            if (!ufd->_multishot_accept) {
+                ufd->_multishot_accept = new multishot_accept_completion(*this, listenfd);
+            }
+            return ufd->_multishot_accept->accept();
+        }
+#endif
         if (listenfd.take_speculation(POLLIN)) {
             try {
                 listenfd.maybe_no_more_recv();
@@ -1740,6 +2408,15 @@ class reactor_backend_uring final : public reactor_backend {
         });
     }
     virtual future<size_t> write_some(pollable_fd_state& fd, net::packet& p) final {
+#ifdef SEASTAR_HAVE_URING_SEND_ZC
+        // Large packets skip speculation too: a non-blocking sendmsg would
+        // copy them.
+        auto& ufd = static_cast<uring_pollable_fd_state&>(fd);
+        auto threshold = _r._cfg.uring_send_zerocopy_threshold;
+        if (threshold && p.len() >= threshold && _has_send_zc && !ufd._zerocopy_unsupported) {
+            return write_some_zerocopy(ufd, p);
+        }
+#endif
         if (fd.take_speculation(EPOLLOUT)) {
             static_assert(offsetof(iovec, iov_base) == offsetof(net::fragment, base) &&
                 sizeof(iovec::iov_base) == sizeof(net::fragment::base) &&
@@ -1839,6 +2516,17 @@ class reactor_backend_uring final : public reactor_backend {
     }
 
     virtual future<temporary_buffer<char>> recv_some(pollable_fd_state& fd, internal::buffer_allocator* ba) override {
+#if defined(SEASTAR_HAVE_URING_BUF_RING) && defined(IORING_RECV_MULTISHOT)
+        // Once armed, the multishot request owns the socket's receive
+        // side, so don't speculate around it.
+        if (fd.multishot_recv && _recv_buffers && _has_multishot_recv) {
+            auto* ufd = static_cast<uring_pollable_fd_state*>(&fd);
+            if (!ufd->_multishot_recv) {
+                ufd->_multishot_recv = new multishot_recv_completion(*this, fd);
+            }
+            return ufd->_multishot_recv->recv(ba);
+        }
+#endif
         if (fd.take_speculation(POLLIN)) {
             auto buffer = ba->allocate_buffer();
             try {
@@ -1847,12 +2535,22 @@ class reactor_backend_uring final : public reactor_backend {
                     if (size_t(*r) == buffer.size()) {
                         fd.speculate_epoll(EPOLLIN);
                     }
+                    buffer.trim(*r);
                     return make_ready_future<temporary_buffer<char>>(std::move(buffer));
                 }
             } catch (...) {
                 return current_exception_as_future<temporary_buffer<char>>();
             }
         }
+#ifdef SEASTAR_HAVE_URING_BUF_RING
+        if (_recv_buffers && _recv_buffers->available()) {
+            return recv_some_provided(fd, ba);
+        }
+#endif
+        return recv_some_allocated(fd, ba);
+    }
+
+    future<temporary_buffer<char>> recv_some_allocated(pollable_fd_state& fd, internal::buffer_allocator* ba) {
         class recv_completion final : public io_completion {
             pollable_fd_state& _fd;
             temporary_buffer<char> _buffer;
@@ -1887,6 +2585,68 @@ class reactor_backend_uring final : public reactor_backend {
         return submit_request(std::move(desc), std::move(req));
     }
 
+#ifdef SEASTAR_HAVE_URING_BUF_RING
+    // Receive without a buffer, letting the kernel select one from
+    // _recv_buffers when data arrives. The buffer allocator is only used
+    // if the ring runs dry in the meantime.
+    future<temporary_buffer<char>> recv_some_provided(pollable_fd_state& fd, internal::buffer_allocator* ba) {
+        class recv_provided_completion final : public kernel_completion {
+            reactor_backend_uring& _be;
+            pollable_fd_state& _fd;
+            internal::buffer_allocator* _ba;
+            lw_shared_ptr<uring_provided_buffer_ring> _ring;
+            promise<temporary_buffer<char>> _result;
+        public:
+            recv_provided_completion(reactor_backend_uring& be, pollable_fd_state& fd, internal::buffer_allocator* ba)
+                : _be(be), _fd(fd), _ba(ba), _ring(be._recv_buffers) {}
+            virtual void complete_with(ssize_t res) override {
+                complete_with_flags(res, 0);
+            }
+            virtual void complete_with_flags(ssize_t res, unsigned flags) override {
+                auto d = defer([this] () noexcept { delete this; });
+                if (res == -ENOBUFS) {
+                    ++_be._r._io_stats.uring_recv_buffers_exhausted;
+                    futurize_invoke([this] {
+                        return _be.recv_some_allocated(_fd, _ba);
+                    }).forward_to(std::move(_result));
+                    return;
+                }
+                if (res < 0) {
+                    ++_be._r._io_stats.aio_errors;
+                    _result.set_exception(std::system_error(-res, std::system_category()));
+                    return;
+                }
+                if (!(flags & IORING_CQE_F_BUFFER)) {
+                    // EOF, no buffer was consumed
+                    _result.set_value(temporary_buffer<char>());
+                    return;
+                }
+                if (size_t(res) == _ring->buffer_size()) {
+                    _fd.speculate_epoll(EPOLLIN);
+                }
+                ++_be._r._io_stats.uring_recv_buffers_used;
+                try {
+                    _result.set_value(_ring->take(flags >> IORING_CQE_BUFFER_SHIFT, res));
+                } catch (...) {
+                    _result.set_exception(std::current_exception());
+                }
+            }
+            future<temporary_buffer<char>> get_future() {
+                return _result.get_future();
+            }
+        };
+        auto desc = new recv_provided_completion(*this, fd, ba);
+        auto fut = desc->get_future();
+        auto sqe = get_sqe();
+        ::io_uring_prep_recv(sqe, fd.fd.get(), nullptr, _recv_buffers->buffer_size(), 0);
+        sqe->flags |= IOSQE_BUFFER_SELECT;
+        sqe->buf_group = uring_provided_buffer_ring::group_id;
+        ::io_uring_sqe_set_data(sqe, static_cast<kernel_completion*>(desc));
+        _has_pending_submissions = true;
+        return fut;
+    }
+#endif
+
     virtual bool do_blocking_io() const override {
         return true;
     }
@@ -1915,6 +2675,24 @@ class reactor_backend_uring final : public reactor_backend {
     virtual pollable_fd_state_ptr make_pollable_fd_state(file_desc fd, pollable_fd::speculation speculate) override {
         return pollable_fd_state_ptr(new uring_pollable_fd_state(std::move(fd), std::move(speculate)));
     }
+    virtual temporary_buffer<char> allocate_dma_buffer(size_t alignment, size_t size) override {
+        // Arena buffers are page aligned
+        if (_dma_buffers && size <= _dma_buffers->buffer_size() && alignment <= 4096) {
+            auto buf = _dma_buffers->allocate(size);
+            if (buf.size()) {
+                return buf;
+            }
+            ++_r._io_stats.uring_fixed_buffers_exhausted;
+        }
+        return reactor_backend::allocate_dma_buffer(alignment, size);
+    }
+    virtual bool cancel_io(kernel_completion* desc) noexcept override {
+        auto sqe = get_sqe();
+        ::io_uring_prep_cancel(sqe, desc, 0);
+        ::io_uring_sqe_set_data(sqe, static_cast<kernel_completion*>(&_ignore_completion));
+        _has_pending_submissions = true;
+        return true;
+    }
 };
 
 #endif
@@ -27,7 +27,11 @@
 #include <seastar/core/internal/poll.hh>
 #include <seastar/core/linux-aio.hh>
 #include <seastar/core/cacheline.hh>
+#include <seastar/core/sstring.hh>
 #include <fmt/ostream.h>
+#include <filesystem>
+#include <system_error>
+#include <sys/stat.h>
 #include <sys/time.h>
 #include <signal.h>
 #include <thread>
@@ -39,6 +43,7 @@
 #ifdef HAVE_OSV
 #include <osv/newpoll.hh>
 #endif
+#include "core/syscall_result.hh"
 
 namespace seastar {
 
@@ -217,6 +222,32 @@ class reactor_backend {
     virtual void start_handling_signal() = 0;
 
     virtual pollable_fd_state_ptr make_pollable_fd_state(file_desc fd, pollable_fd::speculation speculate) = 0;
+
+    // Allocates a buffer for file I/O. Backends that can register memory with
+    // the kernel may hand out such buffers to save pinning pages on each I/O.
+    virtual temporary_buffer<char> allocate_dma_buffer(size_t alignment, size_t size) {
+        return temporary_buffer<char>::aligned(alignment, size);
+    }
+
+    // Asks the kernel to abort an I/O submitted with the given completion.
+    // The completion is still called, with -ECANCELED if the abort worked
+    // or with the result of the I/O otherwise. Returns false if the backend
+    // cannot abort submitted I/O at all.
+    virtual bool cancel_io(kernel_completion* desc) noexcept {
+        return false;
+    }
+
+    // Whether the backend can issue the file system metadata operations
+    // below itself, so that the reactor does not need to run them on the
+    // syscall thread. They take and return what the system calls of the
+    // same names do, and are only called if this returns true.
+    virtual bool has_metadata_ops() const noexcept {
+        return false;
+    }
+    virtual future<syscall_result<int>> openat(sstring path, int flags, mode_t mode);
+    virtual future<syscall_result<int>> renameat(sstring old_path, sstring new_path);
+    virtual future<syscall_result<int>> unlinkat(sstring path, int flags);
+    virtual future<syscall_result_extra<struct stat>> statx(int dirfd, sstring path, int flags);
 };
 
 // reactor backend using file-descriptor & epoll, suitable for running on
@@ -29,6 +29,9 @@
 #include <seastar/util/read_first_line.hh>
 #include <stdlib.h>
 #include <limits>
+#include <cstring>
+#include <fstream>
+#include <unistd.h>
 #include "cgroup.hh"
 #include <seastar/util/log.hh>
 #include <seastar/core/io_queue.hh>
@@ -169,11 +172,15 @@ static optional<fs::path> locate_lowest_cgroup2(fs::path lowest_subdir, std::str
  * For V2, look for the lowest cgroup in our hierarchy that manages the
  * requested settings.
  */
+// on v2-systems, the leaf cgroup that controls this process
+static const optional<fs::path>& cgroup2_path() {
+    static optional<fs::path> cg2_path{cgroup2_path_my_pid()};
+    return cg2_path;
+}
+
 template <typename T>
 optional<T> read_setting_V1V2_as(std::string cg1_path, std::string cg2_fname) {
-    // on v2-systems, cg2_path will be initialized with the leaf cgroup that
-    // controls this process
-    static optional<fs::path> cg2_path{cgroup2_path_my_pid()};
+    auto& cg2_path = cgroup2_path();
 
     if (cg2_path) {
         // this is a v2 system
@@ -205,6 +212,82 @@ optional<T> read_setting_V1V2_as(std::string cg1_path, std::string cg2_fname) {
     return std::nullopt;
 }
 
+static optional<cpu_quota> tighter(optional<cpu_quota> a, optional<cpu_quota> b) {
+    if (!a || (b && b->cpus() < a->cpus())) {
+        return b;
+    }
+    return a;
+}
+
+optional<cpu_quota> cpu_limit() {
+    optional<cpu_quota> ret;
+    try {
+        if (auto& cg2_path = cgroup2_path()) {
+            // "<quota> <period>", or "max <period>"; every level of the
+            // hierarchy may set one
+            for (auto dir = *cg2_path; dir.compare("/sys/fs"); dir = dir.parent_path()) {
+                auto file = dir / "cpu.max";
+                if (!fs::exists(file)) {
+                    continue;
+                }
+                std::vector<std::string> fields;
+                auto line = read_first_line(file);
+                boost::split(fields, line, boost::is_any_of(" "));
+                if (fields.size() == 2 && fields[0] != "max") {
+                    ret = tighter(ret, cpu_quota{std::chrono::microseconds(boost::lexical_cast<int64_t>(fields[0])),
+                            std::chrono::microseconds(boost::lexical_cast<int64_t>(fields[1]))});
+                }
+            }
+        } else {
+            fs::path dir{"/sys/fs/cgroup/cpu"};
+            if (fs::exists(dir / "cpu.cfs_quota_us")) {
+                auto quota = boost::lexical_cast<int64_t>(read_first_line(dir / "cpu.cfs_quota_us"));
+                auto period = boost::lexical_cast<int64_t>(read_first_line(dir / "cpu.cfs_period_us"));
+                // -1 if there is no quota
+                if (quota > 0) {
+                    ret = cpu_quota{std::chrono::microseconds(quota), std::chrono::microseconds(period)};
+                }
+            }
+        }
+    } catch (...) {
+        seastar_logger.warn("Unable to read cgroup's CPU quota: {}. Ignoring.", std::current_exception());
+        return std::nullopt;
+    }
+    if (ret && ret->period.count() <= 0) {
+        return std::nullopt;
+    }
+    return ret;
+}
+
+optional<cpu_throttling> cpu_throttling_stats() {
+    optional<fs::path> cg2_path;
+    try {
+        cg2_path = cgroup2_path();
+    } catch (...) {
+        return std::nullopt;
+    }
+    std::ifstream in(cg2_path ? *cg2_path / "cpu.stat" : fs::path("/sys/fs/cgroup/cpu/cpu.stat"));
+    if (!in) {
+        return std::nullopt;
+    }
+    cpu_throttling ret{};
+    std::string key;
+    uint64_t value;
+    while (in >> key >> value) {
+        if (key == "nr_periods") {
+            ret.periods = value;
+        } else if (key == "nr_throttled") {
+            ret.throttled_periods = value;
+        } else if (key == "throttled_usec") {
+            ret.throttled_time = std::chrono::microseconds(value);
+        } else if (key == "throttled_time" && !cg2_path) {
+            // in nanoseconds
+            ret.throttled_time = std::chrono::microseconds(value / 1000);
+        }
+    }
+    return ret;
+}
+
 }
 
 namespace resource {
@@ -458,11 +541,55 @@ topology_holder& topology_holder::operator=(topology_holder&& o) noexcept {
 }
 
 void topology_holder::init_and_load() {
+    if (_xml_cache && load_xml_cache()) {
+        return;
+    }
     hwloc_topology_init(&_topology);
     // hwloc_topology_destroy is required after hwloc_topology_init
     // on success, _topology will not be null anymore
 
     hwloc_topology_load(_topology);
+    if (_xml_cache) {
+        save_xml_cache();
+    }
+}
+
+bool topology_holder::load_xml_cache() {
+    if (::access(_xml_cache->c_str(), R_OK) != 0) {
+        return false;
+    }
+    hwloc_topology_init(&_topology);
+    // Binding applies to this system, which the cache describes
+    hwloc_topology_set_flags(_topology, HWLOC_TOPOLOGY_FLAG_IS_THISSYSTEM);
+    if (hwloc_topology_set_xml(_topology, _xml_cache->c_str()) == 0 && hwloc_topology_load(_topology) == 0) {
+        // A cheap check that the cache is of this system and of the CPUs
+        // the process may run on
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0
+                && int(hwloc_get_nbobjs_by_type(_topology, HWLOC_OBJ_PU)) == CPU_COUNT(&allowed)) {
+            seastar_logger.debug("Loaded hardware topology from {}", *_xml_cache);
+            return true;
+        }
+    }
+    seastar_logger.warn("Discarding hardware topology cache {}, which does not match this system", *_xml_cache);
+    hwloc_topology_destroy(std::exchange(_topology, nullptr));
+    return false;
+}
+
+void topology_holder::save_xml_cache() {
+    // Written aside and renamed, so that concurrent starts never see part
+    // of it
+    auto tmp = *_xml_cache + ".tmp";
+#if HWLOC_API_VERSION >= 0x00020000
+    auto r = hwloc_topology_export_xml(_topology, tmp.c_str(), 0);
+#else
+    auto r = hwloc_topology_export_xml(_topology, tmp.c_str());
+#endif
+    if (r != 0 || ::rename(tmp.c_str(), _xml_cache->c_str()) != 0) {
+        seastar_logger.warn("Failed to write hardware topology cache {}: {}", *_xml_cache, strerror(errno));
+        ::unlink(tmp.c_str());
+    }
 }
 
 hwloc_topology_t topology_holder::get() {
@@ -599,6 +726,8 @@ resources allocate(configuration& c) {
         auto node = cpu_to_node.at(cpu_id);
         cpu this_cpu;
         this_cpu.cpu_id = cpu_id;
+        auto core = hwloc_get_ancestor(HWLOC_OBJ_CORE, topology, cpu_id);
+        this_cpu.core_id = core ? core->logical_index : cpu_id;
         remain = mem_per_proc - alloc_from_node(this_cpu, node, topo_used_mem, mem_per_proc);
 
         remains.emplace_back(std::move(this_cpu), remain);
@@ -625,6 +754,17 @@ resources allocate(configuration& c) {
         ret.cpus.push_back(std::move(this_cpu));
     }
 
+    std::unordered_map<unsigned, unsigned> core_to_shard;
+    for (unsigned shard = 0; shard < ret.cpus.size(); shard++) {
+        auto& cpu = ret.cpus[shard];
+        seastar_logger.debug("Shard {} on CPU{}, core {}, NUMA{}", shard, cpu.cpu_id, cpu.core_id, cpu.mem.empty() ? 0 : cpu.mem.front().nodeid);
+        auto [it, inserted] = core_to_shard.emplace(cpu.core_id, shard);
+        if (!inserted) {
+            seastar_logger.info("Shards {} and {} share physical core {} (CPU{} and CPU{}); see --avoid-smt-siblings",
+                    it->second, shard, cpu.core_id, ret.cpus[it->second].cpu_id, cpu.cpu_id);
+        }
+    }
+
     unsigned last_node_idx = 0;
     for (auto devid : c.devices) {
         ret.ioq_topology.emplace(devid, allocate_io_queues(topology, ret.cpus, cpu_to_node, c.num_io_groups, last_node_idx));
@@ -636,6 +776,63 @@ unsigned nr_processing_units(configuration& c) {
     return hwloc_get_nbobjs_by_type(c.topology.get(), HWLOC_OBJ_PU);
 }
 
+// Keeps the first CPU of each core
+static cpuset one_cpu_per_core(hwloc_topology_t topology, const cpuset& cpus) {
+    cpuset ret;
+    std::set<hwloc_obj_t> cores;
+    for (auto cpu_id : cpus) {
+        auto core = hwloc_get_ancestor(HWLOC_OBJ_CORE, topology, cpu_id);
+        if (!core || cores.insert(core).second) {
+            ret.insert(cpu_id);
+        }
+    }
+    return ret;
+}
+
+// Keeps the CPUs of the most performant kinds, as many kinds as it takes
+// for nr_shards, or one
+static cpuset performance_cpus(hwloc_topology_t topology, const cpuset& cpus, std::optional<unsigned> nr_shards) {
+#if HWLOC_API_VERSION >= 0x00020400
+    int nr_kinds = hwloc_cpukinds_get_nr(topology, 0);
+    if (nr_kinds <= 1) {
+        return cpus;
+    }
+    cpuset ret;
+    auto bm = hwloc_bitmap_alloc();
+    auto free_bm = defer([&] () noexcept { hwloc_bitmap_free(bm); });
+    // Kinds are sorted by efficiency, the most performant last
+    for (int kind = nr_kinds - 1; kind >= 0; kind--) {
+        int efficiency;
+        if (hwloc_cpukinds_get_info(topology, kind, bm, &efficiency, nullptr, nullptr, 0) != 0) {
+            return cpus;
+        }
+        for (auto cpu_id : cpus) {
+            if (hwloc_bitmap_isset(bm, cpu_id)) {
+                ret.insert(cpu_id);
+            }
+        }
+        if (!ret.empty() && ret.size() >= nr_shards.value_or(1)) {
+            break;
+        }
+    }
+    return ret.empty() ? cpus : ret;
+#else
+    // The kinds of cores are not known to this hwloc
+    return cpus;
+#endif
+}
+
+cpuset apply_placement_policy(configuration& c, cpuset cpus, const placement_policy& p, std::optional<unsigned> nr_shards) {
+    auto topology = c.topology.get();
+    if (p.avoid_smt_siblings) {
+        cpus = one_cpu_per_core(topology, cpus);
+    }
+    if (p.prefer_performance_cores) {
+        cpus = performance_cpus(topology, cpus, nr_shards);
+    }
+    return cpus;
+}
+
 }
 
 }
@@ -676,11 +873,11 @@ resources allocate(configuration& c) {
     ret.cpus.reserve(procs);
     if (c.cpu_set) {
         for (auto cpuid : *c.cpu_set) {
-            ret.cpus.push_back(cpu{cpuid, {{mem / procs, 0}}});
+            ret.cpus.push_back(cpu{cpuid, {{mem / procs, 0}}, cpuid});
         }
     } else {
         for (unsigned i = 0; i < procs; ++i) {
-            ret.cpus.push_back(cpu{i, {{mem / procs, 0}}});
+            ret.cpus.push_back(cpu{i, {{mem / procs, 0}}, i});
         }
     }
 
@@ -692,6 +889,11 @@ unsigned nr_processing_units(configuration&) {
     return ::sysconf(_SC_NPROCESSORS_ONLN);
 }
 
+cpuset apply_placement_policy(configuration&, cpuset cpus, const placement_policy&, std::optional<unsigned>) {
+    // Without hwloc, the cores and their kinds are not known
+    return cpus;
+}
+
 }
 
 }
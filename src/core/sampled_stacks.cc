@@ -0,0 +1,101 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#include "sampled_stacks.hh"
+#include <algorithm>
+#include <execinfo.h>
+#include <iterator>
+#include <ucontext.h>
+
+namespace seastar {
+
+namespace internal {
+
+sampled_stacks::sampled_stacks(size_t capacity)
+        : _capacity(capacity)
+        , _entries(std::make_unique<entry[]>(capacity)) {
+}
+
+void sampled_stacks::record(const uintptr_t* frames, unsigned nr_frames, unsigned sg, const std::type_info* task_type) noexcept {
+    if (_reading) {
+        _dropped++;
+        return;
+    }
+    uint64_t hash = nr_frames ^ (uint64_t(sg) << 32) ^ reinterpret_cast<uintptr_t>(task_type);
+    for (unsigned i = 0; i < nr_frames; ++i) {
+        hash = (hash ^ frames[i]) * 0x100000001b3ull;
+        hash ^= hash >> 29;
+    }
+    for (size_t probe = 0; probe < max_probes; ++probe) {
+        auto& e = _entries[(hash + probe) & (_capacity - 1)];
+        if (!e.count) {
+            e.hash = hash;
+            e.sg = sg;
+            e.task_type = task_type;
+            e.nr_frames = nr_frames;
+            std::copy_n(frames, nr_frames, e.frames);
+            e.count = 1;
+            return;
+        }
+        if (e.hash == hash && e.sg == sg && e.task_type == task_type && e.nr_frames == nr_frames
+                && std::equal(frames, frames + nr_frames, e.frames)) {
+            e.count++;
+            return;
+        }
+    }
+    _dropped++;
+}
+
+void sampled_stacks::record_backtrace(const void* pc, unsigned sg, const std::type_info* task_type) noexcept {
+    // The frames of the signal handler come first, up to the interrupted
+    // function, whose frame the unwinder finds at pc exactly.
+    constexpr int max_handler_frames = 8;
+    void* buffer[max_frames + max_handler_frames];
+    int n = ::backtrace(buffer, std::size(buffer));
+    int first = 0;
+    for (int i = 0; pc && i < std::min(n, max_handler_frames); ++i) {
+        if (buffer[i] == pc) {
+            first = i;
+            break;
+        }
+    }
+    uintptr_t frames[max_frames];
+    unsigned nr_frames = std::min<unsigned>(n - first, max_frames);
+    for (unsigned i = 0; i < nr_frames; ++i) {
+        frames[i] = reinterpret_cast<uintptr_t>(buffer[first + i]);
+    }
+    record(frames, nr_frames, sg, task_type);
+}
+
+const void* interrupted_pc(void* ucontext) noexcept {
+    [[maybe_unused]] auto uc = static_cast<const ucontext_t*>(ucontext);
+#if defined(__x86_64__)
+    return reinterpret_cast<const void*>(uc->uc_mcontext.gregs[REG_RIP]);
+#elif defined(__aarch64__)
+    return reinterpret_cast<const void*>(uc->uc_mcontext.pc);
+#else
+    return nullptr;
+#endif
+}
+
+}
+
+}
@@ -0,0 +1,101 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#pragma once
+
+#include <seastar/util/defer.hh>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <typeinfo>
+
+namespace seastar {
+
+namespace internal {
+
+// Counts backtraces sampled from a signal handler, by call stack and by the
+// scheduling group and task they were sampled in. The table is allocated up
+// front and open-addressed, so that the signal handler can record samples;
+// a sample which finds no room, or which interrupts a reader, is dropped
+// and counted.
+class sampled_stacks {
+public:
+    static constexpr unsigned max_frames = 32;
+    struct entry {
+        uint64_t hash;
+        uint64_t count; // zero if the entry is free
+        const std::type_info* task_type;
+        unsigned sg;
+        unsigned nr_frames;
+        uintptr_t frames[max_frames]; // return addresses, innermost first
+    };
+private:
+    static constexpr size_t max_probes = 32;
+    size_t _capacity;
+    std::unique_ptr<entry[]> _entries;
+    uint64_t _dropped = 0;
+    bool _reading = false;
+public:
+    // capacity: a power of two
+    explicit sampled_stacks(size_t capacity);
+    // Async-signal safe
+    void record(const uintptr_t* frames, unsigned nr_frames, unsigned sg = 0, const std::type_info* task_type = nullptr) noexcept;
+    // Records the backtrace of the thread a signal interrupted, at pc if
+    // known, from its handler. Async-signal safe.
+    void record_backtrace(const void* pc, unsigned sg = 0, const std::type_info* task_type = nullptr) noexcept;
+    // Calls func for each entry, and then dropped_func with the number of
+    // dropped samples. Must not be called from the signal handler.
+    template <typename Func, typename DroppedFunc>
+    void consume(bool reset, Func&& func, DroppedFunc&& dropped_func);
+};
+
+// The address at which a signal interrupted the thread, from the ucontext
+// argument of an SA_SIGINFO handler, or nullptr if unknown.
+const void* interrupted_pc(void* ucontext) noexcept;
+
+template <typename Func, typename DroppedFunc>
+void sampled_stacks::consume(bool reset, Func&& func, DroppedFunc&& dropped_func) {
+    // The signal handler runs on this thread, so it cannot race with us
+    // once it sees the flag.
+    _reading = true;
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+    auto done = defer([this, reset] () noexcept {
+        if (reset) {
+            for (size_t i = 0; i < _capacity; ++i) {
+                _entries[i].count = 0;
+            }
+            _dropped = 0;
+        }
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+        _reading = false;
+    });
+    for (size_t i = 0; i < _capacity; ++i) {
+        if (_entries[i].count) {
+            func(_entries[i]);
+        }
+    }
+    dropped_func(_dropped);
+}
+
+}
+
+}
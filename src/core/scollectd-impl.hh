@@ -24,6 +24,9 @@
 #include <seastar/core/scollectd.hh>
 #include <seastar/core/metrics_api.hh>
 #include <seastar/net/api.hh>
+#include <optional>
+#include <random>
+#include <vector>
 
 namespace seastar {
 
@@ -34,6 +37,19 @@ using duration = std::chrono::milliseconds;
 
 static const ipv4_addr default_addr("239.192.74.66:25826");
 static const std::chrono::milliseconds default_period(1s);
+// What collectd's network plugin reads and sends by default: an ethernet
+// MTU, less the IPv6 and UDP headers
+static constexpr size_t default_packet_size = 1452;
+static constexpr size_t max_packet_size = 65507;
+
+struct send_config {
+    // Shard 0 sends the values of all shards, merged, instead of each
+    // shard sending its own
+    bool aggregate = false;
+    size_t packet_size = default_packet_size;
+    // Percentage of the period by which each send interval varies
+    unsigned jitter = 0;
+};
 
 class impl {
     net::udp_channel _chan;
@@ -42,6 +58,8 @@ class impl {
     sstring _host = "localhost";
     ipv4_addr _addr = default_addr;
     std::chrono::milliseconds _period = default_period;
+    send_config _config;
+    std::default_random_engine _rng{std::random_device{}()};
     uint64_t _num_packets = 0;
     uint64_t _millis = 0;
     uint64_t _bytes = 0;
@@ -60,7 +78,8 @@ class impl {
     future<> send_notification(const type_instance_id & id,
             const sstring & msg);
     // initiates actual value polling -> send to target "loop"
-    void start(const sstring & host, const ipv4_addr & addr, const std::chrono::milliseconds period);
+    void start(const sstring & host, const ipv4_addr & addr, const std::chrono::milliseconds period,
+            send_config config = {});
     void stop();
 
     value_list_map& get_value_list_map();
@@ -69,8 +88,20 @@ class impl {
     }
 
 private:
+    struct send_entry {
+        const seastar::metrics::impl::metric_id* id;
+        const type_id* type;
+        const seastar::metrics::impl::metric_value* value;
+    };
+    struct merged_value;
+
     void arm();
     void run();
+    future<> send_local();
+    future<> send_aggregated();
+    // Sends the values in as few packets as they fit in; plugin_instance,
+    // if set, is sent in place of the shard the values come from
+    future<> send_values(std::vector<send_entry> entries, std::optional<sstring> plugin_instance);
 
 public:
     shared_ptr<value_list> get_values(const type_instance_id & id) const;
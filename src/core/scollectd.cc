@@ -27,12 +27,19 @@
 #include <map>
 #include <iostream>
 #include <unordered_map>
+#include <optional>
+#include <random>
+#include <vector>
+#include <boost/range/irange.hpp>
 
 #include <seastar/core/seastar.hh>
 #include <seastar/core/scollectd_api.hh>
 #include <seastar/core/metrics_api.hh>
 #include <seastar/core/byteorder.hh>
 #include <seastar/core/print.hh>
+#include <seastar/core/do_with.hh>
+#include <seastar/core/loop.hh>
+#include <seastar/core/smp.hh>
 
 #include "core/scollectd-impl.hh"
 
@@ -92,8 +99,6 @@ seastar::metrics::impl::metric_id to_metrics_id(const type_instance_id & id) {
 
 const plugin_instance_id per_cpu_plugin_instance("#cpu");
 
-static const size_t payload_size = 1024;
-
 enum class part_type : uint16_t {
     Host = 0x0000, // The name of the host to associate with subsequent data values
     Time = 0x0001, // Time  Numeric The timestamp to associate with subsequent data values, unix time format (seconds since epoch)
@@ -117,19 +122,22 @@ typedef std::chrono::duration<uint64_t, std::ratio<1, 0x40000000>> collectd_hres
 // yet another writer type, this one to construct collectd network
 // protocol data.
 struct cpwriter {
-    typedef std::array<char, payload_size> buffer_type;
+    typedef std::vector<char> buffer_type;
     typedef buffer_type::iterator mark_type;
     typedef buffer_type::const_iterator const_mark_type;
 
-    buffer_type _buf = {};
+    buffer_type _buf;
     mark_type _pos;
     bool _overflow = false;
+    // Sent as the plugin instance instead of the shard, if set
+    std::optional<sstring> _plugin_instance;
 
     std::unordered_map<uint16_t, sstring> _cache;
 
-    cpwriter()
-            : _pos(_buf.begin()) {
+    explicit cpwriter(size_t size = default_packet_size)
+            : _buf(size), _pos(_buf.begin()) {
     }
+    cpwriter(const cpwriter&) = delete;
     mark_type mark() const {
         return _pos;
     }
@@ -287,6 +295,7 @@ struct cpwriter {
         put_cached(part_type::Plugin, id.group_name());
         // Optional
         put_cached(part_type::PluginInst,
+                _plugin_instance ? *_plugin_instance :
                 id.instance_id() == per_cpu_plugin_instance ?
                         to_sstring(this_shard_id()) : id.instance_id());
         put_cached(part_type::Type, type);
@@ -339,24 +348,25 @@ future<> impl::send_metric(const type_instance_id & id,
     if (values.empty()) {
         return make_ready_future();
     }
-    cpwriter out;
+    cpwriter out(_config.packet_size);
     out.put(_host, duration(), id, values);
     return _chan.send(_addr, net::packet(out.data(), out.size()));
 }
 
 future<> impl::send_notification(const type_instance_id & id,
         const sstring & msg) {
-    cpwriter out;
+    cpwriter out(_config.packet_size);
     out.put(_host, to_metrics_id(id), id.type());
     out.put(part_type::Message, msg);
     return _chan.send(_addr, net::packet(out.data(), out.size()));
 }
 
 // initiates actual value polling -> send to target "loop"
-void impl::start(const sstring & host, const ipv4_addr & addr, const duration period) {
+void impl::start(const sstring & host, const ipv4_addr & addr, const duration period, send_config config) {
     _period = period;
     _addr = addr;
     _host = host;
+    _config = config;
     _chan = make_udp_channel();
     _timer.set_callback(std::bind(&impl::run, this));
 
@@ -382,7 +392,11 @@ void impl::start(const sstring & host, const ipv4_addr & addr, const duration pe
     (void)send_notification(
             type_instance_id("scollectd", per_cpu_plugin_instance,
                     "network"), "daemon started");
-    arm();
+    // When aggregating, the other shards only send what they are
+    // explicitly asked to
+    if (!_config.aggregate || this_shard_id() == 0) {
+        arm();
+    }
 }
 
 void impl::stop() {
@@ -392,80 +406,152 @@ void impl::stop() {
 
 
 void impl::arm() {
-    if (_period != duration()) {
-        _timer.arm(_period);
+    if (_period == duration()) {
+        return;
+    }
+    auto period = _period;
+    if (_config.jitter) {
+        // Spread the sends of the shards, and of the nodes started
+        // together, instead of having them burst at the same time
+        auto max_jitter = _period.count() * std::min(_config.jitter, 100u) / 100;
+        std::uniform_int_distribution<duration::rep> dist(-max_jitter, max_jitter);
+        period = std::max(duration(1), _period + duration(dist(_rng)));
     }
+    _timer.arm(period);
+}
+
+struct impl::merged_value {
+    seastar::metrics::impl::metric_id id;
+    type_id type;
+    seastar::metrics::impl::metric_value value;
+    unsigned count;
+};
+
+static bool is_scalar(const seastar::metrics::impl::metric_value& v) {
+    return std::holds_alternative<double>(v.u);
 }
 
 void impl::run() {
-    typedef size_t metric_family_id;
-    typedef seastar::metrics::impl::value_vector::iterator value_iterator;
-    typedef seastar::metrics::impl::metric_metadata_vector::iterator metadata_iterator;
-    typedef std::tuple<metric_family_id, metadata_iterator, value_iterator, type_id, cpwriter> context;
+    // No need to wait for future.
+    // The caller has to call impl::stop() to synchronize.
+    (void)(_config.aggregate ? send_aggregated() : send_local()).finally([this] {
+        arm();
+    });
+}
 
-    auto ctxt = make_lw_shared<context>();
-    foreign_ptr<shared_ptr<seastar::metrics::impl::values_copy>> vals =  seastar::metrics::impl::get_values();
+future<> impl::send_local() {
+    auto vals = seastar::metrics::impl::get_values();
 
     // note we're doing this unsynced since we assume
     // all registrations to this instance will be done on the
     // same cpu, and without interuptions (no wait-states)
 
     auto& values = vals->values;
-    auto metadata = vals->metadata;
-    std::get<metric_family_id>(*ctxt) = 0;
-    if (values.size() > 0) {
-        std::get<value_iterator>(*ctxt) = values[0].begin();
-        std::get<metadata_iterator>(*ctxt) = metadata->at(0).metrics.begin();
-        std::get<type_id>(*ctxt) = metadata->at(0).mf.inherit_type;
+    auto& metadata = *vals->metadata;
+    std::vector<send_entry> entries;
+    for (size_t mf = 0; mf < values.size(); ++mf) {
+        auto& md = metadata[mf];
+        for (size_t i = 0; i < values[mf].size(); ++i) {
+            if (is_scalar(values[mf][i])) {
+                entries.push_back(send_entry{&md.metrics[i].id, &md.mf.inherit_type, &values[mf][i]});
+            }
+        }
     }
+    return send_values(std::move(entries), std::nullopt).finally([vals = std::move(vals)] {});
+}
 
-    auto stop_when = [ctxt, metadata]() {
-        auto done = std::get<metric_family_id>(*ctxt) == metadata->size();
-        return done;
+future<> impl::send_aggregated() {
+    return do_with(std::vector<foreign_ptr<seastar::metrics::impl::values_reference>>(smp::count), [this] (auto& shard_values) {
+        return parallel_for_each(boost::irange(0u, smp::count), [&shard_values] (unsigned c) {
+            return smp::submit_to(c, [] {
+                return seastar::metrics::impl::get_values();
+            }).then([&shard_values, c] (foreign_ptr<seastar::metrics::impl::values_reference> vals) {
+                shard_values[c] = std::move(vals);
+            });
+        }).then([this, &shard_values] {
+            // Same series of all shards are merged: counters are summed,
+            // gauges averaged
+            auto merged = make_lw_shared<std::vector<merged_value>>();
+            std::unordered_map<sstring, size_t> index;
+            for (auto& vals : shard_values) {
+                auto& values = vals->values;
+                auto& metadata = *vals->metadata;
+                for (size_t mf = 0; mf < values.size(); ++mf) {
+                    auto& md = metadata[mf];
+                    for (size_t i = 0; i < values[mf].size(); ++i) {
+                        auto& v = values[mf][i];
+                        if (!is_scalar(v)) {
+                            continue;
+                        }
+                        auto& id = md.metrics[i].id;
+                        auto key = id.full_name();
+                        for (auto& l : id.labels()) {
+                            if (l.first != seastar::metrics::shard_label.name()) {
+                                key += sstring("\0", 1) + l.first + "=" + l.second;
+                            }
+                        }
+                        auto [it, inserted] = index.emplace(std::move(key), merged->size());
+                        if (inserted) {
+                            merged->push_back(merged_value{id, md.mf.inherit_type, v, 1});
+                        } else {
+                            auto& m = (*merged)[it->second];
+                            m.value = seastar::metrics::impl::metric_value(m.value.d() + v.d(), m.value.type());
+                            ++m.count;
+                        }
+                    }
+                }
+            }
+            shard_values.clear();
+            std::vector<send_entry> entries;
+            entries.reserve(merged->size());
+            for (auto& m : *merged) {
+                if (m.value.type() == seastar::metrics::impl::data_type::GAUGE) {
+                    m.value = seastar::metrics::impl::metric_value(m.value.d() / m.count, m.value.type());
+                }
+                entries.push_back(send_entry{&m.id, &m.type, &m.value});
+            }
+            return send_values(std::move(entries), sstring("total")).finally([merged] {});
+        });
+    });
+}
+
+future<> impl::send_values(std::vector<send_entry> entries, std::optional<sstring> plugin_instance) {
+    struct context {
+        std::vector<send_entry> entries;
+        size_t next = 0;
+        cpwriter out;
+        context(std::vector<send_entry> e, size_t packet_size) : entries(std::move(e)), out(packet_size) {}
+    };
+    auto ctxt = make_lw_shared<context>(std::move(entries), _config.packet_size);
+    ctxt->out._plugin_instance = std::move(plugin_instance);
+
+    auto stop_when = [ctxt] {
+        return ctxt->next == ctxt->entries.size();
     };
-    // append as many values as we can fit into a packet (1024 bytes)
-    auto send_packet = [this, ctxt, &values, metadata]() mutable {
+    // append as many values as we can fit into a packet
+    auto send_packet = [this, ctxt] {
         auto start = steady_clock_type::now();
-        auto& mf = std::get<metric_family_id>(*ctxt);
-        auto & md_iterator = std::get<metadata_iterator>(*ctxt);
-        auto & i = std::get<value_iterator>(*ctxt);
-        auto & out = std::get<cpwriter>(*ctxt);
+        auto& out = ctxt->out;
 
         out.clear();
 
-        bool out_of_space = false;
-        while (!out_of_space && mf < values.size()) {
-            while (i != values[mf].end()) {
-                if (i->type() == seastar::metrics::impl::data_type::HISTOGRAM) {
-                    ++i;
-                    ++md_iterator;
-                    continue;
-                }
-                auto m = out.mark();
-                out.put(_host, _period, std::get<type_id>(*ctxt), md_iterator->id, *i);
-                if (!out) {
-                    out.reset(m);
-                    out_of_space = true;
-                    break;
-                }
-                ++i;
-                ++md_iterator;
-            }
-            if (out_of_space) {
+        while (ctxt->next < ctxt->entries.size()) {
+            auto& e = ctxt->entries[ctxt->next];
+            auto m = out.mark();
+            out.put(_host, _period, *e.type, *e.id, *e.value);
+            if (!out) {
+                out.reset(m);
                 break;
             }
-            ++mf;
-            if (mf < values.size()) {
-                i = values[mf].begin();
-                md_iterator = metadata->at(mf).metrics.begin();
-                std::get<type_id>(*ctxt) = metadata->at(mf).mf.inherit_type;
-            }
+            ++ctxt->next;
         }
         if (out.empty()) {
+            // Does not fit even an empty packet
+            ++ctxt->next;
             return make_ready_future();
         }
         return _chan.send(_addr, net::packet(out.data(), out.size())).then([start, ctxt, this]() {
-                    auto & out = std::get<cpwriter>(*ctxt);
+                    auto & out = ctxt->out;
                     auto now = steady_clock_type::now();
                     // dogfood stats
                     ++_num_packets;
@@ -482,11 +568,7 @@ void impl::run() {
                     }
                 });
     };
-    // No need to wait for future.
-    // The caller has to call impl::stop() to synchronize.
-    (void)do_until(stop_when, send_packet).finally([this, vals = std::move(vals)]() mutable {
-        arm();
-    });
+    return do_until(stop_when, send_packet);
 }
 
 std::vector<type_instance_id> impl::get_instance_ids() const {
@@ -535,12 +617,19 @@ void configure(const options& opts) {
     auto host = (opts.collectd_hostname.get_value() == "")
             ? seastar::metrics::impl::get_local_impl()->get_config().hostname
             : sstring(opts.collectd_hostname.get_value());
+    send_config config;
+    config.aggregate = opts.collectd_aggregate.get_value();
+    config.packet_size = opts.collectd_packet_size.get_value();
+    config.jitter = opts.collectd_poll_jitter.get_value();
+    if (config.packet_size < 64 || config.packet_size > max_packet_size) {
+        throw std::invalid_argument(format("collectd-packet-size must be between 64 and {}", max_packet_size));
+    }
 
     // Now create send loops on each cpu
     for (unsigned c = 0; c < smp::count; c++) {
         // FIXME: future is discarded
         (void)smp::submit_to(c, [=] () {
-            get_impl().start(host, addr, period);
+            get_impl().start(host, addr, period, config);
         });
     }
 }
@@ -558,6 +647,15 @@ options::options(program_options::option_group* parent_group)
     , collectd_hostname(*this, "collectd-hostname",
             "",
             "Deprecated option, use metrics-hostname instead")
+    , collectd_aggregate(*this, "collectd-aggregate",
+            false,
+            "send the values of all shards, summed or averaged, from shard 0 only")
+    , collectd_packet_size(*this, "collectd-packet-size",
+            default_packet_size,
+            "maximum size of the packets sent, in bytes (default: 1452, to fit an ethernet frame)")
+    , collectd_poll_jitter(*this, "collectd-poll-jitter",
+            10,
+            "percentage of the poll period by which each send is randomly advanced or delayed (default: 10)")
 {
 }
 
@@ -0,0 +1,205 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#include <seastar/core/service_graph.hh>
+#include <seastar/core/shared_future.hh>
+#include <seastar/core/when_all.hh>
+#include <seastar/util/log.hh>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace seastar {
+
+static logger sglog("service_graph");
+
+void service_graph::add(sstring name, std::vector<sstring> deps, start_func start, stop_func stop) {
+    _services.push_back(service{std::move(name), std::move(deps), std::move(start), std::move(stop)});
+}
+
+std::vector<size_t> service_graph::sorted() const {
+    std::unordered_map<sstring, size_t> index;
+    for (size_t i = 0; i < _services.size(); i++) {
+        if (!index.emplace(_services[i].name, i).second) {
+            throw std::invalid_argument(format("service {} added twice", _services[i].name));
+        }
+    }
+    std::vector<unsigned> nr_deps(_services.size());
+    std::vector<std::vector<size_t>> dependents(_services.size());
+    for (size_t i = 0; i < _services.size(); i++) {
+        for (auto& d : _services[i].deps) {
+            auto it = index.find(d);
+            if (it == index.end()) {
+                throw std::invalid_argument(format("service {} depends on unknown service {}", _services[i].name, d));
+            }
+            dependents[it->second].push_back(i);
+            nr_deps[i]++;
+        }
+    }
+    std::vector<size_t> order;
+    order.reserve(_services.size());
+    for (size_t i = 0; i < _services.size(); i++) {
+        if (!nr_deps[i]) {
+            order.push_back(i);
+        }
+    }
+    for (size_t n = 0; n < order.size(); n++) {
+        for (auto i : dependents[order[n]]) {
+            if (!--nr_deps[i]) {
+                order.push_back(i);
+            }
+        }
+    }
+    if (order.size() != _services.size()) {
+        for (size_t i = 0; i < _services.size(); i++) {
+            if (nr_deps[i]) {
+                throw std::invalid_argument(format("service {} is part of a dependency cycle", _services[i].name));
+            }
+        }
+    }
+    return order;
+}
+
+future<> service_graph::start_one(size_t idx) {
+    auto& s = _services[idx];
+    sglog.debug("Starting {}", s.name);
+    auto start = clock_type::now();
+    return futurize_invoke(s.start).then([this, idx, start] {
+        auto& s = _services[idx];
+        s.started = true;
+        s.startup_time = clock_type::now() - start;
+        sglog.info("Started {} in {} ms", s.name,
+                std::chrono::duration_cast<std::chrono::milliseconds>(*s.startup_time).count());
+    });
+}
+
+future<> service_graph::start() {
+    try {
+        _order = sorted();
+    } catch (...) {
+        return current_exception_as_future();
+    }
+    std::unordered_map<sstring, size_t> index;
+    for (size_t i = 0; i < _services.size(); i++) {
+        index.emplace(_services[i].name, i);
+    }
+    std::vector<shared_future<>> started(_services.size());
+    for (auto idx : _order) {
+        std::vector<future<>> deps;
+        deps.reserve(_services[idx].deps.size());
+        for (auto& d : _services[idx].deps) {
+            deps.push_back(started[index.at(d)].get_future());
+        }
+        started[idx] = when_all_succeed(deps.begin(), deps.end()).then([this, idx] {
+            return start_one(idx);
+        });
+    }
+    std::vector<future<>> all;
+    all.reserve(started.size());
+    for (auto& f : started) {
+        all.push_back(f.get_future());
+    }
+    return when_all(all.begin(), all.end()).then([this] (std::vector<future<>> results) {
+        std::exception_ptr ex;
+        for (auto& f : results) {
+            if (f.failed()) {
+                auto e = f.get_exception();
+                if (!ex) {
+                    ex = std::move(e);
+                }
+            }
+        }
+        if (!ex) {
+            return make_ready_future<>();
+        }
+        sglog.error("Failed to start services: {}", ex);
+        return stop().then_wrapped([ex = std::move(ex)] (future<> f) {
+            f.ignore_ready_future();
+            return make_exception_future<>(std::move(ex));
+        });
+    });
+}
+
+future<> service_graph::stop() {
+    std::vector<std::vector<size_t>> dependents(_services.size());
+    std::unordered_map<sstring, size_t> index;
+    for (size_t i = 0; i < _services.size(); i++) {
+        index.emplace(_services[i].name, i);
+    }
+    for (auto i : _order) {
+        for (auto& d : _services[i].deps) {
+            dependents[index.at(d)].push_back(i);
+        }
+    }
+    std::vector<shared_future<>> stopped(_services.size());
+    for (auto it = _order.rbegin(); it != _order.rend(); ++it) {
+        auto idx = *it;
+        std::vector<future<>> waits;
+        waits.reserve(dependents[idx].size());
+        for (auto i : dependents[idx]) {
+            waits.push_back(stopped[i].get_future());
+        }
+        // A dependent which failed to stop does not keep its dependencies
+        // running
+        stopped[idx] = when_all(waits.begin(), waits.end()).then([this, idx] (std::vector<future<>> results) {
+            for (auto& f : results) {
+                f.ignore_ready_future();
+            }
+            auto& s = _services[idx];
+            if (!std::exchange(s.started, false)) {
+                return make_ready_future<>();
+            }
+            sglog.debug("Stopping {}", s.name);
+            return futurize_invoke(s.stop).handle_exception([this, idx] (std::exception_ptr ex) {
+                sglog.warn("Failed to stop {}: {}", _services[idx].name, ex);
+                return make_exception_future<>(std::move(ex));
+            });
+        });
+    }
+    std::vector<future<>> all;
+    all.reserve(_order.size());
+    for (auto idx : _order) {
+        all.push_back(stopped[idx].get_future());
+    }
+    return when_all(all.begin(), all.end()).then([] (std::vector<future<>> results) {
+        std::exception_ptr ex;
+        for (auto& f : results) {
+            if (f.failed()) {
+                auto e = f.get_exception();
+                if (!ex) {
+                    ex = std::move(e);
+                }
+            }
+        }
+        return ex ? make_exception_future<>(std::move(ex)) : make_ready_future<>();
+    });
+}
+
+std::vector<std::pair<sstring, service_graph::clock_type::duration>> service_graph::startup_times() const {
+    std::vector<std::pair<sstring, clock_type::duration>> ret;
+    for (auto& s : _services) {
+        if (s.startup_time) {
+            ret.emplace_back(s.name, *s.startup_time);
+        }
+    }
+    return ret;
+}
+
+}
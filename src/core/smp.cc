@@ -24,6 +24,7 @@
 #include <seastar/core/semaphore.hh>
 #include <seastar/core/print.hh>
 #include <boost/range/algorithm/find_if.hpp>
+#include <map>
 #include <vector>
 
 namespace seastar {
@@ -112,4 +113,50 @@ smp_service_group_semaphore& get_smp_service_groups_semaphore(unsigned ssg_id, s
     return smp_service_groups[ssg_id].clients[t];
 }
 
+unsigned smp::numa_node_of(shard_id shard) noexcept {
+    return placement_of(shard).numa_node;
+}
+
+shard_placement smp::placement_of(shard_id shard) noexcept {
+    return shard < _placements.size() ? _placements[shard] : shard_placement{};
+}
+
+shard_load smp::load_of(shard_id shard) noexcept {
+    if (!_loads || shard >= count) {
+        return shard_load{};
+    }
+    auto& l = _loads[shard];
+    return shard_load{l.utilization.load(std::memory_order_relaxed), l.runnable_tasks.load(std::memory_order_relaxed)};
+}
+
+namespace internal {
+
+shard_reduction_order make_shard_reduction_order(shard_id root) {
+    shard_reduction_order order;
+    order.shards.reserve(smp::count);
+    auto root_node = smp::numa_node_of(root);
+    std::map<unsigned, std::vector<shard_id>> other_nodes;
+    order.shards.push_back(root);
+    for (shard_id s : smp::all_cpus()) {
+        if (s == root) {
+            continue;
+        }
+        auto node = smp::numa_node_of(s);
+        if (node == root_node) {
+            order.shards.push_back(s);
+        } else {
+            other_nodes[node].push_back(s);
+        }
+    }
+    order.node_starts.push_back(0);
+    for (auto& [node, shards] : other_nodes) {
+        order.node_starts.push_back(order.shards.size());
+        order.shards.insert(order.shards.end(), shards.begin(), shards.end());
+    }
+    order.node_starts.push_back(order.shards.size());
+    return order;
+}
+
+}
+
 }
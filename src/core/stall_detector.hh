@@ -31,11 +31,13 @@
 #include <seastar/core/metrics_registration.hh>
 #include <seastar/core/scheduling.hh>
 #include <linux/perf_event.h>
+#include "sampled_stacks.hh"
 
 namespace seastar {
 
 class reactor;
 class thread_cputime_clock;
+struct stall_profile;
 
 namespace internal {
 
@@ -44,6 +46,8 @@ struct cpu_stall_detector_config {
     unsigned stall_detector_reports_per_minute = 1;
     float slack = 0.3;  // fraction of threshold that we're allowed to overshoot
     bool oneline = true; // print a simplified backtrace on a single line
+    bool profile = false; // sample backtraces while stalled, see stall_profile.hh
+    std::chrono::duration<double> profile_interval = std::chrono::milliseconds(1); // CPU time between samples
     std::function<void ()> report;  // alternative reporting function for tests
 };
 
@@ -64,6 +68,12 @@ class cpu_stall_detector {
     sched_clock::time_point _run_started_at{};
     sched_clock::duration _threshold;
     sched_clock::duration _slack;
+    sched_clock::duration _profile_interval;
+    // Time sampled since the last report, while the stall lasts
+    sched_clock::duration _sampled_for{};
+    bool _profiling = false;
+    bool _sampling = false; // a stall was detected, and is being sampled
+    std::unique_ptr<sampled_stacks> _profile;
     cpu_stall_detector_config _config;
     seastar::metrics::metric_groups _metrics;
     friend reactor;
@@ -75,6 +85,11 @@ class cpu_stall_detector {
     void maybe_report();
     virtual void arm_timer() = 0;
     void report_suppressions(sched_clock::time_point now);
+    void on_profiled_stall(const void* pc) noexcept;
+protected:
+    sched_clock::duration timer_period() const noexcept {
+        return _sampling ? _profile_interval : _threshold * _report_at + _slack;
+    }
 public:
     using clock_type = thread_cputime_clock;
 public:
@@ -86,7 +101,9 @@ class cpu_stall_detector {
     void generate_trace();
     void update_config(cpu_stall_detector_config cfg);
     cpu_stall_detector_config get_config() const;
-    void on_signal();
+    // pc: the address at which the signal interrupted the thread, if known
+    void on_signal(const void* pc = nullptr);
+    stall_profile get_profile(bool reset);
     virtual void start_sleep() = 0;
     void end_sleep();
 };
@@ -0,0 +1,67 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#include <seastar/core/stall_profile.hh>
+#include <seastar/core/reactor.hh>
+#include <seastar/core/smp.hh>
+#include <seastar/http/httpd.hh>
+#include <seastar/http/function_handlers.hh>
+#include <sstream>
+
+namespace seastar {
+
+void write_folded(std::ostream& os, const stall_profile& profile) {
+    for (auto& stack : profile.stacks) {
+        os << "shard " << profile.shard;
+        for (auto f = stack.frames.rbegin(); f != stack.frames.rend(); ++f) {
+            os << ';' << *f;
+        }
+        os << ' ' << stack.samples << '\n';
+    }
+}
+
+future<std::vector<stall_profile>> get_stall_profiles(bool reset) {
+    return do_with(std::vector<stall_profile>(smp::count), [reset] (std::vector<stall_profile>& profiles) {
+        return smp::invoke_on_all([&profiles, reset] {
+            // Each shard writes its own element
+            profiles[this_shard_id()] = engine().get_stall_profile(reset);
+        }).then([&profiles] {
+            return std::move(profiles);
+        });
+    });
+}
+
+future<> add_stall_profile_route(httpd::http_server& server, sstring path) {
+    server._routes.put(httpd::GET, path, new httpd::function_handler([] (std::unique_ptr<httpd::request> req, std::unique_ptr<httpd::reply> rep) {
+        bool reset = req->get_query_param("reset") == "true";
+        return get_stall_profiles(reset).then([rep = std::move(rep)] (std::vector<stall_profile> profiles) mutable {
+            std::ostringstream os;
+            for (auto& profile : profiles) {
+                write_folded(os, profile);
+            }
+            rep->write_body("txt", sstring(os.str()));
+            return std::move(rep);
+        });
+    }, "txt"));
+    return make_ready_future<>();
+}
+
+}
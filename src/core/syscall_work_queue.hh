@@ -69,6 +69,11 @@ class syscall_work_queue {
         return current_exception_as_future<T>();
       }
     }
+    // Requests submitted and not completed yet, including those waiting
+    // for room in the queue
+    size_t in_flight() const noexcept {
+        return queue_length - _queue_has_room.available_units() + _queue_has_room.waiters();
+    }
 private:
     void work();
     // Scans the _completed queue, that contains the requests already handled by the syscall thread,
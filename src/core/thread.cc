@@ -25,6 +25,8 @@
 #include <seastar/core/reactor.hh>
 #include <ucontext.h>
 #include <algorithm>
+#include <optional>
+#include <vector>
 
 #include <valgrind/valgrind.h>
 
@@ -176,17 +178,121 @@ thread_context::thread_context(thread_attributes attr, noncopyable_function<void
 }
 
 thread_context::~thread_context() {
+    _all_threads.erase(_all_threads.iterator_to(*this));
+}
+
+namespace {
+
+// Stacks of finished threads, by size, guard page included, to be reused
+// by new threads
+class stack_pool {
+    struct pooled_stack {
+        char* mem;
+        int valgrind_id;
+    };
+    std::vector<std::pair<size_t, std::vector<pooled_stack>>> _free;
+    size_t _capacity = 4 << 20;
+    thread_stack_pool_stats _stats;
+
+    std::vector<pooled_stack>* find(size_t size) noexcept {
+        for (auto& [s, stacks] : _free) {
+            if (s == size) {
+                return &stacks;
+            }
+        }
+        return nullptr;
+    }
+    void shrink() noexcept {
+        for (auto& [size, stacks] : _free) {
+            while (_stats.cached_bytes > _capacity && !stacks.empty()) {
+                free_stack(stacks.back().mem, stacks.back().valgrind_id);
+                stacks.pop_back();
+                _stats.cached_bytes -= size;
+            }
+        }
+    }
+public:
+    ~stack_pool() {
+        set_capacity(0);
+    }
+    static void free_stack(char* mem, int valgrind_id) noexcept {
 #ifdef SEASTAR_THREAD_STACK_GUARDS
-    auto mp_result = mprotect(_stack.get(), getpagesize(), PROT_READ | PROT_WRITE);
-    assert(mp_result == 0);
+        auto mp_result = mprotect(mem, getpagesize(), PROT_READ | PROT_WRITE);
+        assert(mp_result == 0);
 #endif
-    _all_threads.erase(_all_threads.iterator_to(*this));
+        VALGRIND_STACK_DEREGISTER(valgrind_id);
+        free(mem);
+    }
+    // Returns a stack of the size, with its valgrind id, if the pool has one
+    std::optional<pooled_stack> take(size_t size) noexcept {
+        auto stacks = find(size);
+        if (!stacks || stacks->empty()) {
+            _stats.misses++;
+            return std::nullopt;
+        }
+        auto stack = stacks->back();
+        stacks->pop_back();
+        _stats.hits++;
+        _stats.cached_bytes -= size;
+        return stack;
+    }
+    void release(char* mem, int valgrind_id, size_t size) noexcept {
+        auto stacks = find(size);
+        if (_stats.cached_bytes + size > _capacity) {
+            _stats.drops++;
+            free_stack(mem, valgrind_id);
+            return;
+        }
+        try {
+            if (!stacks) {
+                stacks = &_free.emplace_back(size, std::vector<pooled_stack>()).second;
+            }
+            stacks->push_back({mem, valgrind_id});
+        } catch (...) {
+            _stats.drops++;
+            free_stack(mem, valgrind_id);
+            return;
+        }
+        _stats.releases++;
+        _stats.cached_bytes += size;
+    }
+    void set_capacity(size_t bytes) noexcept {
+        _capacity = bytes;
+        shrink();
+    }
+    const thread_stack_pool_stats& stats() const noexcept {
+        return _stats;
+    }
+};
+
+thread_local stack_pool local_stack_pool;
+
+}
+
+void set_thread_stack_pool_capacity(size_t bytes) {
+    local_stack_pool.set_capacity(bytes);
+}
+
+thread_stack_pool_stats get_thread_stack_pool_stats() noexcept {
+    return local_stack_pool.stats();
 }
 
-thread_context::stack_deleter::stack_deleter(int valgrind_id) : valgrind_id(valgrind_id) {}
+thread_context::stack_deleter::stack_deleter(int valgrind_id, size_t size) : valgrind_id(valgrind_id), size(size) {}
 
 thread_context::stack_holder
 thread_context::make_stack(size_t stack_size) {
+    if (auto pooled = local_stack_pool.take(stack_size)) {
+        auto stack = stack_holder(pooled->mem, stack_deleter(pooled->valgrind_id, stack_size));
+#ifdef SEASTAR_ASAN_ENABLED
+        // Avoid ASAN false positive due to garbage on stack
+#ifdef SEASTAR_THREAD_STACK_GUARDS
+        std::fill(stack.get() + getpagesize(), stack.get() + stack_size, 0);
+#else
+        std::fill_n(stack.get(), stack_size, 0);
+#endif
+#endif
+        return stack;
+    }
 #ifdef SEASTAR_THREAD_STACK_GUARDS
     size_t page_size = getpagesize();
     size_t alignment = page_size;
@@ -198,7 +304,7 @@ thread_context::make_stack(size_t stack_size) {
         throw std::bad_alloc();
     }
     int valgrind_id = VALGRIND_STACK_REGISTER(mem, reinterpret_cast<char*>(mem) + stack_size);
-    auto stack = stack_holder(new (mem) char[stack_size], stack_deleter(valgrind_id));
+    auto stack = stack_holder(new (mem) char[stack_size], stack_deleter(valgrind_id, stack_size));
 #ifdef SEASTAR_ASAN_ENABLED
     // Avoid ASAN false positive due to garbage on stack
     std::fill_n(stack.get(), stack_size, 0);
@@ -213,8 +319,7 @@ thread_context::make_stack(size_t stack_size) {
 }
 
 void thread_context::stack_deleter::operator()(char* ptr) const noexcept {
-    VALGRIND_STACK_DEREGISTER(valgrind_id);
-    free(ptr);
+    local_stack_pool.release(ptr, valgrind_id, size);
 }
 
 void
@@ -21,16 +21,66 @@
 
 #include <seastar/core/reactor.hh>
 #include "core/thread_pool.hh"
+#include <algorithm>
 
 namespace seastar {
 
 /* not yet implemented for OSv. TODO: do the notification like we do class smp. */
 #ifndef HAVE_OSV
-thread_pool::thread_pool(reactor* r, sstring name) : _reactor(r), _worker_thread([this, name] { work(name); }) {
+thread_pool::worker::worker(thread_pool& pool, sstring name)
+    : thread([this, &pool, name] { pool.work(*this, name); })
+{ }
+
+thread_pool::thread_pool(reactor* r, sstring name, unsigned nr_regular, unsigned nr_slow)
+    : _reactor(r)
+    , _nr_regular(std::max(nr_regular, 1u))
+{
+    _workers.reserve(_nr_regular + nr_slow);
+    for (unsigned i = 0; i < _nr_regular; i++) {
+        _workers.push_back(std::make_unique<worker>(*this, i ? format("{}.{}", name, i) : name));
+    }
+    for (unsigned i = 0; i < nr_slow; i++) {
+        _workers.push_back(std::make_unique<worker>(*this, format("{}s{}", name, i)));
+    }
+}
+
+thread_pool::worker& thread_pool::pick(lane l) noexcept {
+    auto b = _workers.begin();
+    auto e = _workers.begin() + _nr_regular;
+    if (l == lane::slow && e != _workers.end()) {
+        b = e;
+        e = _workers.end();
+    }
+    return **std::min_element(b, e, [] (const auto& x, const auto& y) {
+        return x->wq.in_flight() < y->wq.in_flight();
+    });
 }
 
-void thread_pool::work(sstring name) {
-    pthread_setname_np(pthread_self(), name.c_str());
+size_t thread_pool::queue_depth(lane l) const noexcept {
+    auto b = _workers.begin();
+    auto e = _workers.begin() + _nr_regular;
+    if (l == lane::slow) {
+        b = e;
+        e = _workers.end();
+    }
+    size_t depth = 0;
+    for (auto i = b; i != e; ++i) {
+        depth += (*i)->wq.in_flight();
+    }
+    return depth;
+}
+
+unsigned thread_pool::complete() {
+    unsigned nr = 0;
+    for (auto& w : _workers) {
+        nr += w->wq.complete();
+    }
+    return nr;
+}
+
+void thread_pool::work(worker& w, sstring name) {
+    // Thread names are limited to 15 characters
+    pthread_setname_np(pthread_self(), name.substr(0, 15).c_str());
     sigset_t mask;
     sigfillset(&mask);
     auto r = ::pthread_sigmask(SIG_BLOCK, &mask, NULL);
@@ -38,19 +88,19 @@ void thread_pool::work(sstring name) {
     std::array<syscall_work_queue::work_item*, syscall_work_queue::queue_length> tmp_buf;
     while (true) {
         uint64_t count;
-        auto r = ::read(inter_thread_wq._start_eventfd.get_read_fd(), &count, sizeof(count));
+        auto r = ::read(w.wq._start_eventfd.get_read_fd(), &count, sizeof(count));
         assert(r == sizeof(count));
         if (_stopped.load(std::memory_order_relaxed)) {
             break;
         }
         auto end = tmp_buf.data();
-        inter_thread_wq._pending.consume_all([&] (syscall_work_queue::work_item* wi) {
+        w.wq._pending.consume_all([&] (syscall_work_queue::work_item* wi) {
             *end++ = wi;
         });
         for (auto p = tmp_buf.data(); p != end; ++p) {
             auto wi = *p;
             wi->process();
-            inter_thread_wq._completed.push(wi);
+            w.wq._completed.push(wi);
         }
         if (_main_thread_idle.load(std::memory_order_seq_cst)) {
             uint64_t one = 1;
@@ -61,8 +111,12 @@ void thread_pool::work(sstring name) {
 
 thread_pool::~thread_pool() {
     _stopped.store(true, std::memory_order_relaxed);
-    inter_thread_wq._start_eventfd.signal(1);
-    _worker_thread.join();
+    for (auto& w : _workers) {
+        w->wq._start_eventfd.signal(1);
+    }
+    for (auto& w : _workers) {
+        w->thread.join();
+    }
 }
 #endif
 
@@ -22,30 +22,53 @@
 #pragma once
 
 #include "syscall_work_queue.hh"
+#include <memory>
+#include <vector>
 
 namespace seastar {
 
 class reactor;
 
 class thread_pool {
+public:
+    // System calls which may block for long, such as those syncing or
+    // allocating file data or asking remote file systems for their space,
+    // run on threads of their own, so that the short ones queued behind
+    // them are not held up.
+    enum class lane { regular, slow };
+private:
     reactor* _reactor;
     uint64_t _aio_threaded_fallbacks = 0;
 #ifndef HAVE_OSV
-    syscall_work_queue inter_thread_wq;
-    posix_thread _worker_thread;
+    struct worker {
+        syscall_work_queue wq;
+        posix_thread thread;
+        worker(thread_pool& pool, sstring name);
+    };
+    // The regular lane workers, then those of the slow lane, if any
+    std::vector<std::unique_ptr<worker>> _workers;
+    unsigned _nr_regular;
     std::atomic<bool> _stopped = { false };
     std::atomic<bool> _main_thread_idle = { false };
+
+    // The worker of the lane with the fewest system calls in flight
+    worker& pick(lane l) noexcept;
 public:
-    explicit thread_pool(reactor* r, sstring thread_name);
+    // \param nr_regular number of threads of the regular lane, at least one
+    // \param nr_slow number of threads of the slow lane; if none, its
+    //        system calls run on the regular lane
+    thread_pool(reactor* r, sstring thread_name, unsigned nr_regular = 1, unsigned nr_slow = 0);
     ~thread_pool();
     template <typename T, typename Func>
-    future<T> submit(Func func) noexcept {
+    future<T> submit(Func func, lane l = lane::regular) noexcept {
         ++_aio_threaded_fallbacks;
-        return inter_thread_wq.submit<T>(std::move(func));
+        return pick(l).wq.submit<T>(std::move(func));
     }
     uint64_t operation_count() const { return _aio_threaded_fallbacks; }
+    // System calls submitted to the lane and not completed yet
+    size_t queue_depth(lane l) const noexcept;
 
-    unsigned complete() { return inter_thread_wq.complete(); }
+    unsigned complete();
     // Before we enter interrupt mode, we must make sure that the syscall thread will properly
     // generate signals to wake us up. This means we need to make sure that all modifications to
     // the pending and completed fields in the inter_thread_wq are visible to all threads.
@@ -61,10 +84,12 @@ class thread_pool {
 #else
 public:
     template <typename T, typename Func>
-    future<T> submit(Func func) { std::cerr << "thread_pool not yet implemented on osv\n"; abort(); }
+    future<T> submit(Func func, lane l = lane::regular) { std::cerr << "thread_pool not yet implemented on osv\n"; abort(); }
 #endif
 private:
-    void work(sstring thread_name);
+#ifndef HAVE_OSV
+    void work(worker& w, sstring thread_name);
+#endif
 };
 
 
@@ -0,0 +1,302 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#include <seastar/core/tracing.hh>
+#include <seastar/core/byteorder.hh>
+#include <seastar/core/circular_buffer.hh>
+#include <seastar/core/smp.hh>
+#include <seastar/core/loop.hh>
+#include <seastar/json/formatter.hh>
+#include <fmt/format.h>
+#include <random>
+
+namespace seastar {
+
+namespace tracing {
+
+void trace_context::serialize(char* p) const noexcept {
+    write_le<uint64_t>(p, trace_id_high);
+    write_le<uint64_t>(p + 8, trace_id_low);
+    write_le<uint64_t>(p + 16, span_id);
+    write_le<uint64_t>(p + 24, flags);
+}
+
+trace_context trace_context::deserialize(const char* p) noexcept {
+    trace_context ctx;
+    ctx.trace_id_high = read_le<uint64_t>(p);
+    ctx.trace_id_low = read_le<uint64_t>(p + 8);
+    ctx.span_id = read_le<uint64_t>(p + 16);
+    ctx.flags = read_le<uint64_t>(p + 24) & 0xff;
+    return ctx;
+}
+
+namespace {
+
+// Contexts which tasks refer to by handle: the index of the slot plus one
+// in the low half, and its generation in the high one, so that tasks which
+// outlive a span do not see the next context in its slot.
+struct context_slot {
+    trace_context ctx;
+    uint16_t generation = 0;
+    bool used = false;
+};
+
+struct span_record {
+    trace_context ctx;
+    uint64_t parent_span_id;
+    sstring name;
+    std::chrono::system_clock::time_point start;
+    std::chrono::system_clock::time_point end;
+    std::vector<std::pair<sstring, sstring>> attributes;
+};
+
+struct tracer {
+    static constexpr size_t max_slots = 0xffff;
+    config cfg;
+    std::vector<context_slot> slots;
+    std::vector<uint16_t> free_slots;
+    circular_buffer<span_record> spans;
+    uint64_t dropped_spans = 0;
+    std::mt19937_64 rng{std::random_device{}()};
+
+    uint64_t random_id() noexcept {
+        uint64_t id;
+        do {
+            id = rng();
+        } while (!id);
+        return id;
+    }
+    bool sample() noexcept {
+        return std::uniform_real_distribution<double>(0, 1)(rng) < cfg.sampling_rate;
+    }
+};
+
+thread_local tracer local_tracer;
+
+}
+
+void configure_local(config cfg) {
+    local_tracer.cfg = std::move(cfg);
+    while (local_tracer.spans.size() > local_tracer.cfg.max_spans) {
+        local_tracer.spans.pop_front();
+    }
+}
+
+future<> configure(config cfg) {
+    return smp::invoke_on_all([cfg = std::move(cfg)] {
+        configure_local(cfg);
+    });
+}
+
+namespace internal {
+
+uint32_t attach(const trace_context& ctx) noexcept {
+    auto& t = local_tracer;
+    uint16_t index;
+    if (!t.free_slots.empty()) {
+        index = t.free_slots.back();
+        t.free_slots.pop_back();
+    } else if (t.slots.size() < tracer::max_slots) {
+        try {
+            t.slots.emplace_back();
+            t.free_slots.reserve(t.slots.size());
+        } catch (...) {
+            return 0;
+        }
+        index = t.slots.size() - 1;
+    } else {
+        return 0;
+    }
+    auto& s = t.slots[index];
+    s.ctx = ctx;
+    s.used = true;
+    return (uint32_t(s.generation) << 16) | (index + 1);
+}
+
+void detach(uint32_t handle) noexcept {
+    auto& t = local_tracer;
+    uint16_t index = (handle & 0xffff) - 1;
+    auto& s = t.slots[index];
+    s.used = false;
+    s.generation++;
+    // Never allocates, as reserved in attach()
+    t.free_slots.push_back(index);
+}
+
+}
+
+trace_context current_context() noexcept {
+    auto handle = *seastar::internal::current_trace_handle_ptr();
+    if (!handle) {
+        return {};
+    }
+    auto& t = local_tracer;
+    size_t index = (handle & 0xffff) - 1;
+    if (index >= t.slots.size()) {
+        return {};
+    }
+    auto& s = t.slots[index];
+    if (!s.used || s.generation != (handle >> 16)) {
+        return {};
+    }
+    return s.ctx;
+}
+
+span::span(sstring name)
+        : span(std::move(name), current_context()) {
+}
+
+span::span(sstring name, const trace_context& parent) {
+    auto& t = local_tracer;
+    if (t.cfg.sampling_rate <= 0) {
+        return;
+    }
+    if (parent.valid()) {
+        if (!parent.sampled()) {
+            return;
+        }
+        _context.trace_id_high = parent.trace_id_high;
+        _context.trace_id_low = parent.trace_id_low;
+        _parent_span_id = parent.span_id;
+    } else {
+        if (!t.sample()) {
+            return;
+        }
+        _context.trace_id_high = t.random_id();
+        _context.trace_id_low = t.random_id();
+    }
+    _context.span_id = t.random_id();
+    _context.flags = 1;
+    _name = std::move(name);
+    _handle = internal::attach(_context);
+    _start = std::chrono::system_clock::now();
+}
+
+span::span(span&& x) noexcept
+        : _context(x._context)
+        , _parent_span_id(x._parent_span_id)
+        , _handle(std::exchange(x._handle, 0))
+        , _name(std::move(x._name))
+        , _start(x._start)
+        , _attributes(std::move(x._attributes)) {
+}
+
+span& span::operator=(span&& x) noexcept {
+    if (this != &x) {
+        end();
+        _context = x._context;
+        _parent_span_id = x._parent_span_id;
+        _handle = std::exchange(x._handle, 0);
+        _name = std::move(x._name);
+        _start = x._start;
+        _attributes = std::move(x._attributes);
+    }
+    return *this;
+}
+
+span::~span() {
+    end();
+}
+
+void span::set_attribute(sstring key, sstring value) {
+    if (_handle) {
+        _attributes.emplace_back(std::move(key), std::move(value));
+    }
+}
+
+void span::end() noexcept {
+    if (!_handle) {
+        return;
+    }
+    auto& t = local_tracer;
+    internal::detach(std::exchange(_handle, 0));
+    if (!t.cfg.max_spans) {
+        return;
+    }
+    try {
+        if (t.spans.size() >= t.cfg.max_spans) {
+            t.spans.pop_front();
+            t.dropped_spans++;
+        }
+        t.spans.push_back(span_record{_context, _parent_span_id, std::move(_name), _start,
+                std::chrono::system_clock::now(), std::move(_attributes)});
+    } catch (...) {
+        t.dropped_spans++;
+    }
+}
+
+static uint64_t unix_nanos(std::chrono::system_clock::time_point tp) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(tp.time_since_epoch()).count();
+}
+
+// The spans of this shard, as comma separated OTLP/JSON span objects
+static sstring export_local_spans() {
+    auto& t = local_tracer;
+    fmt::memory_buffer out;
+    auto it = std::back_inserter(out);
+    bool first = true;
+    for (auto& s : t.spans) {
+        fmt::format_to(it, "{}{{\"traceId\":\"{:016x}{:016x}\",\"spanId\":\"{:016x}\",",
+                first ? "" : ",", s.ctx.trace_id_high, s.ctx.trace_id_low, s.ctx.span_id);
+        if (s.parent_span_id) {
+            fmt::format_to(it, "\"parentSpanId\":\"{:016x}\",", s.parent_span_id);
+        }
+        fmt::format_to(it, "\"name\":{},\"kind\":1,\"startTimeUnixNano\":\"{}\",\"endTimeUnixNano\":\"{}\","
+                "\"attributes\":[{{\"key\":\"seastar.shard\",\"value\":{{\"intValue\":\"{}\"}}}}",
+                json::formatter::to_json(s.name), unix_nanos(s.start), unix_nanos(s.end), this_shard_id());
+        for (auto& [key, value] : s.attributes) {
+            fmt::format_to(it, ",{{\"key\":{},\"value\":{{\"stringValue\":{}}}}}",
+                    json::formatter::to_json(key), json::formatter::to_json(value));
+        }
+        fmt::format_to(it, "]}}");
+        first = false;
+    }
+    t.spans.clear();
+    return sstring(out.data(), out.size());
+}
+
+future<sstring> export_otlp_json() {
+    return do_with(std::vector<sstring>(smp::count), [] (std::vector<sstring>& shards) {
+        return smp::invoke_on_all([&shards] {
+            // Each shard writes its own element
+            shards[this_shard_id()] = export_local_spans();
+        }).then([&shards] {
+            fmt::memory_buffer out;
+            auto it = std::back_inserter(out);
+            fmt::format_to(it, "{{\"resourceSpans\":[{{\"resource\":{{\"attributes\":[{{\"key\":\"service.name\","
+                    "\"value\":{{\"stringValue\":{}}}}}]}},\"scopeSpans\":[{{\"scope\":{{\"name\":\"seastar\"}},\"spans\":[",
+                    json::formatter::to_json(local_tracer.cfg.service_name));
+            bool first = true;
+            for (auto& s : shards) {
+                if (!s.empty()) {
+                    fmt::format_to(it, "{}{}", first ? "" : ",", s);
+                    first = false;
+                }
+            }
+            fmt::format_to(it, "]}}]}}]}}");
+            return sstring(out.data(), out.size());
+        });
+    });
+}
+
+}
+
+}
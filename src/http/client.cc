@@ -0,0 +1,326 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#include <seastar/http/client.hh>
+#include <seastar/http/internal/content_source.hh>
+#include <seastar/core/loop.hh>
+#include <seastar/core/seastar.hh>
+#include <seastar/core/semaphore.hh>
+#include <seastar/core/when_all.hh>
+#include <limits>
+
+namespace seastar {
+
+namespace http {
+
+namespace {
+
+// The server closed the connection before sending any of the response
+class connection_closed_error : public std::runtime_error {
+public:
+    connection_closed_error() : std::runtime_error("HTTP connection closed by the server") {}
+};
+
+const sstring* find_header(const http_response& rsp, const char* name) {
+    httpd::request::case_insensitive_cmp cmp;
+    for (auto& h : rsp._headers) {
+        if (cmp(h.first, name)) {
+            return &h.second;
+        }
+    }
+    return nullptr;
+}
+
+bool keeps_connection(const http_response& rsp) {
+    auto c = find_header(rsp, "Connection");
+    httpd::request::case_insensitive_cmp cmp;
+    if (rsp._version == "1.0") {
+        return c && cmp(*c, "keep-alive");
+    }
+    return !c || !cmp(*c, "close");
+}
+
+}
+
+future<connected_socket> basic_connection_factory::make() {
+    return seastar::connect(_addr, {}, transport::TCP);
+}
+
+class client::connection : public enable_lw_shared_from_this<connection> {
+    connected_socket _fd;
+    input_stream<char> _in;
+    output_stream<char> _out;
+    http_response_parser _parser;
+    semaphore _write_lock{1};
+    // Resolves once the response of the last request sent was read
+    future<> _last_response = make_ready_future<>();
+    std::unordered_map<sstring, sstring> _chunk_extensions;
+    std::unordered_map<sstring, sstring> _trailing_headers;
+    unsigned _in_flight = 0;
+    uint64_t _requests = 0;
+    bool _persistent = true;
+public:
+    explicit connection(connected_socket fd)
+            : _fd(std::move(fd))
+            , _in(_fd.input())
+            , _out(_fd.output()) {
+    }
+
+    unsigned in_flight() const noexcept {
+        return _in_flight;
+    }
+
+    bool persistent() const noexcept {
+        return _persistent;
+    }
+
+    void reserve() noexcept {
+        ++_in_flight;
+    }
+
+    void unreserve() noexcept {
+        --_in_flight;
+    }
+
+    future<> make_request(httpd::request& req, reply_handler& handle, std::optional<httpd::reply::status_type> expected) {
+        bool reused = _requests++ != 0;
+        promise<> read_turn;
+        auto prev = std::exchange(_last_response, read_turn.get_future());
+        auto head = req._method == "HEAD";
+        auto f = with_semaphore(_write_lock, 1, [this, &req] {
+            return send_request(req);
+        }).then_wrapped([this, prev = std::move(prev), &handle, expected, head, reused] (future<> sent) mutable {
+            // Responses come in the order of the requests
+            return prev.then([this, sent = std::move(sent), &handle, expected, head, reused] () mutable {
+                if (sent.failed()) {
+                    return std::move(sent);
+                }
+                return recv_response(handle, expected, head, reused);
+            });
+        });
+        return f.then_wrapped([this, read_turn = std::move(read_turn)] (future<> f) mutable {
+            if (f.failed()) {
+                // Either side may be out of sync now, fail the pipelined requests fast
+                _persistent = false;
+                _fd.shutdown_input();
+                _fd.shutdown_output();
+            }
+            read_turn.set_value();
+            return f;
+        });
+    }
+
+    future<> close() {
+        return when_all(_in.close(), _out.close()).discard_result();
+    }
+
+private:
+    future<> send_request(httpd::request& req) {
+        auto head = format("{} {} HTTP/{}\r\n", req._method, req._url, req._version.empty() ? "1.1" : req._version);
+        bool chunked = false;
+        bool has_length = false;
+        for (auto& h : req._headers) {
+            head += h.first + ": " + h.second + "\r\n";
+            httpd::request::case_insensitive_cmp cmp;
+            chunked |= cmp(h.first, "Transfer-Encoding");
+            has_length |= cmp(h.first, "Content-Length");
+        }
+        if (!chunked && !has_length && !req.body_writer && !req.content.empty()) {
+            head += format("Content-Length: {}\r\n", req.content.size());
+        }
+        head += "\r\n";
+        return _out.write(head).then([this, &req, chunked] {
+            if (!req.body_writer) {
+                return _out.write(req.content);
+            }
+            if (chunked) {
+                return req.body_writer(internal::make_http_chunked_output_stream(_out)).then([this] {
+                    return _out.write("0\r\n\r\n", 5);
+                });
+            }
+            return req.body_writer(internal::make_http_content_length_output_stream(_out, req.content_length));
+        }).then([this] {
+            return _out.flush();
+        });
+    }
+
+    future<> recv_response(reply_handler& handle, std::optional<httpd::reply::status_type> expected, bool head, bool reused) {
+        _parser.init();
+        return _in.consume(_parser).then([this, &handle, expected, head, reused] {
+            if (_parser.eof()) {
+                if (reused) {
+                    throw connection_closed_error();
+                }
+                throw std::runtime_error("HTTP connection closed before the response");
+            }
+            auto rsp = _parser.get_parsed_response();
+            if (!rsp || _parser._state != http_response_parser::state::done) {
+                throw std::runtime_error("malformed HTTP response");
+            }
+            _persistent = _persistent && keeps_connection(*rsp);
+            auto status = rsp->_status_code;
+            auto body = make_body(*rsp, head || status / 100 == 1 || status == 204 || status == 304);
+            return do_with(std::move(rsp), std::move(body), [&handle, expected] (std::unique_ptr<http_response>& rsp, input_stream<char>& body) {
+                auto f = make_ready_future<>();
+                if (expected && rsp->_status_code != int(*expected)) {
+                    f = make_exception_future<>(unexpected_status_error(httpd::reply::status_type(rsp->_status_code)));
+                } else {
+                    f = futurize_invoke(handle, *rsp, body);
+                }
+                return f.finally([&body] {
+                    // Whatever the handler left unread is in the way of the next response
+                    return repeat([&body] {
+                        return body.read().then([] (temporary_buffer<char> buf) {
+                            return buf.empty() ? stop_iteration::yes : stop_iteration::no;
+                        });
+                    });
+                });
+            });
+        });
+    }
+
+    input_stream<char> make_body(const http_response& rsp, bool empty) {
+        using namespace httpd::internal;
+        if (empty) {
+            return input_stream<char>(data_source(std::make_unique<content_length_source_impl>(_in, 0)));
+        }
+        if (auto te = find_header(rsp, "Transfer-Encoding")) {
+            if (!httpd::request::case_insensitive_cmp()(*te, "chunked")) {
+                throw std::runtime_error(format("unsupported HTTP transfer encoding: {}", *te));
+            }
+            _chunk_extensions.clear();
+            _trailing_headers.clear();
+            return input_stream<char>(data_source(std::make_unique<chunked_source_impl>(_in, _chunk_extensions, _trailing_headers)));
+        }
+        if (auto len = find_header(rsp, "Content-Length")) {
+            return input_stream<char>(data_source(std::make_unique<content_length_source_impl>(_in, std::stoull(*len))));
+        }
+        // The body ends with the connection
+        _persistent = false;
+        return input_stream<char>(data_source(std::make_unique<content_length_source_impl>(_in, std::numeric_limits<size_t>::max())));
+    }
+};
+
+client::client(socket_address addr, client_options options)
+        : client(std::make_unique<basic_connection_factory>(std::move(addr)), options) {
+}
+
+client::client(std::unique_ptr<connection_factory> factory, client_options options)
+        : _factory(std::move(factory))
+        , _options(options) {
+    if (!_options.max_connections || !_options.max_pipelined_requests) {
+        throw std::invalid_argument("HTTP client needs at least one connection and one request per connection");
+    }
+}
+
+client::~client() = default;
+
+future<lw_shared_ptr<client::connection>> client::make_connection() {
+    ++_connecting;
+    return _factory->make().then_wrapped([this] (future<connected_socket> f) {
+        --_connecting;
+        if (f.failed()) {
+            _connection_released.signal();
+            return make_exception_future<lw_shared_ptr<connection>>(f.get_exception());
+        }
+        auto con = make_lw_shared<connection>(f.get0());
+        con->reserve();
+        _connections.push_back(con);
+        ++_total_new_connections;
+        return make_ready_future<lw_shared_ptr<connection>>(std::move(con));
+    });
+}
+
+future<lw_shared_ptr<client::connection>> client::get_connection() {
+    lw_shared_ptr<connection> best;
+    for (auto& c : _connections) {
+        if (c->persistent() && c->in_flight() < _options.max_pipelined_requests && (!best || c->in_flight() < best->in_flight())) {
+            best = c;
+        }
+    }
+    if (best && best->in_flight() == 0) {
+        best->reserve();
+        return make_ready_future<lw_shared_ptr<connection>>(std::move(best));
+    }
+    if (_connections.size() + _connecting < _options.max_connections) {
+        return make_connection();
+    }
+    if (best) {
+        best->reserve();
+        return make_ready_future<lw_shared_ptr<connection>>(std::move(best));
+    }
+    return _connection_released.wait().then([this] {
+        return get_connection();
+    });
+}
+
+void client::release_connection(lw_shared_ptr<connection> con) {
+    con->unreserve();
+    if (!con->persistent() && !con->in_flight()) {
+        _connections.erase(std::remove(_connections.begin(), _connections.end(), con), _connections.end());
+        // The gate is open, the request this is called for holds it
+        (void)with_gate(_gate, [con] {
+            return con->close().handle_exception([] (std::exception_ptr) {}).finally([con] {});
+        });
+    }
+    _connection_released.signal();
+}
+
+future<> client::do_make_request(httpd::request& req, reply_handler& handle, std::optional<httpd::reply::status_type> expected, bool may_retry) {
+    return get_connection().then([this, &req, &handle, expected, may_retry] (lw_shared_ptr<connection> con) {
+        return con->make_request(req, handle, expected).then_wrapped([this, con, &req, &handle, expected, may_retry] (future<> f) mutable {
+            release_connection(std::move(con));
+            if (f.failed() && may_retry && !req.body_writer) {
+                auto ex = f.get_exception();
+                try {
+                    std::rethrow_exception(ex);
+                } catch (connection_closed_error&) {
+                    // The server closed the idle connection while the request was under way
+                    return do_make_request(req, handle, expected, false);
+                } catch (...) {
+                }
+                return make_exception_future<>(std::move(ex));
+            }
+            return f;
+        });
+    });
+}
+
+future<> client::make_request(httpd::request req, reply_handler handle, std::optional<httpd::reply::status_type> expected) {
+    return with_gate(_gate, [this, req = std::move(req), handle = std::move(handle), expected] () mutable {
+        return do_with(std::move(req), std::move(handle), [this, expected] (httpd::request& req, reply_handler& handle) {
+            return do_make_request(req, handle, expected, true);
+        });
+    });
+}
+
+future<> client::close() {
+    _connection_released.broken();
+    return _gate.close().then([this] {
+        return parallel_for_each(std::exchange(_connections, {}), [] (lw_shared_ptr<connection> con) {
+            return con->close().handle_exception([] (std::exception_ptr) {}).finally([con] {});
+        });
+    });
+}
+
+}
+
+}
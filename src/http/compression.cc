@@ -0,0 +1,410 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#include <seastar/http/compression.hh>
+#include <seastar/http/reply.hh>
+#include <seastar/core/do_with.hh>
+#include <seastar/core/loop.hh>
+#include <seastar/core/print.hh>
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+#include <strings.h>
+#include <zlib.h>
+#ifdef SEASTAR_HAVE_BROTLI
+#include <brotli/encode.h>
+#endif
+
+namespace seastar {
+
+namespace httpd {
+
+namespace {
+
+// The size of the buffers the compressed data is written out in
+constexpr size_t output_chunk = 16 * 1024;
+
+class stream_compressor {
+public:
+    enum class mode { none, flush, finish };
+    virtual ~stream_compressor() = default;
+    // Compress the input into out. Only complete buffers are emitted unless
+    // flushing or finishing, which emit all the output for what came so far.
+    virtual void compress(const char* in, size_t size, mode m, std::vector<temporary_buffer<char>>& out) = 0;
+protected:
+    temporary_buffer<char> _buf;
+    size_t _used = 0;
+
+    // Space for the next output, full buffers go to out
+    void reserve(std::vector<temporary_buffer<char>>& out) {
+        if (_used == _buf.size()) {
+            if (_used) {
+                out.push_back(std::move(_buf));
+            }
+            _buf = temporary_buffer<char>(output_chunk);
+            _used = 0;
+        }
+    }
+
+    void emit(std::vector<temporary_buffer<char>>& out) {
+        if (_used) {
+            _buf.trim(_used);
+            out.push_back(std::move(_buf));
+            _used = 0;
+        }
+    }
+};
+
+class zlib_compressor : public stream_compressor {
+    z_stream _zs = {};
+public:
+    zlib_compressor(content_encoding e, int level) {
+        // gzip wraps the stream in a gzip header and trailer, deflate in the
+        // zlib ones (RFC 7230, section 4.2.2)
+        int window_bits = e == content_encoding::gzip ? 15 + 16 : 15;
+        auto r = deflateInit2(&_zs, level, Z_DEFLATED, window_bits, 8, Z_DEFAULT_STRATEGY);
+        if (r == Z_MEM_ERROR) {
+            throw std::bad_alloc();
+        } else if (r != Z_OK) {
+            throw std::invalid_argument(format("Bad {} compression level {}", to_string(e), level));
+        }
+    }
+    ~zlib_compressor() {
+        deflateEnd(&_zs);
+    }
+    virtual void compress(const char* in, size_t size, mode m, std::vector<temporary_buffer<char>>& out) override {
+        _zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in));
+        _zs.avail_in = size;
+        int flush = m == mode::none ? Z_NO_FLUSH : m == mode::flush ? Z_SYNC_FLUSH : Z_FINISH;
+        do {
+            reserve(out);
+            _zs.next_out = reinterpret_cast<Bytef*>(_buf.get_write() + _used);
+            _zs.avail_out = _buf.size() - _used;
+            // Z_BUF_ERROR only means there was nothing to do
+            if (deflate(&_zs, flush) == Z_STREAM_ERROR) {
+                throw std::runtime_error("deflate failed");
+            }
+            _used = _buf.size() - _zs.avail_out;
+        } while (_zs.avail_out == 0);
+        if (m != mode::none) {
+            emit(out);
+        }
+    }
+};
+
+#ifdef SEASTAR_HAVE_BROTLI
+
+class brotli_compressor : public stream_compressor {
+    std::unique_ptr<BrotliEncoderState, void (*)(BrotliEncoderState*)> _state;
+public:
+    brotli_compressor(int level, size_t size_hint)
+            : _state(BrotliEncoderCreateInstance(nullptr, nullptr, nullptr), BrotliEncoderDestroyInstance) {
+        if (!_state) {
+            throw std::bad_alloc();
+        }
+        if (level < -1 || level > BROTLI_MAX_QUALITY) {
+            throw std::invalid_argument(format("Bad br compression level {}", level));
+        }
+        // The default quality of 11 is meant for static content, 5 is about
+        // as fast as gzip and still compresses better
+        BrotliEncoderSetParameter(_state.get(), BROTLI_PARAM_QUALITY, level < 0 ? 5 : level);
+        // A 256KiB window instead of 4MiB, there may be many responses
+        // in flight
+        BrotliEncoderSetParameter(_state.get(), BROTLI_PARAM_LGWIN, 18);
+        if (size_hint) {
+            BrotliEncoderSetParameter(_state.get(), BROTLI_PARAM_SIZE_HINT, std::min<size_t>(size_hint, 1 << 30));
+        }
+    }
+    virtual void compress(const char* in, size_t size, mode m, std::vector<temporary_buffer<char>>& out) override {
+        auto next_in = reinterpret_cast<const uint8_t*>(in);
+        size_t avail_in = size;
+        auto op = m == mode::none ? BROTLI_OPERATION_PROCESS : m == mode::flush ? BROTLI_OPERATION_FLUSH : BROTLI_OPERATION_FINISH;
+        do {
+            reserve(out);
+            auto next_out = reinterpret_cast<uint8_t*>(_buf.get_write() + _used);
+            size_t avail_out = _buf.size() - _used;
+            if (!BrotliEncoderCompressStream(_state.get(), op, &avail_in, &next_in, &avail_out, &next_out, nullptr)) {
+                throw std::runtime_error("brotli compression failed");
+            }
+            _used = _buf.size() - avail_out;
+        } while (avail_in || BrotliEncoderHasMoreOutput(_state.get())
+                || (m == mode::finish && !BrotliEncoderIsFinished(_state.get())));
+        if (m != mode::none) {
+            emit(out);
+        }
+    }
+};
+
+#endif
+
+std::unique_ptr<stream_compressor> make_compressor(content_encoding e, int level, size_t size_hint = 0) {
+    switch (e) {
+    case content_encoding::deflate:
+    case content_encoding::gzip:
+        return std::make_unique<zlib_compressor>(e, level);
+    case content_encoding::br:
+#ifdef SEASTAR_HAVE_BROTLI
+        return std::make_unique<brotli_compressor>(level, size_hint);
+#else
+        break;
+#endif
+    case content_encoding::identity:
+        break;
+    }
+    throw std::invalid_argument(format("Cannot compress with {}", to_string(e)));
+}
+
+class compressing_data_sink_impl : public data_sink_impl {
+    output_stream<char> _out;
+    std::unique_ptr<stream_compressor> _compressor;
+
+    future<> write(std::vector<temporary_buffer<char>> bufs) {
+        return do_with(std::move(bufs), [this] (std::vector<temporary_buffer<char>>& bufs) {
+            return do_for_each(bufs, [this] (temporary_buffer<char>& buf) {
+                return _out.write(std::move(buf));
+            });
+        });
+    }
+    future<> compress(const char* data, size_t size, stream_compressor::mode m) {
+        std::vector<temporary_buffer<char>> bufs;
+        try {
+            _compressor->compress(data, size, m, bufs);
+        } catch (...) {
+            return current_exception_as_future();
+        }
+        return write(std::move(bufs));
+    }
+public:
+    compressing_data_sink_impl(output_stream<char>&& out, content_encoding e, int level)
+            : _out(std::move(out)), _compressor(make_compressor(e, level)) {
+    }
+
+    virtual future<> put(net::packet data) override {
+        std::vector<temporary_buffer<char>> bufs;
+        try {
+            for (auto& f : data.fragments()) {
+                _compressor->compress(f.base, f.size, stream_compressor::mode::none, bufs);
+            }
+        } catch (...) {
+            return current_exception_as_future();
+        }
+        return write(std::move(bufs));
+    }
+
+    using data_sink_impl::put;
+
+    virtual future<> put(temporary_buffer<char> buf) override {
+        // The compressor is done with the input once it returns
+        return compress(buf.get(), buf.size(), stream_compressor::mode::none);
+    }
+
+    virtual future<> flush() override {
+        return compress(nullptr, 0, stream_compressor::mode::flush).then([this] {
+            return _out.flush();
+        });
+    }
+
+    virtual future<> close() override {
+        return compress(nullptr, 0, stream_compressor::mode::finish).finally([this] {
+            return _out.close();
+        });
+    }
+};
+
+bool has_body(reply::status_type status) {
+    return int(status) >= 200 && status != reply::status_type::no_content
+            && status != reply::status_type::not_modified;
+}
+
+}
+
+std::string_view to_string(content_encoding e) noexcept {
+    switch (e) {
+    case content_encoding::identity:
+        return "identity";
+    case content_encoding::deflate:
+        return "deflate";
+    case content_encoding::gzip:
+        return "gzip";
+    case content_encoding::br:
+        return "br";
+    }
+    return "identity";
+}
+
+const std::vector<content_encoding>& supported_content_encodings() noexcept {
+    static const std::vector<content_encoding> encodings = {
+#ifdef SEASTAR_HAVE_BROTLI
+        content_encoding::br,
+#endif
+        content_encoding::gzip,
+        content_encoding::deflate,
+    };
+    return encodings;
+}
+
+content_encoding negotiate_content_encoding(std::string_view accept_encoding,
+        const std::vector<content_encoding>& candidates) {
+    // The weight of each candidate, -1 for not mentioned, and that of "*"
+    std::vector<float> weights(candidates.size(), -1);
+    float any = -1;
+    while (!accept_encoding.empty()) {
+        auto comma = accept_encoding.find(',');
+        auto item = accept_encoding.substr(0, comma);
+        accept_encoding.remove_prefix(comma == std::string_view::npos ? accept_encoding.size() : comma + 1);
+
+        auto semicolon = item.find(';');
+        auto coding = item.substr(0, semicolon);
+        float q = 1;
+        if (semicolon != std::string_view::npos) {
+            auto params = item.substr(semicolon + 1);
+            auto qpos = params.find_first_of("qQ");
+            auto eq = params.find('=', qpos);
+            if (qpos != std::string_view::npos && eq != std::string_view::npos) {
+                // At most 3 decimals, so a copy on the stack serves strtof
+                char value[8] = {};
+                auto v = params.substr(eq + 1);
+                v.remove_prefix(std::min(v.find_first_not_of(" \t"), v.size()));
+                v.copy(value, sizeof(value) - 1);
+                q = std::strtof(value, nullptr);
+            }
+        }
+        auto b = coding.find_first_not_of(" \t");
+        if (b == std::string_view::npos) {
+            continue;
+        }
+        coding = coding.substr(b, coding.find_last_not_of(" \t") + 1 - b);
+        auto is = [coding] (std::string_view name) {
+            return coding.size() == name.size() && ::strncasecmp(coding.data(), name.data(), name.size()) == 0;
+        };
+        if (is("*")) {
+            any = q;
+            continue;
+        }
+        for (size_t i = 0; i < candidates.size(); i++) {
+            auto name = to_string(candidates[i]);
+            if (is(name) || (candidates[i] == content_encoding::gzip && is("x-gzip"))) {
+                weights[i] = q;
+            }
+        }
+    }
+    auto best = content_encoding::identity;
+    float best_weight = 0;
+    for (size_t i = 0; i < candidates.size(); i++) {
+        auto w = weights[i] < 0 ? any : weights[i];
+        if (w > best_weight) {
+            best = candidates[i];
+            best_weight = w;
+        }
+    }
+    return best;
+}
+
+bool is_compressible(std::string_view content_type) noexcept {
+    auto type = content_type.substr(0, content_type.find(';'));
+    while (!type.empty() && (type.back() == ' ' || type.back() == '\t')) {
+        type.remove_suffix(1);
+    }
+    auto starts_with = [type] (std::string_view prefix) {
+        return type.size() >= prefix.size() && ::strncasecmp(type.data(), prefix.data(), prefix.size()) == 0;
+    };
+    auto ends_with = [type] (std::string_view suffix) {
+        return type.size() >= suffix.size() && ::strncasecmp(type.data() + type.size() - suffix.size(), suffix.data(), suffix.size()) == 0;
+    };
+    return starts_with("text/") || ends_with("/json") || ends_with("+json")
+            || ends_with("/xml") || ends_with("+xml") || ends_with("/javascript");
+}
+
+output_stream<char> make_compressed_output_stream(output_stream<char>&& out, content_encoding e, int level) {
+    output_stream_options opts;
+    opts.trim_to_size = true;
+    return output_stream<char>(data_sink(std::make_unique<compressing_data_sink_impl>(std::move(out), e, level)), 32 * 1024, opts);
+}
+
+future<sstring> compress(sstring content, content_encoding e, int level) {
+    // Parts small enough not to stall the reactor
+    static constexpr size_t part = 64 * 1024;
+    std::unique_ptr<stream_compressor> compressor;
+    try {
+        compressor = make_compressor(e, level, content.size());
+    } catch (...) {
+        return current_exception_as_future<sstring>();
+    }
+    return do_with(std::move(compressor), std::move(content), size_t(0), std::vector<temporary_buffer<char>>(),
+            [] (std::unique_ptr<stream_compressor>& c, sstring& content, size_t& pos, std::vector<temporary_buffer<char>>& out) {
+        return repeat([&] {
+            auto n = std::min(part, content.size() - pos);
+            auto m = pos + n == content.size() ? stream_compressor::mode::finish : stream_compressor::mode::none;
+            c->compress(content.data() + pos, n, m, out);
+            pos += n;
+            return stop_iteration(m == stream_compressor::mode::finish);
+        }).then([&out] {
+            size_t size = 0;
+            for (auto& buf : out) {
+                size += buf.size();
+            }
+            sstring result(sstring::initialized_later(), size);
+            auto p = result.begin();
+            for (auto& buf : out) {
+                p = std::copy(buf.begin(), buf.end(), p);
+            }
+            return result;
+        });
+    });
+}
+
+future<> compress_reply(reply& rep, std::string_view accept_encoding, const compression_config& cfg) {
+    auto type = rep._headers.find("Content-Type");
+    if (type == rep._headers.end() || !is_compressible(type->second) || !has_body(rep._status)
+            || rep._headers.count("Content-Encoding")) {
+        return make_ready_future<>();
+    }
+    // Caches must not serve the compressed reply to clients that did not
+    // ask for it, nor the other way round
+    auto& vary = rep._headers["Vary"];
+    if (vary.empty()) {
+        vary = "Accept-Encoding";
+    } else if (vary.find("Accept-Encoding") == sstring::npos) {
+        vary += ", Accept-Encoding";
+    }
+    if (!rep._body_writer && rep._content.size() < cfg.min_size) {
+        return make_ready_future<>();
+    }
+    auto e = negotiate_content_encoding(accept_encoding, cfg.encodings);
+    if (e == content_encoding::identity) {
+        return make_ready_future<>();
+    }
+    rep._headers["Content-Encoding"] = sstring(to_string(e));
+    int level = cfg.level;
+    if (rep._body_writer) {
+        rep._body_writer = [e, level, writer = std::move(rep._body_writer)] (output_stream<char>&& out) mutable {
+            return writer(make_compressed_output_stream(std::move(out), e, level));
+        };
+        return make_ready_future<>();
+    }
+    return compress(std::move(rep._content), e, level).then([&rep] (sstring content) {
+        rep._content = std::move(content);
+    });
+}
+
+}
+
+}
@@ -28,6 +28,7 @@
 #include <seastar/core/shared_ptr.hh>
 #include <seastar/core/app-template.hh>
 #include <seastar/http/exception.hh>
+#include <seastar/http/compression.hh>
 
 namespace seastar {
 
@@ -83,11 +84,46 @@ output_stream<char> file_interaction_handler::get_stream(std::unique_ptr<request
     return std::move(s);
 }
 
+// The pre-compressed variant of the file the client prefers, trying the
+// next coding when a file is missing; the file itself when there is none
+static future<sstring> find_precompressed(sstring file_name, sstring accept_encoding,
+        std::vector<content_encoding> candidates, reply& rep) {
+    auto e = negotiate_content_encoding(accept_encoding, candidates);
+    if (e == content_encoding::identity) {
+        return make_ready_future<sstring>(std::move(file_name));
+    }
+    sstring name = file_name + (e == content_encoding::br ? ".br" : ".gz");
+    return file_exists(name).then([file_name = std::move(file_name), accept_encoding = std::move(accept_encoding),
+            candidates = std::move(candidates), name, e, &rep] (bool exists) mutable {
+        if (exists) {
+            rep._headers["Content-Encoding"] = sstring(to_string(e));
+            return make_ready_future<sstring>(std::move(name));
+        }
+        candidates.erase(std::find(candidates.begin(), candidates.end(), e));
+        return find_precompressed(std::move(file_name), std::move(accept_encoding), std::move(candidates), rep);
+    });
+}
+
 future<std::unique_ptr<reply>> file_interaction_handler::read(
         sstring file_name, std::unique_ptr<request> req,
         std::unique_ptr<reply> rep) {
+    if (precompressed && !transformer) {
+        rep->_headers["Vary"] = "Accept-Encoding";
+        auto accept_encoding = req->get_header("Accept-Encoding");
+        auto& r = *rep;
+        return find_precompressed(file_name, std::move(accept_encoding), {content_encoding::br, content_encoding::gzip}, r).then(
+                [this, file_name, req = std::move(req), rep = std::move(rep)] (sstring compressed) mutable {
+            return read(std::move(file_name), std::move(compressed), std::move(req), std::move(rep));
+        });
+    }
+    return read(file_name, file_name, std::move(req), std::move(rep));
+}
+
+future<std::unique_ptr<reply>> file_interaction_handler::read(
+        sstring file_name, sstring path, std::unique_ptr<request> req,
+        std::unique_ptr<reply> rep) {
     sstring extension = get_extension(file_name);
-    rep->write_body(extension, [req = std::move(req), extension, file_name, this] (output_stream<char>&& s) mutable {
+    rep->write_body(extension, [req = std::move(req), extension, file_name = std::move(path), this] (output_stream<char>&& s) mutable {
         return do_with(output_stream<char>(get_stream(std::move(req), extension, std::move(s))),
                 [file_name] (output_stream<char>& os) {
             return open_file_dma(file_name, open_flags::ro).then([&os] (file f) {
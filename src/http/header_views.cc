@@ -0,0 +1,69 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#include <seastar/http/header_views.hh>
+#include <algorithm>
+#include <seastar/util/ascii.hh>
+
+namespace seastar {
+
+namespace httpd {
+
+size_t header_views::case_insensitive_hash::operator()(std::string_view s) const noexcept {
+    return ascii_ihash(s);
+}
+
+bool header_views::case_insensitive_equal::operator()(std::string_view a, std::string_view b) const noexcept {
+    return ascii_iequals(a, b);
+}
+
+size_t header_views::find_index(std::string_view name) const noexcept {
+    if (_fields.size() <= scanned_fields) {
+        auto it = std::find_if(_fields.begin(), _fields.end(), [name] (const field& f) {
+            return case_insensitive_equal()(f.first, name);
+        });
+        return it - _fields.begin();
+    }
+    // Fields are only ever added, so the index just catches up with them
+    for (size_t i = _index.size(); i < _fields.size(); i++) {
+        _index.emplace(_fields[i].first, i);
+    }
+    auto it = _index.find(name);
+    return it == _index.end() ? _fields.size() : it->second;
+}
+
+void header_views::append(std::string_view name, std::string_view value, std::string_view separator) {
+    auto i = find_index(name);
+    if (i == _fields.size()) {
+        _fields.emplace_back(name, value);
+        return;
+    }
+    auto& old = _fields[i].second;
+    sstring combined(sstring::initialized_later(), old.size() + separator.size() + value.size());
+    auto out = std::copy(old.begin(), old.end(), combined.begin());
+    out = std::copy(separator.begin(), separator.end(), out);
+    std::copy(value.begin(), value.end(), out);
+    old = keep(std::move(combined));
+}
+
+}
+
+}
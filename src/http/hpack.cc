@@ -0,0 +1,400 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#include <seastar/http/internal/hpack.hh>
+#include <algorithm>
+#include <array>
+#include <cstdint>
+
+namespace seastar {
+
+namespace http {
+
+namespace internal {
+
+namespace {
+
+// RFC 7541, Appendix A
+constexpr std::pair<const char*, const char*> static_table[] = {
+    {":authority", ""},
+    {":method", "GET"},
+    {":method", "POST"},
+    {":path", "/"},
+    {":path", "/index.html"},
+    {":scheme", "http"},
+    {":scheme", "https"},
+    {":status", "200"},
+    {":status", "204"},
+    {":status", "206"},
+    {":status", "304"},
+    {":status", "400"},
+    {":status", "404"},
+    {":status", "500"},
+    {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""},
+    {"accept-ranges", ""},
+    {"accept", ""},
+    {"access-control-allow-origin", ""},
+    {"age", ""},
+    {"allow", ""},
+    {"authorization", ""},
+    {"cache-control", ""},
+    {"content-disposition", ""},
+    {"content-encoding", ""},
+    {"content-language", ""},
+    {"content-length", ""},
+    {"content-location", ""},
+    {"content-range", ""},
+    {"content-type", ""},
+    {"cookie", ""},
+    {"date", ""},
+    {"etag", ""},
+    {"expect", ""},
+    {"expires", ""},
+    {"from", ""},
+    {"host", ""},
+    {"if-match", ""},
+    {"if-modified-since", ""},
+    {"if-none-match", ""},
+    {"if-range", ""},
+    {"if-unmodified-since", ""},
+    {"last-modified", ""},
+    {"link", ""},
+    {"location", ""},
+    {"max-forwards", ""},
+    {"proxy-authenticate", ""},
+    {"proxy-authorization", ""},
+    {"range", ""},
+    {"referer", ""},
+    {"refresh", ""},
+    {"retry-after", ""},
+    {"server", ""},
+    {"set-cookie", ""},
+    {"strict-transport-security", ""},
+    {"transfer-encoding", ""},
+    {"user-agent", ""},
+    {"vary", ""},
+    {"via", ""},
+    {"www-authenticate", ""},
+};
+
+constexpr size_t static_table_size = std::size(static_table);
+
+// The lengths of the Huffman codes of the 256 octets and of EOS (RFC 7541,
+// Appendix B). The code is canonical, so the codes follow from the lengths.
+constexpr uint8_t huffman_lengths[257] = {
+    13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+    28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+    6, 10, 10, 12, 13, 6, 8, 11, 10, 10, 8, 11, 8, 6, 6, 6,
+    5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6, 12, 10,
+    13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6,
+    15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5,
+    6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28,
+    20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+    24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+    22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+    21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+    26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+    19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+    20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+    26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+    30,
+};
+
+constexpr unsigned eos = 256;
+constexpr unsigned max_code_length = 30;
+
+class huffman_code {
+    std::array<uint32_t, 257> _codes;
+    // Canonical decoding: the codes of each length are consecutive, starting
+    // at _first, and their symbols are in _symbols from _offset on.
+    std::array<uint32_t, max_code_length + 1> _first{};
+    std::array<uint16_t, max_code_length + 1> _count{};
+    std::array<uint16_t, max_code_length + 1> _offset{};
+    std::array<uint16_t, 257> _symbols;
+public:
+    huffman_code() {
+        for (unsigned s = 0; s < _symbols.size(); s++) {
+            _symbols[s] = s;
+        }
+        std::stable_sort(_symbols.begin(), _symbols.end(), [] (uint16_t a, uint16_t b) {
+            return huffman_lengths[a] < huffman_lengths[b];
+        });
+        uint32_t code = 0;
+        unsigned prev = huffman_lengths[_symbols[0]];
+        for (unsigned i = 0; i < _symbols.size(); i++) {
+            auto s = _symbols[i];
+            auto len = huffman_lengths[s];
+            if (i) {
+                code = (code + 1) << (len - prev);
+            }
+            if (!_count[len]++) {
+                _first[len] = code;
+                _offset[len] = i;
+            }
+            _codes[s] = code;
+            prev = len;
+        }
+    }
+
+    size_t encoded_size(std::string_view in) const noexcept {
+        size_t bits = 0;
+        for (unsigned char c : in) {
+            bits += huffman_lengths[c];
+        }
+        return (bits + 7) / 8;
+    }
+
+    void encode(std::string& out, std::string_view in) const {
+        uint64_t acc = 0;
+        unsigned bits = 0;
+        for (unsigned char c : in) {
+            acc = (acc << huffman_lengths[c]) | _codes[c];
+            bits += huffman_lengths[c];
+            while (bits >= 8) {
+                bits -= 8;
+                out.push_back(char(acc >> bits));
+            }
+        }
+        if (bits) {
+            // Padded with the most significant bits of EOS, all ones
+            out.push_back(char((acc << (8 - bits)) | (0xff >> bits)));
+        }
+    }
+
+    void decode(sstring& out, std::string_view in) const {
+        std::string ret;
+        ret.reserve(in.size() * 8 / 5);
+        uint32_t code = 0;
+        unsigned len = 0;
+        for (unsigned char c : in) {
+            for (int bit = 7; bit >= 0; bit--) {
+                code = (code << 1) | ((c >> bit) & 1);
+                if (++len > max_code_length) {
+                    throw hpack_error("invalid Huffman code");
+                }
+                if (code >= _first[len] && code - _first[len] < _count[len]) {
+                    auto s = _symbols[_offset[len] + code - _first[len]];
+                    if (s == eos) {
+                        throw hpack_error("EOS in a Huffman coded string");
+                    }
+                    ret.push_back(char(s));
+                    code = 0;
+                    len = 0;
+                }
+            }
+        }
+        if (len > 7 || code != (1u << len) - 1) {
+            throw hpack_error("invalid Huffman code padding");
+        }
+        out = sstring(ret.data(), ret.size());
+    }
+};
+
+const huffman_code huffman;
+
+constexpr size_t entry_overhead = 32;
+
+void encode_integer(std::string& out, uint8_t flags, unsigned prefix_bits, uint64_t value) {
+    uint64_t max_prefix = (1u << prefix_bits) - 1;
+    if (value < max_prefix) {
+        out.push_back(char(flags | value));
+        return;
+    }
+    out.push_back(char(flags | max_prefix));
+    value -= max_prefix;
+    while (value >= 128) {
+        out.push_back(char(0x80 | (value & 0x7f)));
+        value >>= 7;
+    }
+    out.push_back(char(value));
+}
+
+void encode_string(std::string& out, std::string_view s) {
+    auto huffman_size = huffman.encoded_size(s);
+    if (huffman_size < s.size()) {
+        encode_integer(out, 0x80, 7, huffman_size);
+        huffman.encode(out, s);
+    } else {
+        encode_integer(out, 0, 7, s.size());
+        out.append(s.data(), s.size());
+    }
+}
+
+class block_reader {
+    std::string_view _in;
+    size_t _pos = 0;
+public:
+    explicit block_reader(std::string_view in) : _in(in) {}
+
+    bool empty() const noexcept {
+        return _pos == _in.size();
+    }
+
+    uint8_t peek() const noexcept {
+        return _in[_pos];
+    }
+
+    uint64_t integer(unsigned prefix_bits) {
+        if (empty()) {
+            throw hpack_error("truncated header block");
+        }
+        uint64_t max_prefix = (1u << prefix_bits) - 1;
+        uint64_t value = uint8_t(_in[_pos++]) & max_prefix;
+        if (value < max_prefix) {
+            return value;
+        }
+        for (unsigned shift = 0; ; shift += 7) {
+            // Nothing in a header block comes near 2^32
+            if (empty() || shift > 28) {
+                throw hpack_error("invalid integer in header block");
+            }
+            uint8_t b = _in[_pos++];
+            value += uint64_t(b & 0x7f) << shift;
+            if (!(b & 0x80)) {
+                return value;
+            }
+        }
+    }
+
+    sstring string() {
+        bool huffman_coded = !empty() && (peek() & 0x80);
+        auto len = integer(7);
+        if (len > _in.size() - _pos) {
+            throw hpack_error("truncated header block");
+        }
+        auto raw = _in.substr(_pos, len);
+        _pos += len;
+        if (!huffman_coded) {
+            return sstring(raw.data(), raw.size());
+        }
+        sstring ret;
+        huffman.decode(ret, raw);
+        return ret;
+    }
+};
+
+}
+
+const header_field& hpack_decoder::lookup(uint64_t index) const {
+    static thread_local std::vector<header_field> static_fields = [] {
+        std::vector<header_field> ret;
+        for (auto& f : static_table) {
+            ret.emplace_back(f.first, f.second);
+        }
+        return ret;
+    }();
+    if (index == 0) {
+        throw hpack_error("header field index 0");
+    }
+    if (index <= static_table_size) {
+        return static_fields[index - 1];
+    }
+    index -= static_table_size + 1;
+    if (index >= _table.size()) {
+        throw hpack_error("header field index out of the tables");
+    }
+    return _table[index];
+}
+
+void hpack_decoder::evict(size_t max_size) {
+    while (_size > max_size) {
+        auto& f = _table.back();
+        _size -= f.first.size() + f.second.size() + entry_overhead;
+        _table.pop_back();
+    }
+}
+
+void hpack_decoder::insert(header_field field) {
+    auto size = field.first.size() + field.second.size() + entry_overhead;
+    if (size > _max_size) {
+        // Not an error, the field just empties the table
+        evict(0);
+        return;
+    }
+    evict(_max_size - size);
+    _table.push_front(std::move(field));
+    _size += size;
+}
+
+std::vector<header_field> hpack_decoder::decode(std::string_view block) {
+    std::vector<header_field> fields;
+    block_reader in(block);
+    while (!in.empty()) {
+        auto b = in.peek();
+        if (b & 0x80) {
+            // Indexed field
+            fields.push_back(lookup(in.integer(7)));
+        } else if (b & 0x40) {
+            // Literal with incremental indexing
+            auto index = in.integer(6);
+            auto name = index ? lookup(index).first : in.string();
+            auto value = in.string();
+            insert(header_field(name, value));
+            fields.emplace_back(std::move(name), std::move(value));
+        } else if (b & 0x20) {
+            // Dynamic table size update, only allowed ahead of the fields
+            if (!fields.empty()) {
+                throw hpack_error("dynamic table size update after a header field");
+            }
+            auto size = in.integer(5);
+            if (size > _limit) {
+                throw hpack_error("dynamic table size update over the limit");
+            }
+            _max_size = size;
+            evict(_max_size);
+        } else {
+            // Literal without indexing, or never indexed
+            auto index = in.integer(4);
+            auto name = index ? lookup(index).first : in.string();
+            fields.emplace_back(std::move(name), in.string());
+        }
+    }
+    return fields;
+}
+
+void hpack_encoder::encode(std::string& out, std::string_view name, std::string_view value) const {
+    size_t name_index = 0;
+    for (size_t i = 0; i < static_table_size; i++) {
+        if (name == static_table[i].first) {
+            if (value == static_table[i].second) {
+                encode_integer(out, 0x80, 7, i + 1);
+                return;
+            }
+            if (!name_index) {
+                name_index = i + 1;
+            }
+        }
+    }
+    encode_integer(out, 0, 4, name_index);
+    if (!name_index) {
+        encode_string(out, name);
+    }
+    encode_string(out, value);
+}
+
+}
+
+}
+
+}
@@ -0,0 +1,821 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#include <seastar/http/internal/http2.hh>
+#include <seastar/http/httpd.hh>
+#include <seastar/http/reply.hh>
+#include <seastar/core/byteorder.hh>
+#include <seastar/core/loop.hh>
+#include <seastar/core/print.hh>
+#include <seastar/core/queue.hh>
+#include <seastar/util/log.hh>
+#include <seastar/util/short_streams.hh>
+#include <algorithm>
+#include <limits>
+
+namespace seastar {
+
+extern logger hlogger;
+
+namespace httpd {
+
+namespace internal {
+
+namespace {
+
+enum frame_type : uint8_t {
+    data = 0x0,
+    headers = 0x1,
+    priority = 0x2,
+    rst_stream = 0x3,
+    settings = 0x4,
+    push_promise = 0x5,
+    ping = 0x6,
+    goaway = 0x7,
+    window_update = 0x8,
+    continuation = 0x9,
+};
+
+enum frame_flags : uint8_t {
+    flag_end_stream = 0x1,
+    flag_ack = 0x1,
+    flag_end_headers = 0x4,
+    flag_padded = 0x8,
+    flag_priority = 0x20,
+};
+
+enum error_code : uint32_t {
+    no_error = 0x0,
+    protocol_error = 0x1,
+    internal_error = 0x2,
+    flow_control_error = 0x3,
+    stream_closed = 0x5,
+    frame_size_error = 0x6,
+    refused_stream = 0x7,
+    compression_error = 0x9,
+    enhance_your_calm = 0xb,
+};
+
+enum setting : uint16_t {
+    settings_enable_push = 0x2,
+    settings_max_concurrent_streams = 0x3,
+    settings_initial_window_size = 0x4,
+    settings_max_frame_size = 0x5,
+};
+
+constexpr size_t frame_header_size = 9;
+constexpr int64_t default_window = 65535;
+constexpr int64_t max_window = 0x7fffffff;
+// We never raise SETTINGS_MAX_FRAME_SIZE, so that is the most a frame may carry
+constexpr size_t max_frame_size = 16384;
+constexpr uint32_t max_concurrent_streams = 100;
+constexpr size_t max_header_block_size = 256 * 1024;
+
+// Ends the connection with a GOAWAY
+class connection_error : public std::runtime_error {
+    uint32_t _code;
+public:
+    connection_error(uint32_t code, const char* what) : std::runtime_error(what), _code(code) {}
+    uint32_t code() const noexcept {
+        return _code;
+    }
+};
+
+class stream_reset : public std::runtime_error {
+public:
+    stream_reset() : std::runtime_error("HTTP/2 stream reset") {}
+};
+
+// Strips the padding of a DATA or HEADERS frame
+temporary_buffer<char> unpad(uint8_t flags, temporary_buffer<char> payload) {
+    if (!(flags & flag_padded)) {
+        return payload;
+    }
+    if (payload.empty() || size_t(uint8_t(payload[0])) >= payload.size()) {
+        throw connection_error(protocol_error, "padding longer than the frame");
+    }
+    size_t padding = uint8_t(payload[0]);
+    payload.trim_front(1);
+    payload.trim(payload.size() - padding);
+    return payload;
+}
+
+// unpad() for a payload read as the fragments it came in
+void unpad(uint8_t flags, std::vector<temporary_buffer<char>>& payload, size_t size) {
+    if (!(flags & flag_padded)) {
+        return;
+    }
+    if (!size || size_t(uint8_t(payload.front()[0])) >= size) {
+        throw connection_error(protocol_error, "padding longer than the frame");
+    }
+    size_t padding = uint8_t(payload.front()[0]);
+    payload.front().trim_front(1);
+    while (padding) {
+        auto& last = payload.back();
+        auto n = std::min(padding, last.size());
+        last.trim(last.size() - n);
+        padding -= n;
+        if (last.empty()) {
+            payload.pop_back();
+        }
+    }
+    std::erase_if(payload, [] (const temporary_buffer<char>& b) { return b.empty(); });
+}
+
+bool is_connection_specific(std::string_view name) {
+    return name == "connection" || name == "keep-alive" || name == "proxy-connection"
+            || name == "transfer-encoding" || name == "upgrade";
+}
+
+// Fills the request from its header block, or returns false if the block
+// does not make a well formed request
+bool parse_request(request& req, std::vector<http::internal::header_field>& fields) {
+    sstring scheme;
+    sstring authority;
+    bool regular_seen = false;
+    for (auto& [name, value] : fields) {
+        if (std::any_of(name.begin(), name.end(), [] (char c) { return c >= 'A' && c <= 'Z'; })) {
+            return false;
+        }
+        if (!name.empty() && name[0] == ':') {
+            // Pseudo-header fields come first, each of them once
+            sstring* field = name == ":method" ? &req._method
+                    : name == ":path" ? &req._url
+                    : name == ":scheme" ? &scheme
+                    : name == ":authority" ? &authority
+                    : nullptr;
+            if (regular_seen || !field || !field->empty()) {
+                return false;
+            }
+            *field = std::move(value);
+            continue;
+        }
+        regular_seen = true;
+        if (is_connection_specific(name) || (name == "te" && value != "trailers")) {
+            return false;
+        }
+        auto [it, inserted] = req._headers.emplace(name, value);
+        if (!inserted) {
+            it->second += sstring(name == "cookie" ? "; " : ",") + value;
+        }
+    }
+    if (req._method.empty() || req._url.empty() || scheme.empty()) {
+        return false;
+    }
+    if (!authority.empty() && !req._headers.count("Host")) {
+        req._headers["Host"] = std::move(authority);
+    }
+    return true;
+}
+
+}
+
+struct http2_connection::stream {
+    uint32_t id;
+    // What we may still send before the peer's WINDOW_UPDATE
+    int64_t send_window;
+    // What the peer may still send before ours
+    int64_t recv_window = default_window;
+    // Bytes the handler read that we did not give back to the peer yet
+    size_t unannounced = 0;
+    // The request body, an empty buffer marks its end
+    queue<temporary_buffer<char>> body { std::numeric_limits<size_t>::max() };
+    bool end_stream_received = false;
+    bool reset = false;
+
+    stream(uint32_t id, int64_t send_window) : id(id), send_window(send_window) {}
+};
+
+class http2_connection::body_source : public data_source_impl {
+    http2_connection& _conn;
+    lw_shared_ptr<stream> _s;
+public:
+    body_source(http2_connection& conn, lw_shared_ptr<stream> s) : _conn(conn), _s(std::move(s)) {}
+
+    virtual future<temporary_buffer<char>> get() override {
+        return _s->body.pop_eventually().then([this] (temporary_buffer<char> buf) {
+            auto size = buf.size();
+            if (!size) {
+                return make_ready_future<temporary_buffer<char>>();
+            }
+            return _conn.consumed(*_s, size).then([buf = std::move(buf)] () mutable {
+                return std::move(buf);
+            });
+        });
+    }
+};
+
+class http2_connection::body_sink : public data_sink_impl {
+    http2_connection& _conn;
+    lw_shared_ptr<stream> _s;
+public:
+    body_sink(http2_connection& conn, lw_shared_ptr<stream> s) : _conn(conn), _s(std::move(s)) {}
+
+    virtual future<> put(net::packet data) override { abort(); }
+    using data_sink_impl::put;
+    virtual future<> put(temporary_buffer<char> buf) override {
+        if (buf.empty()) {
+            return make_ready_future<>();
+        }
+        return _conn.send_data(_s, std::move(buf), false);
+    }
+    virtual future<> close() override {
+        return _conn.send_data(_s, temporary_buffer<char>(), true);
+    }
+};
+
+http2_connection::http2_connection(http_server& server, input_stream<char>& in, output_stream<char>& out, bool tls)
+        : _server(server)
+        , _in(in)
+        , _out(out)
+        , _tls(tls)
+        , _send_window(default_window)
+        , _peer_initial_window(default_window)
+        , _peer_max_frame_size(max_frame_size) {
+}
+
+http2_connection::~http2_connection() = default;
+
+future<> http2_connection::process() {
+    // Ours are the defaults, but for a bound on the concurrent streams
+    temporary_buffer<char> our_settings(6);
+    write_be<uint16_t>(our_settings.get_write(), settings_max_concurrent_streams);
+    write_be<uint32_t>(our_settings.get_write() + 2, max_concurrent_streams);
+    return send_frame(settings, 0, 0, std::move(our_settings)).then([this] {
+        return do_until([this] { return _eof; }, [this] {
+            return read_frame();
+        });
+    }).handle_exception([this] (std::exception_ptr ex) {
+        ++_server._read_errors;
+        try {
+            std::rethrow_exception(ex);
+        } catch (const connection_error& e) {
+            hlogger.debug("HTTP/2 connection error: {}", e.what());
+            temporary_buffer<char> payload(8);
+            write_be<uint32_t>(payload.get_write(), _last_stream_id);
+            write_be<uint32_t>(payload.get_write() + 4, e.code());
+            return send_frame(goaway, 0, 0, std::move(payload)).handle_exception([] (std::exception_ptr) {});
+        } catch (...) {
+            hlogger.debug("HTTP/2 read exception encountered: {}", std::current_exception());
+        }
+        return make_ready_future<>();
+    }).then([this] {
+        // No more frames come: bodies end where they are, and replies cannot
+        // wait for their windows to grow
+        for (auto& [id, s] : _streams) {
+            if (!s->end_stream_received) {
+                s->body.abort(std::make_exception_ptr(stream_reset()));
+            }
+        }
+        _window_cv.broken();
+        return _streams_gate.close();
+    });
+}
+
+future<> http2_connection::read_frame() {
+    return _in.read_exactly(frame_header_size).then([this] (temporary_buffer<char> header) {
+        if (header.size() < frame_header_size) {
+            _eof = true;
+            return make_ready_future<>();
+        }
+        auto p = reinterpret_cast<const uint8_t*>(header.get());
+        size_t length = (size_t(p[0]) << 16) | (size_t(p[1]) << 8) | p[2];
+        uint8_t type = p[3];
+        uint8_t flags = p[4];
+        uint32_t stream_id = read_be<uint32_t>(header.get() + 5) & 0x7fffffff;
+        if (length > max_frame_size) {
+            throw connection_error(frame_size_error, "frame larger than SETTINGS_MAX_FRAME_SIZE");
+        }
+        if (type == data && _settings_received && !_continued_stream) {
+            // Bodies go to the handlers as they were received, rather than
+            // copied into a buffer per frame
+            return _in.read_exactly_fragmented(length).then([this, length, flags, stream_id] (std::vector<temporary_buffer<char>> payload) {
+                size_t size = 0;
+                for (auto& b : payload) {
+                    size += b.size();
+                }
+                if (size < length) {
+                    _eof = true;
+                    return make_ready_future<>();
+                }
+                return handle_data(flags, stream_id, std::move(payload), length);
+            });
+        }
+        return _in.read_exactly(length).then([this, length, type, flags, stream_id] (temporary_buffer<char> payload) {
+            if (payload.size() < length) {
+                _eof = true;
+                return make_ready_future<>();
+            }
+            return handle_frame(type, flags, stream_id, std::move(payload));
+        });
+    });
+}
+
+future<> http2_connection::handle_frame(uint8_t type, uint8_t flags, uint32_t stream_id, temporary_buffer<char> payload) {
+    if (!_settings_received && type != settings) {
+        throw connection_error(protocol_error, "client preface without SETTINGS");
+    }
+    if (_continued_stream && type != continuation) {
+        throw connection_error(protocol_error, "header block interrupted by another frame");
+    }
+    switch (type) {
+    case data: {
+        auto size = payload.size();
+        std::vector<temporary_buffer<char>> frags;
+        frags.push_back(std::move(payload));
+        return handle_data(flags, stream_id, std::move(frags), size);
+    }
+    case headers:
+        return handle_headers(flags, stream_id, std::move(payload));
+    case priority:
+        // Replies go out as their windows allow, priorities are not followed
+        if (!stream_id) {
+            throw connection_error(protocol_error, "PRIORITY on stream 0");
+        }
+        if (payload.size() != 5) {
+            throw connection_error(frame_size_error, "PRIORITY of a wrong size");
+        }
+        return make_ready_future<>();
+    case rst_stream:
+        handle_rst_stream(stream_id, std::move(payload));
+        return make_ready_future<>();
+    case settings:
+        return handle_settings(flags, stream_id, std::move(payload));
+    case push_promise:
+        throw connection_error(protocol_error, "PUSH_PROMISE from a client");
+    case ping:
+        if (stream_id) {
+            throw connection_error(protocol_error, "PING on a stream");
+        }
+        if (payload.size() != 8) {
+            throw connection_error(frame_size_error, "PING of a wrong size");
+        }
+        if (flags & flag_ack) {
+            return make_ready_future<>();
+        }
+        return send_frame(ping, flag_ack, 0, std::move(payload));
+    case goaway:
+        // The peer opens no more streams and closes the connection once the
+        // ones it has are done, which is when we stop too
+        if (stream_id) {
+            throw connection_error(protocol_error, "GOAWAY on a stream");
+        }
+        return make_ready_future<>();
+    case window_update:
+        return handle_window_update(stream_id, std::move(payload));
+    case continuation:
+        return handle_continuation(flags, stream_id, std::move(payload));
+    default:
+        // Frames of unknown types are ignored
+        return make_ready_future<>();
+    }
+}
+
+future<> http2_connection::handle_data(uint8_t flags, uint32_t stream_id, std::vector<temporary_buffer<char>> payload, size_t size) {
+    if (!stream_id) {
+        throw connection_error(protocol_error, "DATA on stream 0");
+    }
+    unpad(flags, payload, size);
+    size_t data_size = 0;
+    for (auto& b : payload) {
+        data_size += b.size();
+    }
+    // The connection window is given back right away, it is the windows of
+    // the streams that bound what the handlers did not read yet
+    auto f = size ? send_window_update(0, size) : make_ready_future<>();
+    auto it = _streams.find(stream_id);
+    if (it == _streams.end()) {
+        if (stream_id > _last_stream_id) {
+            throw connection_error(protocol_error, "DATA on an idle stream");
+        }
+        // A stream that is done with, or that was refused
+        return f;
+    }
+    auto s = it->second;
+    if (s->reset) {
+        return f;
+    }
+    if (s->end_stream_received) {
+        reset(*s, std::make_exception_ptr(stream_reset()));
+        return f.then([this, stream_id] {
+            return send_rst_stream(stream_id, stream_closed);
+        });
+    }
+    s->recv_window -= size;
+    if (s->recv_window < 0) {
+        reset(*s, std::make_exception_ptr(stream_reset()));
+        return f.then([this, stream_id] {
+            return send_rst_stream(stream_id, flow_control_error);
+        });
+    }
+    // The handler never reads the padding
+    s->unannounced += size - data_size;
+    for (auto& b : payload) {
+        s->body.push(std::move(b));
+    }
+    if (flags & flag_end_stream) {
+        s->end_stream_received = true;
+        s->body.push(temporary_buffer<char>());
+    }
+    return f;
+}
+
+future<> http2_connection::handle_headers(uint8_t flags, uint32_t stream_id, temporary_buffer<char> payload) {
+    if (!stream_id) {
+        throw connection_error(protocol_error, "HEADERS on stream 0");
+    }
+    payload = unpad(flags, std::move(payload));
+    if (flags & flag_priority) {
+        if (payload.size() < 5) {
+            throw connection_error(frame_size_error, "HEADERS too short for its priority");
+        }
+        payload.trim_front(5);
+    }
+    _header_block.assign(payload.get(), payload.size());
+    _continued_end_stream = flags & flag_end_stream;
+    if (!(flags & flag_end_headers)) {
+        _continued_stream = stream_id;
+        return make_ready_future<>();
+    }
+    return handle_header_block(stream_id, _continued_end_stream);
+}
+
+future<> http2_connection::handle_continuation(uint8_t flags, uint32_t stream_id, temporary_buffer<char> payload) {
+    if (!_continued_stream || stream_id != _continued_stream) {
+        throw connection_error(protocol_error, "CONTINUATION of no header block");
+    }
+    _header_block.append(payload.get(), payload.size());
+    if (_header_block.size() > max_header_block_size) {
+        throw connection_error(enhance_your_calm, "header block too long");
+    }
+    if (!(flags & flag_end_headers)) {
+        return make_ready_future<>();
+    }
+    _continued_stream = 0;
+    return handle_header_block(stream_id, _continued_end_stream);
+}
+
+future<> http2_connection::handle_header_block(uint32_t stream_id, bool end_stream) {
+    std::vector<http::internal::header_field> fields;
+    try {
+        fields = _decoder.decode(_header_block);
+    } catch (const http::internal::hpack_error& e) {
+        throw connection_error(compression_error, e.what());
+    }
+    _header_block.clear();
+
+    auto it = _streams.find(stream_id);
+    if (it != _streams.end()) {
+        // Trailers, which end the body. Their fields are dropped, as the
+        // handler already has the request.
+        auto s = it->second;
+        if (s->reset) {
+            return make_ready_future<>();
+        }
+        if (!end_stream || s->end_stream_received) {
+            reset(*s, std::make_exception_ptr(stream_reset()));
+            return send_rst_stream(stream_id, s->end_stream_received ? stream_closed : protocol_error);
+        }
+        s->end_stream_received = true;
+        s->body.push(temporary_buffer<char>());
+        return make_ready_future<>();
+    }
+    if (stream_id <= _last_stream_id) {
+        throw connection_error(stream_closed, "HEADERS on a closed stream");
+    }
+    if (!(stream_id & 1)) {
+        throw connection_error(protocol_error, "stream opened with an even identifier");
+    }
+    _last_stream_id = stream_id;
+    if (_streams.size() >= max_concurrent_streams) {
+        return send_rst_stream(stream_id, refused_stream);
+    }
+
+    auto req = std::make_unique<request>();
+    if (!parse_request(*req, fields)) {
+        return send_rst_stream(stream_id, protocol_error);
+    }
+    req->_version = "2.0";
+    req->http_version_major = 2;
+    req->http_version_minor = 0;
+    if (_tls) {
+        req->protocol_name = "https";
+    }
+    req->content_length = strtol(req->get_header("Content-Length").c_str(), nullptr, 10);
+
+    auto s = make_lw_shared<stream>(stream_id, _peer_initial_window);
+    _streams.emplace(stream_id, s);
+    if (end_stream) {
+        s->end_stream_received = true;
+        s->body.push(temporary_buffer<char>());
+    }
+    (void)with_gate(_streams_gate, [this, s, req = std::move(req)] () mutable {
+        return serve(std::move(s), std::move(req));
+    });
+    return make_ready_future<>();
+}
+
+future<> http2_connection::handle_settings(uint8_t flags, uint32_t stream_id, temporary_buffer<char> payload) {
+    if (stream_id) {
+        throw connection_error(protocol_error, "SETTINGS on a stream");
+    }
+    if (flags & flag_ack) {
+        if (!payload.empty()) {
+            throw connection_error(frame_size_error, "SETTINGS acknowledgement with a payload");
+        }
+        return make_ready_future<>();
+    }
+    if (payload.size() % 6) {
+        throw connection_error(frame_size_error, "SETTINGS of a wrong size");
+    }
+    for (size_t pos = 0; pos < payload.size(); pos += 6) {
+        auto id = read_be<uint16_t>(payload.get() + pos);
+        int64_t value = read_be<uint32_t>(payload.get() + pos + 2);
+        switch (id) {
+        case settings_enable_push:
+            if (value > 1) {
+                throw connection_error(protocol_error, "invalid SETTINGS_ENABLE_PUSH");
+            }
+            break;
+        case settings_initial_window_size:
+            if (value > max_window) {
+                throw connection_error(flow_control_error, "invalid SETTINGS_INITIAL_WINDOW_SIZE");
+            }
+            // The change applies to the windows of the open streams too
+            for (auto& [id, s] : _streams) {
+                s->send_window += value - _peer_initial_window;
+                if (s->send_window > max_window) {
+                    throw connection_error(flow_control_error, "SETTINGS_INITIAL_WINDOW_SIZE overflows a stream window");
+                }
+            }
+            _peer_initial_window = value;
+            break;
+        case settings_max_frame_size:
+            if (value < int64_t(max_frame_size) || value > 0xffffff) {
+                throw connection_error(protocol_error, "invalid SETTINGS_MAX_FRAME_SIZE");
+            }
+            _peer_max_frame_size = value;
+            break;
+        default:
+            // The encoder keeps no dynamic table, so SETTINGS_HEADER_TABLE_SIZE
+            // needs nothing, and we never push
+            break;
+        }
+    }
+    _settings_received = true;
+    _window_cv.broadcast();
+    return send_frame(settings, flag_ack, 0);
+}
+
+future<> http2_connection::handle_window_update(uint32_t stream_id, temporary_buffer<char> payload) {
+    if (payload.size() != 4) {
+        throw connection_error(frame_size_error, "WINDOW_UPDATE of a wrong size");
+    }
+    int64_t increment = read_be<uint32_t>(payload.get()) & 0x7fffffff;
+    if (!stream_id) {
+        if (!increment) {
+            throw connection_error(protocol_error, "WINDOW_UPDATE of 0");
+        }
+        _send_window += increment;
+        if (_send_window > max_window) {
+            throw connection_error(flow_control_error, "connection window overflow");
+        }
+    } else {
+        auto it = _streams.find(stream_id);
+        if (it == _streams.end() || it->second->reset) {
+            return make_ready_future<>();
+        }
+        auto& s = *it->second;
+        if (!increment || s.send_window + increment > max_window) {
+            reset(s, std::make_exception_ptr(stream_reset()));
+            return send_rst_stream(stream_id, increment ? flow_control_error : protocol_error);
+        }
+        s.send_window += increment;
+    }
+    _window_cv.broadcast();
+    return make_ready_future<>();
+}
+
+void http2_connection::handle_rst_stream(uint32_t stream_id, temporary_buffer<char> payload) {
+    if (!stream_id) {
+        throw connection_error(protocol_error, "RST_STREAM on stream 0");
+    }
+    if (payload.size() != 4) {
+        throw connection_error(frame_size_error, "RST_STREAM of a wrong size");
+    }
+    auto it = _streams.find(stream_id);
+    if (it != _streams.end()) {
+        reset(*it->second, std::make_exception_ptr(stream_reset()));
+    } else if (stream_id > _last_stream_id) {
+        throw connection_error(protocol_error, "RST_STREAM on an idle stream");
+    }
+}
+
+future<> http2_connection::serve(lw_shared_ptr<stream> s, std::unique_ptr<request> req) {
+    ++_server._requests_served;
+    return do_with(input_stream<char>(data_source(std::make_unique<body_source>(*this, s))), std::move(req),
+            [this, s] (input_stream<char>& content, std::unique_ptr<request>& req) {
+        req->content_stream = &content;
+        size_t content_length_limit = _server.get_content_length_limit();
+        if (req->content_length > content_length_limit) {
+            auto resp = std::make_unique<reply>();
+            resp->set_status(reply::status_type::payload_too_large,
+                    format("Content length limit ({}) exceeded: {}", content_length_limit, req->content_length));
+            return send_reply(s, std::move(resp));
+        }
+        auto f = make_ready_future<>();
+        if (!_server.streams_content(*req)) {
+            f = util::read_entire_stream_contiguous(content).then([&req] (sstring body) {
+                req->content = std::move(body);
+            });
+        }
+        return f.then([this, &req] {
+            sstring url = connection::set_query_param(*req);
+            sstring accept_encoding = _server._compression ? req->get_header("Accept-Encoding") : sstring();
+            return _server._routes.handle(url, std::move(req), std::make_unique<reply>()).then([this, accept_encoding = std::move(accept_encoding)] (std::unique_ptr<reply> rep) {
+                return _server.compress(accept_encoding, std::move(rep));
+            });
+        }).then([this, s] (std::unique_ptr<reply> rep) {
+            return send_reply(s, std::move(rep));
+        }).finally([&content] {
+            return content.close();
+        });
+    }).then_wrapped([this, s] (future<> f) {
+        _streams.erase(s->id);
+        if (f.failed()) {
+            auto ex = f.get_exception();
+            if (s->reset) {
+                return make_ready_future<>();
+            }
+            ++_server._respond_errors;
+            hlogger.debug("HTTP/2 response exception encountered: {}", ex);
+            reset(*s, ex);
+            return send_rst_stream(s->id, internal_error).handle_exception([] (std::exception_ptr) {});
+        }
+        if (!s->end_stream_received && !s->reset) {
+            // The reply is complete, the rest of the request body is not wanted
+            reset(*s, std::make_exception_ptr(stream_reset()));
+            return send_rst_stream(s->id, no_error).handle_exception([] (std::exception_ptr) {});
+        }
+        return make_ready_future<>();
+    });
+}
+
+future<> http2_connection::send_reply(lw_shared_ptr<stream> s, std::unique_ptr<reply> rep) {
+    rep->set_version("2.0");
+    rep->_headers["Server"] = "Seastar httpd";
+    rep->_headers["Date"] = _server._date;
+    if (!rep->_body_writer) {
+        rep->_headers["Content-Length"] = to_sstring(rep->_content.size());
+    }
+    std::string block;
+    _encoder.encode(block, ":status", to_sstring(int(rep->_status)));
+    for (auto& [name, value] : rep->_headers) {
+        // Field names are lower case in HTTP/2
+        std::string lower(name.begin(), name.end());
+        std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+        if (!is_connection_specific(lower)) {
+            _encoder.encode(block, lower, value);
+        }
+    }
+    bool end_stream = !rep->_body_writer && rep->_content.empty();
+    return with_semaphore(_write_sem, 1, [this, s, end_stream, block = std::move(block)] () mutable {
+        if (s->reset) {
+            return make_exception_future<>(stream_reset());
+        }
+        // The frames of a header block go out back to back
+        return do_with(std::move(block), size_t(0), [this, s, end_stream] (std::string& block, size_t& pos) {
+            return repeat([this, s, end_stream, &block, &pos] {
+                auto n = std::min(block.size() - pos, _peer_max_frame_size);
+                uint8_t flags = (pos + n == block.size() ? flag_end_headers : 0) | (!pos && end_stream ? flag_end_stream : 0);
+                auto type = pos ? continuation : headers;
+                temporary_buffer<char> payload(block.data() + pos, n);
+                pos += n;
+                return write_frame(type, flags, s->id, std::move(payload)).then([&block, &pos] {
+                    return stop_iteration(pos == block.size());
+                });
+            });
+        }).then([this] {
+            return _out.flush();
+        });
+    }).then([this, s, rep = std::move(rep)] () mutable {
+        if (rep->_body_writer) {
+            output_stream_options opts;
+            opts.trim_to_size = true;
+            return rep->_body_writer(output_stream<char>(data_sink(std::make_unique<body_sink>(*this, s)), max_frame_size, opts)).finally([rep = std::move(rep)] {});
+        }
+        if (rep->_content.empty()) {
+            return make_ready_future<>();
+        }
+        auto& content = rep->_content;
+        return send_data(s, temporary_buffer<char>(content.data(), content.size(), make_object_deleter(std::move(rep))), true);
+    });
+}
+
+future<> http2_connection::send_data(lw_shared_ptr<stream> s, temporary_buffer<char> buf, bool end_stream) {
+    return do_with(std::move(buf), [this, s, end_stream] (temporary_buffer<char>& buf) {
+        return repeat([this, s, end_stream, &buf] {
+            if (s->reset) {
+                return make_exception_future<stop_iteration>(stream_reset());
+            }
+            auto window = std::min(_send_window, s->send_window);
+            if (!buf.empty() && window <= 0) {
+                return _window_cv.wait().then([] {
+                    return stop_iteration::no;
+                });
+            }
+            auto n = std::min({buf.size(), size_t(std::max(window, int64_t(0))), _peer_max_frame_size});
+            auto chunk = buf.share(0, n);
+            buf.trim_front(n);
+            _send_window -= n;
+            s->send_window -= n;
+            uint8_t flags = buf.empty() && end_stream ? flag_end_stream : 0;
+            return with_semaphore(_write_sem, 1, [this, s, flags, chunk = std::move(chunk)] () mutable {
+                return write_frame(data, flags, s->id, std::move(chunk)).then([this] {
+                    return _out.flush();
+                });
+            }).then([&buf] {
+                return stop_iteration(buf.empty());
+            });
+        });
+    });
+}
+
+future<> http2_connection::consumed(stream& s, size_t size) {
+    s.unannounced += size;
+    // Once the whole body came there is no point in more window, and the
+    // rest is given back in batches of half of it
+    if (s.end_stream_received || s.reset || int64_t(s.unannounced) < default_window / 2) {
+        return make_ready_future<>();
+    }
+    auto increment = std::exchange(s.unannounced, 0);
+    s.recv_window += increment;
+    return send_window_update(s.id, increment);
+}
+
+void http2_connection::reset(stream& s, std::exception_ptr ex) {
+    s.reset = true;
+    s.body.abort(std::move(ex));
+    _window_cv.broadcast();
+}
+
+future<> http2_connection::write_frame(uint8_t type, uint8_t flags, uint32_t stream_id, temporary_buffer<char> payload) {
+    temporary_buffer<char> header(frame_header_size);
+    auto p = header.get_write();
+    p[0] = char(payload.size() >> 16);
+    p[1] = char(payload.size() >> 8);
+    p[2] = char(payload.size());
+    p[3] = char(type);
+    p[4] = char(flags);
+    write_be<uint32_t>(p + 5, stream_id);
+    return _out.write(std::move(header)).then([this, payload = std::move(payload)] () mutable {
+        if (payload.empty()) {
+            return make_ready_future<>();
+        }
+        return _out.write(std::move(payload));
+    });
+}
+
+future<> http2_connection::send_frame(uint8_t type, uint8_t flags, uint32_t stream_id, temporary_buffer<char> payload) {
+    return with_semaphore(_write_sem, 1, [this, type, flags, stream_id, payload = std::move(payload)] () mutable {
+        return write_frame(type, flags, stream_id, std::move(payload)).then([this] {
+            return _out.flush();
+        });
+    });
+}
+
+future<> http2_connection::send_rst_stream(uint32_t stream_id, uint32_t error_code) {
+    temporary_buffer<char> payload(4);
+    write_be<uint32_t>(payload.get_write(), error_code);
+    return send_frame(rst_stream, 0, stream_id, std::move(payload));
+}
+
+future<> http2_connection::send_window_update(uint32_t stream_id, uint32_t increment) {
+    temporary_buffer<char> payload(4);
+    write_be<uint32_t>(payload.get_write(), increment);
+    return send_frame(window_update, 0, stream_id, std::move(payload));
+}
+
+}
+
+}
+
+}
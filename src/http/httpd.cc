@@ -37,6 +37,7 @@
 #include <vector>
 #include <seastar/http/httpd.hh>
 #include <seastar/http/internal/content_source.hh>
+#include <seastar/http/internal/http2.hh>
 #include <seastar/http/reply.hh>
 #include <seastar/util/short_streams.hh>
 #include <seastar/util/log.hh>
@@ -164,11 +165,22 @@ bool connection::url_decode(const std::string_view& in, sstring& out) {
     return true;
 }
 
+connection::connection(http_server& server, connected_socket&& fd)
+        : _server(server), _fd(std::move(fd))
+        , _read_buf(server._connection_memory ? server._connection_memory->input(_fd) : _fd.input())
+        , _write_buf(server._connection_memory ? server._connection_memory->output(_fd) : _fd.output()) {
+    on_new_connection();
+}
+
 void connection::on_new_connection() {
     ++_server._total_connections;
     ++_server._current_connections;
     _fd.set_nodelay(true);
     _server._connections.push_back(*this);
+    _pipeline_sem.signal(_server._max_pipelined_requests);
+    if (_server._content_memory_limit != std::numeric_limits<size_t>::max()) {
+        _content_memory = make_lw_shared<semaphore>(_server._content_memory_limit);
+    }
 }
 
 future<> connection::read() {
@@ -180,19 +192,28 @@ future<> connection::read() {
             _server._read_errors++;
         }
         f.ignore_ready_future();
-        return _replies.push_eventually( {});
+        // The replies of pipelined requests go first
+        return std::exchange(_pipeline, make_ready_future<>()).then([this] {
+            return _replies.push_eventually( {});
+        });
     }).finally([this] {
         return _read_buf.close();
     });
 }
 
-static input_stream<char> make_content_stream(httpd::request* req, input_stream<char>& buf) {
+static input_stream<char> make_content_stream(httpd::request* req, input_stream<char>& buf,
+        lw_shared_ptr<semaphore> memory, size_t memory_limit) {
     // Create an input stream based on the requests body encoding or lack thereof
+    data_source src;
     if (request::case_insensitive_cmp()(req->get_header("Transfer-Encoding"), "chunked")) {
-        return input_stream<char>(data_source(std::make_unique<internal::chunked_source_impl>(buf, req->chunk_extensions, req->trailing_headers)));
+        src = data_source(std::make_unique<internal::chunked_source_impl>(buf, req->chunk_extensions, req->trailing_headers));
     } else {
-        return input_stream<char>(data_source(std::make_unique<internal::content_length_source_impl>(buf, req->content_length)));
+        src = data_source(std::make_unique<internal::content_length_source_impl>(buf, req->content_length));
+    }
+    if (memory) {
+        src = data_source(std::make_unique<internal::budgeted_source_impl>(std::move(src), std::move(memory), memory_limit));
     }
+    return input_stream<char>(std::move(src));
 }
 
 static future<std::unique_ptr<httpd::request>>
@@ -217,18 +238,30 @@ void connection::generate_error_reply_and_close(std::unique_ptr<httpd::request>
     resp->set_status(status, msg);
     resp->done();
     _done = true;
+    if (pipelined()) {
+        push_reply_in_order(make_ready_future<std::unique_ptr<reply>>(std::move(resp)));
+        return;
+    }
     _replies.push(std::move(resp));
 }
 
 future<> connection::read_one() {
+    _parser.set_header_views(_server._header_views);
     _parser.init();
     return _read_buf.consume(_parser).then([this] () mutable {
         if (_parser.eof()) {
             _done = true;
             return make_ready_future<>();
         }
-        ++_server._requests_served;
         std::unique_ptr<httpd::request> req = _parser.get_parsed_request();
+        // The HTTP/2 connection preface parses as a request, see RFC 7540, Section 3.5
+        if (_server._http2 && !_http1 && !_parser.failed()
+                && req->_method == "PRI" && req->_url == "*" && req->_version == "2.0") {
+            _done = true;
+            return serve_http2();
+        }
+        _http1 = true;
+        ++_server._requests_served;
         if (_server._credentials) {
             req->protocol_name = "https";
         }
@@ -260,11 +293,15 @@ future<> connection::read_one() {
 
         auto maybe_reply_continue = [this, req = std::move(req)] () mutable {
             if (req->_version == "1.1" && request::case_insensitive_cmp()(req->get_header("Expect"), "100-continue")){
-                return _replies.not_full().then([req = std::move(req), this] () mutable {
-                    auto continue_reply = std::make_unique<reply>();
-                    set_headers(*continue_reply);
-                    continue_reply->set_version(req->_version);
-                    continue_reply->set_status(reply::status_type::continue_).done();
+                auto continue_reply = std::make_unique<reply>();
+                set_headers(*continue_reply);
+                continue_reply->set_version(req->_version);
+                continue_reply->set_status(reply::status_type::continue_).done();
+                if (pipelined()) {
+                    push_reply_in_order(make_ready_future<std::unique_ptr<reply>>(std::move(continue_reply)));
+                    return make_ready_future<std::unique_ptr<httpd::request>>(std::move(req));
+                }
+                return _replies.not_full().then([req = std::move(req), continue_reply = std::move(continue_reply), this] () mutable {
                     this->_replies.push(std::move(continue_reply));
                     return make_ready_future<std::unique_ptr<httpd::request>>(std::move(req));
                 });
@@ -274,9 +311,23 @@ future<> connection::read_one() {
         };
 
         return maybe_reply_continue().then([this] (std::unique_ptr<httpd::request> req) {
-            return do_with(make_content_stream(req.get(), _read_buf), sstring(req->_version), std::move(req), [this] (input_stream<char>& content_stream, sstring& version, std::unique_ptr<httpd::request>& req) {
-                return set_request_content(std::move(req), &content_stream, _server.get_content_streaming()).then([this, &content_stream] (std::unique_ptr<httpd::request> req) {
-                    return _replies.not_full().then([this, req = std::move(req)] () mutable {
+            bool streaming = _server.streams_content(*req);
+            // Only what the handler holds of a streamed body is bounded, a
+            // buffered one is bounded by the content length limit
+            auto content = make_content_stream(req.get(), _read_buf, streaming ? _content_memory : nullptr, _server._content_memory_limit);
+            return do_with(std::move(content), sstring(req->_version), std::move(req), [this, streaming] (input_stream<char>& content_stream, sstring& version, std::unique_ptr<httpd::request>& req) {
+                return set_request_content(std::move(req), &content_stream, streaming).then([this, &content_stream, streaming] (std::unique_ptr<httpd::request> req) {
+                    if (pipelined() && !streaming) {
+                        // The content has been read to its end, so the next
+                        // request can be parsed while this one is handled
+                        auto content = std::make_unique<input_stream<char>>(std::move(content_stream));
+                        req->content_stream = content.get();
+                        return generate_reply_pipelined(std::move(req), std::move(content));
+                    }
+                    // The replies of pipelined requests before it go first
+                    return std::exchange(_pipeline, make_ready_future<>()).then([this] {
+                        return _replies.not_full();
+                    }).then([this, req = std::move(req)] () mutable {
                         return generate_reply(std::move(req));
                     }).then([this, &content_stream](bool done) {
                         _done = done;
@@ -303,6 +354,18 @@ future<> connection::read_one() {
     });
 }
 
+future<> connection::serve_http2() {
+    return _read_buf.read_exactly(6).then([this] (temporary_buffer<char> rest) {
+        if (std::string_view(rest.get(), rest.size()) != "SM\r\n\r\n") {
+            _server._read_errors++;
+            return make_ready_future<>();
+        }
+        auto h2 = std::make_unique<internal::http2_connection>(_server, _read_buf, _write_buf, bool(_server._credentials));
+        auto f = h2->process();
+        return f.finally([h2 = std::move(h2)] {});
+    });
+}
+
 future<> connection::process() {
     // Launch read and write "threads" simultaneously:
     return when_all(read(), respond()).then(
@@ -420,25 +483,80 @@ void connection::set_headers(reply& resp) {
 }
 
 future<bool> connection::generate_reply(std::unique_ptr<request> req) {
+    bool keep_alive = req->should_keep_alive();
+    return handle_request(std::move(req)).then([this, keep_alive] (std::unique_ptr<reply> rep) {
+        // Caller guarantees enough room
+        this->_replies.push(std::move(rep));
+        return make_ready_future<bool>(!keep_alive);
+    });
+}
+
+bool connection::pipelined() const {
+    return _server._max_pipelined_requests > 1;
+}
+
+future<> connection::generate_reply_pipelined(std::unique_ptr<request> req, std::unique_ptr<input_stream<char>> content) {
+    _done = !req->should_keep_alive();
+    return get_units(_pipeline_sem, 1).then([this, req = std::move(req), content = std::move(content)] (semaphore_units<> units) mutable {
+        push_reply_in_order(handle_request(std::move(req)).finally([content = std::move(content)] {}), std::move(units));
+    });
+}
+
+void connection::push_reply_in_order(future<std::unique_ptr<reply>> rep, semaphore_units<> units) {
+    // The units go with the reply being queued, so replies waiting for
+    // an earlier one count against the limit too
+    _pipeline = _pipeline.then_wrapped([this, rep = std::move(rep), units = std::move(units)] (future<> prev) mutable {
+        prev.ignore_ready_future();
+        return std::move(rep).then_wrapped([this, units = std::move(units)] (future<std::unique_ptr<reply>> f) mutable {
+            if (_pipeline_broken) {
+                f.ignore_ready_future();
+                return make_ready_future<>();
+            }
+            if (f.failed()) {
+                // Later replies cannot take the place of this one, so the
+                // connection ends after those before it
+                hlogger.debug("Pipelined request failed: {}", f.get_exception());
+                _server._respond_errors++;
+                _pipeline_broken = true;
+                _done = true;
+                _fd.shutdown_input();
+                return make_ready_future<>();
+            }
+            return _replies.push_eventually(f.get0()).handle_exception([this] (std::exception_ptr) {
+                // The replies were aborted, the connection is going down
+                _pipeline_broken = true;
+            }).finally([units = std::move(units)] {});
+        });
+    });
+}
+
+future<std::unique_ptr<reply>> connection::handle_request(std::unique_ptr<request> req) {
     auto resp = std::make_unique<reply>();
     resp->set_version(req->_version);
     set_headers(*resp);
-    bool keep_alive = req->should_keep_alive();
-    if (keep_alive && req->_version == "1.0") {
+    if (req->should_keep_alive() && req->_version == "1.0") {
         resp->_headers["Connection"] = "Keep-Alive";
     }
 
     sstring url = set_query_param(*req.get());
     sstring version = req->_version;
-    return _server._routes.handle(url, std::move(req), std::move(resp)).
-    // Caller guarantees enough room
-    then([this, keep_alive , version = std::move(version)](std::unique_ptr<reply> rep) {
+    sstring accept_encoding = _server._compression ? req->get_header("Accept-Encoding") : sstring();
+    return _server._routes.handle(url, std::move(req), std::move(resp)).then([this, accept_encoding = std::move(accept_encoding)] (std::unique_ptr<reply> rep) {
+        return _server.compress(accept_encoding, std::move(rep));
+    }).then([version = std::move(version)] (std::unique_ptr<reply> rep) {
         rep->set_version(version).done();
-        this->_replies.push(std::move(rep));
-        return make_ready_future<bool>(!keep_alive);
+        return rep;
     });
 }
 
+unsigned http_server::get_max_pipelined_requests() const {
+    return _max_pipelined_requests;
+}
+
+void http_server::set_max_pipelined_requests(unsigned n) {
+    _max_pipelined_requests = std::max(n, 1u);
+}
+
 void http_server::set_tls_credentials(shared_ptr<seastar::tls::server_credentials> credentials) {
     _credentials = credentials;
 }
@@ -459,6 +577,63 @@ void http_server::set_content_streaming(bool b) {
     _content_streaming = b;
 }
 
+size_t http_server::get_content_memory_limit() const {
+    return _content_memory_limit;
+}
+
+void http_server::set_content_memory_limit(size_t limit) {
+    _content_memory_limit = limit;
+}
+
+size_t http_server::get_connection_memory_limit() const {
+    return _connection_memory ? _connection_memory->memory() : std::numeric_limits<size_t>::max();
+}
+
+void http_server::set_connection_memory_limit(size_t limit) {
+    _connection_memory = std::make_unique<net::connection_memory_budget>(limit, _name);
+}
+
+bool http_server::streams_content(const request& req) {
+    if (_content_streaming) {
+        return true;
+    }
+    return _routes.streams_content(str2type(req._method), req._url.substr(0, req._url.find('?')));
+}
+
+bool http_server::get_http2() const {
+    return _http2;
+}
+
+void http_server::set_http2(bool b) {
+    _http2 = b;
+}
+
+const std::optional<compression_config>& http_server::get_compression() const {
+    return _compression;
+}
+
+void http_server::set_compression(std::optional<compression_config> c) {
+    _compression = std::move(c);
+}
+
+future<std::unique_ptr<reply>> http_server::compress(const sstring& accept_encoding, std::unique_ptr<reply> rep) {
+    if (!_compression) {
+        return make_ready_future<std::unique_ptr<reply>>(std::move(rep));
+    }
+    auto& r = *rep;
+    return compress_reply(r, accept_encoding, *_compression).then([rep = std::move(rep)] () mutable {
+        return std::move(rep);
+    });
+}
+
+bool http_server::get_header_views() const {
+    return _header_views;
+}
+
+void http_server::set_header_views(bool b) {
+    _header_views = b;
+}
+
 future<> http_server::listen(socket_address addr, listen_options lo) {
     if (_credentials) {
         _listeners.push_back(seastar::tls::listen(_credentials, addr, lo));
@@ -25,6 +25,7 @@
 #include <memory>
 #include <unordered_map>
 #include <seastar/http/request.hh>
+#include <seastar/http/internal/request_scanner.hh>
 
 namespace seastar {
 
@@ -53,7 +54,11 @@ action store_version {
 }
 
 action store_field_name {
-    _field_name = str();
+    if (_header_views) {
+        _field_name_view = view();
+    } else {
+        _field_name = str();
+    }
 }
 
 action store_value {
@@ -61,8 +66,16 @@ action store_value {
 }
 
 action no_mark_store_value {
-    _value = get_str();
-    g.mark_start(nullptr);
+    if (_header_views) {
+        // Without checkpoints the value runs up to p, trailing white space included
+        _value_view = view();
+        while (!_value_view.empty() && (_value_view.back() == ' ' || _value_view.back() == '\t')) {
+            _value_view.remove_suffix(1);
+        }
+    } else {
+        _value = get_str();
+        g.mark_start(nullptr);
+    }
 }
 
 action checkpoint {
@@ -71,12 +84,16 @@ action checkpoint {
     // of this action.
     // To store the string that ends on the last checkpoint (instead of the last processed character)
     // use %no_mark_store_value instead of %store_value
-    g.mark_end(p);
-    g.mark_start(p);
+    if (!_header_views) {
+        g.mark_end(p);
+        g.mark_start(p);
+    }
 }
 
 action assign_field {
-    if (_req->_headers.count(_field_name)) {
+    if (_header_views) {
+        _req->_header_views.add(_field_name_view, _value_view);
+    } else if (_req->_headers.count(_field_name)) {
         // RFC 7230, section 3.2.2.  Field Parsing:
         // A recipient MAY combine multiple header fields with the same field name into one
         // "field-name: field-value" pair, without changing the semantics of the message,
@@ -92,7 +109,11 @@ action extend_field  {
     // A server that receives an obs-fold in a request message that is not
     // within a message/http container MUST either reject the message [...]
     // or replace each received obs-fold with one or more SP octets [...]
-    _req->_headers[_field_name] += sstring(" ") + std::move(_value);
+    if (_header_views) {
+        _req->_header_views.append(_field_name_view, _value_view, " ");
+    } else {
+        _req->_headers[_field_name] += sstring(" ") + std::move(_value);
+    }
 }
 
 action done {
@@ -141,7 +162,47 @@ public:
     sstring _field_name;
     sstring _value;
     state _state;
+    // Headers go to _req->_header_views as views into the buffers being
+    // parsed, which the request then retains
+    bool _header_views = false;
+    std::string_view _field_name_view;
+    std::string_view _value_view;
+    temporary_buffer<char>* _block = nullptr;
+    bool _block_retained = false;
+    httpd::internal::scanned_request _scanned;
+
+    // Parses a head which the scanner takes in whole, as the machine would
+    bool parse_scanned(temporary_buffer<char>& buf) {
+        auto len = httpd::internal::scan_request_head(buf.get(), buf.size(), _scanned);
+        if (!len) {
+            return false;
+        }
+        _req->_method = sstring(_scanned.method);
+        _req->_url = sstring(_scanned.url);
+        _req->_version = sstring(_scanned.version);
+        if (_header_views) {
+            if (!_scanned.fields.empty()) {
+                _req->_header_views.retain(buf.share());
+            }
+            for (auto& [name, value] : _scanned.fields) {
+                _req->_header_views.add(name, value);
+            }
+        } else {
+            for (auto& [name, value] : _scanned.fields) {
+                auto [it, inserted] = _req->_headers.try_emplace(sstring(name), value);
+                if (!inserted) {
+                    it->second += sstring(",") + sstring(value);
+                }
+            }
+        }
+        buf.trim_front(len);
+        _state = state::done;
+        return true;
+    }
 public:
+    void set_header_views(bool b) {
+        _header_views = b;
+    }
     void init() {
         init_base();
         _req.reset(new httpd::request());
@@ -151,6 +212,19 @@ public:
     char* parse(char* p, char* pe, char* eof) {
         sstring_builder::guard g(_builder, p, pe);
         auto str = [this, &g, &p] { g.mark_end(p); return get_str(); };
+        auto view = [this, &g, &p] {
+            if (auto v = g.mark_end_in_place(p)) {
+                // When called directly rather than through operator(),
+                // the caller keeps the buffer
+                if (_block && !_block_retained) {
+                    _req->_header_views.retain(_block->share());
+                    _block_retained = true;
+                }
+                return *v;
+            }
+            // Split between blocks, so it was built
+            return _req->_header_views.keep(get_str());
+        };
         bool done = false;
         if (p != pe) {
             _state = state::error;
@@ -176,6 +250,25 @@ public:
         }
         return p;
     }
+    // Like ragel_parser_base's, but lets parse() retain the buffer, and
+    // takes a head that is whole in the buffer past the machine
+    future<unconsumed_remainder> operator()(temporary_buffer<char> buf) {
+        if (_fsm_cs == start && parse_scanned(buf)) {
+            return make_ready_future<unconsumed_remainder>(std::move(buf));
+        }
+        _block = &buf;
+        _block_retained = false;
+        char* p = buf.get_write();
+        char* pe = p + buf.size();
+        char* eof = buf.empty() ? pe : nullptr;
+        char* parsed = parse(p, pe, eof);
+        _block = nullptr;
+        if (parsed) {
+            buf.trim_front(parsed - p);
+            return make_ready_future<unconsumed_remainder>(std::move(buf));
+        }
+        return make_ready_future<unconsumed_remainder>();
+    }
     auto get_parsed_request() {
         return std::move(_req);
     }
@@ -0,0 +1,191 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#include <seastar/http/internal/route_tree.hh>
+#include <boost/container/small_vector.hpp>
+#include <algorithm>
+
+namespace seastar {
+
+namespace httpd {
+
+namespace internal {
+
+namespace {
+
+// The end of the segment that starts at pos. Segments start with a slash,
+// but for the first one, and matchers only ever stop at segment ends.
+size_t segment_end(std::string_view url, size_t pos) {
+    auto end = url.find('/', pos + 1);
+    return end == std::string_view::npos ? url.size() : end;
+}
+
+}
+
+struct route_tree::match {
+    const leaf* best = nullptr;
+    // The positions of the parameters on the way to the current node, and
+    // those of the best rule
+    boost::container::small_vector<std::pair<size_t, size_t>, 8> values;
+    boost::container::small_vector<std::pair<size_t, size_t>, 8> best_values;
+
+    bool better(const leaf* l) const noexcept {
+        return l && (!best || l->cookie < best->cookie);
+    }
+};
+
+route_tree::route_tree(const std::map<uint64_t, match_rule*>& rules) {
+    for (auto& [cookie, rule] : rules) {
+        if (!insert(cookie, *rule)) {
+            _others.emplace_back(cookie, rule);
+        }
+    }
+}
+
+bool route_tree::insert(uint64_t cookie, const match_rule& rule) {
+    auto& matchers = rule.matchers();
+    for (size_t i = 0; i < matchers.size(); i++) {
+        auto p = dynamic_cast<const param_matcher*>(matchers[i]);
+        // A parameter that takes the rest of the url has to be the last
+        if (p ? p->entire_path() && i + 1 != matchers.size() : !dynamic_cast<const str_matcher*>(matchers[i])) {
+            return false;
+        }
+    }
+
+    auto l = std::make_unique<leaf>(leaf{cookie, rule.handler(), {}});
+    node* n = &_root;
+    bool rest = matchers.empty();
+    n->min_cookie = std::min(n->min_cookie, cookie);
+    for (auto m : matchers) {
+        if (auto p = dynamic_cast<const param_matcher*>(m)) {
+            l->params.push_back(p->name());
+            if (p->entire_path()) {
+                rest = true;
+                break;
+            }
+            if (!n->param) {
+                n->param = std::make_unique<node>();
+            }
+            n = n->param.get();
+            n->min_cookie = std::min(n->min_cookie, cookie);
+            continue;
+        }
+        const sstring& str = static_cast<const str_matcher*>(m)->str();
+        for (size_t pos = 0; pos < str.size(); ) {
+            auto end = segment_end(str, pos);
+            auto segment = std::string_view(str).substr(pos, end - pos);
+            auto it = n->literals.find(segment);
+            if (it == n->literals.end()) {
+                auto child = std::make_unique<node>();
+                child->segment = sstring(segment.data(), segment.size());
+                std::string_view key = child->segment;
+                it = n->literals.emplace(key, std::move(child)).first;
+            }
+            n = it->second.get();
+            n->min_cookie = std::min(n->min_cookie, cookie);
+            pos = end;
+        }
+    }
+    // Rules come in the order of their cookies, so the first one to get
+    // somewhere is the one that counts
+    auto& slot = rest ? n->rest : n->end;
+    if (!slot) {
+        slot = l.get();
+    }
+    _leaves.push_back(std::move(l));
+    return true;
+}
+
+void route_tree::find(const node& n, std::string_view url, size_t pos, match& m) const {
+    if (m.best && n.min_cookie >= m.best->cookie) {
+        return;
+    }
+    if (m.better(n.rest)) {
+        m.best = n.rest;
+        m.best_values = m.values;
+        if (n.rest->params.size() > m.values.size()) {
+            m.best_values.emplace_back(pos, url.size());
+        }
+    }
+    // Like match_rule::get(), a trailing slash is fine
+    if (pos + 1 >= url.size() && m.better(n.end)) {
+        m.best = n.end;
+        m.best_values = m.values;
+    }
+    if (pos >= url.size()) {
+        return;
+    }
+    auto end = segment_end(url, pos);
+    auto it = n.literals.find(url.substr(pos, end - pos));
+    const node* literal = it != n.literals.end() ? it->second.get() : nullptr;
+    const node* param = n.param.get();
+    auto find_literal = [&] {
+        if (literal) {
+            find(*literal, url, end, m);
+        }
+    };
+    auto find_param = [&] {
+        if (param) {
+            m.values.emplace_back(pos, end);
+            find(*param, url, end, m);
+            m.values.pop_back();
+        }
+    };
+    // The subtree with the earlier rule goes first, what it finds may spare
+    // the look into the other
+    if (literal && param && param->min_cookie < literal->min_cookie) {
+        find_param();
+        find_literal();
+    } else {
+        find_literal();
+        find_param();
+    }
+}
+
+handler_base* route_tree::get(const sstring& url, parameters& params) const {
+    match m;
+    find(_root, url, 0, m);
+    uint64_t found = m.best ? m.best->cookie : no_cookie;
+    for (auto& [cookie, rule] : _others) {
+        if (cookie > found) {
+            break;
+        }
+        auto handler = rule->get(url, params);
+        if (handler) {
+            return handler;
+        }
+        params.clear();
+    }
+    if (!m.best) {
+        return nullptr;
+    }
+    for (size_t i = 0; i < m.best_values.size(); i++) {
+        auto [from, to] = m.best_values[i];
+        params.set(m.best->params[i], url.substr(from, to - from));
+    }
+    return m.best->handler;
+}
+
+}
+
+}
+
+}
@@ -121,16 +121,23 @@ handler_base* routes::get_handler(operation_type type, const sstring& url,
         return handler;
     }
 
-    for (auto&& rule : _rules[type]) {
-        handler = rule.second->get(url, params);
-        if (handler != nullptr) {
-            return handler;
-        }
-        params.clear();
+    auto& tree = _trees[type];
+    if (!tree) {
+        tree = std::make_unique<internal::route_tree>(_rules[type]);
+    }
+    handler = tree->get(url, params);
+    if (handler != nullptr) {
+        return handler;
     }
     return _default_handler;
 }
 
+bool routes::streams_content(operation_type type, const sstring& url) {
+    parameters params;
+    handler_base* handler = get_handler(type, normalize_url(url), params);
+    return handler != nullptr && handler->_content_streaming;
+}
+
 routes& routes::add(operation_type type, const url& url,
         handler_base* handler) {
     match_rule* rule = new match_rule(handler);
@@ -172,6 +179,7 @@ routes& routes::put(operation_type type, const sstring& url, handler_base* handl
 }
 
 match_rule* routes::del_cookie(rule_cookie cookie, operation_type type) {
+    _trees[type].reset();
     return delete_rule_from(type, cookie, _rules);
 }
 
@@ -21,8 +21,13 @@
 
 #include <seastar/json/formatter.hh>
 #include <seastar/json/json_elements.hh>
+#include <seastar/core/bitops.hh>
 #include <cmath>
 #include <algorithm>
+#include <charconv>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 namespace seastar {
 
@@ -50,54 +55,105 @@ static inline bool is_control_char(char c) {
     return c >= 0 && c <= 0x1F;
 }
 
-static bool needs_escaping(const string_view& str) {
-    return std::any_of(str.begin(), str.end(), [] (char c) {
-        return is_control_char(c) || c == '"' || c == '\\';
-    });
+static inline bool needs_escaping(char c) {
+    return is_control_char(c) || c == '"' || c == '\\';
+}
+
+// The length of the prefix of the string that can be copied as is
+static size_t unescaped_prefix(const char* p, size_t n) noexcept {
+    size_t i = 0;
+#ifdef __SSE2__
+    // 16 characters at a time, control characters are those the unsigned
+    // max with 0x1F leaves at 0x1F
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i control = _mm_set1_epi8(0x1F);
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        __m128i special = _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)),
+                _mm_cmpeq_epi8(_mm_max_epu8(v, control), control));
+        unsigned mask = _mm_movemask_epi8(special);
+        if (mask) {
+            return i + count_trailing_zeros(mask);
+        }
+    }
+#endif
+    while (i < n && !needs_escaping(p[i])) {
+        ++i;
+    }
+    return i;
+}
+
+static size_t escape(char c, char* out) noexcept {
+    char e;
+    switch (c) {
+    case '"': e = '"'; break;
+    case '\\': e = '\\'; break;
+    case '\b': e = 'b'; break;
+    case '\f': e = 'f'; break;
+    case '\n': e = 'n'; break;
+    case '\r': e = 'r'; break;
+    case '\t': e = 't'; break;
+    default:
+        if (out) {
+            static constexpr char hex[] = "0123456789ABCDEF";
+            std::copy_n("\\u00", 4, out);
+            out[4] = hex[c >> 4];
+            out[5] = hex[c & 0xF];
+        }
+        return 6;
+    }
+    if (out) {
+        out[0] = '\\';
+        out[1] = e;
+    }
+    return 2;
+}
+
+// Runs over the string, handing the runs that need no escaping and the
+// characters that do to the two functions
+template <typename Run, typename Special>
+static void scan(const string_view& str, Run run, Special special) {
+    size_t pos = 0;
+    while (true) {
+        auto n = unescaped_prefix(str.data() + pos, str.size() - pos);
+        run(str.data() + pos, n);
+        pos += n;
+        if (pos == str.size()) {
+            return;
+        }
+        special(str[pos++]);
+    }
 }
 
 static sstring string_view_to_json(const string_view& str) {
-    if (!needs_escaping(str)) {
-        return format("\"{}\"", str);
-    }
+    // The size first, so that the result is allocated once
+    size_t size = 2;
+    scan(str, [&size] (const char*, size_t n) {
+        size += n;
+    }, [&size] (char c) {
+        size += escape(c, nullptr);
+    });
+    sstring res(sstring::initialized_later(), size);
+    char* out = res.data();
+    *out++ = '"';
+    scan(str, [&out] (const char* p, size_t n) {
+        out = std::copy_n(p, n, out);
+    }, [&out] (char c) {
+        out += escape(c, out);
+    });
+    *out = '"';
+    return res;
+}
 
-    ostringstream oss;
-    oss << std::hex << std::uppercase << std::setfill('0');
-    oss.put('"');
-    for (char c : str) {
-        switch (c) {
-        case '"':
-            oss.put('\\').put('"');
-            break;
-        case '\\':
-            oss.put('\\').put('\\');
-            break;
-        case '\b':
-            oss.put('\\').put('b');
-            break;
-        case '\f':
-            oss.put('\\').put('f');
-            break;
-        case '\n':
-            oss.put('\\').put('n');
-            break;
-        case '\r':
-            oss.put('\\').put('r');
-            break;
-        case '\t':
-            oss.put('\\').put('t');
-            break;
-        default:
-            if (is_control_char(c)) {
-                oss.put('\\').put('u') << std::setw(4) << static_cast<int>(c);
-            } else {
-                oss.put(c);
-            }
-            break;
-        }
-    }
-    oss.put('"');
-    return oss.str();
+// Integers and floating point numbers as std::to_chars() writes them, the
+// shortest form that reads back to the same value
+template <typename T>
+static sstring number_to_json(T n) {
+    char buf[32];
+    auto [end, ec] = std::to_chars(buf, buf + sizeof(buf), n);
+    return sstring(buf, end - buf);
 }
 
 sstring formatter::to_json(const sstring& str) {
@@ -113,15 +169,15 @@ sstring formatter::to_json(const char* str, size_t len) {
 }
 
 sstring formatter::to_json(int n) {
-    return to_string(n);
+    return number_to_json(n);
 }
 
 sstring formatter::to_json(unsigned n) {
-    return to_string(n);
+    return number_to_json(n);
 }
 
 sstring formatter::to_json(long n) {
-    return to_string(n);
+    return number_to_json(n);
 }
 
 sstring formatter::to_json(float f) {
@@ -130,7 +186,7 @@ sstring formatter::to_json(float f) {
     } else if (std::isnan(f)) {
         throw invalid_argument("Invalid float value");
     }
-    return to_sstring(f);
+    return number_to_json(f);
 }
 
 sstring formatter::to_json(double d) {
@@ -139,7 +195,7 @@ sstring formatter::to_json(double d) {
     } else if (std::isnan(d)) {
         throw invalid_argument("Invalid double value");
     }
-    return to_sstring(d);
+    return number_to_json(d);
 }
 
 sstring formatter::to_json(bool b) {
@@ -164,8 +220,12 @@ sstring formatter::to_json(const jsonable& obj) {
     return obj.to_json();
 }
 
+future<> formatter::write(output_stream<char>& s, const jsonable& obj) {
+    return obj.write(s);
+}
+
 sstring formatter::to_json(unsigned long l) {
-    return to_string(l);
+    return number_to_json(l);
 }
 
 }
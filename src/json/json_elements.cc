@@ -139,6 +139,11 @@ class json_stream_builder {
      * @return a string of accumulative object
      */
     future<> done() {
+        if (!open) {
+            // No element was set
+            open = true;
+            return _s.write(json_builder::OPEN + json_builder::CLOSE);
+        }
         return _s.write(json_builder::CLOSE);
     }
 
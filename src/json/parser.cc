@@ -0,0 +1,628 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+
+#include <seastar/json/parser.hh>
+#include <seastar/core/bitops.hh>
+#include <seastar/core/do_with.hh>
+#include <seastar/core/loop.hh>
+#include <seastar/util/later.hh>
+#include <algorithm>
+#include <charconv>
+#include <system_error>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace seastar {
+
+namespace json {
+
+parse_error::parse_error(const std::string& msg, uint64_t offset)
+    : std::runtime_error(msg + " at offset " + std::to_string(offset))
+    , _offset(offset)
+{ }
+
+static inline bool is_whitespace(char c) noexcept {
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+static inline bool is_digit(char c) noexcept {
+    return c >= '0' && c <= '9';
+}
+
+static inline bool is_number_char(char c) noexcept {
+    return is_digit(c) || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E';
+}
+
+// The position of the first character from i that is not whitespace, or n
+static size_t skip_whitespace(const char* p, size_t i, size_t n) noexcept {
+    // Mostly a separator or nothing, indentation is worth the vectors
+    if (i < n && !is_whitespace(p[i])) {
+        return i;
+    }
+#ifdef __SSE2__
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i nl = _mm_set1_epi8('\n');
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i tab = _mm_set1_epi8('\t');
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        __m128i ws = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, space), _mm_cmpeq_epi8(v, nl)),
+                                  _mm_or_si128(_mm_cmpeq_epi8(v, cr), _mm_cmpeq_epi8(v, tab)));
+        unsigned mask = ~_mm_movemask_epi8(ws) & 0xffff;
+        if (mask) {
+            return i + count_trailing_zeros(mask);
+        }
+    }
+#endif
+    while (i < n && is_whitespace(p[i])) {
+        ++i;
+    }
+    return i;
+}
+
+// The position of the first character from i that ends a run of plain
+// string characters: a quote, a backslash or a control character; or n
+static size_t string_run_end(const char* p, size_t i, size_t n) noexcept {
+#ifdef __SSE2__
+    // Control characters are those the unsigned max with 0x1F leaves at 0x1F
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i control = _mm_set1_epi8(0x1F);
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        __m128i special = _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)),
+                _mm_cmpeq_epi8(_mm_max_epu8(v, control), control));
+        unsigned mask = _mm_movemask_epi8(special);
+        if (mask) {
+            return i + count_trailing_zeros(mask);
+        }
+    }
+#endif
+    while (i < n && p[i] != '"' && p[i] != '\\' && static_cast<unsigned char>(p[i]) >= 0x20) {
+        ++i;
+    }
+    return i;
+}
+
+static int hex_value(char c) noexcept {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+static void append_utf8(std::string& s, uint32_t cp) {
+    if (cp < 0x80) {
+        s += char(cp);
+    } else if (cp < 0x800) {
+        s += char(0xC0 | (cp >> 6));
+        s += char(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        s += char(0xE0 | (cp >> 12));
+        s += char(0x80 | ((cp >> 6) & 0x3F));
+        s += char(0x80 | (cp & 0x3F));
+    } else {
+        s += char(0xF0 | (cp >> 18));
+        s += char(0x80 | ((cp >> 12) & 0x3F));
+        s += char(0x80 | ((cp >> 6) & 0x3F));
+        s += char(0x80 | (cp & 0x3F));
+    }
+}
+
+parser::parser(parse_handler& h, parse_options opts)
+    : _h(h)
+    , _max_depth(opts.max_depth)
+{ }
+
+void parser::fail(const char* msg, size_t pos) const {
+    throw parse_error(msg, _offset + pos);
+}
+
+void parser::feed(std::string_view data) {
+    const char* p = data.data();
+    size_t n = data.size();
+    size_t i = 0;
+    while (i < n) {
+        switch (_token) {
+        case token::string:
+        case token::key:
+            i = continue_string(p, i, n);
+            continue;
+        case token::number:
+            i = continue_number(p, i, n);
+            continue;
+        case token::literal:
+            i = continue_literal(p, i, n);
+            continue;
+        case token::none:
+            break;
+        }
+        i = skip_whitespace(p, i, n);
+        if (i == n) {
+            break;
+        }
+        char c = p[i];
+        switch (_expect) {
+        case expect::value_or_end:
+            if (c == ']') {
+                end_container();
+                i++;
+                break;
+            }
+            [[fallthrough]];
+        case expect::value:
+            i = start_value(p, i);
+            break;
+        case expect::key_or_end:
+            if (c == '}') {
+                end_container();
+                i++;
+                break;
+            }
+            [[fallthrough]];
+        case expect::key:
+            if (c != '"') {
+                fail("expected an object key", i);
+            }
+            _token = token::key;
+            i++;
+            break;
+        case expect::colon:
+            if (c != ':') {
+                fail("expected ':'", i);
+            }
+            _expect = expect::value;
+            i++;
+            break;
+        case expect::comma_or_end:
+            if (c == ',') {
+                _expect = _stack.back() ? expect::key : expect::value;
+            } else if (c == (_stack.back() ? '}' : ']')) {
+                end_container();
+            } else {
+                fail(_stack.back() ? "expected ',' or '}'" : "expected ',' or ']'", i);
+            }
+            i++;
+            break;
+        case expect::done:
+            fail("unexpected data after the document", i);
+        }
+    }
+    _offset += n;
+}
+
+void parser::finish() {
+    switch (_token) {
+    case token::number:
+        emit_number(_buf, 0);
+        _buf.clear();
+        break;
+    case token::literal:
+        emit_literal(_buf, 0);
+        _buf.clear();
+        break;
+    default:
+        break;
+    }
+    if (!done()) {
+        fail("unexpected end of the document", 0);
+    }
+}
+
+size_t parser::start_value(const char* p, size_t i) {
+    char c = p[i];
+    switch (c) {
+    case '{':
+        push(true, i);
+        _h.on_start_object();
+        _expect = expect::key_or_end;
+        return i + 1;
+    case '[':
+        push(false, i);
+        _h.on_start_array();
+        _expect = expect::value_or_end;
+        return i + 1;
+    case '"':
+        _token = token::string;
+        return i + 1;
+    case 't':
+    case 'f':
+    case 'n':
+        _token = token::literal;
+        return i;
+    default:
+        if (c == '-' || is_digit(c)) {
+            _token = token::number;
+            return i;
+        }
+        fail("unexpected character", i);
+    }
+}
+
+void parser::push(bool object, size_t pos) {
+    if (_stack.size() >= _max_depth) {
+        fail("document nested too deep", pos);
+    }
+    _stack.push_back(object);
+}
+
+void parser::end_container() {
+    bool object = _stack.back();
+    _stack.pop_back();
+    if (object) {
+        _h.on_end_object();
+    } else {
+        _h.on_end_array();
+    }
+    value_done();
+}
+
+void parser::value_done() noexcept {
+    _expect = _stack.empty() ? expect::done : expect::comma_or_end;
+}
+
+size_t parser::continue_string(const char* p, size_t i, size_t n) {
+    while (i < n) {
+        if (_escape) {
+            i = continue_escape(p, i);
+            continue;
+        }
+        if (_high_surrogate) {
+            // The escape of the low surrogate must follow
+            if (p[i] != '\\') {
+                fail("unpaired surrogate in string", i);
+            }
+            _escape = 1;
+            i++;
+            continue;
+        }
+        auto end = string_run_end(p, i, n);
+        if (end == n) {
+            _buf.append(p + i, n - i);
+            return n;
+        }
+        char c = p[end];
+        if (c == '"') {
+            if (_buf.empty()) {
+                emit_string({p + i, end - i});
+            } else {
+                _buf.append(p + i, end - i);
+                emit_string(_buf);
+                _buf.clear();
+            }
+            return end + 1;
+        }
+        if (c == '\\') {
+            _buf.append(p + i, end - i);
+            _escape = 1;
+            i = end + 1;
+            continue;
+        }
+        fail("control character in string", end);
+    }
+    return i;
+}
+
+size_t parser::continue_escape(const char* p, size_t i) {
+    char c = p[i];
+    if (_escape == 1) {
+        if (_high_surrogate && c != 'u') {
+            fail("unpaired surrogate in string", i);
+        }
+        char e;
+        switch (c) {
+        case '"': e = '"'; break;
+        case '\\': e = '\\'; break;
+        case '/': e = '/'; break;
+        case 'b': e = '\b'; break;
+        case 'f': e = '\f'; break;
+        case 'n': e = '\n'; break;
+        case 'r': e = '\r'; break;
+        case 't': e = '\t'; break;
+        case 'u':
+            _escape = 2;
+            _code = 0;
+            return i + 1;
+        default:
+            fail("invalid escape in string", i);
+        }
+        _buf += e;
+        _escape = 0;
+        return i + 1;
+    }
+    auto d = hex_value(c);
+    if (d < 0) {
+        fail("invalid unicode escape in string", i);
+    }
+    _code = _code * 16 + d;
+    if (++_escape == 6) {
+        _escape = 0;
+        end_unicode_escape(i);
+    }
+    return i + 1;
+}
+
+void parser::end_unicode_escape(size_t pos) {
+    if (_high_surrogate) {
+        if (_code < 0xDC00 || _code > 0xDFFF) {
+            fail("unpaired surrogate in string", pos);
+        }
+        append_utf8(_buf, 0x10000 + ((_high_surrogate - 0xD800) << 10) + (_code - 0xDC00));
+        _high_surrogate = 0;
+    } else if (_code >= 0xD800 && _code <= 0xDBFF) {
+        _high_surrogate = _code;
+    } else if (_code >= 0xDC00 && _code <= 0xDFFF) {
+        fail("unpaired surrogate in string", pos);
+    } else {
+        append_utf8(_buf, _code);
+    }
+}
+
+void parser::emit_string(std::string_view s) {
+    if (_token == token::key) {
+        _token = token::none;
+        _expect = expect::colon;
+        _h.on_key(s);
+    } else {
+        _token = token::none;
+        value_done();
+        _h.on_string(s);
+    }
+}
+
+size_t parser::continue_number(const char* p, size_t i, size_t n) {
+    auto end = i;
+    while (end < n && is_number_char(p[end])) {
+        ++end;
+    }
+    if (end == n) {
+        _buf.append(p + i, n - i);
+        return n;
+    }
+    if (_buf.empty()) {
+        emit_number({p + i, end - i}, end);
+    } else {
+        _buf.append(p + i, end - i);
+        emit_number(_buf, end);
+        _buf.clear();
+    }
+    return end;
+}
+
+void parser::emit_number(std::string_view s, size_t pos) {
+    // -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+    size_t k = 0;
+    auto digits = [&] {
+        auto start = k;
+        while (k < s.size() && is_digit(s[k])) {
+            ++k;
+        }
+        return k > start;
+    };
+    bool valid = true;
+    bool integral = true;
+    if (k < s.size() && s[k] == '-') {
+        ++k;
+    }
+    if (k < s.size() && s[k] == '0') {
+        ++k;
+    } else {
+        valid = k < s.size() && s[k] != '0' && digits();
+    }
+    if (valid && k < s.size() && s[k] == '.') {
+        integral = false;
+        ++k;
+        valid = digits();
+    }
+    if (valid && k < s.size() && (s[k] == 'e' || s[k] == 'E')) {
+        integral = false;
+        ++k;
+        if (k < s.size() && (s[k] == '+' || s[k] == '-')) {
+            ++k;
+        }
+        valid = digits();
+    }
+    if (!valid || k != s.size()) {
+        fail("invalid number", pos);
+    }
+    _token = token::none;
+    value_done();
+    if (integral) {
+        int64_t v;
+        auto [ptr, ec] = std::from_chars(s.data(), s.data() + s.size(), v);
+        if (ec == std::errc()) {
+            _h.on_integer(v);
+            return;
+        }
+    }
+    double d;
+    auto [ptr, ec] = std::from_chars(s.data(), s.data() + s.size(), d);
+    if (ec != std::errc()) {
+        fail("number out of range", pos);
+    }
+    _h.on_double(d);
+}
+
+size_t parser::continue_literal(const char* p, size_t i, size_t n) {
+    auto end = i;
+    while (end < n && p[end] >= 'a' && p[end] <= 'z') {
+        ++end;
+    }
+    if (end == n) {
+        _buf.append(p + i, n - i);
+        if (_buf.size() > 5) {
+            fail("invalid literal", n);
+        }
+        return n;
+    }
+    if (_buf.empty()) {
+        emit_literal({p + i, end - i}, end);
+    } else {
+        _buf.append(p + i, end - i);
+        emit_literal(_buf, end);
+        _buf.clear();
+    }
+    return end;
+}
+
+void parser::emit_literal(std::string_view s, size_t pos) {
+    _token = token::none;
+    if (s == "true") {
+        value_done();
+        _h.on_bool(true);
+    } else if (s == "false") {
+        value_done();
+        _h.on_bool(false);
+    } else if (s == "null") {
+        value_done();
+        _h.on_null();
+    } else {
+        fail("invalid literal", pos);
+    }
+}
+
+// Longer fragments are parsed in slices of that much, to yield in between
+static constexpr size_t parse_slice = 16 << 10;
+
+static future<> feed(parser& p, temporary_buffer<char> buf) {
+    if (buf.size() <= parse_slice) {
+        p.feed({buf.get(), buf.size()});
+        return make_ready_future<>();
+    }
+    return do_with(std::move(buf), size_t(0), [&p] (temporary_buffer<char>& buf, size_t& pos) {
+        return repeat([&p, &buf, &pos] {
+            auto len = std::min(parse_slice, buf.size() - pos);
+            p.feed({buf.get() + pos, len});
+            pos += len;
+            if (pos == buf.size()) {
+                return make_ready_future<stop_iteration>(stop_iteration::yes);
+            }
+            return maybe_yield().then([] {
+                return stop_iteration::no;
+            });
+        });
+    });
+}
+
+future<> parse(input_stream<char>& in, parse_handler& h, parse_options opts) {
+    return do_with(parser(h, opts), [&in] (parser& p) {
+        return repeat([&in, &p] {
+            return in.read().then([&p] (temporary_buffer<char> buf) {
+                if (buf.empty()) {
+                    p.finish();
+                    return make_ready_future<stop_iteration>(stop_iteration::yes);
+                }
+                return feed(p, std::move(buf)).then([] {
+                    return stop_iteration::no;
+                });
+            });
+        });
+    });
+}
+
+const value* value::find(std::string_view key) const noexcept {
+    if (!is_object()) {
+        return nullptr;
+    }
+    for (auto& [k, v] : as_object()) {
+        if (k == key) {
+            return &v;
+        }
+    }
+    return nullptr;
+}
+
+namespace {
+
+// Builds the value of a document from the events of its parse
+class value_builder final : public parse_handler {
+    // The open containers, innermost last, with the key of their next member
+    struct frame {
+        value v;
+        sstring key;
+    };
+    std::vector<frame> _stack;
+    value _root;
+
+    void add(value v) {
+        if (_stack.empty()) {
+            _root = std::move(v);
+            return;
+        }
+        auto& top = _stack.back();
+        if (top.v.is_object()) {
+            top.v.as_object().emplace_back(std::move(top.key), std::move(v));
+        } else {
+            top.v.as_array().push_back(std::move(v));
+        }
+    }
+    void end() {
+        auto v = std::move(_stack.back().v);
+        _stack.pop_back();
+        add(std::move(v));
+    }
+public:
+    void on_null() override { add(value()); }
+    void on_bool(bool b) override { add(value(b)); }
+    void on_integer(int64_t n) override { add(value(n)); }
+    void on_double(double d) override { add(value(d)); }
+    void on_string(std::string_view s) override { add(value(sstring(s))); }
+    void on_start_object() override { _stack.push_back({value(value::object()), {}}); }
+    void on_key(std::string_view key) override { _stack.back().key = sstring(key); }
+    void on_end_object() override { end(); }
+    void on_start_array() override { _stack.push_back({value(value::array()), {}}); }
+    void on_end_array() override { end(); }
+
+    value release() noexcept {
+        return std::move(_root);
+    }
+};
+
+}
+
+value parse_value(std::string_view text, parse_options opts) {
+    value_builder b;
+    parser p(b, opts);
+    p.feed(text);
+    p.finish();
+    return b.release();
+}
+
+future<value> parse_value(input_stream<char>& in, parse_options opts) {
+    return do_with(value_builder(), [&in, opts] (value_builder& b) {
+        return parse(in, b, opts).then([&b] {
+            return b.release();
+        });
+    });
+}
+
+}
+
+}
@@ -37,6 +37,9 @@
 #include <seastar/core/reactor.hh>
 #include <seastar/core/gate.hh>
 #include <seastar/core/print.hh>
+#include <seastar/core/metrics.hh>
+#include <seastar/core/shared_future.hh>
+#include <seastar/core/lowres_clock.hh>
 
 namespace seastar::net {
 
@@ -217,6 +220,16 @@ class net::dns_resolver::impl
 
         ares_set_socket_functions(_channel, &callbacks, this);
 
+        _cache_enabled = opts.cache.value_or(false);
+        _cache_size = std::max<size_t>(opts.cache_size.value_or(10000), 1);
+        _cache_min_ttl = opts.cache_min_ttl.value_or(std::chrono::seconds(1));
+        _cache_max_ttl = opts.cache_max_ttl.value_or(std::chrono::hours(1));
+        _negative_ttl = opts.negative_ttl.value_or(std::chrono::seconds(5));
+        _cache_prefetch = opts.cache_prefetch.value_or(0.9f);
+        if (_cache_enabled) {
+            register_cache_metrics(opts.cache_metrics_name ? *opts.cache_metrics_name : generate_metrics_name());
+        }
+
         // just in case you need printf-debug.
         // dns_log.set_level(log_level::trace);
     }
@@ -234,6 +247,49 @@ class net::dns_resolver::impl
     }
 
     future<hostent> get_host_by_name(sstring name, opt_family family)  {
+        if (!_cache_enabled) {
+            return query_host_by_name(std::move(name), family);
+        }
+        if (!family) {
+            auto res = inet_address::parse_numerical(name);
+            if (res) {
+                return make_ready_future<hostent>(hostent{ {name}, {*res}});
+            }
+        }
+        cache_key key{std::move(name), family ? int(*family) : AF_UNSPEC};
+        auto now = lowres_clock::now();
+        auto i = _cache.find(key);
+        if (i != _cache.end() && i->second.expires > now) {
+            auto& e = i->second;
+            if (e.error) {
+                _cache_stats.negative_hits++;
+                return make_exception_future<hostent>(e.error);
+            }
+            _cache_stats.hits++;
+            if (now >= e.refresh && !_inflight.contains(key)) {
+                _cache_stats.prefetches++;
+                dns_log.debug("Prefetch name {}", key.name);
+                (void)resolve_to_cache(key, family).handle_exception([me = shared_from_this()] (std::exception_ptr) {
+                    return hostent{};
+                });
+            }
+            return make_ready_future<hostent>(*e.host);
+        }
+        if (_inflight.contains(key)) {
+            _cache_stats.coalesced++;
+        } else {
+            _cache_stats.misses++;
+        }
+        return resolve_to_cache(std::move(key), family);
+    }
+
+    cache_stats get_cache_stats() const {
+        auto st = _cache_stats;
+        st.entries = _cache.size();
+        return st;
+    }
+
+    future<hostent> query_host_by_name(sstring name, opt_family family)  {
         class promise_wrap : public promise<hostent> {
         public:
             promise_wrap(sstring s)
@@ -286,6 +342,52 @@ class net::dns_resolver::impl
         });
     }
 
+    // Like query_host_by_name(), with ares_getaddrinfo(), which tells the
+    // TTL of the records
+    future<std::pair<hostent, std::chrono::seconds>> query_host_with_ttl(sstring name, opt_family family) {
+        using result_type = std::pair<hostent, std::chrono::seconds>;
+        class promise_wrap : public promise<result_type> {
+        public:
+            promise_wrap(sstring s)
+                : name(std::move(s))
+            {}
+            sstring name;
+        };
+
+        dns_log.debug("Query name {} ({}) with ttl", name, family);
+
+        auto p = new promise_wrap(std::move(name));
+        auto f = p->get_future();
+
+        dns_call call(*this);
+
+        ares_addrinfo_hints hints = {};
+        hints.ai_family = family ? int(*family) : AF_UNSPEC;
+        hints.ai_flags = ARES_AI_CANONNAME;
+
+        ares_getaddrinfo(_channel, p->name.c_str(), nullptr, &hints, [](void* arg, int status, int timeouts, ares_addrinfo* res) {
+            std::unique_ptr<promise_wrap> p(reinterpret_cast<promise_wrap *>(arg));
+            std::unique_ptr<ares_addrinfo, void(*)(ares_addrinfo*)> ai(res, &ares_freeaddrinfo);
+
+            if (status != ARES_SUCCESS) {
+                dns_log.debug("Query failed: {}", status);
+                p->set_exception(std::system_error(status, ares_errorc, p->name));
+                return;
+            }
+            try {
+                p->set_value(make_hostent(*ai, p->name));
+            } catch (...) {
+                p->set_exception(std::current_exception());
+            }
+        }, reinterpret_cast<void *>(p));
+
+        poll_sockets();
+
+        return f.finally([this] {
+            end_call();
+        });
+    }
+
     future<hostent> get_host_by_addr(inet_address addr) {
         class promise_wrap : public promise<hostent> {
         public:
@@ -509,6 +611,130 @@ class net::dns_resolver::impl
 
         return e;
     }
+    // Addresses of a single family, as in a ::hostent: that of the first
+    // one, which c-ares sorted by preference
+    static std::pair<hostent, std::chrono::seconds> make_hostent(const ares_addrinfo& ai, const sstring& query) {
+        hostent e;
+        int ttl = std::numeric_limits<int>::max();
+        e.names.emplace_back(ai.name ? ai.name : query.c_str());
+        for (auto c = ai.cnames; c != nullptr; c = c->next) {
+            ttl = std::min(ttl, c->ttl);
+            if (c->alias && e.names.front() != c->alias) {
+                e.names.emplace_back(c->alias);
+            }
+        }
+        int family = AF_UNSPEC;
+        for (auto n = ai.nodes; n != nullptr; n = n->ai_next) {
+            if (family == AF_UNSPEC) {
+                family = n->ai_family;
+            }
+            if (n->ai_family != family) {
+                continue;
+            }
+            switch (n->ai_family) {
+            case AF_INET:
+                e.addr_list.emplace_back(reinterpret_cast<const sockaddr_in*>(n->ai_addr)->sin_addr);
+                break;
+            case AF_INET6:
+                e.addr_list.emplace_back(reinterpret_cast<const sockaddr_in6*>(n->ai_addr)->sin6_addr);
+                break;
+            default:
+                continue;
+            }
+            ttl = std::min(ttl, n->ai_ttl);
+        }
+        if (e.addr_list.empty()) {
+            throw std::system_error(ARES_ENODATA, ares_errorc, query);
+        }
+
+        dns_log.debug("Query success: {}/{} ttl {}", e.names.front(), e.addr_list.front(), ttl);
+
+        return {std::move(e), std::chrono::seconds(std::max(ttl, 0))};
+    }
+
+    struct cache_key {
+        sstring name;
+        int family;
+
+        bool operator==(const cache_key&) const = default;
+    };
+    struct cache_key_hash {
+        size_t operator()(const cache_key& k) const noexcept {
+            return std::hash<sstring>()(k.name) ^ size_t(k.family);
+        }
+    };
+    struct cache_entry {
+        std::optional<hostent> host;
+        // Of a name which does not exist
+        std::exception_ptr error;
+        lowres_clock::time_point expires;
+        // After which a lookup refreshes the entry
+        lowres_clock::time_point refresh;
+    };
+
+    future<hostent> resolve_to_cache(cache_key key, opt_family family) {
+        auto i = _inflight.find(key);
+        if (i != _inflight.end()) {
+            return i->second.get_shared_future();
+        }
+        auto& pr = _inflight[key];
+        auto f = pr.get_shared_future();
+        (void)query_host_with_ttl(key.name, family).then_wrapped([this, key = std::move(key), me = shared_from_this()] (auto f) mutable {
+            auto i = _inflight.find(key);
+            auto pr = std::move(i->second);
+            _inflight.erase(i);
+            try {
+                auto [host, ttl] = f.get();
+                ttl = std::clamp(ttl, _cache_min_ttl, _cache_max_ttl);
+                auto now = lowres_clock::now();
+                auto refresh = now + std::chrono::duration_cast<lowres_clock::duration>(ttl * _cache_prefetch);
+                store_in_cache(std::move(key), cache_entry{host, nullptr, now + ttl, refresh});
+                pr.set_value(std::move(host));
+            } catch (const std::system_error& e) {
+                if (e.code().category() == ares_errorc && (e.code().value() == ARES_ENOTFOUND || e.code().value() == ARES_ENODATA)) {
+                    auto expires = lowres_clock::now() + _negative_ttl;
+                    store_in_cache(std::move(key), cache_entry{std::nullopt, std::current_exception(), expires, expires});
+                }
+                pr.set_exception(std::current_exception());
+            } catch (...) {
+                pr.set_exception(std::current_exception());
+            }
+        });
+        return f;
+    }
+
+    void store_in_cache(cache_key key, cache_entry e) {
+        if (_cache.size() >= _cache_size && !_cache.contains(key)) {
+            auto now = lowres_clock::now();
+            std::erase_if(_cache, [now] (const auto& p) {
+                return p.second.expires <= now;
+            });
+            if (_cache.size() >= _cache_size) {
+                _cache.erase(_cache.begin());
+            }
+        }
+        _cache.insert_or_assign(std::move(key), std::move(e));
+    }
+
+    static sstring generate_metrics_name() {
+        static thread_local uint16_t idgen;
+        return seastar::format("dns-{}", idgen++);
+    }
+
+    void register_cache_metrics(const sstring& name) {
+        namespace sm = seastar::metrics;
+        std::vector<sm::label_instance> labels;
+        labels.push_back(sm::label_instance("resolver", name));
+        _metrics.add_group("dns_cache", {
+            sm::make_counter("hits", [this] { return _cache_stats.hits; }, sm::description("Names resolved from the cache"), labels),
+            sm::make_counter("negative_hits", [this] { return _cache_stats.negative_hits; }, sm::description("Names known from the cache not to exist"), labels),
+            sm::make_counter("misses", [this] { return _cache_stats.misses; }, sm::description("Names queried for lack of a cache entry"), labels),
+            sm::make_counter("coalesced", [this] { return _cache_stats.coalesced; }, sm::description("Lookups which waited for a query in flight"), labels),
+            sm::make_counter("prefetches", [this] { return _cache_stats.prefetches; }, sm::description("Names refreshed before they expired"), labels),
+            sm::make_gauge("entries", [this] { return _cache.size(); }, sm::description("Names in the cache"), labels),
+        });
+    }
+
     // We need to partially ref-count our socket entries
     // when we have pending reads/writes, so we don't erase the
     // entry to early.
@@ -978,6 +1204,17 @@ class net::dns_resolver::impl
     timer<> _timer;
     gate _gate;
     bool _closed = false;
+
+    bool _cache_enabled;
+    size_t _cache_size;
+    std::chrono::seconds _cache_min_ttl;
+    std::chrono::seconds _cache_max_ttl;
+    std::chrono::seconds _negative_ttl;
+    float _cache_prefetch;
+    std::unordered_map<cache_key, cache_entry, cache_key_hash> _cache;
+    std::unordered_map<cache_key, shared_promise<hostent>, cache_key_hash> _inflight;
+    cache_stats _cache_stats;
+    metrics::metric_groups _metrics;
 };
 
 net::dns_resolver::dns_resolver()
@@ -1020,6 +1257,10 @@ future<net::dns_resolver::srv_records> net::dns_resolver::get_srv_records(net::d
     return _impl->get_srv_records(proto, service, domain);
 }
 
+net::dns_resolver::cache_stats net::dns_resolver::get_cache_stats() const {
+    return _impl->get_cache_stats();
+}
+
 future<> net::dns_resolver::close() {
     return _impl->close();
 }
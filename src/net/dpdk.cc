@@ -33,7 +33,9 @@
 #include <seastar/core/metrics.hh>
 #include <seastar/util/function_input_iterator.hh>
 #include <seastar/util/transform_iterator.hh>
+#include <seastar/util/spinlock.hh>
 #include <atomic>
+#include <mutex>
 #include <vector>
 #include <queue>
 #include <seastar/util/std-compat.hh>
@@ -57,6 +59,8 @@
 #include <rte_cycles.h>
 #include <rte_memzone.h>
 #include <rte_vfio.h>
+#include <rte_flow.h>
+#include <rte_errno.h>
 
 #if RTE_VERSION <= RTE_VERSION_NUM(2,0,0,16)
 
@@ -348,6 +352,11 @@ class dpdk_device : public device {
     bool _is_i40e_device = false;
     bool _is_vmxnet3_device = false;
     dpdk_xstats _xstats;
+    // Flow rules are created by all shards
+    util::spinlock _flow_lock;
+    std::atomic<bool> _flow_steering = { true };
+    std::atomic<uint64_t> _flow_rules = { 0 };
+    std::atomic<uint64_t> _flow_rule_failures = { 0 };
 
 public:
     rte_eth_dev_info _dev_info = {};
@@ -461,6 +470,13 @@ class dpdk_device : public device {
 
             sm::make_counter("tx_errors", _stats.tx.bad.total,
                             sm::description("Counts a total number of egress errors. A non-zero value usually indicated a problem with a HW or a SW driver."), {sm::shard_label(_stats_plugin_inst)}),
+            // Flow steering
+            sm::make_gauge("flow_rules", [this] { return _flow_rules.load(std::memory_order_relaxed); },
+                            sm::description("Holds a number of installed rules steering a connection to the queue of its shard."), {sm::shard_label(_stats_plugin_inst)}),
+
+            sm::make_counter("flow_rule_failures", [this] { return _flow_rule_failures.load(std::memory_order_relaxed); },
+                            sm::description("Counts a number of connections the port failed to install a steering rule for. "
+                                            "Packets of these connections reach their shard by software forwarding."), {sm::shard_label(_stats_plugin_inst)}),
         });
     }
 
@@ -496,6 +512,8 @@ class dpdk_device : public device {
     virtual uint16_t hw_queues_count() override { return _num_queues; }
     virtual future<> link_ready() override { return _link_ready_promise.get_future(); }
     virtual std::unique_ptr<qp> init_local_queue(const program_options::option_group& opts, uint16_t qid) override;
+    virtual std::unique_ptr<net::flow_rule> steer_flow(const net::flow_tuple& flow, unsigned cpu) override;
+    void destroy_flow(rte_flow* flow);
     virtual unsigned hash2qid(uint32_t hash) override {
         assert(_redir_table.size());
         return _redir_table[hash & (_redir_table.size() - 1)];
@@ -1239,7 +1257,10 @@ class dpdk_qp : public net::qp {
 
 public:
     explicit dpdk_qp(dpdk_device* dev, uint16_t qid,
-                     const std::string stats_plugin_name);
+                     const std::string stats_plugin_name,
+                     unsigned tx_burst = 1,
+                     std::chrono::microseconds tx_burst_delay = {},
+                     unsigned rx_zero_copy_mbufs = 0);
 
     virtual void rx_start() override;
     virtual future<> send(packet p) override {
@@ -1268,6 +1289,20 @@ class dpdk_qp : public net::qp {
     template <class Func>
     uint32_t _send(circular_buffer<packet>& pb, Func packet_to_tx_buf_p) {
         if (_tx_burst.size() == 0) {
+            // Hold small bursts back for a while, one doorbell for many
+            // packets is what gets small packets to line rate
+            if (pb.size() < _tx_burst_min) {
+                auto now = std::chrono::steady_clock::now();
+                if (!_tx_held_since) {
+                    _tx_held_since = now;
+                }
+                if (now - *_tx_held_since < _tx_burst_delay) {
+                    _tx_deferred++;
+                    return 0;
+                }
+            }
+            _tx_held_since.reset();
+
             for (auto&& p : pb) {
                 // TODO: assert() in a fast path! Remove me ASAP!
                 assert(p.len());
@@ -1284,6 +1319,7 @@ class dpdk_qp : public net::qp {
         uint16_t sent = rte_eth_tx_burst(_dev->port_idx(), _qid,
                                          _tx_burst.data() + _tx_burst_idx,
                                          _tx_burst.size() - _tx_burst_idx);
+        _tx_doorbells++;
 
         uint64_t nr_frags = 0, bytes = 0;
 
@@ -1404,6 +1440,16 @@ class dpdk_qp : public net::qp {
      */
     std::optional<packet> from_mbuf_lro(rte_mbuf* m);
 
+    /**
+     * Transform an mbufs' cluster into a "packet" whose fragments point to
+     * the mbufs' data, and which returns the cluster to its pool when it's
+     * destroyed.
+     * @param m HEAD of the mbufs' cluster to transform
+     *
+     * @return the newly received packet
+     */
+    packet from_mbuf_zero_copy(rte_mbuf* m);
+
 private:
     dpdk_device* _dev;
     uint16_t _qid;
@@ -1415,11 +1461,25 @@ class dpdk_qp : public net::qp {
     size_t _num_rx_free_segs = 0;
     reactor::poller _rx_gc_poller;
     std::unique_ptr<void, free_deleter> _rx_xmem;
+    // Without hugetlbfs backing: mbufs of received packets the application
+    // may hold at once, beyond which packets are copied so that the Rx ring
+    // can still be refilled
+    unsigned _rx_zero_copy_mbufs;
+    unsigned _rx_mbufs_held = 0;
+    uint64_t _rx_zero_copy_packets = 0;
+    uint64_t _rx_copied_packets = 0;
     tx_buf_factory _tx_buf_factory;
     std::optional<reactor::poller> _rx_poller;
     reactor::poller _tx_gc_poller;
     std::vector<rte_mbuf*> _tx_burst;
     uint16_t _tx_burst_idx = 0;
+    // Packets to accumulate before calling rte_eth_tx_burst(), and for
+    // how long at most
+    unsigned _tx_burst_min;
+    std::chrono::microseconds _tx_burst_delay;
+    std::optional<std::chrono::steady_clock::time_point> _tx_held_since;
+    uint64_t _tx_doorbells = 0;
+    uint64_t _tx_deferred = 0;
     static constexpr phys_addr_t page_mask = ~(memory::page_size - 1);
 };
 
@@ -1481,7 +1541,10 @@ int dpdk_device::init_port_start()
         DEV_TX_OFFLOAD_GRE_TNL_TSO      |
         DEV_TX_OFFLOAD_IPIP_TNL_TSO     |
         DEV_TX_OFFLOAD_GENEVE_TNL_TSO   |
-        DEV_TX_OFFLOAD_MACSEC_INSERT;
+        DEV_TX_OFFLOAD_MACSEC_INSERT    |
+        // Completed mbufs may be freed in bulk: each Tx queue sends mbufs
+        // from its own pool only and never shares them
+        DEV_TX_OFFLOAD_MBUF_FAST_FREE;
 
     _dev_info.default_txconf.offloads =
         _dev_info.tx_offload_capa & tx_offloads_wanted;
@@ -1923,12 +1986,20 @@ void dpdk_device::check_port_link_status()
 
 template <bool HugetlbfsMemBackend>
 dpdk_qp<HugetlbfsMemBackend>::dpdk_qp(dpdk_device* dev, uint16_t qid,
-                                      const std::string stats_plugin_name)
+                                      const std::string stats_plugin_name,
+                                      unsigned tx_burst,
+                                      std::chrono::microseconds tx_burst_delay,
+                                      unsigned rx_zero_copy_mbufs)
      : qp(true, stats_plugin_name, qid), _dev(dev), _qid(qid),
        _rx_gc_poller(reactor::poller::simple([&] { return rx_gc(); })),
+       _rx_zero_copy_mbufs(rx_zero_copy_mbufs),
        _tx_buf_factory(qid),
-       _tx_gc_poller(reactor::poller::simple([&] { return _tx_buf_factory.gc(); }))
+       _tx_gc_poller(reactor::poller::simple([&] { return _tx_buf_factory.gc(); })),
+       _tx_burst_min(std::min(tx_burst, unsigned(default_ring_size))),
+       _tx_burst_delay(tx_burst_delay)
 {
+    set_tx_refill_threshold(_tx_burst_min);
+
     if (!init_rx_mbuf_pool()) {
         rte_exit(EXIT_FAILURE, "Cannot initialize mbuf pools\n");
     }
@@ -1971,7 +2042,30 @@ dpdk_qp<HugetlbfsMemBackend>::dpdk_qp(dpdk_device* dev, uint16_t qid,
         sm::make_counter(_queue_name + "_rx_no_memory_errors", _stats.rx.bad.no_mem,
                         sm::description("Counts a number of ingress packets received by this HW queue but dropped by the SW due to low memory. "
                                         "A non-zero value indicates that seastar doesn't have enough memory to handle the packet reception or the memory is too fragmented.")),
+
+        sm::make_counter(_queue_name + "_tx_bursts", _tx_doorbells,
+                        sm::description(format("Counts a number of Tx bursts handed to the HW queue. Divide a {} by this value to get an average Tx burst size.", _queue_name + "_tx_packets"))),
+
+        sm::make_counter(_queue_name + "_tx_deferred", _tx_deferred,
+                        sm::description("Counts a number of polls that held Tx packets back to accumulate a larger burst.")),
+
+        sm::make_gauge(_queue_name + "_rx_mbufs_available", [this] { return rte_mempool_avail_count(_pktmbuf_pool_rx); },
+                        sm::description("Number of free mbufs in the Rx pool of this queue. A value close to zero means the HW queue may run out of buffers to receive into.")),
     });
+
+    if (!HugetlbfsMemBackend) {
+        _metrics.add_group(_stats_plugin_name, {
+            sm::make_gauge(_queue_name + "_rx_mbufs_held", _rx_mbufs_held,
+                            sm::description("Number of Rx mbufs held by the application through zero-copy packets.")),
+
+            sm::make_counter(_queue_name + "_rx_zero_copy_packets", _rx_zero_copy_packets,
+                            sm::description("Counts a number of packets handed to the application in the Rx mbufs they were received into.")),
+
+            sm::make_counter(_queue_name + "_rx_copied_packets", _rx_copied_packets,
+                            sm::description(format("Counts a number of packets copied out of their Rx mbufs because the application held too many of them. "
+                                                   "Packets are copied while {} is at the limit set by --dpdk-rx-zero-copy-mbufs.", _queue_name + "_rx_mbufs_held"))),
+        });
+    }
 }
 
 #pragma GCC diagnostic pop
@@ -2015,10 +2109,42 @@ dpdk_qp<false>::from_mbuf_lro(rte_mbuf* m)
     return std::nullopt;
 }
 
+template <bool HugetlbfsMemBackend>
+inline packet
+dpdk_qp<HugetlbfsMemBackend>::from_mbuf_zero_copy(rte_mbuf* m)
+{
+    _frags.clear();
+    for (rte_mbuf* m1 = m; m1 != nullptr; m1 = m1->next) {
+        _frags.emplace_back(fragment{rte_pktmbuf_mtod(m1, char*), rte_pktmbuf_data_len(m1)});
+    }
+    unsigned nb_segs = m->nb_segs;
+    _rx_mbufs_held += nb_segs;
+    _rx_zero_copy_packets++;
+    //
+    // Packets passed to other shards are freed back on this one (see
+    // packet::free_on_cpu()), so the deleter runs here.
+    //
+    return packet(_frags.begin(), _frags.end(),
+                  make_deleter(deleter(), [this, m, nb_segs] {
+                      _rx_mbufs_held -= nb_segs;
+                      rte_pktmbuf_free(m);
+                  }));
+}
+
 template<>
 inline std::optional<packet>
 dpdk_qp<false>::from_mbuf(rte_mbuf* m)
 {
+    //
+    // Hand the mbufs to the application unless it already holds so many of
+    // them that the HW ring could run dry; copy the data out then.
+    //
+    if (_rx_mbufs_held + m->nb_segs <= _rx_zero_copy_mbufs) {
+        return from_mbuf_zero_copy(m);
+    }
+    if (_rx_zero_copy_mbufs) {
+        _rx_copied_packets++;
+    }
     if (!_dev->hw_features_ref().rx_lro || rte_pktmbuf_is_contiguous(m)) {
         //
         // Try to allocate a buffer for packet's data. If we fail - give the
@@ -2185,8 +2311,9 @@ void dpdk_qp<HugetlbfsMemBackend>::process_packets(
             (*p).set_rss_hash(m->hash.rss);
         }
 
-        _dev->l2receive(std::move(*p));
+        gro_receive(std::move(*p));
     }
+    gro_flush();
 
     _stats.rx.good.update_pkts_bunch(count);
     _stats.rx.good.update_frags_stats(nr_frags, bytes);
@@ -2243,17 +2370,110 @@ void dpdk_device::set_rss_table()
     }
 }
 
+class dpdk_flow_rule final : public net::flow_rule {
+    dpdk_device& _dev;
+    rte_flow* _flow;
+public:
+    dpdk_flow_rule(dpdk_device& dev, rte_flow* flow) : _dev(dev), _flow(flow) {}
+    ~dpdk_flow_rule() {
+        _dev.destroy_flow(_flow);
+    }
+};
+
+std::unique_ptr<net::flow_rule> dpdk_device::steer_flow(const net::flow_tuple& flow, unsigned cpu) {
+    // there is an assumption here that qid == cpu_id, shards without a
+    // queue of their own can only be reached by forwarding
+    if (!_flow_steering.load(std::memory_order_relaxed) || cpu >= _num_queues) {
+        return nullptr;
+    }
+
+    rte_flow_attr attr = {};
+    attr.ingress = 1;
+
+    rte_flow_item_ipv4 ip_spec = {}, ip_mask = {};
+    ip_spec.hdr.src_addr = rte_cpu_to_be_32(flow.src_ip.ip);
+    ip_spec.hdr.dst_addr = rte_cpu_to_be_32(flow.dst_ip.ip);
+    ip_mask.hdr.src_addr = ip_mask.hdr.dst_addr = UINT32_MAX;
+
+    rte_flow_item_tcp tcp_spec = {}, tcp_mask = {};
+    rte_flow_item_udp udp_spec = {}, udp_mask = {};
+    rte_flow_item l4 = {};
+    if (flow.proto == ip_protocol_num::tcp) {
+        tcp_spec.hdr.src_port = rte_cpu_to_be_16(flow.src_port);
+        tcp_spec.hdr.dst_port = rte_cpu_to_be_16(flow.dst_port);
+        tcp_mask.hdr.src_port = tcp_mask.hdr.dst_port = UINT16_MAX;
+        l4 = { RTE_FLOW_ITEM_TYPE_TCP, &tcp_spec, nullptr, &tcp_mask };
+    } else if (flow.proto == ip_protocol_num::udp) {
+        udp_spec.hdr.src_port = rte_cpu_to_be_16(flow.src_port);
+        udp_spec.hdr.dst_port = rte_cpu_to_be_16(flow.dst_port);
+        udp_mask.hdr.src_port = udp_mask.hdr.dst_port = UINT16_MAX;
+        l4 = { RTE_FLOW_ITEM_TYPE_UDP, &udp_spec, nullptr, &udp_mask };
+    } else {
+        return nullptr;
+    }
+
+    rte_flow_item pattern[] = {
+        { RTE_FLOW_ITEM_TYPE_ETH, nullptr, nullptr, nullptr },
+        { RTE_FLOW_ITEM_TYPE_IPV4, &ip_spec, nullptr, &ip_mask },
+        l4,
+        { RTE_FLOW_ITEM_TYPE_END, nullptr, nullptr, nullptr },
+    };
+    rte_flow_action_queue queue = {};
+    queue.index = cpu;
+    rte_flow_action actions[] = {
+        { RTE_FLOW_ACTION_TYPE_QUEUE, &queue },
+        { RTE_FLOW_ACTION_TYPE_END, nullptr },
+    };
+
+    rte_flow_error error = {};
+    rte_flow* f;
+    {
+        std::lock_guard<util::spinlock> g(_flow_lock);
+        f = rte_flow_create(_port_idx, &attr, pattern, actions, &error);
+    }
+    if (!f) {
+        _flow_rule_failures.fetch_add(1, std::memory_order_relaxed);
+        // Don't retry on every connection if the port has no flow API at all
+        if (rte_errno == ENOSYS || rte_errno == ENOTSUP) {
+            if (_flow_steering.exchange(false, std::memory_order_relaxed)) {
+                printf("Port %d: flow steering is not supported: %s\n", _port_idx,
+                       error.message ? error.message : "unknown error");
+            }
+        }
+        return nullptr;
+    }
+    _flow_rules.fetch_add(1, std::memory_order_relaxed);
+    return std::make_unique<dpdk_flow_rule>(*this, f);
+}
+
+void dpdk_device::destroy_flow(rte_flow* flow) {
+    rte_flow_error error;
+    std::lock_guard<util::spinlock> g(_flow_lock);
+    rte_flow_destroy(_port_idx, flow, &error);
+    _flow_rules.fetch_sub(1, std::memory_order_relaxed);
+}
+
 std::unique_ptr<qp> dpdk_device::init_local_queue(const program_options::option_group& opts, uint16_t qid) {
     auto net_opts = dynamic_cast<const net::native_stack_options*>(&opts);
     assert(net_opts);
 
+    auto tx_burst = net_opts->dpdk_opts.tx_burst.get_value();
+    auto tx_burst_delay = std::chrono::microseconds(net_opts->dpdk_opts.tx_burst_delay.get_value());
+    auto rx_zero_copy_mbufs = std::min(net_opts->dpdk_opts.rx_zero_copy_mbufs.get_value(),
+                                       unsigned(mbufs_per_queue_rx - default_ring_size));
     std::unique_ptr<qp> qp;
     if (net_opts->_hugepages) {
         qp = std::make_unique<dpdk_qp<true>>(this, qid,
-                                 _stats_plugin_name + "-" + _stats_plugin_inst);
+                                 _stats_plugin_name + "-" + _stats_plugin_inst, tx_burst, tx_burst_delay);
     } else {
         qp = std::make_unique<dpdk_qp<false>>(this, qid,
-                                 _stats_plugin_name + "-" + _stats_plugin_inst);
+                                 _stats_plugin_name + "-" + _stats_plugin_inst, tx_burst, tx_burst_delay,
+                                 rx_zero_copy_mbufs);
+    }
+    // Coalesce in software when the NIC can't. The merged segments keep
+    // the checksums of the first one, so the NIC must have verified them.
+    if (_use_lro && !_hw_features.rx_lro && _hw_features.rx_csum_offload) {
+        qp->enable_gro();
     }
 
     // FIXME: future is discarded
@@ -2315,10 +2535,23 @@ dpdk_options::dpdk_options(program_options::option_group* parent_group)
     , hw_fc(*this, "hw-fc",
                 "on",
                 "Enable HW Flow Control (on / off)")
+    , tx_burst(*this, "dpdk-tx-burst",
+                1,
+                "Number of packets to accumulate before handing them to the NIC")
+    , tx_burst_delay(*this, "dpdk-tx-burst-delay",
+                20,
+                "Maximum time (in us) to hold packets back to accumulate a Tx burst")
+    , rx_zero_copy_mbufs(*this, "dpdk-rx-zero-copy-mbufs",
+                256,
+                "Without --hugepages: number of Rx mbufs per queue the application may hold through received packets, "
+                "beyond which packets are copied out of them (0 to always copy)")
 #else
     : program_options::option_group(parent_group, "DPDK net options", program_options::unused{})
     , dpdk_port_index(*this, "dpdk-port-index", program_options::unused{})
     , hw_fc(*this, "hw-fc", program_options::unused{})
+    , tx_burst(*this, "dpdk-tx-burst", program_options::unused{})
+    , tx_burst_delay(*this, "dpdk-tx-burst-delay", program_options::unused{})
+    , rx_zero_copy_mbufs(*this, "dpdk-rx-zero-copy-mbufs", program_options::unused{})
 #endif
 #if 0
     opts.add_options()
@@ -0,0 +1,169 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#include "gro.hh"
+#include <seastar/net/ethernet.hh>
+#include <seastar/net/ip.hh>
+#include <seastar/net/tcp.hh>
+#include <algorithm>
+#include <cstring>
+
+namespace seastar {
+
+namespace net {
+
+struct gro::segment {
+    ipv4_address src_ip;
+    ipv4_address dst_ip;
+    uint16_t src_port;
+    uint16_t dst_port;
+    uint32_t seq;
+    uint32_t ack;
+    uint16_t window;
+    size_t hdr_len;
+    size_t payload_len;
+    bool psh;
+    // A data segment carrying no control flags other than ACK and PSH
+    bool mergeable;
+};
+
+static constexpr size_t tcp_offset = sizeof(eth_hdr) + sizeof(ip_hdr);
+
+gro::gro(noncopyable_function<void (packet)> deliver)
+    : _deliver(std::move(deliver)) {
+    _flows.reserve(max_flows);
+}
+
+std::optional<gro::segment> gro::parse(packet& p) {
+    auto eh = p.get_header<eth_hdr>(0);
+    if (!eh || ntoh(eh->eth_proto) != uint16_t(eth_protocol_num::ipv4)) {
+        return std::nullopt;
+    }
+    auto iph = p.get_header<ip_hdr>(sizeof(eth_hdr));
+    if (!iph) {
+        return std::nullopt;
+    }
+    auto ip = ntoh(*iph);
+    // Leave IP options and fragments to the slow path
+    if (ip.ver != 4 || ip.ihl != sizeof(ip_hdr) / 4 || ip.ip_proto != uint8_t(ip_protocol_num::tcp)
+            || ip.mf() || ip.offset() || ip.len > p.len() - sizeof(eth_hdr)) {
+        return std::nullopt;
+    }
+    auto th = p.get_header(tcp_offset, tcp_hdr::len);
+    if (!th) {
+        return std::nullopt;
+    }
+    auto h = tcp_hdr::read(th);
+    auto hdr_len = tcp_offset + h.data_offset * 4;
+    if (h.data_offset * 4 < tcp_hdr::len || hdr_len > sizeof(eth_hdr) + ip.len) {
+        return std::nullopt;
+    }
+    segment s;
+    s.src_ip = ip.src_ip;
+    s.dst_ip = ip.dst_ip;
+    s.src_port = h.src_port;
+    s.dst_port = h.dst_port;
+    s.seq = h.seq.raw;
+    s.ack = h.ack.raw;
+    s.window = h.window;
+    s.hdr_len = hdr_len;
+    s.payload_len = sizeof(eth_hdr) + ip.len - hdr_len;
+    s.psh = h.f_psh;
+    // Ethernet padding would end up in the middle of the merged payload
+    s.mergeable = h.f_ack && !h.f_syn && !h.f_fin && !h.f_rst && !h.f_urg && !h.rsvd2
+            && s.payload_len && sizeof(eth_hdr) + ip.len == p.len();
+    return s;
+}
+
+void gro::deliver(std::vector<flow>::iterator f) {
+    auto p = std::move(f->p);
+    _flows.erase(f);
+    _deliver(std::move(p));
+}
+
+void gro::receive(packet p) {
+    auto s = parse(p);
+    if (!s) {
+        _deliver(std::move(p));
+        return;
+    }
+    auto vlan_tci = p.offload_info_ref().vlan_tci;
+    auto f = std::find_if(_flows.begin(), _flows.end(), [&] (const flow& f) {
+        return f.src_ip == s->src_ip && f.dst_ip == s->dst_ip
+                && f.src_port == s->src_port && f.dst_port == s->dst_port
+                && f.vlan_tci == vlan_tci;
+    });
+    if (!s->mergeable) {
+        // Keep the flow's segments in order
+        if (f != _flows.end()) {
+            deliver(f);
+        }
+        _deliver(std::move(p));
+        return;
+    }
+    if (f != _flows.end()) {
+        if (s->seq == f->next_seq && s->ack == f->ack && s->hdr_len == f->hdr_len
+                && f->p.len() - sizeof(eth_hdr) + s->payload_len <= ip_packet_len_max
+                && !std::memcmp(p.get_header(tcp_offset + tcp_hdr::len, s->hdr_len - tcp_offset - tcp_hdr::len),
+                                f->p.get_header(tcp_offset + tcp_hdr::len, s->hdr_len - tcp_offset - tcp_hdr::len),
+                                s->hdr_len - tcp_offset - tcp_hdr::len)) {
+            p.trim_front(s->hdr_len);
+            f->p.append(std::move(p));
+            f->next_seq += s->payload_len;
+            ++_merged;
+
+            auto iph = f->p.get_header<ip_hdr>(sizeof(eth_hdr));
+            iph->len = hton(uint16_t(f->p.len() - sizeof(eth_hdr)));
+            iph->csum = 0;
+            checksummer csum;
+            csum.sum(reinterpret_cast<char*>(iph), sizeof(*iph));
+            iph->csum = csum.get();
+            // The latest window and push flag apply to the merged segment
+            auto th = f->p.get_header(tcp_offset, tcp_hdr::len);
+            write_be<uint16_t>(th + 14, s->window);
+            if (s->psh) {
+                th[13] |= 1 << 3;
+                deliver(f);
+            }
+            return;
+        }
+        deliver(f);
+    }
+    if (s->psh) {
+        _deliver(std::move(p));
+        return;
+    }
+    if (_flows.size() == max_flows) {
+        deliver(_flows.begin());
+    }
+    _flows.push_back(flow{std::move(p), s->src_ip, s->dst_ip, s->src_port, s->dst_port, vlan_tci,
+            s->seq + uint32_t(s->payload_len), s->ack, s->hdr_len});
+}
+
+void gro::flush() {
+    while (!_flows.empty()) {
+        deliver(_flows.begin());
+    }
+}
+
+}
+
+}
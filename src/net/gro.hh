@@ -0,0 +1,78 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#pragma once
+
+#include <seastar/net/packet.hh>
+#include <seastar/net/ipv4_address.hh>
+#include <seastar/util/noncopyable_function.hh>
+#include <optional>
+#include <vector>
+
+namespace seastar {
+
+namespace net {
+
+// Software generic receive offload.
+//
+// Merges consecutive in-order data segments of a TCP/IPv4 flow received
+// within one poll batch into a single packet, the way LRO capable NICs do,
+// so that the stack above runs once per batch and flow rather than once
+// per segment. Only the first segment's headers are kept, with the IP
+// length and checksum fixed up; the TCP checksum is not, so this must
+// only be used when the device verified the checksums already.
+class gro {
+public:
+    static constexpr unsigned max_flows = 8;
+private:
+    struct flow {
+        packet p;
+        ipv4_address src_ip;
+        ipv4_address dst_ip;
+        uint16_t src_port;
+        uint16_t dst_port;
+        std::optional<uint16_t> vlan_tci;
+        uint32_t next_seq;
+        uint32_t ack;
+        size_t hdr_len;
+    };
+    struct segment;
+    noncopyable_function<void (packet)> _deliver;
+    // Flows with a packet held, oldest first
+    std::vector<flow> _flows;
+    uint64_t _merged = 0;
+public:
+    explicit gro(noncopyable_function<void (packet)> deliver);
+    // Queues a received ethernet frame, merging it into a held packet of
+    // its flow when possible
+    void receive(packet p);
+    // Passes up all held packets, to be called at the end of a batch
+    void flush();
+    // Number of segments merged into earlier ones
+    uint64_t merged() const noexcept { return _merged; }
+private:
+    static std::optional<segment> parse(packet& p);
+    void deliver(std::vector<flow>::iterator f);
+};
+
+}
+
+}
@@ -73,7 +73,25 @@ ipv4::ipv4(interface* netif)
         //
         sm::make_counter("linearizations", [] { return ipv4_packet_merger::linearizations(); },
                         sm::description("Counts a number of times a buffer linearization was invoked during buffers merge process. "
-                                        "Divide it by a total IPv4 receive packet rate to get an average number of lineraizations per packet."))
+                                        "Divide it by a total IPv4 receive packet rate to get an average number of lineraizations per packet.")),
+    });
+
+    //
+    // Drops by reason: DERIVE:0:U
+    //
+    auto drops = [] (uint64_t& counter, const char* reason) {
+        return sm::make_counter("rx_drops", counter,
+                        sm::description("Counts a number of received packets dropped by IPv4, by reason. Fragments are counted by datagram."),
+                        {sm::label_instance("reason", reason)});
+    };
+    _metrics.add_group("ipv4", {
+        drops(_rx_drops.bad_header, "bad_header"),
+        drops(_rx_drops.bad_checksum, "bad_checksum"),
+        drops(_rx_drops.bad_length, "bad_length"),
+        drops(_rx_drops.not_for_us, "not_for_us"),
+        drops(_rx_drops.unknown_protocol, "unknown_protocol"),
+        drops(_rx_drops.frag_timeout, "fragment_timeout"),
+        drops(_rx_drops.frag_no_memory, "fragment_no_memory"),
     });
     _frag_timer.set_callback([this] { frag_timeout(); });
 }
@@ -118,6 +136,7 @@ future<>
 ipv4::handle_received_packet(packet p, ethernet_address from) {
     auto iph = p.get_header<ip_hdr>(0);
     if (!iph) {
+        _rx_drops.bad_header++;
         return make_ready_future<>();
     }
 
@@ -126,6 +145,7 @@ ipv4::handle_received_packet(packet p, ethernet_address from) {
         checksummer csum;
         csum.sum(reinterpret_cast<char*>(iph), sizeof(*iph));
         if (csum.get() != 0) {
+            _rx_drops.bad_checksum++;
             return make_ready_future<>();
         }
     }
@@ -140,10 +160,12 @@ ipv4::handle_received_packet(packet p, ethernet_address from) {
         p.trim_back(pkt_len - ip_len);
     } else if (pkt_len < ip_len) {
         // Drop if it contains less than IP total length
+        _rx_drops.bad_length++;
         return make_ready_future<>();
     }
     // Drop if the reassembled datagram will be larger than maximum IP size
     if (offset + p.len() > net::ip_packet_len_max) {
+        _rx_drops.bad_length++;
         return make_ready_future<>();
     }
 
@@ -162,6 +184,7 @@ ipv4::handle_received_packet(packet p, ethernet_address from) {
 
     if (h.dst_ip != _host_address) {
         // FIXME: forward
+        _rx_drops.not_for_us++;
         return make_ready_future<>();
     }
 
@@ -205,6 +228,8 @@ ipv4::handle_received_packet(packet p, ethernet_address from) {
                         _netif->forward(cpu_id, std::move(pkt));
                     }
                 }
+            } else {
+                _rx_drops.unknown_protocol++;
             }
 
             // Delete this frag from _frags and _frags_age
@@ -224,6 +249,8 @@ ipv4::handle_received_packet(packet p, ethernet_address from) {
         // Trim IP header and pass to upper layer
         p.trim_front(ip_hdr_len);
         l4->received(std::move(p), h.src_ip, h.dst_ip);
+    } else {
+        _rx_drops.unknown_protocol++;
     }
     return make_ready_future<>();
 }
@@ -373,6 +400,7 @@ void ipv4::frag_limit_mem() {
         auto& frag = _frags[frag_id];
         auto dropped_size = frag.mem_size;
         frag_drop(frag_id, dropped_size);
+        _rx_drops.frag_no_memory++;
 
         drop -= std::min(drop, dropped_size);
     }
@@ -390,6 +418,7 @@ void ipv4::frag_timeout() {
             auto dropped_size = frag.mem_size;
             // Drop from _frags
             frag_drop(frag_id, dropped_size);
+            _rx_drops.frag_timeout++;
             // Drop from _frags_age
             it = _frags_age.erase(it);
         } else {
@@ -22,17 +22,93 @@
 #include <seastar/net/ip_checksum.hh>
 #include <seastar/net/net.hh>
 #include <arpa/inet.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
 
 namespace seastar {
 
 namespace net {
 
+namespace {
+
+// Vector kernels sum blocks of this many bytes
+constexpr size_t vector_block = 32;
+// Below which the scalar loop is as fast
+constexpr size_t vector_threshold = 128;
+
+uint16_t fold(unsigned __int128 sum) {
+    uint64_t s = uint64_t(sum) + uint64_t(sum >> 64);
+    s += s < uint64_t(sum); // end-around carry
+    s = (s & 0xffff'ffff) + (s >> 32);
+    s = (s & 0xffff) + (s >> 16);
+    s = (s & 0xffff) + (s >> 16);
+    s = (s & 0xffff) + (s >> 16);
+    return s;
+}
+
+// The kernels sum a multiple of vector_block bytes as 32-bit words in
+// host order, into 64-bit lanes, and return the sum folded to 16 bits, in
+// host order too: a ones' complement sum is the same in both byte orders,
+// up to swapping the bytes of the result.
+
+#if defined(__x86_64__)
+
+[[gnu::target("avx2")]]
+uint16_t sum_avx2(const char* data, size_t len) {
+    auto zero = _mm256_setzero_si256();
+    auto acc = zero;
+    for (; len; data += vector_block, len -= vector_block) {
+        auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data));
+        acc = _mm256_add_epi64(acc, _mm256_unpacklo_epi32(v, zero));
+        acc = _mm256_add_epi64(acc, _mm256_unpackhi_epi32(v, zero));
+    }
+    uint64_t lanes[4];
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), acc);
+    return fold((unsigned __int128)lanes[0] + lanes[1] + lanes[2] + lanes[3]);
+}
+
+const bool have_avx2 = [] {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}();
+
+uint16_t (*const vector_sum)(const char*, size_t) = have_avx2 ? sum_avx2 : nullptr;
+
+#elif defined(__aarch64__)
+
+uint16_t sum_neon(const char* data, size_t len) {
+    auto acc = vdupq_n_u64(0);
+    for (; len; data += 16, len -= 16) {
+        acc = vpadalq_u32(acc, vld1q_u32(reinterpret_cast<const uint32_t*>(data)));
+    }
+    return fold((unsigned __int128)vgetq_lane_u64(acc, 0) + vgetq_lane_u64(acc, 1));
+}
+
+uint16_t (*const vector_sum)(const char*, size_t) = sum_neon;
+
+#else
+
+uint16_t (*const vector_sum)(const char*, size_t) = nullptr;
+
+#endif
+
+}
+
 void checksummer::sum(const char* data, size_t len) {
     auto orig_len = len;
     if (odd) {
         csum += uint8_t(*data++);
         --len;
     }
+    if (len >= vector_threshold && vector_sum) {
+        auto n = len & ~(vector_block - 1);
+        csum += ntohs(vector_sum(data, n));
+        data += n;
+        len -= n;
+    }
     auto p64 = reinterpret_cast<const packed<uint64_t>*>(data);
     while (len >= 8) {
         csum += ntohq(*p64++);
@@ -0,0 +1,166 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+
+#include <seastar/net/memory_budget.hh>
+#include <seastar/net/stack.hh>
+#include <seastar/core/metrics.hh>
+#include <seastar/core/shared_ptr.hh>
+#include <algorithm>
+
+namespace seastar {
+
+namespace net {
+
+// Bytes charged by a stream, shared with the buffers it returned, which
+// may outlive it
+using stream_charge = lw_shared_ptr<size_t>;
+
+class connection_memory_budget::source final : public data_source_impl {
+    connection_memory_budget& _budget;
+    data_source _src;
+    stream_charge _held = make_lw_shared<size_t>(0);
+public:
+    source(connection_memory_budget& budget, data_source src)
+        : _budget(budget), _src(std::move(src)) {
+        _budget._streams++;
+    }
+    ~source() {
+        _budget._streams--;
+    }
+    future<temporary_buffer<char>> get() override {
+        return _budget.maybe_wait(*_held, _budget._paused_reads).then([this] {
+            return _src.get();
+        }).then([this] (temporary_buffer<char> buf) {
+            if (buf.empty()) {
+                return buf;
+            }
+            auto n = buf.size();
+            *_held += n;
+            auto d = make_deleter(buf.release(), [units = consume_units(_budget._sem, n), held = _held, n] {
+                *held -= n;
+            });
+            return temporary_buffer<char>(buf.get_write(), n, std::move(d));
+        });
+    }
+    future<temporary_buffer<char>> skip(uint64_t n) override {
+        return _src.skip(n);
+    }
+    future<> close() override {
+        return _src.close();
+    }
+    void cancel() noexcept override {
+        _src.cancel();
+    }
+};
+
+class connection_memory_budget::sink final : public data_sink_impl {
+    connection_memory_budget& _budget;
+    data_sink _sink;
+    size_t _held = 0;
+public:
+    sink(connection_memory_budget& budget, data_sink sink)
+        : _budget(budget), _sink(std::move(sink)) {
+        _budget._streams++;
+    }
+    ~sink() {
+        _budget._streams--;
+    }
+    temporary_buffer<char> allocate_buffer(size_t size) override {
+        return _sink.allocate_buffer(size);
+    }
+    future<> put(net::packet p) override {
+        return _budget.maybe_wait(_held, _budget._paused_writes).then([this, p = std::move(p)] () mutable {
+            auto n = p.len();
+            auto units = consume_units(_budget._sem, n);
+            _held += n;
+            return _sink.put(std::move(p)).finally([this, units = std::move(units), n] {
+                _held -= n;
+            });
+        });
+    }
+    future<> put_file(file& f, uint64_t pos, uint64_t len) override {
+        return _sink.put_file(f, pos, len);
+    }
+    future<> flush() override {
+        return _sink.flush();
+    }
+    future<> close() override {
+        return _sink.close();
+    }
+    size_t buffer_size() const noexcept override {
+        return _sink.buffer_size();
+    }
+};
+
+connection_memory_budget::connection_memory_budget(size_t memory, sstring name)
+    : _sem(memory)
+    , _memory(memory)
+{
+    if (name.empty()) {
+        return;
+    }
+    namespace sm = seastar::metrics;
+    std::vector<sm::label_instance> labels{sm::label_instance("server", name)};
+    _metrics.add_group("connection_memory", {
+        sm::make_gauge("memory_bytes", [this] { return _memory; },
+                sm::description("The memory the buffers of the connections may take up"), labels),
+        sm::make_gauge("used_bytes", [this] { return used(); },
+                sm::description("The memory taken up by the buffers of the connections"), labels),
+        sm::make_gauge("streams", [this] { return _streams; },
+                sm::description("The number of connection streams charging the budget"), labels),
+        sm::make_counter("paused_reads", [this] { return _paused_reads; },
+                sm::description("The number of reads delayed because the budget was used up"), labels),
+        sm::make_counter("paused_writes", [this] { return _paused_writes; },
+                sm::description("The number of sends delayed because the budget was used up"), labels),
+    });
+}
+
+future<> connection_memory_budget::maybe_wait(size_t held, uint64_t& paused) {
+    if (held <= fair_share() || _sem.available_units() > 0) {
+        return make_ready_future<>();
+    }
+    paused++;
+    // Only waits for some memory to be released, the stream then charges
+    // what it actually reads or sends
+    return get_units(_sem, 1).discard_result();
+}
+
+input_stream<char> connection_memory_budget::input(connected_socket& s, connected_socket_input_stream_config csisc) {
+    // The share once this stream is added
+    auto share = _memory / (_streams + 1);
+    csisc.max_buffer_size = std::max<size_t>(csisc.min_buffer_size, std::min<size_t>(csisc.max_buffer_size, share));
+    csisc.buffer_size = std::clamp(csisc.buffer_size, csisc.min_buffer_size, csisc.max_buffer_size);
+    return input_stream<char>(data_source(std::make_unique<source>(*this, s._csi->source(csisc))));
+}
+
+output_stream<char> connection_memory_budget::output(connected_socket& s, size_t buffer_size) {
+    // Small enough for a few sends, a buffer each, to fit the share
+    auto share = _memory / (_streams + 1);
+    buffer_size = std::max<size_t>(512, std::min(buffer_size, share / 2));
+    output_stream_options opts;
+    opts.batch_flushes = true;
+    return output_stream<char>(data_sink(std::make_unique<sink>(*this, s._csi->sink())), buffer_size, opts);
+}
+
+}
+
+}
@@ -23,6 +23,7 @@
 
 #include <seastar/net/stack.hh>
 #include <iostream>
+#include <netinet/tcp.h>
 #include <seastar/net/inet_address.hh>
 
 namespace seastar {
@@ -53,6 +54,7 @@ class native_server_socket_impl : public server_socket_impl {
 template <typename Protocol>
 native_server_socket_impl<Protocol>::native_server_socket_impl(Protocol& proto, uint16_t port, listen_options opt)
     : _listener(proto.listen(port)) {
+    _listener.set_congestion_control(opt.congestion_control);
 }
 
 template <typename Protocol>
@@ -104,6 +106,9 @@ class native_connected_socket_impl : public connected_socket_impl {
     int get_sockopt(int level, int optname, void* data, size_t len) const override;
     void set_sockopt(int level, int optname, const void* data, size_t len) override;
     socket_address local_address() const noexcept override;
+    tcp_connection_stats get_stats() const override {
+        return _conn->get_stats();
+    }
 };
 
 template <typename Protocol>
@@ -177,6 +182,9 @@ class native_connected_socket_impl<Protocol>::native_data_source_impl final
         _conn->close_write();
         return make_ready_future<>();
     }
+    void cancel() noexcept override {
+        _conn->close_read();
+    }
 };
 
 template <typename Protocol>
@@ -257,11 +265,23 @@ keepalive_params native_connected_socket_impl<Protocol>::get_keepalive_parameter
 
 template<typename Protocol>
 void native_connected_socket_impl<Protocol>::set_sockopt(int level, int optname, const void* data, size_t len) {
+    if (level == IPPROTO_TCP && optname == TCP_CONGESTION) {
+        auto name = static_cast<const char*>(data);
+        _conn->set_congestion_control(std::string_view(name, strnlen(name, len)));
+        return;
+    }
     throw std::runtime_error("Setting custom socket options is not supported for native stack");
 }
 
 template<typename Protocol>
 int native_connected_socket_impl<Protocol>::get_sockopt(int level, int optname, void* data, size_t len) const {
+    if (level == IPPROTO_TCP && optname == TCP_CONGESTION) {
+        auto name = std::string_view(_conn->congestion_control());
+        auto n = std::min(len, name.size());
+        std::copy_n(name.data(), n, static_cast<char*>(data));
+        std::fill_n(static_cast<char*>(data) + n, len - n, 0);
+        return 0;
+    }
     throw std::runtime_error("Getting custom socket options is not supported for native stack");
 }
 
@@ -75,6 +75,11 @@ void create_native_net_device(const native_stack_options& opts) {
                 !(opts.dpdk_opts.hw_fc && opts.dpdk_opts.hw_fc.get_value() == "off"));
        } else 
 #endif  
+#ifdef SEASTAR_HAVE_XDP
+        if (opts.xdp) {
+            dev = create_xdp_net_device(opts.xdp_opts);
+        } else
+#endif
         dev = create_virtio_net_device(opts.virtio_opts, opts.lro);
     }
     else {
@@ -329,12 +334,18 @@ native_stack_options::native_stack_options()
     , dpdk_pmd(*this, "dpdk-pmd", "Use DPDK PMD drivers")
 #else
     , dpdk_pmd(*this, "dpdk-pmd", program_options::unused{})
+#endif
+#ifdef SEASTAR_HAVE_XDP
+    , xdp(*this, "xdp", "Use AF_XDP sockets")
+#else
+    , xdp(*this, "xdp", program_options::unused{})
 #endif
     , lro(*this, "lro",
                 "on",
                 "Enable LRO")
     , virtio_opts(this)
     , dpdk_opts(this)
+    , xdp_opts(this)
 {
 }
 
@@ -29,6 +29,7 @@
 #include <seastar/core/metrics.hh>
 #include <seastar/core/print.hh>
 #include <seastar/net/inet_address.hh>
+#include "gro.hh"
 
 namespace seastar {
 
@@ -74,7 +75,7 @@ namespace net {
 
 inline
 bool qp::poll_tx() {
-    if (_tx_packetq.size() < 16) {
+    if (_tx_packetq.size() < _tx_refill_threshold) {
         // refill send queue from upper layers
         uint32_t work;
         do {
@@ -84,12 +85,12 @@ bool qp::poll_tx() {
                 if (p) {
                     work++;
                     _tx_packetq.push_back(std::move(p.value()));
-                    if (_tx_packetq.size() == 128) {
+                    if (_tx_packetq.size() >= std::max(_tx_refill_threshold, size_t(128))) {
                         break;
                     }
                 }
             }
-        } while (work && _tx_packetq.size() < 128);
+        } while (work && _tx_packetq.size() < std::max(_tx_refill_threshold, size_t(128)));
     }
     if (!_tx_packetq.empty()) {
         _stats.tx.good.update_pkts_bunch(send(_tx_packetq));
@@ -158,6 +159,19 @@ qp::qp(bool register_copy_stats,
         // Rx
         sm::make_counter(_queue_name + "_rx_frags", _stats.rx.good.nr_frags,
                         sm::description(format("Counts a number of received fragments. Divide this value by a {} to get an average number of fragments in an Rx packet.", _queue_name + "_rx_packets"))),
+
+        //
+        // Drops by reason: DERIVE:0:U
+        //
+        sm::make_counter(_queue_name + "_rx_drops", _stats.rx.bad.ring_full,
+                        sm::description("Counts a number of received packets dropped by this queue, by reason."),
+                        {sm::label_instance("reason", "ring_full")}),
+        sm::make_counter(_queue_name + "_rx_drops", _stats.rx.bad.no_mem,
+                        sm::description("Counts a number of received packets dropped by this queue, by reason."),
+                        {sm::label_instance("reason", "no_memory")}),
+        sm::make_counter(_queue_name + "_rx_drops", _stats.rx.bad.csum,
+                        sm::description("Counts a number of received packets dropped by this queue, by reason."),
+                        {sm::label_instance("reason", "bad_checksum")}),
     });
 
     if (register_copy_stats) {
@@ -189,6 +203,33 @@ qp::qp(bool register_copy_stats,
 qp::~qp() {
 }
 
+void qp::enable_gro() {
+    _gro = std::make_unique<gro>([this] (packet p) {
+        // FIXME: future is discarded
+        (void)_rx_stream.produce(std::move(p));
+    });
+    namespace sm = metrics;
+    _metrics.add_group(_stats_plugin_name, {
+        sm::make_counter(_queue_name + "_rx_gro_merged", [this] { return _gro->merged(); },
+                        sm::description(format("Counts a number of received TCP segments merged into an earlier one of their flow. Subtract this value from a {} to get a number of packets passed to the stack.", _queue_name + "_rx_packets"))),
+    });
+}
+
+void qp::gro_receive(packet p) {
+    if (_gro) {
+        _gro->receive(std::move(p));
+    } else {
+        // FIXME: future is discarded
+        (void)_rx_stream.produce(std::move(p));
+    }
+}
+
+void qp::gro_flush() {
+    if (_gro) {
+        _gro->flush();
+    }
+}
+
 void qp::configure_proxies(const std::map<unsigned, float>& cpu_weights) {
     assert(!cpu_weights.empty());
     if ((cpu_weights.size() == 1 && cpu_weights.begin()->first == this_shard_id())) {
@@ -203,7 +244,10 @@ void qp::configure_proxies(const std::map<unsigned, float>& cpu_weights) {
         }
         return p;
     });
-    build_sw_reta(cpu_weights);
+    // A device which spreads flows over all shards itself keeps its table
+    if (!_sw_reta) {
+        build_sw_reta(cpu_weights);
+    }
 }
 
 void qp::build_sw_reta(const std::map<unsigned, float>& cpu_weights) {
@@ -254,6 +298,20 @@ interface::interface(std::shared_ptr<device> dev)
     : _dev(dev)
     , _hw_address(_dev->hw_address())
     , _hw_features(_dev->hw_features()) {
+    namespace sm = metrics;
+    _metrics.add_group("network", {
+        sm::make_counter("forwarded_packets", _forwarded,
+                        sm::description("Counts a number of received packets passed to the shard owning their flow. "
+                                        "High values mean the device delivers many packets to other shards than the ones handling them.")),
+        sm::make_counter("forward_drops", _forward_drops,
+                        sm::description("Counts a number of received packets dropped because too many packets were being forwarded to other shards.")),
+        sm::make_counter("rx_drops", _forward_drops,
+                        sm::description("Counts a number of received packets dropped by the interface, by protocol and reason."),
+                        {sm::label_instance("protocol", "any"), sm::label_instance("reason", "forward_queue_full")}),
+        sm::make_counter("rx_drops", _unknown_protocol_drops,
+                        sm::description("Counts a number of received packets dropped by the interface, by protocol and reason."),
+                        {sm::label_instance("protocol", "other"), sm::label_instance("reason", "unknown_protocol")}),
+    });
     // FIXME: ignored future
     (void)_dev->receive([this] (packet p) {
         return dispatch_packet(std::move(p));
@@ -279,6 +337,15 @@ interface::interface(std::shared_ptr<device> dev)
         });
 }
 
+static sstring protocol_name(eth_protocol_num proto_num) {
+    switch (proto_num) {
+    case eth_protocol_num::ipv4: return "ipv4";
+    case eth_protocol_num::arp: return "arp";
+    case eth_protocol_num::ipv6: return "ipv6";
+    }
+    return format("{:#06x}", uint16_t(proto_num));
+}
+
 future<>
 interface::register_l3(eth_protocol_num proto_num,
         std::function<future<> (packet p, ethernet_address from)> next,
@@ -286,6 +353,17 @@ interface::register_l3(eth_protocol_num proto_num,
     auto i = _proto_map.emplace(std::piecewise_construct, std::make_tuple(uint16_t(proto_num)), std::forward_as_tuple(std::move(forward)));
     assert(i.second);
     l3_rx_stream& l3_rx = i.first->second;
+    namespace sm = metrics;
+    auto proto = sm::label_instance("protocol", protocol_name(proto_num));
+    _metrics.add_group("network", {
+        sm::make_counter("rx_packets", l3_rx.packets,
+                        sm::description("Counts a number of received packets passed to a protocol."), {proto}),
+        sm::make_counter("rx_drops", l3_rx.busy_drops,
+                        sm::description("Counts a number of received packets dropped by the interface, by protocol and reason."),
+                        {proto, sm::label_instance("reason", "protocol_busy")}),
+        sm::make_histogram("rx_latency", sm::description(format("Histogram of the time a protocol took to handle a received packet, sampled from one in {} packets, in seconds.", rx_latency_sample_interval)),
+                        {proto}, [&l3_rx] { return l3_rx.latency.to_metrics_histogram(); }),
+    });
     return l3_rx.packet_stream.listen(std::move(next)).done();
 }
 
@@ -306,6 +384,7 @@ void interface::forward(unsigned cpuid, packet p) {
 
     if (queue_depth < 1000) {
         queue_depth++;
+        _forwarded++;
         auto src_cpu = this_shard_id();
         // FIXME: future is discarded
         (void)smp::submit_to(cpuid, [this, p = std::move(p), src_cpu]() mutable {
@@ -313,9 +392,15 @@ void interface::forward(unsigned cpuid, packet p) {
         }).then([] {
             queue_depth--;
         });
+    } else {
+        _forward_drops++;
     }
 }
 
+std::unique_ptr<flow_rule> interface::steer_flow(const flow_tuple& flow) {
+    return _dev->steer_flow(flow, this_shard_id());
+}
+
 future<> interface::dispatch_packet(packet p) {
     auto eh = p.get_header<eth_hdr>();
     if (eh) {
@@ -343,9 +428,28 @@ future<> interface::dispatch_packet(packet p) {
                 // avoid chaining, since queue lenth is unlimited
                 // drop instead.
                 if (l3.ready.available()) {
-                    l3.ready = l3.packet_stream.produce(std::move(p), from);
+                    l3.packets++;
+                    if (++_rx_latency_sample < rx_latency_sample_interval) {
+                        l3.ready = l3.packet_stream.produce(std::move(p), from);
+                    } else {
+                        _rx_latency_sample = 0;
+                        auto start = std::chrono::steady_clock::now();
+                        auto f = l3.packet_stream.produce(std::move(p), from);
+                        if (f.available()) {
+                            l3.latency.add(std::chrono::steady_clock::now() - start);
+                            l3.ready = std::move(f);
+                        } else {
+                            l3.ready = f.finally([&l3, start] {
+                                l3.latency.add(std::chrono::steady_clock::now() - start);
+                            });
+                        }
+                    }
+                } else {
+                    l3.busy_drops++;
                 }
             }
+        } else {
+            _unknown_protocol_drops++;
         }
     }
     return make_ready_future<>();
@@ -37,6 +37,9 @@ static_assert(std::is_nothrow_move_constructible_v<packet>);
 
 constexpr size_t packet::internal_data_size;
 constexpr size_t packet::default_nr_frags;
+constexpr size_t packet::small_fragment_size;
+constexpr size_t packet::tail_buffer_size;
+constexpr size_t packet::max_nr_frags;
 
 void packet::linearize(size_t at_frag, size_t desired_size) {
     _impl->unuse_internal_data();
@@ -67,6 +70,38 @@ void packet::linearize(size_t at_frag, size_t desired_size) {
 }
 
 
+void packet::compact() noexcept {
+    auto frags = _impl->_frags;
+    auto nr = _impl->_nr_frags;
+    // The internal fragment stays where prepending headers finds it
+    unsigned i = _impl->using_internal_data();
+    unsigned out = i;
+    try {
+        while (i < nr) {
+            unsigned end = i;
+            size_t size = 0;
+            while (end < nr && frags[end].size <= small_fragment_size) {
+                size += frags[end++].size;
+            }
+            if (end - i < 2) {
+                frags[out++] = frags[i++];
+                continue;
+            }
+            std::unique_ptr<char[]> buf(new char[size]);
+            auto p = buf.get();
+            for (; i < end; ++i) {
+                p = std::copy(frags[i].base, frags[i].base + frags[i].size, p);
+            }
+            frags[out++] = fragment{buf.get(), size};
+            _impl->_deleter = make_deleter(std::move(_impl->_deleter), [buf = std::move(buf)] {});
+        }
+    } catch (...) {
+        // Compacting is an optimization; keep the rest as is
+        out = std::copy(frags + i, frags + nr, frags + out) - frags;
+    }
+    _impl->_nr_frags = out;
+}
+
 packet packet::free_on_cpu(unsigned cpu, std::function<void()> cb)
 {
     // make new deleter that runs old deleter on an origin cpu
@@ -19,12 +19,16 @@
  * Copyright (C) 2014 Cloudius Systems, Ltd.
  */
 
+#include <mutex>
 #include <random>
 
 #include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/bpf.h>
 #include <linux/if.h>
 #include <linux/netlink.h>
 #include <linux/rtnetlink.h>
+#include <linux/tls.h>
 #include <net/route.h>
 
 #include <seastar/core/loop.hh>
@@ -36,7 +40,9 @@
 #include <seastar/net/inet_address.hh>
 #include <seastar/util/std-compat.hh>
 #include <netinet/tcp.h>
+#include <netinet/udp.h>
 #include <netinet/sctp.h>
+#include "core/file-impl.hh"
 
 namespace std {
 
@@ -92,6 +98,9 @@ class posix_connected_socket_operations {
     virtual socket_address local_address(file_desc& _fd) const {
         return _fd.get_address();
     }
+    virtual tcp_connection_stats get_stats(file_desc& _fd) const {
+        throw std::system_error(ENOTSUP, std::system_category(), "connection statistics");
+    }
 };
 
 thread_local posix_ap_server_socket_impl::sockets_map_t posix_ap_server_socket_impl::sockets{};
@@ -124,6 +133,24 @@ class posix_tcp_connected_socket_operations : public posix_connected_socket_oper
             _fd.getsockopt<unsigned>(IPPROTO_TCP, TCP_KEEPCNT)
         };
     }
+    virtual tcp_connection_stats get_stats(file_desc& _fd) const override {
+        auto info = _fd.getsockopt<tcp_info>(IPPROTO_TCP, TCP_INFO);
+        // The kernel counts the windows and the data in flight in segments
+        auto in_segments = [mss = uint64_t(info.tcpi_snd_mss)] (uint64_t n) {
+            return uint32_t(std::min<uint64_t>(n * mss, std::numeric_limits<uint32_t>::max()));
+        };
+        tcp_connection_stats stats;
+        stats.mss = info.tcpi_snd_mss;
+        stats.cwnd = in_segments(info.tcpi_snd_cwnd);
+        stats.ssthresh = in_segments(info.tcpi_snd_ssthresh);
+        // Linux's tcp_packets_in_flight()
+        stats.bytes_in_flight = in_segments(info.tcpi_unacked - info.tcpi_sacked - info.tcpi_lost + info.tcpi_retrans);
+        stats.srtt = std::chrono::microseconds(info.tcpi_rtt);
+        stats.rttvar = std::chrono::microseconds(info.tcpi_rttvar);
+        stats.rto = std::chrono::microseconds(info.tcpi_rto);
+        stats.retransmits = info.tcpi_total_retrans;
+        return stats;
+    }
 };
 
 class posix_sctp_connected_socket_operations : public posix_connected_socket_operations {
@@ -266,6 +293,121 @@ class posix_connected_socket_impl final : public connected_socket_impl {
     socket_address local_address() const noexcept override {
         return _ops->local_address(_fd.get_file_desc());
     }
+    tcp_connection_stats get_stats() const override {
+        return _ops->get_stats(_fd.get_file_desc());
+    }
+    future<> send_tls_record(uint8_t content_type, temporary_buffer<char> data) override {
+        struct record {
+            temporary_buffer<char> data;
+            ::iovec iov;
+            alignas(::cmsghdr) char control[CMSG_SPACE(sizeof(uint8_t))] = {};
+            ::msghdr hdr = {};
+        };
+        auto r = std::make_unique<record>();
+        r->data = std::move(data);
+        r->iov = ::iovec{r->data.get_write(), r->data.size()};
+        r->hdr.msg_iov = &r->iov;
+        r->hdr.msg_iovlen = 1;
+        r->hdr.msg_control = r->control;
+        r->hdr.msg_controllen = sizeof(r->control);
+        auto cmsg = CMSG_FIRSTHDR(&r->hdr);
+        cmsg->cmsg_level = SOL_TLS;
+        cmsg->cmsg_type = TLS_SET_RECORD_TYPE;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(uint8_t));
+        *CMSG_DATA(cmsg) = content_type;
+        auto& hdr = r->hdr;
+        return _fd.sendmsg(&hdr).then([r = std::move(r)] (size_t) {});
+    }
+    future<> send_message(temporary_buffer<char> data, std::vector<file_desc> fds) override {
+        if (data.empty() && !fds.empty() && _fd.get_file_desc().getsockopt<int>(SOL_SOCKET, SO_TYPE) == SOCK_STREAM) {
+            return make_exception_future<>(std::invalid_argument("file descriptors need data to go with on a stream socket"));
+        }
+        struct message {
+            temporary_buffer<char> data;
+            std::vector<file_desc> fds;
+            ::iovec iov;
+            std::vector<char> control;
+            ::msghdr hdr = {};
+        };
+        auto m = std::make_unique<message>();
+        m->data = std::move(data);
+        m->fds = std::move(fds);
+        m->iov = ::iovec{m->data.get_write(), m->data.size()};
+        m->hdr.msg_iov = &m->iov;
+        m->hdr.msg_iovlen = 1;
+        if (!m->fds.empty()) {
+            auto len = sizeof(int) * m->fds.size();
+            m->control.resize(CMSG_SPACE(len));
+            m->hdr.msg_control = m->control.data();
+            m->hdr.msg_controllen = m->control.size();
+            auto cmsg = CMSG_FIRSTHDR(&m->hdr);
+            cmsg->cmsg_level = SOL_SOCKET;
+            cmsg->cmsg_type = SCM_RIGHTS;
+            cmsg->cmsg_len = CMSG_LEN(len);
+            auto p = CMSG_DATA(cmsg);
+            for (auto& fd : m->fds) {
+                auto raw = fd.get();
+                memcpy(p, &raw, sizeof(raw));
+                p += sizeof(raw);
+            }
+        }
+        auto& hdr = m->hdr;
+        return _fd.sendmsg(&hdr).then([this, m = std::move(m)] (size_t sent) mutable {
+            // A stream socket may take part of the data, the descriptors
+            // went with the first byte
+            if (sent == m->data.size()) {
+                return make_ready_future<>();
+            }
+            auto& data = m->data;
+            return _fd.write_all(data.get() + sent, data.size() - sent).finally([m = std::move(m)] {});
+        });
+    }
+    future<unix_message> receive_message(size_t max_size, unsigned max_fds) override {
+        struct message {
+            temporary_buffer<char> data;
+            ::iovec iov;
+            std::vector<char> control;
+            ::msghdr hdr = {};
+        };
+        auto m = std::make_unique<message>();
+        m->data = temporary_buffer<char>(max_size);
+        m->iov = ::iovec{m->data.get_write(), m->data.size()};
+        m->hdr.msg_iov = &m->iov;
+        m->hdr.msg_iovlen = 1;
+        if (max_fds) {
+            m->control.resize(CMSG_SPACE(sizeof(int) * max_fds));
+            m->hdr.msg_control = m->control.data();
+            m->hdr.msg_controllen = m->control.size();
+        }
+        auto& hdr = m->hdr;
+        return _fd.recvmsg(&hdr).then([m = std::move(m)] (size_t size) {
+            unix_message ret;
+            // Own the descriptors first, so that they're closed if the
+            // message is dropped
+            for (auto cmsg = CMSG_FIRSTHDR(&m->hdr); cmsg; cmsg = CMSG_NXTHDR(&m->hdr, cmsg)) {
+                if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+                    continue;
+                }
+                auto n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+                auto p = CMSG_DATA(cmsg);
+                for (size_t i = 0; i < n; i++) {
+                    int raw;
+                    memcpy(&raw, p + i * sizeof(int), sizeof(int));
+                    ret.fds.push_back(file_desc::from_fd(raw));
+                    ::fcntl(raw, F_SETFD, FD_CLOEXEC);
+                }
+            }
+            if (m->hdr.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) {
+                return make_exception_future<unix_message>(std::system_error(EMSGSIZE, std::system_category(), "unix socket message"));
+            }
+            m->data.trim(size);
+            ret.data = std::move(m->data);
+            return make_ready_future<unix_message>(std::move(ret));
+        });
+    }
+    file_desc dup_fd() const override {
+        return _fd.get_file_desc().dup();
+    }
 
     friend class posix_server_socket_impl;
     friend class posix_ap_server_socket_impl;
@@ -273,6 +415,7 @@ class posix_connected_socket_impl final : public connected_socket_impl {
     friend class posix_network_stack;
     friend class posix_ap_network_stack;
     friend class posix_socket_impl;
+    friend connected_socket seastar::make_connected_socket(file_desc fd);
 };
 
 static void resolve_outgoing_address(socket_address& a) {
@@ -416,13 +559,13 @@ class posix_socket_impl final : public socket_impl {
     }
 
     /// an aux function to handle unix-domain-specific requests
-    future<connected_socket> connect_unix_domain(socket_address sa, socket_address local) {
+    future<connected_socket> connect_unix_domain(socket_address sa, socket_address local, transport proto) {
         // note that if the 'local' address was not set by the client, it was created as an undefined address
         if (local.is_unspecified()) {
             local = socket_address{unix_domain_addr{std::string{}}};
         }
 
-        _fd = engine().make_pollable_fd(sa, 0);
+        _fd = engine().make_pollable_fd(sa, int(proto));
         return engine().posix_connect(_fd, sa, local).then(
             [fd = _fd, allocator = _allocator](){
                 // a problem with 'private' interaction with 'unique_ptr'
@@ -438,7 +581,7 @@ class posix_socket_impl final : public socket_impl {
 
     virtual future<connected_socket> connect(socket_address sa, socket_address local, transport proto = transport::TCP) override {
         if (sa.is_af_unix()) {
-            return connect_unix_domain(sa, local);
+            return connect_unix_domain(sa, local, proto);
         }
         return find_port_and_connect(sa, local, proto).then([this, sa, proto, allocator = _allocator] () mutable {
             std::unique_ptr<connected_socket_impl> csi;
@@ -475,12 +618,50 @@ class posix_socket_impl final : public socket_impl {
     }
 };
 
+posix_server_socket_impl::posix_server_socket_impl(int protocol, socket_address sa, pollable_fd lfd,
+        server_socket::load_balancing_algorithm lba, shard_id fixed_cpu,
+        std::pmr::polymorphic_allocator<char>* allocator)
+    : _sa(sa), _protocol(protocol), _lfd(std::move(lfd)), _lba(lba), _fixed_cpu(fixed_cpu), _allocator(allocator)
+{
+    if (_lba == server_socket::load_balancing_algorithm::incoming_cpu) {
+        for (auto shard : smp::all_cpus()) {
+            _shard_of_cpu.emplace(smp::placement_of(shard).cpu_id, shard);
+        }
+    }
+}
+
+conntrack::handle posix_server_socket_impl::handle_of_incoming_cpu(const pollable_fd& fd) {
+    // The CPU which last processed the socket's packets; -1 until one did,
+    // which a connection that went through a handshake has
+    int cpu = -1;
+    try {
+        cpu = fd.get_file_desc().getsockopt<int>(SOL_SOCKET, SO_INCOMING_CPU);
+    } catch (std::system_error&) {
+    }
+    auto i = _shard_of_cpu.find(unsigned(cpu));
+    if (cpu < 0 || i == _shard_of_cpu.end()) {
+        return _conntrack.get_handle();
+    }
+    return _conntrack.get_handle(i->second);
+}
+
+conntrack::handle posix_server_socket_impl::handle_of_napi_id(const pollable_fd& fd) {
+    // Zero for connections which didn't come through a NAPI device, like
+    // those of the loopback
+    unsigned napi_id = 0;
+    try {
+        napi_id = fd.get_file_desc().getsockopt<unsigned>(SOL_SOCKET, SO_INCOMING_NAPI_ID);
+    } catch (std::system_error&) {
+    }
+    return napi_id ? _conntrack.get_handle_by_napi_id(napi_id) : _conntrack.get_handle();
+}
+
 future<accept_result>
 posix_server_socket_impl::accept() {
     return _lfd.accept().then([this] (std::tuple<pollable_fd, socket_address> fd_sa) {
         auto& fd = std::get<0>(fd_sa);
         auto& sa = std::get<1>(fd_sa);
-        auto cth = [this, &sa] {
+        auto cth = [this, &sa, &fd] {
             switch(_lba) {
             case server_socket::load_balancing_algorithm::connection_distribution:
                 return _conntrack.get_handle();
@@ -488,19 +669,29 @@ posix_server_socket_impl::accept() {
                 return _conntrack.get_handle(ntoh(sa.as_posix_sockaddr_in().sin_port) % smp::count);
             case server_socket::load_balancing_algorithm::fixed:
                 return _conntrack.get_handle(_fixed_cpu);
+            case server_socket::load_balancing_algorithm::load_aware:
+                return _conntrack.get_handle_by_load();
+            case server_socket::load_balancing_algorithm::incoming_cpu:
+                return handle_of_incoming_cpu(fd);
+            case server_socket::load_balancing_algorithm::napi_id:
+                return handle_of_napi_id(fd);
             default: abort();
             }
         } ();
         auto cpu = cth.cpu();
+        auto multishot_recv = _lfd.multishot_recv();
         if (cpu == this_shard_id()) {
+            fd.set_multishot(false, multishot_recv);
             std::unique_ptr<connected_socket_impl> csi(
                     new posix_connected_socket_impl(sa.family(), _protocol, std::move(fd), std::move(cth), _allocator));
             return make_ready_future<accept_result>(
                     accept_result{connected_socket(std::move(csi)), sa});
         } else {
             // FIXME: future is discarded
-            (void)smp::submit_to(cpu, [protocol = _protocol, ssa = _sa, fd = std::move(fd.get_file_desc()), sa, cth = std::move(cth), allocator = _allocator] () mutable {
-                posix_ap_server_socket_impl::move_connected_socket(protocol, ssa, pollable_fd(std::move(fd)), sa, std::move(cth), allocator);
+            (void)smp::submit_to(cpu, [protocol = _protocol, ssa = _sa, fd = std::move(fd.get_file_desc()), sa, cth = std::move(cth), allocator = _allocator, multishot_recv] () mutable {
+                pollable_fd pfd(std::move(fd));
+                pfd.set_multishot(false, multishot_recv);
+                posix_ap_server_socket_impl::move_connected_socket(protocol, ssa, std::move(pfd), sa, std::move(cth), allocator);
             });
             return accept();
         }
@@ -553,9 +744,10 @@ posix_ap_server_socket_impl::abort_accept() {
 
 future<accept_result>
 posix_reuseport_server_socket_impl::accept() {
-    return _lfd.accept().then([allocator = _allocator, protocol = _protocol] (std::tuple<pollable_fd, socket_address> fd_sa) {
+    return _lfd.accept().then([allocator = _allocator, protocol = _protocol, multishot_recv = _lfd.multishot_recv()] (std::tuple<pollable_fd, socket_address> fd_sa) {
         auto& fd = std::get<0>(fd_sa);
         auto& sa = std::get<1>(fd_sa);
+        fd.set_multishot(false, multishot_recv);
         std::unique_ptr<connected_socket_impl> csi(
                 new posix_connected_socket_impl(sa.family(), protocol, std::move(fd), allocator));
         return make_ready_future<accept_result>(
@@ -613,6 +805,10 @@ future<> posix_data_source_impl::close() {
     return make_ready_future<>();
 }
 
+void posix_data_source_impl::cancel() noexcept {
+    shutdown_socket_fd(_fd, SHUT_RD);
+}
+
 std::vector<struct iovec> to_iovec(const packet& p) {
     std::vector<struct iovec> v;
     v.reserve(p.nr_frags());
@@ -642,6 +838,30 @@ posix_data_sink_impl::put(packet p) {
     return _fd.write_all(_p).then([this] { _p.reset(); });
 }
 
+future<>
+posix_data_sink_impl::put_file(file& f, uint64_t pos, uint64_t len) {
+    auto in_fd = posix_file_impl::fd_of(f);
+    if (in_fd < 0) {
+        return data_sink_impl::put_file(f, pos, len);
+    }
+    return do_with(pos, len, [this, in_fd] (uint64_t& pos, uint64_t& len) {
+        return repeat([this, in_fd, &pos, &len] {
+            if (!len) {
+                return make_ready_future<stop_iteration>(stop_iteration::yes);
+            }
+            return _fd.sendfile(in_fd, pos, len).then([&pos, &len] (size_t sent) {
+                if (!sent) {
+                    // end of file
+                    return stop_iteration::yes;
+                }
+                pos += sent;
+                len -= sent;
+                return stop_iteration::no;
+            });
+        });
+    });
+}
+
 future<>
 posix_data_sink_impl::close() {
     _fd.shutdown(SHUT_WR);
@@ -652,6 +872,153 @@ posix_network_stack::posix_network_stack(const program_options::option_group& op
         : _reuseport(engine().posix_reuseport_available()), _allocator(allocator) {
 }
 
+// Steers the connections of a SO_REUSEPORT group to the listener of the
+// shard running on the CPU which received the SYN. An eBPF program looks the
+// CPU up in a socket array, into which each shard puts its listener under
+// its CPU, and selects the listener it finds; CPUs with no listener leave the
+// choice to the kernel's hash. The group's listeners share the program and
+// the array, which live while any of them does.
+class reuseport_steering {
+    file_desc _map;
+    file_desc _prog;
+
+    static long bpf(int cmd, union bpf_attr& attr) {
+        return ::syscall(__NR_bpf, cmd, &attr, sizeof(attr));
+    }
+
+    static file_desc create_map(unsigned max_entries) {
+        union bpf_attr attr = {};
+        attr.map_type = BPF_MAP_TYPE_REUSEPORT_SOCKARRAY;
+        attr.key_size = sizeof(uint32_t);
+        attr.value_size = sizeof(uint64_t);
+        attr.max_entries = max_entries;
+        auto fd = bpf(BPF_MAP_CREATE, attr);
+        throw_system_error_on(fd == -1, "bpf(BPF_MAP_CREATE)");
+        return file_desc::from_fd(fd);
+    }
+
+    static file_desc load_program(int map_fd) {
+        struct bpf_insn insns[] = {
+            // r6 = ctx
+            {BPF_ALU64 | BPF_MOV | BPF_X, 6, 1, 0, 0},
+            // r0 = bpf_get_smp_processor_id()
+            {BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_get_smp_processor_id},
+            // key = r0
+            {BPF_STX | BPF_MEM | BPF_W, 10, 0, -4, 0},
+            // bpf_sk_select_reuseport(ctx, map, &key, 0)
+            {BPF_ALU64 | BPF_MOV | BPF_X, 1, 6, 0, 0},
+            {BPF_LD | BPF_DW | BPF_IMM, 2, BPF_PSEUDO_MAP_FD, 0, map_fd},
+            {0, 0, 0, 0, 0},
+            {BPF_ALU64 | BPF_MOV | BPF_X, 3, 10, 0, 0},
+            {BPF_ALU64 | BPF_ADD | BPF_K, 3, 0, 0, -4},
+            {BPF_ALU64 | BPF_MOV | BPF_K, 4, 0, 0, 0},
+            {BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_sk_select_reuseport},
+            // Accept the connection, on the selected listener if any
+            {BPF_ALU64 | BPF_MOV | BPF_K, 0, 0, 0, SK_PASS},
+            {BPF_JMP | BPF_EXIT, 0, 0, 0, 0},
+        };
+        static const char license[] = "Dual BSD/GPL";
+        union bpf_attr attr = {};
+        attr.prog_type = BPF_PROG_TYPE_SK_REUSEPORT;
+        attr.insns = reinterpret_cast<uintptr_t>(insns);
+        attr.insn_cnt = std::size(insns);
+        attr.license = reinterpret_cast<uintptr_t>(license);
+        auto fd = bpf(BPF_PROG_LOAD, attr);
+        throw_system_error_on(fd == -1, "bpf(BPF_PROG_LOAD)");
+        return file_desc::from_fd(fd);
+    }
+
+    explicit reuseport_steering(unsigned max_entries)
+        : _map(create_map(max_entries))
+        , _prog(load_program(_map.get()))
+    {}
+public:
+    // The steering of the group listening on the address, shared by the
+    // shards which listen on it
+    static std::shared_ptr<reuseport_steering> of(int protocol, socket_address sa) {
+        static std::mutex mutex;
+        static std::unordered_map<sstring, std::weak_ptr<reuseport_steering>> groups;
+        std::lock_guard<std::mutex> lock(mutex);
+        std::erase_if(groups, [] (auto& g) { return g.second.expired(); });
+        auto& g = groups[format("{}/{}", protocol, sa)];
+        auto steering = g.lock();
+        if (!steering) {
+            unsigned max_cpu = 0;
+            for (auto shard : smp::all_cpus()) {
+                max_cpu = std::max(max_cpu, smp::placement_of(shard).cpu_id);
+            }
+            steering.reset(new reuseport_steering(max_cpu + 1));
+            g = steering;
+        }
+        return steering;
+    }
+
+    // Adds the listener of this shard to the group's steering
+    void add(file_desc& listener) {
+        uint32_t cpu = smp::placement_of(this_shard_id()).cpu_id;
+        uint64_t fd = listener.get();
+        union bpf_attr attr = {};
+        attr.map_fd = _map.get();
+        attr.key = reinterpret_cast<uintptr_t>(&cpu);
+        attr.value = reinterpret_cast<uintptr_t>(&fd);
+        attr.flags = BPF_ANY;
+        throw_system_error_on(bpf(BPF_MAP_UPDATE_ELEM, attr) == -1, "bpf(BPF_MAP_UPDATE_ELEM)");
+        listener.setsockopt(SOL_SOCKET, SO_ATTACH_REUSEPORT_EBPF, _prog.get());
+    }
+};
+
+// A listener of a SO_REUSEPORT group. With incoming_cpu, it gets the
+// connections which arrive on the CPU of this shard: steered there by
+// reuseport_steering, or, where eBPF is not permitted, by SO_INCOMING_CPU,
+// which makes the kernel prefer the listener for them.
+static std::unique_ptr<server_socket_impl> reuseport_listen(int protocol, socket_address sa, const listen_options& opt,
+        std::pmr::polymorphic_allocator<char>* allocator) {
+    auto fd = engine().posix_listen(sa, opt);
+    std::shared_ptr<reuseport_steering> steering;
+    if (opt.lba == server_socket::load_balancing_algorithm::incoming_cpu) {
+        try {
+            steering = reuseport_steering::of(protocol, sa);
+            steering->add(fd.get_file_desc());
+        } catch (std::system_error& e) {
+            seastar_logger.debug("Cannot steer connections of {} with eBPF, using SO_INCOMING_CPU: {}", sa, e.what());
+            steering = nullptr;
+            fd.get_file_desc().setsockopt(SOL_SOCKET, SO_INCOMING_CPU, int(smp::placement_of(this_shard_id()).cpu_id));
+        }
+    }
+    return std::make_unique<posix_reuseport_server_socket_impl>(protocol, sa, std::move(fd), std::move(steering), allocator);
+}
+
+// A listener whose connections busy poll, which keeps the reactor polling
+// for at least as long as they do
+class busy_polling_server_socket_impl final : public server_socket_impl {
+    std::unique_ptr<server_socket_impl> _impl;
+    std::chrono::nanoseconds _busy_poll;
+public:
+    busy_polling_server_socket_impl(std::unique_ptr<server_socket_impl> impl, std::chrono::nanoseconds busy_poll)
+        : _impl(std::move(impl)), _busy_poll(busy_poll) {
+        engine().add_busy_poll(_busy_poll);
+    }
+    ~busy_polling_server_socket_impl() {
+        engine().remove_busy_poll(_busy_poll);
+    }
+    virtual future<accept_result> accept() override {
+        return _impl->accept();
+    }
+    virtual void abort_accept() override {
+        _impl->abort_accept();
+    }
+    virtual socket_address local_address() const override {
+        return _impl->local_address();
+    }
+};
+
+static server_socket make_server_socket(std::unique_ptr<server_socket_impl> impl, const listen_options& opt) {
+    if (opt.busy_poll.count()) {
+        impl = std::make_unique<busy_polling_server_socket_impl>(std::move(impl), opt.busy_poll);
+    }
+    return server_socket(std::move(impl));
+}
+
 server_socket
 posix_network_stack::listen(socket_address sa, listen_options opt) {
     using server_socket = seastar::server_socket;
@@ -663,10 +1030,10 @@ posix_network_stack::listen(socket_address sa, listen_options opt) {
         return server_socket(std::make_unique<posix_server_socket_impl>(0, sa, engine().posix_listen(sa, opt), opt.lba, opt.fixed_cpu, _allocator));
     }
     auto protocol = static_cast<int>(opt.proto);
-    return _reuseport ?
-        server_socket(std::make_unique<posix_reuseport_server_socket_impl>(protocol, sa, engine().posix_listen(sa, opt), _allocator))
-        :
-        server_socket(std::make_unique<posix_server_socket_impl>(protocol, sa, engine().posix_listen(sa, opt), opt.lba, opt.fixed_cpu, _allocator));
+    if (_reuseport) {
+        return make_server_socket(reuseport_listen(protocol, sa, opt, _allocator), opt);
+    }
+    return make_server_socket(std::make_unique<posix_server_socket_impl>(protocol, sa, engine().posix_listen(sa, opt), opt.lba, opt.fixed_cpu, _allocator), opt);
 }
 
 ::seastar::socket posix_network_stack::socket() {
@@ -688,18 +1055,20 @@ posix_ap_network_stack::listen(socket_address sa, listen_options opt) {
         return server_socket(std::make_unique<posix_ap_server_socket_impl>(0, sa, _allocator));
     }
     auto protocol = static_cast<int>(opt.proto);
-    return _reuseport ?
-        server_socket(std::make_unique<posix_reuseport_server_socket_impl>(protocol, sa, engine().posix_listen(sa, opt), _allocator))
-        :
-        server_socket(std::make_unique<posix_ap_server_socket_impl>(protocol, sa, _allocator));
+    if (_reuseport) {
+        return make_server_socket(reuseport_listen(protocol, sa, opt, _allocator), opt);
+    }
+    return make_server_socket(std::make_unique<posix_ap_server_socket_impl>(protocol, sa, _allocator), opt);
 }
 
+// Room for one IP_PKTINFO or IPV6_PKTINFO control message
 struct cmsg_with_pktinfo {
-    struct cmsghdrcmh;
-    union {
-        struct in_pktinfo pktinfo;
-        struct in6_pktinfo pkt6info;
-    };
+    alignas(struct cmsghdr) char buf[CMSG_SPACE(std::max(sizeof(struct in_pktinfo), sizeof(struct in6_pktinfo)))];
+};
+
+// Room for one UDP_SEGMENT control message
+struct cmsg_with_segment {
+    alignas(struct cmsghdr) char buf[CMSG_SPACE(sizeof(uint16_t))];
 };
 
 class posix_udp_channel : public udp_channel_impl {
@@ -751,11 +1120,136 @@ class posix_udp_channel : public udp_channel_impl {
             resolve_outgoing_address(_dst);
         }
     };
+    // Batches reuse the buffers of slots that received nothing, a
+    // datagram takes its slot's buffer along.
+    struct recv_slot {
+        struct iovec _iov;
+        socket_address _src_addr;
+        cmsg_with_pktinfo _cmsg;
+        std::unique_ptr<char[]> _buffer;
+
+        void prepare(struct mmsghdr& m) {
+            if (!_buffer) {
+                _buffer.reset(new char[MAX_DATAGRAM_SIZE]);
+            }
+            _iov.iov_base = _buffer.get();
+            _iov.iov_len = MAX_DATAGRAM_SIZE;
+            memset(&m, 0, sizeof(m));
+            m.msg_hdr.msg_iov = &_iov;
+            m.msg_hdr.msg_iovlen = 1;
+            m.msg_hdr.msg_name = &_src_addr.u.sa;
+            m.msg_hdr.msg_namelen = sizeof(_src_addr.u.sas);
+            m.msg_hdr.msg_control = &_cmsg;
+            m.msg_hdr.msg_controllen = sizeof(_cmsg);
+        }
+    };
+    struct recv_batch_ctx {
+        std::vector<recv_slot> _slots;
+        std::vector<struct mmsghdr> _hdrs;
+
+        unsigned prepare(size_t max_datagrams) {
+            auto n = std::min<size_t>(std::max<size_t>(max_datagrams, 1), MAX_BATCH);
+            if (_slots.size() < n) {
+                _slots.resize(n);
+                _hdrs.resize(n);
+            }
+            for (unsigned i = 0; i < n; i++) {
+                _slots[i].prepare(_hdrs[i]);
+            }
+            return n;
+        }
+    };
+    // With GSO, a run of datagrams of the same size, the last one possibly
+    // shorter, goes in one message, which the kernel (or the NIC) splits.
+    struct send_batch_ctx {
+        std::vector<struct mmsghdr> _hdrs;
+        std::vector<std::vector<struct iovec>> _iovecs;
+        std::vector<cmsg_with_segment> _cmsgs;
+        // First packet, and bytes, of each message
+        std::vector<size_t> _firsts;
+        std::vector<size_t> _lens;
+        socket_address _dst;
+        std::vector<packet> _packets;
+
+        size_t segments(size_t first) const {
+            auto size = _packets[first].len();
+            size_t total = size;
+            size_t i = first + 1;
+            while (i < _packets.size() && i - first < MAX_SEGMENTS) {
+                auto len = _packets[i].len();
+                if (!len || len > size || total + len > MAX_DATAGRAM_SIZE) {
+                    break;
+                }
+                total += len;
+                i++;
+                if (len < size) {
+                    break;
+                }
+            }
+            return i - first;
+        }
+
+        void prepare(const socket_address& dst, std::vector<packet> packets, bool gso) {
+            _dst = dst;
+            resolve_outgoing_address(_dst);
+            _packets = std::move(packets);
+            _firsts.clear();
+            for (size_t i = 0; i < _packets.size(); i += gso ? segments(i) : 1) {
+                _firsts.push_back(i);
+            }
+            auto n = _firsts.size();
+            _hdrs.resize(n);
+            _iovecs.resize(n);
+            _cmsgs.resize(n);
+            _lens.resize(n);
+            for (size_t m = 0; m < n; m++) {
+                auto first = _firsts[m];
+                auto end = m + 1 < n ? _firsts[m + 1] : _packets.size();
+                auto& iov = _iovecs[m];
+                iov.clear();
+                _lens[m] = 0;
+                for (auto i = first; i < end; i++) {
+                    for (auto& f : _packets[i].fragments()) {
+                        iov.push_back({f.base, f.size});
+                    }
+                    _lens[m] += _packets[i].len();
+                }
+                auto& hdr = _hdrs[m].msg_hdr;
+                memset(&_hdrs[m], 0, sizeof(_hdrs[m]));
+                hdr.msg_name = &_dst.u.sa;
+                hdr.msg_namelen = _dst.addr_length;
+                hdr.msg_iov = iov.data();
+                hdr.msg_iovlen = iov.size();
+                if (end - first > 1) {
+                    hdr.msg_control = _cmsgs[m].buf;
+                    hdr.msg_controllen = sizeof(_cmsgs[m].buf);
+                    auto* cmsg = CMSG_FIRSTHDR(&hdr);
+                    cmsg->cmsg_level = SOL_UDP;
+                    cmsg->cmsg_type = UDP_SEGMENT;
+                    cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+                    uint16_t segment = _packets[first].len();
+                    memcpy(CMSG_DATA(cmsg), &segment, sizeof(segment));
+                }
+            }
+        }
+    };
+    // Linux caps a single recvmmsg()/sendmmsg() call at UIO_MAXIOV messages;
+    // we stay well below that to bound the per-channel buffers.
+    static constexpr size_t MAX_BATCH = 64;
+    // Datagrams in one GSO message; older kernels take no more
+    static constexpr size_t MAX_SEGMENTS = 64;
     pollable_fd _fd;
     socket_address _address;
     recv_ctx _recv;
     send_ctx _send;
+    recv_batch_ctx _recv_batch;
+    send_batch_ctx _send_batch;
+    // Cleared when the kernel or the device turn GSO down
+    bool _gso = true;
     bool _closed;
+
+    socket_address get_dst(struct msghdr& hdr) const;
+    future<> send_batch_from(size_t first);
 public:
     posix_udp_channel(const socket_address& bind_address)
             : _closed(false) {
@@ -771,8 +1265,10 @@ class posix_udp_channel : public udp_channel_impl {
     }
     virtual ~posix_udp_channel() { if (!_closed) close(); };
     virtual future<udp_datagram> receive() override;
+    virtual future<std::vector<udp_datagram>> receive_batch(size_t max_datagrams) override;
     virtual future<> send(const socket_address& dst, const char *msg) override;
     virtual future<> send(const socket_address& dst, packet p) override;
+    virtual future<> send(const socket_address& dst, std::vector<packet> packets) override;
     virtual void shutdown_input() override {
         _fd.shutdown(SHUT_RD, pollable_fd::shutdown_kernel_only::no);
     }
@@ -805,6 +1301,48 @@ future<> posix_udp_channel::send(const socket_address& dst, packet p) {
             .then([len] (size_t size) { assert(size == len); });
 }
 
+future<> posix_udp_channel::send(const socket_address& dst, std::vector<packet> packets) {
+    if (packets.empty()) {
+        return make_ready_future<>();
+    }
+    _send_batch.prepare(dst, std::move(packets), _gso);
+    return send_batch_from(0);
+}
+
+future<> posix_udp_channel::send_batch_from(size_t first) {
+    auto n = std::min(_send_batch._hdrs.size() - first, MAX_BATCH);
+    return _fd.sendmmsg(&_send_batch._hdrs[first], n).then_wrapped([this, first] (future<size_t> f) {
+        if (f.failed() && _gso && _send_batch._hdrs[first].msg_hdr.msg_control) {
+            auto ex = f.get_exception();
+            try {
+                std::rethrow_exception(ex);
+            } catch (std::system_error& e) {
+                // Segmentation offload is unavailable on the route's device
+                // (EIO), or the kernel lacks it (EINVAL): resend the rest of
+                // the batch one datagram per message.
+                if (e.code().category() == std::system_category() && (e.code().value() == EIO || e.code().value() == EINVAL)) {
+                    _gso = false;
+                    std::vector<packet> rest(std::make_move_iterator(_send_batch._packets.begin() + _send_batch._firsts[first]),
+                            std::make_move_iterator(_send_batch._packets.end()));
+                    _send_batch.prepare(_send_batch._dst, std::move(rest), false);
+                    return send_batch_from(0);
+                }
+            } catch (...) {
+            }
+            return make_exception_future<>(std::move(ex));
+        }
+        auto sent = f.get();
+        for (size_t i = first; i < first + sent; i++) {
+            assert(_send_batch._hdrs[i].msg_len == _send_batch._lens[i]);
+        }
+        if (first + sent == _send_batch._hdrs.size()) {
+            _send_batch._packets.clear();
+            return make_ready_future<>();
+        }
+        return send_batch_from(first + sent);
+    });
+}
+
 udp_channel
 posix_network_stack::make_udp_channel(const socket_address& addr) {
     return udp_channel(std::make_unique<posix_udp_channel>(addr));
@@ -837,20 +1375,23 @@ class posix_datagram : public udp_datagram_impl {
     virtual packet& get_data() override { return _p; }
 };
 
+socket_address
+posix_udp_channel::get_dst(struct msghdr& hdr) const {
+    for (auto* cmsg = CMSG_FIRSTHDR(&hdr); cmsg != nullptr; cmsg = CMSG_NXTHDR(&hdr, cmsg)) {
+        if (cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_PKTINFO) {
+            return ipv4_addr(copy_reinterpret_cast<in_pktinfo>(CMSG_DATA(cmsg)).ipi_addr, _address.port());
+        } else if (cmsg->cmsg_level == IPPROTO_IPV6 && cmsg->cmsg_type == IPV6_PKTINFO) {
+            return ipv6_addr(copy_reinterpret_cast<in6_pktinfo>(CMSG_DATA(cmsg)).ipi6_addr, _address.port());
+        }
+    }
+    return socket_address();
+}
+
 future<udp_datagram>
 posix_udp_channel::receive() {
     _recv.prepare();
     return _fd.recvmsg(&_recv._hdr).then([this] (size_t size) {
-        socket_address dst;
-        for (auto* cmsg = CMSG_FIRSTHDR(&_recv._hdr); cmsg != nullptr; cmsg = CMSG_NXTHDR(&_recv._hdr, cmsg)) {
-            if (cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_PKTINFO) {
-                dst = ipv4_addr(copy_reinterpret_cast<in_pktinfo>(CMSG_DATA(cmsg)).ipi_addr, _address.port());
-                break;
-            } else if (cmsg->cmsg_level == IPPROTO_IPV6 && cmsg->cmsg_type == IPV6_PKTINFO) {
-                dst = ipv6_addr(copy_reinterpret_cast<in6_pktinfo>(CMSG_DATA(cmsg)).ipi6_addr, _address.port());
-                break;
-            }
-        }
+        socket_address dst = get_dst(_recv._hdr);
         return make_ready_future<udp_datagram>(udp_datagram(std::make_unique<posix_datagram>(
             _recv._src_addr, dst, packet(fragment{_recv._buffer, size}, make_deleter([buf = _recv._buffer] { delete[] buf; })))));
     }).handle_exception([p = _recv._buffer](auto ep) {
@@ -859,6 +1400,23 @@ posix_udp_channel::receive() {
     });
 }
 
+future<std::vector<udp_datagram>>
+posix_udp_channel::receive_batch(size_t max_datagrams) {
+    auto n = _recv_batch.prepare(max_datagrams);
+    return _fd.recvmmsg(_recv_batch._hdrs.data(), n).then([this] (size_t received) {
+        std::vector<udp_datagram> ret;
+        ret.reserve(received);
+        for (size_t i = 0; i < received; i++) {
+            auto& slot = _recv_batch._slots[i];
+            auto& hdr = _recv_batch._hdrs[i];
+            auto buf = slot._buffer.release();
+            ret.emplace_back(std::make_unique<posix_datagram>(slot._src_addr, get_dst(hdr.msg_hdr),
+                    packet(fragment{buf, hdr.msg_len}, make_deleter([buf] { delete[] buf; }))));
+        }
+        return ret;
+    });
+}
+
 network_stack_entry register_posix_stack() {
     return network_stack_entry{
         "posix", std::make_unique<program_options::option_group>(nullptr, "Posix"),
@@ -1095,4 +1653,12 @@ std::vector<network_interface> posix_network_stack::network_interfaces() {
 
 }
 
+connected_socket make_connected_socket(file_desc fd) {
+    auto family = fd.get_address().family();
+    auto protocol = family == AF_UNIX ? 0 : fd.getsockopt<int>(SOL_SOCKET, SO_PROTOCOL);
+    std::unique_ptr<net::connected_socket_impl> csi;
+    csi.reset(new net::posix_connected_socket_impl(family, protocol, engine().make_pollable_fd(std::move(fd))));
+    return connected_socket(std::move(csi));
+}
+
 }
@@ -0,0 +1,1283 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+
+#ifdef SEASTAR_HAVE_QUIC
+
+#include <seastar/net/quic.hh>
+#include <seastar/net/inet_address.hh>
+#include <seastar/net/stack.hh>
+#include <seastar/core/circular_buffer.hh>
+#include <seastar/core/condition-variable.hh>
+#include <seastar/core/iostream.hh>
+#include <seastar/core/loop.hh>
+#include <seastar/core/seastar.hh>
+#include <seastar/core/semaphore.hh>
+#include <seastar/core/timer.hh>
+#include <seastar/util/log.hh>
+#include <ngtcp2/ngtcp2.h>
+#include <ngtcp2/ngtcp2_crypto.h>
+#include <ngtcp2/ngtcp2_crypto_gnutls.h>
+#include <gnutls/gnutls.h>
+#include <gnutls/crypto.h>
+#include <array>
+#include <deque>
+#include <unordered_map>
+
+namespace seastar {
+
+namespace quic {
+
+static logger qlog("quic");
+
+namespace {
+
+using clock_type = steady_clock_type;
+
+// Length of the connection IDs we issue; a server tells its connections
+// apart by the first bytes of short header packets
+constexpr size_t cid_length = 16;
+
+// Datagrams fetched from the UDP channel at once
+constexpr size_t receive_batch_size = 64;
+
+constexpr const char* priority = "%DISABLE_TLS13_COMPAT_MODE:NORMAL:-VERS-ALL:+VERS-TLS1.3:"
+        "-CIPHER-ALL:+AES-128-GCM:+AES-256-GCM:+CHACHA20-POLY1305:+AES-128-CCM:"
+        "-GROUP-ALL:+GROUP-SECP256R1:+GROUP-X25519:+GROUP-SECP384R1:+GROUP-SECP521R1";
+
+ngtcp2_tstamp timestamp() noexcept {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now().time_since_epoch()).count();
+}
+
+ngtcp2_cid random_cid() {
+    ngtcp2_cid cid;
+    cid.datalen = cid_length;
+    gnutls_rnd(GNUTLS_RND_RANDOM, cid.data, cid.datalen);
+    return cid;
+}
+
+sstring cid_key(const uint8_t* data, size_t len) {
+    return sstring(reinterpret_cast<const char*>(data), len);
+}
+
+ngtcp2_path make_path(const socket_address& local, const socket_address& remote) {
+    ngtcp2_path path{};
+    path.local.addr = const_cast<ngtcp2_sockaddr*>(reinterpret_cast<const ngtcp2_sockaddr*>(&local.u.sa));
+    path.local.addrlen = local.addr_length;
+    path.remote.addr = const_cast<ngtcp2_sockaddr*>(reinterpret_cast<const ngtcp2_sockaddr*>(&remote.u.sa));
+    path.remote.addrlen = remote.addr_length;
+    return path;
+}
+
+std::runtime_error quic_error(const char* what, int rv) {
+    return std::runtime_error(format("QUIC {}: {}", what, ngtcp2_strerror(rv)));
+}
+
+std::runtime_error tls_error(const char* what, int rv) {
+    return std::runtime_error(format("QUIC {}: {}", what, gnutls_strerror(rv)));
+}
+
+// A UDP channel, shared by the connections of a server, or owned by a
+// client's connection. A channel sends one batch at a time.
+class endpoint {
+    net::udp_channel _chan;
+    semaphore _send_sem{1};
+public:
+    explicit endpoint(net::udp_channel chan) noexcept : _chan(std::move(chan)) {}
+
+    net::udp_channel& channel() noexcept {
+        return _chan;
+    }
+    future<> send(socket_address dst, std::vector<net::packet> packets) {
+        return with_semaphore(_send_sem, 1, [this, dst, packets = std::move(packets)] () mutable {
+            return _chan.send(dst, std::move(packets));
+        });
+    }
+    // Closes the channel once its receive loop ended
+    future<> close() {
+        return get_units(_send_sem, 1).then([this] (auto units) {
+            _chan.close();
+        });
+    }
+};
+
+struct stream {
+    int64_t id;
+    circular_buffer<temporary_buffer<char>> rx;
+    bool rx_fin = false;
+    std::exception_ptr rx_error;
+    condition_variable rx_cv;
+    // Written data, from the first byte not acknowledged yet, which ngtcp2
+    // may have to send again; tx_acked is the offset of tx.front()
+    std::deque<temporary_buffer<char>> tx;
+    uint64_t tx_acked = 0;
+    uint64_t tx_sent = 0;
+    uint64_t tx_written = 0;
+    bool fin = false;
+    bool fin_sent = false;
+    bool fin_acked = false;
+    std::exception_ptr tx_error;
+    condition_variable tx_cv;
+    bool sendable = false;
+
+    explicit stream(int64_t i) noexcept : id(i) {}
+
+    bool has_pending() const noexcept {
+        return tx_sent < tx_written || (fin && !fin_sent);
+    }
+    size_t buffered() const noexcept {
+        return tx_written - tx_acked;
+    }
+    // Vectors of the data not sent yet
+    size_t unsent(ngtcp2_vec* v, size_t max) const noexcept {
+        size_t n = 0;
+        auto off = tx_acked;
+        for (auto& b : tx) {
+            if (n == max) {
+                break;
+            }
+            auto end = off + b.size();
+            if (end > tx_sent) {
+                auto skip = tx_sent > off ? tx_sent - off : 0;
+                v[n].base = reinterpret_cast<uint8_t*>(const_cast<char*>(b.get())) + skip;
+                v[n].len = b.size() - skip;
+                n++;
+            }
+            off = end;
+        }
+        return n;
+    }
+    void acked(uint64_t upto) {
+        while (!tx.empty() && tx_acked + tx.front().size() <= upto) {
+            tx_acked += tx.front().size();
+            tx.pop_front();
+        }
+        tx_cv.broadcast();
+    }
+    void fail(std::exception_ptr ex) {
+        if (!rx_error && !rx_fin) {
+            rx_error = ex;
+        }
+        if (!tx_error) {
+            tx_error = ex;
+        }
+        rx_cv.broadcast();
+        tx_cv.broadcast();
+    }
+};
+
+}
+
+class connection_impl : public enable_lw_shared_from_this<connection_impl> {
+    lw_shared_ptr<endpoint> _ep;
+    server_impl* _server;
+    socket_address _local;
+    socket_address _remote;
+    options _opts;
+    ngtcp2_conn* _conn = nullptr;
+    gnutls_session_t _session = nullptr;
+    ngtcp2_crypto_conn_ref _conn_ref;
+    std::unordered_map<int64_t, lw_shared_ptr<stream>> _streams;
+    // Streams with data or a FIN to send
+    circular_buffer<lw_shared_ptr<stream>> _sendable;
+    circular_buffer<lw_shared_ptr<stream>> _incoming;
+    condition_variable _incoming_cv;
+    condition_variable _credit_cv;
+    promise<> _handshake;
+    bool _handshake_done = false;
+    timer<clock_type> _timer;
+    bool _writing = false;
+    bool _write_again = false;
+    std::exception_ptr _error;
+    // Connection IDs a server routes to this connection
+    std::vector<sstring> _cids;
+
+    friend class server_impl;
+    friend class stream_socket;
+    friend class stream_source;
+    friend class stream_sink;
+public:
+    connection_impl(lw_shared_ptr<endpoint> ep, server_impl* server, socket_address local, socket_address remote, options opts);
+    ~connection_impl();
+
+    void init_client(void* creds, const sstring& name);
+    void init_server(const ngtcp2_pkt_hd& hd, const ngtcp2_cid& scid, void* creds, const std::array<uint8_t, 32>& reset_secret);
+
+    // Processes a datagram; false if the connection is gone
+    bool receive(const uint8_t* data, size_t len, const socket_address& from);
+    // Sends what ngtcp2 has to send, in the background
+    void flush();
+    future<> handshake() {
+        return _handshake.get_future();
+    }
+
+    future<connected_socket> open_stream();
+    future<connected_socket> accept_stream();
+    socket_address local_address() const noexcept {
+        return _local;
+    }
+    socket_address remote_address() const noexcept {
+        return _remote;
+    }
+    sstring alpn() const;
+    future<> close(uint64_t error_code);
+private:
+    void init_tls(bool server, void* creds, const sstring& name);
+    void init_conn(ngtcp2_callbacks& cb, ngtcp2_settings& settings, ngtcp2_transport_params& params);
+    std::vector<net::packet> produce();
+    void rearm_timer();
+    void on_timer();
+    lw_shared_ptr<stream> make_stream(int64_t id);
+    connected_socket make_socket(lw_shared_ptr<stream> s);
+    void make_sendable(const lw_shared_ptr<stream>& s);
+    // Sends a CONNECTION_CLOSE, and fails everything with ex
+    future<> close_with(const ngtcp2_ccerr& ccerr, std::exception_ptr ex);
+    void abort(std::exception_ptr ex);
+
+    future<temporary_buffer<char>> read(lw_shared_ptr<stream> s);
+    future<> write(lw_shared_ptr<stream> s, net::packet p);
+    future<> finish(lw_shared_ptr<stream> s);
+    void shutdown_input(stream& s);
+    void shutdown_output(stream& s);
+
+    static connection_impl& from(void* user_data) noexcept {
+        return *static_cast<connection_impl*>(user_data);
+    }
+    lw_shared_ptr<stream> find(int64_t id) const noexcept {
+        auto it = _streams.find(id);
+        return it == _streams.end() ? nullptr : it->second;
+    }
+
+    static ngtcp2_conn* get_conn(ngtcp2_crypto_conn_ref* ref) noexcept;
+    static void on_rand(uint8_t* dest, size_t len, const ngtcp2_rand_ctx*) noexcept;
+    static int on_new_cid(ngtcp2_conn*, ngtcp2_cid* cid, uint8_t* token, size_t len, void* user_data) noexcept;
+    static int on_remove_cid(ngtcp2_conn*, const ngtcp2_cid* cid, void* user_data) noexcept;
+    static int on_handshake_completed(ngtcp2_conn*, void* user_data) noexcept;
+    static int on_stream_data(ngtcp2_conn*, uint32_t flags, int64_t id, uint64_t offset,
+            const uint8_t* data, size_t len, void* user_data, void*) noexcept;
+    static int on_acked(ngtcp2_conn*, int64_t id, uint64_t offset, uint64_t len, void* user_data, void*) noexcept;
+    static int on_stream_open(ngtcp2_conn*, int64_t id, void* user_data) noexcept;
+    static int on_stream_close(ngtcp2_conn*, uint32_t flags, int64_t id, uint64_t error_code, void* user_data, void*) noexcept;
+    static int on_stream_reset(ngtcp2_conn*, int64_t id, uint64_t final_size, uint64_t error_code, void* user_data, void*) noexcept;
+    static int on_stop_sending(ngtcp2_conn*, int64_t id, uint64_t error_code, void* user_data, void*) noexcept;
+    static int on_extend_streams(ngtcp2_conn*, uint64_t max_streams, void* user_data) noexcept;
+    static int on_extend_stream_data(ngtcp2_conn*, int64_t id, uint64_t max_data, void* user_data, void*) noexcept;
+};
+
+class server_impl : public enable_lw_shared_from_this<server_impl> {
+    lw_shared_ptr<endpoint> _ep;
+    shared_ptr<tls::server_credentials> _creds;
+    options _opts;
+    socket_address _local;
+    std::array<uint8_t, 32> _reset_secret;
+    std::unordered_map<sstring, lw_shared_ptr<connection_impl>> _cids;
+    circular_buffer<lw_shared_ptr<connection_impl>> _accepted;
+    condition_variable _accept_cv;
+    bool _stopped = false;
+    future<> _receiver = make_ready_future<>();
+
+    friend class connection_impl;
+public:
+    server_impl(socket_address local, shared_ptr<tls::server_credentials> creds, options opts);
+
+    void start();
+    future<connection> accept();
+    socket_address local_address() const noexcept {
+        return _local;
+    }
+    future<> stop();
+private:
+    future<> receive_loop();
+    void handle(net::udp_datagram& d, std::vector<lw_shared_ptr<connection_impl>>& touched);
+    void send_version_negotiation(const ngtcp2_version_cid& vc, const socket_address& to);
+    lw_shared_ptr<connection_impl> accept_new(const ngtcp2_pkt_hd& hd, const socket_address& from);
+    void add_cid(const sstring& key, lw_shared_ptr<connection_impl> c) {
+        _cids[key] = std::move(c);
+    }
+    void remove_cid(const sstring& key) {
+        _cids.erase(key);
+    }
+    void established(lw_shared_ptr<connection_impl> c) {
+        _accepted.push_back(std::move(c));
+        _accept_cv.signal();
+    }
+};
+
+class stream_source final : public data_source_impl {
+    lw_shared_ptr<connection_impl> _conn;
+    lw_shared_ptr<stream> _s;
+public:
+    stream_source(lw_shared_ptr<connection_impl> conn, lw_shared_ptr<stream> s) noexcept
+        : _conn(std::move(conn)), _s(std::move(s)) {}
+    virtual future<temporary_buffer<char>> get() override;
+};
+
+class stream_sink final : public data_sink_impl {
+    lw_shared_ptr<connection_impl> _conn;
+    lw_shared_ptr<stream> _s;
+public:
+    stream_sink(lw_shared_ptr<connection_impl> conn, lw_shared_ptr<stream> s) noexcept
+        : _conn(std::move(conn)), _s(std::move(s)) {}
+    using data_sink_impl::put;
+    virtual future<> put(net::packet p) override;
+    virtual future<> close() override;
+    virtual size_t buffer_size() const noexcept override {
+        return 16 << 10;
+    }
+};
+
+class stream_socket final : public net::connected_socket_impl {
+    lw_shared_ptr<connection_impl> _conn;
+    lw_shared_ptr<stream> _s;
+public:
+    stream_socket(lw_shared_ptr<connection_impl> conn, lw_shared_ptr<stream> s) noexcept
+        : _conn(std::move(conn)), _s(std::move(s)) {}
+    virtual data_source source() override {
+        return data_source(std::make_unique<stream_source>(_conn, _s));
+    }
+    virtual data_sink sink() override {
+        return data_sink(std::make_unique<stream_sink>(_conn, _s));
+    }
+    virtual void shutdown_input() override {
+        _conn->shutdown_input(*_s);
+    }
+    virtual void shutdown_output() override {
+        _conn->shutdown_output(*_s);
+    }
+    // Streams have no Nagle algorithm nor keepalives of their own; the
+    // connection's idle timeout plays the latter's role
+    virtual void set_nodelay(bool) override {}
+    virtual bool get_nodelay() const override {
+        return true;
+    }
+    virtual void set_keepalive(bool) override {}
+    virtual bool get_keepalive() const override {
+        return false;
+    }
+    virtual void set_keepalive_parameters(const net::keepalive_params&) override {}
+    virtual net::keepalive_params get_keepalive_parameters() const override {
+        return net::tcp_keepalive_params{std::chrono::seconds(0), std::chrono::seconds(0), 0};
+    }
+    virtual void set_sockopt(int, int, const void*, size_t) override {
+        throw std::runtime_error("setting socket options is not supported on QUIC streams");
+    }
+    virtual int get_sockopt(int, int, void*, size_t) const override {
+        throw std::runtime_error("getting socket options is not supported on QUIC streams");
+    }
+    virtual socket_address local_address() const noexcept override {
+        return _conn->local_address();
+    }
+};
+
+future<temporary_buffer<char>> stream_source::get() {
+    return _conn->read(_s);
+}
+
+future<> stream_sink::put(net::packet p) {
+    return _conn->write(_s, std::move(p));
+}
+
+future<> stream_sink::close() {
+    return _conn->finish(_s);
+}
+
+connection_impl::connection_impl(lw_shared_ptr<endpoint> ep, server_impl* server, socket_address local, socket_address remote, options opts)
+    : _ep(std::move(ep))
+    , _server(server)
+    , _local(local)
+    , _remote(remote)
+    , _opts(std::move(opts))
+    , _timer([this] { on_timer(); })
+{
+    _conn_ref.get_conn = get_conn;
+    _conn_ref.user_data = this;
+}
+
+connection_impl::~connection_impl() {
+    if (_conn) {
+        ngtcp2_conn_del(_conn);
+    }
+    if (_session) {
+        gnutls_deinit(_session);
+    }
+}
+
+void connection_impl::init_tls(bool server, void* creds, const sstring& name) {
+    auto rv = gnutls_init(&_session, (server ? GNUTLS_SERVER : GNUTLS_CLIENT) | GNUTLS_ENABLE_EARLY_DATA | GNUTLS_NO_END_OF_EARLY_DATA);
+    if (rv != GNUTLS_E_SUCCESS) {
+        throw tls_error("TLS session", rv);
+    }
+    rv = server ? ngtcp2_crypto_gnutls_configure_server_session(_session) : ngtcp2_crypto_gnutls_configure_client_session(_session);
+    if (rv != 0) {
+        throw std::runtime_error("QUIC TLS session: cannot configure it for QUIC");
+    }
+    rv = gnutls_priority_set_direct(_session, priority, nullptr);
+    if (rv != GNUTLS_E_SUCCESS) {
+        throw tls_error("TLS priorities", rv);
+    }
+    rv = gnutls_credentials_set(_session, GNUTLS_CRD_CERTIFICATE, creds);
+    if (rv != GNUTLS_E_SUCCESS) {
+        throw tls_error("TLS credentials", rv);
+    }
+    gnutls_session_set_ptr(_session, &_conn_ref);
+    if (!_opts.alpn.empty()) {
+        std::vector<gnutls_datum_t> protocols;
+        for (auto& p : _opts.alpn) {
+            protocols.push_back({reinterpret_cast<unsigned char*>(const_cast<char*>(p.data())), unsigned(p.size())});
+        }
+        rv = gnutls_alpn_set_protocols(_session, protocols.data(), protocols.size(), server ? GNUTLS_ALPN_MANDATORY : 0);
+        if (rv != GNUTLS_E_SUCCESS) {
+            throw tls_error("ALPN", rv);
+        }
+    }
+    if (!server && !name.empty()) {
+        gnutls_server_name_set(_session, GNUTLS_NAME_DNS, name.data(), name.size());
+        gnutls_session_set_verify_cert(_session, name.c_str(), 0);
+    }
+}
+
+void connection_impl::init_conn(ngtcp2_callbacks& cb, ngtcp2_settings& settings, ngtcp2_transport_params& params) {
+    cb.recv_crypto_data = ngtcp2_crypto_recv_crypto_data_cb;
+    cb.encrypt = ngtcp2_crypto_encrypt_cb;
+    cb.decrypt = ngtcp2_crypto_decrypt_cb;
+    cb.hp_mask = ngtcp2_crypto_hp_mask_cb;
+    cb.update_key = ngtcp2_crypto_update_key_cb;
+    cb.delete_crypto_aead_ctx = ngtcp2_crypto_delete_crypto_aead_ctx_cb;
+    cb.delete_crypto_cipher_ctx = ngtcp2_crypto_delete_crypto_cipher_ctx_cb;
+    cb.get_path_challenge_data = ngtcp2_crypto_get_path_challenge_data_cb;
+    cb.version_negotiation = ngtcp2_crypto_version_negotiation_cb;
+    cb.rand = on_rand;
+    cb.get_new_connection_id = on_new_cid;
+    cb.remove_connection_id = on_remove_cid;
+    cb.handshake_completed = on_handshake_completed;
+    cb.recv_stream_data = on_stream_data;
+    cb.acked_stream_data_offset = on_acked;
+    cb.stream_open = on_stream_open;
+    cb.stream_close = on_stream_close;
+    cb.stream_reset = on_stream_reset;
+    cb.stream_stop_sending = on_stop_sending;
+    cb.extend_max_local_streams_bidi = on_extend_streams;
+    cb.extend_max_stream_data = on_extend_stream_data;
+
+    ngtcp2_settings_default(&settings);
+    settings.initial_ts = timestamp();
+    settings.max_tx_udp_payload_size = std::max<size_t>(_opts.max_udp_payload_size, NGTCP2_MAX_UDP_PAYLOAD_SIZE);
+
+    ngtcp2_transport_params_default(&params);
+    params.initial_max_stream_data_bidi_local = _opts.max_stream_data;
+    params.initial_max_stream_data_bidi_remote = _opts.max_stream_data;
+    params.initial_max_stream_data_uni = _opts.max_stream_data;
+    params.initial_max_data = _opts.max_data;
+    params.initial_max_streams_bidi = _opts.max_streams;
+    params.initial_max_streams_uni = _opts.max_uni_streams;
+    params.max_idle_timeout = std::chrono::duration_cast<std::chrono::nanoseconds>(_opts.idle_timeout).count();
+    // The kernel would steer a migrated connection's packets to whichever
+    // shard it likes
+    params.disable_active_migration = 1;
+}
+
+void connection_impl::init_client(void* creds, const sstring& name) {
+    init_tls(false, creds, name);
+    ngtcp2_callbacks cb{};
+    ngtcp2_settings settings;
+    ngtcp2_transport_params params;
+    init_conn(cb, settings, params);
+    cb.client_initial = ngtcp2_crypto_client_initial_cb;
+    cb.recv_retry = ngtcp2_crypto_recv_retry_cb;
+    auto dcid = random_cid();
+    auto scid = random_cid();
+    auto path = make_path(_local, _remote);
+    auto rv = ngtcp2_conn_client_new(&_conn, &dcid, &scid, &path, NGTCP2_PROTO_VER_V1, &cb, &settings, &params, nullptr, this);
+    if (rv != 0) {
+        throw quic_error("connection", rv);
+    }
+    ngtcp2_conn_set_tls_native_handle(_conn, _session);
+}
+
+void connection_impl::init_server(const ngtcp2_pkt_hd& hd, const ngtcp2_cid& scid, void* creds, const std::array<uint8_t, 32>& reset_secret) {
+    init_tls(true, creds, {});
+    ngtcp2_callbacks cb{};
+    ngtcp2_settings settings;
+    ngtcp2_transport_params params;
+    init_conn(cb, settings, params);
+    cb.recv_client_initial = ngtcp2_crypto_recv_client_initial_cb;
+    params.original_dcid = hd.dcid;
+    params.original_dcid_present = 1;
+    params.stateless_reset_token_present = 1;
+    auto rv = ngtcp2_crypto_generate_stateless_reset_token(params.stateless_reset_token, reset_secret.data(), reset_secret.size(), &scid);
+    if (rv != 0) {
+        throw quic_error("stateless reset token", rv);
+    }
+    auto path = make_path(_local, _remote);
+    rv = ngtcp2_conn_server_new(&_conn, &hd.scid, &scid, &path, hd.version, &cb, &settings, &params, nullptr, this);
+    if (rv != 0) {
+        throw quic_error("connection", rv);
+    }
+    ngtcp2_conn_set_tls_native_handle(_conn, _session);
+}
+
+ngtcp2_conn* connection_impl::get_conn(ngtcp2_crypto_conn_ref* ref) noexcept {
+    return from(ref->user_data)._conn;
+}
+
+void connection_impl::on_rand(uint8_t* dest, size_t len, const ngtcp2_rand_ctx*) noexcept {
+    gnutls_rnd(GNUTLS_RND_RANDOM, dest, len);
+}
+
+int connection_impl::on_new_cid(ngtcp2_conn*, ngtcp2_cid* cid, uint8_t* token, size_t len, void* user_data) noexcept {
+    auto& c = from(user_data);
+    if (gnutls_rnd(GNUTLS_RND_RANDOM, cid->data, len) != 0) {
+        return NGTCP2_ERR_CALLBACK_FAILURE;
+    }
+    cid->datalen = len;
+    if (!c._server) {
+        gnutls_rnd(GNUTLS_RND_RANDOM, token, NGTCP2_STATELESS_RESET_TOKENLEN);
+        return 0;
+    }
+    auto& secret = c._server->_reset_secret;
+    if (ngtcp2_crypto_generate_stateless_reset_token(token, secret.data(), secret.size(), cid) != 0) {
+        return NGTCP2_ERR_CALLBACK_FAILURE;
+    }
+    try {
+        auto key = cid_key(cid->data, cid->datalen);
+        c._server->add_cid(key, c.shared_from_this());
+        c._cids.push_back(std::move(key));
+    } catch (...) {
+        return NGTCP2_ERR_CALLBACK_FAILURE;
+    }
+    return 0;
+}
+
+int connection_impl::on_remove_cid(ngtcp2_conn*, const ngtcp2_cid* cid, void* user_data) noexcept {
+    auto& c = from(user_data);
+    if (c._server) {
+        auto key = cid_key(cid->data, cid->datalen);
+        c._server->remove_cid(key);
+        std::erase(c._cids, key);
+    }
+    return 0;
+}
+
+int connection_impl::on_handshake_completed(ngtcp2_conn*, void* user_data) noexcept {
+    auto& c = from(user_data);
+    c._handshake_done = true;
+    if (c._server) {
+        c._server->established(c.shared_from_this());
+    } else {
+        c._handshake.set_value();
+    }
+    return 0;
+}
+
+int connection_impl::on_stream_data(ngtcp2_conn*, uint32_t flags, int64_t id, uint64_t,
+        const uint8_t* data, size_t len, void* user_data, void*) noexcept {
+    auto s = from(user_data).find(id);
+    if (!s) {
+        // Read side shut down: give the credit back at once
+        ngtcp2_conn_extend_max_stream_offset(from(user_data)._conn, id, len);
+        ngtcp2_conn_extend_max_offset(from(user_data)._conn, len);
+        return 0;
+    }
+    try {
+        if (len) {
+            s->rx.push_back(temporary_buffer<char>(reinterpret_cast<const char*>(data), len));
+        }
+    } catch (...) {
+        return NGTCP2_ERR_CALLBACK_FAILURE;
+    }
+    if (flags & NGTCP2_STREAM_DATA_FLAG_FIN) {
+        s->rx_fin = true;
+    }
+    s->rx_cv.signal();
+    return 0;
+}
+
+int connection_impl::on_acked(ngtcp2_conn*, int64_t id, uint64_t offset, uint64_t len, void* user_data, void*) noexcept {
+    if (auto s = from(user_data).find(id)) {
+        s->acked(offset + len);
+    }
+    return 0;
+}
+
+int connection_impl::on_stream_open(ngtcp2_conn*, int64_t id, void* user_data) noexcept {
+    auto& c = from(user_data);
+    try {
+        c._incoming.push_back(c.make_stream(id));
+    } catch (...) {
+        return NGTCP2_ERR_CALLBACK_FAILURE;
+    }
+    c._incoming_cv.signal();
+    return 0;
+}
+
+int connection_impl::on_stream_close(ngtcp2_conn* conn, uint32_t flags, int64_t id, uint64_t error_code, void* user_data, void*) noexcept {
+    auto& c = from(user_data);
+    if (auto s = c.find(id)) {
+        s->fin_acked = s->fin_sent;
+        if (!s->rx_fin || !s->fin_acked) {
+            s->fail(std::make_exception_ptr(std::system_error(ECONNRESET, std::system_category())));
+        } else {
+            s->rx_cv.broadcast();
+            s->tx_cv.broadcast();
+        }
+        c._streams.erase(id);
+    }
+    // Let the peer open another one
+    if (!ngtcp2_conn_is_local_stream(conn, id)) {
+        if (ngtcp2_is_bidi_stream(id)) {
+            ngtcp2_conn_extend_max_streams_bidi(conn, 1);
+        } else {
+            ngtcp2_conn_extend_max_streams_uni(conn, 1);
+        }
+    }
+    return 0;
+}
+
+int connection_impl::on_stream_reset(ngtcp2_conn*, int64_t id, uint64_t, uint64_t error_code, void* user_data, void*) noexcept {
+    if (auto s = from(user_data).find(id)) {
+        if (!s->rx_fin && !s->rx_error) {
+            s->rx_error = std::make_exception_ptr(std::system_error(ECONNRESET, std::system_category(),
+                    format("QUIC stream reset by peer, error {}", error_code)));
+        }
+        s->rx_cv.broadcast();
+    }
+    return 0;
+}
+
+int connection_impl::on_stop_sending(ngtcp2_conn*, int64_t id, uint64_t error_code, void* user_data, void*) noexcept {
+    if (auto s = from(user_data).find(id)) {
+        if (!s->tx_error) {
+            s->tx_error = std::make_exception_ptr(std::system_error(EPIPE, std::system_category(),
+                    format("QUIC stream stopped by peer, error {}", error_code)));
+        }
+        s->tx_cv.broadcast();
+    }
+    return 0;
+}
+
+int connection_impl::on_extend_streams(ngtcp2_conn*, uint64_t, void* user_data) noexcept {
+    from(user_data)._credit_cv.broadcast();
+    return 0;
+}
+
+int connection_impl::on_extend_stream_data(ngtcp2_conn*, int64_t id, uint64_t, void* user_data, void*) noexcept {
+    auto& c = from(user_data);
+    if (auto s = c.find(id); s && s->has_pending()) {
+        c.make_sendable(s);
+    }
+    return 0;
+}
+
+lw_shared_ptr<stream> connection_impl::make_stream(int64_t id) {
+    auto s = make_lw_shared<stream>(id);
+    _streams.emplace(id, s);
+    return s;
+}
+
+connected_socket connection_impl::make_socket(lw_shared_ptr<stream> s) {
+    return connected_socket(std::make_unique<stream_socket>(shared_from_this(), std::move(s)));
+}
+
+void connection_impl::make_sendable(const lw_shared_ptr<stream>& s) {
+    if (!s->sendable) {
+        s->sendable = true;
+        _sendable.push_back(s);
+    }
+}
+
+bool connection_impl::receive(const uint8_t* data, size_t len, const socket_address& from) {
+    if (_error) {
+        return false;
+    }
+    auto path = make_path(_local, from);
+    ngtcp2_pkt_info pi{};
+    auto rv = ngtcp2_conn_read_pkt(_conn, &path, &pi, data, len, timestamp());
+    if (rv == 0) {
+        return true;
+    }
+    ngtcp2_ccerr ccerr;
+    ngtcp2_ccerr_default(&ccerr);
+    switch (rv) {
+    case NGTCP2_ERR_DRAINING: {
+        auto* peer = ngtcp2_conn_get_ccerr(_conn);
+        abort(std::make_exception_ptr(std::system_error(ECONNRESET, std::system_category(),
+                format("QUIC connection closed by peer, error {}", peer->error_code))));
+        return false;
+    }
+    case NGTCP2_ERR_DROP_CONN:
+        abort(std::make_exception_ptr(quic_error("connection dropped", rv)));
+        return false;
+    case NGTCP2_ERR_CRYPTO:
+        ngtcp2_ccerr_set_tls_alert(&ccerr, ngtcp2_conn_get_tls_alert(_conn), nullptr, 0);
+        break;
+    default:
+        ngtcp2_ccerr_set_liberr(&ccerr, rv, nullptr, 0);
+    }
+    qlog.debug("Connection to {} failed: {}", _remote, ngtcp2_strerror(rv));
+    (void)close_with(ccerr, std::make_exception_ptr(quic_error("connection failed", rv)));
+    return false;
+}
+
+std::vector<net::packet> connection_impl::produce() {
+    std::vector<net::packet> packets;
+    auto max_size = ngtcp2_conn_get_max_tx_udp_payload_size(_conn);
+    auto ts = timestamp();
+    ngtcp2_path_storage ps;
+    ngtcp2_path_storage_zero(&ps);
+    std::array<ngtcp2_vec, 16> vecs;
+    while (packets.size() < _opts.max_send_batch) {
+        temporary_buffer<char> buf(max_size);
+        auto* out = reinterpret_cast<uint8_t*>(buf.get_write());
+        size_t written = 0;
+        // Coalesce the data of as many streams as fit in the datagram
+        for (;;) {
+            lw_shared_ptr<stream> s;
+            while (!_sendable.empty() && !s) {
+                s = _sendable.front();
+                if (!s->has_pending() || s->tx_error || !find(s->id)) {
+                    s->sendable = false;
+                    _sendable.pop_front();
+                    s = nullptr;
+                }
+            }
+            uint32_t flags = NGTCP2_WRITE_STREAM_FLAG_MORE;
+            size_t nvecs = 0;
+            int64_t id = -1;
+            if (s) {
+                id = s->id;
+                nvecs = s->unsent(vecs.data(), vecs.size());
+                uint64_t len = 0;
+                for (size_t i = 0; i < nvecs; i++) {
+                    len += vecs[i].len;
+                }
+                if (s->fin && s->tx_sent + len == s->tx_written) {
+                    flags |= NGTCP2_WRITE_STREAM_FLAG_FIN;
+                }
+            }
+            ngtcp2_ssize consumed = -1;
+            ngtcp2_pkt_info pi;
+            auto n = ngtcp2_conn_writev_stream(_conn, &ps.path, &pi, out, max_size, &consumed,
+                    flags, id, vecs.data(), nvecs, ts);
+            if (s && consumed >= 0) {
+                s->tx_sent += consumed;
+                if ((flags & NGTCP2_WRITE_STREAM_FLAG_FIN) && s->tx_sent == s->tx_written) {
+                    s->fin_sent = true;
+                }
+            }
+            if (n == NGTCP2_ERR_WRITE_MORE) {
+                if (s && !s->has_pending()) {
+                    s->sendable = false;
+                    _sendable.pop_front();
+                }
+                continue;
+            }
+            if (n == NGTCP2_ERR_STREAM_DATA_BLOCKED || n == NGTCP2_ERR_STREAM_SHUT_WR) {
+                // Flow control, or a reset: extend_max_stream_data() puts
+                // the stream back if it's the former
+                s->sendable = false;
+                _sendable.pop_front();
+                continue;
+            }
+            if (n < 0) {
+                ngtcp2_ccerr ccerr;
+                ngtcp2_ccerr_default(&ccerr);
+                ngtcp2_ccerr_set_liberr(&ccerr, n, nullptr, 0);
+                (void)close_with(ccerr, std::make_exception_ptr(quic_error("write", n)));
+                return {};
+            }
+            written = n;
+            if (s && !s->has_pending()) {
+                s->sendable = false;
+                _sendable.pop_front();
+            }
+            break;
+        }
+        if (!written) {
+            break;
+        }
+        buf.trim(written);
+        packets.emplace_back(std::move(buf));
+    }
+    if (!packets.empty()) {
+        ngtcp2_conn_update_pkt_tx_time(_conn, ts);
+    }
+    return packets;
+}
+
+void connection_impl::flush() {
+    if (_error) {
+        return;
+    }
+    if (_writing) {
+        _write_again = true;
+        return;
+    }
+    _writing = true;
+    (void)repeat([this] {
+        _write_again = false;
+        if (_error) {
+            return make_ready_future<stop_iteration>(stop_iteration::yes);
+        }
+        auto packets = produce();
+        if (packets.empty()) {
+            return make_ready_future<stop_iteration>(stop_iteration(!_write_again));
+        }
+        // A full batch may be followed by more
+        bool full = packets.size() == _opts.max_send_batch;
+        return _ep->send(_remote, std::move(packets)).then([this, full] {
+            return stop_iteration(!full && !_write_again);
+        });
+    }).handle_exception([this] (std::exception_ptr ex) {
+        // Lost datagrams are sent again after the loss timer
+        qlog.debug("Sending to {} failed: {}", _remote, ex);
+    }).finally([this, self = shared_from_this()] {
+        _writing = false;
+        rearm_timer();
+    });
+}
+
+void connection_impl::rearm_timer() {
+    if (_error) {
+        return;
+    }
+    auto expiry = ngtcp2_conn_get_expiry(_conn);
+    if (expiry == UINT64_MAX) {
+        _timer.cancel();
+        return;
+    }
+    auto now = timestamp();
+    _timer.rearm(clock_type::now() + std::chrono::nanoseconds(expiry > now ? expiry - now : 0));
+}
+
+void connection_impl::on_timer() {
+    auto rv = ngtcp2_conn_handle_expiry(_conn, timestamp());
+    if (rv == NGTCP2_ERR_IDLE_CLOSE) {
+        abort(std::make_exception_ptr(std::system_error(ETIMEDOUT, std::system_category(), "QUIC connection idle")));
+        return;
+    }
+    if (rv != 0) {
+        ngtcp2_ccerr ccerr;
+        ngtcp2_ccerr_default(&ccerr);
+        ngtcp2_ccerr_set_liberr(&ccerr, rv, nullptr, 0);
+        (void)close_with(ccerr, std::make_exception_ptr(quic_error("timer", rv)));
+        return;
+    }
+    flush();
+}
+
+future<> connection_impl::close_with(const ngtcp2_ccerr& ccerr, std::exception_ptr ex) {
+    if (_error) {
+        return make_ready_future<>();
+    }
+    auto f = make_ready_future<>();
+    if (!ngtcp2_conn_in_closing_period(_conn) && !ngtcp2_conn_in_draining_period(_conn)) {
+        temporary_buffer<char> buf(NGTCP2_MAX_UDP_PAYLOAD_SIZE);
+        ngtcp2_path_storage ps;
+        ngtcp2_path_storage_zero(&ps);
+        ngtcp2_pkt_info pi;
+        auto n = ngtcp2_conn_write_connection_close(_conn, &ps.path, &pi, reinterpret_cast<uint8_t*>(buf.get_write()),
+                buf.size(), &ccerr, timestamp());
+        if (n > 0) {
+            buf.trim(n);
+            std::vector<net::packet> packets;
+            packets.emplace_back(std::move(buf));
+            f = _ep->send(_remote, std::move(packets)).handle_exception([] (std::exception_ptr) {});
+        }
+    }
+    abort(std::move(ex));
+    return f;
+}
+
+void connection_impl::abort(std::exception_ptr ex) {
+    if (_error) {
+        return;
+    }
+    _error = ex;
+    _timer.cancel();
+    for (auto& [id, s] : _streams) {
+        s->fail(ex);
+    }
+    _streams.clear();
+    _sendable.clear();
+    _incoming_cv.broadcast();
+    _credit_cv.broadcast();
+    if (!_handshake_done && !_server) {
+        _handshake.set_exception(ex);
+    }
+    if (_server) {
+        for (auto& key : _cids) {
+            _server->remove_cid(key);
+        }
+        _cids.clear();
+    } else {
+        // Ends the client's receive loop
+        _ep->channel().shutdown_input();
+    }
+}
+
+future<connected_socket> connection_impl::open_stream() {
+    return _credit_cv.wait([this] {
+        return _error || ngtcp2_conn_get_streams_bidi_left(_conn) > 0;
+    }).then([this] {
+        if (_error) {
+            return make_exception_future<connected_socket>(_error);
+        }
+        int64_t id;
+        auto rv = ngtcp2_conn_open_bidi_stream(_conn, &id, nullptr);
+        if (rv != 0) {
+            return make_exception_future<connected_socket>(quic_error("stream", rv));
+        }
+        return make_ready_future<connected_socket>(make_socket(make_stream(id)));
+    });
+}
+
+future<connected_socket> connection_impl::accept_stream() {
+    return _incoming_cv.wait([this] {
+        return _error || !_incoming.empty();
+    }).then([this] {
+        if (!_incoming.empty()) {
+            auto s = std::move(_incoming.front());
+            _incoming.pop_front();
+            return make_ready_future<connected_socket>(make_socket(std::move(s)));
+        }
+        return make_exception_future<connected_socket>(_error);
+    });
+}
+
+sstring connection_impl::alpn() const {
+    gnutls_datum_t protocol;
+    if (gnutls_alpn_get_selected_protocol(_session, &protocol) != GNUTLS_E_SUCCESS) {
+        return {};
+    }
+    return sstring(reinterpret_cast<const char*>(protocol.data), protocol.size);
+}
+
+future<> connection_impl::close(uint64_t error_code) {
+    if (_error) {
+        return make_ready_future<>();
+    }
+    ngtcp2_ccerr ccerr;
+    ngtcp2_ccerr_default(&ccerr);
+    ngtcp2_ccerr_set_application_error(&ccerr, error_code, nullptr, 0);
+    return close_with(ccerr, std::make_exception_ptr(std::system_error(ECONNABORTED, std::system_category(), "QUIC connection closed")));
+}
+
+future<temporary_buffer<char>> connection_impl::read(lw_shared_ptr<stream> s) {
+    return s->rx_cv.wait([s] {
+        return !s->rx.empty() || s->rx_fin || s->rx_error;
+    }).then([this, s] {
+        if (!s->rx.empty()) {
+            auto b = std::move(s->rx.front());
+            s->rx.pop_front();
+            if (!_error) {
+                // Let the peer send as much again
+                ngtcp2_conn_extend_max_stream_offset(_conn, s->id, b.size());
+                ngtcp2_conn_extend_max_offset(_conn, b.size());
+                flush();
+            }
+            return make_ready_future<temporary_buffer<char>>(std::move(b));
+        }
+        if (s->rx_error) {
+            return make_exception_future<temporary_buffer<char>>(s->rx_error);
+        }
+        return make_ready_future<temporary_buffer<char>>();
+    });
+}
+
+future<> connection_impl::write(lw_shared_ptr<stream> s, net::packet p) {
+    return s->tx_cv.wait([this, s] {
+        return s->buffered() < _opts.max_stream_data || s->tx_error;
+    }).then([this, s, p = std::move(p)] () mutable {
+        if (s->tx_error) {
+            return make_exception_future<>(s->tx_error);
+        }
+        if (s->fin) {
+            return make_exception_future<>(std::system_error(EPIPE, std::system_category()));
+        }
+        for (auto& b : p.release()) {
+            s->tx_written += b.size();
+            s->tx.push_back(std::move(b));
+        }
+        make_sendable(s);
+        flush();
+        return make_ready_future<>();
+    });
+}
+
+future<> connection_impl::finish(lw_shared_ptr<stream> s) {
+    if (s->tx_error || s->fin) {
+        return make_ready_future<>();
+    }
+    s->fin = true;
+    make_sendable(s);
+    flush();
+    // The data must reach the peer before the connection may be closed
+    return s->tx_cv.wait([s] {
+        return s->fin_acked || s->tx_error;
+    }).handle_exception([] (std::exception_ptr) {});
+}
+
+void connection_impl::shutdown_input(stream& s) {
+    if (!_error && find(s.id)) {
+        ngtcp2_conn_shutdown_stream_read(_conn, 0, s.id, 0);
+        flush();
+    }
+    s.rx.clear();
+    s.rx_fin = true;
+    s.rx_cv.broadcast();
+}
+
+void connection_impl::shutdown_output(stream& s) {
+    if (!_error && find(s.id)) {
+        ngtcp2_conn_shutdown_stream_write(_conn, 0, s.id, 0);
+        flush();
+    }
+    if (!s.tx_error) {
+        s.tx_error = std::make_exception_ptr(std::system_error(EPIPE, std::system_category()));
+    }
+    s.tx_cv.broadcast();
+}
+
+server_impl::server_impl(socket_address local, shared_ptr<tls::server_credentials> creds, options opts)
+    : _ep(make_lw_shared<endpoint>(make_udp_channel(local)))
+    , _creds(std::move(creds))
+    , _opts(std::move(opts))
+    , _local(_ep->channel().local_address())
+{
+    gnutls_rnd(GNUTLS_RND_RANDOM, _reset_secret.data(), _reset_secret.size());
+}
+
+void server_impl::start() {
+    _receiver = receive_loop();
+}
+
+future<> server_impl::receive_loop() {
+    return repeat([this] {
+        return _ep->channel().receive_batch(receive_batch_size).then([this] (std::vector<net::udp_datagram> datagrams) {
+            std::vector<lw_shared_ptr<connection_impl>> touched;
+            for (auto& d : datagrams) {
+                handle(d, touched);
+            }
+            // Acknowledgements and responses to the whole batch go out
+            // together
+            for (auto& c : touched) {
+                c->flush();
+            }
+            return stop_iteration(_stopped);
+        });
+    }).handle_exception([this] (std::exception_ptr ex) {
+        if (!_stopped) {
+            qlog.error("Receiving on {} failed: {}", _local, ex);
+        }
+    });
+}
+
+void server_impl::handle(net::udp_datagram& d, std::vector<lw_shared_ptr<connection_impl>>& touched) {
+    auto& p = d.get_data();
+    p.linearize();
+    if (!p.len()) {
+        return;
+    }
+    auto* data = reinterpret_cast<const uint8_t*>(p.frag(0).base);
+    auto len = p.len();
+    auto from = d.get_src();
+    ngtcp2_version_cid vc;
+    auto rv = ngtcp2_pkt_decode_version_cid(&vc, data, len, cid_length);
+    if (rv == NGTCP2_ERR_VERSION_NEGOTIATION) {
+        send_version_negotiation(vc, from);
+        return;
+    }
+    if (rv != 0) {
+        return;
+    }
+    lw_shared_ptr<connection_impl> c;
+    if (auto it = _cids.find(cid_key(vc.dcid, vc.dcidlen)); it != _cids.end()) {
+        c = it->second;
+    } else {
+        ngtcp2_pkt_hd hd;
+        if (_stopped || ngtcp2_accept(&hd, data, len) != 0) {
+            return;
+        }
+        try {
+            c = accept_new(hd, from);
+        } catch (...) {
+            qlog.warn("Cannot accept a connection from {}: {}", from, std::current_exception());
+            return;
+        }
+    }
+    if (c->receive(data, len, from) && std::find(touched.begin(), touched.end(), c) == touched.end()) {
+        touched.push_back(std::move(c));
+    }
+}
+
+void server_impl::send_version_negotiation(const ngtcp2_version_cid& vc, const socket_address& to) {
+    std::array<uint32_t, 1> versions = {NGTCP2_PROTO_VER_V1};
+    temporary_buffer<char> buf(NGTCP2_MAX_UDP_PAYLOAD_SIZE);
+    uint8_t unused;
+    gnutls_rnd(GNUTLS_RND_NONCE, &unused, 1);
+    auto n = ngtcp2_pkt_write_version_negotiation(reinterpret_cast<uint8_t*>(buf.get_write()), buf.size(), unused,
+            vc.scid, vc.scidlen, vc.dcid, vc.dcidlen, versions.data(), versions.size());
+    if (n <= 0) {
+        return;
+    }
+    buf.trim(n);
+    std::vector<net::packet> packets;
+    packets.emplace_back(std::move(buf));
+    (void)_ep->send(to, std::move(packets)).handle_exception([] (std::exception_ptr) {});
+}
+
+lw_shared_ptr<connection_impl> server_impl::accept_new(const ngtcp2_pkt_hd& hd, const socket_address& from) {
+    auto c = make_lw_shared<connection_impl>(_ep, this, _local, from, _opts);
+    auto scid = random_cid();
+    c->init_server(hd, scid, tls::credentials_access::gnutls_credentials(*_creds), _reset_secret);
+    // The client keeps using the destination ID it picked until it hears
+    // from us
+    for (auto key : {cid_key(scid.data, scid.datalen), cid_key(hd.dcid.data, hd.dcid.datalen)}) {
+        add_cid(key, c);
+        c->_cids.push_back(std::move(key));
+    }
+    return c;
+}
+
+future<connection> server_impl::accept() {
+    return _accept_cv.wait([this] {
+        return _stopped || !_accepted.empty();
+    }).then([this] {
+        if (_accepted.empty()) {
+            return make_exception_future<connection>(std::system_error(ECONNABORTED, std::system_category(), "QUIC server stopped"));
+        }
+        auto c = std::move(_accepted.front());
+        _accepted.pop_front();
+        return make_ready_future<connection>(connection(std::move(c)));
+    });
+}
+
+future<> server_impl::stop() {
+    if (_stopped) {
+        return make_ready_future<>();
+    }
+    _stopped = true;
+    _accept_cv.broadcast();
+    std::vector<lw_shared_ptr<connection_impl>> conns;
+    for (auto& [key, c] : _cids) {
+        if (std::find(conns.begin(), conns.end(), c) == conns.end()) {
+            conns.push_back(c);
+        }
+    }
+    _accepted.clear();
+    return parallel_for_each(conns, [] (lw_shared_ptr<connection_impl> c) {
+        return c->close(0);
+    }).then([this] {
+        _ep->channel().shutdown_input();
+        return std::exchange(_receiver, make_ready_future<>());
+    }).then([this] {
+        return _ep->close();
+    });
+}
+
+future<connection> connect(socket_address remote, shared_ptr<tls::certificate_credentials> creds, sstring name, options opts) {
+    auto family = remote.family() == AF_INET6 ? net::inet_address::family::INET6 : net::inet_address::family::INET;
+    auto ep = make_lw_shared<endpoint>(make_udp_channel(socket_address(net::inet_address(family))));
+    auto c = make_lw_shared<connection_impl>(ep, nullptr, ep->channel().local_address(), remote, std::move(opts));
+    try {
+        c->init_client(tls::credentials_access::gnutls_credentials(*creds), name);
+    } catch (...) {
+        ep->channel().close();
+        return current_exception_as_future<connection>();
+    }
+    // The connection owns the channel: the loop ends when it's closed
+    (void)repeat([c, ep] {
+        return ep->channel().receive_batch(receive_batch_size).then([c] (std::vector<net::udp_datagram> datagrams) {
+            for (auto& d : datagrams) {
+                auto& p = d.get_data();
+                p.linearize();
+                if (p.len() && !c->receive(reinterpret_cast<const uint8_t*>(p.frag(0).base), p.len(), d.get_src())) {
+                    return stop_iteration::yes;
+                }
+            }
+            c->flush();
+            return stop_iteration::no;
+        });
+    }).handle_exception([] (std::exception_ptr) {}).finally([c, ep] {
+        return ep->close();
+    });
+    c->flush();
+    return c->handshake().then([c] {
+        return connection(c);
+    });
+}
+
+connection::connection(lw_shared_ptr<connection_impl> impl) noexcept : _impl(std::move(impl)) {}
+connection::connection(connection&&) noexcept = default;
+connection& connection::operator=(connection&&) noexcept = default;
+connection::~connection() = default;
+
+future<connected_socket> connection::open_stream() {
+    return _impl->open_stream();
+}
+
+future<connected_socket> connection::accept_stream() {
+    return _impl->accept_stream();
+}
+
+socket_address connection::local_address() const noexcept {
+    return _impl->local_address();
+}
+
+socket_address connection::remote_address() const noexcept {
+    return _impl->remote_address();
+}
+
+sstring connection::alpn() const {
+    return _impl->alpn();
+}
+
+future<> connection::close(uint64_t error_code) {
+    return _impl->close(error_code);
+}
+
+server::server(socket_address local, shared_ptr<tls::server_credentials> creds, options opts)
+    : _impl(make_lw_shared<server_impl>(local, std::move(creds), std::move(opts)))
+{
+    _impl->start();
+}
+
+server::server(server&&) noexcept = default;
+server& server::operator=(server&&) noexcept = default;
+server::~server() = default;
+
+future<connection> server::accept() {
+    return _impl->accept();
+}
+
+socket_address server::local_address() const noexcept {
+    return _impl->local_address();
+}
+
+future<> server::stop() {
+    return _impl->stop();
+}
+
+}
+
+}
+
+#endif
@@ -0,0 +1,510 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#include <seastar/net/shm.hh>
+#include <seastar/net/stack.hh>
+#include <seastar/core/condition-variable.hh>
+#include <seastar/core/internal/pollable_fd.hh>
+#include <seastar/core/loop.hh>
+#include <seastar/core/posix.hh>
+#include <seastar/core/shared_ptr.hh>
+#include <atomic>
+#include <cstring>
+#include <new>
+#include <sys/mman.h>
+#include <sys/socket.h>
+
+namespace seastar {
+
+namespace net {
+
+namespace {
+
+// Layout of the shared memory: a page with the headers of both rings,
+// followed by the client to server and the server to client ring data.
+
+constexpr uint32_t shm_magic = 0x53484d31; // "SHM1"
+constexpr size_t header_area = 4096;
+
+struct handshake {
+    uint32_t magic;
+    uint32_t ring_size;
+};
+
+// A single producer single consumer byte ring. The positions only grow, the
+// offset into the ring is the position modulo its size.
+struct ring_header {
+    alignas(64) std::atomic<uint64_t> head{0}; // bytes produced
+    std::atomic<uint32_t> producer_waiting{0}; // the producer sleeps until space frees up
+    std::atomic<uint32_t> closed{0}; // no more data will be produced
+    alignas(64) std::atomic<uint64_t> tail{0}; // bytes consumed
+    std::atomic<uint32_t> consumer_waiting{0}; // the consumer sleeps until data arrives
+    std::atomic<uint32_t> abandoned{0}; // the consumer reads no more
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "ring positions must be usable across processes");
+static_assert(2 * sizeof(ring_header) <= header_area);
+
+size_t area_size(size_t ring_size) {
+    return header_area + 2 * ring_size;
+}
+
+bool valid_ring_size(size_t ring_size) {
+    return ring_size >= 4096 && (ring_size & (ring_size - 1)) == 0;
+}
+
+// One end of a connection. The ends of a connection are symmetric, they only
+// differ in which ring they produce to.
+class shm_channel : public enable_lw_shared_from_this<shm_channel> {
+    struct ring {
+        ring_header* hdr;
+        char* data;
+    };
+    pollable_fd _ctl;
+    mmap_area _area;
+    size_t _size;
+    ring _tx;
+    ring _rx;
+    // Signalled by the peer, and by us to stop the wakeup loop
+    pollable_fd _wake;
+    file_desc _peer_wake;
+    uint64_t _wake_count;
+    char _ctl_byte;
+    condition_variable _wakeup;
+    socket_address _local;
+    unsigned _users = 0;
+    bool _peer_gone = false;
+    bool _stopped = false;
+    bool _input_shutdown = false;
+    bool _output_shutdown = false;
+public:
+    shm_channel(pollable_fd ctl, mmap_area area, size_t size, bool client, pollable_fd wake, file_desc peer_wake, socket_address local)
+            : _ctl(std::move(ctl))
+            , _area(std::move(area))
+            , _size(size)
+            , _wake(std::move(wake))
+            , _peer_wake(std::move(peer_wake))
+            , _local(std::move(local)) {
+        auto headers = reinterpret_cast<ring_header*>(_area.get());
+        ring c2s{headers, _area.get() + header_area};
+        ring s2c{headers + 1, _area.get() + header_area + _size};
+        _tx = client ? c2s : s2c;
+        _rx = client ? s2c : c2s;
+    }
+
+    void start() {
+        (void)do_until([this] { return _stopped; }, [this] {
+            return _wake.read_some(reinterpret_cast<char*>(&_wake_count), sizeof(_wake_count)).then([this] (size_t) {
+                _wakeup.broadcast();
+            });
+        }).handle_exception([] (std::exception_ptr) {}).finally([self = shared_from_this()] {});
+        // The peer closes the unix socket when it is done, or when it dies
+        (void)_ctl.read_some(&_ctl_byte, 1).then_wrapped([this, self = shared_from_this()] (future<size_t> f) {
+            f.ignore_ready_future();
+            _peer_gone = true;
+            _wakeup.broadcast();
+        });
+    }
+
+    void acquire() noexcept {
+        ++_users;
+    }
+
+    void release() noexcept {
+        if (--_users == 0) {
+            shutdown_input();
+            shutdown_output();
+            _stopped = true;
+            _ctl.shutdown(SHUT_RDWR, pollable_fd::shutdown_kernel_only::no);
+            signal(_wake.get_file_desc());
+        }
+    }
+
+    const socket_address& local_address() const noexcept {
+        return _local;
+    }
+
+    size_t ring_size() const noexcept {
+        return _size;
+    }
+
+    void shutdown_input() noexcept {
+        if (!_input_shutdown) {
+            _input_shutdown = true;
+            _rx.hdr->abandoned.store(1);
+            signal(_peer_wake);
+            _wakeup.broadcast();
+        }
+    }
+
+    void shutdown_output() noexcept {
+        if (!_output_shutdown) {
+            _output_shutdown = true;
+            _tx.hdr->closed.store(1);
+            signal(_peer_wake);
+            _wakeup.broadcast();
+        }
+    }
+
+    future<temporary_buffer<char>> read() {
+        return repeat_until_value([this] () -> future<std::optional<temporary_buffer<char>>> {
+            // Check for the end before looking at the data, the producer
+            // publishes all of its data before it closes
+            auto closed = _rx.hdr->closed.load() || _peer_gone || _input_shutdown;
+            if (auto buf = pull()) {
+                return make_ready_future<std::optional<temporary_buffer<char>>>(std::move(buf));
+            }
+            if (closed) {
+                return make_ready_future<std::optional<temporary_buffer<char>>>(temporary_buffer<char>());
+            }
+            _rx.hdr->consumer_waiting.store(1);
+            if (_rx.hdr->head.load() != _rx.hdr->tail.load(std::memory_order_relaxed)) {
+                return make_ready_future<std::optional<temporary_buffer<char>>>(std::nullopt);
+            }
+            return _wakeup.wait().then([] {
+                return std::optional<temporary_buffer<char>>();
+            });
+        });
+    }
+
+    future<> write(const char* data, size_t len) {
+        return repeat([this, data, len] () mutable {
+            if (_output_shutdown || _peer_gone || _tx.hdr->abandoned.load()) {
+                return make_exception_future<stop_iteration>(std::system_error(EPIPE, std::system_category()));
+            }
+            auto n = push(data, len);
+            data += n;
+            len -= n;
+            if (!len) {
+                return make_ready_future<stop_iteration>(stop_iteration::yes);
+            }
+            if (n) {
+                return make_ready_future<stop_iteration>(stop_iteration::no);
+            }
+            _tx.hdr->producer_waiting.store(1);
+            if (_tx.hdr->head.load(std::memory_order_relaxed) - _tx.hdr->tail.load() < _size) {
+                return make_ready_future<stop_iteration>(stop_iteration::no);
+            }
+            return _wakeup.wait().then([] {
+                return stop_iteration::no;
+            });
+        });
+    }
+
+private:
+    static void signal(file_desc& fd) noexcept {
+        uint64_t one = 1;
+        // Only fails once the counter would overflow, the peer is woken already then
+        (void)::write(fd.get(), &one, sizeof(one));
+    }
+
+    temporary_buffer<char> pull() {
+        auto head = _rx.hdr->head.load();
+        auto tail = _rx.hdr->tail.load(std::memory_order_relaxed);
+        if (head == tail) {
+            return {};
+        }
+        auto off = tail & (_size - 1);
+        auto n = std::min<size_t>(head - tail, _size - off);
+        temporary_buffer<char> buf(_rx.data + off, n);
+        _rx.hdr->tail.store(tail + n);
+        if (_rx.hdr->producer_waiting.exchange(0)) {
+            signal(_peer_wake);
+        }
+        return buf;
+    }
+
+    size_t push(const char* data, size_t len) {
+        auto head = _tx.hdr->head.load(std::memory_order_relaxed);
+        auto tail = _tx.hdr->tail.load();
+        auto n = std::min<size_t>(len, _size - (head - tail));
+        if (!n) {
+            return 0;
+        }
+        auto off = head & (_size - 1);
+        auto first = std::min(n, _size - off);
+        std::memcpy(_tx.data + off, data, first);
+        std::memcpy(_tx.data, data + first, n - first);
+        _tx.hdr->head.store(head + n);
+        if (_tx.hdr->consumer_waiting.exchange(0)) {
+            signal(_peer_wake);
+        }
+        return n;
+    }
+};
+
+// Keeps the channel in use, the last one shuts it down
+class channel_ref {
+    lw_shared_ptr<shm_channel> _ch;
+public:
+    explicit channel_ref(lw_shared_ptr<shm_channel> ch) noexcept : _ch(std::move(ch)) {
+        _ch->acquire();
+    }
+    channel_ref(const channel_ref& o) noexcept : channel_ref(o._ch) {}
+    channel_ref(channel_ref&&) noexcept = default;
+    ~channel_ref() {
+        if (_ch) {
+            _ch->release();
+        }
+    }
+    shm_channel* operator->() const noexcept {
+        return _ch.get();
+    }
+};
+
+class shm_data_source_impl final : public data_source_impl {
+    channel_ref _ch;
+public:
+    explicit shm_data_source_impl(channel_ref ch) noexcept : _ch(std::move(ch)) {}
+    virtual future<temporary_buffer<char>> get() override {
+        return _ch->read();
+    }
+    virtual future<> close() override {
+        _ch->shutdown_input();
+        return make_ready_future<>();
+    }
+};
+
+class shm_data_sink_impl final : public data_sink_impl {
+    channel_ref _ch;
+public:
+    explicit shm_data_sink_impl(channel_ref ch) noexcept : _ch(std::move(ch)) {}
+    virtual future<> put(net::packet p) override {
+        return do_with(std::move(p), size_t(0), [this] (net::packet& p, size_t& i) {
+            return do_until([&p, &i] { return i == p.nr_frags(); }, [this, &p, &i] {
+                auto& f = p.fragments()[i++];
+                return _ch->write(f.base, f.size);
+            });
+        });
+    }
+    virtual future<> close() override {
+        _ch->shutdown_output();
+        return make_ready_future<>();
+    }
+    virtual size_t buffer_size() const noexcept override {
+        return _ch->ring_size() / 4;
+    }
+};
+
+class shm_connected_socket_impl final : public connected_socket_impl {
+    channel_ref _ch;
+public:
+    explicit shm_connected_socket_impl(channel_ref ch) noexcept : _ch(std::move(ch)) {}
+    virtual data_source source() override {
+        return data_source(std::make_unique<shm_data_source_impl>(_ch));
+    }
+    virtual data_sink sink() override {
+        return data_sink(std::make_unique<shm_data_sink_impl>(_ch));
+    }
+    virtual void shutdown_input() override {
+        _ch->shutdown_input();
+    }
+    virtual void shutdown_output() override {
+        _ch->shutdown_output();
+    }
+    virtual void set_nodelay(bool) override {}
+    virtual bool get_nodelay() const override {
+        return true;
+    }
+    virtual void set_keepalive(bool) override {}
+    virtual bool get_keepalive() const override {
+        return false;
+    }
+    virtual void set_keepalive_parameters(const keepalive_params&) override {}
+    virtual keepalive_params get_keepalive_parameters() const override {
+        return tcp_keepalive_params{std::chrono::seconds(0), std::chrono::seconds(0), 0};
+    }
+    virtual void set_sockopt(int, int, const void*, size_t) override {
+        throw std::runtime_error("shared memory connections have no socket options");
+    }
+    virtual int get_sockopt(int, int, void*, size_t) const override {
+        throw std::runtime_error("shared memory connections have no socket options");
+    }
+    virtual socket_address local_address() const noexcept override {
+        return _ch->local_address();
+    }
+};
+
+connected_socket make_connection(pollable_fd ctl, mmap_area area, size_t size, bool client, pollable_fd wake, file_desc peer_wake) {
+    auto local = ctl.get_file_desc().get_address();
+    auto ch = make_lw_shared<shm_channel>(std::move(ctl), std::move(area), size, client, std::move(wake), std::move(peer_wake), std::move(local));
+    ch->start();
+    return connected_socket(std::make_unique<shm_connected_socket_impl>(channel_ref(std::move(ch))));
+}
+
+// The message handing the shared memory over: the handshake, with the
+// memfd and the eventfds waking the client and the server attached
+struct handover {
+    static constexpr unsigned nr_fds = 3;
+    handshake hs;
+    iovec iov;
+    msghdr msg;
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * nr_fds)];
+
+    handover() noexcept {
+        std::memset(&msg, 0, sizeof(msg));
+        iov = iovec{&hs, sizeof(hs)};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+    }
+    void set_fds(const int (&fds)[nr_fds]) noexcept {
+        auto cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+        std::memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+    }
+    std::vector<file_desc> take_fds() {
+        std::vector<file_desc> fds;
+        for (auto cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+                auto n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+                for (size_t i = 0; i < n; i++) {
+                    int fd;
+                    std::memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+                    fds.push_back(file_desc::from_fd(fd));
+                }
+            }
+        }
+        return fds;
+    }
+};
+
+file_desc make_eventfd() {
+    return file_desc::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+}
+
+class shm_socket_impl final : public socket_impl {
+    shm_options _opts;
+    std::optional<pollable_fd> _ctl;
+public:
+    explicit shm_socket_impl(shm_options opts) noexcept : _opts(opts) {}
+    virtual future<connected_socket> connect(socket_address sa, socket_address local, transport) override {
+        if (!valid_ring_size(_opts.ring_size)) {
+            return make_exception_future<connected_socket>(std::invalid_argument("shared memory ring size must be a power of two of at least 4096"));
+        }
+        _ctl.emplace(file_desc::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC));
+        return _ctl->connect(sa).then([this, size = _opts.ring_size] {
+            auto memfd = file_desc::from_fd(::memfd_create("seastar-shm", MFD_CLOEXEC));
+            throw_system_error_on(memfd.get() == -1, "memfd_create");
+            memfd.truncate(area_size(size));
+            auto area = memfd.map_shared_rw(area_size(size), 0);
+            auto headers = reinterpret_cast<ring_header*>(area.get());
+            new (headers) ring_header();
+            new (headers + 1) ring_header();
+            auto client_wake = make_eventfd();
+            auto server_wake = make_eventfd();
+            auto ho = std::make_unique<handover>();
+            ho->hs = handshake{shm_magic, uint32_t(size)};
+            ho->set_fds({memfd.get(), client_wake.get(), server_wake.get()});
+            auto& msg = ho->msg;
+            // The descriptors stay open until the message is sent
+            return _ctl->sendmsg(&msg).then([this, ho = std::move(ho), memfd = std::move(memfd)] (size_t) mutable {
+                // The server acknowledges once it mapped the memory
+                return _ctl->read_some(reinterpret_cast<char*>(&ho->hs), sizeof(ho->hs)).then([ho = std::move(ho)] (size_t n) {
+                    if (n != sizeof(handshake) || ho->hs.magic != shm_magic) {
+                        throw std::runtime_error("shared memory handshake rejected by the server");
+                    }
+                });
+            }).then([this, size, area = std::move(area), client_wake = std::move(client_wake), server_wake = std::move(server_wake)] () mutable {
+                auto ctl = std::move(*_ctl);
+                _ctl.reset();
+                return make_connection(std::move(ctl), std::move(area), size, true, pollable_fd(std::move(client_wake)), std::move(server_wake));
+            });
+        });
+    }
+    virtual void set_reuseaddr(bool) override {}
+    virtual bool get_reuseaddr() const override {
+        return false;
+    }
+    virtual void shutdown() override {
+        if (_ctl) {
+            _ctl->shutdown(SHUT_RDWR, pollable_fd::shutdown_kernel_only::no);
+        }
+    }
+};
+
+class shm_server_socket_impl final : public server_socket_impl {
+    pollable_fd _lfd;
+    shm_options _opts;
+public:
+    shm_server_socket_impl(pollable_fd lfd, shm_options opts) noexcept : _lfd(std::move(lfd)), _opts(opts) {}
+    virtual future<accept_result> accept() override {
+        return _lfd.accept().then([this] (std::tuple<pollable_fd, socket_address> fd_sa) {
+            return exchange_handshake(std::move(std::get<0>(fd_sa)), std::move(std::get<1>(fd_sa))).then_wrapped([this] (future<accept_result> f) {
+                if (f.failed()) {
+                    // Only this peer is at fault, keep accepting the others
+                    f.ignore_ready_future();
+                    return accept();
+                }
+                return f;
+            });
+        });
+    }
+    virtual void abort_accept() override {
+        _lfd.shutdown(SHUT_RD, pollable_fd::shutdown_kernel_only::no);
+    }
+    virtual socket_address local_address() const override {
+        return _lfd.get_file_desc().get_address();
+    }
+private:
+    future<accept_result> exchange_handshake(pollable_fd ctl, socket_address sa) {
+        auto ho = std::make_unique<handover>();
+        auto& msg = ho->msg;
+        return ctl.recvmsg(&msg).then([this, ctl, sa = std::move(sa), ho = std::move(ho)] (size_t n) mutable {
+            auto fds = ho->take_fds();
+            auto size = ho->hs.ring_size;
+            if (n != sizeof(handshake) || ho->hs.magic != shm_magic || fds.size() != handover::nr_fds
+                    || !valid_ring_size(size) || size > _opts.ring_size) {
+                throw std::runtime_error("invalid shared memory handshake");
+            }
+            auto area = fds[0].map_shared_rw(area_size(size), 0);
+            auto& hs = ho->hs;
+            return ctl.write_all(reinterpret_cast<const char*>(&hs), sizeof(hs)).then(
+                    [ctl, sa = std::move(sa), ho = std::move(ho), area = std::move(area), fds = std::move(fds), size] () mutable {
+                auto conn = make_connection(std::move(ctl), std::move(area), size, false, pollable_fd(std::move(fds[2])), std::move(fds[1]));
+                return accept_result{std::move(conn), std::move(sa)};
+            });
+        });
+    }
+};
+
+}
+
+server_socket shm_listen(socket_address sa, shm_options opts) {
+    if (!valid_ring_size(opts.ring_size)) {
+        throw std::invalid_argument("shared memory ring size must be a power of two of at least 4096");
+    }
+    auto fd = file_desc::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC);
+    fd.bind(sa.u.sa, sa.addr_length);
+    fd.listen(100);
+    return server_socket(std::make_unique<shm_server_socket_impl>(pollable_fd(std::move(fd)), opts));
+}
+
+socket shm_socket(shm_options opts) {
+    return socket(std::make_unique<shm_socket_impl>(opts));
+}
+
+}
+
+}
@@ -21,6 +21,8 @@
 
 #include <seastar/net/stack.hh>
 #include <seastar/net/inet_address.hh>
+#include <seastar/core/do_with.hh>
+#include <seastar/core/loop.hh>
 
 namespace seastar {
 
@@ -65,6 +67,30 @@ future<> net::udp_channel::send(const socket_address& dst, packet p) {
     return _impl->send(dst, std::move(p));
 }
 
+future<std::vector<net::udp_datagram>> net::udp_channel::receive_batch(size_t max_datagrams) {
+    return _impl->receive_batch(max_datagrams);
+}
+
+future<> net::udp_channel::send(const socket_address& dst, std::vector<packet> packets) {
+    return _impl->send(dst, std::move(packets));
+}
+
+future<std::vector<net::udp_datagram>> net::udp_channel_impl::receive_batch(size_t max_datagrams) {
+    return receive().then([] (udp_datagram dgram) {
+        std::vector<udp_datagram> ret;
+        ret.push_back(std::move(dgram));
+        return ret;
+    });
+}
+
+future<> net::udp_channel_impl::send(const socket_address& dst, std::vector<packet> packets) {
+    return do_with(dst, std::move(packets), [this] (const socket_address& dst, std::vector<packet>& packets) {
+        return do_for_each(packets, [this, &dst] (packet& p) {
+            return send(dst, std::move(p));
+        });
+    });
+}
+
 bool net::udp_channel::is_closed() const {
     return _impl->is_closed();
 }
@@ -137,6 +163,22 @@ socket_address connected_socket::local_address() const noexcept {
     return _csi->local_address();
 }
 
+net::tcp_connection_stats connected_socket::get_stats() const {
+    return _csi->get_stats();
+}
+
+future<> connected_socket::send_message(temporary_buffer<char> data, std::vector<file_desc> fds) {
+    return _csi->send_message(std::move(data), std::move(fds));
+}
+
+future<net::unix_message> connected_socket::receive_message(size_t max_size, unsigned max_fds) {
+    return _csi->receive_message(max_size, max_fds);
+}
+
+file_desc connected_socket::dup_fd() const {
+    return _csi->dup_fd();
+}
+
 void connected_socket::shutdown_output() {
     _csi->shutdown_output();
 }
@@ -151,6 +193,31 @@ net::connected_socket_impl::source(connected_socket_input_stream_config csisc) {
     return source();
 }
 
+net::tcp_connection_stats
+net::connected_socket_impl::get_stats() const {
+    throw std::system_error(ENOTSUP, std::system_category(), "connection statistics");
+}
+
+future<>
+net::connected_socket_impl::send_tls_record(uint8_t content_type, temporary_buffer<char> data) {
+    return make_exception_future<>(std::system_error(ENOTSUP, std::system_category(), "kernel tls records"));
+}
+
+future<>
+net::connected_socket_impl::send_message(temporary_buffer<char> data, std::vector<file_desc> fds) {
+    return make_exception_future<>(std::system_error(ENOTSUP, std::system_category(), "unix socket messages"));
+}
+
+future<net::unix_message>
+net::connected_socket_impl::receive_message(size_t max_size, unsigned max_fds) {
+    return make_exception_future<net::unix_message>(std::system_error(ENOTSUP, std::system_category(), "unix socket messages"));
+}
+
+file_desc
+net::connected_socket_impl::dup_fd() const {
+    throw std::system_error(ENOTSUP, std::system_category(), "socket file descriptor");
+}
+
 socket::~socket()
 {}
 
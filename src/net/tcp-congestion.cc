@@ -0,0 +1,314 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#include <seastar/net/tcp-congestion.hh>
+#include <fmt/format.h>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+
+namespace seastar {
+
+namespace net {
+
+using namespace std::chrono_literals;
+using clock_type = congestion_sample::clock_type;
+
+namespace {
+
+// RFC3465 appropriate byte counting, with L = 2 * SMSS
+void slow_start(congestion_window& w, uint32_t acked_bytes) {
+    w.cwnd += std::min(acked_bytes, 2 * w.mss);
+}
+
+// RFC5681 slow start and congestion avoidance
+class reno final : public congestion_controller {
+public:
+    virtual const char* name() const noexcept override {
+        return "reno";
+    }
+    virtual void on_ack(congestion_window& w, const congestion_sample& s) override {
+        if (s.in_recovery) {
+            return;
+        }
+        if (w.cwnd < w.ssthresh) {
+            slow_start(w, s.acked_bytes);
+        } else {
+            // About one SMSS per round trip
+            w.cwnd += std::max(uint32_t(1), uint32_t(uint64_t(w.mss) * s.acked_bytes / w.cwnd));
+        }
+    }
+    virtual uint32_t on_loss(congestion_window& w, uint32_t flight_size, clock_type::time_point) override {
+        return std::max(flight_size / 2, 2 * w.mss);
+    }
+};
+
+// RFC9438 CUBIC, window sizes are in segments as in the RFC
+class cubic final : public congestion_controller {
+    static constexpr double c = 0.4;
+    static constexpr double beta = 0.7;
+    // RFC9438 4.3: makes the Reno estimate grow as fast as Reno would
+    // with the CUBIC multiplicative decrease
+    static constexpr double alpha = 3 * (1 - beta) / (1 + beta);
+    double _w_max = 0;
+    double _k = 0;
+    double _w_est = 0;
+    // Fractions of a byte of window growth not applied yet
+    double _growth = 0;
+    std::optional<clock_type::time_point> _epoch_start;
+public:
+    virtual const char* name() const noexcept override {
+        return "cubic";
+    }
+    virtual void on_ack(congestion_window& w, const congestion_sample& s) override {
+        if (s.in_recovery) {
+            return;
+        }
+        if (w.cwnd < w.ssthresh) {
+            slow_start(w, s.acked_bytes);
+            return;
+        }
+        double cwnd = double(w.cwnd) / w.mss;
+        if (!_epoch_start) {
+            _epoch_start = s.now;
+            if (cwnd < _w_max) {
+                _k = std::cbrt((_w_max - cwnd) / c);
+            } else {
+                _k = 0;
+                _w_max = cwnd;
+            }
+            _w_est = cwnd;
+        }
+        // RFC9438 4.2: aim at the window one round trip ahead
+        auto t = std::chrono::duration<double>(s.now - *_epoch_start + s.srtt).count();
+        auto target = std::clamp(c * std::pow(t - _k, 3) + _w_max, cwnd, 1.5 * cwnd);
+        _w_est += alpha * s.acked_bytes / w.cwnd;
+        target = std::max(target, _w_est);
+        // RFC9438 4.4: grow by (target - cwnd) / cwnd per acknowledged segment
+        _growth += (target - cwnd) / cwnd * s.acked_bytes;
+        auto inc = uint32_t(_growth);
+        _growth -= inc;
+        w.cwnd += inc;
+    }
+    virtual uint32_t on_loss(congestion_window& w, uint32_t flight_size, clock_type::time_point) override {
+        double cwnd = double(w.cwnd) / w.mss;
+        // RFC9438 4.7: fast convergence, release bandwidth to new flows
+        _w_max = cwnd < _w_max ? cwnd * (1 + beta) / 2 : cwnd;
+        _epoch_start.reset();
+        _growth = 0;
+        return std::max(uint32_t(w.cwnd * beta), 2 * w.mss);
+    }
+    virtual void on_timeout(congestion_window& w) override {
+        _epoch_start.reset();
+    }
+};
+
+// Model based congestion control after BBRv2: the pacing rate and cwnd
+// follow the estimated bottleneck bandwidth and round trip propagation
+// time, and loss bounds the data in flight.
+class bbr final : public congestion_controller {
+    enum class mode { startup, drain, probe_bw, probe_rtt };
+    static constexpr double startup_gain = 2.885; // 2 / ln(2)
+    static constexpr double drain_gain = 1 / startup_gain;
+    static constexpr double cwnd_gain = 2;
+    static constexpr std::array<double, 8> probe_bw_gains = { 1.25, 0.75, 1, 1, 1, 1, 1, 1 };
+    static constexpr unsigned bw_window_rounds = 10;
+    static constexpr auto min_rtt_window = 10s;
+    static constexpr auto probe_rtt_duration = 200ms;
+    static constexpr unsigned min_cwnd_segments = 4;
+    static constexpr double loss_beta = 0.7;
+    static constexpr double pacing_margin = 0.99;
+
+    mode _mode = mode::startup;
+    double _pacing_gain = startup_gain;
+    double _cwnd_gain = startup_gain;
+    // Windowed maximum of the delivery rate, one slot per round trip
+    std::array<uint64_t, bw_window_rounds> _bw_samples = {};
+    unsigned _bw_slot = 0;
+    uint64_t _max_bw = 0;
+    clock_type::time_point _round_start;
+    std::chrono::microseconds _min_rtt = std::chrono::microseconds::max();
+    clock_type::time_point _min_rtt_stamp;
+    // Startup ends once the bandwidth stops growing
+    uint64_t _full_bw = 0;
+    unsigned _full_bw_rounds = 0;
+    bool _full_pipe = false;
+    unsigned _cycle_idx = 0;
+    clock_type::time_point _cycle_stamp;
+    clock_type::time_point _probe_rtt_done;
+    uint32_t _prior_cwnd = 0;
+    // Data in flight deemed safe, lowered on loss and probed upwards
+    uint32_t _inflight_hi = std::numeric_limits<uint32_t>::max();
+private:
+    uint32_t bdp(double gain) const {
+        if (!_max_bw || _min_rtt == std::chrono::microseconds::max()) {
+            return 0;
+        }
+        return uint32_t(std::min(gain * _max_bw * std::chrono::duration<double>(_min_rtt).count(), double(std::numeric_limits<uint32_t>::max())));
+    }
+    bool start_round(const congestion_sample& s) {
+        auto rtt = _min_rtt != std::chrono::microseconds::max() ? _min_rtt : s.srtt;
+        if (s.now - _round_start < rtt) {
+            return false;
+        }
+        _round_start = s.now;
+        return true;
+    }
+    void update_model(const congestion_sample& s, bool new_round) {
+        if (new_round) {
+            _bw_slot = (_bw_slot + 1) % bw_window_rounds;
+            _bw_samples[_bw_slot] = 0;
+        }
+        _bw_samples[_bw_slot] = std::max(_bw_samples[_bw_slot], s.delivery_rate);
+        _max_bw = *std::max_element(_bw_samples.begin(), _bw_samples.end());
+        if (s.rtt.count() && (s.rtt <= _min_rtt || _mode == mode::probe_rtt)) {
+            _min_rtt = s.rtt;
+            _min_rtt_stamp = s.now;
+        }
+        if (new_round && !_full_pipe) {
+            if (_max_bw >= _full_bw * 5 / 4) {
+                _full_bw = _max_bw;
+                _full_bw_rounds = 0;
+            } else if (++_full_bw_rounds >= 3) {
+                _full_pipe = true;
+            }
+        }
+    }
+    void enter_probe_bw(clock_type::time_point now) {
+        _mode = mode::probe_bw;
+        _cwnd_gain = cwnd_gain;
+        // Start cruising rather than probing, after draining the queue
+        _cycle_idx = 2;
+        _cycle_stamp = now;
+        _pacing_gain = probe_bw_gains[_cycle_idx];
+    }
+    void update_mode(congestion_window& w, const congestion_sample& s, bool new_round) {
+        switch (_mode) {
+        case mode::startup:
+            if (_full_pipe) {
+                _mode = mode::drain;
+                _pacing_gain = drain_gain;
+                _cwnd_gain = cwnd_gain;
+            }
+            break;
+        case mode::drain:
+            if (s.flight_size <= bdp(1)) {
+                enter_probe_bw(s.now);
+            }
+            break;
+        case mode::probe_bw:
+            if (s.now - _cycle_stamp >= _min_rtt) {
+                if (probe_bw_gains[_cycle_idx] > 1 && _inflight_hi != std::numeric_limits<uint32_t>::max()) {
+                    // A probe went by without loss, let inflight grow
+                    _inflight_hi += w.mss;
+                }
+                _cycle_idx = (_cycle_idx + 1) % probe_bw_gains.size();
+                _cycle_stamp = s.now;
+                _pacing_gain = probe_bw_gains[_cycle_idx];
+            }
+            break;
+        case mode::probe_rtt:
+            if (s.now >= _probe_rtt_done) {
+                _min_rtt_stamp = s.now;
+                w.cwnd = std::max(w.cwnd, _prior_cwnd);
+                if (_full_pipe) {
+                    enter_probe_bw(s.now);
+                } else {
+                    _mode = mode::startup;
+                    _pacing_gain = startup_gain;
+                    _cwnd_gain = startup_gain;
+                }
+            }
+            return;
+        }
+        // Refresh an expired round trip estimate with an almost empty pipe
+        if (_min_rtt != std::chrono::microseconds::max() && s.now - _min_rtt_stamp > min_rtt_window) {
+            _mode = mode::probe_rtt;
+            _pacing_gain = 1;
+            _prior_cwnd = w.cwnd;
+            _probe_rtt_done = s.now + probe_rtt_duration;
+        }
+    }
+    uint32_t target_cwnd(congestion_window& w) const {
+        // Room for the delayed and stretched acknowledgments
+        auto target = bdp(_cwnd_gain) + 3 * w.mss;
+        return std::max(std::min(target, _inflight_hi), min_cwnd_segments * w.mss);
+    }
+public:
+    virtual const char* name() const noexcept override {
+        return "bbr";
+    }
+    virtual void on_ack(congestion_window& w, const congestion_sample& s) override {
+        auto new_round = start_round(s);
+        update_model(s, new_round);
+        update_mode(w, s, new_round);
+        if (s.in_recovery) {
+            return;
+        }
+        auto target = target_cwnd(w);
+        if (!bdp(1)) {
+            // No model yet, grow as slow start does
+            w.cwnd = std::min(w.cwnd + s.acked_bytes, _inflight_hi);
+        } else if (_full_pipe) {
+            w.cwnd = std::min(w.cwnd + s.acked_bytes, target);
+        } else if (w.cwnd < target) {
+            w.cwnd += s.acked_bytes;
+        }
+        if (_mode == mode::probe_rtt) {
+            w.cwnd = std::min(w.cwnd, min_cwnd_segments * w.mss);
+        }
+        w.cwnd = std::max(w.cwnd, min_cwnd_segments * w.mss);
+    }
+    virtual uint32_t on_loss(congestion_window& w, uint32_t flight_size, clock_type::time_point now) override {
+        _inflight_hi = std::max(uint32_t(flight_size * loss_beta), min_cwnd_segments * w.mss);
+        // Loss ends startup, the pipe is full already
+        if (_mode == mode::startup) {
+            _full_pipe = true;
+        }
+        return _inflight_hi;
+    }
+    virtual void on_recovery_exit(congestion_window& w) override {
+        w.cwnd = std::max(w.cwnd, target_cwnd(w));
+    }
+    virtual uint64_t pacing_rate() const noexcept override {
+        return uint64_t(_pacing_gain * _max_bw * pacing_margin);
+    }
+};
+
+}
+
+std::unique_ptr<congestion_controller> make_congestion_controller(std::string_view name) {
+    if (name.empty() || name == "reno") {
+        return std::make_unique<reno>();
+    } else if (name == "cubic") {
+        return std::make_unique<cubic>();
+    } else if (name == "bbr") {
+        return std::make_unique<bbr>();
+    }
+    throw std::invalid_argument(fmt::format("unknown TCP congestion control algorithm: {}", name));
+}
+
+}
+
+}
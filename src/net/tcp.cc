@@ -59,6 +59,11 @@ void tcp_option::parse(uint8_t* beg1, uint8_t* end1) {
             _sack_received = true;
             beg += option_len::sack;
             break;
+        case option_kind::timestamps:
+            _timestamps_received = true;
+            _ts_recent = timestamps::read(beg).t1;
+            beg += option_len::timestamps;
+            break;
         case option_kind::nop:
             beg += option_len::nop;
             break;
@@ -77,6 +82,49 @@ void tcp_option::parse(uint8_t* beg1, uint8_t* end1) {
     }
 }
 
+const char* tcp_option::find_option(uint8_t* beg1, uint8_t* end1, option_kind wanted) {
+    const char* beg = reinterpret_cast<const char*>(beg1);
+    const char* end = reinterpret_cast<const char*>(end1);
+    while (beg < end) {
+        auto kind = option_kind(*beg);
+        if (kind == option_kind::eol) {
+            break;
+        }
+        if (kind == option_kind::nop) {
+            beg += option_len::nop;
+            continue;
+        }
+        if (beg + 1 >= end) {
+            break;
+        }
+        auto len = uint8_t(beg[1]);
+        // Prevent infinite loop and reading past the options
+        if (len < 2 || beg + len > end) {
+            break;
+        }
+        if (kind == wanted) {
+            return beg;
+        }
+        beg += len;
+    }
+    return nullptr;
+}
+
+tcp_option::sack_blocks tcp_option::parse_sack_blocks(uint8_t* beg, uint8_t* end) {
+    if (auto p = find_option(beg, end, option_kind::sack_blocks)) {
+        return sack_blocks::read(p);
+    }
+    return {};
+}
+
+std::optional<tcp_option::timestamps> tcp_option::parse_timestamps(uint8_t* beg, uint8_t* end) {
+    auto p = find_option(beg, end, option_kind::timestamps);
+    if (!p || uint8_t(p[1]) != uint8_t(option_len::timestamps)) {
+        return std::nullopt;
+    }
+    return timestamps::read(p);
+}
+
 uint8_t tcp_option::fill(void* h, const tcp_hdr* th, uint8_t options_size) {
     auto hdr = reinterpret_cast<char*>(h);
     auto off = hdr + tcp_hdr::len;
@@ -99,6 +147,26 @@ uint8_t tcp_option::fill(void* h, const tcp_hdr* th, uint8_t options_size) {
             off += win_scale.len;
             size += win_scale.len;
         }
+        if (_sack_received || !ack_on) {
+            auto sack = tcp_option::sack();
+            sack.write(off);
+            off += sack.len;
+            size += sack.len;
+        }
+    } else if (_local_sack_blocks.nr) {
+        _local_sack_blocks.write(off);
+        off += _local_sack_blocks.size();
+        size += _local_sack_blocks.size();
+    }
+    // Offered in our SYN, then sent in every segment once the remote
+    // agreed (RFC7323 3.2); TSecr of a SYN is zero as TS.Recent is
+    if (_timestamps_received || (syn_on && !ack_on)) {
+        auto ts = tcp_option::timestamps();
+        ts.t1 = _local_ts_val;
+        ts.t2 = _ts_recent;
+        ts.write(off);
+        off += ts.len;
+        size += ts.len;
     }
     if (size > 0) {
         // Insert NOP option
@@ -127,6 +195,14 @@ uint8_t tcp_option::get_size(bool syn_on, bool ack_on) {
         if (_win_scale_received || !ack_on) {
             size += option_len::win_scale;
         }
+        if (_sack_received || !ack_on) {
+            size += option_len::sack;
+        }
+    } else if (_local_sack_blocks.nr) {
+        size += _local_sack_blocks.size();
+    }
+    if (_timestamps_received || (syn_on && !ack_on)) {
+        size += option_len::timestamps;
     }
     if (size > 0) {
         size += option_len::eol;
@@ -21,7 +21,16 @@
 
 #include <gnutls/gnutls.h>
 #include <gnutls/x509.h>
+#include <linux/tls.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <mutex>
 #include <stdexcept>
+#include <thread>
+#include <unordered_map>
 #include <system_error>
 
 #include <seastar/core/loop.hh>
@@ -34,6 +43,9 @@
 #include <seastar/core/timer.hh>
 #include <seastar/core/print.hh>
 #include <seastar/core/with_timeout.hh>
+#include <seastar/core/gate.hh>
+#include <seastar/core/smp.hh>
+#include <seastar/core/alien.hh>
 #include <seastar/net/tls.hh>
 #include <seastar/net/stack.hh>
 #include <seastar/util/std-compat.hh>
@@ -397,10 +409,36 @@ class tls::certificate_credentials::impl: public gnutlsobj {
     gnutls_priority_t get_priority() const {
         return _priority.get();
     }
+    bool allows_tls13() const {
+        if (!_priority) {
+            return true;
+        }
+        const unsigned* list;
+        auto n = gnutls_priority_protocol_list(_priority.get(), &list);
+        return n < 0 || std::find(list, list + n, unsigned(GNUTLS_TLS1_3)) != list + n;
+    }
 
     void set_dn_verification_callback(dn_callback cb) {
         _dn_callback = std::move(cb);
     }
+    void set_kernel_tls(bool enable) {
+        _kernel_tls = enable;
+    }
+    bool get_kernel_tls() const {
+        return _kernel_tls;
+    }
+    void set_session_ticket_key(const blob& key) {
+        _session_ticket_key = sstring(key.data(), key.size());
+    }
+    void set_session_cache(sharded<session_cache>* cache) {
+        _session_cache = cache;
+    }
+    void set_handshake_offload(bool enable) {
+        _handshake_offload = enable;
+    }
+    bool get_handshake_offload() const {
+        return _handshake_offload;
+    }
 private:
     friend class credentials_builder;
     friend class session;
@@ -422,10 +460,18 @@ class tls::certificate_credentials::impl: public gnutlsobj {
     std::unique_ptr<std::remove_pointer_t<gnutls_priority_t>, void(*)(gnutls_priority_t)> _priority;
     client_auth _client_auth = client_auth::NONE;
     bool _load_system_trust = false;
+    bool _kernel_tls = false;
+    bool _handshake_offload = false;
+    sstring _session_ticket_key;
+    sharded<session_cache>* _session_cache = nullptr;
     semaphore _system_trust_sem {1};
     dn_callback _dn_callback;
 };
 
+void* tls::credentials_access::gnutls_credentials(const certificate_credentials& c) {
+    return static_cast<gnutls_certificate_credentials_t>(*c._impl);
+}
+
 tls::certificate_credentials::certificate_credentials()
         : _impl(make_shared<impl>()) {
 }
@@ -501,6 +547,14 @@ void tls::certificate_credentials::set_dn_verification_callback(dn_callback cb)
     _impl->set_dn_verification_callback(std::move(cb));
 }
 
+void tls::certificate_credentials::set_kernel_tls(bool enable) {
+    _impl->set_kernel_tls(enable);
+}
+
+void tls::certificate_credentials::set_handshake_offload(bool enable) {
+    _impl->set_handshake_offload(enable);
+}
+
 tls::server_credentials::server_credentials()
 #if GNUTLS_VERSION_NUMBER < 0x030600
     : server_credentials(dh_params{})
@@ -523,6 +577,143 @@ void tls::server_credentials::set_client_auth(client_auth ca) {
     _impl->set_client_auth(ca);
 }
 
+void tls::server_credentials::set_session_ticket_key(const blob& key) {
+    _impl->set_session_ticket_key(key);
+}
+
+void tls::server_credentials::set_session_cache(sharded<session_cache>& cache) {
+    _impl->set_session_cache(&cache);
+}
+
+sstring tls::generate_session_ticket_key() {
+    gnutls_datum_t key;
+    gtls_chk(gnutls_session_ticket_key_generate(&key));
+    sstring res(reinterpret_cast<const char*>(key.data), key.size);
+    gnutls_memset(key.data, 0, key.size);
+    gnutls_free(key.data);
+    return res;
+}
+
+static thread_local tls::write_stats tls_write_stats;
+
+static tls::write_stats& local_write_stats() noexcept {
+    return tls_write_stats;
+}
+
+const tls::write_stats& tls::get_write_stats() noexcept {
+    return tls_write_stats;
+}
+
+class tls::session_cache::impl {
+public:
+    struct entry {
+        sstring data;
+        lowres_clock::time_point expires;
+        std::list<sstring>::iterator age;
+    };
+
+    size_t max_entries;
+    std::chrono::seconds expiry;
+    std::unordered_map<sstring, entry> entries;
+    // Ids, the least recently stored first
+    std::list<sstring> ages;
+    stats st;
+    gate pending;
+
+    impl(size_t max, std::chrono::seconds exp)
+        : max_entries(std::max<size_t>(max, 1)), expiry(exp) {
+    }
+
+    std::optional<sstring> lookup(const sstring& id) {
+        st.lookups++;
+        auto i = entries.find(id);
+        if (i == entries.end()) {
+            return std::nullopt;
+        }
+        if (i->second.expires <= lowres_clock::now()) {
+            erase(i);
+            return std::nullopt;
+        }
+        st.hits++;
+        return i->second.data;
+    }
+    void store(sstring id, sstring data) {
+        st.stores++;
+        auto i = entries.find(id);
+        if (i != entries.end()) {
+            erase(i);
+        }
+        while (entries.size() >= max_entries) {
+            entries.erase(ages.front());
+            ages.pop_front();
+            st.evictions++;
+        }
+        auto age = ages.insert(ages.end(), id);
+        entries.emplace(std::move(id), entry{std::move(data), lowres_clock::now() + expiry, age});
+    }
+    void remove(const sstring& id) {
+        auto i = entries.find(id);
+        if (i != entries.end()) {
+            erase(i);
+        }
+    }
+    void erase(std::unordered_map<sstring, entry>::iterator i) {
+        ages.erase(i->second.age);
+        entries.erase(i);
+    }
+};
+
+tls::session_cache::session_cache(size_t max_entries, std::chrono::seconds expiry)
+    : _impl(std::make_unique<impl>(max_entries, expiry)) {
+}
+
+tls::session_cache::~session_cache() = default;
+
+future<> tls::session_cache::stop() {
+    return _impl->pending.close();
+}
+
+static shard_id session_owner(const sstring& id) {
+    return std::hash<sstring>()(id) % smp::count;
+}
+
+future<std::optional<sstring>> tls::session_cache::lookup(sstring id) {
+    auto owner = session_owner(id);
+    return container().invoke_on(owner, [id = std::move(id)] (session_cache& cache) {
+        return cache._impl->lookup(id);
+    });
+}
+
+void tls::session_cache::store(sstring id, sstring data) {
+    auto owner = session_owner(id);
+    (void)try_with_gate(_impl->pending, [this, owner, id = std::move(id), data = std::move(data)] () mutable {
+        return container().invoke_on(owner, [id = std::move(id), data = std::move(data)] (session_cache& cache) mutable {
+            cache._impl->store(std::move(id), std::move(data));
+        });
+    }).handle_exception([] (std::exception_ptr) {});
+}
+
+void tls::session_cache::remove(sstring id) {
+    auto owner = session_owner(id);
+    (void)try_with_gate(_impl->pending, [this, owner, id = std::move(id)] () mutable {
+        return container().invoke_on(owner, [id = std::move(id)] (session_cache& cache) {
+            cache._impl->remove(id);
+        });
+    }).handle_exception([] (std::exception_ptr) {});
+}
+
+std::chrono::seconds tls::session_cache::expiry() const noexcept {
+    return _impl->expiry;
+}
+
+size_t tls::session_cache::size() const noexcept {
+    return _impl->entries.size();
+}
+
+const tls::session_cache::stats& tls::session_cache::get_stats() const noexcept {
+    return _impl->st;
+}
+
 static const sstring dh_level_key = "dh_level";
 static const sstring x509_trust_key = "x509_trust";
 static const sstring x509_crl_key = "x509_crl";
@@ -625,6 +816,22 @@ void tls::credentials_builder::set_priority_string(const sstring& prio) {
     _priority = prio;
 }
 
+void tls::credentials_builder::set_kernel_tls(bool enable) {
+    _kernel_tls = enable;
+}
+
+void tls::credentials_builder::set_handshake_offload(bool enable) {
+    _handshake_offload = enable;
+}
+
+void tls::credentials_builder::set_session_ticket_key(const blob& key) {
+    _session_ticket_key = sstring(key.data(), key.size());
+}
+
+void tls::credentials_builder::set_session_cache(sharded<session_cache>& cache) {
+    _session_cache = &cache;
+}
+
 template<typename Blobs, typename Visitor>
 static void visit_blobs(Blobs& blobs, Visitor&& visitor) {
     auto visit = [&](const sstring& key, auto* vt) {
@@ -672,6 +879,10 @@ void tls::credentials_builder::apply_to(certificate_credentials& creds) const {
     }
 
     creds._impl->set_client_auth(_client_auth);
+    creds._impl->set_kernel_tls(_kernel_tls);
+    creds._impl->set_handshake_offload(_handshake_offload);
+    creds._impl->set_session_ticket_key(_session_ticket_key);
+    creds._impl->set_session_cache(_session_cache);
 }
 
 shared_ptr<tls::certificate_credentials> tls::credentials_builder::build_certificate_credentials() const {
@@ -739,7 +950,7 @@ class tls::reloadable_credentials_base {
         }
         void start() {
             // run the loop in a thread. makes code almost readable.
-            (void)async(std::bind(&reloading_builder::run, this)).finally([me = shared_from_this()] {});
+            (void)seastar::async(std::bind(&reloading_builder::run, this)).finally([me = shared_from_this()] {});
         }
         void run() {
             while (_creds) {
@@ -972,6 +1183,93 @@ namespace tls {
  * of these, since we handle handshake etc.
  *
  */
+// Threads, shared by all shards, on which sessions run the steps of their
+// handshakes, whose public key operations may take milliseconds, see
+// certificate_credentials::set_handshake_offload(). Results go back to the
+// shard of the session through its alien queue.
+class handshake_offloader {
+    struct job {
+        gnutls_session_t session;
+        alien::instance* instance;
+        unsigned shard;
+        promise<int>* result;
+    };
+
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    std::deque<job> _jobs;
+    bool _stopped = false;
+    std::vector<std::thread> _threads;
+
+    static std::atomic<unsigned> nr_threads;
+
+    void work() {
+        for (;;) {
+            job j;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _cv.wait(lock, [this] { return _stopped || !_jobs.empty(); });
+                if (_jobs.empty()) {
+                    return;
+                }
+                j = _jobs.front();
+                _jobs.pop_front();
+            }
+            int res = gnutls_handshake(j.session);
+            alien::run_on(*j.instance, j.shard, [result = j.result, res] () noexcept {
+                result->set_value(res);
+                delete result;
+            });
+        }
+    }
+public:
+    explicit handshake_offloader(unsigned n) {
+        for (unsigned i = 0; i < std::max(n, 1u); i++) {
+            _threads.emplace_back([this] { work(); });
+        }
+    }
+    ~handshake_offloader() {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stopped = true;
+        }
+        _cv.notify_all();
+        for (auto& t : _threads) {
+            t.join();
+        }
+    }
+
+    static void set_threads(unsigned n) {
+        nr_threads.store(n, std::memory_order_relaxed);
+    }
+    // Results need the alien queues which app_template sets up
+    static bool usable() noexcept {
+        return alien::internal::default_instance != nullptr;
+    }
+    static handshake_offloader& get() {
+        static handshake_offloader offloader(nr_threads.load(std::memory_order_relaxed));
+        return offloader;
+    }
+
+    future<int> submit(gnutls_session_t session) {
+        auto result = std::make_unique<promise<int>>();
+        auto f = result->get_future();
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _jobs.push_back(job{session, alien::internal::default_instance, this_shard_id(), result.get()});
+        }
+        result.release();
+        _cv.notify_one();
+        return f;
+    }
+};
+
+std::atomic<unsigned> handshake_offloader::nr_threads{2};
+
+void set_handshake_offload_threads(unsigned n) {
+    handshake_offloader::set_threads(n);
+}
+
 class session : public enable_lw_shared_from_this<session> {
 public:
     enum class type
@@ -1013,6 +1311,21 @@ class session : public enable_lw_shared_from_this<session> {
             gtls_chk(gnutls_priority_set(*this, prio));
         }
 
+        if (_type == type::SERVER) {
+            if (!_creds->_session_ticket_key.empty()) {
+                _session_ticket_key = _creds->_session_ticket_key;
+                blob_wrapper key(_session_ticket_key);
+                gtls_chk(gnutls_session_ticket_enable_server(*this, &key));
+            }
+            if (_creds->_session_cache) {
+                gnutls_db_set_ptr(*this, this);
+                gnutls_db_set_retrieve_function(*this, &db_retrieve_wrapper);
+                gnutls_db_set_store_function(*this, &db_store_wrapper);
+                gnutls_db_set_remove_function(*this, &db_remove_wrapper);
+                gnutls_db_set_cache_expiration(*this, _creds->_session_cache->local().expiry().count());
+            }
+        }
+
         gnutls_transport_set_ptr(*this, this);
         gnutls_transport_set_vec_push_function(*this, &vec_push_wrapper);
         gnutls_transport_set_pull_function(*this, &pull_wrapper);
@@ -1075,8 +1388,37 @@ class session : public enable_lw_shared_from_this<session> {
         if (_type == type::CLIENT && !_hostname.empty()) {
             gnutls_server_name_set(*this, GNUTLS_NAME_DNS, _hostname.data(), _hostname.size());
         }
+        return handshake_step().then([this] (int res) {
+            return handle_handshake_step(res);
+        });
+    }
+
+    // Runs gnutls_handshake() until it needs I/O, on the reactor, or on
+    // the offload threads, where push and pull only touch buffers of the
+    // session, and what must run on the reactor is left for after the step.
+    future<int> handshake_step() {
+        if (!_creds->get_handshake_offload() || !handshake_offloader::usable()) {
+            return make_ready_future<int>(gnutls_handshake(*this));
+        }
+        _offloaded = true;
+        return handshake_offloader::get().submit(*this).then([this] (int res) {
+            _offloaded = false;
+            if (!_offloaded_output.empty()) {
+                temporary_buffer<char> buf(_offloaded_output.data(), _offloaded_output.size());
+                _offloaded_output = {};
+                _output_pending = _output_pending.then([this, buf = std::move(buf)] () mutable {
+                    return _out.put(std::move(buf));
+                });
+            }
+            for (auto& work : std::exchange(_offloaded_work, {})) {
+                work();
+            }
+            return res;
+        });
+    }
+
+    future<> handle_handshake_step(int res) {
         try {
-            auto res = gnutls_handshake(*this);
             if (res < 0) {
                 switch (res) {
                 case GNUTLS_E_AGAIN:
@@ -1121,8 +1463,11 @@ class session : public enable_lw_shared_from_this<session> {
                 verify();
             }
             _connected = true;
+            _max_record_size = std::max<size_t>(gnutls_record_get_max_size(*this), 1);
             // make sure we reset output_pending
-            return wait_for_output();
+            return wait_for_output().then([this] {
+                maybe_enable_kernel_tls();
+            });
         } catch (...) {
             return make_exception_future<>(std::current_exception());
         }
@@ -1138,7 +1483,9 @@ class session : public enable_lw_shared_from_this<session> {
         // acquire both semaphores to sync both read & write
         return with_semaphore(_in_sem, 1, [this] {
             return with_semaphore(_out_sem, 1, [this] {
-                return do_handshake().handle_exception([this](auto ep) {
+                return prefetch_cached_session().then([this] {
+                    return do_handshake();
+                }).handle_exception([this](auto ep) {
                     if (!_error) {
                         _error = ep;
                     }
@@ -1148,6 +1495,85 @@ class session : public enable_lw_shared_from_this<session> {
         });
     }
 
+    // Hands the directions of the record layer which the kernel can take
+    // over to it, see certificate_credentials::set_kernel_tls(). Called
+    // when the handshake is done and its output flushed, with both
+    // semaphores held.
+    void maybe_enable_kernel_tls() noexcept {
+        if (!_creds->get_kernel_tls() || _ktls_tx || _ktls_rx) {
+            return;
+        }
+        auto version = gnutls_protocol_get_version(*this);
+        if (version != GNUTLS_TLS1_2 && version != GNUTLS_TLS1_3) {
+            return;
+        }
+        try {
+            static constexpr char ulp[] = "tls";
+            _sock->set_sockopt(SOL_TCP, TCP_ULP, ulp, sizeof(ulp));
+        } catch (...) {
+            // Not a posix socket, or no kernel support
+            return;
+        }
+        _ktls_tx = set_kernel_tls_keys(TLS_TX, version);
+        // Records we already read off the socket are past the kernel
+        if (_input.empty() && gnutls_record_check_pending(*this) == 0
+                && (version == GNUTLS_TLS1_2 || _type == type::SERVER)) {
+            _ktls_rx = set_kernel_tls_keys(TLS_RX, version);
+        }
+    }
+
+    bool set_kernel_tls_keys(int direction, gnutls_protocol_t version) noexcept {
+        gnutls_datum_t mac_key, iv, cipher_key;
+        unsigned char seq[8];
+        if (gnutls_record_get_state(*this, direction == TLS_RX, &mac_key, &iv, &cipher_key, seq) < 0) {
+            return false;
+        }
+        uint16_t tls_version = version == GNUTLS_TLS1_2 ? TLS_1_2_VERSION : TLS_1_3_VERSION;
+        switch (gnutls_cipher_get(*this)) {
+        case GNUTLS_CIPHER_AES_128_GCM:
+            return set_crypto_info<tls12_crypto_info_aes_gcm_128>(direction, TLS_CIPHER_AES_GCM_128, tls_version, iv, cipher_key, seq);
+        case GNUTLS_CIPHER_AES_256_GCM:
+            return set_crypto_info<tls12_crypto_info_aes_gcm_256>(direction, TLS_CIPHER_AES_GCM_256, tls_version, iv, cipher_key, seq);
+        case GNUTLS_CIPHER_CHACHA20_POLY1305:
+            return set_crypto_info<tls12_crypto_info_chacha20_poly1305>(direction, TLS_CIPHER_CHACHA20_POLY1305, tls_version, iv, cipher_key, seq);
+        default:
+            return false;
+        }
+    }
+
+    template <typename CryptoInfo>
+    bool set_crypto_info(int direction, uint16_t cipher, uint16_t tls_version,
+            const gnutls_datum_t& iv, const gnutls_datum_t& key, const unsigned char* seq) noexcept {
+        CryptoInfo info;
+        std::memset(&info, 0, sizeof(info));
+        info.info.version = tls_version;
+        info.info.cipher_type = cipher;
+        if (key.size != sizeof(info.key)) {
+            return false;
+        }
+        // gnutls keeps the whole nonce as the IV for TLS 1.3 (and
+        // ChaCha20), and only its implicit part, the salt, for TLS 1.2
+        // AES-GCM, whose explicit part starts as the sequence number.
+        if (iv.size == sizeof(info.salt) + sizeof(info.iv)) {
+            std::memcpy(info.iv, iv.data + sizeof(info.salt), sizeof(info.iv));
+        } else if (iv.size == sizeof(info.salt) && tls_version == TLS_1_2_VERSION) {
+            std::memcpy(info.iv, seq, sizeof(info.iv));
+        } else {
+            return false;
+        }
+        std::memcpy(info.salt, iv.data, sizeof(info.salt));
+        std::memcpy(info.key, key.data, sizeof(info.key));
+        std::memcpy(info.rec_seq, seq, sizeof(info.rec_seq));
+        bool ok = true;
+        try {
+            _sock->set_sockopt(SOL_TLS, direction, &info, sizeof(info));
+        } catch (...) {
+            ok = false;
+        }
+        gnutls_memset(&info, 0, sizeof(info));
+        return ok;
+    }
+
     size_t in_avail() const {
         return _input.size();
     }
@@ -1173,13 +1599,130 @@ class session : public enable_lw_shared_from_this<session> {
         });
     }
 
+    struct client_hello_info {
+        sstring session_id;
+        bool offers_tls13 = false;
+    };
+
+    // What matters to the session cache in a client hello, if it starts buf
+    static client_hello_info parse_client_hello(const buf_type& buf) {
+        client_hello_info res;
+        auto p = reinterpret_cast<const uint8_t*>(buf.get());
+        auto n = buf.size();
+        auto u16 = [p](size_t i) {
+            return size_t(p[i]) << 8 | p[i + 1];
+        };
+        // Record header, handshake header, client version, random
+        size_t i = 5 + 4 + 2 + 32;
+        if (n <= i || p[0] != 22 || p[5] != 1) {
+            return res;
+        }
+        size_t id_len = p[i++];
+        if (id_len > 32 || i + id_len > n) {
+            return res;
+        }
+        res.session_id = sstring(buf.get() + i, id_len);
+        i += id_len;
+        // Cipher suites, compression methods
+        if (i + 2 > n || (i += 2 + u16(i)) >= n || (i += 1 + p[i]) + 2 > n) {
+            return res;
+        }
+        auto end = std::min(n, i + 2 + u16(i));
+        for (i += 2; i + 4 <= end; i += 4 + u16(i + 2)) {
+            // supported_versions
+            if (u16(i) == 43 && i + 4 < end) {
+                auto versions_end = std::min(end, i + 5 + p[i + 4]);
+                for (auto v = i + 5; v + 2 <= versions_end; v += 2) {
+                    res.offers_tls13 |= u16(v) == 0x0304;
+                }
+            }
+        }
+        return res;
+    }
+
+    // gnutls looks TLS 1.2 sessions up synchronously, as it reads the
+    // client hello, so the session it asks for is fetched from the shard
+    // which owns it beforehand. TLS 1.3 resumes with tickets only, and its
+    // clients send random session ids.
+    future<> prefetch_cached_session() {
+        if (_type != type::SERVER || !_creds->_session_cache || std::exchange(_session_prefetched, true)) {
+            return make_ready_future<>();
+        }
+        return wait_for_input().then([this] {
+            auto hello = parse_client_hello(_input);
+            if (hello.session_id.empty() || (hello.offers_tls13 && _creds->allows_tls13())) {
+                return make_ready_future<>();
+            }
+            auto id = hello.session_id;
+            return _creds->_session_cache->local().lookup(std::move(id)).then([this, id = std::move(hello.session_id)](std::optional<sstring> data) mutable {
+                if (data) {
+                    _cached_session.emplace(std::move(id), std::move(*data));
+                }
+            });
+        });
+    }
+
+    static gnutls_datum_t db_retrieve_wrapper(void* ptr, gnutls_datum_t key) {
+        auto s = static_cast<session*>(ptr);
+        gnutls_datum_t res{nullptr, 0};
+        if (s->_cached_session && std::string_view(s->_cached_session->first) == std::string_view(reinterpret_cast<const char*>(key.data), key.size)) {
+            auto& data = s->_cached_session->second;
+            res.data = static_cast<unsigned char*>(gnutls_malloc(data.size()));
+            if (res.data) {
+                std::memcpy(res.data, data.data(), data.size());
+                res.size = data.size();
+            }
+        }
+        return res;
+    }
+    static int db_store_wrapper(void* ptr, gnutls_datum_t key, gnutls_datum_t data) {
+        try {
+            auto s = static_cast<session*>(ptr);
+            auto store = [s, key = std::string(reinterpret_cast<const char*>(key.data), key.size),
+                    data = std::string(reinterpret_cast<const char*>(data.data), data.size)] {
+                s->_creds->_session_cache->local().store(sstring(key), sstring(data));
+            };
+            if (s->_offloaded) {
+                s->_offloaded_work.emplace_back(std::move(store));
+            } else {
+                store();
+            }
+            return 0;
+        } catch (...) {
+            return -1;
+        }
+    }
+    static int db_remove_wrapper(void* ptr, gnutls_datum_t key) {
+        try {
+            auto s = static_cast<session*>(ptr);
+            auto remove = [s, key = std::string(reinterpret_cast<const char*>(key.data), key.size)] {
+                s->_cached_session.reset();
+                s->_creds->_session_cache->local().remove(sstring(key));
+            };
+            if (s->_offloaded) {
+                s->_offloaded_work.emplace_back(std::move(remove));
+            } else {
+                remove();
+            }
+            return 0;
+        } catch (...) {
+            return -1;
+        }
+    }
+
     static session * from_transport_ptr(gnutls_transport_ptr_t ptr) {
         return static_cast<session *>(ptr);
     }
 #if GNUTLS_VERSION_NUMBER >= 0x030406
     static int verify_wrapper(gnutls_session_t gs) {
         try {
-            from_transport_ptr(gnutls_transport_get_ptr(gs))->verify();
+            auto s = from_transport_ptr(gnutls_transport_get_ptr(gs));
+            if (s->_offloaded) {
+                // The peers are verified on the reactor once the
+                // handshake is done, as the dn callback expects
+                return 0;
+            }
+            s->verify();
             return 0;
         } catch (...) {
             return GNUTLS_E_CERTIFICATE_ERROR;
@@ -1256,6 +1799,9 @@ class session : public enable_lw_shared_from_this<session> {
     }
 
     future<temporary_buffer<char>> do_get() {
+        if (_ktls_rx) {
+            return do_get_kernel_tls();
+        }
         // gnutls might have stuff in its buffers.
         auto avail = gnutls_record_check_pending(*this);
         if (avail == 0) {
@@ -1299,10 +1845,43 @@ class session : public enable_lw_shared_from_this<session> {
         });
     }
 
+    future<temporary_buffer<char>> do_get_kernel_tls() {
+        if (eof()) {
+            return make_ready_future<temporary_buffer<char>>();
+        }
+        return _in.get().then_wrapped([this](future<temporary_buffer<char>> f) {
+            try {
+                auto buf = f.get();
+                _eof |= buf.empty();
+                return buf;
+            } catch (const std::system_error& e) {
+                // The kernel fails reads of records other than data; past
+                // the handshake, that is the alert closing the session.
+                if (e.code() != std::error_code(EIO, std::system_category())) {
+                    _error = std::current_exception();
+                    throw;
+                }
+                _eof = true;
+                return temporary_buffer<char>();
+            } catch (...) {
+                _error = std::current_exception();
+                throw;
+            }
+        });
+    }
+
     typedef net::fragment* frag_iter;
 
+    // Bounds the plaintext gnutls copies while corked
+    static constexpr size_t max_corked = 256 * 1024;
+
     future<> do_put(frag_iter i, frag_iter e) {
         assert(_output_pending.available());
+        // Corked, gnutls fills records up to their maximum size with as many
+        // fragments as they take, and pushes them all in one write when
+        // uncorked, rather than a record and a write per fragment.
+        gnutls_record_cork(*this);
+        _corked = 0;
         return do_for_each(i, e, [this](net::fragment& f) {
             auto ptr = f.base;
             auto size = f.size;
@@ -1314,13 +1893,44 @@ class session : public enable_lw_shared_from_this<session> {
                 auto res = gnutls_record_send(*this, ptr + off, size - off);
                 if (res > 0) { // don't really need to check, but...
                     off += res;
+                    _corked += res;
                 }
                 // what will we wait for? error or results...
-                auto f = res < 0 ? handle_output_error(res) : wait_for_output();
+                auto f = res < 0 ? handle_output_error(res)
+                        : _corked >= max_corked ? uncork().then([this] {
+                            gnutls_record_cork(*this);
+                        })
+                        : wait_for_output();
                 return f.then([] {
                     return make_ready_future<stop_iteration>(stop_iteration::no);
                 });
             });
+        }).then([this] {
+            return uncork();
+        });
+    }
+
+    future<> uncork() {
+        return repeat([this] {
+            auto res = gnutls_record_uncork(*this, 0);
+            if (res >= 0) {
+                auto& st = local_write_stats();
+                st.writes++;
+                st.bytes += _corked;
+                st.records += (_corked + _max_record_size - 1) / _max_record_size;
+                _corked = 0;
+                return wait_for_output().then([] {
+                    return make_ready_future<stop_iteration>(stop_iteration::yes);
+                });
+            }
+            if (res == GNUTLS_E_AGAIN || res == GNUTLS_E_INTERRUPTED) {
+                return wait_for_output().then([] {
+                    return make_ready_future<stop_iteration>(stop_iteration::no);
+                });
+            }
+            return handle_output_error(res).then([] {
+                return make_ready_future<stop_iteration>(stop_iteration::yes);
+            });
         });
     }
     future<> put(net::packet p) {
@@ -1335,6 +1945,15 @@ class session : public enable_lw_shared_from_this<session> {
                return put(std::move(p));
             });
         }
+        if (_ktls_tx) {
+            // The kernel makes the records
+            return with_semaphore(_out_sem, 1, [this, p = std::move(p)]() mutable {
+                return _out.put(std::move(p)).handle_exception([this](auto ep) {
+                    _error = ep;
+                    return make_exception_future(ep);
+                });
+            });
+        }
         auto i = p.fragments().begin();
         auto e = p.fragments().end();
         return with_semaphore(_out_sem, 1, std::bind(&session::do_put, this, i, e)).finally([p = std::move(p)] {});
@@ -1356,6 +1975,14 @@ class session : public enable_lw_shared_from_this<session> {
         return n;
     }
     ssize_t vec_push(const giovec_t * iov, int iovcnt) {
+        if (_offloaded) {
+            ssize_t n = 0;
+            for (int i = 0; i < iovcnt; ++i) {
+                _offloaded_output.append(reinterpret_cast<const char *>(iov[i].iov_base), iov[i].iov_len);
+                n += iov[i].iov_len;
+            }
+            return n;
+        }
         if (!_output_pending.available()) {
             gnutls_transport_set_errno(*this, EAGAIN);
             return -1;
@@ -1417,6 +2044,17 @@ class session : public enable_lw_shared_from_this<session> {
         if (_error || !_connected) {
             return make_ready_future();
         }
+        if (_ktls_tx) {
+            // gnutls no longer knows the sequence number, so the kernel
+            // sends the close_notify alert
+            static constexpr uint8_t alert_content_type = 21;
+            temporary_buffer<char> alert(2);
+            alert.get_write()[0] = char(GNUTLS_AL_WARNING);
+            alert.get_write()[1] = char(GNUTLS_A_CLOSE_NOTIFY);
+            return _out.flush().then([this, alert = std::move(alert)]() mutable {
+                return _sock->send_tls_record(alert_content_type, std::move(alert));
+            });
+        }
         auto res = gnutls_bye(*this, GNUTLS_SHUT_WR);
         if (res < 0) {
             switch (res) {
@@ -1555,8 +2193,25 @@ class session : public enable_lw_shared_from_this<session> {
     bool _eof = false;
     bool _shutdown = false;
     bool _connected = false;
+    // Directions of the record layer offloaded to the kernel
+    bool _ktls_tx = false;
+    bool _ktls_rx = false;
+    bool _session_prefetched = false;
     std::exception_ptr _error;
 
+    // While a handshake step runs on the offload threads
+    bool _offloaded = false;
+    std::string _offloaded_output;
+    std::vector<std::function<void()>> _offloaded_work;
+
+    // Plaintext sent since the last uncork()
+    size_t _corked = 0;
+    size_t _max_record_size = 16384;
+
+    sstring _session_ticket_key;
+    // The id and data of the session the client hello asks to resume
+    std::optional<std::pair<sstring, sstring>> _cached_session;
+
     future<> _output_pending;
     buf_type _input;
 
@@ -1632,6 +2287,9 @@ class tls_connected_socket_impl : public net::connected_socket_impl, public sess
     socket_address local_address() const noexcept override {
         return _session->socket().local_address();
     }
+    net::tcp_connection_stats get_stats() const override {
+        return _session->socket().get_stats();
+    }
     future<std::optional<session_dn>> get_distinguished_name() {
         return _session->get_distinguished_name();
     }
@@ -1649,6 +2307,9 @@ class tls_connected_socket_impl::source_impl: public data_source_impl, public se
         _session->close();
         return make_ready_future<>();
     }
+    void cancel() noexcept override {
+        _session->close();
+    }
 };
 
 // Note: source/sink, and by extension, the in/out streams
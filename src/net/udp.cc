@@ -98,6 +98,10 @@ class native_channel : public udp_channel_impl {
         return _state->_queue.pop_eventually();
     }
 
+    virtual future<std::vector<udp_datagram>> receive_batch(size_t max_datagrams) override {
+        return _state->_queue.pop_eventually_batch(max_datagrams);
+    }
+
     virtual future<> send(const socket_address& dst, const char* msg) override {
         return send(dst, packet::from_static_data(msg, strlen(msg)));
     }
@@ -110,6 +114,25 @@ class native_channel : public udp_channel_impl {
         });
     }
 
+    virtual future<> send(const socket_address& dst, std::vector<packet> packets) override {
+        size_t len = 0;
+        for (auto& p : packets) {
+            len += p.len();
+        }
+        if (len > _state->send_buffer_size()) {
+            return udp_channel_impl::send(dst, std::move(packets));
+        }
+        // One wait for the whole batch, whose packets reference the
+        // caller's fragments as single sends do
+        return _state->wait_for_send_buffer(len).then([this, dst, packets = std::move(packets)] () mutable {
+            for (auto& p : packets) {
+                auto len = p.len();
+                p = packet(std::move(p), make_deleter([s = _state, len] { s->complete_send(len); }));
+                _proto.send(_reg.port(), dst, std::move(p));
+            }
+        });
+    }
+
     virtual bool is_closed() const override {
         return _closed;
     }
@@ -134,9 +157,13 @@ using namespace net::ipv4_udp_impl;
 
 const int ipv4_udp::default_queue_size = 1024;
 
+thread_local ipv4_udp* ipv4_udp::_local = nullptr;
+
 ipv4_udp::ipv4_udp(ipv4& inet)
     : _inet(inet)
+    , _next_anonymous_port(min_anonymous_port + (this_shard_id() + smp::count - min_anonymous_port % smp::count) % smp::count)
 {
+    _local = this;
     _inet.register_packet_provider([this] {
         std::optional<ipv4_traits::l4packet> l4p;
         if (!_packetq.empty()) {
@@ -147,6 +174,12 @@ ipv4_udp::ipv4_udp(ipv4& inet)
     });
 }
 
+ipv4_udp::~ipv4_udp() {
+    if (_local == this) {
+        _local = nullptr;
+    }
+}
+
 bool ipv4_udp::forward(forward_hash& out_hash_data, packet& p, size_t off)
 {
     auto uh = p.get_header<udp_hdr>(off);
@@ -159,12 +192,34 @@ bool ipv4_udp::forward(forward_hash& out_hash_data, packet& p, size_t off)
 }
 
 void ipv4_udp::received(packet p, ipv4_address from, ipv4_address to)
+{
+    auto uh = p.get_header<udp_hdr>();
+    if (!uh) {
+        return;
+    }
+    auto port = ntoh(uh->dst_port);
+    auto owner = owner_of(port);
+    if (owner != this_shard_id() && !_channels.count(port)) {
+        // FIXME: future is discarded
+        (void)smp::submit_to(owner, [p = p.free_on_cpu(this_shard_id()), from, to] () mutable {
+            if (_local) {
+                _local->deliver(std::move(p), from, to);
+            }
+        });
+        return;
+    }
+    deliver(std::move(p), from, to);
+}
+
+void ipv4_udp::deliver(packet p, ipv4_address from, ipv4_address to)
 {
     udp_datagram dgram(std::make_unique<native_datagram>(from, to, std::move(p)));
 
     auto chan_it = _channels.find(dgram.get_dst_port());
     if (chan_it != _channels.end()) {
         auto chan = chan_it->second;
+        // Datagrams received in one poll are pushed back to back, and the
+        // receiver picks up all of them at once with receive_batch()
         chan->_queue.push(std::move(dgram));
     }
 }
@@ -200,7 +255,8 @@ void ipv4_udp::send(uint16_t src_port, ipv4_addr dst, packet &&p)
 }
 
 uint16_t ipv4_udp::next_port(uint16_t port) {
-    return (port + 1) == 0 ? min_anonymous_port : port + 1;
+    // The next anonymous port of this shard
+    return uint32_t(port) + smp::count > 0xffff ? port - (port - min_anonymous_port) / smp::count * smp::count : port + smp::count;
 }
 
 udp_channel
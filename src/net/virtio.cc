@@ -29,12 +29,16 @@
 #include <seastar/core/circular_buffer.hh>
 #include <seastar/core/align.hh>
 #include <seastar/core/metrics.hh>
+#include <seastar/core/memory.hh>
 #include <seastar/util/function_input_iterator.hh>
 #include <seastar/util/transform_iterator.hh>
 #include <atomic>
 #include <vector>
 #include <queue>
+#include <mutex>
 #include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <linux/vhost.h>
 #include <linux/if_tun.h>
 #include <seastar/net/ip.hh>
@@ -67,10 +71,17 @@ phys virt_to_phys(void* p) {
 
 #endif
 
+class vhost_user;
+
 class device : public net::device {
 private:
     net::hw_features _hw_features;
     uint64_t _features;
+    uint16_t _queues;
+    std::string _vhost_user_path;
+    // Connected by the first queue to be set up
+    std::mutex _vhost_user_mutex;
+    std::shared_ptr<vhost_user> _vhost_user;
 
 private:
     uint64_t setup_features(const net::virtio_options& opts, const program_options::value<std::string>& lro) {
@@ -116,6 +127,8 @@ class device : public net::device {
 public:
     device(const virtio_options& opts, const program_options::value<std::string>& lro)
        : _features(setup_features(opts, lro))
+       , _queues(std::min(opts.virtio_queues.get_value() ? opts.virtio_queues.get_value() : smp::count, smp::count))
+       , _vhost_user_path(opts.vhost_user.get_value())
        {}
     ethernet_address hw_address() override {
         return { 0x12, 0x23, 0x34, 0x56, 0x67, 0x78 };
@@ -129,6 +142,10 @@ class device : public net::device {
         return _features;
     }
 
+    virtual uint16_t hw_queues_count() override {
+        return _queues;
+    }
+
     virtual std::unique_ptr<net::qp> init_local_queue(const program_options::option_group& opts, uint16_t qid) override;
 };
 
@@ -577,7 +594,7 @@ class qp : public net::qp {
     void common_config(ring_config& r);
     size_t vring_storage_size(size_t ring_size);
 public:
-    explicit qp(device* dev, size_t rx_ring_size, size_t tx_ring_size);
+    explicit qp(device* dev, size_t rx_ring_size, size_t tx_ring_size, uint16_t qid = 0);
     virtual future<> send(packet p) override {
         abort();
     }
@@ -753,8 +770,9 @@ static std::unique_ptr<char[], free_deleter> virtio_buffer(size_t size) {
     return std::unique_ptr<char[], free_deleter>(reinterpret_cast<char*>(ret));
 }
 
-qp::qp(device* dev, size_t rx_ring_size, size_t tx_ring_size)
-    : _dev(dev)
+qp::qp(device* dev, size_t rx_ring_size, size_t tx_ring_size, uint16_t qid)
+    : net::qp(false, "network", qid)
+    , _dev(dev)
     , _txq_storage(virtio_buffer(vring_storage_size(tx_ring_size)))
     , _rxq_storage(virtio_buffer(vring_storage_size(rx_ring_size)))
     , _txq(*this, txq_config(tx_ring_size))
@@ -807,7 +825,7 @@ class qp_vhost : public qp {
     // this driver, as as soon as we close it, vhost stops servicing us.
     file_desc _vhost_fd;
 public:
-    qp_vhost(device* dev, const native_stack_options& opts);
+    qp_vhost(device* dev, const native_stack_options& opts, uint16_t qid);
 };
 
 static size_t config_ring_size(const virtio_options& opts) {
@@ -818,8 +836,8 @@ static size_t config_ring_size(const virtio_options& opts) {
     }
 }
 
-qp_vhost::qp_vhost(device *dev, const native_stack_options& opts)
-    : qp(dev, config_ring_size(opts.virtio_opts), config_ring_size(opts.virtio_opts))
+qp_vhost::qp_vhost(device *dev, const native_stack_options& opts, uint16_t qid)
+    : qp(dev, config_ring_size(opts.virtio_opts), config_ring_size(opts.virtio_opts), qid)
     , _vhost_fd(file_desc::open("/dev/vhost-net", O_RDWR))
 {
     auto tap_device = opts.tap_device.get_value();
@@ -838,10 +856,13 @@ qp_vhost::qp_vhost(device *dev, const native_stack_options& opts)
     // this function. It appears that this is fine - i.e., after we pass
     // this fd to VHOST_NET_SET_BACKEND, the Linux kernel keeps the reference
     // to it and it's fine to close the file descriptor.
+    // With several queues, each one attaches its own file to a multiqueue
+    // tap, with a vhost-net instance of its own.
     file_desc tap_fd(file_desc::open("/dev/net/tun", O_RDWR | O_NONBLOCK));
     assert(tap_device.size() + 1 <= IFNAMSIZ);
     ifreq ifr = {};
-    ifr.ifr_flags = IFF_TAP | IFF_NO_PI | IFF_ONE_QUEUE | IFF_VNET_HDR;
+    ifr.ifr_flags = IFF_TAP | IFF_NO_PI | IFF_VNET_HDR;
+    ifr.ifr_flags |= _dev->hw_queues_count() > 1 ? IFF_MULTI_QUEUE : IFF_ONE_QUEUE;
     strcpy(ifr.ifr_ifrn.ifrn_name, tap_device.c_str());
     tap_fd.ioctl(TUNSETIFF, ifr);
     unsigned int offload = 0;
@@ -898,6 +919,215 @@ qp_vhost::qp_vhost(device *dev, const native_stack_options& opts)
     _vhost_fd.ioctl(VHOST_NET_SET_BACKEND, vhost_vring_file{1, tap_fd.get()});
 }
 
+// A connection to a vhost-user backend, such as the vhost port of a DPDK
+// virtual switch, shared by the queues of the device, which set up their
+// rings over it from their shards.
+//
+// The backend reads and writes the rings and the buffers in place, so it
+// maps the memory of all shards, which must therefore be backed by files,
+// with --hugepages; descriptors carry virtual addresses, which are also the
+// "guest physical" addresses of the memory table.
+class vhost_user {
+    enum request : uint32_t {
+        get_features = 1,
+        set_features = 2,
+        set_owner = 3,
+        set_mem_table = 5,
+        set_vring_num = 8,
+        set_vring_addr = 9,
+        set_vring_base = 10,
+        set_vring_kick = 12,
+        set_vring_call = 13,
+        get_protocol_features = 15,
+        set_protocol_features = 16,
+        get_queue_num = 17,
+        set_vring_enable = 18,
+    };
+    static constexpr uint32_t version = 0x1;
+    static constexpr uint32_t reply_flag = 0x4;
+    static constexpr uint64_t f_protocol_features = uint64_t(1) << 30;
+    static constexpr uint64_t protocol_f_mq = uint64_t(1) << 0;
+    // Backends are only required to take that many
+    static constexpr unsigned max_regions = 8;
+
+    struct header {
+        uint32_t request;
+        uint32_t flags;
+        uint32_t size;
+    };
+    struct vring_state {
+        uint32_t index;
+        uint32_t num;
+    };
+    struct vring_addr {
+        uint32_t index;
+        uint32_t flags;
+        uint64_t desc;
+        uint64_t used;
+        uint64_t avail;
+        uint64_t log;
+    };
+    struct memory_region {
+        uint64_t guest_phys_addr;
+        uint64_t memory_size;
+        uint64_t userspace_addr;
+        uint64_t mmap_offset;
+    };
+    struct memory_table {
+        uint32_t nregions;
+        uint32_t padding;
+        memory_region regions[max_regions];
+    };
+
+    std::mutex _mutex;
+    file_desc _fd;
+    uint64_t _features;
+    bool _protocol_features = false;
+    unsigned _max_queues = 1;
+private:
+    void send(request req, const void* payload, size_t size, const std::vector<int>& fds = {}) {
+        header h{req, version, uint32_t(size)};
+        std::array<iovec, 2> iov = {{
+            {&h, sizeof(h)},
+            {const_cast<void*>(payload), size},
+        }};
+        std::vector<char> control(CMSG_SPACE(sizeof(int) * std::max<size_t>(fds.size(), 1)));
+        msghdr mh = {};
+        mh.msg_iov = iov.data();
+        mh.msg_iovlen = size ? 2 : 1;
+        if (!fds.empty()) {
+            mh.msg_control = control.data();
+            mh.msg_controllen = CMSG_SPACE(sizeof(int) * fds.size());
+            auto cmsg = CMSG_FIRSTHDR(&mh);
+            cmsg->cmsg_level = SOL_SOCKET;
+            cmsg->cmsg_type = SCM_RIGHTS;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+            std::copy(fds.begin(), fds.end(), reinterpret_cast<int*>(CMSG_DATA(cmsg)));
+        }
+        _fd.sendmsg(&mh, MSG_NOSIGNAL);
+    }
+    void send_u64(request req, uint64_t v) {
+        send(req, &v, sizeof(v));
+    }
+    void read_exactly(void* buf, size_t len) {
+        auto p = static_cast<char*>(buf);
+        while (len) {
+            auto r = _fd.read(p, len);
+            if (!r || !*r) {
+                throw std::runtime_error("vhost-user: backend closed the connection");
+            }
+            p += *r;
+            len -= *r;
+        }
+    }
+    uint64_t get_u64(request req) {
+        send(req, nullptr, 0);
+        header h;
+        uint64_t v;
+        read_exactly(&h, sizeof(h));
+        if (h.request != req || !(h.flags & reply_flag) || h.size != sizeof(v)) {
+            throw std::runtime_error(format("vhost-user: bad reply to request {}", unsigned(req)));
+        }
+        read_exactly(&v, sizeof(v));
+        return v;
+    }
+    void set_memory_table() {
+        auto backings = memory::get_memory_backings();
+        if (backings.empty()) {
+            throw std::runtime_error("vhost-user requires the memory to be backed by hugetlbfs (--hugepages)");
+        }
+        if (backings.size() > max_regions) {
+            throw std::runtime_error(format("vhost-user: the memory of {} shards exceeds the {} regions of a memory table",
+                    backings.size(), max_regions));
+        }
+        memory_table m = {};
+        std::vector<int> fds;
+        m.nregions = backings.size();
+        for (unsigned i = 0; i < backings.size(); i++) {
+            auto& b = backings[i];
+            m.regions[i] = memory_region{b.start, b.size, b.start, 0};
+            fds.push_back(b.fd);
+        }
+        send(set_mem_table, &m, sizeof(m), fds);
+    }
+public:
+    vhost_user(const std::string& path, uint64_t features, unsigned queues)
+        : _fd(file_desc::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC)) {
+        sockaddr_un sa = {};
+        sa.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(sa.sun_path)) {
+            throw std::runtime_error(format("vhost-user socket path {} is too long", path));
+        }
+        strcpy(sa.sun_path, path.c_str());
+        _fd.connect(reinterpret_cast<sockaddr&>(sa), sizeof(sa));
+
+        send(set_owner, nullptr, 0);
+        auto backend_features = get_u64(get_features);
+        _features = backend_features & features;
+        if (backend_features & f_protocol_features) {
+            _protocol_features = true;
+            _features |= f_protocol_features;
+            auto protocol = get_u64(get_protocol_features) & protocol_f_mq;
+            send_u64(set_protocol_features, protocol);
+            if (protocol & protocol_f_mq) {
+                _max_queues = get_u64(get_queue_num);
+            }
+        }
+        if (queues > _max_queues) {
+            throw std::runtime_error(format("vhost-user backend supports {} queues, {} requested", _max_queues, queues));
+        }
+        send_u64(set_features, _features);
+        set_memory_table();
+    }
+
+    uint64_t features() const {
+        return _features & ~f_protocol_features;
+    }
+
+    // Vring 2*qid receives, 2*qid+1 transmits
+    void setup_vring(unsigned index, const ring_config& config, int kick, int call) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto tov = [](char* x) { return reinterpret_cast<uintptr_t>(x); };
+        vring_state num{index, config.size};
+        send(set_vring_num, &num, sizeof(num));
+        vring_state base{index, 0};
+        send(set_vring_base, &base, sizeof(base));
+        vring_addr addr{index, 0, tov(config.descs), tov(config.used), tov(config.avail), 0};
+        send(set_vring_addr, &addr, sizeof(addr));
+        uint64_t file = index;
+        send(set_vring_kick, &file, sizeof(file), {kick});
+        send(set_vring_call, &file, sizeof(file), {call});
+        if (_protocol_features) {
+            // Rings of backends with protocol features start disabled
+            vring_state enable{index, 1};
+            send(set_vring_enable, &enable, sizeof(enable));
+        }
+    }
+};
+
+class qp_vhost_user : public qp {
+public:
+    qp_vhost_user(device* dev, vhost_user& backend, const native_stack_options& opts, uint16_t qid);
+};
+
+qp_vhost_user::qp_vhost_user(device* dev, vhost_user& backend, const native_stack_options& opts, uint16_t qid)
+    : qp(dev, config_ring_size(opts.virtio_opts), config_ring_size(opts.virtio_opts), qid)
+{
+    if (backend.features() & VIRTIO_NET_F_MRG_RXBUF) {
+        _header_len = sizeof(net_hdr_mrg);
+    } else {
+        _header_len = sizeof(net_hdr);
+    }
+    readable_eventfd txq_notify;
+    writeable_eventfd txq_kick;
+    readable_eventfd rxq_notify;
+    writeable_eventfd rxq_kick;
+    backend.setup_vring(2 * qid, _rxq.getconfig(), rxq_kick.get_read_fd(), rxq_notify.get_write_fd());
+    backend.setup_vring(2 * qid + 1, _txq.getconfig(), txq_kick.get_read_fd(), txq_notify.get_write_fd());
+    _rxq.set_notifier(std::make_unique<notifier_vhost>(std::move(rxq_kick)));
+    _txq.set_notifier(std::make_unique<notifier_vhost>(std::move(txq_kick)));
+}
+
 #ifdef HAVE_OSV
 class qp_osv : public qp {
 private:
@@ -975,20 +1205,44 @@ qp_osv::qp_osv(device *dev, osv::assigned_virtio &virtio,
 #endif
 
 std::unique_ptr<net::qp> device::init_local_queue(const program_options::option_group& opts, uint16_t qid) {
-    static bool called = false;
-    assert(!qid);
-    assert(!called);
-    called = true;
+    assert(qid < _queues);
 
 #ifdef HAVE_OSV
     if (osv::assigned_virtio::get && osv::assigned_virtio::get()) {
+        assert(!qid);
         std::cout << "In OSv and assigned host's virtio device\n";
         return std::make_unique<qp_osv>(this, *osv::assigned_virtio::get(), opts);
     }
 #endif
     auto net_opts = dynamic_cast<const net::native_stack_options*>(&opts);
     assert(net_opts);
-    return std::make_unique<qp_vhost>(this, *net_opts);
+    std::unique_ptr<qp> ret;
+    if (_vhost_user_path.empty()) {
+        ret = std::make_unique<qp_vhost>(this, *net_opts, qid);
+    } else {
+        std::shared_ptr<vhost_user> backend;
+        {
+            std::lock_guard<std::mutex> lock(_vhost_user_mutex);
+            if (!_vhost_user) {
+                _vhost_user = std::make_shared<vhost_user>(_vhost_user_path, _features, _queues);
+            }
+            backend = _vhost_user;
+        }
+        ret = std::make_unique<qp_vhost_user>(this, *backend, *net_opts, qid);
+    }
+    if (_queues > 1) {
+        // The backend spreads flows over the queues by a hash of its own,
+        // so that a packet may arrive on a queue other than that of the
+        // shard which owns its flow. All queues thus share one table over
+        // all shards, to pass packets on to the owner, and by which
+        // hash2cpu() places new flows.
+        std::map<unsigned, float> cpu_weights;
+        for (unsigned i = 0; i < smp::count; i++) {
+            cpu_weights[i] = i < _queues ? net_opts->hw_queue_weight.get_value() : 1.0f;
+        }
+        ret->build_sw_reta(cpu_weights);
+    }
+    return ret;
 }
 
 }
@@ -1010,6 +1264,13 @@ net::virtio_options::virtio_options(program_options::option_group* parent_group)
     , virtio_ring_size(*this, "virtio-ring-size",
                 256,
                 "Virtio ring size (must be power-of-two)")
+    , virtio_queues(*this, "virtio-queues",
+                1,
+                "Number of virtio queue pairs, at most one per shard (0 for one per shard)")
+    , vhost_user(*this, "vhost-user",
+                "",
+                "Path of the unix socket of a vhost-user backend to use instead of vhost-net and a tap device "
+                "(requires --hugepages)")
 {
 }
 
@@ -0,0 +1,447 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#include <seastar/net/xdp.hh>
+
+#ifdef SEASTAR_HAVE_XDP
+
+#include <seastar/core/posix.hh>
+#include <seastar/core/reactor.hh>
+#include <seastar/core/metrics.hh>
+#include <seastar/core/internal/poll.hh>
+#include <seastar/net/native-stack.hh>
+#include <seastar/net/toeplitz.hh>
+#include <seastar/util/log.hh>
+#include <mutex>
+#include <vector>
+#include <linux/ethtool.h>
+#include <linux/if_xdp.h>
+#include <linux/if_link.h>
+#include <linux/sockios.h>
+#include <net/if.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <xdp/xsk.h>
+
+namespace seastar {
+
+using namespace net;
+
+namespace xdp {
+
+static logger xdp_log("xdp");
+
+static constexpr uint32_t frame_size = XSK_UMEM__DEFAULT_FRAME_SIZE;
+static constexpr uint32_t rx_batch = 64;
+
+class xdp_device : public device {
+    const std::string _ifname;
+    const unsigned _first_queue;
+    const bool _zero_copy;
+    const unsigned _ring_size;
+    uint16_t _num_queues = 1;
+    ethernet_address _hw_address;
+    net::hw_features _hw_features;
+    std::vector<uint8_t> _rss_key_storage;
+    // Queue of each RSS indirection table entry, -1 for queues left to the kernel
+    std::vector<int> _redir_table;
+private:
+    static ifreq make_ifreq(const std::string& ifname) {
+        ifreq ifr = {};
+        if (ifname.size() + 1 > IFNAMSIZ) {
+            throw std::invalid_argument(format("interface name too long: {}", ifname));
+        }
+        strcpy(ifr.ifr_name, ifname.c_str());
+        return ifr;
+    }
+    // Reads the interface's RSS configuration, returns false if we can't
+    // tell where the NIC sends the flows
+    bool read_rss_config(file_desc& fd, unsigned nr_queues) {
+        auto ifr = make_ifreq(_ifname);
+        ethtool_rxfh hdr = {};
+        hdr.cmd = ETHTOOL_GRSSH;
+        ifr.ifr_data = reinterpret_cast<char*>(&hdr);
+        if (::ioctl(fd.get(), SIOCETHTOOL, &ifr) < 0 || !hdr.indir_size || !hdr.key_size) {
+            return false;
+        }
+        std::vector<char> buf(sizeof(ethtool_rxfh) + hdr.indir_size * sizeof(uint32_t) + hdr.key_size);
+        auto rxfh = reinterpret_cast<ethtool_rxfh*>(buf.data());
+        rxfh->cmd = ETHTOOL_GRSSH;
+        rxfh->indir_size = hdr.indir_size;
+        rxfh->key_size = hdr.key_size;
+        ifr.ifr_data = buf.data();
+        if (::ioctl(fd.get(), SIOCETHTOOL, &ifr) < 0 || rxfh->hfunc != ETH_RSS_HASH_TOP
+                || (rxfh->indir_size & (rxfh->indir_size - 1))) {
+            return false;
+        }
+        std::vector<bool> used(nr_queues);
+        for (unsigned i = 0; i < rxfh->indir_size; i++) {
+            auto q = int(rxfh->rss_config[i]) - int(_first_queue);
+            if (q < 0 || unsigned(q) >= nr_queues) {
+                q = -1;
+            } else {
+                used[q] = true;
+            }
+            _redir_table.push_back(q);
+        }
+        if (std::find(used.begin(), used.end(), false) != used.end()) {
+            _redir_table.clear();
+            return false;
+        }
+        auto key = reinterpret_cast<const uint8_t*>(rxfh->rss_config + rxfh->indir_size);
+        _rss_key_storage.assign(key, key + rxfh->key_size);
+        return true;
+    }
+public:
+    explicit xdp_device(const xdp_options& opts)
+        : _ifname(opts.xdp_interface.get_value())
+        , _first_queue(opts.xdp_first_queue.get_value())
+        , _zero_copy(!(opts.xdp_zero_copy && opts.xdp_zero_copy.get_value() == "off"))
+        , _ring_size(opts.xdp_ring_size.get_value())
+    {
+        if (!_ring_size || (_ring_size & (_ring_size - 1))) {
+            throw std::invalid_argument(format("AF_XDP ring size must be a power of two: {}", _ring_size));
+        }
+        auto fd = file_desc::socket(AF_INET, SOCK_DGRAM);
+        auto ifr = make_ifreq(_ifname);
+        fd.ioctl(SIOCGIFHWADDR, ifr);
+        _hw_address = ethernet_address(reinterpret_cast<const uint8_t*>(ifr.ifr_hwaddr.sa_data));
+
+        ifr = make_ifreq(_ifname);
+        fd.ioctl(SIOCGIFMTU, ifr);
+        // A frame has to fit in a single UMEM chunk
+        _hw_features.mtu = std::min<unsigned>(ifr.ifr_mtu, frame_size - XDP_PACKET_HEADROOM - eth_hdr_len);
+
+        ethtool_channels channels = {};
+        channels.cmd = ETHTOOL_GCHANNELS;
+        ifr = make_ifreq(_ifname);
+        ifr.ifr_data = reinterpret_cast<char*>(&channels);
+        unsigned nic_queues = 1;
+        if (::ioctl(fd.get(), SIOCETHTOOL, &ifr) == 0) {
+            nic_queues = std::max(channels.combined_count + channels.rx_count, 1u);
+        }
+        unsigned nr_queues = nic_queues > _first_queue ? nic_queues - _first_queue : 1;
+        if (opts.xdp_queues) {
+            nr_queues = std::min(nr_queues, opts.xdp_queues.get_value());
+        }
+        nr_queues = std::max(std::min(nr_queues, smp::count), 1u);
+
+        // Connections can only be spread over several queues when we know
+        // where the NIC sends them, otherwise one queue takes all and
+        // forwards to the other shards
+        if (nr_queues > 1 && !read_rss_config(fd, nr_queues)) {
+            xdp_log.warn("{}: cannot read a Toeplitz RSS configuration covering queues {}-{}, using queue {} only",
+                    _ifname, _first_queue, _first_queue + nr_queues - 1, _first_queue);
+            nr_queues = 1;
+        }
+        _num_queues = nr_queues;
+        _rss_table_bits = _redir_table.empty() ? 0 : log2ceil(_redir_table.size());
+        xdp_log.info("{}: using {} queue(s) from queue {}, {} mode", _ifname, _num_queues, _first_queue,
+                _zero_copy ? "zero-copy" : "copy");
+    }
+    ethernet_address hw_address() override {
+        return _hw_address;
+    }
+    net::hw_features hw_features() override {
+        return _hw_features;
+    }
+    virtual rss_key_type rss_key() const override {
+        if (_rss_key_storage.empty()) {
+            return default_rsskey_40bytes;
+        }
+        return rss_key_type(_rss_key_storage.data(), _rss_key_storage.size());
+    }
+    virtual uint16_t hw_queues_count() override {
+        return _num_queues;
+    }
+    virtual unsigned hash2qid(uint32_t hash) override {
+        if (_redir_table.empty()) {
+            return 0;
+        }
+        auto q = _redir_table[hash & (_redir_table.size() - 1)];
+        return q < 0 ? 0 : q;
+    }
+    virtual unsigned hash2cpu(uint32_t hash) override {
+        if (!_redir_table.empty() && _redir_table[hash & (_redir_table.size() - 1)] < 0) {
+            // The kernel gets these flows, no shard of ours does
+            return (this_shard_id() + 1) % smp::count;
+        }
+        return device::hash2cpu(hash);
+    }
+    virtual std::unique_ptr<net::qp> init_local_queue(const program_options::option_group& opts, uint16_t qid) override;
+
+    const std::string& ifname() const noexcept { return _ifname; }
+    unsigned nic_queue(uint16_t qid) const noexcept { return _first_queue + qid; }
+    bool zero_copy() const noexcept { return _zero_copy; }
+    unsigned ring_size() const noexcept { return _ring_size; }
+};
+
+// An AF_XDP socket bound to one queue of the interface, with its own UMEM.
+//
+// The UMEM is split in frames: twice the ring size for the receive side,
+// so that packets can be lent to the stack while the fill ring is kept
+// full, and the ring size for the transmit side. Received frames are
+// passed up without copying as long as enough are left for the NIC, and
+// copied otherwise. Transmitted packets are always copied into frames.
+class xdp_qp : public net::qp {
+    xdp_device* _dev;
+    uint16_t _qid;
+    unsigned _ring_size;
+    mmap_area _umem_area;
+    xsk_umem* _umem = nullptr;
+    xsk_socket* _xsk = nullptr;
+    xsk_ring_prod _fill;
+    xsk_ring_cons _comp;
+    xsk_ring_cons _rx;
+    xsk_ring_prod _tx;
+    std::vector<uint64_t> _free_rx_frames;
+    std::vector<uint64_t> _free_tx_frames;
+    std::optional<reactor::poller> _rx_poller;
+    reactor::poller _tx_gc_poller;
+    uint64_t _rx_copied = 0;
+    uint64_t _wakeups = 0;
+    timer<lowres_clock> _stats_timer;
+private:
+    char* frame_data(uint64_t addr) {
+        return static_cast<char*>(xsk_umem__get_data(_umem_area.get(), addr));
+    }
+    void refill() {
+        uint32_t idx;
+        auto n = xsk_ring_prod__reserve(&_fill, _free_rx_frames.size(), &idx);
+        for (uint32_t i = 0; i < n; i++) {
+            *xsk_ring_prod__fill_addr(&_fill, idx + i) = _free_rx_frames.back();
+            _free_rx_frames.pop_back();
+        }
+        xsk_ring_prod__submit(&_fill, n);
+        if (xsk_ring_prod__needs_wakeup(&_fill)) {
+            _wakeups++;
+            ::recvfrom(xsk_socket__fd(_xsk), nullptr, 0, MSG_DONTWAIT, nullptr, nullptr);
+        }
+    }
+    bool reap_tx_completions() {
+        uint32_t idx;
+        auto n = xsk_ring_cons__peek(&_comp, _ring_size, &idx);
+        for (uint32_t i = 0; i < n; i++) {
+            _free_tx_frames.push_back(*xsk_ring_cons__comp_addr(&_comp, idx + i));
+        }
+        xsk_ring_cons__release(&_comp, n);
+        return n;
+    }
+    // The kernel counts the packets it drops for want of room in the rings
+    void collect_stats() {
+        xdp_statistics st = {};
+        socklen_t len = sizeof(st);
+        if (::getsockopt(xsk_socket__fd(_xsk), SOL_XDP, XDP_STATISTICS, &st, &len) == 0) {
+            _stats.rx.bad.ring_full = st.rx_ring_full + st.rx_fill_ring_empty_descs;
+        }
+    }
+    bool poll_rx_once() {
+        uint32_t idx;
+        auto n = xsk_ring_cons__peek(&_rx, rx_batch, &idx);
+        uint64_t bytes = 0;
+        for (uint32_t i = 0; i < n; i++) {
+            auto desc = xsk_ring_cons__rx_desc(&_rx, idx + i);
+            auto base = desc->addr & ~uint64_t(frame_size - 1);
+            auto data = frame_data(desc->addr);
+            bytes += desc->len;
+            // Keep at least half the receive frames for the NIC
+            if (_free_rx_frames.size() < _ring_size / 2) {
+                _rx_copied++;
+                _stats.rx.good.update_copy_stats(1, desc->len);
+                _free_rx_frames.push_back(base);
+                _dev->l2receive(packet(fragment{data, desc->len}));
+            } else {
+                _dev->l2receive(packet(fragment{data, desc->len}, make_deleter([this, base] {
+                    _free_rx_frames.push_back(base);
+                })));
+            }
+        }
+        xsk_ring_cons__release(&_rx, n);
+        if (n) {
+            _stats.rx.good.update_pkts_bunch(n);
+            _stats.rx.good.update_frags_stats(n, bytes);
+        }
+        refill();
+        return n;
+    }
+public:
+    xdp_qp(xdp_device* dev, uint16_t qid, const std::string& stats_plugin_name)
+        : qp(true, stats_plugin_name, qid)
+        , _dev(dev)
+        , _qid(qid)
+        , _ring_size(dev->ring_size())
+        , _tx_gc_poller(reactor::poller::simple([this] { return reap_tx_completions(); }))
+    {
+        auto nr_frames = 3 * _ring_size;
+        _umem_area = mmap_anonymous(nullptr, size_t(nr_frames) * frame_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_POPULATE);
+
+        xsk_umem_config umem_cfg = {};
+        umem_cfg.fill_size = _ring_size;
+        umem_cfg.comp_size = _ring_size;
+        umem_cfg.frame_size = frame_size;
+        umem_cfg.frame_headroom = XSK_UMEM__DEFAULT_FRAME_HEADROOM;
+        auto r = xsk_umem__create(&_umem, _umem_area.get(), size_t(nr_frames) * frame_size, &_fill, &_comp, &umem_cfg);
+        if (r) {
+            throw std::system_error(-r, std::system_category(), "xsk_umem__create");
+        }
+
+        xsk_socket_config xsk_cfg = {};
+        xsk_cfg.rx_size = _ring_size;
+        xsk_cfg.tx_size = _ring_size;
+        xsk_cfg.bind_flags = XDP_USE_NEED_WAKEUP | (dev->zero_copy() ? XDP_ZEROCOPY : XDP_COPY);
+        {
+            // libxdp attaches its redirect program on the first socket of
+            // the interface, don't race with the other shards doing it
+            static std::mutex attach_lock;
+            std::lock_guard<std::mutex> g(attach_lock);
+            r = xsk_socket__create(&_xsk, dev->ifname().c_str(), dev->nic_queue(qid), _umem, &_rx, &_tx, &xsk_cfg);
+            if (r == -EOPNOTSUPP && dev->zero_copy()) {
+                xdp_log.warn("{}: queue {} does not support zero-copy, falling back to copy mode", dev->ifname(), dev->nic_queue(qid));
+                xsk_cfg.bind_flags = XDP_USE_NEED_WAKEUP | XDP_COPY;
+                r = xsk_socket__create(&_xsk, dev->ifname().c_str(), dev->nic_queue(qid), _umem, &_rx, &_tx, &xsk_cfg);
+            }
+        }
+        if (r) {
+            xsk_umem__delete(_umem);
+            throw std::system_error(-r, std::system_category(), "xsk_socket__create");
+        }
+
+        for (uint64_t i = 0; i < 2 * _ring_size; i++) {
+            _free_rx_frames.push_back(i * frame_size);
+        }
+        for (uint64_t i = 2 * _ring_size; i < nr_frames; i++) {
+            _free_tx_frames.push_back(i * frame_size);
+        }
+        refill();
+
+        namespace sm = seastar::metrics;
+        _metrics.add_group(_stats_plugin_name, {
+            sm::make_counter(_queue_name + "_rx_copied", _rx_copied,
+                            sm::description("Counts a number of received packets copied out of the UMEM because too many of its frames were held by the stack.")),
+            sm::make_counter(_queue_name + "_wakeups", _wakeups,
+                            sm::description("Counts a number of system calls made to kick the kernel into processing the AF_XDP rings.")),
+        });
+        _stats_timer.set_callback([this] { collect_stats(); });
+        _stats_timer.arm_periodic(std::chrono::seconds(1));
+    }
+    virtual ~xdp_qp() {
+        if (_xsk) {
+            xsk_socket__delete(_xsk);
+        }
+        if (_umem) {
+            xsk_umem__delete(_umem);
+        }
+    }
+    virtual void rx_start() override {
+        _rx_poller = reactor::poller::simple([this] { return poll_rx_once(); });
+    }
+    virtual future<> send(packet p) override {
+        abort();
+    }
+    virtual uint32_t send(circular_buffer<packet>& pb) override {
+        reap_tx_completions();
+        static constexpr size_t max_len = frame_size - XDP_PACKET_HEADROOM;
+        uint32_t dropped = 0;
+        // Can't be sent in a single frame, the MTU we report should prevent it
+        while (!pb.empty() && pb.front().len() > max_len) {
+            pb.pop_front();
+            dropped++;
+        }
+        size_t count = 0;
+        auto limit = std::min(pb.size(), _free_tx_frames.size());
+        while (count < limit && pb[count].len() <= max_len) {
+            count++;
+        }
+        uint32_t idx;
+        auto n = xsk_ring_prod__reserve(&_tx, count, &idx);
+        uint64_t bytes = 0, nr_frags = 0;
+        for (uint32_t i = 0; i < n; i++) {
+            auto& p = pb.front();
+            auto addr = _free_tx_frames.back();
+            _free_tx_frames.pop_back();
+            auto dst = frame_data(addr);
+            for (auto&& f : p.fragments()) {
+                dst = std::copy_n(f.base, f.size, dst);
+            }
+            auto desc = xsk_ring_prod__tx_desc(&_tx, idx + i);
+            desc->addr = addr;
+            desc->len = p.len();
+            bytes += p.len();
+            nr_frags += p.nr_frags();
+            pb.pop_front();
+        }
+        xsk_ring_prod__submit(&_tx, n);
+        if (n && xsk_ring_prod__needs_wakeup(&_tx)) {
+            _wakeups++;
+            ::sendto(xsk_socket__fd(_xsk), nullptr, 0, MSG_DONTWAIT, nullptr, 0);
+        }
+        _stats.tx.good.update_frags_stats(nr_frags, bytes);
+        _stats.tx.good.update_copy_stats(nr_frags, bytes);
+        return n + dropped;
+    }
+};
+
+std::unique_ptr<net::qp> xdp_device::init_local_queue(const program_options::option_group& opts, uint16_t qid) {
+    return std::make_unique<xdp_qp>(this, qid, std::string("network-") + _ifname);
+}
+
+}
+
+std::unique_ptr<net::device> create_xdp_net_device(const net::xdp_options& opts) {
+    return std::make_unique<xdp::xdp_device>(opts);
+}
+
+}
+
+#endif // SEASTAR_HAVE_XDP
+
+namespace seastar::net {
+
+xdp_options::xdp_options(program_options::option_group* parent_group)
+#ifdef SEASTAR_HAVE_XDP
+    : program_options::option_group(parent_group, "AF_XDP net options")
+    , xdp_interface(*this, "xdp-interface",
+                "eth0",
+                "Network interface to bind the AF_XDP sockets to")
+    , xdp_first_queue(*this, "xdp-first-queue",
+                0,
+                "First queue of the interface to bind to, shard N uses queue xdp-first-queue + N")
+    , xdp_queues(*this, "xdp-queues",
+                std::nullopt,
+                "Number of queues to bind to (default: all, up to the number of shards)")
+    , xdp_zero_copy(*this, "xdp-zero-copy",
+                "on",
+                "Use zero-copy mode when the driver supports it (on / off)")
+    , xdp_ring_size(*this, "xdp-ring-size",
+                2048,
+                "Size of the AF_XDP rings (must be power-of-two)")
+#else
+    : program_options::option_group(parent_group, "AF_XDP net options", program_options::unused{})
+    , xdp_interface(*this, "xdp-interface", program_options::unused{})
+    , xdp_first_queue(*this, "xdp-first-queue", program_options::unused{})
+    , xdp_queues(*this, "xdp-queues", program_options::unused{})
+    , xdp_zero_copy(*this, "xdp-zero-copy", program_options::unused{})
+    , xdp_ring_size(*this, "xdp-ring-size", program_options::unused{})
+#endif
+{
+}
+
+}
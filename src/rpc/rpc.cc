@@ -3,6 +3,8 @@
 #include <seastar/core/seastar.hh>
 #include <seastar/core/print.hh>
 #include <seastar/core/future-util.hh>
+#include <seastar/core/sleep.hh>
+#include <seastar/core/metrics.hh>
 #include <boost/range/adaptor/map.hpp>
 
 #if FMT_VERSION >= 90000
@@ -67,6 +69,112 @@ namespace rpc {
       }
   }
 
+  temporary_buffer<char> blob::linearize() const {
+      if (_fragments.size() == 1) {
+          return _fragments.front().clone();
+      }
+      temporary_buffer<char> ret(_size);
+      auto p = ret.get_write();
+      for (auto& f : _fragments) {
+          p = std::copy_n(f.get(), f.size(), p);
+      }
+      return ret;
+  }
+
+  blob share_blob(rcv_buf& buf, size_t pos, size_t len) {
+      if (pos + len > buf.size) {
+          throw std::out_of_range("blob exceeds the frame");
+      }
+      if (!len) {
+          return blob();
+      }
+      if (auto one = std::get_if<temporary_buffer<char>>(&buf.bufs)) {
+          return blob(one->share(pos, len));
+      }
+      std::vector<temporary_buffer<char>> fragments;
+      auto left = len;
+      for (auto& b : std::get<std::vector<temporary_buffer<char>>>(buf.bufs)) {
+          if (pos >= b.size()) {
+              pos -= b.size();
+              continue;
+          }
+          auto n = std::min(b.size() - pos, left);
+          fragments.push_back(b.share(pos, n));
+          pos = 0;
+          left -= n;
+          if (!left) {
+              break;
+          }
+      }
+      return blob(std::move(fragments), len);
+  }
+
+  verb_call::verb_call(verb_side_stats& stats, size_t request_size) noexcept
+      : _stats(&stats)
+      , _start(std::chrono::steady_clock::now())
+  {
+      stats.requests++;
+      stats.in_flight++;
+      stats.request_size.add(request_size);
+  }
+
+  void verb_call::done() noexcept {
+      if (_stats) {
+          _stats->latency.add(std::chrono::steady_clock::now() - _start);
+          _stats->in_flight--;
+          _stats = nullptr;
+      }
+  }
+
+  void verb_stats::enable(sstring group_name) {
+      if (_group) {
+          return;
+      }
+      _group = std::move(group_name);
+      for (auto& [verb, data] : _verbs) {
+          register_metrics(verb, data);
+      }
+  }
+
+  verb_stats::verb_data& verb_stats::get(uint64_t verb) {
+      auto [it, inserted] = _verbs.try_emplace(verb);
+      if (inserted && _group) {
+          register_metrics(verb, it->second);
+      }
+      return it->second;
+  }
+
+  void verb_stats::register_metrics(uint64_t verb, verb_data& data) {
+      namespace sm = seastar::metrics;
+      auto verb_label = sm::label("verb")(verb);
+      std::vector<sm::metric_definition> defs;
+      auto add_side = [&defs, &verb_label] (const char* side, verb_side_stats& s) {
+          defs.emplace_back(sm::make_counter(format("{}_requests", side), s.requests,
+                  sm::description("Total number of requests"), {verb_label}));
+          defs.emplace_back(sm::make_gauge(format("{}_in_flight", side), s.in_flight,
+                  sm::description("Number of requests in progress"), {verb_label}));
+          defs.emplace_back(sm::make_histogram(format("{}_latency", side), sm::description("Histogram of request latencies, in seconds"), {verb_label}, [&s] {
+                  return s.latency.to_metrics_histogram();
+              }));
+          defs.emplace_back(sm::make_histogram(format("{}_request_size", side), sm::description("Histogram of serialized request sizes, in bytes"), {verb_label}, [&s] {
+                  return s.request_size.to_metrics_histogram();
+              }));
+      };
+      add_side("client", data.client);
+      add_side("server", data.server);
+      _metrics.add_group(*_group, defs);
+  }
+
+  const verb_side_stats* verb_stats::client_stats(uint64_t verb) const noexcept {
+      auto it = _verbs.find(verb);
+      return it != _verbs.end() ? &it->second.client : nullptr;
+  }
+
+  const verb_side_stats* verb_stats::server_stats(uint64_t verb) const noexcept {
+      auto it = _verbs.find(verb);
+      return it != _verbs.end() ? &it->second.server : nullptr;
+  }
+
   // Make a copy of a remote buffer. No data is actually copied, only pointers and
   // a deleter of a new buffer takes care of deleting the original buffer
   template<typename T> // T is either snd_buf or rcv_buf
@@ -109,13 +217,94 @@ namespace rpc {
       c.get_logger()(c.peer_address(), level, std::string_view(formatted.data(), formatted.size()));
   }
 
+  // Set in the length of a compressed frame whose data was not compressed
+  static constexpr uint32_t uncompressed_frame_flag = 0x80000000;
+
+  // The length of a stream frame carrying a window update
+  static constexpr uint32_t stream_window_update = 0xfffffffe;
+
+  // Shares the first size bytes of buf
+  static snd_buf share_prefix(snd_buf& buf, size_t size) {
+      if (auto one = std::get_if<temporary_buffer<char>>(&buf.bufs)) {
+          return snd_buf(one->share(0, size));
+      }
+      std::vector<temporary_buffer<char>> bufs;
+      auto left = size;
+      for (auto& b : std::get<std::vector<temporary_buffer<char>>>(buf.bufs)) {
+          if (!left) {
+              break;
+          }
+          auto n = std::min(left, b.size());
+          bufs.push_back(b.share(0, n));
+          left -= n;
+      }
+      return snd_buf(std::move(bufs), size - left);
+  }
+
+  static snd_buf frame_uncompressed(snd_buf buf) {
+      temporary_buffer<char> header(4);
+      write_le<uint32_t>(header.get_write(), buf.size | uncompressed_frame_flag);
+      std::vector<temporary_buffer<char>> bufs;
+      if (auto one = std::get_if<temporary_buffer<char>>(&buf.bufs)) {
+          bufs.reserve(2);
+          bufs.push_back(std::move(header));
+          bufs.push_back(std::move(*one));
+      } else {
+          auto& frags = std::get<std::vector<temporary_buffer<char>>>(buf.bufs);
+          bufs.reserve(frags.size() + 1);
+          bufs.push_back(std::move(header));
+          std::move(frags.begin(), frags.end(), std::back_inserter(bufs));
+      }
+      return snd_buf(std::move(bufs), buf.size + 4);
+  }
+
+  bool connection::compresses_well(size_t compressed_size, size_t size) const noexcept {
+      return compressed_size <= size * _adaptive_compression->max_ratio;
+  }
+
+  void connection::back_off_compression() noexcept {
+      _compression_backoff = std::clamp(_compression_backoff * 2, 1u, _adaptive_compression->max_backoff);
+      _compression_backoff_left = _compression_backoff;
+  }
+
   snd_buf connection::compress(snd_buf buf) {
-      if (_compressor) {
-          buf = _compressor->compress(4, std::move(buf));
-          static_assert(snd_buf::chunk_size >= 4, "send buffer chunk size is too small");
-          write_le<uint32_t>(buf.front().get_write(), buf.size - 4);
+      if (!_compressor) {
           return buf;
       }
+      static_assert(snd_buf::chunk_size >= 4, "send buffer chunk size is too small");
+      if (_adaptive_compression) {
+          auto& cfg = *_adaptive_compression;
+          if (buf.size < cfg.min_size) {
+              _stats.uncompressed_messages++;
+              return frame_uncompressed(std::move(buf));
+          }
+          if (_compression_backoff_left) {
+              _compression_backoff_left--;
+              _stats.uncompressed_messages++;
+              return frame_uncompressed(std::move(buf));
+          }
+          // After an incompressible frame, probe large ones on a sample
+          if (_compression_backoff && buf.size >= 2 * cfg.sample_size) {
+              auto sample = _compressor->compress(0, share_prefix(buf, cfg.sample_size));
+              if (!compresses_well(sample.size, cfg.sample_size)) {
+                  back_off_compression();
+                  _stats.uncompressed_messages++;
+                  return frame_uncompressed(std::move(buf));
+              }
+          }
+          // The data is shared, so the frame can still be sent as is
+          auto compressed = _compressor->compress(4, share_prefix(buf, buf.size));
+          if (!compresses_well(compressed.size - 4, buf.size)) {
+              back_off_compression();
+              _stats.uncompressed_messages++;
+              return frame_uncompressed(std::move(buf));
+          }
+          _compression_backoff = 0;
+          buf = std::move(compressed);
+      } else {
+          buf = _compressor->compress(4, std::move(buf));
+      }
+      write_le<uint32_t>(buf.front().get_write(), buf.size - 4);
       return buf;
   }
 
@@ -135,26 +324,68 @@ namespace rpc {
 
   future<> connection::send_entry(outgoing_entry& d) {
       if (_propagate_timeout) {
-          static_assert(snd_buf::chunk_size >= 8, "send buffer chunk size is too small");
+          // Requests start with the trace context and then the timeout
+          constexpr size_t trace_size = tracing::trace_context::serialized_size;
+          static_assert(snd_buf::chunk_size >= trace_size + 8, "send buffer chunk size is too small");
+          if (!_tracing_negotiated) {
+              d.buf.front().trim_front(trace_size);
+              d.buf.size -= trace_size;
+          }
           if (_timeout_negotiated) {
               auto expire = d.t.get_timeout();
               uint64_t left = 0;
               if (expire != typename timer<rpc_clock_type>::time_point()) {
                   left = std::chrono::duration_cast<std::chrono::milliseconds>(expire - timer<rpc_clock_type>::clock::now()).count();
               }
-              write_le<uint64_t>(d.buf.front().get_write(), left);
+              write_le<uint64_t>(d.buf.front().get_write() + (_tracing_negotiated ? trace_size : 0), left);
           } else {
+              if (_tracing_negotiated) {
+                  auto p = d.buf.front().get_write();
+                  std::memmove(p + 8, p, trace_size);
+              }
               d.buf.front().trim_front(8);
               d.buf.size -= 8;
           }
       }
       auto buf = compress(std::move(d.buf));
-      return send_buffer(std::move(buf)).then([this] {
+      return send_buffer(std::move(buf)).then([this, &d] {
           _stats.sent_messages++;
-          return _write_buf.flush();
+          return flush_or_coalesce(d);
       });
   }
 
+  future<> connection::flush_written() {
+      _pending_flush = false;
+      _stats.flushes++;
+      return _write_buf.flush();
+  }
+
+  future<> connection::flush_pending() {
+      if (!_pending_flush || _error) {
+          return make_ready_future<>();
+      }
+      return flush_written();
+  }
+
+  future<> connection::flush_or_coalesce(outgoing_entry& d) {
+      auto queued_behind = [this, &d] {
+          return std::next(_outgoing_queue.iterator_to(d)) != _outgoing_queue.end();
+      };
+      // Leave the flush to the last of the queued entries, so that all
+      // their frames go out together
+      if (queued_behind()) {
+          _pending_flush = true;
+          return make_ready_future<>();
+      }
+      if (_coalescing_delay.count()) {
+          _pending_flush = true;
+          return seastar::sleep(_coalescing_delay).then([this, queued_behind] {
+              return queued_behind() ? make_ready_future<>() : flush_pending();
+          });
+      }
+      return flush_written();
+  }
+
   void connection::set_negotiated() noexcept {
       _negotiated->set_value();
       _negotiated = std::nullopt;
@@ -197,13 +428,13 @@ namespace rpc {
       });
   }
 
-  void connection::set_socket(connected_socket&& fd) {
+  void connection::set_socket(connected_socket&& fd, net::connection_memory_budget* budget) {
       if (_connected) {
           throw std::runtime_error("already connected");
       }
       _fd = std::move(fd);
-      _read_buf =_fd.input();
-      _write_buf = _fd.output();
+      _read_buf = budget ? budget->input(_fd) : _fd.input();
+      _write_buf = budget ? budget->output(_fd) : _fd.output();
       _connected = true;
   }
 
@@ -248,9 +479,16 @@ namespace rpc {
       // by moving it.done into pit.done. For simplicity (verging on obscurity?)
       // both done's are just swapped and "it" resolves its new promise
 
+      auto last = std::next(it) == _outgoing_queue.end();
       std::swap(it->done, pit->done);
       it->uncancellable();
       it->unlink();
+      if (last) {
+          // The entries before may have left their flush to this one
+          _outgoing_queue_ready = _outgoing_queue_ready.then([this] {
+              return flush_pending();
+          });
+      }
       if (ex == nullptr) {
           it->done.set_value();
       } else {
@@ -258,16 +496,35 @@ namespace rpc {
       }
   }
 
-  future<> connection::send(snd_buf buf, std::optional<rpc_clock_type::time_point> timeout, cancellable* cancel) {
+  future<> connection::send(snd_buf buf, std::optional<rpc_clock_type::time_point> timeout, cancellable* cancel, unsigned lane) {
       if (!_error) {
           if (timeout && *timeout <= rpc_clock_type::now()) {
               return make_ready_future<>();
           }
 
-          auto p = std::make_unique<outgoing_entry>(std::move(buf));
+          auto p = std::make_unique<outgoing_entry>(std::move(buf), std::min(lane, outgoing_lanes - 1));
           auto& d = *p;
-          _outgoing_queue.push_back(d);
+          // Overtake the entries of lower lanes, except the front one that
+          // may be being sent already
+          auto pos = _outgoing_queue.end();
+          while (pos != _outgoing_queue.begin() && std::prev(pos) != _outgoing_queue.begin() && std::prev(pos)->lane < d.lane) {
+              --pos;
+          }
+          future<> ready = make_ready_future<>();
+          if (pos == _outgoing_queue.end()) {
+              ready = std::exchange(_outgoing_queue_ready, d.done.get_future());
+          } else {
+              // Like withdraw() in reverse: the entry before pos now releases
+              // the new entry, which in turn releases pos once sent
+              auto pit = std::prev(pos);
+              promise<> pr;
+              ready = pr.get_future();
+              std::swap(pit->done, pr);
+              d.done = std::move(pr);
+          }
+          _outgoing_queue.insert(pos, d);
           _outgoing_queue_size++;
+          _outgoing_lane_size[d.lane]++;
           auto deleter = [this, it = _outgoing_queue.iterator_to(d)] {
               // Front entry is most likely (unless _negotiated is unresolved) sitting
               // inside send_entry() continuations and thus it cannot be cancelled.
@@ -290,9 +547,10 @@ namespace rpc {
           // New entry should continue (do its .then() lambda) after _outgoing_queue_ready
           // resolves. Next entry will need to do the same after this entry's done resolves.
           // Thus -- replace _outgoing_queue_ready with d's future and chain its continuation
-          // on ..._ready's old value.
-          return std::exchange(_outgoing_queue_ready, d.done.get_future()).then([this, p = std::move(p)] () mutable {
+          // on ..._ready's old value, unless the entry was queued ahead of others above.
+          return ready.then([this, p = std::move(p)] () mutable {
               _outgoing_queue_size--;
+              _outgoing_lane_size[p->lane]--;
               if (__builtin_expect(!p->is_linked(), false)) {
                   // If withdrawn the entry is unlinked and this lambda is fired right at once
                   return make_ready_future<>();
@@ -458,12 +716,16 @@ namespace rpc {
               }
               auto ptr = compress_header.get();
               auto size = read_le<uint32_t>(ptr);
-              return read_rcv_buf(in, size).then([this, size, &compressor, info] (rcv_buf compressed_data) {
+              auto uncompressed = _uncompressed_frames && (size & uncompressed_frame_flag);
+              if (uncompressed) {
+                  size &= ~uncompressed_frame_flag;
+              }
+              return read_rcv_buf(in, size).then([this, size, uncompressed, &compressor, info] (rcv_buf compressed_data) {
                   if (compressed_data.size != size) {
                       _logger(info, format("unexpected eof on a {} while reading compressed data: expected {:d} got {:d}", FrameType::role(), size, compressed_data.size));
                       return FrameType::empty_value();
                   }
-                  auto eb = compressor->decompress(std::move(compressed_data));
+                  auto eb = uncompressed ? std::move(compressed_data) : compressor->decompress(std::move(compressed_data));
                   net::packet p;
                   auto* one = std::get_if<temporary_buffer<char>>(&eb.bufs);
                   if (one) {
@@ -486,11 +748,12 @@ namespace rpc {
   }
 
   struct stream_frame {
-      using opt_buf_type = std::optional<rcv_buf>;
+      using opt_buf_type = std::optional<connection::stream_frame_value>;
       using return_type = future<opt_buf_type>;
       struct header_type {
           uint32_t size;
           bool eos;
+          bool window_update;
       };
       static size_t header_size() {
           return 4;
@@ -502,10 +765,13 @@ namespace rpc {
           return make_ready_future<opt_buf_type>(std::nullopt);
       }
       static header_type decode_header(const char* ptr) {
-          header_type h{read_le<uint32_t>(ptr), false};
+          header_type h{read_le<uint32_t>(ptr), false, false};
           if (h.size == -1U) {
               h.size = 0;
               h.eos = true;
+          } else if (h.size == stream_window_update) {
+              h.size = sizeof(uint32_t);
+              h.window_update = true;
           }
           return h;
       }
@@ -513,6 +779,11 @@ namespace rpc {
           return t.size;
       }
       static future<opt_buf_type> make_value(const header_type& t, rcv_buf data) {
+          if (t.window_update) {
+              uint32_t credit;
+              make_deserializer_stream(data).read(reinterpret_cast<char*>(&credit), sizeof(credit));
+              return make_ready_future<opt_buf_type>(le_to_cpu(credit));
+          }
           if (t.eos) {
               data.size = -1U;
           }
@@ -520,7 +791,7 @@ namespace rpc {
       }
   };
 
-  future<std::optional<rcv_buf>>
+  future<std::optional<connection::stream_frame_value>>
   connection::read_stream_frame_compressed(input_stream<char>& in) {
       return read_frame_compressed<stream_frame>(peer_address(), _compressor, in);
   }
@@ -548,25 +819,64 @@ namespace rpc {
   }
 
   future<> connection::handle_stream_frame() {
-      return read_stream_frame_compressed(_read_buf).then([this] (std::optional<rcv_buf> data) {
+      return read_stream_frame_compressed(_read_buf).then([this] (std::optional<stream_frame_value> data) {
           if (!data) {
               _error = true;
               return make_ready_future<>();
           }
-          return stream_process_incoming(std::move(*data));
+          if (auto credit = std::get_if<uint32_t>(&*data)) {
+              _stream_credits.signal(*credit);
+              return make_ready_future<>();
+          }
+          return stream_process_incoming(std::get<rcv_buf>(std::move(*data)));
       });
   }
 
+  void connection::set_stream_windows(uint32_t send_window, uint32_t recv_window) {
+      _stream_send_window = send_window;
+      _stream_recv_window = recv_window;
+      _stream_credits.signal(send_window);
+      // Let a full window in, rather than stopping to read at the default limit
+      if (recv_window > max_stream_buffers_memory) {
+          _stream_sem.signal(recv_window - max_stream_buffers_memory);
+      }
+  }
+
+  // A frame too large for the window takes all of it, so that it is sent
+  // once everything before it was consumed
+  future<> connection::stream_wait_credits(size_t frame_size) {
+      if (!_stream_send_window) {
+          return make_ready_future<>();
+      }
+      return _stream_credits.wait(std::min(frame_size, size_t(_stream_send_window)));
+  }
+
+  void connection::stream_return_credits(size_t credit) {
+      if (!credit || _error) {
+          return;
+      }
+      snd_buf data(8);
+      auto p = data.front().get_write();
+      write_le<uint32_t>(p, stream_window_update);
+      write_le<uint32_t>(p + 4, credit);
+      // A failure breaks the connection, which the stream notices anyway
+      (void)send(std::move(data), {}, nullptr).handle_exception([] (std::exception_ptr) {});
+  }
+
   future<> connection::stream_receive(circular_buffer<foreign_ptr<std::unique_ptr<rcv_buf>>>& bufs) {
       return _stream_queue.not_empty().then([this, &bufs] {
-          bool eof = !_stream_queue.consume([&bufs] (rcv_buf&& b) {
+          size_t credit = 0;
+          bool eof = !_stream_queue.consume([this, &bufs, &credit] (rcv_buf&& b) {
               if (b.size == -1U) { // max fragment length marks an end of a stream
                   return false;
               } else {
+                  // The sender spent the frame size, including its length
+                  credit += std::min(size_t(b.size) + 4, size_t(_stream_recv_window));
                   bufs.push_back(make_foreign(std::make_unique<rcv_buf>(std::move(b))));
                   return true;
               }
           });
+          stream_return_credits(credit);
           if (eof && !bufs.empty()) {
               assert(_stream_queue.empty());
               _stream_queue.push(rcv_buf(-1U)); // push eof marker back for next read to notice it
@@ -604,6 +914,21 @@ namespace rpc {
           case protocol_features::TIMEOUT:
               _timeout_negotiated = true;
               break;
+          case protocol_features::TRACING:
+              _tracing_negotiated = true;
+              break;
+          case protocol_features::UNCOMPRESSED_FRAMES:
+              _uncompressed_frames = true;
+              _adaptive_compression = _options.adaptive_compression;
+              break;
+          case protocol_features::SHARD_INFO:
+              _peer_shard_info = deserialize_shard_info(e.second);
+              break;
+          case protocol_features::STREAM_FLOW_CONTROL:
+              if (auto window = deserialize_stream_window(e.second)) {
+                  set_stream_windows(window, _options.stream.window);
+              }
+              break;
           case protocol_features::CONNECTION_ID: {
               _id = deserialize_connection_id(e.second);
               break;
@@ -660,10 +985,15 @@ namespace rpc {
       return read_frame_compressed<response_frame>(_server_addr, _compressor, in);
   }
 
+  void connection::fill_queue_stats(stats& res) const noexcept {
+      res.pending = outgoing_queue_length();
+      std::copy(_outgoing_lane_size.begin(), _outgoing_lane_size.end(), res.pending_per_lane.begin());
+  }
+
   stats client::get_stats() const {
       stats res = _stats;
       res.wait_reply = _outstanding.size();
-      res.pending = outgoing_queue_length();
+      fill_queue_stats(res);
       return res;
   }
 
@@ -716,11 +1046,22 @@ namespace rpc {
   client::client(const logger& l, void* s, client_options ops, socket socket, const socket_address& addr, const socket_address& local)
   : rpc::connection(l, s), _socket(std::move(socket)), _server_addr(addr), _local_addr(local), _options(ops) {
        _socket.set_reuseaddr(ops.reuseaddr);
+       _coalescing_delay = ops.coalescing_delay;
       // Run client in the background.
       // Communicate result via _stopped.
       // The caller has to call client::stop() to synchronize.
       (void)_socket.connect(addr, local).then([this, ops = std::move(ops)] (connected_socket fd) {
           fd.set_nodelay(ops.tcp_nodelay);
+          if (ops.busy_poll.count()) {
+              try {
+                  int usec = ops.busy_poll.count();
+                  int prefer = 1;
+                  fd.set_sockopt(SOL_SOCKET, SO_BUSY_POLL, &usec, sizeof(usec));
+                  fd.set_sockopt(SOL_SOCKET, SO_PREFER_BUSY_POLL, &prefer, sizeof(prefer));
+              } catch (...) {
+                  log_exception(*this, log_level::debug, "cannot busy poll", std::current_exception());
+              }
+          }
           if (ops.keepalive) {
               fd.set_keepalive(true);
               fd.set_keepalive_parameters(ops.keepalive.value());
@@ -730,12 +1071,20 @@ namespace rpc {
           feature_map features;
           if (_options.compressor_factory) {
               features[protocol_features::COMPRESS] = _options.compressor_factory->supported();
+              features[protocol_features::UNCOMPRESSED_FRAMES] = "";
           }
+          features[protocol_features::SHARD_INFO] = "";
           if (_options.send_timeout_data) {
               features[protocol_features::TIMEOUT] = "";
           }
+          if (_options.send_trace_context) {
+              features[protocol_features::TRACING] = "";
+          }
           if (_options.stream_parent) {
               features[protocol_features::STREAM_PARENT] = serialize_connection_id(_options.stream_parent);
+              if (_options.stream.window) {
+                  features[protocol_features::STREAM_FLOW_CONTROL] = serialize_stream_window(_options.stream.window);
+              }
           }
           if (!_options.isolation_cookie.empty()) {
               features[protocol_features::ISOLATION] = _options.isolation_cookie;
@@ -799,6 +1148,7 @@ namespace rpc {
           }
           _error = true;
           _stream_queue.abort(std::make_exception_ptr(stream_closed()));
+          _stream_credits.broken(std::make_exception_ptr(closed_error()));
           return stop_send_loop(ep).then_wrapped([this] (future<> f) {
               f.ignore_ready_future();
               _outstanding.clear();
@@ -847,6 +1197,26 @@ namespace rpc {
               _timeout_negotiated = true;
               ret[protocol_features::TIMEOUT] = "";
               break;
+          case protocol_features::TRACING:
+              _tracing_negotiated = true;
+              ret[protocol_features::TRACING] = "";
+              break;
+          case protocol_features::UNCOMPRESSED_FRAMES:
+              // COMPRESS sorts first, so it has been negotiated already
+              if (_compressor) {
+                  _uncompressed_frames = true;
+                  _adaptive_compression = _server._options.adaptive_compression;
+                  ret[protocol_features::UNCOMPRESSED_FRAMES] = "";
+              }
+              break;
+          case protocol_features::SHARD_INFO: {
+              shard_info info;
+              info.shard = this_shard_id();
+              info.shard_count = smp::count;
+              info.port_routing = _server._options.load_balancing_algorithm == server_socket::load_balancing_algorithm::port;
+              ret[protocol_features::SHARD_INFO] = serialize_shard_info(info);
+              break;
+          }
           case protocol_features::STREAM_PARENT: {
               if (!_server._options.streaming_domain) {
                   f = f.then([] {
@@ -875,6 +1245,16 @@ namespace rpc {
               }
               break;
           }
+          case protocol_features::STREAM_FLOW_CONTROL: {
+              // STREAM_PARENT sorts first, so it is known whether this is a stream
+              auto requested = deserialize_stream_window(e.second);
+              auto window = std::min(requested, _server._options.max_stream_window);
+              if (_is_stream && window) {
+                  set_stream_windows(requested, window);
+                  ret[protocol_features::STREAM_FLOW_CONTROL] = serialize_stream_window(window);
+              }
+              break;
+          }
           case protocol_features::ISOLATION: {
               auto&& isolation_cookie = e.second;
               struct isolation_function_visitor {
@@ -923,9 +1303,9 @@ namespace rpc {
 
   struct request_frame {
       using opt_buf_type = std::optional<rcv_buf>;
-      using header_and_buffer_type = std::tuple<std::optional<uint64_t>, uint64_t, int64_t, opt_buf_type>;
+      using header_and_buffer_type = std::tuple<std::optional<uint64_t>, uint64_t, int64_t, opt_buf_type, tracing::trace_context>;
       using return_type = future<header_and_buffer_type>;
-      using header_type = std::tuple<std::optional<uint64_t>, uint64_t, int64_t, uint32_t>;
+      using header_type = std::tuple<std::optional<uint64_t>, uint64_t, int64_t, uint32_t, tracing::trace_context>;
       static size_t header_size() {
           return 20;
       }
@@ -933,19 +1313,19 @@ namespace rpc {
           return "server";
       }
       static auto empty_value() {
-          return make_ready_future<header_and_buffer_type>(header_and_buffer_type(std::nullopt, uint64_t(0), 0, std::nullopt));
+          return make_ready_future<header_and_buffer_type>(header_and_buffer_type(std::nullopt, uint64_t(0), 0, std::nullopt, tracing::trace_context()));
       }
       static header_type decode_header(const char* ptr) {
           auto type = read_le<uint64_t>(ptr);
           auto msgid = read_le<int64_t>(ptr + 8);
           auto size = read_le<uint32_t>(ptr + 16);
-          return std::make_tuple(std::nullopt, type, msgid, size);
+          return std::make_tuple(std::nullopt, type, msgid, size, tracing::trace_context());
       }
       static uint32_t get_size(const header_type& t) {
           return std::get<3>(t);
       }
       static auto make_value(const header_type& t, rcv_buf data) {
-          return make_ready_future<header_and_buffer_type>(header_and_buffer_type(std::get<0>(t), std::get<1>(t), std::get<2>(t), std::move(data)));
+          return make_ready_future<header_and_buffer_type>(header_and_buffer_type(std::get<0>(t), std::get<1>(t), std::get<2>(t), std::move(data), std::get<4>(t)));
       }
   };
 
@@ -961,8 +1341,28 @@ namespace rpc {
       }
   };
 
+  template <typename Frame>
+  struct request_frame_with_trace : Frame {
+      using super = Frame;
+      static size_t header_size() {
+          return tracing::trace_context::serialized_size + super::header_size();
+      }
+      static typename super::header_type decode_header(const char* ptr) {
+          auto h = super::decode_header(ptr + tracing::trace_context::serialized_size);
+          std::get<4>(h) = tracing::trace_context::deserialize(ptr);
+          return h;
+      }
+  };
+
   future<request_frame::header_and_buffer_type>
   server::connection::read_request_frame_compressed(input_stream<char>& in) {
+      if (_tracing_negotiated) {
+          if (_timeout_negotiated) {
+              return read_frame_compressed<request_frame_with_trace<request_frame_with_timeout>>(_info.addr, _compressor, in);
+          } else {
+              return read_frame_compressed<request_frame_with_trace<request_frame>>(_info.addr, _compressor, in);
+          }
+      }
       if (_timeout_negotiated) {
           return read_frame_compressed<request_frame_with_timeout>(_info.addr, _compressor, in);
       } else {
@@ -980,7 +1380,7 @@ namespace rpc {
   }
 
 future<> server::connection::send_unknown_verb_reply(std::optional<rpc_clock_type::time_point> timeout, int64_t msg_id, uint64_t type) {
-    return wait_for_resources(28, timeout).then([this, timeout, msg_id, type] (auto permit) {
+    return get_resources(28, timeout).then([this, timeout, msg_id, type] (auto permit) {
         // send unknown_verb exception back
         snd_buf data(28);
         static_assert(snd_buf::chunk_size >= 28, "send buffer chunk size is too small");
@@ -1000,6 +1400,70 @@ future<> server::connection::send_unknown_verb_reply(std::optional<rpc_clock_typ
     });
 }
 
+future<> server::connection::send_overloaded_reply(std::optional<rpc_clock_type::time_point> timeout, int64_t msg_id) {
+    // The reply takes no resources, waiting for them is what it reports
+    snd_buf data(20);
+    static_assert(snd_buf::chunk_size >= 20, "send buffer chunk size is too small");
+    auto p = data.front().get_write() + 12;
+    write_le<uint32_t>(p, uint32_t(exception_type::OVERLOADED));
+    write_le<uint32_t>(p + 4, uint32_t(0));
+    return try_with_gate(_server._reply_gate, [this, timeout, msg_id, data = std::move(data)] () mutable {
+        return respond(-msg_id, std::move(data), timeout);
+    }).handle_exception_type([] (gate_closed_exception&) {/* ignore */});
+}
+
+void server::admission_queue::record(clock_type::duration wait, clock_type::time_point now, const load_shedding_config& cfg) noexcept {
+    average_wait = average_wait - average_wait / 8 + wait / 8;
+    min_wait = std::min(min_wait, wait);
+    if (now >= interval_end) {
+        standing = min_wait > cfg.target;
+        min_wait = clock_type::duration::max();
+        interval_end = now + cfg.interval;
+    }
+}
+
+future<resource_permit> server::connection::admit(size_t memory_consumed, std::optional<rpc_clock_type::time_point> timeout) {
+    using clock_type = admission_queue::clock_type;
+    const auto& cfg = *_server._limits.load_shedding;
+    auto& q = _server._admission[internal::scheduling_group_index(current_scheduling_group())];
+    auto start = clock_type::now();
+    auto& sem = _server._resources_available;
+    if (!sem.waiters() && sem.available_units() >= ssize_t(memory_consumed)) {
+        q.record(clock_type::duration(0), start, cfg);
+        return make_ready_future<resource_permit>(consume_units(sem, memory_consumed));
+    }
+    auto rpc_now = rpc_clock_type::now();
+    if (timeout && rpc_now + std::chrono::duration_cast<rpc_clock_type::duration>(q.average_wait) >= *timeout) {
+        _stats.shed++;
+        return make_exception_future<resource_permit>(overloaded_error());
+    }
+    auto deadline = timeout;
+    bool own_deadline = false;
+    if (q.standing) {
+        auto limit = rpc_now + std::chrono::duration_cast<rpc_clock_type::duration>(cfg.target);
+        if (!timeout || limit < *timeout) {
+            deadline = limit;
+            own_deadline = true;
+        }
+    }
+    return get_resources(memory_consumed, deadline).then_wrapped([this, &q, &cfg, start, own_deadline] (future<resource_permit> f) {
+        auto now = clock_type::now();
+        q.record(now - start, now, cfg);
+        if (own_deadline && f.failed()) {
+            auto ep = f.get_exception();
+            try {
+                std::rethrow_exception(ep);
+            } catch (semaphore_timed_out&) {
+                _stats.shed++;
+                return make_exception_future<resource_permit>(overloaded_error());
+            } catch (...) {
+                return make_exception_future<resource_permit>(std::move(ep));
+            }
+        }
+        return f;
+    });
+}
+
   future<> server::connection::process() {
       return negotiate_protocol(_read_buf).then([this] () mutable {
         auto sg = _isolation_config ? _isolation_config->sched_group : current_scheduling_group();
@@ -1014,6 +1478,7 @@ future<> server::connection::send_unknown_verb_reply(std::optional<rpc_clock_typ
                   auto& type = std::get<1>(header_and_buffer);
                   auto& msg_id = std::get<2>(header_and_buffer);
                   auto& data = std::get<3>(header_and_buffer);
+                  auto& trace = std::get<4>(header_and_buffer);
                   if (!data) {
                       _error = true;
                       return make_ready_future<>();
@@ -1030,11 +1495,21 @@ future<> server::connection::send_unknown_verb_reply(std::optional<rpc_clock_typ
                       // If the new method of per-connection scheduling group was used, honor it.
                       // Otherwise, use the old per-handler scheduling group.
                       auto sg = _isolation_config ? _isolation_config->sched_group : h->sg;
-                      return with_scheduling_group(sg, [this, timeout, msg_id, h, data = std::move(data.value())] () mutable {
-                          return h->func(shared_from_this(), timeout, msg_id, std::move(data)).finally([this, h] {
-                              // If anything between get_handler() and here throws, we leak put_handler
-                              _server._proto->put_handler(h);
-                          });
+                      return with_scheduling_group(sg, [this, timeout, msg_id, type, h, trace, data = std::move(data.value())] () mutable {
+                          auto handle = [this, timeout, msg_id, h, data = std::move(data)] () mutable {
+                              return h->func(shared_from_this(), timeout, msg_id, std::move(data)).finally([this, h] {
+                                  // If anything between get_handler() and here throws, we leak put_handler
+                                  _server._proto->put_handler(h);
+                              });
+                          };
+                          if (!trace.valid()) {
+                              return handle();
+                          }
+                          // The handler is a child of the span of the caller
+                          tracing::span s("rpc.server", trace);
+                          s.set_attribute("rpc.verb", to_sstring(type));
+                          auto f = s.activate(handle);
+                          return f.finally([s = std::move(s)] () mutable { s.end(); });
                       });
                   }
               });
@@ -1050,6 +1525,7 @@ future<> server::connection::send_unknown_verb_reply(std::optional<rpc_clock_typ
           _fd.shutdown_input();
           _error = true;
           _stream_queue.abort(std::make_exception_ptr(stream_closed()));
+          _stream_credits.broken(std::make_exception_ptr(closed_error()));
           return stop_send_loop(ep).then_wrapped([this] (future<> f) {
               f.ignore_ready_future();
               _server._conns.erase(get_connection_id());
@@ -1067,8 +1543,10 @@ future<> server::connection::send_unknown_verb_reply(std::optional<rpc_clock_typ
   }
 
   server::connection::connection(server& s, connected_socket&& fd, socket_address&& addr, const logger& l, void* serializer, connection_id id)
-      : rpc::connection(std::move(fd), l, serializer, id), _server(s) {
+      : rpc::connection(l, serializer, id), _server(s) {
+      set_socket(std::move(fd), s._connection_memory.get());
       _info.addr = std::move(addr);
+      _coalescing_delay = s._options.coalescing_delay;
   }
 
   future<> server::connection::deregister_this_stream() {
@@ -1093,8 +1571,16 @@ future<> server::connection::send_unknown_verb_reply(std::optional<rpc_clock_typ
       : server(proto, seastar::listen(addr, listen_options{true}), limits, server_options{})
   {}
 
+  static listen_options listen_options_of(const server_options& opts) {
+      listen_options lo;
+      lo.reuse_address = true;
+      lo.lba = opts.load_balancing_algorithm;
+      lo.busy_poll = opts.busy_poll;
+      return lo;
+  }
+
   server::server(protocol_base* proto, server_options opts, const socket_address& addr, resource_limits limits)
-      : server(proto, seastar::listen(addr, listen_options{true, opts.load_balancing_algorithm}), limits, opts)
+      : server(proto, seastar::listen(addr, listen_options_of(opts)), limits, opts)
   {}
 
   server::server(protocol_base* proto, server_socket ss, resource_limits limits, server_options opts)
@@ -1106,6 +1592,9 @@ future<> server::connection::send_unknown_verb_reply(std::optional<rpc_clock_typ
           }
           _servers[*_options.streaming_domain] = this;
       }
+      if (_options.connection_memory) {
+          _connection_memory = std::make_unique<net::connection_memory_budget>(*_options.connection_memory, _options.connection_memory_name);
+      }
       accept();
   }
 
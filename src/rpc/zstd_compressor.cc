@@ -0,0 +1,324 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#ifdef SEASTAR_HAVE_ZSTD
+
+#include <seastar/rpc/zstd_compressor.hh>
+#include <seastar/core/byteorder.hh>
+#include <seastar/core/print.hh>
+#include <zstd.h>
+#include <zdict.h>
+#include <algorithm>
+#include <stdexcept>
+
+namespace seastar {
+
+namespace rpc {
+
+// Compressed frame format: the 4 byte little-endian size of the decompressed
+// data, followed by a single zstd frame without the content size, checksum
+// and dictionary id fields, which are either carried by the header or
+// implied by the negotiated feature.
+
+namespace {
+
+size_t check(size_t ret, const char* what) {
+    if (ZSTD_isError(ret)) {
+        throw std::runtime_error(format("RPC frame zstd {} failure: {}", what, ZSTD_getErrorName(ret)));
+    }
+    return ret;
+}
+
+// Compression is synchronous, so one pair of contexts per shard serves all
+// connections, however many of them use zstd.
+class contexts {
+    struct cctx_deleter {
+        void operator()(ZSTD_CCtx* p) const noexcept { ZSTD_freeCCtx(p); }
+    };
+    struct dctx_deleter {
+        void operator()(ZSTD_DCtx* p) const noexcept { ZSTD_freeDCtx(p); }
+    };
+    std::unique_ptr<ZSTD_CCtx, cctx_deleter> _cctx;
+    std::unique_ptr<ZSTD_DCtx, dctx_deleter> _dctx;
+public:
+    ZSTD_CCtx* compression(int level, const zstd_dictionary* dict, size_t src_size) {
+        if (!_cctx) {
+            _cctx.reset(ZSTD_createCCtx());
+            if (!_cctx) {
+                throw std::bad_alloc();
+            }
+        }
+        auto cctx = _cctx.get();
+        check(ZSTD_CCtx_reset(cctx, ZSTD_reset_session_and_parameters), "compression");
+        if (dict) {
+            check(ZSTD_CCtx_refCDict(cctx, dict->cdict()), "compression");
+        } else {
+            check(ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, level), "compression");
+        }
+        check(ZSTD_CCtx_setParameter(cctx, ZSTD_c_contentSizeFlag, 0), "compression");
+        check(ZSTD_CCtx_setParameter(cctx, ZSTD_c_checksumFlag, 0), "compression");
+        check(ZSTD_CCtx_setParameter(cctx, ZSTD_c_dictIDFlag, 0), "compression");
+        // Lets zstd size its window and tables after the frame
+        check(ZSTD_CCtx_setPledgedSrcSize(cctx, src_size), "compression");
+        return cctx;
+    }
+    ZSTD_DCtx* decompression(const zstd_dictionary* dict) {
+        if (!_dctx) {
+            _dctx.reset(ZSTD_createDCtx());
+            if (!_dctx) {
+                throw std::bad_alloc();
+            }
+        }
+        auto dctx = _dctx.get();
+        check(ZSTD_DCtx_reset(dctx, ZSTD_reset_session_and_parameters), "decompression");
+        check(ZSTD_DCtx_refDDict(dctx, dict ? dict->ddict() : nullptr), "decompression");
+        return dctx;
+    }
+};
+
+thread_local contexts local_contexts;
+
+using fragment = std::pair<const char*, size_t>;
+
+std::vector<fragment> fragments(const std::variant<std::vector<temporary_buffer<char>>, temporary_buffer<char>>& bufs) {
+    std::vector<fragment> ret;
+    if (auto single = std::get_if<temporary_buffer<char>>(&bufs)) {
+        ret.emplace_back(single->get(), single->size());
+    } else {
+        for (auto& b : std::get<std::vector<temporary_buffer<char>>>(bufs)) {
+            ret.emplace_back(b.get(), b.size());
+        }
+    }
+    return ret;
+}
+
+// Output buffers of at most snd_buf::chunk_size, allocated as they fill up
+class chunked_output {
+    std::vector<temporary_buffer<char>> _chunks;
+    size_t _limit;
+    size_t _allocated = 0;
+public:
+    ZSTD_outBuffer out{nullptr, 0, 0};
+public:
+    explicit chunked_output(size_t limit) : _limit(limit) {}
+    // Returns false if the limit was reached
+    bool next(size_t min_size = 0) {
+        if (_allocated == _limit) {
+            return false;
+        }
+        flush();
+        auto size = std::min(_limit - _allocated, std::max(snd_buf::chunk_size, min_size));
+        _chunks.emplace_back(size);
+        _allocated += size;
+        out = ZSTD_outBuffer{_chunks.back().get_write(), size, 0};
+        return true;
+    }
+    char* front() noexcept {
+        return _chunks.front().get_write();
+    }
+    template <typename Output>
+    Output finish() {
+        flush();
+        size_t size = 0;
+        for (auto& c : _chunks) {
+            size += c.size();
+        }
+        if (_chunks.size() == 1) {
+            return Output(std::move(_chunks.front()));
+        }
+        return Output(std::move(_chunks), size);
+    }
+private:
+    void flush() noexcept {
+        if (out.dst) {
+            _chunks.back().trim(out.pos);
+            out.dst = nullptr;
+        }
+    }
+};
+
+}
+
+void zstd_dictionary::cdict_deleter::operator()(ZSTD_CDict_s* p) const noexcept {
+    ZSTD_freeCDict(p);
+}
+
+void zstd_dictionary::ddict_deleter::operator()(ZSTD_DDict_s* p) const noexcept {
+    ZSTD_freeDDict(p);
+}
+
+zstd_dictionary::zstd_dictionary(sstring id, const temporary_buffer<char>& data, int level)
+    : _id(std::move(id))
+    , _cdict(ZSTD_createCDict(data.get(), data.size(), level))
+    , _ddict(ZSTD_createDDict(data.get(), data.size()))
+{
+    if (_id.find(',') != sstring::npos) {
+        throw std::invalid_argument(format("zstd dictionary id cannot contain ',': {}", _id));
+    }
+    if (!_cdict || !_ddict) {
+        throw std::runtime_error(format("failed to load zstd dictionary {}", _id));
+    }
+}
+
+temporary_buffer<char> zstd_dictionary::train(const std::vector<temporary_buffer<char>>& samples, size_t max_size) {
+    std::vector<size_t> sizes;
+    sizes.reserve(samples.size());
+    size_t total = 0;
+    for (auto& s : samples) {
+        sizes.push_back(s.size());
+        total += s.size();
+    }
+    auto concatenated = std::unique_ptr<char[]>(new char[total]);
+    auto dst = concatenated.get();
+    for (auto& s : samples) {
+        dst = std::copy_n(s.get(), s.size(), dst);
+    }
+    temporary_buffer<char> dict(max_size);
+    auto size = ZDICT_trainFromBuffer(dict.get_write(), max_size, concatenated.get(), sizes.data(), sizes.size());
+    if (ZDICT_isError(size)) {
+        throw std::runtime_error(format("zstd dictionary training failure: {}", ZDICT_getErrorName(size)));
+    }
+    dict.trim(size);
+    return dict;
+}
+
+zstd_compressor::factory::factory(int level)
+    : _level(level)
+    , _name("ZSTD")
+{ }
+
+zstd_compressor::factory::factory(std::shared_ptr<const zstd_dictionary> dict)
+    : _level(default_level)
+    , _dict(std::move(dict))
+    , _name("ZSTD:" + _dict->id())
+{ }
+
+const sstring& zstd_compressor::factory::supported() const {
+    return _name;
+}
+
+std::unique_ptr<rpc::compressor> zstd_compressor::factory::negotiate(sstring feature, bool is_server) const {
+    return feature == _name ? std::make_unique<zstd_compressor>(_level, _dict) : nullptr;
+}
+
+zstd_compressor::zstd_compressor(int level, std::shared_ptr<const zstd_dictionary> dict)
+    : _level(level)
+    , _dict(std::move(dict))
+{ }
+
+sstring zstd_compressor::name() const {
+    return _dict ? "ZSTD:" + _dict->id() : sstring("ZSTD");
+}
+
+snd_buf zstd_compressor::compress(size_t head_space, snd_buf data) {
+    head_space += 4;
+    auto cctx = local_contexts.compression(_level, _dict.get(), data.size);
+    chunked_output dst(head_space + ZSTD_compressBound(data.size));
+    dst.next(head_space + 1);
+    dst.out.pos = head_space;
+
+    auto src = fragments(data.bufs);
+    if (src.empty()) {
+        src.emplace_back(nullptr, 0);
+    }
+    for (size_t i = 0; i < src.size(); i++) {
+        auto last = i == src.size() - 1;
+        auto mode = last ? ZSTD_e_end : ZSTD_e_continue;
+        ZSTD_inBuffer in{src[i].first, src[i].second, 0};
+        while (true) {
+            if (dst.out.pos == dst.out.size && !dst.next()) {
+                throw std::runtime_error("RPC frame zstd compression failure: output exceeds bound");
+            }
+            auto remaining = check(ZSTD_compressStream2(cctx, &dst.out, &in, mode), "compression");
+            if (last ? remaining == 0 : in.pos == in.size) {
+                break;
+            }
+        }
+    }
+    write_le<uint32_t>(dst.front() + (head_space - 4), data.size);
+    return dst.finish<snd_buf>();
+}
+
+rcv_buf zstd_compressor::decompress(rcv_buf data) {
+    if (data.size < 4) {
+        return rcv_buf();
+    }
+    auto src = fragments(data.bufs);
+
+    // The size header may straddle fragments
+    char header[4];
+    size_t header_size = 0;
+    auto it = src.begin();
+    while (header_size < sizeof(header)) {
+        auto n = std::min(sizeof(header) - header_size, it->second);
+        std::copy_n(it->first, n, header + header_size);
+        header_size += n;
+        it->first += n;
+        it->second -= n;
+        if (!it->second) {
+            ++it;
+        }
+    }
+    auto dst_size = read_le<uint32_t>(header);
+    if (!dst_size) {
+        throw std::runtime_error("RPC frame zstd decompression failure: decompressed size cannot be zero");
+    }
+
+    auto dctx = local_contexts.decompression(_dict.get());
+    chunked_output dst(dst_size);
+    dst.next();
+    size_t ret = 1;
+    for (; it != src.end() && ret; ++it) {
+        ZSTD_inBuffer in{it->first, it->second, 0};
+        while (in.pos < in.size) {
+            if (dst.out.pos == dst.out.size && !dst.next()) {
+                throw std::runtime_error("RPC frame zstd decompression failure: data exceeds the declared size");
+            }
+            ret = check(ZSTD_decompressStream(dctx, &dst.out, &in), "decompression");
+            if (!ret) {
+                break;
+            }
+        }
+    }
+    // Flush whatever zstd still holds once the output space ran out
+    while (ret) {
+        if (dst.out.pos == dst.out.size && !dst.next()) {
+            throw std::runtime_error("RPC frame zstd decompression failure: data exceeds the declared size");
+        }
+        auto pos = dst.out.pos;
+        ZSTD_inBuffer in{nullptr, 0, 0};
+        ret = check(ZSTD_decompressStream(dctx, &dst.out, &in), "decompression");
+        if (ret && dst.out.pos == pos) {
+            throw std::runtime_error("RPC frame zstd decompression failure: truncated frame");
+        }
+    }
+    auto result = dst.finish<rcv_buf>();
+    if (result.size != dst_size) {
+        throw std::runtime_error("RPC frame zstd decompression failure: data is shorter than the declared size");
+    }
+    return result;
+}
+
+}
+
+}
+
+#endif
@@ -23,6 +23,23 @@
 #include <seastar/testing/entry_point.hh>
 #include <seastar/testing/seastar_test.hh>
 #include <seastar/testing/test_runner.hh>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+#include <sched.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char** environ;
 
 namespace seastar {
 
@@ -58,7 +75,211 @@ static void install_dummy_handler(int sig) {
     sigaction(sig, &sa, nullptr);
 }
 
+// Removes a --jobs option from the arguments for boost, those before
+// "--"; returns its value, or 0 if there is none
+static unsigned take_jobs_option(int& argc, char** argv) {
+    unsigned jobs = 0;
+    for (int i = 1; i < argc && std::string_view(argv[i]) != "--";) {
+        std::string_view arg = argv[i];
+        int n = 0;
+        if (arg == "--jobs" && i + 1 < argc) {
+            jobs = std::stoul(argv[i + 1]);
+            n = 2;
+        } else if (arg.starts_with("--jobs=")) {
+            jobs = std::stoul(std::string(arg.substr(7)));
+            n = 1;
+        } else {
+            i++;
+            continue;
+        }
+        std::copy(argv + i + n, argv + argc + 1, argv + i);
+        argc -= n;
+    }
+    return jobs;
+}
+
+// Whether the arguments for boost pick the tests to run, or ask for
+// something other than running them
+static bool selects_tests(int argc, char** argv) {
+    for (int i = 1; i < argc && std::string_view(argv[i]) != "--"; i++) {
+        std::string_view arg = argv[i];
+        for (auto opt : {"--run_test", "-t", "--list_content", "--help", "-?"}) {
+            if (arg.starts_with(opt)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// Runs each test in a process of its own, up to jobs at a time. A test
+// process gets cores and memory of its own: as many cores as it asks for
+// with --smp (one if it does not), pinned apart from the other processes
+// if there are enough to go around, and an equal part of the memory.
+// A test's output is shown if it fails.
+static int run_tests_in_parallel(int argc, char** argv, unsigned jobs) {
+    using clock = std::chrono::steady_clock;
+    std::vector<std::string> boost_args;
+    std::vector<std::string> seastar_args;
+    int i = 1;
+    for (; i < argc && std::string_view(argv[i]) != "--"; i++) {
+        boost_args.emplace_back(argv[i]);
+    }
+    for (i++; i < argc; i++) {
+        seastar_args.emplace_back(argv[i]);
+    }
+
+    unsigned smp = 0;
+    bool placed = false;
+    bool has_memory = false;
+    for (size_t j = 0; j < seastar_args.size(); j++) {
+        std::string_view arg = seastar_args[j];
+        auto value = [&] (std::string_view opt) -> std::optional<std::string> {
+            if (arg == opt && j + 1 < seastar_args.size()) {
+                return seastar_args[j + 1];
+            }
+            if (arg.starts_with(opt) && arg.size() > opt.size()) {
+                return std::string(arg.substr(opt.size() + (opt.starts_with("--") ? 1 : 0)));
+            }
+            return std::nullopt;
+        };
+        auto v = value("--smp");
+        if (!v) {
+            v = value("-c");
+        }
+        if (v) {
+            smp = std::stoul(*v);
+        }
+        placed |= arg.starts_with("--cpuset") || arg.starts_with("--overprovisioned") || arg.starts_with("--thread-affinity");
+        has_memory |= arg.starts_with("--memory") || arg.starts_with("-m");
+    }
+    if (!smp) {
+        smp = 1;
+        seastar_args.emplace_back("--smp=1");
+    }
+    std::vector<unsigned> cpus;
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+        for (unsigned c = 0; c < CPU_SETSIZE; c++) {
+            if (CPU_ISSET(c, &allowed)) {
+                cpus.push_back(c);
+            }
+        }
+    }
+    bool pin = !placed && jobs * smp <= cpus.size();
+    if (!placed && !pin) {
+        seastar_args.emplace_back("--overprovisioned");
+    }
+    if (!has_memory) {
+        uint64_t mb = uint64_t(sysconf(_SC_PHYS_PAGES)) * sysconf(_SC_PAGESIZE) >> 20;
+        seastar_args.emplace_back("--memory=" + std::to_string(mb * 9 / 10 / jobs) + "M");
+    }
+
+    struct child {
+        pid_t pid;
+        seastar_test* test;
+        FILE* out;
+        clock::time_point start;
+    };
+    std::vector<std::optional<child>> slots(jobs);
+    std::deque<seastar_test*> pending(known_tests().begin(), known_tests().end());
+    unsigned nr_tests = pending.size();
+    std::vector<std::string> failed;
+    int exit_code = 0;
+    auto suite_start = clock::now();
+
+    auto spawn = [&] (unsigned slot, seastar_test* test) {
+        std::vector<std::string> args{argv[0], std::string("--run_test=") + test->get_name()};
+        args.insert(args.end(), boost_args.begin(), boost_args.end());
+        args.emplace_back("--");
+        args.insert(args.end(), seastar_args.begin(), seastar_args.end());
+        if (pin) {
+            std::string cpuset;
+            for (unsigned c = slot * smp; c < (slot + 1) * smp; c++) {
+                cpuset += (cpuset.empty() ? "" : ",") + std::to_string(cpus[c]);
+            }
+            args.emplace_back("--cpuset=" + cpuset);
+        }
+        std::vector<char*> cargs;
+        for (auto& a : args) {
+            cargs.push_back(a.data());
+        }
+        cargs.push_back(nullptr);
+
+        FILE* out = std::tmpfile();
+        if (!out) {
+            throw std::system_error(errno, std::system_category(), "creating test output file");
+        }
+        posix_spawn_file_actions_t actions;
+        posix_spawn_file_actions_init(&actions);
+        posix_spawn_file_actions_adddup2(&actions, fileno(out), STDOUT_FILENO);
+        posix_spawn_file_actions_adddup2(&actions, fileno(out), STDERR_FILENO);
+        pid_t pid;
+        auto r = posix_spawn(&pid, "/proc/self/exe", &actions, nullptr, cargs.data(), environ);
+        posix_spawn_file_actions_destroy(&actions);
+        if (r) {
+            std::fclose(out);
+            throw std::system_error(r, std::system_category(), "starting test process");
+        }
+        slots[slot] = child{pid, test, out, clock::now()};
+    };
+
+    std::cout << "Running " << nr_tests << " test cases, " << jobs << " at a time" << std::endl;
+    unsigned running = 0;
+    while (running || !pending.empty()) {
+        for (unsigned slot = 0; slot < jobs && !pending.empty(); slot++) {
+            if (!slots[slot]) {
+                spawn(slot, pending.front());
+                pending.pop_front();
+                running++;
+            }
+        }
+        int status;
+        pid_t pid = ::waitpid(-1, &status, 0);
+        if (pid < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::system_error(errno, std::system_category(), "waiting for test processes");
+        }
+        auto it = std::find_if(slots.begin(), slots.end(), [pid] (const std::optional<child>& c) {
+            return c && c->pid == pid;
+        });
+        if (it == slots.end()) {
+            continue;
+        }
+        auto c = std::move(**it);
+        it->reset();
+        running--;
+        auto took = std::chrono::duration<double>(clock::now() - c.start).count();
+        int code = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+        std::cout << "*** " << c.test->get_name() << (code ? " FAILED" : " passed") << " in " << took << " s" << std::endl;
+        if (code) {
+            std::rewind(c.out);
+            char buf[4096];
+            size_t n;
+            while ((n = std::fread(buf, 1, sizeof(buf), c.out)) > 0) {
+                std::cout.write(buf, n);
+            }
+            std::cout.flush();
+            failed.emplace_back(c.test->get_name());
+            exit_code = exit_code ? exit_code : code;
+        }
+        std::fclose(c.out);
+    }
+    std::cout << "*** " << nr_tests - failed.size() << " of " << nr_tests << " test cases passed in "
+              << std::chrono::duration<double>(clock::now() - suite_start).count() << " s" << std::endl;
+    for (auto& name : failed) {
+        std::cout << "*** failed: " << name << std::endl;
+    }
+    return exit_code;
+}
+
 int entry_point(int argc, char** argv) {
+    if (auto jobs = take_jobs_option(argc, argv); jobs > 1 && !selects_tests(argc, argv)) {
+        return run_tests_in_parallel(argc, argv, jobs);
+    }
+
 #ifndef SEASTAR_ASAN_ENABLED
     // Before we call into boost, install some dummy signal
     // handlers. This seems to be the only way to stop boost from
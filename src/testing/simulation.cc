@@ -0,0 +1,415 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#include <seastar/testing/simulation.hh>
+#include <seastar/core/loop.hh>
+#include <seastar/core/sleep.hh>
+#include <seastar/core/timer.hh>
+#include <seastar/net/stack.hh>
+#include <seastar/util/later.hh>
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <stdexcept>
+#include <system_error>
+#include <sys/stat.h>
+
+namespace seastar {
+
+namespace testing {
+
+static future<> sleep_until(manual_clock::time_point t) {
+    auto now = manual_clock::now();
+    return t > now ? sleep<manual_clock>(t - now) : make_ready_future<>();
+}
+
+// One direction of a connection: buffers sent at one end come out at the
+// other in order, each when the model says its transfer completes
+class simulation::channel {
+    simulation& _sim;
+    manual_clock::time_point _free;
+    manual_clock::time_point _last_arrival;
+    std::deque<std::pair<manual_clock::time_point, temporary_buffer<char>>> _in_flight;
+    std::deque<temporary_buffer<char>> _arrived;
+    std::optional<promise<>> _reader;
+    timer<manual_clock> _timer;
+    bool _output_shut = false;
+    bool _input_shut = false;
+    bool _eof = false;
+
+    void deliver() {
+        auto now = manual_clock::now();
+        while (!_in_flight.empty() && _in_flight.front().first <= now) {
+            _arrived.push_back(std::move(_in_flight.front().second));
+            _in_flight.pop_front();
+        }
+        if (!_in_flight.empty()) {
+            _timer.arm(_in_flight.front().first);
+        }
+        if (_reader && !_arrived.empty()) {
+            std::exchange(_reader, std::nullopt)->set_value();
+        }
+    }
+    void enqueue(temporary_buffer<char> buf) {
+        auto size = buf.size();
+        auto at = std::max(_sim.schedule(_sim._network, _free, size), _last_arrival);
+        _last_arrival = at;
+        _in_flight.emplace_back(at, std::move(buf));
+        if (!_timer.armed()) {
+            _timer.arm(at);
+        }
+    }
+public:
+    explicit channel(simulation& sim)
+        : _sim(sim)
+        , _free(manual_clock::now())
+        , _last_arrival(_free)
+        , _timer([this] { deliver(); })
+    { }
+
+    // Resolves once the buffers are on the link, as a socket buffer the
+    // size of what one put() sends would
+    future<> send(std::vector<temporary_buffer<char>> bufs) {
+        if (_output_shut) {
+            return make_exception_future<>(std::system_error(EPIPE, std::system_category()));
+        }
+        for (auto& buf : bufs) {
+            if (!buf.empty()) {
+                enqueue(std::move(buf));
+            }
+        }
+        return sleep_until(_free);
+    }
+    future<temporary_buffer<char>> receive() {
+        if (_eof || _input_shut) {
+            return make_ready_future<temporary_buffer<char>>();
+        }
+        if (!_arrived.empty()) {
+            auto buf = std::move(_arrived.front());
+            _arrived.pop_front();
+            _eof = buf.empty();
+            return make_ready_future<temporary_buffer<char>>(std::move(buf));
+        }
+        _reader.emplace();
+        return _reader->get_future().then([this] {
+            return receive();
+        });
+    }
+    // The end of the stream travels like data
+    void shutdown_output() {
+        if (!std::exchange(_output_shut, true)) {
+            enqueue(temporary_buffer<char>());
+        }
+    }
+    void shutdown_input() {
+        _input_shut = true;
+        if (_reader) {
+            std::exchange(_reader, std::nullopt)->set_value();
+        }
+    }
+};
+
+class simulation::sim_source final : public seastar::data_source_impl {
+    lw_shared_ptr<channel> _rx;
+public:
+    explicit sim_source(lw_shared_ptr<channel> rx) : _rx(std::move(rx)) {}
+    future<temporary_buffer<char>> get() override {
+        return _rx->receive();
+    }
+};
+
+class simulation::sim_sink final : public seastar::data_sink_impl {
+    lw_shared_ptr<channel> _tx;
+public:
+    explicit sim_sink(lw_shared_ptr<channel> tx) : _tx(std::move(tx)) {}
+    future<> put(net::packet data) override {
+        return _tx->send(data.release());
+    }
+    future<> put(std::vector<temporary_buffer<char>> data) override {
+        return _tx->send(std::move(data));
+    }
+    future<> close() override {
+        _tx->shutdown_output();
+        return make_ready_future<>();
+    }
+};
+
+class simulation::sim_socket final : public net::connected_socket_impl {
+    lw_shared_ptr<channel> _rx;
+    lw_shared_ptr<channel> _tx;
+    bool _nodelay = true;
+public:
+    sim_socket(lw_shared_ptr<channel> rx, lw_shared_ptr<channel> tx)
+        : _rx(std::move(rx)), _tx(std::move(tx)) {}
+    data_source source() override {
+        return data_source(std::make_unique<sim_source>(_rx));
+    }
+    data_sink sink() override {
+        return data_sink(std::make_unique<sim_sink>(_tx));
+    }
+    void shutdown_input() override {
+        _rx->shutdown_input();
+    }
+    void shutdown_output() override {
+        _tx->shutdown_output();
+    }
+    void set_nodelay(bool nodelay) override {
+        _nodelay = nodelay;
+    }
+    bool get_nodelay() const override {
+        return _nodelay;
+    }
+    void set_keepalive(bool) override {}
+    bool get_keepalive() const override {
+        return false;
+    }
+    void set_keepalive_parameters(const net::keepalive_params&) override {}
+    net::keepalive_params get_keepalive_parameters() const override {
+        return net::tcp_keepalive_params{std::chrono::seconds(0), std::chrono::seconds(0), 0};
+    }
+    void set_sockopt(int, int, const void*, size_t) override {
+        throw std::runtime_error("Setting custom socket options is not supported for simulated sockets");
+    }
+    int get_sockopt(int, int, void*, size_t) const override {
+        throw std::runtime_error("Getting custom socket options is not supported for simulated sockets");
+    }
+    socket_address local_address() const noexcept override {
+        return {};
+    }
+};
+
+class simulation::sim_server_socket final : public net::server_socket_impl {
+    simulation& _sim;
+    socket_address _addr;
+    lw_shared_ptr<queue<connected_socket>> _pending;
+public:
+    sim_server_socket(simulation& sim, socket_address addr, lw_shared_ptr<queue<connected_socket>> pending)
+        : _sim(sim), _addr(addr), _pending(std::move(pending)) {}
+    ~sim_server_socket() {
+        _sim._listeners.erase(_addr);
+    }
+    future<accept_result> accept() override {
+        return _pending->pop_eventually().then([] (connected_socket cs) {
+            return accept_result{std::move(cs), socket_address()};
+        });
+    }
+    void abort_accept() override {
+        _pending->abort(std::make_exception_ptr(std::system_error(ECONNABORTED, std::system_category())));
+    }
+    socket_address local_address() const override {
+        return _addr;
+    }
+};
+
+struct simulation::file_data {
+    std::vector<char> data;
+};
+
+// Reads and writes are done at once, and complete when the disk model says
+class simulation::sim_file final : public seastar::file_impl {
+    simulation& _sim;
+    lw_shared_ptr<file_data> _data;
+
+    future<size_t> complete(const latency_model& m, manual_clock::time_point& free, size_t len) {
+        return sleep_until(_sim.schedule(m, free, len)).then([len] {
+            return len;
+        });
+    }
+    size_t write(uint64_t pos, const void* buffer, size_t len) {
+        auto& d = _data->data;
+        if (pos + len > d.size()) {
+            d.resize(pos + len);
+        }
+        std::memcpy(d.data() + pos, buffer, len);
+        return len;
+    }
+    size_t read(uint64_t pos, void* buffer, size_t len) const {
+        auto& d = _data->data;
+        if (pos >= d.size()) {
+            return 0;
+        }
+        len = std::min<size_t>(len, d.size() - pos);
+        std::memcpy(buffer, d.data() + pos, len);
+        return len;
+    }
+public:
+    sim_file(simulation& sim, lw_shared_ptr<file_data> data)
+        : _sim(sim), _data(std::move(data)) {}
+
+    future<size_t> write_dma(uint64_t pos, const void* buffer, size_t len, const io_priority_class&) override {
+        return complete(_sim._disk.write, _sim._disk_write_free, write(pos, buffer, len));
+    }
+    future<size_t> write_dma(uint64_t pos, std::vector<iovec> iov, const io_priority_class&) override {
+        size_t len = 0;
+        for (auto& v : iov) {
+            len += write(pos + len, v.iov_base, v.iov_len);
+        }
+        return complete(_sim._disk.write, _sim._disk_write_free, len);
+    }
+    future<size_t> read_dma(uint64_t pos, void* buffer, size_t len, const io_priority_class&) override {
+        return complete(_sim._disk.read, _sim._disk_read_free, read(pos, buffer, len));
+    }
+    future<size_t> read_dma(uint64_t pos, std::vector<iovec> iov, const io_priority_class&) override {
+        size_t len = 0;
+        for (auto& v : iov) {
+            auto n = read(pos + len, v.iov_base, v.iov_len);
+            len += n;
+            if (n < v.iov_len) {
+                break;
+            }
+        }
+        return complete(_sim._disk.read, _sim._disk_read_free, len);
+    }
+    future<> flush() override {
+        // After the writes sent before it
+        return complete(_sim._disk.write, _sim._disk_write_free, 0).discard_result();
+    }
+    future<struct stat> stat() override {
+        struct stat st = {};
+        st.st_mode = S_IFREG | 0644;
+        st.st_size = _data->data.size();
+        st.st_blksize = _disk_write_dma_alignment;
+        st.st_blocks = (st.st_size + 511) / 512;
+        return make_ready_future<struct stat>(st);
+    }
+    future<> truncate(uint64_t length) override {
+        _data->data.resize(length);
+        return make_ready_future<>();
+    }
+    future<> discard(uint64_t offset, uint64_t length) override {
+        auto& d = _data->data;
+        if (offset < d.size()) {
+            std::fill_n(d.begin() + offset, std::min<uint64_t>(length, d.size() - offset), 0);
+        }
+        return make_ready_future<>();
+    }
+    future<> allocate(uint64_t, uint64_t) override {
+        return make_ready_future<>();
+    }
+    future<uint64_t> size() override {
+        return make_ready_future<uint64_t>(_data->data.size());
+    }
+    future<> close() override {
+        return make_ready_future<>();
+    }
+    subscription<directory_entry> list_directory(std::function<future<> (directory_entry de)>) override {
+        throw std::system_error(ENOTDIR, std::system_category());
+    }
+    future<temporary_buffer<uint8_t>> dma_read_bulk(uint64_t offset, size_t range_size, const io_priority_class&) override {
+        auto buf = temporary_buffer<uint8_t>::aligned(_memory_dma_alignment, range_size);
+        auto len = read(offset, buf.get_write(), range_size);
+        buf.trim(len);
+        return complete(_sim._disk.read, _sim._disk_read_free, len).then([buf = std::move(buf)] (size_t) mutable {
+            return std::move(buf);
+        });
+    }
+};
+
+simulation::simulation(uint64_t seed, latency_model network, disk_model disk)
+    : _seed(seed)
+    , _rng(seed)
+    , _network(network)
+    , _disk(disk)
+    , _disk_read_free(manual_clock::now())
+    , _disk_write_free(_disk_read_free)
+{ }
+
+simulation::~simulation() = default;
+
+manual_clock::duration simulation::extra_latency(const latency_model& m) {
+    auto d = m.latency;
+    if (m.jitter.count() > 0) {
+        d += manual_clock::duration(_rng() % uint64_t(m.jitter.count()));
+    }
+    if (m.tail_probability > 0 && double(_rng() >> 11) * 0x1.0p-53 < m.tail_probability) {
+        d += m.tail_latency;
+    }
+    return d;
+}
+
+manual_clock::time_point simulation::schedule(const latency_model& m, manual_clock::time_point& free, size_t bytes) {
+    auto start = std::max(manual_clock::now(), free);
+    free = start;
+    if (m.bandwidth) {
+        free += manual_clock::duration(int64_t(double(bytes) * 1e9 / m.bandwidth));
+    }
+    return free + extra_latency(m);
+}
+
+future<> simulation::run(future<> f) {
+    return do_with(std::move(f), [] (future<>& f) {
+        return repeat([&f] {
+            if (f.available()) {
+                return make_ready_future<stop_iteration>(stop_iteration::yes);
+            }
+            if (!manual_clock::advance_to_next_timer()) {
+                return make_exception_future<stop_iteration>(std::runtime_error("simulation stalled: no task to run and no timer to wait for"));
+            }
+            return yield().then([] {
+                return stop_iteration::no;
+            });
+        }).then([&f] {
+            return std::move(f);
+        });
+    });
+}
+
+std::pair<connected_socket, connected_socket> simulation::make_connection() {
+    auto a = make_lw_shared<channel>(*this);
+    auto b = make_lw_shared<channel>(*this);
+    return {connected_socket(std::make_unique<sim_socket>(a, b)), connected_socket(std::make_unique<sim_socket>(b, a))};
+}
+
+server_socket simulation::listen(socket_address addr) {
+    auto [it, inserted] = _listeners.try_emplace(addr, make_lw_shared<queue<connected_socket>>(128));
+    if (!inserted) {
+        throw std::system_error(EADDRINUSE, std::system_category());
+    }
+    return server_socket(std::make_unique<sim_server_socket>(*this, addr, it->second));
+}
+
+future<connected_socket> simulation::connect(socket_address addr) {
+    auto [client, server] = make_connection();
+    auto there = manual_clock::now() + extra_latency(_network);
+    return sleep_until(there).then([this, addr, server = std::move(server)] () mutable {
+        auto it = _listeners.find(addr);
+        if (it == _listeners.end()) {
+            return make_exception_future<>(std::system_error(ECONNREFUSED, std::system_category()));
+        }
+        return it->second->push_eventually(std::move(server));
+    }).then([this, client = std::move(client)] () mutable {
+        return sleep_until(manual_clock::now() + extra_latency(_network)).then([client = std::move(client)] () mutable {
+            return std::move(client);
+        });
+    });
+}
+
+file simulation::open_file(sstring name) {
+    auto& data = _files[name];
+    if (!data) {
+        data = make_lw_shared<file_data>();
+    }
+    return file(make_shared<sim_file>(*this, data));
+}
+
+}
+
+}
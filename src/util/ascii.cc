@@ -0,0 +1,147 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#include <seastar/util/ascii.hh>
+#include <seastar/core/bitops.hh>
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace seastar {
+
+// Lower case of the eight bytes of a word, with no branches: the high bit
+// of each byte ends up telling whether it is an ASCII upper case letter,
+// and shifted down to 0x20, it is what makes it lower case.
+static inline uint64_t ascii_tolower8(uint64_t x) noexcept {
+    constexpr uint64_t ones = 0x0101010101010101ull;
+    constexpr uint64_t high = 0x8080808080808080ull;
+    uint64_t low7 = x & ~high;
+    uint64_t ge_a = low7 + (0x80 - 'A') * ones;
+    uint64_t gt_z = low7 + (0x7f - 'Z') * ones;
+    uint64_t upper = ge_a & ~gt_z & ~x & high;
+    return x | (upper >> 2);
+}
+
+static inline uint64_t load8(const char* p, size_t n) noexcept {
+    uint64_t x = 0;
+    std::memcpy(&x, p, n);
+    return x;
+}
+
+#ifdef __SSE2__
+static inline __m128i ascii_tolower16(__m128i v) noexcept {
+    // Signed compares, so bytes past ASCII are never letters
+    __m128i ge_a = _mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1));
+    __m128i le_z = _mm_cmplt_epi8(v, _mm_set1_epi8('Z' + 1));
+    return _mm_or_si128(v, _mm_and_si128(_mm_and_si128(ge_a, le_z), _mm_set1_epi8(0x20)));
+}
+#endif
+
+bool ascii_iequals(std::string_view a, std::string_view b) noexcept {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    auto pa = a.data();
+    auto pb = b.data();
+    size_t n = a.size();
+    size_t i = 0;
+#ifdef __SSE2__
+    for (; i + 16 <= n; i += 16) {
+        __m128i va = ascii_tolower16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pa + i)));
+        __m128i vb = ascii_tolower16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pb + i)));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)) != 0xffff) {
+            return false;
+        }
+    }
+#endif
+    for (; i + 8 <= n; i += 8) {
+        if (ascii_tolower8(load8(pa + i, 8)) != ascii_tolower8(load8(pb + i, 8))) {
+            return false;
+        }
+    }
+    return i == n || ascii_tolower8(load8(pa + i, n - i)) == ascii_tolower8(load8(pb + i, n - i));
+}
+
+size_t ascii_ihash(std::string_view s) noexcept {
+    // A word at a time, mixed in by multiplication, and the length in the
+    // seed, as the last word is padded with zeros
+    constexpr uint64_t k = 0x9e3779b97f4a7c15ull;
+    uint64_t h = s.size() * k;
+    auto p = s.data();
+    size_t n = s.size();
+    size_t i = 0;
+    auto mix = [&h] (uint64_t w) {
+        h = (h ^ w) * k;
+        h ^= h >> 32;
+    };
+    for (; i + 8 <= n; i += 8) {
+        mix(ascii_tolower8(load8(p + i, 8)));
+    }
+    if (i != n) {
+        mix(ascii_tolower8(load8(p + i, n - i)));
+    }
+    return h;
+}
+
+size_t ascii_find_first_of(std::string_view s, std::string_view chars, size_t pos) noexcept {
+    if (pos >= s.size() || chars.empty()) {
+        return std::string_view::npos;
+    }
+    if (chars.size() == 1) {
+        auto p = static_cast<const char*>(std::memchr(s.data() + pos, chars[0], s.size() - pos));
+        return p ? p - s.data() : std::string_view::npos;
+    }
+    size_t i = pos;
+#ifdef __SSE2__
+    // A compare per character of the set; past a few, the table below wins
+    if (chars.size() <= 4) {
+        __m128i set[4];
+        for (size_t c = 0; c < 4; c++) {
+            set[c] = _mm_set1_epi8(chars[std::min(c, chars.size() - 1)]);
+        }
+        for (; i + 16 <= s.size(); i += 16) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s.data() + i));
+            __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, set[0]), _mm_cmpeq_epi8(v, set[1])),
+                                     _mm_or_si128(_mm_cmpeq_epi8(v, set[2]), _mm_cmpeq_epi8(v, set[3])));
+            unsigned mask = _mm_movemask_epi8(m);
+            if (mask) {
+                return i + count_trailing_zeros(mask);
+            }
+        }
+    }
+#endif
+    std::array<bool, 256> table{};
+    for (unsigned char c : chars) {
+        table[c] = true;
+    }
+    for (; i < s.size(); ++i) {
+        if (table[static_cast<unsigned char>(s[i])]) {
+            return i;
+        }
+    }
+    return std::string_view::npos;
+}
+
+}
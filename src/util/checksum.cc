@@ -0,0 +1,322 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#include <seastar/util/checksum.hh>
+#include <seastar/core/byteorder.hh>
+#include <array>
+#include <cstring>
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
+namespace seastar {
+
+namespace internal {
+
+// Reflected
+static constexpr uint32_t crc32c_poly = 0x82f63b78;
+
+// Table k continues the register over a byte followed by k zero bytes
+static constexpr std::array<std::array<uint32_t, 256>, 8> crc32c_tables = [] {
+    std::array<std::array<uint32_t, 256>, 8> t{};
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) {
+            c = c & 1 ? (c >> 1) ^ crc32c_poly : c >> 1;
+        }
+        t[0][i] = c;
+    }
+    for (int k = 1; k < 8; k++) {
+        for (uint32_t i = 0; i < 256; i++) {
+            t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xff];
+        }
+    }
+    return t;
+}();
+
+static inline uint64_t load64(const char* p) noexcept {
+    uint64_t v;
+    std::memcpy(&v, p, 8);
+    return v;
+}
+
+static uint32_t crc32c_table(uint32_t crc, const char* p, size_t n) noexcept {
+    auto& t = crc32c_tables;
+    for (; n >= 8; p += 8, n -= 8) {
+        auto v = le_to_cpu(load64(p)) ^ crc;
+        crc = t[7][v & 0xff] ^ t[6][(v >> 8) & 0xff] ^ t[5][(v >> 16) & 0xff] ^ t[4][(v >> 24) & 0xff]
+            ^ t[3][(v >> 32) & 0xff] ^ t[2][(v >> 40) & 0xff] ^ t[1][(v >> 48) & 0xff] ^ t[0][v >> 56];
+    }
+    while (n--) {
+        crc = t[0][(crc ^ uint8_t(*p++)) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+// a(x) * b(x) modulo the polynomial, in the reflected representation
+static uint32_t crc32c_multiply(uint32_t a, uint32_t b) noexcept {
+    uint32_t m = uint32_t(1) << 31;
+    uint32_t p = 0;
+    for (; m; m >>= 1) {
+        if (a & m) {
+            p ^= b;
+        }
+        b = b & 1 ? (b >> 1) ^ crc32c_poly : b >> 1;
+    }
+    return p;
+}
+
+// x^(8 * n) modulo the polynomial, which shifts a register over n zero bytes
+static uint32_t crc32c_shift_of(size_t n) noexcept {
+    // x^1, squared to x^8
+    uint32_t sq = uint32_t(1) << 30;
+    for (int i = 0; i < 3; i++) {
+        sq = crc32c_multiply(sq, sq);
+    }
+    uint32_t p = uint32_t(1) << 31;
+    for (; n; n >>= 1) {
+        if (n & 1) {
+            p = crc32c_multiply(sq, p);
+        }
+        sq = crc32c_multiply(sq, sq);
+    }
+    return p;
+}
+
+// Length of each of the three streams of the interleaved kernel; the
+// three CRC instructions in flight hide the latency of each
+static constexpr size_t interleave_stride = 4096;
+
+#if defined(__x86_64__)
+
+#define SEASTAR_CRC32C_TARGET __attribute__((target("sse4.2")))
+
+SEASTAR_CRC32C_TARGET
+static inline uint64_t crc32c_u64(uint64_t crc, uint64_t v) noexcept {
+    return _mm_crc32_u64(crc, v);
+}
+
+SEASTAR_CRC32C_TARGET
+static inline uint32_t crc32c_u8(uint32_t crc, uint8_t v) noexcept {
+    return _mm_crc32_u8(crc, v);
+}
+
+bool crc32c_hardware_available() noexcept {
+    static const bool available = __builtin_cpu_supports("sse4.2");
+    return available;
+}
+
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+
+#define SEASTAR_CRC32C_TARGET
+
+static inline uint64_t crc32c_u64(uint64_t crc, uint64_t v) noexcept {
+    return __crc32cd(crc, v);
+}
+
+static inline uint32_t crc32c_u8(uint32_t crc, uint8_t v) noexcept {
+    return __crc32cb(crc, v);
+}
+
+bool crc32c_hardware_available() noexcept {
+    return true;
+}
+
+#else
+
+#define SEASTAR_CRC32C_NO_HARDWARE
+
+bool crc32c_hardware_available() noexcept {
+    return false;
+}
+
+#endif
+
+#ifndef SEASTAR_CRC32C_NO_HARDWARE
+
+SEASTAR_CRC32C_TARGET
+static uint32_t crc32c_hardware(uint32_t crc, const char* p, size_t n) noexcept {
+    uint64_t c = crc;
+    for (; n >= 8; p += 8, n -= 8) {
+        c = crc32c_u64(c, le_to_cpu(load64(p)));
+    }
+    crc = c;
+    while (n--) {
+        crc = crc32c_u8(crc, *p++);
+    }
+    return crc;
+}
+
+SEASTAR_CRC32C_TARGET
+static uint32_t crc32c_interleaved(uint32_t crc, const char* p, size_t n) noexcept {
+    static const uint32_t shift = crc32c_shift_of(interleave_stride);
+    constexpr size_t s = interleave_stride;
+    for (; n >= 3 * s; p += 3 * s, n -= 3 * s) {
+        uint64_t a = crc;
+        uint64_t b = 0;
+        uint64_t c = 0;
+        for (size_t i = 0; i < s; i += 8) {
+            a = crc32c_u64(a, le_to_cpu(load64(p + i)));
+            b = crc32c_u64(b, le_to_cpu(load64(p + s + i)));
+            c = crc32c_u64(c, le_to_cpu(load64(p + 2 * s + i)));
+        }
+        // The register over the three streams, each continuing from zero
+        // but the first: shift the earlier ones over those after them
+        crc = crc32c_multiply(shift, crc32c_multiply(shift, a) ^ b) ^ c;
+    }
+    return crc32c_hardware(crc, p, n);
+}
+
+#else
+
+static uint32_t crc32c_hardware(uint32_t crc, const char* p, size_t n) noexcept {
+    return crc32c_table(crc, p, n);
+}
+
+static uint32_t crc32c_interleaved(uint32_t crc, const char* p, size_t n) noexcept {
+    return crc32c_table(crc, p, n);
+}
+
+#endif
+
+uint32_t crc32c_update(uint32_t crc, const char* data, size_t len, crc32c_kernel k) noexcept {
+    if (k == crc32c_kernel::best) {
+        k = !crc32c_hardware_available() ? crc32c_kernel::table
+            : len >= 3 * interleave_stride ? crc32c_kernel::interleaved : crc32c_kernel::hardware;
+    }
+    switch (k) {
+    case crc32c_kernel::hardware:
+        return crc32c_hardware(crc, data, len);
+    case crc32c_kernel::interleaved:
+        return crc32c_interleaved(crc, data, len);
+    default:
+        return crc32c_table(crc, data, len);
+    }
+}
+
+}
+
+uint32_t crc32c::combine(uint32_t crc1, uint32_t crc2, size_t len2) noexcept {
+    // The inversions before and after each piece cancel out
+    return internal::crc32c_multiply(internal::crc32c_shift_of(len2), crc1) ^ crc2;
+}
+
+static constexpr uint64_t xxh_prime1 = 0x9e3779b185ebca87ull;
+static constexpr uint64_t xxh_prime2 = 0xc2b2ae3d27d4eb4full;
+static constexpr uint64_t xxh_prime3 = 0x165667b19e3779f9ull;
+static constexpr uint64_t xxh_prime4 = 0x85ebca77c2b2ae63ull;
+static constexpr uint64_t xxh_prime5 = 0x27d4eb2f165667c5ull;
+
+static inline uint64_t rotl64(uint64_t x, int r) noexcept {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t xxh_round(uint64_t acc, uint64_t input) noexcept {
+    acc += input * xxh_prime2;
+    acc = rotl64(acc, 31);
+    return acc * xxh_prime1;
+}
+
+static inline uint64_t xxh_merge_round(uint64_t acc, uint64_t v) noexcept {
+    acc ^= xxh_round(0, v);
+    return acc * xxh_prime1 + xxh_prime4;
+}
+
+static inline void xxh_stripe(uint64_t* acc, const char* p) noexcept {
+    for (int i = 0; i < 4; i++) {
+        acc[i] = xxh_round(acc[i], le_to_cpu(internal::load64(p + 8 * i)));
+    }
+}
+
+// Hashes the tail, shorter than a stripe, into h, and mixes it
+static uint64_t xxh_finish(uint64_t h, const char* p, size_t n) noexcept {
+    for (; n >= 8; p += 8, n -= 8) {
+        h ^= xxh_round(0, le_to_cpu(internal::load64(p)));
+        h = rotl64(h, 27) * xxh_prime1 + xxh_prime4;
+    }
+    if (n >= 4) {
+        uint32_t v;
+        std::memcpy(&v, p, 4);
+        h ^= uint64_t(le_to_cpu(v)) * xxh_prime1;
+        h = rotl64(h, 23) * xxh_prime2 + xxh_prime3;
+        p += 4;
+        n -= 4;
+    }
+    while (n--) {
+        h ^= uint8_t(*p++) * xxh_prime5;
+        h = rotl64(h, 11) * xxh_prime1;
+    }
+    h ^= h >> 33;
+    h *= xxh_prime2;
+    h ^= h >> 29;
+    h *= xxh_prime3;
+    h ^= h >> 32;
+    return h;
+}
+
+xxhash64::xxhash64(uint64_t seed) noexcept
+        : _acc{seed + xxh_prime1 + xxh_prime2, seed + xxh_prime2, seed, seed - xxh_prime1}
+        , _seed(seed)
+{ }
+
+void xxhash64::update(const char* data, size_t len) noexcept {
+    _total += len;
+    if (_buffered) {
+        auto n = std::min(len, sizeof(_buf) - _buffered);
+        std::memcpy(_buf + _buffered, data, n);
+        _buffered += n;
+        data += n;
+        len -= n;
+        if (_buffered < sizeof(_buf)) {
+            return;
+        }
+        xxh_stripe(_acc, _buf);
+        _buffered = 0;
+    }
+    for (; len >= 32; data += 32, len -= 32) {
+        xxh_stripe(_acc, data);
+    }
+    std::memcpy(_buf, data, len);
+    _buffered = len;
+}
+
+uint64_t xxhash64::digest() const noexcept {
+    uint64_t h;
+    if (_total >= 32) {
+        h = rotl64(_acc[0], 1) + rotl64(_acc[1], 7) + rotl64(_acc[2], 12) + rotl64(_acc[3], 18);
+        for (auto a : _acc) {
+            h = xxh_merge_round(h, a);
+        }
+    } else {
+        h = _seed + xxh_prime5;
+    }
+    return xxh_finish(h + _total, _buf, _buffered);
+}
+
+uint64_t xxhash64::of(const char* data, size_t len, uint64_t seed) noexcept {
+    xxhash64 h(seed);
+    h.update(data, len);
+    return h.digest();
+}
+
+}
@@ -23,10 +23,14 @@
 #include <iostream>
 #include <list>
 #include <deque>
+#include <stdexcept>
 
 #include <seastar/core/reactor.hh>
 #include <seastar/core/seastar.hh>
+#include <seastar/core/align.hh>
+#include <seastar/core/when_all.hh>
 #include <seastar/util/file.hh>
+#include "core/file-impl.hh"
 
 namespace seastar {
 
@@ -201,6 +205,96 @@ future<> recursive_remove_directory(fs::path path) noexcept {
     });
 }
 
+static future<> stream_copy(file& src, uint64_t src_pos, file& dst, uint64_t dst_pos, uint64_t len, const io_priority_class& pc) {
+    auto align = dst.disk_write_dma_alignment();
+    if (dst_pos % align) {
+        return make_exception_future<>(std::invalid_argument(format("copy_file: destination position {} not aligned to {}", dst_pos, align)));
+    }
+    static constexpr size_t chunk = 128 << 10;
+    struct state {
+        uint64_t copied = 0;
+        uint64_t dst_size;
+        temporary_buffer<char> buf;
+    };
+    return dst.size().then([&src, src_pos, &dst, dst_pos, len, &pc, align] (uint64_t dst_size) {
+        auto buf = temporary_buffer<char>::aligned(dst.memory_dma_alignment(), chunk);
+        return do_with(state{0, dst_size, std::move(buf)}, [&src, src_pos, &dst, dst_pos, len, &pc, align] (state& st) {
+            return repeat([&src, src_pos, &dst, dst_pos, len, &pc, align, &st] {
+                if (st.copied == len) {
+                    return make_ready_future<stop_iteration>(stop_iteration::yes);
+                }
+                auto n = std::min<uint64_t>(chunk, len - st.copied);
+                return src.dma_read<char>(src_pos + st.copied, n, pc).then([&dst, dst_pos, &pc, align, &st, n] (temporary_buffer<char> data) {
+                    if (data.empty()) {
+                        return make_ready_future<stop_iteration>(stop_iteration::yes);
+                    }
+                    auto pos = dst_pos + st.copied;
+                    auto padded = align_up<uint64_t>(data.size(), align);
+                    // An unaligned tail keeps the data of dst which follows it
+                    auto tail = padded == data.size() || pos + padded > st.dst_size
+                            ? make_ready_future<>()
+                            : dst.dma_read(pos + padded - align, st.buf.get_write() + padded - align, align, pc).discard_result();
+                    return tail.then([&dst, &pc, &st, data = std::move(data), pos, padded, n] {
+                        if (pos + padded > st.dst_size) {
+                            std::fill(st.buf.get_write() + data.size(), st.buf.get_write() + padded, 0);
+                        }
+                        std::copy(data.begin(), data.end(), st.buf.get_write());
+                        return dst.dma_write(pos, st.buf.get(), padded, pc).then([&st, size = data.size(), n] (size_t) {
+                            st.copied += size;
+                            return stop_iteration(size < n);
+                        });
+                    });
+                });
+            }).then([&dst, dst_pos, align, &st] {
+                auto end = dst_pos + st.copied;
+                if (end % align == 0 || align_up(end, uint64_t(align)) <= st.dst_size) {
+                    return make_ready_future<>();
+                }
+                // Drop the padding written past the range
+                return dst.truncate(std::max(end, st.dst_size));
+            });
+        });
+    });
+}
+
+future<copy_file_method> copy_file(file& src, uint64_t src_pos, file& dst, uint64_t dst_pos, uint64_t len, const io_priority_class& pc) noexcept {
+    auto src_fd = posix_file_impl::fd_of(src);
+    auto dst_fd = posix_file_impl::fd_of(dst);
+    auto in_kernel = src_fd != -1 && dst_fd != -1
+            ? posix_file_impl::copy_in_kernel(src_fd, src_pos, dst_fd, dst_pos, len)
+            : make_ready_future<posix_file_impl::kernel_copy_result>(posix_file_impl::kernel_copy_result{0, false});
+    return in_kernel.then([&src, src_pos, &dst, dst_pos, len, &pc] (posix_file_impl::kernel_copy_result r) {
+        if (r.cloned) {
+            return make_ready_future<copy_file_method>(copy_file_method::clone);
+        }
+        auto method = r.copied ? copy_file_method::copy_range : copy_file_method::stream;
+        if (r.copied == len) {
+            return make_ready_future<copy_file_method>(method);
+        }
+        return stream_copy(src, src_pos + r.copied, dst, dst_pos + r.copied, len - r.copied, pc).then([method] {
+            return method;
+        });
+    });
+}
+
+future<copy_file_method> copy_file(std::string_view src, std::string_view dst, const io_priority_class& pc) noexcept {
+    return open_file_dma(src, open_flags::ro).then([dst = sstring(dst), &pc] (file src) {
+        return open_file_dma(dst, open_flags::wo | open_flags::create | open_flags::truncate).then([src = std::move(src), &pc] (file dst) mutable {
+            return do_with(std::move(src), std::move(dst), [&pc] (file& src, file& dst) {
+                return src.size().then([&src, &dst, &pc] (uint64_t size) {
+                    return copy_file(src, 0, dst, 0, size, pc);
+                }).then([&dst] (copy_file_method method) {
+                    return dst.flush().then([method] {
+                        return method;
+                    });
+                }).finally([&src, &dst] {
+                    return when_all_succeed(src.close(), dst.close()).discard_result();
+                });
+            });
+        });
+    });
+}
+
 namespace util {
 
 future<std::vector<temporary_buffer<char>>> read_entire_file(std::filesystem::path path) {
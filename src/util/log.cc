@@ -24,6 +24,9 @@
 #if FMT_VERSION >= 60000
 #include <fmt/chrono.h>
 #include <fmt/color.h>
+#if FMT_VERSION >= 80000
+#include <fmt/args.h>
+#endif
 #elif FMT_VERSION >= 50000
 #include <fmt/time.h>
 #endif
@@ -51,6 +54,8 @@
 #include <system_error>
 #include <chrono>
 #include <algorithm>
+#include <semaphore>
+#include <thread>
 
 #include "core/program_options.hh"
 
@@ -219,23 +224,41 @@ std::ostream& operator<<(std::ostream& os, logger_ostream_type lot) {
     return os;
 }
 
-static internal::log_buf::inserter_iterator print_no_timestamp(internal::log_buf::inserter_iterator it) {
+// The timestamp of a message is taken when it is logged, and printed when it
+// is formatted, which may be later, on the async log thread.
+struct timestamp_style {
+    int64_t (*capture)() noexcept;
+    internal::log_buf::inserter_iterator (*print)(internal::log_buf::inserter_iterator, int64_t);
+};
+
+static int64_t capture_no_timestamp() noexcept {
+    return 0;
+}
+
+static internal::log_buf::inserter_iterator print_no_timestamp(internal::log_buf::inserter_iterator it, int64_t) {
     return it;
 }
 
-static internal::log_buf::inserter_iterator print_boot_timestamp(internal::log_buf::inserter_iterator it) {
-    auto n = std::chrono::steady_clock::now().time_since_epoch() / 1us;
+static int64_t capture_boot_timestamp() noexcept {
+    return std::chrono::steady_clock::now().time_since_epoch() / 1us;
+}
+
+static internal::log_buf::inserter_iterator print_boot_timestamp(internal::log_buf::inserter_iterator it, int64_t n) {
     return fmt::format_to(it, "{:10d}.{:06d}", n / 1000000, n % 1000000);
 }
 
-static internal::log_buf::inserter_iterator print_real_timestamp(internal::log_buf::inserter_iterator it) {
+static int64_t capture_real_timestamp() noexcept {
+    return std::chrono::system_clock::now().time_since_epoch().count();
+}
+
+static internal::log_buf::inserter_iterator print_real_timestamp(internal::log_buf::inserter_iterator it, int64_t ts) {
     struct a_second {
         time_t t;
         std::string s;
     };
     static thread_local a_second this_second;
     using clock = std::chrono::system_clock;
-    auto n = clock::now();
+    auto n = clock::time_point(clock::duration(ts));
     auto t = clock::to_time_t(n);
     if (this_second.t != t) {
         this_second.s = fmt::format("{:%Y-%m-%d %T}", fmt::localtime(t));
@@ -245,7 +268,11 @@ static internal::log_buf::inserter_iterator print_real_timestamp(internal::log_b
     return fmt::format_to(it, "{},{:03d}", this_second.s, ms);
 }
 
-static internal::log_buf::inserter_iterator (*print_timestamp)(internal::log_buf::inserter_iterator) = print_no_timestamp;
+static const timestamp_style no_timestamp{capture_no_timestamp, print_no_timestamp};
+static const timestamp_style boot_timestamp{capture_boot_timestamp, print_boot_timestamp};
+static const timestamp_style real_timestamp{capture_real_timestamp, print_real_timestamp};
+
+static const timestamp_style* log_timestamp = &no_timestamp;
 
 const std::map<log_level, sstring> log_level_names = {
         { log_level::trace, "trace" },
@@ -278,6 +305,7 @@ std::istream& operator>>(std::istream& in, log_level& level) {
 std::ostream* logger::_out = &std::cerr;
 std::atomic<bool> logger::_ostream = { true };
 std::atomic<bool> logger::_syslog = { false };
+std::atomic<bool> logger::_deferred = { false };
 unsigned logger::_shard_field_width = 1;
 
 logger::logger(sstring name) : _name(std::move(name)) {
@@ -294,6 +322,348 @@ logger::~logger() {
 
 static thread_local std::array<char, 8192> static_log_buf;
 
+static int syslog_level(log_level level) {
+    static array_map<int, 20> level_map = {
+            { int(log_level::debug), LOG_DEBUG },
+            { int(log_level::info), LOG_INFO },
+            { int(log_level::trace), LOG_DEBUG },  // no LOG_TRACE
+            { int(log_level::warn), LOG_WARNING },
+            { int(log_level::error), LOG_ERR },
+    };
+    return level_map[int(level)];
+}
+
+namespace {
+
+enum class log_destination : uint8_t {
+    padding,
+    ostream,
+    syslog,
+    // A deferred_record, to format
+    deferred,
+};
+
+// A message with its formatting deferred to the log thread, followed by
+// the name of the logger, the format string, and the arguments, as
+// serialized by internal::log_arg_encoder
+struct deferred_record {
+    int64_t timestamp;
+    // -1 outside of a reactor
+    int32_t shard;
+    log_level level;
+    bool to_ostream;
+    bool to_syslog;
+    uint32_t name_size;
+    uint32_t format_size;
+};
+
+// Formatted records of one thread, on their way to the thread which writes
+// them out: a single producer, single consumer ring of variable-sized
+// records.
+class log_ring {
+    struct header {
+        // Of the whole record, aligned
+        uint32_t size;
+        uint32_t length;
+        log_destination dest;
+        uint8_t level;
+    };
+    // Leaves room for a padding header at the end of the buffer
+    static constexpr size_t alignment = 16;
+    static_assert(sizeof(header) <= alignment);
+
+    std::unique_ptr<char[]> _buf;
+    size_t _capacity;
+    // Bytes written, and bytes consumed, since the start
+    alignas(cache_line_size) std::atomic<size_t> _head = { 0 };
+    alignas(cache_line_size) std::atomic<size_t> _tail = { 0 };
+public:
+    std::atomic<uint64_t> dropped = { 0 };
+    // Consumer only
+    uint64_t reported_dropped = 0;
+    // Set when the producing thread exits
+    std::atomic<bool> orphaned = { false };
+
+    explicit log_ring(size_t capacity)
+        : _buf(new char[capacity])
+        , _capacity(capacity) {
+    }
+
+    // The longest message which fits; longer ones are truncated
+    static size_t max_message_size(size_t capacity) noexcept {
+        return capacity / 4 - sizeof(header);
+    }
+
+    // Returns the position past the record, or 0 if there was no room
+    size_t push(log_destination dest, int level, std::string_view msg) noexcept {
+        msg = msg.substr(0, max_message_size(_capacity));
+        auto head = _head.load(std::memory_order_relaxed);
+        auto size = align_up(sizeof(header) + msg.size(), alignment);
+        auto offset = head % _capacity;
+        auto padding = _capacity - offset < size ? _capacity - offset : 0;
+        if (head + padding + size - _tail.load(std::memory_order_acquire) > _capacity) {
+            return 0;
+        }
+        if (padding) {
+            new (&_buf[offset]) header{uint32_t(padding), 0, log_destination::padding, 0};
+            offset = 0;
+        }
+        new (&_buf[offset]) header{uint32_t(size), uint32_t(msg.size()), dest, uint8_t(level)};
+        std::copy(msg.begin(), msg.end(), &_buf[offset + sizeof(header)]);
+        head += padding + size;
+        _head.store(head, std::memory_order_release);
+        return head;
+    }
+
+    // Calls func(dest, level, msg) for the records written so far, freeing
+    // each one as soon as func returns
+    template <typename Func>
+    bool consume(Func&& func) {
+        auto tail = _tail.load(std::memory_order_relaxed);
+        auto head = _head.load(std::memory_order_acquire);
+        if (tail == head) {
+            return false;
+        }
+        while (tail != head) {
+            auto offset = tail % _capacity;
+            header h;
+            std::memcpy(&h, &_buf[offset], sizeof(h));
+            if (h.dest != log_destination::padding) {
+                auto data = &_buf[offset + sizeof(header)];
+                func(h.dest, h.level, std::string_view(data, h.length));
+            }
+            tail += h.size;
+            _tail.store(tail, std::memory_order_release);
+        }
+        return true;
+    }
+
+    bool consumed(size_t pos) const noexcept {
+        return _tail.load(std::memory_order_acquire) >= pos;
+    }
+
+    bool empty() const noexcept {
+        return _tail.load(std::memory_order_acquire) == _head.load(std::memory_order_acquire);
+    }
+};
+
+}
+
+// Writes log messages from a thread of its own, so that a slow terminal,
+// pipe or syslog daemon does not stall the threads which log.
+class async_log_sink {
+    // The records are written with line terminators, and \0 is not needed
+    // for syslog(), which is given the length
+    size_t _ring_size;
+    std::mutex _rings_mutex;
+    std::vector<std::shared_ptr<log_ring>> _rings;
+    std::atomic<bool> _wakeup_pending = { false };
+    std::binary_semaphore _wakeup{0};
+    std::atomic<bool> _stopping = { false };
+    std::thread _thread;
+
+    // Tells apart the sinks of successive set_async_enabled() calls
+    static inline std::atomic<uint64_t> _last_id = { 0 };
+    uint64_t _id = ++_last_id;
+
+    struct ring_holder {
+        std::shared_ptr<log_ring> ring;
+        uint64_t sink_id = 0;
+        ~ring_holder() {
+            if (ring) {
+                ring->orphaned.store(true, std::memory_order_relaxed);
+            }
+        }
+    };
+    static thread_local ring_holder _local;
+
+    log_ring& local_ring() {
+        if (_local.sink_id != _id) {
+            auto ring = std::make_shared<log_ring>(_ring_size);
+            std::lock_guard<std::mutex> g(_rings_mutex);
+            _rings.push_back(ring);
+            _local.ring = std::move(ring);
+            _local.sink_id = _id;
+        }
+        return *_local.ring;
+    }
+
+    void wake() noexcept {
+        if (!_wakeup_pending.exchange(true, std::memory_order_acq_rel)) {
+            _wakeup.release();
+        }
+    }
+
+    static void write(log_destination dest, int level, std::string_view msg) {
+        if (dest == log_destination::ostream) {
+            logger::_out->write(msg.data(), msg.size());
+        } else if (dest == log_destination::syslog) {
+            syslog(level, "%.*s", int(msg.size()), msg.data());
+        } else {
+            write_deferred(msg);
+        }
+    }
+
+#if FMT_VERSION >= 80000
+    static internal::log_buf::inserter_iterator format_args(internal::log_buf::inserter_iterator it,
+            std::string_view format, std::string_view args) {
+        fmt::dynamic_format_arg_store<fmt::format_context> store;
+        auto p = args.data();
+        auto end = p + args.size();
+        auto get = [&p] <typename T> (T& v) {
+            std::memcpy(&v, p, sizeof(v));
+            p += sizeof(v);
+        };
+        while (p != end) {
+            internal::log_arg_type type;
+            get(type);
+            switch (type) {
+            case internal::log_arg_type::i64: { int64_t v; get(v); store.push_back(v); break; }
+            case internal::log_arg_type::u64: { uint64_t v; get(v); store.push_back(v); break; }
+            case internal::log_arg_type::f32: { float v; get(v); store.push_back(v); break; }
+            case internal::log_arg_type::f64: { double v; get(v); store.push_back(v); break; }
+            case internal::log_arg_type::boolean: { bool v; get(v); store.push_back(v); break; }
+            case internal::log_arg_type::character: { char v; get(v); store.push_back(v); break; }
+            case internal::log_arg_type::pointer: { const void* v; get(v); store.push_back(v); break; }
+            case internal::log_arg_type::string: {
+                uint32_t len;
+                get(len);
+                // Not copied by the store
+                store.push_back(std::string_view(p, len));
+                p += len;
+                break;
+            }
+            }
+        }
+        return fmt::vformat_to(it, fmt::string_view(format.data(), format.size()), store);
+    }
+#endif
+
+    static void write_deferred(std::string_view msg) {
+#if FMT_VERSION >= 80000
+        deferred_record r;
+        std::memcpy(&r, msg.data(), sizeof(r));
+        auto name = msg.substr(sizeof(r), r.name_size);
+        auto format = msg.substr(sizeof(r) + r.name_size, r.format_size);
+        auto args = msg.substr(sizeof(r) + r.name_size + r.format_size);
+        auto print_once = [&] (internal::log_buf::inserter_iterator it) {
+            if (r.shard >= 0) {
+                it = fmt::format_to(it, " [shard {:{}}]", r.shard, logger::_shard_field_width);
+            }
+            it = fmt::format_to(it, " {} - ", name);
+            try {
+                return format_args(it, format, args);
+            } catch (...) {
+                return fmt::format_to(it, "failed to log message: fmt='{}': {}", format, std::current_exception());
+            }
+        };
+        if (r.to_ostream) {
+            internal::log_buf buf(static_log_buf.data(), static_log_buf.size());
+            auto it = buf.back_insert_begin();
+            it = fmt::format_to(it, "{} ", wrapped_log_level{r.level});
+            it = log_timestamp->print(it, r.timestamp);
+            it = print_once(it);
+            *it++ = '\n';
+            write(log_destination::ostream, 0, buf.view());
+        }
+        if (r.to_syslog) {
+            internal::log_buf buf(static_log_buf.data(), static_log_buf.size());
+            auto it = buf.back_insert_begin();
+            it = print_once(it);
+            write(log_destination::syslog, syslog_level(r.level), buf.view());
+        }
+#endif
+    }
+
+    bool drain() {
+        std::vector<std::shared_ptr<log_ring>> rings;
+        {
+            std::lock_guard<std::mutex> g(_rings_mutex);
+            std::erase_if(_rings, [] (auto& r) {
+                return r->orphaned.load(std::memory_order_relaxed) && r->empty();
+            });
+            rings = _rings;
+        }
+        bool any = false;
+        for (auto& r : rings) {
+            any |= r->consume(write);
+            auto dropped = r->dropped.load(std::memory_order_relaxed);
+            if (dropped != r->reported_dropped) {
+                auto msg = fmt::format("WARN  dropped {} log messages: the log sink is too slow\n", dropped - r->reported_dropped);
+                write(log_destination::ostream, 0, msg);
+                r->reported_dropped = dropped;
+                any = true;
+            }
+        }
+        if (any) {
+            logger::_out->flush();
+        }
+        return any;
+    }
+
+    void run() {
+        while (!_stopping.load(std::memory_order_relaxed)) {
+            _wakeup.acquire();
+            _wakeup_pending.store(false, std::memory_order_release);
+            while (drain()) {
+            }
+        }
+        drain();
+    }
+public:
+    explicit async_log_sink(size_t ring_size)
+        : _ring_size(std::max<size_t>(align_up<size_t>(ring_size, cache_line_size), 4096))
+        , _thread([this] { run(); }) {
+    }
+
+    ~async_log_sink() {
+        _stopping.store(true, std::memory_order_relaxed);
+        _wakeup.release();
+        _thread.join();
+    }
+
+    // Queues a message; messages at error level are never dropped, and
+    // are only returned from once they are written out, so that they are
+    // not lost if the process aborts right after them
+    void log(log_destination dest, log_level level, int syslog_level, std::string_view msg) {
+        auto& ring = local_ring();
+        auto pos = ring.push(dest, syslog_level, msg);
+        if (level != log_level::error) {
+            if (!pos) {
+                ring.dropped.fetch_add(1, std::memory_order_relaxed);
+            }
+            wake();
+            return;
+        }
+        while (!pos) {
+            wake();
+            std::this_thread::yield();
+            pos = ring.push(dest, syslog_level, msg);
+        }
+        wake();
+        while (!ring.consumed(pos)) {
+            std::this_thread::yield();
+        }
+    }
+
+    size_t max_message_size() const noexcept {
+        return log_ring::max_message_size(_ring_size);
+    }
+
+    uint64_t dropped() {
+        std::lock_guard<std::mutex> g(_rings_mutex);
+        uint64_t n = 0;
+        for (auto& r : _rings) {
+            n += r->dropped.load(std::memory_order_relaxed);
+        }
+        return n;
+    }
+};
+
+thread_local async_log_sink::ring_holder async_log_sink::_local;
+
+static std::unique_ptr<async_log_sink> async_sink;
+
 bool logger::rate_limit::check() {
     const auto now = clock::now();
     if (now < _next) {
@@ -331,34 +701,70 @@ logger::do_log(log_level level, log_writer& writer) {
         internal::log_buf buf(static_log_buf.data(), static_log_buf.size());
         auto it = buf.back_insert_begin();
         it = fmt::format_to(it, "{} ", wrapped_log_level{level});
-        it = print_timestamp(it);
+        it = log_timestamp->print(it, log_timestamp->capture());
         it = print_once(it);
         *it++ = '\n';
-        *_out << buf.view();
-        _out->flush();
+        if (async_sink) {
+            async_sink->log(log_destination::ostream, level, 0, buf.view());
+        } else {
+            *_out << buf.view();
+            _out->flush();
+        }
     }
     if (is_syslog_enabled) {
         internal::log_buf buf(static_log_buf.data(), static_log_buf.size());
         auto it = buf.back_insert_begin();
         it = print_once(it);
         *it = '\0';
-        static array_map<int, 20> level_map = {
-                { int(log_level::debug), LOG_DEBUG },
-                { int(log_level::info), LOG_INFO },
-                { int(log_level::trace), LOG_DEBUG },  // no LOG_TRACE
-                { int(log_level::warn), LOG_WARNING },
-                { int(log_level::error), LOG_ERR },
-        };
-        // NOTE: syslog() can block, which will stall the reactor thread.
-        //       this should be rare (will have to fill the pipe buffer
-        //       before syslogd can clear it) but can happen.  If it does,
-        //       we'll have to implement some internal buffering (which
-        //       still means the problem can happen, just less frequently).
-        // syslog() interprets % characters, so send msg as a parameter
-        syslog(level_map[int(level)], "%s", buf.data());
+        if (async_sink) {
+            auto msg = std::string_view(buf.data(), buf.size() - 1);
+            async_sink->log(log_destination::syslog, level, syslog_level(level), msg);
+        } else {
+            // NOTE: syslog() can block, which will stall the reactor thread.
+            //       this should be rare (will have to fill the pipe buffer
+            //       before syslogd can clear it) but can happen.  If it does,
+            //       use set_async_enabled().
+            // syslog() interprets % characters, so send msg as a parameter
+            syslog(syslog_level(level), "%s", buf.data());
+        }
     }
 }
 
+bool
+logger::do_log_deferred(log_level level, std::string_view format, std::string_view args) {
+#if FMT_VERSION >= 80000
+    if (!async_sink) {
+        return false;
+    }
+    deferred_record r;
+    r.timestamp = log_timestamp->capture();
+    r.shard = local_engine ? int32_t(this_shard_id()) : -1;
+    r.level = level;
+    r.to_ostream = _ostream.load(std::memory_order_relaxed);
+    r.to_syslog = _syslog.load(std::memory_order_relaxed);
+    r.name_size = _name.size();
+    r.format_size = format.size();
+    auto size = sizeof(r) + _name.size() + format.size() + args.size();
+    if (size > std::min(static_log_buf.size(), async_sink->max_message_size())) {
+        return false;
+    }
+    if (!r.to_ostream && !r.to_syslog) {
+        return true;
+    }
+    auto p = static_log_buf.data();
+    std::memcpy(p, &r, sizeof(r));
+    p = std::copy(_name.begin(), _name.end(), p + sizeof(r));
+    p = std::copy(format.begin(), format.end(), p);
+    std::copy(args.begin(), args.end(), p);
+
+    silencer be_silent;
+    async_sink->log(log_destination::deferred, level, 0, std::string_view(static_log_buf.data(), size));
+    return true;
+#else
+    return false;
+#endif
+}
+
 void logger::failed_to_log(std::exception_ptr ex, format_info fmt) noexcept
 {
     try {
@@ -395,6 +801,24 @@ logger::set_syslog_enabled(bool enabled) noexcept {
     _syslog.store(enabled, std::memory_order_relaxed);
 }
 
+void
+logger::set_async_enabled(bool enabled, size_t buffer_size) {
+    async_sink.reset();
+    if (enabled) {
+        async_sink = std::make_unique<async_log_sink>(buffer_size);
+    }
+}
+
+void
+logger::set_deferred_formatting(bool enabled) noexcept {
+    _deferred.store(enabled, std::memory_order_relaxed);
+}
+
+uint64_t
+logger::async_dropped_messages() noexcept {
+    return async_sink ? async_sink->dropped() : 0;
+}
+
 void
 logger::set_shard_field_width(unsigned width) noexcept {
     _shard_field_width = width;
@@ -486,16 +910,18 @@ void apply_logging_settings(const logging_settings& s) {
     }
     logger::set_syslog_enabled(s.syslog_enabled);
     logger::set_with_color(s.with_color);
+    logger::set_async_enabled(s.async, s.async_buffer_size);
+    logger::set_deferred_formatting(s.deferred_formatting);
 
     switch (s.stdout_timestamp_style) {
     case logger_timestamp_style::none:
-        print_timestamp = print_no_timestamp;
+        log_timestamp = &no_timestamp;
         break;
     case logger_timestamp_style::boot:
-        print_timestamp = print_boot_timestamp;
+        log_timestamp = &boot_timestamp;
         break;
     case logger_timestamp_style::real:
-        print_timestamp = print_real_timestamp;
+        log_timestamp = &real_timestamp;
         break;
     default:
         break;
@@ -575,6 +1001,13 @@ options::options(program_options::option_group* parent_group)
             "Send log output to: none|stdout|stderr")
     , log_to_syslog(*this, "log-to-syslog", false, "Send log output to syslog.")
     , log_with_color(*this, "log-with-color", isatty(STDOUT_FILENO), "Print colored tag prefix in log message written to ostream")
+    , log_async(*this, "log-async", false,
+            "Write log messages from a dedicated thread, so that a slow output stream or syslog does not stall the reactor")
+    , log_async_buffer_size(*this, "log-async-buffer-size", 1 << 20,
+            "Size in bytes of the buffer of each thread for messages not yet written, with --log-async. "
+            "Messages are dropped while it is full, except errors, which wait")
+    , log_deferred_formatting(*this, "log-deferred-formatting", false,
+            "With --log-async, leave the formatting of messages to the log thread")
 {
 }
 
@@ -606,6 +1039,9 @@ logging_settings extract_settings(const options& opts) {
         opts.log_with_color.get_value(),
         opts.logger_stdout_timestamps.get_value(),
         opts.logger_ostream_type.get_value(),
+        opts.log_async.get_value(),
+        opts.log_async_buffer_size.get_value(),
+        opts.log_deferred_formatting.get_value(),
     };
 }
 
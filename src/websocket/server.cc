@@ -26,6 +26,10 @@
 #include <cryptopp/base64.h>
 #include <seastar/core/scattered_message.hh>
 #include <seastar/core/byteorder.hh>
+#include <seastar/core/loop.hh>
+#include <charconv>
+#include <cstring>
+#include <zlib.h>
 
 #ifndef CRYPTOPP_NO_GLOBAL_BYTE
 namespace CryptoPP {
@@ -53,15 +57,240 @@ opcodes websocket_parser::opcode() const {
     }
 }
 
+bool websocket_parser::fin() const {
+    return _header && _header->fin;
+}
+
+bool websocket_parser::compressed() const {
+    return _header && _header->rsv1;
+}
+
+bool websocket_parser::frame_done() const {
+    return _payload_length == 0;
+}
+
 websocket_parser::buff_t websocket_parser::result() {
-    _payload_length = 0;
-    _masking_key = 0;
-    _state = parsing_state::flags_and_payload_data;
+    if (_payload_length == 0) {
+        _masking_key = 0;
+        _mask_offset = 0;
+        _state = parsing_state::flags_and_payload_data;
+        _header.reset(nullptr);
+    }
     _cstate = connection_state::valid;
-    _header.reset(nullptr);
     return std::move(_result);
 }
 
+void websocket_parser::remove_mask(buff_t& p, size_t n) {
+    char* payload = p.get_write();
+    // The key bytes in the order they apply from the start of p, twice, so
+    // that the payload can be unmasked a word at a time
+    char key[8];
+    for (size_t j = 0; j < 4; ++j) {
+        key[j] = key[j + 4] = static_cast<char>(_masking_key >> (24 - ((j + _mask_offset) % 4) * 8));
+    }
+    uint64_t key_word;
+    std::memcpy(&key_word, key, sizeof(key_word));
+    size_t i = 0;
+    for (; i + sizeof(key_word) <= n; i += sizeof(key_word)) {
+        uint64_t word;
+        std::memcpy(&word, payload + i, sizeof(word));
+        word ^= key_word;
+        std::memcpy(payload + i, &word, sizeof(word));
+    }
+    for (; i < n; ++i) {
+        payload[i] ^= key[i % 4];
+    }
+    _mask_offset = (_mask_offset + n) % 4;
+}
+
+/*
+ * The permessage-deflate extension (RFC 7692). The payload of a compressed
+ * message is raw deflate data that ends in an empty stored block, whose
+ * 0x00 0x00 0xff 0xff tail is left out on the wire.
+ */
+class permessage_deflate {
+public:
+    struct params {
+        bool server_no_context_takeover = false;
+        bool client_no_context_takeover = false;
+        // 0 when the client did not ask for a limit
+        int server_max_window_bits = 0;
+
+        sstring to_string() const;
+    };
+private:
+    static constexpr char tail[] = {'\x00', '\x00', '\xff', '\xff'};
+    static constexpr size_t output_chunk = 16 * 1024;
+    params _params;
+    z_stream _deflate = {};
+    z_stream _inflate = {};
+public:
+    permessage_deflate(params p, int level) : _params(p) {
+        int window_bits = p.server_max_window_bits ? p.server_max_window_bits : 15;
+        if (deflateInit2(&_deflate, level, Z_DEFLATED, -window_bits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            throw std::bad_alloc();
+        }
+        // The client may use any window, a full one can decode them all
+        if (inflateInit2(&_inflate, -15) != Z_OK) {
+            deflateEnd(&_deflate);
+            throw std::bad_alloc();
+        }
+    }
+    ~permessage_deflate() {
+        deflateEnd(&_deflate);
+        inflateEnd(&_inflate);
+    }
+
+    // Picks the first offer of the Sec-WebSocket-Extensions header that can
+    // be served
+    static std::optional<params> negotiate(std::string_view offers);
+
+    temporary_buffer<char> compress(temporary_buffer<char> msg);
+
+    // Decompresses the next part of a message and passes what comes out to
+    // consumer, a buffer at a time
+    future<> decompress(temporary_buffer<char> part, bool fin,
+            noncopyable_function<future<>(temporary_buffer<char>)> consumer);
+};
+
+static std::string_view trim(std::string_view s) {
+    auto b = s.find_first_not_of(" \t");
+    if (b == std::string_view::npos) {
+        return {};
+    }
+    return s.substr(b, s.find_last_not_of(" \t") - b + 1);
+}
+
+sstring permessage_deflate::params::to_string() const {
+    sstring s = "permessage-deflate";
+    if (server_no_context_takeover) {
+        s += "; server_no_context_takeover";
+    }
+    if (client_no_context_takeover) {
+        s += "; client_no_context_takeover";
+    }
+    if (server_max_window_bits) {
+        s += format("; server_max_window_bits={}", server_max_window_bits);
+    }
+    return s;
+}
+
+std::optional<permessage_deflate::params> permessage_deflate::negotiate(std::string_view offers) {
+    while (!offers.empty()) {
+        auto comma = offers.find(',');
+        auto offer = offers.substr(0, comma);
+        offers.remove_prefix(comma == std::string_view::npos ? offers.size() : comma + 1);
+
+        auto semicolon = offer.find(';');
+        if (trim(offer.substr(0, semicolon)) != "permessage-deflate") {
+            continue;
+        }
+        params p;
+        bool ok = true;
+        while (ok && semicolon != std::string_view::npos) {
+            offer.remove_prefix(semicolon + 1);
+            semicolon = offer.find(';');
+            auto param = offer.substr(0, semicolon);
+            auto eq = param.find('=');
+            auto name = trim(param.substr(0, eq));
+            auto value = eq == std::string_view::npos ? std::string_view() : trim(param.substr(eq + 1));
+            if (value.size() >= 2 && value.front() == '"' && value.back() == '"') {
+                value = value.substr(1, value.size() - 2);
+            }
+            if (name == "server_no_context_takeover" && value.empty()) {
+                p.server_no_context_takeover = true;
+            } else if (name == "client_no_context_takeover" && value.empty()) {
+                p.client_no_context_takeover = true;
+            } else if (name == "server_max_window_bits") {
+                int bits = 0;
+                auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), bits);
+                // zlib cannot deflate with a window of 8 bits
+                ok = ec == std::errc() && ptr == value.data() + value.size() && bits >= 9 && bits <= 15;
+                p.server_max_window_bits = bits;
+            } else if (name == "client_max_window_bits") {
+                // Nothing to answer: without a limit in the reply, the
+                // client sticks to 15 bits, which is what we inflate with
+            } else {
+                ok = false;
+            }
+        }
+        if (ok) {
+            return p;
+        }
+    }
+    return std::nullopt;
+}
+
+temporary_buffer<char> permessage_deflate::compress(temporary_buffer<char> msg) {
+    _deflate.next_in = reinterpret_cast<Bytef*>(msg.get_write());
+    _deflate.avail_in = msg.size();
+    // With Z_SYNC_FLUSH the output ends with the tail, which is dropped
+    temporary_buffer<char> out(deflateBound(&_deflate, msg.size()) + 16);
+    size_t used = 0;
+    for (;;) {
+        _deflate.next_out = reinterpret_cast<Bytef*>(out.get_write() + used);
+        _deflate.avail_out = out.size() - used;
+        // Z_BUF_ERROR only means there was nothing to do
+        if (deflate(&_deflate, Z_SYNC_FLUSH) == Z_STREAM_ERROR) {
+            throw websocket::exception("deflate failed");
+        }
+        used = out.size() - _deflate.avail_out;
+        if (_deflate.avail_out != 0) {
+            break;
+        }
+        temporary_buffer<char> bigger(out.size() * 2);
+        std::copy_n(out.get(), used, bigger.get_write());
+        out = std::move(bigger);
+    }
+    if (_params.server_no_context_takeover) {
+        deflateReset(&_deflate);
+    }
+    out.trim(used - sizeof(tail));
+    return out;
+}
+
+future<> permessage_deflate::decompress(temporary_buffer<char> part, bool fin,
+        noncopyable_function<future<>(temporary_buffer<char>)> consumer) {
+    struct state {
+        temporary_buffer<char> input;
+        bool fin;
+        bool tail_fed = false;
+        noncopyable_function<future<>(temporary_buffer<char>)> consumer;
+    };
+    return do_with(state{std::move(part), fin, false, std::move(consumer)}, [this] (state& st) {
+        _inflate.next_in = reinterpret_cast<Bytef*>(st.input.get_write());
+        _inflate.avail_in = st.input.size();
+        return repeat([this, &st] {
+            if (_inflate.avail_in == 0) {
+                if (!st.fin || st.tail_fed) {
+                    return make_ready_future<stop_iteration>(stop_iteration::yes);
+                }
+                _inflate.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(tail));
+                _inflate.avail_in = sizeof(tail);
+                st.tail_fed = true;
+            }
+            temporary_buffer<char> out(output_chunk);
+            _inflate.next_out = reinterpret_cast<Bytef*>(out.get_write());
+            _inflate.avail_out = out.size();
+            auto r = inflate(&_inflate, Z_SYNC_FLUSH);
+            if (r == Z_STREAM_END) {
+                // The client ended the deflate stream with a final block,
+                // what follows starts a new one
+                inflateReset(&_inflate);
+            } else if (r != Z_OK && r != Z_BUF_ERROR) {
+                return make_exception_future<stop_iteration>(websocket::exception("Corrupt compressed message"));
+            }
+            out.trim(out.size() - _inflate.avail_out);
+            if (out.empty()) {
+                return make_ready_future<stop_iteration>(stop_iteration::no);
+            }
+            return st.consumer(std::move(out)).then([] {
+                return stop_iteration::no;
+            });
+        });
+    });
+}
+
 void server::listen(socket_address addr, listen_options lo) {
     _listeners.push_back(seastar::listen(addr, lo));
     do_accepts(_listeners.size() - 1);
@@ -108,6 +337,21 @@ future<> server::stop() {
     });
 }
 
+connection::connection(server& server, connected_socket&& fd)
+    : _server(server)
+    , _fd(std::move(fd))
+    , _read_buf(_fd.input())
+    , _write_buf(_fd.output())
+    , _input_buffer{PIPE_SIZE}
+    , _output_buffer{PIPE_SIZE}
+{
+    _input = input_stream<char>{data_source{
+            std::make_unique<connection_source_impl>(&_input_buffer)}};
+    _output = output_stream<char>{data_sink{
+            std::make_unique<connection_sink_impl>(&_output_buffer)}};
+    on_new_connection();
+}
+
 connection::~connection() {
     _server._connections.erase(_server._connections.iterator_to(*this));
 }
@@ -172,12 +416,25 @@ future<> connection::read_http_upgrade_request() {
         std::string sha1_output = sha1_base64(sha1_input);
         wlogger.debug("SHA1 output: {} of size {}", sha1_output, sha1_output.size());
 
+        sstring extensions;
+        if (_server._permessage_deflate) {
+            auto params = permessage_deflate::negotiate(req->get_header("Sec-WebSocket-Extensions"));
+            if (params) {
+                _deflate = std::make_unique<permessage_deflate>(*params, _server._compression_level);
+                _websocket_parser.set_permessage_deflate(true);
+                extensions = "\r\nSec-WebSocket-Extensions: " + params->to_string();
+                wlogger.debug("Sec-WebSocket-Extensions: {}", params->to_string());
+            }
+        }
+
         return _write_buf.write(http_upgrade_reply_template).then([this, sha1_output = std::move(sha1_output)] {
             return _write_buf.write(sha1_output);
         }).then([this] {
             return _write_buf.write("\r\nSec-WebSocket-Protocol: ", 26);
         }).then([this] {
             return _write_buf.write(_subprotocol);
+        }).then([this, extensions = std::move(extensions)] {
+            return _write_buf.write(extensions);
         }).then([this] {
             return _write_buf.write("\r\n\r\n", 4);
         }).then([this] {
@@ -205,8 +462,11 @@ future<websocket_parser::consumption_result_t> websocket_parser::operator()(
                 // https://datatracker.ietf.org/doc/html/rfc6455#section-5.1
                 // We must close the connection if data isn't masked.
                 if ((!_header->masked) || 
-                        // RSVX must be 0 
-                        (_header->rsv1 | _header->rsv2 | _header->rsv3) ||
+                        // RSVX must be 0, but for RSV1 on the first frame of
+                        // a compressed message
+                        (_header->rsv1 && !(_permessage_deflate &&
+                                (_header->opcode == opcodes::TEXT || _header->opcode == opcodes::BINARY))) ||
+                        (_header->rsv2 | _header->rsv3) ||
                         // Opcode must be known.
                         (!_header->is_opcode_known())) {
                     _cstate = connection_state::error;
@@ -247,6 +507,10 @@ future<websocket_parser::consumption_result_t> websocket_parser::operator()(
         }
     }
     if (_state == parsing_state::payload) {
+        if (data.empty() && _payload_length) {
+            // The header took all there was
+            return websocket_parser::dont_stop();
+        }
         if (_payload_length > data.size()) {
             _payload_length -= data.size();
             remove_mask(data, data.size());
@@ -282,21 +546,33 @@ future<> connection::read_one() {
             // FIXME: implement error handling
             switch(_websocket_parser.opcode()) {
                 // We do not distinguish between these 3 types.
-                case opcodes::CONTINUATION:
                 case opcodes::TEXT:
                 case opcodes::BINARY:
-                    return _input_buffer.push_eventually(_websocket_parser.result());
+                    _message_compressed = _websocket_parser.compressed();
+                    [[fallthrough]];
+                case opcodes::CONTINUATION: {
+                    // Frames, and parts of them, are passed on as they come,
+                    // a fragmented message is never put back together
+                    bool fin = _websocket_parser.frame_done() && _websocket_parser.fin();
+                    return receive_data(_websocket_parser.result(), fin).handle_exception([this] (std::exception_ptr e) {
+                        wlogger.debug("Receiving a message failed: {}", e);
+                        return close(true);
+                    });
+                }
                 case opcodes::CLOSE:
                     wlogger.debug("Received close frame.");
+                    _websocket_parser.result();
                     /*
                      * datatracker.ietf.org/doc/html/rfc6455#section-5.5.1
                      */
                     return close(true);
                 case opcodes::PING:
-                    return handle_ping();
                     wlogger.debug("Received ping frame.");
+                    _websocket_parser.result();
+                    return handle_ping();
                 case opcodes::PONG:
                     wlogger.debug("Received pong frame.");
+                    _websocket_parser.result();
                     return handle_pong();
                 default:
                     // Invalid - do nothing.
@@ -310,6 +586,19 @@ future<> connection::read_one() {
     });
 }
 
+future<> connection::receive_data(temporary_buffer<char> buff, bool fin) {
+    if (_message_compressed) {
+        return _deflate->decompress(std::move(buff), fin, [this] (temporary_buffer<char> b) {
+            return _input_buffer.push_eventually(std::move(b));
+        });
+    }
+    if (buff.empty()) {
+        // It would read as the end of the stream
+        return make_ready_future<>();
+    }
+    return _input_buffer.push_eventually(std::move(buff));
+}
+
 future<> connection::read_loop() {
     return read_http_upgrade_request().then([this] {
         return when_all_succeed(
@@ -340,18 +629,22 @@ future<> connection::close(bool send_close) {
     });
 }
 
-future<> connection::send_data(opcodes opcode, temporary_buffer<char>&& buff) {
+future<> connection::send_data(opcodes opcode, temporary_buffer<char>&& buff, bool compressed) {
     char header[10] = {'\x80', 0};
     size_t header_size = 2;
 
     header[0] += opcode;
+    if (compressed) {
+        // RSV1
+        header[0] |= '\x40';
+    }
 
     if ((126 <= buff.size()) && (buff.size() <= std::numeric_limits<uint16_t>::max())) {
         header[1] = '\x7e';
         write_be<uint16_t>(header + 2, buff.size());
-        header_size = 3;
+        header_size = 4;
     } else if (std::numeric_limits<uint16_t>::max() < buff.size()) {
-        header[1] = '\x7e';
+        header[1] = '\x7f';
         write_be<uint64_t>(header + 2, buff.size());
         header_size = 10;
     } else {
@@ -371,6 +664,9 @@ future<> connection::response_loop() {
         // FIXME: implement error handling
         return _output_buffer.pop_eventually().then([this] (
                 temporary_buffer<char> buf) {
+            if (_deflate && !buf.empty()) {
+                return send_data(opcodes::BINARY, _deflate->compress(std::move(buf)), true);
+            }
             return send_data(opcodes::BINARY, std::move(buf));
         });
     }).finally([this]() {
@@ -396,4 +692,9 @@ void server::register_handler(std::string&& name, handler_t handler) {
     _handlers[name] = handler;
 }
 
+void server::set_permessage_deflate(bool b, int level) {
+    _permessage_deflate = b;
+    _compression_level = level;
+}
+
 }
@@ -0,0 +1,103 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#include <fmt/core.h>
+#include <seastar/core/alien.hh>
+#include <seastar/core/app-template.hh>
+#include <seastar/core/future.hh>
+#include <seastar/core/smp.hh>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+using namespace seastar;
+using namespace std::chrono;
+
+// Threads outside of seastar submit calls to all shards, one at a time
+// with alien::submit_to(), then in batches with alien::submit_batch_to(),
+// and report how many calls per second get through.
+
+static double run(alien::instance& alien, unsigned threads, unsigned calls, unsigned batch) {
+    auto submit = [&alien, calls, batch] (unsigned thread) {
+        std::vector<std::future<unsigned>> futs;
+        for (unsigned i = 0; i < calls; i += batch) {
+            auto shard = (thread + i / batch) % smp::count;
+            if (batch == 1) {
+                futs.push_back(alien::submit_to(alien, shard, [i] {
+                    return make_ready_future<unsigned>(i);
+                }));
+                continue;
+            }
+            std::vector<std::function<future<unsigned>()>> funcs;
+            for (unsigned j = i; j < std::min(i + batch, calls); j++) {
+                funcs.emplace_back([j] {
+                    return make_ready_future<unsigned>(j);
+                });
+            }
+            for (auto& f : alien::submit_batch_to(alien, shard, std::move(funcs))) {
+                futs.push_back(std::move(f));
+            }
+        }
+        for (auto& f : futs) {
+            f.get();
+        }
+    };
+    auto start = steady_clock::now();
+    std::vector<std::thread> submitters;
+    for (unsigned t = 0; t < threads; t++) {
+        submitters.emplace_back(submit, t);
+    }
+    for (auto& t : submitters) {
+        t.join();
+    }
+    auto took = duration_cast<duration<double>>(steady_clock::now() - start);
+    return threads * calls / took.count();
+}
+
+int main(int ac, char** av) {
+    app_template app;
+    namespace bpo = boost::program_options;
+    app.add_options()
+            ("threads", bpo::value<unsigned>()->default_value(4), "number of submitting threads")
+            ("calls", bpo::value<unsigned>()->default_value(1000000), "calls each thread submits")
+            ("batch", bpo::value<unsigned>()->default_value(64), "calls per batch")
+        ;
+
+    promise<> done;
+    return app.run(ac, av, [&app, &done] {
+        auto threads = app.configuration()["threads"].as<unsigned>();
+        auto calls = app.configuration()["calls"].as<unsigned>();
+        auto batch = app.configuration()["batch"].as<unsigned>();
+        auto f = done.get_future();
+        // Runs the submitters outside of the reactor, which keeps
+        // polling the alien queues meanwhile
+        std::thread([&alien = app.alien(), threads, calls, batch, &done] {
+            auto single = run(alien, threads, calls, 1);
+            fmt::print("single: {:.0f} calls/s\n", single);
+            auto batched = run(alien, threads, calls, batch);
+            fmt::print("batches of {}: {:.0f} calls/s\n", batch, batched);
+            alien::run_on(alien, 0, [&done] {
+                done.set_value();
+            });
+        }).detach();
+        return f;
+    });
+}
@@ -0,0 +1,93 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#include <array>
+#include <memory>
+
+#include <seastar/testing/perf_tests.hh>
+#include <seastar/core/future.hh>
+
+// Models the allocation pattern of future/continuation churn: many small,
+// short-lived objects allocated and freed in roughly LIFO order, with a
+// bounded number outstanding at any time.
+
+struct small_allocations {
+    static constexpr unsigned outstanding = 64;
+    std::array<void*, outstanding> slots{};
+
+    ~small_allocations() {
+        for (auto p : slots) {
+            ::free(p);
+        }
+    }
+
+    template <size_t Size>
+    size_t churn() {
+        for (unsigned i = 0; i < outstanding; i++) {
+            slots[i] = ::malloc(Size);
+            perf_tests::do_not_optimize(slots[i]);
+        }
+        for (unsigned i = outstanding; i-- > 0;) {
+            ::free(std::exchange(slots[i], nullptr));
+        }
+        return outstanding;
+    }
+};
+
+PERF_TEST_F(small_allocations, churn_16) {
+    return churn<16>();
+}
+
+PERF_TEST_F(small_allocations, churn_32) {
+    return churn<32>();
+}
+
+PERF_TEST_F(small_allocations, churn_64) {
+    return churn<64>();
+}
+
+PERF_TEST_F(small_allocations, churn_128) {
+    return churn<128>();
+}
+
+[[gnu::noinline]]
+future<int> step(int v) {
+    return make_ready_future<int>(v + 1);
+}
+
+PERF_TEST(small_allocations, continuation_chain) {
+    // a ready future forces nothing to be allocated, so go through a
+    // promise to get a continuation object for every link
+    promise<> p;
+    auto f = p.get_future().then([] {
+        return step(0);
+    }).then([] (int v) {
+        return step(v);
+    }).then([] (int v) {
+        return step(v);
+    }).then([] (int v) {
+        perf_tests::do_not_optimize(v);
+    });
+    p.set_value();
+    return f.then([] {
+        return size_t(4);
+    });
+}
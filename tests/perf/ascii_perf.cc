@@ -0,0 +1,89 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#include <seastar/testing/perf_tests.hh>
+#include <seastar/core/sstring.hh>
+#include <seastar/util/ascii.hh>
+#include <algorithm>
+#include <cctype>
+#include <functional>
+
+using namespace seastar;
+
+// Header names, and a request line, as the HTTP server looks them up
+struct ascii {
+    sstring name = "Content-Type";
+    sstring long_name = "Access-Control-Allow-Credentials";
+    sstring long_lower = "access-control-allow-credentials";
+    sstring line = "GET /api/v1/resource17/42/sub3/7?timeout=10&consistency=quorum HTTP/1.1";
+
+    static size_t tolower_hash(std::string_view s) {
+        sstring copy(s.data(), s.size());
+        std::transform(copy.begin(), copy.end(), copy.begin(), ::tolower);
+        return std::hash<sstring>()(copy);
+    }
+
+    static bool tolower_equal(std::string_view a, std::string_view b) {
+        return std::equal(a.begin(), a.end(), b.begin(), b.end(), [] (char x, char y) {
+            return ::tolower(x) == ::tolower(y);
+        });
+    }
+};
+
+PERF_TEST_F(ascii, hash_tolower)
+{
+    perf_tests::do_not_optimize(tolower_hash(name));
+}
+
+PERF_TEST_F(ascii, hash)
+{
+    perf_tests::do_not_optimize(ascii_ihash(name));
+}
+
+PERF_TEST_F(ascii, hash_long_tolower)
+{
+    perf_tests::do_not_optimize(tolower_hash(long_name));
+}
+
+PERF_TEST_F(ascii, hash_long)
+{
+    perf_tests::do_not_optimize(ascii_ihash(long_name));
+}
+
+PERF_TEST_F(ascii, equal_tolower)
+{
+    perf_tests::do_not_optimize(tolower_equal(long_name, long_lower));
+}
+
+PERF_TEST_F(ascii, equal)
+{
+    perf_tests::do_not_optimize(ascii_iequals(long_name, long_lower));
+}
+
+PERF_TEST_F(ascii, find_first_of_std)
+{
+    perf_tests::do_not_optimize(std::string_view(line).find_first_of("?#"));
+}
+
+PERF_TEST_F(ascii, find_first_of)
+{
+    perf_tests::do_not_optimize(ascii_find_first_of(line, "?#"));
+}
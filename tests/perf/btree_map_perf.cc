@@ -0,0 +1,94 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+
+#include <seastar/testing/perf_tests.hh>
+#include <seastar/core/btree_map.hh>
+#include <algorithm>
+#include <map>
+#include <random>
+#include <vector>
+
+using namespace seastar;
+
+// Lookups and inserts of random 64-bit keys in an index of a million
+// entries, in a B+tree and in std::map.
+
+template <typename Map>
+struct index_lookup {
+    static constexpr size_t entries = 1 << 20;
+    static constexpr size_t lookups = 1 << 12;
+
+    Map map;
+    std::vector<uint64_t> keys;
+
+    index_lookup() {
+        std::mt19937_64 rng(1);
+        keys.reserve(entries);
+        for (size_t i = 0; i < entries; i++) {
+            keys.push_back(rng());
+            map.emplace(keys.back(), i);
+        }
+        std::shuffle(keys.begin(), keys.end(), rng);
+    }
+
+    size_t find() {
+        for (size_t i = 0; i < lookups; i++) {
+            perf_tests::do_not_optimize(map.find(keys[i])->second);
+        }
+        return lookups;
+    }
+
+    size_t scan() {
+        size_t n = 0;
+        for (auto it = map.lower_bound(keys[0]); it != map.end() && n < lookups; ++it, ++n) {
+            perf_tests::do_not_optimize(it->second);
+        }
+        return n;
+    }
+
+    size_t erase_insert() {
+        for (size_t i = 0; i < lookups; i++) {
+            map.erase(keys[i]);
+        }
+        for (size_t i = 0; i < lookups; i++) {
+            map.emplace(keys[i], i);
+        }
+        return lookups * 2;
+    }
+};
+
+template <typename Key, typename T>
+struct btree_index : btree_map<Key, T> {
+    void emplace(Key k, T v) {
+        this->insert(k, v);
+    }
+};
+
+using btree_lookup = index_lookup<btree_index<uint64_t, uint64_t>>;
+using std_map_lookup = index_lookup<std::map<uint64_t, uint64_t>>;
+
+PERF_TEST_F(btree_lookup, find) { return find(); }
+PERF_TEST_F(btree_lookup, scan) { return scan(); }
+PERF_TEST_F(btree_lookup, erase_insert) { return erase_insert(); }
+PERF_TEST_F(std_map_lookup, find) { return find(); }
+PERF_TEST_F(std_map_lookup, scan) { return scan(); }
+PERF_TEST_F(std_map_lookup, erase_insert) { return erase_insert(); }
@@ -0,0 +1,91 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#include <seastar/testing/perf_tests.hh>
+#include <seastar/util/checksum.hh>
+#include <string>
+
+using namespace seastar;
+using internal::crc32c_kernel;
+
+struct checksum {
+    std::string small = std::string(64, 'x');
+    std::string page = std::string(4096, 'x');
+    std::string block = std::string(64 << 10, 'x');
+
+    static uint32_t crc(const std::string& s, crc32c_kernel k) {
+        if (k != crc32c_kernel::table && !internal::crc32c_hardware_available()) {
+            k = crc32c_kernel::table;
+        }
+        return internal::crc32c_update(~0u, s.data(), s.size(), k);
+    }
+};
+
+PERF_TEST_F(checksum, crc32c_table_64)
+{
+    perf_tests::do_not_optimize(crc(small, crc32c_kernel::table));
+}
+
+PERF_TEST_F(checksum, crc32c_hardware_64)
+{
+    perf_tests::do_not_optimize(crc(small, crc32c_kernel::hardware));
+}
+
+PERF_TEST_F(checksum, xxhash64_64)
+{
+    perf_tests::do_not_optimize(xxhash64::of(small));
+}
+
+PERF_TEST_F(checksum, crc32c_table_4k)
+{
+    perf_tests::do_not_optimize(crc(page, crc32c_kernel::table));
+}
+
+PERF_TEST_F(checksum, crc32c_hardware_4k)
+{
+    perf_tests::do_not_optimize(crc(page, crc32c_kernel::hardware));
+}
+
+PERF_TEST_F(checksum, xxhash64_4k)
+{
+    perf_tests::do_not_optimize(xxhash64::of(page));
+}
+
+PERF_TEST_F(checksum, crc32c_table_64k)
+{
+    perf_tests::do_not_optimize(crc(block, crc32c_kernel::table));
+}
+
+PERF_TEST_F(checksum, crc32c_hardware_64k)
+{
+    perf_tests::do_not_optimize(crc(block, crc32c_kernel::hardware));
+}
+
+PERF_TEST_F(checksum, crc32c_interleaved_64k)
+{
+    perf_tests::do_not_optimize(crc(block, crc32c_kernel::interleaved));
+}
+
+PERF_TEST_F(checksum, xxhash64_64k)
+{
+    perf_tests::do_not_optimize(xxhash64::of(block));
+}
@@ -24,11 +24,44 @@
 #ifdef SEASTAR_COROUTINES_ENABLED
 
 #include <seastar/core/coroutine.hh>
+#include <seastar/core/internal/coroutine_frame_pool.hh>
 #include <seastar/coroutine/maybe_yield.hh>
+#include <seastar/coroutine/batch_generator.hh>
+#include <array>
+#include <numeric>
 
 struct coroutine_test {
 };
 
+// The same tests with coroutine frames from the allocator, for comparison
+struct coroutine_test_unpooled {
+    coroutine_test_unpooled() {
+        internal::coroutine_frame_pool::set_enabled(false);
+    }
+    ~coroutine_test_unpooled() {
+        internal::coroutine_frame_pool::set_enabled(true);
+    }
+};
+
+// A coroutine with a few hundred bytes of frame, suspending once
+[[gnu::noinline]]
+static future<int> frame_heavy_leaf(int x) {
+    std::array<int, 64> scratch;
+    scratch[x % scratch.size()] = x;
+    perf_tests::do_not_optimize(scratch);
+    co_await coroutine::maybe_yield();
+    co_return scratch[x % scratch.size()];
+}
+
+static future<size_t> nested_calls() {
+    int sum = 0;
+    for (int i = 0; i < 100; i++) {
+        sum += co_await frame_heavy_leaf(i);
+    }
+    perf_tests::do_not_optimize(sum);
+    co_return 100;
+}
+
 PERF_TEST_C(coroutine_test, empty)
 {
     co_return;
@@ -49,4 +82,67 @@ PERF_TEST_C(coroutine_test, maybe_yield)
     co_await coroutine::maybe_yield();
 }
 
+PERF_TEST_CN(coroutine_test, nested)
+{
+    co_return co_await nested_calls();
+}
+
+// Records per second through a generator, one record or a batch of them per
+// resumption
+
+static constexpr size_t generated_records = 10000;
+
+static coroutine::experimental::generator<int, std::optional> generate_records() {
+    for (size_t i = 0; i < generated_records; i++) {
+        co_yield int(i);
+    }
+}
+
+static coroutine::experimental::batch_generator<int> generate_record_batches(size_t batch_size) {
+    std::vector<int> batch(batch_size);
+    for (size_t i = 0; i < generated_records; i += batch_size) {
+        std::iota(batch.begin(), batch.end(), int(i));
+        co_yield batch;
+    }
+}
+
+PERF_TEST_CN(coroutine_test, generator_records)
+{
+    auto records = generate_records();
+    int sum = 0;
+    while (auto record = co_await records()) {
+        sum += *record;
+    }
+    perf_tests::do_not_optimize(sum);
+    co_return generated_records;
+}
+
+PERF_TEST_CN(coroutine_test, batch_generator_records)
+{
+    auto batches = generate_record_batches(100);
+    int sum = 0;
+    while (auto batch = co_await batches()) {
+        for (int record : *batch) {
+            sum += record;
+        }
+    }
+    perf_tests::do_not_optimize(sum);
+    co_return generated_records;
+}
+
+PERF_TEST_C(coroutine_test_unpooled, empty)
+{
+    co_return;
+}
+
+PERF_TEST_C(coroutine_test_unpooled, ready)
+{
+    co_await make_ready_future<>();
+}
+
+PERF_TEST_CN(coroutine_test_unpooled, nested)
+{
+    co_return co_await nested_calls();
+}
+
 #endif // SEASTAR_COROUTINES_ENABLED
@@ -28,6 +28,7 @@
 #include <seastar/core/loop.hh>
 #include <seastar/core/when_all.hh>
 #include <boost/range/irange.hpp>
+#include <thread>
 
 static constexpr fair_queue::class_id cid = 0;
 
@@ -144,3 +145,179 @@ PERF_TEST_F(perf_fair_queue, contended_shared)
 {
     return test(false);
 }
+
+// A noisy tenant with many busy classes competes with a quiet one that has a
+// single class. The time it takes the quiet tenant to get its requests served
+// shows how well it's isolated from the noisy one: with flat classes it gets
+// only its per-class slice, with class groups it gets half of the capacity.
+struct perf_fair_queue_tenants {
+    static constexpr unsigned noisy_classes = 8;
+    static constexpr unsigned noisy_requests_per_class = 4;
+    static constexpr unsigned quiet_requests = 100;
+    static constexpr fair_queue::class_id quiet_cid = noisy_classes;
+
+    struct entry {
+        seastar::fair_queue_entry ent;
+        fair_queue::class_id cid;
+
+        explicit entry(fair_queue::class_id c) : ent(seastar::fair_queue_ticket(1, 1)), cid(c) {}
+
+        static entry& from(fair_queue_entry& ent) noexcept {
+            return *boost::intrusive::get_parent_from_member(&ent, &entry::ent);
+        }
+    };
+
+    seastar::fair_group fg;
+    seastar::fair_queue flat;
+    seastar::fair_queue grouped;
+    std::vector<std::unique_ptr<entry>> flat_noisy;
+    std::vector<std::unique_ptr<entry>> grouped_noisy;
+    std::vector<std::unique_ptr<entry>> quiet;
+
+    static fair_group::config fg_config() {
+        fair_group::config cfg;
+        cfg.weight_rate = std::numeric_limits<int>::max();
+        cfg.size_rate = std::numeric_limits<int>::max();
+        return cfg;
+    }
+
+    void start_noisy(fair_queue& fq, std::vector<std::unique_ptr<entry>>& noisy) {
+        for (fair_queue::class_id c = 0; c < noisy_classes; c++) {
+            for (unsigned i = 0; i < noisy_requests_per_class; i++) {
+                noisy.push_back(std::make_unique<entry>(c));
+                fq.queue(c, noisy.back()->ent);
+            }
+        }
+    }
+
+    perf_fair_queue_tenants()
+        : fg(fg_config())
+        , flat(fg, seastar::fair_queue::config())
+        , grouped(fg, seastar::fair_queue::config())
+    {
+        static constexpr fair_queue::group_id noisy_group = 1;
+        static constexpr fair_queue::group_id quiet_group = 2;
+        grouped.register_priority_class_group(noisy_group, 100);
+        grouped.register_priority_class_group(quiet_group, 100);
+        for (fair_queue::class_id c = 0; c < noisy_classes; c++) {
+            flat.register_priority_class(c, 100);
+            grouped.register_priority_class(c, 100, noisy_group);
+        }
+        flat.register_priority_class(quiet_cid, 100);
+        grouped.register_priority_class(quiet_cid, 100, quiet_group);
+
+        start_noisy(flat, flat_noisy);
+        start_noisy(grouped, grouped_noisy);
+        for (unsigned i = 0; i < quiet_requests; i++) {
+            quiet.push_back(std::make_unique<entry>(quiet_cid));
+        }
+    }
+
+    ~perf_fair_queue_tenants() {
+        for (auto* fq : { &flat, &grouped }) {
+            unsigned left = noisy_classes * noisy_requests_per_class;
+            while (left != 0) {
+                fq->dispatch_requests([fq, &left] (fair_queue_entry& ent) {
+                    fq->notify_request_finished(ent.ticket());
+                    left--;
+                });
+            }
+            for (fair_queue::class_id c = 0; c <= quiet_cid; c++) {
+                fq->unregister_priority_class(c);
+            }
+        }
+    }
+
+    // Serves the quiet tenant's requests while keeping the noisy one backlogged
+    size_t serve_quiet(fair_queue& fq) {
+        for (auto& e : quiet) {
+            fq.queue(quiet_cid, e->ent);
+        }
+
+        unsigned served = 0;
+        std::vector<entry*> requeue;
+        while (served < quiet_requests) {
+            fq.dispatch_requests([&fq, &served, &requeue] (fair_queue_entry& ent) {
+                fq.notify_request_finished(ent.ticket());
+                auto& e = entry::from(ent);
+                if (e.cid == quiet_cid) {
+                    served++;
+                } else {
+                    requeue.push_back(&e);
+                }
+            });
+            for (auto* e : requeue) {
+                fq.queue(e->cid, e->ent);
+            }
+            requeue.clear();
+        }
+        return quiet_requests;
+    }
+};
+
+PERF_TEST_F(perf_fair_queue_tenants, isolation_flat)
+{
+    return serve_quiet(flat);
+}
+
+PERF_TEST_F(perf_fair_queue_tenants, isolation_grouped)
+{
+    return serve_quiet(grouped);
+}
+
+// Threads standing for shards dispatch requests through one token bucket,
+// either grabbing and releasing the capacity of every request on the shared
+// rovers, or through per-shard leases. How the time per request grows with
+// the number of threads shows how the bucket scales to many shards.
+struct perf_token_bucket_shards {
+    using token_bucket_t = fair_group::token_bucket_t;
+    using lease_t = fair_group::lease_t;
+    using capacity_t = fair_group::capacity_t;
+
+    static constexpr unsigned requests_per_shard = 20000;
+    static constexpr capacity_t request_capacity = 1 << 10;
+    static constexpr capacity_t lease_capacity = 16 * request_capacity;
+
+    token_bucket_t bucket;
+
+    perf_token_bucket_shards()
+        : bucket(token_bucket_t::max_rate, std::numeric_limits<capacity_t>::max() / 4, 1)
+    {}
+
+    template <typename Grab, typename Release>
+    static void dispatch(const token_bucket_t& bucket, Grab grab, Release release) {
+        for (unsigned i = 0; i < requests_per_shard; i++) {
+            auto head = grab(request_capacity);
+            perf_tests::do_not_optimize(bucket.deficiency(head));
+            release(request_capacity);
+        }
+    }
+
+    size_t run_shards(unsigned shards, bool leased) {
+        std::vector<std::thread> threads;
+        threads.reserve(shards);
+        perf_tests::start_measuring_time();
+        for (unsigned s = 0; s < shards; s++) {
+            threads.emplace_back([this, leased] {
+                if (leased) {
+                    lease_t lease(bucket, lease_capacity);
+                    dispatch(bucket, [&lease] (capacity_t c) { return lease.grab(c); }, [&lease] (capacity_t c) { lease.release(c); });
+                } else {
+                    dispatch(bucket, [this] (capacity_t c) { return bucket.grab(c); }, [this] (capacity_t c) { bucket.release(c); });
+                }
+            });
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+        perf_tests::stop_measuring_time();
+        return shards * requests_per_shard;
+    }
+};
+
+PERF_TEST_F(perf_token_bucket_shards, direct_1) { return run_shards(1, false); }
+PERF_TEST_F(perf_token_bucket_shards, leased_1) { return run_shards(1, true); }
+PERF_TEST_F(perf_token_bucket_shards, direct_16) { return run_shards(16, false); }
+PERF_TEST_F(perf_token_bucket_shards, leased_16) { return run_shards(16, true); }
+PERF_TEST_F(perf_token_bucket_shards, direct_128) { return run_shards(128, false); }
+PERF_TEST_F(perf_token_bucket_shards, leased_128) { return run_shards(128, true); }
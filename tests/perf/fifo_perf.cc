@@ -0,0 +1,72 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#include <seastar/testing/perf_tests.hh>
+#include <seastar/core/chunked_fifo.hh>
+#include <seastar/core/circular_buffer.hh>
+#include <numeric>
+#include <vector>
+
+using namespace seastar;
+
+// Batches of pointers, as the reactor's task and completion queues carry,
+// pushed to and popped from a queue an element at a time and in bulk.
+
+template <typename Queue>
+struct fifo_batches {
+    static constexpr size_t batch = 256;
+    static constexpr size_t batches = 64;
+
+    Queue queue;
+    std::vector<void*> items = std::vector<void*>(batch);
+
+    size_t one_by_one() {
+        for (size_t b = 0; b < batches; b++) {
+            for (auto p : items) {
+                queue.push_back(p);
+            }
+        }
+        for (size_t i = 0; i < batch * batches; i++) {
+            perf_tests::do_not_optimize(queue.front());
+            queue.pop_front();
+        }
+        return batch * batches;
+    }
+
+    size_t bulk() {
+        for (size_t b = 0; b < batches; b++) {
+            queue.push_back(items.begin(), items.end());
+        }
+        for (auto& p : queue) {
+            perf_tests::do_not_optimize(p);
+        }
+        queue.pop_front(batch * batches);
+        return batch * batches;
+    }
+};
+
+using circular_buffer_batches = fifo_batches<circular_buffer<void*>>;
+using chunked_fifo_batches = fifo_batches<chunked_fifo<void*>>;
+
+PERF_TEST_F(circular_buffer_batches, one_by_one) { return one_by_one(); }
+PERF_TEST_F(circular_buffer_batches, bulk) { return bulk(); }
+PERF_TEST_F(chunked_fifo_batches, one_by_one) { return one_by_one(); }
+PERF_TEST_F(chunked_fifo_batches, bulk) { return bulk(); }
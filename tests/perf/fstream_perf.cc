@@ -25,59 +25,131 @@
 #include <seastar/core/app-template.hh>
 #include <seastar/core/do_with.hh>
 #include <seastar/core/loop.hh>
+#include <seastar/core/thread.hh>
+#include <boost/range/irange.hpp>
 #include <fmt/printf.h>
 
 using namespace seastar;
 using namespace std::chrono_literals;
 
+static future<> write_test(unsigned concurrency, size_t buffer_size, unsigned total_ops, bool sloppy_size) {
+    file_open_options foo;
+    foo.sloppy_size = sloppy_size;
+    return open_file_dma(
+            "testfile.tmp", open_flags::wo | open_flags::create | open_flags::exclusive,
+            foo).then([=] (file f) {
+        file_output_stream_options foso;
+        foso.buffer_size = buffer_size;
+        foso.preallocation_size = 32 << 20;
+        foso.write_behind = concurrency;
+        return api_v3::and_newer::make_file_output_stream(f, foso).then([=] (output_stream<char>&& os) {
+            return do_with(std::move(os), std::move(f), unsigned(0), [=] (output_stream<char>& os, file& f, unsigned& completed) {
+                auto start = std::chrono::steady_clock::now();
+                return repeat([=, &os, &completed] {
+                    if (completed == total_ops) {
+                        return make_ready_future<stop_iteration>(stop_iteration::yes);
+                    }
+                    char buf[buffer_size];
+                    memset(buf, 0, buffer_size);
+                    return os.write(buf, buffer_size).then([&completed] {
+                        ++completed;
+                        return stop_iteration::no;
+                    });
+                }).then([=, &os] {
+                    auto end = std::chrono::steady_clock::now();
+                    using fseconds = std::chrono::duration<float, std::ratio<1, 1>>;
+                    auto iops = total_ops / std::chrono::duration_cast<fseconds>(end - start).count();
+                    fmt::print("{:10} {:10} {:10} {:12}\n", "bufsize", "ops", "iodepth", "IOPS");
+                    fmt::print("{:10d} {:10d} {:10d} {:12.0f}\n", buffer_size, total_ops, concurrency, iops);
+                    return os.flush();
+                }).then([&os] {
+                    return os.close();
+                });
+            });
+        });
+    });
+}
+
+// A full scan of testfile.tmp through an input stream with deep read-ahead,
+// while point reads of the same class hit random places of the file. Shows
+// how read-ahead settings trade scan throughput for point read latency.
+static future<> mixed_scan_test(size_t buffer_size, unsigned read_ahead, bool adaptive, size_t budget, unsigned point_readers) {
+    return async([=] {
+        using fseconds = std::chrono::duration<float, std::ratio<1, 1>>;
+        auto pc = io_priority_class::register_one("mixed", 100);
+        if (budget) {
+            set_read_ahead_budget(pc, budget);
+        }
+        auto f = open_file_dma("testfile.tmp", open_flags::ro).get0();
+        auto size = f.size().get0();
+        auto blocks = size / 4096;
+        if (!blocks) {
+            throw std::runtime_error("testfile.tmp is too small, run in write mode first");
+        }
+
+        bool scanning = true;
+        uint64_t point_ops = 0;
+        fseconds point_time(0);
+        auto points = parallel_for_each(boost::irange(0u, point_readers), [&] (unsigned) {
+            return do_until([&] { return !scanning; }, [&] {
+                auto pos = (std::rand() % blocks) * 4096;
+                auto start = std::chrono::steady_clock::now();
+                return f.dma_read<char>(pos, 4096, pc).then([&, start] (temporary_buffer<char>) {
+                    point_time += std::chrono::steady_clock::now() - start;
+                    point_ops++;
+                });
+            });
+        });
+
+        file_input_stream_options fiso;
+        fiso.buffer_size = buffer_size;
+        fiso.read_ahead = read_ahead;
+        fiso.adaptive_read_ahead = adaptive;
+        fiso.io_priority_class = pc;
+        auto in = make_file_input_stream(f, fiso);
+        auto start = std::chrono::steady_clock::now();
+        uint64_t scanned = 0;
+        while (true) {
+            auto buf = in.read().get0();
+            if (buf.empty()) {
+                break;
+            }
+            scanned += buf.size();
+        }
+        auto took = std::chrono::duration_cast<fseconds>(std::chrono::steady_clock::now() - start);
+        scanning = false;
+        points.get();
+        in.close().get();
+        f.close().get();
+
+        fmt::print("{:10} {:10} {:10} {:12} {:12} {:14}\n", "bufsize", "readahead", "adaptive", "budget", "scan MB/s", "point lat us");
+        fmt::print("{:10d} {:10d} {:10} {:12d} {:12.1f} {:14.1f}\n", buffer_size, read_ahead, adaptive, budget,
+                scanned / took.count() / (1 << 20), point_ops ? point_time.count() * 1e6 / point_ops : 0.0);
+    });
+}
+
 int main(int ac, char** av) {
     app_template at;
     namespace bpo = boost::program_options;
     at.add_options()
+            ("mode", bpo::value<sstring>()->default_value("write"), "Test to run: write (sequential writes of testfile.tmp) or mixed-scan (scan testfile.tmp with concurrent point reads)")
             ("concurrency", bpo::value<unsigned>()->default_value(1), "Write operations to issue in parallel")
-            ("buffer-size", bpo::value<size_t>()->default_value(4096), "Write buffer size")
+            ("buffer-size", bpo::value<size_t>()->default_value(4096), "Write (or scan) buffer size")
             ("total-ops", bpo::value<unsigned>()->default_value(100000), "Total write operations to issue")
             ("sloppy-size", bpo::value<bool>()->default_value(false), "Enable the sloppy-size optimization")
+            ("read-ahead", bpo::value<unsigned>()->default_value(16), "Scan read-ahead (mixed-scan mode)")
+            ("adaptive-read-ahead", bpo::value<bool>()->default_value(false), "Let the scan adapt read-ahead to the access pattern (mixed-scan mode)")
+            ("read-ahead-budget", bpo::value<size_t>()->default_value(0), "Read-ahead budget of the class in bytes, 0 for unlimited (mixed-scan mode)")
+            ("point-readers", bpo::value<unsigned>()->default_value(4), "Point reads to issue in parallel with the scan (mixed-scan mode)")
             ;
     return at.run(ac, av, [&at] {
-        auto concurrency = at.configuration()["concurrency"].as<unsigned>();
-        auto buffer_size = at.configuration()["buffer-size"].as<size_t>();
-        auto total_ops = at.configuration()["total-ops"].as<unsigned>();
-        auto sloppy_size = at.configuration()["sloppy-size"].as<bool>();
-        file_open_options foo;
-        foo.sloppy_size = sloppy_size;
-        return open_file_dma(
-                "testfile.tmp", open_flags::wo | open_flags::create | open_flags::exclusive,
-                foo).then([=] (file f) {
-            file_output_stream_options foso;
-            foso.buffer_size = buffer_size;
-            foso.preallocation_size = 32 << 20;
-            foso.write_behind = concurrency;
-            return api_v3::and_newer::make_file_output_stream(f, foso).then([=] (output_stream<char>&& os) {
-                return do_with(std::move(os), std::move(f), unsigned(0), [=] (output_stream<char>& os, file& f, unsigned& completed) {
-                    auto start = std::chrono::steady_clock::now();
-                    return repeat([=, &os, &completed] {
-                        if (completed == total_ops) {
-                            return make_ready_future<stop_iteration>(stop_iteration::yes);
-                        }
-                        char buf[buffer_size];
-                        memset(buf, 0, buffer_size);
-                        return os.write(buf, buffer_size).then([&completed] {
-                            ++completed;
-                            return stop_iteration::no;
-                        });
-                    }).then([=, &os] {
-                        auto end = std::chrono::steady_clock::now();
-                        using fseconds = std::chrono::duration<float, std::ratio<1, 1>>;
-                        auto iops = total_ops / std::chrono::duration_cast<fseconds>(end - start).count();
-                        fmt::print("{:10} {:10} {:10} {:12}\n", "bufsize", "ops", "iodepth", "IOPS");
-                        fmt::print("{:10d} {:10d} {:10d} {:12.0f}\n", buffer_size, total_ops, concurrency, iops);
-                        return os.flush();
-                    }).then([&os] {
-                        return os.close();
-                    });
-                });
-            });
-        });
+        auto& cfg = at.configuration();
+        auto mode = cfg["mode"].as<sstring>();
+        auto buffer_size = cfg["buffer-size"].as<size_t>();
+        if (mode == "mixed-scan") {
+            return mixed_scan_test(buffer_size, cfg["read-ahead"].as<unsigned>(), cfg["adaptive-read-ahead"].as<bool>(),
+                    cfg["read-ahead-budget"].as<size_t>(), cfg["point-readers"].as<unsigned>());
+        }
+        return write_test(cfg["concurrency"].as<unsigned>(), buffer_size, cfg["total-ops"].as<unsigned>(), cfg["sloppy-size"].as<bool>());
     });
 }
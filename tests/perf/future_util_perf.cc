@@ -157,6 +157,45 @@ PERF_TEST_F(parallel_for_each, suspend_100)
     });
 }
 
+// Continuations attached to an unresolved future have to be allocated;
+// these show the cost of a typical chain once the continuation storage
+// is recycled.
+PERF_TEST(continuation_chain, then_4)
+{
+    promise<int> pr;
+    auto f = pr.get_future().then([] (int v) {
+        return v + 1;
+    }).then([] (int v) {
+        return v * 2;
+    }).then([] (int v) {
+        return v - 1;
+    }).then([] (int v) {
+        perf_tests::do_not_optimize(v);
+    });
+    pr.set_value(1);
+    return f.then([] {
+        return 4;
+    });
+}
+
+PERF_TEST(continuation_chain, then_wrapped_4)
+{
+    promise<> pr;
+    auto f = pr.get_future().then_wrapped([] (future<> f) {
+        return f;
+    }).then_wrapped([] (future<> f) {
+        return f;
+    }).then_wrapped([] (future<> f) {
+        return f;
+    }).then_wrapped([] (future<> f) {
+        return f;
+    });
+    pr.set_value();
+    return f.then([] {
+        return 4;
+    });
+}
+
 #ifdef SEASTAR_COROUTINES_ENABLED
 
 PERF_TEST_C(parallel_for_each, cor_empty)
@@ -0,0 +1,78 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+
+#include <seastar/testing/perf_tests.hh>
+#include <seastar/http/request_parser.hh>
+
+using namespace seastar;
+
+// A browser's request: a head of about 500 bytes with a dozen fields
+struct http_request_parser_perf {
+    sstring msg =
+        "GET /api/v1/resource17/1234/sub3/42?format=json&verbose=true HTTP/1.1\r\n"
+        "Host: www.example.com\r\n"
+        "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:109.0) Gecko/20100101 Firefox/115.0\r\n"
+        "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,*/*;q=0.8\r\n"
+        "Accept-Language: en-US,en;q=0.5\r\n"
+        "Accept-Encoding: gzip, deflate, br\r\n"
+        "Referer: https://www.example.com/index.html\r\n"
+        "Connection: keep-alive\r\n"
+        "Cookie: session=0123456789abcdef0123456789abcdef; theme=dark\r\n"
+        "Upgrade-Insecure-Requests: 1\r\n"
+        "Sec-Fetch-Dest: document\r\n"
+        "Sec-Fetch-Mode: navigate\r\n"
+        "Cache-Control: max-age=0\r\n"
+        "\r\n";
+    http_request_parser parser;
+
+    // A split after the first byte keeps the head from the scanner
+    size_t parse(size_t split) {
+        parser.init();
+        if (split) {
+            parser(temporary_buffer<char>(msg.c_str(), split)).get0();
+        }
+        parser(temporary_buffer<char>(msg.c_str() + split, msg.size() - split)).get0();
+        return parser.get_parsed_request()->get_header("Cookie").size();
+    }
+};
+
+PERF_TEST_F(http_request_parser_perf, scanned)
+{
+    perf_tests::do_not_optimize(parse(0));
+}
+
+PERF_TEST_F(http_request_parser_perf, machine)
+{
+    perf_tests::do_not_optimize(parse(1));
+}
+
+PERF_TEST_F(http_request_parser_perf, scanned_header_views)
+{
+    parser.set_header_views(true);
+    perf_tests::do_not_optimize(parse(0));
+}
+
+PERF_TEST_F(http_request_parser_perf, machine_header_views)
+{
+    parser.set_header_views(true);
+    perf_tests::do_not_optimize(parse(1));
+}
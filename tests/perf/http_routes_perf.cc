@@ -0,0 +1,91 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#include <seastar/testing/perf_tests.hh>
+#include <seastar/http/routes.hh>
+#include <seastar/http/function_handlers.hh>
+
+using namespace seastar;
+using namespace httpd;
+
+// Routing of a REST API with a few hundred endpoints, most of them with
+// parameters, like /api/v1/resource17/{id}/sub3/{sub_id}.
+struct http_routes {
+    static constexpr int resources = 50;
+    static constexpr int subresources = 5;
+
+    routes r;
+    parameters params;
+
+    http_routes() {
+        for (int i = 0; i < resources; i++) {
+            auto prefix = format("/api/v1/resource{}", i);
+            r.put(GET, prefix, make_handler());
+            add_rule().add_str(prefix).add_param("id");
+            for (int j = 0; j < subresources; j++) {
+                auto sub = format("/sub{}", j);
+                add_rule().add_str(prefix).add_param("id").add_str(sub);
+                add_rule().add_str(prefix).add_param("id").add_str(sub).add_param("sub_id");
+            }
+        }
+        r.add(GET, url("/static").remainder("path"), make_handler());
+    }
+
+    static handler_base* make_handler() {
+        return new function_handler([] (const_req req) { return ""; });
+    }
+
+    match_rule& add_rule() {
+        auto rule = new match_rule(make_handler());
+        r.add(rule, GET);
+        return *rule;
+    }
+
+    handler_base* lookup(const sstring& url) {
+        params.clear();
+        return r.get_handler(GET, url, params);
+    }
+};
+
+PERF_TEST_F(http_routes, exact)
+{
+    perf_tests::do_not_optimize(lookup("/api/v1/resource25"));
+}
+
+PERF_TEST_F(http_routes, param_first)
+{
+    perf_tests::do_not_optimize(lookup("/api/v1/resource0/42"));
+}
+
+PERF_TEST_F(http_routes, param_last)
+{
+    perf_tests::do_not_optimize(lookup("/api/v1/resource49/42/sub4/7"));
+}
+
+PERF_TEST_F(http_routes, remainder)
+{
+    perf_tests::do_not_optimize(lookup("/static/css/site/main.css"));
+}
+
+PERF_TEST_F(http_routes, not_found)
+{
+    perf_tests::do_not_optimize(lookup("/api/v2/resource49/42/sub4/7"));
+}
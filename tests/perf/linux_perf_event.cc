@@ -92,3 +92,46 @@ linux_perf_event::user_instructions_retired() {
             .exclude_hv = 1,
             }, 0, -1, -1, 0);
 }
+
+static linux_perf_event
+user_event(uint32_t type, uint64_t config, int group_fd) {
+    // Members of a group are enabled along with their leader
+    return linux_perf_event(perf_event_attr{
+            .type = type,
+            .size = sizeof(struct perf_event_attr),
+            .config = config,
+            .disabled = group_fd == -1,
+            .exclude_kernel = 1,
+            .exclude_hv = 1,
+            }, 0, -1, group_fd, 0);
+}
+
+static constexpr uint64_t
+cache_event(perf_hw_cache_id cache, perf_hw_cache_op_id op, perf_hw_cache_op_result_id result) {
+    return cache | (op << 8) | (result << 16);
+}
+
+linux_perf_event
+linux_perf_event::user_cpu_cycles(int group_fd) {
+    return user_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, group_fd);
+}
+
+linux_perf_event
+linux_perf_event::user_l1d_read_misses(int group_fd) {
+    return user_event(PERF_TYPE_HW_CACHE, cache_event(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS), group_fd);
+}
+
+linux_perf_event
+linux_perf_event::user_llc_misses(int group_fd) {
+    return user_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, group_fd);
+}
+
+linux_perf_event
+linux_perf_event::user_branch_misses(int group_fd) {
+    return user_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, group_fd);
+}
+
+linux_perf_event
+linux_perf_event::user_dtlb_read_misses(int group_fd) {
+    return user_event(PERF_TYPE_HW_CACHE, cache_event(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS), group_fd);
+}
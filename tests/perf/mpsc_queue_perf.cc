@@ -0,0 +1,121 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#include <seastar/testing/perf_tests.hh>
+#include <seastar/core/mpsc_queue.hh>
+#include <seastar/core/loop.hh>
+#include <seastar/core/when_all.hh>
+#include <seastar/util/later.hh>
+#include <boost/lockfree/spsc_queue.hpp>
+#include <boost/range/irange.hpp>
+#include <memory>
+#include <vector>
+
+using namespace seastar;
+
+// All shards but the first feed items to the first one, through one
+// mpsc_queue, or through a single-producer queue per shard which the
+// consumer polls in turn. Run with --smp 64 or more to see how either
+// scales with the number of producers.
+struct fan_in {
+    static constexpr size_t per_shard = 10000;
+    static constexpr size_t capacity = 1024;
+
+    using spsc_queue = boost::lockfree::spsc_queue<size_t, boost::lockfree::capacity<capacity>>;
+
+    mpsc_queue<size_t> mpsc{capacity};
+    std::vector<std::unique_ptr<spsc_queue>> spsc;
+
+    fan_in() {
+        for (unsigned i = 0; i < smp::count; i++) {
+            spsc.push_back(std::make_unique<spsc_queue>());
+        }
+    }
+    ~fan_in() {
+        mpsc.stop().get();
+    }
+
+    static size_t total() noexcept {
+        return per_shard * (smp::count - 1);
+    }
+
+    future<size_t> run_mpsc() {
+        auto producers = smp::invoke_on_others(0, [this] {
+            return do_with(boost::irange(size_t(0), per_shard), [this] (auto& items) {
+                return do_for_each(items, [this] (size_t i) {
+                    return mpsc.push(i);
+                });
+            });
+        });
+        auto consumer = do_with(size_t(0), [this] (size_t& received) {
+            return do_until([&received] { return received == total(); }, [this, &received] {
+                return mpsc.wait_not_empty().then([this, &received] {
+                    received += mpsc.consume([] (size_t i) noexcept {
+                        perf_tests::do_not_optimize(i);
+                    });
+                });
+            });
+        });
+        return when_all_succeed(std::move(producers), std::move(consumer)).then_unpack([] {
+            return total();
+        });
+    }
+
+    future<size_t> run_spsc() {
+        auto producers = smp::invoke_on_others(0, [this] {
+            auto& q = *spsc[this_shard_id()];
+            return do_with(size_t(0), [&q] (size_t& i) {
+                return do_until([&i] { return i == per_shard; }, [&q, &i] {
+                    if (q.push(i)) {
+                        i++;
+                        return make_ready_future<>();
+                    }
+                    return yield();
+                });
+            });
+        });
+        auto consumer = do_with(size_t(0), [this] (size_t& received) {
+            return do_until([&received] { return received == total(); }, [this, &received] {
+                size_t got = 0;
+                for (unsigned s = 1; s < smp::count; s++) {
+                    got += spsc[s]->consume_all([] (size_t i) {
+                        perf_tests::do_not_optimize(i);
+                    });
+                }
+                received += got;
+                return got ? make_ready_future<>() : yield();
+            });
+        });
+        return when_all_succeed(std::move(producers), std::move(consumer)).then_unpack([] {
+            return total();
+        });
+    }
+};
+
+PERF_TEST_F(fan_in, mpsc_queue)
+{
+    return run_mpsc();
+}
+
+PERF_TEST_F(fan_in, spsc_queues)
+{
+    return run_spsc();
+}
@@ -27,6 +27,7 @@
 #include <boost/range.hpp>
 #include <boost/range/adaptors.hpp>
 #include <boost/range/algorithm.hpp>
+#include <boost/algorithm/string.hpp>
 
 #include <fmt/ostream.h>
 
@@ -123,11 +124,74 @@ uint64_t perf_stats::perf_tasks_processed() {
     return engine().get_sched_stats().tasks_processed;
 }
 
-perf_stats perf_stats::snapshot(linux_perf_event* instructions_retired_counter) {
+static const char* hw_counter_name(hw_counter c) {
+    switch (c) {
+    case hw_counter::cycles: return "cycles";
+    case hw_counter::l1d_misses: return "l1d-misses";
+    case hw_counter::llc_misses: return "llc-misses";
+    case hw_counter::branch_misses: return "branch-misses";
+    case hw_counter::dtlb_misses: return "dtlb-misses";
+    }
+    return "";
+}
+
+void perf_counters::open(hw_counter c) {
+    auto leader = _instructions_retired.fd();
+    auto& event = _hw[unsigned(c)];
+    switch (c) {
+    case hw_counter::cycles: event = linux_perf_event::user_cpu_cycles(leader); break;
+    case hw_counter::l1d_misses: event = linux_perf_event::user_l1d_read_misses(leader); break;
+    case hw_counter::llc_misses: event = linux_perf_event::user_llc_misses(leader); break;
+    case hw_counter::branch_misses: event = linux_perf_event::user_branch_misses(leader); break;
+    case hw_counter::dtlb_misses: event = linux_perf_event::user_dtlb_read_misses(leader); break;
+    }
+}
+
+void perf_counters::close() noexcept {
+    for (auto& event : _hw) {
+        event.reset();
+    }
+}
+
+void perf_counters::enable() {
+    _instructions_retired.enable();
+    if (_instructions_retired.fd() == -1) {
+        // Not in a group
+        for (auto& event : _hw) {
+            if (event) {
+                event->enable();
+            }
+        }
+    }
+}
+
+void perf_counters::disable() {
+    _instructions_retired.disable();
+    if (_instructions_retired.fd() == -1) {
+        for (auto& event : _hw) {
+            if (event) {
+                event->disable();
+            }
+        }
+    }
+}
+
+hw_counter_values perf_counters::read_hw() {
+    hw_counter_values values = {};
+    for (unsigned i = 0; i < nr_hw_counters; i++) {
+        if (_hw[i]) {
+            values[i] = _hw[i]->read();
+        }
+    }
+    return values;
+}
+
+perf_stats perf_stats::snapshot(perf_counters* counters) {
     return perf_stats(
         perf_mallocs(),
         perf_tasks_processed(),
-        instructions_retired_counter ? instructions_retired_counter->read() : 0
+        counters ? counters->instructions_retired() : 0,
+        counters ? counters->read_hw() : hw_counter_values{}
     );
 }
 
@@ -149,6 +213,16 @@ struct config {
     unsigned number_of_runs;
     std::vector<std::unique_ptr<result_printer>> printers;
     unsigned random_seed = 0;
+    // Time each call, one after the other
+    bool latency = false;
+    // Calls per second in an open loop, or zero
+    double rate = 0;
+    // Counted along with the retired instructions
+    std::vector<hw_counter> hw_counters;
+
+    bool records_latencies() const {
+        return latency || rate;
+    }
 };
 
 struct result {
@@ -165,6 +239,16 @@ struct result {
     double allocs = 0.;
     double tasks = 0.;
     double inst = 0.;
+    // Per iteration, indexed by hw_counter
+    std::array<double, nr_hw_counters> hw = {};
+
+    // Latencies of calls, over all runs, in the latency modes
+    uint64_t calls = 0;
+    double p50 = 0.;
+    double p90 = 0.;
+    double p99 = 0.;
+    double p999 = 0.;
+    double max_latency = 0.;
 };
 
 
@@ -191,27 +275,69 @@ static inline std::ostream& operator<<(std::ostream& os, duration d)
 
 static constexpr auto header_format_string = "{:<40} {:>11} {:>11} {:>11} {:>11} {:>11} {:>11} {:>11} {:>11}\n";
 static constexpr auto        format_string = "{:<40} {:>11} {:>11} {:>11} {:>11} {:>11} {:>11.3f} {:>11.3f} {:>11.1f}\n";
+static constexpr auto latency_header_format_string = "{:<40} {:>11} {:>11} {:>11} {:>11} {:>11} {:>11} {:>11} {:>11} {:>11}\n";
+static constexpr auto        latency_format_string = "{:<40} {:>11} {:>11} {:>11} {:>11} {:>11} {:>11} {:>11} {:>11.3f} {:>11.3f}\n";
 
 struct stdout_printer final : result_printer {
+  bool _latency = false;
+  std::vector<hw_counter> _hw_counters;
+
   virtual void print_configuration(const config& c) override {
-    fmt::print("{:<25} {}\n{:<25} {}\n{:<25} {}\n{:<25} {}\n{:<25} {}\n\n",
+    fmt::print("{:<25} {}\n{:<25} {}\n{:<25} {}\n{:<25} {}\n{:<25} {}\n",
                "single run iterations:", c.single_run_iterations,
                "single run duration:", duration { double(c.single_run_duration.count()) },
                "number of runs:", c.number_of_runs,
                "number of cores:", smp::count,
                "random seed:", c.random_seed);
-    fmt::print(header_format_string, "test", "iterations", "median", "mad", "min", "max", "allocs", "tasks", "inst");
+    if (c.rate) {
+        fmt::print("{:<25} {}/s\n", "open loop rate:", c.rate);
+    }
+    fmt::print("\n");
+    _latency = c.records_latencies();
+    _hw_counters = c.hw_counters;
+    auto header = _latency
+        ? fmt::format(latency_header_format_string, "test", "calls", "median", "p50", "p90", "p99", "p999", "max", "allocs", "tasks")
+        : fmt::format(header_format_string, "test", "iterations", "median", "mad", "min", "max", "allocs", "tasks", "inst");
+    header.pop_back();
+    for (auto hc : _hw_counters) {
+        header += fmt::format(" {:>13}", hw_counter_name(hc));
+    }
+    fmt::print("{}\n", header);
+  }
+
+  void print_hw_counters(const result& r) {
+    for (auto hc : _hw_counters) {
+        fmt::print(" {:>13.3f}", r.hw[unsigned(hc)]);
+    }
+    fmt::print("\n");
   }
 
   virtual void print_result(const result& r) override {
-    fmt::print(format_string, r.test_name, r.total_iterations / r.runs, duration { r.median },
+    if (_latency) {
+        auto line = fmt::format(latency_format_string, r.test_name, r.calls / r.runs, duration { r.median },
+                   duration { r.p50 }, duration { r.p90 }, duration { r.p99 }, duration { r.p999 },
+                   duration { r.max_latency }, r.allocs, r.tasks);
+        line.pop_back();
+        fmt::print("{}", line);
+        print_hw_counters(r);
+        return;
+    }
+    auto line = fmt::format(format_string, r.test_name, r.total_iterations / r.runs, duration { r.median },
                duration { r.mad }, duration { r.min }, duration { r.max },
                r.allocs, r.tasks, r.inst);
+    line.pop_back();
+    fmt::print("{}", line);
+    print_hw_counters(r);
   }
 };
 
+// Results are keyed by test name, and times are in nanoseconds per
+// iteration, so that the files of different runs can be compared; the
+// configuration tells whether they were run the same way.
 class json_printer final : public result_printer {
     std::string _output_file;
+    std::vector<hw_counter> _hw_counters;
+    std::unordered_map<std::string, double> _configuration;
     std::unordered_map<std::string,
                        std::unordered_map<std::string,
                                           std::unordered_map<std::string, double>>> _root;
@@ -220,10 +346,22 @@ class json_printer final : public result_printer {
 
     ~json_printer() {
         std::ofstream out(_output_file);
-        out << json::formatter::to_json(_root);
+        auto results = json::formatter::to_json(_root);
+        // Adds the configuration next to the results
+        results.resize(results.size() - 1);
+        out << results << ",\"configuration\":" << json::formatter::to_json(_configuration) << "}";
     }
 
-    virtual void print_configuration(const config&) override { }
+    virtual void print_configuration(const config& c) override {
+        _configuration["single_run_iterations"] = c.single_run_iterations;
+        _configuration["single_run_duration_ns"] = c.single_run_duration.count();
+        _configuration["runs"] = c.number_of_runs;
+        _configuration["cores"] = smp::count;
+        _configuration["random_seed"] = c.random_seed;
+        _configuration["latency"] = c.records_latencies();
+        _configuration["rate"] = c.rate;
+        _hw_counters = c.hw_counters;
+    }
 
     virtual void print_result(const result& r) override {
         auto& result = _root["results"][r.test_name];
@@ -236,6 +374,17 @@ class json_printer final : public result_printer {
         result["allocs"] = r.allocs;
         result["tasks"] = r.tasks;
         result["inst"] = r.inst;
+        for (auto hc : _hw_counters) {
+            result[hw_counter_name(hc)] = r.hw[unsigned(hc)];
+        }
+        if (r.calls) {
+            result["calls"] = r.calls;
+            result["p50"] = r.p50;
+            result["p90"] = r.p90;
+            result["p99"] = r.p99;
+            result["p999"] = r.p999;
+            result["max_latency"] = r.max_latency;
+        }
     }
 };
 
@@ -250,8 +399,15 @@ void performance_test::do_run(const config& conf)
         _max_single_run_iterations.store(0, std::memory_order_relaxed);
     });
 
-    // dry run, estimate the number of iterations
-    if (conf.single_run_duration.count()) {
+    auto interval = clock_type::duration(0);
+    if (conf.rate) {
+        // The number of calls is set by the rate, not by the speed of the test
+        interval = std::chrono::duration_cast<clock_type::duration>(std::chrono::duration<double>(1 / conf.rate));
+        if (!conf.single_run_iterations) {
+            _max_single_run_iterations = std::max<uint64_t>(1, std::chrono::duration<double>(conf.single_run_duration).count() * conf.rate);
+        }
+    } else if (conf.single_run_duration.count()) {
+        // dry run, estimate the number of iterations
         // switch out of seastar thread
         yield().then([&] {
             tmr.arm(conf.single_run_duration);
@@ -263,6 +419,8 @@ void performance_test::do_run(const config& conf)
     }
 
     result r{};
+    _latencies.reset();
+    _max_latency = 0;
 
     auto results = std::vector<double>(conf.number_of_runs);
     uint64_t total_iterations = 0;
@@ -270,7 +428,8 @@ void performance_test::do_run(const config& conf)
         // switch out of seastar thread
         yield().then([&] {
             _single_run_iterations = 0;
-            return do_single_run().then([&] (run_result rr) {
+            auto run = conf.records_latencies() ? do_latency_run(interval) : do_single_run();
+            return run.then([&] (run_result rr) {
                 clock_type::duration dt = rr.duration;
                 double ns = std::chrono::duration_cast<std::chrono::nanoseconds>(dt).count();
                 results[i] = ns / _single_run_iterations;
@@ -280,6 +439,9 @@ void performance_test::do_run(const config& conf)
                 r.allocs += double(rr.stats.allocations) / _single_run_iterations;
                 r.tasks += double(rr.stats.tasks_executed) / _single_run_iterations;
                 r.inst += double(rr.stats.instructions_retired) / _single_run_iterations;
+                for (unsigned i = 0; i < nr_hw_counters; i++) {
+                    r.hw[i] += double(rr.stats.hw[i]) / _single_run_iterations;
+                }
             });
         }).get();
     }
@@ -305,6 +467,18 @@ void performance_test::do_run(const config& conf)
     r.allocs /= conf.number_of_runs;
     r.tasks /= conf.number_of_runs;
     r.inst /= conf.number_of_runs;
+    for (auto& v : r.hw) {
+        v /= conf.number_of_runs;
+    }
+
+    if (conf.records_latencies()) {
+        r.calls = _latencies.count();
+        r.p50 = _latencies.quantile(0.5);
+        r.p90 = _latencies.quantile(0.9);
+        r.p99 = _latencies.quantile(0.99);
+        r.p999 = _latencies.quantile(0.999);
+        r.max_latency = _max_latency;
+    }
 
     for (auto& rp : conf.printers) {
         rp->print_result(r);
@@ -313,14 +487,20 @@ void performance_test::do_run(const config& conf)
 
 void performance_test::run(const config& conf)
 {
+    // Tests only hold counters while they run, as the PMU has few of them
+    for (auto hc : conf.hw_counters) {
+        _counters.open(hc);
+    }
     set_up();
     try {
         do_run(conf);
     } catch (...) {
         tear_down();
+        _counters.close();
         throw;
     }
     tear_down();
+    _counters.close();
 }
 
 std::vector<std::unique_ptr<performance_test>>& all_tests()
@@ -371,6 +551,12 @@ int main(int ac, char** av)
             "random number generator seed")
         ("no-stdout", "do not print to stdout")
         ("json-output", bpo::value<std::string>(), "output json file")
+        ("latency", "time each call of the tests, and report latency percentiles")
+        ("counters", bpo::value<std::string>()->default_value(""),
+            "comma separated hardware counters to report per iteration, of cycles, l1d-misses, llc-misses, "
+            "branch-misses and dtlb-misses, or all")
+        ("rate", bpo::value<double>(), "call the tests at this rate per second, without waiting for previous calls "
+            "to complete, and report latency percentiles from when each call was due")
         ("list", "list available tests")
         ;
 
@@ -384,6 +570,27 @@ int main(int ac, char** av)
             conf.single_run_duration = std::chrono::duration_cast<std::chrono::nanoseconds>(dur);
             conf.number_of_runs = app.configuration()["runs"].as<size_t>();
             conf.random_seed = app.configuration()["random-seed"].as<unsigned>();
+            conf.latency = app.configuration().count("latency");
+            if (app.configuration().count("rate")) {
+                conf.rate = app.configuration()["rate"].as<double>();
+            }
+            std::vector<std::string> counters;
+            boost::split(counters, app.configuration()["counters"].as<std::string>(), boost::is_any_of(","), boost::token_compress_on);
+            for (auto& name : counters) {
+                bool found = false;
+                for (unsigned i = 0; i < nr_hw_counters; i++) {
+                    auto hc = hw_counter(i);
+                    if (name == "all" || name == hw_counter_name(hc)) {
+                        if (boost::range::find(conf.hw_counters, hc) == conf.hw_counters.end()) {
+                            conf.hw_counters.push_back(hc);
+                        }
+                        found = true;
+                    }
+                }
+                if (!found && !name.empty()) {
+                    throw std::invalid_argument(fmt::format("unknown hardware counter: {}", name));
+                }
+            }
 
             std::vector<std::string> tests_to_run;
             if (app.configuration().count("test")) {
@@ -23,6 +23,7 @@
 
 #include <seastar/rpc/lz4_compressor.hh>
 #include <seastar/rpc/lz4_fragmented_compressor.hh>
+#include <seastar/rpc/zstd_compressor.hh>
 
 #include <seastar/testing/perf_tests.hh>
 #include <seastar/testing/random.hh>
@@ -74,6 +75,12 @@ struct compression {
         return seastar::rpc::snd_buf(input.share());
     }
 
+    static double ratio(size_t size, const std::vector<temporary_buffer<char>>& compressed) {
+        auto compressed_size = std::accumulate(compressed.begin(), compressed.end(), size_t(0),
+            [] (size_t n, const temporary_buffer<char>& buf) { return n + buf.size(); });
+        return double(size) / compressed_size;
+    }
+
 public:
     compression()
         : _small_buffer_random(seastar::temporary_buffer<char>(small_buffer_size))
@@ -129,6 +136,14 @@ struct compression {
             _large_compressed_buffer_zeroes
                 = std::move(std::get<std::vector<seastar::temporary_buffer<char>>>(rcv.bufs));
         }
+
+        static bool ratio_reported = false;
+        if (!std::exchange(ratio_reported, true)) {
+            fmt::print("{} compression ratio: small random {:.3f}, small zeroes {:.3f}, large random {:.3f}, large zeroes {:.3f}\n",
+                _compressor.name(),
+                ratio(small_buffer_size, _small_compressed_buffer_random), ratio(small_buffer_size, _small_compressed_buffer_zeroes),
+                ratio(large_buffer_size, _large_compressed_buffer_random), ratio(large_buffer_size, _large_compressed_buffer_zeroes));
+        }
     }
 
     Compressor& compressor() { return _compressor; }
@@ -261,3 +276,57 @@ PERF_TEST_F(lz4_fragmented, large_zeroed_buffer_decompress) {
         compressor().decompress(large_compressed_buffer_zeroes())
     );
 }
+
+#ifdef SEASTAR_HAVE_ZSTD
+
+using zstd = compression<seastar::rpc::zstd_compressor>;
+
+PERF_TEST_F(zstd, small_random_buffer_compress) {
+    perf_tests::do_not_optimize(
+        compressor().compress(0, small_buffer_random())
+    );
+}
+
+PERF_TEST_F(zstd, small_zeroed_buffer_compress) {
+    perf_tests::do_not_optimize(
+        compressor().compress(0, small_buffer_zeroes())
+    );
+}
+
+PERF_TEST_F(zstd, large_random_buffer_compress) {
+    perf_tests::do_not_optimize(
+        compressor().compress(0, large_buffer_random())
+    );
+}
+
+PERF_TEST_F(zstd, large_zeroed_buffer_compress) {
+    perf_tests::do_not_optimize(
+        compressor().compress(0, large_buffer_zeroes())
+    );
+}
+
+PERF_TEST_F(zstd, small_random_buffer_decompress) {
+    perf_tests::do_not_optimize(
+        compressor().decompress(small_compressed_buffer_random())
+    );
+}
+
+PERF_TEST_F(zstd, small_zeroed_buffer_decompress) {
+    perf_tests::do_not_optimize(
+        compressor().decompress(small_compressed_buffer_zeroes())
+    );
+}
+
+PERF_TEST_F(zstd, large_random_buffer_decompress) {
+    perf_tests::do_not_optimize(
+        compressor().decompress(large_compressed_buffer_random())
+    );
+}
+
+PERF_TEST_F(zstd, large_zeroed_buffer_decompress) {
+    perf_tests::do_not_optimize(
+        compressor().decompress(large_compressed_buffer_zeroes())
+    );
+}
+
+#endif
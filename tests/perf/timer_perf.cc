@@ -0,0 +1,130 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#include <seastar/testing/perf_tests.hh>
+#include <seastar/core/timer-wheel.hh>
+#include <chrono>
+#include <random>
+#include <vector>
+
+using namespace seastar;
+using namespace std::chrono_literals;
+
+// Many per-request timeouts, of a few seconds, of which most are cancelled
+// and a few expire, as in rpc clients and the TCP stack; compares timer_set
+// with timer_wheel.
+
+struct perf_timer {
+    using clock = std::chrono::steady_clock;
+    using duration = clock::duration;
+    using time_point = clock::time_point;
+
+    boost::intrusive::list_member_hook<> link;
+    time_point expiry;
+
+    time_point get_timeout() const noexcept { return expiry; }
+    // Timers are all removed before the containers are destroyed
+    bool cancel() noexcept { abort(); }
+};
+
+template <typename Container>
+struct timers {
+    static constexpr size_t armed = 100000;
+    static constexpr size_t batch = 1000;
+
+    Container container;
+    std::vector<perf_timer> pool = std::vector<perf_timer>(armed + batch);
+    std::vector<perf_timer::duration> timeouts;
+    perf_timer::time_point now;
+    size_t next = 0;
+
+    timers() {
+        std::default_random_engine rnd;
+        std::uniform_int_distribution<int64_t> ms(1000, 10000);
+        for (size_t i = 0; i < pool.size(); i++) {
+            timeouts.push_back(std::chrono::milliseconds(ms(rnd)));
+        }
+        for (size_t i = 0; i < armed; i++) {
+            arm(pool[i], i);
+        }
+    }
+
+    ~timers() {
+        for (size_t i = 0; i < armed; i++) {
+            container.remove(pool[i]);
+        }
+    }
+
+    void arm(perf_timer& t, size_t i) {
+        t.expiry = now + timeouts[i];
+        container.insert(t);
+    }
+
+    // Arms a batch of timers, and cancels them
+    size_t arm_cancel() {
+        auto first = pool.begin() + armed;
+        for (size_t i = 0; i < batch; i++) {
+            arm(first[i], armed + i);
+        }
+        for (size_t i = 0; i < batch; i++) {
+            container.remove(first[i]);
+        }
+        return batch;
+    }
+
+    // Advances time by a millisecond, and rearms what expired
+    size_t expire() {
+        now += 1ms;
+        auto exp = container.expire(now);
+        size_t n = 0;
+        while (!exp.empty()) {
+            auto& t = exp.front();
+            exp.pop_front();
+            arm(t, &t - pool.data());
+            n++;
+        }
+        perf_tests::do_not_optimize(container.get_next_timeout());
+        return std::max<size_t>(n, 1);
+    }
+};
+
+using timer_set_timers = timers<timer_set<perf_timer, &perf_timer::link>>;
+using timer_wheel_timers = timers<timer_wheel<perf_timer, &perf_timer::link>>;
+
+PERF_TEST_F(timer_set_timers, arm_cancel)
+{
+    return arm_cancel();
+}
+
+PERF_TEST_F(timer_wheel_timers, arm_cancel)
+{
+    return arm_cancel();
+}
+
+PERF_TEST_F(timer_set_timers, expire)
+{
+    return expire();
+}
+
+PERF_TEST_F(timer_wheel_timers, expire)
+{
+    return expire();
+}
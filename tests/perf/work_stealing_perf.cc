@@ -0,0 +1,95 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#include <boost/range/irange.hpp>
+#include <fmt/core.h>
+#include <seastar/core/app-template.hh>
+#include <seastar/core/thread.hh>
+#include <seastar/core/loop.hh>
+#include <seastar/core/smp.hh>
+#include <seastar/core/scheduling.hh>
+#include <seastar/core/with_scheduling_group.hh>
+
+using namespace seastar;
+using namespace std::chrono;
+
+// Loads shard 0 with CPU-bound work submitted via smp::submit_stealable()
+// and reports how fast it drains, and where it ran, with the scheduling
+// group migratable and not.
+
+static shard_id spin(microseconds think) {
+    auto until = steady_clock::now() + think;
+    while (steady_clock::now() < until) {
+        ; // do nothing
+    }
+    return this_shard_id();
+}
+
+static void run(scheduling_group sg, bool migratable, unsigned tasks, unsigned concurrency, microseconds think) {
+    smp::invoke_on_all([sg, migratable] () mutable {
+        sg.set_migratable(migratable);
+    }).get();
+
+    std::vector<uint64_t> ran_on(smp::count, 0);
+    unsigned submitted = 0;
+    auto start = steady_clock::now();
+    with_scheduling_group(sg, [&] {
+        return parallel_for_each(boost::irange(0u, concurrency), [&] (unsigned) {
+            return do_until([&] { return submitted >= tasks; }, [&] {
+                submitted++;
+                return smp::submit_stealable([think] {
+                    return spin(think);
+                }).then([&ran_on] (shard_id where) {
+                    ran_on[where]++;
+                });
+            });
+        });
+    }).get();
+    auto took = duration_cast<duration<double>>(steady_clock::now() - start);
+
+    fmt::print("migratable={}: {} tasks in {:.3f}s, {:.1f} tasks/s\n", migratable, tasks, took.count(), tasks / took.count());
+    for (unsigned i = 0; i < smp::count; i++) {
+        fmt::print("  shard {:2}: {} tasks\n", i, ran_on[i]);
+    }
+}
+
+int main(int ac, char** av) {
+    app_template at;
+    namespace bpo = boost::program_options;
+    at.add_options()
+            ("tasks", bpo::value<unsigned>()->default_value(100000), "number of tasks to submit")
+            ("think", bpo::value<unsigned>()->default_value(50), "time (us) each task busyloops for")
+            ("concurrency", bpo::value<unsigned>()->default_value(256), "smp::submit_stealable operations to issue in parallel")
+        ;
+
+    return at.run(ac, av, [&at] {
+        auto tasks = at.configuration()["tasks"].as<unsigned>();
+        auto think = microseconds(at.configuration()["think"].as<unsigned>());
+        auto concurrency = at.configuration()["concurrency"].as<unsigned>();
+
+        return async([tasks, think, concurrency] {
+            auto sg = create_scheduling_group("stealable", 100).get0();
+            run(sg, false, tasks, concurrency, think);
+            run(sg, true, tasks, concurrency, think);
+            destroy_scheduling_group(sg).get();
+        });
+    });
+}
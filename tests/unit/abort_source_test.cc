@@ -25,6 +25,7 @@
 #include <seastar/core/gate.hh>
 #include <seastar/core/sleep.hh>
 #include <seastar/core/do_with.hh>
+#include <seastar/core/memory.hh>
 
 using namespace seastar;
 using namespace std::chrono_literals;
@@ -56,6 +57,29 @@ SEASTAR_TEST_CASE(test_abort_source_subscription_unregister) {
     return make_ready_future<>();
 }
 
+SEASTAR_THREAD_TEST_CASE(test_abort_source_subscription_does_not_allocate) {
+    bool signalled = false;
+    abort_source as;
+    auto before = memory::stats().mallocs();
+    {
+        auto sub = as.subscribe([&signalled] () noexcept {
+            signalled = true;
+        });
+        auto sub_ex = as.subscribe([&signalled] (const std::optional<std::exception_ptr>&) noexcept {
+            signalled = true;
+        });
+        // so that the subscriptions are not optimized away
+        BOOST_REQUIRE(sub && sub_ex);
+    }
+#ifndef SEASTAR_DEFAULT_ALLOCATOR
+    BOOST_REQUIRE_EQUAL(memory::stats().mallocs(), before);
+#endif
+    BOOST_REQUIRE(!as.abort_requested_exception_ptr());
+    as.request_abort();
+    BOOST_REQUIRE(!signalled);
+    BOOST_REQUIRE_THROW(std::rethrow_exception(as.abort_requested_exception_ptr()), abort_requested_exception);
+}
+
 SEASTAR_TEST_CASE(test_abort_source_rejects_subscription) {
     auto as = abort_source();
     as.request_abort();
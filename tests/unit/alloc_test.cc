@@ -20,9 +20,11 @@
  */
 
 #include <seastar/testing/test_case.hh>
+#include <seastar/testing/thread_test_case.hh>
 #include <seastar/core/memory.hh>
 #include <seastar/core/smp.hh>
 #include <seastar/core/temporary_buffer.hh>
+#include <seastar/core/thread.hh>
 #include <seastar/util/memory_diagnostics.hh>
 
 #include <vector>
@@ -75,6 +77,40 @@ SEASTAR_TEST_CASE(test_live_objects_counter_with_cross_cpu_free) {
     });
 }
 
+SEASTAR_THREAD_TEST_CASE(test_batched_cross_cpu_free_reaches_owner) {
+#ifndef SEASTAR_DEFAULT_ALLOCATOR
+    if (smp::count < 2) {
+        return;
+    }
+    auto live_on_owner = [] {
+        return smp::submit_to(1, [] {
+            memory::drain_cross_cpu_freelist();
+            return memory::stats().live_objects();
+        }).get0();
+    };
+    auto before = live_on_owner();
+    // Fewer objects than a full batch, so they are only handed back to
+    // shard 1 once this shard polls
+    auto vec = smp::submit_to(1, [] {
+        auto ret = std::vector<std::unique_ptr<int>>(10);
+        for (auto& o : ret) {
+            o = std::make_unique<int>(0);
+        }
+        return ret;
+    }).get0();
+    auto frees_before = memory::stats().cross_cpu_frees();
+    vec.clear();
+    vec.shrink_to_fit();
+    BOOST_REQUIRE_GE(memory::stats().cross_cpu_frees() - frees_before, 10);
+    // leave some slack for unrelated allocations on shard 1
+    auto returned = [&] { return live_on_owner() < before + 5; };
+    for (int i = 0; i < 1000 && !returned(); ++i) {
+        thread::yield();
+    }
+    BOOST_REQUIRE(returned());
+#endif
+}
+
 SEASTAR_TEST_CASE(test_aligned_alloc) {
     for (size_t align = sizeof(void*); align <= 65536; align <<= 1) {
         for (size_t size = align; size <= align * 2; size <<= 1) {
@@ -212,3 +248,180 @@ SEASTAR_TEST_CASE(test_large_allocation_warning_off_by_one) {
 #endif
     return make_ready_future<>();
 }
+
+SEASTAR_TEST_CASE(test_free_huge_pages) {
+#ifndef SEASTAR_DEFAULT_ALLOCATOR
+    auto before = memory::stats().free_huge_pages();
+    BOOST_REQUIRE_LE(before * memory::huge_page_size, memory::stats().free_memory());
+    // A huge page sized allocation consumes a whole free huge page
+    auto obj = malloc(memory::huge_page_size);
+    BOOST_REQUIRE(obj != nullptr);
+    BOOST_REQUIRE_LT(memory::stats().free_huge_pages(), before);
+    free(obj);
+    BOOST_REQUIRE_EQUAL(memory::stats().free_huge_pages(), before);
+#endif
+    return make_ready_future<>();
+}
+
+SEASTAR_TEST_CASE(test_numa_stats) {
+    auto st = memory::numa_stats(128);
+    BOOST_REQUIRE_LE(st.misplaced_pages + st.unpopulated_pages, st.sampled_pages);
+    size_t bound = 0;
+    for (auto& n : st.nodes) {
+        bound += n.bound;
+    }
+    if (!st.nodes.empty()) {
+        // bound covers the memory handed to the shard by memory::configure()
+        BOOST_REQUIRE_GT(bound, 0);
+        BOOST_REQUIRE_LE(bound, memory::stats().total_memory());
+    }
+    return make_ready_future<>();
+}
+
+SEASTAR_TEST_CASE(test_sampled_heap_profile) {
+    memory::set_heap_profiling_sampling_interval(64 << 10);
+    {
+        memory::scoped_heap_profiling profiling;
+        std::vector<std::unique_ptr<char[]>> objs;
+        for (int i = 0; i < 1000; ++i) {
+            objs.push_back(std::make_unique<char[]>(1024));
+        }
+        auto profile = memory::generate_heap_profile();
+        // empty when compiled without heap profiling support
+        if (!profile.empty()) {
+            BOOST_REQUIRE_EQUAL(memory::get_heap_profiling_sampling_interval(), 64 << 10);
+            BOOST_REQUIRE(profile.find("heap profile: ") == 0);
+            BOOST_REQUIRE(profile.find("@ heap_v2/65536\n") != sstring::npos);
+            BOOST_REQUIRE(profile.find("MAPPED_LIBRARIES:") != sstring::npos);
+        }
+    }
+    memory::set_heap_profiling_sampling_interval(0);
+    return make_ready_future<>();
+}
+
+SEASTAR_TEST_CASE(test_top_allocation_sites) {
+    memory::set_heap_profiling_sampling_interval(64 << 10);
+    {
+        memory::scoped_heap_profiling profiling;
+        memory::snapshot_allocation_sites();
+        std::vector<std::unique_ptr<char[]>> objs;
+        for (int i = 0; i < 1000; ++i) {
+            objs.push_back(std::make_unique<char[]>(4096));
+        }
+        auto by_size = memory::top_allocation_sites(3);
+        auto by_growth = memory::top_allocation_sites(3, memory::allocation_site_order::growth);
+        // empty when compiled without heap profiling support
+        if (!by_size.empty()) {
+            BOOST_REQUIRE_LE(by_size.size(), 3u);
+            for (size_t i = 1; i < by_size.size(); ++i) {
+                BOOST_REQUIRE_GE(by_size[i - 1].size, by_size[i].size);
+            }
+            for (size_t i = 1; i < by_growth.size(); ++i) {
+                BOOST_REQUIRE_GE(by_growth[i - 1].growth, by_growth[i].growth);
+            }
+            // The estimate of the loop's 4M is scaled up from a few dozen samples
+            BOOST_REQUIRE_GE(by_growth.front().growth, 1 << 20);
+            auto report = memory::generate_memory_diagnostics_report();
+            BOOST_REQUIRE(report.find("Top allocation sites by retained memory:") != sstring::npos);
+            BOOST_REQUIRE(report.find("Top allocation sites by growth:") != sstring::npos);
+        }
+    }
+    memory::set_heap_profiling_sampling_interval(0);
+    return make_ready_future<>();
+}
+
+SEASTAR_THREAD_TEST_CASE(test_memory_pressure_listener) {
+#ifndef SEASTAR_DEFAULT_ALLOCATOR
+    auto old_min_free_pages = memory::min_free_memory() / memory::page_size;
+    std::vector<memory::memory_pressure> seen;
+    memory::memory_pressure_listener listener([&seen] (memory::memory_pressure p) {
+        seen.push_back(p);
+    });
+    // Moving the low water mark above the free memory puts us under
+    // critical pressure without actually exhausting memory
+    memory::set_min_free_pages(memory::free_memory() / memory::page_size + 1000);
+    BOOST_REQUIRE(memory::current_memory_pressure() == memory::memory_pressure::critical);
+    for (int i = 0; i < 100 && seen.empty(); ++i) {
+        thread::yield();
+    }
+    memory::set_min_free_pages(old_min_free_pages);
+    BOOST_REQUIRE(!seen.empty());
+    BOOST_REQUIRE(seen.front() == memory::memory_pressure::critical);
+    BOOST_REQUIRE(memory::current_memory_pressure() != memory::memory_pressure::critical);
+#endif
+}
+
+SEASTAR_TEST_CASE(test_span_allocation_stats) {
+#ifndef SEASTAR_DEFAULT_ALLOCATOR
+    auto before = memory::stats();
+    std::vector<void*> objs;
+    for (size_t size = 128 << 10; size <= 4 << 20; size *= 2) {
+        objs.push_back(malloc(size));
+        BOOST_REQUIRE(objs.back());
+    }
+    auto after = memory::stats();
+    BOOST_REQUIRE_GE(after.span_allocations() - before.span_allocations(), objs.size());
+    BOOST_REQUIRE_GE(after.span_splits(), before.span_splits());
+    for (auto p : objs) {
+        free(p);
+    }
+#endif
+    return make_ready_future<>();
+}
+
+SEASTAR_TEST_CASE(test_fragmentation_report_and_compaction) {
+#ifndef SEASTAR_DEFAULT_ALLOCATOR
+    constexpr size_t object_size = 1000;
+    std::vector<void*> objs;
+    for (int i = 0; i < 20000; ++i) {
+        objs.push_back(malloc(object_size));
+    }
+    // keep one object in 64, leaving sparse spans behind
+    std::vector<void*> kept;
+    for (size_t i = 0; i < objs.size(); ++i) {
+        if (i % 64) {
+            free(objs[i]);
+        } else {
+            kept.push_back(objs[i]);
+        }
+    }
+    objs.clear();
+
+    auto report = memory::get_fragmentation_report();
+    BOOST_REQUIRE_EQUAL(report.free_spans.size(), 32);
+    BOOST_REQUIRE_GT(report.largest_free_span, 0);
+    size_t sparse = 0;
+    for (auto& p : report.small_pools) {
+        BOOST_REQUIRE_LE(p.sparse_spans, p.spans);
+        BOOST_REQUIRE_LE(p.live_objects * p.object_size, p.memory);
+        sparse += p.sparse_spans;
+    }
+
+    size_t requests = 0;
+    memory::compactor c([&] (memory::compaction_request r) {
+        ++requests;
+        size_t moved = 0;
+        auto start = static_cast<const char*>(r.start);
+        for (auto& o : kept) {
+            auto p = static_cast<const char*>(o);
+            if (p >= start && p < start + r.size) {
+                auto n = malloc(object_size);
+                std::memcpy(n, o, object_size);
+                free(o);
+                o = n;
+                moved += object_size;
+            }
+        }
+        return moved;
+    });
+    auto moved = memory::compact_sparse_spans();
+    if (sparse) {
+        BOOST_REQUIRE_GT(requests, 0);
+    }
+    BOOST_REQUIRE_LE(moved, kept.size() * object_size);
+    for (auto o : kept) {
+        free(o);
+    }
+#endif
+    return make_ready_future<>();
+}
@@ -0,0 +1,116 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#include <seastar/testing/thread_test_case.hh>
+#include <seastar/util/log.hh>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace seastar;
+
+static logger test_logger("async_log_test");
+
+SEASTAR_THREAD_TEST_CASE(test_async_log) {
+    std::ostringstream out;
+    logger::set_ostream(out);
+    logger::set_with_color(false);
+    // Small enough for messages to be dropped
+    logger::set_async_enabled(true, 4096);
+    const int n = 10000;
+    for (int i = 0; i < n; i++) {
+        test_logger.info("message {}", i);
+    }
+    // Errors are never dropped
+    test_logger.error("the last message");
+    auto dropped = logger::async_dropped_messages();
+    logger::set_async_enabled(false);
+    logger::set_ostream(std::cerr);
+
+    BOOST_REQUIRE(out.str().find("the last message") != std::string::npos);
+    size_t lines = 0;
+    std::istringstream in(out.str());
+    int prev = -1;
+    for (std::string line; std::getline(in, line);) {
+        auto pos = line.find("message ");
+        if (line.find("async_log_test") == std::string::npos || pos == std::string::npos) {
+            continue;
+        }
+        auto i = std::stoi(line.substr(pos + 8));
+        // Messages of a shard come out in order
+        BOOST_REQUIRE_GT(i, prev);
+        prev = i;
+        lines++;
+    }
+    BOOST_REQUIRE_EQUAL(lines + dropped, size_t(n));
+}
+
+SEASTAR_THREAD_TEST_CASE(test_deferred_formatting) {
+    auto log_all = [] {
+        sstring ss = "sstring";
+        std::string s = "string";
+        const char* null_str = nullptr;
+        test_logger.info("{} {} {} {} {:x} {}", 1, -2L, uint8_t(3), 'c', 255u, true);
+        test_logger.info("{} {} {:.2f}", 0.1f, 0.1, 3.14159);
+        test_logger.info("{} {} {} {}", ss, s, std::string_view("view"), "literal");
+        test_logger.info("{}", static_cast<const void*>(&ss));
+        // Not deferred: the encoder has no long double
+        test_logger.info("{}", 1.5L);
+        // Not deferred either, and reported as a failure
+        test_logger.info("{}", null_str);
+        // The format string is not checked until formatted
+        test_logger.info("{} {}", 1);
+    };
+    auto messages = [] (const std::string& out) {
+        // Without the level and timestamp
+        std::vector<std::string> lines;
+        std::istringstream in(out);
+        for (std::string line; std::getline(in, line);) {
+            lines.push_back(line.substr(line.find(" - ")));
+        }
+        return lines;
+    };
+
+    logger::set_with_color(false);
+    std::ostringstream eager;
+    logger::set_ostream(eager);
+    logger::set_async_enabled(true);
+    log_all();
+    logger::set_async_enabled(false);
+
+    std::ostringstream deferred;
+    logger::set_ostream(deferred);
+    logger::set_async_enabled(true);
+    logger::set_deferred_formatting(true);
+    log_all();
+    logger::set_async_enabled(false);
+    logger::set_deferred_formatting(false);
+    logger::set_ostream(std::cerr);
+
+    auto expected = messages(eager.str());
+    auto actual = messages(deferred.str());
+    BOOST_REQUIRE_EQUAL(expected.size(), 7u);
+    for (size_t i = 0; i < expected.size() - 1; i++) {
+        BOOST_REQUIRE_EQUAL(actual[i], expected[i]);
+    }
+    BOOST_REQUIRE(actual.back().find("failed to log message") != std::string::npos);
+}
@@ -0,0 +1,148 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+
+#include <seastar/testing/thread_test_case.hh>
+
+#include <seastar/core/btree_map.hh>
+#include <map>
+#include <random>
+
+using namespace seastar;
+
+namespace {
+
+template <typename Map>
+void check_equal(const Map& b, const std::map<typename Map::key_type, typename Map::mapped_type>& m) {
+    BOOST_REQUIRE_EQUAL(b.size(), m.size());
+    auto it = b.begin();
+    for (auto& [k, v] : m) {
+        BOOST_REQUIRE(it != b.end());
+        BOOST_REQUIRE_EQUAL(it->first, k);
+        BOOST_REQUIRE_EQUAL(it->second, v);
+        ++it;
+    }
+    BOOST_REQUIRE(it == b.end());
+    for (auto r = m.rbegin(); r != m.rend(); ++r) {
+        --it;
+        BOOST_REQUIRE_EQUAL(it->first, r->first);
+    }
+}
+
+// Random inserts, erases and lookups, compared with std::map
+template <typename Key, size_t NodeSize, typename MakeKey>
+void test_random(MakeKey make_key) {
+    btree_map<Key, sstring, std::less<Key>, NodeSize> b;
+    std::map<Key, sstring> m;
+    std::mt19937 rng(std::random_device{}());
+    for (unsigned i = 0; i < 50000; i++) {
+        auto k = make_key(rng() % 2000);
+        switch (rng() % 8) {
+        case 0: case 1: case 2: case 3: {
+            auto v = to_sstring(i);
+            auto [it, inserted] = b.insert(k, v);
+            BOOST_REQUIRE_EQUAL(inserted, m.emplace(k, v).second);
+            BOOST_REQUIRE_EQUAL(it->first, k);
+            BOOST_REQUIRE_EQUAL(it->second, m[k]);
+            break;
+        }
+        case 4: case 5: case 6:
+            BOOST_REQUIRE_EQUAL(b.erase(k), m.erase(k));
+            break;
+        case 7: {
+            auto lb = b.lower_bound(k);
+            auto mlb = m.lower_bound(k);
+            BOOST_REQUIRE_EQUAL(lb == b.end(), mlb == m.end());
+            if (mlb != m.end()) {
+                BOOST_REQUIRE_EQUAL(lb->first, mlb->first);
+            }
+            auto ub = b.upper_bound(k);
+            auto mub = m.upper_bound(k);
+            BOOST_REQUIRE_EQUAL(ub == b.end(), mub == m.end());
+            if (mub != m.end()) {
+                BOOST_REQUIRE_EQUAL(ub->first, mub->first);
+            }
+            BOOST_REQUIRE_EQUAL(b.contains(k), m.contains(k));
+            break;
+        }
+        }
+        if (i % 10000 == 0) {
+            check_equal(b, m);
+        }
+    }
+    check_equal(b, m);
+    for (auto it = b.begin(); it != b.end();) {
+        m.erase(it->first);
+        it = b.erase(it);
+    }
+    BOOST_REQUIRE(b.empty());
+    BOOST_REQUIRE(m.empty());
+}
+
+}
+
+SEASTAR_THREAD_TEST_CASE(test_btree_map_random) {
+    test_random<int, 4>([] (unsigned i) { return int(i); });
+    test_random<int64_t, 64>([] (unsigned i) { return int64_t(i) - 1000; });
+    test_random<sstring, 5>([] (unsigned i) { return to_sstring(i); });
+}
+
+SEASTAR_THREAD_TEST_CASE(test_btree_map_access) {
+    btree_map<int, int> b;
+    b[3] += 1;
+    b[3] += 1;
+    BOOST_REQUIRE_EQUAL(b[3], 2);
+    BOOST_REQUIRE(!b.try_emplace(3, 7).second);
+    BOOST_REQUIRE_EQUAL(b.find(3)->second, 2);
+    BOOST_REQUIRE(b.find(4) == b.end());
+
+    auto moved = std::move(b);
+    BOOST_REQUIRE(b.empty());
+    BOOST_REQUIRE_EQUAL(moved.size(), 1u);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_btree_map_clear_gently) {
+    btree_map<uint64_t, uint64_t, std::less<uint64_t>, 8> b;
+    for (uint64_t i = 0; i < 100000; i++) {
+        b.insert(i, i);
+    }
+    auto f = b.clear_gently();
+    // The map is empty and usable while the nodes are being freed
+    BOOST_REQUIRE(b.empty());
+    b.insert(1, 1);
+    f.get();
+    BOOST_REQUIRE_EQUAL(b.size(), 1u);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_btree_map_erase_gently) {
+    btree_map<int, int, std::less<int>, 8> b;
+    std::map<int, int> m;
+    for (int i = 0; i < 100000; i++) {
+        b.insert(i, i);
+        m.emplace(i, i);
+    }
+    b.erase_gently(1000, 90000).get();
+    m.erase(m.lower_bound(1000), m.lower_bound(90000));
+    check_equal(b, m);
+    b.erase_gently(-5, 0).get();
+    b.erase_gently(100000, 200000).get();
+    check_equal(b, m);
+}
@@ -0,0 +1,65 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#include <seastar/testing/test_case.hh>
+#include <seastar/core/buffer_pool.hh>
+#include <seastar/core/polymorphic_temporary_buffer.hh>
+
+using namespace seastar;
+
+SEASTAR_TEST_CASE(test_buffer_pool_recycles) {
+    memory::buffer_pool pool(64 << 10);
+    std::pmr::polymorphic_allocator<char> alloc(&pool);
+
+    const char* p;
+    {
+        auto buf = make_temporary_buffer<char>(&alloc, 10000);
+        p = buf.get();
+        BOOST_REQUIRE_EQUAL(reinterpret_cast<uintptr_t>(p) % memory::page_size, 0);
+    }
+    BOOST_REQUIRE_EQUAL(pool.get_stats().releases, 1);
+    BOOST_REQUIRE_EQUAL(pool.get_stats().cached_bytes, 16 << 10);
+
+    // Same size class
+    {
+        auto buf = make_temporary_buffer<char>(&alloc, 16 << 10);
+        BOOST_REQUIRE_EQUAL(buf.get(), p);
+        BOOST_REQUIRE_EQUAL(pool.get_stats().hits, 1);
+        BOOST_REQUIRE_EQUAL(pool.get_stats().cached_bytes, 0);
+    }
+
+    // Not pooled
+    make_temporary_buffer<char>(&alloc, 100);
+    make_temporary_buffer<char>(&alloc, 1 << 20);
+    BOOST_REQUIRE_EQUAL(pool.get_stats().allocations, 2);
+
+    // Beyond capacity
+    {
+        auto a = make_temporary_buffer<char>(&alloc, 64 << 10);
+        auto b = make_temporary_buffer<char>(&alloc, 64 << 10);
+    }
+    BOOST_REQUIRE_EQUAL(pool.get_stats().drops, 2);
+    BOOST_REQUIRE_LE(pool.get_stats().cached_bytes, 64 << 10);
+
+    pool.release();
+    BOOST_REQUIRE_EQUAL(pool.get_stats().cached_bytes, 0);
+    return make_ready_future<>();
+}
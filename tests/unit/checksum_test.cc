@@ -0,0 +1,95 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#define BOOST_TEST_MODULE core
+
+#include <seastar/util/checksum.hh>
+
+#include <boost/test/included/unit_test.hpp>
+
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace seastar;
+
+static std::string random_data(size_t n) {
+    std::mt19937 rng;
+    std::string s(n, '\0');
+    for (auto& c : s) {
+        c = char(rng());
+    }
+    return s;
+}
+
+BOOST_AUTO_TEST_CASE(test_crc32c_known_values) {
+    BOOST_REQUIRE_EQUAL(crc32c::of(""), 0u);
+    BOOST_REQUIRE_EQUAL(crc32c::of("123456789"), 0xe3069283u);
+    // RFC 3720, B.4: 32 bytes of zeros
+    BOOST_REQUIRE_EQUAL(crc32c::of(std::string(32, '\0')), 0x8a9136aau);
+}
+
+BOOST_AUTO_TEST_CASE(test_crc32c_kernels_agree) {
+    using internal::crc32c_kernel;
+    auto data = random_data(100000);
+    std::vector<crc32c_kernel> kernels = {crc32c_kernel::table, crc32c_kernel::best};
+    if (internal::crc32c_hardware_available()) {
+        kernels.push_back(crc32c_kernel::hardware);
+        kernels.push_back(crc32c_kernel::interleaved);
+    }
+    for (size_t n : {1, 7, 8, 100, 3 * 4096 - 1, 3 * 4096, 3 * 4096 + 9, 100000}) {
+        auto expected = internal::crc32c_update(~0u, data.data(), n, crc32c_kernel::table);
+        for (auto k : kernels) {
+            BOOST_REQUIRE_EQUAL(internal::crc32c_update(~0u, data.data(), n, k), expected);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_crc32c_fragments_and_combine) {
+    auto data = random_data(10000);
+    std::vector<temporary_buffer<char>> fragments;
+    for (size_t pos = 0; pos < data.size(); pos += 333) {
+        auto n = std::min<size_t>(333, data.size() - pos);
+        fragments.emplace_back(data.data() + pos, n);
+    }
+    crc32c c;
+    c.update_fragments(fragments);
+    BOOST_REQUIRE_EQUAL(c.checksum(), crc32c::of(data));
+
+    std::string_view v(data);
+    BOOST_REQUIRE_EQUAL(crc32c::combine(crc32c::of(v.substr(0, 1234)), crc32c::of(v.substr(1234)), v.size() - 1234), crc32c::of(v));
+}
+
+BOOST_AUTO_TEST_CASE(test_xxhash64) {
+    BOOST_REQUIRE_EQUAL(xxhash64::of(""), 0xef46db3751d8e999ull);
+    BOOST_REQUIRE_EQUAL(xxhash64::of("abc"), 0x44bc2cf5ad770999ull);
+    BOOST_REQUIRE_NE(xxhash64::of("abc", 1), xxhash64::of("abc"));
+
+    auto data = random_data(1000);
+    for (size_t step : {1, 5, 31, 32, 100}) {
+        xxhash64 h;
+        for (size_t pos = 0; pos < data.size(); pos += step) {
+            h.update(data.data() + pos, std::min(step, data.size() - pos));
+        }
+        BOOST_REQUIRE_EQUAL(h.digest(), xxhash64::of(data));
+    }
+}
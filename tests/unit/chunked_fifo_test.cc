@@ -27,6 +27,9 @@
 #include <stdlib.h>
 #include <chrono>
 #include <deque>
+#include <numeric>
+#include <string>
+#include <vector>
 #include <seastar/core/circular_buffer.hh>
 
 using namespace seastar;
@@ -356,3 +359,38 @@ BOOST_AUTO_TEST_CASE(chunked_fifo_iterator) {
         BOOST_REQUIRE(std::equal(fifo.begin(), fifo.end(), reference.begin(), reference.end()));
     }
 }
+
+BOOST_AUTO_TEST_CASE(chunked_fifo_bulk) {
+    constexpr auto items_per_chunk = 8;
+    auto fifo = chunked_fifo<int, items_per_chunk>{};
+    auto reference = std::deque<int>{};
+    std::vector<int> v(items_per_chunk * 5);
+    std::iota(v.begin(), v.end(), 0);
+
+    // Leave a partially popped chunk, so that the free items of the back
+    // chunk wrap around
+    fifo.push_back(v.begin(), v.begin() + 5);
+    reference.insert(reference.end(), v.begin(), v.begin() + 5);
+    fifo.pop_front(3);
+    reference.erase(reference.begin(), reference.begin() + 3);
+    BOOST_REQUIRE(std::equal(fifo.begin(), fifo.end(), reference.begin(), reference.end()));
+
+    fifo.push_back(v.begin(), v.end());
+    reference.insert(reference.end(), v.begin(), v.end());
+    BOOST_REQUIRE_EQUAL(fifo.size(), reference.size());
+    BOOST_REQUIRE(std::equal(fifo.begin(), fifo.end(), reference.begin(), reference.end()));
+
+    fifo.pop_front(items_per_chunk * 2 + 1);
+    reference.erase(reference.begin(), reference.begin() + items_per_chunk * 2 + 1);
+    BOOST_REQUIRE_EQUAL(fifo.size(), reference.size());
+    BOOST_REQUIRE(std::equal(fifo.begin(), fifo.end(), reference.begin(), reference.end()));
+
+    fifo.pop_front(fifo.size());
+    BOOST_REQUIRE(fifo.empty());
+
+    auto sfifo = chunked_fifo<std::string, items_per_chunk>{};
+    std::vector<std::string> sv(items_per_chunk + 2, "x");
+    sfifo.push_back(sv.begin(), sv.end());
+    sfifo.pop_front(items_per_chunk + 1);
+    BOOST_REQUIRE_EQUAL(sfifo.size(), 1u);
+}
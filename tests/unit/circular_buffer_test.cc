@@ -26,7 +26,10 @@
 #include <stdlib.h>
 #include <chrono>
 #include <deque>
+#include <numeric>
 #include <random>
+#include <string>
+#include <vector>
 #include <seastar/core/circular_buffer.hh>
 
 using namespace seastar;
@@ -177,3 +180,29 @@ BOOST_AUTO_TEST_CASE(test_underflow_index_iterator_comparison) {
         buf.erase(buf.begin() + offset, buf.begin() + std::min(size_t(offset + erase_count), buf.size()));
     }
 }
+
+BOOST_AUTO_TEST_CASE(test_bulk_push_and_pop) {
+    circular_buffer<int> buf;
+    std::vector<int> v(100);
+    std::iota(v.begin(), v.end(), 0);
+
+    // Wrap the storage around before the bulk push
+    buf.push_back(v.begin(), v.begin() + 10);
+    buf.pop_front(7);
+    buf.push_back(v.begin() + 10, v.end());
+    BOOST_REQUIRE_EQUAL(buf.size(), 93u);
+    for (size_t i = 0; i < buf.size(); i++) {
+        BOOST_REQUIRE_EQUAL(buf[i], int(i + 7));
+    }
+
+    buf.pop_front(buf.size());
+    BOOST_REQUIRE(buf.empty());
+
+    // Non-trivial elements from a non-contiguous range
+    circular_buffer<std::string> sbuf;
+    std::deque<std::string> d{"a", "b", "c"};
+    sbuf.push_back(d.begin(), d.end());
+    sbuf.pop_front(2);
+    BOOST_REQUIRE_EQUAL(sbuf.size(), 1u);
+    BOOST_REQUIRE_EQUAL(sbuf.front(), "c");
+}
@@ -34,6 +34,7 @@
 #include <seastar/core/when_all.hh>
 #include <seastar/core/when_any.hh>
 #include <seastar/core/with_timeout.hh>
+#include <seastar/core/internal/wakeup_batch.hh>
 #include <boost/range/irange.hpp>
 
 using namespace seastar;
@@ -222,6 +223,46 @@ SEASTAR_THREAD_TEST_CASE(test_condition_variable_has_waiter) {
     BOOST_REQUIRE_EQUAL(cv.has_waiters(), false);
 }
 
+SEASTAR_THREAD_TEST_CASE(test_condition_variable_batched_broadcast) {
+    // Pretend the task quota is used up, so that broadcast() wakes a
+    // single batch right away
+    internal::preemption_monitor preempted{1, 0};
+    auto broadcast_preempted = [&] (condition_variable& cv) {
+        auto old = internal::get_need_preempt_var();
+        internal::set_need_preempt_var(&preempted);
+        cv.broadcast();
+        internal::set_need_preempt_var(old);
+    };
+    auto woken = [] (const std::vector<future<>>& fs) {
+        return std::count_if(fs.begin(), fs.end(), [] (const future<>& f) { return f.available(); });
+    };
+
+    condition_variable cv;
+    std::vector<future<>> fs;
+    for (int i = 0; i < 1000; ++i) {
+        fs.push_back(cv.wait());
+    }
+    auto deferred = internal::get_wakeup_stats().deferred_batches;
+    broadcast_preempted(cv);
+    BOOST_REQUIRE_EQUAL(woken(fs), internal::min_wakeup_batch);
+    BOOST_REQUIRE_EQUAL(internal::get_wakeup_stats().deferred_batches, deferred + 1);
+    BOOST_REQUIRE(!cv.has_waiters());
+    when_all_succeed(fs.begin(), fs.end()).get();
+
+    // Destroying the variable wakes the rest of a broadcast() without an error
+    fs.clear();
+    {
+        condition_variable cv2;
+        for (int i = 0; i < 1000; ++i) {
+            fs.push_back(cv2.wait());
+        }
+        broadcast_preempted(cv2);
+        BOOST_REQUIRE_EQUAL(woken(fs), internal::min_wakeup_batch);
+    }
+    BOOST_REQUIRE_EQUAL(woken(fs), 1000);
+    when_all_succeed(fs.begin(), fs.end()).get();
+}
+
 #ifdef SEASTAR_COROUTINES_ENABLED
 
 SEASTAR_TEST_CASE(test_condition_variable_signal_consume_coroutine) {
@@ -0,0 +1,97 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+
+#include <seastar/testing/thread_test_case.hh>
+
+#include <seastar/net/memory_budget.hh>
+#include <seastar/core/thread.hh>
+#include "loopback_socket.hh"
+
+using namespace seastar;
+
+namespace {
+
+// Both ends of a loopback connection
+std::pair<connected_socket, connected_socket> make_connection() {
+    auto b1 = make_lw_shared<loopback_buffer>(nullptr, loopback_buffer::type::CLIENT_TX);
+    auto b2 = make_lw_shared<loopback_buffer>(nullptr, loopback_buffer::type::SERVER_TX);
+    return {
+        connected_socket(std::make_unique<loopback_connected_socket_impl>(make_foreign(b1), b2)),
+        connected_socket(std::make_unique<loopback_connected_socket_impl>(make_foreign(b2), b1)),
+    };
+}
+
+}
+
+SEASTAR_THREAD_TEST_CASE(test_connection_memory_budget_shares) {
+    net::connection_memory_budget budget(64 << 10);
+    auto [c1, s1] = make_connection();
+    auto [c2, s2] = make_connection();
+    {
+        auto in1 = budget.input(s1);
+        auto out1 = budget.output(s1);
+        auto in2 = budget.input(s2);
+        auto out2 = budget.output(s2);
+        BOOST_REQUIRE_EQUAL(budget.streams(), 4u);
+        BOOST_REQUIRE_EQUAL(budget.fair_share(), 16u << 10);
+        in1.close().get();
+        out1.close().get();
+        in2.close().get();
+        out2.close().get();
+    }
+    BOOST_REQUIRE_EQUAL(budget.streams(), 0u);
+    BOOST_REQUIRE_EQUAL(budget.used(), 0u);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_connection_memory_budget_pauses_reads) {
+    net::connection_memory_budget budget(1000);
+    auto [client, server] = make_connection();
+    auto in = budget.input(server);
+    auto out = client.output();
+    auto writer = seastar::async([&out] {
+        for (int i = 0; i < 3; i++) {
+            out.write(sstring(600, 'x')).get();
+            out.flush().get();
+        }
+    });
+
+    // Within its share, and then over it while the budget is used up
+    auto b1 = in.read().get();
+    BOOST_REQUIRE_EQUAL(b1.size(), 600u);
+    auto b2 = in.read().get();
+    BOOST_REQUIRE_EQUAL(budget.used(), 1200u);
+    auto f = in.read();
+    BOOST_REQUIRE(!f.available());
+    BOOST_REQUIRE_EQUAL(budget.paused_reads(), 1u);
+
+    b1 = {};
+    auto b3 = f.get();
+    BOOST_REQUIRE_EQUAL(b3.size(), 600u);
+    BOOST_REQUIRE_EQUAL(budget.used(), 1200u);
+    b2 = {};
+    b3 = {};
+    BOOST_REQUIRE_EQUAL(budget.used(), 0u);
+
+    writer.get();
+    out.close().get();
+    in.close().get();
+}
@@ -49,6 +49,7 @@ SEASTAR_TEST_CASE(test_coroutines_not_compiled_in) {
 #include <seastar/coroutine/as_future.hh>
 #include <seastar/coroutine/exception.hh>
 #include <seastar/coroutine/generator.hh>
+#include <seastar/coroutine/batch_generator.hh>
 
 namespace {
 
@@ -112,6 +113,29 @@ SEASTAR_TEST_CASE(test_simple_coroutines) {
     }), 17);
 }
 
+SEASTAR_TEST_CASE(test_coroutine_frame_pool) {
+    using pool = internal::coroutine_frame_pool;
+    auto before = pool::get_stats();
+    for (int i = 0; i < 10; i++) {
+        BOOST_REQUIRE_EQUAL(co_await simple_coroutine(), 53);
+    }
+    auto after = pool::get_stats();
+    uint64_t allocations = 0;
+    uint64_t reuses = 0;
+    for (size_t i = 0; i <= pool::size_classes; i++) {
+        allocations += after.allocations[i] - before.allocations[i];
+    }
+    for (size_t i = 0; i < pool::size_classes; i++) {
+        reuses += after.reuses[i] - before.reuses[i];
+    }
+    // The test case itself is a coroutine too, its frame is not counted
+    BOOST_REQUIRE_EQUAL(allocations, 10);
+#ifndef SEASTAR_DEBUG
+    // Each call after the first takes the frame of the one before
+    BOOST_REQUIRE_GE(reuses, 9);
+#endif
+}
+
 SEASTAR_TEST_CASE(test_abandond_coroutine) {
     std::optional<future<int>> f;
     {
@@ -644,6 +668,72 @@ SEASTAR_TEST_CASE(test_parallel_for_each) {
 #endif
 }
 
+SEASTAR_TEST_CASE(test_max_concurrent_for_each) {
+    // Never more than the limit in flight, and all of the elements done
+    int in_flight = 0;
+    int max_in_flight = 0;
+    int count = 0;
+    co_await coroutine::max_concurrent_for_each(std::views::iota(0, 100), 3, [&] (int x) -> future<> {
+        ++in_flight;
+        max_in_flight = std::max(max_in_flight, in_flight);
+        co_await sleep(std::chrono::milliseconds(x % 3));
+        --in_flight;
+        ++count;
+    });
+    BOOST_REQUIRE_EQUAL(count, 100);
+    BOOST_REQUIRE_EQUAL(max_in_flight, 3);
+
+    // Ready futures, more of them than a task quota takes
+    count = 0;
+    co_await coroutine::max_concurrent_for_each(std::views::iota(0, 1000000), 10, [&] (int x) {
+        ++count;
+    });
+    BOOST_REQUIRE_EQUAL(count, 1000000);
+
+    // Empty range
+    std::vector<int> values;
+    co_await coroutine::max_concurrent_for_each(values, 10, [&] (int x) {
+        ++count;
+    });
+    BOOST_REQUIRE_EQUAL(count, 1000000);
+
+    // The function is invoked on all elements, even if some throw
+    count = 0;
+    auto f = coroutine::max_concurrent_for_each(std::views::iota(0, 10), 4, [&] (int x) -> future<> {
+        co_await sleep(std::chrono::milliseconds(x % 2));
+        ++count;
+        if (x == 5) {
+            throw std::runtime_error("test");
+        }
+    });
+    BOOST_REQUIRE_THROW(co_await std::move(f), std::runtime_error);
+    BOOST_REQUIRE_EQUAL(count, 10);
+}
+
+SEASTAR_TEST_CASE(test_max_concurrent_map) {
+    // Results come in the order of the range, not that of completion
+    std::vector<int> values = { 5, 1, 4, 2, 3, 0 };
+    auto squares = co_await coroutine::max_concurrent_map(values, 2, [] (int x) -> future<int> {
+        co_await sleep(std::chrono::milliseconds(x));
+        co_return x * x;
+    });
+    BOOST_REQUIRE(squares == std::vector<int>({ 25, 1, 16, 4, 9, 0 }));
+
+    auto strings = co_await coroutine::max_concurrent_map(values.begin(), values.begin() + 3, 10, [] (int x) {
+        return std::to_string(x);
+    });
+    BOOST_REQUIRE(strings == std::vector<std::string>({ "5", "1", "4" }));
+
+    auto f = coroutine::max_concurrent_map(values, 3, [] (int x) -> future<int> {
+        co_await coroutine::maybe_yield();
+        if (x == 4) {
+            throw std::runtime_error("test");
+        }
+        co_return x;
+    });
+    BOOST_REQUIRE_THROW(co_await std::move(f), std::runtime_error);
+}
+
 SEASTAR_TEST_CASE(test_void_as_future) {
     auto f = co_await coroutine::as_future(make_ready_future<>());
     BOOST_REQUIRE(f.available());
@@ -806,6 +896,59 @@ SEASTAR_TEST_CASE(test_async_generator_not_drained_unbuffered) {
     return test_async_generator_not_drained<std::optional>();
 }
 
+coroutine::experimental::batch_generator<int> count_in_batches(int n, size_t batch_size) {
+    std::vector<int> batch;
+    for (int i = 0; i < n; i++) {
+        batch.push_back(i);
+        if (batch.size() == batch_size) {
+            co_await coroutine::maybe_yield();
+            co_yield batch;
+            batch.clear();
+        }
+    }
+    if (!batch.empty()) {
+        co_yield batch;
+    }
+}
+
+SEASTAR_TEST_CASE(test_batch_generator) {
+    auto batches = count_in_batches(10, 4);
+    std::vector<size_t> sizes;
+    std::vector<int> values;
+    while (auto batch = co_await batches()) {
+        sizes.push_back(batch->size());
+        values.insert(values.end(), batch->begin(), batch->end());
+    }
+    BOOST_REQUIRE_EQUAL(sizes, (std::vector<size_t>{4, 4, 2}));
+    BOOST_REQUIRE_EQUAL(values, (std::vector<int>{0, 1, 2, 3, 4, 5, 6, 7, 8, 9}));
+}
+
+class buffers_source_impl : public data_source_impl {
+    std::vector<std::string_view> _buffers;
+    size_t _next = 0;
+public:
+    explicit buffers_source_impl(std::vector<std::string_view> buffers) : _buffers(std::move(buffers)) {}
+    virtual future<temporary_buffer<char>> get() override {
+        if (_next == _buffers.size()) {
+            return make_ready_future<temporary_buffer<char>>();
+        }
+        auto b = _buffers[_next++];
+        return make_ready_future<temporary_buffer<char>>(temporary_buffer<char>(b.data(), b.size()));
+    }
+};
+
+SEASTAR_TEST_CASE(test_read_delimited) {
+    input_stream<char> in(data_source(std::make_unique<buffers_source_impl>(std::vector<std::string_view>{
+        "one\ntwo\nth", "r", "ee\n\nfour\n", "five"})));
+    auto lines = coroutine::experimental::read_delimited(in);
+    std::vector<std::vector<std::string>> batches;
+    while (auto batch = co_await lines()) {
+        batches.emplace_back(batch->begin(), batch->end());
+    }
+    BOOST_REQUIRE(batches == (std::vector<std::vector<std::string>>{
+        {"one", "two"}, {"three", "", "four"}, {"five"}}));
+}
+
 struct counter_t {
     int n;
     int* count;
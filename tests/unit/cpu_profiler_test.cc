@@ -0,0 +1,118 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#include <seastar/core/cpu_profiler.hh>
+#include <seastar/core/reactor.hh>
+#include <seastar/core/thread.hh>
+#include <seastar/core/thread_cputime_clock.hh>
+#include <seastar/testing/test_case.hh>
+#include <seastar/testing/thread_test_case.hh>
+#include <seastar/util/defer.hh>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <sstream>
+
+using namespace seastar;
+using namespace std::chrono_literals;
+
+static void spin_cooperatively(std::chrono::duration<double> how_much) {
+    auto end = thread_cputime_clock::now() + how_much;
+    while (thread_cputime_clock::now() < end) {
+        if (need_preempt()) {
+            thread::yield();
+        }
+    }
+}
+
+static uint64_t total_samples(const cpu_profile& profile) {
+    uint64_t samples = 0;
+    for (auto& stack : profile.stacks) {
+        samples += stack.samples;
+    }
+    return samples;
+}
+
+SEASTAR_THREAD_TEST_CASE(test_cpu_profiler_samples_scheduling_groups) {
+    auto sg = create_scheduling_group("profiled", 100).get0();
+    auto destroy = defer([sg] () noexcept { destroy_scheduling_group(sg).get(); });
+
+    start_cpu_profiler(1ms).get();
+    auto stop = defer([] () noexcept { stop_cpu_profiler().get(); });
+    BOOST_REQUIRE(engine().cpu_profiler_running());
+    engine().get_cpu_profile(true);
+
+    thread_attributes attr;
+    attr.sched_group = sg;
+    seastar::async(attr, [] {
+        spin_cooperatively(200ms);
+    }).get();
+
+    auto profile = engine().get_cpu_profile(true);
+    BOOST_REQUIRE_EQUAL(profile.shard, this_shard_id());
+    BOOST_REQUIRE(profile.period == 1ms);
+    // 200 samples are due, but leave room for a slow timer
+    BOOST_REQUIRE_GE(total_samples(profile) + profile.dropped_samples, 100);
+    auto in_group = std::find_if(profile.stacks.begin(), profile.stacks.end(), [] (const cpu_profile_stack& s) {
+        return s.scheduling_group == "profiled" && s.task_type && !s.addresses.empty();
+    });
+    BOOST_REQUIRE(in_group != profile.stacks.end());
+
+    std::ostringstream os;
+    write_folded(os, profile);
+    std::istringstream is(os.str());
+    std::string line;
+    size_t lines = 0;
+    while (std::getline(is, line)) {
+        BOOST_REQUIRE(line.starts_with(fmt::format("shard {};sg:", this_shard_id())));
+        ++lines;
+    }
+    BOOST_REQUIRE_EQUAL(lines, profile.stacks.size());
+}
+
+SEASTAR_THREAD_TEST_CASE(test_cpu_profiler_stop) {
+    start_cpu_profiler(1ms).get();
+    spin_cooperatively(20ms);
+    stop_cpu_profiler().get();
+    BOOST_REQUIRE(!engine().cpu_profiler_running());
+    auto samples = total_samples(engine().get_cpu_profile());
+    BOOST_REQUIRE_GT(samples, 0);
+
+    spin_cooperatively(20ms);
+    BOOST_REQUIRE_EQUAL(total_samples(engine().get_cpu_profile(true)), samples);
+    BOOST_REQUIRE_EQUAL(total_samples(engine().get_cpu_profile()), 0);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_cpu_profiler_pprof_format) {
+    cpu_profile profile;
+    profile.period = 10ms;
+    profile.stacks.push_back(cpu_profile_stack{{0x1000, 0x2000}, "main", nullptr, 7});
+
+    std::ostringstream os;
+    write_pprof(os, {profile});
+    auto out = os.str();
+    std::vector<uintptr_t> expected = {0, 3, 0, 10000, 0, 7, 2, 0x1000, 0x2000, 0, 1, 0};
+    auto size = expected.size() * sizeof(uintptr_t);
+    BOOST_REQUIRE_GT(out.size(), size);
+    BOOST_REQUIRE_EQUAL(std::memcmp(out.data(), expected.data(), size), 0);
+    // The mappings follow
+    BOOST_REQUIRE_NE(out.find("r-xp", size), std::string::npos);
+}
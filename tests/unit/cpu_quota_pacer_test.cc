@@ -0,0 +1,72 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#define BOOST_TEST_MODULE core
+
+#include <boost/test/included/unit_test.hpp>
+#include <seastar/core/internal/cpu_quota_pacer.hh>
+
+using namespace seastar;
+using namespace std::chrono_literals;
+using internal::cpu_quota_pacer;
+
+BOOST_AUTO_TEST_CASE(test_within_share) {
+    cpu_quota_pacer p(0.5, 1ms);
+    for (int i = 0; i < 100; i++) {
+        BOOST_REQUIRE(p.update(10ms, 5ms) == 0ns);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_sleeps_off_excess) {
+    cpu_quota_pacer p(0.5, 1ms);
+    // 10ms of CPU time in 10ms: 5ms over the share, less the burst, take
+    // 8ms to earn back at half a CPU
+    auto s = p.update(10ms, 10ms);
+    BOOST_REQUIRE(s == 8ms);
+    // Sleeping pays it back
+    BOOST_REQUIRE(p.update(s, 0ms) == 0ns);
+}
+
+BOOST_AUTO_TEST_CASE(test_idle_credit_is_capped) {
+    cpu_quota_pacer p(0.25, 2ms);
+    // A long idle period saves up no more than the burst
+    BOOST_REQUIRE(p.update(10s, 0ms) == 0ns);
+    BOOST_REQUIRE(p.update(0ms, 2ms) == 0ns);
+    BOOST_REQUIRE(p.update(0ms, 1ms) == 4ms);
+}
+
+BOOST_AUTO_TEST_CASE(test_average_rate) {
+    cpu_quota_pacer p(0.3, 1ms);
+    // A busy shard, which uses all the time it is not asked to sleep,
+    // ends up at its share
+    std::chrono::nanoseconds wall{0}, cpu{0};
+    auto slice = 500us;
+    for (int i = 0; i < 10000; i++) {
+        auto s = p.update(slice, slice);
+        wall += slice + s;
+        cpu += slice;
+        if (s > 0ns) {
+            BOOST_REQUIRE(p.update(s, 0ms) == 0ns);
+        }
+    }
+    auto rate = double(cpu.count()) / wall.count();
+    BOOST_REQUIRE_CLOSE(rate, 0.3, 1);
+}
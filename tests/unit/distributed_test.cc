@@ -23,6 +23,7 @@
 #include <seastar/testing/test_case.hh>
 #include <seastar/testing/thread_test_case.hh>
 #include <seastar/core/distributed.hh>
+#include <seastar/core/replicated.hh>
 #include <seastar/core/loop.hh>
 #include <seastar/core/semaphore.hh>
 #include <seastar/core/sleep.hh>
@@ -205,6 +206,48 @@ SEASTAR_TEST_CASE(test_map_reduce0_lifetime) {
     });
 }
 
+SEASTAR_THREAD_TEST_CASE(test_tree_map_reduce0) {
+    distributed<X> x;
+    x.start().get();
+    auto stop = deferred_stop(x);
+    long n = smp::count - 1;
+    long expected = (n * (n + 1) * (2*n + 1)) / 6;
+    for (unsigned fanout : {1, 2, 4, 64}) {
+        auto result = x.tree_map_reduce0([] (const X& x) {
+            return yield().then([&x] {
+                return long(x.cpu_id_squared());
+            });
+        }, 0L, std::plus<long>(), fanout).get0();
+        BOOST_REQUIRE_EQUAL(result, expected);
+
+        // Each shard is mapped once, on itself
+        auto shards = x.tree_map_reduce0([] (const X&) {
+            return std::vector<unsigned>{this_shard_id()};
+        }, std::vector<unsigned>(), [] (std::vector<unsigned> a, std::vector<unsigned> b) {
+            a.insert(a.end(), b.begin(), b.end());
+            return a;
+        }, fanout).get0();
+        std::sort(shards.begin(), shards.end());
+        BOOST_REQUIRE(shards == boost::copy_range<std::vector<unsigned>>(smp::all_cpus()));
+    }
+}
+
+SEASTAR_THREAD_TEST_CASE(test_replicated) {
+    replicated<std::vector<int>> r(std::vector<int>{1, 2, 3});
+    smp::invoke_on_all([&r] {
+        BOOST_REQUIRE(r.local() == std::vector<int>({1, 2, 3}));
+    }).get();
+
+    for (int i = 0; i < 10; i++) {
+        r.publish(std::vector<int>(i, i)).get();
+        // Every shard sees the new snapshot as soon as publish() resolves
+        smp::invoke_on_all([&r, i] {
+            BOOST_REQUIRE_EQUAL(r->size(), size_t(i));
+            BOOST_REQUIRE(std::all_of(r->begin(), r->end(), [i] (int x) { return x == i; }));
+        }).get();
+    }
+}
+
 SEASTAR_TEST_CASE(test_map_lifetime) {
     struct map {
         bool destroyed = false;
@@ -26,6 +26,7 @@
 #include <seastar/testing/test_case.hh>
 #include <seastar/core/sstring.hh>
 #include <seastar/core/reactor.hh>
+#include <seastar/core/when_all.hh>
 #include <seastar/core/do_with.hh>
 #include <seastar/net/dns.hh>
 #include <seastar/net/inet_address.hh>
@@ -150,3 +151,36 @@ static future<> test_srv() {
 SEASTAR_TEST_CASE(test_srv_tcp) {
     return test_srv();
 }
+
+SEASTAR_TEST_CASE(test_resolve_cached) {
+    dns_resolver::options opts;
+    opts.cache = true;
+    auto d = ::make_lw_shared<dns_resolver>(std::move(opts));
+    // Concurrent lookups share a query, later ones hit the cache
+    auto f1 = d->get_host_by_name(seastar_name, inet_address::family::INET);
+    auto f2 = d->get_host_by_name(seastar_name, inet_address::family::INET);
+    return when_all_succeed(std::move(f1), std::move(f2)).then_unpack([d](hostent e1, hostent e2) {
+        BOOST_REQUIRE(!e1.addr_list.empty());
+        BOOST_REQUIRE(e1.addr_list == e2.addr_list);
+        return d->get_host_by_name(seastar_name, inet_address::family::INET).then([d, e1](hostent e) {
+            BOOST_REQUIRE(e.addr_list == e1.addr_list);
+            auto st = d->get_cache_stats();
+            BOOST_REQUIRE_EQUAL(st.misses, 1u);
+            BOOST_REQUIRE_EQUAL(st.coalesced, 1u);
+            BOOST_REQUIRE_EQUAL(st.hits, 1u);
+            BOOST_REQUIRE_EQUAL(st.entries, 1u);
+        });
+    }).then([d] {
+        return d->get_host_by_name("apa.ninja.gnu", inet_address::family::INET).then_wrapped([d](future<hostent> f) {
+            BOOST_REQUIRE(f.failed());
+            f.ignore_ready_future();
+            return d->get_host_by_name("apa.ninja.gnu", inet_address::family::INET).then_wrapped([d](future<hostent> f) {
+                BOOST_REQUIRE(f.failed());
+                f.ignore_ready_future();
+                BOOST_REQUIRE_EQUAL(d->get_cache_stats().negative_hits, 1u);
+            });
+        });
+    }).finally([d]{
+        return d->close();
+    });
+}
@@ -20,6 +20,7 @@
  */
 
 #include <algorithm>
+#include <numeric>
 #include <vector>
 #include <chrono>
 
@@ -291,6 +292,23 @@ SEASTAR_TEST_CASE(test_unique_stage_names_are_enforced) {
     });
 }
 
+SEASTAR_THREAD_TEST_CASE(test_stage_batch_stats) {
+    auto stage = seastar::make_execution_stage("test", [] (int x) { return x; });
+    std::vector<future<int>> fs;
+    for (int i = 0; i < 10; i++) {
+        fs.push_back(stage(i));
+    }
+    for (int i = 0; i < 10; i++) {
+        BOOST_REQUIRE_EQUAL(fs[i].get0(), i);
+    }
+    auto& st = stage.get_stats();
+    // The ten calls went in one batch, of up to 16 calls
+    BOOST_REQUIRE_EQUAL(st.batch_sizes[4], 1);
+    BOOST_REQUIRE_EQUAL(std::accumulate(st.batch_sizes.begin(), st.batch_sizes.end(), uint64_t(0)), 1);
+    BOOST_REQUIRE_GE(stage.queue_length_limit(), execution_stage::min_queue_length);
+    BOOST_REQUIRE_LE(stage.queue_length_limit(), execution_stage::max_queue_length);
+}
+
 SEASTAR_THREAD_TEST_CASE(test_inheriting_concrete_execution_stage) {
     auto sg1 = seastar::create_scheduling_group("sg1", 300).get0();
     auto ksg1 = seastar::defer([&] () noexcept { seastar::destroy_scheduling_group(sg1).get(); });
@@ -60,6 +60,7 @@ class test_env {
     std::vector<int> _results;
     std::vector<std::vector<std::exception_ptr>> _exceptions;
     fair_queue::class_id _nr_classes = 0;
+    fair_queue::group_id _nr_groups = fair_queue::default_group;
     std::vector<request> _inflight;
 
     static fair_group::config fg_config(unsigned cap) {
@@ -124,13 +125,18 @@ class test_env {
         }
     }
 
-    size_t register_priority_class(uint32_t shares) {
+    size_t register_priority_class(uint32_t shares, fair_queue::group_id group = fair_queue::default_group) {
         _results.push_back(0);
         _exceptions.push_back(std::vector<std::exception_ptr>());
-        _fq.register_priority_class(_nr_classes, shares);
+        _fq.register_priority_class(_nr_classes, shares, group);
         return _nr_classes++;
     }
 
+    fair_queue::group_id register_priority_class_group(uint32_t shares) {
+        _fq.register_priority_class_group(++_nr_groups, shares);
+        return _nr_groups;
+    }
+
     void do_op(fair_queue::class_id id, unsigned weight) {
         unsigned index = id;
         auto req = std::make_unique<request>(weight, index, [this, index] (request& req) mutable noexcept {
@@ -234,6 +240,32 @@ SEASTAR_THREAD_TEST_CASE(test_fair_queue_different_shares) {
     return env.verify("different_shares", {1, 2});
 }
 
+// Two groups with equal shares, one with a single class and another one
+// with three. The groups split the capacity in halves, so the lone class
+// is expected to get 3 x more requests than each of the other three.
+SEASTAR_THREAD_TEST_CASE(test_fair_queue_class_groups) {
+    test_env env(1);
+
+    auto noisy = env.register_priority_class_group(100);
+    auto quiet = env.register_priority_class_group(100);
+
+    auto a = env.register_priority_class(10, noisy);
+    auto b = env.register_priority_class(10, noisy);
+    auto c = env.register_priority_class(10, noisy);
+    auto d = env.register_priority_class(10, quiet);
+
+    for (int i = 0; i < 200; ++i) {
+        env.do_op(a, 1);
+        env.do_op(b, 1);
+        env.do_op(c, 1);
+        env.do_op(d, 1);
+    }
+    yield().get();
+    // allow a quarter of the requests in
+    env.tick(200);
+    return env.verify("class_groups", {1, 1, 1, 3}, 2);
+}
+
 // Equal ratios, high capacity queue. Should still divide equally.
 //
 // Note that we sleep less because now more requests will be going through the
@@ -0,0 +1,91 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+
+#include <seastar/testing/thread_test_case.hh>
+
+#include <seastar/core/fair_scheduler.hh>
+#include <seastar/core/loop.hh>
+#include <seastar/core/sleep.hh>
+#include <seastar/core/when_all.hh>
+#include <boost/range/irange.hpp>
+
+using namespace seastar;
+using namespace std::chrono_literals;
+
+static fair_group::config group_config(unsigned long ops_rate) {
+    fair_group::config cfg;
+    cfg.weight_rate = ops_rate;
+    cfg.size_rate = std::numeric_limits<int>::max();
+    return cfg;
+}
+
+SEASTAR_THREAD_TEST_CASE(test_fair_scheduler_permits) {
+    fair_group group(group_config(1'000'000));
+    fair_scheduler sched(group, {});
+    sched.register_class(0, 100);
+
+    auto p = sched.acquire(0, fair_queue_ticket(1, 100)).get();
+    BOOST_REQUIRE(bool(p));
+    BOOST_REQUIRE(p.ticket() == fair_queue_ticket(1, 100));
+    BOOST_REQUIRE(sched.queue().resources_currently_executing() == fair_queue_ticket(1, 100));
+    auto moved = std::move(p);
+    BOOST_REQUIRE(!p);
+    moved.release();
+    BOOST_REQUIRE(!moved);
+    BOOST_REQUIRE(sched.queue().resources_currently_executing() == fair_queue_ticket());
+    BOOST_REQUIRE_EQUAL(sched.waiters(), 0u);
+
+    sched.unregister_class(0);
+}
+
+// Two classes keep the scheduler busy, the rate of the group being the
+// bottleneck; the permits they get are in proportion to their shares
+SEASTAR_THREAD_TEST_CASE(test_fair_scheduler_shares) {
+    fair_group group(group_config(20'000));
+    fair_scheduler sched(group, {});
+    sched.register_class(0, 100);
+    sched.register_class(1, 300);
+
+    std::array<unsigned, 2> granted = {};
+    bool stop = false;
+    auto run_class = [&] (fair_queue::class_id c) {
+        return parallel_for_each(boost::irange(0, 8), [&, c] (int) {
+            return do_until([&] { return stop; }, [&, c] {
+                return sched.acquire(c, fair_queue_ticket(1, 0)).then([&, c] (fair_scheduler::permit p) {
+                    granted[c]++;
+                });
+            });
+        });
+    };
+    auto done = when_all_succeed(run_class(0), run_class(1));
+    sleep(200ms).get();
+    stop = true;
+    done.get();
+
+    BOOST_TEST_MESSAGE(format("granted {} {}", granted[0], granted[1]));
+    BOOST_REQUIRE(granted[0] > 0);
+    auto ratio = double(granted[1]) / granted[0];
+    BOOST_REQUIRE(ratio > 2 && ratio < 4);
+
+    sched.unregister_class(0);
+    sched.unregister_class(1);
+}
@@ -24,22 +24,35 @@
 #include <seastar/testing/test_runner.hh>
 
 #include <seastar/core/seastar.hh>
+#include <seastar/core/reactor.hh>
 #include <seastar/core/semaphore.hh>
 #include <seastar/core/condition-variable.hh>
 #include <seastar/core/file.hh>
 #include <seastar/core/layered_file.hh>
+#include <seastar/core/cached_file.hh>
+#include <seastar/core/compressed_file.hh>
+#include <seastar/core/fstream.hh>
+#include <seastar/core/mapped_file.hh>
 #include <seastar/core/thread.hh>
 #include <seastar/core/stall_sampler.hh>
 #include <seastar/core/aligned_buffer.hh>
+#include <seastar/core/append_log.hh>
 #include <seastar/core/io_intent.hh>
+#include <seastar/core/io_trace.hh>
 #include <seastar/util/tmp_file.hh>
 #include <seastar/util/alloc_failure_injector.hh>
 #include <seastar/util/closeable.hh>
+#include <seastar/util/defer.hh>
+#include <seastar/util/file.hh>
 #include <seastar/util/internal/magic.hh>
 #include <seastar/util/internal/iovec_utils.hh>
 
 #include <boost/range/adaptor/transformed.hpp>
 #include <iostream>
+#include <map>
+#include <numeric>
+#include <sstream>
+#include <random>
 #include <sys/statfs.h>
 #include <fcntl.h>
 
@@ -210,6 +223,34 @@ SEASTAR_TEST_CASE(parallel_write_fsync) {
     });
 }
 
+SEASTAR_TEST_CASE(test_concurrent_flushes) {
+    return tmp_dir::do_with_thread([] (tmp_dir& t) {
+        auto fname = (t.get_path() / "testfile.tmp").native();
+        auto f = open_file_dma(fname, open_flags::rw | open_flags::create | open_flags::truncate).get0();
+        auto close_f = deferred_close(f);
+        static constexpr size_t buffer_size = 4096;
+        static constexpr unsigned writers = 32;
+
+        // Flushes that overlap are batched, each must still complete
+        // after the write it follows
+        parallel_for_each(boost::irange(0u, writers), [&f] (unsigned i) {
+            auto buf = temporary_buffer<char>::aligned(f.memory_dma_alignment(), buffer_size);
+            memset(buf.get_write(), 'a' + i % 26, buf.size());
+            return f.dma_write(i * buffer_size, buf.get(), buf.size()).then([&f, buf = std::move(buf)] (size_t w) {
+                BOOST_REQUIRE_EQUAL(w, buffer_size);
+                return f.flush();
+            });
+        }).get();
+        f.flush().get();
+
+        auto rbuf = temporary_buffer<char>::aligned(f.memory_dma_alignment(), buffer_size);
+        for (unsigned i = 0; i < writers; i++) {
+            BOOST_REQUIRE_EQUAL(f.dma_read(i * buffer_size, rbuf.get_write(), rbuf.size()).get0(), buffer_size);
+            BOOST_REQUIRE(std::all_of(rbuf.begin(), rbuf.end(), [i] (char c) { return c == char('a' + i % 26); }));
+        }
+    });
+}
+
 SEASTAR_TEST_CASE(test_iov_max) {
   return tmp_dir::do_with_thread([] (tmp_dir& t) {
     static constexpr size_t buffer_size = 4096;
@@ -408,6 +449,147 @@ SEASTAR_TEST_CASE(test_make_directory_permissions) {
   });
 }
 
+SEASTAR_TEST_CASE(test_list_directory_batches) {
+  return tmp_dir::do_with_thread([] (tmp_dir& t) {
+    constexpr unsigned nr_files = 1000;
+    for (unsigned i = 0; i < nr_files; i++) {
+        auto f = open_file_dma((t.get_path() / fmt::format("file-{}", i)).native(), open_flags::wo | open_flags::create).get0();
+        f.close().get();
+    }
+    make_directory((t.get_path() / "subdir").native()).get();
+
+    for (bool resolve_types : {false, true}) {
+        auto dir = open_directory(t.get_path().native()).get0();
+        std::map<sstring, std::optional<directory_entry_type>> listed;
+        unsigned batches = 0;
+        list_directory_options opts;
+        // Small enough to take several reads
+        opts.buffer_size = 4096;
+        opts.resolve_types = resolve_types;
+        dir.list_directory_batches([&] (std::span<directory_entry> entries) {
+            batches++;
+            for (auto& de : entries) {
+                BOOST_REQUIRE(listed.emplace(de.name, de.type).second);
+            }
+            return make_ready_future<>();
+        }, opts).get();
+        dir.close().get();
+
+        BOOST_REQUIRE_GT(batches, 1u);
+        BOOST_REQUIRE_EQUAL(listed.size(), nr_files + 1);
+        BOOST_REQUIRE(!listed.contains(".") && !listed.contains(".."));
+        if (resolve_types) {
+            BOOST_REQUIRE(listed["subdir"] == directory_entry_type::directory);
+            BOOST_REQUIRE(listed["file-0"] == directory_entry_type::regular);
+        }
+    }
+  });
+}
+
+SEASTAR_TEST_CASE(test_copy_file) {
+  return tmp_dir::do_with_thread([] (tmp_dir& t) {
+    auto src_name = (t.get_path() / "src").native();
+    auto dst_name = (t.get_path() / "dst").native();
+    // Not a multiple of the DMA alignment
+    constexpr size_t size = 3 * 4096 + 100;
+    sstring data(size, '\0');
+    for (size_t i = 0; i < size; i++) {
+        data[i] = 'a' + i % 26;
+    }
+    {
+        auto f = open_file_dma(src_name, open_flags::wo | open_flags::create).get0();
+        auto buf = allocate_aligned_buffer<char>(4 * 4096, 4096);
+        std::copy(data.begin(), data.end(), buf.get());
+        f.dma_write(0, buf.get(), 4 * 4096).get();
+        f.truncate(size).get();
+        f.close().get();
+    }
+
+    copy_file(src_name, dst_name).get();
+    BOOST_REQUIRE_EQUAL(util::read_entire_file_contiguous(dst_name).get0(), data);
+
+    // A range into the middle of an existing file
+    auto src = open_file_dma(src_name, open_flags::ro).get0();
+    auto dst = open_file_dma(dst_name, open_flags::rw).get0();
+    copy_file(src, 100, dst, 4096, 4096).get();
+    src.close().get();
+    dst.close().get();
+    auto expected = data.substr(0, 4096) + data.substr(100, 4096) + data.substr(2 * 4096);
+    BOOST_REQUIRE_EQUAL(util::read_entire_file_contiguous(dst_name).get0(), expected);
+  });
+}
+
+SEASTAR_TEST_CASE(test_mapped_file) {
+  return tmp_dir::do_with_thread([] (tmp_dir& t) {
+    auto name = (t.get_path() / "mapped").native();
+    constexpr size_t size = 16 * 4096;
+    {
+        auto f = open_file_dma(name, open_flags::wo | open_flags::create).get0();
+        auto buf = allocate_aligned_buffer<char>(size, 4096);
+        for (size_t i = 0; i < size; i++) {
+            buf.get()[i] = char(i / 4096);
+        }
+        f.dma_write(0, buf.get(), size).get();
+        f.flush().get();
+        f.close().get();
+    }
+
+    auto m = mapped_file::open(name).get0();
+    BOOST_REQUIRE_EQUAL(m.size(), size);
+    m.prefault(4096, 2 * 4096).get();
+    BOOST_REQUIRE(m.resident(4096, 2 * 4096));
+    BOOST_REQUIRE_EQUAL(m.data()[4096], 1);
+    BOOST_REQUIRE_EQUAL(m.data()[3 * 4096 - 1], 2);
+    m.prefault().get();
+    BOOST_REQUIRE(m.resident(0, size));
+    BOOST_REQUIRE_EQUAL(m.span().back(), 15);
+
+    auto empty_name = (t.get_path() / "empty").native();
+    open_file_dma(empty_name, open_flags::wo | open_flags::create).get0().close().get();
+    auto empty = mapped_file::open_populated(empty_name).get0();
+    BOOST_REQUIRE_EQUAL(empty.size(), 0u);
+    BOOST_REQUIRE(empty.resident(0, 1));
+
+    BOOST_REQUIRE_THROW(mapped_file::open((t.get_path() / "missing").native()).get(), std::system_error);
+  });
+}
+
+SEASTAR_TEST_CASE(test_append_log) {
+  return tmp_dir::do_with_thread([] (tmp_dir& t) {
+    auto name = (t.get_path() / "log").native();
+    sstring expected;
+    append_log_options opts;
+    opts.preallocation_size = 64 << 10;
+
+    auto log = open_append_log(name, opts).get0();
+    std::vector<future<uint64_t>> appends;
+    std::vector<uint64_t> offsets;
+    for (unsigned i = 0; i < 1000; i++) {
+        auto record = sstring(i % 100 + 1, char('a' + i % 26));
+        offsets.push_back(expected.size());
+        expected += record;
+        appends.push_back(log->append(record));
+    }
+    for (unsigned i = 0; i < appends.size(); i++) {
+        BOOST_REQUIRE_EQUAL(appends[i].get0(), offsets[i]);
+    }
+    // Concurrent appends are written together
+    BOOST_REQUIRE_LT(log->get_stats().writes, log->get_stats().appends);
+    BOOST_REQUIRE_GT(log->get_stats().preallocations, 0u);
+    BOOST_REQUIRE_EQUAL(log->get_stats().bytes, expected.size());
+    log->close().get();
+    BOOST_REQUIRE_EQUAL(file_size(name).get0(), expected.size());
+
+    // Reopened, appends go on from the unaligned end
+    log = open_append_log(name, opts).get0();
+    BOOST_REQUIRE_EQUAL(log->size(), expected.size());
+    BOOST_REQUIRE_EQUAL(log->append("tail").get0(), expected.size());
+    expected += "tail";
+    log->close().get();
+    BOOST_REQUIRE_EQUAL(util::read_entire_file_contiguous(name).get0(), expected);
+  });
+}
+
 SEASTAR_TEST_CASE(test_touch_directory_permissions) {
   return tmp_dir::do_with_thread([] (tmp_dir& t) {
     sstring dirname = (t.get_path() / "testdir.tmp").native();
@@ -646,6 +828,113 @@ SEASTAR_TEST_CASE(test_underlying_file) {
     });
 }
 
+SEASTAR_TEST_CASE(test_cached_file) {
+    return tmp_dir::do_with_thread([] (tmp_dir& t) {
+        auto oflags = open_flags::rw | open_flags::create | open_flags::truncate;
+        sstring filename = (t.get_path() / "testfile.tmp").native();
+        auto f = open_file_dma(filename, oflags).get0();
+        auto buf = allocate_aligned_buffer<char>(4096, 4096);
+        for (char c : { 'a', 'b', 'c' }) {
+            memset(buf.get(), c, 4096);
+            f.dma_write(f.size().get0(), buf.get(), 4096).get();
+        }
+        // a short last page
+        f.truncate(3 * 4096 + 100).get();
+
+        auto cf = make_cached_file(f);
+        auto close_cf = deferred_close(cf);
+        auto& stats = get_page_cache_stats();
+
+        auto misses = stats.misses;
+        auto rb = cf.dma_read<char>(4096 + 10, 20).get0();
+        BOOST_REQUIRE_EQUAL(rb.size(), 20);
+        BOOST_REQUIRE(std::all_of(rb.begin(), rb.end(), [] (char c) { return c == 'b'; }));
+        BOOST_REQUIRE_EQUAL(stats.misses, misses + 1);
+
+        // Hits the cached page, but misses both neighbours
+        auto hits = stats.hits;
+        rb = cf.dma_read<char>(4000, 8192).get0();
+        BOOST_REQUIRE_EQUAL(rb.size(), 8192);
+        BOOST_REQUIRE_EQUAL(rb[0], 'a');
+        BOOST_REQUIRE_EQUAL(rb[96], 'b');
+        BOOST_REQUIRE_EQUAL(rb[96 + 4096], 'c');
+        BOOST_REQUIRE_EQUAL(stats.hits, hits + 1);
+        BOOST_REQUIRE_EQUAL(stats.misses, misses + 3);
+
+        // Reads stop at the end of the file
+        rb = cf.dma_read_bulk<char>(3 * 4096, 8192).get0();
+        BOOST_REQUIRE_EQUAL(rb.size(), 100);
+        rb = cf.dma_read_bulk<char>(3 * 4096, 8192).get0();
+        BOOST_REQUIRE_EQUAL(rb.size(), 100);
+
+        // Writes through the cached file replace cached pages
+        memset(buf.get(), 'x', 4096);
+        cf.dma_write(4096, buf.get(), 4096).get();
+        rb = cf.dma_read<char>(4096, 4096).get0();
+        BOOST_REQUIRE(std::all_of(rb.begin(), rb.end(), [] (char c) { return c == 'x'; }));
+    });
+}
+
+SEASTAR_TEST_CASE(test_compressed_file) {
+    return tmp_dir::do_with_thread([] (tmp_dir& t) {
+        sstring filename = (t.get_path() / "compressed").native();
+        compressed_file_options opts;
+        opts.block_size = 16 << 10;
+        // Compressible, with an incompressible stretch, and a short last block
+        sstring data(10 * opts.block_size + 1000, '\0');
+        for (size_t i = 0; i < data.size(); i++) {
+            data[i] = 'a' + (i / 100) % 26;
+        }
+        std::mt19937 rng;
+        for (size_t i = 3 * opts.block_size; i < 4 * opts.block_size; i++) {
+            data[i] = char(rng());
+        }
+
+        auto f = open_file_dma(filename, open_flags::rw | open_flags::create).get0();
+        auto cf = make_compressed_file(f, opts).get0();
+        auto out = make_file_output_stream(cf).get0();
+        out.write(data).get();
+        out.close().get();
+        BOOST_REQUIRE_LT(file_size(filename).get0(), data.size() / 2);
+
+        f = open_file_dma(filename, open_flags::ro).get0();
+        cf = make_compressed_file(f, opts).get0();
+        auto close_cf = deferred_close(cf);
+        BOOST_REQUIRE_EQUAL(cf.size().get0(), data.size());
+        for (auto [pos, len] : std::initializer_list<std::pair<uint64_t, size_t>>{
+                {0, data.size()}, {100, 10}, {opts.block_size - 10, 20}, {3 * opts.block_size + 5, opts.block_size}, {data.size() - 10, 100}}) {
+            auto rb = cf.dma_read<char>(pos, len).get0();
+            BOOST_REQUIRE_EQUAL(std::string_view(rb.get(), rb.size()), std::string_view(data).substr(pos, len));
+        }
+        auto buf = allocate_aligned_buffer<char>(4096, 4096);
+        BOOST_REQUIRE_THROW(cf.dma_write(data.size(), buf.get(), 4096).get(), std::system_error);
+    });
+}
+
+SEASTAR_TEST_CASE(test_compressed_file_corruption) {
+    return tmp_dir::do_with_thread([] (tmp_dir& t) {
+        sstring filename = (t.get_path() / "compressed").native();
+        auto f = open_file_dma(filename, open_flags::rw | open_flags::create).get0();
+        auto cf = make_compressed_file(f).get0();
+        auto buf = allocate_aligned_buffer<char>(4096, 4096);
+        memset(buf.get(), 'x', 4096);
+        cf.dma_write(0, buf.get(), 4096).get();
+        // Writes must be sequential
+        BOOST_REQUIRE_THROW(cf.dma_write(0, buf.get(), 4096).get(), std::invalid_argument);
+        cf.close().get();
+
+        // Flip a byte of the only block, past the header block
+        f = open_file_dma(filename, open_flags::rw).get0();
+        auto rb = f.dma_read<char>(4096, 4096).get0();
+        memcpy(buf.get(), rb.get(), rb.size());
+        buf.get()[10] ^= 1;
+        f.dma_write(4096, buf.get(), 4096).get();
+        cf = make_compressed_file(f).get0();
+        auto close_cf = deferred_close(cf);
+        BOOST_REQUIRE_THROW(cf.dma_read<char>(0, 100).get(), std::runtime_error);
+    });
+}
+
 SEASTAR_TEST_CASE(test_file_stat_method_with_file) {
     return tmp_dir::do_with_thread([] (tmp_dir& t) {
         auto oflags = open_flags::rw | open_flags::create | open_flags::truncate;
@@ -948,3 +1237,71 @@ SEASTAR_TEST_CASE(test_oversized_io_works) {
         BOOST_REQUIRE((size_t)std::count_if(buf.get(), buf.get() + buf_size, [](auto x) { return x == 'a'; }) == buf_size);
     });
 }
+
+SEASTAR_TEST_CASE(test_dma_buffer_roundtrip) {
+    return tmp_dir::do_with_thread([] (tmp_dir& t) {
+        sstring filename = (t.get_path() / "testfile.tmp").native();
+        auto f = open_file_dma(filename, open_flags::rw | open_flags::create).get0();
+        auto close_f = deferred_close(f);
+
+        // May come from the io_uring fixed buffer arena, must behave like
+        // any other aligned buffer either way
+        auto wbuf = engine().allocate_dma_buffer(f.memory_dma_alignment(), 64 * 1024);
+        BOOST_REQUIRE_EQUAL(wbuf.size(), 64 * 1024);
+        BOOST_REQUIRE_EQUAL(reinterpret_cast<uintptr_t>(wbuf.get()) & (f.memory_dma_alignment() - 1), 0);
+        std::iota(wbuf.get_write(), wbuf.get_write() + wbuf.size(), 0);
+        BOOST_REQUIRE_EQUAL(f.dma_write(0, wbuf.get(), wbuf.size()).get0(), wbuf.size());
+
+        auto rbuf = f.dma_read_bulk<char>(0, wbuf.size()).get0();
+        BOOST_REQUIRE(rbuf == wbuf);
+    });
+}
+
+SEASTAR_TEST_CASE(test_io_trace) {
+    return tmp_dir::do_with_thread([] (tmp_dir& t) {
+        sstring filename = (t.get_path() / "testfile.tmp").native();
+        auto f = open_file_dma(filename, open_flags::rw | open_flags::create).get0();
+        auto close_f = deferred_close(f);
+        auto buf = allocate_aligned_buffer<unsigned char>(4096, 4096);
+        std::fill(buf.get(), buf.get() + 4096, 'a');
+
+        set_io_trace_size(4);
+        auto disable = defer([] () noexcept {
+            try {
+                set_io_trace_size(0);
+            } catch (...) {
+            }
+        });
+        for (unsigned i = 0; i < 3; i++) {
+            BOOST_REQUIRE_EQUAL(f.dma_write(i * 4096, buf.get(), 4096).get0(), 4096);
+        }
+        BOOST_REQUIRE_EQUAL(f.dma_read(4096, buf.get(), 4096).get0(), 4096);
+
+        auto trace = get_io_trace(true);
+        BOOST_REQUIRE_EQUAL(trace.entries.size(), 4);
+        BOOST_REQUIRE_EQUAL(trace.dropped, 0);
+        for (unsigned i = 0; i < 4; i++) {
+            auto& e = trace.entries[i];
+            BOOST_REQUIRE(e.result == io_trace_entry::outcome::completed);
+            BOOST_REQUIRE_EQUAL(e.write, i < 3);
+            BOOST_REQUIRE_EQUAL(e.pos, i < 3 ? i * 4096 : 4096);
+            BOOST_REQUIRE_EQUAL(e.length, 4096);
+            BOOST_REQUIRE_EQUAL(e.bytes, 4096);
+            BOOST_REQUIRE(e.queued <= e.dispatched);
+            BOOST_REQUIRE(e.dispatched <= e.completed);
+        }
+
+        // The ring keeps the last requests
+        for (unsigned i = 0; i < 6; i++) {
+            f.dma_read(i * 4096 % 12288, buf.get(), 4096).get();
+        }
+        trace = get_io_trace();
+        BOOST_REQUIRE_EQUAL(trace.entries.size(), 4);
+        BOOST_REQUIRE_EQUAL(trace.dropped, 2);
+        BOOST_REQUIRE_EQUAL(trace.entries.back().pos, 8192);
+        std::ostringstream os;
+        write_io_trace(os, trace);
+        auto text = os.str();
+        BOOST_REQUIRE_EQUAL(std::count(text.begin(), text.end(), '\n'), 4);
+    });
+}
@@ -163,3 +163,73 @@ SEASTAR_THREAD_TEST_CASE(foreign_ptr_destroy_test) {
     BOOST_REQUIRE(destroyed_on[1]);
     BOOST_REQUIRE(!destroyed_on[0]);
 }
+
+SEASTAR_THREAD_TEST_CASE(foreign_ptr_batched_destroy_test) {
+    if (smp::count == 1) {
+        std::cerr << "Skipping multi-cpu foreign_ptr tests. Run with --smp=2 to test multi-cpu delete and reset.";
+        return;
+    }
+
+    using namespace std::chrono_literals;
+
+    struct tracked {
+        std::vector<int>& destroyed;
+        int id;
+        ~tracked() {
+            destroyed.push_back(this_shard_id() == 1 ? id : -1);
+        }
+    };
+
+    // Only touched on shard 1, if the objects are destroyed there
+    std::vector<int> destroyed;
+    constexpr int nr = 1000;
+    auto ptrs = smp::submit_to(1, [&] {
+        std::vector<foreign_ptr<std::unique_ptr<tracked>>> ptrs;
+        for (int i = 0; i < nr; i++) {
+            ptrs.push_back(make_foreign(std::make_unique<tracked>(destroyed, i)));
+        }
+        return ptrs;
+    }).get0();
+
+    ptrs.clear();
+    auto nr_destroyed = [&] {
+        return smp::submit_to(1, [&] { return destroyed.size(); }).get0();
+    };
+    while (nr_destroyed() != nr) {
+        sleep(1ms).get();
+    }
+    // On their shard, in order
+    smp::submit_to(1, [&] {
+        for (int i = 0; i < nr; i++) {
+            BOOST_REQUIRE_EQUAL(destroyed[i], i);
+        }
+    }).get();
+}
+
+SEASTAR_THREAD_TEST_CASE(submit_batched_test) {
+    if (smp::count == 1) {
+        std::cerr << "Skipping multi-cpu foreign_ptr tests. Run with --smp=2 to test multi-cpu delete and reset.";
+        return;
+    }
+
+    using namespace std::chrono_literals;
+
+    std::vector<int> order;
+    std::vector<int> local_order;
+    for (int i = 0; i < 100; i++) {
+        smp::submit_batched(1, [&order, i] {
+            order.push_back(i);
+        });
+        // Runs in place
+        smp::submit_batched(0, [&local_order, i] {
+            local_order.push_back(i);
+        });
+    }
+    BOOST_REQUIRE_EQUAL(local_order.size(), 100u);
+    while (smp::submit_to(1, [&] { return order.size(); }).get0() != 100) {
+        sleep(1ms).get();
+    }
+    for (int i = 0; i < 100; i++) {
+        BOOST_REQUIRE_EQUAL(order[i], i);
+    }
+}
@@ -225,3 +225,67 @@ SEASTAR_THREAD_TEST_CASE(test_shutdown_notifier) {
     auto events = fut.get0();
     BOOST_REQUIRE(events.empty());
 }
+
+SEASTAR_THREAD_TEST_CASE(test_notify_batched_coalesced) {
+    tmpdir tmp;
+    fsnotifier fsn;
+
+    auto w = fsn.create_watch(tmp.path().native(), fsnotifier::flags::create_child | fsnotifier::flags::modify).get0();
+
+    constexpr unsigned nr_files = 200;
+    for (unsigned i = 0; i < nr_files; i++) {
+        auto f = open_file_dma((tmp.path() / fmt::format("file-{}", i)).native(), open_flags::create|open_flags::rw).get0();
+        f.close().get();
+    }
+    auto p = tmp.path() / "kossa.dat";
+    auto f = open_file_dma(p.native(), open_flags::create|open_flags::rw).get0();
+    auto os = api_v3::and_newer::make_file_output_stream(f).get0();
+    for (int i = 0; i < 10; i++) {
+        os.write("kossa").get();
+        os.flush().get();
+    }
+    os.close().get();
+
+    fsnotifier::wait_options opts;
+    opts.coalesce_window = std::chrono::milliseconds(10);
+    auto events = fsn.wait(opts).get0();
+    // All queued events in one batch, the writes to the file in one event
+    BOOST_REQUIRE_EQUAL(std::count_if(events.begin(), events.end(), [] (auto& e) {
+        return (e.mask & fsnotifier::flags::create_child) != fsnotifier::flags{};
+    }), nr_files + 1);
+    BOOST_REQUIRE_EQUAL(std::count_if(events.begin(), events.end(), [&] (auto& e) {
+        return (e.mask & fsnotifier::flags::modify) != fsnotifier::flags{} && e.name == p.filename().native();
+    }), 1);
+    BOOST_REQUIRE(find_event(events, w, fsnotifier::flags::modify, p.filename().native()));
+}
+
+SEASTAR_THREAD_TEST_CASE(test_notify_recursive) {
+    tmpdir tmp;
+    fsnotifier fsn;
+
+    make_directory((tmp.path() / "a").native()).get();
+    make_directory((tmp.path() / "a" / "b").native()).get();
+    auto w = fsn.create_recursive_watch(tmp.path().native(), fsnotifier::flags::create_child).get0();
+
+    auto touch = [&] (fs::path p) {
+        open_file_dma(p.native(), open_flags::create|open_flags::rw).get0().close().get();
+    };
+
+    touch(tmp.path() / "a" / "b" / "deep");
+    {
+        auto events = fsn.wait().get0();
+        BOOST_REQUIRE(find_event(events, w, fsnotifier::flags::create_child, "a/b/deep"));
+    }
+
+    // A new directory is watched once its creation is seen
+    make_directory((tmp.path() / "c").native()).get();
+    {
+        auto events = fsn.wait().get0();
+        BOOST_REQUIRE(find_event(events, w, fsnotifier::flags::create_child, "c"));
+    }
+    touch(tmp.path() / "c" / "new");
+    {
+        auto events = fsn.wait().get0();
+        BOOST_REQUIRE(find_event(events, w, fsnotifier::flags::create_child, "c/new"));
+    }
+}
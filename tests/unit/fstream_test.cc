@@ -539,6 +539,83 @@ SEASTAR_TEST_CASE(test_fstream_slow_start) {
     });
 }
 
+SEASTAR_TEST_CASE(test_fstream_adaptive_read_ahead) {
+    return seastar::async([] {
+        static constexpr size_t file_size = 64 * 1024 * 1024;
+        static constexpr size_t buffer_size = 64 * 1024;
+
+        auto mock_file = make_shared<mock_read_only_file>(file_size);
+        mock_file->set_expected_read_size(buffer_size);
+
+        file_input_stream_options options{};
+        options.buffer_size = buffer_size;
+        options.read_ahead = 8;
+        options.adaptive_read_ahead = true;
+        auto fstr = make_file_input_stream(file(mock_file), 0, file_size, options);
+
+        auto read_issuing = [&] (size_t requests) {
+            mock_file->set_allowed_read_requests(requests);
+            auto buf = fstr.read().get0();
+            BOOST_REQUIRE_EQUAL(buf.size(), buffer_size);
+        };
+
+        // Sequential, read-ahead doubles with every read: 1, 2, 4, 8, 8
+        read_issuing(2);
+        read_issuing(2);
+        read_issuing(3);
+        read_issuing(5);
+        read_issuing(1);
+
+        // Random skip drops read-ahead altogether
+        fstr.skip(10 * buffer_size + 4096).get();
+        read_issuing(1);
+        fstr.skip(20 * buffer_size - 4096).get();
+        read_issuing(1);
+
+        // ... until the stream becomes sequential again
+        read_issuing(2);
+        read_issuing(2);
+
+        fstr.close().get();
+    });
+}
+
+SEASTAR_TEST_CASE(test_fstream_coalescing_writes) {
+    return tmp_dir::do_with_thread([] (tmp_dir& t) {
+        auto filename = (t.get_path() / "testfile.tmp").native();
+        // Small enough for put() to wait for some writes to complete
+        set_write_behind_memory_limit(64 * 1024);
+        auto reset_limit = defer([] () noexcept { set_write_behind_memory_limit(std::numeric_limits<size_t>::max()); });
+
+        auto f = open_file_dma(filename, open_flags::rw | open_flags::create | open_flags::truncate).get0();
+        file_output_stream_options options;
+        options.buffer_size = 4096;
+        options.write_behind = 4;
+        options.coalesce_size = 32 * 1024;
+        auto out = make_file_output_stream(std::move(f), options).get0();
+
+        static constexpr size_t file_size = 1024 * 1024 + 17;
+        for (size_t i = 0; i < file_size; i++) {
+            out.write(format("{}", char('a' + i % 26))).get();
+            if (i + 1 == 512 * 1024) {
+                // a barrier at an aligned position
+                out.flush().get();
+            }
+        }
+        out.close().get();
+
+        f = open_file_dma(filename, open_flags::ro).get0();
+        BOOST_REQUIRE_EQUAL(f.size().get0(), file_size);
+        auto in = make_file_input_stream(std::move(f));
+        auto buf = in.read_exactly(file_size).get0();
+        in.close().get();
+        BOOST_REQUIRE_EQUAL(buf.size(), file_size);
+        for (size_t i = 0; i < file_size; i++) {
+            BOOST_REQUIRE_EQUAL(buf[i], char('a' + i % 26));
+        }
+    });
+}
+
 #ifdef SEASTAR_ENABLE_ALLOC_FAILURE_INJECTION
 
 SEASTAR_TEST_CASE(test_close_error) {
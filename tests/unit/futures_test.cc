@@ -46,7 +46,10 @@
 #include <boost/range/irange.hpp>
 
 #include <seastar/core/internal/api-level.hh>
+#include <seastar/core/internal/wakeup_batch.hh>
+#include <numeric>
 #include <stdexcept>
+#include <string_view>
 #include <unistd.h>
 
 using namespace seastar;
@@ -1480,6 +1483,27 @@ SEASTAR_THREAD_TEST_CASE(test_shared_future_with_abort) {
     BOOST_REQUIRE(f4.available());
 }
 
+SEASTAR_THREAD_TEST_CASE(test_shared_future_batched_wakeups) {
+    shared_promise<int> pr;
+    std::vector<future<int>> fs;
+    for (int i = 0; i < 1000; ++i) {
+        fs.push_back(pr.get_shared_future());
+    }
+    auto before = internal::get_wakeup_stats();
+    pr.set_value(42);
+    // Resolved in batches, each of its own task when the task quota is
+    // used up (always in debug mode)
+    for (auto& f : fs) {
+        BOOST_REQUIRE_EQUAL(f.get0(), 42);
+    }
+    auto& after = internal::get_wakeup_stats();
+    BOOST_REQUIRE_EQUAL(after.wakeups, before.wakeups + 1);
+    BOOST_REQUIRE_EQUAL(after.waiters, before.waiters + 1000);
+#ifdef SEASTAR_DEBUG
+    BOOST_REQUIRE_GE(after.deferred_batches, before.deferred_batches + 1000 / internal::min_wakeup_batch);
+#endif
+}
+
 #if SEASTAR_API_LEVEL < 4
 #define THEN_UNPACK then
 #else
@@ -1903,6 +1927,40 @@ SEASTAR_THREAD_TEST_CASE(test_for_each_set) {
     BOOST_REQUIRE_EQUAL(res, 17);
 }
 
+SEASTAR_THREAD_TEST_CASE(test_preemptible_for_each) {
+    std::vector<int> range(1000);
+    std::iota(range.begin(), range.end(), 0);
+    long sum = 0;
+    preemptible_for_each(range, [&sum] (int v) {
+        sum += v;
+        // For the stall detector to report
+        BOOST_REQUIRE_EQUAL(internal::running_loop_name(), std::string_view("sum"));
+    }, {.name = "sum"}).get();
+    BOOST_REQUIRE_EQUAL(sum, 999 * 1000 / 2);
+    BOOST_REQUIRE(!internal::running_loop_name());
+
+    BOOST_REQUIRE_THROW(preemptible_for_each(range.begin(), range.end(), [] (int v) {
+        if (v == 500) {
+            throw expected_exception();
+        }
+    }).get(), expected_exception);
+
+    // A long loop lets other tasks run
+    bool other_ran = false;
+    bool other_ran_during_loop = false;
+    auto other = yield().then([&] {
+        other_ran = true;
+    });
+    preemptible_for_each(range, [&] (int) {
+        auto end = std::chrono::steady_clock::now() + 20us;
+        while (std::chrono::steady_clock::now() < end) {
+        }
+        other_ran_during_loop |= other_ran;
+    }, {.check_every = 4}).get();
+    other.get();
+    BOOST_REQUIRE(other_ran_during_loop);
+}
+
 SEASTAR_THREAD_TEST_CASE(test_yield) {
     bool flag = false;
     auto one = yield().then([&] {
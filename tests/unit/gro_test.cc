@@ -0,0 +1,134 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#define BOOST_TEST_MODULE gro
+
+#include <boost/test/included/unit_test.hpp>
+#include <seastar/net/ethernet.hh>
+#include <seastar/net/ip.hh>
+#include <seastar/net/tcp.hh>
+#include "../../src/net/gro.hh"
+
+using namespace seastar;
+using namespace net;
+
+namespace {
+
+constexpr uint8_t f_ack = 1 << 4;
+constexpr uint8_t f_psh = 1 << 3;
+constexpr uint8_t f_fin = 1 << 0;
+
+packet make_segment(uint16_t src_port, uint32_t seq, size_t len, uint8_t flags = f_ack, char fill = 'x') {
+    auto tcp_len = tcp_hdr::len;
+    temporary_buffer<char> buf(sizeof(eth_hdr) + sizeof(ip_hdr) + tcp_len + len);
+    std::fill_n(buf.get_write(), buf.size(), 0);
+    auto eh = reinterpret_cast<eth_hdr*>(buf.get_write());
+    eh->eth_proto = uint16_t(eth_protocol_num::ipv4);
+    *eh = hton(*eh);
+    auto iph = reinterpret_cast<ip_hdr*>(buf.get_write() + sizeof(eth_hdr));
+    iph->ihl = sizeof(ip_hdr) / 4;
+    iph->ver = 4;
+    iph->len = sizeof(ip_hdr) + tcp_len + len;
+    iph->ttl = 64;
+    iph->ip_proto = uint8_t(ip_protocol_num::tcp);
+    iph->src_ip = ipv4_address(0x0a000001);
+    iph->dst_ip = ipv4_address(0x0a000002);
+    *iph = hton(*iph);
+    auto th = buf.get_write() + sizeof(eth_hdr) + sizeof(ip_hdr);
+    write_be<uint16_t>(th + 0, src_port);
+    write_be<uint16_t>(th + 2, 80);
+    write_be<uint32_t>(th + 4, seq);
+    write_be<uint32_t>(th + 8, 1);
+    th[12] = (tcp_len / 4) << 4;
+    th[13] = flags;
+    write_be<uint16_t>(th + 14, 1024);
+    std::fill_n(th + tcp_len, len, fill);
+    return packet(fragment{buf.get_write(), buf.size()}, buf.release());
+}
+
+struct harness {
+    std::vector<packet> delivered;
+    gro g{[this] (packet p) { delivered.push_back(std::move(p)); }};
+};
+
+std::string payload(packet& p) {
+    auto hdr = sizeof(eth_hdr) + sizeof(ip_hdr) + tcp_hdr::len;
+    p.linearize();
+    auto& f = p.frag(0);
+    return std::string(f.base + hdr, f.size - hdr);
+}
+
+uint16_t ip_len(packet& p) {
+    return ntoh(*p.get_header<ip_hdr>(sizeof(eth_hdr))).len;
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(test_merges_in_order_segments) {
+    harness h;
+    h.g.receive(make_segment(1000, 100, 10, f_ack, 'a'));
+    h.g.receive(make_segment(1000, 110, 10, f_ack, 'b'));
+    h.g.receive(make_segment(1000, 120, 5, f_ack, 'c'));
+    BOOST_REQUIRE(h.delivered.empty());
+    h.g.flush();
+    BOOST_REQUIRE_EQUAL(h.delivered.size(), 1u);
+    BOOST_REQUIRE_EQUAL(h.g.merged(), 2u);
+    auto& p = h.delivered[0];
+    BOOST_REQUIRE_EQUAL(ip_len(p), sizeof(ip_hdr) + tcp_hdr::len + 25);
+    BOOST_REQUIRE_EQUAL(payload(p), std::string(10, 'a') + std::string(10, 'b') + std::string(5, 'c'));
+    checksummer csum;
+    csum.sum(p.get_header(sizeof(eth_hdr), sizeof(ip_hdr)), sizeof(ip_hdr));
+    BOOST_REQUIRE_EQUAL(csum.get(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(test_does_not_merge_across_gaps_and_flows) {
+    harness h;
+    h.g.receive(make_segment(1000, 100, 10));
+    h.g.receive(make_segment(2000, 100, 10));
+    // A gap ends the held run of its flow only
+    h.g.receive(make_segment(1000, 200, 10));
+    BOOST_REQUIRE_EQUAL(h.delivered.size(), 1u);
+    h.g.receive(make_segment(2000, 110, 10));
+    h.g.flush();
+    BOOST_REQUIRE_EQUAL(h.delivered.size(), 3u);
+    BOOST_REQUIRE_EQUAL(h.g.merged(), 1u);
+}
+
+BOOST_AUTO_TEST_CASE(test_control_segments_keep_order) {
+    harness h;
+    h.g.receive(make_segment(1000, 100, 10, f_ack, 'a'));
+    h.g.receive(make_segment(1000, 110, 0, f_ack | f_fin));
+    BOOST_REQUIRE_EQUAL(h.delivered.size(), 2u);
+    BOOST_REQUIRE_EQUAL(payload(h.delivered[0]), std::string(10, 'a'));
+    BOOST_REQUIRE_EQUAL(payload(h.delivered[1]), "");
+}
+
+BOOST_AUTO_TEST_CASE(test_push_ends_merging) {
+    harness h;
+    h.g.receive(make_segment(1000, 100, 10));
+    h.g.receive(make_segment(1000, 110, 10, f_ack | f_psh));
+    BOOST_REQUIRE_EQUAL(h.delivered.size(), 1u);
+    auto th = h.delivered[0].get_header(sizeof(eth_hdr) + sizeof(ip_hdr), tcp_hdr::len);
+    BOOST_REQUIRE(tcp_hdr::read(th).f_psh);
+    h.g.receive(make_segment(1000, 120, 10));
+    h.g.flush();
+    BOOST_REQUIRE_EQUAL(h.delivered.size(), 2u);
+}
@@ -21,9 +21,18 @@
 #include <seastar/util/noncopyable_function.hh>
 #include <seastar/http/json_path.hh>
 #include <seastar/http/response_parser.hh>
+#include <seastar/http/client.hh>
+#include <seastar/http/internal/hpack.hh>
+#include <seastar/http/compression.hh>
+#include <seastar/core/byteorder.hh>
+#include <seastar/util/short_streams.hh>
 #include <sstream>
+#include <map>
+#include <set>
 #include <seastar/core/shared_future.hh>
 #include <seastar/util/later.hh>
+#include <seastar/core/sleep.hh>
+#include <zlib.h>
 
 using namespace seastar;
 using namespace httpd;
@@ -98,6 +107,50 @@ SEASTAR_TEST_CASE(test_match_rule_order)
     return make_ready_future<>();
 }
 
+SEASTAR_TEST_CASE(test_route_tree)
+{
+    parameters params;
+    routes route;
+
+    handl* users = new handl();
+    route.add(operation_type::GET, url("/api/users").remainder("id"), users);
+    handl* posts = new handl();
+    auto posts_rule = new match_rule(posts);
+    posts_rule->add_str("/api/users").add_param("id").add_str("/posts").add_param("post");
+    route.add(posts_rule, operation_type::GET);
+    handl* files = new handl();
+    auto files_rule = new match_rule(files);
+    files_rule->add_str("/files").add_param("path", true);
+    route.add(files_rule, operation_type::GET);
+
+    // The earlier rule takes everything under /api/users
+    BOOST_REQUIRE_EQUAL(route.get_handler(GET, "/api/users/7/posts/3", params), users);
+    BOOST_REQUIRE_EQUAL(params.path("id"), "/7/posts/3");
+    params.clear();
+
+    BOOST_REQUIRE_EQUAL(route.get_handler(GET, "/files/etc/hosts", params), files);
+    BOOST_REQUIRE_EQUAL(params["path"], "etc/hosts");
+    params.clear();
+
+    httpd::handler_base* nl = nullptr;
+    BOOST_REQUIRE_EQUAL(route.get_handler(GET, "/api/groups/7", params), nl);
+    BOOST_REQUIRE_EQUAL(route.get_handler(POST, "/files/etc/hosts", params), nl);
+
+    // Rules added after a lookup are seen by the next one
+    handl* comments = new handl();
+    auto comments_rule = new match_rule(comments);
+    comments_rule->add_str("/api/comments").add_param("id").add_str("/");
+    auto cookie = route.add_cookie(comments_rule, GET);
+    BOOST_REQUIRE_EQUAL(route.get_handler(GET, "/api/comments/5/", params), comments);
+    BOOST_REQUIRE_EQUAL(params["id"], "5");
+    params.clear();
+    BOOST_REQUIRE_EQUAL(route.get_handler(GET, "/api/comments/5/6", params), nl);
+    delete route.del_cookie(cookie, GET);
+    BOOST_REQUIRE_EQUAL(route.get_handler(GET, "/api/comments/5/", params), nl);
+
+    return make_ready_future<>();
+}
+
 SEASTAR_TEST_CASE(test_put_drop_rule)
 {
     routes rts;
@@ -373,6 +426,97 @@ SEASTAR_TEST_CASE(test_transformer) {
     });
 }
 
+static std::string inflate_all(std::string_view in) {
+    z_stream zs = {};
+    // Takes both the zlib and the gzip wrapping
+    BOOST_REQUIRE_EQUAL(inflateInit2(&zs, 15 + 32), Z_OK);
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+    zs.avail_in = in.size();
+    std::string out;
+    int r;
+    do {
+        char buf[4096];
+        zs.next_out = reinterpret_cast<Bytef*>(buf);
+        zs.avail_out = sizeof(buf);
+        r = inflate(&zs, Z_NO_FLUSH);
+        BOOST_REQUIRE(r == Z_OK || r == Z_STREAM_END);
+        out.append(buf, sizeof(buf) - zs.avail_out);
+    } while (r != Z_STREAM_END);
+    BOOST_REQUIRE_EQUAL(zs.avail_in, 0);
+    inflateEnd(&zs);
+    return out;
+}
+
+SEASTAR_THREAD_TEST_CASE(test_compression) {
+    using ce = content_encoding;
+    std::vector<ce> candidates = {ce::br, ce::gzip, ce::deflate};
+    BOOST_REQUIRE(negotiate_content_encoding("", candidates) == ce::identity);
+    BOOST_REQUIRE(negotiate_content_encoding("identity", candidates) == ce::identity);
+    BOOST_REQUIRE(negotiate_content_encoding("gzip, deflate", candidates) == ce::gzip);
+    BOOST_REQUIRE(negotiate_content_encoding("deflate, GZIP, br", candidates) == ce::br);
+    BOOST_REQUIRE(negotiate_content_encoding("gzip;q=0.5, deflate", candidates) == ce::deflate);
+    BOOST_REQUIRE(negotiate_content_encoding("gzip ; q=1.0, br;q=0", candidates) == ce::gzip);
+    BOOST_REQUIRE(negotiate_content_encoding("x-gzip", candidates) == ce::gzip);
+    BOOST_REQUIRE(negotiate_content_encoding("*", candidates) == ce::br);
+    BOOST_REQUIRE(negotiate_content_encoding("br;q=0, *;q=0.1", candidates) == ce::gzip);
+    BOOST_REQUIRE(negotiate_content_encoding("gzip", {ce::deflate}) == ce::identity);
+
+    BOOST_REQUIRE(is_compressible("application/json"));
+    BOOST_REQUIRE(is_compressible("text/html; charset=utf-8"));
+    BOOST_REQUIRE(is_compressible("image/svg+xml"));
+    BOOST_REQUIRE(!is_compressible("image/png"));
+    BOOST_REQUIRE(!is_compressible("application/octet-stream"));
+
+    std::string text;
+    for (int i = 0; i < 20000; i++) {
+        text += format("{{\"id\": {}, \"name\": \"item\"}},", i);
+    }
+    for (auto e : {ce::gzip, ce::deflate}) {
+        std::stringstream ss;
+        auto out = make_compressed_output_stream(output_stream<char>(memory_data_sink(ss), 4096), e, 1);
+        // Uneven parts, with a flush in the middle
+        size_t pos = 0;
+        for (size_t n = 1; pos < text.size(); n = n * 3 + 1) {
+            n = std::min(n, text.size() - pos);
+            out.write(text.data() + pos, n).get();
+            pos += n;
+            if (pos > text.size() / 2 && pos - n <= text.size() / 2) {
+                out.flush().get();
+                // All that came so far can be decoded
+                BOOST_REQUIRE(!ss.str().empty());
+            }
+        }
+        out.close().get();
+        auto compressed = ss.str();
+        BOOST_REQUIRE_LT(compressed.size(), text.size() / 5);
+        BOOST_REQUIRE_EQUAL(inflate_all(compressed), text);
+
+        auto whole = compress(sstring(text), e).get0();
+        BOOST_REQUIRE_EQUAL(inflate_all(whole), text);
+    }
+
+    compression_config cfg;
+    cfg.encodings = {ce::gzip, ce::deflate};
+    reply rep;
+    rep.write_body("json", sstring(text));
+    compress_reply(rep, "gzip;q=0.5, deflate", cfg).get();
+    BOOST_REQUIRE_EQUAL(rep._headers["Content-Encoding"], "deflate");
+    BOOST_REQUIRE_EQUAL(rep._headers["Vary"], "Accept-Encoding");
+    BOOST_REQUIRE_EQUAL(inflate_all(rep._content), text);
+
+    reply small;
+    small.write_body("json", sstring("{}"));
+    compress_reply(small, "gzip", cfg).get();
+    BOOST_REQUIRE_EQUAL(small._headers.count("Content-Encoding"), 0);
+    BOOST_REQUIRE_EQUAL(small._headers["Vary"], "Accept-Encoding");
+
+    reply image;
+    image.write_body("png", sstring(text));
+    compress_reply(image, "gzip", cfg).get();
+    BOOST_REQUIRE_EQUAL(image._headers.count("Content-Encoding"), 0);
+    BOOST_REQUIRE_EQUAL(image._content, text);
+}
+
 struct http_consumer {
     std::map<sstring, std::string> _headers;
     std::string _body;
@@ -838,6 +982,56 @@ SEASTAR_TEST_CASE(test_100_continue) {
 }
 
 
+SEASTAR_TEST_CASE(test_pipelined_requests) {
+    return seastar::async([] {
+        loopback_connection_factory lcf;
+        http_server server("test");
+        server.set_max_pipelined_requests(4);
+        loopback_socket_impl lsi(lcf);
+        httpd::http_server_tester::listeners(server).emplace_back(lcf.get_server_socket());
+        constexpr int requests = 8;
+        int in_flight = 0;
+        int max_in_flight = 0;
+        future<> client = seastar::async([&lsi] {
+            connected_socket c_socket = lsi.connect(socket_address(ipv4_addr()), socket_address(ipv4_addr())).get0();
+            input_stream<char> input(c_socket.input());
+            output_stream<char> output(c_socket.output());
+            sstring reqs;
+            for (int i = 0; i < requests; i++) {
+                reqs += format("GET /test?id={} HTTP/1.1\r\nHost: test\r\n{}\r\n", i, i == requests - 1 ? "Connection: close\r\n" : "");
+            }
+            output.write(reqs).get();
+            output.flush().get();
+            auto resp = util::read_entire_stream_contiguous(input).get0();
+            // The earlier requests take longer, their replies still go first
+            size_t pos = 0;
+            for (int i = 0; i < requests; i++) {
+                auto next = resp.find(format("reply-{}", i), pos);
+                BOOST_REQUIRE_NE(next, sstring::npos);
+                pos = next;
+            }
+            input.close().get();
+            output.close().get();
+        });
+
+        server._routes.put(GET, "/test", new function_handler([&] (std::unique_ptr<request> req, std::unique_ptr<reply> rep) {
+            auto id = std::stoi(req->get_query_param("id"));
+            max_in_flight = std::max(max_in_flight, ++in_flight);
+            return sleep(std::chrono::milliseconds((requests - id) * 10)).then([&, id, rep = std::move(rep)] () mutable {
+                --in_flight;
+                rep->_content = format("reply-{}", id);
+                return std::move(rep);
+            });
+        }, "txt"));
+        server.do_accepts(0).get();
+
+        client.get();
+        server.stop().get();
+        BOOST_REQUIRE_GT(max_in_flight, 1);
+        BOOST_REQUIRE_LE(max_in_flight, 4);
+    });
+}
+
 SEASTAR_TEST_CASE(test_unparsable_request) {
     // Test if a message that cannot be parsed as a http request is being replied with a 400 Bad Request response
     return seastar::async([] {
@@ -1037,6 +1231,69 @@ SEASTAR_TEST_CASE(test_streamed_content) {
     });
 }
 
+SEASTAR_TEST_CASE(test_streamed_content_memory_limit) {
+    return seastar::async([] {
+        loopback_connection_factory lcf;
+        http_server server("test");
+        server.set_content_memory_limit(8);
+        loopback_socket_impl lsi(lcf);
+        httpd::http_server_tester::listeners(server).emplace_back(lcf.get_server_socket());
+        promise<> first_part_read;
+        future<> client = seastar::async([&lsi, &first_part_read] {
+            connected_socket c_socket = lsi.connect(socket_address(ipv4_addr()), socket_address(ipv4_addr())).get0();
+            input_stream<char> input(c_socket.input());
+            output_stream<char> output(c_socket.output());
+
+            output.write(sstring("POST /stream HTTP/1.1\r\nHost: test\r\nContent-Length: 20\r\n\r\n1234567890")).get();
+            output.flush().get();
+            first_part_read.get_future().get();
+            output.write(sstring("abcdefghij")).get();
+            output.flush().get();
+            auto resp = input.read().get0();
+            BOOST_REQUIRE_NE(std::string(resp.get(), resp.size()).find("1234567890abcdefghij"), std::string::npos);
+
+            // Other handlers still get the body read for them
+            output.write(sstring("POST /buffered HTTP/1.1\r\nHost: test\r\nContent-Length: 5\r\n\r\nhello")).get();
+            output.flush().get();
+            resp = input.read().get0();
+            BOOST_REQUIRE_NE(std::string(resp.get(), resp.size()).find("hello"), std::string::npos);
+
+            input.close().get();
+            output.close().get();
+        });
+
+        auto streaming = new function_handler([&first_part_read] (std::unique_ptr<request> req, std::unique_ptr<reply> rep) {
+            return seastar::async([&first_part_read, req = std::move(req), rep = std::move(rep)] () mutable {
+                BOOST_REQUIRE(req->content.empty());
+                auto first = req->content_stream->read().get0();
+                BOOST_REQUIRE_EQUAL(first.size(), 10);
+                first_part_read.set_value();
+                // The first part takes up all of the memory, so the second
+                // one is held back until it is released
+                auto next = req->content_stream->read();
+                sleep(std::chrono::milliseconds(20)).get();
+                BOOST_REQUIRE(!next.available());
+                sstring body(first.get(), first.size());
+                first = {};
+                auto second = next.get0();
+                body += sstring(second.get(), second.size());
+                BOOST_REQUIRE(req->content_stream->read().get0().empty());
+                rep->_content = std::move(body);
+                return std::move(rep);
+            });
+        }, "txt");
+        streaming->stream_content();
+        server._routes.put(POST, "/stream", streaming);
+        server._routes.put(POST, "/buffered", new function_handler([] (const_req req) {
+            return req.content;
+        }, "txt"));
+        server.do_accepts(0).get();
+
+        client.get();
+        server.stop().get();
+    });
+}
+
 SEASTAR_TEST_CASE(test_not_implemented_encoding) {
     return check_http_reply({
         "GET /test HTTP/1.1\r\nHost: test\r\nTransfer-Encoding: gzip, chunked\r\n\r\n",
@@ -1120,6 +1377,209 @@ SEASTAR_TEST_CASE(test_string_content) {
     });
 }
 
+class loopback_http_factory : public http::connection_factory {
+    loopback_socket_impl _lsi;
+public:
+    explicit loopback_http_factory(loopback_connection_factory& lcf) : _lsi(lcf) {}
+    virtual future<connected_socket> make() override {
+        return _lsi.connect(socket_address(ipv4_addr()), socket_address(ipv4_addr()));
+    }
+};
+
+static http::client::reply_handler expect_body(sstring expected) {
+    return [expected] (const http_response& rsp, input_stream<char>& body) {
+        return util::read_entire_stream_contiguous(body).then([expected] (sstring s) {
+            BOOST_REQUIRE_EQUAL(s, expected);
+        });
+    };
+}
+
+SEASTAR_TEST_CASE(test_http_client) {
+    return seastar::async([] {
+        loopback_connection_factory lcf;
+        http_server server("test");
+        httpd::http_server_tester::listeners(server).emplace_back(lcf.get_server_socket());
+        server._routes.put(GET, "/test", new function_handler([] (const_req req) { return "hello"; }, "txt"));
+        server._routes.put(POST, "/echo", new function_handler([] (const_req req) { return req.content; }, "txt"));
+        server.do_accepts(0).get();
+
+        http::client cln(std::make_unique<loopback_http_factory>(lcf));
+        for (int i = 0; i < 5; i++) {
+            cln.make_request(request::make("GET", "test", "/test"), expect_body("hello"), reply::status_type::ok).get();
+        }
+        // The connection is kept alive between the requests
+        BOOST_REQUIRE_EQUAL(cln.total_new_connections(), 1);
+
+        auto req = request::make("POST", "test", "/echo");
+        req.write_body("txt", sstring("plain body"));
+        cln.make_request(std::move(req), expect_body("plain body")).get();
+
+        req = request::make("POST", "test", "/echo");
+        req.write_body("txt", [] (output_stream<char>&& o) {
+            return do_with(std::move(o), [] (output_stream<char>& out) {
+                return out.write("chunked ").then([&out] {
+                    return out.write("body");
+                }).then([&out] {
+                    return out.close();
+                });
+            });
+        });
+        cln.make_request(std::move(req), expect_body("chunked body")).get();
+
+        BOOST_REQUIRE_THROW(cln.make_request(request::make("GET", "test", "/missing"), expect_body(""), reply::status_type::ok).get(),
+                http::unexpected_status_error);
+        // The unread body of the failed request was skipped
+        cln.make_request(request::make("GET", "test", "/test"), expect_body("hello")).get();
+        BOOST_REQUIRE_EQUAL(cln.total_new_connections(), 1);
+
+        cln.close().get();
+        server.stop().get();
+    });
+}
+
+SEASTAR_TEST_CASE(test_http_client_pipelining) {
+    return seastar::async([] {
+        loopback_connection_factory lcf;
+        http_server server("test");
+        httpd::http_server_tester::listeners(server).emplace_back(lcf.get_server_socket());
+        server._routes.put(GET, "/test", new function_handler([] (const_req req) { return req.get_query_param("id"); }, "txt"));
+        server.do_accepts(0).get();
+
+        http::client_options opts;
+        opts.max_connections = 1;
+        opts.max_pipelined_requests = 4;
+        http::client cln(std::make_unique<loopback_http_factory>(lcf), opts);
+        std::vector<future<>> fs;
+        for (int i = 0; i < 10; i++) {
+            fs.push_back(cln.make_request(request::make("GET", "test", format("/test?id={}", i)), expect_body(to_sstring(i))));
+        }
+        when_all_succeed(fs.begin(), fs.end()).get();
+        BOOST_REQUIRE_EQUAL(cln.total_new_connections(), 1);
+
+        cln.close().get();
+        server.stop().get();
+    });
+}
+
+SEASTAR_TEST_CASE(test_hpack) {
+    // RFC 7541, Appendix C.4.1
+    const char expected[] = "\x82\x86\x84\x41\x8c\xf1\xe3\xc2\xe5\xf2\x3a\x6b\xa0\xab\x90\xf4\xff";
+    http::internal::hpack_decoder decoder;
+    auto fields = decoder.decode(std::string_view(expected, sizeof(expected) - 1));
+    BOOST_REQUIRE_EQUAL(fields.size(), 4);
+    BOOST_REQUIRE_EQUAL(fields[0].second, "GET");
+    BOOST_REQUIRE_EQUAL(fields[1].second, "http");
+    BOOST_REQUIRE_EQUAL(fields[2].second, "/");
+    BOOST_REQUIRE_EQUAL(fields[3].first, ":authority");
+    BOOST_REQUIRE_EQUAL(fields[3].second, "www.example.com");
+    BOOST_REQUIRE_EQUAL(decoder.table_size(), 57);
+
+    // The authority is now in the dynamic table, at index 62
+    fields = decoder.decode("\xbe");
+    BOOST_REQUIRE_EQUAL(fields.size(), 1);
+    BOOST_REQUIRE_EQUAL(fields[0].second, "www.example.com");
+
+    std::string block;
+    http::internal::hpack_encoder encoder;
+    encoder.encode(block, ":status", "200");
+    encoder.encode(block, "content-type", "text/plain");
+    encoder.encode(block, "x-custom", "some value");
+    fields = http::internal::hpack_decoder().decode(block);
+    BOOST_REQUIRE_EQUAL(block[0], '\x88');
+    BOOST_REQUIRE_EQUAL(fields.size(), 3);
+    BOOST_REQUIRE_EQUAL(fields[1].second, "text/plain");
+    BOOST_REQUIRE_EQUAL(fields[2].first, "x-custom");
+    BOOST_REQUIRE_EQUAL(fields[2].second, "some value");
+
+    BOOST_REQUIRE_THROW(http::internal::hpack_decoder().decode("\xc0"), http::internal::hpack_error);
+    return make_ready_future<>();
+}
+
+static sstring h2_frame(uint8_t type, uint8_t flags, uint32_t stream_id, std::string_view payload = {}) {
+    sstring frame(sstring::initialized_later(), 9 + payload.size());
+    frame[0] = char(payload.size() >> 16);
+    frame[1] = char(payload.size() >> 8);
+    frame[2] = char(payload.size());
+    frame[3] = char(type);
+    frame[4] = char(flags);
+    write_be<uint32_t>(frame.data() + 5, stream_id);
+    std::copy(payload.begin(), payload.end(), frame.data() + 9);
+    return frame;
+}
+
+SEASTAR_TEST_CASE(test_http2) {
+    return seastar::async([] {
+        loopback_connection_factory lcf;
+        http_server server("test");
+        server.set_http2(true);
+        httpd::http_server_tester::listeners(server).emplace_back(lcf.get_server_socket());
+        server._routes.put(GET, "/test", new function_handler([] (const_req req) { return req.get_query_param("id"); }, "txt"));
+        server._routes.put(POST, "/echo", new function_handler([] (const_req req) { return req.content; }, "txt"));
+        server.do_accepts(0).get();
+
+        loopback_socket_impl lsi(lcf);
+        connected_socket c_socket = lsi.connect(socket_address(ipv4_addr()), socket_address(ipv4_addr())).get0();
+        input_stream<char> input(c_socket.input());
+        output_stream<char> output(c_socket.output());
+
+        http::internal::hpack_encoder encoder;
+        auto request_headers = [&encoder] (const char* method, const char* path) {
+            std::string block;
+            encoder.encode(block, ":method", method);
+            encoder.encode(block, ":scheme", "http");
+            encoder.encode(block, ":authority", "test");
+            encoder.encode(block, ":path", path);
+            return block;
+        };
+        output.write(sstring("PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n")).get();
+        output.write(h2_frame(0x4, 0, 0)).get();
+        // Both streams are open before either is answered
+        output.write(h2_frame(0x1, 0x4, 1, request_headers("POST", "/echo"))).get();
+        output.write(h2_frame(0x1, 0x5, 3, request_headers("GET", "/test?id=3"))).get();
+        output.write(h2_frame(0x0, 0x1, 1, "echoed body")).get();
+        output.flush().get();
+
+        http::internal::hpack_decoder decoder;
+        std::map<uint32_t, sstring> statuses;
+        std::map<uint32_t, sstring> bodies;
+        std::set<uint32_t> ended;
+        bool settings_acked = false;
+        while (ended.size() < 2) {
+            auto header = input.read_exactly(9).get0();
+            BOOST_REQUIRE_EQUAL(header.size(), 9);
+            auto p = reinterpret_cast<const uint8_t*>(header.get());
+            size_t length = (size_t(p[0]) << 16) | (size_t(p[1]) << 8) | p[2];
+            uint32_t stream_id = read_be<uint32_t>(header.get() + 5);
+            auto payload = input.read_exactly(length).get0();
+            if (p[3] == 0x4) {
+                settings_acked |= p[4] & 0x1;
+            } else if (p[3] == 0x1) {
+                BOOST_REQUIRE(p[4] & 0x4);
+                for (auto& [name, value] : decoder.decode(std::string_view(payload.get(), payload.size()))) {
+                    if (name == ":status") {
+                        statuses[stream_id] = value;
+                    }
+                }
+            } else if (p[3] == 0x0) {
+                bodies[stream_id] += sstring(payload.get(), payload.size());
+            }
+            if ((p[3] == 0x0 || p[3] == 0x1) && (p[4] & 0x1)) {
+                ended.insert(stream_id);
+            }
+        }
+        BOOST_REQUIRE(settings_acked);
+        BOOST_REQUIRE_EQUAL(statuses[1], "200");
+        BOOST_REQUIRE_EQUAL(statuses[3], "200");
+        BOOST_REQUIRE_EQUAL(bodies[1], "echoed body");
+        BOOST_REQUIRE_EQUAL(bodies[3], "3");
+        BOOST_REQUIRE_EQUAL(server.requests_served(), 2);
+
+        input.close().get();
+        output.close().get();
+        server.stop().get();
+    });
+}
+
 SEASTAR_TEST_CASE(test_full_chunk_format) {
     return check_http_reply({
         "GET /test HTTP/1.1\r\nHost: test\r\nTransfer-Encoding: chunked\r\n\r\n",
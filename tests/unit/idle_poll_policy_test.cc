@@ -0,0 +1,84 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#define BOOST_TEST_MODULE core
+
+#include <boost/test/included/unit_test.hpp>
+#include <seastar/core/internal/idle_poll_policy.hh>
+
+using namespace seastar;
+using namespace std::chrono_literals;
+using internal::idle_poll_policy;
+
+BOOST_AUTO_TEST_CASE(test_short_periods_within_budget) {
+    idle_poll_policy p(200us, 0.1);
+    BOOST_REQUIRE(p.poll_time() == 200us);
+    // Polling through all of them costs 50ms a second
+    for (int i = 0; i < 1000; i++) {
+        p.on_idle_end(50us);
+    }
+    p.update(1s);
+    // Long enough for them, and no longer
+    BOOST_REQUIRE(p.poll_time() >= 50us);
+    BOOST_REQUIRE(p.poll_time() < 200us);
+}
+
+BOOST_AUTO_TEST_CASE(test_long_periods_are_not_polled_for) {
+    idle_poll_policy p(200us, 0.1);
+    for (int i = 0; i < 1000; i++) {
+        p.on_idle_end(50us);
+    }
+    p.update(1s);
+    // The load changes to work coming too late for polling to help
+    for (int s = 0; s < 10; s++) {
+        for (int i = 0; i < 50; i++) {
+            p.on_idle_end(10ms);
+        }
+        p.update(1s);
+    }
+    BOOST_REQUIRE(p.poll_time() == 0us);
+}
+
+BOOST_AUTO_TEST_CASE(test_budget) {
+    idle_poll_policy p(200us, 0.1);
+    // Polling through all of them would cost 300ms a second
+    for (int i = 0; i < 10000; i++) {
+        p.on_idle_end(30us);
+    }
+    p.update(1s);
+    BOOST_REQUIRE(p.poll_time() == 0us);
+
+    idle_poll_policy unlimited(200us, 1);
+    for (int i = 0; i < 10000; i++) {
+        unlimited.on_idle_end(30us);
+    }
+    unlimited.update(1s);
+    BOOST_REQUIRE(unlimited.poll_time() >= 30us);
+}
+
+BOOST_AUTO_TEST_CASE(test_max_poll_time) {
+    idle_poll_policy p(200us, 0.1);
+    for (int i = 0; i < 100; i++) {
+        p.on_idle_end(150us);
+    }
+    p.update(1s);
+    BOOST_REQUIRE(p.poll_time() == 200us);
+}
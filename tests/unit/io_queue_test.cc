@@ -73,8 +73,8 @@ struct io_queue_for_tests {
     io_queue queue;
     timer<> kicker;
 
-    io_queue_for_tests()
-        : group(std::make_shared<io_group>(io_queue::config{0}))
+    explicit io_queue_for_tests(io_queue::config cfg = io_queue::config{0})
+        : group(std::make_shared<io_group>(std::move(cfg)))
         , sink()
         , queue(group, sink)
         , kicker([this] { kick(); })
@@ -87,6 +87,10 @@ struct io_queue_for_tests {
             fg->replenish_capacity(std::chrono::steady_clock::now());
         }
     }
+
+    double rate_scale() const {
+        return group->_fgs[0]->rate_scale();
+    }
 };
 
 SEASTAR_THREAD_TEST_CASE(test_basic_flow) {
@@ -173,6 +177,101 @@ SEASTAR_THREAD_TEST_CASE(test_large_request_flow_error) {
     do_test_large_request_flow(part_flaw::error);
 }
 
+SEASTAR_THREAD_TEST_CASE(test_striped_request_split) {
+    io_queue::config cfg{0};
+    cfg.stripe_members = 2;
+    cfg.stripe_size = 4096;
+    io_queue_for_tests tio(std::move(cfg));
+
+    auto buf = std::make_unique<char[]>(8192);
+    auto f = tio.queue.queue_request(default_priority_class(), internal::io_direction_and_length(internal::io_direction_and_length::write_idx, 8192),
+                internal::io_request::make_write(0, 2048, buf.get(), 8192, false), nullptr, {});
+
+    std::vector<std::pair<uint64_t, size_t>> submitted;
+    seastar::sleep(std::chrono::milliseconds(500)).get();
+    tio.queue.poll_io_queue();
+    tio.sink.drain([&submitted] (internal::io_request& rq, io_completion* desc) -> bool {
+        submitted.emplace_back(rq.pos(), rq.size());
+        desc->complete_with(rq.size());
+        return true;
+    });
+
+    BOOST_REQUIRE_EQUAL(f.get0(), 8192);
+    std::sort(submitted.begin(), submitted.end());
+    BOOST_REQUIRE_EQUAL(submitted.size(), 3);
+    BOOST_REQUIRE(submitted[0] == std::make_pair(uint64_t(2048), size_t(2048)));
+    BOOST_REQUIRE(submitted[1] == std::make_pair(uint64_t(4096), size_t(4096)));
+    BOOST_REQUIRE(submitted[2] == std::make_pair(uint64_t(8192), size_t(2048)));
+}
+
+SEASTAR_THREAD_TEST_CASE(test_adjacent_reads_merge) {
+    io_queue::config cfg{0};
+    cfg.max_read_merge_length = 16 << 10;
+    io_queue_for_tests tio(std::move(cfg));
+
+    auto buf = std::make_unique<char[]>(12288);
+    auto dnl = internal::io_direction_and_length(internal::io_direction_and_length::read_idx, 4096);
+    auto f1 = tio.queue.queue_request(default_priority_class(), dnl, internal::io_request::make_read(0, 0, buf.get(), 4096, false), nullptr, {});
+    auto f2 = tio.queue.queue_request(default_priority_class(), dnl, internal::io_request::make_read(0, 4096, buf.get() + 4096, 4096, false), nullptr, {});
+    // Not contiguous, stays on its own
+    auto f3 = tio.queue.queue_request(default_priority_class(), dnl, internal::io_request::make_read(0, 16384, buf.get() + 8192, 4096, false), nullptr, {});
+
+    std::vector<std::pair<internal::io_request::operation, size_t>> submitted;
+    seastar::sleep(std::chrono::milliseconds(500)).get();
+    tio.queue.poll_io_queue();
+    tio.sink.drain([&submitted] (internal::io_request& rq, io_completion* desc) -> bool {
+        submitted.emplace_back(rq.opcode(), rq.size());
+        if (rq.opcode() == internal::io_request::operation::readv) {
+            // come short by 1k into the second read
+            desc->complete_with(4096 + 3072);
+        } else {
+            desc->complete_with(rq.size());
+        }
+        return true;
+    });
+
+    BOOST_REQUIRE_EQUAL(submitted.size(), 2);
+    BOOST_REQUIRE(submitted[0] == std::make_pair(internal::io_request::operation::readv, size_t(2)));
+    BOOST_REQUIRE(submitted[1] == std::make_pair(internal::io_request::operation::read, size_t(4096)));
+    BOOST_REQUIRE_EQUAL(f1.get0(), 4096);
+    BOOST_REQUIRE_EQUAL(f2.get0(), 3072);
+    BOOST_REQUIRE_EQUAL(f3.get0(), 4096);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_latency_feedback_derates_slow_disk) {
+    io_queue::config cfg{0};
+    cfg.latency_target = std::chrono::milliseconds(1);
+    io_queue_for_tests tio(std::move(cfg));
+    fake_file file;
+    BOOST_REQUIRE_EQUAL(tio.rate_scale(), 1.0);
+
+    // The "disk" completes requests some 5ms after they are dispatched,
+    // which is well above the target, so the rate must go down
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    std::vector<int> values(64, 42);
+    while (tio.rate_scale() == 1.0 && std::chrono::steady_clock::now() < deadline) {
+        unsigned completed = 0;
+        std::vector<future<>> futs;
+        for (unsigned i = 0; i < values.size(); i++) {
+            futs.push_back(tio.queue.queue_request(default_priority_class(), internal::io_direction_and_length(internal::io_direction_and_length::write_idx, 0), file.make_write_req(i, &values[i]), nullptr, {})
+                .then([&completed] (size_t) {
+                    completed++;
+                }));
+        }
+        while (completed < values.size()) {
+            tio.queue.poll_io_queue();
+            seastar::sleep(std::chrono::milliseconds(5)).get();
+            tio.sink.drain([&file] (internal::io_request& rq, io_completion* desc) -> bool {
+                file.execute_write_req(rq, desc);
+                return true;
+            });
+        }
+        when_all_succeed(futs.begin(), futs.end()).get();
+    }
+
+    BOOST_REQUIRE_LT(tio.rate_scale(), 1.0);
+}
+
 SEASTAR_THREAD_TEST_CASE(test_intent_safe_ref) {
     auto get_cancelled = [] (internal::intent_reference& iref) -> bool {
         try {
@@ -220,6 +319,26 @@ SEASTAR_THREAD_TEST_CASE(test_intent_safe_ref) {
     BOOST_REQUIRE(ref_empty_2.retrieve() == nullptr);
 }
 
+SEASTAR_THREAD_TEST_CASE(test_intent_abort_source) {
+    abort_source as;
+    io_intent intent(as);
+    internal::intent_reference ref(&intent);
+
+    // The subscription follows the intent
+    io_intent moved(std::move(intent));
+    BOOST_REQUIRE(ref.retrieve() == &moved);
+
+    as.request_abort();
+    BOOST_REQUIRE_THROW(ref.retrieve(), cancelled_error);
+
+    // Requests made after the abort are cancelled right away
+    internal::intent_reference late(&moved);
+    BOOST_REQUIRE_THROW(late.retrieve(), cancelled_error);
+    io_intent aborted(as);
+    internal::intent_reference ref_aborted(&aborted);
+    BOOST_REQUIRE_THROW(ref_aborted.retrieve(), cancelled_error);
+}
+
 static constexpr int nr_requests = 24;
 
 SEASTAR_THREAD_TEST_CASE(test_io_cancellation) {
@@ -313,6 +432,43 @@ SEASTAR_THREAD_TEST_CASE(test_io_cancellation) {
     when_all_succeed(finished.begin(), finished.end()).get();
 }
 
+SEASTAR_THREAD_TEST_CASE(test_dispatched_io_cancellation) {
+    fake_file file;
+    io_queue_for_tests tio;
+    io_intent intent;
+
+    std::vector<int> values(4, 42);
+    std::vector<future<size_t>> futs;
+    for (unsigned i = 0; i < values.size(); i++) {
+        futs.push_back(tio.queue.queue_request(default_priority_class(), internal::io_direction_and_length(internal::io_direction_and_length::write_idx, 0), file.make_write_req(i, &values[i]), &intent, {}));
+    }
+
+    seastar::sleep(std::chrono::milliseconds(500)).get();
+    tio.queue.poll_io_queue();
+    intent.cancel();
+
+    // Requests are already with the "disk", the futures must wait for it
+    for (auto& f : futs) {
+        BOOST_REQUIRE(!f.available());
+    }
+
+    // Half of them get aborted, half make it anyway
+    unsigned nr = 0;
+    tio.sink.drain([&file, &nr] (internal::io_request& rq, io_completion* desc) -> bool {
+        if (nr++ % 2 == 0) {
+            desc->complete_with(-ECANCELED);
+        } else {
+            file.execute_write_req(rq, desc);
+        }
+        return true;
+    });
+
+    for (auto& f : futs) {
+        BOOST_REQUIRE_THROW(f.get(), cancelled_error);
+    }
+    BOOST_REQUIRE_EQUAL(tio.queue.requests_currently_executing(), 0);
+}
+
 SEASTAR_TEST_CASE(test_request_buffer_split) {
     auto ensure = [] (const std::vector<internal::io_request::part>& parts, const internal::io_request& req, int idx, uint64_t pos, size_t size, uintptr_t mem) {
         BOOST_REQUIRE(parts[idx].req.opcode() == req.opcode());
@@ -19,6 +19,7 @@
 /*
  * Copyright (C) 2016 ScyllaDB.
  */
+#include <limits>
 #include <vector>
 
 #include <seastar/core/do_with.hh>
@@ -26,6 +27,10 @@
 #include <seastar/core/sstring.hh>
 #include <seastar/core/do_with.hh>
 #include <seastar/json/formatter.hh>
+#include <seastar/json/json_elements.hh>
+#include <seastar/core/iostream.hh>
+#include <seastar/core/print.hh>
+#include <seastar/testing/thread_test_case.hh>
 
 using namespace seastar;
 using namespace json;
@@ -50,6 +55,50 @@ SEASTAR_TEST_CASE(test_simple_values) {
     return make_ready_future();
 }
 
+SEASTAR_TEST_CASE(test_long_strings) {
+    // Characters to escape at every position of the scanned blocks, and
+    // bytes above 0x7f, which are not escaped
+    for (size_t len = 0; len < 70; len++) {
+        for (char special : {'"', '\\', '\n', '\x1f', '\x01'}) {
+            sstring str(len, 'a');
+            std::string expected = "\"" + std::string(len, 'a') + "\"";
+            BOOST_CHECK_EQUAL(expected, formatter::to_json(str));
+            for (size_t pos = 0; pos < len; pos += 7) {
+                str[pos] = special;
+            }
+            str += "\xc3\xa9\x7f";
+            expected = "\"";
+            for (char c : str) {
+                if (c == special) {
+                    expected += formatter::to_json(&c, 1).substr(1, sstring::npos);
+                    expected.pop_back();
+                } else {
+                    expected += c;
+                }
+            }
+            expected += "\"";
+            BOOST_CHECK_EQUAL(expected, formatter::to_json(str));
+        }
+    }
+    BOOST_CHECK_EQUAL("\"\\u0001\\u001F\\\"\\\\\"", formatter::to_json(sstring("\x01\x1f\"\\")));
+    return make_ready_future();
+}
+
+SEASTAR_TEST_CASE(test_numbers) {
+    BOOST_CHECK_EQUAL("-2147483648", formatter::to_json(std::numeric_limits<int>::min()));
+    BOOST_CHECK_EQUAL("4294967295", formatter::to_json(std::numeric_limits<unsigned>::max()));
+    BOOST_CHECK_EQUAL("-9223372036854775808", formatter::to_json(std::numeric_limits<long>::min()));
+    BOOST_CHECK_EQUAL("18446744073709551615", formatter::to_json(std::numeric_limits<unsigned long>::max()));
+    // The shortest form that reads back to the same value, with no
+    // precision lost to a fixed number of digits
+    BOOST_CHECK_EQUAL("1234567", formatter::to_json(1234567.0));
+    BOOST_CHECK_EQUAL("0.30000000000000004", formatter::to_json(0.1 + 0.2));
+    BOOST_CHECK_EQUAL("0.1", formatter::to_json(0.1f));
+    BOOST_CHECK_EQUAL("-0.25", formatter::to_json(-0.25));
+    BOOST_CHECK_EQUAL("1e+300", formatter::to_json(1e300));
+    return make_ready_future();
+}
+
 SEASTAR_TEST_CASE(test_collections) {
     BOOST_CHECK_EQUAL("{1:2,3:4}", formatter::to_json(std::map<int,int>({{1,2},{3,4}})));
     BOOST_CHECK_EQUAL("[1,2,3,4]", formatter::to_json(std::vector<int>({1,2,3,4})));
@@ -59,3 +108,82 @@ SEASTAR_TEST_CASE(test_collections) {
 
     return make_ready_future();
 }
+
+// Collects what is written to it
+class string_sink_impl : public data_sink_impl {
+    std::string& _out;
+public:
+    explicit string_sink_impl(std::string& out) : _out(out) {}
+    virtual future<> put(net::packet data) override {
+        for (auto& f : data.fragments()) {
+            _out.append(f.base, f.size);
+        }
+        return make_ready_future<>();
+    }
+    virtual future<> close() override {
+        return make_ready_future<>();
+    }
+};
+
+template<typename T>
+static std::string write_to_string(const T& val) {
+    std::string out;
+    // A small buffer, so that the document crosses many of them
+    output_stream<char> s(data_sink(std::make_unique<string_sink_impl>(out)), 16);
+    formatter::write(s, val).get();
+    s.close().get();
+    return out;
+}
+
+struct test_item : public json_base {
+    json_element<int> id;
+    json_element<sstring> name;
+    json_list<int> values;
+
+    test_item() {
+        add(&id, "id");
+        add(&name, "name");
+        add(&values, "values");
+    }
+    test_item(const test_item& o) : test_item() {
+        *this = o;
+    }
+    test_item& operator=(const test_item& o) {
+        id = o.id;
+        name = o.name;
+        values = o.values;
+        return *this;
+    }
+};
+
+SEASTAR_THREAD_TEST_CASE(test_streaming) {
+    auto same = [] (const auto& val) {
+        BOOST_CHECK_EQUAL(write_to_string(val), formatter::to_json(val));
+    };
+    same(std::map<int,int>({{1,2},{3,4}}));
+    same(std::vector<int>({1,2,3,4}));
+    same(std::vector<std::pair<int,int>>({{1,2},{3,4}}));
+    same(std::vector<std::map<int,int>>({{{1,2}},{{3,4}}}));
+    same(std::vector<std::vector<int>>({{1,2},{3,4}}));
+    same(std::vector<sstring>({"a\"b", "c"}));
+
+    std::vector<test_item> items(1000);
+    for (int i = 0; i < 1000; i++) {
+        items[i].id = i;
+        items[i].name = format("item{}", i);
+        if (i % 2) {
+            items[i].values = std::vector<int>({i, i + 1});
+        }
+    }
+    std::string expected = "[";
+    for (int i = 0; i < 1000; i++) {
+        expected += format("{}{{\"id\":{},\"name\":\"item{}\"", i ? "," : "", i, i);
+        expected += i % 2 ? format(",\"values\":[{},{}]}}", i, i + 1) : "}";
+    }
+    expected += "]";
+    BOOST_CHECK_EQUAL(write_to_string(items), expected);
+    BOOST_CHECK_EQUAL(write_to_string(items[1]), "{\"id\":1,\"name\":\"item1\",\"values\":[1,2]}");
+
+    // An object with nothing set is still an object
+    BOOST_CHECK_EQUAL(write_to_string(test_item()), "{}");
+}
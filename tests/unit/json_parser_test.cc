@@ -0,0 +1,160 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+
+#include <seastar/testing/thread_test_case.hh>
+
+#include <seastar/json/parser.hh>
+#include <seastar/core/iostream.hh>
+#include <string>
+#include <vector>
+
+using namespace seastar;
+using namespace json;
+
+namespace {
+
+// Records the events of a parse as text
+struct recorder final : public parse_handler {
+    std::string events;
+    void on_null() override { events += "null "; }
+    void on_bool(bool b) override { events += b ? "true " : "false "; }
+    void on_integer(int64_t n) override { events += "i" + std::to_string(n) + " "; }
+    void on_double(double d) override { events += "d" + std::to_string(d) + " "; }
+    void on_string(std::string_view s) override { events += "s:" + std::string(s) + " "; }
+    void on_start_object() override { events += "{ "; }
+    void on_key(std::string_view k) override { events += "k:" + std::string(k) + " "; }
+    void on_end_object() override { events += "} "; }
+    void on_start_array() override { events += "[ "; }
+    void on_end_array() override { events += "] "; }
+};
+
+std::string parse_in_fragments(std::string_view doc, size_t fragment) {
+    recorder r;
+    parser p(r);
+    for (size_t i = 0; i < doc.size(); i += fragment) {
+        p.feed(doc.substr(i, fragment));
+    }
+    p.finish();
+    return r.events;
+}
+
+// Hands out the fragments it was made with
+class fragments_source final : public data_source_impl {
+    std::vector<temporary_buffer<char>> _bufs;
+    size_t _next = 0;
+public:
+    explicit fragments_source(std::vector<temporary_buffer<char>> bufs) : _bufs(std::move(bufs)) {}
+    future<temporary_buffer<char>> get() override {
+        if (_next == _bufs.size()) {
+            return make_ready_future<temporary_buffer<char>>();
+        }
+        return make_ready_future<temporary_buffer<char>>(std::move(_bufs[_next++]));
+    }
+};
+
+input_stream<char> make_stream(std::string_view doc, size_t fragment) {
+    std::vector<temporary_buffer<char>> bufs;
+    for (size_t i = 0; i < doc.size(); i += fragment) {
+        auto part = doc.substr(i, fragment);
+        bufs.emplace_back(part.data(), part.size());
+    }
+    return input_stream<char>(data_source(std::make_unique<fragments_source>(std::move(bufs))));
+}
+
+}
+
+SEASTAR_THREAD_TEST_CASE(test_parse_events) {
+    std::string_view doc = R"( {"a": [1, -2.5e1, true, false, null], "b" : {}, "c":[],)"
+                           R"( "long key to cross the vector width": "x\"y\\\u00e9\ud83d\ude00", "d": 1e400})";
+    BOOST_REQUIRE_THROW(parse_in_fragments(doc, doc.size()), parse_error);
+
+    doc = R"( {"a": [1, -2.5e1, true, false, null], "b" : {}, "c":[],)"
+          R"( "long key to cross the vector width": "x\"y\\\u00e9\ud83d\ude00", "d": 123456789012345678901})";
+    auto expected = parse_in_fragments(doc, doc.size());
+    BOOST_REQUIRE_EQUAL(expected,
+            "{ k:a [ i1 d-25.000000 true false null ] k:b { } k:c [ ] "
+            "k:long key to cross the vector width s:x\"y\\\xc3\xa9\xf0\x9f\x98\x80 "
+            "k:d d123456789012345683968.000000 } ");
+    // Tokens split anywhere parse the same
+    for (size_t fragment = 1; fragment < doc.size(); fragment++) {
+        BOOST_REQUIRE_EQUAL(parse_in_fragments(doc, fragment), expected);
+    }
+    BOOST_REQUIRE_EQUAL(parse_in_fragments("42", 1), "i42 ");
+    BOOST_REQUIRE_EQUAL(parse_in_fragments(" null ", 2), "null ");
+}
+
+SEASTAR_THREAD_TEST_CASE(test_parse_errors) {
+    for (std::string_view doc : {"", "[1,]", "{\"a\" 1}", "{\"a\":1,}", "01", "1.", "1e", "-", "[1 2]",
+                                 "tru", "nul1", "{}x", "[", "\"a\x01\"", "\"\\x\"", "\"\\ud800\"",
+                                 "\"\\udc00\"", "\"\\u12G4\"", "{1:2}"}) {
+        BOOST_TEST_MESSAGE(doc);
+        BOOST_REQUIRE_THROW(parse_in_fragments(doc, 3), parse_error);
+    }
+    try {
+        parse_value("[1, 2 3]");
+        BOOST_FAIL("parsed");
+    } catch (parse_error& e) {
+        BOOST_REQUIRE_EQUAL(e.offset(), 6u);
+    }
+
+    std::string deep(20, '[');
+    deep += std::string(20, ']');
+    BOOST_REQUIRE_NO_THROW(parse_value(deep, parse_options{.max_depth = 20}));
+    BOOST_REQUIRE_THROW(parse_value(deep, parse_options{.max_depth = 19}), parse_error);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_parse_value) {
+    auto v = parse_value(R"({"k": [1, 2.5, "s"], "n": null, "o": {"b": false}, "k": 2})");
+    BOOST_REQUIRE(v.is_object());
+    BOOST_REQUIRE_EQUAL(v.as_object().size(), 4u);
+    auto& k = v.find("k")->as_array();
+    BOOST_REQUIRE_EQUAL(k.size(), 3u);
+    BOOST_REQUIRE_EQUAL(k[0].as_integer(), 1);
+    BOOST_REQUIRE_EQUAL(k[0].as_double(), 1.0);
+    BOOST_REQUIRE_EQUAL(k[1].as_double(), 2.5);
+    BOOST_REQUIRE_EQUAL(k[2].as_string(), "s");
+    BOOST_REQUIRE(v.find("n")->is_null());
+    BOOST_REQUIRE_EQUAL(v.find("o")->find("b")->as_bool(), false);
+    BOOST_REQUIRE(!v.find("missing"));
+    BOOST_REQUIRE_THROW(k[2].as_integer(), std::bad_variant_access);
+    BOOST_REQUIRE(v == parse_value(R"({"k":[1,2.5,"s"],"n":null,"o":{"b":false},"k":2})"));
+}
+
+SEASTAR_THREAD_TEST_CASE(test_parse_stream) {
+    // Long enough to be parsed in slices
+    std::string doc = "[";
+    for (int i = 0; i < 20000; i++) {
+        doc += "{\"id\": " + std::to_string(i) + ", \"name\": \"item\"},";
+    }
+    doc += "null]";
+    for (size_t fragment : {size_t(7), size_t(4096), doc.size()}) {
+        auto in = make_stream(doc, fragment);
+        auto v = parse_value(in).get();
+        auto& a = v.as_array();
+        BOOST_REQUIRE_EQUAL(a.size(), 20001u);
+        BOOST_REQUIRE_EQUAL(a[12345].find("id")->as_integer(), 12345);
+        BOOST_REQUIRE(a.back().is_null());
+    }
+
+    auto in = make_stream("[1, 2", 2);
+    BOOST_REQUIRE_THROW(parse_value(in).get(), parse_error);
+}
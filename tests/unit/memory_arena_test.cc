@@ -0,0 +1,70 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#include <seastar/testing/test_case.hh>
+#include <seastar/core/memory_arena.hh>
+
+#include <cstdint>
+#include <vector>
+
+using namespace seastar;
+
+SEASTAR_TEST_CASE(test_arena_alignment_and_reuse) {
+    memory::arena a(8192);
+    BOOST_REQUIRE_EQUAL(a.reserved_bytes(), 0);
+    for (size_t align = 1; align <= 4096; align <<= 1) {
+        auto p = a.allocate(3, align);
+        BOOST_REQUIRE_EQUAL(reinterpret_cast<uintptr_t>(p) % align, 0);
+    }
+    auto x = a.make<uint64_t>(42);
+    BOOST_REQUIRE_EQUAL(*x, 42);
+    BOOST_REQUIRE_GT(a.allocated_bytes(), 0);
+
+    // larger than a chunk
+    auto big = static_cast<char*>(a.allocate(100000, 16));
+    std::fill_n(big, 100000, 'x');
+    auto reserved = a.reserved_bytes();
+    BOOST_REQUIRE_GE(reserved, 100000 + 8192);
+
+    // only the most recent chunk survives a reset, and is reused
+    a.reset();
+    BOOST_REQUIRE_EQUAL(a.allocated_bytes(), 0);
+    BOOST_REQUIRE_LT(a.reserved_bytes(), reserved);
+    auto after_reset = a.reserved_bytes();
+    BOOST_REQUIRE(a.allocate(64, 8));
+    BOOST_REQUIRE_EQUAL(a.reserved_bytes(), after_reset);
+    return make_ready_future<>();
+}
+
+SEASTAR_TEST_CASE(test_arena_memory_resource) {
+    memory::arena a;
+    std::pmr::vector<int> v(&a);
+    for (int i = 0; i < 10000; ++i) {
+        v.push_back(i);
+    }
+    for (int i = 0; i < 10000; ++i) {
+        BOOST_REQUIRE_EQUAL(v[i], i);
+    }
+    BOOST_REQUIRE(a.is_equal(a));
+    memory::arena b;
+    BOOST_REQUIRE(!a.is_equal(b));
+    return make_ready_future<>();
+}
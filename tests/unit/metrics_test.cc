@@ -23,6 +23,7 @@
 #include <seastar/core/metrics_registration.hh>
 #include <seastar/core/metrics.hh>
 #include <seastar/core/metrics_api.hh>
+#include <seastar/core/exponential_histogram.hh>
 #include <seastar/core/reactor.hh>
 #include <seastar/core/scheduling.hh>
 #include <seastar/core/sleep.hh>
@@ -30,6 +31,8 @@
 #include <seastar/core/do_with.hh>
 #include <seastar/core/io_queue.hh>
 #include <seastar/core/loop.hh>
+#include <seastar/core/with_scheduling_group.hh>
+#include <seastar/util/later.hh>
 #include <seastar/testing/test_case.hh>
 #include <seastar/testing/thread_test_case.hh>
 #include <seastar/testing/test_runner.hh>
@@ -168,3 +171,88 @@ SEASTAR_THREAD_TEST_CASE(test_renaming_io_priority_classes) {
     bool name2_found = label_vals.find(sstring(name2)) != label_vals.end();
     BOOST_REQUIRE((name1_found && !name2_found) || (name2_found && !name1_found));
 }
+
+static seastar::metrics::histogram get_histogram(seastar::sstring metric_name, seastar::sstring label_name, seastar::sstring label_value) {
+    namespace smi = seastar::metrics::impl;
+    auto all_metrics = smi::get_values();
+    const auto& all_metadata = *all_metrics->metadata;
+    for (size_t i = 0; i < all_metadata.size(); i++) {
+        if (all_metadata[i].mf.name != metric_name) {
+            continue;
+        }
+        for (size_t j = 0; j < all_metadata[i].metrics.size(); j++) {
+            auto found = all_metadata[i].metrics[j].id.labels().find(label_name);
+            if (found != all_metadata[i].metrics[j].id.labels().cend() && found->second == label_value) {
+                return all_metrics->values[i][j].get_histogram();
+            }
+        }
+    }
+    BOOST_FAIL("metric not found");
+    return {};
+}
+
+SEASTAR_THREAD_TEST_CASE(test_scheduling_group_latency_histograms) {
+    using namespace seastar;
+
+    scheduling_group sg = create_scheduling_group("histograms", 100).get0();
+    with_scheduling_group(sg, [] {
+        return do_with(0, [] (int& i) {
+            return repeat([&i] {
+                return yield().then([&i] {
+                    return stop_iteration(++i == 100);
+                });
+            });
+        });
+    }).get();
+
+    auto delay = get_histogram("scheduler_queue_delay", "group", "histograms");
+    auto runtime = get_histogram("scheduler_quantum_runtime", "group", "histograms");
+    BOOST_REQUIRE_GT(delay.sample_count, 0u);
+    BOOST_REQUIRE_GT(runtime.sample_count, 0u);
+    BOOST_REQUIRE_EQUAL(delay.buckets.back().count, delay.sample_count);
+    destroy_scheduling_group(sg).get();
+}
+
+SEASTAR_THREAD_TEST_CASE(test_exponential_histogram) {
+    using namespace seastar;
+
+    metrics::exponential_histogram h(1e-3, 10);
+    // Powers of two are bucket bounds
+    BOOST_REQUIRE_EQUAL(h.upper_bound(h.bucket_id(0.5)), 0.5);
+    BOOST_REQUIRE_EQUAL(h.upper_bound(h.bucket_id(1)), 1);
+    for (double v = 1e-3; v < 10; v *= 1.1) {
+        auto id = h.bucket_id(v);
+        BOOST_REQUIRE_LE(v, h.upper_bound(id) * (1 + 1e-12));
+        BOOST_REQUIRE_GT(v, h.upper_bound(id - 1) * (1 - 1e-12));
+    }
+
+    for (int i = 1; i <= 1000; i++) {
+        h.record(i * 1e-3);
+    }
+    h.record(0.0);
+    h.record(std::chrono::seconds(100));
+    BOOST_REQUIRE_EQUAL(h.count(), 1002u);
+    BOOST_REQUIRE_EQUAL(h.quantile(0.5), 0.5);
+    // Buckets are 9% wide with the default schema
+    BOOST_REQUIRE_GE(h.quantile(0.9), 0.9);
+    BOOST_REQUIRE_LE(h.quantile(0.9), 0.9 * 1.1);
+
+    auto mh = h.to_metrics_histogram();
+    BOOST_REQUIRE(mh.native_histogram);
+    BOOST_REQUIRE_EQUAL(mh.native_histogram->schema, 3);
+    BOOST_REQUIRE_EQUAL(mh.buckets.front().count, 1u);
+    BOOST_REQUIRE_EQUAL(mh.buckets.back().count, 1002u);
+    BOOST_REQUIRE_EQUAL(mh.buckets.back().upper_bound, std::numeric_limits<double>::infinity());
+
+    // Histograms of all shards add up, as when aggregated over the shard label
+    auto sum = mh + mh;
+    BOOST_REQUIRE_EQUAL(sum.sample_count, 2004u);
+    BOOST_REQUIRE_EQUAL(sum.buckets.back().count, 2004u);
+    h += h;
+    BOOST_REQUIRE_EQUAL(h.count(), 2004u);
+    BOOST_REQUIRE_THROW(h += metrics::exponential_histogram(1e-3, 10, 2), std::invalid_argument);
+
+    auto summary = h.to_metrics_summary({0.5, 0.99}, 1e3);
+    BOOST_REQUIRE_EQUAL(summary.buckets.size(), 2u);
+    BOOST_REQUIRE_EQUAL(summary.buckets[0].count, 500u);
+}
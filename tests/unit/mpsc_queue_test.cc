@@ -0,0 +1,92 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+
+#include <seastar/testing/test_case.hh>
+#include <seastar/testing/thread_test_case.hh>
+
+#include <seastar/core/mpsc_queue.hh>
+#include <seastar/core/sleep.hh>
+#include <seastar/core/smp.hh>
+#include <boost/range/irange.hpp>
+#include <vector>
+
+using namespace seastar;
+using namespace std::chrono_literals;
+
+SEASTAR_THREAD_TEST_CASE(test_mpsc_queue_local) {
+    mpsc_queue<int> q(3);
+    BOOST_REQUIRE_EQUAL(q.capacity(), 4u);
+    BOOST_REQUIRE(q.empty());
+    BOOST_REQUIRE(!q.try_pop());
+    for (int i = 0; i < 4; i++) {
+        int v = i;
+        BOOST_REQUIRE(q.try_push(v));
+    }
+    int v = 4;
+    BOOST_REQUIRE(!q.try_push(v));
+
+    // A waiting producer gets in once there's room
+    auto pushed = q.push(4);
+    BOOST_REQUIRE(!pushed.available());
+    BOOST_REQUIRE_EQUAL(*q.try_pop(), 0);
+    pushed.get();
+
+    std::vector<int> popped;
+    BOOST_REQUIRE_EQUAL(q.consume([&] (int v) noexcept { popped.push_back(v); }), 4u);
+    BOOST_REQUIRE_EQUAL(popped, (std::vector<int>{1, 2, 3, 4}));
+
+    auto f = q.pop();
+    BOOST_REQUIRE(!f.available());
+    q.push(5).get();
+    BOOST_REQUIRE_EQUAL(f.get0(), 5);
+    q.stop().get();
+}
+
+// All shards push more items than fit into the queue of shard 0
+SEASTAR_THREAD_TEST_CASE(test_mpsc_queue_fan_in) {
+    constexpr int per_shard = 1000;
+    mpsc_queue<std::pair<shard_id, int>> q(16);
+    auto producers = smp::invoke_on_all([&q] {
+        return do_with(boost::irange(0, per_shard), [&q] (auto& items) {
+            return do_for_each(items, [&q] (int i) {
+                return q.push({this_shard_id(), i});
+            });
+        });
+    });
+
+    std::vector<int> next(smp::count, 0);
+    for (size_t n = 0; n < per_shard * smp::count; n++) {
+        auto [shard, i] = q.pop().get0();
+        // Items of a shard come in the order they were pushed
+        BOOST_REQUIRE_EQUAL(i, next[shard]++);
+    }
+    producers.get();
+    BOOST_REQUIRE(q.empty());
+    q.stop().get();
+}
+
+SEASTAR_THREAD_TEST_CASE(test_mpsc_queue_stop) {
+    mpsc_queue<int> q(2);
+    auto f = q.pop();
+    q.stop().get();
+    BOOST_REQUIRE_THROW(f.get(), broken_condition_variable);
+}
@@ -85,3 +85,22 @@ BOOST_AUTO_TEST_CASE(large_move_tests) {
     do_move_tests<1000>();
 }
 
+
+BOOST_AUTO_TEST_CASE(inplace_tests) {
+    // A payload too large for the default inline storage fits in a larger one
+    using payload = ::payload<100>;
+    using function = inplace_function<int (), 128>;
+    static_assert(sizeof(payload) > noncopyable_function<int ()>::inline_capacity);
+    static_assert(sizeof(function) >= sizeof(payload));
+    auto f1 = function(payload(3));
+    BOOST_REQUIRE_EQUAL(payload::live, 1u);
+    BOOST_REQUIRE_EQUAL(f1(), 3);
+    auto f2 = function();
+    BOOST_CHECK_THROW(f2(), std::bad_function_call);
+    f2 = std::move(f1);
+    BOOST_CHECK_THROW(f1(), std::bad_function_call);
+    BOOST_REQUIRE_EQUAL(f2(), 3);
+    BOOST_REQUIRE_EQUAL(payload::live, 1u);
+    f2 = {};
+    BOOST_REQUIRE_EQUAL(payload::live, 0u);
+}
@@ -157,3 +157,31 @@ SEASTAR_THREAD_TEST_CASE(test_simple_write) {
     BOOST_REQUIRE_EQUAL(buf.size(), 1);
     BOOST_REQUIRE_EQUAL(sstring(buf.front().get(), buf.front().size()), value);
 }
+
+SEASTAR_THREAD_TEST_CASE(test_cork_merges_flushes) {
+    for (auto batch_flushes : {false, true}) {
+        auto vec = std::vector<net::packet>{};
+        auto out = output_stream<char>(data_sink(std::make_unique<vector_data_sink>(vec)), 8,
+                output_stream_options{.batch_flushes = batch_flushes});
+
+        out.cork();
+        out.cork();
+        for (auto s : {"ab", "cd", "ef"}) {
+            out.write(s).get();
+            out.flush().get();
+        }
+        BOOST_REQUIRE(vec.empty());
+        out.uncork().get();
+        BOOST_REQUIRE(vec.empty());
+        // Filling the buffer still puts it
+        out.write("ghijk").get();
+        BOOST_REQUIRE_EQUAL(vec.size(), 1);
+        BOOST_REQUIRE_EQUAL(to_sstring(vec[0]), "abcdefgh");
+        out.uncork().get();
+        BOOST_REQUIRE(!out.corked());
+        out.close().get();
+
+        BOOST_REQUIRE_EQUAL(vec.size(), 2);
+        BOOST_REQUIRE_EQUAL(to_sstring(vec[1]), "ijk");
+    }
+}
@@ -25,6 +25,7 @@
 #include <boost/test/included/unit_test.hpp>
 #include <seastar/net/packet.hh>
 #include <array>
+#include <string>
 
 using namespace seastar;
 using namespace net;
@@ -119,3 +120,31 @@ BOOST_AUTO_TEST_CASE(test_headers_are_contiguous_even_with_many_fragments) {
     BOOST_REQUIRE_EQUAL(p.nr_frags(), 9u);
 }
 
+
+BOOST_AUTO_TEST_CASE(test_small_appends_are_coalesced) {
+    std::string expected;
+    packet p;
+    for (int i = 0; i < 100; ++i) {
+        auto s = "frag" + std::to_string(i);
+        expected += s;
+        p = packet(std::move(p), fragment{s.data(), s.size()});
+    }
+    BOOST_REQUIRE_EQUAL(p.nr_frags(), 1u);
+    auto frag = p.frag(0);
+    BOOST_REQUIRE_EQUAL(std::string(frag.base, frag.size), expected);
+}
+
+BOOST_AUTO_TEST_CASE(test_many_small_fragments_are_compacted) {
+    std::string expected;
+    packet p;
+    for (int i = 0; i < 1000; ++i) {
+        auto tmp = temporary_buffer<char>(3);
+        std::fill_n(tmp.get_write(), 3, 'a' + i % 26);
+        expected.append(tmp.get(), tmp.size());
+        p = packet(std::move(p), std::move(tmp));
+        BOOST_REQUIRE_LE(p.nr_frags(), 129u);
+    }
+    p.linearize();
+    auto frag = p.frag(0);
+    BOOST_REQUIRE_EQUAL(std::string(frag.base, frag.size), expected);
+}
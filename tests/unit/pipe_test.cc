@@ -49,3 +49,19 @@ SEASTAR_THREAD_TEST_CASE(simple_pipe_test) {
     BOOST_CHECK(f2.available());
     BOOST_REQUIRE_EQUAL(*f2.get0(), 42);
 }
+
+SEASTAR_THREAD_TEST_CASE(pipe_batch_test) {
+    seastar::pipe<int> p(2);
+
+    auto written = p.writer.write_batch({1, 2, 3});
+    BOOST_REQUIRE_EQUAL(p.reader.read_batch(10).get0(), (std::vector<int>{1, 2}));
+    written.get();
+    p.reader.unread(0);
+    BOOST_REQUIRE_EQUAL(p.reader.read_batch(10).get0(), (std::vector<int>{0}));
+    BOOST_REQUIRE_EQUAL(p.reader.read_batch(10).get0(), (std::vector<int>{3}));
+
+    auto eof = p.reader.read_batch(10);
+    { auto w = std::move(p.writer); }
+    BOOST_REQUIRE(eof.get0().empty());
+    BOOST_REQUIRE(p.reader.read_batch(10).get0().empty());
+}
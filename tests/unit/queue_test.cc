@@ -161,3 +161,34 @@ SEASTAR_TEST_CASE(test_queue_push_abort) {
         done.get();
     });
 }
+
+SEASTAR_THREAD_TEST_CASE(test_queue_batches) {
+    queue<int> q(4);
+    q.set_not_full_threshold(1);
+
+    auto pushed = q.push_batch_eventually(std::vector<int>{0, 1, 2, 3, 4, 5});
+    BOOST_REQUIRE(!pushed.available());
+    BOOST_REQUIRE_EQUAL(q.size(), 4u);
+
+    auto batch = q.pop_eventually_batch(2).get0();
+    BOOST_REQUIRE_EQUAL(batch, (std::vector<int>{0, 1}));
+    // Not drained down to the threshold yet
+    yield().get();
+    BOOST_REQUIRE(!pushed.available());
+    BOOST_REQUIRE_EQUAL(q.size(), 2u);
+
+    batch = q.pop_eventually_batch(10).get0();
+    BOOST_REQUIRE_EQUAL(batch, (std::vector<int>{2, 3}));
+    pushed.get();
+    batch = q.pop_eventually_batch(10).get0();
+    BOOST_REQUIRE_EQUAL(batch, (std::vector<int>{4, 5}));
+
+    auto popped = q.pop_eventually_batch(10);
+    BOOST_REQUIRE(!popped.available());
+    q.push_batch_eventually(std::vector<int>{6}).get();
+    BOOST_REQUIRE_EQUAL(popped.get0(), (std::vector<int>{6}));
+
+    q.abort(std::make_exception_ptr(std::runtime_error("aborted")));
+    BOOST_REQUIRE_THROW(q.pop_eventually_batch(1).get(), std::runtime_error);
+    BOOST_REQUIRE_THROW(q.push_batch_eventually(std::vector<int>{7}).get(), std::runtime_error);
+}
@@ -0,0 +1,134 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+
+#ifdef SEASTAR_HAVE_QUIC
+
+#include <seastar/core/loop.hh>
+#include <seastar/core/thread.hh>
+#include <seastar/net/quic.hh>
+#include <seastar/testing/thread_test_case.hh>
+#include <boost/dll.hpp>
+#include <boost/range/irange.hpp>
+
+using namespace seastar;
+
+static const auto cert_location = boost::dll::program_location().parent_path();
+
+static std::string certfile(const std::string& file) {
+    return (cert_location / file).string();
+}
+
+static quic::server make_server(quic::options opts = {}) {
+    auto certs = ::make_shared<tls::server_credentials>(::make_shared<tls::dh_params>());
+    certs->set_x509_key_file(certfile("test.crt"), certfile("test.key"), tls::x509_crt_format::PEM).get();
+    return quic::server(::make_ipv4_address({0x7f000001, 0}), std::move(certs), std::move(opts));
+}
+
+static ::shared_ptr<tls::certificate_credentials> client_credentials() {
+    tls::credentials_builder b;
+    b.set_x509_trust_file(certfile("catest.pem"), tls::x509_crt_format::PEM).get();
+    return b.build_certificate_credentials();
+}
+
+// Echoes every stream the peer opens, until it closes its side
+static future<> echo(quic::connection& c) {
+    return repeat([&c] {
+        return c.accept_stream().then([] (connected_socket s) {
+            (void)do_with(std::move(s), [] (connected_socket& s) {
+                return do_with(s.input(), s.output(), [] (input_stream<char>& in, output_stream<char>& out) {
+                    return repeat([&in, &out] {
+                        return in.read().then([&out] (temporary_buffer<char> buf) {
+                            if (buf.empty()) {
+                                return make_ready_future<stop_iteration>(stop_iteration::yes);
+                            }
+                            return out.write(std::move(buf)).then([&out] {
+                                return out.flush();
+                            }).then([] {
+                                return stop_iteration::no;
+                            });
+                        });
+                    }).finally([&out] {
+                        return out.close();
+                    });
+                });
+            });
+            return stop_iteration::no;
+        });
+    }).handle_exception([] (std::exception_ptr) {});
+}
+
+static sstring roundtrip(quic::connection& c, sstring msg) {
+    auto s = c.open_stream().get();
+    auto in = s.input();
+    auto out = s.output();
+    auto reader = async([&in] {
+        sstring ret;
+        for (;;) {
+            auto buf = in.read().get();
+            if (buf.empty()) {
+                return ret;
+            }
+            ret += sstring(buf.get(), buf.size());
+        }
+    });
+    out.write(msg).get();
+    out.close().get();
+    return reader.get();
+}
+
+SEASTAR_THREAD_TEST_CASE(test_quic_echo) {
+    quic::options opts;
+    opts.alpn = {"echo"};
+    auto server = make_server(opts);
+    auto accepted = server.accept();
+    auto client = quic::connect(server.local_address(), client_credentials(), "test.scylladb.org", opts).get();
+    auto conn = accepted.get();
+    BOOST_REQUIRE_EQUAL(client.alpn(), "echo");
+    BOOST_REQUIRE_EQUAL(conn.alpn(), "echo");
+    auto echoing = echo(conn);
+
+    BOOST_REQUIRE_EQUAL(roundtrip(client, "hello"), "hello");
+
+    // More than the flow control windows, over several streams at once
+    sstring big(1 << 20, 'x');
+    for (size_t i = 0; i < big.size(); i++) {
+        big[i] = 'a' + i % 26;
+    }
+    parallel_for_each(boost::irange(0, 4), [&] (int) {
+        return async([&] {
+            BOOST_REQUIRE(roundtrip(client, big) == big);
+        });
+    }).get();
+
+    client.close().get();
+    conn.close().get();
+    echoing.get();
+    server.stop().get();
+}
+
+SEASTAR_THREAD_TEST_CASE(test_quic_bad_certificate_name) {
+    auto server = make_server();
+    BOOST_REQUIRE_THROW(quic::connect(server.local_address(), client_credentials(), "other.scylladb.org").get(), std::exception);
+    server.stop().get();
+}
+
+#endif
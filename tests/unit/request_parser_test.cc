@@ -21,6 +21,7 @@
  */
 
 #include <seastar/core/ragel.hh>
+#include <seastar/core/print.hh>
 #include <seastar/core/sstring.hh>
 #include <seastar/core/temporary_buffer.hh>
 #include <seastar/http/request.hh>
@@ -31,6 +32,7 @@
 #include <vector>
 
 using namespace seastar;
+using namespace std::string_view_literals;
 
 SEASTAR_TEST_CASE(test_header_parsing) {
     struct test_set {
@@ -61,13 +63,132 @@ SEASTAR_TEST_CASE(test_header_parsing) {
     };
 
     http_request_parser parser;
-    for (auto& tset : tests) {
+    for (bool header_views : {false, true}) {
+        parser.set_header_views(header_views);
+        for (auto& tset : tests) {
+            parser.init();
+            BOOST_REQUIRE(parser(tset.buf()).get0().has_value());
+            BOOST_REQUIRE_NE(parser.failed(), tset.parsable);
+            if (tset.parsable) {
+                auto req = parser.get_parsed_request();
+                BOOST_REQUIRE_EQUAL(req->get_header(tset.header_name), tset.header_value);
+                BOOST_REQUIRE_EQUAL(req->_headers.empty(), header_views);
+            }
+        }
+    }
+    return make_ready_future<>();
+}
+
+SEASTAR_TEST_CASE(test_header_views_split) {
+    sstring msg = "GET /test HTTP/1.1\r\nHost: test\r\nAccept:  a, b  \r\nX-Folded: fiel\r\n  d\r\nAccept: c\r\n\r\n";
+    http_request_parser parser;
+    parser.set_header_views(true);
+    // Every token gets split between the two buffers at some point
+    for (size_t split = 1; split < msg.size(); split++) {
+        parser.init();
+        BOOST_REQUIRE(!parser(temporary_buffer<char>(msg.c_str(), split)).get0().has_value());
+        BOOST_REQUIRE(parser(temporary_buffer<char>(msg.c_str() + split, msg.size() - split)).get0().has_value());
+        BOOST_REQUIRE(!parser.failed());
+        // The buffers are gone, the request keeps what the views need
+        auto req = parser.get_parsed_request();
+        BOOST_REQUIRE_EQUAL(req->get_header("host"), "test");
+        BOOST_REQUIRE_EQUAL(req->get_header("Accept"), "a, b,c");
+        BOOST_REQUIRE_EQUAL(req->get_header("X-Folded"), "fiel d");
+        BOOST_REQUIRE_EQUAL(req->_header_views.size(), 3);
+    }
+    return make_ready_future<>();
+}
+
+SEASTAR_TEST_CASE(test_header_views_many) {
+    sstring msg = "GET /test HTTP/1.1\r\n";
+    for (int i = 0; i < 40; i++) {
+        msg += format("Header-{}: {}\r\n", i, i);
+    }
+    msg += "header-7: again\r\n\r\n";
+    http_request_parser parser;
+    parser.set_header_views(true);
+    parser.init();
+    BOOST_REQUIRE(parser(temporary_buffer<char>(msg.c_str(), msg.size())).get0().has_value());
+    auto req = parser.get_parsed_request();
+    BOOST_REQUIRE_EQUAL(req->_header_views.size(), 40);
+    for (int i = 0; i < 40; i++) {
+        BOOST_REQUIRE_EQUAL(req->get_header(format("HEADER-{}", i)), i == 7 ? "7,again" : to_sstring(i));
+    }
+    BOOST_REQUIRE_EQUAL(req->get_header("Header-40"), "");
+    return make_ready_future<>();
+}
+
+// A head whole in one buffer goes through the scanner, one split after its
+// first byte through the ragel machine; both must parse it alike
+SEASTAR_TEST_CASE(test_scanned_matches_machine) {
+    std::vector<sstring> msgs = {
+        "GET /test HTTP/1.1\r\nHost: test\r\n\r\n",
+        "POST /a/very/long/url/which/spans/several/vectors?x=1&y=2 HTTP/1.1\r\n"
+            "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36\t \r\n"
+            "Accept: text/html,application/xhtml+xml,application/xml;q=0.9\r\n"
+            "accept:\t*/*\r\n"
+            "Content-Length: 4\r\n\r\nbody",
+        "GET /hello HTTP/1.0\r\nHeader: \r\nOther:\r\n\r\n",
+        "GET /hello HTTP/1.0\r\nHeader: fiel\r\n\td\r\nNext: x\r\n\r\n",
+        "GET /hello HTTP/1.0\r\ntchars.^_`|123: printable!@#%^&*()obs_text\x80\x81\xff\r\n\r\n",
+        "GET /url\twith\x01controls HTTP/1.1\r\nHost: test\r\n\r\n",
+        "GET /hello HTTP/1.0\r\nHeader: a value with a DEL\x7f in its second vector\r\n\r\n",
+        sstring("GET /hello HTTP/1.0\r\nHeader: a value with a NUL\0 in its second vector\r\n\r\n"sv),
+        "GET /hello HTTP/1.0\r\nHeader : Field\r\n\r\n",
+        "GET /hello HTTP/1.0\r\nHeader@: Field\r\n\r\n",
+        "GET /hello HTTP/1.0\r\nHeader: Field\n\r\n",
+        "GET /hello HTTP/1.0\r\nHeader: Field\r\n\r",
+        "GET /hello HTTP/1.0\r\nHeader: Field",
+        "get /hello HTTP/1.0\r\n\r\n",
+        "GET /hello HTTP/1.0\r\n\r\nGET /next HTTP/1.0\r\n\r\n",
+    };
+
+    struct result {
+        bool complete;
+        bool failed;
+        std::unique_ptr<httpd::request> req;
+        sstring remainder;
+    };
+    auto parse = [] (http_request_parser& parser, const sstring& msg, size_t split) {
         parser.init();
-        BOOST_REQUIRE(parser(tset.buf()).get0().has_value());
-        BOOST_REQUIRE_NE(parser.failed(), tset.parsable);
-        if (tset.parsable) {
-            auto req = parser.get_parsed_request();
-            BOOST_REQUIRE_EQUAL(req->get_header(std::move(tset.header_name)), std::move(tset.header_value));
+        result r;
+        std::optional<temporary_buffer<char>> rem;
+        if (split) {
+            rem = parser(temporary_buffer<char>(msg.c_str(), split)).get0();
+        }
+        if (!rem) {
+            rem = parser(temporary_buffer<char>(msg.c_str() + split, msg.size() - split)).get0();
+        }
+        r.complete = rem.has_value();
+        r.failed = parser.failed();
+        r.req = parser.get_parsed_request();
+        if (rem) {
+            r.remainder = sstring(rem->get(), rem->size());
+        }
+        return r;
+    };
+
+    http_request_parser parser;
+    for (bool header_views : {false, true}) {
+        parser.set_header_views(header_views);
+        for (auto& msg : msgs) {
+            BOOST_TEST_MESSAGE(format("header_views={} msg={}", header_views, msg));
+            auto scanned = parse(parser, msg, 0);
+            auto machine = parse(parser, msg, 1);
+            BOOST_REQUIRE_EQUAL(scanned.complete, machine.complete);
+            BOOST_REQUIRE_EQUAL(scanned.failed, machine.failed);
+            if (!scanned.complete || scanned.failed) {
+                continue;
+            }
+            BOOST_REQUIRE_EQUAL(scanned.remainder, machine.remainder);
+            BOOST_REQUIRE_EQUAL(scanned.req->_method, machine.req->_method);
+            BOOST_REQUIRE_EQUAL(scanned.req->_url, machine.req->_url);
+            BOOST_REQUIRE_EQUAL(scanned.req->_version, machine.req->_version);
+            BOOST_REQUIRE(scanned.req->_headers == machine.req->_headers);
+            BOOST_REQUIRE_EQUAL(scanned.req->_header_views.size(), machine.req->_header_views.size());
+            for (auto& [name, value] : machine.req->_header_views) {
+                BOOST_REQUIRE_EQUAL(scanned.req->get_header(sstring(name)), sstring(value));
+            }
         }
     }
     return make_ready_future<>();
@@ -25,6 +25,8 @@
 #include <seastar/rpc/lz4_compressor.hh>
 #include <seastar/rpc/lz4_fragmented_compressor.hh>
 #include <seastar/rpc/multi_algo_compressor_factory.hh>
+#include <seastar/rpc/zstd_compressor.hh>
+#include <seastar/net/shm.hh>
 #include <seastar/testing/test_case.hh>
 #include <seastar/testing/thread_test_case.hh>
 #include <seastar/testing/test_runner.hh>
@@ -32,10 +34,12 @@
 #include <seastar/core/sleep.hh>
 #include <seastar/core/distributed.hh>
 #include <seastar/core/loop.hh>
+#include <seastar/util/later.hh>
 #include <seastar/util/defer.hh>
 #include <seastar/util/log.hh>
 #include <seastar/util/closeable.hh>
 #include <seastar/util/noncopyable_function.hh>
+#include <numeric>
 
 using namespace seastar;
 
@@ -386,6 +390,66 @@ SEASTAR_TEST_CASE(test_rpc_connect_multi_compression_algo) {
     });
 }
 
+SEASTAR_TEST_CASE(test_rpc_adaptive_compression) {
+    auto factory = std::make_unique<cfactory>();
+    rpc::server_options so;
+    rpc::client_options co;
+    so.compressor_factory = factory.get();
+    so.adaptive_compression = rpc::adaptive_compression_config{};
+    co.compressor_factory = factory.get();
+    co.adaptive_compression = rpc::adaptive_compression_config{};
+    rpc_test_config cfg;
+    cfg.server_options = so;
+    return rpc_test_env<>::do_with_thread(cfg, co, [] (rpc_test_env<>& env, test_rpc_proto::client& c1) {
+        env.register_handler(1, [] (sstring s) {
+            return make_ready_future<sstring>(std::move(s));
+        }).get();
+        auto echo = env.proto().make_client<sstring (sstring)>(1);
+
+        auto& eng = testing::local_random_engine;
+        auto dist = std::uniform_int_distribution<char>();
+        auto random = uninitialized_string(128 * 1024);
+        std::generate(random.begin(), random.end(), [&] { return dist(eng); });
+        auto compressible = sstring(128 * 1024, 'a');
+
+        BOOST_REQUIRE_EQUAL(echo(c1, "small").get0(), "small");
+        BOOST_REQUIRE_EQUAL(c1.get_stats().uncompressed_messages, 1);
+        BOOST_REQUIRE_EQUAL(echo(c1, compressible).get0(), compressible);
+        BOOST_REQUIRE_EQUAL(c1.get_stats().uncompressed_messages, 1);
+        // Incompressible, then skipped once before probing again
+        BOOST_REQUIRE_EQUAL(echo(c1, random).get0(), random);
+        BOOST_REQUIRE_EQUAL(c1.get_stats().uncompressed_messages, 2);
+        BOOST_REQUIRE_EQUAL(echo(c1, compressible).get0(), compressible);
+        BOOST_REQUIRE_EQUAL(c1.get_stats().uncompressed_messages, 3);
+        BOOST_REQUIRE_EQUAL(echo(c1, compressible).get0(), compressible);
+        BOOST_REQUIRE_EQUAL(c1.get_stats().uncompressed_messages, 3);
+    }).finally([factory = std::move(factory)] {});
+}
+
+SEASTAR_TEST_CASE(test_rpc_client_pool) {
+    return rpc_test_env<>::do_with_thread(rpc_test_config(), [] (rpc_test_env<>& env) {
+        env.register_handler(1, [] (int a, int b) {
+            return make_ready_future<int>(a + b);
+        }).get();
+        auto sum = env.proto().make_client<int (int, int)>(1);
+        test_rpc_proto::client_pool pool(env.proto(), {}, ipv4_addr(), 3, [&env] { return env.make_socket(); });
+        pool.start().get();
+        // The loopback server does not route connections by source port
+        BOOST_REQUIRE(!pool.shard_routing());
+        BOOST_REQUIRE_EQUAL(pool.size(), 3);
+        auto& info = pool.for_shard(0).peer_shard_info();
+        BOOST_REQUIRE(info);
+        BOOST_REQUIRE_EQUAL(info->shard_count, smp::count);
+        BOOST_REQUIRE(!info->port_routing);
+        BOOST_REQUIRE_EQUAL(&pool.for_shard(1), &pool.for_shard(4));
+        for (int i = 0; i < 6; i++) {
+            BOOST_REQUIRE_EQUAL(sum(pool.next(), i, 1).get0(), i + 1);
+            BOOST_REQUIRE_EQUAL(sum(pool.for_shard(i), i, 2).get0(), i + 2);
+        }
+        pool.stop().get();
+    });
+}
+
 SEASTAR_TEST_CASE(test_rpc_connect_abort) {
     rpc_test_config cfg;
     rpc_loopback_error_injector::config ecfg;
@@ -445,6 +509,201 @@ SEASTAR_TEST_CASE(test_rpc_cancel) {
     });
 }
 
+SEASTAR_TEST_CASE(test_rpc_abort_source) {
+    using namespace std::chrono_literals;
+    return rpc_test_env<>::do_with_thread(rpc_test_config(), [] (rpc_test_env<>& env, test_rpc_proto::client& c1) {
+        promise<> handler_called;
+        future<> f_handler_called = handler_called.get_future();
+        env.register_handler(1, [&handler_called] {
+            handler_called.set_value();
+            return sleep(1s);
+        }).get();
+        auto call = env.proto().make_client<void ()>(1);
+        abort_source as;
+        auto f = call(c1, as);
+        f_handler_called.get();
+        // The reply is no longer waited for
+        as.request_abort();
+        BOOST_REQUIRE_THROW(f.get(), rpc::canceled_error);
+        BOOST_REQUIRE_THROW(call(c1, as).get(), rpc::canceled_error);
+    });
+}
+
+SEASTAR_TEST_CASE(test_rpc_outgoing_lanes) {
+    rpc::client_options co;
+    co.verb_lane = [] (uint64_t verb) { return verb == 2 ? 2 : 0; };
+    return rpc_test_env<>::do_with_thread(rpc_test_config(), co, [] (rpc_test_env<>& env, test_rpc_proto::client& c1) {
+        std::vector<int> order;
+        env.register_handler(1, [&order] (int i) { order.push_back(i); }).get();
+        env.register_handler(2, [&order] (int i) { order.push_back(i); }).get();
+        auto bulk = env.proto().make_client<void (int)>(1);
+        auto urgent = env.proto().make_client<void (int)>(2);
+
+        promise<> cont;
+        c1.suspend_for_testing(cont);
+        std::vector<future<>> fs;
+        for (int i = 0; i < 3; i++) {
+            fs.push_back(bulk(c1, i));
+        }
+        fs.push_back(urgent(c1, 100));
+        auto stats = c1.get_stats();
+        BOOST_REQUIRE_EQUAL(stats.pending_per_lane[0], 3);
+        BOOST_REQUIRE_EQUAL(stats.pending_per_lane[2], 1);
+        cont.set_value();
+        when_all_succeed(fs.begin(), fs.end()).get();
+        BOOST_REQUIRE(order == std::vector<int>({100, 0, 1, 2}));
+        BOOST_REQUIRE_EQUAL(c1.get_stats().pending_per_lane[0], 0);
+    });
+}
+
+SEASTAR_TEST_CASE(test_rpc_blob) {
+    return rpc_test_env<>::do_with_thread(rpc_test_config(), [] (rpc_test_env<>& env, test_rpc_proto::client& c1) {
+        env.register_handler(1, [] (int before, rpc::blob b, int after, rpc::optional<rpc::blob> empty) {
+            BOOST_REQUIRE_EQUAL(before, 1);
+            BOOST_REQUIRE_EQUAL(after, 2);
+            BOOST_REQUIRE(empty && empty->empty());
+            return b;
+        }).get();
+        auto echo = env.proto().make_client<rpc::blob (int, rpc::blob, int, rpc::blob)>(1);
+
+        std::vector<temporary_buffer<char>> fragments;
+        size_t size = 0;
+        for (auto len : {100, 128 * 1024, 1, 3 * 1024 * 1024}) {
+            temporary_buffer<char> f(len);
+            std::iota(f.get_write(), f.get_write() + len, char(size));
+            size += len;
+            fragments.push_back(std::move(f));
+        }
+        auto b = rpc::blob(std::move(fragments), size);
+        auto ret = echo(c1, 1, b, 2, rpc::blob()).get();
+        BOOST_REQUIRE_EQUAL(ret.size(), size);
+        auto expected = b.linearize();
+        auto received = ret.linearize();
+        BOOST_REQUIRE(std::equal(expected.begin(), expected.end(), received.begin(), received.end()));
+    });
+}
+
+SEASTAR_TEST_CASE(test_rpc_verb_stats) {
+    return rpc_test_env<>::do_with_thread(rpc_test_config(), [] (rpc_test_env<>& env, test_rpc_proto::client& c1) {
+        env.proto().enable_verb_stats("rpc_verbs_test");
+        env.register_handler(1, [] (sstring s) { return s; }).get();
+        env.register_handler(2, [] (int i) {}).get();
+        auto echo = env.proto().make_client<sstring (sstring)>(1);
+        auto noop = env.proto().make_client<void (int)>(2);
+        for (int i = 0; i < 10; i++) {
+            echo(c1, sstring(i * 100, 'x')).get();
+        }
+        noop(c1, 1).get();
+
+        auto& stats = env.proto().get_verb_stats();
+        auto client = stats.client_stats(1);
+        BOOST_REQUIRE(client);
+        BOOST_REQUIRE_EQUAL(client->requests, 10);
+        BOOST_REQUIRE_EQUAL(client->in_flight, 0);
+        BOOST_REQUIRE_EQUAL(client->latency.count(), 10);
+        BOOST_REQUIRE_EQUAL(client->request_size.count(), 10);
+        // The largest argument is 900 bytes plus its length
+        BOOST_REQUIRE_GE(client->request_size.percentile(1), 900);
+
+        auto server = stats.server_stats(1);
+        BOOST_REQUIRE(server);
+        BOOST_REQUIRE_EQUAL(server->requests, 10);
+        BOOST_REQUIRE_EQUAL(stats.client_stats(2)->requests, 1);
+        BOOST_REQUIRE(!stats.client_stats(3));
+    });
+}
+
+SEASTAR_TEST_CASE(test_rpc_load_shedding) {
+    rpc_test_config cfg;
+    cfg.resource_limits.max_memory = 1500;
+    cfg.resource_limits.load_shedding = rpc::load_shedding_config{};
+    rpc::client_options co;
+    co.send_timeout_data = 1;
+    return rpc_test_env<>::do_with_thread(cfg, co, [] (rpc_test_env<>& env, test_rpc_proto::client& c1) {
+        promise<> release;
+        shared_future<> released(release.get_future());
+        env.register_handler(1, [released] (sstring s) { return released.get_future(); }).get();
+        auto call = env.proto().make_client<void (sstring)>(1);
+        // Holds most of the server memory until released
+        auto blocker = call(c1, sstring(1000, 'x'));
+        sleep(std::chrono::milliseconds(10)).get();
+
+        // Waits for memory until its timeout, which teaches the server how long waits are
+        auto f = call(c1, std::chrono::milliseconds(100), sstring(1000, 'x'));
+        BOOST_REQUIRE_THROW(f.get(), rpc::timeout_error);
+        sleep(std::chrono::milliseconds(50)).get();
+
+        // Rejected right away, it would time out before getting the memory
+        BOOST_REQUIRE_THROW(call(c1, std::chrono::milliseconds(5), sstring(1000, 'x')).get(), rpc::overloaded_error);
+        BOOST_REQUIRE_EQUAL(c1.get_stats().exception_received, 1);
+
+        release.set_value();
+        blocker.get();
+        // Requests that get memory right away are never shed
+        call(c1, std::chrono::milliseconds(5), sstring(10, 'x')).get();
+    });
+}
+
+SEASTAR_THREAD_TEST_CASE(test_rpc_shm_transport) {
+    // The ring is smaller than the large messages, which wrap around it many times
+    net::shm_options opts;
+    opts.ring_size = 4096;
+    socket_address addr(unix_domain_addr(std::string(1, '\0') + "seastar-rpc-shm-test-" + std::to_string(::getpid())));
+    test_rpc_proto proto(serializer{});
+    test_rpc_proto::server server(proto, net::shm_listen(addr, opts));
+    proto.register_handler(1, [] (sstring s) { return s; });
+    auto echo = proto.make_client<sstring (sstring)>(1);
+    test_rpc_proto::client c(proto, rpc::client_options{}, net::shm_socket(opts), addr);
+    for (size_t size : {0, 1, 1000, 100000}) {
+        auto s = uninitialized_string(size);
+        std::iota(s.begin(), s.end(), 'a');
+        BOOST_REQUIRE_EQUAL(echo(c, s).get0(), s);
+    }
+    c.stop().get();
+    proto.unregister_handler(1).get();
+    server.stop().get();
+}
+
+SEASTAR_TEST_CASE(test_rpc_send_coalescing) {
+    return rpc_test_env<>::do_with_thread(rpc_test_config(), [] (rpc_test_env<>& env, test_rpc_proto::client& c1) {
+        env.register_handler(1, [] (int i) {}).get();
+        auto call = env.proto().make_client<void (int)>(1);
+        c1.await_connection().get();
+        auto before = c1.get_stats();
+        std::vector<future<>> fs;
+        for (int i = 0; i < 10; i++) {
+            fs.push_back(call(c1, i));
+        }
+        when_all_succeed(fs.begin(), fs.end()).get();
+        auto after = c1.get_stats();
+        BOOST_REQUIRE_EQUAL(after.sent_messages - before.sent_messages, 10);
+        // The messages queued behind the first one are flushed together
+        BOOST_REQUIRE_LE(after.flushes - before.flushes, 2);
+    });
+}
+
+SEASTAR_TEST_CASE(test_rpc_send_coalescing_delay) {
+    rpc::client_options co;
+    co.coalescing_delay = std::chrono::milliseconds(10);
+    return rpc_test_env<>::do_with_thread(rpc_test_config(), co, [] (rpc_test_env<>& env, test_rpc_proto::client& c1) {
+        env.register_handler(1, [] (int i) {}).get();
+        auto call = env.proto().make_client<void (int)>(1);
+        c1.await_connection().get();
+        auto before = c1.get_stats();
+        std::vector<future<>> fs;
+        fs.push_back(call(c1, 0));
+        // Sent while the first message waits for company
+        yield().get();
+        for (int i = 1; i < 5; i++) {
+            fs.push_back(call(c1, i));
+        }
+        when_all_succeed(fs.begin(), fs.end()).get();
+        auto after = c1.get_stats();
+        BOOST_REQUIRE_EQUAL(after.sent_messages - before.sent_messages, 5);
+        BOOST_REQUIRE_EQUAL(after.flushes - before.flushes, 1);
+    });
+}
+
 SEASTAR_TEST_CASE(test_message_to_big) {
     rpc_test_config cfg;
     cfg.resource_limits = {0, 1, 100};
@@ -647,6 +906,56 @@ SEASTAR_TEST_CASE(test_stream_connection_error) {
     });
 }
 
+SEASTAR_TEST_CASE(test_stream_flow_control) {
+    rpc::server_options so;
+    so.streaming_domain = rpc::streaming_domain_type(1);
+    rpc_test_config cfg;
+    cfg.server_options = so;
+    return rpc_test_env<>::do_with(cfg, [] (rpc_test_env<>& env) {
+        return seastar::async([&env] {
+            test_rpc_proto::client c(env.proto(), {}, env.make_socket(), ipv4_addr());
+            auto frame = [] (int i) { return sstring(200, char('a' + i % 26)); };
+            promise<> start_reading;
+            future<> server_done = make_ready_future();
+            int received = 0;
+            env.register_handler(1, [&] (rpc::source<sstring> source) {
+                server_done = start_reading.get_future().then([source, &received, &frame] () mutable {
+                    return repeat([source, &received, &frame] () mutable {
+                        return source().then([&received, &frame] (std::optional<std::tuple<sstring>> data) {
+                            if (!data) {
+                                return stop_iteration::yes;
+                            }
+                            BOOST_REQUIRE_EQUAL(std::get<0>(*data), frame(received++));
+                            return stop_iteration::no;
+                        });
+                    });
+                });
+                return make_ready_future<>();
+            }).get();
+            auto call = env.proto().make_client<void (rpc::sink<sstring>)>(1);
+
+            rpc::stream_options opts;
+            opts.window = 1024;
+            auto sink = c.make_stream_sink<serializer, sstring>(env.make_socket(), opts).get0();
+            call(c, sink).get();
+            for (int i = 0; i < 20; i++) {
+                sink(frame(i)).get();
+            }
+            // Most of the frames wait for the server to consume the first ones
+            auto flushed = sink.flush();
+            sleep(std::chrono::milliseconds(10)).get();
+            BOOST_REQUIRE(!flushed.available());
+
+            start_reading.set_value();
+            flushed.get();
+            sink.close().get();
+            server_done.get();
+            BOOST_REQUIRE_EQUAL(received, 20);
+            c.stop().get();
+        });
+    });
+}
+
 SEASTAR_TEST_CASE(test_stream_negotiation_error) {
     rpc::server_options so;
     so.streaming_domain = rpc::streaming_domain_type(1);
@@ -1170,6 +1479,60 @@ SEASTAR_THREAD_TEST_CASE(test_lz4_fragmented_compressor) {
     test_compressor([] { return std::make_unique<rpc::lz4_fragmented_compressor>(); });
 }
 
+#ifdef SEASTAR_HAVE_ZSTD
+
+static std::shared_ptr<const rpc::zstd_dictionary> make_zstd_dictionary(sstring id) {
+    std::vector<temporary_buffer<char>> samples;
+    for (int i = 0; i < 1000; i++) {
+        auto sample = format("{{\"key\": \"partition-{}\", \"value\": \"The quick brown fox number {}\"}}", i, i * 7);
+        samples.emplace_back(sample.data(), sample.size());
+    }
+    auto data = rpc::zstd_dictionary::train(samples, 4096);
+    return std::make_shared<rpc::zstd_dictionary>(std::move(id), data, rpc::zstd_compressor::default_level);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_zstd_compressor) {
+    test_compressor([] { return std::make_unique<rpc::zstd_compressor>(); });
+}
+
+SEASTAR_THREAD_TEST_CASE(test_zstd_dictionary_compressor) {
+    auto dict = make_zstd_dictionary("test");
+    test_compressor([&] { return std::make_unique<rpc::zstd_compressor>(rpc::zstd_compressor::default_level, dict); });
+}
+
+SEASTAR_TEST_CASE(test_rpc_connect_zstd_dictionary) {
+    auto v1 = make_zstd_dictionary("v1");
+    auto v2 = make_zstd_dictionary("v2");
+    static rpc::zstd_compressor::factory plain;
+    static rpc::zstd_compressor::factory with_v1(v1);
+    static rpc::zstd_compressor::factory with_v2(v2);
+    // The server knows a newer dictionary the client lacks
+    static rpc::multi_algo_compressor_factory server({&with_v2, &with_v1, &plain});
+    static rpc::multi_algo_compressor_factory client({&with_v1, &plain});
+    BOOST_REQUIRE_EQUAL(server.negotiate(client.supported(), true)->name(), "ZSTD:v1");
+    BOOST_REQUIRE_EQUAL(client.negotiate("ZSTD:v1", false)->name(), "ZSTD:v1");
+
+    rpc::server_options so;
+    rpc::client_options co;
+    so.compressor_factory = &server;
+    co.compressor_factory = &client;
+    rpc_test_config cfg;
+    cfg.server_options = so;
+    return rpc_test_env<>::do_with_thread(cfg, co, [] (rpc_test_env<>& env, test_rpc_proto::client& c1) {
+        env.register_handler(1, [] (sstring s) {
+            return make_ready_future<sstring>(std::move(s));
+        }).get();
+        auto echo = env.proto().make_client<sstring (sstring)>(1);
+        auto payload = uninitialized_string(256 * 1024);
+        for (size_t i = 0; i < payload.size(); i++) {
+            payload[i] = "partition-"[i % 10];
+        }
+        BOOST_REQUIRE_EQUAL(echo(c1, payload).get0(), payload);
+    });
+}
+
+#endif
+
 // Test reproducing issue #671: If timeout is time_point::max(), translating
 // it to relative timeout in the sender and then back in the receiver, when
 // these calculations happen across a millisecond boundary, overflowed the
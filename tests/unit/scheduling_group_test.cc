@@ -33,6 +33,8 @@
 #include <seastar/core/scheduling_specific.hh>
 #include <seastar/core/smp.hh>
 #include <seastar/core/with_scheduling_group.hh>
+#include <seastar/core/with_deadline.hh>
+#include <seastar/core/when_all.hh>
 #include <seastar/core/reactor.hh>
 #include <seastar/util/later.hh>
 #include <seastar/util/defer.hh>
@@ -253,6 +255,100 @@ SEASTAR_THREAD_TEST_CASE(yield_preserves_sg) {
     }).get();
 }
 
+SEASTAR_THREAD_TEST_CASE(with_deadline_runs_earliest_deadline_first) {
+    std::vector<int> order;
+    auto now = sched_clock::now();
+    auto f_plain = yield().then([&] { order.push_back(0); });
+    auto f3 = with_deadline(now + 3ms, [&] { order.push_back(3); });
+    auto f1 = with_deadline(now + 1ms, [&] { order.push_back(1); });
+    auto f2 = with_deadline(now + 2ms, [&] { order.push_back(2); });
+    when_all_succeed(std::move(f_plain), std::move(f1), std::move(f2), std::move(f3)).discard_result().get();
+    BOOST_REQUIRE(order == (std::vector<int>{1, 2, 3, 0}));
+}
+
+SEASTAR_THREAD_TEST_CASE(sg_supergroups_divide_cpu_hierarchically) {
+    auto a = create_scheduling_supergroup(100).get0();
+    auto b = create_scheduling_supergroup(100).get0();
+    std::vector<scheduling_group> groups;
+    groups.push_back(create_scheduling_group("tenant_a", 100, a).get0());
+    for (int i = 0; i < 3; i++) {
+        groups.push_back(create_scheduling_group(format("tenant_b_{}", i), 100, b).get0());
+    }
+    BOOST_REQUIRE(groups[0].supergroup() == a);
+    BOOST_REQUIRE(groups[1].supergroup() == b);
+    BOOST_REQUIRE(default_scheduling_group().supergroup().is_top_level());
+    BOOST_REQUIRE_THROW(destroy_scheduling_supergroup(a).get(), std::runtime_error);
+
+    bool stop = false;
+    std::vector<uint64_t> loops(groups.size());
+    std::vector<future<>> busy;
+    for (size_t i = 0; i < groups.size(); i++) {
+        thread_attributes attr;
+        attr.sched_group = groups[i];
+        busy.push_back(seastar::async(attr, [&stop, &loops, i] {
+            while (!stop) {
+                auto end = sched_clock::now() + 10us;
+                while (sched_clock::now() < end) {
+                }
+                loops[i]++;
+                thread::maybe_yield();
+            }
+        }));
+    }
+    sleep(500ms).get();
+    stop = true;
+    when_all_succeed(busy.begin(), busy.end()).get();
+
+    // The tenants get the same CPU time, though b has three busy groups;
+    // flat, a would get a third of b's
+    auto ratio = double(loops[0]) / (loops[1] + loops[2] + loops[3]);
+    BOOST_TEST_MESSAGE(format("tenant a / tenant b CPU time: {:.2f}", ratio));
+    BOOST_REQUIRE_GT(ratio, 0.6);
+    BOOST_REQUIRE_LT(ratio, 1.6);
+
+    for (auto sg : groups) {
+        destroy_scheduling_group(sg).get();
+    }
+    destroy_scheduling_supergroup(a).get();
+    destroy_scheduling_supergroup(b).get();
+}
+
+SEASTAR_THREAD_TEST_CASE(sg_cpu_cap) {
+    auto sg = create_scheduling_group("capped", 1000).get0();
+    auto destroy = defer([sg] () noexcept {
+        destroy_scheduling_group(sg).get();
+    });
+    BOOST_REQUIRE(!sg.cpu_cap());
+    sg.set_cpu_cap(0.2);
+    BOOST_REQUIRE(sg.cpu_cap());
+    BOOST_REQUIRE_CLOSE(*sg.cpu_cap(), 0.2, 0.01);
+
+    // Nothing else wants the CPU, yet the group gets no more than its cap
+    bool stop = false;
+    sched_clock::duration busy_time{0};
+    thread_attributes attr;
+    attr.sched_group = sg;
+    auto busy = seastar::async(attr, [&] {
+        while (!stop) {
+            auto start = sched_clock::now();
+            while (sched_clock::now() < start + 10us) {
+            }
+            busy_time += sched_clock::now() - start;
+            thread::maybe_yield();
+        }
+    });
+    auto start = sched_clock::now();
+    sleep(500ms).get();
+    stop = true;
+    busy.get();
+    auto used = std::chrono::duration<double>(busy_time) / (sched_clock::now() - start);
+    BOOST_TEST_MESSAGE(format("capped group CPU use: {:.2f}", used));
+    BOOST_REQUIRE_GT(used, 0.1);
+    BOOST_REQUIRE_LT(used, 0.3);
+    sg.set_cpu_cap(std::nullopt);
+    BOOST_REQUIRE(!sg.cpu_cap());
+}
+
 SEASTAR_THREAD_TEST_CASE(sg_count) {
     class scheduling_group_destroyer {
         scheduling_group _sg;
@@ -32,6 +32,7 @@
 #include <seastar/core/sleep.hh>
 #include <seastar/core/shared_mutex.hh>
 #include <boost/range/irange.hpp>
+#include <numeric>
 
 using namespace seastar;
 using namespace std::chrono_literals;
@@ -431,3 +432,61 @@ SEASTAR_THREAD_TEST_CASE(test_semaphore_abort_before_wait) {
     BOOST_CHECK_THROW(fut1.get(), semaphore_aborted);
     BOOST_REQUIRE_EQUAL(x, 0);
 }
+
+SEASTAR_THREAD_TEST_CASE(test_semaphore_stats) {
+    auto sem = semaphore(1);
+    BOOST_REQUIRE(!sem.stats());
+    sem.enable_stats();
+    sem.wait().get();
+    auto f1 = sem.wait();
+    auto f2 = sem.wait();
+    BOOST_REQUIRE_EQUAL(sem.stats()->immediate, 1);
+    BOOST_REQUIRE_EQUAL(sem.stats()->waits, 2);
+    BOOST_REQUIRE_EQUAL(sem.stats()->max_queue_length, 2);
+    sleep(std::chrono::milliseconds(2)).get();
+    sem.signal(2);
+    f1.get();
+    f2.get();
+    BOOST_REQUIRE_EQUAL(sem.stats()->granted, 2);
+    BOOST_REQUIRE_GE(sem.stats()->total_wait_time, std::chrono::milliseconds(4));
+    auto& hist = sem.stats()->wait_time_histogram;
+    BOOST_REQUIRE_EQUAL(std::accumulate(hist.begin(), hist.end(), uint64_t(0)), 2);
+    // Two milliseconds or more are past the 2^11 microseconds bucket
+    BOOST_REQUIRE_EQUAL(std::accumulate(hist.begin(), hist.begin() + 11, uint64_t(0)), 0);
+}
+
+#ifdef SEASTAR_COROUTINES_ENABLED
+
+SEASTAR_TEST_CASE(test_semaphore_acquire) {
+    auto sem = semaphore(2);
+    co_await sem.acquire(2);
+    BOOST_REQUIRE_EQUAL(sem.available_units(), 0);
+
+    // Coroutine waiters are served in order with the others
+    std::vector<int> order;
+    auto waiter = [&] (int id, size_t nr) -> future<> {
+        co_await sem.acquire(nr);
+        order.push_back(id);
+    };
+    auto f1 = waiter(1, 1);
+    auto f2 = sem.wait(1).then([&] { order.push_back(2); });
+    auto f3 = waiter(3, 2);
+    BOOST_REQUIRE_EQUAL(sem.waiters(), 3);
+    sem.signal(1);
+    co_await std::move(f1);
+    sem.signal(2);
+    co_await std::move(f2);
+    // The third waits for two units
+    BOOST_REQUIRE(!f3.available());
+    sem.signal(1);
+    co_await std::move(f3);
+    BOOST_REQUIRE(order == std::vector<int>({1, 2, 3}));
+    BOOST_REQUIRE_EQUAL(sem.waiters(), 0);
+
+    auto f4 = waiter(4, 1);
+    sem.broken();
+    BOOST_REQUIRE_THROW(co_await std::move(f4), broken_semaphore);
+    BOOST_REQUIRE_THROW(co_await sem.acquire(), broken_semaphore);
+}
+
+#endif
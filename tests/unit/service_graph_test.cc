@@ -0,0 +1,139 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#include <seastar/testing/thread_test_case.hh>
+
+#include <seastar/core/service_graph.hh>
+#include <seastar/core/sleep.hh>
+#include <stdexcept>
+
+using namespace seastar;
+using namespace std::chrono_literals;
+
+namespace {
+
+struct counter_service {
+    int value;
+    explicit counter_service(int v) : value(v) {}
+    future<> stop() { return make_ready_future<>(); }
+};
+
+struct user_service {
+    int value;
+    explicit user_service(sharded<counter_service>& c) : value(c.local().value + 1) {}
+    future<> stop() { return make_ready_future<>(); }
+};
+
+}
+
+SEASTAR_THREAD_TEST_CASE(test_service_graph_order) {
+    std::vector<sstring> events;
+    unsigned running = 0;
+    unsigned max_running = 0;
+    service_graph g;
+    auto add = [&] (sstring name, std::vector<sstring> deps) {
+        g.add(name, std::move(deps), [&, name] {
+            events.push_back("start " + name);
+            max_running = std::max(max_running, ++running);
+            return sleep(10ms).then([&] {
+                running--;
+            });
+        }, [&, name] {
+            events.push_back("stop " + name);
+            return make_ready_future<>();
+        });
+    };
+    add("c", {"a", "b"});
+    add("a", {});
+    add("b", {});
+    g.start().get();
+
+    // a and b start together, c after them
+    BOOST_REQUIRE_EQUAL(max_running, 2u);
+    BOOST_REQUIRE_EQUAL(events.size(), 3u);
+    BOOST_REQUIRE_EQUAL(events.back(), "start c");
+    auto times = g.startup_times();
+    BOOST_REQUIRE_EQUAL(times.size(), 3u);
+    for (auto& [name, t] : times) {
+        BOOST_REQUIRE(t >= 10ms);
+    }
+
+    events.clear();
+    g.stop().get();
+    BOOST_REQUIRE_EQUAL(events.size(), 3u);
+    BOOST_REQUIRE_EQUAL(events.front(), "stop c");
+}
+
+SEASTAR_THREAD_TEST_CASE(test_service_graph_invalid) {
+    auto noop = [] { return make_ready_future<>(); };
+    {
+        service_graph g;
+        g.add("a", {"b"}, noop, noop);
+        g.add("b", {"a"}, noop, noop);
+        BOOST_REQUIRE_THROW(g.start().get(), std::invalid_argument);
+    }
+    {
+        service_graph g;
+        g.add("a", {"missing"}, noop, noop);
+        BOOST_REQUIRE_THROW(g.start().get(), std::invalid_argument);
+    }
+}
+
+SEASTAR_THREAD_TEST_CASE(test_service_graph_start_failure) {
+    std::vector<sstring> stopped;
+    bool dependent_started = false;
+    service_graph g;
+    g.add("a", {}, [] {
+        return make_ready_future<>();
+    }, [&] {
+        stopped.push_back("a");
+        return make_ready_future<>();
+    });
+    g.add("b", {}, [] {
+        return sleep(1ms).then([] {
+            return make_exception_future<>(std::runtime_error("b"));
+        });
+    }, [&] {
+        stopped.push_back("b");
+        return make_ready_future<>();
+    });
+    g.add("c", {"a", "b"}, [&] {
+        dependent_started = true;
+        return make_ready_future<>();
+    }, [&] {
+        stopped.push_back("c");
+        return make_ready_future<>();
+    });
+    BOOST_REQUIRE_THROW(g.start().get(), std::runtime_error);
+    BOOST_REQUIRE(!dependent_started);
+    BOOST_REQUIRE_EQUAL(stopped, std::vector<sstring>{"a"});
+}
+
+SEASTAR_THREAD_TEST_CASE(test_service_graph_sharded) {
+    sharded<counter_service> counter;
+    sharded<user_service> user;
+    service_graph g;
+    g.add_sharded("user", user, {"counter"}, std::ref(counter));
+    g.add_sharded("counter", counter, {}, 41);
+    g.start().get();
+    BOOST_REQUIRE_EQUAL(user.local().value, 42);
+    g.stop().get();
+}
@@ -0,0 +1,185 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+
+#include <seastar/testing/thread_test_case.hh>
+
+#include <seastar/core/sharded.hh>
+#include <seastar/core/sharded_cache.hh>
+#include <seastar/core/sleep.hh>
+#include <seastar/core/thread.hh>
+#include <stdexcept>
+
+using namespace seastar;
+using namespace std::chrono_literals;
+
+namespace {
+
+// Entries of 100 bytes, limit of n entries
+sharded_cache_options options_for(size_t n, cache_eviction eviction) {
+    sharded_cache_options opts;
+    opts.memory_limit = n * 100;
+    opts.eviction = eviction;
+    return opts;
+}
+
+size_t entry_size(const int&, const int&) {
+    return 100;
+}
+
+}
+
+SEASTAR_THREAD_TEST_CASE(test_sharded_cache_basic) {
+    for (auto eviction : {cache_eviction::clock, cache_eviction::w_tinylfu}) {
+        sharded_cache<int, int> c(options_for(100, eviction), entry_size);
+        BOOST_REQUIRE(!c.find(1));
+        c.insert(1, 10);
+        c.insert(2, 20);
+        BOOST_REQUIRE_EQUAL(c.find(1).value(), 10);
+        c.insert(1, 11);
+        BOOST_REQUIRE_EQUAL(c.find(1).value(), 11);
+        BOOST_REQUIRE_EQUAL(c.size(), 2u);
+        BOOST_REQUIRE_EQUAL(c.get_stats().bytes, 200u);
+        BOOST_REQUIRE(c.erase(2));
+        BOOST_REQUIRE(!c.erase(2));
+        BOOST_REQUIRE(!c.find(2));
+        BOOST_REQUIRE_EQUAL(c.get_stats().hits, 2u);
+        BOOST_REQUIRE_EQUAL(c.get_stats().misses, 2u);
+        c.clear();
+        BOOST_REQUIRE_EQUAL(c.size(), 0u);
+        BOOST_REQUIRE_EQUAL(c.get_stats().bytes, 0u);
+        c.stop().get();
+    }
+}
+
+SEASTAR_THREAD_TEST_CASE(test_sharded_cache_clock_eviction) {
+    sharded_cache<int, int> c(options_for(10, cache_eviction::clock), entry_size);
+    for (int i = 0; i < 10; i++) {
+        c.insert(i, i);
+    }
+    BOOST_REQUIRE(c.find(0));
+    // 0 was used since inserted, 1 was not
+    c.insert(10, 10);
+    BOOST_REQUIRE_EQUAL(c.size(), 10u);
+    BOOST_REQUIRE_EQUAL(c.get_stats().evictions, 1u);
+    BOOST_REQUIRE(c.find(0));
+    BOOST_REQUIRE(!c.find(1));
+
+    c.set_memory_limit(500);
+    BOOST_REQUIRE_EQUAL(c.size(), 5u);
+    BOOST_REQUIRE_EQUAL(c.get_stats().bytes, 500u);
+    c.stop().get();
+}
+
+SEASTAR_THREAD_TEST_CASE(test_sharded_cache_tinylfu_scan_resistance) {
+    sharded_cache<int, int> c(options_for(100, cache_eviction::w_tinylfu), entry_size);
+    for (int round = 0; round < 4; round++) {
+        for (int i = 0; i < 50; i++) {
+            if (!c.find(i)) {
+                c.insert(i, i);
+            }
+        }
+    }
+    // Keys used once do not push out the ones used often
+    for (int i = 1000; i < 11000; i++) {
+        if (!c.find(i)) {
+            c.insert(i, i);
+        }
+    }
+    BOOST_REQUIRE_LE(c.size(), 100u);
+    BOOST_REQUIRE_GT(c.get_stats().rejections, 0u);
+    unsigned hot = 0;
+    for (int i = 0; i < 50; i++) {
+        hot += bool(c.find(i));
+    }
+    BOOST_REQUIRE_GE(hot, 45u);
+    c.stop().get();
+}
+
+SEASTAR_THREAD_TEST_CASE(test_sharded_cache_coalesced_load) {
+    sharded_cache<int, int> c(options_for(100, cache_eviction::w_tinylfu), entry_size);
+    promise<int> p;
+    unsigned loads = 0;
+    auto load = [&] (const int&) {
+        loads++;
+        return p.get_future();
+    };
+    auto f1 = c.get_or_load(1, load);
+    auto f2 = c.get_or_load(1, load);
+    BOOST_REQUIRE_EQUAL(loads, 1u);
+    p.set_value(10);
+    BOOST_REQUIRE_EQUAL(f1.get(), 10);
+    BOOST_REQUIRE_EQUAL(f2.get(), 10);
+    BOOST_REQUIRE_EQUAL(c.find(1).value(), 10);
+    BOOST_REQUIRE_EQUAL(c.get_or_load(1, load).get(), 10);
+    BOOST_REQUIRE_EQUAL(loads, 1u);
+    BOOST_REQUIRE_EQUAL(c.get_stats().loads, 1u);
+    BOOST_REQUIRE_EQUAL(c.get_stats().coalesced, 1u);
+
+    // Failed loads are not cached
+    auto f3 = c.get_or_load(2, [] (const int&) {
+        return make_exception_future<int>(std::runtime_error("load"));
+    });
+    BOOST_REQUIRE_THROW(f3.get(), std::runtime_error);
+    // Lets the failed load be dropped
+    thread::yield();
+    BOOST_REQUIRE_EQUAL(c.get_or_load(2, [] (const int&) { return make_ready_future<int>(20); }).get(), 20);
+    c.stop().get();
+}
+
+SEASTAR_THREAD_TEST_CASE(test_sharded_cache_invalidated_load) {
+    sharded_cache<int, int> c(options_for(100, cache_eviction::clock), entry_size);
+    promise<int> p;
+    auto f = c.get_or_load(1, [&] (const int&) {
+        return p.get_future();
+    });
+    BOOST_REQUIRE(!c.erase(1));
+    p.set_value(10);
+    BOOST_REQUIRE_EQUAL(f.get(), 10);
+    // The value may be older than the erase
+    BOOST_REQUIRE(!c.find(1));
+    c.stop().get();
+}
+
+SEASTAR_THREAD_TEST_CASE(test_sharded_cache_ttl) {
+    auto opts = options_for(100, cache_eviction::w_tinylfu);
+    opts.ttl = 20ms;
+    sharded_cache<int, int> c(opts, entry_size);
+    c.insert(1, 10);
+    BOOST_REQUIRE(c.find(1));
+    sleep(100ms).get();
+    BOOST_REQUIRE(!c.find(1));
+    BOOST_REQUIRE_EQUAL(c.get_stats().expirations, 1u);
+    BOOST_REQUIRE_EQUAL(c.size(), 0u);
+    c.stop().get();
+}
+
+SEASTAR_THREAD_TEST_CASE(test_sharded_cache_sharded) {
+    sharded<sharded_cache<int, int>> c;
+    c.start(options_for(100, cache_eviction::w_tinylfu)).get();
+    c.invoke_on_all([] (sharded_cache<int, int>& c) {
+        c.insert(1, this_shard_id());
+    }).get();
+    c.invoke_on_all([] (sharded_cache<int, int>& c) {
+        BOOST_REQUIRE_EQUAL(c.find(1).value(), int(this_shard_id()));
+    }).get();
+    c.stop().get();
+}
@@ -27,6 +27,7 @@
 #include <unordered_map>
 #include <seastar/core/sstring.hh>
 #include <seastar/core/shared_ptr.hh>
+#include <seastar/core/intrusive_ref.hh>
 
 using namespace seastar;
 
@@ -202,3 +203,54 @@ BOOST_AUTO_TEST_CASE(test_const_release) {
     do_test_release<const A>();
     do_test_release<const A_esft>();
 }
+
+namespace {
+
+struct counted_deleter;
+
+struct counted : intrusive_ref_counted<counted, counted_deleter> {
+    static int deleted;
+    int value;
+    explicit counted(int v) : value(v) {}
+};
+
+int counted::deleted = 0;
+
+struct counted_deleter {
+    void operator()(counted* c) const noexcept {
+        counted::deleted++;
+        delete c;
+    }
+};
+
+}
+
+BOOST_AUTO_TEST_CASE(test_intrusive_ref) {
+    counted::deleted = 0;
+    {
+        auto p = make_intrusive_ref<counted>(42);
+        BOOST_REQUIRE_EQUAL(p.use_count(), 1);
+        BOOST_REQUIRE_EQUAL(p->value, 42);
+        {
+            auto q = p;
+            BOOST_REQUIRE_EQUAL(p.use_count(), 2);
+            BOOST_REQUIRE(q == p);
+            // A reference taken from the raw pointer shares the count
+            intrusive_ref<counted> r(q.get());
+            BOOST_REQUIRE_EQUAL(p.use_count(), 3);
+            intrusive_ref<const counted> c = std::move(r);
+            BOOST_REQUIRE(!r);
+            BOOST_REQUIRE_EQUAL(c->value, 42);
+            BOOST_REQUIRE_EQUAL(p.use_count(), 3);
+        }
+        BOOST_REQUIRE_EQUAL(p.use_count(), 1);
+        p = p;
+        BOOST_REQUIRE_EQUAL(counted::deleted, 0);
+        p = make_intrusive_ref<counted>(1);
+        BOOST_REQUIRE_EQUAL(counted::deleted, 1);
+        p = nullptr;
+        BOOST_REQUIRE(p == nullptr);
+    }
+    BOOST_REQUIRE_EQUAL(counted::deleted, 2);
+    static_assert(sizeof(intrusive_ref<counted>) == sizeof(void*));
+}
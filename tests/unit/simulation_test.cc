@@ -0,0 +1,154 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#include <seastar/testing/thread_test_case.hh>
+
+#include <seastar/testing/simulation.hh>
+#include <seastar/core/iostream.hh>
+#include <seastar/core/thread.hh>
+#include <seastar/core/when_all.hh>
+#include <stdexcept>
+#include <system_error>
+
+using namespace seastar;
+using namespace std::chrono_literals;
+
+static std::string as_string(temporary_buffer<char> buf) {
+    return std::string(buf.get(), buf.size());
+}
+
+SEASTAR_THREAD_TEST_CASE(test_simulation_transfer_time) {
+    // 10 ns a byte
+    testing::simulation sim(0, {.latency = 1ms, .bandwidth = 100'000'000});
+    auto [a, b] = sim.make_connection();
+    auto start = manual_clock::now();
+    manual_clock::time_point sent;
+    manual_clock::time_point received;
+    size_t total = 1'000'000;
+    sim.run(when_all_succeed(async([&] {
+        auto out = a.output();
+        out.write(sstring(total, 'x')).get();
+        out.close().get();
+        sent = manual_clock::now();
+    }), async([&] {
+        auto in = b.input();
+        size_t got = 0;
+        while (got < total) {
+            auto buf = in.read().get0();
+            BOOST_REQUIRE(!buf.empty());
+            got += buf.size();
+        }
+        received = manual_clock::now();
+        BOOST_REQUIRE(in.read().get0().empty());
+    })).discard_result()).get();
+    BOOST_REQUIRE(sent - start == 10ms);
+    BOOST_REQUIRE(received - start == 11ms);
+}
+
+// Ping-pong over links with jitter and a latency tail
+static manual_clock::duration ping_pong(uint64_t seed) {
+    testing::simulation sim(seed, {.latency = 100us, .jitter = 50us, .tail_probability = 0.05, .tail_latency = 5ms});
+    auto [a, b] = sim.make_connection();
+    auto start = manual_clock::now();
+    sim.run(when_all_succeed(async([&] {
+        auto out = a.output();
+        auto in = a.input();
+        for (int i = 0; i < 100; i++) {
+            out.write("ping").get();
+            out.flush().get();
+            BOOST_REQUIRE_EQUAL(as_string(in.read_exactly(4).get0()), "pong");
+        }
+        out.close().get();
+    }), async([&] {
+        auto out = b.output();
+        auto in = b.input();
+        while (!in.read_exactly(4).get0().empty()) {
+            out.write("pong").get();
+            out.flush().get();
+        }
+        out.close().get();
+    })).discard_result()).get();
+    return manual_clock::now() - start;
+}
+
+SEASTAR_THREAD_TEST_CASE(test_simulation_replay) {
+    auto t = ping_pong(42);
+    // At least 200 trips of 100us, some of them in the tail
+    BOOST_REQUIRE(t > 20ms + 5ms);
+    BOOST_REQUIRE(ping_pong(42) == t);
+    BOOST_REQUIRE(ping_pong(43) != t);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_simulation_connect) {
+    testing::simulation sim(0, {.latency = 1ms});
+    auto addr = socket_address(ipv4_addr("10.0.0.1", 80));
+    auto listener = sim.listen(addr);
+    auto start = manual_clock::now();
+    sim.run(when_all_succeed(async([&] {
+        auto ar = listener.accept().get0();
+        BOOST_REQUIRE(manual_clock::now() - start == 1ms);
+        auto in = ar.connection.input();
+        BOOST_REQUIRE_EQUAL(as_string(in.read_exactly(2).get0()), "hi");
+        BOOST_REQUIRE(manual_clock::now() - start == 3ms);
+    }), async([&] {
+        auto s = sim.connect(addr).get0();
+        BOOST_REQUIRE(manual_clock::now() - start == 2ms);
+        auto out = s.output();
+        out.write("hi").get();
+        out.close().get();
+    })).discard_result()).get();
+
+    BOOST_REQUIRE_THROW(sim.run(sim.connect(socket_address(ipv4_addr("10.0.0.2", 80))).discard_result()).get(), std::system_error);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_simulation_file) {
+    // 1 ns a byte
+    testing::simulation sim(0, {}, {.read = {.latency = 100us, .bandwidth = 1'000'000'000},
+                                    .write = {.latency = 1ms, .bandwidth = 1'000'000'000}});
+    auto f = sim.open_file("data");
+    auto wbuf = temporary_buffer<char>::aligned(f.memory_dma_alignment(), 4096);
+    std::fill_n(wbuf.get_write(), wbuf.size(), 'a');
+    auto start = manual_clock::now();
+    sim.run([&] {
+        // The second write waits for the first to be transferred
+        return when_all_succeed(f.dma_write(0, wbuf.get(), wbuf.size()), f.dma_write(4096, wbuf.get(), wbuf.size()));
+    }).get();
+    BOOST_REQUIRE(manual_clock::now() - start == 1ms + 8192ns);
+    BOOST_REQUIRE_EQUAL(f.size().get0(), 8192u);
+
+    // The same file, with what was written
+    auto g = sim.open_file("data");
+    start = manual_clock::now();
+    sim.run([&] {
+        return g.dma_read<char>(4096, 4096).then([] (temporary_buffer<char> buf) {
+            BOOST_REQUIRE_EQUAL(buf.size(), 4096u);
+            BOOST_REQUIRE(std::all_of(buf.begin(), buf.end(), [] (char c) { return c == 'a'; }));
+        });
+    }).get();
+    BOOST_REQUIRE(manual_clock::now() - start == 100us + 4096ns);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_simulation_stall) {
+    testing::simulation sim(0);
+    promise<> never;
+    BOOST_REQUIRE_THROW(sim.run(never.get_future()).get(), std::runtime_error);
+    never.set_value();
+}
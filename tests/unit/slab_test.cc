@@ -118,10 +118,80 @@ static void test_allocation_with_lru(const double growth_factor, const unsigned
     std::cout << __FUNCTION__ << " done!\n";
 }
 
+static void test_segmented_lru(const double growth_factor, const unsigned slab_limit_size) {
+    bi::list<item, bi::member_hook<item, bi::list_member_hook<>, &item::_cache_link>> _cache;
+    slab_allocator<item> slab(growth_factor, slab_limit_size, max_object_size,
+        [&](item& item_ref) { _cache.erase(_cache.iterator_to(item_ref)); });
+    size_t size = 4096;
+
+    // Items used again and again outlive those used once
+    std::vector<item*> used;
+    for (auto i = 0u; i < 16; i++) {
+        auto item = slab.create(size);
+        _cache.push_front(*item);
+        used.push_back(item);
+    }
+    auto per_slab_page = max_object_size / slab.class_size(size);
+    for (auto i = 0u; i < per_slab_page * (slab_limit_size / max_object_size) * 10; i++) {
+        auto item = slab.create(size);
+        assert(item != nullptr);
+        _cache.push_front(*item);
+        for (auto u : used) {
+            slab.touch(u);
+        }
+    }
+    for (auto u : used) {
+        assert(u->_cache_link.is_linked());
+    }
+    assert(slab.evictions() > 0);
+    assert(slab.items(slab_lru_segment::cold) > slab.items(slab_lru_segment::hot));
+
+    _cache.clear();
+
+    std::cout << __FUNCTION__ << " done!\n";
+}
+
+static void test_rebalance(const double growth_factor, const unsigned slab_limit_size) {
+    bi::list<item, bi::member_hook<item, bi::list_member_hook<>, &item::_cache_link>> _cache;
+    unsigned evictions = 0;
+    slab_allocator<item> slab(growth_factor, slab_limit_size, max_object_size,
+        [&](item& item_ref) { _cache.erase(_cache.iterator_to(item_ref)); evictions++; });
+    size_t small = 1024;
+    size_t large = 64 * 1024;
+
+    // All pages go to small items, then large items evict each other
+    auto small_per_page = max_object_size / slab.class_size(small);
+    for (auto i = 0u; i < small_per_page * (slab_limit_size / max_object_size); i++) {
+        _cache.push_front(*slab.create(small));
+    }
+    auto large_per_page = max_object_size / slab.class_size(large);
+    for (auto i = 0u; i < large_per_page * 2; i++) {
+        _cache.push_front(*slab.create(large));
+    }
+    assert(evictions == large_per_page);
+
+    assert(slab.rebalance());
+    assert(slab.page_moves() == 1);
+    assert(evictions == large_per_page + small_per_page);
+    // A page more for large items
+    for (auto i = 0u; i < large_per_page; i++) {
+        _cache.push_front(*slab.create(large));
+    }
+    assert(evictions == large_per_page + small_per_page);
+    // Nothing was evicted since
+    assert(!slab.rebalance());
+
+    _cache.clear();
+
+    std::cout << __FUNCTION__ << " done!\n";
+}
+
 int main(int ac, char** av) {
     test_allocation_1(1.25, 5*1024*1024);
     test_allocation_2(1.07, 5*1024*1024); // 1.07 is the growth factor used by facebook.
     test_allocation_with_lru(1.25, 5*1024*1024);
+    test_segmented_lru(1.25, 5*1024*1024);
+    test_rebalance(1.25, 5*1024*1024);
 
     return 0;
 }
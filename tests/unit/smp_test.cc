@@ -23,6 +23,9 @@
 #include <seastar/core/smp.hh>
 #include <seastar/core/app-template.hh>
 #include <seastar/core/print.hh>
+#include <seastar/core/with_scheduling_group.hh>
+#include <seastar/core/shard_channel.hh>
+#include <seastar/core/sharded.hh>
 
 using namespace seastar;
 
@@ -58,6 +61,72 @@ future<bool> test_smp_exception() {
     });
 }
 
+future<bool> test_smp_stealable() {
+    return create_scheduling_group("stealable", 100).then([] (scheduling_group sg) {
+        return smp::invoke_on_all([sg] () mutable {
+            sg.set_migratable(true);
+        }).then([sg] {
+            return with_scheduling_group(sg, [] {
+                return smp::submit_stealable([] {
+                    return current_scheduling_group().name() == "stealable" ? 3 : 0;
+                });
+            });
+        }).then([sg] (int ret) {
+            return destroy_scheduling_group(sg).then([ret] {
+                return make_ready_future<bool>(ret == 3);
+            });
+        });
+    });
+}
+
+future<bool> test_smp_traffic_stats() {
+    return smp::submit_to(1, [] {}).then([] {
+        return smp::get_traffic_stats();
+    }).then([] (std::vector<smp_traffic_stats> stats) {
+        auto it = std::find_if(stats.begin(), stats.end(), [] (const smp_traffic_stats& s) {
+            return s.from == 0 && s.to == 1;
+        });
+        return make_ready_future<bool>(stats.size() == smp::count * (smp::count - 1) && it != stats.end() && it->messages > 0);
+    });
+}
+
+future<bool> test_smp_channel() {
+    // Shard 1 streams foreign pointers to shard 0 through a channel smaller
+    // than the stream, so that it waits for credits
+    using channel = shard_channel<foreign_ptr<std::unique_ptr<int>>>;
+    static constexpr int n = 1000;
+    auto ch = std::make_unique<channel>(64, 8);
+    auto producer = smp::submit_to(1, [tx = ch->make_sender()] () mutable {
+        return do_with(std::move(tx), 0, [] (channel::sender& tx, int& i) {
+            return repeat([&tx, &i] {
+                if (i == n) {
+                    return make_ready_future<stop_iteration>(stop_iteration::yes);
+                }
+                return tx.push(make_foreign(std::make_unique<int>(i++))).then([] {
+                    return stop_iteration::no;
+                });
+            }).then([&tx] {
+                return tx.close();
+            });
+        });
+    });
+    return do_with(std::move(ch), std::move(producer), 0, true, [] (std::unique_ptr<channel>& ch, future<>& producer, int& next, bool& ok) {
+        return repeat([&ch, &next, &ok] {
+            return ch->pop().then([&next, &ok] (std::optional<foreign_ptr<std::unique_ptr<int>>> item) {
+                if (!item) {
+                    return stop_iteration::yes;
+                }
+                ok &= (**item == next++ && item->get_owner_shard() == 1);
+                return stop_iteration::no;
+            });
+        }).then([&producer, &next, &ok] {
+            return std::move(producer).then([&next, &ok] {
+                return ok && next == n;
+            });
+        });
+    });
+}
+
 int tests, fails;
 
 future<>
@@ -73,6 +142,12 @@ int main(int ac, char** av) {
     return app_template().run_deprecated(ac, av, [] {
        return report("smp call", test_smp_call()).then([] {
            return report("smp exception", test_smp_exception());
+       }).then([] {
+           return report("smp stealable", test_smp_stealable());
+       }).then([] {
+           return report("smp traffic stats", test_smp_traffic_stats());
+       }).then([] {
+           return report("smp channel", test_smp_channel());
        }).then([] {
            fmt::print("\n{:d} tests / {:d} failures\n", tests, fails);
            engine().exit(fails ? 1 : 0);
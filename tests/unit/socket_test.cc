@@ -29,6 +29,9 @@
 #include <seastar/core/abort_source.hh>
 #include <seastar/core/sleep.hh>
 #include <seastar/core/thread.hh>
+#include <seastar/core/file.hh>
+#include <seastar/core/aligned_buffer.hh>
+#include <seastar/util/tmp_file.hh>
 
 #include <seastar/net/posix-stack.hh>
 
@@ -106,9 +109,175 @@ SEASTAR_TEST_CASE(socket_skip_test) {
     });
 }
 
+SEASTAR_TEST_CASE(socket_write_file_test) {
+    return tmp_dir::do_with_thread([] (tmp_dir& t) {
+        constexpr size_t file_size = 16 * 1024;
+        auto f = open_file_dma((t.get_path() / "testfile.tmp").native(), open_flags::rw | open_flags::create).get0();
+        auto wbuf = allocate_aligned_buffer<char>(file_size, 4096);
+        for (size_t i = 0; i < file_size; i++) {
+            wbuf.get()[i] = 'a' + i % 26;
+        }
+        f.dma_write(0, wbuf.get(), file_size).get();
+
+        listen_options lo;
+        lo.reuse_address = true;
+        server_socket ss = seastar::listen(ipv4_addr("127.0.0.1", 1235), lo);
+
+        auto client = async([&f, &wbuf] {
+            connected_socket socket = connect(ipv4_addr("127.0.0.1", 1235)).get();
+            auto out = socket.output();
+            out.write("head").get();
+            out.write_file(f, 100, 10000).get();
+            // reading past the end of the file stops there
+            out.write_file(f, file_size - 10, 100).get();
+            out.write("tail").get();
+            out.close().get();
+        });
+
+        accept_result accepted = ss.accept().get();
+        input_stream<char> input = accepted.connection.input();
+        sstring received;
+        while (auto buf = input.read().get0()) {
+            received += sstring(buf.get(), buf.size());
+        }
+        client.get();
+        f.close().get();
+
+        auto expected = "head" + sstring(wbuf.get() + 100, 10000) + sstring(wbuf.get() + file_size - 10, 10) + "tail";
+        BOOST_REQUIRE_EQUAL(received, expected);
+    });
+}
+
+SEASTAR_TEST_CASE(udp_batch_test) {
+    return seastar::async([] {
+        auto sc = make_udp_channel(ipv4_addr("127.0.0.1", 0));
+        auto cc = make_udp_channel(ipv4_addr("127.0.0.1", 0));
+
+        std::vector<net::packet> packets;
+        for (int i = 0; i < 10; i++) {
+            auto msg = format("datagram {}", i);
+            packets.emplace_back(msg.data(), msg.size());
+        }
+        cc.send(sc.local_address(), std::move(packets)).get();
+
+        int received = 0;
+        while (received < 10) {
+            auto dgrams = sc.receive_batch(4).get0();
+            BOOST_REQUIRE(!dgrams.empty());
+            BOOST_REQUIRE_LE(dgrams.size(), 4);
+            for (auto& d : dgrams) {
+                BOOST_REQUIRE_EQUAL(d.get_src(), cc.local_address());
+                auto& p = d.get_data();
+                p.linearize();
+                auto& f = p.frag(0);
+                BOOST_REQUIRE_EQUAL(sstring(f.base, f.size), format("datagram {}", received));
+                received++;
+            }
+        }
+        cc.close();
+        sc.close();
+    });
+}
+
 SEASTAR_TEST_CASE(test_file_desc_fdinfo) {
     auto fd = file_desc::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
     auto info = fd.fdinfo();
     BOOST_REQUIRE_EQUAL(info.substr(0, 8), "socket:[");
     return make_ready_future<>();
 }
+
+SEASTAR_TEST_CASE(socket_stats_test) {
+    return seastar::async([] {
+        listen_options lo;
+        lo.reuse_address = true;
+        server_socket ss = seastar::listen(ipv4_addr("127.0.0.1", 1236), lo);
+        auto client = connect(ipv4_addr("127.0.0.1", 1236));
+        accept_result accepted = ss.accept().get();
+        connected_socket socket = client.get0();
+
+        auto out = socket.output();
+        out.write(sstring(100000, 'x')).get();
+        out.flush().get();
+        auto in = accepted.connection.input();
+        size_t received = 0;
+        while (received < 100000) {
+            received += in.read().get0().size();
+        }
+
+        auto stats = socket.get_stats();
+        BOOST_REQUIRE_GT(stats.mss, 0);
+        BOOST_REQUIRE_GE(stats.cwnd, stats.mss);
+        BOOST_REQUIRE_GT(stats.rto.count(), 0);
+        out.close().get();
+    });
+}
+
+SEASTAR_TEST_CASE(socket_abortable_read_test) {
+    return seastar::async([] {
+        listen_options lo;
+        lo.reuse_address = true;
+        server_socket ss = seastar::listen(ipv4_addr("127.0.0.1", 1238), lo);
+        abort_source as;
+        auto client = connect(ipv4_addr("127.0.0.1", 1238), {}, transport::TCP, as);
+        accept_result accepted = ss.accept().get();
+        connected_socket socket = client.get0();
+        auto out = socket.output();
+        auto in = accepted.connection.input();
+
+        out.write("abc").get();
+        out.flush().get();
+        auto buf = in.read(as).get0();
+        BOOST_REQUIRE_EQUAL(sstring(buf.get(), buf.size()), "abc");
+
+        // Nothing more is sent; the abort cancels the pending read
+        auto f = in.read(as);
+        sleep(std::chrono::milliseconds(10)).get();
+        BOOST_REQUIRE(!f.available());
+        as.request_abort();
+        BOOST_REQUIRE_THROW(f.get(), abort_requested_exception);
+        BOOST_REQUIRE_THROW(in.read(as).get(), abort_requested_exception);
+        BOOST_REQUIRE_THROW(connect(ipv4_addr("127.0.0.1", 1238), {}, transport::TCP, as).get(), abort_requested_exception);
+        in.close().get();
+        out.close().get();
+    });
+}
+
+SEASTAR_TEST_CASE(socket_load_balancing_test) {
+    return seastar::async([] {
+        auto load = smp::load_of(this_shard_id());
+        BOOST_REQUIRE_GE(load.utilization, 0);
+        BOOST_REQUIRE_LE(load.utilization, 1);
+
+        for (auto lba : {server_socket::load_balancing_algorithm::load_aware, server_socket::load_balancing_algorithm::incoming_cpu,
+                server_socket::load_balancing_algorithm::napi_id}) {
+            listen_options lo;
+            lo.reuse_address = true;
+            lo.lba = lba;
+            // Not permitted without CAP_NET_ADMIN above net.core.busy_read,
+            // which leaves the connections as they are
+            lo.busy_poll = std::chrono::microseconds(50);
+            server_socket ss = seastar::listen(ipv4_addr("127.0.0.1", 1237), lo);
+            auto client = connect(ipv4_addr("127.0.0.1", 1237));
+            // With more shards the connection may go to one which doesn't
+            // listen in this test
+            if (smp::count == 1) {
+                accept_result accepted = ss.accept().get();
+                BOOST_REQUIRE(accepted.connection);
+            }
+            client.get0().shutdown_output();
+        }
+    });
+}
+
+SEASTAR_TEST_CASE(unix_socket_stats_test) {
+    return tmp_dir::do_with_thread([] (tmp_dir& t) {
+        socket_address addr(unix_domain_addr((t.get_path() / "sock").native()));
+        server_socket ss = seastar::listen(addr);
+        auto client = connect(addr);
+        accept_result accepted = ss.accept().get();
+        connected_socket socket = client.get0();
+        BOOST_REQUIRE_EXCEPTION(socket.get_stats(), std::system_error, [] (const std::system_error& e) {
+            return e.code().value() == ENOTSUP;
+        });
+    });
+}
@@ -23,6 +23,7 @@
 
 #include <boost/test/included/unit_test.hpp>
 #include <seastar/core/sstring.hh>
+#include <seastar/util/ascii.hh>
 #include <list>
 
 using namespace seastar;
@@ -214,3 +215,25 @@ BOOST_AUTO_TEST_CASE(test_nul_termination) {
         BOOST_REQUIRE(!strncmp(s1.c_str(), s2.c_str(), std::min(s1.size(), s2.size())));
     }
 }
+
+BOOST_AUTO_TEST_CASE(test_ascii_case_insensitive) {
+    // Long enough for the 16 and 8 byte blocks, and a tail
+    sstring a = "Content-Type-And-Then-Some-X";
+    sstring b = "cONTENT-tYPE-aND-tHEN-sOME-x";
+    BOOST_REQUIRE(ascii_iequals(a, b));
+    BOOST_REQUIRE_EQUAL(ascii_ihash(a), ascii_ihash(b));
+    BOOST_REQUIRE(!ascii_iequals(a, "Content-Type-And-Then-Some-Y"));
+    BOOST_REQUIRE(!ascii_iequals(a, "Content-Type"));
+    // Only ASCII letters change case: '@' and '`', '[' and '{' differ by 0x20
+    BOOST_REQUIRE(!ascii_iequals("@[", "`{"));
+    BOOST_REQUIRE(!ascii_iequals("\xc1", "\xe1"));
+    BOOST_REQUIRE(ascii_iequals("", ""));
+    BOOST_REQUIRE_NE(ascii_ihash("a"), ascii_ihash(std::string_view("a\0", 2)));
+
+    sstring s = "GET /index.html?a=b&c=d HTTP/1.1";
+    for (std::string_view chars : {"?", "?&", "&=#", "xyz", " /?&=#.:"}) {
+        for (size_t pos = 0; pos <= s.size() + 1; pos++) {
+            BOOST_REQUIRE_EQUAL(ascii_find_first_of(s, chars, pos), std::string_view(s).find_first_of(chars, pos));
+        }
+    }
+}
@@ -22,12 +22,16 @@
 #include <seastar/core/reactor.hh>
 #include <seastar/core/thread_cputime_clock.hh>
 #include <seastar/core/loop.hh>
+#include <seastar/core/stall_profile.hh>
 #include <seastar/util/later.hh>
 #include <seastar/testing/test_case.hh>
 #include <seastar/testing/thread_test_case.hh>
 #include <../../src/core/stall_detector.hh>
+#include <seastar/util/defer.hh>
 #include <atomic>
 #include <chrono>
+#include <sstream>
+#include <vector>
 
 using namespace seastar;
 using namespace std::chrono_literals;
@@ -106,3 +110,52 @@ SEASTAR_THREAD_TEST_CASE(no_poll_no_stall) {
     f.get();
     BOOST_REQUIRE_EQUAL(reports, 0);
 }
+
+SEASTAR_THREAD_TEST_CASE(stall_profile_aggregates_samples) {
+    std::atomic<unsigned> reports{};
+    temporary_stall_detector_settings tsds(10ms, [&] { ++reports; });
+    engine().set_stall_profiling(true, 1ms);
+    auto disable = defer([] () noexcept { engine().set_stall_profiling(false); });
+    engine().get_stall_profile(true);
+    spin_some_cooperatively(1ms); // need to yield so that stall detector change from above take effect
+    for (unsigned i = 0; i < 3; ++i) {
+        spin(100ms);
+        spin_some_cooperatively(10ms);
+    }
+
+    auto profile = engine().get_stall_profile(true);
+    BOOST_REQUIRE_EQUAL(profile.shard, this_shard_id());
+    BOOST_REQUIRE(!profile.stacks.empty());
+    uint64_t samples = 0;
+    for (auto& stack : profile.stacks) {
+        BOOST_REQUIRE(!stack.frames.empty());
+        samples += stack.samples;
+    }
+    // About 85 samples per stall, after the first 13ms
+    BOOST_REQUIRE_GE(samples + profile.dropped_samples, 150);
+
+    std::ostringstream os;
+    write_folded(os, profile);
+    std::istringstream is(os.str());
+    std::string line;
+    size_t lines = 0;
+    while (std::getline(is, line)) {
+        BOOST_REQUIRE(line.starts_with(fmt::format("shard {};", this_shard_id())));
+        auto count = line.substr(line.rfind(' ') + 1);
+        BOOST_REQUIRE_EQUAL(count, fmt::format("{}", profile.stacks[lines].samples));
+        ++lines;
+    }
+    BOOST_REQUIRE_EQUAL(lines, profile.stacks.size());
+
+    BOOST_REQUIRE(engine().get_stall_profile().stacks.empty());
+}
+
+SEASTAR_THREAD_TEST_CASE(preemptible_loop_no_stall) {
+    std::atomic<unsigned> reports{};
+    temporary_stall_detector_settings tsds(10ms, [&] { ++reports; });
+    std::vector<int> v(100000);
+    preemptible_for_each(v, [] (int) {
+        spin(2us);
+    }, {.name = "fast_loop"}).get();
+    BOOST_REQUIRE_EQUAL(reports, 0);
+}
@@ -109,3 +109,44 @@ SEASTAR_TEST_CASE(test_skip_all) {
         BOOST_REQUIRE(to_sstring(empty_inp.read().get0()).empty());
     });
 }
+
+SEASTAR_TEST_CASE(test_read_exactly_fragmented) {
+    return async([] {
+        input_stream<char> inp(data_source(std::make_unique<test_source_impl>(5, 16)));
+        auto first = inp.read_exactly(2).get0();
+        BOOST_REQUIRE_EQUAL(to_sstring(std::move(first)), "ab");
+        auto frags = inp.read_exactly_fragmented(10).get0();
+        BOOST_REQUIRE_EQUAL(frags.size(), 3);
+        BOOST_REQUIRE_EQUAL(frags[0].size(), 3);
+        BOOST_REQUIRE_EQUAL(frags[1].size(), 5);
+        BOOST_REQUIRE_EQUAL(frags[2].size(), 2);
+        sstring s;
+        for (auto&& buf : frags) {
+            s += to_sstring(std::move(buf));
+        }
+        BOOST_REQUIRE_EQUAL(s, "cdefghijkl");
+        frags = inp.read_exactly_fragmented(10).get0();
+        s = "";
+        for (auto&& buf : frags) {
+            s += to_sstring(std::move(buf));
+        }
+        BOOST_REQUIRE_EQUAL(s, "mnop");
+        BOOST_REQUIRE(inp.eof());
+        BOOST_REQUIRE(inp.read_exactly_fragmented(10).get0().empty());
+    });
+}
+
+SEASTAR_TEST_CASE(test_read_exactly_into) {
+    return async([] {
+        input_stream<char> inp(data_source(std::make_unique<test_source_impl>(5, 16)));
+        char buf[16];
+        BOOST_REQUIRE_EQUAL(inp.read_exactly_into(buf, 3).get0(), 3);
+        BOOST_REQUIRE_EQUAL(std::string(buf, 3), "abc");
+        BOOST_REQUIRE_EQUAL(inp.read_exactly_into(buf, 9).get0(), 9);
+        BOOST_REQUIRE_EQUAL(std::string(buf, 9), "defghijkl");
+        BOOST_REQUIRE_EQUAL(inp.read_exactly_into(buf, 16).get0(), 4);
+        BOOST_REQUIRE_EQUAL(std::string(buf, 4), "mnop");
+        BOOST_REQUIRE(inp.eof());
+        BOOST_REQUIRE_EQUAL(inp.read_exactly_into(buf, 16).get0(), 0);
+    });
+}
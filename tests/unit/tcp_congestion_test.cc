@@ -0,0 +1,126 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#define BOOST_TEST_MODULE tcp_congestion
+
+#include <boost/test/included/unit_test.hpp>
+#include <seastar/net/tcp-congestion.hh>
+#include <stdexcept>
+
+using namespace seastar::net;
+using namespace std::chrono_literals;
+
+namespace {
+
+constexpr uint32_t mss = 1460;
+
+struct connection {
+    uint32_t cwnd = 10 * mss;
+    uint32_t ssthresh;
+    std::unique_ptr<congestion_controller> cc;
+    congestion_sample::clock_type::time_point now = congestion_sample::clock_type::now();
+
+    connection(std::string_view name, uint32_t ssthresh_ = 1 << 30) : ssthresh(ssthresh_), cc(make_congestion_controller(name)) {}
+
+    // Acknowledges a window worth of data, one ACK per two segments, as
+    // a link of the given rate and round trip time would
+    void round_trip(std::chrono::microseconds rtt, uint64_t rate) {
+        auto w = window();
+        auto acks = std::max(cwnd / (2 * mss), 1u);
+        for (unsigned i = 0; i < acks; i++) {
+            now += rtt / acks;
+            congestion_sample s;
+            s.now = now;
+            s.acked_bytes = 2 * mss;
+            s.flight_size = cwnd;
+            s.rtt = rtt;
+            s.srtt = rtt;
+            s.delivery_rate = rate;
+            cc->on_ack(w, s);
+        }
+    }
+    void loss() {
+        auto w = window();
+        ssthresh = cc->on_loss(w, cwnd, now);
+        cwnd = ssthresh;
+    }
+    congestion_window window() {
+        return congestion_window{cwnd, ssthresh, mss};
+    }
+};
+
+}
+
+BOOST_AUTO_TEST_CASE(test_unknown_algorithm) {
+    BOOST_REQUIRE_EQUAL(make_congestion_controller({})->name(), std::string("reno"));
+    BOOST_REQUIRE_EQUAL(make_congestion_controller("cubic")->name(), std::string("cubic"));
+    BOOST_REQUIRE_THROW(make_congestion_controller("vegas"), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(test_reno_halves_on_loss) {
+    connection c("reno");
+    auto before = c.cwnd;
+    c.round_trip(10ms, 0);
+    // Slow start doubles the window every round trip
+    BOOST_REQUIRE_EQUAL(c.cwnd, 2 * before);
+    c.loss();
+    BOOST_REQUIRE_EQUAL(c.cwnd, before);
+    c.round_trip(10ms, 0);
+    // Congestion avoidance adds about a segment
+    BOOST_REQUIRE_GE(c.cwnd, before + mss * 3 / 4);
+    BOOST_REQUIRE_LE(c.cwnd, before + 2 * mss);
+}
+
+BOOST_AUTO_TEST_CASE(test_cubic_recovers_faster_than_reno) {
+    connection reno("reno", 0);
+    connection cubic("cubic", 0);
+    reno.cwnd = cubic.cwnd = 1000 * mss;
+    reno.loss();
+    cubic.loss();
+    // CUBIC backs off less
+    BOOST_REQUIRE_GT(cubic.cwnd, reno.cwnd);
+    for (int i = 0; i < 200; i++) {
+        reno.round_trip(50ms, 0);
+        cubic.round_trip(50ms, 0);
+    }
+    // and returns to the window it lost at in fewer round trips
+    BOOST_REQUIRE_GE(cubic.cwnd, 1000 * mss);
+    BOOST_REQUIRE_LT(reno.cwnd, 1000 * mss);
+}
+
+BOOST_AUTO_TEST_CASE(test_bbr_follows_bottleneck) {
+    connection c("bbr");
+    constexpr uint64_t rate = 125'000'000; // 1Gbit/s
+    constexpr auto rtt = 20ms;
+    constexpr auto bdp = rate * 20 / 1000;
+    for (int i = 0; i < 50; i++) {
+        c.round_trip(rtt, rate);
+    }
+    // Paced at about the bottleneck rate, with cwnd about twice the BDP
+    BOOST_REQUIRE_GE(c.cc->pacing_rate(), rate * 3 / 4);
+    BOOST_REQUIRE_LE(c.cc->pacing_rate(), rate * 5 / 4);
+    BOOST_REQUIRE_GE(c.cwnd, bdp);
+    BOOST_REQUIRE_LE(c.cwnd, 3 * bdp);
+    // Loss bounds the data in flight
+    auto before = c.cwnd;
+    c.loss();
+    BOOST_REQUIRE_LT(c.cwnd, before);
+}
@@ -166,6 +166,24 @@ SEASTAR_TEST_CASE(test_thread_custom_stack_size) {
     });
 }
 
+SEASTAR_THREAD_TEST_CASE(test_thread_stack_pool) {
+    thread_attributes attr;
+    attr.stack_size = 48 << 10;
+    async(attr, [] {}).get();
+    auto before = get_thread_stack_pool_stats();
+    BOOST_REQUIRE_GE(before.cached_bytes, attr.stack_size);
+    async(attr, [] {}).get();
+    auto after = get_thread_stack_pool_stats();
+    BOOST_REQUIRE_EQUAL(after.hits, before.hits + 1);
+    BOOST_REQUIRE_EQUAL(after.releases, before.releases + 1);
+
+    set_thread_stack_pool_capacity(0);
+    BOOST_REQUIRE_EQUAL(get_thread_stack_pool_stats().cached_bytes, 0);
+    async(attr, [] {}).get();
+    BOOST_REQUIRE_EQUAL(get_thread_stack_pool_stats().drops, after.drops + 1);
+    set_thread_stack_pool_capacity(4 << 20);
+}
+
 // The test case uses x86_64 specific signal handler info. The test
 // fails with detect_stack_use_after_return=1. We could put it behind
 // a command line option and fork/exec to run it after removing
@@ -0,0 +1,147 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#define BOOST_TEST_MODULE core
+
+#include <boost/test/included/unit_test.hpp>
+#include <seastar/core/timer-wheel.hh>
+#include <chrono>
+#include <map>
+#include <random>
+#include <vector>
+
+using namespace seastar;
+using namespace std::chrono_literals;
+
+struct test_clock {
+    using duration = std::chrono::microseconds;
+    using time_point = std::chrono::time_point<test_clock, duration>;
+    static time_point now() noexcept { return time_point(); }
+};
+
+struct test_timer {
+    using clock = test_clock;
+    using duration = clock::duration;
+    using time_point = clock::time_point;
+
+    boost::intrusive::list_member_hook<> link;
+    time_point expiry;
+    bool armed = false;
+
+    time_point get_timeout() const noexcept { return expiry; }
+    bool cancel() noexcept;
+};
+
+using test_wheel = timer_wheel<test_timer, &test_timer::link>;
+
+static test_wheel* current_wheel;
+
+bool test_timer::cancel() noexcept {
+    if (!armed) {
+        return false;
+    }
+    current_wheel->remove(*this);
+    armed = false;
+    return true;
+}
+
+// Arms, cancels and expires timers at random, over spans from below a tick
+// to past the reach of the wheel, and checks that each expire() returns
+// exactly the timers that are due, and that get_next_timeout() never lets
+// one be late.
+BOOST_AUTO_TEST_CASE(test_timer_wheel_random) {
+    std::default_random_engine rnd(std::random_device{}());
+    test_wheel wheel(1ms);
+    current_wheel = &wheel;
+    std::vector<test_timer> timers(1000);
+    std::multimap<test_clock::time_point, test_timer*> armed;
+    test_clock::time_point now;
+    const std::vector<test_clock::duration> spans = {100us, 10ms, 1s, 1h, 24h * 1000 * 1000};
+
+    for (int iteration = 0; iteration < 20000; iteration++) {
+        auto& t = timers[rnd() % timers.size()];
+        if (t.armed) {
+            auto range = armed.equal_range(t.expiry);
+            for (auto i = range.first; i != range.second; ++i) {
+                if (i->second == &t) {
+                    armed.erase(i);
+                    break;
+                }
+            }
+            t.cancel();
+        } else {
+            auto span = spans[rnd() % spans.size()];
+            t.expiry = now + test_clock::duration(rnd() % span.count());
+            t.armed = true;
+            wheel.insert(t);
+            armed.emplace(t.expiry, &t);
+        }
+        BOOST_REQUIRE_EQUAL(wheel.size(), armed.size());
+
+        if (rnd() % 8 == 0) {
+            auto next = wheel.get_next_timeout();
+            BOOST_REQUIRE(armed.empty() || next <= armed.begin()->first);
+            // Either up to the next timeout, or some way past it
+            now = std::max(now, rnd() % 2 ? next : now + test_clock::duration(rnd() % spans[rnd() % 3].count()));
+            auto exp = wheel.expire(now);
+            auto last = armed.upper_bound(now);
+            size_t n = 0;
+            for (auto& e : exp) {
+                BOOST_REQUIRE(e.expiry <= now);
+                e.armed = false;
+                n++;
+            }
+            BOOST_REQUIRE_EQUAL(n, size_t(std::distance(armed.begin(), last)));
+            armed.erase(armed.begin(), last);
+            exp.clear();
+        }
+    }
+
+    // Far timers come out of the overflow list, on time
+    while (!armed.empty()) {
+        now = wheel.get_next_timeout();
+        BOOST_REQUIRE(now <= armed.begin()->first);
+        auto exp = wheel.expire(now);
+        for (auto& e : exp) {
+            e.armed = false;
+        }
+        auto last = armed.upper_bound(now);
+        BOOST_REQUIRE_EQUAL(exp.size(), size_t(std::distance(armed.begin(), last)));
+        armed.erase(armed.begin(), last);
+        exp.clear();
+    }
+    BOOST_REQUIRE(wheel.empty());
+}
+
+BOOST_AUTO_TEST_CASE(test_timer_wheel_past) {
+    test_wheel wheel(1ms);
+    current_wheel = &wheel;
+    wheel.expire(test_clock::time_point(10s));
+    test_timer t;
+    t.expiry = test_clock::time_point(5s);
+    t.armed = true;
+    BOOST_REQUIRE(wheel.insert(t));
+    BOOST_REQUIRE(wheel.get_next_timeout() == test_clock::time_point(10s));
+    auto exp = wheel.expire(test_clock::time_point(10s));
+    BOOST_REQUIRE_EQUAL(exp.size(), 1u);
+    exp.clear();
+    BOOST_REQUIRE(wheel.empty());
+}
@@ -34,6 +34,7 @@
 #include <seastar/core/iostream.hh>
 #include <seastar/core/with_timeout.hh>
 #include <seastar/util/std-compat.hh>
+#include <seastar/util/defer.hh>
 #include <seastar/net/tls.hh>
 #include <seastar/net/dns.hh>
 #include <seastar/net/inet_address.hh>
@@ -418,7 +419,8 @@ static future<> run_echo_test(sstring message,
                 sstring client_key = {},
                 bool do_read = true,
                 bool use_dh_params = true,
-                tls::dn_callback distinguished_name_callback = {}
+                tls::dn_callback distinguished_name_callback = {},
+                bool handshake_offload = false
 )
 {
     static const auto port = 4711;
@@ -430,6 +432,8 @@ static future<> run_echo_test(sstring message,
 
     assert(do_read || loops == 1);
 
+    certs->set_handshake_offload(handshake_offload);
+
     future<> f = make_ready_future();
 
     if (!client_crt.empty() && !client_key.empty()) {
@@ -511,6 +515,31 @@ SEASTAR_TEST_CASE(test_simple_x509_client_server_again) {
     return run_echo_test(message, 20, certfile("catest.pem"), "test.scylladb.org");
 }
 
+SEASTAR_TEST_CASE(test_simple_x509_client_server_handshake_offload) {
+    return run_echo_test(message, 20, certfile("catest.pem"), "test.scylladb.org",
+        certfile("test.crt"), certfile("test.key"), tls::client_auth::NONE,
+        {}, {}, true, true, {}, /* handshake_offload */ true
+    );
+}
+
+SEASTAR_TEST_CASE(test_x509_client_server_cert_validation_fail_handshake_offload) {
+    // The peer is verified after an offloaded handshake
+    return run_echo_test(message, 1, certfile("tls-ca-bundle.pem"), {},
+        certfile("test.crt"), certfile("test.key"), tls::client_auth::NONE,
+        {}, {}, true, true, {}, /* handshake_offload */ true
+    ).then([] {
+            BOOST_FAIL("Should have gotten validation error");
+    }).handle_exception([](auto ep) {
+        try {
+            std::rethrow_exception(ep);
+        } catch (tls::verification_error&) {
+            // ok.
+        } catch (...) {
+            BOOST_FAIL("Unexpected exception");
+        }
+    });
+}
+
 #if GNUTLS_VERSION_NUMBER >= 0x030600
 // Test #769 - do not set dh_params in server certs - let gnutls negotiate.
 SEASTAR_TEST_CASE(test_simple_server_default_dhparams) {
@@ -1219,3 +1248,35 @@ SEASTAR_THREAD_TEST_CASE(test_dn_name_handling) {
     fetch_dn("client1.org", client1_creds);
     fetch_dn("client2.org", client2_creds);
 }
+
+SEASTAR_THREAD_TEST_CASE(test_session_cache) {
+    sharded<tls::session_cache> cache;
+    cache.start(2, std::chrono::seconds(60)).get();
+    auto stop = defer([&cache] () noexcept { cache.stop().get(); });
+
+    auto& local = cache.local();
+    BOOST_REQUIRE(!local.lookup("id1").get());
+
+    // Stores and lookups from one shard reach the owner in order
+    local.store("id1", "data1");
+    local.store("id2", "data2");
+    BOOST_REQUIRE_EQUAL(*local.lookup("id1").get(), "data1");
+    BOOST_REQUIRE_EQUAL(*local.lookup("id2").get(), "data2");
+
+    local.store("id1", "data3");
+    BOOST_REQUIRE_EQUAL(*local.lookup("id1").get(), "data3");
+
+    local.remove("id2");
+    BOOST_REQUIRE(!local.lookup("id2").get());
+
+    auto total = cache.map_reduce0([] (tls::session_cache& c) { return c.size(); }, size_t(0), std::plus<size_t>()).get();
+    BOOST_REQUIRE_EQUAL(total, 1u);
+
+    // Each shard keeps at most two sessions
+    for (int i = 0; i < 10 * int(smp::count); i++) {
+        local.store(format("many{}", i), "data");
+    }
+    cache.invoke_on_all([] (tls::session_cache& c) {
+        BOOST_REQUIRE_LE(c.size(), 2u);
+    }).get();
+}
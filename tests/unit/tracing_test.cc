@@ -0,0 +1,105 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2023 ScyllaDB
+ */
+
+#include <seastar/core/tracing.hh>
+#include <seastar/core/smp.hh>
+#include <seastar/core/sleep.hh>
+#include <seastar/core/thread.hh>
+#include <seastar/testing/test_case.hh>
+#include <seastar/testing/thread_test_case.hh>
+#include <seastar/util/defer.hh>
+#include <fmt/format.h>
+
+using namespace seastar;
+using namespace std::chrono_literals;
+
+static void enable_tracing() {
+    tracing::configure({.sampling_rate = 1}).get();
+}
+
+static void disable_tracing() {
+    tracing::configure({}).get();
+    tracing::export_otlp_json().discard_result().get();
+}
+
+SEASTAR_THREAD_TEST_CASE(test_serialize_round_trip) {
+    tracing::trace_context ctx{0x0102030405060708, 0x1112131415161718, 0x2122232425262728, 1};
+    char buf[tracing::trace_context::serialized_size];
+    ctx.serialize(buf);
+    auto back = tracing::trace_context::deserialize(buf);
+    BOOST_REQUIRE_EQUAL(back.trace_id_high, ctx.trace_id_high);
+    BOOST_REQUIRE_EQUAL(back.trace_id_low, ctx.trace_id_low);
+    BOOST_REQUIRE_EQUAL(back.span_id, ctx.span_id);
+    BOOST_REQUIRE(back.sampled());
+
+    tracing::trace_context().serialize(buf);
+    BOOST_REQUIRE(!tracing::trace_context::deserialize(buf).valid());
+}
+
+SEASTAR_THREAD_TEST_CASE(test_unsampled_spans_do_not_record) {
+    tracing::span s("unsampled");
+    BOOST_REQUIRE(!s.recording());
+    BOOST_REQUIRE(!tracing::current_context().valid());
+}
+
+SEASTAR_THREAD_TEST_CASE(test_context_follows_continuations) {
+    enable_tracing();
+    auto reset = defer([] () noexcept { disable_tracing(); });
+
+    tracing::span root("root");
+    BOOST_REQUIRE(root.recording());
+    auto trace_id = root.context().trace_id_low;
+    tracing::trace_context inner;
+    tracing::trace_context after_sleep;
+    root.activate([&] {
+        return tracing::with_span("child", [&] {
+            inner = tracing::current_context();
+            return sleep(1ms).then([&] {
+                after_sleep = tracing::current_context();
+            });
+        });
+    }).get();
+    BOOST_REQUIRE_EQUAL(inner.trace_id_low, trace_id);
+    BOOST_REQUIRE_NE(inner.span_id, root.context().span_id);
+    BOOST_REQUIRE_EQUAL(after_sleep.span_id, inner.span_id);
+    // The thread runs outside of the span
+    BOOST_REQUIRE(!tracing::current_context().valid());
+    root.end();
+
+    auto json = tracing::export_otlp_json().get();
+    BOOST_REQUIRE_NE(json.find(fmt::format("{:016x}", trace_id)), sstring::npos);
+    BOOST_REQUIRE_NE(json.find("\"child\""), sstring::npos);
+    BOOST_REQUIRE_NE(json.find("\"root\""), sstring::npos);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_context_follows_submit_to) {
+    enable_tracing();
+    auto reset = defer([] () noexcept { disable_tracing(); });
+
+    tracing::span root("root");
+    auto remote = root.activate([] {
+        return smp::submit_to((this_shard_id() + 1) % smp::count, [] {
+            return tracing::current_context();
+        });
+    }).get();
+    BOOST_REQUIRE_EQUAL(remote.trace_id_low, root.context().trace_id_low);
+    BOOST_REQUIRE_EQUAL(remote.span_id, root.context().span_id);
+}
@@ -20,6 +20,7 @@
  */ 
 
 #include <seastar/testing/test_case.hh>
+#include <seastar/testing/thread_test_case.hh>
 #include <seastar/core/seastar.hh>
 #include <seastar/net/api.hh>
 #include <seastar/net/inet_address.hh>
@@ -230,3 +231,73 @@ SEASTAR_TEST_CASE(unixdomain_abort) {
     });
 }
 
+
+SEASTAR_THREAD_TEST_CASE(unixdomain_seqpacket_fds) {
+    socket_address addr{unix_domain_addr{std::string("\0seqpacket", 10)}};
+    listen_options lo;
+    lo.proto = transport::SEQPACKET;
+    auto server = seastar::listen(addr, lo);
+    auto accepted = server.accept();
+    auto client = seastar::connect(addr, {}, transport::SEQPACKET).get();
+    auto conn = accepted.get().connection;
+
+    // Messages keep their boundaries
+    client.send_message(temporary_buffer<char>("first", 5)).get();
+    client.send_message(temporary_buffer<char>("second", 6)).get();
+    auto m = conn.receive_message().get();
+    BOOST_REQUIRE_EQUAL(sstring(m.data.get(), m.data.size()), "first");
+    BOOST_REQUIRE(m.fds.empty());
+    m = conn.receive_message().get();
+    BOOST_REQUIRE_EQUAL(sstring(m.data.get(), m.data.size()), "second");
+
+    // A pipe's write end, passed to the peer, writes to the same pipe
+    int p[2];
+    BOOST_REQUIRE_EQUAL(::pipe(p), 0);
+    auto read_end = file_desc::from_fd(p[0]);
+    std::vector<file_desc> fds;
+    fds.push_back(file_desc::from_fd(p[1]));
+    client.send_message(temporary_buffer<char>("pipe", 4), std::move(fds)).get();
+    m = conn.receive_message().get();
+    BOOST_REQUIRE_EQUAL(sstring(m.data.get(), m.data.size()), "pipe");
+    BOOST_REQUIRE_EQUAL(m.fds.size(), 1u);
+    BOOST_REQUIRE_EQUAL(m.fds[0].write("x", 1).value_or(0), 1u);
+    char c = 0;
+    BOOST_REQUIRE_EQUAL(read_end.read(&c, 1).value_or(0), 1u);
+    BOOST_REQUIRE_EQUAL(c, 'x');
+
+    // A message longer than the buffer
+    client.send_message(temporary_buffer<char>("too long", 8)).get();
+    BOOST_REQUIRE_THROW(conn.receive_message(4).get(), std::system_error);
+}
+
+//  a connection handed over an AF_UNIX socket keeps working
+SEASTAR_THREAD_TEST_CASE(unixdomain_connection_handoff) {
+    listen_options lo;
+    lo.reuse_address = true;
+    auto tcp_server = seastar::listen(make_ipv4_address({0x7f000001, 0}), lo);
+    auto tcp_client = seastar::connect(tcp_server.local_address()).get();
+    auto tcp_conn = tcp_server.accept().get().connection;
+
+    socket_address addr{unix_domain_addr{std::string("\0handoff", 8)}};
+    auto server = seastar::listen(addr);
+    auto accepted = server.accept();
+    auto from = seastar::connect(addr).get();
+    auto to = accepted.get().connection;
+
+    std::vector<file_desc> fds;
+    fds.push_back(tcp_conn.dup_fd());
+    from.send_message(temporary_buffer<char>("c", 1), std::move(fds)).get();
+    tcp_conn = {};
+    auto m = to.receive_message().get();
+    BOOST_REQUIRE_EQUAL(m.fds.size(), 1u);
+    auto adopted = make_connected_socket(std::move(m.fds[0]));
+
+    auto out = tcp_client.output();
+    out.write("hello").get();
+    out.flush().get();
+    auto in = adopted.input();
+    auto buf = in.read().get();
+    BOOST_REQUIRE_EQUAL(sstring(buf.get(), buf.size()), "hello");
+    out.close().get();
+    in.close().get();
+}
@@ -8,6 +8,7 @@
 #include <seastar/http/response_parser.hh>
 #include <seastar/util/defer.hh>
 #include "loopback_socket.hh"
+#include <zlib.h>
 
 using namespace seastar;
 using namespace seastar::experimental;
@@ -154,3 +155,136 @@ SEASTAR_TEST_CASE(test_websocket_handler_registration) {
         BOOST_REQUIRE_EQUAL(rs_frame, response_str);
     });
 }
+
+static std::string mask_frame(char first_byte, std::string_view payload) {
+    // Payloads of up to 125 bytes, masked with "TEST"
+    std::string frame{first_byte, char(0x80 | payload.size())};
+    frame += "TEST";
+    for (size_t i = 0; i < payload.size(); i++) {
+        frame += char(payload[i] ^ "TEST"[i % 4]);
+    }
+    return frame;
+}
+
+SEASTAR_TEST_CASE(test_websocket_permessage_deflate) {
+    return seastar::async([] {
+        loopback_connection_factory factory;
+        loopback_socket_impl lsi(factory);
+
+        auto acceptor = factory.get_server_socket().accept();
+        auto connector = lsi.connect(socket_address(), socket_address());
+        connected_socket sock = connector.get0();
+        auto input = sock.input();
+        auto output = sock.output();
+
+        websocket::server ws;
+        ws.set_permessage_deflate(true);
+        ws.register_handler("echo", [] (input_stream<char>& in, output_stream<char>& out) {
+            return repeat([&in, &out]() {
+                return in.read().then([&out](temporary_buffer<char> f) {
+                    if (f.empty()) {
+                        return make_ready_future<stop_iteration>(stop_iteration::yes);
+                    }
+                    return out.write(std::move(f)).then([&out]() {
+                        return out.flush().then([] {
+                            return stop_iteration::no;
+                        });
+                    });
+                });
+            });
+        });
+        websocket::connection conn(ws, acceptor.get0().connection);
+        future<> serve = conn.process();
+
+        auto close = defer([&conn, &input, &output, &serve] () noexcept {
+            conn.shutdown();
+            conn.close().get();
+            input.close().get();
+            output.close().get();
+            serve.get();
+        });
+
+        const std::string request =
+                "GET / HTTP/1.1\r\n"
+                "Upgrade: websocket\r\n"
+                "Connection: Upgrade\r\n"
+                "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+                "Sec-WebSocket-Version: 13\r\n"
+                "Sec-WebSocket-Protocol: echo\r\n"
+                "Sec-WebSocket-Extensions: permessage-deflate; server_max_window_bits=8, "
+                        "permessage-deflate; client_max_window_bits\r\n"
+                "\r\n";
+        output.write(request).get();
+        output.flush().get();
+        http_response_parser parser;
+        parser.init();
+        input.consume(parser).get();
+        std::unique_ptr<http_response> resp = parser.get_parsed_response();
+        BOOST_REQUIRE(resp);
+        // The first offer asks for a window zlib cannot do
+        BOOST_REQUIRE_NE(resp->_headers["Sec-WebSocket-Extensions"].find("permessage-deflate"), sstring::npos);
+        BOOST_REQUIRE_EQUAL(resp->_headers["Sec-WebSocket-Extensions"].find("server_max_window_bits"), sstring::npos);
+
+        std::string text;
+        for (int i = 0; i < 1000; i++) {
+            text += std::to_string(i * i) + " ";
+        }
+
+        // A compressed message in two frames: a text frame with RSV1 and a
+        // continuation, with the empty block's tail left out
+        z_stream deflater = {};
+        BOOST_REQUIRE_EQUAL(deflateInit2(&deflater, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY), Z_OK);
+        std::string compressed(deflateBound(&deflater, text.size()) + 16, '\0');
+        deflater.next_in = reinterpret_cast<Bytef*>(text.data());
+        deflater.avail_in = text.size();
+        deflater.next_out = reinterpret_cast<Bytef*>(compressed.data());
+        deflater.avail_out = compressed.size();
+        BOOST_REQUIRE_EQUAL(deflate(&deflater, Z_SYNC_FLUSH), Z_OK);
+        compressed.resize(compressed.size() - deflater.avail_out - 4);
+        deflateEnd(&deflater);
+        std::string_view payload(compressed);
+        std::string frames;
+        while (!payload.empty()) {
+            auto part = payload.substr(0, 100);
+            payload.remove_prefix(part.size());
+            char first = frames.empty() ? char(0x40 | websocket::opcodes::TEXT) : char(websocket::opcodes::CONTINUATION);
+            if (payload.empty()) {
+                first |= 0x80;
+            }
+            frames += mask_frame(first, part);
+        }
+        // Split mid-frame, so that some of the payload comes in parts
+        output.write(frames.substr(0, 37)).get();
+        output.flush().get();
+        output.write(frames.substr(37)).get();
+        output.flush().get();
+
+        // Echoed back as compressed messages, using the context of those
+        // before them
+        z_stream inflater = {};
+        BOOST_REQUIRE_EQUAL(inflateInit2(&inflater, -15), Z_OK);
+        std::string echoed;
+        while (echoed.size() < text.size()) {
+            auto header = input.read_exactly(2).get0();
+            BOOST_REQUIRE_EQUAL(uint8_t(header[0]), 0x80 | 0x40 | websocket::opcodes::BINARY);
+            size_t length = header[1];
+            if (length == 126) {
+                auto ext = input.read_exactly(2).get0();
+                length = (uint8_t(ext[0]) << 8) | uint8_t(ext[1]);
+            }
+            BOOST_REQUIRE_LT(length, 126 * 256);
+            auto body = input.read_exactly(length).get0();
+            std::string in(body.get(), body.size());
+            in += std::string("\0\0\xff\xff", 4);
+            std::string out(text.size(), '\0');
+            inflater.next_in = reinterpret_cast<Bytef*>(in.data());
+            inflater.avail_in = in.size();
+            inflater.next_out = reinterpret_cast<Bytef*>(out.data());
+            inflater.avail_out = out.size();
+            BOOST_REQUIRE_EQUAL(inflate(&inflater, Z_SYNC_FLUSH), Z_OK);
+            echoed.append(out.data(), out.size() - inflater.avail_out);
+        }
+        inflateEnd(&inflater);
+        BOOST_REQUIRE_EQUAL(echoed, text);
+    });
+}